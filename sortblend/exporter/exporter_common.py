@@ -1,4 +1,8 @@
 import os
+import struct
+import mmap
+import platform
+import numpy as np
 import mathutils
 import bpy
 from .. import utility
@@ -10,6 +14,18 @@ def getCamera(scene):
         return
     return camera
 
+# get the rendered region of the image as x, y, w, h with y going down, it is the whole image without border rendering
+def getRenderRegion(scene):
+    xres = int(scene.render.resolution_x * scene.render.resolution_percentage / 100)
+    yres = int(scene.render.resolution_y * scene.render.resolution_percentage / 100)
+    if not scene.render.use_border:
+        return 0, 0, xres, yres
+    left = int(scene.render.border_min_x * xres)
+    right = int(scene.render.border_max_x * xres)
+    top = yres - int(scene.render.border_max_y * yres)
+    bottom = yres - int(scene.render.border_min_y * yres)
+    return left, top, max(1, right - left), max(1, bottom - top)
+
 # get camera data
 def lookAt(camera):
     # it seems that the matrix return here is the inverse of view matrix.
@@ -78,4 +94,122 @@ def is_renderable(scene, ob):
 
 # list all objects in the scene
 def renderable_objects(scene):
-    return [ob for ob in scene.objects if is_renderable(scene, ob)]
\ No newline at end of file
+    return [ob for ob in scene.objects if is_renderable(scene, ob)]
+# write an element tree in the binary format of SORT, it is loaded without parsing text
+# the layout is the magic 'SBXM', the version, the string table and the elements in pre-order
+def write_binary_xml(root, filename):
+    strings = {}
+    def string_id(s):
+        if s not in strings:
+            strings[s] = len(strings)
+        return strings[s]
+    elements = bytearray()
+    def write_element(element):
+        elements.extend(struct.pack('<II', string_id(element.tag), len(element.attrib)))
+        for name, value in element.attrib.items():
+            elements.extend(struct.pack('<II', string_id(name), string_id(value)))
+        children = list(element)
+        elements.extend(struct.pack('<I', len(children)))
+        for child in children:
+            write_element(child)
+    write_element(root)
+    with open(filename, 'wb') as file:
+        file.write(b'SBXM')
+        file.write(struct.pack('<II', 1, len(strings)))
+        for s in sorted(strings, key=strings.get):
+            data = s.encode('utf-8')
+            file.write(struct.pack('<I', len(data)))
+            file.write(data)
+        file.write(elements)
+
+# the arrays of a mesh for the mesh transfer , every corner of the polygons is a vertex of its own so that the split
+# normals and the uvs are kept , the vertexes are in world space so that SORT reads the arrays in place
+def mesh_transfer_arrays(obj, matrix):
+    mesh = obj.data
+    mesh.calc_normals_split()
+    loop_cnt = len(mesh.loops)
+    poly_cnt = len(mesh.polygons)
+
+    vertex_index = np.empty(loop_cnt, dtype=np.uint32)
+    mesh.loops.foreach_get('vertex_index', vertex_index)
+    co = np.empty(len(mesh.vertices) * 3, dtype=np.float32)
+    mesh.vertices.foreach_get('co', co)
+    normals = np.empty(loop_cnt * 3, dtype=np.float32)
+    mesh.loops.foreach_get('normal', normals)
+    uvs = None
+    if len(mesh.uv_layers) > 0:
+        uvs = np.empty(loop_cnt * 2, dtype=np.float32)
+        mesh.uv_layers.active.data.foreach_get('uv', uvs)
+
+    # positions are transformed by the matrix , normals by its inverse transpose
+    m = np.array(matrix, dtype=np.float64)
+    positions = np.dot(co.reshape(-1, 3)[vertex_index], m[:3, :3].T) + m[:3, 3]
+    normals = np.dot(normals.reshape(-1, 3), np.linalg.inv(m[:3, :3]))
+    lengths = np.linalg.norm(normals, axis=1)
+    normals /= np.where(lengths > 0.0, lengths, 1.0)[:, None]
+
+    # polygons are split into fans of triangles , the triangles are sorted by their materials
+    loop_start = np.empty(poly_cnt, dtype=np.uint32)
+    loop_total = np.empty(poly_cnt, dtype=np.uint32)
+    material_index = np.empty(poly_cnt, dtype=np.uint32)
+    mesh.polygons.foreach_get('loop_start', loop_start)
+    mesh.polygons.foreach_get('loop_total', loop_total)
+    mesh.polygons.foreach_get('material_index', material_index)
+    fan = np.maximum(loop_total.astype(np.int64) - 2, 0)
+    poly = np.repeat(np.arange(poly_cnt), fan)
+    corner = np.arange(len(poly)) - np.repeat(np.cumsum(fan) - fan, fan) + 1
+    start = loop_start[poly].astype(np.int64)
+    indices = np.stack([start, start + corner, start + corner + 1], axis=1)
+
+    slot_cnt = max(len(mesh.materials), 1)
+    tri_material = np.minimum(material_index[poly], slot_cnt - 1)
+    order = np.argsort(tri_material, kind='stable')
+    counts = np.bincount(tri_material, minlength=slot_cnt)
+    names = [m.name if m else '' for m in mesh.materials] or ['']
+    trunks = [(names[i], int(counts[i])) for i in range(slot_cnt) if counts[i] > 0]
+
+    return (positions.astype(np.float32), normals.astype(np.float32), uvs, indices[order].astype(np.uint32), trunks)
+
+# keep the transfer region alive until the next export , SORT maps it while rendering
+transfer_memory = None
+transfer_serial = 0
+
+# write the mesh transfer , the region SORT maps the meshes from without parsing them , the name of the region is returned
+# the layout is the header 'SXFR' , the version , the mesh count and the size , then the table of meshes and the arrays
+# aligned to 16 bytes , see src/managers/meshio/meshtransfer.h
+def write_mesh_transfer(meshes, filename):
+    global transfer_memory, transfer_serial
+    blobs = bytearray()
+    table_size = 24 + 64 * len(meshes)
+    def add_blob(data):
+        if data is None:
+            return 0
+        blobs.extend(bytes((-(table_size + len(blobs))) % 16))
+        offset = table_size + len(blobs)
+        blobs.extend(data)
+        return offset
+    def add_name(name):
+        return add_blob(name.encode('utf-8') + b'\0') if name else 0
+
+    table = bytearray()
+    for name, positions, normals, uvs, indices, trunks in meshes:
+        trunk_data = bytearray()
+        for material, count in trunks:
+            trunk_data.extend(struct.pack('<QII', add_name(material), count, 0))
+        table.extend(struct.pack('<QQQQQQIIII', add_name(name), add_blob(positions.tobytes()), add_blob(normals.tobytes() if normals is not None else None),
+                                 add_blob(uvs.tobytes() if uvs is not None else None), add_blob(indices.tobytes()),
+                                 add_blob(bytes(trunk_data)), len(positions), len(indices), len(trunks), 0))
+    size = table_size + len(blobs)
+    data = struct.pack('<4sIIIQ', b'SXFR', 1, len(meshes), 0, size) + bytes(table) + bytes(blobs)
+
+    # windows has no file behind the shared memory , every export takes a new name while SORT could still map the last one
+    transfer_memory = None
+    if platform.system() == "Windows":
+        transfer_serial += 1
+        tagname = 'SORTBLEND_SCENEMEM_%d' % transfer_serial
+        transfer_memory = mmap.mmap(-1, size, tagname)
+        transfer_memory.write(data)
+        return tagname
+    with open(filename, 'wb') as file:
+        file.write(data)
+    return 'blender_intermediate/' + os.path.basename(filename)
@@ -19,7 +19,7 @@ def export_blender(scene, force_debug=False):
     # export scene
     export_scene(scene, force_debug)
     # export material
-    export_material( force_debug )
+    export_material( scene, force_debug )
 
 # clear old data and create new path
 def create_path(scene, force_debug):
@@ -47,22 +47,56 @@ def export_sort_file(scene, force_debug):
     ET.SubElement( integrator_node , "Property" , name="inte_max_recur_depth" , value="%d"%scene.inte_max_recur_depth )
     if integrator_type == "ao":
         ET.SubElement( integrator_node , "Property" , name="max_distance" , value="%f"%scene.ao_max_dist)
+        ET.SubElement( integrator_node , "Property" , name="ao_samples" , value="%d"%scene.ao_samples)
+    if integrator_type == "pt":
+        ET.SubElement( integrator_node , "Property" , name="pt_guiding" , value="%d"%scene.pt_guiding)
+        ET.SubElement( integrator_node , "Property" , name="pt_adrrs" , value="%d"%scene.pt_adrrs)
+        ET.SubElement( integrator_node , "Property" , name="pt_spectral" , value=scene.pt_spectral)
+        ET.SubElement( integrator_node , "Property" , name="pt_shadow_roulette" , value="%f"%scene.pt_shadow_roulette)
+    if integrator_type == "direct":
+        ET.SubElement( integrator_node , "Property" , name="direct_adaptive" , value="%d"%scene.direct_adaptive)
+        ET.SubElement( integrator_node , "Property" , name="shadow_rays" , value="%d"%scene.shadow_rays)
+        ET.SubElement( integrator_node , "Property" , name="direct_restir" , value="%d"%scene.direct_restir)
+        ET.SubElement( integrator_node , "Property" , name="restir_candidates" , value="%d"%scene.restir_candidates)
+        ET.SubElement( integrator_node , "Property" , name="restir_neighbors" , value="%d"%scene.restir_neighbors)
+    if integrator_type == "lt":
+        ET.SubElement( integrator_node , "Property" , name="lt_paths" , value="%d"%scene.lt_paths)
     if integrator_type == "bdpt":
         ET.SubElement( integrator_node , "Property" , name="bdpt_mis" , value="%d"%scene.bdpt_mis)
+        ET.SubElement( integrator_node , "Property" , name="bdpt_lvc" , value="%d"%scene.bdpt_lvc)
     if integrator_type == 'ir':
         ET.SubElement( integrator_node , "Property" , name="light_path_set_num" , value='%d'%scene.ir_light_path_set_num)
         ET.SubElement( integrator_node , "Property" , name="light_path_num" , value='%d'%scene.ir_light_path_num)
         ET.SubElement( integrator_node , "Property" , name="min_distance" , value='%f'%scene.ir_min_dist)
+        ET.SubElement( integrator_node , "Property" , name="lightcut_error" , value='%f'%scene.ir_lightcut_error)
+    if integrator_type == 'ic':
+        ET.SubElement( integrator_node , "Property" , name="ic_error" , value='%f'%scene.ic_error)
+        ET.SubElement( integrator_node , "Property" , name="ic_samples" , value='%d'%scene.ic_samples)
+        ET.SubElement( integrator_node , "Property" , name="ic_spacing" , value='%d'%scene.ic_spacing)
     # image size
     xres = scene.render.resolution_x * scene.render.resolution_percentage / 100
     yres = scene.render.resolution_y * scene.render.resolution_percentage / 100
     ET.SubElement(root, 'RenderTargetSize', w='%d'%xres, h='%d'%yres )
+    # border rendering only renders the tiles in the border
+    if scene.render.use_border:
+        x, y, w, h = exporter_common.getRenderRegion(scene)
+        ET.SubElement(root, 'RenderRegion', x='%d'%x, y='%d'%y, w='%d'%w, h='%d'%h )
     # output file name
     ET.SubElement(root, 'OutputFile', name='blender_intermediate/blender_generated.bmp')
     # sampler type
     sampler_type = scene.sampler_type_prop
     sampler_count = scene.sampler_count_prop
-    ET.SubElement(root, 'Sampler', type=sampler_type, round='%s'%sampler_count)
+    sampler_node = ET.SubElement(root, 'Sampler', type=sampler_type, round='%s'%sampler_count)
+    if scene.blue_noise_prop:
+        sampler_node.set('bluenoise', 'true')
+    if scene.deterministic_prop:
+        ET.SubElement(root, 'Deterministic')
+    # pixel filter
+    if scene.filter_type_prop != 'box' or scene.filter_radius_prop > 0.0:
+        ET.SubElement(root, 'Filter', type=scene.filter_type_prop, radius='%f'%scene.filter_radius_prop)
+    # denoiser
+    if scene.denoise_prop:
+        ET.SubElement(root, 'Denoiser', type='auto')
     # camera node
     camera = exporter_common.getCamera(scene)
     pos, target, up = exporter_common.lookAt(camera)
@@ -107,15 +141,31 @@ def export_scene(scene, force_debug):
     ET.SubElement( root , 'Resource', path="./blender_intermediate/res/")
     # acceleration structure
     accelerator_type = scene.accelerator_type_prop
-    ET.SubElement( root , 'Accel', type=accelerator_type)
+    accelerator_cache = '1' if scene.accelerator_cache_prop else '0'
+    ET.SubElement( root , 'Accel', type=accelerator_type, cache=accelerator_cache)
     all_nodes = exporter_common.renderable_objects(scene)
+    # the arrays of the meshes are written to the mesh transfer instead of obj files , SORT maps them without parsing
+    transfer_meshes = []
     for ob in all_nodes:
         if ob.type == 'MESH':
-            model_node = ET.SubElement( root , 'Model' , filename=ob.name + '.obj', name = ob.name )
-            transform_node = ET.SubElement( model_node , 'Transform' )
-            ET.SubElement( transform_node , 'Matrix' , value = 'm '+ utility.matrixtostr( utility.getGlobalMatrix() * ob.matrix_world) )
-            # output the mesh to file
-            export_mesh(ob,scene, force_debug)
+            world_matrix = utility.getGlobalMatrix() * ob.matrix_world
+            if scene.mesh_transfer_prop:
+                model_node = ET.SubElement( root , 'Model' , filename='mem:transfer/' + ob.name, name = ob.name )
+                transfer_meshes.append( (ob.name,) + exporter_common.mesh_transfer_arrays(ob, world_matrix) )
+            else:
+                model_node = ET.SubElement( root , 'Model' , filename=ob.name + '.obj', name = ob.name )
+                transform_node = ET.SubElement( model_node , 'Transform' )
+                ET.SubElement( transform_node , 'Matrix' , value = 'm '+ utility.matrixtostr( world_matrix ) )
+                # output the mesh to file
+                export_mesh(ob,scene, force_debug)
+            # the cage of a subdivision surface is exported as it is , the renderer subdivides it on demand
+            subsurf = [ m for m in ob.modifiers if m.type == 'SUBSURF' and m.show_render ]
+            if subsurf:
+                model_node.set( 'subdiv' , str( subsurf[0].render_levels ) )
+            # hair is exported as curves instead of triangle strips
+            for psys in ob.particle_systems:
+                if psys.settings.type == 'HAIR':
+                    export_hair(root, ob, psys, force_debug)
         elif ob.type == 'LAMP':
             lamp = ob.data
             world_matrix = utility.getGlobalMatrix() * ob.matrix_world
@@ -162,10 +212,21 @@ def export_scene(scene, force_debug):
                 #eul = mathutils.Euler((-ob.rotation_euler[0], -ob.rotation_euler[2], -ob.rotation_euler[1]), ob.rotation_mode).to_matrix().to_4x4()
                 ET.SubElement( light_node , 'Property' , name='transform' , value = "m " + utility.matrixtostr(utility.getGlobalMatrix() * ob.matrix_world) )
 
+    if transfer_meshes:
+        transfer_name = exporter_common.write_mesh_transfer(transfer_meshes, preference.get_immediate_dir(force_debug) + 'scene.bin')
+        ET.SubElement( root , 'MeshTransfer' , name=transfer_name )
+
     # output the xml
     output_scene_file = preference.get_immediate_dir(force_debug) + 'blender.xml'
-    tree = ET.ElementTree(root)
-    tree.write(output_scene_file)
+    write_xml(scene, root, output_scene_file)
+
+# output an element tree, SORT detects the binary format by its content so the file names are the same
+def write_xml(scene, root, filename):
+    if scene.binary_scene_prop:
+        exporter_common.write_binary_xml(root, filename)
+    else:
+        tree = ET.ElementTree(root)
+        tree.write(filename)
 
 def name_compat(name):
     if name is None:
@@ -173,6 +234,39 @@ def name_compat(name):
     else:
         return name.replace(' ', '_')
 
+# export the hair of a particle system as cubic bezier curves , one curve between each pair of neighboring hair keys
+def export_hair(root, obj, psys, force_debug):
+    name = '%s_%s' % (name_compat(obj.name), name_compat(psys.name))
+    output_path = preference.get_immediate_res_dir(force_debug) + name + '.curves'
+
+    settings = psys.settings
+    root_width = 2.0 * settings.root_radius * settings.radius_scale
+    tip_width = 2.0 * settings.tip_radius * settings.radius_scale
+    with open(output_path, 'w') as file:
+        file.write("# SORT curves : c p0 p1 p2 p3 width0 width1\n")
+        for i, particle in enumerate(psys.particles):
+            keys = [psys.co_hair(obj, i, k) for k in range(len(particle.hair_keys))]
+            n = len(keys) - 1
+            for k in range(n):
+                # the catmull-rom spline through the keys is converted to bezier curves
+                p0 = keys[max(k - 1, 0)]
+                p1 = keys[k]
+                p2 = keys[k + 1]
+                p3 = keys[min(k + 2, n)]
+                b1 = p1 + (p2 - p0) / 6.0
+                b2 = p2 - (p3 - p1) / 6.0
+                w0 = root_width + (tip_width - root_width) * k / n
+                w1 = root_width + (tip_width - root_width) * (k + 1) / n
+                file.write("c %s %s %s %s %f %f\n" % (utility.vec3tostr(p1), utility.vec3tostr(b1), utility.vec3tostr(b2), utility.vec3tostr(p2), w0, w1))
+
+    # the keys are in world space already
+    curves_node = ET.SubElement( root , 'Curves' , filename=name + '.curves', name=name, type='tube' )
+    material = obj.material_slots[settings.material - 1].material if 0 < settings.material <= len(obj.material_slots) else None
+    if material:
+        curves_node.set( 'mat' , material.name )
+    transform_node = ET.SubElement( curves_node , 'Transform' )
+    ET.SubElement( transform_node , 'Matrix' , value = 'm '+ utility.matrixtostr( utility.getGlobalMatrix() ) )
+
 mtl_dict = {}
 mtl_rev_dict = {}
 
@@ -345,7 +439,7 @@ def export_mesh(obj,scene,force_debug):
 
             file.write("\n")
 
-def export_material(force_debug):
+def export_material(scene, force_debug):
     # create root node
     root = ET.Element("Root")
 
@@ -376,6 +470,5 @@ def export_material(force_debug):
 
     # output the xml
     output_material_file = preference.get_immediate_dir(force_debug) + 'blender_material.xml'
-    tree = ET.ElementTree(root)
-    tree.write(output_material_file)
+    write_xml(scene, root, output_material_file)
 
@@ -183,9 +183,18 @@ class SORTNodeOutput(SORTShadingNode):
     bl_label = 'SORT_output'
     bl_idname = common.sort_node_output_bl_name
 
+    stochastic_prop = bpy.props.BoolProperty(name='Stochastic Lobes', description='Evaluate only the sampled bxdf of layered materials in importance sampling, it is cheaper with a little more noise', default=False)
+
     def init(self, context):
         input = self.inputs.new('SORTNodeSocketBxdf', 'Surface')
 
+    def draw_buttons(self, context, layout):
+        layout.prop(self,'stochastic_prop')
+
+    def export_prop(self, xml_node):
+        if self.stochastic_prop:
+            ET.SubElement( xml_node , 'Property' , name='Stochastic' , type='string', value='true' )
+
 # layered bxdf node
 class SORTNodeLayeredBXDF(SORTShadingNode):
     bl_label = 'SORT_layered_bxdf'
@@ -351,6 +360,7 @@ class SORTNodeMerl(SORTShadingNode):
     bl_idname = 'SORTNodeMerl'
 
     file_name_prop = bpy.props.StringProperty(name="", default="", subtype='FILE_PATH' )
+    half_prop = bpy.props.BoolProperty(name='Half Precision', description='Store the measured data as half, it takes half of the memory', default=False)
 
     def init(self, context):
         self.outputs.new('SORTNodeSocketBxdf', 'Result')
@@ -359,12 +369,16 @@ class SORTNodeMerl(SORTShadingNode):
         row = layout.row()
         row.label("Filename")
         row.prop(self,'file_name_prop')
+        layout.prop(self,'half_prop')
 
     def draw_props(self, context, layout, indented_label):
         self.draw_prop(layout, 'Filename' , 'file_name_prop' , indented_label)
+        self.draw_prop(layout, 'Half Precision' , 'half_prop' , indented_label)
 
     def export_prop(self, xml_node):
         ET.SubElement( xml_node , 'Property' , name='Filename' , type='string', value= self.file_name_prop )
+        if self.half_prop:
+            ET.SubElement( xml_node , 'Property' , name='Half' , type='string', value='true' )
 
 # fourier bxdf node
 class SORTNodeFourierBxdf(SORTShadingNode):
@@ -5,15 +5,97 @@ import math
 import struct
 import numpy
 import platform
+import queue
+import threading
 from .exporter import sort_exporter
+from .exporter import exporter_common
 from . import preference
 from . import common
 from extensions_framework.util import TimerThread
 
+# the ring of finished tiles at the beginning of the shared memory , it matches 'TileRing' in SORT
+TILE_RING_MAGIC = 0x42545253
+TILE_RING_VERSION = 2
+TILE_RING_HEADER_SIZE = 64
+TILE_RING_ENTRY_SIZE = 16
+
+# pixels of the tiles are four half floats
+PIXEL_SIZE = 8
+
+# the number of entries of the ring
+def tile_ring_capacity(tile_count):
+    return max( 64 , 2 * tile_count )
+
+# the size of the ring , the tiles follow it
+def tile_ring_size(tile_count):
+    return TILE_RING_HEADER_SIZE + ( ( tile_count * 4 + 7 ) & ~7 ) + tile_ring_capacity(tile_count) * TILE_RING_ENTRY_SIZE
+
+# SORT keeps running between renderings in server mode , its threads and the scene are reused if nothing changed
+class SORT_Server:
+    def __init__(self, binary_path, binary_dir):
+        self.binary_path = binary_path
+        self.jobs = queue.Queue()
+        self.process = subprocess.Popen([binary_path, 'server', 'blendermode'], cwd=binary_dir, stdin=subprocess.PIPE, stdout=subprocess.PIPE, universal_newlines=True)
+        self.reader = threading.Thread(target=self.read, daemon=True)
+        self.reader.start()
+        self.job_done = True
+
+    # the log is still printed , the lines reporting finished renderings are picked from it
+    def read(self):
+        for line in self.process.stdout:
+            if line.startswith('SORT_JOB_'):
+                self.jobs.put(line)
+            else:
+                print(line, end='')
+
+    def alive(self):
+        return self.process.poll() is None
+
+    # ask the server to render a settings file
+    def submit(self, setting_file):
+        self.job_done = False
+        self.process.stdin.write('render ' + setting_file + '\n')
+        self.process.stdin.flush()
+
+    # whether the rendering is finished , it waits at most 'timeout' seconds
+    def finished(self, timeout=0.0):
+        if not self.job_done:
+            try:
+                self.jobs.get(timeout=timeout) if timeout > 0 else self.jobs.get_nowait()
+                self.job_done = True
+            except queue.Empty:
+                self.job_done = not self.alive()
+        return self.job_done
+
+    def stop(self):
+        if self.alive():
+            try:
+                self.process.stdin.write('quit\n')
+                self.process.stdin.flush()
+                self.process.wait(timeout=10)
+            except (OSError, subprocess.TimeoutExpired):
+                self.process.terminate()
+
+sort_server = None
+
+# get the running server , a new one is started if there is none
+def get_sort_server(binary_path, binary_dir):
+    global sort_server
+    if sort_server is None or not sort_server.alive() or sort_server.binary_path != binary_path:
+        if sort_server is not None:
+            sort_server.stop()
+        sort_server = SORT_Server(binary_path, binary_dir)
+    return sort_server
+
+def stop_sort_server():
+    global sort_server
+    if sort_server is not None:
+        sort_server.stop()
+        sort_server = None
+
 class SORT_Thread(TimerThread):
     render_engine = None
     shared_memory = None
-    float_shared_memory = None
 
     def setrenderengine(self, re):
         self.render_engine = re
@@ -22,8 +104,9 @@ class SORT_Thread(TimerThread):
         # setup shared memory
         self.shared_memory = sm
 
-        # pack image content as float
-        self.float_shared_memory = struct.pack('%sf'%(self.render_engine.image_size_in_bytes), *sm[self.render_engine.image_header_size:self.render_engine.image_size_in_bytes + self.render_engine.image_header_size] )
+        # the position in the ring and the versions of the tiles read so far
+        self.read_seq = 0
+        self.tile_versions = [0] * self.render_engine.image_tile_count
 
     def kick(self, render_end=False):
         self.update()
@@ -51,12 +134,12 @@ class SORT_Thread(TimerThread):
             offset_y = max( mod - tile_y_offset , 0 )
 
             # load shared memory
-            self.shared_memory.seek( self.render_engine.image_header_size + i * self.render_engine.image_tile_size_in_bytes + offset_y * tile_size_x * 16)
-            byptes = self.shared_memory.read(self.render_engine.image_tile_size_in_bytes - offset_y * tile_size_x * 16)
+            pixel_count = ( tile_size_y - offset_y ) * tile_size_x
+            tile_offset = self.render_engine.image_header_size + i * self.render_engine.image_tile_size_in_bytes + offset_y * tile_size_x * PIXEL_SIZE
 
-            # convert binary to two dimensional array
-            tile_data = numpy.fromstring(byptes, dtype=numpy.float32)
-            tile_rect = tile_data.reshape( ( ( self.render_engine.image_tile_pixel_count - offset_y * tile_size_x ) , 4 ) )
+            # convert half floats to two dimensional array
+            tile_data = numpy.frombuffer(self.shared_memory, dtype=numpy.float16, count=pixel_count * 4, offset=tile_offset)
+            tile_rect = tile_data.astype(numpy.float32).reshape( ( pixel_count , 4 ) )
 
             # begin result
             result = self.render_engine.begin_result(tile_x_offset, max(tile_y_offset - mod,0), tile_size_x, tile_size_y - offset_y)
@@ -67,20 +150,44 @@ class SORT_Thread(TimerThread):
             # refresh the update
             self.render_engine.end_result(result)
 
-            # update header info to make sure it is not processed again
-            self.shared_memory[i] = self.shared_memory[i] + 1
-
         # close the shared memory if it is the last update
         #if final_update:
         #    self.shared_memory.close()
 
+    # read the tiles finished since the last update from the ring , only the sequence number is read if there is none
     def picknewtiles(self):
-        active_tiles = []
-        for i in range( self.render_engine.image_header_size ):
-            if self.shared_memory[i] is 1:
-                active_tiles.append(i)
+        sm = self.shared_memory
+        magic, version, tile_count, capacity, write_seq = struct.unpack_from('<IIIIQ', sm, 0)
+        if magic != TILE_RING_MAGIC or version != TILE_RING_VERSION or tile_count != len(self.tile_versions):
+            return []
+        if write_seq == self.read_seq:
+            return []
+
+        active_tiles = set()
+        overrun = write_seq - self.read_seq > capacity
+        entry_base = TILE_RING_HEADER_SIZE + ( ( tile_count * 4 + 7 ) & ~7 )
+        seq = self.read_seq
+        while not overrun and seq < write_seq:
+            offset = entry_base + ( seq % capacity ) * TILE_RING_ENTRY_SIZE
+            entry_seq, tile, tile_version = struct.unpack_from('<QII', sm, offset)
+            # the entry is rewritten by a later tile while it is read
+            if entry_seq != seq + 1 or struct.unpack_from('<Q', sm, offset)[0] != entry_seq:
+                overrun = True
+                break
+            active_tiles.add(tile)
+            self.tile_versions[tile] = max( self.tile_versions[tile] , tile_version )
+            seq += 1
 
-        return active_tiles
+        # the ring is overwritten before it is read , the tiles with new versions are picked instead
+        if overrun:
+            versions = struct.unpack_from('<%dI' % tile_count, sm, TILE_RING_HEADER_SIZE)
+            for i in range( tile_count ):
+                if versions[i] != self.tile_versions[i]:
+                    active_tiles.add(i)
+                    self.tile_versions[i] = versions[i]
+
+        self.read_seq = write_seq
+        return sorted(active_tiles)
 
 class SORT_RENDERER(bpy.types.RenderEngine):
     # These three members are used by blender to set up the
@@ -93,8 +200,8 @@ class SORT_RENDERER(bpy.types.RenderEngine):
     def spawnnewthread(self):
         import mmap
 
-        # setup shared memory size
-        self.sm_size = self.image_size_in_bytes * 2 + self.image_header_size + 2
+        # setup shared memory size, the last three bytes are progress, final update flag and render control
+        self.sm_size = self.image_size_in_bytes + self.image_header_size + 3
  
         # on mac os
         if platform.system() == "Darwin" or platform.system() == "Linux":
@@ -117,22 +224,22 @@ class SORT_RENDERER(bpy.types.RenderEngine):
     
     def __init__(self):
         self.sort_available = True
-        self.cmd_argument = []
         self.render_pass = None
         self.sort_thread = SORT_Thread()
         self.sort_thread.setrenderengine(self)
         self.sharedmemory = None
 
         self.image_tile_size = 64
-        self.image_size_w = int(bpy.data.scenes[0].render.resolution_x * bpy.data.scenes[0].render.resolution_percentage / 100)
-        self.image_size_h = int(bpy.data.scenes[0].render.resolution_y * bpy.data.scenes[0].render.resolution_percentage / 100)
+        # the tiles cover the rendered region only, it is the border with border rendering
+        _, _, self.image_size_w, self.image_size_h = exporter_common.getRenderRegion(bpy.data.scenes[0])
         self.image_pixel_count = self.image_size_w * self.image_size_h
         self.image_tile_count_x = math.ceil( self.image_size_w / self.image_tile_size )
         self.image_tile_count_y = math.ceil( self.image_size_h / self.image_tile_size )
-        self.image_header_size = self.image_tile_count_x * self.image_tile_count_y
+        self.image_tile_count = self.image_tile_count_x * self.image_tile_count_y
+        self.image_header_size = tile_ring_size(self.image_tile_count)
         self.image_tile_pixel_count = self.image_tile_size * self.image_tile_size
-        self.image_tile_size_in_bytes = self.image_tile_pixel_count * 16
-        self.image_size_in_bytes = self.image_tile_count_x * self.image_tile_count_y * self.image_tile_size_in_bytes
+        self.image_tile_size_in_bytes = self.image_tile_pixel_count * PIXEL_SIZE
+        self.image_size_in_bytes = self.image_tile_count * self.image_tile_size_in_bytes
 
     # update frame
     def update(self, data, scene):
@@ -177,47 +284,31 @@ class SORT_RENDERER(bpy.types.RenderEngine):
         binary_dir = preference.get_sort_dir()
         binary_path = preference.get_sort_bin_path()
 
-        # execute binary
-        self.cmd_argument = [binary_path];
-        self.cmd_argument.append('./blender_intermediate/blender_exported.xml')
-        self.cmd_argument.append('blendermode')
-        process = subprocess.Popen(self.cmd_argument,cwd=binary_dir)
+        # the rendering is done by the server , it is only started for the first rendering
+        server = get_sort_server(binary_path, binary_dir)
+        server.submit('./blender_intermediate/blender_exported.xml')
 
-        # wait for the process to finish
-        while subprocess.Popen.poll(process) is None:
+        # wait for the rendering to finish
+        while not server.finished():
             if self.test_break():
+                # ask SORT to stop, the partially rendered image is still delivered with the final update
+                self.sharedmemory[self.image_size_in_bytes + self.image_header_size + 2] = 1
+                server.finished(timeout=10)
                 break
-            progress = self.sharedmemory[self.image_size_in_bytes * 2 + self.image_header_size]
+            progress = self.sharedmemory[self.image_size_in_bytes + self.image_header_size]
             self.update_progress(progress/100)
 
-        # terminate the process by force
-        if subprocess.Popen.poll(process) is None:
-            subprocess.Popen.terminate(process)
+        # stop the server by force if it doesn't respond , a new one is started for the next rendering
+        if not server.finished():
+            stop_sort_server()
 
         # wait for the thread to finish
         if self.sort_thread.isAlive():
             self.sort_thread.stop()
             self.sort_thread.join()
+            # the final image is sent as tiles too , the last ones are read here
             self.sort_thread.update(True)
 
-            # if final update is necessary
-            final_update = self.sharedmemory[self.image_size_in_bytes * 2 + self.image_header_size + 1]
-            if final_update:
-                # begin result
-                result = self.begin_result(0, 0, bpy.data.scenes[0].render.resolution_x, bpy.data.scenes[0].render.resolution_y)
-
-                self.sharedmemory.seek( self.image_header_size + self.image_size_in_bytes)
-                byptes = self.sharedmemory.read(self.image_pixel_count * 16)
-
-                tile_data = numpy.fromstring(byptes, dtype=numpy.float32)
-                tile_rect = tile_data.reshape( self.image_pixel_count , 4 )
-
-                # update image memory
-                result.layers[0].passes[0].rect = tile_rect
-
-                # refresh the update
-                self.end_result(result)
-
             # close shared memory connection
             self.sharedmemory.close()
 
@@ -226,5 +317,8 @@ def register():
     bpy.utils.register_class(SORT_RENDERER)
 
 def unregister():
+    # the server doesn't outlive the add-on
+    stop_sort_server()
+
     # Unregister RenderEngine
     bpy.utils.unregister_class(SORT_RENDERER)
@@ -29,6 +29,11 @@ class IntegratorPanel(SORTRenderPanel,bpy.types.Panel):
         ("ao", "Ambient Occlusion", "", 5),
         ("direct", "Direct Lighting", "", 6),
         ("whitted", "Whitted", "", 7),
+        ("wavefront_pt", "Wavefront Path Tracing", "", 8),
+        ("vcm", "Vertex Connection and Merging", "", 9),
+        ("ic", "Irradiance Caching", "", 10),
+        ("sppm", "Stochastic Progressive Photon Mapping", "", 11),
+        ("pssmlt", "Primary Sample Space MLT", "", 12),
         ]
     bpy.types.Scene.integrator_type_prop = bpy.props.EnumProperty(items=integrator_types, name='Integrator')
 
@@ -36,25 +41,53 @@ class IntegratorPanel(SORTRenderPanel,bpy.types.Panel):
     accelerator_types = [
         ("kd_tree", "SAH KDTree", "", 1),
         ("bvh", "Bounding Volume Hierarchy", "", 2),
+        ("lbvh", "Linear BVH ( Fast Build )", "", 6),
         ("uniform_grid", "Uniform Grid", "", 3),
         ("octree" , "OcTree" , "" , 4),
         ("bruteforce", "No Accelerator", "", 5),
         ]
     bpy.types.Scene.accelerator_type_prop = bpy.props.EnumProperty(items=accelerator_types, name='Accelerator')
+    bpy.types.Scene.accelerator_cache_prop = bpy.props.BoolProperty(name='Cache Accelerator', description='Reuse the acceleration structure built last time if the geometry is unchanged', default=True)
+    bpy.types.Scene.binary_scene_prop = bpy.props.BoolProperty(name='Binary Scene', description='Export the scene and the materials in the binary format that loads without parsing XML', default=False)
+    bpy.types.Scene.mesh_transfer_prop = bpy.props.BoolProperty(name='Mesh Transfer', description='Hand the meshes over in shared memory that SORT maps without parsing instead of writing OBJ files', default=True)
 
     # general integrator parameters
     bpy.types.Scene.inte_max_recur_depth = bpy.props.IntProperty(name='Maximum Recursive Depth', default=16, min=1)
 
     # ao integrator parameters
     bpy.types.Scene.ao_max_dist = bpy.props.FloatProperty(name='Maximum Distance', default=3.0, min=0.01)
+    bpy.types.Scene.ao_samples = bpy.props.IntProperty(name='Occlusion Rays', description='Number of occlusion rays traced together at each hit', default=1, min=1)
 
     # instant radiosity parameters
     bpy.types.Scene.ir_light_path_set_num = bpy.props.IntProperty(name='Light Path Set Num', default=1, min=1)
     bpy.types.Scene.ir_light_path_num = bpy.props.IntProperty(name='Light Path Num', default=64, min=1)
     bpy.types.Scene.ir_min_dist = bpy.props.FloatProperty(name='Minimum Distance', default=1.0, min=0.0)
+    bpy.types.Scene.ir_lightcut_error = bpy.props.FloatProperty(name='Light Cut Error', default=0.02, min=0.0, max=1.0)
+
+    # path tracing parameters
+    bpy.types.Scene.pt_guiding = bpy.props.BoolProperty(name='Path Guiding', description='Learn the incident radiance during progressive rendering and sample directions from it', default=False)
+    bpy.types.Scene.pt_adrrs = bpy.props.BoolProperty(name='Adaptive Russian Roulette', description='Split or terminate paths by their expected contribution to the pixel estimated in previous passes', default=False)
+    bpy.types.Scene.pt_spectral = bpy.props.EnumProperty(name='Spectral Rendering', description='Number of wavelengths carried by each path instead of rgb values', items=[('0','RGB',''),('4','4 Wavelengths',''),('8','8 Wavelengths','')], default='0')
+    bpy.types.Scene.pt_shadow_roulette = bpy.props.FloatProperty(name='Shadow Ray Roulette', description='Shadow rays dimmer than this fraction of the radiance of their path are traced randomly, 0 traces all of them', default=0.0, min=0.0, max=1.0)
+
+    # direct lighting parameters
+    bpy.types.Scene.direct_adaptive = bpy.props.BoolProperty(name='Adaptive Light Sampling', description='Spread the shadow rays across lights by their importance to the shading point', default=False)
+    bpy.types.Scene.shadow_rays = bpy.props.IntProperty(name='Shadow Rays', description='Number of shadow rays of each shading point in adaptive light sampling', default=8, min=1)
+    bpy.types.Scene.direct_restir = bpy.props.BoolProperty(name='Reservoir Resampling', description='Resample light candidates and reuse them across neighbor pixels and progressive passes', default=False)
+    bpy.types.Scene.restir_candidates = bpy.props.IntProperty(name='Light Candidates', description='Number of light candidates resampled at each shading point', default=32, min=1)
+    bpy.types.Scene.restir_neighbors = bpy.props.IntProperty(name='Spatial Neighbors', description='Number of neighbor reservoirs reused at each shading point', default=4, min=0)
+
+    # light tracing parameters
+    bpy.types.Scene.lt_paths = bpy.props.IntProperty(name='Light Paths', description='Number of light paths traced in every pass, 0 traces one for each pixel sample', default=0, min=0)
+
+    # irradiance caching parameters
+    bpy.types.Scene.ic_error = bpy.props.FloatProperty(name='Maximum Error', description='Largest error of reusing an irradiance record, smaller values create more records', default=0.2, min=0.01, max=1.0)
+    bpy.types.Scene.ic_samples = bpy.props.IntProperty(name='Gather Rays', description='Number of rays gathering the irradiance of a record', default=256, min=1)
+    bpy.types.Scene.ic_spacing = bpy.props.IntProperty(name='Pixel Spacing', description='Distance in pixels between the camera rays creating records before rendering', default=8, min=1)
 
     # bidirectional path tracing parameters
     bpy.types.Scene.bdpt_mis = bpy.props.BoolProperty(name='Multiple Importance Sampling', default=True)
+    bpy.types.Scene.bdpt_lvc = bpy.props.BoolProperty(name='Light Vertex Cache', default=False)
 
     def draw(self, context):
         self.layout.prop(context.scene,"integrator_type_prop")
@@ -63,14 +96,40 @@ class IntegratorPanel(SORTRenderPanel,bpy.types.Panel):
             self.layout.prop(context.scene,"inte_max_recur_depth")
         if integrator_type == "ao":
             self.layout.prop(context.scene,"ao_max_dist")
+            self.layout.prop(context.scene,"ao_samples")
+        if integrator_type == "pt":
+            self.layout.prop(context.scene,"pt_guiding")
+            self.layout.prop(context.scene,"pt_adrrs")
+            self.layout.prop(context.scene,"pt_spectral")
+            self.layout.prop(context.scene,"pt_shadow_roulette")
+        if integrator_type == "direct":
+            self.layout.prop(context.scene,"direct_adaptive")
+            if context.scene.direct_adaptive:
+                self.layout.prop(context.scene,"shadow_rays")
+            self.layout.prop(context.scene,"direct_restir")
+            if context.scene.direct_restir:
+                self.layout.prop(context.scene,"restir_candidates")
+                self.layout.prop(context.scene,"restir_neighbors")
+        if integrator_type == "lt":
+            self.layout.prop(context.scene,"lt_paths")
         if integrator_type == "bdpt":
             self.layout.prop(context.scene,"bdpt_mis")
+            self.layout.prop(context.scene,"bdpt_lvc")
         if integrator_type == "ir":
             self.layout.prop(context.scene,"ir_light_path_set_num")
             self.layout.prop(context.scene,"ir_light_path_num")
             self.layout.prop(context.scene, "ir_min_dist")
+            self.layout.prop(context.scene, "ir_lightcut_error")
+        if integrator_type == "ic":
+            self.layout.prop(context.scene, "ic_error")
+            self.layout.prop(context.scene, "ic_samples")
+            self.layout.prop(context.scene, "ic_spacing")
 
         self.layout.prop(context.scene,"accelerator_type_prop")
+        if context.scene.accelerator_type_prop in ("kd_tree","bvh"):
+            self.layout.prop(context.scene,"accelerator_cache_prop")
+        self.layout.prop(context.scene,"binary_scene_prop")
+        self.layout.prop(context.scene,"mesh_transfer_prop")
 
 class MultiThreadPanel(SORTRenderPanel, bpy.types.Panel):
     bl_label = common.thread_panel_bl_name
@@ -88,15 +147,36 @@ class SamplerPanel(SORTRenderPanel, bpy.types.Panel):
         ("stratified", "Stratified", "", 3),
         ("random", "Random", "", 2),
         ("regular", "Uniform", "", 1),
+        ("sobol", "Sobol", "", 4),
+        ("halton", "Halton", "", 5),
+        ("pmj02", "Progressive Multi-Jittered (0,2)", "", 6),
         ]
     bpy.types.Scene.sampler_type_prop = bpy.props.EnumProperty(items=sampler_types, name='Type')
 
     # sampler count
     bpy.types.Scene.sampler_count_prop = bpy.props.IntProperty(name='Count',default=1, min=1)
+    bpy.types.Scene.deterministic_prop = bpy.props.BoolProperty(name='Deterministic', description='Render the same image every time regardless of the threads taking the tiles', default=False)
+    bpy.types.Scene.blue_noise_prop = bpy.props.BoolProperty(name='Blue Noise Dithering', description='Distribute the error of neighbor pixels as blue noise, it mostly helps at low sample counts', default=False)
+
+    # pixel filter
+    filter_types = [
+        ("box", "Box", "", 1),
+        ("gaussian", "Gaussian", "", 2),
+        ("mitchell", "Mitchell-Netravali", "", 3),
+        ("blackman_harris", "Blackman-Harris", "", 4),
+        ]
+    bpy.types.Scene.filter_type_prop = bpy.props.EnumProperty(items=filter_types, name='Pixel Filter')
+    bpy.types.Scene.filter_radius_prop = bpy.props.FloatProperty(name='Filter Radius', description='Radius of the pixel filter in pixels, samples are splatted to every pixel within it, 0 uses the default radius of the filter', default=0.0, min=0.0, max=4.0)
+    bpy.types.Scene.denoise_prop = bpy.props.BoolProperty(name='Denoise', description='Denoise the final image guided by the albedo and the normal of the first hit, only path tracing renders them', default=False)
 
     def draw(self, context):
         self.layout.prop(context.scene,"sampler_type_prop")
         self.layout.prop(context.scene,"sampler_count_prop")
+        self.layout.prop(context.scene,"deterministic_prop")
+        self.layout.prop(context.scene,"blue_noise_prop")
+        self.layout.prop(context.scene,"filter_type_prop")
+        self.layout.prop(context.scene,"filter_radius_prop")
+        self.layout.prop(context.scene,"denoise_prop")
 
 # export debug scene
 class SORT_export_debug_scene(bpy.types.Operator):
@@ -0,0 +1,162 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "accelbench.h"
+#include "accelerator.h"
+#include "geometry/scene.h"
+#include "geometry/intersection.h"
+#include "camera/camera.h"
+#include "sampler/sample.h"
+#include "utility/samplemethod.h"
+#include "utility/rand.h"
+#include "accelstats.h"
+#include "log/log.h"
+#include <chrono>
+#include <sstream>
+
+// constructor generating the ray sets
+AccelBenchmark::AccelBenchmark( Scene& scene , const Camera* camera , unsigned width , unsigned height , unsigned ray_num ) : m_scene(scene)
+{
+    m_raySets.resize( 3 );
+    Ray_Set& camera_set = m_raySets[0];
+    Ray_Set& diffuse_set = m_raySets[1];
+    Ray_Set& shadow_set = m_raySets[2];
+    camera_set.name = "camera";
+    diffuse_set.name = "diffuse";
+    shadow_set.name = "shadow";
+    shadow_set.shadow = true;
+
+    // camera rays are distributed over the image in scan line order, neighbouring rays are coherent
+    const unsigned grid_w = max( 1u , (unsigned)( sqrt( (float)ray_num * width / max( height , 1u ) ) + 0.5f ) );
+    const unsigned grid_h = ( ray_num + grid_w - 1 ) / grid_w;
+    PixelSample ps;
+    for( unsigned i = 0 ; i < ray_num ; ++i ){
+        ps.img_u = sort_canonical();
+        ps.img_v = sort_canonical();
+        ps.dof_u = sort_canonical();
+        ps.dof_v = sort_canonical();
+        const float x = (float)( i % grid_w ) * width / grid_w;
+        const float y = (float)( i / grid_w ) * height / grid_h;
+        camera_set.rays.push_back( camera->GenerateRay( x , y , ps ) );
+    }
+
+    // secondary rays start from the first hits
+    const BBox& bbox = scene.GetBBox();
+    for( const Ray& r : camera_set.rays ){
+        Intersection ip;
+        if( !scene.GetIntersect( r , &ip ) )
+            continue;
+
+        // diffuse bounce with a cosine weighted direction around the normal
+        const Vector nn = ip.normal;
+        const Vector tn = Normalize( Cross( nn , ip.tangent ) );
+        const Vector sn = Cross( tn , nn );
+        const Vector _wi = CosSampleHemisphere( sort_canonical() , sort_canonical() );
+        Vector wi = Vector( _wi.x * sn.x + _wi.y * nn.x + _wi.z * tn.x ,
+                            _wi.x * sn.y + _wi.y * nn.y + _wi.z * tn.y ,
+                            _wi.x * sn.z + _wi.y * nn.z + _wi.z * tn.z );
+        if( Dot( r.m_Dir , nn ) > 0.0f )
+            wi *= -1.0f;
+        diffuse_set.rays.push_back( ip.SpawnRay( wi , 1 ) );
+
+        // shadow ray toward a random point in the scene, it is limited by the distance to the point
+        const Point target( bbox.m_Min.x + ( bbox.m_Max.x - bbox.m_Min.x ) * sort_canonical() ,
+                            bbox.m_Min.y + ( bbox.m_Max.y - bbox.m_Min.y ) * sort_canonical() ,
+                            bbox.m_Min.z + ( bbox.m_Max.z - bbox.m_Min.z ) * sort_canonical() );
+        const Vector delta = target - ip.intersect;
+        if( delta.Length() > 0.002f ){
+            shadow_set.rays.push_back( ip.SpawnRayTo( target ) );
+            shadow_set.rays.back().m_Depth = 1;
+        }
+    }
+}
+
+// build each accelerator and trace all ray sets with it
+void AccelBenchmark::Run( const std::vector<std::string>& types )
+{
+    for( const Ray_Set& set : m_raySets )
+        slog( INFO , PERFORMANCE , stringFormat( "Benchmark ray set '%s' has %d rays." , set.name.c_str() , (unsigned)set.rays.size() ) );
+
+    for( const std::string& type : types ){
+        Accelerator* accel = createAccelerator( type );
+        if( accel == nullptr ){
+            slog( WARNING , PERFORMANCE , stringFormat( "Accelerator '%s' is not supported, it is skipped in the benchmark." , type.c_str() ) );
+            continue;
+        }
+
+        accel->SetPrimitives( &m_scene.GetPrimitives() );
+        const auto start = std::chrono::high_resolution_clock::now();
+        accel->Build();
+        const std::chrono::duration<double,std::milli> build_time = std::chrono::high_resolution_clock::now() - start;
+
+        const size_t memory = accel->GetMemoryUsage();
+        slog( INFO , PERFORMANCE , stringFormat( "Accelerator '%s' is built in %.2f ms, it takes %s." , type.c_str() , build_time.count() ,
+            memory ? stringFormat( "%.2f MB" , memory / ( 1024.0 * 1024.0 ) ).c_str() : "unknown memory" ) );
+
+        for( const Ray_Set& set : m_raySets ){
+            unsigned hits = 0;
+            SORT_STATS( AccelStats::Reset() );
+            const double seconds = trace( accel , set , hits );
+            const double mrays = ( seconds > 0.0 ) ? set.rays.size() / seconds * 1e-6 : 0.0;
+            slog( INFO , PERFORMANCE , stringFormat( "Accelerator '%s' traces %s rays at %.2f Mrays/s, %d of them hit the scene." , type.c_str() , set.name.c_str() , mrays , hits ) );
+
+            // the counters are only available with SORT_ACCEL_STATS enabled, they slow down the traversal a bit
+            SORT_STATS( const AccelStats stats = AccelStats::Total() );
+            SORT_STATS( const double rays = (double)max( set.rays.size() , (size_t)1 ) );
+            SORT_STATS( slog( INFO , PERFORMANCE , stringFormat( "Accelerator '%s' visits %.2f nodes and tests %.2f primitives per %s ray." , type.c_str() , stats.nodes / rays , stats.primitives / rays , set.name.c_str() ) ) );
+        }
+
+        delete accel;
+    }
+}
+
+// create an accelerator from its description
+Accelerator* AccelBenchmark::createAccelerator( const std::string& desc ) const
+{
+    std::istringstream stream( desc );
+    std::string token;
+    std::getline( stream , token , ':' );
+    Accelerator* accel = CREATE_TYPE( token , Accelerator );
+    if( accel == nullptr )
+        return nullptr;
+
+    // the rest are properties in the form of 'name=value'
+    while( std::getline( stream , token , ':' ) ){
+        const size_t pos = token.find( '=' );
+        if( pos != std::string::npos )
+            accel->SetProperty( token.substr( 0 , pos ) , token.substr( pos + 1 ) );
+    }
+    return accel;
+}
+
+// trace a ray set once
+double AccelBenchmark::trace( const Accelerator* accel , const Ray_Set& set , unsigned& hits ) const
+{
+    hits = 0;
+    const auto start = std::chrono::high_resolution_clock::now();
+    if( set.shadow ){
+        for( const Ray& r : set.rays )
+            hits += accel->IsOccluded( r ) ? 1 : 0;
+    }else{
+        for( const Ray& r : set.rays ){
+            Intersection ip;
+            hits += accel->GetIntersect( r , &ip ) ? 1 : 0;
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
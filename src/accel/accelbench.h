@@ -0,0 +1,77 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <vector>
+#include "geometry/ray.h"
+
+class Scene;
+class Camera;
+class Accelerator;
+
+//! @brief Benchmark comparing spatial accelerators on the same scene.
+/**
+ * Choosing an accelerator for a scene used to take full renders with each of them. The benchmark builds
+ * every requested accelerator over the primitives of the loaded scene and times the construction, then it
+ * traces the same ray sets with each of them. There are three ray sets, coherent camera rays, incoherent
+ * diffuse bounces from the first hits and shadow rays from the first hits toward random points in the scene.
+ * The sets are generated once with the accelerator of the scene file so that all accelerators trace exactly
+ * the same rays, the throughput is measured on one thread without any shading. With SORT_ACCEL_STATS enabled,
+ * the number of nodes visited and primitives tested per ray are reported as well.
+ */
+class AccelBenchmark
+{
+public:
+    //! @brief Constructor generating the ray sets.
+    //! @param scene    The scene, it has to be preprocessed already.
+    //! @param camera   The camera generating the camera rays.
+    //! @param width    The width of the image.
+    //! @param height   The height of the image.
+    //! @param ray_num  The number of camera rays, the other sets have up to the same number of rays.
+    AccelBenchmark( Scene& scene , const Camera* camera , unsigned width , unsigned height , unsigned ray_num );
+
+    //! @brief Build each accelerator and trace all ray sets with it.
+    //! @param types    Accelerators to be compared. Each one is a type name optionally followed by properties,
+    //!                 like 'bvh:sbvh=1:compress=8'.
+    void Run( const std::vector<std::string>& types );
+
+private:
+    //! @brief Rays traced together in one measurement.
+    struct Ray_Set
+    {
+        std::string         name;           /**< Name of the ray set in the report. */
+        std::vector<Ray>    rays;           /**< The rays in the set. */
+        bool                shadow = false; /**< Whether the rays are traced as shadow rays. */
+    };
+
+    Scene&                  m_scene;        /**< The benchmarked scene. */
+    std::vector<Ray_Set>    m_raySets;      /**< Ray sets shared by all accelerators. */
+
+    //! @brief Create an accelerator from its description.
+    //! @param desc     Type name optionally followed by properties.
+    //! @return         The accelerator, nullptr if the type is not registered.
+    Accelerator* createAccelerator( const std::string& desc ) const;
+
+    //! @brief Trace a ray set once.
+    //! @param accel    The accelerator to be tested.
+    //! @param set      The ray set.
+    //! @param hits     The number of rays hitting any primitive.
+    //! @return         The time spent on tracing in seconds.
+    double trace( const Accelerator* accel , const Ray_Set& set , unsigned& hits ) const;
+};
@@ -0,0 +1,193 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "accelcache.h"
+#include "accelerator.h"
+#include "geometry/primitive.h"
+#include "log/log.h"
+#include "utility/mappedfile.h"
+#include "managers/smmanager.h"
+#include <fstream>
+
+static const char ACCEL_CACHE_MAGIC[4] = { 'S' , 'A' , 'C' , 'C' };
+
+// header of the cache file, the payload written by the accelerator follows it
+struct AccelCacheHeader
+{
+    char                magic[4];
+    unsigned            version;
+    unsigned long long  key;
+    unsigned long long  size;       // size of the payload in bytes
+    unsigned long long  checksum;   // hash of the payload, truncated or corrupted files are detected with it
+};
+
+// FNV-1a hash of a range of bytes
+static unsigned long long fnv1a( const void* data , size_t size , unsigned long long hash = 0xcbf29ce484222325ULL )
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for( size_t i = 0 ; i < size ; ++i ){
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// compute the key of an acceleration structure
+unsigned long long AccelCache::Key( const std::vector<Primitive*>& primitives , const std::string& params )
+{
+    unsigned long long hash = fnv1a( &ACCEL_CACHE_VERSION , sizeof( ACCEL_CACHE_VERSION ) );
+    hash = fnv1a( params.c_str() , params.size() , hash );
+    const unsigned long long count = primitives.size();
+    hash = fnv1a( &count , sizeof( count ) , hash );
+
+    // triangles are hashed with their vertices, other primitives with their bounding boxes
+    for( auto primitive : primitives ){
+        float data[9];
+        Point p0 , p1 , p2;
+        if( primitive->GetTriangleVertices( p0 , p1 , p2 ) ){
+            const Point* points[3] = { &p0 , &p1 , &p2 };
+            for( unsigned i = 0 ; i < 3 ; ++i )
+                for( unsigned axis = 0 ; axis < 3 ; ++axis )
+                    data[3*i+axis] = (*points[i])[axis];
+            hash = fnv1a( data , sizeof( float ) * 9 , hash );
+        }else{
+            const BBox& box = primitive->GetBBox();
+            for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+                data[axis] = box.m_Min[axis];
+                data[3+axis] = box.m_Max[axis];
+            }
+            hash = fnv1a( data , sizeof( float ) * 6 , hash );
+        }
+    }
+    return hash;
+}
+
+// hash a range of bytes
+unsigned long long AccelCache::Hash( const void* data , size_t size )
+{
+    return fnv1a( data , size );
+}
+
+// load the acceleration structure from a header and its payload
+// 'source' names the place of the bytes in the log , 'persistent' tells whether the bytes outlive the accelerator
+static bool loadBytes( const char* bytes , size_t size , unsigned long long key , Accelerator* accel , const std::string& source , bool persistent )
+{
+    if( size < sizeof( AccelCacheHeader ) )
+        return false;
+
+    AccelCacheHeader header;
+    memcpy( &header , bytes , sizeof( header ) );
+    const char* payload = bytes + sizeof( header );
+    bool loaded = false;
+    if( memcmp( header.magic , ACCEL_CACHE_MAGIC , sizeof( ACCEL_CACHE_MAGIC ) ) != 0 || header.version != ACCEL_CACHE_VERSION )
+        slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "Acceleration structure %s is ignored, it is not a cache of the current version." , source.c_str() ) );
+    else if( header.key != key )
+        slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "Acceleration structure %s is outdated, the primitives or the build parameters changed." , source.c_str() ) );
+    else if( header.size != size - sizeof( header ) || header.checksum != fnv1a( payload , (size_t)header.size ) )
+        slog( WARNING , SPATIAL_ACCELERATOR , stringFormat( "Acceleration structure %s is corrupted." , source.c_str() ) );
+    else{
+        AccelReader reader( payload , (size_t)header.size , persistent );
+        loaded = accel->Deserialize( reader ) && reader.IsComplete();
+        if( !loaded )
+            slog( WARNING , SPATIAL_ACCELERATOR , stringFormat( "Failed to load acceleration structure %s." , source.c_str() ) );
+    }
+
+    if( loaded )
+        slog( INFO , SPATIAL_ACCELERATOR , stringFormat( "Acceleration structure is loaded from %s." , source.c_str() ) );
+    return loaded;
+}
+
+// write the header of the built acceleration structure followed by its payload
+static bool saveBytes( unsigned long long key , const Accelerator* accel , AccelCacheHeader& header , AccelWriter& writer )
+{
+    if( !accel->Serialize( writer ) )
+        return false;
+    const std::vector<char>& payload = writer.GetData();
+
+    memcpy( header.magic , ACCEL_CACHE_MAGIC , sizeof( ACCEL_CACHE_MAGIC ) );
+    header.version = ACCEL_CACHE_VERSION;
+    header.key = key;
+    header.size = payload.size();
+    header.checksum = fnv1a( payload.data() , payload.size() );
+    return true;
+}
+
+// load the acceleration structure from a cache file
+bool AccelCache::Load( const std::string& filename , unsigned long long key , Accelerator* accel )
+{
+    // map the whole file into memory
+    MappedFile file;
+    if( !file.Open( filename ) )
+        return false;
+    return loadBytes( file.GetData() , file.GetSize() , key , accel , "cache " + filename , false );
+}
+
+// store the built acceleration structure in a cache file
+bool AccelCache::Save( const std::string& filename , unsigned long long key , const Accelerator* accel )
+{
+    AccelCacheHeader header;
+    AccelWriter writer;
+    if( !saveBytes( key , accel , header , writer ) )
+        return false;
+    const std::vector<char>& payload = writer.GetData();
+
+    std::ofstream file( filename.c_str() , std::ios::binary | std::ios::trunc );
+    if( file.is_open() ){
+        file.write( (const char*)&header , sizeof( header ) );
+        file.write( payload.data() , payload.size() );
+    }
+    if( !file.is_open() || !file ){
+        slog( WARNING , SPATIAL_ACCELERATOR , stringFormat( "Failed to write acceleration structure cache %s." , filename.c_str() ) );
+        return false;
+    }
+
+    slog( INFO , SPATIAL_ACCELERATOR , stringFormat( "Acceleration structure is stored in cache %s." , filename.c_str() ) );
+    return true;
+}
+
+// load the acceleration structure published by another process on the host
+bool AccelCache::LoadShared( unsigned long long key , Accelerator* accel )
+{
+    size_t size = 0;
+    const char* bytes = SMManager::GetSingleton().OpenSceneData( key , size );
+    return bytes && loadBytes( bytes , size , key , accel , "shared memory" , true );
+}
+
+// publish the built acceleration structure for other processes on the host
+bool AccelCache::SaveShared( unsigned long long key , Accelerator* accel )
+{
+    AccelCacheHeader header;
+    AccelWriter writer;
+    if( !saveBytes( key , accel , header , writer ) )
+        return false;
+    const std::vector<char>& payload = writer.GetData();
+
+    // another process could have published the same structure first , it is loaded then
+    const char* bytes = SMManager::GetSingleton().PublishSceneData( key , sizeof( header ) + payload.size() , [&]( char* dst ){
+        memcpy( dst , &header , sizeof( header ) );
+        memcpy( dst + sizeof( header ) , payload.data() , payload.size() );
+        return true;
+    });
+    if( bytes == nullptr )
+        return false;
+
+    // the built structure is dropped by loading , it is built again if the shared copy can't be loaded
+    if( loadBytes( bytes , sizeof( header ) + payload.size() , key , accel , "shared memory" , true ) )
+        return true;
+    accel->Build();
+    return false;
+}
@@ -0,0 +1,178 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <vector>
+#include <string.h>
+
+class Primitive;
+class Accelerator;
+
+static const unsigned ACCEL_CACHE_VERSION = 2;  /**< Version of the cache file layout, caches of other versions are ignored. */
+
+//! @brief Binary buffer an accelerator writes its built structure into.
+class AccelWriter
+{
+public:
+    //! @brief Append an array of plain data to the buffer.
+    //! @param data     The data to be written.
+    //! @param count    The number of elements.
+    template< class T >
+    void Write( const T* data , size_t count ){
+        const size_t offset = m_data.size();
+        m_data.resize( offset + sizeof( T ) * count );
+        if( count )
+            memcpy( &m_data[offset] , data , sizeof( T ) * count );
+    }
+
+    //! @brief Append one value of plain data to the buffer.
+    template< class T >
+    void Write( const T& value ){ Write( &value , 1 ); }
+
+    //! @brief Pad the buffer so that the next array starts at a multiple of an alignment.
+    //! @param alignment    The alignment in bytes.
+    void Align( size_t alignment ){ m_data.resize( ( m_data.size() + alignment - 1 ) / alignment * alignment , 0 ); }
+
+    //! The written bytes.
+    const std::vector<char>& GetData() const { return m_data; }
+
+private:
+    std::vector<char>   m_data;     /**< The written bytes. */
+};
+
+//! @brief Reader over the payload of a cache file.
+//!
+//! Reading past the end of the payload fails instead of touching memory out of the file, the reader
+//! stays failed afterward so that accelerators only need to check the result at the end.
+class AccelReader
+{
+public:
+    //! @brief Constructor from the payload.
+    //! @param data         The payload, it has to outlive the reader.
+    //! @param size         The size of the payload in bytes.
+    //! @param persistent   Whether the payload outlives the accelerator too, arrays could be used in place then.
+    AccelReader( const char* data , size_t size , bool persistent = false ) : m_data(data) , m_size(size) , m_persistent(persistent) {}
+
+    //! @brief Read an array of plain data.
+    //! @param data     The destination of the data.
+    //! @param count    The number of elements.
+    //! @return         False if there is not enough data left.
+    template< class T >
+    bool Read( T* data , size_t count ){
+        if( !m_ok || sizeof( T ) * count > m_size - m_offset )
+            return m_ok = false;
+        // the math types declare their own copy assignment, they are still plain bytes to fill
+        if( count )
+            memcpy( (void*)data , m_data + m_offset , sizeof( T ) * count );
+        m_offset += sizeof( T ) * count;
+        return true;
+    }
+
+    //! @brief Read one value of plain data.
+    template< class T >
+    bool Read( T& value ){ return Read( &value , 1 ); }
+
+    //! @brief Refer to an array of plain data in place instead of reading it.
+    //!
+    //! It only works with a persistent payload in which the array is aligned, the array is left unread otherwise.
+    //! @param count    The number of elements.
+    //! @return         The array in the payload, it is nullptr if it has to be read.
+    template< class T >
+    const T* View( size_t count ){
+        const char* ptr = m_data + m_offset;
+        if( !m_persistent || !m_ok || sizeof( T ) * count > m_size - m_offset || (size_t)ptr % alignof( T ) != 0 )
+            return nullptr;
+        m_offset += sizeof( T ) * count;
+        return (const T*)ptr;
+    }
+
+    //! @brief Skip the padding written by AccelWriter::Align.
+    //! @param alignment    The alignment in bytes.
+    bool Align( size_t alignment ){
+        const size_t padding = ( alignment - m_offset % alignment ) % alignment;
+        if( !m_ok || padding > m_size - m_offset )
+            return m_ok = false;
+        m_offset += padding;
+        return true;
+    }
+
+    //! Whether all reads succeeded and the whole payload is consumed.
+    bool IsComplete() const { return m_ok && m_offset == m_size; }
+
+private:
+    const char* m_data;             /**< The payload. */
+    size_t      m_size;             /**< The size of the payload. */
+    size_t      m_offset = 0;       /**< The offset of the next read. */
+    bool        m_ok = true;        /**< Whether all reads so far succeeded. */
+    bool        m_persistent;       /**< Whether the payload outlives the accelerator. */
+};
+
+//! @brief Cache of built acceleration structures on disk.
+/**
+ * Building the acceleration structure of a large scene takes long, while the geometry is usually unchanged
+ * between two renderings of the same scene. The built structure is stored in a versioned binary file next
+ * to the scene, keyed by a hash of the primitive data and the build parameters. The file is mapped back into
+ * memory on the next run instead of rebuilding, a cache with a different key or a corrupted one is ignored.
+ * Processes rendering the same scene on one host could share the built structure in shared memory too,
+ * accelerators refer to the arrays of the shared payload in place where they can.
+ */
+class AccelCache
+{
+public:
+    //! @brief Compute the key of an acceleration structure.
+    //! @param primitives   The primitive set of the acceleration structure, the order of primitives matters.
+    //! @param params       The type of the accelerator and its build parameters.
+    //! @return             The hash of the primitive data and the parameters.
+    static unsigned long long Key( const std::vector<Primitive*>& primitives , const std::string& params );
+
+    //! @brief Hash a range of bytes , it is the hash used for keys and checksums of cache files.
+    //! @param data     The bytes to be hashed.
+    //! @param size     The number of bytes.
+    //! @return         The FNV-1a hash of the bytes.
+    static unsigned long long Hash( const void* data , size_t size );
+
+    //! @brief Load the acceleration structure from a cache file.
+    //! @param filename     The name of the cache file.
+    //! @param key          The expected key of the cache.
+    //! @param accel        The accelerator to be loaded, its primitive set has to be set already.
+    //! @return             True if the accelerator is loaded from the cache.
+    static bool Load( const std::string& filename , unsigned long long key , Accelerator* accel );
+
+    //! @brief Store the built acceleration structure in a cache file.
+    //! @param filename     The name of the cache file.
+    //! @param key          The key of the cache.
+    //! @param accel        The built accelerator.
+    //! @return             True if the cache file is written.
+    static bool Save( const std::string& filename , unsigned long long key , const Accelerator* accel );
+
+    //! @brief Load the acceleration structure published by another process on the host.
+    //! @param key          The expected key of the structure.
+    //! @param accel        The accelerator to be loaded, its primitive set has to be set already.
+    //! @return             True if the accelerator is loaded from shared memory.
+    static bool LoadShared( unsigned long long key , Accelerator* accel );
+
+    //! @brief Publish the built acceleration structure for other processes on the host.
+    //!
+    //! The accelerator is loaded back from the shared copy afterward so that the arrays it could refer to
+    //! in place are not kept twice.
+    //! @param key          The key of the structure.
+    //! @param accel        The built accelerator.
+    //! @return             True if the accelerator refers to the shared copy.
+    static bool SaveShared( unsigned long long key , Accelerator* accel );
+};
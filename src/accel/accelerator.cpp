@@ -17,6 +17,7 @@
 
 #include "accelerator.h"
 #include "geometry/primitive.h"
+#include "geometry/intersection.h"
 
 // Generate the bounding box for the primitive set.
 void Accelerator::computeBBox()
@@ -34,3 +35,17 @@ void Accelerator::computeBBox()
 	m_bbox.m_Min -= delta;
 	m_bbox.m_Max += delta;
 }
+
+// get the nearest intersections of a stream of rays one by one
+void Accelerator::GetIntersect( const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const
+{
+	for( unsigned i = 0 ; i < count ; ++i )
+		results[i] = GetIntersect( rays[i] , &intersects[i] );
+}
+
+// check whether each ray in a stream is blocked by any primitive
+void Accelerator::IsOccluded( const Ray* rays , bool* results , unsigned count ) const
+{
+	for( unsigned i = 0 ; i < count ; ++i )
+		results[i] = IsOccluded( rays[i] );
+}
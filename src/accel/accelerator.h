@@ -21,10 +21,15 @@
 #include <vector>
 #include "geometry/bbox.h"
 #include "utility/creator.h"
+#include "utility/propertyset.h"
 
 class Primitive;
 class Intersection;
 class Ray;
+class AccelWriter;
+class AccelReader;
+class StatsGroup;
+struct GpuTree;
 
 //! @brief Spatial acceleration structure interface.
 /**
@@ -35,8 +40,10 @@ class Ray;
  * can optimize the algorithm so that it is O(M*lg(N)), a significant improvement over
  * the naive brute force ray tracing.
  * Common spatial structures inlcude KD-Tree, BVH and Uniform Grid.
+ * Accelerators could expose build options as properties, which are set from the
+ * 'Property' nodes under the 'Accel' node in the scene file.
  */
-class	Accelerator
+class	Accelerator : public PropertySet<Accelerator>
 {
 public:
 	//! Destructor of Accelerator, nothing is done in it.
@@ -59,12 +66,77 @@ public:
     //! @return             It will return true if there is an intersection, otherwise it returns false.
 	virtual bool GetIntersect( const Ray& r , Intersection* intersect ) const = 0;
 
+    //! @brief Check whether the ray is blocked by any primitive.
+    //!
+    //! This is the query for shadow rays. It stops as soon as any intersection is found and no
+    //! intersection information is filled. Accelerators are expected to override it with a traversal
+    //! that returns at the first blocking primitive, the default one falls back to GetIntersect.
+    //! @param r    The input ray to be tested.
+    //! @return     It will return true if there is any intersection, otherwise it returns false.
+	virtual bool IsOccluded( const Ray& r ) const { return GetIntersect( r , nullptr ); }
+
+    //! @brief Get the nearest intersections of a stream of rays.
+    //!
+    //! Coherent rays, like camera rays of the same pixel, could share the traversal of the acceleration structure.
+    //! Accelerators are expected to override it with a packet traversal, the default one tests the rays one by one.
+    //! @param rays         The rays to be tested.
+    //! @param intersects   The intersection results, one for each ray. Their distances have to be initialized.
+    //! @param results      Whether each ray hits any primitive.
+    //! @param count        The number of rays in the stream.
+	virtual void GetIntersect( const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const;
+
+    //! @brief Check whether each ray in a stream is blocked by any primitive.
+    //!
+    //! It is the query for batches of shadow rays, the default one tests the rays one by one.
+    //! @param rays         The rays to be tested.
+    //! @param results      Whether each ray is blocked by any primitive.
+    //! @param count        The number of rays in the stream.
+	virtual void IsOccluded( const Ray* rays , bool* results , unsigned count ) const;
+
     //! @brief Build the acceleration structure.
 	virtual void Build() = 0;
 
+    //! @brief Write the built acceleration structure so that it could be loaded instead of rebuilt next time.
+    //!
+    //! Primitives are referenced by their indices in the primitive set, the default one doesn't support it.
+    //! @param stream   The buffer to write into.
+    //! @return         False if the accelerator doesn't support serialization.
+	virtual bool Serialize( AccelWriter& stream ) const { return false; }
+
+    //! @brief Load the acceleration structure written by Serialize instead of building it.
+    //!
+    //! The primitive set has to be the same with the one during serialization.
+    //! @param stream   The payload to read from.
+    //! @return         False if the accelerator doesn't support serialization or the data is invalid, nothing is loaded in this case.
+	virtual bool Deserialize( AccelReader& stream ) { return false; }
+
 	//! @brief Output log information.
 	virtual void OutputLog() const = 0;
 
+    //! @brief Add the type and the shape of the built acceleration structure to a group of the statistics report.
+    //! @param stats    The group of the accelerator.
+	virtual void CollectStats( StatsGroup& stats ) const {}
+
+    //! @brief Get the memory taken by the built acceleration structure.
+    //!
+    //! Only the memory used during traversal is counted, temporary data during construction is not.
+    //! @return The size of the acceleration structure in bytes, it is 0 if the accelerator doesn't report it.
+	virtual size_t GetMemoryUsage() const { return 0; }
+
+    //! @brief Get the order in which leaves of the built acceleration structure reference the primitives.
+    //!
+    //! Primitives of the same leaf are next to each other in the order, so that their data could be laid out to share cache lines.
+    //! @param order    The indices of primitives in the primitive set, primitives not referenced by any leaf are not in it.
+    //! @return         False if the accelerator doesn't report the order.
+	virtual bool GetPrimitiveOrder( std::vector<unsigned>& order ) const { return false; }
+
+    //! @brief Flatten the built acceleration structure into nodes and world space primitives that could be traced on the GPU.
+    //!
+    //! Only binary trees of static triangles and analytic shapes could be flattened this way.
+    //! @param tree     The flattened tree.
+    //! @return         False if the accelerator doesn't support it or there is any primitive tested with its own routine.
+	virtual bool ExportGpuTree( GpuTree& tree ) const { return false; }
+
 	//! @brief Get the bounding box of the primitive set.
     //! @return Bounding box of the spatial acceleration structure.
 	const BBox& GetBBox() const { return m_bbox; }
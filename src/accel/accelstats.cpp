@@ -0,0 +1,75 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "accelstats.h"
+#include "log/log.h"
+#include "utility/define.h"
+#include "utility/strhelper.h"
+#include <mutex>
+
+// counters of each thread
+static Thread_Local AccelStats g_localStats;
+
+// counters of the finished threads
+static AccelStats g_totalStats;
+static std::mutex g_statsMutex;
+
+// counters of the current thread
+AccelStats& AccelStats::Local()
+{
+    return g_localStats;
+}
+
+// merge the counters of the current thread into the total
+void AccelStats::Flush()
+{
+    std::lock_guard<std::mutex> lock( g_statsMutex );
+    g_totalStats.rays += g_localStats.rays;
+    g_totalStats.nodes += g_localStats.nodes;
+    g_totalStats.primitives += g_localStats.primitives;
+    g_totalStats.earlyOuts += g_localStats.earlyOuts;
+    g_localStats = AccelStats();
+}
+
+// clear all counters
+void AccelStats::Reset()
+{
+    std::lock_guard<std::mutex> lock( g_statsMutex );
+    g_totalStats = AccelStats();
+    g_localStats = AccelStats();
+}
+
+// get the total
+AccelStats AccelStats::Total()
+{
+    std::lock_guard<std::mutex> lock( g_statsMutex );
+    AccelStats total = g_totalStats;
+    total.rays += g_localStats.rays;
+    total.nodes += g_localStats.nodes;
+    total.primitives += g_localStats.primitives;
+    total.earlyOuts += g_localStats.earlyOuts;
+    return total;
+}
+
+// output the total
+void AccelStats::OutputLog()
+{
+    const AccelStats total = Total();
+    const double rays = (double)max( total.rays , 1ULL );
+    slog( INFO , PERFORMANCE , stringFormat( "Traversal statistics: %llu rays, %llu nodes visited, %llu primitives tested, %llu early-outs." , total.rays , total.nodes , total.primitives , total.earlyOuts ) );
+    slog( INFO , PERFORMANCE , stringFormat( "Per ray, %.2f nodes are visited, %.2f primitives are tested, %.2f visits are skipped." , total.nodes / rays , total.primitives / rays , total.earlyOuts / rays ) );
+}
@@ -0,0 +1,59 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+
+//! @brief Statements only compiled with SORT_ACCEL_STATS enabled.
+//!
+//! Counting is wrapped in it so that traversal code pays nothing for the counters in regular builds.
+#if SORT_ACCEL_STATS
+#define SORT_STATS(...)     __VA_ARGS__
+#else
+#define SORT_STATS(...)
+#endif
+
+//! @brief Counters of the work done during ray traversal.
+/**
+ * Each thread counts in its own copy so that there is no synchronization during traversal, the copy of
+ * a render thread is merged into the total once the thread finishes. The counters tell how good the
+ * acceleration structure of a scene is, they are helpful to tune the build parameters of accelerators.
+ * There is no member initializer since it is a thread local variable, they are zero-initialized with it.
+ */
+struct AccelStats
+{
+    unsigned long long  rays;           /**< Number of rays traced in the scene. */
+    unsigned long long  nodes;          /**< Number of nodes, voxels or leaves visited. */
+    unsigned long long  primitives;     /**< Number of primitives tested against rays. */
+    unsigned long long  earlyOuts;      /**< Number of visits skipped because of an intersection found already. */
+
+    //! Counters of the current thread.
+    static AccelStats& Local();
+
+    //! Merge the counters of the current thread into the total and clear them.
+    static void Flush();
+
+    //! Clear the total along with the counters of the current thread.
+    static void Reset();
+
+    //! The total along with the counters of the current thread.
+    static AccelStats Total();
+
+    //! Output the total to the performance log.
+    static void OutputLog();
+};
@@ -21,13 +21,52 @@
 #include "log/log.h"
 #include "managers/memmanager.h"
 #include "geometry/intersection.h"
+#include "accelcache.h"
+#include "accelstats.h"
+#include "utility/statsreport.h"
+#include "utility/hugepage.h"
+#include "gpuquery.h"
+#include "utility/multithread/threadpool.h"
+#include <mutex>
+#include <unordered_map>
+#include <limits>
 
-static const unsigned   BVH_LEAF_PRILIST_MEMID  = 1027;
+static const unsigned   BVH_LEAF_PRILIST_MEMID  = 1027;   // the first arena of primitive lists , bvhs built at the same time take the following ones
 static const unsigned   BVH_SPLIT_COUNT         = 16;
 static const float      BVH_INV_SPLIT_COUNT     = 0.0625f;
+static const unsigned   BVH_PARALLEL_THRESHOLD  = 65536;    // nodes with more primitives spread bounding box and binning work across the thread pool
+static const unsigned   BVH_FORK_THRESHOLD      = 4096;     // both children need more primitives than this to be built as separate jobs
+static const unsigned   BVH_MAX_CHUNK           = 32;       // maximum number of chunks a parallel loop is split into
+static const float      SBVH_OVERLAP_THRESHOLD  = 0.00001f; // spatial splits are only tried if the children of the object split overlap more than this, relative to the root
 
 IMPLEMENT_CREATOR( Bvh );
 
+static_assert( sizeof( Bvh::Bvh_Linear_Node ) == 32 , "Flattened BVH node is expected to be 32 bytes." );
+
+// decode a quantized bound relative to the range of the parent, both ends of the range are exact
+template< class T >
+static inline float dequantizeBound( T q , float _min , float _max )
+{
+    const unsigned q_max = std::numeric_limits<T>::max();
+    if( q == 0 )
+        return _min;
+    if( q == q_max )
+        return _max;
+    return _min + ( _max - _min ) * ( (float)q / (float)q_max );
+}
+
+// decode the bounding box of a child of a quantized node
+template< class T >
+static inline BBox decodeBounds( const T bounds[2][3][2] , unsigned child , const BBox& box )
+{
+    BBox decoded;
+    for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+        decoded.m_Min[axis] = dequantizeBound<T>( bounds[0][axis][child] , box.m_Min[axis] , box.m_Max[axis] );
+        decoded.m_Max[axis] = dequantizeBound<T>( bounds[1][axis][child] , box.m_Min[axis] , box.m_Max[axis] );
+    }
+    return decoded;
+}
+
 // destructor
 Bvh::~Bvh()
 {
@@ -38,53 +77,1052 @@ Bvh::~Bvh()
 void Bvh::OutputLog() const
 {
     slog( INFO , SPATIAL_ACCELERATOR , "Spatial accelerator type is BVH ( Bounding Volume Hierarchy )." );
+    if( m_sbvh )
+        slog( INFO , SPATIAL_ACCELERATOR , stringFormat( "Spatial splits are enabled, there are %d primitive references for %d primitives." , m_refCount , (unsigned)m_primitives->size() ) );
+    if( m_qnodes ){
+        const unsigned qnode_size = ( m_compressBits == 8 ) ? sizeof( Bvh_Quantized_Node<unsigned char> ) : sizeof( Bvh_Quantized_Node<unsigned short> );
+        slog( INFO , SPATIAL_ACCELERATOR , stringFormat( "BVH nodes are quantized to %d bits, they take %d bytes instead of %d bytes." , m_compressBits , m_qnodeCount * qnode_size , m_totalNode * (unsigned)sizeof( Bvh_Linear_Node ) ) );
+    }
     slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "Maximum depth in BVH tree is %d. Total number of nodes in it is %d, number of inner nodes is %d, number of leaf nodes is %d. Average number of triangles per leaf nodes is %f, maximum number of triangles in leaf nodes is %d" , m_bvhDepth , m_totalNode , m_totalNode - m_leafNode , m_leafNode , (((float)m_primitives->size())/m_leafNode) , m_maxPriInLeaf ) );
 }
 
+// add the shape of the bvh to the report
+void Bvh::CollectStats( StatsGroup& stats ) const
+{
+    stats.Add( "type" , "bvh" ).Add( "depth" , m_bvhDepth ).Add( "nodes" , m_totalNode ).Add( "leaves" , m_leafNode )
+         .Add( "max_leaf_primitives" , m_maxLeafTriNum ).Add( "avg_leaf_primitives" , m_leafNode ? (float)m_primitives->size() / m_leafNode : 0.0f )
+         .Add( "spatial_splits" , m_sbvh ).Add( "references" , m_sbvh ? m_refCount : (unsigned)m_primitives->size() ).Add( "quantized_bits" , m_qnodes ? m_compressBits : 0u );
+}
+
+// memory taken by the bvh
+size_t Bvh::GetMemoryUsage() const
+{
+    size_t size = sizeof( TrianglePacket ) * m_packetCount;
+    if( m_qnodes )
+        size += m_qnodeCount * ( ( m_compressBits == 8 ) ? sizeof( Bvh_Quantized_Node<unsigned char> ) : sizeof( Bvh_Quantized_Node<unsigned short> ) );
+    else if( m_nodes && !m_sharedNodes )
+        size += m_totalNode * sizeof( Bvh_Linear_Node );
+    if( m_motion )
+        size += m_totalNode * sizeof( Bvh_Motion_Bounds );
+    if( m_hidden )
+        size += m_totalNode;
+    return size;
+}
+
+// get the order of primitives in the leaf nodes
+bool Bvh::GetPrimitiveOrder( std::vector<unsigned>& order ) const
+{
+    if( m_packets == nullptr )
+        return false;
+
+    std::unordered_map<const Primitive*,unsigned> ids;
+    for( unsigned i = 0 ; i < (unsigned)m_primitives->size() ; ++i )
+        ids[(*m_primitives)[i]] = i;
+
+    order.clear();
+    std::vector<bool> visited( m_primitives->size() , false );
+    for( unsigned k = 0 ; k < m_packetCount ; ++k ){
+        for( unsigned i = 0 ; i < 4 && m_packets[k].primitive[i] ; ++i ){
+            const unsigned id = ids[m_packets[k].primitive[i]];
+            if( !visited[id] ){
+                visited[id] = true;
+                order.push_back( id );
+            }
+        }
+    }
+    return true;
+}
+
+// flatten the tree for the GPU
+bool Bvh::ExportGpuTree( GpuTree& tree ) const
+{
+    if( m_nodes == nullptr || m_packets == nullptr || m_motion != nullptr || m_hidden != nullptr )
+        return false;
+    for( unsigned k = 0 ; k < m_packetCount ; ++k ){
+        if( m_packets[k].type == PACKET_GENERIC || m_packets[k].cutout )
+            return false;
+    }
+
+    tree.nodes.resize( m_totalNode );
+    tree.primitives.clear();
+    tree.sources.clear();
+    for( unsigned id = 0 ; id < m_totalNode ; ++id ){
+        const Bvh_Linear_Node& node = m_nodes[id];
+        GpuNode& gpu_node = tree.nodes[id];
+        for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+            gpu_node.bmin[axis] = node.bbox.m_Min[axis];
+            gpu_node.bmax[axis] = node.bbox.m_Max[axis];
+        }
+        gpu_node.count = node.pri_num;
+        gpu_node.offset = node.offset;
+        if( node.pri_num == 0 )
+            continue;
+
+        // the lanes of the packets of the leaf are laid out one after another , duplicated references keep their own entries
+        gpu_node.offset = (unsigned)tree.primitives.size();
+        for( unsigned k = node.offset , left = node.pri_num ; left > 0 ; left -= m_packets[k++].count ){
+            const TrianglePacket& tp = m_packets[k];
+            for( unsigned i = 0 ; i < tp.count ; ++i ){
+                GpuPrimitive primitive;
+                for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+                    primitive.p0[axis] = tp.p0[axis][i];
+                    primitive.e1[axis] = tp.e1[axis][i];
+                    primitive.e2[axis] = tp.e2[axis][i];
+                }
+                primitive.type = tp.type;
+                primitive.source = (unsigned)tree.sources.size();
+                primitive.padding = 0;
+                tree.sources.push_back( tp.primitive[i] );
+                tree.primitives.push_back( primitive );
+            }
+        }
+    }
+    return true;
+}
+
+// register all properties
+void Bvh::_registerAllProperty()
+{
+	_registerProperty( "sbvh" , new SbvhProperty(this) );
+	_registerProperty( "sbvh_budget" , new SbvhBudgetProperty(this) );
+	_registerProperty( "refit" , new RefitProperty(this) );
+	_registerProperty( "refit_threshold" , new RefitThresholdProperty(this) );
+	_registerProperty( "compress" , new CompressProperty(this) );
+}
+
+// the arenas of primitive lists not taken by any construction
+static std::mutex               g_freeArenaMutex;
+static std::vector<unsigned>    g_freeArenas;
+static unsigned                 g_arenaCount = 0;
+
+// take an arena for the primitive list of a construction , constructions running at the same time never share one
+static unsigned acquireArena()
+{
+    std::lock_guard<std::mutex> lock( g_freeArenaMutex );
+    if( g_freeArenas.empty() )
+        return BVH_LEAF_PRILIST_MEMID + g_arenaCount++;
+    const unsigned id = g_freeArenas.back();
+    g_freeArenas.pop_back();
+    return id;
+}
+
+// return an arena once the primitive list is released
+static void releaseArena( unsigned id )
+{
+    std::lock_guard<std::mutex> lock( g_freeArenaMutex );
+    g_freeArenas.push_back( id );
+}
+
 // malloc the memory
-void Bvh::mallocMemory()
+void Bvh::mallocMemory( unsigned count )
+{
+    if( m_bvhpri == nullptr )
+        m_arena = acquireArena();
+	SORT_PREMALLOC( sizeof( Bvh_Primitive ) * count , m_arena );
+	m_bvhpri = SORT_MEMORY_ID( Bvh_Primitive , m_arena );
+}
+
+// release the primitive buffer used during construction
+void Bvh::releasePrimitives()
 {
-	SORT_PREMALLOC( (unsigned)(sizeof( Bvh_Primitive ) * m_primitives->size()) , BVH_LEAF_PRILIST_MEMID );
-	m_bvhpri = SORT_MEMORY_ID( Bvh_Primitive , BVH_LEAF_PRILIST_MEMID );
+	if( m_bvhpri ){
+		SORT_DEALLOC( m_arena );
+		releaseArena( m_arena );
+		m_bvhpri = nullptr;
+	}
 }
 
 // dealloc memory
 void Bvh::deallocMemory()
 {
-	SORT_DEALLOC( BVH_LEAF_PRILIST_MEMID );
+	releasePrimitives();
     deleteNode( m_root );
+    m_root = nullptr;
+    if( !m_sharedNodes )
+        HugePages::Free( m_nodes );
+    m_nodes = nullptr;
+    m_sharedNodes = false;
+    HugePages::Free( m_packets );
+    m_packets = nullptr;
+    m_packetCount = 0;
+    HugePages::Free( m_qnodes );
+    m_qnodes = nullptr;
+    m_qnodeCount = 0;
+    m_qrootPriNum = 0;
+    HugePages::Free( m_motion );
+    m_motion = nullptr;
+    HugePages::Free( m_hidden );
+    m_hidden = nullptr;
 }
 
 // build the acceleration structure
 void Bvh::Build()
 {
-	// malloc memory
-	mallocMemory();
+    // keep the topology of the previous build and only update the bounding boxes if possible
+    // shared nodes are read-only , the tree is built again instead
+    if( m_refit && m_nodes && !m_sharedNodes && m_builtPriNum == (unsigned)m_primitives->size() ){
+        if( refit() ){
+            buildMotionBounds();
+            buildHiddenMasks();
+            return;
+        }
+    }
+    deallocMemory();
+
+    // an empty scene has no tree at all, every ray misses its empty bounding box before any node is visited
+    if( m_primitives->empty() ){
+        computeBBox();
+        m_totalNode = m_leafNode = m_bvhDepth = m_maxLeafTriNum = 0;
+        m_builtPriNum = 0;
+        return;
+    }
+
+	// build the binary tree
+	buildTree();
+
+    // flatten the tree so that traversal doesn't need to chase pointers
+    m_nodes = (Bvh_Linear_Node*)HugePages::Alloc( sizeof( Bvh_Linear_Node ) * m_totalNode , alignof( Bvh_Linear_Node ) );
+    unsigned offset = 0;
+    std::vector<TrianglePacket> packets;
+    flattenNode( m_root , offset , packets );
+    storePackets( packets );
+    releasePrimitives();
 
+    // the quality of the tree is recorded so that refitting knows when to give up
+    m_buildSah = evaluateSah();
+    m_builtPriNum = (unsigned)m_primitives->size();
+
+    // moving primitives need the linear bounds of the flattened nodes , which quantized nodes can't hold
+    buildMotionBounds();
+    buildHiddenMasks();
+    if( m_motion && m_compressBits ){
+        slog( WARNING , SPATIAL_ACCELERATOR , "BVH nodes are not quantized since some primitives move." );
+    }
+    // quantized nodes replace the flattened ones to save memory
+    else if( m_compressBits == 8 )
+        compressNodes<unsigned char>();
+    else if( m_compressBits == 16 )
+        compressNodes<unsigned short>();
+
+    // the pointer based tree is not needed anymore
+    deleteNode( m_root );
+    m_root = nullptr;
+}
+
+// split the range into consecutive chunks and process them in the thread pool
+template< class Func >
+unsigned Bvh::parallelFor( unsigned _start , unsigned _end , const Func& func )
+{
+    // small ranges are not worth the cost of scheduling jobs
+    const unsigned count = _end - _start;
+    if( count <= BVH_PARALLEL_THRESHOLD ){
+        func( 0u , _start , _end );
+        return 1;
+    }
+
+    // the grain keeps the number of chunks within the per chunk arrays of the callers
+    const unsigned grain = ( count + BVH_MAX_CHUNK - 1 ) / BVH_MAX_CHUNK;
+    ParallelFor( _start , _end , grain , func );
+    return ParallelChunkCount( count , grain );
+}
+
+// build the pointer based binary tree
+void Bvh::buildTree()
+{
+    // the statistics of a previous build are discarded
+    m_totalNode = 0;
+    m_leafNode = 0;
+    m_bvhDepth = 0;
+    m_maxLeafTriNum = 0;
+
+    if( m_sbvh ){
+        buildSpatialTree();
+    }else{
+        // malloc memory
+        const unsigned pri_num = (unsigned)m_primitives->size();
+        mallocMemory( pri_num );
+
+        // generate bvh primitives, bounding boxes of primitives are evaluated into the array along the way
+        Bvh_Primitive* bvhpri = MemManager::GetSingleton().GetPtr<Bvh_Primitive>( pri_num , m_arena );
+        parallelFor( 0u , pri_num , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+            for( unsigned i = _start ; i < _end ; i++ )
+                new (&bvhpri[i]) Bvh_Primitive( (*m_primitives)[i] );
+        });
+
+        // build bounding box
+        computeBBox();
+
+        // recursively split node
+        m_root = new Bvh_Node();
+        splitNode( m_root , 0u , pri_num , 0u );
+    }
+
+    // the statistics are collected afterward since sub-trees are built concurrently
+    collectStats( m_root , 0u );
+}
+
+// build the pointer based binary tree with spatial splits
+void Bvh::buildSpatialTree()
+{
 	// build bounding box
 	computeBBox();
+    m_rootArea = m_bbox.HalfSurfaceArea();
+
+    // each primitive is referenced once initially
+    const unsigned pri_num = (unsigned)m_primitives->size();
+    std::vector<Bvh_Reference> refs( pri_num );
+    for( unsigned i = 0 ; i < pri_num ; i++ ){
+        refs[i].primitive = (*m_primitives)[i];
+        refs[i].bbox = refs[i].primitive->GetBBox();
+    }
+    m_refCount = pri_num;
+    m_refLimit = (unsigned)( pri_num * ( 1.0f + m_sbvhBudget ) );
 
-	// generate bvh primitives
-    for( auto primitive : *m_primitives )
-        SORT_MALLOC_ID(Bvh_Primitive,BVH_LEAF_PRILIST_MEMID)(primitive);
-    
 	// recursively split node
+    std::vector<Primitive*> leaf_pris;
     m_root = new Bvh_Node();
-	splitNode( m_root , 0u , (unsigned)m_primitives->size() , 0u );
+    splitSpatialNode( m_root , refs , 0u , leaf_pris );
+
+    // the leaf nodes reference primitives in the buffer, some of them could be referenced more than once
+    m_refCount = (unsigned)leaf_pris.size();
+    mallocMemory( m_refCount );
+    for( auto primitive : leaf_pris )
+        SORT_MALLOC_ID(Bvh_Primitive,m_arena)(primitive);
 }
 
-// recursively split BVH node
-void Bvh::splitNode( Bvh_Node* node , unsigned _start , unsigned _end , unsigned depth )
+// split the node with object splits or spatial splits
+void Bvh::splitSpatialNode( Bvh_Node* node , std::vector<Bvh_Reference>& refs , unsigned depth , std::vector<Primitive*>& leaf_pris )
+{
+    for( const auto& ref : refs )
+        node->bbox.Union( ref.bbox );
+
+    auto make_leaf = [&](){
+        const unsigned offset = (unsigned)leaf_pris.size();
+        for( const auto& ref : refs )
+            leaf_pris.push_back( ref.primitive );
+        makeLeaf( node , offset , (unsigned)leaf_pris.size() );
+    };
+
+    const unsigned tri_num = (unsigned)refs.size();
+	if( tri_num <= m_maxPriInLeaf || depth + 1 >= BVH_MAX_DEPTH ){
+		make_leaf();
+		return;
+	}
+
+    // pick the best object split first
+    unsigned obj_axis = 0;
+    float obj_pos = 0.0f;
+    BBox obj_lbox , obj_rbox;
+    const float obj_sah = pickObjectSplit( obj_axis , obj_pos , obj_lbox , obj_rbox , node , refs );
+
+    // spatial splits only pay off if the children of the object split overlap a lot
+    unsigned spa_axis = 0;
+    float spa_pos = 0.0f;
+    float spa_sah = FLT_MAX;
+    const BBox overlap = Overlap( obj_lbox , obj_rbox );
+    if( m_refCount < m_refLimit && overlap.IsValid() && overlap.HalfSurfaceArea() > SBVH_OVERLAP_THRESHOLD * m_rootArea )
+        spa_sah = pickSpatialSplit( spa_axis , spa_pos , node , refs );
+
+	if( min( obj_sah , spa_sah ) >= tri_num ){
+		make_leaf();
+		return;
+	}
+
+    std::vector<Bvh_Reference> left , right;
+    if( spa_sah < obj_sah ){
+        splitReferences( spa_axis , spa_pos , node , refs , left , right );
+    }else{
+        for( const auto& ref : refs ){
+            if( ( ref.bbox.m_Min[obj_axis] + ref.bbox.m_Max[obj_axis] ) * 0.5f < obj_pos )
+                left.push_back( ref );
+            else
+                right.push_back( ref );
+        }
+    }
+    if( left.empty() || right.empty() ){
+		make_leaf();
+		return;
+	}
+
+    // the references of the node are not needed anymore
+    std::vector<Bvh_Reference>().swap( refs );
+
+    node->left = new Bvh_Node();
+	splitSpatialNode( node->left , left , depth + 1 , leaf_pris );
+    node->right = new Bvh_Node();
+	splitSpatialNode( node->right , right , depth + 1 , leaf_pris );
+}
+
+// pick the best object split of primitive references
+float Bvh::pickObjectSplit( unsigned& axis , float& split_pos , BBox& lbox , BBox& rbox , const Bvh_Node* node , const std::vector<Bvh_Reference>& refs )
+{
+	BBox inner;
+    for( const auto& ref : refs )
+        inner.Union( ( ref.bbox.m_Min + ref.bbox.m_Max ) * 0.5f );
+
+	const unsigned tri_num = (unsigned)refs.size();
+	axis = inner.MaxAxisId();
+	float min_sah = FLT_MAX;
+
+	// all centroids are at the same position, there is no way to split them
+	if( inner.Delta(axis) <= 0.0f )
+		return min_sah;
+
+	// distribute the references into bins
+	unsigned	bin[BVH_SPLIT_COUNT];
+	BBox		bbox[BVH_SPLIT_COUNT];
+	BBox		rboxes[BVH_SPLIT_COUNT-1];
+	memset( bin , 0 , sizeof( unsigned ) * BVH_SPLIT_COUNT );
+	const float split_start = inner.m_Min[axis];
+	const float split_delta = inner.Delta(axis) * BVH_INV_SPLIT_COUNT;
+	const float inv_split_delta = 1.0f / split_delta;
+    for( const auto& ref : refs ){
+		int index = (int)(((ref.bbox.m_Min[axis] + ref.bbox.m_Max[axis]) * 0.5f - split_start) * inv_split_delta);
+		index = min( index , (int)(BVH_SPLIT_COUNT - 1) );
+		bin[index]++;
+		bbox[index].Union( ref.bbox );
+	}
+
+	rboxes[BVH_SPLIT_COUNT-2] = bbox[BVH_SPLIT_COUNT-1];
+	for( int i = BVH_SPLIT_COUNT-3; i >= 0 ; i-- )
+		rboxes[i] = Union( rboxes[i+1] , bbox[i+1] );
+
+	unsigned	left = bin[0];
+	BBox		_lbox = bbox[0];
+	float pos = split_delta + split_start ;
+	for( unsigned i = 0 ; i < BVH_SPLIT_COUNT - 1 ; i++ ){
+		float sah_value = sah( left , tri_num - left , _lbox , rboxes[i] , node->bbox );
+		if( sah_value < min_sah ){
+			min_sah = sah_value;
+			split_pos = pos;
+            lbox = _lbox;
+            rbox = rboxes[i];
+		}
+		left += bin[i+1];
+		_lbox.Union( bbox[i+1] );
+		pos += split_delta;
+	}
+
+	return min_sah;
+}
+
+// pick the best spatial split of primitive references
+float Bvh::pickSpatialSplit( unsigned& axis , float& split_pos , const Bvh_Node* node , const std::vector<Bvh_Reference>& refs )
+{
+	axis = node->bbox.MaxAxisId();
+	float min_sah = FLT_MAX;
+	if( node->bbox.Delta(axis) <= 0.0f )
+		return min_sah;
+
+	// count the references entering and exiting each bin, the bounding box of each bin only covers the clipped references
+	unsigned	enter[BVH_SPLIT_COUNT];
+	unsigned	leave[BVH_SPLIT_COUNT];
+	BBox		bbox[BVH_SPLIT_COUNT];
+	BBox		rbox[BVH_SPLIT_COUNT-1];
+	memset( enter , 0 , sizeof( unsigned ) * BVH_SPLIT_COUNT );
+	memset( leave , 0 , sizeof( unsigned ) * BVH_SPLIT_COUNT );
+	const float split_start = node->bbox.m_Min[axis];
+	const float split_delta = node->bbox.Delta(axis) * BVH_INV_SPLIT_COUNT;
+	const float inv_split_delta = 1.0f / split_delta;
+    for( const auto& ref : refs ){
+		int first = (int)((ref.bbox.m_Min[axis] - split_start) * inv_split_delta);
+		int last = (int)((ref.bbox.m_Max[axis] - split_start) * inv_split_delta);
+		first = max( 0 , min( first , (int)(BVH_SPLIT_COUNT - 1) ) );
+		last = max( first , min( last , (int)(BVH_SPLIT_COUNT - 1) ) );
+		enter[first]++;
+		leave[last]++;
+
+		if( first == last ){
+			bbox[first].Union( ref.bbox );
+			continue;
+		}
+		for( int i = first ; i <= last ; i++ ){
+			BBox slab = ref.bbox;
+			if( i > first )
+				slab.m_Min[axis] = split_start + split_delta * i;
+			if( i < last )
+				slab.m_Max[axis] = split_start + split_delta * ( i + 1 );
+			const BBox clipped = ref.primitive->GetClippedBBox( slab );
+			if( clipped.IsValid() )
+				bbox[i].Union( clipped );
+		}
+	}
+
+	rbox[BVH_SPLIT_COUNT-2] = bbox[BVH_SPLIT_COUNT-1];
+	for( int i = BVH_SPLIT_COUNT-3; i >= 0 ; i-- )
+		rbox[i] = Union( rbox[i+1] , bbox[i+1] );
+
+	unsigned	left = enter[0];
+	unsigned	right = (unsigned)refs.size();
+	BBox		lbox = bbox[0];
+	for( unsigned i = 0 ; i < BVH_SPLIT_COUNT - 1 ; i++ ){
+		right -= leave[i];
+		float sah_value = sah( left , right , lbox , rbox[i] , node->bbox );
+		if( sah_value < min_sah ){
+			min_sah = sah_value;
+			split_pos = split_start + split_delta * ( i + 1 );
+		}
+		left += enter[i+1];
+		lbox.Union( bbox[i+1] );
+	}
+
+	return min_sah;
+}
+
+// distribute primitive references to both sides of a spatial split plane
+void Bvh::splitReferences( unsigned axis , float split_pos , const Bvh_Node* node , const std::vector<Bvh_Reference>& refs , std::vector<Bvh_Reference>& left , std::vector<Bvh_Reference>& right )
+{
+    // references totally on one side go to that side directly, the others are clipped
+    struct Straddling_Reference{
+        const Bvh_Reference*    ref;
+        BBox                    lbox;
+        BBox                    rbox;
+    };
+    std::vector<Straddling_Reference> straddling;
+    BBox lbox , rbox;
+    for( const auto& ref : refs ){
+        if( ref.bbox.m_Max[axis] <= split_pos ){
+            left.push_back( ref );
+            lbox.Union( ref.bbox );
+        }else if( ref.bbox.m_Min[axis] >= split_pos ){
+            right.push_back( ref );
+            rbox.Union( ref.bbox );
+        }else{
+            BBox lslab = ref.bbox , rslab = ref.bbox;
+            lslab.m_Max[axis] = split_pos;
+            rslab.m_Min[axis] = split_pos;
+            Straddling_Reference s = { &ref , ref.primitive->GetClippedBBox( lslab ) , ref.primitive->GetClippedBBox( rslab ) };
+            if( !s.lbox.IsValid() ){
+                right.push_back( { ref.primitive , s.rbox } );
+                rbox.Union( s.rbox );
+            }else if( !s.rbox.IsValid() ){
+                left.push_back( { ref.primitive , s.lbox } );
+                lbox.Union( s.lbox );
+            }else{
+                straddling.push_back( s );
+                lbox.Union( s.lbox );
+                rbox.Union( s.rbox );
+            }
+        }
+    }
+
+    // straddling references are counted in both sides at the beginning
+    unsigned left_cnt = (unsigned)( left.size() + straddling.size() );
+    unsigned right_cnt = (unsigned)( right.size() + straddling.size() );
+    for( const auto& s : straddling ){
+        // it could be cheaper to put the whole reference in one side only
+        const BBox lunion = Union( lbox , s.ref->bbox );
+        const BBox runion = Union( rbox , s.ref->bbox );
+        const float cost_split = lbox.HalfSurfaceArea() * left_cnt + rbox.HalfSurfaceArea() * right_cnt;
+        const float cost_left = lunion.HalfSurfaceArea() * left_cnt + rbox.HalfSurfaceArea() * ( right_cnt - 1 );
+        const float cost_right = lbox.HalfSurfaceArea() * ( left_cnt - 1 ) + runion.HalfSurfaceArea() * right_cnt;
+
+        // duplicating the reference is not allowed anymore once the memory budget is used up
+        const bool can_split = m_refCount < m_refLimit;
+        if( can_split && cost_split < cost_left && cost_split < cost_right ){
+            left.push_back( { s.ref->primitive , s.lbox } );
+            right.push_back( { s.ref->primitive , s.rbox } );
+            m_refCount++;
+        }else if( cost_left <= cost_right ){
+            left.push_back( *s.ref );
+            lbox = lunion;
+            right_cnt--;
+        }else{
+            right.push_back( *s.ref );
+            rbox = runion;
+            left_cnt--;
+        }
+    }
+}
+
+// collect the statistics of the bvh sub-tree
+void Bvh::collectStats( const Bvh_Node* node , unsigned depth )
 {
 	m_totalNode ++;
 	m_bvhDepth = max( depth , m_bvhDepth );
 
+    // a node without children is a leaf even if it holds no primitive
+    if( node->pri_num != 0 || node->left == nullptr ){
+        m_leafNode++;
+        m_maxLeafTriNum = max( m_maxLeafTriNum , node->pri_num );
+        return;
+    }
+
+    collectStats( node->left , depth + 1 );
+    collectStats( node->right , depth + 1 );
+}
+
+// flatten the bvh sub-tree in depth-first order
+unsigned Bvh::flattenNode( const Bvh_Node* node , unsigned& offset , std::vector<TrianglePacket>& packets )
+{
+    const unsigned id = offset++;
+    Bvh_Linear_Node* linear = new (&m_nodes[id]) Bvh_Linear_Node();
+    linear->bbox = node->bbox;
+    linear->pri_num = node->pri_num;
+    if( node->pri_num != 0 ){
+        linear->offset = packLeaf( node->pri_offset , node->pri_num , packets );
+        return id;
+    }
+
+    flattenNode( node->left , offset , packets );
+    linear->offset = flattenNode( node->right , offset , packets );
+    return id;
+}
+
+// refit the bounding boxes of the flattened tree bottom-up
+bool Bvh::refit()
+{
+    // vertexes have changed, the cached bounding boxes of primitives are out of date
+    parallelFor( 0u , (unsigned)m_primitives->size() , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+        for( unsigned i = _start ; i < _end ; i++ ){
+            (*m_primitives)[i]->ClearBBoxCache();
+            (*m_primitives)[i]->GetBBox();
+        }
+    });
+
+    // leaf nodes are independent of each other, their bounding boxes and triangle packets are updated in parallel
+    parallelFor( 0u , m_totalNode , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+        for( unsigned id = _start ; id < _end ; id++ ){
+            Bvh_Linear_Node& node = m_nodes[id];
+            if( node.pri_num == 0 )
+                continue;
+            node.bbox.InvalidBBox();
+            for( unsigned k = node.offset , left = node.pri_num ; left > 0 ; left -= m_packets[k++].count ){
+                TrianglePacket& tp = m_packets[k];
+                for( unsigned i = 0 ; i < tp.count ; ++i )
+                    node.bbox.Union( tp.primitive[i]->GetBBox() );
+                tp.Pack( tp.primitive , tp.count );
+            }
+        }
+    });
+
+    // interior nodes are stored before their children, a reverse sweep visits children first
+    for( unsigned id = m_totalNode ; id-- > 0 ; ){
+        Bvh_Linear_Node& node = m_nodes[id];
+        if( node.pri_num == 0 )
+            node.bbox = Union( m_nodes[id+1].bbox , m_nodes[node.offset].bbox );
+    }
+    computeBBox();
+
+    // the tree is rebuilt if refitting degrades it too much
+    const float cost = evaluateSah();
+    if( cost > m_buildSah * m_refitThreshold ){
+        slog( INFO , SPATIAL_ACCELERATOR , stringFormat( "SAH cost of the refitted BVH grows from %f to %f, the BVH is rebuilt." , m_buildSah , cost ) );
+        return false;
+    }
+    slog( INFO , SPATIAL_ACCELERATOR , stringFormat( "BVH is refitted, SAH cost changes from %f to %f." , m_buildSah , cost ) );
+    return true;
+}
+
+// evaluate the linear bounds of the flattened nodes bottom-up
+void Bvh::buildMotionBounds()
+{
+    HugePages::Free( m_motion );
+    m_motion = nullptr;
+
+    BBox start , end;
+    bool moving = false;
+    for( unsigned i = 0 ; i < (unsigned)m_primitives->size() && !moving ; i++ )
+        moving = (*m_primitives)[i]->GetMotionBBox( start , end );
+    if( !moving )
+        return;
+
+    m_motion = (Bvh_Motion_Bounds*)HugePages::Alloc( sizeof( Bvh_Motion_Bounds ) * m_totalNode );
+
+    // interior nodes are stored before their children, a reverse sweep visits children first
+    for( unsigned id = m_totalNode ; id-- > 0 ; ){
+        const Bvh_Linear_Node& node = m_nodes[id];
+        Bvh_Motion_Bounds& bounds = *new (&m_motion[id]) Bvh_Motion_Bounds();
+        if( node.pri_num == 0 ){
+            bounds.start = Union( m_motion[id+1].start , m_motion[node.offset].start );
+            bounds.end = Union( m_motion[id+1].end , m_motion[node.offset].end );
+            continue;
+        }
+
+        // static primitives are covered by the same bounding box all the time
+        for( unsigned k = node.offset , left = node.pri_num ; left > 0 ; left -= m_packets[k++].count ){
+            const TrianglePacket& tp = m_packets[k];
+            for( unsigned i = 0 ; i < tp.count ; ++i ){
+                if( !tp.primitive[i]->GetMotionBBox( start , end ) )
+                    start = end = tp.primitive[i]->GetBBox();
+                bounds.start.Union( start );
+                bounds.end.Union( end );
+            }
+        }
+    }
+}
+
+// gather the kinds of rays the flattened nodes are hidden from bottom-up
+void Bvh::buildHiddenMasks()
+{
+    HugePages::Free( m_hidden );
+    m_hidden = nullptr;
+
+    bool hidden = false;
+    for( unsigned k = 0 ; k < m_packetCount && !hidden ; k++ )
+        hidden = m_packets[k].hidden != 0;
+    if( !hidden )
+        return;
+
+    m_hidden = (unsigned char*)HugePages::Alloc( m_totalNode );
+
+    // interior nodes are stored before their children, a reverse sweep visits children first
+    for( unsigned id = m_totalNode ; id-- > 0 ; ){
+        const Bvh_Linear_Node& node = m_nodes[id];
+        if( node.pri_num == 0 ){
+            m_hidden[id] = m_hidden[id+1] & m_hidden[node.offset];
+            continue;
+        }
+
+        unsigned mask = RAY_ALL;
+        for( unsigned k = node.offset , left = node.pri_num ; left > 0 ; left -= m_packets[k++].count )
+            mask &= m_packets[k].HiddenFromAll();
+        m_hidden[id] = (unsigned char)mask;
+    }
+}
+
+// quantize a bound relative to the range of the parent, it is rounded outward so that the decoded bound is conservative
+template< class T >
+static inline T quantizeBound( float v , float _min , float _max , bool upper )
+{
+    const unsigned q_max = std::numeric_limits<T>::max();
+    const float extent = _max - _min;
+    if( !( extent > 0.0f ) )
+        return upper ? (T)q_max : (T)0;
+    const float f = ( v - _min ) / extent * q_max;
+    int q = upper ? (int)ceil( f ) : (int)floor( f );
+    q = min( max( q , 0 ) , (int)q_max );
+
+    // rounding errors of the decoding are fixed by moving one more step outward
+    if( upper ){
+        while( q < (int)q_max && dequantizeBound<T>( (T)q , _min , _max ) < v )
+            ++q;
+    }else{
+        while( q > 0 && dequantizeBound<T>( (T)q , _min , _max ) > v )
+            --q;
+    }
+    return (T)q;
+}
+
+// replace the flattened nodes with quantized ones
+template< class T >
+void Bvh::compressNodes()
+{
+    // the packet of a root leaf is always the first one
+    m_qrootBox = m_nodes[0].bbox;
+    m_qrootPriNum = m_nodes[0].pri_num;
+
+    std::vector<Bvh_Quantized_Node<T>> qnodes;
+    if( m_qrootPriNum == 0 ){
+        qnodes.reserve( m_totalNode / 2 );
+        quantizeNode<T>( 0 , m_qrootBox , qnodes );
+    }
+
+    m_qnodeCount = (unsigned)qnodes.size();
+    if( m_qnodeCount ){
+        m_qnodes = HugePages::Alloc( sizeof( Bvh_Quantized_Node<T> ) * m_qnodeCount , 16 );
+        memcpy( m_qnodes , &qnodes[0] , sizeof( Bvh_Quantized_Node<T> ) * m_qnodeCount );
+    }
+
+    HugePages::Free( m_nodes );
+    m_nodes = nullptr;
+
+    // quantized nodes only skip hidden primitives in the leaves
+    HugePages::Free( m_hidden );
+    m_hidden = nullptr;
+}
+
+// quantize the children of a flattened interior node
+template< class T >
+unsigned Bvh::quantizeNode( unsigned id , const BBox& box , std::vector<Bvh_Quantized_Node<T>>& qnodes ) const
+{
+    const unsigned qid = (unsigned)qnodes.size();
+    qnodes.push_back( Bvh_Quantized_Node<T>() );
+
+    // children are quantized relative to the decoded box of the node, which is what traversal sees
+    const unsigned children[2] = { id + 1 , m_nodes[id].offset };
+    Bvh_Quantized_Node<T> qnode;
+    for( unsigned i = 0 ; i < 2 ; ++i ){
+        const Bvh_Linear_Node& child = m_nodes[children[i]];
+        for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+            qnode.bounds[0][axis][i] = quantizeBound<T>( child.bbox.m_Min[axis] , box.m_Min[axis] , box.m_Max[axis] , false );
+            qnode.bounds[1][axis][i] = quantizeBound<T>( child.bbox.m_Max[axis] , box.m_Min[axis] , box.m_Max[axis] , true );
+        }
+        qnode.pri_num[i] = child.pri_num;
+        qnode.child[i] = ( child.pri_num != 0 ) ? child.offset : quantizeNode<T>( children[i] , decodeBounds<T>( qnode.bounds , i , box ) , qnodes );
+    }
+    qnodes[qid] = qnode;
+    return qid;
+}
+
+// evaluate the SAH cost of the flattened tree
+float Bvh::evaluateSah() const
+{
+    const float root_area = m_nodes[0].bbox.HalfSurfaceArea();
+    if( root_area <= 0.0f )
+        return 0.0f;
+
+    float cost = 0.0f;
+    for( unsigned id = 0 ; id < m_totalNode ; id++ ){
+        if( m_nodes[id].pri_num != 0 )
+            cost += m_nodes[id].pri_num * m_nodes[id].bbox.HalfSurfaceArea();
+    }
+    return cost / root_area;
+}
+
+// pack the primitives of a leaf node into triangle packets
+unsigned Bvh::packLeaf( unsigned pri_offset , unsigned pri_num , std::vector<TrianglePacket>& packets ) const
+{
+    // primitives are grouped by their kinds , a packet never mixes them
+    std::vector<const Primitive*> kinds[PACKET_GENERIC+1];
+    for( unsigned i = 0 ; i < pri_num ; ++i ){
+        Point p0;
+        Vector e1 , e2;
+        const Primitive* primitive = m_bvhpri[pri_offset+i].primitive;
+        kinds[PacketType( primitive , p0 , e1 , e2 )].push_back( primitive );
+    }
+
+    const unsigned first = (unsigned)packets.size();
+    for( const auto& pris : kinds ){
+        for( unsigned i = 0 ; i < (unsigned)pris.size() ; i += 4 ){
+            packets.push_back( TrianglePacket() );
+            packets.back().Pack( &pris[i] , min( (unsigned)pris.size() - i , 4u ) );
+        }
+    }
+    return first;
+}
+
+// check whether a leaf node references existing triangle packets only
+bool Bvh::validLeaf( unsigned packet , unsigned pri_num ) const
+{
+    for( unsigned left = pri_num ; left > 0 ; left -= m_packets[packet++].count ){
+        if( packet >= m_packetCount || m_packets[packet].count > left )
+            return false;
+    }
+    return true;
+}
+
+// copy the triangle packets into aligned memory
+void Bvh::storePackets( const std::vector<TrianglePacket>& packets )
+{
+    m_packetCount = (unsigned)packets.size();
+    if( m_packetCount == 0 )
+        return;
+    m_packets = (TrianglePacket*)HugePages::Alloc( sizeof( TrianglePacket ) * m_packetCount , alignof( TrianglePacket ) );
+    memcpy( m_packets , &packets[0] , sizeof( TrianglePacket ) * m_packetCount );
+}
+
+// write the primitives of all triangle packets
+void Bvh::serializePackets( AccelWriter& stream ) const
+{
+    std::unordered_map<const Primitive*,unsigned> ids;
+    for( unsigned i = 0 ; i < (unsigned)m_primitives->size() ; ++i )
+        ids[(*m_primitives)[i]] = i;
+
+    // empty lanes are written as invalid indices
+    std::vector<unsigned> indices( 4 * m_packetCount , ~0u );
+    for( unsigned k = 0 ; k < m_packetCount ; ++k ){
+        for( unsigned i = 0 ; i < 4 && m_packets[k].primitive[i] ; ++i )
+            indices[4*k+i] = ids[m_packets[k].primitive[i]];
+    }
+    stream.Write( m_packetCount );
+    stream.Write( indices.data() , indices.size() );
+}
+
+// read the primitives of all triangle packets and pack them again
+bool Bvh::deserializePackets( AccelReader& stream )
+{
+    unsigned count = 0;
+    if( !stream.Read( count ) )
+        return false;
+    std::vector<unsigned> indices( 4 * (size_t)count );
+    if( !stream.Read( indices.data() , indices.size() ) )
+        return false;
+
+    std::vector<TrianglePacket> packets( count );
+    for( unsigned k = 0 ; k < count ; ++k ){
+        const Primitive* pris[4];
+        unsigned lanes = 0;
+        while( lanes < 4 && indices[4*k+lanes] != ~0u ){
+            if( indices[4*k+lanes] >= m_primitives->size() )
+                return false;
+            pris[lanes] = (*m_primitives)[indices[4*k+lanes]];
+            ++lanes;
+        }
+        // packets of other kinds of primitives or empty ones are never written
+        if( lanes == 0 || !packets[k].Pack( pris , lanes ) )
+            return false;
+    }
+    storePackets( packets );
+    return true;
+}
+
+// write the flattened BVH
+bool Bvh::Serialize( AccelWriter& stream ) const
+{
+    if( m_nodes == nullptr )
+        return false;
+
+    stream.Write( m_bbox );
+    stream.Write( m_totalNode );
+    stream.Write( m_leafNode );
+    stream.Write( m_bvhDepth );
+    stream.Write( m_maxLeafTriNum );
+    stream.Write( m_refCount );
+    stream.Align( alignof( Bvh_Linear_Node ) );
+    stream.Write( m_nodes , m_totalNode );
+    serializePackets( stream );
+    return true;
+}
+
+// load the flattened BVH
+bool Bvh::Deserialize( AccelReader& stream )
+{
+    deallocMemory();
+
+    unsigned total = 0;
+    if( !stream.Read( m_bbox ) || !stream.Read( total ) || !stream.Read( m_leafNode ) || !stream.Read( m_bvhDepth ) ||
+        !stream.Read( m_maxLeafTriNum ) || !stream.Read( m_refCount ) || total == 0 )
+        return false;
+
+    // the nodes in a payload shared with other processes are used in place
+    m_totalNode = total;
+    bool valid = stream.Align( alignof( Bvh_Linear_Node ) );
+    m_nodes = valid ? const_cast<Bvh_Linear_Node*>( stream.View<Bvh_Linear_Node>( m_totalNode ) ) : nullptr;
+    m_sharedNodes = m_nodes != nullptr;
+    if( valid && !m_sharedNodes ){
+        m_nodes = (Bvh_Linear_Node*)HugePages::Alloc( sizeof( Bvh_Linear_Node ) * m_totalNode , alignof( Bvh_Linear_Node ) );
+        valid = stream.Read( m_nodes , m_totalNode );
+    }
+    valid = valid && deserializePackets( stream );
+
+    // the traversal trusts the offsets in the nodes, they are checked once here
+    for( unsigned id = 0 ; valid && id < m_totalNode ; id++ ){
+        const Bvh_Linear_Node& node = m_nodes[id];
+        valid = ( node.pri_num != 0 ) ? validLeaf( node.offset , node.pri_num ) : ( id + 1 < m_totalNode && node.offset > id && node.offset < m_totalNode );
+    }
+    if( !valid ){
+        deallocMemory();
+        m_totalNode = 0;
+        return false;
+    }
+
+    // the loaded tree could be refitted later just like a built one
+    m_buildSah = evaluateSah();
+    m_builtPriNum = (unsigned)m_primitives->size();
+
+    // the linear bounds of moving primitives and the hidden masks are not cached , they are evaluated again from the leaves
+    buildMotionBounds();
+    buildHiddenMasks();
+    return true;
+}
+
+// test the primitives of a packet with the loop of their kind , generic packets are tested by the caller
+static inline unsigned testPacket( const TrianglePacket& tp , const Ray& ray , float t[4] , float u[4] , float v[4] )
+{
+    switch( tp.type ){
+    case PACKET_TRIANGLE:
+        return IntersectPacket( tp , ray , t , u , v );
+    case PACKET_SPHERE:
+        return IntersectSpherePacket( tp , ray , t );
+    case PACKET_DISK:
+        return IntersectPlanarPacket( tp , ray , true , t );
+    case PACKET_RECTANGLE:
+        return IntersectPlanarPacket( tp , ray , false , t );
+    default:
+        return 0;
+    }
+}
+
+// get the nearest intersection in a leaf node
+bool Bvh::intersectLeaf( const Ray& ray , Intersection* intersect , unsigned packet , unsigned pri_num ) const
+{
+    SORT_STATS( AccelStats::Local().primitives += pri_num );
+
+    bool inter = false;
+    for( unsigned k = packet , left = pri_num ; left > 0 ; left -= m_packets[k++].count ){
+        const TrianglePacket& tp = m_packets[k];
+        // primitives hidden from the ray are never hit
+        const unsigned hidden = tp.HiddenLanes( ray.m_Type );
+        if( tp.type == PACKET_GENERIC ){
+            for( unsigned i = 0 ; i < tp.count ; ++i ){
+                if( ( hidden & ( 1 << i ) ) == 0 && tp.primitive[i]->GetIntersect( ray , intersect ) )
+                    inter = true;
+            }
+            continue;
+        }
+
+        // analytic shapes have no barycentric coordinates
+        float t[4] , u[4] = { 0.0f } , v[4] = { 0.0f };
+        unsigned mask = testPacket( tp , ray , t , u , v ) & ~hidden;
+
+        // hits are committed in lane order, it is the same with testing the primitives one by one
+        while( mask ){
+            int i = 0;
+            while( ( mask & ( 1 << i ) ) == 0 )
+                ++i;
+            mask &= ~( 1 << i );
+
+            // hits cut away by the opacity of the material are ignored, the opacity is only checked for hits closer than the current one
+            if( !( t[i] > intersect->t ) && !( ( tp.cutout & ( 1 << i ) ) && tp.primitive[i]->IsCutAway( u[i] , v[i] ) ) ){
+                // only the hit is recorded, it is resolved once the closest one is found
+                intersect->t = t[i];
+                intersect->bu = u[i];
+                intersect->bv = v[i];
+                intersect->primitive = const_cast<Primitive*>( tp.primitive[i] );
+                inter = true;
+            }
+        }
+    }
+    return inter;
+}
+
+// check whether the ray is blocked by any primitive in a leaf node
+bool Bvh::occludedLeaf( const Ray& ray , unsigned packet , unsigned pri_num ) const
+{
+    for( unsigned k = packet , left = pri_num ; left > 0 ; left -= m_packets[k++].count ){
+        const TrianglePacket& tp = m_packets[k];
+        SORT_STATS( AccelStats::Local().primitives += tp.count );
+        // occlusion queries are shadow rays , primitives hidden from them never block anything
+        const unsigned hidden = tp.HiddenLanes( RAY_SHADOW );
+        if( tp.type == PACKET_GENERIC ){
+            for( unsigned i = 0 ; i < tp.count ; ++i ){
+                if( ( hidden & ( 1 << i ) ) == 0 && tp.primitive[i]->GetIntersect( ray , nullptr ) )
+                    return true;
+            }
+            continue;
+        }
+
+        float t[4] , u[4] , v[4];
+        const unsigned mask = testPacket( tp , ray , t , u , v ) & ~hidden;
+        if( tp.type != PACKET_TRIANGLE ){
+            if( mask )
+                return true;
+            continue;
+        }
+        for( int i = 0 ; i < 4 ; ++i ){
+            if( ( mask & ( 1 << i ) ) && t[i] > ray.m_fMin && t[i] < ray.m_fMax &&
+                !( ( tp.cutout & ( 1 << i ) ) && tp.primitive[i]->IsCutAway( u[i] , v[i] ) ) )
+                return true;
+        }
+    }
+    return false;
+}
+
+// recursively split BVH node
+void Bvh::splitNode( Bvh_Node* node , unsigned _start , unsigned _end , unsigned depth )
+{
 	// generate the bounding box for the node
-	for( unsigned i = _start ; i < _end ; i++ )
-		node->bbox.Union( m_bvhpri[i].GetBBox() );
+    BBox chunk_bbox[BVH_MAX_CHUNK];
+    const unsigned chunk_cnt = parallelFor( _start , _end , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        for( unsigned i = chunk_start ; i < chunk_end ; i++ )
+            chunk_bbox[chunk].Union( m_bvhpri[i].GetBBox() );
+    });
+    for( unsigned i = 0 ; i < chunk_cnt ; i++ )
+        node->bbox.Union( chunk_bbox[i] );
 
 	unsigned tri_num = _end - _start;
-	if( tri_num <= m_maxPriInLeaf ){
+	if( tri_num <= m_maxPriInLeaf || depth + 1 >= BVH_MAX_DEPTH ){
 		makeLeaf( node , _start , _end );
 		return;
 	}
@@ -102,11 +1140,21 @@ void Bvh::splitNode( Bvh_Node* node , unsigned _start , unsigned _end , unsigned
     auto compare = [split_pos,split_axis](const Bvh::Bvh_Primitive& pri){return pri.m_centroid[split_axis] < split_pos;};
 	const Bvh_Primitive* middle = partition( &m_bvhpri[_start] , &m_bvhpri[_end-1]+1 , compare );
 	unsigned mid = (unsigned)(middle - m_bvhpri);
+	if( mid == _start || mid == _end ){
+		makeLeaf( node , _start , _end );
+		return;
+	}
 
     node->left = new Bvh_Node();
-	splitNode( node->left , _start , mid , depth + 1 );
-
     node->right = new Bvh_Node();
+
+    // the two sub-trees touch disjoint ranges of primitives, they are built as separate jobs if both are large
+    if( min( mid - _start , _end - mid ) > BVH_FORK_THRESHOLD ){
+        ParallelInvoke( [&](){ splitNode( node->left , _start , mid , depth + 1 ); } , [&](){ splitNode( node->right , mid , _end , depth + 1 ); } );
+        return;
+    }
+
+	splitNode( node->left , _start , mid , depth + 1 );
 	splitNode( node->right , mid , _end , depth + 1 );
 }
 
@@ -114,12 +1162,21 @@ void Bvh::splitNode( Bvh_Node* node , unsigned _start , unsigned _end , unsigned
 float Bvh::pickBestSplit( unsigned& axis , float& split_pos , Bvh_Node* node , unsigned _start , unsigned _end )
 {
 	BBox inner;
-	for( unsigned i = _start ; i < _end ; i++ )
-		inner.Union( m_bvhpri[i].m_centroid );
+    BBox chunk_inner[BVH_MAX_CHUNK];
+    unsigned chunk_cnt = parallelFor( _start , _end , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        for( unsigned i = chunk_start ; i < chunk_end ; i++ )
+            chunk_inner[chunk].Union( m_bvhpri[i].m_centroid );
+    });
+    for( unsigned i = 0 ; i < chunk_cnt ; i++ )
+        inner.Union( chunk_inner[i] );
 
 	unsigned tri_num = _end - _start;
 	axis = inner.MaxAxisId();
 	float min_sah = FLT_MAX;
+	
+	// all centroids are at the same position, there is no way to split them
+	if( inner.Delta(axis) <= 0.0f )
+		return min_sah;
 
 	// distribute the triangles into bins
 	unsigned	bin[BVH_SPLIT_COUNT];
@@ -129,12 +1186,27 @@ float Bvh::pickBestSplit( unsigned& axis , float& split_pos , Bvh_Node* node , u
 	float split_start = inner.m_Min[axis];
 	float split_delta = inner.Delta(axis) * BVH_INV_SPLIT_COUNT;
 	float inv_split_delta = 1.0f / split_delta;
-    for( unsigned i = _start ; i < _end ; i++ ){
-		int index = (int)((m_bvhpri[i].m_centroid[axis] - split_start) * inv_split_delta);
-		index = min( index , (int)(BVH_SPLIT_COUNT - 1) );
-		bin[index]++;
-		bbox[index].Union( m_bvhpri[i].GetBBox() );
-	}
+
+    // each chunk fills its own bins, they are merged in order afterward
+    unsigned    chunk_bin[BVH_MAX_CHUNK][BVH_SPLIT_COUNT];
+    BBox        chunk_bbox[BVH_MAX_CHUNK][BVH_SPLIT_COUNT];
+    chunk_cnt = parallelFor( _start , _end , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        unsigned* _bin = chunk_bin[chunk];
+        BBox* _bbox = chunk_bbox[chunk];
+        memset( _bin , 0 , sizeof( unsigned ) * BVH_SPLIT_COUNT );
+        for( unsigned i = chunk_start ; i < chunk_end ; i++ ){
+            int index = (int)((m_bvhpri[i].m_centroid[axis] - split_start) * inv_split_delta);
+            index = min( index , (int)(BVH_SPLIT_COUNT - 1) );
+            _bin[index]++;
+            _bbox[index].Union( m_bvhpri[i].GetBBox() );
+        }
+    });
+    for( unsigned i = 0 ; i < chunk_cnt ; i++ ){
+        for( unsigned k = 0 ; k < BVH_SPLIT_COUNT ; k++ ){
+            bin[k] += chunk_bin[i][k];
+            bbox[k].Union( chunk_bbox[i][k] );
+        }
+    }
 
 	rbox[BVH_SPLIT_COUNT-2].Union( bbox[BVH_SPLIT_COUNT-1] );
 	for( int i = BVH_SPLIT_COUNT-3; i >= 0 ; i-- )
@@ -168,72 +1240,351 @@ void Bvh::makeLeaf( Bvh_Node* node , unsigned _start , unsigned _end )
 {
 	node->pri_num = _end - _start;
 	node->pri_offset = _start;
-
-	m_leafNode++;
-	m_maxLeafTriNum = max( m_maxLeafTriNum , node->pri_num );
 }
 
 // get the intersection between the ray and the primitive set
 bool Bvh::GetIntersect( const Ray& ray , Intersection* intersect ) const
 {
+	// quantized nodes replace the flattened ones once the tree is compressed
+	if( m_nodes == nullptr )
+		return ( m_compressBits == 8 ) ? intersectQuantized<unsigned char>( ray , intersect ) : intersectQuantized<unsigned short>( ray , intersect );
+
+	const TraversalRay traversal_ray( ray );
 	float fmax;
-	float fmin = Intersect( ray , m_bbox , &fmax );
+	float fmin = Intersect( traversal_ray , m_bbox , &fmax );
 	if( fmin < 0.0f )
 		return false;
 
-	if( traverseNode( m_root , ray , intersect , fmin , fmax ) ){
-		if( intersect == 0 )
-			return true;
-		return intersect->primitive != 0 ;
+	// nodes to be visited along with the entering distance of their bounding boxes
+	struct Bvh_Stack_Entry{
+		unsigned	node;
+		float		fmin;
+	};
+	Bvh_Stack_Entry stack[BVH_MAX_DEPTH];
+	Bvh_Stack_Entry* top = stack;
+	top->node = 0;
+	top->fmin = fmin;
+	++top;
+
+	SORT_STATS( AccelStats& stats = AccelStats::Local() );
+	bool inter = false;
+	const unsigned type = RayType( ray , intersect == nullptr );
+	// the bounding boxes of the children at the time of the ray if any primitive moves
+	BBox moved0 , moved1;
+	while( top > stack ){
+		--top;
+		const unsigned id = top->node;
+
+		// the bounding box is behind the closest intersection found so far , or everything below it is hidden from the ray
+		if( ( intersect && intersect->t < top->fmin ) || nodeHidden( id , type ) ){
+			SORT_STATS( ++stats.earlyOuts );
+			continue;
+		}
+
+		SORT_STATS( ++stats.nodes );
+		const Bvh_Linear_Node& node = m_nodes[id];
+		if( node.pri_num != 0 ){
+			if( intersect == 0 ){
+				if( occludedLeaf( ray , node.offset , node.pri_num ) ){
+					SORT_STATS( ++stats.earlyOuts );
+					return true;
+				}
+			}else if( intersectLeaf( ray , intersect , node.offset , node.pri_num ) ){
+				inter = true;
+			}
+			continue;
+		}
+
+		// the first child is right after the current node
+		const unsigned left = id + 1;
+		const unsigned right = node.offset;
+
+		float	_fmax0 , _fmax1;
+		const float _fmin0 = Intersect( traversal_ray , nodeBox( left , ray.m_Time , moved0 ) , &_fmax0 );
+		const float _fmin1 = Intersect( traversal_ray , nodeBox( right , ray.m_Time , moved1 ) , &_fmax1 );
+
+		// push the further child first so that the nearer one is visited first
+		if( _fmin1 > _fmin0 ){
+			if( _fmin1 >= 0.0f ){ top->node = right; top->fmin = _fmin1; ++top; }
+			if( _fmin0 >= 0.0f ){ top->node = left; top->fmin = _fmin0; ++top; }
+		}else{
+			if( _fmin0 >= 0.0f ){ top->node = left; top->fmin = _fmin0; ++top; }
+			if( _fmin1 >= 0.0f ){ top->node = right; top->fmin = _fmin1; ++top; }
+		}
 	}
-    
-	return false;
+
+	return inter;
 }
 
-// traverse node
-bool Bvh::traverseNode( const Bvh_Node* node , const Ray& ray , Intersection* intersect , float fmin , float fmax ) const
+// get the nearest intersections of a stream of rays
+void Bvh::GetIntersect( const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const
 {
-	if( fmin < 0.0f )
+	// packets are not supported by quantized nodes, rays are traced one by one
+	if( m_nodes == nullptr ){
+		Accelerator::GetIntersect( rays , intersects , results , count );
+		return;
+	}
+
+	for( unsigned i = 0 ; i < count ; i += BVH_PACKET_SIZE )
+		intersectPacket( rays + i , intersects + i , results + i , min( count - i , BVH_PACKET_SIZE ) );
+}
+
+// get the nearest intersections of a packet of rays
+void Bvh::intersectPacket( const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const
+{
+	TraversalRay traversal_rays[BVH_PACKET_SIZE];
+	for( unsigned i = 0 ; i < count ; ++i ){
+		results[i] = false;
+		traversal_rays[i] = TraversalRay( rays[i] );
+	}
+
+	// nodes to be visited along with the rays that may hit them
+	struct Bvh_Packet_Entry{
+		unsigned	node;
+		unsigned	mask;
+	};
+	Bvh_Packet_Entry stack[BVH_MAX_DEPTH];
+	Bvh_Packet_Entry* top = stack;
+	top->node = 0;
+	top->mask = ( 1u << count ) - 1;
+	++top;
+
+	SORT_STATS( AccelStats& stats = AccelStats::Local() );
+	// the bounding box of the node at the time of a ray if any primitive moves
+	BBox moved;
+	while( top > stack ){
+		--top;
+		const unsigned id = top->node;
+		const Bvh_Linear_Node& node = m_nodes[id];
+		SORT_STATS( for( unsigned m = top->mask ; m ; m &= m - 1 ) ++stats.nodes );
+
+		// only rays hitting the bounding box in front of their closest intersection go on
+		unsigned mask = 0;
+		unsigned first = count;
+		for( unsigned i = 0 ; i < count ; ++i ){
+			if( ( top->mask & ( 1 << i ) ) == 0 || nodeHidden( id , rays[i].m_Type ) )
+				continue;
+			const float fmin = Intersect( traversal_rays[i] , nodeBox( id , rays[i].m_Time , moved ) );
+			SORT_STATS( stats.earlyOuts += ( fmin >= 0.0f && intersects[i].t < fmin ) ? 1 : 0 );
+			if( fmin >= 0.0f && !( intersects[i].t < fmin ) ){
+				mask |= ( 1 << i );
+				first = min( first , i );
+			}
+		}
+		if( mask == 0 )
+			continue;
+
+		if( node.pri_num != 0 ){
+			for( unsigned i = first ; i < count ; ++i ){
+				if( ( mask & ( 1 << i ) ) && intersectLeaf( rays[i] , &intersects[i] , node.offset , node.pri_num ) )
+					results[i] = true;
+			}
+			continue;
+		}
+
+		// the children are ordered along the axis separating them the most, by the direction of the first active ray
+		const unsigned left = id + 1;
+		const unsigned right = node.offset;
+		const Vector delta = ( m_nodes[right].bbox.m_Min + m_nodes[right].bbox.m_Max ) - ( m_nodes[left].bbox.m_Min + m_nodes[left].bbox.m_Max );
+		unsigned axis = 0;
+		for( unsigned k = 1 ; k < 3 ; ++k ){
+			if( fabs( delta[k] ) > fabs( delta[axis] ) )
+				axis = k;
+		}
+		const bool left_first = ( delta[axis] * rays[first].m_Dir[axis] ) >= 0.0f;
+
+		// push the further child first so that the nearer one is visited first
+		top->node = left_first ? right : left; top->mask = mask; ++top;
+		top->node = left_first ? left : right; top->mask = mask; ++top;
+	}
+}
+
+// check whether each ray in a stream is blocked by any primitive
+void Bvh::IsOccluded( const Ray* rays , bool* results , unsigned count ) const
+{
+	// packets are not supported by quantized nodes, rays are traced one by one
+	if( m_nodes == nullptr ){
+		Accelerator::IsOccluded( rays , results , count );
+		return;
+	}
+
+	for( unsigned i = 0 ; i < count ; i += BVH_PACKET_SIZE )
+		occludedPacket( rays + i , results + i , min( count - i , BVH_PACKET_SIZE ) );
+}
+
+// check whether each ray of a packet is blocked by any primitive
+void Bvh::occludedPacket( const Ray* rays , bool* results , unsigned count ) const
+{
+	TraversalRay traversal_rays[BVH_PACKET_SIZE];
+	for( unsigned i = 0 ; i < count ; ++i ){
+		results[i] = false;
+		traversal_rays[i] = TraversalRay( rays[i] );
+	}
+
+	// nodes to be visited along with the rays that may hit them
+	struct Bvh_Packet_Entry{
+		unsigned	node;
+		unsigned	mask;
+	};
+	Bvh_Packet_Entry stack[BVH_MAX_DEPTH];
+	Bvh_Packet_Entry* top = stack;
+	top->node = 0;
+	top->mask = ( 1u << count ) - 1;
+	++top;
+
+	// the rays not found blocked yet
+	unsigned active = top[-1].mask;
+
+	SORT_STATS( AccelStats& stats = AccelStats::Local() );
+	// the bounding box of the node at the time of a ray if any primitive moves
+	BBox moved;
+	while( top > stack ){
+		--top;
+		const unsigned id = top->node;
+		const Bvh_Linear_Node& node = m_nodes[id];
+
+		// rays found blocked in other nodes are done , so are all rays if everything below the node is hidden from shadow rays
+		unsigned mask = 0;
+		const unsigned candidates = nodeHidden( id , RAY_SHADOW ) ? 0 : top->mask & active;
+		for( unsigned i = 0 ; i < count ; ++i ){
+			if( ( candidates & ( 1 << i ) ) == 0 )
+				continue;
+			SORT_STATS( ++stats.nodes );
+			if( Intersect( traversal_rays[i] , nodeBox( id , rays[i].m_Time , moved ) ) >= 0.0f )
+				mask |= ( 1 << i );
+		}
+		if( mask == 0 )
+			continue;
+
+		if( node.pri_num != 0 ){
+			for( unsigned i = 0 ; i < count ; ++i ){
+				if( ( mask & ( 1 << i ) ) && occludedLeaf( rays[i] , node.offset , node.pri_num ) ){
+					SORT_STATS( ++stats.earlyOuts );
+					results[i] = true;
+					active &= ~( 1u << i );
+				}
+			}
+			if( active == 0 )
+				return;
+			continue;
+		}
+
+		// any intersection is enough, there is no need to order the children
+		top->node = node.offset; top->mask = mask; ++top;
+		top->node = id + 1; top->mask = mask; ++top;
+	}
+}
+
+// check whether the ray is blocked by any primitive
+bool Bvh::IsOccluded( const Ray& ray ) const
+{
+	if( m_nodes == nullptr )
+		return ( m_compressBits == 8 ) ? intersectQuantized<unsigned char>( ray , nullptr ) : intersectQuantized<unsigned short>( ray , nullptr );
+
+	const TraversalRay traversal_ray( ray );
+	if( Intersect( traversal_ray , m_bbox ) < 0.0f )
 		return false;
 
-	if( intersect && intersect->t < fmin )
-		return true;
-	
-    if( node->pri_num != 0 ){
-        unsigned _start = node->pri_offset;
-        unsigned _tri = node->pri_num;
-        unsigned _end = _start + _tri;
-        
-        bool inter = false;
-        for( unsigned i = _start ; i < _end ; i++ ){
-            inter |= m_bvhpri[i].primitive->GetIntersect( ray , intersect );
-            if( intersect == 0 && inter )
-                return true;
-        }
-        return inter;
+	// any intersection is enough, there is no need to order the children
+	unsigned stack[BVH_MAX_DEPTH];
+	unsigned* top = stack;
+	*top++ = 0;
+	SORT_STATS( AccelStats& stats = AccelStats::Local() );
+	// the bounding box of a child at the time of the ray if any primitive moves
+	BBox moved;
+	while( top > stack ){
+		const unsigned id = *--top;
+		const Bvh_Linear_Node& node = m_nodes[id];
+		SORT_STATS( ++stats.nodes );
+		if( nodeHidden( id , RAY_SHADOW ) )
+			continue;
+		if( node.pri_num != 0 ){
+			if( occludedLeaf( ray , node.offset , node.pri_num ) ){
+				SORT_STATS( ++stats.earlyOuts );
+				return true;
+			}
+			continue;
+		}
+
+		if( Intersect( traversal_ray , nodeBox( node.offset , ray.m_Time , moved ) ) >= 0.0f )
+			*top++ = node.offset;
+		if( Intersect( traversal_ray , nodeBox( id + 1 , ray.m_Time , moved ) ) >= 0.0f )
+			*top++ = id + 1;
 	}
 
-    const Bvh_Node* left = node->left;
-	const Bvh_Node* right = node->right;
+	return false;
+}
+
+// get the intersection between the ray and the primitive set using quantized nodes
+template< class T >
+bool Bvh::intersectQuantized( const Ray& ray , Intersection* intersect ) const
+{
+	const TraversalRay traversal_ray( ray );
+	float fmin = Intersect( traversal_ray , m_bbox );
+	if( fmin < 0.0f )
+		return false;
+
+	// the whole tree is one leaf
+	if( m_qrootPriNum != 0 )
+		return intersect ? intersectLeaf( ray , intersect , 0 , m_qrootPriNum ) : occludedLeaf( ray , 0 , m_qrootPriNum );
 
-	float	_fmin0 , _fmax0;
-	_fmin0 = Intersect( ray , left->bbox , &_fmax0 );
-	float	_fmin1 , _fmax1;
-	_fmin1 = Intersect( ray , right->bbox , &_fmax1 );
+	// the decoded bounding box of each interior node is carried along since the bounds of its children are relative to it
+	struct Bvh_Stack_Entry{
+		unsigned	child;
+		unsigned	pri_num;
+		float		fmin;
+		BBox		bbox;
+	};
+	Bvh_Stack_Entry stack[BVH_MAX_DEPTH];
+	Bvh_Stack_Entry* top = stack;
+	top->child = 0;
+	top->pri_num = 0;
+	top->fmin = fmin;
+	top->bbox = m_qrootBox;
+	++top;
 
+	const Bvh_Quantized_Node<T>* qnodes = (const Bvh_Quantized_Node<T>*)m_qnodes;
+	SORT_STATS( AccelStats& stats = AccelStats::Local() );
 	bool inter = false;
-	if( _fmin1 > _fmin0 ){
-		inter |= traverseNode( left , ray , intersect , _fmin0 , _fmax0 );
-		if( inter && intersect == 0 ) return true;
-		inter |= traverseNode( right , ray , intersect , _fmin1 , _fmax1 );
-	}else{
-		inter |= traverseNode( right , ray , intersect , _fmin1 , _fmax1 );
-		if( inter && intersect == 0 ) return true;
-		inter |= traverseNode( left , ray , intersect , _fmin0 , _fmax0 );
-	}
-	if( intersect == 0 )
-		return inter;
-	return true;
+	while( top > stack ){
+		--top;
+
+		// the bounding box is behind the closest intersection found so far
+		if( intersect && intersect->t < top->fmin ){
+			SORT_STATS( ++stats.earlyOuts );
+			continue;
+		}
+
+		SORT_STATS( ++stats.nodes );
+		if( top->pri_num != 0 ){
+			if( intersect == 0 ){
+				if( occludedLeaf( ray , top->child , top->pri_num ) ){
+					SORT_STATS( ++stats.earlyOuts );
+					return true;
+				}
+			}else if( intersectLeaf( ray , intersect , top->child , top->pri_num ) ){
+				inter = true;
+			}
+			continue;
+		}
+
+		const Bvh_Quantized_Node<T>& node = qnodes[top->child];
+		const BBox bbox = top->bbox;
+		Bvh_Stack_Entry entries[2];
+		for( unsigned i = 0 ; i < 2 ; ++i ){
+			entries[i].child = node.child[i];
+			entries[i].pri_num = node.pri_num[i];
+			entries[i].bbox = decodeBounds<T>( node.bounds , i , bbox );
+			entries[i].fmin = Intersect( traversal_ray , entries[i].bbox );
+		}
+
+		// push the further child first so that the nearer one is visited first
+		const unsigned first = ( entries[1].fmin > entries[0].fmin ) ? 1 : 0;
+		if( entries[first].fmin >= 0.0f ) *top++ = entries[first];
+		if( entries[1-first].fmin >= 0.0f ) *top++ = entries[1-first];
+	}
+
+	return inter;
 }
 
 // delete bvh node recursively
@@ -19,6 +19,10 @@
 
 #include "accelerator.h"
 #include "geometry/primitive.h"
+#include "geometry/tripacket.h"
+
+static const unsigned BVH_MAX_DEPTH = 64;   /**< Maximum depth of BVH, it also limits the stack size during traversal. */
+static const unsigned BVH_PACKET_SIZE = 16; /**< Maximum number of rays traversing BVH together as a packet. */
 
 //! @brief Bounding volume hierarchy.
 /**
@@ -28,12 +32,20 @@
  * Please refer to this paper 
  * <a href="http://www.sci.utah.edu/~wald/Publications/2007/ParallelBVHBuild/fastbuild.pdf">
  * On fast Construction of SAH-based Bounding Volume Hierarchies</a> for further details.
+ * With the 'sbvh' property enabled, spatial splits are considered along with object splits,
+ * primitive references straddling a spatial split plane are clipped and duplicated.
+ * Please refer to this paper
+ * <a href="https://www.nvidia.com/docs/IO/77714/sbvh.pdf">
+ * Spatial Splits in Bounding Volume Hierarchies</a> for further details.
  */
 class Bvh : public Accelerator
 {
 public:
 	DEFINE_CREATOR( Bvh , Accelerator , "bvh" );
 
+	//! Default constructor.
+	Bvh() { _registerAllProperty(); }
+
 	//! Destructor
     ~Bvh() override;
 
@@ -52,12 +64,70 @@ public:
     //! @return             It will return true if there is an intersection, otherwise it returns false.
     bool GetIntersect( const Ray& r , Intersection* intersect ) const override;
 
-    //! Build BVH structure in O(N*lg(N)).
+    //! @brief Check whether the ray is blocked by any primitive using BVH.
+    //!
+    //! It is the dedicated query for shadow rays. Both children of a node are pushed without checking which one is nearer
+    //! and it returns at the first blocking primitive. Quantized trees share the traversal of the nearest intersection query.
+    //! @param r            The input ray to be tested.
+    //! @return             It will return true if there is any intersection, otherwise it returns false.
+    bool IsOccluded( const Ray& r ) const override;
+
+    //! @brief Get the nearest intersections of a stream of rays using BVH.
+    //!
+    //! The stream is split into packets of up to BVH_PACKET_SIZE rays, rays in a packet traverse the tree together
+    //! so that each node is fetched once for all of them. Results are the same with tracing the rays one by one.
+    //! @param rays         The rays to be tested.
+    //! @param intersects   The intersection results, one for each ray. Their distances have to be initialized.
+    //! @param results      Whether each ray hits any primitive.
+    //! @param count        The number of rays in the stream.
+    void GetIntersect( const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const override;
+
+    //! @brief Check whether each ray in a stream is blocked by any primitive using BVH.
+    //!
+    //! The stream is split into packets of up to BVH_PACKET_SIZE rays like the nearest intersection query, a ray
+    //! leaves its packet as soon as it is found blocked.
+    //! @param rays         The rays to be tested.
+    //! @param results      Whether each ray is blocked by any primitive.
+    //! @param count        The number of rays in the stream.
+    void IsOccluded( const Ray* rays , bool* results , unsigned count ) const override;
+
+    //! @brief Build BVH structure in O(N*lg(N)).
+    //!
+    //! The construction is spread across the threads of the thread pool.
+    //! With the 'refit' property enabled, building the same primitive set again keeps the topology of the tree
+    //! and only refits the bounding boxes, the tree is rebuilt if its SAH cost degrades past 'refit_threshold'.
+    //! With the 'compress' property set to 8 or 16, nodes are quantized afterward to reduce the memory footprint.
 	void Build() override;
 
 	//! Output log information
 	void OutputLog() const override;
 
+	//! Add the shape of the structure to the statistics report
+	void CollectStats( StatsGroup& stats ) const override;
+
+    //! Memory taken by the nodes and the triangle packets.
+	size_t GetMemoryUsage() const override;
+
+    //! @brief Get the order of primitives in the triangle packets, which is the depth-first order of leaf nodes.
+    //! @param order    The indices of primitives, primitives duplicated by spatial splits only appear at their first leaf.
+    //! @return         False if the BVH is not built yet.
+	bool GetPrimitiveOrder( std::vector<unsigned>& order ) const override;
+
+    //! @brief Flatten the tree into nodes and world space primitives that could be traced on the GPU.
+    //! @param tree     The flattened tree.
+    //! @return         False if the nodes are compressed or collapsed, any primitive moves, is hidden or cut out, or any primitive is tested with its own routine.
+	bool ExportGpuTree( GpuTree& tree ) const override;
+
+    //! @brief Write the flattened BVH, primitives of leaf nodes are written as their indices.
+    //! @param stream   The buffer to write into.
+    //! @return         False if the BVH is not built yet.
+	bool Serialize( AccelWriter& stream ) const override;
+
+    //! @brief Load the flattened BVH, triangle packets are packed again from the primitives.
+    //! @param stream   The payload to read from.
+    //! @return         False if the data doesn't match the primitive set.
+	bool Deserialize( AccelReader& stream ) override;
+
     //! Bounding volume hierarchy node.
     struct Bvh_Node
     {
@@ -68,26 +138,88 @@ public:
         Bvh_Node*   right       = 0;    /**< Right child of the BVH node. */
     };
     
+    //! @brief Flattened bounding volume hierarchy node.
+    //!
+    //! After construction, all nodes are stored in a contiguous array in depth-first order. The first child of an
+    //! interior node is always the node right after it, only the offset of the second child is stored.
+    //! Each node is exactly 32 bytes so that two nodes fit in one cache line.
+    struct alignas(32) Bvh_Linear_Node
+    {
+        BBox		bbox;               /**< Bounding box of the BVH node. */
+        unsigned 	pri_num     = 0;    /**< Number of primitives in the BVH node. It is 0 for interior nodes. */
+        unsigned	offset      = 0;    /**< Index of the first triangle packet for leaf nodes, index of the second child for interior nodes. */
+    };
+
+    //! @brief Quantized BVH node holding the bounding boxes of both children.
+    //!
+    //! Bounds of the children are quantized relative to the bounding box of the node itself, which is only
+    //! known from its parent during traversal. Decoded bounding boxes are always conservative.
+    template< class T >
+    struct Bvh_Quantized_Node
+    {
+        T           bounds[2][3][2];    /**< Quantized bounding boxes of the two children, bounds[0] holds the minimum points, bounds[1] holds the maximum points. */
+        unsigned    child[2];           /**< Index of the quantized node for interior children, index of the first triangle packet for leaf children. */
+        unsigned    pri_num[2];         /**< Number of primitives in leaf children, it is 0 for interior children. */
+    };
+
+    //! @brief Bounding boxes of a flattened node at the start and the end of the frame.
+    //!
+    //! They are only kept if any primitive moves. The bounding box of the node at any time of the frame is their
+    //! linear interpolation, which is tighter than the bounding box covering the whole frame.
+    struct Bvh_Motion_Bounds
+    {
+        BBox        start;  /**< Bounding box at the start of the frame. */
+        BBox        end;    /**< Bounding box at the end of the frame. */
+    };
+
+    //! @brief Primitive reference used during SBVH construction.
+    //!
+    //! A primitive could be referenced by several nodes after spatial splits, each reference only
+    //! covers the part of the primitive inside the node.
+    struct Bvh_Reference
+    {
+        Primitive*  primitive;  /**< The referenced primitive. */
+        BBox        bbox;       /**< Bounding box of the part of the primitive covered by the reference. */
+    };
+
     //! Bounding volume hierarchy node primitives. It is used during BVH construction.
+    //!
+    //! Primitives don't cache their bounding boxes, the box is evaluated once here so that the
+    //! construction sweeps a contiguous array instead of reading the vertexes again.
     struct Bvh_Primitive
     {
         Primitive*	primitive;      /**< Primitive lists for this node. */
         Point		m_centroid;     /**< Center point of the BVH node. */
+        BBox		m_bbox;         /**< Bounding box of the primitive. */
         
         //! @brief Constructor of Bvh_Primitive.
         //! @param p primitive list holding all primitives in the node.
-        Bvh_Primitive( Primitive* p ):primitive(p)
-        {m_centroid = ( p->GetBBox().m_Max + p->GetBBox().m_Min ) * 0.5f;}
+        Bvh_Primitive( Primitive* p ):primitive(p),m_bbox(p->GetBBox())
+        {m_centroid = ( m_bbox.m_Max + m_bbox.m_Min ) * 0.5f;}
         
         //! Get bounding box of this primitive set.
         //! @return Axis-Aligned bounding box holding all the primitives.
         const BBox& GetBBox() const
-        {return primitive->GetBBox();}
+        {return m_bbox;}
     };
     
-private:
+protected:
     Bvh_Primitive*	m_bvhpri = nullptr; /**< Primitive list during BVH construction. */
-    Bvh_Node*       m_root = nullptr;   /**< Root node of the BVH structure. */
+    unsigned        m_arena = 0;        /**< The memory arena of the primitive list, it is only valid during construction. */
+    Bvh_Node*       m_root = nullptr;   /**< Root node of the BVH structure. It is only valid during construction. */
+    Bvh_Linear_Node* m_nodes = nullptr; /**< Flattened BVH nodes in depth-first order. */
+    bool             m_sharedNodes = false; /**< Whether the flattened nodes are a read-only copy shared with other processes, it is never freed then. */
+    TrianglePacket*  m_packets = nullptr;   /**< Precomputed triangle packets of all leaf nodes, each leaf owns consecutive packets. */
+    unsigned         m_packetCount = 0;     /**< Number of triangle packets. */
+    Bvh_Motion_Bounds* m_motion = nullptr;  /**< Linear bounds of the flattened nodes, one for each node. It is null if no primitive moves. */
+    unsigned char*   m_hidden = nullptr;    /**< Kinds of rays each flattened node is hidden from, one for each node. It is null if no primitive is hidden. */
+
+    // node compression
+    unsigned    m_compressBits = 0;     /**< Number of bits of quantized child bounds, 8 or 16. Nodes are not compressed if it is 0. */
+    void*       m_qnodes = nullptr;     /**< Quantized nodes in depth-first order, they replace the flattened nodes once compressed. */
+    unsigned    m_qnodeCount = 0;       /**< Number of quantized nodes. */
+    BBox        m_qrootBox;             /**< Bounding box of the root node, the bounds of its children are relative to it. */
+    unsigned    m_qrootPriNum = 0;      /**< Number of primitives in the root node if the whole tree is one leaf. */
 
 	const unsigned	m_maxPriInLeaf = 8; /**< Maximum primitives in a leaf node. During BVH construction, a node with less primitives will be marked as a leaf node. */
 
@@ -97,12 +229,38 @@ private:
 	unsigned	m_bvhDepth = 0;         /**< Depth of the BVH. */
 	unsigned	m_maxLeafTriNum = 0;    /**< Real maximum number of primitives in the leaf node after construction. */
 
-	//! Malloc necessary memory.
-	void mallocMemory();
+    // SBVH construction
+    bool        m_sbvh = false;         /**< Whether spatial splits are considered during construction. */
+    float       m_sbvhBudget = 0.5f;    /**< Maximum number of extra primitive references from spatial splits, relative to the number of primitives. */
+    unsigned    m_refCount = 0;         /**< Number of primitive references during SBVH construction. */
+    unsigned    m_refLimit = 0;         /**< Maximum number of primitive references allowed during SBVH construction. */
+    float       m_rootArea = 0.0f;      /**< Half surface area of the root node. */
+
+    // refitting
+    bool        m_refit = false;        /**< Whether the bounding boxes are refitted instead of rebuilding the tree when it is built again. */
+    float       m_refitThreshold = 1.5f;    /**< The tree is rebuilt once the SAH cost after refitting grows beyond this ratio of the cost after the last full build. */
+    float       m_buildSah = 0.0f;      /**< SAH cost of the tree after the last full build. */
+    unsigned    m_builtPriNum = 0;      /**< Number of primitives in the last full build. */
+
+	//! @brief Build the pointer based binary tree with SAH.
+    //!
+    //! The tree is rooted at m_root, it is up to the caller to flatten or collapse it afterward.
+    //! Builders with other strategies override it, the rest of the construction is shared.
+	virtual void buildTree();
+
+	//! @brief Malloc necessary memory.
+    //! @param count    The number of primitives referenced by the leaf nodes.
+	void mallocMemory( unsigned count );
 
 	//! Dealloc all allocated memory.
 	void deallocMemory();
 
+	//! @brief Release the primitive buffer used during construction.
+    //!
+    //! Leaves only reference triangle packets after construction. The buffer is shared by all BVHs,
+    //! bottom level BVHs of mesh instances among them, so it is released as soon as the leaves are packed.
+	void releasePrimitives();
+
 	//! @brief Split current BVH node.
     //! @param node     The BVH node to be split.
     //! @param _start   The start offset of primitives that the node holds.
@@ -110,6 +268,129 @@ private:
     //! @param depth    The current depth of the node.
 	void splitNode( Bvh_Node* node , unsigned _start , unsigned _end , unsigned depth );
 
+	//! @brief Build the pointer based binary tree with spatial splits.
+	void buildSpatialTree();
+
+	//! @brief Split current BVH node with object splits or spatial splits.
+    //! @param node         The BVH node to be split.
+    //! @param refs         The primitive references in the node, it is released once the node is split.
+    //! @param depth        The current depth of the node.
+    //! @param leaf_pris    The primitives of all leaf nodes created so far, leaves of the node will be appended to it.
+	void splitSpatialNode( Bvh_Node* node , std::vector<Bvh_Reference>& refs , unsigned depth , std::vector<Primitive*>& leaf_pris );
+
+	//! @brief Pick the best object split of primitive references.
+    //! @param axis      The selected axis id of the picked split plane.
+    //! @param split_pos Position of the selected split plane.
+    //! @param lbox      Bounding box of the left child of the picked split.
+    //! @param rbox      Bounding box of the right child of the picked split.
+    //! @param node      The node to be split.
+    //! @param refs      The primitive references in the node.
+    //! @return          The SAH value of the selected best split plane.
+	float pickObjectSplit( unsigned& axis , float& split_pos , BBox& lbox , BBox& rbox , const Bvh_Node* node , const std::vector<Bvh_Reference>& refs );
+
+	//! @brief Pick the best spatial split of primitive references.
+    //! @param axis      The selected axis id of the picked split plane.
+    //! @param split_pos Position of the selected split plane.
+    //! @param node      The node to be split.
+    //! @param refs      The primitive references in the node.
+    //! @return          The SAH value of the selected best split plane.
+	float pickSpatialSplit( unsigned& axis , float& split_pos , const Bvh_Node* node , const std::vector<Bvh_Reference>& refs );
+
+	//! @brief Distribute primitive references to both sides of a spatial split plane.
+    //!
+    //! A reference straddling the plane is clipped and referenced by both sides, unless putting it in one side
+    //! only is cheaper or the memory budget is used up.
+    //! @param axis      The axis id of the split plane.
+    //! @param split_pos Position of the split plane.
+    //! @param node      The node to be split.
+    //! @param refs      The primitive references in the node.
+    //! @param left      The primitive references in the left child.
+    //! @param right     The primitive references in the right child.
+	void splitReferences( unsigned axis , float split_pos , const Bvh_Node* node , const std::vector<Bvh_Reference>& refs , std::vector<Bvh_Reference>& left , std::vector<Bvh_Reference>& right );
+
+	//! @brief Refit the bounding boxes of the flattened tree after primitives moved.
+    //!
+    //! The topology of the tree is kept, bounding boxes and triangle packets of leaf nodes are updated in parallel
+    //! and interior nodes are updated bottom-up afterward.
+    //! @return         False if the SAH cost grows too much and the tree needs to be rebuilt.
+	bool refit();
+
+	//! @brief Replace the flattened nodes with quantized ones.
+    //!
+    //! The flattened nodes are released afterward, so neither refitting nor serialization is available for compressed trees.
+	template< class T >
+	void compressNodes();
+
+	//! @brief Quantize the children of a flattened interior node.
+    //! @param id       The index of the flattened node.
+    //! @param box      The decoded bounding box of the node, bounds of its children are quantized relative to it.
+    //! @param qnodes   The quantized nodes, the ones of the sub-tree will be appended to it.
+    //! @return         The index of the quantized node.
+	template< class T >
+	unsigned quantizeNode( unsigned id , const BBox& box , std::vector<Bvh_Quantized_Node<T>>& qnodes ) const;
+
+	//! @brief Get intersection between the ray and the primitive set using quantized nodes.
+    //! @param r            The input ray to be tested.
+    //! @param intersect    The intersection result, it stops as long as any intersection is found if it is nullptr.
+    //! @return             It will return true if there is an intersection, otherwise it returns false.
+	template< class T >
+	bool intersectQuantized( const Ray& r , Intersection* intersect ) const;
+
+	//! @brief Evaluate the linear bounds of the flattened nodes if any primitive moves.
+    //!
+    //! The tree is built with the bounding boxes covering the whole frame, the linear bounds are evaluated bottom-up
+    //! afterward so that the topology is the same with a static tree.
+	void buildMotionBounds();
+
+	//! @brief Gather the kinds of rays each flattened node is hidden from if any primitive is hidden.
+    //!
+    //! A node is hidden from a kind of rays only if all primitives below it are, the whole subtree is skipped
+    //! by such rays then. The masks are evaluated bottom-up just like the linear bounds of moving primitives.
+	void buildHiddenMasks();
+
+	//! @brief Whether a flattened node is hidden from a kind of rays.
+    //! @param id       The index of the flattened node.
+    //! @param type     The kind of the ray, it is one of RAY_TYPE.
+    //! @return         True if all primitives below the node are hidden from the ray.
+	bool nodeHidden( unsigned id , unsigned type ) const
+	{
+		return m_hidden && ( m_hidden[id] & type );
+	}
+
+	//! @brief Get the bounding box of a flattened node at a time of the frame.
+    //! @param id       The index of the flattened node.
+    //! @param time     The time of the ray.
+    //! @param moved    The storage of the interpolated bounding box if any primitive moves.
+    //! @return         The bounding box of the node, it is either the one of the node or 'moved'.
+	const BBox& nodeBox( unsigned id , float time , BBox& moved ) const
+	{
+		if( m_motion == nullptr )
+			return m_nodes[id].bbox;
+		const Bvh_Motion_Bounds& bounds = m_motion[id];
+		moved.m_Min = bounds.start.m_Min + ( bounds.end.m_Min - bounds.start.m_Min ) * time;
+		moved.m_Max = bounds.start.m_Max + ( bounds.end.m_Max - bounds.start.m_Max ) * time;
+		return moved;
+	}
+
+	//! @brief Evaluate the SAH cost of the flattened tree relative to the root node.
+    //! @return         The SAH cost of the tree.
+	float evaluateSah() const;
+
+	//! @brief Collect the statistics of the BVH sub-tree after construction.
+    //! @param node     The root node of the sub-tree.
+    //! @param depth    The depth of the node.
+	void collectStats( const Bvh_Node* node , unsigned depth );
+
+	//! @brief Split a range of primitives into consecutive chunks and process them in the thread pool.
+    //!
+    //! Ranges with few primitives are processed on the current thread as one chunk.
+    //! @param _start   The start offset of the range.
+    //! @param _end     The end offset of the range.
+    //! @param func     The function processing one chunk, its parameters are the chunk id and the range of the chunk.
+    //! @return         The number of chunks, it is never larger than the maximum number of chunks.
+    template< class Func >
+	unsigned parallelFor( unsigned _start , unsigned _end , const Func& func );
+
 	//! @brief Mark the current node as leaf node.
     //! @param node     The BVH node to be marked as leaf node.
     //! @param _start   The start offset of primitives that the node holds.
@@ -134,18 +415,141 @@ private:
     //! @return          The SAH value of the selected best split plane.
 	float pickBestSplit( unsigned& axis , float& split_pos , Bvh_Node* node , unsigned _start , unsigned _end );
 
-	//! @brief A recursive function that traverses the BVH node.
-    //! @param node         The node to be traversed.
-    //! @param ray          The ray to be tested.
-    //! @param intersect    The structure holding the intersection information. If empty pointer is passed,
-    //!                     it will return as long as one intersection is found and it won't be necessary to be
-    //!                     the nearest one.
-    //! @param fmin         The minimum range along the ray.
-    //! @param fmax         The maximum range along the ray.
-    //! @return             True if there is intersection, otherwise it will return false.
-	bool traverseNode( const Bvh_Node* node , const Ray& ray , Intersection* intersect , float fmin , float fmax ) const;
-    
+	//! @brief Flatten the BVH sub-tree into the linear node array in depth-first order.
+    //! @param node     The root node of the sub-tree to be flattened.
+    //! @param offset   The index of the next free slot in the linear node array, it will be updated.
+    //! @param packets  The triangle packets of leaf nodes flattened so far, leaves of the sub-tree will be appended to it.
+    //! @return         The index of the node in the linear node array.
+	unsigned flattenNode( const Bvh_Node* node , unsigned& offset , std::vector<TrianglePacket>& packets );
+
+	//! @brief Pack the primitives of a leaf node into triangle packets.
+    //!
+    //! Primitives are grouped by their kinds first, so that each packet is tested with the loop of its kind.
+    //! @param pri_offset   The offset of the primitives of the leaf node in the primitive buffer.
+    //! @param pri_num      The number of primitives in the leaf node.
+    //! @param packets      The triangle packets, new packets will be appended to it.
+    //! @return             The index of the first packet of the leaf node.
+	unsigned packLeaf( unsigned pri_offset , unsigned pri_num , std::vector<TrianglePacket>& packets ) const;
+
+	//! @brief Copy the triangle packets into aligned memory used during traversal.
+    //! @param packets      The triangle packets of all leaf nodes.
+	void storePackets( const std::vector<TrianglePacket>& packets );
+
+	//! @brief Write the primitives of all triangle packets as indices in the primitive set.
+    //! @param stream       The buffer to write into.
+	void serializePackets( AccelWriter& stream ) const;
+
+	//! @brief Read the primitives of all triangle packets and pack them again.
+    //! @param stream       The payload to read from.
+    //! @return             False if the data doesn't match the primitive set.
+	bool deserializePackets( AccelReader& stream );
+
+	//! @brief Check whether a leaf node references existing triangle packets only.
+    //!
+    //! Packets of a leaf hold primitives of one kind each, the leaf owns the consecutive packets whose lanes add up to its primitives.
+    //! @param packet       The index of the first packet of the leaf node.
+    //! @param pri_num      The number of primitives in the leaf node.
+    //! @return             True if all packets of the leaf node exist.
+	bool validLeaf( unsigned packet , unsigned pri_num ) const;
+
+	//! @brief Get the nearest intersection between the ray and the primitives of a leaf node.
+    //! @param r            The input ray to be tested.
+    //! @param intersect    The intersection result, it is only updated with intersections nearer than the one it holds.
+    //! @param packet       The index of the first packet of the leaf node.
+    //! @param pri_num      The number of primitives in the leaf node.
+    //! @return             It will return true if there is a nearer intersection in the leaf node.
+	bool intersectLeaf( const Ray& r , Intersection* intersect , unsigned packet , unsigned pri_num ) const;
+
+	//! @brief Get the nearest intersections of a packet of rays.
+    //! @param rays         The rays in the packet.
+    //! @param intersects   The intersection results, one for each ray.
+    //! @param results      Whether each ray hits any primitive.
+    //! @param count        The number of rays in the packet, it can't be larger than BVH_PACKET_SIZE.
+	void intersectPacket( const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const;
+
+	//! @brief Check whether each ray of a packet is blocked by any primitive.
+    //! @param rays         The rays in the packet.
+    //! @param results      Whether each ray is blocked by any primitive.
+    //! @param count        The number of rays in the packet, it can't be larger than BVH_PACKET_SIZE.
+	void occludedPacket( const Ray* rays , bool* results , unsigned count ) const;
+
+	//! @brief Check whether the ray is blocked by any primitive of a leaf node.
+    //! @param r            The input ray to be tested.
+    //! @param packet       The index of the first packet of the leaf node.
+    //! @param pri_num      The number of primitives in the leaf node.
+    //! @return             It will return true if there is any intersection in the leaf node.
+	bool occludedLeaf( const Ray& r , unsigned packet , unsigned pri_num ) const;
+
     //! @brief Delete all nodes in the BVH.
     //! @param node The node to be deleted.
     void deleteNode( Bvh_Node* node );
+
+	//! Register all properties.
+	void _registerAllProperty();
+
+	//! Property enabling spatial splits, '1' enables it.
+	class SbvhProperty : public PropertyHandler<Accelerator>
+	{
+	public:
+		PH_CONSTRUCTOR(SbvhProperty,Accelerator);
+		void SetValue( const string& str )
+		{
+			Bvh* bvh = CAST_TARGET(Bvh);
+			if( bvh )
+				bvh->m_sbvh = ( atoi( str.c_str() ) == 1 );
+		}
+	};
+
+	//! Property enabling refitting when the BVH is built again, '1' enables it. Only the binary BVH supports it.
+	class RefitProperty : public PropertyHandler<Accelerator>
+	{
+	public:
+		PH_CONSTRUCTOR(RefitProperty,Accelerator);
+		void SetValue( const string& str )
+		{
+			Bvh* bvh = CAST_TARGET(Bvh);
+			if( bvh )
+				bvh->m_refit = ( atoi( str.c_str() ) == 1 );
+		}
+	};
+
+	//! Property of the allowed SAH cost growth ratio before a refitted BVH is rebuilt.
+	class RefitThresholdProperty : public PropertyHandler<Accelerator>
+	{
+	public:
+		PH_CONSTRUCTOR(RefitThresholdProperty,Accelerator);
+		void SetValue( const string& str )
+		{
+			Bvh* bvh = CAST_TARGET(Bvh);
+			if( bvh )
+				bvh->m_refitThreshold = max( 1.0f , (float)atof( str.c_str() ) );
+		}
+	};
+
+	//! Property of the number of bits of quantized node bounds, '8' or '16' enables compression. Only the binary BVH supports it.
+	class CompressProperty : public PropertyHandler<Accelerator>
+	{
+	public:
+		PH_CONSTRUCTOR(CompressProperty,Accelerator);
+		void SetValue( const string& str )
+		{
+			Bvh* bvh = CAST_TARGET(Bvh);
+			const unsigned bits = (unsigned)atoi( str.c_str() );
+			if( bvh )
+				bvh->m_compressBits = ( bits == 8 || bits == 16 ) ? bits : 0;
+		}
+	};
+
+	//! Property limiting the extra primitive references from spatial splits, relative to the number of primitives.
+	class SbvhBudgetProperty : public PropertyHandler<Accelerator>
+	{
+	public:
+		PH_CONSTRUCTOR(SbvhBudgetProperty,Accelerator);
+		void SetValue( const string& str )
+		{
+			Bvh* bvh = CAST_TARGET(Bvh);
+			if( bvh )
+				bvh->m_sbvhBudget = max( 0.0f , (float)atof( str.c_str() ) );
+		}
+	};
 };
@@ -0,0 +1,274 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "embreeaccel.h"
+
+#if SORT_USE_EMBREE
+
+#include "geometry/primitive.h"
+#include "geometry/intersection.h"
+#include "log/log.h"
+#include "utility/statsreport.h"
+
+IMPLEMENT_CREATOR( EmbreeAccel );
+
+// the context of a query , the callbacks of user geometries need the original ray and the intersection to fill
+struct EmbreeContext
+{
+	RTCIntersectContext	context;		// it has to be the first member , Embree passes a pointer to it
+	const Ray*			ray;
+	Intersection*		intersect;
+};
+
+// convert a ray to the one of Embree
+static void toEmbreeRay( const Ray& r , float tfar , RTCRay& ray )
+{
+	ray.org_x = r.m_Ori.x; ray.org_y = r.m_Ori.y; ray.org_z = r.m_Ori.z;
+	ray.dir_x = r.m_Dir.x; ray.dir_y = r.m_Dir.y; ray.dir_z = r.m_Dir.z;
+	ray.tnear = r.m_fMin;
+	ray.tfar = tfar;
+	ray.time = r.m_Time;
+	ray.mask = 0xFFFFFFFF;
+	ray.id = 0;
+	ray.flags = 0;
+}
+
+// destructor
+EmbreeAccel::~EmbreeAccel()
+{
+	release();
+}
+
+// release the scene and the device
+void EmbreeAccel::release()
+{
+	if( m_scene )
+		rtcReleaseScene( m_scene );
+	if( m_device )
+		rtcReleaseDevice( m_device );
+	m_scene = nullptr;
+	m_device = nullptr;
+	m_triGeometry = m_userGeometry = RTC_INVALID_GEOMETRY_ID;
+	m_triangles.clear();
+	m_others.clear();
+}
+
+// keep track of the memory allocated by the device
+bool EmbreeAccel::memoryMonitor( void* ptr , ssize_t bytes , bool post )
+{
+	((EmbreeAccel*)ptr)->m_memory += (long long)bytes;
+	return true;
+}
+
+// the bounding box of a primitive of the user geometry
+void EmbreeAccel::userBounds( const RTCBoundsFunctionArguments* args )
+{
+	const EmbreeAccel* accel = (const EmbreeAccel*)args->geometryUserPtr;
+	const BBox& bbox = accel->m_others[args->primID]->GetBBox();
+	args->bounds_o->lower_x = bbox.m_Min.x; args->bounds_o->lower_y = bbox.m_Min.y; args->bounds_o->lower_z = bbox.m_Min.z;
+	args->bounds_o->upper_x = bbox.m_Max.x; args->bounds_o->upper_y = bbox.m_Max.y; args->bounds_o->upper_z = bbox.m_Max.z;
+}
+
+// intersect a primitive of the user geometry with its own routine , only single rays are traced
+void EmbreeAccel::userIntersect( const RTCIntersectFunctionNArguments* args )
+{
+	if( !args->valid[0] )
+		return;
+
+	const EmbreeAccel* accel = (const EmbreeAccel*)args->geometryUserPtr;
+	const EmbreeContext* context = (const EmbreeContext*)args->context;
+	RTCRayHit* rayhit = (RTCRayHit*)args->rayhit;
+
+	// primitives hidden from the ray are never hit
+	const Primitive* primitive = accel->m_others[args->primID];
+	if( primitive->IsHiddenFrom( context->ray->m_Type ) )
+		return;
+
+	// the hit is only taken if it is closer than the current one
+	Intersection hit;
+	hit.t = rayhit->ray.tfar;
+	if( !primitive->GetIntersect( *context->ray , &hit ) || !( hit.t < rayhit->ray.tfar ) )
+		return;
+
+	// the primitive , which could be a mesh instance , is recorded along with the distance
+	Intersection* intersect = context->intersect;
+	intersect->t = hit.t;
+	intersect->bu = hit.bu;
+	intersect->bv = hit.bv;
+	intersect->primitive = hit.primitive;
+	intersect->instanced = hit.instanced;
+
+	rayhit->ray.tfar = hit.t;
+	rayhit->hit.geomID = args->geomID;
+	rayhit->hit.primID = args->primID;
+	rayhit->hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+}
+
+// check whether the ray is blocked by a primitive of the user geometry
+void EmbreeAccel::userOccluded( const RTCOccludedFunctionNArguments* args )
+{
+	if( !args->valid[0] )
+		return;
+
+	const EmbreeAccel* accel = (const EmbreeAccel*)args->geometryUserPtr;
+	const EmbreeContext* context = (const EmbreeContext*)args->context;
+	RTCRay* ray = (RTCRay*)args->ray;
+
+	// occlusion queries are shadow rays
+	const Primitive* primitive = accel->m_others[args->primID];
+	if( primitive->IsHiddenFrom( RAY_SHADOW ) )
+		return;
+
+	Ray r = *context->ray;
+	r.m_fMax = ray->tfar;
+	if( primitive->GetIntersect( r , nullptr ) )
+		ray->tfar = -FLT_MAX;
+}
+
+// build the embree scene
+void EmbreeAccel::Build()
+{
+	release();
+	computeBBox();
+
+	m_device = rtcNewDevice( nullptr );
+	if( m_device == nullptr ){
+		slog( WARNING , SPATIAL_ACCELERATOR , stringFormat( "Failed to create Embree device , error code %d." , (int)rtcGetDeviceError( nullptr ) ) );
+		return;
+	}
+	rtcSetDeviceMemoryMonitorFunction( m_device , memoryMonitor , this );
+	m_scene = rtcNewScene( m_device );
+	rtcSetSceneBuildQuality( m_scene , m_quality );
+	// the robust mode of embree is watertight , it agrees with the triangle test of the other accelerators
+	rtcSetSceneFlags( m_scene , RTC_SCENE_FLAG_ROBUST );
+
+	// static triangles seen by all rays and never cut away go to the native geometry , everything else is tested with its own routine
+	std::vector<Point> vertices;
+	for( Primitive* primitive : *m_primitives ){
+		Point p0 , p1 , p2;
+		BBox start , end;
+		if( !primitive->GetMotionBBox( start , end ) && primitive->GetHidden() == 0 && !primitive->IsCutout() && primitive->GetTriangleVertices( p0 , p1 , p2 ) ){
+			vertices.push_back( p0 );
+			vertices.push_back( p1 );
+			vertices.push_back( p2 );
+			m_triangles.push_back( primitive );
+		}else
+			m_others.push_back( primitive );
+	}
+
+	if( !m_triangles.empty() ){
+		const unsigned count = (unsigned)m_triangles.size();
+		RTCGeometry geometry = rtcNewGeometry( m_device , RTC_GEOMETRY_TYPE_TRIANGLE );
+		rtcSetGeometryBuildQuality( geometry , m_quality );
+		float* vb = (float*)rtcSetNewGeometryBuffer( geometry , RTC_BUFFER_TYPE_VERTEX , 0 , RTC_FORMAT_FLOAT3 , 3 * sizeof( float ) , 3 * count );
+		unsigned* ib = (unsigned*)rtcSetNewGeometryBuffer( geometry , RTC_BUFFER_TYPE_INDEX , 0 , RTC_FORMAT_UINT3 , 3 * sizeof( unsigned ) , count );
+		for( unsigned i = 0 ; i < 3 * count ; ++i ){
+			vb[ 3 * i ] = vertices[i].x;
+			vb[ 3 * i + 1 ] = vertices[i].y;
+			vb[ 3 * i + 2 ] = vertices[i].z;
+			ib[i] = i;
+		}
+		rtcCommitGeometry( geometry );
+		m_triGeometry = rtcAttachGeometry( m_scene , geometry );
+		rtcReleaseGeometry( geometry );
+	}
+	vector<Point>().swap( vertices );
+
+	if( !m_others.empty() ){
+		RTCGeometry geometry = rtcNewGeometry( m_device , RTC_GEOMETRY_TYPE_USER );
+		rtcSetGeometryUserPrimitiveCount( geometry , (unsigned)m_others.size() );
+		rtcSetGeometryUserData( geometry , this );
+		rtcSetGeometryBoundsFunction( geometry , userBounds , nullptr );
+		rtcSetGeometryIntersectFunction( geometry , userIntersect );
+		rtcSetGeometryOccludedFunction( geometry , userOccluded );
+		rtcCommitGeometry( geometry );
+		m_userGeometry = rtcAttachGeometry( m_scene , geometry );
+		rtcReleaseGeometry( geometry );
+	}
+
+	rtcCommitScene( m_scene );
+
+	const RTCError error = rtcGetDeviceError( m_device );
+	if( error != RTC_ERROR_NONE )
+		slog( WARNING , SPATIAL_ACCELERATOR , stringFormat( "Embree reported error code %d during construction." , (int)error ) );
+}
+
+// get the intersection between the ray and the scene
+bool EmbreeAccel::GetIntersect( const Ray& r , Intersection* intersect ) const
+{
+	if( m_scene == nullptr )
+		return false;
+	if( intersect == nullptr )
+		return IsOccluded( r );
+
+	EmbreeContext context;
+	rtcInitIntersectContext( &context.context );
+	context.ray = &r;
+	context.intersect = intersect;
+
+	RTCRayHit rayhit;
+	toEmbreeRay( r , min( r.m_fMax , intersect->t ) , rayhit.ray );
+	rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+	rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+	rtcIntersect1( m_scene , &context.context , &rayhit );
+
+	if( rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID )
+		return false;
+
+	// hits of the user geometry are recorded in the callback already , the barycentric coordinates of Embree match the ones of triangles
+	if( rayhit.hit.geomID == m_triGeometry ){
+		intersect->t = rayhit.ray.tfar;
+		intersect->bu = rayhit.hit.u;
+		intersect->bv = rayhit.hit.v;
+		intersect->primitive = primitiveOf( rayhit.hit.geomID , rayhit.hit.primID );
+		intersect->instanced = nullptr;
+	}
+	return true;
+}
+
+// check whether the ray is blocked by any primitive
+bool EmbreeAccel::IsOccluded( const Ray& r ) const
+{
+	if( m_scene == nullptr )
+		return false;
+
+	EmbreeContext context;
+	rtcInitIntersectContext( &context.context );
+	context.context.flags = RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+	context.ray = &r;
+	context.intersect = nullptr;
+
+	RTCRay ray;
+	toEmbreeRay( r , r.m_fMax , ray );
+	rtcOccluded1( m_scene , &context.context , &ray );
+	return ray.tfar < 0.0f;
+}
+
+// output log information
+void EmbreeAccel::OutputLog() const
+{
+	slog( INFO , SPATIAL_ACCELERATOR , "Spatial accelerator is Embree." );
+	slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "%d triangles are traced by Embree , %d other primitives are tested with their own routines. Embree takes %lld bytes." , (unsigned)m_triangles.size() , (unsigned)m_others.size() , m_memory.load() ) );
+}
+
+// add the size of the scene to the report
+void EmbreeAccel::CollectStats( StatsGroup& stats ) const
+{
+	stats.Add( "type" , "embree" ).Add( "triangles" , (unsigned)m_triangles.size() ).Add( "user_primitives" , (unsigned)m_others.size() );
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "accelerator.h"
+
+#if SORT_USE_EMBREE
+
+#include <embree3/rtcore.h>
+
+//! @brief Acceleration structure built and traversed by Intel Embree.
+/**
+ * Triangles are copied into a triangle geometry of an Embree scene, in world space, since the vertex
+ * buffers of meshes could be quantized or shared by instances and can't be handed to Embree as they are.
+ * Any other primitive, including mesh instances and moving triangles, is kept in a user geometry whose
+ * intersection callback calls the routine of the primitive itself.
+ * Only the distance and the barycentric coordinates of the nearest hit are recorded, the shading
+ * information is resolved by the primitive afterward the same way as with the other accelerators.
+ * It is only available if SORT is built with Embree, 'bvh' is used instead otherwise.
+ */
+class EmbreeAccel : public Accelerator
+{
+public:
+	DEFINE_CREATOR( EmbreeAccel , Accelerator , "embree" );
+
+	//! Default constructor.
+	EmbreeAccel() { _registerProperty( "quality" , new QualityProperty(this) ); }
+
+	//! Destructor releasing the Embree scene and device.
+	~EmbreeAccel() override;
+
+    //! @brief Get intersection between the ray and the primitive set.
+    //! @param r            The input ray to be tested.
+    //! @param intersect    The intersection result, the query stops at any hit if it is nullptr.
+    //! @return             It will return true if there is an intersection, otherwise it returns false.
+	bool GetIntersect( const Ray& r , Intersection* intersect ) const override;
+
+    //! @brief Check whether the ray is blocked by any primitive.
+    //! @param r    The input ray to be tested.
+    //! @return     It will return true if there is any intersection, otherwise it returns false.
+	bool IsOccluded( const Ray& r ) const override;
+
+	//! Build the Embree scene.
+	void Build() override;
+
+	//! Output log information
+	void OutputLog() const override;
+
+	//! Add the type and the size of the scene to the statistics report
+	void CollectStats( StatsGroup& stats ) const override;
+
+	//! Get the memory allocated by Embree for the scene
+	size_t GetMemoryUsage() const override { return (size_t)m_memory.load(); }
+
+private:
+	RTCDevice                   m_device = nullptr;         /**< The Embree device owning the scene. */
+	RTCScene                    m_scene = nullptr;          /**< The committed Embree scene. */
+	unsigned                    m_triGeometry = RTC_INVALID_GEOMETRY_ID;    /**< Id of the geometry of triangles. */
+	unsigned                    m_userGeometry = RTC_INVALID_GEOMETRY_ID;   /**< Id of the geometry of the other primitives. */
+	std::vector<Primitive*>     m_triangles;                /**< Primitives of the triangle geometry, indexed by Embree primitive id. */
+	std::vector<Primitive*>     m_others;                   /**< Primitives of the user geometry, indexed by Embree primitive id. */
+	RTCBuildQuality             m_quality = RTC_BUILD_QUALITY_HIGH; /**< Quality of the built hierarchy. */
+	std::atomic<long long>      m_memory{0};                /**< Bytes currently allocated by the device. */
+
+	//! Release the scene and the device.
+	void release();
+
+	//! @brief Get the primitive of a hit reported by Embree.
+    //! @param geomID   The id of the geometry that is hit.
+    //! @param primID   The id of the primitive in the geometry.
+    //! @return         The primitive that is hit.
+	Primitive* primitiveOf( unsigned geomID , unsigned primID ) const {
+		return ( geomID == m_triGeometry ) ? m_triangles[primID] : m_others[primID];
+	}
+
+	//! Callbacks of Embree, they are static members so that they can reach the private fields.
+	static bool memoryMonitor( void* ptr , ssize_t bytes , bool post );
+	static void userBounds( const RTCBoundsFunctionArguments* args );
+	static void userIntersect( const RTCIntersectFunctionNArguments* args );
+	static void userOccluded( const RTCOccludedFunctionNArguments* args );
+
+	//! Property of the quality of the hierarchy, it is one of 'low', 'medium' and 'high'.
+	class QualityProperty : public PropertyHandler<Accelerator>
+	{
+	public:
+		PH_CONSTRUCTOR(QualityProperty,Accelerator);
+		void SetValue( const string& str )
+		{
+			EmbreeAccel* embree = CAST_TARGET(EmbreeAccel);
+			if( embree )
+				embree->m_quality = ( str == "low" ) ? RTC_BUILD_QUALITY_LOW : ( ( str == "medium" ) ? RTC_BUILD_QUALITY_MEDIUM : RTC_BUILD_QUALITY_HIGH );
+		}
+	};
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "gpudevice.h"
+
+#if SORT_USE_CUDA
+
+#include <cuda_runtime.h>
+#include "gputraversal.h"
+
+static const unsigned GPU_BLOCK_SIZE = 128;     // threads of a block , one for each ray
+
+// trace a batch of rays , one thread for each ray
+__global__ void gpuTraceKernel( const GpuNode* nodes , const GpuPrimitive* primitives , const GpuRay* rays , GpuHit* hits , unsigned count , bool any )
+{
+    const unsigned i = blockIdx.x * blockDim.x + threadIdx.x;
+    if( i < count )
+        hits[i] = gpuTraverse( nodes , primitives , rays[i] , any );
+}
+
+// whether there is a device
+bool GpuDeviceAvailable()
+{
+    int count = 0;
+    return cudaGetDeviceCount( &count ) == cudaSuccess && count > 0;
+}
+
+// copy a buffer to the device
+void* GpuUpload( const void* data , size_t bytes )
+{
+    void* ptr = nullptr;
+    if( cudaMalloc( &ptr , bytes ) != cudaSuccess )
+        return nullptr;
+    if( cudaMemcpy( ptr , data , bytes , cudaMemcpyHostToDevice ) != cudaSuccess ){
+        cudaFree( ptr );
+        return nullptr;
+    }
+    return ptr;
+}
+
+// release a buffer on the device
+void GpuRelease( void* ptr )
+{
+    if( ptr )
+        cudaFree( ptr );
+}
+
+// release the stream and the buffers
+GpuStream::~GpuStream()
+{
+    cudaFreeHost( m_hostRays );
+    cudaFreeHost( m_hostHits );
+    cudaFree( m_devRays );
+    cudaFree( m_devHits );
+    if( m_stream )
+        cudaStreamDestroy( (cudaStream_t)m_stream );
+}
+
+// get the host buffer of rays
+GpuRay* GpuStream::Reserve( unsigned count )
+{
+    if( m_stream == nullptr ){
+        cudaStream_t stream;
+        cudaStreamCreateWithFlags( &stream , cudaStreamNonBlocking );
+        m_stream = stream;
+    }
+    if( count <= m_capacity )
+        return m_hostRays;
+
+    // the buffers grow by half of their size at least , so that they are not reallocated for every larger batch
+    const unsigned capacity = count > m_capacity + m_capacity / 2 ? count : m_capacity + m_capacity / 2;
+    cudaFreeHost( m_hostRays );
+    cudaFreeHost( m_hostHits );
+    cudaFree( m_devRays );
+    cudaFree( m_devHits );
+    cudaMallocHost( (void**)&m_hostRays , sizeof( GpuRay ) * capacity );
+    cudaMallocHost( (void**)&m_hostHits , sizeof( GpuHit ) * capacity );
+    cudaMalloc( (void**)&m_devRays , sizeof( GpuRay ) * capacity );
+    cudaMalloc( (void**)&m_devHits , sizeof( GpuHit ) * capacity );
+    m_capacity = capacity;
+    return m_hostRays;
+}
+
+// trace the rays asynchronously
+void GpuStream::Launch( const GpuNode* nodes , const GpuPrimitive* primitives , unsigned count , bool any )
+{
+    cudaStream_t stream = (cudaStream_t)m_stream;
+    cudaMemcpyAsync( m_devRays , m_hostRays , sizeof( GpuRay ) * count , cudaMemcpyHostToDevice , stream );
+    gpuTraceKernel<<< ( count + GPU_BLOCK_SIZE - 1 ) / GPU_BLOCK_SIZE , GPU_BLOCK_SIZE , 0 , stream >>>( nodes , primitives , m_devRays , m_devHits , count , any );
+    cudaMemcpyAsync( m_hostHits , m_devHits , sizeof( GpuHit ) * count , cudaMemcpyDeviceToHost , stream );
+}
+
+// wait for the batch
+const GpuHit* GpuStream::Sync()
+{
+    cudaStreamSynchronize( (cudaStream_t)m_stream );
+    return m_hostHits;
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "gpuquery.h"
+
+#if SORT_USE_CUDA
+
+// the interface of the CUDA translation unit , nothing else of SORT is compiled by nvcc
+
+//! @brief Whether there is a CUDA device to trace rays with.
+bool GpuDeviceAvailable();
+
+//! @brief Copy a buffer to the memory of the device.
+//! @param data     The data to copy.
+//! @param bytes    The size of the data.
+//! @return         The buffer on the device, it is nullptr if it can't be allocated.
+void* GpuUpload( const void* data , size_t bytes );
+
+//! @brief Release a buffer on the device.
+//! @param ptr      The buffer returned by GpuUpload.
+void GpuRelease( void* ptr );
+
+//! @brief A CUDA stream along with its buffers , one batch of rays is traced in it at a time.
+class GpuStream
+{
+public:
+    //! Destructor releasing the stream and the buffers.
+    ~GpuStream();
+
+    //! @brief Get the pinned host buffer to fill rays into.
+    //! @param count    Number of rays of the batch, the buffers grow if needed.
+    //! @return         The buffer of the rays.
+    GpuRay* Reserve( unsigned count );
+
+    //! @brief Copy the rays to the device and trace them asynchronously.
+    //! @param nodes        Nodes of the tree on the device.
+    //! @param primitives   Primitives of the tree on the device.
+    //! @param count        Number of rays in the batch.
+    //! @param any          Whether the traversal stops at the first hit.
+    void Launch( const GpuNode* nodes , const GpuPrimitive* primitives , unsigned count , bool any );
+
+    //! @brief Wait for the batch to be done.
+    //! @return The hits copied back to the host, one for each ray.
+    const GpuHit* Sync();
+
+private:
+    void*       m_stream = nullptr;     /**< The CUDA stream. */
+    GpuRay*     m_hostRays = nullptr;   /**< Pinned host buffer of rays. */
+    GpuHit*     m_hostHits = nullptr;   /**< Pinned host buffer of hits. */
+    GpuRay*     m_devRays = nullptr;    /**< Rays on the device. */
+    GpuHit*     m_devHits = nullptr;    /**< Hits on the device. */
+    unsigned    m_capacity = 0;         /**< Number of rays the buffers could hold. */
+};
+
+#endif
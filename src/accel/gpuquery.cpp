@@ -0,0 +1,112 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "gpuquery.h"
+
+#if SORT_USE_CUDA
+
+#include "gpudevice.h"
+#include "geometry/ray.h"
+#include "geometry/intersection.h"
+
+// the CUDA streams and the batches of the two slots of a rendering thread
+struct GpuThreadContext
+{
+    GpuStream               streams[2];
+    GpuRayQuery::Batch      batches[2];
+};
+
+static GpuThreadContext& threadContext()
+{
+    static thread_local GpuThreadContext context;
+    return context;
+}
+
+// release the tree on the device
+GpuRayQuery::~GpuRayQuery()
+{
+    GpuRelease( m_nodes );
+    GpuRelease( m_primitives );
+}
+
+// upload the tree
+bool GpuRayQuery::Upload( const GpuTree& tree )
+{
+    if( tree.nodes.empty() || tree.primitives.empty() || !GpuDeviceAvailable() )
+        return false;
+
+    const size_t node_bytes = sizeof( GpuNode ) * tree.nodes.size();
+    const size_t primitive_bytes = sizeof( GpuPrimitive ) * tree.primitives.size();
+    m_nodes = (GpuNode*)GpuUpload( tree.nodes.data() , node_bytes );
+    m_primitives = (GpuPrimitive*)GpuUpload( tree.primitives.data() , primitive_bytes );
+    if( m_nodes == nullptr || m_primitives == nullptr )
+        return false;
+
+    m_tree = &tree;
+    m_memory = node_bytes + primitive_bytes;
+    return true;
+}
+
+// start tracing a batch
+void GpuRayQuery::Submit( unsigned slot , const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const
+{
+    GpuThreadContext& context = threadContext();
+    Batch& batch = context.batches[slot];
+    batch.rays = rays;
+    batch.intersects = intersects;
+    batch.results = results;
+    batch.count = count;
+    if( count == 0 )
+        return;
+
+    GpuRay* gpu_rays = context.streams[slot].Reserve( count );
+    for( unsigned i = 0 ; i < count ; ++i ){
+        const Ray& r = rays[i];
+        GpuRay& ray = gpu_rays[i];
+        ray.ori[0] = r.m_Ori.x; ray.ori[1] = r.m_Ori.y; ray.ori[2] = r.m_Ori.z;
+        ray.dir[0] = r.m_Dir.x; ray.dir[1] = r.m_Dir.y; ray.dir[2] = r.m_Dir.z;
+        ray.tmin = r.m_fMin;
+        ray.tmax = ( intersects && intersects[i].t < r.m_fMax ) ? intersects[i].t : r.m_fMax;
+    }
+    context.streams[slot].Launch( m_nodes , m_primitives , count , intersects == nullptr );
+}
+
+// wait for a batch and fill its results
+const GpuRayQuery::Batch& GpuRayQuery::Wait( unsigned slot ) const
+{
+    GpuThreadContext& context = threadContext();
+    const Batch& batch = context.batches[slot];
+    if( batch.count == 0 )
+        return batch;
+
+    const GpuHit* hits = context.streams[slot].Sync();
+    for( unsigned i = 0 ; i < batch.count ; ++i ){
+        const GpuHit& hit = hits[i];
+        batch.results[i] = ( hit.source != GPU_NO_HIT );
+        if( batch.results[i] && batch.intersects ){
+            // only the hit is recorded , it is resolved by the caller
+            Intersection& intersect = batch.intersects[i];
+            intersect.t = hit.t;
+            intersect.bu = hit.u;
+            intersect.bv = hit.v;
+            intersect.primitive = const_cast<Primitive*>( m_tree->sources[hit.source] );
+        }
+    }
+    return batch;
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <vector>
+
+class Primitive;
+class Ray;
+class Intersection;
+
+//! @brief Flattened node of the hierarchy traced on the GPU, it is exactly 32 bytes.
+struct GpuNode
+{
+    float       bmin[3];    /**< The minimum point of the bounding box. */
+    unsigned    count;      /**< Number of primitives in a leaf, it is 0 for interior nodes. */
+    float       bmax[3];    /**< The maximum point of the bounding box. */
+    unsigned    offset;     /**< Index of the first primitive for leaves, index of the second child for interior nodes. */
+};
+
+//! @brief World space primitive traced on the GPU, its data is precomputed the same way as the lanes of triangle packets.
+struct GpuPrimitive
+{
+    float       p0[3];      /**< The first vertex of a triangle or the center of an analytic shape. */
+    float       e1[3];      /**< The second vertex of a triangle or the first axis of an analytic shape. */
+    float       e2[3];      /**< The third vertex of a triangle or the second axis of an analytic shape. */
+    unsigned    type;       /**< The kind of the primitive , it is one of PACKET_TYPE except PACKET_GENERIC. */
+    unsigned    source;     /**< Index of the primitive in the source table of the tree. */
+    unsigned    padding;    /**< Unused , it keeps the size at 48 bytes. */
+};
+
+//! @brief Ray uploaded to the GPU, only the parts needed by traversal are kept.
+struct GpuRay
+{
+    float       ori[3];     /**< The origin of the ray. */
+    float       tmin;       /**< The minimum distance along the ray. */
+    float       dir[3];     /**< The direction of the ray. */
+    float       tmax;       /**< The maximum distance along the ray. */
+};
+
+//! @brief The nearest hit of a ray found on the GPU.
+struct GpuHit
+{
+    float       t;          /**< Distance along the ray. */
+    float       u;          /**< The first barycentric coordinate. */
+    float       v;          /**< The second barycentric coordinate. */
+    unsigned    source;     /**< Index of the primitive in the source table, it is GPU_NO_HIT if nothing is hit. */
+};
+
+static const unsigned GPU_NO_HIT = 0xFFFFFFFF;  /**< The primitive index of rays that hit nothing. */
+
+//! @brief The acceleration structure in a layout that could be copied to the GPU as it is.
+//!
+//! Nodes are in depth-first order, the first child of an interior node is right after it.
+//! Primitives of a leaf are consecutive, the node at index 0 is the root.
+struct GpuTree
+{
+    std::vector<GpuNode>            nodes;      /**< Nodes of the hierarchy. */
+    std::vector<GpuPrimitive>       primitives; /**< Primitives referenced by the leaves. */
+    std::vector<const Primitive*>   sources;    /**< The primitive of each index referenced by the flattened primitives. */
+};
+
+#if SORT_USE_CUDA
+
+//! @brief Closest hit and occlusion queries of ray streams running on the GPU.
+/**
+ * The flattened tree exported by the accelerator is uploaded once, batches of rays are then traced
+ * asynchronously, one thread of the GPU for each ray. Every rendering thread has its own CUDA streams
+ * and pinned buffers for two slots, so that the batch of one slot is traced while the batch of the
+ * other slot is shaded on the CPU. Only the distance, the barycentric coordinates and the primitive
+ * of hits are filled, resolving the hits is up to the caller.
+ */
+class GpuRayQuery
+{
+public:
+    //! @brief A batch of rays being traced in a slot.
+    struct Batch
+    {
+        const Ray*      rays = nullptr;         /**< The rays of the batch. */
+        Intersection*   intersects = nullptr;   /**< The intersections to fill, it is nullptr for occlusion queries. */
+        bool*           results = nullptr;      /**< Whether each ray hits anything. */
+        unsigned        count = 0;              /**< Number of rays in the batch. */
+    };
+
+    //! Destructor releasing the memory on the device.
+    ~GpuRayQuery();
+
+    //! @brief Upload the tree to the GPU.
+    //! @param tree     The flattened tree, it has to be kept alive since the source table is referenced.
+    //! @return         False if there is no usable device or the memory can't be allocated.
+    bool Upload( const GpuTree& tree );
+
+    //! @brief Start tracing a batch of rays in a slot of the current thread.
+    //! @param slot         The slot, 0 or 1. The previous batch of the slot has to be waited for.
+    //! @param rays         The rays to trace, they have to be kept alive until the batch is waited for.
+    //! @param intersects   The intersections to fill with the nearest hits, nullptr for occlusion queries.
+    //! @param results      Whether each ray hits anything or is blocked.
+    //! @param count        Number of rays in the batch.
+    void Submit( unsigned slot , const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const;
+
+    //! @brief Wait for the batch of a slot of the current thread and fill its results.
+    //! @param slot     The slot that the batch is submitted to.
+    //! @return         The batch that is done.
+    const Batch& Wait( unsigned slot ) const;
+
+    //! Get the memory of the tree on the device.
+    size_t GetMemoryUsage() const { return m_memory; }
+
+private:
+    GpuNode*        m_nodes = nullptr;      /**< Nodes on the device. */
+    GpuPrimitive*   m_primitives = nullptr; /**< Primitives on the device. */
+    const GpuTree*  m_tree = nullptr;       /**< The uploaded tree, its source table maps the hits back. */
+    size_t          m_memory = 0;           /**< Bytes of the tree on the device. */
+};
+
+#endif
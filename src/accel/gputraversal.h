@@ -0,0 +1,229 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "gpuquery.h"
+#include "utility/enum.h"
+#include <float.h>
+
+// the traversal is shared by the kernels and the host , so that it could be checked against the accelerator on the CPU
+#ifdef __CUDACC__
+    #define GPU_FUNC    __host__ __device__ inline
+#else
+    #define GPU_FUNC    inline
+#endif
+
+static const unsigned   GPU_STACK_SIZE      = 64;           // the same depth limit with the BVH
+
+GPU_FUNC float gpuDot( const float a[3] , const float b[3] )
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+GPU_FUNC void gpuCross( const float a[3] , const float b[3] , float c[3] )
+{
+    c[0] = a[1] * b[2] - a[2] * b[1];
+    c[1] = a[2] * b[0] - a[0] * b[2];
+    c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// entering distance of a ray into a bounding box , it is negative if the ray misses it
+GPU_FUNC float gpuIntersectBox( const GpuRay& ray , const float inv[3] , const float bmin[3] , const float bmax[3] , float tmax )
+{
+    float t0 = ray.tmin , t1 = tmax;
+    for( int axis = 0 ; axis < 3 ; ++axis ){
+        float n = ( bmin[axis] - ray.ori[axis] ) * inv[axis];
+        float f = ( bmax[axis] - ray.ori[axis] ) * inv[axis];
+        if( n > f ){ const float tmp = n; n = f; f = tmp; }
+        t0 = n > t0 ? n : t0;
+        t1 = f < t1 ? f : t1;
+        if( t0 > t1 )
+            return -1.0f;
+    }
+    return t0;
+}
+
+// the bound of the relative rounding error of 'n' float operations , it is the same with ErrorBound
+GPU_FUNC float gpuErrorBound( int n )
+{
+    const float eps = FLT_EPSILON * 0.5f;
+    return ( n * eps ) / ( 1.0f - n * eps );
+}
+
+GPU_FUNC float gpuMax3( float a , float b , float c )
+{
+    const float m = a < b ? b : a;
+    return m < c ? c : m;
+}
+
+// watertight intersection between a ray and a triangle , it follows IntersectTriangle operation by operation , 'e1' and 'e2' are the other two vertexes
+GPU_FUNC bool gpuIntersectTriangle( const GpuRay& ray , const GpuPrimitive& tri , float& t , float& u , float& v )
+{
+    // the axis the direction is the longest along becomes z , the direction is sheared to ( 0 , 0 , 1 )
+    const float ax = fabsf( ray.dir[0] ) , ay = fabsf( ray.dir[1] ) , az = fabsf( ray.dir[2] );
+    const int kz = ( ax > ay ) ? ( ( ax > az ) ? 0 : 2 ) : ( ( ay > az ) ? 1 : 2 );
+    const int kx = ( kz + 1 ) % 3;
+    const int ky = ( kx + 1 ) % 3;
+    const float sx = -ray.dir[kx] / ray.dir[kz];
+    const float sy = -ray.dir[ky] / ray.dir[kz];
+    const float sz = 1.0f / ray.dir[kz];
+
+    const float* p[3] = { tri.p0 , tri.e1 , tri.e2 };
+    float x[3] , y[3] , z[3];
+    for( int k = 0 ; k < 3 ; ++k ){
+        const float dx = p[k][kx] - ray.ori[kx];
+        const float dy = p[k][ky] - ray.ori[ky];
+        const float dz = p[k][kz] - ray.ori[kz];
+        x[k] = dx + sx * dz;
+        y[k] = dy + sy * dz;
+        z[k] = dz * sz;
+    }
+
+    const float e0 = x[1] * y[2] - y[1] * x[2];
+    const float e1 = x[2] * y[0] - y[2] * x[0];
+    const float e2 = x[0] * y[1] - y[0] * x[1];
+    if( ( e0 < 0.0f || e1 < 0.0f || e2 < 0.0f ) && ( e0 > 0.0f || e1 > 0.0f || e2 > 0.0f ) )
+        return false;
+    const float det = e0 + e1 + e2;
+    if( det == 0.0f )
+        return false;
+
+    const float inv_det = 1.0f / det;
+    t = ( e0 * z[0] + e1 * z[1] + e2 * z[2] ) * inv_det;
+    u = e1 * inv_det;
+    v = e2 * inv_det;
+
+    // the same conservative bound with WatertightErrorBound
+    const float max_x = gpuMax3( fabsf( x[0] ) , fabsf( x[1] ) , fabsf( x[2] ) );
+    const float max_y = gpuMax3( fabsf( y[0] ) , fabsf( y[1] ) , fabsf( y[2] ) );
+    const float max_z = gpuMax3( fabsf( z[0] ) , fabsf( z[1] ) , fabsf( z[2] ) );
+    const float max_e = gpuMax3( fabsf( e0 ) , fabsf( e1 ) , fabsf( e2 ) );
+    const float delta_z = gpuErrorBound( 3 ) * max_z;
+    const float delta_x = gpuErrorBound( 5 ) * ( max_x + max_z );
+    const float delta_y = gpuErrorBound( 5 ) * ( max_y + max_z );
+    const float delta_e = 2.0f * ( gpuErrorBound( 2 ) * max_x * max_y + delta_y * max_x + delta_x * max_y );
+    const float delta_t = 3.0f * ( gpuErrorBound( 3 ) * max_e * max_z + delta_e * max_z + delta_z * max_e ) * fabsf( inv_det );
+    if( !( t > delta_t ) )
+        return false;
+    return t >= ray.tmin && t <= ray.tmax;
+}
+
+// intersection between a ray and a sphere , it is the same with IntersectSpherePacket , the radius is the first component of 'e1'
+GPU_FUNC bool gpuIntersectSphere( const GpuRay& ray , const GpuPrimitive& sphere , float& t )
+{
+    const float o[3] = { ray.ori[0] - sphere.p0[0] , ray.ori[1] - sphere.p0[1] , ray.ori[2] - sphere.p0[2] };
+    const float radius = sphere.e1[0];
+    const float b = 2.0f * gpuDot( ray.dir , o );
+    const float c = gpuDot( o , o ) - radius * radius;
+    const float delta = b * b - 4.0f * c;
+    if( !( delta >= 0.0f ) )
+        return false;
+    const float sq = sqrtf( delta );
+    const float min_t = ( -b - sq ) * 0.5f;
+    const float max_t = ( -b + sq ) * 0.5f;
+    t = ( min_t > 0.0f ) ? min_t : max_t;
+    return t > 0.0f && t >= ray.tmin && t <= ray.tmax;
+}
+
+// intersection between a ray and a disk or a rectangle , it is the same with IntersectPlanarPacket
+GPU_FUNC bool gpuIntersectPlanar( const GpuRay& ray , const GpuPrimitive& shape , bool disk , float& t )
+{
+    const float o[3] = { ray.ori[0] - shape.p0[0] , ray.ori[1] - shape.p0[1] , ray.ori[2] - shape.p0[2] };
+    float n[3];
+    gpuCross( shape.e2 , shape.e1 , n );
+    const float dn = gpuDot( ray.dir , n );
+    if( dn == 0.0f )
+        return false;
+    t = -gpuDot( o , n ) / dn;
+    if( !( t > ray.tmin ) || t > ray.tmax )
+        return false;
+    const float p[3] = { o[0] + ray.dir[0] * t , o[1] + ray.dir[1] * t , o[2] + ray.dir[2] * t };
+    const float u = gpuDot( p , shape.e1 );
+    const float v = gpuDot( p , shape.e2 );
+    return disk ? ( u * u + v * v <= 1.0f ) : ( fabsf( u ) <= 1.0f && fabsf( v ) <= 1.0f );
+}
+
+// intersection between a ray and a primitive of any kind , analytic shapes have no barycentric coordinates
+GPU_FUNC bool gpuIntersectPrimitive( const GpuRay& ray , const GpuPrimitive& primitive , float& t , float& u , float& v )
+{
+    u = v = 0.0f;
+    switch( primitive.type ){
+    case PACKET_TRIANGLE:
+        return gpuIntersectTriangle( ray , primitive , t , u , v );
+    case PACKET_SPHERE:
+        return gpuIntersectSphere( ray , primitive , t );
+    case PACKET_DISK:
+        return gpuIntersectPlanar( ray , primitive , true , t );
+    case PACKET_RECTANGLE:
+        return gpuIntersectPlanar( ray , primitive , false , t );
+    default:
+        return false;
+    }
+}
+
+// trace a ray through the tree , it stops at the first hit if 'any' is true
+GPU_FUNC GpuHit gpuTraverse( const GpuNode* nodes , const GpuPrimitive* primitives , const GpuRay& ray , bool any )
+{
+    GpuHit hit;
+    hit.t = ray.tmax;
+    hit.u = hit.v = 0.0f;
+    hit.source = GPU_NO_HIT;
+
+    const float inv[3] = { 1.0f / ray.dir[0] , 1.0f / ray.dir[1] , 1.0f / ray.dir[2] };
+    if( gpuIntersectBox( ray , inv , nodes[0].bmin , nodes[0].bmax , hit.t ) < 0.0f )
+        return hit;
+
+    unsigned stack[GPU_STACK_SIZE];
+    unsigned top = 0;
+    stack[top++] = 0;
+    while( top > 0 ){
+        const unsigned id = stack[--top];
+        const GpuNode& node = nodes[id];
+        if( node.count != 0 ){
+            for( unsigned i = node.offset ; i < node.offset + node.count ; ++i ){
+                float t , u , v;
+                if( !gpuIntersectPrimitive( ray , primitives[i] , t , u , v ) || t > hit.t )
+                    continue;
+                // shadow rays don't count hits at either end of their range
+                if( any && ( t <= ray.tmin || t >= ray.tmax ) )
+                    continue;
+                hit.t = t;
+                hit.u = u;
+                hit.v = v;
+                hit.source = primitives[i].source;
+                if( any )
+                    return hit;
+            }
+            continue;
+        }
+
+        // visit the nearer child first , children behind the closest hit are skipped
+        const unsigned left = id + 1;
+        const unsigned right = node.offset;
+        const float t0 = gpuIntersectBox( ray , inv , nodes[left].bmin , nodes[left].bmax , hit.t );
+        const float t1 = gpuIntersectBox( ray , inv , nodes[right].bmin , nodes[right].bmax , hit.t );
+        if( t1 > t0 ){
+            if( t1 >= 0.0f ) stack[top++] = right;
+            if( t0 >= 0.0f ) stack[top++] = left;
+        }else{
+            if( t0 >= 0.0f ) stack[top++] = left;
+            if( t1 >= 0.0f ) stack[top++] = right;
+        }
+    }
+    return hit;
+}
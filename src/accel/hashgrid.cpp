@@ -0,0 +1,110 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "hashgrid.h"
+#include "utility/multithread/threadpool.h"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+// build the grid
+void HashGrid::Build( const std::vector<Point>& points , float radius )
+{
+    Release();
+    const unsigned count = (unsigned)points.size();
+    if( count == 0 )
+        return;
+
+    m_radius = radius;
+    m_radiusSqr = radius * radius;
+    m_invCellSize = 1.0f / ( 2.0f * radius );
+    for( const auto& p : points )
+        m_bbox.Union( p );
+
+    // there are as many buckets as points
+    const unsigned bucket_cnt = count;
+    const unsigned grain = 1024;
+    m_bucketStart.resize( bucket_cnt + 1 );
+    std::vector<unsigned> hashes( count );
+    std::unique_ptr< std::atomic<unsigned>[] > counters( new std::atomic<unsigned>[bucket_cnt] );
+    ParallelFor( 0 , bucket_cnt , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        for( unsigned b = chunk_start ; b < chunk_end ; ++b )
+            counters[b].store( 0 , std::memory_order_relaxed );
+    });
+
+    // count the points in each bucket
+    ParallelFor( 0 , count , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        for( unsigned i = chunk_start ; i < chunk_end ; ++i ){
+            const Point& p = points[i];
+            hashes[i] = _hash( (int)floor( ( p.x - m_bbox.m_Min.x ) * m_invCellSize ) ,
+                               (int)floor( ( p.y - m_bbox.m_Min.y ) * m_invCellSize ) ,
+                               (int)floor( ( p.z - m_bbox.m_Min.z ) * m_invCellSize ) );
+            counters[hashes[i]].fetch_add( 1 , std::memory_order_relaxed );
+        }
+    });
+
+    // prefix sum over the counts , chunks are summed first and offset afterward
+    std::vector<unsigned> sums( ParallelChunkCount( bucket_cnt , grain ) , 0 );
+    ParallelFor( 0 , bucket_cnt , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        unsigned sum = 0;
+        for( unsigned b = chunk_start ; b < chunk_end ; ++b )
+            sum += counters[b].load( std::memory_order_relaxed );
+        sums[chunk] = sum;
+    });
+    unsigned offset = 0;
+    for( auto& sum : sums ){
+        const unsigned s = sum;
+        sum = offset;
+        offset += s;
+    }
+    ParallelFor( 0 , bucket_cnt , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        unsigned start = sums[chunk];
+        for( unsigned b = chunk_start ; b < chunk_end ; ++b ){
+            m_bucketStart[b] = start;
+            start += counters[b].load( std::memory_order_relaxed );
+            // the counter becomes the cursor of the bucket while scattering
+            counters[b].store( m_bucketStart[b] , std::memory_order_relaxed );
+        }
+    });
+    m_bucketStart[bucket_cnt] = count;
+
+    // scatter the points into their buckets
+    m_indices.resize( count );
+    ParallelFor( 0 , count , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+            m_indices[ counters[hashes[i]].fetch_add( 1 , std::memory_order_relaxed ) ] = i;
+    });
+
+    // points in a bucket are sorted so that the order doesn't depend on the scheduling of threads
+    m_points.resize( count );
+    ParallelFor( 0 , bucket_cnt , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        for( unsigned b = chunk_start ; b < chunk_end ; ++b ){
+            std::sort( m_indices.begin() + m_bucketStart[b] , m_indices.begin() + m_bucketStart[b+1] );
+            for( unsigned slot = m_bucketStart[b] ; slot < m_bucketStart[b+1] ; ++slot )
+                m_points[slot] = points[m_indices[slot]];
+        }
+    });
+}
+
+// release the memory of the grid
+void HashGrid::Release()
+{
+    m_bbox.InvalidBBox();
+    m_points.clear();
+    m_indices.clear();
+    m_bucketStart.clear();
+}
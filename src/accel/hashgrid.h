@@ -0,0 +1,105 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "math/point.h"
+#include "geometry/bbox.h"
+#include <vector>
+
+//! @brief Hashed uniform grid over points for queries of a fixed radius.
+/**
+ * Points are hashed by the cell they fall in, cells are as wide as the diameter of queries so that a query
+ * only visits the eight cells around it. The grid is built in parallel, points are counted per bucket with
+ * atomic counters, buckets are compacted with a prefix sum and the points are scattered in the order of
+ * buckets. Owners of the points could store their data in the same order so that queries read contiguous memory.
+ */
+class HashGrid
+{
+public:
+    //! @brief Build the grid.
+    //! @param points   The points.
+    //! @param radius   The radius of queries.
+    void Build( const std::vector<Point>& points , float radius );
+
+    //! Release the memory of the grid.
+    void Release();
+
+    //! @brief The index of the point in a slot, slots are ordered by buckets.
+    //! @param slot     The slot of the point.
+    //! @return         The index of the point in the points the grid is built with.
+    unsigned GetIndex( unsigned slot ) const { return m_indices[slot]; }
+
+    //! The number of points in the grid.
+    unsigned GetCount() const { return (unsigned)m_indices.size(); }
+
+    //! @brief Visit the points within the radius of a point.
+    //! @param p        The center of the query.
+    //! @param func     The function called with the slot of each point within the radius.
+    template< class F >
+    void Query( const Point& p , F func ) const {
+        if( m_indices.empty() )
+            return;
+        for( unsigned axis = 0 ; axis < 3 ; ++axis )
+            if( p[axis] < m_bbox.m_Min[axis] - m_radius || p[axis] > m_bbox.m_Max[axis] + m_radius )
+                return;
+
+        // the point is in the cell 'c' , the closer neighbor along each axis is visited too
+        int c[3] , o[3];
+        for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+            const float d = ( p[axis] - m_bbox.m_Min[axis] ) * m_invCellSize;
+            const float f = floor( d );
+            c[axis] = (int)f;
+            o[axis] = ( d - f < 0.5f ) ? c[axis] - 1 : c[axis] + 1;
+        }
+
+        // different cells could share a bucket , each bucket is visited once
+        unsigned buckets[8];
+        unsigned bucket_cnt = 0;
+        for( unsigned i = 0 ; i < 8 ; ++i ){
+            const unsigned b = _hash( ( i & 1 ) ? o[0] : c[0] , ( i & 2 ) ? o[1] : c[1] , ( i & 4 ) ? o[2] : c[2] );
+            bool visited = false;
+            for( unsigned j = 0 ; j < bucket_cnt && !visited ; ++j )
+                visited = ( buckets[j] == b );
+            if( !visited )
+                buckets[bucket_cnt++] = b;
+        }
+
+        for( unsigned i = 0 ; i < bucket_cnt ; ++i )
+            for( unsigned slot = m_bucketStart[buckets[i]] ; slot < m_bucketStart[buckets[i]+1] ; ++slot )
+                if( ( m_points[slot] - p ).SquaredLength() <= m_radiusSqr )
+                    func( slot );
+    }
+
+private:
+    BBox                    m_bbox;                 /**< Bounding box of the points. */
+    float                   m_radius = 0.0f;        /**< Radius of queries. */
+    float                   m_radiusSqr = 0.0f;     /**< Squared radius of queries. */
+    float                   m_invCellSize = 0.0f;   /**< Reciprocal of the size of a cell. */
+    std::vector<Point>      m_points;               /**< The points in the order of slots. */
+    std::vector<unsigned>   m_indices;              /**< The index of the point in each slot. */
+    std::vector<unsigned>   m_bucketStart;          /**< The first slot of each bucket, the last one is the number of points. */
+
+    //! @brief Hash a cell into a bucket.
+    //! @param x , y , z    The coordinate of the cell.
+    //! @return             The bucket of the cell.
+    unsigned _hash( int x , int y , int z ) const {
+        const unsigned h = ( (unsigned)x * 73856093u ) ^ ( (unsigned)y * 19349663u ) ^ ( (unsigned)z * 83492791u );
+        return h % (unsigned)( m_bucketStart.size() - 1 );
+    }
+};
@@ -0,0 +1,166 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "irradiancecache.h"
+
+// the maximum depth of the octree
+static const unsigned IRRADIANCE_CACHE_MAX_DEPTH = 20;
+
+// constructor of an empty node
+IrradianceCache::Cache_Node::Cache_Node()
+{
+    records.store( nullptr , std::memory_order_relaxed );
+    for( unsigned i = 0 ; i < 8 ; ++i )
+        child[i].store( nullptr , std::memory_order_relaxed );
+}
+
+// reset the octree
+void IrradianceCache::Build( const BBox& bbox , float error )
+{
+    Release();
+
+    // the root node is a cube , records on the boundary of the scene are kept inside it
+    m_center = ( bbox.m_Min + bbox.m_Max ) * 0.5f;
+    const Vector delta = bbox.m_Max - bbox.m_Min;
+    m_halfSize = max( max( delta.x , delta.y ) , delta.z ) * 0.5f * 1.001f + 0.0001f;
+    m_error = error;
+    m_root = new Cache_Node();
+    m_nodeCount.store( 1 , std::memory_order_relaxed );
+}
+
+// release the octree
+void IrradianceCache::Release()
+{
+    _release( m_root );
+    m_root = nullptr;
+    m_recordCount.store( 0 , std::memory_order_relaxed );
+    m_nodeCount.store( 0 , std::memory_order_relaxed );
+}
+
+// release a sub-tree
+void IrradianceCache::_release( Cache_Node* node )
+{
+    if( node == nullptr )
+        return;
+    Irradiance_Record* record = node->records.load( std::memory_order_relaxed );
+    while( record ){
+        Irradiance_Record* next = record->next;
+        delete record;
+        record = next;
+    }
+    for( unsigned i = 0 ; i < 8 ; ++i )
+        _release( node->child[i].load( std::memory_order_relaxed ) );
+    delete node;
+}
+
+// insert a record
+void IrradianceCache::Insert( Irradiance_Record* record ) const
+{
+    if( m_root == nullptr ){
+        delete record;
+        return;
+    }
+
+    // descend while the child is still wider than the sphere the record is valid in
+    const float influence = m_error * record->radius;
+    Cache_Node* node = m_root;
+    Point center = m_center;
+    float half = m_halfSize;
+    for( unsigned depth = 0 ; depth < IRRADIANCE_CACHE_MAX_DEPTH && influence <= half * 0.5f ; ++depth ){
+        unsigned c = 0;
+        half *= 0.5f;
+        for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+            if( record->p[axis] >= center[axis] ){
+                c |= 1 << axis;
+                center[axis] += half;
+            }else{
+                center[axis] -= half;
+            }
+        }
+
+        // the thread losing the race of creating the child uses the one of the winner
+        Cache_Node* child = node->child[c].load( std::memory_order_acquire );
+        if( child == nullptr ){
+            Cache_Node* created = new Cache_Node();
+            if( node->child[c].compare_exchange_strong( child , created , std::memory_order_acq_rel ) ){
+                child = created;
+                m_nodeCount.fetch_add( 1 , std::memory_order_relaxed );
+            }else{
+                delete created;
+            }
+        }
+        node = child;
+    }
+
+    // push the record into the list of the node
+    Irradiance_Record* head = node->records.load( std::memory_order_relaxed );
+    do{
+        record->next = head;
+    }while( !node->records.compare_exchange_weak( head , record , std::memory_order_release , std::memory_order_relaxed ) );
+    m_recordCount.fetch_add( 1 , std::memory_order_relaxed );
+}
+
+// interpolate the irradiance at a point
+bool IrradianceCache::Interpolate( const Point& p , const Vector& n , Spectrum& e ) const
+{
+    if( m_root == nullptr )
+        return false;
+
+    Spectrum sum;
+    float weight = 0.0f;
+    _interpolate( m_root , m_center , m_halfSize , p , n , sum , weight );
+    if( weight <= 0.0f )
+        return false;
+    e = sum / weight;
+    return true;
+}
+
+// accumulate the records valid at a point
+void IrradianceCache::_interpolate( const Cache_Node* node , const Point& center , float half , const Point& p , const Vector& n , Spectrum& e , float& weight ) const
+{
+    // records are centered in the node and valid within half of its size
+    for( unsigned axis = 0 ; axis < 3 ; ++axis )
+        if( fabs( p[axis] - center[axis] ) > 2.0f * half )
+            return;
+
+    const float inv_error = 1.0f / m_error;
+    for( const Irradiance_Record* record = node->records.load( std::memory_order_acquire ) ; record ; record = record->next ){
+        // the record is not used if the point is in front of it , the record misses the occlusion between them
+        const Vector delta = p - record->p;
+        if( Dot( delta , record->n + n ) < -0.02f * record->radius )
+            continue;
+
+        // the error of Ward et al. , the weight fades to zero at the largest error so that the interpolation is continuous
+        const float error = delta.Length() / record->radius + sqrt( max( 0.0f , 1.0f - Dot( n , record->n ) ) );
+        if( error >= m_error )
+            continue;
+        const float w = 1.0f / max( error , 0.0001f ) - inv_error;
+        e += record->e * w;
+        weight += w;
+    }
+
+    const float child_half = half * 0.5f;
+    for( unsigned i = 0 ; i < 8 ; ++i ){
+        const Cache_Node* child = node->child[i].load( std::memory_order_acquire );
+        if( child == nullptr )
+            continue;
+        Point child_center = center;
+        for( unsigned axis = 0 ; axis < 3 ; ++axis )
+            child_center[axis] += ( i & ( 1 << axis ) ) ? child_half : -child_half;
+        _interpolate( child , child_center , child_half , p , n , e , weight );
+    }
+}
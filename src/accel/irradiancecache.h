@@ -0,0 +1,109 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "math/point.h"
+#include "math/vector3.h"
+#include "geometry/bbox.h"
+#include "spectrum/spectrum.h"
+#include <atomic>
+
+//! @brief Irradiance computed at a point, it is valid in a neighborhood of the point.
+struct Irradiance_Record
+{
+    Point               p;                  /**< The position of the record. */
+    Vector              n;                  /**< The normal at the position. */
+    Spectrum            e;                  /**< The irradiance arriving at the position. */
+    float               radius;             /**< The harmonic mean distance to the surfaces seen from the position. */
+    Irradiance_Record*  next = nullptr;     /**< The next record in the same node of the octree. */
+};
+
+//! @brief Octree of irradiance records that threads could insert into and query at the same time.
+/**
+ * The error of reusing a record drops with the distance relative to the harmonic mean distance of the surfaces
+ * around it and with the difference of normals, as proposed in "A Ray Tracing Solution for Diffuse Interreflection"
+ * by Ward et al. A record is stored in the deepest node that is at least as wide as the sphere it is valid in,
+ * a query visits the nodes whose bounding boxes expanded by half of their size contain the point. Like OcTree,
+ * the root node is the bounding box of the scene and nodes are split in the middle. Records are pushed into
+ * the lists of nodes and children are created with compare-and-swap, nodes and records are never moved or
+ * freed before the octree is released, so queries run without locking while other threads insert.
+ */
+class IrradianceCache
+{
+public:
+    //! @brief Destructor releasing all records.
+    ~IrradianceCache() { Release(); }
+
+    //! @brief Reset the octree to an empty root node.
+    //! @param bbox     The bounding box of the scene.
+    //! @param error    The largest error of reusing a record, it decides the size of the neighborhood records are valid in.
+    void Build( const BBox& bbox , float error );
+
+    //! Release all records and nodes, no thread could query or insert meanwhile.
+    void Release();
+
+    //! @brief Insert a record, it is safe to call from any thread.
+    //! @param record   The record allocated with 'new', the octree takes its ownership.
+    void Insert( Irradiance_Record* record ) const;
+
+    //! @brief Interpolate the irradiance of the records valid at a point, it is safe to call from any thread.
+    //! @param p        The point.
+    //! @param n        The normal at the point.
+    //! @param e        The interpolated irradiance.
+    //! @return         False if no record is valid at the point.
+    bool Interpolate( const Point& p , const Vector& n , Spectrum& e ) const;
+
+    //! The number of records in the octree.
+    unsigned GetRecordCount() const { return m_recordCount.load( std::memory_order_relaxed ); }
+
+    //! The number of nodes in the octree.
+    unsigned GetNodeCount() const { return m_nodeCount.load( std::memory_order_relaxed ); }
+
+private:
+    //! @brief Node of the octree.
+    struct Cache_Node
+    {
+        std::atomic<Irradiance_Record*> records;    /**< The records stored in the node. */
+        std::atomic<Cache_Node*>        child[8];   /**< The children, they are created once a record is stored in them. */
+
+        //! Constructor of an empty node.
+        Cache_Node();
+    };
+
+    Cache_Node*             m_root = nullptr;   /**< The root node. */
+    Point                   m_center;           /**< The center of the root node. */
+    float                   m_halfSize = 0.0f;  /**< Half of the size of the root node, it is a cube. */
+    float                   m_error = 0.2f;     /**< The largest error of reusing a record. */
+    mutable std::atomic<unsigned>   m_recordCount;  /**< The number of records. */
+    mutable std::atomic<unsigned>   m_nodeCount;    /**< The number of nodes. */
+
+    //! @brief Release a sub-tree.
+    //! @param node     The root of the sub-tree.
+    static void _release( Cache_Node* node );
+
+    //! @brief Accumulate the weighted irradiance of the records in a sub-tree valid at a point.
+    //! @param node     The root of the sub-tree.
+    //! @param center   The center of the node.
+    //! @param half     Half of the size of the node.
+    //! @param p        The point.
+    //! @param n        The normal at the point.
+    //! @param e        The accumulated weighted irradiance.
+    //! @param weight   The accumulated weight.
+    void _interpolate( const Cache_Node* node , const Point& center , float half , const Point& p , const Vector& n , Spectrum& e , float& weight ) const;
+};
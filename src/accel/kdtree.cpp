@@ -20,9 +20,19 @@
 #include "geometry/intersection.h"
 #include <algorithm>
 #include "log/log.h"
+#include "accelcache.h"
+#include "accelstats.h"
+#include "utility/statsreport.h"
+#include "utility/multithread/threadpool.h"
+
+static const unsigned   KD_PARALLEL_THRESHOLD   = 65536;    // nodes with more primitives process the three axes as separate jobs
+static const unsigned   KD_FORK_THRESHOLD       = 4096;     // both children need more primitives than this to be built as separate jobs
+static const unsigned   KD_STACK_SIZE           = 64;       // size of the traversal stack, it has to be larger than the maximum depth
 
 IMPLEMENT_CREATOR( KDTree );
 
+static_assert( sizeof( KDTree::Kd_Compact_Node ) == 8 , "Compact KD-Tree node is expected to be 8 bytes." );
+
 // destructor
 KDTree::~KDTree()
 {
@@ -33,11 +43,17 @@ KDTree::~KDTree()
 // build the acceleration structure
 void KDTree::Build()
 {
+	// the tree of a previous build is discarded , the scene could be built again after its models move
+	m_nodes.clear();
+	m_leafPri.clear();
+	m_total = m_leaf = m_depth = m_MaxLeafTri = 0;
+	m_fAvgLeafTri = 0.0f;
+
 	if( m_primitives->size() == 0 )
 		return;
 
-	// pre-malloc node and leaf triangle list memory
-	m_temp = new unsigned char[m_primitives->size()];
+	// temporary buffer for marking primitives
+	unsigned char* temp = new unsigned char[m_primitives->size()];
 
 	// get the bounding box for the whole primitive list
 	computeBBox();
@@ -47,28 +63,89 @@ void KDTree::Build()
 	Splits splits;
 	for( int i = 0 ; i < 3 ; i++ )
 		splits.split[i] = new Split[2*count];
-	for( int k = 0 ; k < 3 ; k++ ){
+	parallelAxes( count , [&]( unsigned k ){
 		for( unsigned i = 0 ; i < count ; i++ ){
 			Primitive* pri = (*m_primitives)[i];
 			const BBox& box = pri->GetBBox();
             splits.split[k][2*i] = Split(box.m_Min[k], Split_Type::Split_Start, i, pri);
             splits.split[k][2*i+1] = Split(box.m_Max[k], Split_Type::Split_End, i, pri);
 		}
-	}
-	for( int i = 0 ; i < 3 ; i++ )
-		sort( splits.split[i] , splits.split[i] + 2 * count);
+		sort( splits.split[k] , splits.split[k] + 2 * count);
+	});
 
 	// create root node
 	m_root = new Kd_Node(m_bbox);
 
 	// build kd-tree
-	splitNode( m_root , splits , count , 0 );
+	splitNode( m_root , splits , count , 0 , temp );
 
+	// delete temporary memory
+	SAFE_DELETE_ARRAY(temp);
+
+	// the statistics are collected afterward since sub-trees are built concurrently
+	collectStats( m_root , 0 );
 	if( m_leaf != 0 )
 		m_fAvgLeafTri /= m_leaf;
 
-	// delete temporary memory
-	SAFE_DELETE_ARRAY(m_temp);
+	// pack the tree into compact nodes, the pointer based tree is not needed anymore
+	m_nodes.reserve( m_total );
+	flattenNode( m_root );
+	deleteKdNode( m_root );
+	m_root = nullptr;
+}
+
+// run the function for each axis
+template< class Func >
+void KDTree::parallelAxes( unsigned prinum , const Func& func )
+{
+	// few primitives are not worth the cost of scheduling jobs
+	if( prinum <= KD_PARALLEL_THRESHOLD ){
+		for( unsigned k = 0 ; k < 3 ; k++ )
+			func( k );
+		return;
+	}
+
+	ParallelFor( 0 , 3 , 1 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		for( unsigned k = chunk_start ; k < chunk_end ; k++ )
+			func( k );
+	});
+}
+
+// pack the kd-tree sub-tree into compact nodes
+void KDTree::flattenNode( const Kd_Node* node )
+{
+	const unsigned id = (unsigned)m_nodes.size();
+	m_nodes.push_back( Kd_Compact_Node() );
+
+	if( node->flag == 3 ){
+		m_nodes[id].pri_offset = (unsigned)m_leafPri.size();
+		m_nodes[id].flags = 3 | ( (unsigned)node->trilist.size() << 2 );
+		m_leafPri.insert( m_leafPri.end() , node->trilist.begin() , node->trilist.end() );
+		return;
+	}
+
+	// the left child is right after the node
+	flattenNode( node->leftChild );
+	m_nodes[id].split = node->split;
+	m_nodes[id].flags = node->flag | ( (unsigned)m_nodes.size() << 2 );
+	flattenNode( node->rightChild );
+}
+
+// collect the statistics of the kd-tree sub-tree
+void KDTree::collectStats( const Kd_Node* node , unsigned depth )
+{
+	m_total++;
+	if( node->flag == 3 ){
+		const unsigned prinum = (unsigned)node->trilist.size();
+		m_leaf++;
+		m_fAvgLeafTri += prinum;
+		m_MaxLeafTri = max( m_MaxLeafTri , prinum );
+		return;
+	}
+
+	m_depth = max( m_depth , depth );
+	collectStats( node->leftChild , depth + 1 );
+	collectStats( node->rightChild , depth + 1 );
 }
 
 // output log
@@ -78,8 +155,73 @@ void KDTree::OutputLog() const
     slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "KD-Tree depth is %d. Total number of nodes in it is %d. Total number of inner nodes is %d. Leaf Node number is %d. Average number of triangles in leaf is %f. Maximum number of triangles in leaf nodes is %d." , m_depth , m_total , m_total - m_leaf , m_leaf , m_fAvgLeafTri , m_MaxLeafTri ) );
 }
 
+// add the shape of the kd-tree to the report
+void KDTree::CollectStats( StatsGroup& stats ) const
+{
+    stats.Add( "type" , "kd_tree" ).Add( "depth" , m_depth ).Add( "nodes" , m_total ).Add( "leaves" , m_leaf )
+         .Add( "max_leaf_primitives" , m_MaxLeafTri ).Add( "avg_leaf_primitives" , m_fAvgLeafTri );
+}
+
+// memory taken by the kd-tree
+size_t KDTree::GetMemoryUsage() const
+{
+	return sizeof( Kd_Compact_Node ) * m_nodes.size() + sizeof( unsigned ) * m_leafPri.size();
+}
+
+// write the compact kd-tree
+bool KDTree::Serialize( AccelWriter& stream ) const
+{
+	if( m_nodes.empty() )
+		return false;
+
+	stream.Write( m_bbox );
+	stream.Write( m_total );
+	stream.Write( m_leaf );
+	stream.Write( m_fAvgLeafTri );
+	stream.Write( m_depth );
+	stream.Write( m_MaxLeafTri );
+	const unsigned node_count = (unsigned)m_nodes.size();
+	const unsigned index_count = (unsigned)m_leafPri.size();
+	stream.Write( node_count );
+	stream.Write( index_count );
+	stream.Write( m_nodes.data() , m_nodes.size() );
+	stream.Write( m_leafPri.data() , m_leafPri.size() );
+	return true;
+}
+
+// load the compact kd-tree
+bool KDTree::Deserialize( AccelReader& stream )
+{
+	unsigned node_count = 0 , index_count = 0;
+	if( !stream.Read( m_bbox ) || !stream.Read( m_total ) || !stream.Read( m_leaf ) || !stream.Read( m_fAvgLeafTri ) ||
+		!stream.Read( m_depth ) || !stream.Read( m_MaxLeafTri ) || !stream.Read( node_count ) || !stream.Read( index_count ) || node_count == 0 )
+		return false;
+
+	m_nodes.resize( node_count );
+	m_leafPri.resize( index_count );
+	bool valid = stream.Read( m_nodes.data() , m_nodes.size() ) && stream.Read( m_leafPri.data() , m_leafPri.size() );
+
+	// the traversal trusts the offsets in the nodes, they are checked once here
+	for( unsigned id = 0 ; valid && id < node_count ; id++ ){
+		const Kd_Compact_Node& node = m_nodes[id];
+		if( node.IsLeaf() )
+			valid = node.pri_offset <= index_count && node.PriNum() <= index_count - node.pri_offset;
+		else
+			valid = id + 1 < node_count && node.RightChild() > id && node.RightChild() < node_count;
+	}
+	for( unsigned i = 0 ; valid && i < index_count ; i++ )
+		valid = m_leafPri[i] < m_primitives->size();
+
+	if( !valid ){
+		m_nodes.clear();
+		m_leafPri.clear();
+		return false;
+	}
+	return true;
+}
+
 // split node
-void KDTree::splitNode( Kd_Node* node , Splits& splits , unsigned prinum , unsigned depth )
+void KDTree::splitNode( Kd_Node* node , Splits& splits , unsigned prinum , unsigned depth , unsigned char* temp )
 {
 	if( prinum < m_maxTriInLeaf || depth > m_maxDepth ){
 		makeLeaf( node , splits , prinum );
@@ -106,18 +248,18 @@ void KDTree::splitNode( Kd_Node* node , Splits& splits , unsigned prinum , unsig
 	Split* _splits = splits.split[split_Axis];
 	unsigned l_num = 0 , r_num = 0;
 	for( unsigned i = 0 ; i < split_count; i++ )
-		m_temp[splits.split[split_Axis][i].id] = 0;
+		temp[splits.split[split_Axis][i].id] = 0;
 	for( unsigned i = 0 ; i < split_count; i++ )
 	{
         if (i < split_offset) {
             if (_splits[i].type == Split_Type::Split_Start) {
-                m_temp[_splits[i].id] |= 1;
+                temp[_splits[i].id] |= 1;
                 ++l_num;
             }
         }
         else if (i > split_offset) {
             if (_splits[i].type == Split_Type::Split_End) {
-                m_temp[_splits[i].id] |= 2;
+                temp[_splits[i].id] |= 2;
                 ++r_num;
             }
         }
@@ -137,9 +279,9 @@ void KDTree::splitNode( Kd_Node* node , Splits& splits , unsigned prinum , unsig
 		for( unsigned i = 0 ; i < split_count ; i++ ){
             const Split& old = splits.split[k][i];
             unsigned id = old.id;
-            if (m_temp[id] & 0x01)
+            if (temp[id] & 0x01)
                 l_splits.split[k][l_offset++] = old;
-            if (m_temp[id] & 0x02)
+            if (temp[id] & 0x02)
                 r_splits.split[k][r_offset++] = old;
 		}
         sAssert(l_offset == 2 * l_num, SPATIAL_ACCELERATOR);
@@ -150,16 +292,25 @@ void KDTree::splitNode( Kd_Node* node , Splits& splits , unsigned prinum , unsig
 	BBox left_box = node->bbox;
 	left_box.m_Max[split_Axis] = node->split;
 	node->leftChild = new Kd_Node(left_box);
-	splitNode( node->leftChild , l_splits , l_num , depth + 1 );
-	m_total ++;
 
 	BBox right_box = node->bbox;
 	right_box.m_Min[split_Axis] = node->split;
 	node->rightChild = new Kd_Node(right_box);
-	splitNode( node->rightChild , r_splits , r_num , depth + 1 );
-	m_total ++;
 
-	m_depth = max( m_depth , depth );
+	// the sub-trees are built as separate jobs if both of them are large, the left one has its own marking buffer
+	if( min( l_num , r_num ) > KD_FORK_THRESHOLD ){
+		ParallelInvoke( [&](){
+			unsigned char* left_temp = new unsigned char[m_primitives->size()];
+			splitNode( node->leftChild , l_splits , l_num , depth + 1 , left_temp );
+			SAFE_DELETE_ARRAY(left_temp);
+		} , [&](){
+			splitNode( node->rightChild , r_splits , r_num , depth + 1 , temp );
+		});
+		return;
+	}
+
+	splitNode( node->leftChild , l_splits , l_num , depth + 1 , temp );
+	splitNode( node->rightChild , r_splits , r_num , depth + 1 , temp );
 }
 
 // evaluate sah value for a specific split plane
@@ -180,9 +331,12 @@ float KDTree::sah( unsigned l , unsigned r , unsigned axis , float split , const
 float KDTree::pickSplitting( const Splits& splits , unsigned prinum , const BBox& box ,
 							 unsigned& splitAxis , unsigned& split_offset )
 {
-	float min_sah = FLT_MAX;
-	for( int k = 0 ; k < 3 ; k++ )
+	// each axis is swept independently, the best one is picked afterward in the same order
+	float		axis_sah[3] = { FLT_MAX , FLT_MAX , FLT_MAX };
+	unsigned	axis_offset[3] = { 0 , 0 , 0 };
+	parallelAxes( prinum , [&]( unsigned k )
 	{
+		float min_sah = FLT_MAX;
 		unsigned n_l = 0 ;
 		unsigned n_r = prinum ;
 		unsigned split_count = prinum * 2;
@@ -202,8 +356,7 @@ float KDTree::pickSplitting( const Splits& splits , unsigned prinum , const BBox
 			float sahv = sah( n_l , n_r , k , splits.split[k][i].pos , box );
 			if( sahv < min_sah ){
 				min_sah = sahv;
-				splitAxis = k;
-                split_offset = i;
+                axis_offset[k] = i;
 			}
 			
             if (splits.split[k][i].type == Split_Type::Split_Start)
@@ -211,8 +364,17 @@ float KDTree::pickSplitting( const Splits& splits , unsigned prinum , const BBox
             
             ++i;
 		}
-	}
+		axis_sah[k] = min_sah;
+	});
 
+	float min_sah = FLT_MAX;
+	for( unsigned k = 0 ; k < 3 ; k++ ){
+		if( axis_sah[k] < min_sah ){
+			min_sah = axis_sah[k];
+			splitAxis = k;
+			split_offset = axis_offset[k];
+		}
+	}
 	return min_sah;
 }
 
@@ -224,74 +386,180 @@ void KDTree::makeLeaf( Kd_Node* node , Splits& splits , unsigned prinum )
         if( splits.split[0][i].type == Split_Type::Split_Start ){
 			const Primitive* primitive = splits.split[0][i].primitive;
 			if( primitive->GetIntersect( node->bbox ) )
-				node->trilist.push_back(primitive);
+				node->trilist.push_back(splits.split[0][i].id);
 		}
 	}
 	splits.Release();
-
-	m_leaf++;
-	m_fAvgLeafTri += prinum;
-	m_MaxLeafTri = max( m_MaxLeafTri , prinum );
 }
 
 // get the intersection between the ray and the primitive set
 bool KDTree::GetIntersect( const Ray& r , Intersection* intersect ) const
 {
+	static const float		delta = 0.001f;
+
+	if( m_nodes.empty() )
+		return false;
+
 	float fmax;
 	float fmin = Intersect( r , m_bbox , &fmax );
 	if( fmin < 0.0f )
 		return false;
 
-	if( traverse( m_root , r , intersect , fmin , fmax ) ){
-		if( intersect == 0 )
-			return true;
-		return intersect->primitive != 0;
+	// nodes to be visited along with the range of the ray inside them
+	struct Kd_Stack_Entry{
+		const Kd_Compact_Node*	node;
+		float					fmin;
+		float					fmax;
+	};
+	Kd_Stack_Entry stack[KD_STACK_SIZE];
+	Kd_Stack_Entry* top = stack;
+
+	SORT_STATS( AccelStats& stats = AccelStats::Local() );
+	bool inter = false;
+	const unsigned type = RayType( r , intersect == nullptr );
+	const Kd_Compact_Node* node = &m_nodes[0];
+	while( node ){
+		// there is an intersection before the node
+		if( intersect && intersect->t < fmin - delta ){
+			SORT_STATS( ++stats.earlyOuts );
+			break;
+		}
+
+		SORT_STATS( ++stats.nodes );
+		if( !node->IsLeaf() ){
+			// get the intersection point between the ray and the splitting plane
+			const unsigned split_axis = node->SplitAxis();
+			const float dir = r.m_Dir[split_axis];
+			const float t = (dir==0.0f) ? FLT_MAX : ( node->split - r.m_Ori[split_axis] ) / dir;
+
+			const Kd_Compact_Node* first = node + 1;
+			const Kd_Compact_Node* second = &m_nodes[node->RightChild()];
+			if( dir < 0.0f || (dir==0.0f&&r.m_Ori[split_axis] > node->split) )
+				swap(first, second);
+
+			if( t <= fmin - delta ){
+				// the ray only passes through the second child
+				node = second;
+				fmin = max( t , fmin );
+			}else if( t >= fmax + delta ){
+				// the ray only passes through the first child
+				node = first;
+				fmax = min( fmax , t );
+			}else{
+				// visit the first child now and the second one later
+				top->node = second;
+				top->fmin = max( t , fmin );
+				top->fmax = fmax;
+				++top;
+				node = first;
+				fmax = min( fmax , t );
+			}
+			continue;
+		}
+
+		// it's a leaf node
+		const unsigned* pri = &m_leafPri[node->pri_offset];
+		const unsigned prinum = node->PriNum();
+		for( unsigned i = 0 ; i < prinum ; i++ ){
+			SORT_STATS( ++stats.primitives );
+			const Primitive* primitive = (*m_primitives)[pri[i]];
+			if( !primitive->IsHiddenFrom( type ) && primitive->GetIntersect( r , intersect ) ){
+				if( intersect == 0 ){
+					SORT_STATS( ++stats.earlyOuts );
+					return true;
+				}
+				inter = true;
+			}
+		}
+
+		// the nearest intersection inside the leaf node is the nearest one along the ray
+		if( inter && intersect->t < fmax + delta ){
+			SORT_STATS( stats.earlyOuts += ( top > stack ) ? 1 : 0 );
+			break;
+		}
+
+		if( top == stack )
+			break;
+		--top;
+		node = top->node;
+		fmin = top->fmin;
+		fmax = top->fmax;
 	}
-	return false;
+
+	return inter;
 }
 
-// traverse kd-tree node
-bool KDTree::traverse( const Kd_Node* node , const Ray& ray , Intersection* intersect , float fmin , float fmax ) const
+// check whether the ray is blocked by any primitive
+bool KDTree::IsOccluded( const Ray& r ) const
 {
-	static const unsigned	mask = 0x00000003;
 	static const float		delta = 0.001f;
 
-    if( fmin > fmax )
-        return false;
-    
-	if( intersect && intersect->t < fmin - delta )
-		return true;
-
-	// it's a leaf node
-	if( (node->flag & mask) == 3 ){
-		bool inter = false;
-        for( auto tri : node->trilist ){
-			inter |= tri->GetIntersect( ray , intersect );
-			if( intersect == 0 && inter )
-				return true;
+	if( m_nodes.empty() )
+		return false;
+
+	float fmax;
+	float fmin = Intersect( r , m_bbox , &fmax );
+	if( fmin < 0.0f )
+		return false;
+
+	// nodes to be visited along with the range of the ray inside them
+	struct Kd_Stack_Entry{
+		const Kd_Compact_Node*	node;
+		float					fmin;
+		float					fmax;
+	};
+	Kd_Stack_Entry stack[KD_STACK_SIZE];
+	Kd_Stack_Entry* top = stack;
+
+	SORT_STATS( AccelStats& stats = AccelStats::Local() );
+	const Kd_Compact_Node* node = &m_nodes[0];
+	while( true ){
+		SORT_STATS( ++stats.nodes );
+		if( !node->IsLeaf() ){
+			const unsigned split_axis = node->SplitAxis();
+			const float dir = r.m_Dir[split_axis];
+			const float t = (dir==0.0f) ? FLT_MAX : ( node->split - r.m_Ori[split_axis] ) / dir;
+
+			const Kd_Compact_Node* first = node + 1;
+			const Kd_Compact_Node* second = &m_nodes[node->RightChild()];
+			if( dir < 0.0f || (dir==0.0f&&r.m_Ori[split_axis] > node->split) )
+				swap(first, second);
+
+			if( t <= fmin - delta ){
+				node = second;
+				fmin = max( t , fmin );
+			}else if( t >= fmax + delta ){
+				node = first;
+				fmax = min( fmax , t );
+			}else{
+				top->node = second;
+				top->fmin = max( t , fmin );
+				top->fmax = fmax;
+				++top;
+				node = first;
+				fmax = min( fmax , t );
+			}
+			continue;
 		}
-		return inter && ( intersect->t < ( fmax + delta ) && intersect->t > ( fmin - delta ) );
-	}
 
-	// get the intersection point between the ray and the splitting plane
-	const unsigned split_axis = node->flag & mask;
-	const float dir = ray.m_Dir[split_axis];
-	const float t = (dir==0.0f) ? FLT_MAX : ( node->split - ray.m_Ori[split_axis] ) / dir;
-	
-	const Kd_Node* first = node->leftChild;
-	const Kd_Node* second = node->rightChild;
-	if( dir < 0.0f || (dir==0.0f&&ray.m_Ori[split_axis] > node->split) )
-        swap(first, second);
+		const unsigned* pri = &m_leafPri[node->pri_offset];
+		const unsigned prinum = node->PriNum();
+		for( unsigned i = 0 ; i < prinum ; i++ ){
+			SORT_STATS( ++stats.primitives );
+			const Primitive* primitive = (*m_primitives)[pri[i]];
+			if( !primitive->IsHiddenFrom( RAY_SHADOW ) && primitive->GetIntersect( r , nullptr ) ){
+				SORT_STATS( ++stats.earlyOuts );
+				return true;
+			}
+		}
 
-	bool inter = false;
-	if( t > fmin - delta ){
-		inter = traverse( first , ray , intersect , fmin , min( fmax , t ) );
-		if( !intersect && inter )
-			return true;
+		if( top == stack )
+			return false;
+		--top;
+		node = top->node;
+		fmin = top->fmin;
+		fmax = top->fmax;
 	}
-	if( !inter && ( fmax + delta ) > t )
-		return traverse( second , ray , intersect , max( t , fmin ) , fmax );
-	return inter;
 }
 
 // delete all kd-tree nodes
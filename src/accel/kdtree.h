@@ -30,6 +30,8 @@
  * Please refer to this paper
  * <a href="http://www.eng.utah.edu/~cs6965/papers/kdtree.pdf">
  * On building fast kd-Trees for Ray Tracing, and on doing that in O(N log N)</a> for further details.
+ * Sub-trees are built concurrently in the thread pool. After construction, the tree is
+ * packed into 8 bytes nodes like the one in PBRT, leaf nodes share one primitive index array.
  */
 class KDTree : public Accelerator
 {
@@ -54,12 +56,36 @@ public:
     //! @return             It will return true if there is an intersection, otherwise it returns false.
 	bool GetIntersect( const Ray& r , Intersection* intersect ) const override;
 
+    //! @brief Check whether the ray is blocked by any primitive using KD-Tree.
+    //!
+    //! It is the dedicated query for shadow rays. The split plane already tells the near child from the far one so nodes are
+    //! still visited front to back, it returns at the first blocking primitive instead of searching for the nearest one.
+    //! @param r            The input ray to be tested.
+    //! @return             It will return true if there is any intersection, otherwise it returns false.
+	bool IsOccluded( const Ray& r ) const override;
+
 	//! Build KD-Tree structure in O(N*lg(N)).
 	void Build() override;
 
 	//! Output log information
 	void OutputLog() const override;
 
+	//! Add the shape of the structure to the statistics report
+	void CollectStats( StatsGroup& stats ) const override;
+
+    //! Memory taken by the compact nodes and the primitive indices of leaf nodes.
+	size_t GetMemoryUsage() const override;
+
+    //! @brief Write the compact KD-Tree nodes along with the primitive indices of leaf nodes.
+    //! @param stream   The buffer to write into.
+    //! @return         False if the KD-Tree is not built yet.
+	bool Serialize( AccelWriter& stream ) const override;
+
+    //! @brief Load the compact KD-Tree nodes written by Serialize.
+    //! @param stream   The payload to read from.
+    //! @return         False if the data doesn't match the primitive set.
+	bool Deserialize( AccelReader& stream ) override;
+
     //! KD-Tree split plane type
     enum class Split_Type
     {
@@ -68,14 +94,14 @@ public:
         Split_End = 2,      /**< Split plane at the end of one primitive along an axis. */
     };
     
-    //! KD-Tree node structure
+    //! KD-Tree node structure, it is only used during construction.
     struct Kd_Node
     {
     public:
         Kd_Node*					leftChild = nullptr;	/**< Pointer to the left child of the KD-Tree node. */
         Kd_Node*					rightChild = nullptr;	/**< Pointer to the right child of the KD-Tree node. */
         BBox						bbox;                   /**< Bounding box of the KD-Tree node. */
-        vector<const Primitive*>	trilist;                /**< Vector holding all primitives in the node. It 
+        vector<unsigned>            trilist;                /**< Indices of all primitives in the node. It 
                                                              should be empty for interior nodes. */
         unsigned					flag = 0;               /**< Special mask used for nodes. The node is a leaf node if it is 3. 
                                                              For interior nodes, it will be the cooreponding id of the split axis.*/
@@ -86,6 +112,29 @@ public:
         Kd_Node( const BBox& bb ):bbox(bb){}
     };
     
+    //! @brief Compact KD-Tree node.
+    //!
+    //! Each node takes exactly 8 bytes. The lowest two bits of 'flags' are the split axis for interior nodes
+    //! and 3 for leaf nodes, the rest of the bits hold the index of the right child for interior nodes or the
+    //! number of primitives for leaf nodes. The left child of an interior node is always right after it.
+    struct Kd_Compact_Node
+    {
+        union{
+            float       split;          /**< Split position for interior nodes. */
+            unsigned    pri_offset;     /**< Offset in the shared primitive index array for leaf nodes. */
+        };
+        unsigned        flags;          /**< Bit-packed split axis, right child index or number of primitives. */
+
+        //! Whether the node is a leaf node.
+        bool IsLeaf() const { return ( flags & 3 ) == 3; }
+        //! The split axis of interior nodes.
+        unsigned SplitAxis() const { return flags & 3; }
+        //! The index of the right child of interior nodes.
+        unsigned RightChild() const { return flags >> 2; }
+        //! The number of primitives in leaf nodes.
+        unsigned PriNum() const { return flags >> 2; }
+    };
+
     //! A split candidate.
     struct Split
     {
@@ -128,8 +177,9 @@ public:
     };
     
 private:
-	Kd_Node*		m_root = nullptr;           /**< Root node of the KD-Tree. */
-	unsigned char*	m_temp = nullptr;           /**< Temporary buffer for marking primitives. */
+	Kd_Node*		m_root = nullptr;           /**< Root node of the KD-Tree. It is only valid during construction. */
+	vector<Kd_Compact_Node>	m_nodes;            /**< Compact KD-Tree nodes in depth-first order. */
+	vector<unsigned>        m_leafPri;          /**< Indices of primitives in all leaf nodes. */
 
 	const unsigned	m_maxDepth = 28;            /**< Maximum allowed depth of KD-Tree. */
 	const unsigned	m_maxTriInLeaf = 32;        /**< Maximum allowed number of primitives in a leaf node. */
@@ -146,7 +196,14 @@ private:
     //! @param splits   The split plane that holds all primitive pointers.
     //! @param prinum   The number of primitives in the node.
     //! @param depth    The current depth of the node.
-	void splitNode( Kd_Node* node , Splits& splits , unsigned prinum , unsigned depth );
+    //! @param temp     Temporary buffer for marking primitives, each thread has its own buffer.
+	void splitNode( Kd_Node* node , Splits& splits , unsigned prinum , unsigned depth , unsigned char* temp );
+
+    //! @brief Run a function for each axis, the axes could be processed in the thread pool.
+    //! @param prinum   The number of primitives involved, few primitives are processed on the current thread only.
+    //! @param func     The function processing one axis, its parameter is the axis id.
+    template< class Func >
+	void parallelAxes( unsigned prinum , const Func& func );
 
     //! @brief Evalute SAH value for a specific split plane.
     //! @param l        Number of primitives on the left of the split plane.
@@ -173,16 +230,14 @@ private:
     //! @param prinum   The number of primitives in the node.
 	void makeLeaf( Kd_Node* node , Splits& splits , unsigned prinum );
 	
-    //! @brief A recursive function that traverses the KD-Tree node.
-    //! @param node         The node to be traversed.
-    //! @param ray          The ray to be tested.
-    //! @param intersect    The structure holding the intersection information. If empty pointer is passed,
-    //!                     it will return as long as one intersection is found and it won't be necessary to be
-    //!                     the nearest one.
-    //! @param fmin         The minimum range along the ray.
-    //! @param fmax         The maximum range along the ray.
-    //! @return             True if there is intersection, otherwise it will return false.
-	bool traverse( const Kd_Node* node , const Ray& ray , Intersection* intersect , float fmin , float fmax ) const;
+    //! @brief Pack the KD-Tree sub-tree into compact nodes in depth-first order.
+    //! @param node     The root node of the sub-tree.
+	void flattenNode( const Kd_Node* node );
+
+    //! @brief Collect the statistics of the KD-Tree sub-tree after construction.
+    //! @param node     The root node of the sub-tree.
+    //! @param depth    The depth of the node.
+	void collectStats( const Kd_Node* node , unsigned depth );
 
     //! @brief Delete all sub tree originating from node.
     //! @param node The KD-Tree node to be deleted.
@@ -0,0 +1,272 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "lbvh.h"
+#include <algorithm>
+#include <functional>
+#include "log/log.h"
+#include "utility/statsreport.h"
+#include "utility/multithread/threadpool.h"
+
+static const unsigned   LBVH_MORTON_BITS        = 30;       // number of bits in Morton codes, 10 bits for each axis
+static const unsigned   LBVH_RADIX_BITS         = 10;       // number of bits sorted in each pass of the radix sort
+static const unsigned   LBVH_RADIX_BUCKETS      = 1 << LBVH_RADIX_BITS;
+static const unsigned   LBVH_CLUSTER_BITS       = 12;       // HLBVH clusters primitives sharing this number of top bits
+static const unsigned   LBVH_TOP_SAH_DEPTH      = 24;       // deeper top levels split clusters in the middle to bound the depth of the tree
+static const unsigned   LBVH_PARALLEL_THRESHOLD = 65536;    // fewer primitives are processed on the current thread only
+static const unsigned   LBVH_FORK_THRESHOLD     = 4096;     // both children need more primitives than this to be built as separate jobs
+static const unsigned   LBVH_MAX_CHUNK          = 32;       // maximum number of chunks a parallel loop is split into
+
+IMPLEMENT_CREATOR( Lbvh );
+
+// spread the lowest 10 bits so that there are two zero bits between each of them
+static inline unsigned expandBits( unsigned v )
+{
+    v = ( v * 0x00010001u ) & 0xFF0000FFu;
+    v = ( v * 0x00000101u ) & 0x0F00F00Fu;
+    v = ( v * 0x00000011u ) & 0xC30C30C3u;
+    v = ( v * 0x00000005u ) & 0x49249249u;
+    return v;
+}
+
+// get the number of chunks shared by the parallel loops over a range, few primitives are processed on the current thread only
+static unsigned chunkCount( unsigned count )
+{
+    return ( count > LBVH_PARALLEL_THRESHOLD ) ? min( ThreadPool::GetSingleton().GetThreadNum() , LBVH_MAX_CHUNK ) : 1u;
+}
+
+// run the function on a fixed number of consecutive chunks of the range, the chunks are processed in the thread pool
+static void runChunks( unsigned chunk_cnt , unsigned count , const std::function<void(unsigned,unsigned,unsigned)>& func )
+{
+    ParallelFor( 0 , chunk_cnt , 1 , [&]( unsigned , unsigned first , unsigned last ){
+        for( unsigned i = first ; i < last ; ++i )
+            func( i , (unsigned)( (unsigned long long)count * i / chunk_cnt ) , (unsigned)( (unsigned long long)count * ( i + 1 ) / chunk_cnt ) );
+    });
+}
+
+// output log information
+void Lbvh::OutputLog() const
+{
+    slog( INFO , SPATIAL_ACCELERATOR , m_hlbvh ? "Spatial accelerator type is HLBVH ( Hierarchical Linear Bounding Volume Hierarchy )." : "Spatial accelerator type is LBVH ( Linear Bounding Volume Hierarchy )." );
+    slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "Maximum depth in LBVH tree is %d. Total number of nodes in it is %d, number of inner nodes is %d, number of leaf nodes is %d. Maximum number of triangles in leaf nodes is %d" , m_bvhDepth , m_totalNode , m_totalNode - m_leafNode , m_leafNode , m_maxLeafTriNum ) );
+}
+
+// add the shape of the lbvh to the report
+void Lbvh::CollectStats( StatsGroup& stats ) const
+{
+    stats.Add( "type" , m_hlbvh ? "hlbvh" : "lbvh" ).Add( "depth" , m_bvhDepth ).Add( "nodes" , m_totalNode ).Add( "leaves" , m_leafNode )
+         .Add( "max_leaf_primitives" , m_maxLeafTriNum );
+}
+
+// build the pointer based binary tree
+void Lbvh::buildTree()
+{
+    // the statistics of a previous build are discarded
+    m_totalNode = 0;
+    m_leafNode = 0;
+    m_bvhDepth = 0;
+    m_maxLeafTriNum = 0;
+
+    const unsigned pri_num = (unsigned)m_primitives->size();
+    mallocMemory( pri_num );
+    computeBBox();
+    m_root = new Bvh_Node();
+
+    // the same number of chunks is used by all parallel loops so that per chunk data lines up
+    const unsigned chunk_cnt = chunkCount( pri_num );
+
+    // generate bvh primitives along with the bounding box of their centroids
+    Bvh_Primitive* bvhpri = m_bvhpri;
+    BBox chunk_bbox[LBVH_MAX_CHUNK];
+    runChunks( chunk_cnt , pri_num , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+        for( unsigned i = _start ; i < _end ; i++ ){
+            new (&bvhpri[i]) Bvh_Primitive( (*m_primitives)[i] );
+            chunk_bbox[chunk].Union( bvhpri[i].m_centroid );
+        }
+    });
+    BBox centroid_bbox;
+    for( unsigned i = 0 ; i < chunk_cnt ; i++ )
+        centroid_bbox.Union( chunk_bbox[i] );
+
+    // quantize the centroids into Morton codes
+    std::vector<Morton_Primitive> codes( pri_num );
+    const Vector extent = centroid_bbox.m_Max - centroid_bbox.m_Min;
+    runChunks( chunk_cnt , pri_num , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+        for( unsigned i = _start ; i < _end ; i++ ){
+            unsigned quantized[3];
+            for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+                const float t = ( extent[axis] > 0.0f ) ? ( bvhpri[i].m_centroid[axis] - centroid_bbox.m_Min[axis] ) / extent[axis] : 0.5f;
+                quantized[axis] = (unsigned)min( max( t * 1024.0f , 0.0f ) , 1023.0f );
+            }
+            codes[i].code = ( expandBits( quantized[0] ) << 2 ) | ( expandBits( quantized[1] ) << 1 ) | expandBits( quantized[2] );
+            codes[i].index = i;
+        }
+    });
+
+    radixSort( codes );
+
+    // reorder the primitives so that leaf nodes own consecutive ranges of them
+    std::vector<Bvh_Primitive> unsorted( bvhpri , bvhpri + pri_num );
+    for( unsigned i = 0 ; i < pri_num ; i++ )
+        bvhpri[i] = unsorted[codes[i].index];
+
+    if( m_hlbvh ){
+        // group primitives sharing the top bits of their codes into clusters
+        const unsigned shift = LBVH_MORTON_BITS - LBVH_CLUSTER_BITS;
+        std::vector<Lbvh_Cluster> clusters;
+        for( unsigned i = 0 ; i < pri_num ; i++ ){
+            if( i == 0 || ( codes[i].code >> shift ) != ( codes[i-1].code >> shift ) ){
+                clusters.push_back( Lbvh_Cluster() );
+                clusters.back()._start = i;
+            }
+            clusters.back()._end = i + 1;
+            clusters.back().bbox.Union( bvhpri[i].GetBBox() );
+        }
+        for( auto& cluster : clusters )
+            cluster.centroid = ( cluster.bbox.m_Min + cluster.bbox.m_Max ) * 0.5f;
+        emitTopNode( m_root , codes , clusters , 0u , (unsigned)clusters.size() , 0u );
+    }else{
+        emitNode( m_root , codes , 0u , pri_num , (int)LBVH_MORTON_BITS - 1 , 0u );
+    }
+
+    // the statistics are collected afterward since sub-trees are built concurrently
+    collectStats( m_root , 0u );
+}
+
+// sort the primitives by their morton codes
+void Lbvh::radixSort( std::vector<Morton_Primitive>& codes )
+{
+    const unsigned count = (unsigned)codes.size();
+    const unsigned chunk_cnt = chunkCount( count );
+
+    std::vector<Morton_Primitive> sorted( count );
+    std::vector<unsigned> offsets( chunk_cnt * LBVH_RADIX_BUCKETS );
+    for( unsigned shift = 0 ; shift < LBVH_MORTON_BITS ; shift += LBVH_RADIX_BITS ){
+        // count the codes falling into each bucket in each chunk
+        std::fill( offsets.begin() , offsets.end() , 0 );
+        runChunks( chunk_cnt , count , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+            unsigned* histogram = &offsets[chunk * LBVH_RADIX_BUCKETS];
+            for( unsigned i = _start ; i < _end ; i++ )
+                histogram[( codes[i].code >> shift ) & ( LBVH_RADIX_BUCKETS - 1 )]++;
+        });
+
+        // earlier chunks go first within the same bucket, this keeps the sort stable
+        unsigned sum = 0;
+        for( unsigned bucket = 0 ; bucket < LBVH_RADIX_BUCKETS ; bucket++ ){
+            for( unsigned chunk = 0 ; chunk < chunk_cnt ; chunk++ ){
+                const unsigned cnt = offsets[chunk * LBVH_RADIX_BUCKETS + bucket];
+                offsets[chunk * LBVH_RADIX_BUCKETS + bucket] = sum;
+                sum += cnt;
+            }
+        }
+
+        // scatter the codes, each chunk writes to its own slots
+        runChunks( chunk_cnt , count , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+            unsigned* offset = &offsets[chunk * LBVH_RADIX_BUCKETS];
+            for( unsigned i = _start ; i < _end ; i++ )
+                sorted[offset[( codes[i].code >> shift ) & ( LBVH_RADIX_BUCKETS - 1 )]++] = codes[i];
+        });
+        codes.swap( sorted );
+    }
+}
+
+// emit the sub-tree of a range of sorted primitives
+void Lbvh::emitNode( Bvh_Node* node , const std::vector<Morton_Primitive>& codes , unsigned _start , unsigned _end , int bit , unsigned depth )
+{
+    if( _end - _start <= m_maxPriInLeaf || depth + 1 >= BVH_MAX_DEPTH ){
+        for( unsigned i = _start ; i < _end ; i++ )
+            node->bbox.Union( m_bvhpri[i].GetBBox() );
+        makeLeaf( node , _start , _end );
+        return;
+    }
+
+    // codes in the range are sorted, so the highest differing bit is the one differing between the first and the last code
+    while( bit >= 0 && ( ( codes[_start].code ^ codes[_end-1].code ) & ( 1u << bit ) ) == 0 )
+        --bit;
+
+    // the first primitive with the bit set starts the right child, identical codes are split in the middle
+    unsigned mid = ( _start + _end ) / 2;
+    if( bit >= 0 ){
+        const unsigned mask = 1u << bit;
+        auto it = std::partition_point( codes.begin() + _start , codes.begin() + _end , [mask]( const Morton_Primitive& p ){ return ( p.code & mask ) == 0; } );
+        mid = (unsigned)( it - codes.begin() );
+    }
+
+    node->left = new Bvh_Node();
+    node->right = new Bvh_Node();
+
+    // the two sub-trees touch disjoint ranges of primitives, they are built as separate jobs if both are large
+    if( min( mid - _start , _end - mid ) > LBVH_FORK_THRESHOLD ){
+        ParallelInvoke( [&](){ emitNode( node->left , codes , _start , mid , bit - 1 , depth + 1 ); } , [&](){ emitNode( node->right , codes , mid , _end , bit - 1 , depth + 1 ); } );
+    }else{
+        emitNode( node->left , codes , _start , mid , bit - 1 , depth + 1 );
+        emitNode( node->right , codes , mid , _end , bit - 1 , depth + 1 );
+    }
+    node->bbox = Union( node->left->bbox , node->right->bbox );
+}
+
+// build the top levels of the tree over clusters with sah
+void Lbvh::emitTopNode( Bvh_Node* node , const std::vector<Morton_Primitive>& codes , std::vector<Lbvh_Cluster>& clusters , unsigned _start , unsigned _end , unsigned depth )
+{
+    // a single cluster is a sub-tree emitted from its Morton codes
+    if( _end - _start == 1 ){
+        const Lbvh_Cluster& cluster = clusters[_start];
+        emitNode( node , codes , cluster._start , cluster._end , (int)( LBVH_MORTON_BITS - LBVH_CLUSTER_BITS ) - 1 , depth );
+        return;
+    }
+
+    BBox centroid_bbox;
+    for( unsigned i = _start ; i < _end ; i++ )
+        centroid_bbox.Union( clusters[i].centroid );
+
+    // sweep the clusters along each axis and keep the split with the minimal sah
+    unsigned best_axis = centroid_bbox.MaxAxisId();
+    unsigned mid = ( _start + _end ) / 2;
+    if( depth < LBVH_TOP_SAH_DEPTH ){
+        float best_sah = FLT_MAX;
+        std::vector<float> right_cost( _end - _start );
+        for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+            std::sort( clusters.begin() + _start , clusters.begin() + _end , [axis]( const Lbvh_Cluster& a , const Lbvh_Cluster& b ){ return a.centroid[axis] < b.centroid[axis]; } );
+            BBox rbox;
+            unsigned rcount = 0;
+            for( unsigned i = _end - 1 ; i > _start ; --i ){
+                rbox.Union( clusters[i].bbox );
+                rcount += clusters[i]._end - clusters[i]._start;
+                right_cost[i-_start] = rcount * rbox.HalfSurfaceArea();
+            }
+            BBox lbox;
+            unsigned lcount = 0;
+            for( unsigned i = _start + 1 ; i < _end ; ++i ){
+                lbox.Union( clusters[i-1].bbox );
+                lcount += clusters[i-1]._end - clusters[i-1]._start;
+                const float cost = lcount * lbox.HalfSurfaceArea() + right_cost[i-_start];
+                if( cost < best_sah ){
+                    best_sah = cost;
+                    best_axis = axis;
+                    mid = i;
+                }
+            }
+        }
+    }
+    std::sort( clusters.begin() + _start , clusters.begin() + _end , [best_axis]( const Lbvh_Cluster& a , const Lbvh_Cluster& b ){ return a.centroid[best_axis] < b.centroid[best_axis]; } );
+
+    node->left = new Bvh_Node();
+    node->right = new Bvh_Node();
+    emitTopNode( node->left , codes , clusters , _start , mid , depth + 1 );
+    emitTopNode( node->right , codes , clusters , mid , _end , depth + 1 );
+    node->bbox = Union( node->left->bbox , node->right->bbox );
+}
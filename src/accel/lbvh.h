@@ -0,0 +1,105 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "bvh.h"
+
+//! @brief Linear bounding volume hierarchy.
+/**
+ * LBVH trades the quality of the tree for construction speed. Centroids of primitives are quantized
+ * into 30-bit Morton codes and sorted with a parallel radix sort, the hierarchy is then emitted by
+ * splitting ranges of primitives at the highest differing bit of their codes, no cost is evaluated at all.
+ * With the 'hlbvh' property enabled, primitives are grouped into clusters by the top bits of their codes
+ * and the top levels of the tree are built over the clusters with SAH, which recovers most of the quality.
+ * Please refer to this paper
+ * <a href="https://research.nvidia.com/sites/default/files/publications/HLBVH-final.pdf">
+ * Simpler and Faster HLBVH with Work Queues</a> for further details.
+ * Everything after the construction of the binary tree, including traversal and refitting, is shared with BVH.
+ * Spatial splits are not supported.
+ */
+class Lbvh : public Bvh
+{
+public:
+	DEFINE_CREATOR( Lbvh , Accelerator , "lbvh" );
+
+	//! Default constructor.
+	Lbvh() { _registerProperty( "hlbvh" , new HlbvhProperty(this) ); }
+
+	//! Output log information
+	void OutputLog() const override;
+
+	//! Add the shape of the structure to the statistics report
+	void CollectStats( StatsGroup& stats ) const override;
+
+    //! @brief Primitive along with its Morton code, it is the element sorted during construction.
+    struct Morton_Primitive
+    {
+        unsigned    code;       /**< 30-bit Morton code of the centroid of the primitive. */
+        unsigned    index;      /**< Index of the primitive in the primitive buffer. */
+    };
+
+    //! @brief Cluster of primitives sharing the top bits of their Morton codes, it is only used by HLBVH.
+    struct Lbvh_Cluster
+    {
+        BBox        bbox;       /**< Bounding box of the primitives in the cluster. */
+        Point       centroid;   /**< Center of the bounding box. */
+        unsigned    _start;     /**< The start offset of the primitives in the cluster. */
+        unsigned    _end;       /**< The end offset of the primitives in the cluster. */
+    };
+
+protected:
+    bool    m_hlbvh = false;    /**< Whether the top levels of the tree are built with SAH. */
+
+	//! Build the pointer based binary tree from sorted Morton codes.
+	void buildTree() override;
+
+	//! @brief Sort the primitives by their Morton codes.
+    //! @param codes    The Morton codes to be sorted.
+	void radixSort( std::vector<Morton_Primitive>& codes );
+
+	//! @brief Emit the sub-tree of a range of primitives sorted by Morton codes.
+    //! @param node     The root node of the sub-tree.
+    //! @param codes    The sorted Morton codes.
+    //! @param _start   The start offset of primitives that the node holds.
+    //! @param _end     The end offset of primitives that the node holds.
+    //! @param bit      The highest bit that could differ among the codes of the range.
+    //! @param depth    The current depth of the node.
+	void emitNode( Bvh_Node* node , const std::vector<Morton_Primitive>& codes , unsigned _start , unsigned _end , int bit , unsigned depth );
+
+	//! @brief Build the top levels of the tree over clusters with SAH.
+    //! @param node     The root node of the sub-tree.
+    //! @param codes    The sorted Morton codes.
+    //! @param clusters The clusters in the sub-tree, they are reordered during construction.
+    //! @param _start   The offset of the first cluster of the sub-tree.
+    //! @param _end     The offset after the last cluster of the sub-tree.
+    //! @param depth    The current depth of the node.
+	void emitTopNode( Bvh_Node* node , const std::vector<Morton_Primitive>& codes , std::vector<Lbvh_Cluster>& clusters , unsigned _start , unsigned _end , unsigned depth );
+
+	//! Property enabling SAH construction of the top levels, '1' enables it.
+	class HlbvhProperty : public PropertyHandler<Accelerator>
+	{
+	public:
+		PH_CONSTRUCTOR(HlbvhProperty,Accelerator);
+		void SetValue( const string& str )
+		{
+			Lbvh* lbvh = CAST_TARGET(Lbvh);
+			if( lbvh )
+				lbvh->m_hlbvh = ( atoi( str.c_str() ) == 1 );
+		}
+	};
+};
@@ -17,15 +17,15 @@
 
 #include "octree.h"
 #include "geometry/primitive.h"
+#include "geometry/intersection.h"
 #include "log/log.h"
+#include "accelstats.h"
+#include "utility/statsreport.h"
 
 IMPLEMENT_CREATOR( OcTree );
 
-// destructor
-OcTree::~OcTree()
-{
-	releaseOcTree( m_pRoot );
-}
+// each level of interior nodes adds at most four nodes to the traversal stack, three of them stay there
+static const unsigned OCTREE_STACK_SIZE = 128;
 
 // Get the intersection between the ray and the primitive set
 // @param r The ray
@@ -33,22 +33,25 @@ OcTree::~OcTree()
 // @return 'true' if the ray pirece one of the primitve in the list
 bool OcTree::GetIntersect( const Ray& r , Intersection* intersect ) const
 {
-	float fmax;
-	float fmin = Intersect( r , m_bbox , &fmax );
-	if( fmin < 0.0f )
+	if( !traverseOcTree( r , intersect ) )
 		return false;
+	return !intersect || nullptr != intersect->primitive;
+}
 
-	if( traverseOcTree( m_pRoot , r , intersect , fmin , fmax ) ){
-		if( !intersect )
-			return true;
-		return nullptr != intersect->primitive;
-	}
-	return false;
+// check whether the ray is blocked by any primitive
+bool OcTree::IsOccluded( const Ray& r ) const
+{
+	return traverseOcTree( r , nullptr );
 }
 
 // build the acceleration structure
 void OcTree::Build()
 {
+	m_nodes.clear();
+	m_leafPri.clear();
+	m_leafCount = 0;
+	m_depth = 0;
+
 	// handling empty mesh case
 	if( m_primitives->size() == 0 )
 		return ;
@@ -58,21 +61,40 @@ void OcTree::Build()
 
 	// initialize a triangle container
 	NodeTriangleContainer* container = new NodeTriangleContainer();
-    for( auto primitive : *m_primitives )
-		container->primitives.push_back( primitive );
+	for( unsigned i = 0 ; i < (unsigned)m_primitives->size() ; ++i )
+		container->primitives.push_back( i );
 	
 	// create root node
-	m_pRoot = new OcTreeNode();
-	m_pRoot->bb = m_bbox;
+	OcTreeNode* root = new OcTreeNode();
+	root->bb = m_bbox;
 
 	// split octree node
-	splitNode( m_pRoot , container , 0 );
+	splitNode( root , container , 0 );
+
+	// flatten the tree, the pointer based one is not needed afterward
+	m_nodes.resize( 1 );
+	flattenNode( root , 0 , 1 );
+	releaseOcTree( root );
 }
 
 // output log information
 void OcTree::OutputLog() const
 {
     slog( INFO , SPATIAL_ACCELERATOR , "Spatial accelerator is OcTree." );
+    slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "OcTree depth is %d. Total number of nodes in it is %d, number of leaf nodes is %d. Average number of triangles in leaf is %f." , m_depth , (unsigned)m_nodes.size() , m_leafCount , ( m_leafCount == 0 ) ? 0.0f : (float)m_leafPri.size() / m_leafCount ) );
+}
+
+// add the shape of the octree to the report
+void OcTree::CollectStats( StatsGroup& stats ) const
+{
+    stats.Add( "type" , "octree" ).Add( "depth" , m_depth ).Add( "nodes" , (unsigned)m_nodes.size() ).Add( "leaves" , m_leafCount )
+         .Add( "avg_leaf_primitives" , ( m_leafCount == 0 ) ? 0.0f : (float)m_leafPri.size() / m_leafCount );
+}
+
+// memory taken by the octree
+size_t OcTree::GetMemoryUsage() const
+{
+	return sizeof( OcTree_Compact_Node ) * m_nodes.size() + sizeof( unsigned ) * m_leafPri.size();
 }
 
 // Release OcTree memory.
@@ -128,11 +150,11 @@ void OcTree::splitNode( OcTreeNode* node , NodeTriangleContainer* container , un
 	}
 	
 	// distribute triangles
-	vector<const Primitive*>::const_iterator it = container->primitives.begin();
+	vector<unsigned>::const_iterator it = container->primitives.begin();
 	while( it != container->primitives.end() ){
 		for( int i = 0 ; i < 8 ; ++i ){
 			// check for intersection
-			if( (*it)->GetIntersect( node->child[i]->bb ) ){
+			if( (*m_primitives)[*it]->GetIntersect( node->child[i]->bb ) ){
 				childcontainer[i]->primitives.push_back( *it );
 			}
 		}
@@ -176,72 +198,141 @@ void OcTree::makeLeaf( OcTreeNode* node , NodeTriangleContainer* container )
 	delete container;
 }
 
-// Traverse OcTree recursively.
-// @param node Sub-tree belongs to this node will be visited in a depth first manner.
+// Flatten the sub-tree of a node.
+// @param node Sub-tree belongs to this node will be flattened recursively.
+// @param id Index of the flattened node, it is allocated already.
+// @param depth Current depth of this node.
+void OcTree::flattenNode( const OcTreeNode* node , unsigned id , unsigned depth )
+{
+	m_depth = max( m_depth , depth );
+
+	if( node->child[0] == 0 ){
+		m_nodes[id].pri_offset = (unsigned)m_leafPri.size();
+		m_nodes[id].pri_num = (unsigned)node->primitives.size();
+		m_leafPri.insert( m_leafPri.end() , node->primitives.begin() , node->primitives.end() );
+		++m_leafCount;
+		return;
+	}
+
+	// all children are allocated together so that the index of a child is the first one plus its octant
+	const unsigned child = (unsigned)m_nodes.size();
+	m_nodes.resize( child + 8 );
+	m_nodes[id].child = child;
+	for( unsigned i = 0 ; i < 8 ; ++i )
+		flattenNode( node->child[i] , child + i , depth + 1 );
+}
+
+// Traverse the flattened OcTree from near to far along the ray.
+// The ray is mirrored so that its direction is positive along all axes, the octant of the mirrored children
+// is flipped back with a mask. The parametric ranges of the children are the halves of the parent's ranges,
+// there is no need to intersect their bounding boxes.
 // @param ray The input ray to be tested.
-// @param fmin Current minimum value along the range.
-// @param fmax Current maximum value along the range.
-// @param ray_max Maximum value in along the range for optimization of shadow ray.
+// @param intersect The intersection result, nullptr for shadow rays.
 // @result Whether the ray intersects anything in the primitive set
-bool OcTree::traverseOcTree( const OcTreeNode* node , const Ray& ray , Intersection* intersect , float fmin , float fmax ) const
+bool OcTree::traverseOcTree( const Ray& ray , Intersection* intersect ) const
 {
-	static const float	delta = 0.001f;
-	bool inter = false;
-
-	// Early rejections
-	if( fmin > fmax )
+	if( m_nodes.empty() )
 		return false;
-	if( intersect && intersect->t < fmin - delta )
-		return true;
 
-	// Iterate if there is primitives in the node. Since it is not allowed to store primitives in non-leaf node, there is no need to proceed.
-	if( node->child[0] == 0 ){
-        for( auto tri : node->primitives ){
-			inter |= tri->GetIntersect( ray , intersect );
-			if( !intersect && inter )
-				return true;
+	// mirror the ray, zero directions are replaced by tiny ones to keep the ranges finite
+	unsigned mirror = 0;
+	float t0[3] , t1[3];
+	for( int i = 0 ; i < 3 ; ++i ){
+		float ori = ray.m_Ori[i];
+		float dir = ray.m_Dir[i];
+		if( dir < 0.0f ){
+			ori = m_bbox.m_Min[i] + m_bbox.m_Max[i] - ori;
+			dir = -dir;
+			mirror |= ( 1 << i );
 		}
-		return inter && ( intersect->t < ( fmax + delta ) && intersect->t > ( fmin - delta ) );
+		const float inv = 1.0f / max( dir , 1e-20f );
+		t0[i] = ( m_bbox.m_Min[i] - ori ) * inv;
+		t1[i] = ( m_bbox.m_Max[i] - ori ) * inv;
 	}
 
-	const Point contact = ray(fmin);
-	const Point center = ( node->bb.m_Max + node->bb.m_Min ) * 0.5f;
-    int node_index = ( contact.x > center.x ) + ( contact.y > center.y ) * 2 + ( contact.z > center.z ) * 4;
-
-	float	_curt = fmin;
-	int 	_dir[3];
-	float	_delta[3],_next[3];
-	for( int i = 0 ; i < 3 ; i++ ){
-		_dir[i] = ( ray.m_Dir[i] > 0.0f ) ? 1 : -1;
-        _delta[i] = ( ray.m_Dir[i] != 0.0f )?fabs( node->bb.Delta(i) / ray.m_Dir[i] ) * 0.5f : FLT_MAX;
-	}
-	for( int i = 0 ; i < 3 ; i++ ){
-		const float target = node->child[node_index]->bb.m_Min[i] + ((_dir[i]+1)>>1) * node->bb.Delta(i) * 0.5f;
-        _next[i] = ( ray.m_Dir[i] == 0.0f )?FLT_MAX:( target - ray.m_Ori[i] ) / ray.m_Dir[i];
+	// nodes to be visited along with their parametric ranges
+	struct OcTree_Stack_Entry{
+		unsigned	node;
+		float		t0[3];
+		float		t1[3];
+	};
+	OcTree_Stack_Entry stack[OCTREE_STACK_SIZE];
+	OcTree_Stack_Entry* top = stack;
+	top->node = 0;
+	for( int i = 0 ; i < 3 ; ++i ){
+		top->t0[i] = t0[i];
+		top->t1[i] = t1[i];
 	}
+	++top;
+
+	SORT_STATS( AccelStats& stats = AccelStats::Local() );
+	bool inter = false;
+	const unsigned type = RayType( ray , intersect == nullptr );
+	while( top > stack ){
+		const OcTree_Stack_Entry entry = *--top;
+		const float tmin = max( entry.t0[0] , max( entry.t0[1] , entry.t0[2] ) );
+		const float tmax = min( entry.t1[0] , min( entry.t1[1] , entry.t1[2] ) );
+
+		// the node is missed or out of the range of the ray
+		if( tmin > tmax || tmax < ray.m_fMin || tmin > ray.m_fMax )
+			continue;
 
-	// traverse the octree
-	while( ( intersect && _curt < intersect->t ) || !intersect ){
-		// get the axis along which the ray leaves the node fastest.
-		unsigned nextAxis = (_next[0] <= _next[1])?0:1;
-		nextAxis = (_next[nextAxis] <= _next[2])?nextAxis:2;
+		// nodes are visited from near to far, all of the rest are behind the intersection found so far
+		if( intersect && intersect->t < tmin ){
+			SORT_STATS( ++stats.earlyOuts );
+			break;
+		}
+
+		SORT_STATS( ++stats.nodes );
+		const OcTree_Compact_Node& node = m_nodes[entry.node];
+		if( node.child == 0 ){
+			const unsigned* pri = &m_leafPri[node.pri_offset];
+			for( unsigned i = 0 ; i < node.pri_num ; ++i ){
+				SORT_STATS( ++stats.primitives );
+				const Primitive* primitive = (*m_primitives)[pri[i]];
+				if( !primitive->IsHiddenFrom( type ) && primitive->GetIntersect( ray , intersect ) ){
+					if( intersect == 0 ){
+						SORT_STATS( ++stats.earlyOuts );
+						return true;
+					}
+					inter = true;
+				}
+			}
+			continue;
+		}
 
-		// chech if there is intersection in the current grid
-		if( traverseOcTree( node->child[node_index] , ray , intersect , _curt , _next[nextAxis] ) )
-			return true;
+		float tm[3];
+		for( int i = 0 ; i < 3 ; ++i )
+			tm[i] = 0.5f * ( entry.t0[i] + entry.t1[i] );
 
-		// get to the next node based on distance
-		node_index += ( 1 << nextAxis ) * _dir[nextAxis];
+		// the first child is decided by the plane the ray enters the node through
+		unsigned octant = 0;
+		const int entry_axis = ( entry.t0[0] > entry.t0[1] ) ? ( ( entry.t0[0] > entry.t0[2] ) ? 0 : 2 ) : ( ( entry.t0[1] > entry.t0[2] ) ? 1 : 2 );
+		for( int i = 0 ; i < 3 ; ++i ){
+			if( i != entry_axis && tm[i] < entry.t0[entry_axis] )
+				octant |= ( 1 << i );
+		}
 
-		// update next
-		_curt = _next[nextAxis];
-		_next[nextAxis] += _delta[nextAxis];
+		// walk through at most four children, the next one is across the plane the ray leaves the current one through
+		OcTree_Stack_Entry children[4];
+		int child_cnt = 0;
+		while( true ){
+			OcTree_Stack_Entry& child = children[child_cnt++];
+			child.node = node.child + ( octant ^ mirror );
+			for( int i = 0 ; i < 3 ; ++i ){
+				const bool upper = ( octant & ( 1 << i ) ) != 0;
+				child.t0[i] = upper ? tm[i] : entry.t0[i];
+				child.t1[i] = upper ? entry.t1[i] : tm[i];
+			}
+			const int exit_axis = ( child.t1[0] < child.t1[1] ) ? ( ( child.t1[0] < child.t1[2] ) ? 0 : 2 ) : ( ( child.t1[1] < child.t1[2] ) ? 1 : 2 );
+			if( octant & ( 1 << exit_axis ) )
+				break;
+			octant |= ( 1 << exit_axis );
+		}
 
-		// check for early rejection
-		if( node_index < 0 || node_index > 7 )
-			break;
-		if( _curt > fmax + delta || _curt < fmin - delta )
-			break;
+		// push the further children first so that the nearest one is visited first
+		while( child_cnt > 0 )
+			*top++ = children[--child_cnt];
 	}
 
 	return inter;
@@ -26,15 +26,18 @@
  * OcTree is a popular data strucutre in scene management, which is commonly seen in game engines.
  * Instead of scene visibility management, it can also serves for the purpose of accelerating ray
  * tracer applications.
+ * The tree is flattened after construction, the eight children of an interior node are consecutive and
+ * the primitives of all leaves share one index array. It is traversed iteratively with the parametric
+ * algorithm, children are visited from near to far in the order decided by the octant of the ray.
+ * Please refer to this paper
+ * <a href="http://wscg.zcu.cz/wscg2000/Papers_2000/X31.pdf">
+ * An Efficient Parametric Algorithm for Octree Traversal</a> for further details.
  */
 class OcTree : public Accelerator
 {
 public:
 	DEFINE_CREATOR( OcTree , Accelerator , "octree" );
 
-	//! destructor
-	~OcTree();
-
     //! @brief Get intersection between the ray and the primitive set using OcTree.
     //!
     //! It will return true if there is intersection between the ray and the primitive set.
@@ -48,28 +51,54 @@ public:
     //!                     long as it finds an intersection. It is faster than the one with intersection information
     //!                     data and suitable for shadow ray calculation.
     //! @return             It will return true if there is an intersection, otherwise it returns false.
-	virtual bool GetIntersect( const Ray& r , Intersection* intersect ) const;
+	bool GetIntersect( const Ray& r , Intersection* intersect ) const override;
+
+    //! @brief Check whether the ray is blocked by any primitive using OcTree.
+    //!
+    //! It is the dedicated query for shadow rays. It walks the nodes near to far like GetIntersect and returns at the first
+    //! blocking primitive.
+    //! @param r            The input ray to be tested.
+    //! @return             It will return true if there is any intersection, otherwise it returns false.
+	bool IsOccluded( const Ray& r ) const override;
 
 	//! Build the OcTree in O(Nlg(N)) time
-	virtual void Build();
+	void Build() override;
 
 	//! output log information
-	void OutputLog() const;
+	void OutputLog() const override;
+
+	//! Add the shape of the structure to the statistics report
+	void CollectStats( StatsGroup& stats ) const override;
+
+	//! memory taken by the flattened nodes and the primitive indices of leaf nodes
+	size_t GetMemoryUsage() const override;
 
-    //! OcTree node structure
+    //! OcTree node structure, it is only used during construction
     struct OcTreeNode{
         OcTreeNode*					child[8] = {};	/**< Child node pointers, all will be NULL if current node is a leaf.*/
-        vector<const Primitive*>	primitives;     /**< Primitives buffer.*/
+        vector<unsigned>			primitives;     /**< Indices of primitives in the node.*/
         BBox						bb;             /**< Bounding box for this octree node.*/
     };
     
     //! @brief Triangle information in octree node.
     struct NodeTriangleContainer{
-        vector<const Primitive*>	primitives;		/**< Primitive buffer used during octree construction.*/
+        vector<unsigned>			primitives;		/**< Indices of primitives used during octree construction.*/
+    };
+
+    //! @brief Flattened OcTree node used during traversal.
+    //!
+    //! The bounding box is not stored, it is derived from the parent during traversal since a node is always split in the middle.
+    struct OcTree_Compact_Node{
+        unsigned    child = 0;          /**< Index of the first one of the eight consecutive children, it is 0 for leaf nodes. */
+        unsigned    pri_offset = 0;     /**< Offset in the shared primitive index array for leaf nodes. */
+        unsigned    pri_num = 0;        /**< Number of primitives in leaf nodes. */
     };
     
 private:
-	OcTreeNode*	m_pRoot = nullptr;				/**< Pointer to the root node of this octree.*/
+	vector<OcTree_Compact_Node>	m_nodes;        /**< Flattened nodes, children of a node are consecutive and the root is the first one.*/
+	vector<unsigned>	m_leafPri;              /**< Indices of primitives in all leaf nodes.*/
+	unsigned	m_leafCount = 0;                /**< Number of leaf nodes.*/
+	unsigned	m_depth = 0;                    /**< Depth of the octree.*/
 	const unsigned	m_uMaxTriInLeaf = 16;		/**< Maximum number of triangles allowed in a leaf node, 16 is the default value.*/
 	const unsigned	m_uMaxDepthInOcTree = 16;	/**< Maximum depth of the octree, 16 is the default value.*/
 
@@ -87,15 +116,18 @@ private:
 	//! @param container    Container holdes all triangle information in this node.
 	void makeLeaf( OcTreeNode* node , NodeTriangleContainer* container );
 
-	//! @brief Traverse OcTree recursively and return if there is interesection.
-	//! @param node         Sub-tree belongs to this node will be visited in a depth first manner.
+	//! @brief Flatten the sub-tree of a node.
+	//! @param node         Sub-tree belongs to this node will be flattened recursively.
+	//! @param id           Index of the flattened node, it is allocated already.
+	//! @param depth        Current depth of this node.
+	void flattenNode( const OcTreeNode* node , unsigned id , unsigned depth );
+
+	//! @brief Traverse the flattened OcTree from near to far along the ray.
 	//! @param ray          The input ray to be tested.
     //! @param intersect    A pointer to the result intersection information. If empty is passed, it will return as long as an intersection is
     //!                     detected and it is not necessarily to be the nearest one.
-	//! @param fmin         Current minimum value along the ray
-	//! @param fmax         Current maximum value along the ray.
 	//! @return             Whether the ray intersects anything in the primitive set
-	bool traverseOcTree( const OcTreeNode* node , const Ray& ray , Intersection* intersect , float fmin , float fmax ) const;
+	bool traverseOcTree( const Ray& ray , Intersection* intersect ) const;
 
 	//! @brief Release OcTree memory.
 	//! @param node Sub-tree belongs to this node will be released recursively.
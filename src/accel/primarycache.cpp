@@ -0,0 +1,250 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "primarycache.h"
+#include "geometry/scene.h"
+#include "geometry/primitive.h"
+#include "camera/camera.h"
+#include "light/light.h"
+#include "sampler/sample.h"
+#include "sampler/lowdiscrepancy.h"
+#include "accel/accelcache.h"
+#include "utility/multithread/threadpool.h"
+#include "log/log.h"
+
+static const unsigned   PRIMARY_CACHE_EMPTY = 0xffffffff;       // the point is not traced yet
+static const unsigned   PRIMARY_CACHE_MISS = 0xfffffffe;        // the camera ray of the point misses the scene
+static const unsigned   PRIMARY_CACHE_TRIANGLE = 0x80000000;    // the flag of world space triangles in the index of a primitive
+
+// allocate the records
+bool PrimaryCache::Build( const Scene& scene , const Camera* camera , int width , int height , unsigned pattern , unsigned budget , bool shadows )
+{
+    // the camera rays of the same point in a pixel differ across passes with DOF or motion blur
+    const std::vector<Primitive*>& primitives = scene.GetPrimitives();
+    if( width <= 0 || height <= 0 || pattern == 0 || camera->HasLens() || scene.HasMotion() || primitives.size() >= PRIMARY_CACHE_TRIANGLE ){
+        Release();
+        return false;
+    }
+
+    const unsigned long long pixels = (unsigned long long)width * height;
+    const size_t point_size = sizeof( Cache_Record ) + ( shadows ? sizeof( unsigned ) : 0 );
+    const unsigned long long fit = (unsigned long long)budget * 1024 * 1024 / ( pixels * point_size );
+    if( fit == 0 ){
+        Release();
+        return false;
+    }
+    const unsigned points = (unsigned)min( (unsigned long long)pattern , fit );
+    if( points < pattern )
+        slog( WARNING , GENERAL , stringFormat( "The pattern of the primary cache is shrunk to %u points per pixel to fit into %u MB." , points , budget ) );
+
+    // the records of the previous rendering are kept if they belong to the same scene , camera and settings
+    const unsigned long long signature = _signature( scene , camera , width , height , points , shadows );
+    const bool kept = m_built && signature == m_signature;
+    if( !kept ){
+        Release();
+        m_width = width;
+        m_height = height;
+        m_pattern = points;
+        m_signature = signature;
+        m_records.assign( pixels * m_pattern , Cache_Record{ PRIMARY_CACHE_EMPTY , 0.0f , 0.0f , 0.0f } );
+        m_shadows.assign( shadows ? pixels * m_pattern : 0 , 0u );
+        m_primitives.assign( primitives.begin() , primitives.end() );
+        m_indices.reserve( primitives.size() );
+        for( unsigned i = 0 ; i < (unsigned)primitives.size() ; ++i )
+            m_indices[primitives[i]] = i;
+        m_built = true;
+    }
+    m_reused = 0;
+    m_traced = 0;
+    if( shadows )
+        _assignSlots( scene );
+
+    if( kept )
+        slog( INFO , GENERAL , "The first hits of the camera rays are kept from the previous rendering." );
+    return true;
+}
+
+// release the records
+void PrimaryCache::Release()
+{
+    m_built = false;
+    m_signature = 0;
+    m_records.clear();
+    m_records.shrink_to_fit();
+    m_shadows.clear();
+    m_shadows.shrink_to_fit();
+    for( unsigned s = 0 ; s < PRIMARY_CACHE_SHADOW_SLOTS ; ++s ){
+        m_slotKeys[s] = 0;
+        m_slotLights[s] = nullptr;
+    }
+    m_kept = 0;
+    m_primitives.clear();
+    m_indices.clear();
+}
+
+// get the position of a sample in its pixel
+void PrimaryCache::Jitter( int x , int y , unsigned sample , float& u , float& v ) const
+{
+    // the points of the pattern are the first ones of a scrambled Sobol sequence , every pixel has its own scrambling
+    const unsigned point = sample % m_pattern;
+    const unsigned seed = MixBits( (unsigned)x * 0x9e3779b9 ^ MixBits( (unsigned)y ) );
+    u = FixedToCanonical( OwenScramble( ReverseBits( point ) , seed ) );
+    v = FixedToCanonical( OwenScramble( SobolSecondDimension( point ) , MixBits( seed ) ) );
+}
+
+// get the first hit of a sample
+bool PrimaryCache::Lookup( int x , int y , unsigned sample , Primary_Hit& hit ) const
+{
+    const size_t index = ( (size_t)y * m_width + x ) * m_pattern + sample % m_pattern;
+    const Cache_Record& record = m_records[index];
+    if( record.primitive == PRIMARY_CACHE_EMPTY )
+        return false;
+
+    hit = Primary_Hit();
+    if( record.primitive == PRIMARY_CACHE_MISS )
+        return true;
+    hit.primitive = m_primitives[ record.primitive & ~PRIMARY_CACHE_TRIANGLE ];
+    hit.triangle = ( record.primitive & PRIMARY_CACHE_TRIANGLE ) != 0;
+    hit.t = record.t;
+    hit.u = record.u;
+    hit.v = record.v;
+    if( !m_shadows.empty() ){
+        hit.cache = this;
+        hit.shadows = &m_shadows[index];
+    }
+    return true;
+}
+
+// keep the first hit of a sample
+void PrimaryCache::Store( int x , int y , unsigned sample , Primary_Hit& hit )
+{
+    const size_t index = ( (size_t)y * m_width + x ) * m_pattern + sample % m_pattern;
+    Cache_Record& record = m_records[index];
+    if( hit.primitive == nullptr ){
+        record.primitive = PRIMARY_CACHE_MISS;
+        return;
+    }
+
+    // primitives the scene doesn't list are traced again in every pass
+    const auto it = m_indices.find( hit.primitive );
+    if( it == m_indices.end() )
+        return;
+    record.primitive = it->second | ( hit.triangle ? PRIMARY_CACHE_TRIANGLE : 0 );
+    record.t = hit.t;
+    record.u = hit.u;
+    record.v = hit.v;
+    if( !m_shadows.empty() ){
+        hit.cache = this;
+        hit.shadows = &m_shadows[index];
+    }
+}
+
+// get the slot of the shadow rays towards a light
+int PrimaryCache::ShadowSlot( const Light* light ) const
+{
+    for( unsigned s = 0 ; s < PRIMARY_CACHE_SHADOW_SLOTS ; ++s )
+        if( m_slotLights[s] == light )
+            return (int)s;
+    return -1;
+}
+
+// hash the scene , the camera and the settings
+unsigned long long PrimaryCache::_signature( const Scene& scene , const Camera* camera , int width , int height , unsigned pattern , bool shadows ) const
+{
+    // the camera is compared by its rays through the corners and the center of the image
+    std::vector<float> data;
+    const PixelSample ps;
+    const float xs[5] = { 0.0f , (float)width , 0.0f , (float)width , width * 0.5f };
+    const float ys[5] = { 0.0f , 0.0f , (float)height , (float)height , height * 0.5f };
+    for( unsigned k = 0 ; k < 5 ; ++k ){
+        const Ray r = camera->GenerateRay( xs[k] , ys[k] , ps );
+        for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+            data.push_back( r.m_Ori[axis] );
+            data.push_back( r.m_Dir[axis] );
+        }
+    }
+    const unsigned long long settings[5] = { scene.GetVersion() , (unsigned long long)width , (unsigned long long)height , pattern , shadows ? 1ull : 0ull };
+    return AccelCache::Hash( data.data() , data.size() * sizeof( float ) ) ^ AccelCache::Hash( settings , sizeof( settings ) );
+}
+
+// give a slot to every delta light
+void PrimaryCache::_assignSlots( const Scene& scene )
+{
+    // only the shadow rays of delta lights don't depend on the samples , the ones of other lights are traced in every pass
+    std::vector<const Light*> lights;
+    for( const Light* light : scene.GetLights() )
+        if( light->IsDelta() && lights.size() < PRIMARY_CACHE_SHADOW_SLOTS )
+            lights.push_back( light );
+
+    // the lights keep their slots if they are not edited
+    unsigned clear_mask = 0;
+    bool taken[PRIMARY_CACHE_SHADOW_SLOTS] = {};
+    m_kept = 0;
+    for( unsigned s = 0 ; s < PRIMARY_CACHE_SHADOW_SLOTS ; ++s ){
+        m_slotLights[s] = nullptr;
+        for( const Light* light : lights )
+            if( m_slotKeys[s] != 0 && light->GetKey() == m_slotKeys[s] ){
+                m_slotLights[s] = light;
+                taken[s] = true;
+                ++m_kept;
+            }
+    }
+    for( const Light* light : lights ){
+        if( ShadowSlot( light ) >= 0 )
+            continue;
+        for( unsigned s = 0 ; s < PRIMARY_CACHE_SHADOW_SLOTS ; ++s )
+            if( !taken[s] ){
+                taken[s] = true;
+                m_slotLights[s] = light;
+                m_slotKeys[s] = light->GetKey();
+                clear_mask |= ( 1u << s ) | ( 1u << ( s + PRIMARY_CACHE_SHADOW_SLOTS ) );
+                break;
+            }
+    }
+
+    // the results of the lights no longer in the scene are wiped out from every point
+    if( clear_mask != 0 ){
+        const unsigned count = (unsigned)m_shadows.size();
+        ParallelFor( 0 , count , 65536 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+            for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+                m_shadows[i] &= ~clear_mask;
+        });
+    }
+}
+
+// count the camera rays of a render task
+void PrimaryCache::Count( unsigned long long reused , unsigned long long traced ) const
+{
+    m_reused.fetch_add( reused , std::memory_order_relaxed );
+    m_traced.fetch_add( traced , std::memory_order_relaxed );
+}
+
+// output the size of the records
+void PrimaryCache::OutputLog() const
+{
+    if( !m_built )
+        return;
+    const unsigned long long reused = m_reused.load() , traced = m_traced.load();
+    slog( INFO , PERFORMANCE , stringFormat( "Primary cache : %u points per pixel , %.1f MB , %llu of %llu camera rays reused the first hits of earlier passes." ,
+        m_pattern , ( m_records.size() * sizeof( Cache_Record ) + m_shadows.size() * sizeof( unsigned ) ) / ( 1024.0f * 1024.0f ) , reused , reused + traced ) );
+    if( !m_shadows.empty() ){
+        unsigned lights = 0;
+        for( unsigned s = 0 ; s < PRIMARY_CACHE_SHADOW_SLOTS ; ++s )
+            lights += m_slotLights[s] ? 1 : 0;
+        slog( INFO , PERFORMANCE , stringFormat( "Primary cache : the shadow rays of %u delta lights are kept , %u of them from the previous rendering." , lights , m_kept ) );
+    }
+}
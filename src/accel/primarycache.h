@@ -0,0 +1,155 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "primaryraster.h"
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+
+class Scene;
+class Camera;
+class Primitive;
+class Light;
+
+//! The number of delta lights whose shadow rays could be kept by the primary cache.
+static const unsigned PRIMARY_CACHE_SHADOW_SLOTS = 16;
+
+//! @brief The first hits of the camera rays of progressive rendering, they are kept across passes.
+/**
+ * The samples of a pixel are placed at the points of a fixed pattern instead of the positions drawn by the
+ * sampler, the sample 's' of a pixel takes the point 's % pattern'. With a pinhole camera and a static scene,
+ * the camera ray of a point is the same in every pass, so its first hit is only found once. The hit is kept
+ * as the index of the primitive, the distance and the barycentric coordinates, sixteen bytes for each point
+ * of each pixel. The pattern is shrunk until the records fit into the memory budget.
+ *
+ * The shadow rays from a first hit towards delta lights are the same in every pass as well, their results could
+ * be kept in another four bytes of each point, two bits for each of the lights holding a slot. The records are
+ * kept after rendering, the next rendering of the render server reuses them if it has the same scene, camera and
+ * settings. A light edited between the renderings is created again with another key, only its slot is cleared.
+ */
+class PrimaryCache
+{
+public:
+    //! @brief Allocate the records of every pixel.
+    //! @param scene    The scene, its primitives are indexed.
+    //! @param camera   The camera of the view.
+    //! @param width    The width of the image.
+    //! @param height   The height of the image.
+    //! @param pattern  The number of points of the pattern of each pixel.
+    //! @param budget   The memory budget of the records in megabytes.
+    //! @param shadows  Whether the shadow rays towards delta lights are kept too.
+    //! @return         False if the camera has DOF, anything in the scene moves or not even one point of each pixel fits into the budget.
+    bool Build( const Scene& scene , const Camera* camera , int width , int height , unsigned pattern , unsigned budget , bool shadows );
+
+    //! Release the records.
+    void Release();
+
+    //! Whether the records are allocated.
+    bool IsBuilt() const { return m_built; }
+
+    //! @brief Get the position of a sample in its pixel.
+    //! @param x        The x coordinate of the pixel.
+    //! @param y        The y coordinate of the pixel.
+    //! @param sample   The index of the sample in the pixel.
+    //! @param u        The horizontal position in the pixel, it is in [0,1).
+    //! @param v        The vertical position in the pixel.
+    void Jitter( int x , int y , unsigned sample , float& u , float& v ) const;
+
+    //! @brief Get the first hit of a sample traced in an earlier pass.
+    //! @param x        The x coordinate of the pixel.
+    //! @param y        The y coordinate of the pixel.
+    //! @param sample   The index of the sample in the pixel.
+    //! @param hit      The first hit of the camera ray of the sample.
+    //! @return         False if the point of the sample is not traced yet.
+    bool Lookup( int x , int y , unsigned sample , Primary_Hit& hit ) const;
+
+    //! @brief Keep the first hit of a sample.
+    //! @param x        The x coordinate of the pixel.
+    //! @param y        The y coordinate of the pixel.
+    //! @param sample   The index of the sample in the pixel.
+    //! @param hit      The first hit of the camera ray of the sample, it refers to the shadow rays of its point once it is kept.
+    void Store( int x , int y , unsigned sample , Primary_Hit& hit );
+
+    //! @brief Get the slot of the shadow rays towards a light.
+    //! @param light    The light.
+    //! @return         The slot of the light, it is negative if its shadow rays are not kept.
+    int ShadowSlot( const Light* light ) const;
+
+    //! @brief Get the result of the shadow ray from a first hit towards a light.
+    //! @param hit      The first hit found by the cache.
+    //! @param slot     The slot of the light.
+    //! @param occluded Whether the light is occluded from the hit.
+    //! @return         False if the shadow ray is not traced yet.
+    static bool LookupShadow( const Primary_Hit& hit , int slot , bool& occluded )
+    {
+        if( ( *hit.shadows & ( 1u << slot ) ) == 0 )
+            return false;
+        occluded = ( *hit.shadows & ( 1u << ( slot + PRIMARY_CACHE_SHADOW_SLOTS ) ) ) != 0;
+        return true;
+    }
+
+    //! @brief Keep the result of the shadow ray from a first hit towards a light.
+    //! @param hit      The first hit found by the cache.
+    //! @param slot     The slot of the light.
+    //! @param occluded Whether the light is occluded from the hit.
+    static void StoreShadow( const Primary_Hit& hit , int slot , bool occluded )
+    {
+        *hit.shadows |= ( 1u << slot ) | ( occluded ? 1u << ( slot + PRIMARY_CACHE_SHADOW_SLOTS ) : 0u );
+    }
+
+    //! @brief Count the camera rays of a render task.
+    //! @param reused   The number of rays whose first hits are found in the records.
+    //! @param traced   The number of rays traced to fill the records.
+    void Count( unsigned long long reused , unsigned long long traced ) const;
+
+    //! Output the size of the records and the number of rays reusing them to the log.
+    void OutputLog() const;
+
+private:
+    //! @brief The first hit of a point of the pattern of a pixel.
+    struct Cache_Record
+    {
+        unsigned    primitive;  /**< The index of the primitive, the top bit is set for world space triangles. */
+        float       t;          /**< The distance of the hit. */
+        float       u;          /**< The weight of the second vertex of a triangle. */
+        float       v;          /**< The weight of the third vertex of a triangle. */
+    };
+
+    bool                                            m_built = false;    /**< Whether the records are allocated. */
+    unsigned long long                              m_signature = 0;    /**< The hash of the scene, the camera and the settings the records belong to. */
+    int                                             m_width = 0;        /**< The width of the image. */
+    int                                             m_height = 0;       /**< The height of the image. */
+    unsigned                                        m_pattern = 0;      /**< The number of points of the pattern of each pixel. */
+    std::vector<Cache_Record>                       m_records;          /**< The records of every point of every pixel. */
+    mutable std::vector<unsigned>                   m_shadows;          /**< The shadow rays of every point, the low half marks the traced ones and the high half the occluded ones. */
+    unsigned long long                              m_slotKeys[PRIMARY_CACHE_SHADOW_SLOTS] = {};    /**< The key of the light of each slot, zero if the slot is free. */
+    const Light*                                    m_slotLights[PRIMARY_CACHE_SHADOW_SLOTS] = {};  /**< The light of each slot in the rendering. */
+    std::vector<const Primitive*>                   m_primitives;       /**< The primitives of the scene by their indices. */
+    std::unordered_map<const Primitive*,unsigned>   m_indices;          /**< The indices of the primitives. */
+    mutable std::atomic<unsigned long long>         m_reused{ 0 };      /**< The number of camera rays whose first hits are found in the records. */
+    mutable std::atomic<unsigned long long>         m_traced{ 0 };      /**< The number of camera rays traced to fill the records. */
+    unsigned                                        m_kept = 0;         /**< The number of lights whose shadow rays are kept from the previous rendering. */
+
+    //! @brief Hash the scene, the camera and the settings of the records.
+    unsigned long long _signature( const Scene& scene , const Camera* camera , int width , int height , unsigned pattern , bool shadows ) const;
+
+    //! @brief Give a slot to every delta light of the scene, the slots of the lights no longer in it are cleared and given to new ones.
+    void _assignSlots( const Scene& scene );
+};
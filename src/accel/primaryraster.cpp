@@ -0,0 +1,307 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "primaryraster.h"
+#include "geometry/scene.h"
+#include "geometry/primitive.h"
+#include "geometry/triangle.h"
+#include "geometry/intersection.h"
+#include "camera/camera.h"
+#include "utility/multithread/threadpool.h"
+#include "log/log.h"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+static const int    PRIMARY_BIN_SIZE = 16;          // the size of a bin in pixels
+static const float  PRIMARY_BOUND_EPSILON = 0.01f;  // the projected bounds are grown by this many pixels against rounding errors
+
+// build the bins
+bool PrimaryRaster::Build( const Scene& scene , const Camera* camera , int width , int height )
+{
+    Release();
+
+    // the rays of a pixel sample are linear in its raster position , they are 'dir + dx * x + dy * y'
+    Point eye;
+    Vector corners[4];
+    if( width <= 0 || height <= 0 || scene.HasMotion() || !camera->GetFrustum( 0 , 0 , 1 , 1 , eye , corners ) )
+        return false;
+    const Vector dir = corners[0];
+    const Vector dx = corners[1] - corners[0];
+    const Vector dy = corners[3] - corners[0];
+
+    // the raster position of a point is found by the inverse of the matrix with the columns 'dir' , 'dx' and 'dy'
+    const Vector row0 = Cross( dx , dy );
+    const Vector row1 = Cross( dy , dir );
+    const Vector row2 = Cross( dir , dx );
+    const float det = Dot( dir , row0 );
+    if( det == 0.0f )
+        return false;
+    const float inv_det = 1.0f / det;
+
+    m_width = width;
+    m_height = height;
+    m_binX = ( width + PRIMARY_BIN_SIZE - 1 ) / PRIMARY_BIN_SIZE;
+    m_binY = ( height + PRIMARY_BIN_SIZE - 1 ) / PRIMARY_BIN_SIZE;
+
+    // project the primitives , the bounding boxes of the ones other than triangles are projected instead
+    const std::vector<Primitive*>& primitives = scene.GetPrimitives();
+    const unsigned count = (unsigned)primitives.size();
+    const unsigned grain = 1024;
+    m_prims.resize( count );
+    ParallelFor( 0 , count , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        for( unsigned i = chunk_start ; i < chunk_end ; ++i ){
+            Raster_Primitive& rp = m_prims[i];
+            rp.primitive = primitives[i];
+
+            // primitives hidden from the camera never cover any pixel
+            if( rp.primitive->IsHiddenFrom( RAY_CAMERA ) )
+                continue;
+
+            Point points[8];
+            unsigned point_cnt = 0;
+            BBox box;
+            // triangles cut out by their materials are tested with their own routine like other primitives
+            rp.triangle = !rp.primitive->IsCutout() && rp.primitive->GetTriangleVertices( rp.p0 , rp.p1 , rp.p2 );
+            if( rp.triangle ){
+                points[0] = rp.p0;
+                points[1] = rp.p1;
+                points[2] = rp.p2;
+                point_cnt = 3;
+                box = BBox( rp.p0 , rp.p0 );
+                box.Union( rp.p1 );
+                box.Union( rp.p2 );
+            }else{
+                box = rp.primitive->GetBBox();
+                for( unsigned k = 0 ; k < 8 ; ++k )
+                    points[k] = Point( ( k & 1 ) ? box.m_Max.x : box.m_Min.x , ( k & 2 ) ? box.m_Max.y : box.m_Min.y , ( k & 4 ) ? box.m_Max.z : box.m_Min.z );
+                point_cnt = 8;
+            }
+
+            // the distance to the bounding box bounds the distance of any hit
+            float sqr = 0.0f;
+            for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+                const float d = max( 0.0f , max( box.m_Min[axis] - eye[axis] , eye[axis] - box.m_Max[axis] ) );
+                sqr += d * d;
+            }
+            rp.nearest = sqrt( sqr );
+
+            // primitives crossing the plane of the camera could project anywhere
+            float min_x = FLT_MAX , min_y = FLT_MAX , max_x = -FLT_MAX , max_y = -FLT_MAX;
+            for( unsigned k = 0 ; k < point_cnt && !rp.unbounded ; ++k ){
+                const Vector d = points[k] - eye;
+                const float s = Dot( row0 , d ) * inv_det;
+                if( s <= 0.0f ){
+                    rp.unbounded = true;
+                    break;
+                }
+                const float x = Dot( row1 , d ) * inv_det / s;
+                const float y = Dot( row2 , d ) * inv_det / s;
+                min_x = min( min_x , x );
+                min_y = min( min_y , y );
+                max_x = max( max_x , x );
+                max_y = max( max_y , y );
+            }
+            if( rp.unbounded ){
+                rp.visible = true;
+                rp.x0 = 0;
+                rp.y0 = 0;
+                rp.x1 = width - 1;
+                rp.y1 = height - 1;
+                continue;
+            }
+
+            // the samples of a pixel are inside of its edges , a sample at 'x' belongs to the pixel 'floor(x)'
+            min_x -= PRIMARY_BOUND_EPSILON;
+            min_y -= PRIMARY_BOUND_EPSILON;
+            max_x += PRIMARY_BOUND_EPSILON;
+            max_y += PRIMARY_BOUND_EPSILON;
+            rp.visible = max_x >= 0.0f && max_y >= 0.0f && min_x < (float)width && min_y < (float)height;
+            if( !rp.visible )
+                continue;
+            rp.x0 = (int)floor( max( min_x , 0.0f ) );
+            rp.y0 = (int)floor( max( min_y , 0.0f ) );
+            rp.x1 = min( width - 1 , (int)floor( min( max_x , (float)width ) ) );
+            rp.y1 = min( height - 1 , (int)floor( min( max_y , (float)height ) ) );
+        }
+    });
+
+    // count the primitives in each bin , primitives crossing the plane of the camera are kept apart
+    const unsigned bin_cnt = (unsigned)( m_binX * m_binY );
+    std::unique_ptr< std::atomic<unsigned>[] > counters( new std::atomic<unsigned>[bin_cnt] );
+    for( unsigned b = 0 ; b < bin_cnt ; ++b )
+        counters[b].store( 0 , std::memory_order_relaxed );
+    ParallelFor( 0 , count , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        for( unsigned i = chunk_start ; i < chunk_end ; ++i ){
+            const Raster_Primitive& rp = m_prims[i];
+            if( !rp.visible || rp.unbounded )
+                continue;
+            for( int by = rp.y0 / PRIMARY_BIN_SIZE ; by <= rp.y1 / PRIMARY_BIN_SIZE ; ++by )
+                for( int bx = rp.x0 / PRIMARY_BIN_SIZE ; bx <= rp.x1 / PRIMARY_BIN_SIZE ; ++bx )
+                    counters[ by * m_binX + bx ].fetch_add( 1 , std::memory_order_relaxed );
+        }
+    });
+    m_binStart.resize( bin_cnt + 1 );
+    unsigned offset = 0;
+    for( unsigned b = 0 ; b < bin_cnt ; ++b ){
+        m_binStart[b] = offset;
+        offset += counters[b].load( std::memory_order_relaxed );
+        counters[b].store( m_binStart[b] , std::memory_order_relaxed );
+    }
+    m_binStart[bin_cnt] = offset;
+
+    // scatter the primitives into their bins , the order in a bin doesn't matter as tiles sort their candidates
+    m_binPrims.resize( offset );
+    ParallelFor( 0 , count , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+        for( unsigned i = chunk_start ; i < chunk_end ; ++i ){
+            const Raster_Primitive& rp = m_prims[i];
+            if( !rp.visible || rp.unbounded )
+                continue;
+            for( int by = rp.y0 / PRIMARY_BIN_SIZE ; by <= rp.y1 / PRIMARY_BIN_SIZE ; ++by )
+                for( int bx = rp.x0 / PRIMARY_BIN_SIZE ; bx <= rp.x1 / PRIMARY_BIN_SIZE ; ++bx )
+                    m_binPrims[ counters[ by * m_binX + bx ].fetch_add( 1 , std::memory_order_relaxed ) ] = i;
+        }
+    });
+    for( unsigned i = 0 ; i < count ; ++i )
+        if( m_prims[i].unbounded )
+            m_unbounded.push_back( i );
+
+    m_built = true;
+    return true;
+}
+
+// release the memory of the bins
+void PrimaryRaster::Release()
+{
+    m_built = false;
+    m_prims.clear();
+    m_prims.shrink_to_fit();
+    m_binStart.clear();
+    m_binPrims.clear();
+    m_binPrims.shrink_to_fit();
+    m_unbounded.clear();
+}
+
+// list the candidates of every pixel of a tile
+void PrimaryRaster::BuildTile( const Vector2i& ori , const Vector2i& size , Primary_Tile& tile ) const
+{
+    tile.ori = ori;
+    tile.size = size;
+    const unsigned pixel_cnt = (unsigned)( size.x * size.y );
+    tile.pixelStart.assign( pixel_cnt + 1 , 0 );
+    tile.candidates.clear();
+    if( pixel_cnt == 0 )
+        return;
+
+    // the primitives of the bins under the tile , a primitive in several bins is only kept once
+    std::vector<unsigned> prims( m_unbounded );
+    const int bx0 = ori.x / PRIMARY_BIN_SIZE , bx1 = min( m_binX - 1 , ( ori.x + size.x - 1 ) / PRIMARY_BIN_SIZE );
+    const int by0 = ori.y / PRIMARY_BIN_SIZE , by1 = min( m_binY - 1 , ( ori.y + size.y - 1 ) / PRIMARY_BIN_SIZE );
+    for( int by = by0 ; by <= by1 ; ++by )
+        for( int bx = bx0 ; bx <= bx1 ; ++bx ){
+            const unsigned b = by * m_binX + bx;
+            prims.insert( prims.end() , m_binPrims.begin() + m_binStart[b] , m_binPrims.begin() + m_binStart[b+1] );
+        }
+    std::sort( prims.begin() , prims.end() );
+    prims.erase( std::unique( prims.begin() , prims.end() ) , prims.end() );
+
+    // rasterize the bounds of the primitives into the lists of the pixels
+    const int x_end = ori.x + size.x - 1 , y_end = ori.y + size.y - 1;
+    for( unsigned pass = 0 ; pass < 2 ; ++pass ){
+        for( const unsigned i : prims ){
+            const Raster_Primitive& rp = m_prims[i];
+            for( int y = max( rp.y0 , ori.y ) ; y <= min( rp.y1 , y_end ) ; ++y )
+                for( int x = max( rp.x0 , ori.x ) ; x <= min( rp.x1 , x_end ) ; ++x ){
+                    const unsigned pixel = ( y - ori.y ) * size.x + x - ori.x;
+                    if( pass == 0 )
+                        ++tile.pixelStart[pixel + 1];
+                    else
+                        tile.candidates[ tile.pixelStart[pixel]++ ] = i;
+                }
+        }
+
+        // the counts become the first candidates , the filling pass moves them to the ends , which are the starts of the next pixels
+        if( pass == 0 ){
+            for( unsigned p = 0 ; p < pixel_cnt ; ++p )
+                tile.pixelStart[p + 1] += tile.pixelStart[p];
+            tile.candidates.resize( tile.pixelStart[pixel_cnt] );
+        }else{
+            for( unsigned p = pixel_cnt ; p > 0 ; --p )
+                tile.pixelStart[p] = tile.pixelStart[p - 1];
+            tile.pixelStart[0] = 0;
+        }
+    }
+
+    // the closer candidates are tested first
+    for( unsigned p = 0 ; p < pixel_cnt ; ++p )
+        std::sort( tile.candidates.begin() + tile.pixelStart[p] , tile.candidates.begin() + tile.pixelStart[p + 1] , [this]( unsigned a , unsigned b ){
+            return m_prims[a].nearest < m_prims[b].nearest || ( m_prims[a].nearest == m_prims[b].nearest && a < b );
+        });
+}
+
+// find the first hits of the camera rays of a pixel
+void PrimaryRaster::Trace( const Primary_Tile& tile , int x , int y , const Ray* rays , Primary_Hit* hits , unsigned count ) const
+{
+    const unsigned pixel = ( y - tile.ori.y ) * tile.size.x + x - tile.ori.x;
+    const unsigned* first = tile.candidates.data() + tile.pixelStart[pixel];
+    const unsigned* last = tile.candidates.data() + tile.pixelStart[pixel + 1];
+    for( unsigned k = 0 ; k < count ; ++k ){
+        const Ray& r = rays[k];
+        const ShearedRay sr( r );
+        const float length = r.m_Dir.Length();
+        Primary_Hit& hit = hits[k];
+        hit = Primary_Hit();
+
+        float closest = r.m_fMax;
+        for( const unsigned* c = first ; c < last ; ++c ){
+            const Raster_Primitive& rp = m_prims[*c];
+
+            // none of the candidates left could be closer
+            if( rp.nearest > closest * length )
+                break;
+
+            if( rp.triangle ){
+                float t , u , v;
+                if( !IntersectTriangle( sr , rp.p0 , rp.p1 , rp.p2 , t , u , v ) || t < r.m_fMin || t > closest )
+                    continue;
+                hit.primitive = rp.primitive;
+                hit.t = closest = t;
+                hit.u = u;
+                hit.v = v;
+                hit.triangle = true;
+            }else{
+                Intersection inter;
+                inter.t = closest;
+                if( !rp.primitive->GetIntersect( r , &inter ) || inter.t > closest )
+                    continue;
+                hit.primitive = rp.primitive;
+                hit.t = closest = inter.t;
+                hit.triangle = false;
+            }
+        }
+    }
+}
+
+// output the numbers of the binning
+void PrimaryRaster::OutputLog() const
+{
+    if( !m_built )
+        return;
+    const unsigned bin_cnt = (unsigned)( m_binX * m_binY );
+    slog( INFO , PERFORMANCE , stringFormat( "Primary raster : %u primitives binned into %u bins of %dx%d pixels , %.1f per bin , %u cross the plane of the camera." ,
+        (unsigned)m_prims.size() , bin_cnt , PRIMARY_BIN_SIZE , PRIMARY_BIN_SIZE , bin_cnt ? (float)m_binPrims.size() / bin_cnt : 0.0f , (unsigned)m_unbounded.size() ) );
+}
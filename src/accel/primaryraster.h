@@ -0,0 +1,119 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "math/point.h"
+#include "math/vector2.h"
+#include <vector>
+
+class Scene;
+class Camera;
+class Primitive;
+class Ray;
+class PrimaryCache;
+
+//! @brief The first hit of a camera ray found by the raster pass.
+struct Primary_Hit
+{
+    const Primitive*    primitive = nullptr;    /**< The primitive hit first, it is null if the ray misses the scene. */
+    float               t = 0.0f;               /**< The distance of the hit. */
+    float               u = 0.0f;               /**< The barycentric coordinate of the hit on a triangle, the weight of its second vertex. */
+    float               v = 0.0f;               /**< The weight of the third vertex. */
+    bool                triangle = false;       /**< Whether the hit is on a world space triangle, the hit record of other primitives is filled by testing them again. */
+    const PrimaryCache* cache = nullptr;        /**< The primary cache keeping the shadow rays of delta lights from the hit, it is null if they are traced. */
+    unsigned*           shadows = nullptr;      /**< The shadow rays from the hit kept by the primary cache. */
+};
+
+//! @brief The primitives a render tile could see, they are listed for each of its pixels.
+struct Primary_Tile
+{
+    Vector2i                ori;            /**< The top left pixel of the tile. */
+    Vector2i                size;           /**< The size of the tile in pixels. */
+    std::vector<unsigned>   pixelStart;     /**< The first candidate of each pixel, the last one is the number of candidates. */
+    std::vector<unsigned>   candidates;     /**< The primitives overlapping each pixel, sorted by their distances to the camera. */
+};
+
+//! @brief Rasterized primary visibility of a pinhole camera.
+/**
+ * The primitives of the scene are projected onto the image and binned into square bins of pixels before
+ * rendering, the projection and the binning run in parallel. A render task gathers the primitives of the bins
+ * under its tile and rasterizes their bounds into a candidate list of each pixel, sorted by the distance from
+ * the camera to their bounding boxes. The camera rays of a pixel are only tested against its candidates, the
+ * closest one found so far stops the test once the next candidate is further away. Triangles are tested with
+ * the same watertight test the accelerators use, so the hits are the same as the ones of traversal.
+ */
+class PrimaryRaster
+{
+public:
+    //! @brief Project and bin the primitives of the scene.
+    //! @param scene    The scene, its acceleration structure is built already.
+    //! @param camera   The camera of the view.
+    //! @param width    The width of the image.
+    //! @param height   The height of the image.
+    //! @return         False if the camera has no frustum or anything in the scene moves, the raster pass is not used then.
+    bool Build( const Scene& scene , const Camera* camera , int width , int height );
+
+    //! Release the memory of the bins.
+    void Release();
+
+    //! Whether the bins are built.
+    bool IsBuilt() const { return m_built; }
+
+    //! @brief List the candidates of every pixel of a tile.
+    //! @param ori      The top left pixel of the tile.
+    //! @param size     The size of the tile in pixels.
+    //! @param tile     The candidate lists of the tile.
+    void BuildTile( const Vector2i& ori , const Vector2i& size , Primary_Tile& tile ) const;
+
+    //! @brief Find the first hits of the camera rays of a pixel.
+    //! @param tile     The candidate lists of the tile holding the pixel.
+    //! @param x        The x coordinate of the pixel.
+    //! @param y        The y coordinate of the pixel.
+    //! @param rays     The camera rays of the pixel.
+    //! @param hits     The first hit of each ray.
+    //! @param count    The number of rays.
+    void Trace( const Primary_Tile& tile , int x , int y , const Ray* rays , Primary_Hit* hits , unsigned count ) const;
+
+    //! Output the numbers of the binning to the log.
+    void OutputLog() const;
+
+private:
+    //! @brief A primitive projected onto the image.
+    struct Raster_Primitive
+    {
+        const Primitive*    primitive = nullptr;    /**< The primitive. */
+        Point               p0 , p1 , p2;           /**< The vertexes of a world space triangle. */
+        bool                triangle = false;       /**< Whether the primitive is a world space triangle. */
+        bool                visible = false;        /**< Whether the primitive could be seen by the camera. */
+        bool                unbounded = false;      /**< Whether the primitive crosses the plane of the camera, it could cover any pixel. */
+        float               nearest = 0.0f;         /**< The distance from the camera to the bounding box of the primitive. */
+        int                 x0 = 0 , y0 = 0;        /**< The first pixel covered by the projected bounding box. */
+        int                 x1 = -1 , y1 = -1;      /**< The last pixel covered by the projected bounding box, it is inclusive. */
+    };
+
+    bool                            m_built = false;    /**< Whether the bins are built. */
+    int                             m_width = 0;        /**< The width of the image. */
+    int                             m_height = 0;       /**< The height of the image. */
+    int                             m_binX = 0;         /**< The number of bins along x. */
+    int                             m_binY = 0;         /**< The number of bins along y. */
+    std::vector<Raster_Primitive>   m_prims;            /**< The projected primitives, in the order of the primitives of the scene. */
+    std::vector<unsigned>           m_binStart;         /**< The first slot of each bin, the last one is the number of slots. */
+    std::vector<unsigned>           m_binPrims;         /**< The primitives of each bin. */
+    std::vector<unsigned>           m_unbounded;        /**< The primitives crossing the plane of the camera, every tile sees them. */
+};
@@ -0,0 +1,290 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "sdtree.h"
+#include "utility/multithread/threadpool.h"
+
+//! The maximum depth of quadtrees.
+static const unsigned SDTREE_MAX_DIRECTIONAL_DEPTH = 20;
+//! The maximum depth of the spatial tree.
+static const unsigned SDTREE_MAX_SPATIAL_DEPTH = 48;
+
+// map a point of the unit square to a direction , the cylindrical mapping preserves area
+static Vector canonicalToDir( float x , float y )
+{
+    const float cos_theta = 2.0f * x - 1.0f;
+    const float sin_theta = sqrt( max( 0.0f , 1.0f - cos_theta * cos_theta ) );
+    const float phi = TWO_PI * y;
+    return Vector( sin_theta * cos( phi ) , sin_theta * sin( phi ) , cos_theta );
+}
+
+// map a direction to a point of the unit square
+static void dirToCanonical( const Vector& dir , float& x , float& y )
+{
+    const float cos_theta = max( -1.0f , min( 1.0f , dir.z ) );
+    float phi = atan2( dir.y , dir.x );
+    if( phi < 0.0f )
+        phi += TWO_PI;
+    x = min( ( cos_theta + 1.0f ) * 0.5f , 0.99999994f );
+    y = min( phi / TWO_PI , 0.99999994f );
+}
+
+// reset the tree
+void SDTree::Build( const BBox& bbox )
+{
+    // the cube keeps the cells of the spatial tree from getting thin
+    float size = 0.0f;
+    for( unsigned axis = 0 ; axis < 3 ; ++axis )
+        size = max( size , bbox.m_Max[axis] - bbox.m_Min[axis] );
+    size = max( size , 1e-4f );
+    m_bbox = BBox( bbox.m_Min , bbox.m_Min + Vector( size , size , size ) );
+    m_invSize = 1.0f / size;
+
+    m_nodes.assign( 1 , Spatial_Node() );
+    m_leaves.assign( 1 , Guide_Leaf() );
+    m_leaves[0].building.nodes.push_back( Quad_Node() );
+    m_leaves[0].sampling.nodes.push_back( Quad_Node() );
+}
+
+// release the memory
+void SDTree::Release()
+{
+    m_nodes.clear();
+    m_nodes.shrink_to_fit();
+    m_leaves.clear();
+    m_leaves.shrink_to_fit();
+}
+
+// find the spatial leaf holding a point
+unsigned SDTree::Lookup( const Point& p ) const
+{
+    float q[3];
+    for( unsigned axis = 0 ; axis < 3 ; ++axis )
+        q[axis] = max( 0.0f , min( 1.0f , ( p[axis] - m_bbox.m_Min[axis] ) * m_invSize ) );
+
+    unsigned node = 0;
+    while( m_nodes[node].child ){
+        const unsigned axis = m_nodes[node].axis;
+        if( q[axis] < 0.5f ){
+            q[axis] *= 2.0f;
+            node = m_nodes[node].child;
+        }else{
+            q[axis] = q[axis] * 2.0f - 1.0f;
+            node = m_nodes[node].child + 1;
+        }
+    }
+    return m_nodes[node].leaf;
+}
+
+// sample a direction
+Vector SDTree::Sample( unsigned leaf , float u , float v , float* pdf ) const
+{
+    const DTree& tree = m_leaves[leaf].sampling;
+    float p = 1.0f;
+    float ox = 0.0f , oy = 0.0f , size = 1.0f;
+    unsigned node = 0;
+    while( tree.total > 0.0f ){
+        const Quad_Node& n = tree.nodes[node];
+        const float s[4] = { n.sum[0].Load() , n.sum[1].Load() , n.sum[2].Load() , n.sum[3].Load() };
+        const float t = s[0] + s[1] + s[2] + s[3];
+        if( t <= 0.0f )
+            break;
+
+        // the horizontal half is picked first , the vertical half in it next
+        const float left = ( s[0] + s[2] ) / t;
+        unsigned x = 0;
+        if( u < left )
+            u /= left;
+        else{
+            u = ( u - left ) / ( 1.0f - left );
+            x = 1;
+        }
+        const float bottom = s[x] / ( s[x] + s[x+2] );
+        unsigned y = 0;
+        if( v < bottom )
+            v /= bottom;
+        else{
+            v = ( v - bottom ) / ( 1.0f - bottom );
+            y = 1;
+        }
+
+        const unsigned c = x + 2 * y;
+        p *= 4.0f * s[c] / t;
+        size *= 0.5f;
+        ox += x * size;
+        oy += y * size;
+        if( n.child[c] == 0 )
+            break;
+        node = n.child[c];
+    }
+
+    if( pdf )
+        *pdf = p / ( 4.0f * PI );
+    return canonicalToDir( ox + min( u , 0.99999994f ) * size , oy + min( v , 0.99999994f ) * size );
+}
+
+// the pdf of sampling a direction
+float SDTree::Pdf( unsigned leaf , const Vector& dir ) const
+{
+    const DTree& tree = m_leaves[leaf].sampling;
+    float x , y;
+    dirToCanonical( dir , x , y );
+
+    float p = 1.0f;
+    unsigned node = 0;
+    while( tree.total > 0.0f ){
+        const Quad_Node& n = tree.nodes[node];
+        const float s[4] = { n.sum[0].Load() , n.sum[1].Load() , n.sum[2].Load() , n.sum[3].Load() };
+        const float t = s[0] + s[1] + s[2] + s[3];
+        if( t <= 0.0f )
+            break;
+
+        const unsigned bx = ( x >= 0.5f ) ? 1 : 0;
+        const unsigned by = ( y >= 0.5f ) ? 1 : 0;
+        const unsigned c = bx + 2 * by;
+        p *= 4.0f * s[c] / t;
+        if( n.child[c] == 0 || p == 0.0f )
+            break;
+        x = x * 2.0f - bx;
+        y = y * 2.0f - by;
+        node = n.child[c];
+    }
+    return p / ( 4.0f * PI );
+}
+
+// record an estimate of incident radiance
+void SDTree::Record( unsigned leaf , const Vector& dir , float value ) const
+{
+    const Guide_Leaf& data = m_leaves[leaf];
+    data.weight.Add( 1.0f );
+    if( !( value > 0.0f ) )
+        return;
+
+    float x , y;
+    dirToCanonical( dir , x , y );
+    unsigned node = 0;
+    while( true ){
+        const Quad_Node& n = data.building.nodes[node];
+        const unsigned bx = ( x >= 0.5f ) ? 1 : 0;
+        const unsigned by = ( y >= 0.5f ) ? 1 : 0;
+        const unsigned c = bx + 2 * by;
+        if( n.child[c] == 0 ){
+            n.sum[c].Add( value );
+            return;
+        }
+        x = x * 2.0f - bx;
+        y = y * 2.0f - by;
+        node = n.child[c];
+    }
+}
+
+// sum the energy of interior nodes
+float SDTree::_sumNode( DTree& tree , unsigned node )
+{
+    float total = 0.0f;
+    for( unsigned c = 0 ; c < 4 ; ++c ){
+        // the child is copied first , the nodes could not be referenced during recursion
+        const unsigned child = tree.nodes[node].child[c];
+        if( child )
+            tree.nodes[node].sum[c] = AtomicFloat( _sumNode( tree , child ) );
+        total += tree.nodes[node].sum[c].Load();
+    }
+    return total;
+}
+
+// build the structure of the quadtree of the next iteration
+void SDTree::_refineNode( const DTree& old , int oldNode , float energy , DTree& tree , unsigned node , unsigned depth , float threshold )
+{
+    for( unsigned c = 0 ; c < 4 ; ++c ){
+        // quadrants finer than the old tree share the energy of the old quadrant evenly
+        float e = energy * 0.25f;
+        int old_child = -1;
+        if( oldNode >= 0 ){
+            e = old.nodes[oldNode].sum[c].Load();
+            if( old.nodes[oldNode].child[c] )
+                old_child = (int)old.nodes[oldNode].child[c];
+        }
+        if( e <= threshold || depth >= SDTREE_MAX_DIRECTIONAL_DEPTH )
+            continue;
+
+        const unsigned child = (unsigned)tree.nodes.size();
+        tree.nodes.push_back( Quad_Node() );
+        tree.nodes[node].child[c] = child;
+        _refineNode( old , old_child , e , tree , child , depth + 1 , threshold );
+    }
+}
+
+// finish an iteration of training
+void SDTree::Refine( float spatialThreshold , float energyThreshold )
+{
+    // split the spatial leaves with many records , both halves are expected to receive half of the records
+    std::vector<unsigned> depths( m_nodes.size() , 0 );
+    for( unsigned i = 0 ; i < m_nodes.size() ; ++i ){
+        if( m_nodes[i].child )
+            continue;
+        const unsigned leaf = m_nodes[i].leaf;
+        const float weight = m_leaves[leaf].weight.Load();
+        if( weight <= spatialThreshold || depths[i] >= SDTREE_MAX_SPATIAL_DEPTH )
+            continue;
+
+        const unsigned child = (unsigned)m_nodes.size();
+        Spatial_Node left , right;
+        left.axis = right.axis = ( m_nodes[i].axis + 1 ) % 3;
+        left.leaf = leaf;
+        right.leaf = (unsigned)m_leaves.size();
+        m_leaves[leaf].weight = AtomicFloat( weight * 0.5f );
+        const Guide_Leaf copy = m_leaves[leaf];
+        m_leaves.push_back( copy );
+        m_nodes[i].child = child;
+        m_nodes.push_back( left );
+        m_nodes.push_back( right );
+        depths.push_back( depths[i] + 1 );
+        depths.push_back( depths[i] + 1 );
+    }
+
+    // rebuild the quadtrees , leaves are independent
+    ParallelFor( 0 , (unsigned)m_leaves.size() , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+        for( unsigned i = _start ; i < _end ; ++i ){
+            Guide_Leaf& leaf = m_leaves[i];
+            leaf.building.total = _sumNode( leaf.building , 0 );
+            leaf.sampling = leaf.building;
+
+            // the new quadtree starts empty , its quadrants hold similar fractions of the energy learnt so far
+            DTree tree;
+            tree.nodes.push_back( Quad_Node() );
+            if( leaf.sampling.total > 0.0f )
+                _refineNode( leaf.sampling , 0 , leaf.sampling.total , tree , 0 , 1 , energyThreshold * leaf.sampling.total );
+            else
+                tree = leaf.building;
+            for( auto& n : tree.nodes )
+                for( unsigned c = 0 ; c < 4 ; ++c )
+                    n.sum[c] = AtomicFloat( 0.0f );
+            tree.total = 0.0f;
+            leaf.building = tree;
+            leaf.weight = AtomicFloat( 0.0f );
+        }
+    });
+}
+
+// the number of quadtree nodes used for sampling
+unsigned SDTree::GetDirectionalNodeCount() const
+{
+    size_t count = 0;
+    for( const auto& leaf : m_leaves )
+        count += leaf.sampling.nodes.size();
+    return (unsigned)count;
+}
@@ -0,0 +1,164 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "math/point.h"
+#include "math/vector3.h"
+#include "geometry/bbox.h"
+#include <vector>
+#include <atomic>
+
+//! @brief Float that many threads add to without locking.
+class AtomicFloat
+{
+public:
+    //! @brief Constructor from a value.
+    AtomicFloat( float value = 0.0f ) : m_value( value ) {}
+
+    //! @brief Copy constructor, the containers holding atomic floats are only copied while no thread writes.
+    AtomicFloat( const AtomicFloat& other ) : m_value( other.Load() ) {}
+
+    //! @brief Assignment, the same restriction as the copy constructor applies.
+    AtomicFloat& operator = ( const AtomicFloat& other ) { m_value.store( other.Load() , std::memory_order_relaxed ); return *this; }
+
+    //! The current value.
+    float Load() const { return m_value.load( std::memory_order_relaxed ); }
+
+    //! @brief Add a value atomically, it does not change the logical state of the containing structure.
+    void Add( float value ) const {
+        float old = m_value.load( std::memory_order_relaxed );
+        while( !m_value.compare_exchange_weak( old , old + value , std::memory_order_relaxed ) );
+    }
+
+private:
+    mutable std::atomic<float>  m_value;    /**< The value. */
+};
+
+//! @brief Spatial-directional tree learning the distribution of incident radiance for path guiding.
+/**
+ * The space is subdivided by a binary tree splitting its cells in the middle along cycled axes, each leaf of the
+ * spatial tree holds a quadtree over the cylindrical mapping of directions. Radiance arriving at vertices of
+ * paths is recorded into the quadtrees of one iteration with atomic additions, so all threads train the same
+ * tree without locking. Between iterations, the spatial leaves that received many records are split and each
+ * quadtree is rebuilt so that its leaves hold similar energy, the distribution learnt in one iteration is used
+ * for sampling in the next one. Please refer to the paper
+ * <a href="https://tom94.net/data/publications/mueller17practical/mueller17practical.pdf">
+ * Practical Path Guiding for Efficient Light-Transport Simulation</a> for further details.
+ */
+class SDTree
+{
+public:
+    //! @brief Reset the tree to one spatial leaf with the uniform distribution.
+    //! @param bbox     The bounding box of the scene.
+    void Build( const BBox& bbox );
+
+    //! Release the memory of the tree.
+    void Release();
+
+    //! @brief Find the spatial leaf holding a point.
+    //! @param p        The point.
+    //! @return         The index of the leaf.
+    unsigned Lookup( const Point& p ) const;
+
+    //! @brief Whether the distribution of a leaf is learnt already.
+    //! @param leaf     The index of the leaf.
+    bool IsTrained( unsigned leaf ) const { return m_leaves[leaf].sampling.total > 0.0f; }
+
+    //! @brief Sample a direction from the learnt distribution of a leaf.
+    //! @param leaf     The index of the leaf.
+    //! @param u , v    Canonical random variables.
+    //! @param pdf      The pdf of the direction w.r.t. solid angle.
+    //! @return         The sampled direction in world space.
+    Vector Sample( unsigned leaf , float u , float v , float* pdf ) const;
+
+    //! @brief The pdf of sampling a direction from the learnt distribution of a leaf.
+    //! @param leaf     The index of the leaf.
+    //! @param dir      The direction in world space.
+    //! @return         The pdf w.r.t. solid angle.
+    float Pdf( unsigned leaf , const Vector& dir ) const;
+
+    //! @brief Record an estimate of incident radiance, it is safe to call from any thread.
+    //! @param leaf     The index of the leaf.
+    //! @param dir      The direction the radiance arrives from.
+    //! @param value    The estimate of the radiance divided by the pdf of the direction.
+    void Record( unsigned leaf , const Vector& dir , float value ) const;
+
+    //! @brief Finish an iteration of training, it can only be called while no thread records.
+    //! @param spatialThreshold The number of records a spatial leaf needs to be split.
+    //! @param energyThreshold  The fraction of energy a quadrant needs to be subdivided.
+    void Refine( float spatialThreshold , float energyThreshold = 0.01f );
+
+    //! The number of spatial leaves.
+    unsigned GetLeafCount() const { return (unsigned)m_leaves.size(); }
+
+    //! The number of quadtree nodes used for sampling in all leaves.
+    unsigned GetDirectionalNodeCount() const;
+
+private:
+    //! @brief Node of the spatial tree.
+    struct Spatial_Node
+    {
+        unsigned    axis = 0;       /**< The axis the node is split along. */
+        unsigned    child = 0;      /**< The first child, the second one follows it, it is 0 for a leaf. */
+        unsigned    leaf = 0;       /**< The index of the leaf data. */
+    };
+
+    //! @brief Node of a quadtree, quadrant 'x + 2 * y' covers the half 'x' horizontally and the half 'y' vertically.
+    struct Quad_Node
+    {
+        AtomicFloat sum[4];                 /**< The energy of each quadrant. */
+        unsigned    child[4] = { 0 , 0 , 0 , 0 };   /**< The node subdividing each quadrant, it is 0 for a leaf quadrant. */
+    };
+
+    //! @brief Quadtree over directions.
+    struct DTree
+    {
+        std::vector<Quad_Node>  nodes;              /**< The nodes, the first one is the root. */
+        float                   total = 0.0f;       /**< The total energy of the tree. */
+    };
+
+    //! @brief Data of a spatial leaf.
+    struct Guide_Leaf
+    {
+        DTree       sampling;       /**< The distribution learnt in the last iteration. */
+        DTree       building;       /**< The distribution of the current iteration. */
+        AtomicFloat weight;         /**< The number of records of the current iteration. */
+    };
+
+    BBox                        m_bbox;                 /**< The cube bounding the space. */
+    float                       m_invSize = 0.0f;       /**< The reciprocal of the size of the cube. */
+    std::vector<Spatial_Node>   m_nodes;                /**< The nodes of the spatial tree, the first one is the root. */
+    std::vector<Guide_Leaf>     m_leaves;               /**< The data of spatial leaves. */
+
+    //! @brief Sum the energy of the quadrants of interior nodes from their children.
+    //! @param tree     The quadtree.
+    //! @param node     The node to be summed.
+    //! @return         The total energy of the node.
+    static float _sumNode( DTree& tree , unsigned node );
+
+    //! @brief Build the structure of the quadtree of the next iteration.
+    //! @param old          The quadtree of the finished iteration.
+    //! @param oldNode      The node of the old tree covering the node, it is -1 if the old tree is coarser.
+    //! @param energy       The energy of the node, it is only used if the old tree is coarser.
+    //! @param tree         The quadtree to be built.
+    //! @param node         The node to be built.
+    //! @param depth        The depth of the node.
+    //! @param threshold    The energy a quadrant needs to be subdivided.
+    static void _refineNode( const DTree& old , int oldNode , float energy , DTree& tree , unsigned node , unsigned depth , float threshold );
+};
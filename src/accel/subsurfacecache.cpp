@@ -0,0 +1,134 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "subsurfacecache.h"
+#include "material/subsurface.h"
+
+// the largest number of points in a leaf
+static constexpr unsigned SUBSURFACE_LEAF_POINTS = 8;
+// the deepest level of the octree , points in one place are kept in one leaf
+static constexpr unsigned SUBSURFACE_MAX_DEPTH = 24;
+
+void SubsurfaceCache::Build( std::vector<Subsurface_Point>&& points )
+{
+    m_points = std::move( points );
+    m_nodes.clear();
+    m_nodes.push_back( Cache_Node() );
+    if( !m_points.empty() )
+        _build( 0 , 0 , (unsigned)m_points.size() , 0 );
+}
+
+void SubsurfaceCache::_build( unsigned node , unsigned start , unsigned end , unsigned depth )
+{
+    // the centroid is weighted by the irradiance , nodes in the dark fall back to the area
+    BBox bbox( m_points[start].p , m_points[start].p );
+    Spectrum power;
+    float area = 0.0f , weight = 0.0f , area_weight = 0.0f;
+    Vector centroid , area_centroid;
+    for( unsigned i = start ; i < end ; ++i ){
+        const Subsurface_Point& point = m_points[i];
+        const Vector p( point.p.x , point.p.y , point.p.z );
+        const float w = point.e.GetIntensity() * point.area;
+        bbox.Union( point.p );
+        power += point.e * point.area;
+        area += point.area;
+        centroid += p * w;
+        weight += w;
+        area_centroid += p * point.area;
+        area_weight += point.area;
+    }
+    if( weight > 0.0f )
+        centroid /= weight;
+    else
+        centroid = area_weight > 0.0f ? area_centroid / area_weight : Vector( m_points[start].p.x , m_points[start].p.y , m_points[start].p.z );
+
+    Cache_Node& n = m_nodes[node];
+    n.bbox = bbox;
+    n.centroid = Point( centroid.x , centroid.y , centroid.z );
+    n.power = power;
+    n.area = area;
+    n.first = start;
+    n.count = end - start;
+    n.leaf = true;
+    if( end - start <= SUBSURFACE_LEAF_POINTS || depth >= SUBSURFACE_MAX_DEPTH )
+        return;
+
+    // the points are sorted into the octants around the center of their bounding box
+    const Point center = ( bbox.m_Min + bbox.m_Max ) * 0.5f;
+    auto octant = [&]( const Point& p ){
+        return ( p.x > center.x ? 1u : 0u ) | ( p.y > center.y ? 2u : 0u ) | ( p.z > center.z ? 4u : 0u );
+    };
+    unsigned offset[9] = { 0 };
+    for( unsigned i = start ; i < end ; ++i )
+        ++offset[octant( m_points[i].p ) + 1];
+    for( unsigned i = 1 ; i < 9 ; ++i )
+        offset[i] += offset[i-1];
+    std::vector<Subsurface_Point> sorted( end - start );
+    unsigned cursor[8];
+    for( unsigned i = 0 ; i < 8 ; ++i )
+        cursor[i] = offset[i];
+    for( unsigned i = start ; i < end ; ++i )
+        sorted[cursor[octant( m_points[i].p )]++] = m_points[i];
+    std::copy( sorted.begin() , sorted.end() , m_points.begin() + start );
+
+    // the children of the node are allocated together , only the octants with points get one
+    unsigned children = 0;
+    for( unsigned i = 0 ; i < 8 ; ++i )
+        children += ( offset[i+1] > offset[i] ) ? 1 : 0;
+    const unsigned first = (unsigned)m_nodes.size();
+    m_nodes.resize( first + children );
+    m_nodes[node].first = first;
+    m_nodes[node].count = children;
+    m_nodes[node].leaf = false;
+
+    unsigned child = first;
+    for( unsigned i = 0 ; i < 8 ; ++i )
+        if( offset[i+1] > offset[i] )
+            _build( child++ , start + offset[i] , start + offset[i+1] , depth + 1 );
+}
+
+Spectrum SubsurfaceCache::Exitance( const Point& p , const SubsurfaceProfile& profile , float error ) const
+{
+    Spectrum mo;
+    if( m_points.empty() )
+        return mo;
+
+    unsigned stack[8 * SUBSURFACE_MAX_DEPTH + 8];
+    unsigned top = 0;
+    stack[top++] = 0;
+    while( top > 0 ){
+        const Cache_Node& node = m_nodes[stack[--top]];
+        if( node.leaf ){
+            for( unsigned i = node.first ; i < node.first + node.count ; ++i ){
+                const Subsurface_Point& point = m_points[i];
+                mo += profile.Rd( ( point.p - p ).SquaredLength() ) * point.e * point.area;
+            }
+            continue;
+        }
+
+        for( unsigned i = node.first ; i < node.first + node.count ; ++i ){
+            const Cache_Node& child = m_nodes[i];
+            const float sqr_distance = ( child.centroid - p ).SquaredLength();
+            if( !child.bbox.IsInBBox( p , 0.0f ) && child.area < error * sqr_distance )
+                mo += profile.Rd( sqr_distance ) * child.power;
+            else
+                stack[top++] = i;
+        }
+    }
+    return mo;
+}
@@ -0,0 +1,90 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "sort.h"
+#include "math/point.h"
+#include "math/vector3.h"
+#include "geometry/bbox.h"
+#include "spectrum/spectrum.h"
+#include <vector>
+
+class SubsurfaceProfile;
+
+//! @brief Irradiance arriving at a point on the surface of a translucent material.
+struct Subsurface_Point
+{
+    Point       p;              /**< The position of the point. */
+    Vector      n;              /**< The normal at the point. */
+    float       area = 0.0f;    /**< The area of the surface the point stands for. */
+    Spectrum    e;              /**< The irradiance entering the surface at the point. */
+};
+
+//! @brief Octree of irradiance points on the surface of a translucent material.
+/**
+ * The exitance at a point of the surface is the diffuse reflectance of the dipole integrated over the irradiance
+ * of all points, as proposed in "A Rapid Hierarchical Rendering Technique for Translucent Materials" by Jensen and
+ * Buhler. Every node keeps the area of its points, the sum of their irradiance weighted by their area and the
+ * centroid of the irradiance, a node far enough from the shaded point is treated as one point at its centroid.
+ * A node is far enough if the solid angle of its area seen from the shaded point is below the error and the point
+ * is outside of its bounding box. The octree is built once and read only, nodes are flattened in one array.
+ */
+class SubsurfaceCache
+{
+public:
+    //! @brief Build the octree over the points.
+    //! @param points   The points, the octree takes them over and reorders them.
+    void Build( std::vector<Subsurface_Point>&& points );
+
+    //! @brief Evaluate the exitance of the surface at a point, it is safe to call from any thread.
+    //! @param p        The point on the surface.
+    //! @param profile  The diffusion profile of the material.
+    //! @param error    The largest solid angle of a node treated as one point.
+    //! @return         The sum of the diffuse reflectance weighted by the irradiance and the area of the points.
+    Spectrum Exitance( const Point& p , const SubsurfaceProfile& profile , float error ) const;
+
+    //! The number of points in the octree.
+    unsigned GetPointCount() const { return (unsigned)m_points.size(); }
+
+    //! The number of nodes in the octree.
+    unsigned GetNodeCount() const { return (unsigned)m_nodes.size(); }
+
+private:
+    //! @brief Node of the octree.
+    struct Cache_Node
+    {
+        BBox        bbox;           /**< The bounding box of the points in the node. */
+        Point       centroid;       /**< The centroid of the points weighted by their irradiance. */
+        Spectrum    power;          /**< The sum of the irradiance of the points weighted by their area. */
+        float       area = 0.0f;    /**< The area of the points. */
+        unsigned    first = 0;      /**< The first child of an interior node, or the first point of a leaf. */
+        unsigned    count = 0;      /**< The number of children of an interior node, or the number of points of a leaf. */
+        bool        leaf = true;    /**< Whether the node is a leaf. */
+    };
+
+    std::vector<Subsurface_Point>   m_points;   /**< The points, the ones in a leaf are next to each other. */
+    std::vector<Cache_Node>         m_nodes;    /**< The nodes, the children of a node are next to each other. */
+
+    //! @brief Fill the aggregates of a node and split it.
+    //! @param node     The index of the node.
+    //! @param start    The first point in the node.
+    //! @param end      The point after the last one in the node.
+    //! @param depth    The depth of the node.
+    void _build( unsigned node , unsigned start , unsigned end , unsigned depth );
+};
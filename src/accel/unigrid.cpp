@@ -19,20 +19,104 @@
 #include "geometry/primitive.h"
 #include "geometry/intersection.h"
 #include "log/log.h"
-#include "utility/sassert.h"
+#include "accelstats.h"
+#include "utility/statsreport.h"
+#include "utility/multithread/threadpool.h"
+#include <functional>
+
+static const float      UNIGRID_DENSITY             = 3.0f;     // number of voxels along the longest axis relative to the cube root of the number of primitives
+static const float      UNIGRID_TWO_LEVEL_DENSITY   = 1.0f;     // the same density for the coarser top level grid of two-level grids
+static const float      UNIGRID_CELL_DENSITY        = 2.0f;     // number of cells per primitive inside a subdivided voxel
+static const unsigned   UNIGRID_MAX_RES             = 256;      // maximum number of voxels along each axis
+static const unsigned   UNIGRID_MAX_CELL_RES        = 16;       // maximum number of cells along each axis inside a voxel
+static const unsigned   UNIGRID_SUBDIVIDE_THRESHOLD = 8;        // voxels with more primitives are subdivided in two-level grids
+static const unsigned   UNIGRID_PARALLEL_THRESHOLD  = 65536;    // fewer primitives are processed on the current thread only
+static const unsigned   UNIGRID_MAX_CHUNK           = 32;       // maximum number of chunks a parallel loop is split into
 
 IMPLEMENT_CREATOR( UniGrid );
 
-// destructor
-UniGrid::~UniGrid()
+// reference from a voxel or a cell to a primitive overlapping it
+struct UniGrid_Reference
 {
-	release();
+	unsigned	cell;
+	unsigned	pri;
+};
+
+// run the function on a fixed number of consecutive chunks of the range, the chunks are processed in the thread pool
+static void runChunks( unsigned chunk_cnt , unsigned count , const std::function<void(unsigned,unsigned,unsigned)>& func )
+{
+	ParallelFor( 0 , chunk_cnt , 1 , [&]( unsigned , unsigned first , unsigned last ){
+		for( unsigned i = first ; i < last ; ++i )
+			func( i , (unsigned)( (unsigned long long)count * i / chunk_cnt ) , (unsigned)( (unsigned long long)count * ( i + 1 ) / chunk_cnt ) );
+	});
+}
+
+// sort references by cells, it is stable so that primitives in a cell keep the order of the references
+static void countingSort( const std::vector<UniGrid_Reference>* refs , unsigned ref_cnt , unsigned cell_cnt , std::vector<unsigned>& offsets , std::vector<unsigned>& pris )
+{
+	offsets.assign( cell_cnt + 1 , 0 );
+	for( unsigned i = 0 ; i < ref_cnt ; ++i )
+		for( const auto& ref : refs[i] )
+			++offsets[ref.cell + 1];
+	for( unsigned i = 0 ; i < cell_cnt ; ++i )
+		offsets[i + 1] += offsets[i];
+
+	pris.resize( offsets[cell_cnt] );
+	std::vector<unsigned> cursor( offsets.begin() , offsets.end() - 1 );
+	for( unsigned i = 0 ; i < ref_cnt ; ++i )
+		for( const auto& ref : refs[i] )
+			pris[cursor[ref.cell]++] = ref.pri;
+}
+
+// walk through the cells of a grid along the ray from near to far, it stops once the function returns true
+template< class Func >
+static bool walkGrid( const Ray& r , const Point& origin , const Vector& extent , const Vector& inv_extent , const unsigned res[3] , float tmin , float tmax , const Func& visit )
+{
+	int		cell[3] , step[3];
+	float	next[3] , delta[3];
+	const Point start = r( tmin );
+	for( int i = 0 ; i < 3 ; i++ )
+	{
+		cell[i] = (int)min( res[i] - 1 , (unsigned)max( 0.0f , ( start[i] - origin[i] ) * inv_extent[i] ) );
+		if( r.m_Dir[i] > 0.0f ){
+			step[i] = 1;
+			next[i] = ( origin[i] + ( cell[i] + 1 ) * extent[i] - r.m_Ori[i] ) / r.m_Dir[i];
+			delta[i] = extent[i] / r.m_Dir[i];
+		}else if( r.m_Dir[i] < 0.0f ){
+			step[i] = -1;
+			next[i] = ( origin[i] + cell[i] * extent[i] - r.m_Ori[i] ) / r.m_Dir[i];
+			delta[i] = -extent[i] / r.m_Dir[i];
+		}else{
+			step[i] = 0;
+			next[i] = FLT_MAX;
+			delta[i] = FLT_MAX;
+		}
+	}
+
+	float t = tmin;
+	while( true )
+	{
+		// the ray leaves the current cell through the nearest plane
+		const int axis = ( next[0] < next[1] ) ? ( ( next[0] < next[2] ) ? 0 : 2 ) : ( ( next[1] < next[2] ) ? 1 : 2 );
+		if( visit( cell , t , min( next[axis] , tmax ) ) )
+			return true;
+		if( next[axis] >= tmax )
+			return false;
+
+		cell[axis] += step[axis];
+		if( cell[axis] < 0 || cell[axis] >= (int)res[axis] )
+			return false;
+		t = next[axis];
+		next[axis] += delta[axis];
+	}
 }
 
 // release the data
 void UniGrid::release()
 {
-	SAFE_DELETE_ARRAY( m_pVoxels );
+	m_voxels.clear();
+	m_cellOffsets.clear();
+	m_cellPri.clear();
 	for( int i = 0 ; i < 3 ; i++ )
 	{
 		m_voxelNum[i] = 0;
@@ -45,70 +129,76 @@ void UniGrid::release()
 // get the intersection between the ray and the primitive set
 bool UniGrid::GetIntersect( const Ray& r , Intersection* intersect ) const
 {
-	if( m_pVoxels == 0 || m_primitives == 0 )
+	return traverse( r , intersect );
+}
+
+// check whether the ray is blocked by any primitive
+bool UniGrid::IsOccluded( const Ray& r ) const
+{
+	return traverse( r , nullptr );
+}
+
+// traverse the grid
+bool UniGrid::traverse( const Ray& r , Intersection* intersect ) const
+{
+	if( m_voxels.empty() || m_primitives == 0 )
 		return false;
 
-	// get the intersect point
-	float maxt;
-	float cur_t = Intersect( r , m_bbox , &maxt );
-	if( cur_t < 0.0f )
+	float tmax;
+	const float tmin = Intersect( r , m_bbox , &tmax );
+	if( tmin < 0.0f )
 		return false;
-	if( intersect )
-		intersect->t = min( intersect->t , maxt );
 
-	int 	curGrid[3] , dir[3];
-	float	delta[3] , next[3];
-	for( int i = 0 ; i < 3 ; i++ )
-	{
-		curGrid[i] = point2VoxelId( r(cur_t) , i );
-		dir[i] = ( r.m_Dir[i] > 0.0f ) ? 1 : -1;
-		if( r.m_Dir[i] != 0.0f )
-			delta[i] = fabs( m_voxelExtent[i] / r.m_Dir[i] );
-		else
-			delta[i] = FLT_MAX;
-	}
-	Point gridCorner = voxelId2Point( curGrid );
-	for( int i = 0 ; i < 3 ; i++ )
-	{
-		// get the next t
-		float target = gridCorner[i] + ((dir[i]+1)>>1) * m_voxelExtent[i];
-		next[i] = ( target - r.m_Ori[i] ) / r.m_Dir[i];
-		if( r.m_Dir[i] == 0.0f )
-			next[i] = FLT_MAX;
-	}
+	SORT_STATS( AccelStats& stats = AccelStats::Local() );
+	bool inter = false;
+	const unsigned type = RayType( r , intersect == nullptr );
 
-	// traverse the uniform grid
-	const unsigned array[] = { 0 , 0 , 1 , 0 , 2 , 2 , 1 , 0  };// [0] and [7] is impossible
-	while( ( intersect && cur_t < intersect->t ) || ( intersect == 0 ) )
-	{
-		// current voxel id
-		unsigned voxelId = offset( curGrid[0] , curGrid[1] , curGrid[2] );
+	// test the primitives in a cell, the traversal stops once it returns true
+	auto visitCell = [&]( unsigned cell , float t_exit ) -> bool {
+		SORT_STATS( ++stats.nodes );
+		for( unsigned i = m_cellOffsets[cell] ; i < m_cellOffsets[cell + 1] ; ++i ){
+			SORT_STATS( ++stats.primitives );
+			const Primitive* primitive = (*m_primitives)[m_cellPri[i]];
+			if( !primitive->IsHiddenFrom( type ) && primitive->GetIntersect( r , intersect ) ){
+				if( intersect == 0 ){
+					SORT_STATS( ++stats.earlyOuts );
+					return true;
+				}
+				inter = true;
+			}
+		}
 
-		// get the next t
-		unsigned nextAxis = (next[0] <= next[1])+((unsigned)(next[1] <= next[2]))*2+((unsigned)(next[2] <= next[0]))*4;
-		nextAxis = array[nextAxis];
+		// a primitive could overlap cells further along the ray, its intersection is the nearest one only if it is inside the cell
+		return inter && intersect->t <= t_exit;
+	};
 
-		// chech if there is intersection in the current grid
-		if( getIntersect( r , intersect , voxelId , next[nextAxis] ) )
-			return true;
+	const bool stopped = walkGrid( r , m_bbox.m_Min , m_voxelExtent , m_voxelInvExtent , m_voxelNum , tmin , tmax , [&]( const int* coord , float t_enter , float t_exit ) -> bool {
+		const UniGrid_Voxel& voxel = m_voxels[offset( coord[0] , coord[1] , coord[2] )];
+		if( voxel.res[0] == 1 && voxel.res[1] == 1 && voxel.res[2] == 1 )
+			return visitCell( voxel.cell , t_exit );
 
-		// get to the next voxel
-		curGrid[nextAxis] += dir[nextAxis];
-
-		if( curGrid[nextAxis] < 0 || (unsigned)curGrid[nextAxis] >= m_voxelNum[nextAxis] )
-			return ( intersect && intersect->t < maxt && ( intersect->primitive != 0 ));
+		// walk through the cells of the subdivided voxel
+		const unsigned res[3] = { voxel.res[0] , voxel.res[1] , voxel.res[2] };
+		Point origin;
+		Vector extent , inv_extent;
+		for( int i = 0 ; i < 3 ; i++ ){
+			origin[i] = m_bbox.m_Min[i] + coord[i] * m_voxelExtent[i];
+			extent[i] = m_voxelExtent[i] / res[i];
+			inv_extent[i] = m_voxelInvExtent[i] * res[i];
+		}
+		return walkGrid( r , origin , extent , inv_extent , res , t_enter , t_exit , [&]( const int* cell , float , float cell_exit ) -> bool {
+			return visitCell( voxel.cell + ( cell[2] * res[1] + cell[1] ) * res[0] + cell[0] , cell_exit );
+		});
+	});
 
-		// update next
-		cur_t = next[nextAxis];
-		next[nextAxis] += delta[nextAxis];
-	}
-	
-	return ( intersect && intersect->t < maxt && ( intersect->primitive != 0 ));
+	return intersect ? inter : stopped;
 }
 
 // build the acceleration structure
 void UniGrid::Build()
 {
+	release();
+
 	if( nullptr == m_primitives || m_primitives->empty() ){
         slog( WARNING , SPATIAL_ACCELERATOR , "There is no primitive in uniform grid." );
 		return;
@@ -123,57 +213,176 @@ void UniGrid::Build()
 	float extent = delta[id];
 
 	// get the total number of primitives
-	unsigned count = (unsigned)m_primitives->size();
+	const unsigned count = (unsigned)m_primitives->size();
 	
-	// grid per distance
-	float gridPerDistance = 3 * powf( (float)count , 0.333f ) / extent ;
+	// grid per distance, the top level of two-level grids is coarser since dense voxels are subdivided
+	float gridPerDistance = ( m_twoLevel ? UNIGRID_TWO_LEVEL_DENSITY : UNIGRID_DENSITY ) * powf( (float)count , 0.333f ) / extent ;
 
-	// the grid size
+	// the grid size, there is at least one voxel along axes without any extent
 	for( int i = 0 ; i < 3 ; i++ )
 	{
-		m_voxelNum[i] = (unsigned)(min( 256.0f , gridPerDistance * delta[i] ));
-		m_voxelInvExtent[i] = m_voxelNum[i] / delta[i];
-		m_voxelExtent[i] = 1.0f / m_voxelInvExtent[i];
+		m_voxelNum[i] = max( 1u , (unsigned)(min( (float)UNIGRID_MAX_RES , gridPerDistance * delta[i] )) );
+		m_voxelInvExtent[i] = ( delta[i] > 0.0f ) ? m_voxelNum[i] / delta[i] : 0.0f;
+		m_voxelExtent[i] = delta[i] / m_voxelNum[i];
 	}
 
 	m_voxelCount = m_voxelNum[0] * m_voxelNum[1] * m_voxelNum[2];
 
-	// allocate the memory
-	SAFE_DELETE_ARRAY( m_pVoxels );
-	m_pVoxels = new vector<Primitive*>[ m_voxelCount ];
+	// the same number of chunks is used by all parallel loops
+	const unsigned chunk_cnt = ( count > UNIGRID_PARALLEL_THRESHOLD ) ? min( ThreadPool::GetSingleton().GetThreadNum() , UNIGRID_MAX_CHUNK ) : 1u;
 
-	// distribute the primitives
-	vector<Primitive*>::const_iterator it = m_primitives->begin();
-	while( it != m_primitives->end() )
-	{
-		unsigned maxGridId[3];
-		unsigned minGridId[3];
-		for( int i = 0 ; i < 3 ; i++ )
-		{
-			minGridId[i] = point2VoxelId( (*it)->GetBBox().m_Min , i );
-			maxGridId[i] = point2VoxelId( (*it)->GetBBox().m_Max , i );
+	// find the voxels overlapped by each primitive, chunks are consecutive ranges of primitives so the references stay in the order of primitives
+	std::vector<UniGrid_Reference> chunk_refs[UNIGRID_MAX_CHUNK];
+	runChunks( chunk_cnt , count , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned pri = _start ; pri < _end ; ++pri ){
+			const Primitive* primitive = (*m_primitives)[pri];
+			const BBox box = primitive->GetBBox();
+			unsigned maxGridId[3];
+			unsigned minGridId[3];
+			for( int i = 0 ; i < 3 ; i++ )
+			{
+				minGridId[i] = point2VoxelId( box.m_Min , i );
+				maxGridId[i] = point2VoxelId( box.m_Max , i );
+			}
+
+			for( unsigned i = minGridId[2] ; i <= maxGridId[2] ; i++ )
+				for( unsigned j = minGridId[1] ; j <= maxGridId[1] ; j++ )
+					for( unsigned k = minGridId[0] ; k <= maxGridId[0] ; k++ )
+					{
+						BBox bb;
+						bb.m_Min = m_bbox.m_Min + Vector( (float)k , (float)j , (float)i ) * m_voxelExtent;
+						bb.m_Max = bb.m_Min + m_voxelExtent;
+
+						// only add the triangle if it is actually intersected
+						if( primitive->GetIntersect( bb ) ){
+							UniGrid_Reference ref;
+							ref.cell = offset( k , j , i );
+							ref.pri = pri;
+							chunk_refs[chunk].push_back( ref );
+						}
+					}
 		}
+	});
 
-		for( unsigned i = minGridId[2] ; i <= maxGridId[2] ; i++ )
-			for( unsigned j = minGridId[1] ; j <= maxGridId[1] ; j++ )
-				for( unsigned k = minGridId[0] ; k <= maxGridId[0] ; k++ )
-				{
-					BBox bb;
-					bb.m_Min = m_bbox.m_Min + Vector( (float)k , (float)j , (float)i ) * m_voxelExtent;
-					bb.m_Max = bb.m_Min + m_voxelExtent;
+	std::vector<unsigned> voxel_offsets , voxel_pri;
+	countingSort( chunk_refs , chunk_cnt , m_voxelCount , voxel_offsets , voxel_pri );
+	for( unsigned i = 0 ; i < chunk_cnt ; ++i )
+		std::vector<UniGrid_Reference>().swap( chunk_refs[i] );
+
+	m_voxels.resize( m_voxelCount );
+	if( !m_twoLevel ){
+		// every voxel is one cell
+		for( unsigned i = 0 ; i < m_voxelCount ; ++i )
+			m_voxels[i].cell = i;
+		m_cellOffsets.swap( voxel_offsets );
+		m_cellPri.swap( voxel_pri );
+		return;
+	}
+
+	// the resolution of dense voxels depends on the number of primitives in them, axes without extent are not subdivided
+	float volume = 1.0f;
+	int dims = 0;
+	for( int i = 0 ; i < 3 ; i++ ){
+		if( m_voxelExtent[i] > 0.0f ){
+			volume *= m_voxelExtent[i];
+			++dims;
+		}
+	}
+	std::vector<unsigned> subdivided;
+	unsigned cell_count = 0;
+	for( unsigned v = 0 ; v < m_voxelCount ; ++v ){
+		UniGrid_Voxel& voxel = m_voxels[v];
+		const unsigned pri_num = voxel_offsets[v + 1] - voxel_offsets[v];
+		if( pri_num > UNIGRID_SUBDIVIDE_THRESHOLD && dims > 0 ){
+			const float cell_per_distance = powf( UNIGRID_CELL_DENSITY * pri_num / volume , 1.0f / dims );
+			for( int i = 0 ; i < 3 ; i++ )
+				voxel.res[i] = (unsigned char)min( UNIGRID_MAX_CELL_RES , max( 1u , (unsigned)ceilf( cell_per_distance * m_voxelExtent[i] ) ) );
+			if( voxel.res[0] * voxel.res[1] * voxel.res[2] > 1 )
+				subdivided.push_back( v );
+		}
+		voxel.cell = cell_count;
+		cell_count += voxel.res[0] * voxel.res[1] * voxel.res[2];
+	}
+
+	// dense voxels are subdivided independently
+	std::vector< std::vector<unsigned> > sub_counts( subdivided.size() ) , sub_pri( subdivided.size() );
+	runChunks( chunk_cnt , (unsigned)subdivided.size() , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; ++i ){
+			const unsigned v = subdivided[i];
+			const unsigned coord[3] = { v % m_voxelNum[0] , ( v / m_voxelNum[0] ) % m_voxelNum[1] , v / ( m_voxelNum[0] * m_voxelNum[1] ) };
+			subdivideVoxel( m_voxels[v] , coord , voxel_offsets[v] , voxel_offsets[v + 1] , voxel_pri , sub_counts[i] , sub_pri[i] );
+		}
+	});
 
-					// only add the triangle if it is actually intersected
-					if( (*it)->GetIntersect( bb ) )
-						m_pVoxels[offset( k , j , i )].push_back( *it );
+	// gather all cells into the compact layout
+	m_cellOffsets.resize( cell_count + 1 );
+	m_cellPri.reserve( voxel_pri.size() );
+	unsigned next_sub = 0;
+	for( unsigned v = 0 ; v < m_voxelCount ; ++v ){
+		const UniGrid_Voxel& voxel = m_voxels[v];
+		if( next_sub < subdivided.size() && subdivided[next_sub] == v ){
+			const std::vector<unsigned>& counts = sub_counts[next_sub];
+			for( unsigned c = 0 ; c < (unsigned)counts.size() ; ++c )
+				m_cellOffsets[voxel.cell + c] = ( c == 0 ) ? (unsigned)m_cellPri.size() : m_cellOffsets[voxel.cell + c - 1] + counts[c - 1];
+			m_cellPri.insert( m_cellPri.end() , sub_pri[next_sub].begin() , sub_pri[next_sub].end() );
+			++next_sub;
+		}else{
+			for( unsigned c = 0 ; c < (unsigned)( voxel.res[0] * voxel.res[1] * voxel.res[2] ) ; ++c )
+				m_cellOffsets[voxel.cell + c] = (unsigned)m_cellPri.size();
+			m_cellPri.insert( m_cellPri.end() , voxel_pri.begin() + voxel_offsets[v] , voxel_pri.begin() + voxel_offsets[v + 1] );
+		}
+	}
+	m_cellOffsets[cell_count] = (unsigned)m_cellPri.size();
+}
+
+// subdivide a voxel into cells
+void UniGrid::subdivideVoxel( const UniGrid_Voxel& voxel , const unsigned coord[3] , unsigned _start , unsigned _end , const std::vector<unsigned>& voxelPri ,
+                              std::vector<unsigned>& counts , std::vector<unsigned>& cellPri ) const
+{
+	const unsigned res[3] = { voxel.res[0] , voxel.res[1] , voxel.res[2] };
+	Point origin;
+	Vector extent , inv_extent;
+	for( int i = 0 ; i < 3 ; i++ ){
+		origin[i] = m_bbox.m_Min[i] + coord[i] * m_voxelExtent[i];
+		extent[i] = m_voxelExtent[i] / res[i];
+		inv_extent[i] = m_voxelInvExtent[i] * res[i];
+	}
+
+	std::vector<UniGrid_Reference> refs;
+	for( unsigned k = _start ; k < _end ; ++k ){
+		const Primitive* primitive = (*m_primitives)[voxelPri[k]];
+		const BBox& box = primitive->GetBBox();
+		unsigned lo[3] , hi[3];
+		for( int i = 0 ; i < 3 ; i++ ){
+			lo[i] = min( res[i] - 1 , (unsigned)max( 0.0f , ( box.m_Min[i] - origin[i] ) * inv_extent[i] ) );
+			hi[i] = min( res[i] - 1 , (unsigned)max( 0.0f , ( box.m_Max[i] - origin[i] ) * inv_extent[i] ) );
+		}
+		for( unsigned z = lo[2] ; z <= hi[2] ; z++ )
+			for( unsigned y = lo[1] ; y <= hi[1] ; y++ )
+				for( unsigned x = lo[0] ; x <= hi[0] ; x++ ){
+					BBox bb;
+					bb.m_Min = origin + Vector( (float)x , (float)y , (float)z ) * extent;
+					bb.m_Max = bb.m_Min + extent;
+					if( primitive->GetIntersect( bb ) ){
+						UniGrid_Reference ref;
+						ref.cell = ( z * res[1] + y ) * res[0] + x;
+						ref.pri = voxelPri[k];
+						refs.push_back( ref );
+					}
 				}
-		it++;
 	}
+
+	std::vector<unsigned> offsets;
+	countingSort( &refs , 1 , res[0] * res[1] * res[2] , offsets , cellPri );
+	counts.resize( res[0] * res[1] * res[2] );
+	for( unsigned c = 0 ; c < (unsigned)counts.size() ; ++c )
+		counts[c] = offsets[c + 1] - offsets[c];
 }
 
 // voxel id from point
 unsigned UniGrid::point2VoxelId( const Point& p , unsigned axis ) const
 {
-	return min( m_voxelNum[axis] - 1 , (unsigned)( ( p[axis] - m_bbox.m_Min[axis] ) * m_voxelInvExtent[axis] ) );
+	return min( m_voxelNum[axis] - 1 , (unsigned)max( 0.0f , ( p[axis] - m_bbox.m_Min[axis] ) * m_voxelInvExtent[axis] ) );
 }
 
 // get the id offset
@@ -182,41 +391,25 @@ unsigned UniGrid::offset( unsigned x , unsigned y , unsigned z ) const
 	return z * m_voxelNum[1] * m_voxelNum[0] + y * m_voxelNum[0] + x;
 }
 
-// voxel id to point
-Point UniGrid::voxelId2Point( int id[3] ) const
+// memory taken by the uniform grid
+size_t UniGrid::GetMemoryUsage() const
 {
-	Point p;
-	p.x = m_bbox.m_Min.x + id[0] * m_voxelExtent[0];
-	p.y = m_bbox.m_Min.y + id[1] * m_voxelExtent[1];
-	p.z = m_bbox.m_Min.z + id[2] * m_voxelExtent[2];
-
-	return p;
-}
-
-// get intersection between the ray and the triangles in the grid
-bool UniGrid::getIntersect( const Ray& r , Intersection* intersect , unsigned voxelId , float nextT ) const
-{
-    sAssertMsg( voxelId < m_voxelCount , SPATIAL_ACCELERATOR , "asfsa" );
-    
-	bool inter = false;
-    for( auto voxel : m_pVoxels[voxelId] ){
-		// get intersection
-		inter |= voxel->GetIntersect( r , intersect );
-		if( intersect == 0 && inter )
-			return true;
-	}
-
-	return inter && ( intersect->t < nextT + 0.00001f );
+	return sizeof( UniGrid_Voxel ) * m_voxels.size() + sizeof( unsigned ) * ( m_cellOffsets.size() + m_cellPri.size() );
 }
 
 // output log information
 void UniGrid::OutputLog() const
 {
-	unsigned count = 0;
-	for( unsigned i = 0 ; i < m_voxelCount ; i++ )
-		count += (unsigned)m_pVoxels[i].size();
-    
-    slog( INFO , SPATIAL_ACCELERATOR , "Spatial accelerator is Uniform Grid." );
-    slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "Total grid count is %d. Grid dimension is %d x %d x %d. Average number of triangles per grid is %f" , m_voxelCount , m_voxelNum[0] , m_voxelNum[1] , m_voxelNum[2] , ((m_voxelCount==0)?0:(float)count/(float)m_voxelCount) ) );
+	const unsigned cell_count = m_cellOffsets.empty() ? 0 : (unsigned)m_cellOffsets.size() - 1;
+    slog( INFO , SPATIAL_ACCELERATOR , m_twoLevel ? "Spatial accelerator is Two-Level Uniform Grid." : "Spatial accelerator is Uniform Grid." );
+    slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "Total grid count is %d. Grid dimension is %d x %d x %d. Total cell count is %d. Average number of triangles per cell is %f" , m_voxelCount , m_voxelNum[0] , m_voxelNum[1] , m_voxelNum[2] , cell_count , ((cell_count==0)?0:(float)m_cellPri.size()/(float)cell_count) ) );
 }
 
+// add the shape of the grid to the report
+void UniGrid::CollectStats( StatsGroup& stats ) const
+{
+	const unsigned cell_count = m_cellOffsets.empty() ? 0 : (unsigned)m_cellOffsets.size() - 1;
+	stats.Add( "type" , "uniform_grid" ).Add( "two_level" , m_twoLevel ).Add( "voxels" , m_voxelCount )
+		 .Add( "dim_x" , m_voxelNum[0] ).Add( "dim_y" , m_voxelNum[1] ).Add( "dim_z" , m_voxelNum[2] ).Add( "cells" , cell_count )
+		 .Add( "avg_cell_primitives" , ( cell_count == 0 ) ? 0.0f : (float)m_cellPri.size() / (float)cell_count );
+}
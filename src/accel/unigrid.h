@@ -25,14 +25,20 @@
  * Unlike other complex data structure, like KD-Tree, uniform grid takes linear
  * time complexity to build. However the travesal efficiency may be lower than
  * its peers.
+ * Cells are stored in a compact layout, each cell owns a consecutive range of one shared primitive index array.
+ * With the 'two_level' property enabled, the top level grid is coarser and each dense voxel is subdivided
+ * into its own grid whose resolution depends on the number of primitives in it.
+ * Please refer to this paper
+ * <a href="https://graphics.cg.uni-saarland.de/fileadmin/cguds/papers/2011/kalojanov_tlg/kalojanov_tlg.pdf">
+ * Two-Level Grids for Ray Tracing on GPUs</a> for further details.
  */
 class UniGrid : public Accelerator
 {
 public:
 	DEFINE_CREATOR( UniGrid , Accelerator , "uniform_grid" );
 
-	//! Destructor releasing all voxel data.
-    ~UniGrid() override;
+	//! Default constructor.
+	UniGrid() { _registerProperty( "two_level" , new TwoLevelProperty(this) ); }
 
     //! @brief Get intersection between the ray and the primitive set using uniform grid.
     //!
@@ -49,18 +55,44 @@ public:
     //! @return             It will return true if there is an intersection, otherwise it returns false.
     bool GetIntersect( const Ray& r , Intersection* intersect ) const override;
 
-	//! Build uniform grid structure in O(N).
+    //! @brief Check whether the ray is blocked by any primitive using uniform grid.
+    //!
+    //! It is the dedicated query for shadow rays. The cells along the ray are stepped through in order like GetIntersect,
+    //! it returns at the first blocking primitive even if the hit lies beyond the cell the primitive is found in.
+    //! @param r            The input ray to be tested.
+    //! @return             It will return true if there is any intersection, otherwise it returns false.
+    bool IsOccluded( const Ray& r ) const override;
+
+	//! @brief Build uniform grid structure in O(N).
+    //!
+    //! Primitives are distributed to voxels in the thread pool, the cells are then filled with a counting sort.
     void Build() override;
 
 	//! Output log information
 	void OutputLog() const override;
 
+	//! Add the shape of the structure to the statistics report
+	void CollectStats( StatsGroup& stats ) const override;
+
+    //! Memory taken by the voxels, the cells and the primitive indices in them.
+	size_t GetMemoryUsage() const override;
+
+    //! @brief Voxel of the top level grid.
+    struct UniGrid_Voxel
+    {
+        unsigned        cell = 0;           /**< Index of the first cell of the voxel, cells of a voxel are consecutive. */
+        unsigned char   res[3] = {1,1,1};   /**< Number of cells along each axis in the voxel, it is one cell if it is not subdivided. */
+    };
+
 private:
 	unsigned	m_voxelCount = 0;               /**< Total number of voxels. */
     unsigned	m_voxelNum[3] = {};             /**< Number of voxels along each axis. */
 	Vector		m_voxelExtent;                  /**< Extent of one voxel along each axis. */
 	Vector		m_voxelInvExtent;               /**< Inverse of extent of one voxel along each axis. */
-	vector<Primitive*>*	m_pVoxels = nullptr;    /**< Vector holding all voxels. */
+    std::vector<UniGrid_Voxel>  m_voxels;       /**< Voxels of the top level grid. */
+    std::vector<unsigned>       m_cellOffsets;  /**< Offset of the primitives of each cell, there is one more offset marking the end of the last cell. */
+    std::vector<unsigned>       m_cellPri;      /**< Indices of primitives in all cells. */
+    bool        m_twoLevel = false;             /**< Whether dense voxels are subdivided. */
 
 	//! Release all allocated memory.
 	void release();
@@ -71,23 +103,40 @@ private:
     //! @return     The id of the voxel along the selected axis.
 	unsigned point2VoxelId( const Point& p , unsigned axis ) const;
     
-	//! @brief Caculate the point with the minimal values along each axis in the voxel.
-    //! @param voxel    The id of the voxel to be evaluted along three dimensions.
-    //! @return         The point with minimal value along each axis in the voxel.
-	Point	voxelId2Point( int voxel[3] ) const;
-    
 	//! @brief Translate voxel id from three-dimensional to one-dimentional.
     //! @param x ID of voxel along axis-x.
     //! @param y ID of voxel along axis-y.
     //! @param z ID of voxel along axis-z.
     //! @return  ID of the voxel in one single dimension.
 	unsigned offset( unsigned x , unsigned y , unsigned z ) const;
-	
-    //! @brief Get the nearest intersection between a ray and the primitive set.
+
+    //! @brief Subdivide a voxel into cells.
+    //! @param voxel    The voxel to be subdivided, its resolution is decided already.
+    //! @param coord    ID of the voxel along each axis.
+    //! @param _start   The offset of the first primitive of the voxel in the primitive index array of voxels.
+    //! @param _end     The offset after the last primitive of the voxel.
+    //! @param voxelPri The primitive index array of voxels.
+    //! @param counts   The number of primitives in each cell of the voxel.
+    //! @param cellPri  The primitive indices of cells of the voxel, they are ordered by cells.
+    void subdivideVoxel( const UniGrid_Voxel& voxel , const unsigned coord[3] , unsigned _start , unsigned _end , const std::vector<unsigned>& voxelPri ,
+                         std::vector<unsigned>& counts , std::vector<unsigned>& cellPri ) const;
+
+    //! @brief Traverse the grid from near to far along the ray.
     //! @param r            The ray to be tested.
-    //! @param intersect    A pointer to the intersection information. If it is empty, it will return true as long as there is an intersection detected, which is not necessarily the nearest one.
-    //! @param voxelId      ID of the voxel to be tested.
-    //! @param nextT        The intersected position of the ray and the next to-be-traversed voxel along the ray.
-    //! @return             It will return true if there is an intersection, otherwise it returns false.
-	bool getIntersect( const Ray& r , Intersection* intersect , unsigned voxelId , float nextT ) const;
+    //! @param intersect    The intersection result, nullptr for shadow rays.
+    //! @return             Whether the ray intersects anything in the primitive set.
+    bool traverse( const Ray& r , Intersection* intersect ) const;
+
+	//! Property subdividing dense voxels, '1' enables it.
+	class TwoLevelProperty : public PropertyHandler<Accelerator>
+	{
+	public:
+		PH_CONSTRUCTOR(TwoLevelProperty,Accelerator);
+		void SetValue( const string& str )
+		{
+			UniGrid* grid = CAST_TARGET(UniGrid);
+			if( grid )
+				grid->m_twoLevel = ( atoi( str.c_str() ) == 1 );
+		}
+	};
 };
@@ -0,0 +1,354 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "widebvh.h"
+#include "geometry/bbox_simd.h"
+#include "geometry/intersection.h"
+#include "log/log.h"
+#include "accelcache.h"
+#include "accelstats.h"
+#include "utility/statsreport.h"
+#include "utility/hugepage.h"
+
+IMPLEMENT_CREATOR( Qbvh );
+IMPLEMENT_CREATOR( Obvh );
+
+// destructor
+template<int N>
+WideBvh<N>::~WideBvh()
+{
+    HugePages::Free( m_wideNodes );
+    m_wideNodes = nullptr;
+}
+
+// output log information
+template<int N>
+void WideBvh<N>::OutputLog() const
+{
+    slog( INFO , SPATIAL_ACCELERATOR , stringFormat( "Spatial accelerator type is %d-wide BVH ( Bounding Volume Hierarchy )." , N ) );
+    slog( DEBUG , SPATIAL_ACCELERATOR , stringFormat( "Number of nodes in the binary BVH is %d, it is collapsed into %d wide nodes. Number of leaf nodes is %d, maximum depth of the binary BVH is %d." , m_totalNode , m_wideNodeCount , m_leafNode , m_bvhDepth ) );
+}
+
+// add the shape of the wide bvh to the report
+template<int N>
+void WideBvh<N>::CollectStats( StatsGroup& stats ) const
+{
+    stats.Add( "type" , ( N == 4 ) ? "qbvh" : "obvh" ).Add( "width" , N ).Add( "depth" , m_bvhDepth ).Add( "binary_nodes" , m_totalNode )
+         .Add( "nodes" , m_wideNodeCount ).Add( "leaves" , m_leafNode );
+}
+
+// memory taken by the wide bvh
+template<int N>
+size_t WideBvh<N>::GetMemoryUsage() const
+{
+    return sizeof( Bvh_Wide_Node ) * m_wideNodeCount + sizeof( TrianglePacket ) * m_packetCount;
+}
+
+// build the acceleration structure
+template<int N>
+void WideBvh<N>::Build()
+{
+    // refitting is not supported, the tree of a previous build is discarded
+    deallocMemory();
+    HugePages::Free( m_wideNodes );
+    m_wideNodes = nullptr;
+    m_wideNodeCount = 0;
+
+    // an empty scene has no tree at all, every ray misses its empty bounding box before any node is visited
+    if( m_primitives->empty() ){
+        computeBBox();
+        m_totalNode = m_leafNode = m_bvhDepth = m_maxLeafTriNum = 0;
+        return;
+    }
+
+    // build the binary tree with the same SAH builder
+    buildTree();
+
+    // collapse the binary tree
+    std::vector<Bvh_Wide_Node> nodes;
+    std::vector<TrianglePacket> packets;
+    if( m_root->pri_num == 0 ){
+        collapseNode( m_root , nodes , packets );
+    }else{
+        // the whole tree is one leaf, wrap it in a wide node
+        Bvh_Wide_Node wide_node;
+        for( int i = 0 ; i < N ; ++i ){
+            for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+                wide_node.bounds[0][axis][i] = FLT_MAX;
+                wide_node.bounds[1][axis][i] = -FLT_MAX;
+            }
+            wide_node.child[i] = 0;
+            wide_node.pri_num[i] = 0;
+        }
+        for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+            wide_node.bounds[0][axis][0] = m_root->bbox.m_Min[axis];
+            wide_node.bounds[1][axis][0] = m_root->bbox.m_Max[axis];
+        }
+        wide_node.child[0] = packLeaf( m_root->pri_offset , m_root->pri_num , packets );
+        wide_node.pri_num[0] = m_root->pri_num;
+        nodes.push_back( wide_node );
+    }
+
+    // copy the nodes into aligned memory
+    m_wideNodeCount = (unsigned)nodes.size();
+    m_wideNodes = (Bvh_Wide_Node*)HugePages::Alloc( sizeof( Bvh_Wide_Node ) * m_wideNodeCount , alignof( Bvh_Wide_Node ) );
+    memcpy( m_wideNodes , &nodes[0] , sizeof( Bvh_Wide_Node ) * m_wideNodeCount );
+    storePackets( packets );
+    releasePrimitives();
+
+    // the pointer based tree is not needed anymore
+    deleteNode( m_root );
+    m_root = nullptr;
+}
+
+// collapse the binary sub-tree into wide nodes
+template<int N>
+unsigned WideBvh<N>::collapseNode( const Bvh_Node* node , std::vector<Bvh_Wide_Node>& nodes , std::vector<TrianglePacket>& packets )
+{
+    // pull the grand children up until there are N children, always open the largest interior child first
+    const Bvh_Node* children[N];
+    int child_cnt = 0;
+    children[child_cnt++] = node->left;
+    children[child_cnt++] = node->right;
+    while( child_cnt < N ){
+        int best = -1;
+        float best_area = -1.0f;
+        for( int i = 0 ; i < child_cnt ; ++i ){
+            if( children[i]->pri_num != 0 )
+                continue;
+            const float area = children[i]->bbox.HalfSurfaceArea();
+            if( area > best_area ){
+                best_area = area;
+                best = i;
+            }
+        }
+        if( best < 0 )
+            break;
+        const Bvh_Node* opened = children[best];
+        children[best] = opened->left;
+        children[child_cnt++] = opened->right;
+    }
+
+    const unsigned id = (unsigned)nodes.size();
+    nodes.push_back( Bvh_Wide_Node() );
+
+    Bvh_Wide_Node wide_node;
+    for( int i = 0 ; i < N ; ++i ){
+        if( i < child_cnt ){
+            const Bvh_Node* child = children[i];
+            for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+                wide_node.bounds[0][axis][i] = child->bbox.m_Min[axis];
+                wide_node.bounds[1][axis][i] = child->bbox.m_Max[axis];
+            }
+            wide_node.pri_num[i] = child->pri_num;
+            wide_node.child[i] = ( child->pri_num != 0 ) ? packLeaf( child->pri_offset , child->pri_num , packets ) : collapseNode( child , nodes , packets );
+        }else{
+            for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+                wide_node.bounds[0][axis][i] = FLT_MAX;
+                wide_node.bounds[1][axis][i] = -FLT_MAX;
+            }
+            wide_node.child[i] = 0;
+            wide_node.pri_num[i] = 0;
+        }
+    }
+    nodes[id] = wide_node;
+
+    return id;
+}
+
+// write the wide BVH
+template<int N>
+bool WideBvh<N>::Serialize( AccelWriter& stream ) const
+{
+    if( m_wideNodes == nullptr )
+        return false;
+
+    stream.Write( m_bbox );
+    stream.Write( m_totalNode );
+    stream.Write( m_leafNode );
+    stream.Write( m_bvhDepth );
+    stream.Write( m_wideNodeCount );
+    stream.Write( m_wideNodes , m_wideNodeCount );
+    serializePackets( stream );
+    return true;
+}
+
+// load the wide BVH
+template<int N>
+bool WideBvh<N>::Deserialize( AccelReader& stream )
+{
+    deallocMemory();
+    HugePages::Free( m_wideNodes );
+    m_wideNodes = nullptr;
+    m_wideNodeCount = 0;
+
+    unsigned count = 0;
+    if( !stream.Read( m_bbox ) || !stream.Read( m_totalNode ) || !stream.Read( m_leafNode ) || !stream.Read( m_bvhDepth ) ||
+        !stream.Read( count ) || count == 0 )
+        return false;
+
+    m_wideNodes = (Bvh_Wide_Node*)HugePages::Alloc( sizeof( Bvh_Wide_Node ) * count , alignof( Bvh_Wide_Node ) );
+    m_wideNodeCount = count;
+    bool valid = stream.Read( m_wideNodes , count ) && deserializePackets( stream );
+
+    // the traversal trusts the children in the nodes, they are checked once here
+    for( unsigned id = 0 ; valid && id < count ; id++ ){
+        const Bvh_Wide_Node& node = m_wideNodes[id];
+        for( int i = 0 ; valid && i < N ; ++i )
+            valid = ( node.pri_num[i] != 0 ) ? validLeaf( node.child[i] , node.pri_num[i] ) : ( node.child[i] < count );
+    }
+    if( !valid ){
+        deallocMemory();
+        HugePages::Free( m_wideNodes );
+        m_wideNodes = nullptr;
+        m_wideNodeCount = 0;
+        return false;
+    }
+    return true;
+}
+
+// get the intersection between the ray and the primitive set
+template<int N>
+bool WideBvh<N>::GetIntersect( const Ray& ray , Intersection* intersect ) const
+{
+    const TraversalRay bbox_ray( ray );
+    float fmax;
+    float fmin = Intersect( bbox_ray , m_bbox , &fmax );
+    if( fmin < 0.0f )
+        return false;
+
+    // interior nodes or leaves to be visited along with the entering distance of their bounding boxes
+    struct Bvh_Stack_Entry{
+        unsigned    child;
+        unsigned    pri_num;
+        float       fmin;
+    };
+    Bvh_Stack_Entry stack[BVH_MAX_DEPTH * ( N - 1 ) + 1];
+    Bvh_Stack_Entry* top = stack;
+    top->child = 0;
+    top->pri_num = 0;
+    top->fmin = fmin;
+    ++top;
+
+    SORT_STATS( AccelStats& stats = AccelStats::Local() );
+    bool inter = false;
+    while( top > stack ){
+        --top;
+
+        // the bounding box is behind the closest intersection found so far
+        if( intersect && intersect->t < top->fmin ){
+            SORT_STATS( ++stats.earlyOuts );
+            continue;
+        }
+
+        SORT_STATS( ++stats.nodes );
+        if( top->pri_num != 0 ){
+            if( intersect == 0 ){
+                if( occludedLeaf( ray , top->child , top->pri_num ) ){
+                    SORT_STATS( ++stats.earlyOuts );
+                    return true;
+                }
+            }else if( intersectLeaf( ray , intersect , top->child , top->pri_num ) ){
+                inter = true;
+            }
+            continue;
+        }
+
+        // test all children at once
+        const Bvh_Wide_Node& node = m_wideNodes[top->child];
+        const float tmax = intersect ? min( ray.m_fMax , intersect->t ) : ray.m_fMax;
+        float t_near[N];
+        unsigned mask = IntersectSoA<N>( bbox_ray , node.bounds , ray.m_fMin , tmax , t_near );
+        if( mask == 0 )
+            continue;
+
+        // sort the hit children from far to near so that the nearest one is on top of the stack
+        Bvh_Stack_Entry* base = top;
+        while( mask ){
+            int i = 0;
+            while( ( mask & ( 1 << i ) ) == 0 )
+                ++i;
+            mask &= ~( 1 << i );
+
+            Bvh_Stack_Entry entry;
+            entry.child = node.child[i];
+            entry.pri_num = node.pri_num[i];
+            entry.fmin = t_near[i];
+
+            Bvh_Stack_Entry* it = top;
+            while( it > base && ( it - 1 )->fmin < entry.fmin ){
+                *it = *( it - 1 );
+                --it;
+            }
+            *it = entry;
+            ++top;
+        }
+    }
+
+    return inter;
+}
+
+// check whether the ray is blocked by any primitive
+template<int N>
+bool WideBvh<N>::IsOccluded( const Ray& ray ) const
+{
+    const TraversalRay bbox_ray( ray );
+    if( Intersect( bbox_ray , m_bbox ) < 0.0f )
+        return false;
+
+    // interior nodes or leaves to be visited, any intersection is enough so they are not sorted
+    struct Bvh_Stack_Entry{
+        unsigned    child;
+        unsigned    pri_num;
+    };
+    Bvh_Stack_Entry stack[BVH_MAX_DEPTH * ( N - 1 ) + 1];
+    Bvh_Stack_Entry* top = stack;
+    top->child = 0;
+    top->pri_num = 0;
+    ++top;
+
+    SORT_STATS( AccelStats& stats = AccelStats::Local() );
+    while( top > stack ){
+        --top;
+        SORT_STATS( ++stats.nodes );
+        if( top->pri_num != 0 ){
+            if( occludedLeaf( ray , top->child , top->pri_num ) ){
+                SORT_STATS( ++stats.earlyOuts );
+                return true;
+            }
+            continue;
+        }
+
+        const Bvh_Wide_Node& node = m_wideNodes[top->child];
+        float t_near[N];
+        unsigned mask = IntersectSoA<N>( bbox_ray , node.bounds , ray.m_fMin , ray.m_fMax , t_near );
+        while( mask ){
+            int i = 0;
+            while( ( mask & ( 1 << i ) ) == 0 )
+                ++i;
+            mask &= ~( 1 << i );
+            top->child = node.child[i];
+            top->pri_num = node.pri_num[i];
+            ++top;
+        }
+    }
+
+    return false;
+}
+
+template class WideBvh<4>;
+template class WideBvh<8>;
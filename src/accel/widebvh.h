@@ -0,0 +1,133 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "bvh.h"
+
+//! @brief Wide bounding volume hierarchy.
+/**
+ * A wide BVH has up to N children in each node, the bounding boxes of all children
+ * are stored in SoA layout so that one SIMD slab test covers all of them. It is built
+ * by collapsing the binary SAH BVH, so the leaf nodes are exactly the same with BVH.
+ * Please refer to this paper
+ * <a href="https://www.uni-ulm.de/fileadmin/website_uni_ulm/iui.inst.100/institut/Papers/QBVH.pdf">
+ * Shallow Bounding Volume Hierarchies for Fast SIMD Ray Tracing of Incoherent Rays</a> for further details.
+ */
+template<int N>
+class WideBvh : public Bvh
+{
+public:
+	//! Destructor
+    ~WideBvh() override;
+
+    //! @brief Get intersection between the ray and the primitive set using wide BVH.
+    //!
+    //! It will return true if there is intersection between the ray and the primitive set.
+    //! In case of an existed intersection, if intersect is not empty, it will fill the
+    //! structure and return the nearest intersection.
+    //! If intersect is nullptr, it will stop as long as one intersection is found, it is not
+    //! necessary to be the nearest one.
+    //! False will be returned if there is no intersection at all.
+    //! @param r            The input ray to be tested.
+    //! @param intersect    The intersection result. If a nullptr pointer is provided, it stops as
+    //!                     long as it finds an intersection. It is faster than the one with intersection information
+    //!                     data and suitable for shadow ray calculation.
+    //! @return             It will return true if there is an intersection, otherwise it returns false.
+    bool GetIntersect( const Ray& r , Intersection* intersect ) const override;
+
+    //! @brief Check whether the ray is blocked by any primitive using wide BVH.
+    //!
+    //! It is the dedicated query for shadow rays. The children hit by the ray are pushed in the order of their slots instead
+    //! of being sorted by distance, and it returns at the first blocking primitive.
+    //! @param r            The input ray to be tested.
+    //! @return             It will return true if there is any intersection, otherwise it returns false.
+    bool IsOccluded( const Ray& r ) const override;
+
+    //! @brief Get the nearest intersections of a stream of rays.
+    //!
+    //! Wide nodes already test several children at once, so the rays are traced one by one.
+    void GetIntersect( const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const override {
+        Accelerator::GetIntersect( rays , intersects , results , count );
+    }
+
+    //! @brief Check whether each ray in a stream is blocked by any primitive.
+    //!
+    //! The rays are traced one by one for the same reason.
+    void IsOccluded( const Ray* rays , bool* results , unsigned count ) const override {
+        Accelerator::IsOccluded( rays , results , count );
+    }
+
+    //! Build the binary BVH and collapse it into a wide BVH.
+	void Build() override;
+
+	//! Output log information
+	void OutputLog() const override;
+
+	//! Add the shape of the structure to the statistics report
+	void CollectStats( StatsGroup& stats ) const override;
+
+    //! Memory taken by the wide nodes and the triangle packets.
+	size_t GetMemoryUsage() const override;
+
+    //! @brief Write the wide BVH, primitives of leaf nodes are written as their indices.
+    //! @param stream   The buffer to write into.
+    //! @return         False if the BVH is not built yet.
+	bool Serialize( AccelWriter& stream ) const override;
+
+    //! @brief Load the wide BVH, triangle packets are packed again from the primitives.
+    //! @param stream   The payload to read from.
+    //! @return         False if the data doesn't match the primitive set.
+	bool Deserialize( AccelReader& stream ) override;
+
+    //! @brief Wide BVH node.
+    //!
+    //! Empty child slots have an inverted bounding box so that they are never hit.
+    struct alignas(sizeof(float)*(N>4?8:4)) Bvh_Wide_Node
+    {
+        float       bounds[2][3][N];    /**< Bounding boxes of children in SoA layout, bounds[0] holds the minimum points, bounds[1] holds the maximum points. */
+        unsigned    child[N];           /**< Index of the child node for interior children, index of the first triangle packet for leaf children. */
+        unsigned    pri_num[N];         /**< Number of primitives in leaf children, it is 0 for interior children and empty slots. */
+    };
+
+protected:
+    Bvh_Wide_Node*  m_wideNodes = nullptr;  /**< Wide BVH nodes in depth-first order. */
+    unsigned        m_wideNodeCount = 0;    /**< Number of wide BVH nodes. */
+
+	//! @brief Collapse a binary BVH sub-tree into wide BVH nodes.
+    //! @param node     The root node of the binary sub-tree, it has to be an interior node.
+    //! @param nodes    The container of the wide nodes.
+    //! @param packets  The triangle packets of leaf nodes collapsed so far, leaves of the sub-tree will be appended to it.
+    //! @return         The index of the collapsed node.
+	unsigned collapseNode( const Bvh_Node* node , std::vector<Bvh_Wide_Node>& nodes , std::vector<TrianglePacket>& packets );
+};
+
+//! @brief 4-wide BVH, the slab test of one node is a single SSE operation.
+class Qbvh : public WideBvh<4>
+{
+public:
+	DEFINE_CREATOR( Qbvh , Accelerator , "qbvh" );
+};
+
+//! @brief 8-wide BVH, the slab test of one node is a single AVX operation.
+//!
+//! Without AVX support from the compiler, the slab test falls back to two SSE operations.
+class Obvh : public WideBvh<8>
+{
+public:
+	DEFINE_CREATOR( Obvh , Accelerator , "obvh" );
+};
@@ -0,0 +1,247 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "sortsession.h"
+#include "system.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "thirdparty/tinyxml/tinyxml.h"
+#include <atomic>
+
+extern System g_System;
+
+namespace {
+// the names of the files of the session in memory
+const char* SESSION_PREFIX = "mem:session/";
+const char* SESSION_SETTINGS = "mem:session/settings.xml";
+const char* SESSION_SCENE = "mem:session/scene.xml";
+const char* SESSION_MATERIALS = "mem:session/materials.xml";
+const char* SESSION_MESH_PREFIX = "mem:session/mesh/";
+
+// whether a session is open , the renderer only keeps one scene
+std::atomic<bool> g_sessionOpen( false );
+
+// create an element with the type and the properties of an object
+TiXmlElement* objectElement( const char* tag , const std::string& type , const SessionProperties& props ){
+    TiXmlElement* element = new TiXmlElement( tag );
+    element->SetAttribute( "type" , type.c_str() );
+    for( const auto& prop : props ){
+        TiXmlElement* child = new TiXmlElement( "Property" );
+        child->SetAttribute( "name" , prop.first.c_str() );
+        child->SetAttribute( "value" , prop.second.c_str() );
+        element->LinkEndChild( child );
+    }
+    return element;
+}
+
+// the text of a document , the attributes are escaped by the printer
+std::string documentText( const TiXmlDocument& doc ){
+    TiXmlPrinter printer;
+    doc.Accept( &printer );
+    return printer.CStr();
+}
+}
+
+// open a session
+SortSession::SortSession()
+{
+    bool open = false;
+    m_valid = g_sessionOpen.compare_exchange_strong( open , true );
+    if( !m_valid )
+        slog( WARNING , GENERAL , "Another session is open , the renderer only keeps one scene at a time." );
+}
+
+// close the session
+SortSession::~SortSession()
+{
+    if( !m_valid )
+        return;
+    g_System.Reset( false );
+    MemoryFiles::Remove( SESSION_PREFIX );
+    g_sessionOpen = false;
+}
+
+// set the size of the image
+void SortSession::SetResolution( unsigned w , unsigned h )
+{
+    m_width = w;
+    m_height = h;
+}
+
+// set the number of threads
+void SortSession::SetThreadNum( unsigned n )
+{
+    m_threadNum = n;
+}
+
+// set the sampler
+void SortSession::SetSampler( const std::string& type , unsigned spp )
+{
+    m_sampler = type;
+    m_spp = spp;
+}
+
+// set the integrator
+void SortSession::SetIntegrator( const std::string& type , const SessionProperties& props )
+{
+    m_integrator.type = type;
+    m_integrator.props = props;
+}
+
+// set the camera
+void SortSession::SetCamera( const std::string& type , const SessionProperties& props )
+{
+    m_camera.type = type;
+    m_camera.props = props;
+}
+
+// set the material library
+void SortSession::SetMaterials( const std::string& xml )
+{
+    if( !m_valid )
+        return;
+    MemoryFiles::SetText( SESSION_MATERIALS , xml );
+    m_hasMaterials = true;
+}
+
+// add a mesh to the scene
+bool SortSession::AddMesh( const std::string& name , const MemoryMesh& mesh , const std::string& transform )
+{
+    if( !m_valid )
+        return false;
+    for( const auto& m : m_meshes ){
+        if( m.name == name ){
+            slog( WARNING , GENERAL , stringFormat( "A mesh with name %s already existed." , name.c_str() ) );
+            return false;
+        }
+    }
+    MemoryFiles::SetMesh( SESSION_MESH_PREFIX + name , mesh );
+    m_meshes.push_back( { name , transform } );
+    return true;
+}
+
+// add a light to the scene
+void SortSession::AddLight( const std::string& type , const SessionProperties& props )
+{
+    m_lights.push_back( { type , props } );
+}
+
+// remove the meshes and the lights
+void SortSession::ClearScene()
+{
+    if( m_valid )
+        MemoryFiles::Remove( SESSION_MESH_PREFIX );
+    m_meshes.clear();
+    m_lights.clear();
+}
+
+// render the image
+bool SortSession::Render( float* rgba )
+{
+    if( !m_valid || rgba == nullptr )
+        return false;
+
+    _updateScene();
+    MemoryFiles::SetText( SESSION_SETTINGS , _settingsText() );
+
+    // the scene is kept for the next rendering , it is only loaded again if some of it changed
+    g_System.SetOutputBuffer( rgba );
+    const bool done = g_System.Setup( SESSION_SETTINGS );
+    if( done )
+        g_System.Render();
+    g_System.Reset();
+    return done;
+}
+
+// register the scene
+void SortSession::_updateScene()
+{
+    TiXmlDocument doc;
+    TiXmlElement* root = new TiXmlElement( "Root" );
+    doc.LinkEndChild( root );
+
+    if( m_hasMaterials ){
+        TiXmlElement* material = new TiXmlElement( "Material" );
+        material->SetAttribute( "value" , SESSION_MATERIALS );
+        root->LinkEndChild( material );
+    }
+    TiXmlElement* accel = new TiXmlElement( "Accel" );
+    accel->SetAttribute( "type" , "bvh" );
+    root->LinkEndChild( accel );
+
+    for( const auto& mesh : m_meshes ){
+        TiXmlElement* model = new TiXmlElement( "Model" );
+        model->SetAttribute( "filename" , ( SESSION_MESH_PREFIX + mesh.name ).c_str() );
+        model->SetAttribute( "name" , mesh.name.c_str() );
+        if( !mesh.transform.empty() ){
+            TiXmlElement* transform = new TiXmlElement( "Transform" );
+            TiXmlElement* matrix = new TiXmlElement( "Matrix" );
+            matrix->SetAttribute( "value" , mesh.transform.c_str() );
+            transform->LinkEndChild( matrix );
+            model->LinkEndChild( transform );
+        }
+        root->LinkEndChild( model );
+    }
+    for( const auto& light : m_lights )
+        root->LinkEndChild( objectElement( "Light" , light.type , light.props ) );
+
+    // registering the same text again would bump its revision and the scene would be loaded again
+    const std::string text = documentText( doc );
+    if( text != m_sceneText ){
+        MemoryFiles::SetText( SESSION_SCENE , text );
+        m_sceneText = text;
+    }
+}
+
+// the text of the render settings
+std::string SortSession::_settingsText() const
+{
+    TiXmlDocument doc;
+    TiXmlElement* root = new TiXmlElement( "Root" );
+    doc.LinkEndChild( root );
+
+    TiXmlElement* scene = new TiXmlElement( "Scene" );
+    scene->SetAttribute( "value" , SESSION_SCENE );
+    root->LinkEndChild( scene );
+
+    TiXmlElement* threads = new TiXmlElement( "ThreadNum" );
+    threads->SetAttribute( "name" , (int)m_threadNum );
+    root->LinkEndChild( threads );
+
+    root->LinkEndChild( objectElement( "Integrator" , m_integrator.type , m_integrator.props ) );
+
+    TiXmlElement* size = new TiXmlElement( "RenderTargetSize" );
+    size->SetAttribute( "w" , (int)m_width );
+    size->SetAttribute( "h" , (int)m_height );
+    root->LinkEndChild( size );
+
+    TiXmlElement* sampler = new TiXmlElement( "Sampler" );
+    sampler->SetAttribute( "type" , m_sampler.c_str() );
+    sampler->SetAttribute( "round" , (int)m_spp );
+    root->LinkEndChild( sampler );
+
+    // the pixels are square unless the camera says otherwise
+    SessionProperties props = m_camera.props;
+    bool aspect = false;
+    for( const auto& prop : props )
+        aspect |= ( prop.first == "aspect" );
+    if( !aspect )
+        props.push_back( { "aspect" , "1 1" } );
+    root->LinkEndChild( objectElement( "Camera" , m_camera.type , props ) );
+
+    return documentText( doc );
+}
@@ -0,0 +1,133 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "utility/memoryfile.h"
+#include <string>
+#include <vector>
+#include <utility>
+
+//! @brief The properties of a light, a camera or an integrator, pairs of names and values as in the xml files.
+typedef std::vector<std::pair<std::string,std::string>> SessionProperties;
+
+//! @brief The renderer embedded in another application.
+/**
+ * A session describes the scene and the settings to the renderer without any file on disk, the meshes are read from
+ * the arrays of the application in place and the image is copied to a buffer of the application. Scenes are kept
+ * between renderings, an unchanged scene is not loaded again, edited lights and materials are updated in place.
+ *
+ * The renderer keeps its managers process wide, only one session is open at a time. A session opened while another
+ * one is still open is invalid and renders nothing.
+ */
+class SortSession
+{
+public:
+    //! @brief Open a session, it is invalid if another one is open.
+    SortSession();
+
+    //! @brief Close the session, the scene and the files in memory are released.
+    ~SortSession();
+
+    SortSession( const SortSession& ) = delete;
+    SortSession& operator = ( const SortSession& ) = delete;
+
+    //! @brief Whether the session is the open one.
+    bool IsValid() const { return m_valid; }
+
+    //! @brief Set the size of the image.
+    //! @param w        The width of the image.
+    //! @param h        The height of the image.
+    void SetResolution( unsigned w , unsigned h );
+
+    //! @brief Set the number of threads rendering the image.
+    //! @param n        The number of threads.
+    void SetThreadNum( unsigned n );
+
+    //! @brief Set the sampler and the number of samples per pixel.
+    //! @param type     The type of the sampler, like 'stratified'.
+    //! @param spp      The number of samples per pixel.
+    void SetSampler( const std::string& type , unsigned spp );
+
+    //! @brief Set the integrator.
+    //! @param type     The type of the integrator, like 'pt'.
+    //! @param props    The properties of the integrator.
+    void SetIntegrator( const std::string& type , const SessionProperties& props = SessionProperties() );
+
+    //! @brief Set the camera.
+    //! @param type     The type of the camera, like 'perspective'.
+    //! @param props    The properties of the camera, like 'eye' and 'target'.
+    void SetCamera( const std::string& type , const SessionProperties& props );
+
+    //! @brief Set the material library, the meshes refer to the materials by their names.
+    //! @param xml      The text of the library, as in the material files.
+    void SetMaterials( const std::string& xml );
+
+    //! @brief Add a mesh to the scene, its arrays have to stay valid until the scene is cleared or the session is closed.
+    //! @param name     The name of the mesh, it is unique in the scene.
+    //! @param mesh     The arrays of the mesh.
+    //! @param transform The transform of the mesh as in the scene files, like 't 0 1 0', the arrays are copied unless it is empty.
+    //! @return         False if the name is taken.
+    bool AddMesh( const std::string& name , const MemoryMesh& mesh , const std::string& transform = std::string() );
+
+    //! @brief Add a light to the scene.
+    //! @param type     The type of the light, like 'area' or 'skylight'.
+    //! @param props    The properties of the light.
+    void AddLight( const std::string& type , const SessionProperties& props );
+
+    //! @brief Remove the meshes and the lights of the scene, the settings and the materials are kept.
+    void ClearScene();
+
+    //! @brief Render the image.
+    //! @param rgba     Four floats for each pixel in rows from the top, the alpha channel is one.
+    //! @return         False if the session is invalid or the scene can't be loaded.
+    bool Render( float* rgba );
+
+private:
+    //! @brief A mesh of the scene.
+    struct SessionMesh
+    {
+        std::string     name;       /**< The name of the mesh in the scene. */
+        std::string     transform;  /**< The transform of the mesh, it is empty for the identity. */
+    };
+
+    //! @brief A light, a camera or an integrator.
+    struct SessionObject
+    {
+        std::string         type;   /**< The type of the object. */
+        SessionProperties   props;  /**< The properties of the object. */
+    };
+
+    bool                        m_valid = false;            /**< Whether the session is the open one. */
+    unsigned                    m_width = 1280;             /**< The width of the image. */
+    unsigned                    m_height = 720;             /**< The height of the image. */
+    unsigned                    m_threadNum = 1;            /**< The number of threads. */
+    std::string                 m_sampler = "stratified";   /**< The type of the sampler. */
+    unsigned                    m_spp = 16;                 /**< The number of samples per pixel. */
+    SessionObject               m_integrator{ "pt" , SessionProperties() };    /**< The integrator. */
+    SessionObject               m_camera{ "perspective" , SessionProperties() };    /**< The camera. */
+    bool                        m_hasMaterials = false;     /**< Whether there is a material library. */
+    std::vector<SessionMesh>    m_meshes;                   /**< The meshes of the scene. */
+    std::vector<SessionObject>  m_lights;                   /**< The lights of the scene. */
+    std::string                 m_sceneText;                /**< The text of the scene registered last time. */
+
+    //! @brief Register the scene, it is only registered again if it changed so that the scene of the last rendering is reused.
+    void _updateScene();
+
+    //! @brief The text of the render settings.
+    std::string _settingsText() const;
+};
@@ -17,21 +17,106 @@
 
 #include "bsdf.h"
 #include "bxdf.h"
+#include "lambert.h"
+#include "orennayar.h"
+#include "microfacet.h"
 #include "geometry/intersection.h"
 #include "sampler/sample.h"
 #include "utility/sassert.h"
+#include "material/material_program.h"
+#include "material/shadingstats.h"
+
+// call a bxdf through its final type if it is one of the tagged closures , the calls are resolved statically then
+template< class Visitor >
+static inline typename Visitor::result_type visitBxdf( const Bxdf* bxdf , const Visitor& visitor )
+{
+	switch( bxdf->GetClosure() )
+	{
+	case BXDF_CLOSURE_LAMBERT:								return visitor( *static_cast<const Lambert*>( bxdf ) );
+	case BXDF_CLOSURE_ORENNAYAR:							return visitor( *static_cast<const OrenNayar*>( bxdf ) );
+	case BXDF_CLOSURE_MF_REFLECTION_BLINN_COOKTORRANCE:		return visitor( *static_cast<const MicroFacetReflectionBlinnCookTorrance*>( bxdf ) );
+	case BXDF_CLOSURE_MF_REFLECTION_BECKMANN_COOKTORRANCE:	return visitor( *static_cast<const MicroFacetReflectionBeckmannCookTorrance*>( bxdf ) );
+	case BXDF_CLOSURE_MF_REFLECTION_GGX_COOKTORRANCE:		return visitor( *static_cast<const MicroFacetReflectionGGXCookTorrance*>( bxdf ) );
+	case BXDF_CLOSURE_MF_REFLECTION_GGX_SMITHJOINT:			return visitor( *static_cast<const MicroFacetReflectionGGXSmithJoint*>( bxdf ) );
+	case BXDF_CLOSURE_MF_REFRACTION_BLINN_COOKTORRANCE:		return visitor( *static_cast<const MicroFacetRefractionBlinnCookTorrance*>( bxdf ) );
+	case BXDF_CLOSURE_MF_REFRACTION_GGX_COOKTORRANCE:		return visitor( *static_cast<const MicroFacetRefractionGGXCookTorrance*>( bxdf ) );
+	case BXDF_CLOSURE_MF_REFRACTION_GGX_SMITHJOINT:			return visitor( *static_cast<const MicroFacetRefractionGGXSmithJoint*>( bxdf ) );
+	default:												return visitor( *bxdf );
+	}
+}
+
+// evaluate a bxdf
+struct BxdfEvaluate
+{
+	typedef Spectrum result_type;
+	const Vector& wo;
+	const Vector& wi;
+
+	template< class T >
+	Spectrum operator()( const T& bxdf ) const { return bxdf.f( wo , wi ); }
+};
+
+// evaluate a bxdf for a batch of directions
+struct BxdfEvaluateBatch
+{
+	typedef void result_type;
+	const Vector& wo;
+	const Vector* wi;
+	Spectrum* f;
+	unsigned count;
+
+	template< class T >
+	void operator()( const T& bxdf ) const { bxdf.f_batch( wo , wi , f , count ); }
+};
+
+// sample a direction from a bxdf
+struct BxdfSample
+{
+	typedef Spectrum result_type;
+	const Vector& wo;
+	Vector& wi;
+	const BsdfSample& bs;
+	float* pdf;
+
+	template< class T >
+	Spectrum operator()( const T& bxdf ) const { return bxdf.sample_f( wo , wi , bs , pdf ); }
+};
+
+// the pdf of a direction sampled from a bxdf
+struct BxdfPdf
+{
+	typedef float result_type;
+	const Vector& wo;
+	const Vector& wi;
+
+	template< class T >
+	float operator()( const T& bxdf ) const { return bxdf.Pdf( wo , wi ); }
+};
 
 // constructor
-Bsdf::Bsdf( const Intersection* _intersect ) : intersect( *_intersect )
+Bsdf::Bsdf( const Intersection* intersect )
 {
-	nn = intersect.normal;
-	tn = Normalize(Cross( nn , intersect.tangent ));
+	nn = intersect->normal;
+	tn = Normalize(Cross( nn , intersect->tangent ));
 	sn = Cross( tn , nn );
+
+	m_texLookup = { intersect->u , intersect->v , intersect->dudx , intersect->dvdx , intersect->dudy , intersect->dvdy };
+}
+
+// construct the deferred bxdfs
+void Bsdf::construct() const
+{
+	// the program adds the bxdfs to the bsdf , it is only executed once
+	const MaterialProgram* program = m_program;
+	m_program = nullptr;
+	program->Execute( const_cast<Bsdf*>( this ) , m_storage );
 }
 
 // get the number of components in current bsdf
 unsigned Bsdf::NumComponents( BXDF_TYPE type ) const
 {
+	resolve();
+
 	unsigned count = 0;
 	for( unsigned i = 0 ; i < m_bxdfCount ; i++ )
 	{
@@ -53,6 +138,9 @@ void Bsdf::AddBxdf( Bxdf* bxdf )
 // evaluate bxdf
 Spectrum Bsdf::f( const Vector& wo , const Vector& wi , BXDF_TYPE type ) const
 {
+	SHADING_STATS( ShadingTimer timer( m_materialId , 0 ) );
+	resolve();
+
 	// the result
 	Spectrum r;
 
@@ -62,12 +150,41 @@ Spectrum Bsdf::f( const Vector& wo , const Vector& wi , BXDF_TYPE type ) const
 	for( unsigned i = 0 ; i < m_bxdfCount ; i++ )
 	{
 		if( m_bxdf[i]->MatchFlag( type ) )
-			r += m_bxdf[i]->f( swo , swi ) * m_bxdf[i]->m_weight;
+			r += visitBxdf( m_bxdf[i] , BxdfEvaluate{ swo , swi } ) * m_bxdf[i]->m_weight;
 	}
 
 	return r;
 }
 
+// evaluate bxdf for a batch of directions
+void Bsdf::f( const Vector& wo , const Vector* wi , Spectrum* f , unsigned count , BXDF_TYPE type ) const
+{
+	SHADING_STATS( ShadingTimer timer( m_materialId , 0 ) );
+	resolve();
+
+	const Vector swo = worldToLocal( wo );
+
+	Vector swi[BXDF_BATCH_SIZE];
+	Spectrum v[BXDF_BATCH_SIZE];
+	for( unsigned s = 0 ; s < count ; s += BXDF_BATCH_SIZE )
+	{
+		const unsigned n = min( count - s , (unsigned)BXDF_BATCH_SIZE );
+		for( unsigned i = 0 ; i < n ; ++i ){
+			swi[i] = worldToLocal( wi[s+i] );
+			f[s+i] = 0.0f;
+		}
+
+		for( unsigned k = 0 ; k < m_bxdfCount ; k++ )
+		{
+			if( !m_bxdf[k]->MatchFlag( type ) )
+				continue;
+			visitBxdf( m_bxdf[k] , BxdfEvaluateBatch{ swo , swi , v , n } );
+			for( unsigned i = 0 ; i < n ; ++i )
+				f[s+i] += v[i] * m_bxdf[k]->m_weight;
+		}
+	}
+}
+
 // transform vector from world coordinate to shading coordinate
 Vector Bsdf::worldToLocal( const Vector& v ) const
 {
@@ -82,54 +199,102 @@ Vector Bsdf::localToWorld( const Vector& v ) const
 					v.x * sn.z + v.y * nn.z + v.z * tn.z );
 }
 
+// the probability of picking each bxdf in sampling
+unsigned Bsdf::pickProbabilities( BXDF_TYPE type , float* prob ) const
+{
+	// bxdfs are picked by their weights times a rough estimation of their albedo
+	unsigned count = 0;
+	float total = 0.0f;
+	for( unsigned i = 0 ; i < m_bxdfCount ; ++i )
+	{
+		prob[i] = 0.0f;
+		if( !m_bxdf[i]->MatchFlag( type ) )
+			continue;
+		prob[i] = max( 0.0f , m_bxdf[i]->m_weight.GetIntensity() * m_bxdf[i]->Albedo() );
+		total += prob[i];
+		++count;
+	}
+
+	// fall back to picking them uniformly if nothing could be estimated
+	for( unsigned i = 0 ; i < m_bxdfCount ; ++i )
+	{
+		if( total > 0.0f )
+			prob[i] /= total;
+		else if( m_bxdf[i]->MatchFlag( type ) )
+			prob[i] = 1.0f / count;
+	}
+	return count;
+}
+
 // sample a ray from bsdf
 Spectrum Bsdf::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pdf , BXDF_TYPE type , BXDF_TYPE* bxdf_type ) const
 {
-	unsigned com_num = NumComponents(type);
+	SHADING_STATS( ShadingTimer timer( m_materialId , 0 ) );
+	resolve();
+
+	float prob[MAX_BXDF_COUNT];
+	unsigned com_num = pickProbabilities( type , prob );
 	if( com_num == 0 )
 	{
 		if( pdf ) *pdf = 0.0f;
 		if( bxdf_type ) *bxdf_type = BXDF_NONE;
 		return 0.0f;
 	}
-	int bsdf_id = min( (int)(bs.t*(float)com_num) , (int)(com_num-1) );
-	Bxdf* bxdf = 0;
-	int count = bsdf_id;
+
+	// pick a bxdf by the probabilities
+	unsigned picked = m_bxdfCount;
+	float cdf = 0.0f;
 	for( unsigned i = 0 ; i < m_bxdfCount ; ++i )
-		if( m_bxdf[i]->MatchFlag(type) ){
-			if( count == 0 )
-			{
-				bxdf = m_bxdf[i];
-				break;
-			}
-			count--;
-		}
+	{
+		if( prob[i] <= 0.0f )
+			continue;
+		picked = i;
+		cdf += prob[i];
+		if( bs.t < cdf )
+			break;
+	}
 
-	sAssert( bxdf != 0 , BSDF );
+	sAssert( picked < m_bxdfCount , BSDF );
+	const Bxdf* bxdf = m_bxdf[picked];
 
 	// transform the 'wo' from world space to shading coordinate
 	Vector swo = Normalize(worldToLocal( wo ));
 
 	// sample the direction
-	Spectrum t = bxdf->sample_f( swo , wi , bs , pdf ) * bxdf->m_weight;
+	float bxdf_pdf = 0.0f;
+	Spectrum t = visitBxdf( bxdf , BxdfSample{ swo , wi , bs , &bxdf_pdf } ) * bxdf->m_weight;
 
 	// if there is no properbility of sampling that direction , just return 0.0f
-	if( pdf && *pdf == 0.0f ) return 0.0f;
+	if( bxdf_pdf == 0.0f )
+	{
+		if( pdf ) *pdf = 0.0f;
+		return 0.0f;
+	}
 	if( bxdf_type ) *bxdf_type = bxdf->GetType();
 
-	// setup pdf
-	if( pdf  && ( com_num > 1 ) )
+	// the pdf of the direction is the one of the whole mixture , MIS needs it even if only one bxdf is evaluated
+	float mix_pdf = prob[picked] * bxdf_pdf;
+	if( com_num > 1 )
 	{
 		for( unsigned i = 0; i < m_bxdfCount ; ++i )
-			if( m_bxdf[i] != bxdf && m_bxdf[i]->MatchFlag( type ) )
-				*pdf += m_bxdf[i]->Pdf( wo , wi );
+			if( i != picked && prob[i] > 0.0f )
+				mix_pdf += prob[i] * visitBxdf( m_bxdf[i] , BxdfPdf{ swo , wi } );
 	}
-	if( pdf ) *pdf /= com_num;
-	
-	for( unsigned i = 0 ; i < m_bxdfCount ; ++i )
-		if( bxdf != m_bxdf[i] && m_bxdf[i]->MatchFlag(type) )
-			t += m_bxdf[i]->f(wo,wi) * m_bxdf[i]->m_weight;
-	
+	if( pdf ) *pdf = mix_pdf;
+
+	if( m_stochastic )
+	{
+		// one-sample estimation , only the picked bxdf is evaluated and it is scaled so that dividing it
+		// by the pdf of the mixture is the same as dividing it by the pdf of picking and sampling it
+		t *= mix_pdf / ( prob[picked] * bxdf_pdf );
+	}
+	else
+	{
+		for( unsigned i = 0 ; i < m_bxdfCount ; ++i )
+			if( i != picked && m_bxdf[i]->MatchFlag(type) )
+				t += visitBxdf( m_bxdf[i] , BxdfEvaluate{ swo , wi } ) * m_bxdf[i]->m_weight;
+	}
+
 	// transform the direction back
 	wi = localToWorld( wi );
 
@@ -139,18 +304,47 @@ Spectrum Bsdf::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs ,
 // get the pdf according to sampled direction
 float Bsdf::Pdf( const Vector& wo , const Vector& wi , BXDF_TYPE type ) const
 {
+	SHADING_STATS( ShadingTimer timer( m_materialId , 0 ) );
+	resolve();
+
 	Vector lwo = worldToLocal( wo );
 	Vector lwi = worldToLocal( wi );
 
-    unsigned int count = 0;
+	float prob[MAX_BXDF_COUNT];
+	pickProbabilities( type , prob );
+
 	float pdf = 0.0f;
 	for( unsigned i = 0 ; i < m_bxdfCount ; ++i )
-		if( m_bxdf[i]->MatchFlag( type ) )
-        {
-            ++count;
-            pdf += m_bxdf[i]->Pdf( lwo , lwi );
-        }
-    if( count )
-        pdf /= count;
+		if( prob[i] > 0.0f )
+			pdf += prob[i] * visitBxdf( m_bxdf[i] , BxdfPdf{ lwo , lwi } );
 	return pdf;
 }
+
+// evaluate bxdf and the pdf of the direction together
+Spectrum Bsdf::EvalAndPdf( const Vector& wo , const Vector& wi , float* pdf , BXDF_TYPE type ) const
+{
+	SHADING_STATS( ShadingTimer timer( m_materialId , 0 ) );
+	resolve();
+
+	const Vector lwo = worldToLocal( wo );
+	const Vector lwi = worldToLocal( wi );
+
+	float prob[MAX_BXDF_COUNT];
+	if( pdf )
+	{
+		pickProbabilities( type , prob );
+		*pdf = 0.0f;
+	}
+
+	Spectrum r;
+	for( unsigned i = 0 ; i < m_bxdfCount ; ++i )
+	{
+		if( !m_bxdf[i]->MatchFlag( type ) )
+			continue;
+		r += visitBxdf( m_bxdf[i] , BxdfEvaluate{ lwo , lwi } ) * m_bxdf[i]->m_weight;
+		if( pdf && prob[i] > 0.0f )
+			*pdf += prob[i] * visitBxdf( m_bxdf[i] , BxdfPdf{ lwo , lwi } );
+	}
+
+	return r;
+}
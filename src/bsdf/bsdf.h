@@ -20,12 +20,14 @@
 #include "sort.h"
 #include "spectrum/spectrum.h"
 #include "math/vector3.h"
+#include "math/fastmath.h"
 #include "utility/enum.h"
-#include "geometry/intersection.h"
+#include "texture/texture.h"
 
 class Bxdf;
 class Intersection;
 class BsdfSample;
+class MaterialProgram;
 
 #define	MAX_BXDF_COUNT 8
 
@@ -46,6 +48,34 @@ public:
 	//! @param The bxdf to be added.
 	void AddBxdf( Bxdf* bxdf );
 
+	//! @brief Defer the construction of the bxdfs until the bsdf is evaluated the first time.
+    //!
+    //! Textures are not sampled and no bxdf is constructed for hits that are never shaded, like the ones
+    //! only contributing emission or terminated by russian roulette.
+    //! @param program  The program of the material constructing the bxdfs.
+    //! @param storage  The memory of the slots of the bxdfs.
+	void Defer( const MaterialProgram* program , char* storage ) { m_program = program; m_storage = storage; }
+
+	//! @brief Set the id of the material creating the bsdf, the shading statistics are counted by it.
+    //! @param id   The id of the material.
+	void SetMaterialID( unsigned id ) { m_materialId = id; }
+
+	//! @brief Evaluate only the sampled bxdf in importance sampling.
+    //!
+    //! A bxdf is picked by its weight and its albedo, only the picked one is evaluated in sampling, the others
+    //! are not. The pdf of the direction is still the one of all bxdfs so that MIS stays unbiased.
+    //! @param stochastic   Whether only the sampled bxdf is evaluated.
+	void SetStochastic( bool stochastic ) { m_stochastic = stochastic; }
+
+	//! @brief Get the number of bxdfs in the BSDF, the deferred bxdfs are constructed.
+    //! @return The number of bxdfs.
+	unsigned GetBxdfCount() const { resolve(); return m_bxdfCount; }
+
+	//! @brief Get a bxdf in the BSDF, the deferred bxdfs are constructed.
+    //! @param i    The index of the bxdf.
+    //! @return     The bxdf.
+	Bxdf* GetBxdf( unsigned i ) const { resolve(); return m_bxdf[i]; }
+
 	//! @brief Evalute the value of BSDF based on the incoming and outgoing directions.
     //! @param wo   Exitance direction in shading coordinate.
     //! @param wi   Incomiing direction in shading coordinate.
@@ -53,6 +83,17 @@ public:
     //! @return     The evaluted value of the BSDF.
 	Spectrum f( const Vector& wo , const Vector& wi , BXDF_TYPE type = BXDF_ALL ) const;
 
+	//! @brief Evalute the value of BSDF for many incoming directions sharing the outgoing direction.
+    //!
+    //! The directions are evaluated in batches by the bxdfs, it is cheaper than evaluating them one by one
+    //! when one bsdf is connected to many light samples.
+    //! @param wo       Exitance direction in world coordinate.
+    //! @param wi       Incoming directions in world coordinate.
+    //! @param f        The evaluated value of each direction.
+    //! @param count    The number of directions.
+    //! @param type     The specific type to be considered.
+	void f( const Vector& wo , const Vector* wi , Spectrum* f , unsigned count , BXDF_TYPE type = BXDF_ALL ) const;
+
     //! @brief Importance sampling for the bsdf.
     //! @param wo   Exitance direction in shading coordinate.
     //! @param wi   Incomiing direction in shading coordinate.
@@ -70,20 +111,48 @@ public:
     //! @return     The probabilty of choosing the out-going direction based on the incoming direction.
 	float Pdf( const Vector& wo , const Vector& wi , BXDF_TYPE type = BXDF_ALL ) const;
 
-	//! @brief Get intersection information of the point at which the bsdf is evaluated.
-    //! @return The intersection information of the point at which the bsdf is evaluated.
-	const Intersection* GetIntersection() const { return &intersect; }
+    //! @brief Evalute the value of BSDF and the pdf of sampling the incoming direction together.
+    //!
+    //! Both directions are transformed to shading coordinate once and all bxdfs are visited in a single pass,
+    //! it is cheaper than calling f and Pdf separately when both of them are needed, like in MIS.
+    //! @param wo   Exitance direction in world coordinate.
+    //! @param wi   Incoming direction in world coordinate.
+    //! @param pdf  Probability density of sampling the incoming direction, it is not evaluated if it is nullptr.
+    //! @param type The specific bxdf type it considers during evaluation.
+    //! @return     The evaluted value of the BSDF.
+	Spectrum EvalAndPdf( const Vector& wo , const Vector& wi , float* pdf , BXDF_TYPE type = BXDF_ALL ) const;
+
+	//! @brief Get the texture coordinate of the point at which the bsdf is evaluated.
+    //! @return The texture coordinate and its change to the neighbouring pixels.
+	const TexLookup& GetTexLookup() const { return m_texLookup; }
 
 private:
     Bxdf*	m_bxdf[MAX_BXDF_COUNT] = {};    /**< List of Bxdf in the BSDF. */
 	unsigned m_bxdfCount = 0;               /**< Number of Bxdf in the BSDF. */
 
+    bool    m_stochastic = false;   /**< Whether only the sampled bxdf is evaluated in sampling. */
+    unsigned m_materialId = 0;      /**< The id of the material creating the bsdf. */
+
+    mutable const MaterialProgram*  m_program = nullptr;    /**< The program constructing the deferred bxdfs. */
+    char*   m_storage = nullptr;    /**< The memory of the slots of the deferred bxdfs. */
+
     Vector nn;  /**< Normal at the point to be evaluted. */
     Vector sn;  /**< Bi-tangent at the point to be evaluated. */
     Vector tn;  /**< Tangent at the point to be evaluted. */
 
-	// intersection for the bsdf
-	const Intersection intersect;   /**<    Intersection information of the point to be evaluted. */
+    TexLookup m_texLookup;  /**< Texture coordinate at the point to be evaluated, the rest of the intersection is not kept. */
+
+    //! @brief The probability of picking each bxdf in sampling.
+    //! @param type The specific bxdf type it considers, the others are never picked.
+    //! @param prob The probability of each bxdf.
+    //! @return     The number of bxdfs matching the type.
+    unsigned pickProbabilities( BXDF_TYPE type , float* prob ) const;
+
+    //! @brief Construct the deferred bxdfs if there are any.
+    void resolve() const { if( m_program ) construct(); }
+
+    //! @brief Execute the program of the material to construct the deferred bxdfs.
+    void construct() const;
 
     //! @brief Transform a vector from world coordinate to shading coordinate.
     //! @param v    A vector in world coordiante.
@@ -132,26 +201,31 @@ inline bool SameHemisphere(const Vector &w, const Vector &wp) {
 }
 
 inline float SphericalTheta(const Vector &v) {
-    return acosf(clamp(v.y, -1.f, 1.f));
+    return Acos(clamp(v.y, -1.f, 1.f));
 }
 
 inline float SphericalPhi(const Vector &v) {
-    float p = atan2f(v.z, v.x);
+    float p = Atan2(v.z, v.x);
     return (p < 0.f) ? p + 2.f*PI : p;
 }
 
 inline Vector SphericalVec( float theta , float phi ){
-	float x = sin( theta ) * cos( phi );
-	float y = cos( theta );
-	float z = sin( theta ) * sin( phi );
+	float sin_theta , cos_theta , sin_phi , cos_phi;
+	SinCos( theta , sin_theta , cos_theta );
+	SinCos( phi , sin_phi , cos_phi );
+	float x = sin_theta * cos_phi;
+	float y = cos_theta;
+	float z = sin_theta * sin_phi;
 
 	return Vector( x , y , z );
 }
 
 inline Vector SphericalVec( float sintheta , float costheta , float phi ){
-	float x = sintheta * cos( phi );
+	float sin_phi , cos_phi;
+	SinCos( phi , sin_phi , cos_phi );
+	float x = sintheta * cos_phi;
 	float y = costheta;
-	float z = sintheta * sin( phi );
+	float z = sintheta * sin_phi;
 	return Vector( x , y , z );
 }
 
@@ -19,6 +19,13 @@
 #include "utility/samplemethod.h"
 #include "sampler/sample.h"
 
+// evaluate a batch of directions one by one
+void Bxdf::f_batch( const Vector& wo , const Vector* wi , Spectrum* f , unsigned count ) const
+{
+	for( unsigned i = 0 ; i < count ; ++i )
+		f[i] = this->f( wo , wi[i] );
+}
+
 // sample a direction randomly
 Spectrum Bxdf::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pdf ) const
 {
@@ -23,6 +23,9 @@
 
 class BsdfSample;
 
+//! The maximum number of directions a bxdf evaluates in one batch.
+#define BXDF_BATCH_SIZE 8
+
 //! @brief Brdf or btdf.
 /**
  * Bxdf is either brdf(bidirectional reflection density function) or btdf(
@@ -41,6 +44,15 @@ public:
     //! @param wi   Incomiing direction in shading coordinate.
     //! @return     The evaluted BRDF value.
 	virtual Spectrum f( const Vector& wo , const Vector& wi ) const = 0;
+
+    //! @brief Evaluate the BRDF for a batch of incident directions sharing the exitant direction.
+    //!
+    //! Each direction is evaluated on its own by default, bxdfs with vectorized kernels override it.
+    //! @param wo       Exitance direction in shading coordinate.
+    //! @param wi       Incident directions in shading coordinate.
+    //! @param f        The evaluated BRDF value of each direction.
+    //! @param count    The number of directions, it is at most BXDF_BATCH_SIZE.
+    virtual void f_batch( const Vector& wo , const Vector* wi , Spectrum* f , unsigned count ) const;
     
     //! @brief Importance sampling for the bxdf.
     //!
@@ -66,6 +78,12 @@ public:
     //! @return     The probabilty of choosing the out-going direction based on the incoming direction.
 	virtual float Pdf( const Vector& wo , const Vector& wi ) const;
 
+	//! @brief A rough estimation of the albedo of the bxdf.
+    //!
+    //! The bsdf picks bxdfs in proportion to their weights times the estimation in importance sampling.
+    //! @return The estimated albedo, one by default.
+	virtual float Albedo() const { return 1.0f; }
+
 	//! @brief  Check the type of the bxdf, it shouldn't be overriden by derived classes.
     //! @param type     The type to check.
     //! @return         If the bxdf belongs to the input type.
@@ -76,8 +94,13 @@ public:
     //! @return The specific type of the bxdf.
 	virtual BXDF_TYPE GetType() const final { return m_type; }
 
+	//! @brief  Get the concrete type of the bxdf.
+    //! @return The closure tag, the bsdf calls the tagged bxdfs through their final types.
+	BXDF_CLOSURE GetClosure() const { return m_closure; }
+
 	Spectrum	m_weight;           /**< The weight for the bxdf, usually between 0 and 1. */
 
 protected:
 	BXDF_TYPE m_type = BXDF_NONE;   /**< The specific type of the bxdf. */
+	BXDF_CLOSURE m_closure = BXDF_CLOSURE_GENERIC;  /**< The concrete type of the bxdf, only set by final classes. */
 };
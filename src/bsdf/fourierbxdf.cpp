@@ -18,9 +18,13 @@
 // include the header file
 #include "fourierbxdf.h"
 #include "bsdf.h"
-#include "managers/memmanager.h"
+#include "managers/fouriermanager.h"
 #include "utility/samplemethod.h"
-#include <fstream>
+#include "sampler/sample.h"
+
+#if defined(SORT_SIMD_SSE)
+#include <xmmintrin.h>
+#endif
 
 // constructor
 FourierBxdf::FourierBxdf()
@@ -30,76 +34,15 @@ FourierBxdf::FourierBxdf()
 
 void FourierBxdf::LoadData( const string& filename )
 {
-    ifstream file( filename.c_str(), ios::binary);
-    if( !file.is_open() )
-        return;
-    
-    // We assume both of the system and the file are of the same endian, which should be little endian on Intel chip.
-    auto ReadFile = [&]( char* data , int sizeInByte )-> bool {
-        file.read( data , sizeInByte );
-        return sizeInByte == file.gcount();
-    };
-    
-    const char* header = "SCATFUN\x01";
-    char file_header[8];
-    memset( file_header , 0 , sizeof( file_header ) );
-    ReadFile( file_header , 8 );
-    if( memcmp( file_header , header , 8 ) != 0 )
-        return;
-    
-    int flags = 0, coeff = 0, unused[4];
-    std::unique_ptr<int[]> offsetAndLength;
-    
-    if( !ReadFile( (char*)&flags , 4 ) || flags != 1 ) {file.close(); return;}
-    if( !ReadFile( (char*)&bsdfTable.nMu , 4 ) || bsdfTable.nMu <= 1 ) {file.close(); return;}
-    if( !ReadFile( (char*)&coeff , 4 ) || coeff <= 0 ) {file.close(); return;}
-    if( !ReadFile( (char*)&bsdfTable.nMax , 4 ) || bsdfTable.nMax <= 0 ) {file.close(); return;}
-    if( !ReadFile( (char*)&bsdfTable.nChannels , 4 ) || (bsdfTable.nChannels != 1 && bsdfTable.nChannels != 3) ) {file.close(); return;}
-    if( !ReadFile( (char*)unused , 16 ) ) {file.close(); return;}
-    if( !ReadFile( (char*)&bsdfTable.eta , 4 ) ) {file.close(); return;}
-    if( !ReadFile( (char*)unused , 16 ) ) {file.close(); return;}
-    
-    const int sqMu = bsdfTable.nMu * bsdfTable.nMu;
-    bsdfTable.mu = new float[bsdfTable.nMu];
-    bsdfTable.cdf = new float[sqMu];
-    offsetAndLength.reset( new int[sqMu * 2] );
-    bsdfTable.m = new int[sqMu];
-    bsdfTable.aOffset = new int[sqMu];
-    bsdfTable.a = new float[coeff];
-    bsdfTable.a0 = new float[sqMu];
-    bsdfTable.recip = new float[bsdfTable.nMu];
-    
-    if(!ReadFile( (char*)bsdfTable.mu , bsdfTable.nMu * sizeof(float) ) ||
-       !ReadFile( (char*)bsdfTable.cdf , sqMu * sizeof(float) ) ||
-       !ReadFile( (char*)offsetAndLength.get() , 2 * sqMu * sizeof(int) ) ||
-       !ReadFile( (char*)bsdfTable.a , coeff * sizeof( float ) ) )
-        {file.close(); return;}
-    
-    for( int i = 0 ; i < bsdfTable.nMu * bsdfTable.nMu ; ++i ){
-        bsdfTable.aOffset[i] = offsetAndLength[2*i];
-        bsdfTable.m[i] = offsetAndLength[2*i+1];
-        bsdfTable.a0[i] = ( bsdfTable.m[i] > 0 )?bsdfTable.a[offsetAndLength[2*i]]:0.0f;
-    }
-    
-    bsdfTable.recip[0] = 0.0f;
-    for( int i = 1 ; i < bsdfTable.nMu ; ++i )
-        bsdfTable.recip[i] = 1.0f / (float) i;
-    
-    file.close();
-    
-    Vector wo = Vector( -.5f , .8f , -.5f );
-    Vector wi = Vector( .4 , .7 , .52f );
-    auto spec = f( wo , wi );
-    const float YWeight[3] = {0.212671f, 0.715160f, 0.072169f};
-    float t = spec.GetR() * YWeight[0] + spec.GetG() * YWeight[1] + spec.GetB() * YWeight[2];
-    
-    float delta = fabs( 2.679294 - t );
-    int a = 0;
+    m_table = FourierManager::GetSingleton().Load( filename );
 }
 
 // evaluate bxdf
 Spectrum FourierBxdf::f( const Vector& wo , const Vector& wi ) const
 {
+    if( !m_table )
+        return 0.0f;
+
     const float muI = CosTheta( -wi );
     const float muO = CosTheta( wo );
     const float dPhi = CosDPhi( wo , -wi );
@@ -110,31 +53,36 @@ Spectrum FourierBxdf::f( const Vector& wo , const Vector& wi ) const
         !getCatmullRomWeights( muO , offsetO , weightsO ) )
         return 0.0f;
     
-    float* ak = SORT_MALLOC_ARRAY(float, bsdfTable.nMax * bsdfTable.nChannels );
-    memset( ak , 0 , sizeof( float ) * bsdfTable.nMax * bsdfTable.nChannels );
-    int nMax = blendCoefficients( ak , bsdfTable.nChannels , offsetI, offsetO, weightsI, weightsO );
+    alignas(16) float ak[ 3 * FOURIER_MAX_ORDER ];
+    memset( ak , 0 , sizeof( float ) * m_table->nMax * m_table->nChannels );
+    int nMax = blendCoefficients( ak , m_table->nChannels , offsetI, offsetO, weightsI, weightsO );
     
     float Y = max( 0.0f , fourier( ak , nMax , dPhi ) );
     float scale = ( muI != 0.0f ) ? ( 1 / fabs(muI) ) : 0.0f;
     if( muI * muO > 0.0f ){
-        float eta = ( muI > 0.0f ) ? 1 / bsdfTable.eta : bsdfTable.eta;
+        float eta = ( muI > 0.0f ) ? 1 / m_table->eta : m_table->eta;
         scale *= eta * eta;
     }
     
-    if( bsdfTable.nChannels == 1 )
+    if( m_table->nChannels == 1 )
         return scale * Y;
     
-    float R = fourier( ak + 1 * bsdfTable.nMax , nMax , dPhi );
-    float B = fourier( ak + 2 * bsdfTable.nMax , nMax , dPhi );
+    float R = fourier( ak + 1 * m_table->nMax , nMax , dPhi );
+    float B = fourier( ak + 2 * m_table->nMax , nMax , dPhi );
     float G = 1.39829f * Y - 0.100913f * B - 0.297375f * R;
     return Spectrum( R * scale , G * scale , B * scale ).Clamp( 0.0f , FLT_MAX );
 }
 
 Spectrum FourierBxdf::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pdf ) const
 {
+    if( !m_table ){
+        if( pdf ) *pdf = 0.0f;
+        return 0.0f;
+    }
+
     float muO = CosTheta(wo);
     float pdfMu;
-    float muI = sampleCatmullRom2D(bsdfTable.nMu, bsdfTable.nMu, bsdfTable.mu, bsdfTable.mu, bsdfTable.a0, bsdfTable.cdf, muO, bs.u, nullptr, &pdfMu);
+    float muI = sampleCatmullRom2D(m_table->nMu, m_table->nMu, m_table->mu, m_table->mu, m_table->a0.data(), m_table->cdf, muO, bs.u, nullptr, &pdfMu);
     
     int offsetI , offsetO;
     float weightsI[4] , weightsO[4];
@@ -144,12 +92,12 @@ Spectrum FourierBxdf::sample_f( const Vector& wo , Vector& wi , const BsdfSample
         return 0.0f;
     }
     
-    float* ak = SORT_MALLOC_ARRAY(float, bsdfTable.nMax * bsdfTable.nChannels );
-    memset( ak , 0 , sizeof( float ) * bsdfTable.nMax * bsdfTable.nChannels );
-    int nMax = blendCoefficients( ak , bsdfTable.nChannels , offsetI, offsetO, weightsI, weightsO );
+    alignas(16) float ak[ 3 * FOURIER_MAX_ORDER ];
+    memset( ak , 0 , sizeof( float ) * m_table->nMax * m_table->nChannels );
+    int nMax = blendCoefficients( ak , m_table->nChannels , offsetI, offsetO, weightsI, weightsO );
     
     float phi, pdfPhi;
-    float Y = sampleFourier(ak, bsdfTable.recip, nMax, bs.v, &pdfPhi, &phi);
+    float Y = sampleFourier(ak, m_table->recip.data(), nMax, bs.v, &pdfPhi, &phi);
     *pdf = max( 0.0f , pdfPhi * pdfMu );
     
     float sin2ThetaI = max( 0.0f , 1.0f - muI * muI );
@@ -164,21 +112,24 @@ Spectrum FourierBxdf::sample_f( const Vector& wo , Vector& wi , const BsdfSample
     
     float scale = ( muI != 0.0f ) ? ( 1 / fabs(muI) ) : 0.0f;
     if( muI * muO > 0.0f ){
-        float eta = ( muI > 0.0f ) ? 1 / bsdfTable.eta : bsdfTable.eta;
+        float eta = ( muI > 0.0f ) ? 1 / m_table->eta : m_table->eta;
         scale *= eta * eta;
     }
     
-    if( bsdfTable.nChannels == 1 )
+    if( m_table->nChannels == 1 )
         return scale * Y;
     
-    float R = fourier( ak + 1 * bsdfTable.nMax , nMax , cosPhi );
-    float B = fourier( ak + 2 * bsdfTable.nMax , nMax , cosPhi );
+    float R = fourier( ak + 1 * m_table->nMax , nMax , cosPhi );
+    float B = fourier( ak + 2 * m_table->nMax , nMax , cosPhi );
     float G = 1.39829f * Y - 0.100913f * B - 0.297375f * R;
     return Spectrum( R * scale , G * scale , B * scale ).Clamp( 0.0f , FLT_MAX );
 }
 
 float FourierBxdf::Pdf( const Vector& wo , const Vector& wi ) const
 {
+    if( !m_table )
+        return 0.0f;
+
     float muI = CosTheta(-wi) , muO = CosTheta(wo);
     float cosPhi = CosDPhi( -wi , wo );
     
@@ -188,14 +139,14 @@ float FourierBxdf::Pdf( const Vector& wo , const Vector& wi ) const
         !getCatmullRomWeights( muO , offsetO , weightsO ) )
         return 0.0f;
     
-    float* ak = SORT_MALLOC_ARRAY(float, bsdfTable.nMax );
-    memset( ak , 0 , sizeof( float ) * bsdfTable.nMax );
+    alignas(16) float ak[ FOURIER_MAX_ORDER ];
+    memset( ak , 0 , sizeof( float ) * m_table->nMax );
     int nMax = blendCoefficients( ak , 1 , offsetI, offsetO, weightsI, weightsO );
     
     float rho = 0.0f;
     for( int o = 0 ; o < 4 ; ++o ){
         if( weightsO[o] == 0 ) continue;
-        rho += weightsO[o] * bsdfTable.cdf[ (offsetO + o) * bsdfTable.nMu + bsdfTable.nMu - 1 ] * TWO_PI;
+        rho += weightsO[o] * m_table->cdf[ (offsetO + o) * m_table->nMu + m_table->nMu - 1 ] * TWO_PI;
     }
 
     float Y = fourier(ak, nMax, cosPhi);
@@ -221,20 +172,20 @@ int FourierBxdf::findInterval( int cnt , const Predicate& pred ) const
 // Get CatmullRomWeights
 bool FourierBxdf::getCatmullRomWeights( float x , int& offset , float* weights ) const
 {
-    if( !(x >= bsdfTable.mu[0] && x <= bsdfTable.mu[bsdfTable.nMu-1] ) )
+    if( !(x >= m_table->mu[0] && x <= m_table->mu[m_table->nMu-1] ) )
         return false;
     
     // use binary search to get the offset
-    offset = findInterval( bsdfTable.nMu , [&](int i) { return bsdfTable.mu[i] <= x; } ) - 1;
+    offset = findInterval( m_table->nMu , [&](int i) { return m_table->mu[i] <= x; } ) - 1;
     
-    float x1 = bsdfTable.mu[offset+1] , x2 = bsdfTable.mu[offset+2];
+    float x1 = m_table->mu[offset+1] , x2 = m_table->mu[offset+2];
     float t = ( x - x1 ) / ( x2 - x1 ) , t2 = t * t, t3 = t2 * t;
     
     weights[0] = weights[3] = 0.0f;
     weights[1] = 2 * t3 - 3 * t2 + 1;
     weights[2] = -2 * t3 + 3 * t2;
     if( offset >= 0 ){
-        float w0 = (t3 - 2 * t2 + t) * (x2 - x1) / (x2 - bsdfTable.mu[offset]);
+        float w0 = (t3 - 2 * t2 + t) * (x2 - x1) / (x2 - m_table->mu[offset]);
         weights[0] = -w0;
         weights[2] += w0;
     }else{
@@ -242,8 +193,8 @@ bool FourierBxdf::getCatmullRomWeights( float x , int& offset , float* weights )
         weights[1] -= w0;
         weights[2] += w0;
     }
-    if( offset < bsdfTable.nMu - 3 ){
-        float w3 = (t3 - t2) * (x2 - x1) / (bsdfTable.mu[offset+3] - x1);
+    if( offset < m_table->nMu - 3 ){
+        float w3 = (t3 - t2) * (x2 - x1) / (m_table->mu[offset+3] - x1);
         weights[1] -= w3;
         weights[3] = w3;
     }else{
@@ -394,20 +345,42 @@ float FourierBxdf::sampleFourier( const float* ak , const float* recip , int m ,
 }
 
 // helper functio to blend coefficients for fourier
-int FourierBxdf::blendCoefficients( float* ak , int channel , int offsetI , int offsetO , float* weightsI , float* weightsO ) const
+int FourierBxdf::blendCoefficients( float* ak , int channel , int offsetI , int offsetO , const float* weightsI , const float* weightsO ) const
 {
+    // the weights of all 4x4 pairs of elevations
+    alignas(16) float weights[16];
+#if defined(SORT_SIMD_SSE)
+    const __m128 wi = _mm_loadu_ps( weightsI );
+    for( int i = 0 ; i < 4 ; ++i )
+        _mm_store_ps( weights + 4 * i , _mm_mul_ps( wi , _mm_set1_ps( weightsO[i] ) ) );
+#else
+    for( int i = 0 ; i < 4 ; ++i )
+        for( int j = 0 ; j < 4 ; ++j )
+            weights[4*i+j] = weightsI[j] * weightsO[i];
+#endif
+
+    const int stride = m_table->nMax;
     int nMax = 0;
     for( int i = 0 ; i < 4 ; ++i ){
         for( int j = 0 ; j < 4 ; ++j ){
-            float w = weightsI[j] * weightsO[i];
-            if( w != 0.0f ){
-                int m;
-                float* a = bsdfTable.GetAk(offsetI + j , offsetO + i, &m );
-                nMax = max( nMax , m );
-                for( int c = 0 ; c < channel ; ++c ){
-                    for( int k = 0 ; k < m ; ++k )
-                        ak[ c * bsdfTable.nMax + k ] += w * a[ c * m + k ];
-                }
+            const float w = weights[4*i+j];
+            if( w == 0.0f )
+                continue;
+
+            int m;
+            const float* a = m_table->GetAk(offsetI + j , offsetO + i, &m );
+            nMax = max( nMax , m );
+            for( int c = 0 ; c < channel ; ++c ){
+                float* dst = ak + c * stride;
+                const float* src = a + c * m;
+                int k = 0;
+#if defined(SORT_SIMD_SSE)
+                const __m128 w4 = _mm_set1_ps( w );
+                for( ; k + 4 <= m ; k += 4 )
+                    _mm_storeu_ps( dst + k , _mm_add_ps( _mm_loadu_ps( dst + k ) , _mm_mul_ps( w4 , _mm_loadu_ps( src + k ) ) ) );
+#endif
+                for( ; k < m ; ++k )
+                    dst[k] += w * src[k];
             }
         }
     }
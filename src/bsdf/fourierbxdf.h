@@ -19,6 +19,8 @@
 
 // include header file
 #include "bxdf.h"
+#include "fouriertable.h"
+#include <memory>
 
 //! @brief FourierBxdf.
 /**
@@ -67,38 +69,7 @@ public:
     void	LoadData( const string& filename );
 
 private:
-    // Bxdf Table
-    struct FourierBxdfTable{
-        float   eta = 1.0f;
-        int     nMax = 0;
-        int     nChannels = 1;
-        int     nMu = 0;
-        float   *mu = nullptr;
-        int     *m = nullptr;
-        int     *aOffset = nullptr;
-        float   *a = nullptr;
-        float   *a0 = nullptr;
-        float   *cdf = nullptr;
-        float   *recip = nullptr;
-        
-        ~FourierBxdfTable(){
-            SAFE_DELETE_ARRAY(mu);
-            SAFE_DELETE_ARRAY(m);
-            SAFE_DELETE_ARRAY(aOffset);
-            SAFE_DELETE_ARRAY(a);
-            SAFE_DELETE_ARRAY(a0);
-            SAFE_DELETE_ARRAY(cdf);
-            SAFE_DELETE_ARRAY(recip);
-        }
-        
-        float* GetAk( int offsetI , int offsetO , int* mptr ) const{
-            const int offset = offsetO * nMu + offsetI;
-            *mptr = m[offset];
-            return a + aOffset[offset];
-        }
-    };
-    
-    FourierBxdfTable    bsdfTable;
+    std::shared_ptr<const FourierTable>   m_table;    /**< The table shared by the bxdfs loading the same file. */
     
     // Fourier interpolation
     float fourier( const float* ak , int m , double cosPhi ) const;
@@ -120,5 +91,5 @@ private:
     int findInterval( int cnt , const Predicate& pred ) const;
     
     // helper functio to blend coefficients for fourier
-    int blendCoefficients( float* ak , int channel , int offsetI , int offsetO , float* weightsI , float* weightsO ) const;
+    int blendCoefficients( float* ak , int channel , int offsetI , int offsetO , const float* weightsI , const float* weightsO ) const;
 };
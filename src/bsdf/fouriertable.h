@@ -0,0 +1,63 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+#pragma once
+
+#include "sort.h"
+#include "utility/mappedfile.h"
+#include "utility/memstats.h"
+#include <vector>
+
+//! The largest order of the Fourier series supported, the coefficients are blended in a fixed array on the stack.
+#define FOURIER_MAX_ORDER   1024
+
+//! @brief The tabulated data of a Fourier bsdf.
+/**
+ * The table is read-only once it is loaded, it is shared by all bxdfs referring to the same file. The
+ * arrays point into the mapped file, only the first coefficient of each pair of elevations and the
+ * reciprocals used in sampling are computed when the table is loaded.
+ */
+class FourierTable
+{
+public:
+    float           eta = 1.0f;         /**< Relative index of refraction. */
+    int             nMax = 0;           /**< The largest order of the Fourier series in the table. */
+    int             nChannels = 1;      /**< The number of channels, luminance only or luminance, red and blue. */
+    int             nMu = 0;            /**< The number of elevations tabulated. */
+    const float*    mu = nullptr;       /**< The cosines of the elevations tabulated. */
+    const float*    cdf = nullptr;      /**< The cdf of the incident elevation for each exitant elevation. */
+    const int*      offsetAndLength = nullptr;  /**< The offset and the order of the coefficients for each pair of elevations. */
+    const float*    a = nullptr;        /**< The coefficients of all pairs of elevations. */
+    std::vector<float>  a0;             /**< The first coefficient for each pair of elevations. */
+    std::vector<float>  recip;          /**< Reciprocals of the orders up to nMax. */
+
+    //! @brief Get the coefficients of a pair of elevations.
+    //! @param offsetI  The index of the incident elevation.
+    //! @param offsetO  The index of the exitant elevation.
+    //! @param mptr     The order of the coefficients.
+    //! @return         The coefficients of all channels, one channel after another.
+    const float* GetAk( int offsetI , int offsetO , int* mptr ) const{
+        const int offset = offsetO * nMu + offsetI;
+        *mptr = offsetAndLength[2*offset+1];
+        return a + offsetAndLength[2*offset];
+    }
+
+private:
+    MappedFile      m_file;                         /**< The Fourier bsdf file the arrays point into. */
+    MemoryTracker   m_tracker{ MEM_FOURIER };       /**< The memory taken by the table. */
+
+    friend class FourierManager;
+};
@@ -19,6 +19,10 @@
 
 #include "spectrum/spectrum.h"
 
+#if defined(SORT_SIMD_SSE)
+#include <xmmintrin.h>
+#endif
+
 //! @brief Interface for fresnel.
 class	Fresnel
 {
@@ -28,10 +32,21 @@ public:
     //! @param coso     Cosine value between the outgoing ray and the normal.
     //! @return         Evaluted fresnel value.
 	virtual Spectrum Evaluate( float cosi , float coso) const = 0;
+
+	//! @brief Evalute the Fresnel term for a batch of directions.
+    //! @param cosi     Cosine values between the incoming rays and the normal.
+    //! @param coso     Cosine values between the outgoing rays and the normal.
+    //! @param f        Evaluted fresnel value of each direction.
+    //! @param count    The number of directions.
+	virtual void Evaluate( const float* cosi , const float* coso , Spectrum* f , unsigned count ) const
+	{
+		for( unsigned i = 0 ; i < count ; ++i )
+			f[i] = Evaluate( cosi[i] , coso[i] );
+	}
 };
 
 //! @brief A hack that presents no fresnel.
-class	FresnelNo : public Fresnel
+class	FresnelNo final : public Fresnel
 {
 public:
     //! @brief Evalute the Fresnel term.
@@ -41,10 +56,16 @@ public:
     Spectrum Evaluate( float cosi , float coso ) const override{
 		return 1.0f;
 	}
+
+    //! @brief Evalute the Fresnel term for a batch of directions.
+	void Evaluate( const float* cosi , const float* coso , Spectrum* f , unsigned count ) const override{
+		for( unsigned i = 0 ; i < count ; ++i )
+			f[i] = 1.0f;
+	}
 };
 
 //! @brief Fresnel for conductors.
-class	FresnelConductor : public Fresnel
+class	FresnelConductor final : public Fresnel
 {
 public:
 	//! Constructor
@@ -73,13 +94,42 @@ public:
 		return (Rparl2+Rperp2)*0.5f;
 	}
 
+    //! @brief Evalute the Fresnel term for a batch of directions, each channel is evaluated for four directions at once.
+	void Evaluate( const float* cosi , const float* coso , Spectrum* f , unsigned count ) const override
+	{
+		unsigned i = 0;
+#if defined(SORT_SIMD_SSE)
+		const float e[3] = { eta.GetR() , eta.GetG() , eta.GetB() };
+		const float a[3] = { k.GetR() , k.GetG() , k.GetB() };
+		const __m128 one = _mm_set1_ps( 1.0f );
+		const __m128 sign = _mm_set1_ps( -0.0f );
+		for( ; i + 4 <= count ; i += 4 ){
+			const __m128 abs_cos = _mm_andnot_ps( sign , _mm_loadu_ps( coso + i ) );
+			const __m128 sq_cos = _mm_mul_ps( abs_cos , abs_cos );
+			alignas(16) float r[3][4];
+			for( unsigned c = 0 ; c < 3 ; ++c ){
+				const __m128 t = _mm_mul_ps( _mm_set1_ps( 2.0f * e[c] ) , abs_cos );
+				const __m128 tmp_f = _mm_set1_ps( e[c] * e[c] + a[c] * a[c] );
+				const __m128 tmp = _mm_mul_ps( tmp_f , sq_cos );
+				const __m128 rparl2 = _mm_div_ps( _mm_add_ps( _mm_sub_ps( tmp , t ) , one ) , _mm_add_ps( _mm_add_ps( tmp , t ) , one ) );
+				const __m128 rperp2 = _mm_div_ps( _mm_add_ps( _mm_sub_ps( tmp_f , t ) , sq_cos ) , _mm_add_ps( _mm_add_ps( tmp_f , t ) , sq_cos ) );
+				_mm_store_ps( r[c] , _mm_mul_ps( _mm_add_ps( rparl2 , rperp2 ) , _mm_set1_ps( 0.5f ) ) );
+			}
+			for( unsigned j = 0 ; j < 4 ; ++j )
+				f[i+j] = Spectrum( r[0][j] , r[1][j] , r[2][j] );
+		}
+#endif
+		for( ; i < count ; ++i )
+			f[i] = Evaluate( cosi[i] , coso[i] );
+	}
+
 private:
     Spectrum eta;   /**< Internal data used for fresnel calculation. */
     Spectrum k;     /**< Internal data used for fresnel calculation. */
 };
 
 //! @brief Fresnel for dielectric.
-class	FresnelDielectric : public Fresnel
+class	FresnelDielectric final : public Fresnel
 {
 public:
     //! Constructor
@@ -109,6 +159,33 @@ public:
 		return ( Rparl * Rparl + Rparp * Rparp ) * 0.5f;
 	}
 
+    //! @brief Evalute the Fresnel term for a batch of directions, four of them are evaluated at once.
+	void Evaluate( const float* cosi , const float* coso , Spectrum* f , unsigned count ) const override
+	{
+		unsigned i = 0;
+#if defined(SORT_SIMD_SSE)
+		const __m128 sign = _mm_set1_ps( -0.0f );
+		const __m128 et = _mm_set1_ps( eta_t );
+		const __m128 ei = _mm_set1_ps( eta_i );
+		for( ; i + 4 <= count ; i += 4 ){
+			const __m128 cos_i = _mm_andnot_ps( sign , _mm_loadu_ps( cosi + i ) );
+			const __m128 cos_o = _mm_andnot_ps( sign , _mm_loadu_ps( coso + i ) );
+			const __m128 t0 = _mm_mul_ps( et , cos_i );
+			const __m128 t1 = _mm_mul_ps( ei , cos_o );
+			const __m128 t2 = _mm_mul_ps( ei , cos_i );
+			const __m128 t3 = _mm_mul_ps( et , cos_o );
+			const __m128 rparl = _mm_div_ps( _mm_sub_ps( t0 , t1 ) , _mm_add_ps( t0 , t1 ) );
+			const __m128 rparp = _mm_div_ps( _mm_sub_ps( t2 , t3 ) , _mm_add_ps( t2 , t3 ) );
+			alignas(16) float r[4];
+			_mm_store_ps( r , _mm_mul_ps( _mm_add_ps( _mm_mul_ps( rparl , rparl ) , _mm_mul_ps( rparp , rparp ) ) , _mm_set1_ps( 0.5f ) ) );
+			for( unsigned j = 0 ; j < 4 ; ++j )
+				f[i+j] = r[j];
+		}
+#endif
+		for( ; i < count ; ++i )
+			f[i] = Evaluate( cosi[i] , coso[i] );
+	}
+
 private:
     float eta_t;    /**< Internal data used for fresnel calculation. TBD */
     float eta_i;    /**< Internal data used for fresnel calculation. TBD */
@@ -25,20 +25,24 @@
  * It reflects equal radiance along all exitance directions.
  * One can use Lambert to simulate Matte-like material.
  */
-class Lambert : public Bxdf
+class Lambert final : public Bxdf
 {
 public:
 	//! Default constructor setting default type value
-    Lambert(){ m_type=BXDF_DIFFUSE; }
+    Lambert(){ m_type=BXDF_DIFFUSE; m_closure=BXDF_CLOSURE_LAMBERT; }
 	//! Constructor taking spectrum information.
     //! @param s Direction-Hemisphere reflection.
-    Lambert( const Spectrum& s ):R(s){m_type=BXDF_DIFFUSE;}
+    Lambert( const Spectrum& s ):R(s){m_type=BXDF_DIFFUSE;m_closure=BXDF_CLOSURE_LAMBERT;}
 
     //! Evaluate the BRDF
     //! @param wo   Exitance direction in shading coordinate.
     //! @param wi   Incomiing direction in shading coordinate.
     //! @return     The evaluted BRDF value.
-    Spectrum f( const Vector& wo , const Vector& wi ) const;
+    Spectrum f( const Vector& wo , const Vector& wi ) const override;
+
+    //! The albedo is estimated by the reflectance.
+    //! @return The intensity of the reflectance.
+    float Albedo() const override { return R.GetIntensity(); }
 
 	//! Reset the directional-hemisphere reflection.
     //! @param color    Direction-Hemisphere reflection.
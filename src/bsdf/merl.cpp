@@ -17,119 +17,60 @@
 
 // include the header
 #include "merl.h"
-#include "utility/define.h"
-#include "managers/memmanager.h"
-#include "utility/path.h"
-#include "math/vector3.h"
-#include <fstream>
+#include "managers/merlmanager.h"
+#include "utility/samplemethod.h"
+#include "sampler/sample.h"
 #include "bsdf.h"
 
-// constant to be used in merl
-static const unsigned MERL_SAMPLING_RES_THETA_H = 90;
-static const unsigned MERL_SAMPLING_RES_THETA_D = 90;
-static const unsigned MERL_SAMPLING_RES_PHI_D = 180;
-static const unsigned MERL_SAMPLING_COUNT = 1458000;
-static const double MERL_RED_SCALE = 0.0006666666666667;
-static const double MERL_GREEN_SCALE = 0.000766666666666667;
-static const double MERL_BLUE_SCALE = 0.0011066666666666667;
+// the probability of sampling the cosine weighted hemisphere instead of the tabulated distribution
+static const float MERL_COSINE_SAMPLING = 0.1f;
 
 // Load data from file
-void Merl::LoadData( const string& filename )
+void Merl::LoadData( const string& filename , bool half )
 {
-    // get full path
-    string str = ( filename );
-    
-    // try to open the file
-    ifstream file( str.c_str() , ios::binary );
-    if( false == file.is_open() )
-        return;
-    
-    int dims[3];
-    file.read( (char*)dims , sizeof( int ) * 3 );
-    
-    // check dimension
-    if( dims[0] != MERL_SAMPLING_RES_THETA_H ||
-       dims[1] != MERL_SAMPLING_RES_THETA_D ||
-       dims[2] != MERL_SAMPLING_RES_PHI_D )
-    {
-        file.close();
-        return;
-    }
-    
-    // allocate data
-    unsigned trunksize = dims[0] * dims[1] * dims[2];
-    unsigned size = 3 * trunksize;
-    m_data = new double[size];
-    file.read( (char*)m_data , sizeof( double ) * size );
-    
-    unsigned offset = 0;
-    for( unsigned i = 0 ; i < trunksize ; i++ )
-        m_data[offset++] *= MERL_RED_SCALE;
-    for( unsigned i = 0 ; i < trunksize ; i++ )
-        m_data[offset++] *= MERL_GREEN_SCALE;
-    for( unsigned i = 0 ; i < trunksize ; i++ )
-        m_data[offset++] *= MERL_BLUE_SCALE;
-    
-    file.close();
+	m_table = MerlManager::GetSingleton().Load( filename , half );
 }
 
 // destructor
 Merl::~Merl()
 {
-	SAFE_DELETE(m_data);
 }
 
 // evaluate bxdf
-Spectrum Merl::f( const Vector& Wo , const Vector& Wi ) const
+Spectrum Merl::f( const Vector& wo , const Vector& wi ) const
 {
-	Vector wo = Wo;
-	Vector wi = Wi;
-
-	if( SameHemiSphere( wo , wi ) == false )
+	if( SameHemiSphere( wo , wi ) == false || !m_table )
 		return 0.0f;
     
     // ignore reflection at the back face
     if( wo.y <= 0.0f )
         return 0.0f;
-	
-	// Compute wh and transform wi to halfangle coordinate system
-    Vector wh = wo + wi;
-	if( wh.y < 0.0f )
-	{
-		wh = -wh;
-		wi = -wi;
-		wo = -wo;
-	}
-    if (wh.x == 0.f && wh.y == 0.f && wh.z == 0.f)
-		return Spectrum (0.f);
-    wh = Normalize(wh);
-
-	float whTheta = SphericalTheta(wh);
-    float whCosPhi = CosPhi(wh), whSinPhi = SinPhi(wh);
-    float whCosTheta = CosTheta(wh), whSinTheta = SinTheta(wh);
 
-	Vector whx( whSinPhi , 0 , -whCosPhi );
-	Vector why( whCosPhi * whCosTheta , -whSinTheta , whSinPhi * whCosTheta );
-    Vector wd(Dot(wi, whx), Dot(wi, wh), Dot(wi, why));
-
-    // Compute _index_ into measured BRDF tables
-    float wdTheta = SphericalTheta(wd), wdPhi = SphericalPhi(wd);
-    if (wdPhi > PI) 
-		wdPhi -= PI;
+	return m_table->Evaluate( wo , wi );
+}
 
-    // Compute indices _whThetaIndex_, _wdThetaIndex_, _wdPhiIndex_
-    int whThetaIndex = (int)clamp(sqrtf(max(0.f, whTheta * 2.0f * INV_PI )) * MERL_SAMPLING_RES_THETA_H,  0.f, (float)(MERL_SAMPLING_RES_THETA_H-1));
-    int wdThetaIndex = (int)clamp(wdTheta * INV_PI * 2.0f * MERL_SAMPLING_RES_THETA_D, 0.f , (float)(MERL_SAMPLING_RES_THETA_D-1));
-    int wdPhiIndex = (int)clamp(wdPhi * INV_PI * MERL_SAMPLING_RES_PHI_D, 0.f , (float)(MERL_SAMPLING_RES_PHI_D - 1));
+// sample a direction by the tabulated distribution of half vectors
+Spectrum Merl::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pdf ) const
+{
+	if( !m_table || wo.y <= 0.0f ){
+		if( pdf ) *pdf = 0.0f;
+		return 0.0f;
+	}
 
-	// calculate the index
-    int index = wdPhiIndex + MERL_SAMPLING_RES_PHI_D * (wdThetaIndex + whThetaIndex * MERL_SAMPLING_RES_THETA_D);
+	// the cosine weighted hemisphere covers the directions the table barely samples
+	if( bs.u < MERL_COSINE_SAMPLING )
+		wi = CosSampleHemisphere( bs.u / MERL_COSINE_SAMPLING , bs.v );
+	else
+		wi = m_table->Sample( wo , ( bs.u - MERL_COSINE_SAMPLING ) / ( 1.0f - MERL_COSINE_SAMPLING ) , bs.v );
 
-	const float r = (float)( m_data[ index ] );
-	index += MERL_SAMPLING_COUNT;
-	const float g = (float)( m_data[ index ] );
-	index += MERL_SAMPLING_COUNT;
-	const float b = (float)( m_data[ index ] );
+	if( pdf ) *pdf = Pdf( wo , wi );
+	return f( wo , wi );
+}
 
-	return Spectrum( r , g , b );
+// the pdf of the sampled direction
+float Merl::Pdf( const Vector& wo , const Vector& wi ) const
+{
+	if( !m_table || wo.y <= 0.0f || !SameHemiSphere( wo , wi ) )
+		return 0.0f;
+	return MERL_COSINE_SAMPLING * CosHemispherePdf( wi ) + ( 1.0f - MERL_COSINE_SAMPLING ) * m_table->Pdf( wo , wi );
 }
@@ -18,24 +18,27 @@
 #pragma once
 
 #include "bxdf.h"
+#include <memory>
+
+class MerlTable;
 
 //! @brief  MERL brdf.
 /**
  * MERL is short for Mitsubishi Electric Research Laboratories. They provide some measured
  * brdf on the website http://www.merl.com/brdf/. Merl class is responsible for loading 
  * and displaying the brdf they provided in the renderer.\n
- * There is no importance sampling for this brdf. With the default sampling method, the
- * convergence rage is extremely low. 
  * The paper <a href="http://csbio.unc.edu/mcmillan/pubs/sig03_matusik.pdf">
  * "A Data-Driven Reflectance Model"</a> didn't propose an importance sampling method
- * for it. Further research is needed before it can be practical to be used.
+ * for it. Directions are sampled by the distributions of half vectors tabulated from the
+ * data, mixed with a small amount of cosine weighted sampling to cover the directions the
+ * tables barely reach.
  */
 class Merl : public Bxdf
 {
 public:
 	//! Default constructor setting brdf type.
     Merl(){m_type = BXDF_GLOSSY;}
-	//! Destructor deletes all allocated memory
+	//! Destructor releasing the shared table.
     ~Merl() override;
 
     //! Evaluate the BRDF
@@ -43,15 +46,30 @@ public:
     //! @param wi   Incomiing direction in shading coordinate.
     //! @return     The evaluted BRDF value.
     Spectrum f( const Vector& wo , const Vector& wi ) const override;
+
+    //! @brief Importance sampling for the brdf by the tabulated distributions of half vectors.
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param wi   Incident direction in shading coordinate.
+    //! @param bs   Sample for bsdf that holds some random variables.
+    //! @param pdf  Probability density of the selected direction.
+    //! @return     The evaluted BRDF value.
+    Spectrum sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pdf ) const override;
+
+    //! @brief Evaluate the pdf of an existance direction given the incident direction.
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param wi   Incident direction in shading coordinate.
+    //! @return     The probabilty of choosing the out-going direction based on the Incident direction.
+    float Pdf( const Vector& wo , const Vector& wi ) const override;
     
-	//! Load brdf data from MERL file.
+	//! Load brdf data from MERL file, materials loading the same file share the data.
     //! @param filename Name of the MERL file.
-	void	LoadData( const string& filename );
+    //! @param half     Whether the data is stored as half, it takes half of the memory of float.
+	void	LoadData( const string& filename , bool half = false );
 
 	//! Whether there is valid data loaded.
     //! @return True if data is valid, otherwise it will return false.
-	bool	IsValid() { return m_data != 0; }
+	bool	IsValid() { return m_table != nullptr; }
 
 private:
-	double*	m_data = nullptr;   /**< The actual data of MERL brdf. */
+	std::shared_ptr<const MerlTable>   m_table;    /**< The measured table shared by the materials loading the same file. */
 };
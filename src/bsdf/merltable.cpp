@@ -0,0 +1,154 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "merltable.h"
+#include "bsdf.h"
+#include "utility/samplemethod.h"
+#include "utility/multithread/threadpool.h"
+
+// resolution of the MERL table
+static const unsigned MERL_SAMPLING_RES_THETA_H = 90;
+static const unsigned MERL_SAMPLING_RES_THETA_D = 90;
+static const unsigned MERL_SAMPLING_RES_PHI_D = 180;
+
+// resolution of the sampling distributions , the elevation of wo , the square root of the elevation of the half vector and its azimuth
+static const unsigned MERL_SAMPLING_THETA_O = 32;
+static const unsigned MERL_SAMPLING_THETA_H = 90;
+static const unsigned MERL_SAMPLING_PHI_H = 64;
+
+// default constructor
+MerlTable::MerlTable()
+{
+}
+
+// destructor
+MerlTable::~MerlTable()
+{
+}
+
+// evaluate the brdf
+Spectrum MerlTable::Evaluate( const Vector& Wo , const Vector& Wi ) const
+{
+	Vector wo = Wo;
+	Vector wi = Wi;
+
+	// Compute wh and transform wi to halfangle coordinate system
+    Vector wh = wo + wi;
+	if( wh.y < 0.0f )
+	{
+		wh = -wh;
+		wi = -wi;
+		wo = -wo;
+	}
+    if (wh.x == 0.f && wh.y == 0.f && wh.z == 0.f)
+		return Spectrum (0.f);
+    wh = Normalize(wh);
+
+	float whTheta = SphericalTheta(wh);
+    float whCosPhi = CosPhi(wh), whSinPhi = SinPhi(wh);
+    float whCosTheta = CosTheta(wh), whSinTheta = SinTheta(wh);
+
+	Vector whx( whSinPhi , 0 , -whCosPhi );
+	Vector why( whCosPhi * whCosTheta , -whSinTheta , whSinPhi * whCosTheta );
+    Vector wd(Dot(wi, whx), Dot(wi, wh), Dot(wi, why));
+
+    // Compute _index_ into measured BRDF tables
+    float wdTheta = SphericalTheta(wd), wdPhi = SphericalPhi(wd);
+    if (wdPhi > PI) 
+		wdPhi -= PI;
+
+    // Compute indices _whThetaIndex_, _wdThetaIndex_, _wdPhiIndex_
+    int whThetaIndex = (int)clamp(sqrtf(max(0.f, whTheta * 2.0f * INV_PI )) * MERL_SAMPLING_RES_THETA_H,  0.f, (float)(MERL_SAMPLING_RES_THETA_H-1));
+    int wdThetaIndex = (int)clamp(wdTheta * INV_PI * 2.0f * MERL_SAMPLING_RES_THETA_D, 0.f , (float)(MERL_SAMPLING_RES_THETA_D-1));
+    int wdPhiIndex = (int)clamp(wdPhi * INV_PI * MERL_SAMPLING_RES_PHI_D, 0.f , (float)(MERL_SAMPLING_RES_PHI_D - 1));
+
+	// calculate the index
+    int index = wdPhiIndex + MERL_SAMPLING_RES_PHI_D * (wdThetaIndex + whThetaIndex * MERL_SAMPLING_RES_THETA_D);
+
+	return Spectrum( Get( 0 , index ) , Get( 1 , index ) , Get( 2 , index ) );
+}
+
+// the sampling distribution of an exitant direction
+static unsigned _thetaOIndex( const Vector& wo )
+{
+	const float t = SphericalTheta( wo ) * 2.0f * INV_PI;
+	return min( (unsigned)( max( t , 0.0f ) * MERL_SAMPLING_THETA_O ) , MERL_SAMPLING_THETA_O - 1 );
+}
+
+// sample an incident direction by the tabulated distribution of half vectors
+Vector MerlTable::Sample( const Vector& wo , float u , float v ) const
+{
+	float uv[2];
+	m_sampling[ _thetaOIndex( wo ) ]->SampleContinuous( u , v , uv , nullptr );
+
+	// the azimuth is relative to the one of wo
+	const float theta_h = uv[1] * uv[1] * PI * 0.5f;
+	const float phi_h = uv[0] * TWO_PI + SphericalPhi( wo );
+	const Vector wh = SphericalVec( theta_h , phi_h );
+	return 2.0f * Dot( wo , wh ) * wh - wo;
+}
+
+// the pdf of sampling an incident direction
+float MerlTable::Pdf( const Vector& wo , const Vector& wi ) const
+{
+	Vector wh = wo + wi;
+	if( wh.y <= 0.0f )
+		return 0.0f;
+	wh = Normalize( wh );
+
+	const float theta_h = SphericalTheta( wh );
+	const float t = sqrtf( theta_h * 2.0f * INV_PI );
+	float phi = SphericalPhi( wh ) - SphericalPhi( wo );
+	if( phi < 0.0f )
+		phi += TWO_PI;
+
+	// the jacobian from the parameters of the table to the solid angle of the half vector , then to the one of wi
+	const float jacobian = TWO_PI * PI * t * sinf( theta_h ) * 4.0f * Dot( wo , wh );
+	if( jacobian <= 0.0f )
+		return 0.0f;
+	return m_sampling[ _thetaOIndex( wo ) ]->Pdf( phi * INV_TWOPI , t ) / jacobian;
+}
+
+// tabulate the distributions of half vectors
+void MerlTable::buildSampling()
+{
+	const unsigned size = MERL_SAMPLING_THETA_H * MERL_SAMPLING_PHI_H;
+	std::vector<float> weights( MERL_SAMPLING_THETA_O * size );
+
+	// each distribution is proportional to the brdf times the cosine factor and the jacobian of its parameters at the center of the bins
+	ParallelFor( 0 , MERL_SAMPLING_THETA_O , 1 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; ++i ){
+			const Vector wo = SphericalVec( ( i + 0.5f ) / MERL_SAMPLING_THETA_O * PI * 0.5f , 0.0f );
+			float* w = &weights[ i * size ];
+			for( unsigned j = 0 ; j < MERL_SAMPLING_THETA_H ; ++j ){
+				const float t = ( j + 0.5f ) / MERL_SAMPLING_THETA_H;
+				const float theta_h = t * t * PI * 0.5f;
+				for( unsigned k = 0 ; k < MERL_SAMPLING_PHI_H ; ++k ){
+					const Vector wh = SphericalVec( theta_h , ( k + 0.5f ) / MERL_SAMPLING_PHI_H * TWO_PI );
+					const float cos_oh = Dot( wo , wh );
+					const Vector wi = 2.0f * cos_oh * wh - wo;
+					w[ j * MERL_SAMPLING_PHI_H + k ] = ( wi.y > 0.0f && cos_oh > 0.0f ) ?
+						Evaluate( wo , wi ).GetIntensity() * wi.y * cos_oh * t * sinf( theta_h ) : 0.0f;
+				}
+			}
+		}
+	});
+
+	m_sampling.resize( MERL_SAMPLING_THETA_O );
+	for( unsigned i = 0 ; i < MERL_SAMPLING_THETA_O ; ++i )
+		m_sampling[i].reset( new Distribution2D( &weights[ i * size ] , MERL_SAMPLING_PHI_H , MERL_SAMPLING_THETA_H ) );
+}
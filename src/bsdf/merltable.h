@@ -0,0 +1,96 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "spectrum/spectrum.h"
+#include "math/vector3.h"
+#include "utility/mappedfile.h"
+#include "utility/memstats.h"
+#include <memory>
+#include <vector>
+#include <half.h>
+
+class Distribution2D;
+
+//! @brief The measured table of a MERL brdf.
+/**
+ * The table holds the three channels one after another, already scaled to reflectance. Values are stored as
+ * float, or as half if the material asks for it. A table is either mapped from the converted file next to the
+ * MERL file or kept in memory if the converted file can't be written.\n
+ * Directions are sampled by their half vectors. For a range of elevations of the exitant direction, the
+ * luminance of the brdf times the cosine factor is tabulated over the half vector parameterized as in the
+ * table of MERL, the square root of its elevation and its azimuth relative to the exitant direction. The
+ * tables are piecewise constant, so the pdf of a sampled direction is exact.
+ */
+class MerlTable
+{
+public:
+    //! Default constructor.
+    MerlTable();
+    //! Destructor releasing the sampling distributions.
+    ~MerlTable();
+
+    //! @brief Evaluate the brdf.
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param wi   Incident direction in shading coordinate.
+    //! @return     The value of the brdf.
+    Spectrum Evaluate( const Vector& wo , const Vector& wi ) const;
+
+    //! @brief Sample an incident direction by the tabulated distribution of half vectors.
+    //! @param wo   Exitant direction in shading coordinate, it has to be above the surface.
+    //! @param u    A canonical random number.
+    //! @param v    A canonical random number.
+    //! @return     The incident direction, it could be below the surface.
+    Vector Sample( const Vector& wo , float u , float v ) const;
+
+    //! @brief The pdf of sampling an incident direction by the tabulated distribution.
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param wi   Incident direction in shading coordinate.
+    //! @return     The pdf w.r.t. solid angle.
+    float Pdf( const Vector& wo , const Vector& wi ) const;
+
+    //! @brief Get the value of a channel in the table.
+    //! @param channel  The channel, red, green or blue.
+    //! @param index    The index of the value in the channel.
+    //! @return         The value.
+    float Get( unsigned channel , unsigned index ) const
+    {
+        const size_t i = (size_t)channel * m_count + index;
+        if( m_half ){
+            half h;
+            h.setBits( ( (const unsigned short*)m_data )[i] );
+            return (float)h;
+        }
+        return ( (const float*)m_data )[i];
+    }
+
+private:
+    const void*         m_data = nullptr;   /**< The values of all channels. */
+    unsigned            m_count = 0;        /**< The number of values in each channel. */
+    bool                m_half = false;     /**< Whether the values are stored as half. */
+    MappedFile          m_file;             /**< The converted file the values are mapped from. */
+    std::vector<char>   m_buffer;           /**< The values if the converted file is not available. */
+    MemoryTracker       m_tracker{ MEM_MERL };  /**< The memory taken by the values. */
+
+    std::vector<std::unique_ptr<Distribution2D>>   m_sampling;     /**< The distributions of half vectors for each elevation of wo. */
+
+    //! @brief Tabulate the distributions of half vectors, it is done once the values are loaded.
+    void buildSampling();
+
+    friend class MerlManager;
+};
@@ -19,6 +19,17 @@
 #include "bsdf.h"
 #include "sampler/sample.h"
 
+#if defined(SORT_SIMD_SSE)
+#include <xmmintrin.h>
+#endif
+
+// probabilty of facets with a batch of normals
+void MicroFacetDistribution::D( const float* NoH , float* d , unsigned count ) const
+{
+	for( unsigned i = 0 ; i < count ; ++i )
+		d[i] = D( NoH[i] );
+}
+
 // constructor
 Blinn::Blinn( float roughness )
 {
@@ -77,6 +88,25 @@ float GGX::D(float NoH) const
 	return m / ( PI*d*d );
 }
 
+// probabilty of facets with a batch of normals
+void GGX::D( const float* NoH , float* d , unsigned count ) const
+{
+	unsigned i = 0;
+#if defined(SORT_SIMD_SSE)
+	const __m128 m4 = _mm_set1_ps( m );
+	const __m128 m1 = _mm_set1_ps( m - 1.0f );
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 pi = _mm_set1_ps( PI );
+	for( ; i + 4 <= count ; i += 4 ){
+		const __m128 n = _mm_loadu_ps( NoH + i );
+		const __m128 t = _mm_add_ps( _mm_mul_ps( m1 , _mm_mul_ps( n , n ) ) , one );
+		_mm_storeu_ps( d + i , _mm_div_ps( m4 , _mm_mul_ps( pi , _mm_mul_ps( t , t ) ) ) );
+	}
+#endif
+	for( ; i < count ; ++i )
+		d[i] = D( NoH[i] );
+}
+
 Vector GGX::sample_f( const BsdfSample& bs ) const
 {
 	float theta = atan( alpha * sqrt(bs.v / ( 1.0f - bs.v )) );
@@ -84,22 +114,35 @@ Vector GGX::sample_f( const BsdfSample& bs ) const
 	return SphericalVec( theta , phi );
 }
 
-float VisImplicit::Vis_Term( float NoL , float NoV , float VoH , float NoH)
+// evaluate the visibility term of a batch of directions
+void VisTerm::Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const
+{
+	for( unsigned i = 0 ; i < count ; ++i )
+		vis[i] = Vis_Term( NoL[i] , NoV[i] , VoH[i] , NoH[i] );
+}
+
+float VisImplicit::Vis_Term( float NoL , float NoV , float VoH , float NoH) const
 {
 	return 0.25f;
 }
 
-float VisNeumann::Vis_Term( float NoL , float NoV , float VoH , float NoH)
+void VisImplicit::Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const
+{
+	for( unsigned i = 0 ; i < count ; ++i )
+		vis[i] = 0.25f;
+}
+
+float VisNeumann::Vis_Term( float NoL , float NoV , float VoH , float NoH) const
 {
 	return 1 / ( 4 * max( NoL, NoV ) );
 }
 
-float VisKelemen::Vis_Term( float NoL , float NoV , float VoH , float NoH)
+float VisKelemen::Vis_Term( float NoL , float NoV , float VoH , float NoH) const
 {
 	return 1.0f / ( 4.0f * VoH * VoH );
 }
 
-float VisSchlick::Vis_Term( float NoL , float NoV , float VoH , float NoH)
+float VisSchlick::Vis_Term( float NoL , float NoV , float VoH , float NoH) const
 {
 	float k = roughness * roughness * 0.5f;
 	float Vis_SchlickV = NoV * (1 - k) + k;
@@ -107,7 +150,24 @@ float VisSchlick::Vis_Term( float NoL , float NoV , float VoH , float NoH)
 	return 0.25f / ( Vis_SchlickV * Vis_SchlickL );
 }
 
-float VisSmith::Vis_Term( float NoL , float NoV , float VoH , float NoH)
+void VisSchlick::Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const
+{
+	unsigned i = 0;
+#if defined(SORT_SIMD_SSE)
+	const float k = roughness * roughness * 0.5f;
+	const __m128 k4 = _mm_set1_ps( k );
+	const __m128 k1 = _mm_set1_ps( 1.0f - k );
+	for( ; i + 4 <= count ; i += 4 ){
+		const __m128 v = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( NoV + i ) , k1 ) , k4 );
+		const __m128 l = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( NoL + i ) , k1 ) , k4 );
+		_mm_storeu_ps( vis + i , _mm_div_ps( _mm_set1_ps( 0.25f ) , _mm_mul_ps( v , l ) ) );
+	}
+#endif
+	for( ; i < count ; ++i )
+		vis[i] = Vis_Term( NoL[i] , NoV[i] , VoH[i] , NoH[i] );
+}
+
+float VisSmith::Vis_Term( float NoL , float NoV , float VoH , float NoH) const
 {
 	float a = roughness * roughness;
 	float a2 = a*a;
@@ -117,7 +177,26 @@ float VisSmith::Vis_Term( float NoL , float NoV , float VoH , float NoH)
 	return 1.0f / ( Vis_SmithV * Vis_SmithL );
 }
 
-float VisSmithJointApprox::Vis_Term( float NoL , float NoV , float VoH , float NoH)
+void VisSmith::Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const
+{
+	unsigned i = 0;
+#if defined(SORT_SIMD_SSE)
+	const float a = roughness * roughness;
+	const __m128 a2 = _mm_set1_ps( a * a );
+	const __m128 a1 = _mm_set1_ps( 1.0f - a * a );
+	for( ; i + 4 <= count ; i += 4 ){
+		const __m128 nv = _mm_loadu_ps( NoV + i );
+		const __m128 nl = _mm_loadu_ps( NoL + i );
+		const __m128 v = _mm_add_ps( nv , _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( _mm_mul_ps( nv , nv ) , a1 ) , a2 ) ) );
+		const __m128 l = _mm_add_ps( nl , _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( _mm_mul_ps( nl , nl ) , a1 ) , a2 ) ) );
+		_mm_storeu_ps( vis + i , _mm_div_ps( _mm_set1_ps( 1.0f ) , _mm_mul_ps( v , l ) ) );
+	}
+#endif
+	for( ; i < count ; ++i )
+		vis[i] = Vis_Term( NoL[i] , NoV[i] , VoH[i] , NoH[i] );
+}
+
+float VisSmithJointApprox::Vis_Term( float NoL , float NoV , float VoH , float NoH) const
 {
 	float a = roughness * roughness;
 	float Vis_SmithV = NoL * ( NoV * ( 1 - a ) + a );
@@ -125,7 +204,26 @@ float VisSmithJointApprox::Vis_Term( float NoL , float NoV , float VoH , float N
 	return 0.5f / ( Vis_SmithV + Vis_SmithL );
 }
 
-float VisCookTorrance::Vis_Term( float NoL , float NoV , float VoH , float NoH)
+void VisSmithJointApprox::Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const
+{
+	unsigned i = 0;
+#if defined(SORT_SIMD_SSE)
+	const float a = roughness * roughness;
+	const __m128 a4 = _mm_set1_ps( a );
+	const __m128 a1 = _mm_set1_ps( 1.0f - a );
+	for( ; i + 4 <= count ; i += 4 ){
+		const __m128 nv = _mm_loadu_ps( NoV + i );
+		const __m128 nl = _mm_loadu_ps( NoL + i );
+		const __m128 v = _mm_mul_ps( nl , _mm_add_ps( _mm_mul_ps( nv , a1 ) , a4 ) );
+		const __m128 l = _mm_mul_ps( nv , _mm_add_ps( _mm_mul_ps( nl , a1 ) , a4 ) );
+		_mm_storeu_ps( vis + i , _mm_div_ps( _mm_set1_ps( 0.5f ) , _mm_add_ps( v , l ) ) );
+	}
+#endif
+	for( ; i < count ; ++i )
+		vis[i] = Vis_Term( NoL[i] , NoV[i] , VoH[i] , NoH[i] );
+}
+
+float VisCookTorrance::Vis_Term( float NoL , float NoV , float VoH , float NoH) const
 {
 	return min( 1.0f , 2.0f * min( NoH * NoV / VoH , NoH * NoL / VoH ) ) / ( 4.0f * NoL * NoV );
 }
@@ -153,19 +251,31 @@ Vector Microfacet::getRefracted( Vector v , Vector n , float in_eta , float ext_
 	return -eta * v  + ( eta * coso + factor * sqrt(t)) * n;
 }
 
+// the closure tag of each combination , the generic one is called virtually
+template< class T >
+struct MicrofacetClosure { static const BXDF_CLOSURE value = BXDF_CLOSURE_GENERIC; };
+template<> struct MicrofacetClosure<MicroFacetReflectionBlinnCookTorrance> { static const BXDF_CLOSURE value = BXDF_CLOSURE_MF_REFLECTION_BLINN_COOKTORRANCE; };
+template<> struct MicrofacetClosure<MicroFacetReflectionBeckmannCookTorrance> { static const BXDF_CLOSURE value = BXDF_CLOSURE_MF_REFLECTION_BECKMANN_COOKTORRANCE; };
+template<> struct MicrofacetClosure<MicroFacetReflectionGGXCookTorrance> { static const BXDF_CLOSURE value = BXDF_CLOSURE_MF_REFLECTION_GGX_COOKTORRANCE; };
+template<> struct MicrofacetClosure<MicroFacetReflectionGGXSmithJoint> { static const BXDF_CLOSURE value = BXDF_CLOSURE_MF_REFLECTION_GGX_SMITHJOINT; };
+template<> struct MicrofacetClosure<MicroFacetRefractionBlinnCookTorrance> { static const BXDF_CLOSURE value = BXDF_CLOSURE_MF_REFRACTION_BLINN_COOKTORRANCE; };
+template<> struct MicrofacetClosure<MicroFacetRefractionGGXCookTorrance> { static const BXDF_CLOSURE value = BXDF_CLOSURE_MF_REFRACTION_GGX_COOKTORRANCE; };
+template<> struct MicrofacetClosure<MicroFacetRefractionGGXSmithJoint> { static const BXDF_CLOSURE value = BXDF_CLOSURE_MF_REFRACTION_GGX_SMITHJOINT; };
+
 // constructor
-MicroFacetReflection::MicroFacetReflection(const Spectrum &reflectance, Fresnel* f , MicroFacetDistribution* d , VisTerm* v )
+template< class NDF , class VIS , class FR >
+MicroFacetReflectionT<NDF,VIS,FR>::MicroFacetReflectionT(const Spectrum &reflectance, FR f , NDF d , VIS v ):
+	distribution( d ) , visterm( v ) , fresnel( f )
 {
 	R = reflectance;
-	distribution = d;
-	fresnel = f;
-	visterm = v;
 	
 	m_type = (BXDF_TYPE)(BXDF_DIFFUSE | BXDF_REFLECTION);
+	m_closure = MicrofacetClosure<MicroFacetReflectionT>::value;
 }
 
 // evaluate bxdf
-Spectrum MicroFacetReflection::f( const Vector& wo , const Vector& wi ) const
+template< class NDF , class VIS , class FR >
+Spectrum MicroFacetReflectionT<NDF,VIS,FR>::f( const Vector& wo , const Vector& wi ) const
 {
 	if( SameHemiSphere( wo , wi ) == false )
 		return 0.0f;
@@ -185,17 +295,18 @@ Spectrum MicroFacetReflection::f( const Vector& wo , const Vector& wi ) const
 	float VoH = Dot(wi, wh);
 	float NoH = AbsCosTheta( wh );
 
-	Spectrum F = fresnel->Evaluate(Dot(wi,wh), VoH);
+	Spectrum F = fresnel.Evaluate(Dot(wi,wh), VoH);
 	
 	// return Torrance–Sparrow BRDF
-	return R * distribution->D(NoH) * F * visterm->Vis_Term( NoL , NoV , VoH , NoH );
+	return R * distribution.D(NoH) * F * visterm.Vis_Term( NoL , NoV , VoH , NoH );
 }
 
 // sample a direction randomly
-Spectrum MicroFacetReflection::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pdf ) const
+template< class NDF , class VIS , class FR >
+Spectrum MicroFacetReflectionT<NDF,VIS,FR>::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pdf ) const
 {
 	// sampling the normal
-	Vector wh = distribution->sample_f( bs );
+	Vector wh = distribution.sample_f( bs );
 
 	// reflect the incident direction
 	wi = getReflected( wo , wh );
@@ -210,8 +321,47 @@ Spectrum MicroFacetReflection::sample_f( const Vector& wo , Vector& wi , const B
 	return f( wo , wi );
 }
 
+// evaluate a batch of directions
+template< class NDF , class VIS , class FR >
+void MicroFacetReflectionT<NDF,VIS,FR>::f_batch( const Vector& wo , const Vector* wi , Spectrum* f , unsigned count ) const
+{
+    // ignore reflection at the back face
+	const float NoV = AbsCosTheta( wo );
+	if( wo.y <= 0.0f || NoV == 0.0f ){
+		for( unsigned i = 0 ; i < count ; ++i )
+			f[i] = 0.0f;
+		return;
+	}
+
+	// the cosine values of all directions are gathered , invalid ones take harmless values so the kernels stay finite
+	float NoL[BXDF_BATCH_SIZE] , NoVs[BXDF_BATCH_SIZE] , VoH[BXDF_BATCH_SIZE] , NoH[BXDF_BATCH_SIZE];
+	bool valid[BXDF_BATCH_SIZE];
+	for( unsigned i = 0 ; i < count ; ++i ){
+		NoL[i] = AbsCosTheta( wi[i] );
+		NoVs[i] = NoV;
+		valid[i] = SameHemiSphere( wo , wi[i] ) && NoL[i] != 0.0f;
+		if( valid[i] ){
+			const Vector wh = Normalize( wi[i] + wo );
+			VoH[i] = Dot( wi[i] , wh );
+			NoH[i] = AbsCosTheta( wh );
+		}else{
+			NoL[i] = VoH[i] = NoH[i] = 1.0f;
+		}
+	}
+
+	float D[BXDF_BATCH_SIZE] , Vis[BXDF_BATCH_SIZE];
+	Spectrum F[BXDF_BATCH_SIZE];
+	distribution.D( NoH , D , count );
+	visterm.Vis_Term( NoL , NoVs , VoH , NoH , Vis , count );
+	fresnel.Evaluate( VoH , VoH , F , count );
+
+	for( unsigned i = 0 ; i < count ; ++i )
+		f[i] = valid[i] ? R * D[i] * F[i] * Vis[i] : Spectrum( 0.0f );
+}
+
 // get the pdf of the sampled direction
-float MicroFacetReflection::Pdf( const Vector& wo , const Vector& wi ) const
+template< class NDF , class VIS , class FR >
+float MicroFacetReflectionT<NDF,VIS,FR>::Pdf( const Vector& wo , const Vector& wi ) const
 {
 	if( !SameHemisphere( wo , wi ) )
 		return 0.0f;
@@ -219,16 +369,15 @@ float MicroFacetReflection::Pdf( const Vector& wo , const Vector& wi ) const
 	Vector h = Normalize( wo + wi );
 	float EoH = AbsDot( wo , h );
 	float HoN = AbsCosTheta(h);
-	return distribution->D(HoN) * HoN / (4.0f * EoH);
+	return distribution.D(HoN) * HoN / (4.0f * EoH);
 }
 
 // constructor
-MicroFacetRefraction::MicroFacetRefraction(const Spectrum &reflectance, Fresnel* f , MicroFacetDistribution* d , VisTerm* v , float ieta , float eeta )
+template< class NDF , class VIS , class FR >
+MicroFacetRefractionT<NDF,VIS,FR>::MicroFacetRefractionT(const Spectrum &reflectance, FR f , NDF d , VIS v , float ieta , float eeta ):
+	distribution( d ) , visterm( v ) , fresnel( f )
 {
 	R = reflectance;
-	distribution = d;
-	fresnel = f;
-	visterm = v;
 	eta_in = ieta;
 	eta_ext = eeta;
 
@@ -237,10 +386,12 @@ MicroFacetRefraction::MicroFacetRefraction(const Spectrum &reflectance, Fresnel*
 		eta_in = eta_ext + 0.01f;
 	
 	m_type = (BXDF_TYPE)(BXDF_DIFFUSE | BXDF_REFLECTION);
+	m_closure = MicrofacetClosure<MicroFacetRefractionT>::value;
 }
 
 // evaluate bxdf
-Spectrum MicroFacetRefraction::f( const Vector& wo , const Vector& wi ) const
+template< class NDF , class VIS , class FR >
+Spectrum MicroFacetRefractionT<NDF,VIS,FR>::f( const Vector& wo , const Vector& wi ) const
 {
     if( SameHemiSphere(wi, wo) )
         return Spectrum(0.f);
@@ -259,22 +410,23 @@ Spectrum MicroFacetRefraction::f( const Vector& wo , const Vector& wi ) const
 	float VoH = fabs(sVoH);
 	
 	// Fresnel term
-	Spectrum F = fresnel->Evaluate(Dot(wi, wh),sVoH);
+	Spectrum F = fresnel.Evaluate(Dot(wi, wh),sVoH);
 
 	float sqrtDenom = Dot(wo, wh) + eta * Dot(wi, wh);
 	float t = eta / sqrtDenom;
-	return (Spectrum(1.f) - F) * R * distribution->D(NoH) * visterm->Vis_Term( NoL , NoV , VoH , NoH ) * 
+	return (Spectrum(1.f) - F) * R * distribution.D(NoH) * visterm.Vis_Term( NoL , NoV , VoH , NoH ) * 
 				t * t * AbsDot(wi, wh) * AbsDot(wo, wh) * 4.0f ;
 }
 
 // sample a direction using importance sampling
-Spectrum MicroFacetRefraction::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pdf ) const
+template< class NDF , class VIS , class FR >
+Spectrum MicroFacetRefractionT<NDF,VIS,FR>::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pdf ) const
 {
     if( CosTheta( wo ) == 0.0f )
         return 0.0f;
     
 	// sampling the normal
-	Vector wh = distribution->sample_f( bs );
+	Vector wh = distribution.sample_f( bs );
 
 	// try to get refracted ray
 	bool total_reflection = false;
@@ -287,7 +439,8 @@ Spectrum MicroFacetRefraction::sample_f( const Vector& wo , Vector& wi , const B
 }
 
 // get the pdf of the sampled direction
-float MicroFacetRefraction::Pdf( const Vector& wo , const Vector& wi ) const
+template< class NDF , class VIS , class FR >
+float MicroFacetRefractionT<NDF,VIS,FR>::Pdf( const Vector& wo , const Vector& wi ) const
 {
 	if( SameHemisphere( wo , wi ) )
         return 0.0f;
@@ -299,5 +452,16 @@ float MicroFacetRefraction::Pdf( const Vector& wo , const Vector& wi ) const
     float sqrtDenom = Dot(wo, wh) + eta * Dot(wi, wh);
     float dwh_dwi = eta * eta * AbsDot(wi, wh) / (sqrtDenom * sqrtDenom);
 	float HoN = AbsCosTheta(wh);
-    return distribution->D(HoN) * HoN * dwh_dwi;
+    return distribution.D(HoN) * HoN * dwh_dwi;
 }
+
+// the generic closures and the common combinations are the only instances
+template class MicroFacetReflectionT< const MicroFacetDistribution& , const VisTerm& , const Fresnel& >;
+template class MicroFacetRefractionT< const MicroFacetDistribution& , const VisTerm& , const Fresnel& >;
+template class MicroFacetReflectionT< Blinn , VisCookTorrance , FresnelConductor >;
+template class MicroFacetReflectionT< Beckmann , VisCookTorrance , FresnelConductor >;
+template class MicroFacetReflectionT< GGX , VisCookTorrance , FresnelConductor >;
+template class MicroFacetReflectionT< GGX , VisSmithJointApprox , FresnelConductor >;
+template class MicroFacetRefractionT< Blinn , VisCookTorrance , FresnelDielectric >;
+template class MicroFacetRefractionT< GGX , VisCookTorrance , FresnelDielectric >;
+template class MicroFacetRefractionT< GGX , VisSmithJointApprox , FresnelDielectric >;
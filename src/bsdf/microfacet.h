@@ -27,6 +27,14 @@ public:
 	//! @brief Probabilty of facet with specific normal (v)
 	virtual float D(float NoH) const = 0;
 
+	//! @brief Probabilty of facets with a batch of normals.
+    //!
+    //! Each normal is evaluated on its own by default, distributions with vectorized kernels override it.
+    //! @param NoH      Cosine values between the normals and the surface normal.
+    //! @param d        The probability of each normal.
+    //! @param count    The number of normals.
+	virtual void D( const float* NoH , float* d , unsigned count ) const;
+
 	//! @brief Sampling a normal respect to the NDF.
     //! @param bs   Sample holind all necessary random variables.
     //! @return     Sampled normal direction based on the NDF.
@@ -34,9 +42,11 @@ public:
 };
 
 //! @brief Blinn NDF.
-class Blinn : public MicroFacetDistribution
+class Blinn final : public MicroFacetDistribution
 {
 public:
+	using MicroFacetDistribution::D;
+
 	//! @brief Constructor
     //! @param roughness    Roughness of the surface formed by the micro facets.
 	Blinn( float roughness );
@@ -58,9 +68,11 @@ private:
 };
 
 //! @brief Beckmann NDF.
-class Beckmann : public MicroFacetDistribution
+class Beckmann final : public MicroFacetDistribution
 {
 public:
+	using MicroFacetDistribution::D;
+
     //! @brief Constructor
     //! @param roughness    Roughness of the surface formed by the micro facets.
 	Beckmann( float roughness );
@@ -83,7 +95,7 @@ private:
 };
 
 //! @brief GGX NDF.
-class GGX : public MicroFacetDistribution
+class GGX final : public MicroFacetDistribution
 {
 public:
     //! @brief Constructor
@@ -92,6 +104,9 @@ public:
 
     //! @brief Probabilty of facet with specific normal (v)
     float D(float NoH) const override;
+
+    //! @brief Probabilty of facets with a batch of normals, four of them are evaluated at once.
+    void D( const float* NoH , float* d , unsigned count ) const override;
     
     //! @brief Sampling a normal respect to the NDF.
     //!
@@ -117,77 +132,98 @@ public:
     //! @param VoH  Cosine value of the angle between view and middle vector
     //! @param NoH  Cosine value of the angle between normal and middle vector
     //! @return     Visibility term
-	virtual float Vis_Term( float NoL , float NoV , float VoH , float NoH ) = 0;
+	virtual float Vis_Term( float NoL , float NoV , float VoH , float NoH ) const = 0;
+
+    //! @brief Evalute visibility term for a batch of directions.
+    //!
+    //! Each direction is evaluated on its own by default, visibility terms with vectorized kernels override it.
+    //! @param NoL      Cosine values of the angle between light and normal.
+    //! @param NoV      Cosine values of the angle between view direction and normal
+    //! @param VoH      Cosine values of the angle between view and middle vector
+    //! @param NoH      Cosine values of the angle between normal and middle vector
+    //! @param vis      Visibility term of each direction.
+    //! @param count    The number of directions.
+	virtual void Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const;
 };
 
 //! @brief Implicit visibility term.
-class VisImplicit : public VisTerm
+class VisImplicit final : public VisTerm
 {
 public:
-    float Vis_Term( float NoL , float NoV , float VoH , float NoH) override;
+    float Vis_Term( float NoL , float NoV , float VoH , float NoH) const override;
+    void Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const override;
 };
 
 //! @brief Neumann visibility term.
-class VisNeumann : public VisTerm
+class VisNeumann final : public VisTerm
 {
 public:
-	float Vis_Term( float NoL , float NoV , float VoH , float NoH) override;
+	using VisTerm::Vis_Term;
+
+	float Vis_Term( float NoL , float NoV , float VoH , float NoH) const override;
 };
 
 //! @brief Kelemen visibility term.
-class VisKelemen : public VisTerm
+class VisKelemen final : public VisTerm
 {
 public:
-    float Vis_Term( float NoL , float NoV , float VoH , float NoH) override;
+	using VisTerm::Vis_Term;
+
+    float Vis_Term( float NoL , float NoV , float VoH , float NoH) const override;
 };
 
 //! @brief Schlick visibility term.
-class VisSchlick : public VisTerm
+class VisSchlick final : public VisTerm
 {
 public:
     //! @brief Constructor
     //! @param rough    Roughness value.
 	VisSchlick( float rough ): roughness(rough) {}
     
-    float Vis_Term( float NoL , float NoV , float VoH , float NoH) override;
+    float Vis_Term( float NoL , float NoV , float VoH , float NoH) const override;
+    void Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const override;
 
 private:
 	float roughness;    /**< Roughness value */
 };
 
 //! @brief Smith visibility term.
-class VisSmith : public VisTerm
+class VisSmith final : public VisTerm
 {
 public:
     //! @brief Constructor
     //! @param rough    Roughness value.
 	VisSmith( float rough ): roughness(rough) {}
     
-    float Vis_Term( float NoL , float NoV , float VoH , float NoH) override;
+    float Vis_Term( float NoL , float NoV , float VoH , float NoH) const override;
+    void Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const override;
 
 private:
 	float roughness;    /**< Roughness value */
 };
 
 //! @brief Smith Joint Approximation visibility term.
-class VisSmithJointApprox : public VisTerm
+class VisSmithJointApprox final : public VisTerm
 {
 public:
     //! @brief Constructor
     //! @param rough    Roughness value.
 	VisSmithJointApprox( float rough ): roughness(rough) {}
     
-    float Vis_Term( float NoL , float NoV , float VoH , float NoH) override;
+    float Vis_Term( float NoL , float NoV , float VoH , float NoH) const override;
+    void Vis_Term( const float* NoL , const float* NoV , const float* VoH , const float* NoH , float* vis , unsigned count ) const override;
 
 private:
 	float roughness;    /**< Roughness value */
 };
 
 //! @brief CookTorrance visibility term.
-class VisCookTorrance : public VisTerm
+class VisCookTorrance final : public VisTerm
 {
 public:
-    float Vis_Term( float NoL , float NoV , float VoH , float NoH) override;
+	using VisTerm::Vis_Term;
+
+    float Vis_Term( float NoL , float NoV , float VoH , float NoH) const override;
 };
 
 //! @brief Interface for Microfacet bxdf.
@@ -195,10 +231,13 @@ class Microfacet : public Bxdf
 {
 protected:
 	Spectrum R;                                     /**< Direction-hemisphere reflection. */
-	MicroFacetDistribution* distribution = nullptr; /**< Normal distribution of micro facets. */
-	Fresnel* fresnel = nullptr;                     /**< Fresnel term. */
-	VisTerm* visterm = nullptr;                     /**< Visibility term. */
 
+public:
+	//! The albedo is estimated by the reflectance, the fresnel term is ignored.
+    //! @return The intensity of the reflectance.
+	float Albedo() const override { return R.GetIntensity(); }
+
+protected:
 	//! @brief Get reflected direction based on incident direction and normal.
     //! @param v    Incoming direction.
     //! @param n    Normal of the surface.
@@ -216,7 +255,12 @@ protected:
 };
 
 //! @brief Microfacet for reflection surfaces.
-class MicroFacetReflection : public Microfacet
+//!
+//! The NDF, visibility and fresnel terms are either references to the abstract terms, which are called
+//! virtually, or final terms held by value, whose calls are resolved and inlined at compile time. The
+//! member functions are only instantiated in microfacet.cpp for the combinations listed below.
+template< class NDF , class VIS , class FR >
+class MicroFacetReflectionT final : public Microfacet
 {
 public:
 	//! @brief Constructor
@@ -224,7 +268,7 @@ public:
     //! @param f                Fresnel term.
     //! @param d                NDF term.
     //! @param v                Visibility term.
-	MicroFacetReflection(const Spectrum &reflectance, Fresnel* f , MicroFacetDistribution* d , VisTerm* v );
+	MicroFacetReflectionT( const Spectrum &reflectance, FR f , NDF d , VIS v );
 	
     //! @brief Evaluate the BRDF
     //! @param wo   Exitance direction in shading coordinate.
@@ -245,12 +289,29 @@ public:
     //! @param wi   Incomiing direction in shading coordinate.
     //! @return     The probabilty of choosing the out-going direction based on the incoming direction.
 	float Pdf( const Vector& wo , const Vector& wi ) const override;
+
+    //! @brief Evaluate the BRDF for a batch of incident directions.
+    //!
+    //! The cosine values of all directions are gathered first, then the NDF, visibility and fresnel
+    //! terms are evaluated for the whole batch by their vectorized kernels.
+    //! @param wo       Exitance direction in shading coordinate.
+    //! @param wi       Incident directions in shading coordinate.
+    //! @param f        The evaluated BRDF value of each direction.
+    //! @param count    The number of directions, it is at most BXDF_BATCH_SIZE.
+    void f_batch( const Vector& wo , const Vector* wi , Spectrum* f , unsigned count ) const override;
+
+private:
+	NDF distribution;   /**< Normal distribution of micro facets. */
+	VIS visterm;        /**< Visibility term. */
+	FR fresnel;         /**< Fresnel term. */
 };
 
 /////////////////////////////////////////////////////////////////////
 // microfacet refraction bxdf
 // Refer to "Microfacet Models for Refraction through Rough Surfaces" for further detail
-class MicroFacetRefraction : public Microfacet
+// The terms are template arguments the same way as the ones of MicroFacetReflectionT.
+template< class NDF , class VIS , class FR >
+class MicroFacetRefractionT final : public Microfacet
 {
 public:
     //! @brief Constructor
@@ -260,7 +321,7 @@ public:
     //! @param v                Visibility term.
     //! @param ieta             Index of refraction inside the surface.
     //! @param eeta             Index of refraction outside the surface.
-	MicroFacetRefraction(const Spectrum &reflectance, Fresnel* f , MicroFacetDistribution* d , VisTerm* v , float ieta , float eeta );
+	MicroFacetRefractionT(const Spectrum &reflectance, FR f , NDF d , VIS v , float ieta , float eeta );
 	
     //! @brief Evaluate the BRDF
     //! @param wo   Exitance direction in shading coordinate.
@@ -283,6 +344,33 @@ public:
     float Pdf( const Vector& wo , const Vector& wi ) const override;
 
 private:
+	NDF distribution;   /**< Normal distribution of micro facets. */
+	VIS visterm;        /**< Visibility term. */
+	FR fresnel;         /**< Fresnel term. */
 	float	eta_in;     /**< Index of refraction inside the surface. */
 	float	eta_ext;    /**< Index of refraction outside the surface. */
 };
+
+//! Microfacet reflection with any terms, all of them are called virtually.
+typedef MicroFacetReflectionT< const MicroFacetDistribution& , const VisTerm& , const Fresnel& > MicroFacetReflection;
+//! Microfacet refraction with any terms, all of them are called virtually.
+typedef MicroFacetRefractionT< const MicroFacetDistribution& , const VisTerm& , const Fresnel& > MicroFacetRefraction;
+
+// the common combinations of the material nodes , each of them has its own closure tag
+typedef MicroFacetReflectionT< Blinn , VisCookTorrance , FresnelConductor >			MicroFacetReflectionBlinnCookTorrance;
+typedef MicroFacetReflectionT< Beckmann , VisCookTorrance , FresnelConductor >		MicroFacetReflectionBeckmannCookTorrance;
+typedef MicroFacetReflectionT< GGX , VisCookTorrance , FresnelConductor >			MicroFacetReflectionGGXCookTorrance;
+typedef MicroFacetReflectionT< GGX , VisSmithJointApprox , FresnelConductor >		MicroFacetReflectionGGXSmithJoint;
+typedef MicroFacetRefractionT< Blinn , VisCookTorrance , FresnelDielectric >		MicroFacetRefractionBlinnCookTorrance;
+typedef MicroFacetRefractionT< GGX , VisCookTorrance , FresnelDielectric >			MicroFacetRefractionGGXCookTorrance;
+typedef MicroFacetRefractionT< GGX , VisSmithJointApprox , FresnelDielectric >		MicroFacetRefractionGGXSmithJoint;
+
+extern template class MicroFacetReflectionT< const MicroFacetDistribution& , const VisTerm& , const Fresnel& >;
+extern template class MicroFacetRefractionT< const MicroFacetDistribution& , const VisTerm& , const Fresnel& >;
+extern template class MicroFacetReflectionT< Blinn , VisCookTorrance , FresnelConductor >;
+extern template class MicroFacetReflectionT< Beckmann , VisCookTorrance , FresnelConductor >;
+extern template class MicroFacetReflectionT< GGX , VisCookTorrance , FresnelConductor >;
+extern template class MicroFacetReflectionT< GGX , VisSmithJointApprox , FresnelConductor >;
+extern template class MicroFacetRefractionT< Blinn , VisCookTorrance , FresnelDielectric >;
+extern template class MicroFacetRefractionT< GGX , VisCookTorrance , FresnelDielectric >;
+extern template class MicroFacetRefractionT< GGX , VisSmithJointApprox , FresnelDielectric >;
@@ -32,6 +32,7 @@ OrenNayar::OrenNayar( const Spectrum& reflectance , float roughness)
 	B = 0.45f * roughness2 / ( roughness2 + 0.09f );
 	
 	m_type = (BXDF_TYPE)(BXDF_DIFFUSE | BXDF_REFLECTION);
+	m_closure = BXDF_CLOSURE_ORENNAYAR;
 }
 
 // evaluate bxdf
@@ -25,7 +25,7 @@
  * Like lambert brdf, OrenNayar delievers similar quality with subtle differences.
  * It has slightly brighter color at the contour.
  */
-class OrenNayar : public Bxdf
+class OrenNayar final : public Bxdf
 {
 public:
 	//! Contstructor
@@ -38,6 +38,10 @@ public:
     //! @param wi   Incomiing direction in shading coordinate.
     //! @return     The evaluted BRDF value.
     Spectrum f( const Vector& wo , const Vector& wi ) const override;
+
+    //! The albedo is estimated by the reflectance.
+    //! @return The intensity of the reflectance.
+    float Albedo() const override { return R.GetIntensity(); }
 	
 private:
 	Spectrum R;         /**< Direction-Hemisphere reflection or total reflection. */
@@ -0,0 +1,26 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "camera.h"
+#include "sampler/sample.h"
+
+// generate the rays of a batch of samples one by one
+void Camera::GenerateRays( float x , float y , const PixelSample* ps , Ray* rays , unsigned count ) const
+{
+	for( unsigned k = 0 ; k < count ; ++k )
+		rays[k] = GenerateRay( x , y , ps[k] );
+}
@@ -54,6 +54,43 @@ public:
     //! @return     The generated ray based on the input.
 	virtual Ray	GenerateRay( float x, float y, const PixelSample& ps) const = 0;
 
+	//! @brief Generating the primary rays of a batch of samples in the same pixel.
+    //!
+    //! Each ray is generated on its own by default, cameras with vectorized kernels override it. The importance
+    //! of the rays is not evaluated here, GetRayImportance is only called by the integrators needing it.
+    //! @param x        Coordinate along horizontal axis on the image sensor.
+    //! @param y        Coordinate along vertical axis on the image sensor.
+    //! @param ps       Pixel samples holding the random variables of each ray.
+    //! @param rays     The generated rays, one for each pixel sample.
+    //! @param count    The number of samples.
+	virtual void GenerateRays( float x , float y , const PixelSample* ps , Ray* rays , unsigned count ) const;
+
+	//! @brief Get the importance of a primary ray. It is used in bi-directional path tracing algorithm.
+    //!
+    //! It is kept aside the ray so that the rays traced by other integrators don't carry it around.
+    //! @param r    A ray generated by the camera.
+    //! @return     The importance of the ray, everything is zero for cameras not supporting it.
+	virtual RayImportance GetRayImportance( const Ray& r ) const { return RayImportance(); }
+
+	//! @brief Get the frustum of the primary rays of a region of the image.
+    //!
+    //! The rays of every sample inside the region leave the same point and stay inside the pyramid spanned by the
+    //! corner directions. Cameras whose rays don't share an origin, like the ones with DOF, have no such frustum.
+    //! @param x0       Left edge of the region on the image sensor.
+    //! @param y0       Top edge of the region on the image sensor.
+    //! @param x1       Right edge of the region on the image sensor, it is exclusive.
+    //! @param y1       Bottom edge of the region on the image sensor, it is exclusive.
+    //! @param eye      The origin of the rays in world space.
+    //! @param corners  The unnormalized directions through the four corners of the region in world space, in the order around the region.
+    //! @return         False if the rays of the camera have no such frustum.
+	virtual bool GetFrustum( int x0 , int y0 , int x1 , int y1 , Point& eye , Vector corners[4] ) const { return false; }
+
+	//! @brief Whether the rays of the camera leave a lens instead of a single point.
+    //!
+    //! The rays of the same position on the image sensor differ from sample to sample then.
+    //! @return     True if the camera has DOF.
+	virtual bool HasLens() const { return false; }
+
 	//! @brief Setup image sensor for the camera.
     //! @param is   The pointer to an existed image sensor.
 	void SetImageSensor(ImageSensor* is) { m_imagesensor = is; }
@@ -64,6 +101,13 @@ public:
         return m_imagesensor;
     }
 
+	//! @brief Setup the distance of ray differentials.
+    //!
+    //! Differentials of primary rays go through the next pixels by default. With many samples per pixel,
+    //! each sample only covers a part of the pixel and the differentials are scaled down accordingly.
+    //! @param scale    The distance to the differentials in pixels.
+	void SetDifferentialScale( float scale ) { m_differentialScale = scale; }
+
 	//! @brief Get camera viewing point.
     //! @return Viewing point of the camera.
 	const Point& GetEye() const { return m_eye; }
@@ -96,6 +140,14 @@ protected:
     float           m_aspectRatioW = 0.0f;      /**< Aspect ratio along x axis. */
     float           m_aspectRatioH = 0.0f;      /**< Aspect ratio along y axis. */
 	int             m_aspectFit = 0;            /**< Aspect fit. It equals to 1 if it fits horizontally, otherwise it is 2. */
+    float           m_differentialScale = 1.0f; /**< Distance to the differentials of primary rays in pixels. */
+    float           m_shutterOpen = 0.0f;       /**< Time the shutter opens, 0 is the start of the frame and 1 is the end of it. */
+    float           m_shutterClose = 1.0f;      /**< Time the shutter closes. */
+
+    //! @brief Get the time of a primary ray.
+    //! @param u    The position in the shutter interval, it is in [0,1).
+    //! @return     The time of the ray in the frame.
+    float _shutterTime( float u ) const { return m_shutterOpen + ( m_shutterClose - m_shutterOpen ) * u; }
 
 	// property handler
 	class EyeProperty : public PropertyHandler<Camera>
@@ -152,4 +204,25 @@ protected:
 			camera->m_aspectRatioH = (float)atof( y.c_str() );
 		}
 	};
+
+	// property handler
+	class ShutterProperty : public PropertyHandler<Camera>
+	{
+	public:
+		// constructor
+		PH_CONSTRUCTOR(ShutterProperty,Camera);
+
+		// set value , the times the shutter opens and closes in the frame
+		void SetValue( const string& str )
+		{
+			Camera* camera = CAST_TARGET(Camera);
+
+			string _str = str;
+			string open = NextToken( _str , ' ' );
+			string close = NextToken( _str , ' ' );
+
+			camera->m_shutterOpen = min( 1.0f , max( 0.0f , (float)atof( open.c_str() ) ) );
+			camera->m_shutterClose = min( 1.0f , max( camera->m_shutterOpen , (float)atof( close.c_str() ) ) );
+		}
+	};
 };
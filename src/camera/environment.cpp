@@ -32,17 +32,31 @@ Ray	EnvironmentCamera::GenerateRay( float x , float y , const PixelSample& ps )
 {
 	sAssert( m_imagesensor != 0 , CAMERA );
 
-	x += ps.img_u;
-	y += ps.img_v;
+	// the pixel is in the rendered region of the image
+	x += ps.img_u + m_imagesensor->GetRegionX();
+	y += ps.img_v + m_imagesensor->GetRegionY();
 
 	// generate ray
-	float theta = PI * y / m_imagesensor->GetHeight();
-	float phi = 2 * PI * x / m_imagesensor->GetWidth();
-	Vector dir( sinf( theta ) * cosf( phi ) , cosf( theta ) , sinf( theta ) * sinf( phi ) );
-	Ray r( m_eye , dir );
+	const float h = (float)m_imagesensor->GetFullHeight();
+	const float w = (float)m_imagesensor->GetFullWidth();
+	auto direction = [&]( float px , float py ){
+		const float theta = PI * py / h;
+		const float phi = 2 * PI * px / w;
+		return Vector( sinf( theta ) * cosf( phi ) , cosf( theta ) , sinf( theta ) * sinf( phi ) );
+	};
+	Ray r( m_eye , direction( x , y ) );
+
+	// the differentials start from the eye and go through the same position of the next pixels
+	r.m_HasDifferentials = true;
+	r.m_DxOri = m_eye;
+	r.m_DyOri = m_eye;
+	r.m_DxDir = direction( x + m_differentialScale , y );
+	r.m_DyDir = direction( x , y + m_differentialScale );
 
 	// transform the ray
 	r = m_transform(r);
+	r.m_Time = _shutterTime( ps.time );
+	r.m_Type = RAY_CAMERA;
 
 	return r;
 }
@@ -51,4 +65,5 @@ Ray	EnvironmentCamera::GenerateRay( float x , float y , const PixelSample& ps )
 void EnvironmentCamera::registerAllProperty()
 {
 	_registerProperty( "eye" , new EyeProperty( this ) );
+	_registerProperty( "shutter" , new ShutterProperty( this ) );
 }
@@ -19,6 +19,7 @@
 #include "utility/sassert.h"
 #include "sampler/sample.h"
 #include "imagesensor/imagesensor.h"
+#include "math/simd/simd.h"
 
 IMPLEMENT_CREATOR( OrthoCamera );
 
@@ -35,11 +36,12 @@ OrthoCamera::OrthoCamera()
 // generate camera ray
 Ray OrthoCamera::GenerateRay( float x, float y, const PixelSample &ps) const
 {
-	x += ps.img_u;
-	y += ps.img_v;
+	// the pixel is in the rendered region of the image
+	x += ps.img_u + m_imagesensor->GetRegionX();
+	y += ps.img_v + m_imagesensor->GetRegionY();
 
-	float w = (float)m_imagesensor->GetWidth();
-	float h = (float)m_imagesensor->GetHeight();
+	float w = (float)m_imagesensor->GetFullWidth();
+	float h = (float)m_imagesensor->GetFullHeight();
 
 	x = ( ( x / w ) - 0.5f ) * m_camWidth;
 	y = -1.0f * ( ( y / h - 0.5f ) ) * m_camHeight;
@@ -47,7 +49,64 @@ Ray OrthoCamera::GenerateRay( float x, float y, const PixelSample &ps) const
 	Point ori = world2camera( Point( x , y , 0.0f ) );
 	Vector dir = world2camera( Vector( 0.0f , 0.0f , 1.0f ) );
 
-	return Ray( ori , dir );
+	// the differentials are parallel to the ray and start from the same position of the next pixels
+	Ray r( ori , dir );
+	r.m_HasDifferentials = true;
+	r.m_DxOri = ori + m_rasterDx * m_differentialScale;
+	r.m_DyOri = ori + m_rasterDy * m_differentialScale;
+	r.m_DxDir = dir;
+	r.m_DyDir = dir;
+	r.m_Time = _shutterTime( ps.time );
+	r.m_Type = RAY_CAMERA;
+	return r;
+}
+
+// Preprocess
+void OrthoCamera::PreProcess()
+{
+	// the origin is linear in the raster position , the raster starts from the corner of the rendered region
+	const float w = (float)m_imagesensor->GetFullWidth();
+	const float h = (float)m_imagesensor->GetFullHeight();
+	const float x = m_imagesensor->GetRegionX() / w - 0.5f;
+	const float y = 0.5f - m_imagesensor->GetRegionY() / h;
+	m_rasterOri = world2camera( Point( x * m_camWidth , y * m_camHeight , 0.0f ) );
+	m_rasterDx = world2camera( Vector( m_camWidth / w , 0.0f , 0.0f ) );
+	m_rasterDy = world2camera( Vector( 0.0f , -m_camHeight / h , 0.0f ) );
+	m_dir = world2camera( Vector( 0.0f , 0.0f , 1.0f ) );
+}
+
+// generate the rays of a batch of samples
+void OrthoCamera::GenerateRays( float x , float y , const PixelSample* ps , Ray* rays , unsigned count ) const
+{
+	typedef vfloat<SIMD_NATIVE_WIDTH> vf;
+	const Vec3<vf> ori( Vector( m_rasterOri.x , m_rasterOri.y , m_rasterOri.z ) );
+	const Vec3<vf> dx( m_rasterDx ) , dy( m_rasterDy );
+	const Vector diff_x = m_rasterDx * m_differentialScale , diff_y = m_rasterDy * m_differentialScale;
+	for( unsigned s = 0 ; s < count ; s += SIMD_NATIVE_WIDTH )
+	{
+		// the samples after 'count' are computed but not written
+		float u[SIMD_NATIVE_WIDTH] , v[SIMD_NATIVE_WIDTH];
+		for( int k = 0 ; k < SIMD_NATIVE_WIDTH ; ++k ){
+			const PixelSample& sample = ps[ min( s + k , count - 1 ) ];
+			u[k] = x + sample.img_u;
+			v[k] = y + sample.img_v;
+		}
+		const Vec3<vf> o = ori + dx * vf::Load( u ) + dy * vf::Load( v );
+
+		float r[3][SIMD_NATIVE_WIDTH];
+		o.x.Store( r[0] ); o.y.Store( r[1] ); o.z.Store( r[2] );
+		for( unsigned k = 0 ; k < SIMD_NATIVE_WIDTH && s + k < count ; ++k ){
+			Ray& ray = rays[s+k];
+			ray = Ray( Point( r[0][k] , r[1][k] , r[2][k] ) , m_dir );
+			ray.m_HasDifferentials = true;
+			ray.m_DxOri = ray.m_Ori + diff_x;
+			ray.m_DyOri = ray.m_Ori + diff_y;
+			ray.m_DxDir = m_dir;
+			ray.m_DyDir = m_dir;
+			ray.m_Time = _shutterTime( ps[s+k].time );
+			ray.m_Type = RAY_CAMERA;
+		}
+	}
 }
 
 // set the camera range
@@ -84,4 +143,5 @@ void OrthoCamera::registerAllProperty()
 	_registerProperty( "target" , new TargetProperty( this ) );
 	_registerProperty( "width" , new WidthProperty( this ) );
 	_registerProperty( "height" , new HeightProperty( this ) );
+	_registerProperty( "shutter" , new ShutterProperty( this ) );
 }
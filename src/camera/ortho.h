@@ -40,6 +40,20 @@ public:
     //! @return     The generated ray based on the input.
 	virtual Ray GenerateRay( float x , float y , const PixelSample& ps ) const;
 
+    //! @brief Pre-process after initialization.
+    void PreProcess() override;
+
+    //! @brief Generating the primary rays of a batch of samples in the same pixel.
+    //!
+    //! The origins are linear in the raster position and all rays share the same direction, the origins
+    //! of several samples are evaluated at once from the per-pixel deltas in world space.
+    //! @param x        Coordinate along horizontal axis on the image sensor.
+    //! @param y        Coordinate along vertical axis on the image sensor.
+    //! @param ps       Pixel samples holding the random variables of each ray.
+    //! @param rays     The generated rays, one for each pixel sample.
+    //! @param count    The number of samples.
+    void GenerateRays( float x , float y , const PixelSample* ps , Ray* rays , unsigned count ) const override;
+
     //! @brief Get camera viewing target.
     //! @return Camera viewing target.
     const Point& GetTarget() const { return m_target; }
@@ -102,6 +116,10 @@ protected:
     float   m_camWidth = 1.0f;   /**< Camera image plane width in world space. */
     float   m_camHeight = 1.0f;  /**< Camera image plane height in world space. */
 	Matrix  world2camera;        /**< Transformation from world space to view space. */
+    Point   m_rasterOri;         /**< World space origin of the rays through the corner of the raster. */
+    Vector  m_rasterDx;          /**< Change of the origin from one pixel to the next along x. */
+    Vector  m_rasterDy;          /**< Change of the origin from one pixel to the next along y. */
+    Vector  m_dir;               /**< World space direction shared by all rays. */
 
     //! @brief Udpate transformation
     void updateTransform();
@@ -24,6 +24,7 @@
 #include "utility/samplemethod.h"
 #include "imagesensor/imagesensor.h"
 #include "light/light.h"
+#include "math/simd/simd.h"
 
 IMPLEMENT_CREATOR( PerspectiveCamera );
 
@@ -37,13 +38,14 @@ void PerspectiveCamera::registerAllProperty()
     _registerProperty( "target" , new TargetProperty( this ) );
     _registerProperty( "fov" , new FovProperty( this ) );
     _registerProperty( "len" , new LenProperty( this ) );
+    _registerProperty( "shutter" , new ShutterProperty( this ) );
 }
 
 // Preprocess
 void PerspectiveCamera::PreProcess()
 {
-    float w = (float)m_imagesensor->GetWidth();
-    float h = (float)m_imagesensor->GetHeight();
+    float w = (float)m_imagesensor->GetFullWidth();
+    float h = (float)m_imagesensor->GetFullHeight();
     float aspect = w/h * m_aspectRatioW/m_aspectRatioH;
     
     float yScale = 1.0f / tan( m_fov * 0.5f );
@@ -70,13 +72,20 @@ void PerspectiveCamera::PreProcess()
     m_focalDistance = ( m_target - m_eye ).Length();
     m_forward = ( m_target - m_eye ) / m_focalDistance;
     
-    // clip space to raster space
-    m_clipToRaster = Scale( w , h , 1.0f ) * Scale( 0.5f , -0.5f , 1.0f ) * Translate( 1.0f , -1.0f , 0.0f ) ;
+    // clip space to raster space , the raster starts from the corner of the rendered region
+    m_clipToRaster = Translate( -(float)m_imagesensor->GetRegionX() , -(float)m_imagesensor->GetRegionY() , 0.0f ) * Scale( w , h , 1.0f ) * Scale( 0.5f , -0.5f , 1.0f ) * Translate( 1.0f , -1.0f , 0.0f ) ;
     m_cameraToClip = Perspective(xScale, yScale);
     m_cameraToRaster = m_clipToRaster * m_cameraToClip;
     m_worldToCamera = ViewLookat( m_eye , m_forward , m_up );
+    m_viewTransform = AffineTransform( m_worldToCamera );
     m_worldToRaster = m_cameraToRaster * m_worldToCamera;
 	m_inverseApartureSize = (m_lensRadius==0)? 1.0f : (1.0f / ( m_lensRadius * m_lensRadius * PI));
+
+    // the raster is mapped to the near plane , so the directions of a pinhole camera are linear in the raster position
+    const Vector corner( m_cameraToRaster.invMatrix( Point( 0.0f , 0.0f , 0.0f ) ) );
+    m_rasterDir = m_viewTransform.invMatrix( corner );
+    m_rasterDx = m_viewTransform.invMatrix( Vector( m_cameraToRaster.invMatrix( Point( 1.0f , 0.0f , 0.0f ) ) ) - corner );
+    m_rasterDy = m_viewTransform.invMatrix( Vector( m_cameraToRaster.invMatrix( Point( 0.0f , 1.0f , 0.0f ) ) ) - corner );
 }
 
 // generate ray
@@ -90,6 +99,11 @@ Ray	PerspectiveCamera::GenerateRay( float x , float y , const PixelSample& ps )
 	
 	Ray r;
     r.m_Dir = view_dir.Normalize();
+
+    // the differentials go through the same position of the next pixels
+    r.m_HasDifferentials = true;
+    r.m_DxDir = Normalize( Vector( m_cameraToRaster.invMatrix( Point( rastP.x + m_differentialScale , rastP.y , 0.0f ) ) ) );
+    r.m_DyDir = Normalize( Vector( m_cameraToRaster.invMatrix( Point( rastP.x , rastP.y + m_differentialScale , 0.0f ) ) ) );
     
     // Handle DOF camera ray adaption
     if( m_lensRadius != 0 )
@@ -102,28 +116,115 @@ Ray	PerspectiveCamera::GenerateRay( float x , float y , const PixelSample& ps )
         r.m_Ori.x = s * m_lensRadius;
         r.m_Ori.y = t * m_lensRadius;
         r.m_Dir = Normalize( target - r.m_Ori );
+
+        // the differentials start from the same point on the lens and meet their own rays on the focal plane
+        const Point target_dx = Point() + r.m_DxDir * ( m_focalDistance / r.m_DxDir.z );
+        const Point target_dy = Point() + r.m_DyDir * ( m_focalDistance / r.m_DyDir.z );
+        r.m_DxDir = Normalize( target_dx - r.m_Ori );
+        r.m_DyDir = Normalize( target_dy - r.m_Ori );
     }
+    r.m_DxOri = r.m_Ori;
+    r.m_DyOri = r.m_Ori;
 
     // transform the ray from camera space to world space
-    r = m_worldToCamera.invMatrix( r );
+    r = m_viewTransform.invMatrix( r );
+    r.m_Time = _shutterTime( ps.time );
+    r.m_Type = RAY_CAMERA;
+
+	return r;
+}
+
+// generate the rays of N samples of a pinhole camera , the ones after 'count' are computed but not written
+template<int N>
+static void generatePinholeRays( const Point& eye , const Vector& dir , const Vector& dx , const Vector& dy , float diff ,
+                                 float x , float y , const PixelSample* ps , Ray* rays , unsigned count )
+{
+    typedef vfloat<N> vf;
+    float u[N] , v[N];
+    for( int k = 0 ; k < N ; ++k ){
+        const PixelSample& s = ps[ min( (unsigned)k , count - 1 ) ];
+        u[k] = x + s.img_u;
+        v[k] = y + s.img_v;
+    }
 
+    // the differentials go through the same position of the next pixels
+    const Vec3<vf> d = Vec3<vf>( dir ) + Vec3<vf>( dx ) * vf::Load( u ) + Vec3<vf>( dy ) * vf::Load( v );
+    const Vec3<vf> d_dx = d + Vec3<vf>( dx * diff );
+    const Vec3<vf> d_dy = d + Vec3<vf>( dy * diff );
+    const Vec3<vf> n = d * ( vf( 1.0f ) / Sqrt( Dot( d , d ) ) );
+    const Vec3<vf> n_dx = d_dx * ( vf( 1.0f ) / Sqrt( Dot( d_dx , d_dx ) ) );
+    const Vec3<vf> n_dy = d_dy * ( vf( 1.0f ) / Sqrt( Dot( d_dy , d_dy ) ) );
+
+    float r[9][N];
+    n.x.Store( r[0] ); n.y.Store( r[1] ); n.z.Store( r[2] );
+    n_dx.x.Store( r[3] ); n_dx.y.Store( r[4] ); n_dx.z.Store( r[5] );
+    n_dy.x.Store( r[6] ); n_dy.y.Store( r[7] ); n_dy.z.Store( r[8] );
+    for( unsigned k = 0 ; k < count && k < (unsigned)N ; ++k ){
+        Ray& ray = rays[k];
+        ray = Ray( eye , Vector( r[0][k] , r[1][k] , r[2][k] ) );
+        ray.m_HasDifferentials = true;
+        ray.m_DxOri = eye;
+        ray.m_DyOri = eye;
+        ray.m_DxDir = Vector( r[3][k] , r[4][k] , r[5][k] );
+        ray.m_DyDir = Vector( r[6][k] , r[7][k] , r[8][k] );
+    }
+}
+
+// generate the rays of a batch of samples
+void PerspectiveCamera::GenerateRays( float x , float y , const PixelSample* ps , Ray* rays , unsigned count ) const
+{
+    // the lens samples of a DOF camera move the origins , they are generated one by one
+    if( m_lensRadius != 0 ){
+        Camera::GenerateRays( x , y , ps , rays , count );
+        return;
+    }
+
+    const Point eye = m_viewTransform.invMatrix( Point() );
+    for( unsigned s = 0 ; s < count ; s += SIMD_NATIVE_WIDTH )
+        generatePinholeRays<SIMD_NATIVE_WIDTH>( eye , m_rasterDir , m_rasterDx , m_rasterDy , m_differentialScale , x , y , ps + s , rays + s , count - s );
+    for( unsigned k = 0 ; k < count ; ++k ){
+        rays[k].m_Time = _shutterTime( ps[k].time );
+        rays[k].m_Type = RAY_CAMERA;
+    }
+}
+
+// get the frustum of the primary rays of a region of the image
+bool PerspectiveCamera::GetFrustum( int x0 , int y0 , int x1 , int y1 , Point& eye , Vector corners[4] ) const
+{
+    if( m_lensRadius != 0 )
+        return false;
+
+    // the directions are linear in the raster position , the samples of a pixel stay inside its edges
+    eye = m_viewTransform.invMatrix( Point() );
+    corners[0] = m_rasterDir + m_rasterDx * (float)x0 + m_rasterDy * (float)y0;
+    corners[1] = m_rasterDir + m_rasterDx * (float)x1 + m_rasterDy * (float)y0;
+    corners[2] = m_rasterDir + m_rasterDx * (float)x1 + m_rasterDy * (float)y1;
+    corners[3] = m_rasterDir + m_rasterDx * (float)x0 + m_rasterDy * (float)y1;
+    return true;
+}
+
+// get the importance of a primary ray
+RayImportance PerspectiveCamera::GetRayImportance( const Ray& r ) const
+{
 	// calculate the pdf for camera ray
 	const float cosAtCamera = Dot( m_forward , r.m_Dir );
 	const float imagePointToCameraDist = m_imagePlaneDist / cosAtCamera;
 	const float imageToSolidAngleFactor = imagePointToCameraDist * imagePointToCameraDist / cosAtCamera;
 
+	RayImportance importance;
+
 	// the pdf of the ray
 	// combination of two pdfs, sampling a point on the apature and a direction from the point
-	r.m_fPdfW = imageToSolidAngleFactor;
-	r.m_fPdfA = m_inverseApartureSize;
+	importance.pdfW = imageToSolidAngleFactor;
+	importance.pdfA = m_inverseApartureSize;
 
 	// importance of the ray
-	r.m_we = r.m_fPdfW * r.m_fPdfA / cosAtCamera;
+	importance.we = importance.pdfW * importance.pdfA / cosAtCamera;
 
 	// cos at camera
-	r.m_fCosAtCamera = cosAtCamera;
+	importance.cosAtCamera = cosAtCamera;
 
-	return r;
+	return importance;
 }
 
 // get camera coordinate according to a view direction in world space
@@ -140,7 +241,7 @@ Vector2i PerspectiveCamera::GetScreenCoord(Point p, float* pdfw, float* pdfa, fl
 	// Handle DOF camera ray adaption
 	if( m_lensRadius != 0.0f )
 	{
-		Point view_target = m_worldToCamera( p );
+		Point view_target = m_viewTransform( p );
 
 		float s , t;
         UniformSampleDisk( sort_canonical() , sort_canonical() , s , t );
@@ -156,7 +257,7 @@ Vector2i PerspectiveCamera::GetScreenCoord(Point p, float* pdfw, float* pdfa, fl
         Point view_focal_target = shadow_ray( m_focalDistance / shadow_ray.m_Dir.z );
         rastP = m_cameraToRaster( view_focal_target );
         
-		shadow_ray = m_worldToCamera.invMatrix( shadow_ray );
+		shadow_ray = m_viewTransform.invMatrix( shadow_ray );
 		visibility->ray = shadow_ray ;
 
 		if( eyeP )
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "camera.h"
+#include "math/affine.h"
 
 //! @brief Perspective camera.
 /**
@@ -45,6 +46,36 @@ public:
     //! @return     The generated ray based on the input.
     Ray GenerateRay( float x , float y , const PixelSample& ps ) const override;
 
+    //! @brief Generating the primary rays of a batch of samples in the same pixel.
+    //!
+    //! The directions of a pinhole camera are linear in the raster position, they are evaluated for several
+    //! samples at once from the per-pixel deltas in world space. Cameras with DOF generate them one by one.
+    //! @param x        Coordinate along horizontal axis on the image sensor.
+    //! @param y        Coordinate along vertical axis on the image sensor.
+    //! @param ps       Pixel samples holding the random variables of each ray.
+    //! @param rays     The generated rays, one for each pixel sample.
+    //! @param count    The number of samples.
+    void GenerateRays( float x , float y , const PixelSample* ps , Ray* rays , unsigned count ) const override;
+
+	//! @brief Get the importance of a primary ray.
+    //! @param r    A ray generated by the camera.
+    //! @return     The importance of the ray.
+	RayImportance GetRayImportance( const Ray& r ) const override;
+
+	//! @brief Get the frustum of the primary rays of a region of the image, only a pinhole camera has one.
+    //! @param x0       Left edge of the region on the image sensor.
+    //! @param y0       Top edge of the region on the image sensor.
+    //! @param x1       Right edge of the region on the image sensor, it is exclusive.
+    //! @param y1       Bottom edge of the region on the image sensor, it is exclusive.
+    //! @param eye      The origin of the rays in world space.
+    //! @param corners  The unnormalized directions through the four corners of the region in world space.
+    //! @return         False if the camera has DOF.
+	bool GetFrustum( int x0 , int y0 , int x1 , int y1 , Point& eye , Vector corners[4] ) const override;
+
+	//! @brief Whether the camera has DOF.
+    //! @return     True if the radius of the lens isn't zero.
+	bool HasLens() const override { return m_lensRadius != 0; }
+
 	//! @brief Get camera viewing target.
     //! @return Camera viewing target.
 	const Point& GetTarget() const { return m_target; }
@@ -111,6 +142,10 @@ protected:
     Transform   m_cameraToRaster;       /**< Transformation from view space to screen space. */
     Transform   m_worldToCamera;        /**< Transformation from world space to camera space. */
     Transform   m_worldToRaster;        /**< Transformation from world space to screen space. */
+    AffineTransform m_viewTransform;    /**< The same as m_worldToCamera , the view transformation is always affine. */
+    Vector      m_rasterDir;            /**< Unnormalized world space direction through the corner of the raster. */
+    Vector      m_rasterDx;             /**< Change of the unnormalized direction from one pixel to the next along x. */
+    Vector      m_rasterDy;             /**< Change of the unnormalized direction from one pixel to the next along y. */
 	
 	//! @brief Register all properties for camera.
 	void registerAllProperty();
@@ -95,6 +95,12 @@ void BBox::InvalidBBox()
 	m_Max = Point( -FLT_MAX , -FLT_MAX , -FLT_MAX );
 }
 
+// whether the bounding box is valid
+bool BBox::IsValid() const
+{
+	return m_Min.x <= m_Max.x && m_Min.y <= m_Max.y && m_Min.z <= m_Max.z;
+}
+
 // get the surface area of the bounding box
 float BBox::SurfaceArea() const
 {
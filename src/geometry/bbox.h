@@ -74,6 +74,10 @@ public:
 	// set the bounding box as invalid
 	void InvalidBBox();
 
+	// whether the bounding box is valid
+	// result :	return false if the minium point is larger than the maxium point along any axis
+	bool IsValid() const;
+
 // public data
 public:
 	// the minium and maxium point of the bounding box
@@ -114,6 +118,22 @@ inline BBox Union( const BBox& bbox0 , const BBox& bbox1 )
 	return result;
 }
 
+// para 'bbox0' :	first bounding box
+// para 'bbox1' :	second bounding box
+// result       :	the overlapped part of 'bbox0' and 'bbox1', it is invalid if they don't overlap
+inline BBox Overlap( const BBox& bbox0 , const BBox& bbox1 )
+{
+	BBox result;
+
+	for( int i = 0 ; i < 3 ; i++ )
+	{
+		result.m_Min[i] = max( bbox0.m_Min[i] , bbox1.m_Min[i] );
+		result.m_Max[i] = min( bbox0.m_Max[i] , bbox1.m_Max[i] );
+	}
+
+	return result;
+}
+
 // bounding box and ray intersection
 // para 'ray' : the ray
 // para 'bb'  : the bounding box
@@ -158,4 +178,40 @@ inline float Intersect( const Ray& ray , const BBox& bb , float* fmax = 0 )
 	return tmin;
 }
 
+// bounding box and traversal ray intersection , the result is exactly the same as the test against 'Ray'
+// para 'ray' : the traversal ray
+// para 'bb'  : the bounding box
+// para 'fmax': further away intersected point
+// result     : the first intersected point and retur -1.0f if not crossed
+inline float Intersect( const TraversalRay& ray , const BBox& bb , float* fmax = 0 )
+{
+	float tmax = ray.tmax;
+	float tmin = ray.tmin;
+
+	for( unsigned axis = 0 ; axis < 3 ; axis ++ )
+	{
+		if( ray.parallel & ( 1 << axis ) )
+		{
+			if( ray.ori[axis] > bb.m_Max[axis] || ray.ori[axis] < bb.m_Min[axis] )
+				return -1.0f;
+		}else
+		{
+			// the near and far planes are picked by the sign of the direction
+			const float t1 = ( ( ray.neg[axis] ? bb.m_Max[axis] : bb.m_Min[axis] ) - ray.ori[axis] ) * ray.inv_dir[axis];
+			const float t2 = ( ( ray.neg[axis] ? bb.m_Min[axis] : bb.m_Max[axis] ) - ray.ori[axis] ) * ray.inv_dir[axis];
+
+			tmin = max( t1 , tmin );
+			tmax = min( t2 , tmax );
+
+			if( tmin > tmax )
+				return -1.0f;
+		}
+	}
+
+	if( fmax )
+		*fmax = tmax;
+
+	return tmin;
+}
+
 #endif
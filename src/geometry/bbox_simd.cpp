@@ -0,0 +1,43 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "bbox_simd.h"
+#include "utility/cpuinfo.h"
+
+#if !defined(SORT_SIMD_AVX) && defined(SORT_SIMD_SSE)
+#include <immintrin.h>
+
+const bool g_slabTestAvx = GetCpuIsa() >= CPU_ISA_AVX;
+
+// slab test against eight bounding boxes with AVX , it is the same with the inline version of AVX builds
+SORT_TARGET_AVX unsigned IntersectSoA8Avx( const TraversalRay& ray , const float bounds[2][3][8] , float tmin , float tmax , float t_near[8] )
+{
+    __m256 fmin = _mm256_set1_ps( tmin );
+    __m256 fmax = _mm256_set1_ps( tmax );
+    for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+        const __m256 o = _mm256_set1_ps( ray.ori[axis] );
+        const __m256 inv = _mm256_set1_ps( ray.inv_dir[axis] );
+        const __m256 t0 = _mm256_mul_ps( _mm256_sub_ps( _mm256_loadu_ps( bounds[ray.neg[axis]][axis] ) , o ) , inv );
+        const __m256 t1 = _mm256_mul_ps( _mm256_sub_ps( _mm256_loadu_ps( bounds[1-ray.neg[axis]][axis] ) , o ) , inv );
+        fmin = _mm256_max_ps( fmin , t0 );
+        fmax = _mm256_min_ps( fmax , t1 );
+    }
+    _mm256_storeu_ps( t_near , fmin );
+    return (unsigned)_mm256_movemask_ps( _mm256_cmp_ps( fmin , fmax , _CMP_LE_OQ ) );
+}
+#endif
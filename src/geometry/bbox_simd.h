@@ -0,0 +1,134 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "bbox.h"
+#include "ray.h"
+
+#if defined(SORT_SIMD_SSE)
+#include <xmmintrin.h>
+#endif
+#if defined(SORT_SIMD_AVX)
+#include <immintrin.h>
+#endif
+
+//! @brief Intersection test between a ray and N bounding boxes stored in SoA layout.
+//!
+//! Bounding boxes with minimum point larger than maximum point are never hit.
+//! @param ray      The precomputed ray data.
+//! @param bounds   Bounding boxes in SoA layout, bounds[0] holds the minimum points and bounds[1] holds the maximum points.
+//! @param tmin     The minimum range along the ray.
+//! @param tmax     The maximum range along the ray.
+//! @param t_near   The entering distance of each bounding box, it is only valid for boxes being hit.
+//! @return         A bit mask of bounding boxes being hit by the ray.
+template<int N>
+inline unsigned IntersectSoA( const TraversalRay& ray , const float bounds[2][3][N] , float tmin , float tmax , float t_near[N] )
+{
+    unsigned mask = 0;
+    for( int i = 0 ; i < N ; ++i ){
+        float fmin = tmin , fmax = tmax;
+        for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+            const float t0 = ( bounds[ray.neg[axis]][axis][i] - ray.ori[axis] ) * ray.inv_dir[axis];
+            const float t1 = ( bounds[1-ray.neg[axis]][axis][i] - ray.ori[axis] ) * ray.inv_dir[axis];
+            fmin = max( fmin , t0 );
+            fmax = min( fmax , t1 );
+        }
+        t_near[i] = fmin;
+        if( fmin <= fmax )
+            mask |= ( 1 << i );
+    }
+    return mask;
+}
+
+#if defined(SORT_SIMD_SSE)
+//! @brief Slab test against four bounding boxes with SSE.
+//!
+//! The arrays are the near and far planes along the three axes, each of them holds four floats.
+inline unsigned intersectSoA4( const TraversalRay& ray , const float* const near_p[3] , const float* const far_p[3] , float tmin , float tmax , float* t_near )
+{
+    __m128 fmin = _mm_set1_ps( tmin );
+    __m128 fmax = _mm_set1_ps( tmax );
+    for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+        const __m128 o = _mm_set1_ps( ray.ori[axis] );
+        const __m128 inv = _mm_set1_ps( ray.inv_dir[axis] );
+        const __m128 t0 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( near_p[axis] ) , o ) , inv );
+        const __m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( far_p[axis] ) , o ) , inv );
+        fmin = _mm_max_ps( fmin , t0 );
+        fmax = _mm_min_ps( fmax , t1 );
+    }
+    _mm_storeu_ps( t_near , fmin );
+    return (unsigned)_mm_movemask_ps( _mm_cmple_ps( fmin , fmax ) );
+}
+
+//! @brief Slab test against four bounding boxes in SoA layout with SSE.
+template<>
+inline unsigned IntersectSoA<4>( const TraversalRay& ray , const float bounds[2][3][4] , float tmin , float tmax , float t_near[4] )
+{
+    const float* const near_p[3] = { bounds[ray.neg[0]][0] , bounds[ray.neg[1]][1] , bounds[ray.neg[2]][2] };
+    const float* const far_p[3] = { bounds[1-ray.neg[0]][0] , bounds[1-ray.neg[1]][1] , bounds[1-ray.neg[2]][2] };
+    return intersectSoA4( ray , near_p , far_p , tmin , tmax , t_near );
+}
+#endif
+
+#if defined(SORT_SIMD_AVX)
+//! @brief Slab test against eight bounding boxes in SoA layout with AVX.
+template<>
+inline unsigned IntersectSoA<8>( const TraversalRay& ray , const float bounds[2][3][8] , float tmin , float tmax , float t_near[8] )
+{
+    __m256 fmin = _mm256_set1_ps( tmin );
+    __m256 fmax = _mm256_set1_ps( tmax );
+    for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+        const __m256 o = _mm256_set1_ps( ray.ori[axis] );
+        const __m256 inv = _mm256_set1_ps( ray.inv_dir[axis] );
+        const __m256 t0 = _mm256_mul_ps( _mm256_sub_ps( _mm256_loadu_ps( bounds[ray.neg[axis]][axis] ) , o ) , inv );
+        const __m256 t1 = _mm256_mul_ps( _mm256_sub_ps( _mm256_loadu_ps( bounds[1-ray.neg[axis]][axis] ) , o ) , inv );
+        fmin = _mm256_max_ps( fmin , t0 );
+        fmax = _mm256_min_ps( fmax , t1 );
+    }
+    _mm256_storeu_ps( t_near , fmin );
+    return (unsigned)_mm256_movemask_ps( _mm256_cmp_ps( fmin , fmax , _CMP_LE_OQ ) );
+}
+#elif defined(SORT_SIMD_SSE)
+//! @brief Slab test against eight bounding boxes with AVX in a program that is not compiled for AVX.
+//!
+//! It may only be called if the processor supports AVX.
+unsigned IntersectSoA8Avx( const TraversalRay& ray , const float bounds[2][3][8] , float tmin , float tmax , float t_near[8] );
+
+//! Whether the processor running the program supports AVX, it is detected with cpuid at startup.
+extern const bool g_slabTestAvx;
+
+//! @brief Slab test against eight bounding boxes in SoA layout.
+//!
+//! Processors with AVX take the AVX variant, older ones take two SSE passes.
+template<>
+inline unsigned IntersectSoA<8>( const TraversalRay& ray , const float bounds[2][3][8] , float tmin , float tmax , float t_near[8] )
+{
+    if( g_slabTestAvx )
+        return IntersectSoA8Avx( ray , bounds , tmin , tmax , t_near );
+
+    const float* near_p[3] = { bounds[ray.neg[0]][0] , bounds[ray.neg[1]][1] , bounds[ray.neg[2]][2] };
+    const float* far_p[3] = { bounds[1-ray.neg[0]][0] , bounds[1-ray.neg[1]][1] , bounds[1-ray.neg[2]][2] };
+    const unsigned low = intersectSoA4( ray , near_p , far_p , tmin , tmax , t_near );
+    for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+        near_p[axis] += 4;
+        far_p[axis] += 4;
+    }
+    const unsigned high = intersectSoA4( ray , near_p , far_p , tmin , tmax , t_near + 4 );
+    return low | ( high << 4 );
+}
+#endif
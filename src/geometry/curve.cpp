@@ -0,0 +1,385 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header
+#include "curve.h"
+#include "intersection.h"
+#include "utility/mappedfile.h"
+#include "utility/path.h"
+#include "log/log.h"
+#include <stdlib.h>
+
+// the maximum number of times a segment is subdivided during the intersection test
+static const int CURVE_MAX_DEPTH = 10;
+// the number of pieces a segment is cut into while it is clipped against a bounding box
+static const unsigned CURVE_CLIP_PIECES = 4;
+
+// the point between two points
+static inline Point lerpPoint( float t , const Point& p0 , const Point& p1 )
+{
+	return p0 * ( 1.0f - t ) + p1 * t;
+}
+
+// the blossom of a cubic bezier curve , the control points of a segment are the blossoms of its ends
+static Point blossomBezier( const Point cp[4] , float u0 , float u1 , float u2 )
+{
+	const Point a[3] = { lerpPoint( u0 , cp[0] , cp[1] ) , lerpPoint( u0 , cp[1] , cp[2] ) , lerpPoint( u0 , cp[2] , cp[3] ) };
+	const Point b[2] = { lerpPoint( u1 , a[0] , a[1] ) , lerpPoint( u1 , a[1] , a[2] ) };
+	return lerpPoint( u2 , b[0] , b[1] );
+}
+
+// split a cubic bezier curve in half , the halves share the middle control point
+static void subdivideBezier( const Point cp[4] , Point cps[7] )
+{
+	cps[0] = cp[0];
+	cps[1] = ( cp[0] + cp[1] ) * 0.5f;
+	cps[2] = ( cp[0] + cp[1] * 2.0f + cp[2] ) * 0.25f;
+	cps[3] = ( cp[0] + cp[1] * 3.0f + cp[2] * 3.0f + cp[3] ) * 0.125f;
+	cps[4] = ( cp[1] + cp[2] * 2.0f + cp[3] ) * 0.25f;
+	cps[5] = ( cp[2] + cp[3] ) * 0.5f;
+	cps[6] = cp[3];
+}
+
+// evaluate a cubic bezier curve and its derivative
+static Point evalBezier( const Point cp[4] , float u , Vector& deriv )
+{
+	const Point a[3] = { lerpPoint( u , cp[0] , cp[1] ) , lerpPoint( u , cp[1] , cp[2] ) , lerpPoint( u , cp[2] , cp[3] ) };
+	const Point b[2] = { lerpPoint( u , a[0] , a[1] ) , lerpPoint( u , a[1] , a[2] ) };
+
+	// the derivative vanishes if the first or the last two control points are the same
+	if( ( b[1] - b[0] ).SquaredLength() > 0.0f )
+		deriv = 3.0f * ( b[1] - b[0] );
+	else
+		deriv = cp[3] - cp[0];
+	return lerpPoint( u , b[0] , b[1] );
+}
+
+// the bounding box of control points , it is extended by half of the width
+static BBox bezierBox( const Point cp[4] , float half_width )
+{
+	BBox box;
+	for( unsigned i = 0 ; i < 4 ; ++i )
+		box.Union( cp[i] );
+	const Vector ext( half_width , half_width , half_width );
+	box.m_Min -= ext;
+	box.m_Max += ext;
+	return box;
+}
+
+// whether the ray in its own space goes through the bounding box of control points , it starts at the origin and goes along z
+static bool overlapRay( const Point cp[4] , float half_width , float tmin , float tmax )
+{
+	const BBox box = bezierBox( cp , half_width );
+	return box.m_Min.x <= 0.0f && box.m_Max.x >= 0.0f && box.m_Min.y <= 0.0f && box.m_Max.y >= 0.0f &&
+		   box.m_Min.z <= tmax && box.m_Max.z >= tmin;
+}
+
+// constructor
+Curve::Curve( unsigned pid , const CurveSet* set , unsigned curve , float umin , float umax ):
+Primitive( pid , set->m_Material.get() ) , m_set( set ) , m_curve( curve ) , m_uMin( umin ) , m_uMax( umax )
+{
+}
+
+// get the control points of the segment in world space
+void Curve::_controlPoints( Point cp[4] ) const
+{
+	const Point* curve = &m_set->m_ControlPoints[4*m_curve];
+	cp[0] = blossomBezier( curve , m_uMin , m_uMin , m_uMin );
+	cp[1] = blossomBezier( curve , m_uMin , m_uMin , m_uMax );
+	cp[2] = blossomBezier( curve , m_uMin , m_uMax , m_uMax );
+	cp[3] = blossomBezier( curve , m_uMax , m_uMax , m_uMax );
+}
+
+// get the width of the curve at a parameter
+float Curve::_width( float u ) const
+{
+	const float* width = &m_set->m_Widths[2*m_curve];
+	return width[0] * ( 1.0f - u ) + width[1] * u;
+}
+
+// get the intersection between a ray and the segment
+bool Curve::GetIntersect( const Ray& r , Intersection* intersect ) const
+{
+	Point cp[4];
+	_controlPoints( cp );
+
+	// the control points in the space of the ray , the bounds there are oriented along the ray
+	Vector dx , dy;
+	CoordinateSystem( r.m_Dir , dx , dy );
+	Point rcp[4];
+	for( unsigned i = 0 ; i < 4 ; ++i )
+	{
+		const Vector d = cp[i] - r.m_Ori;
+		rcp[i] = Point( Dot( d , dx ) , Dot( d , dy ) , Dot( d , r.m_Dir ) );
+	}
+
+	const float tmax = ( intersect && intersect->t < r.m_fMax ) ? intersect->t : r.m_fMax;
+	const float max_width = max( _width( m_uMin ) , _width( m_uMax ) );
+	if( !overlapRay( rcp , 0.5f * max_width , r.m_fMin , tmax ) )
+		return false;
+
+	// the segment is subdivided until the pieces are close to lines , the depth depends on how much it bends
+	float l0 = 0.0f;
+	for( unsigned i = 0 ; i < 2 ; ++i )
+		for( unsigned k = 0 ; k < 3 ; ++k )
+			l0 = max( l0 , fabs( rcp[i][k] - 2.0f * rcp[i+1][k] + rcp[i+2][k] ) );
+	int depth = 0;
+	const float eps = max_width * 0.05f;
+	if( l0 > 0.0f && eps > 0.0f )
+		depth = min( CURVE_MAX_DEPTH , max( 0 , (int)log2f( 1.41421356f * 6.0f * l0 / ( 8.0f * eps ) ) / 2 ) );
+
+	float t , u , v;
+	if( !_intersect( rcp , m_uMin , m_uMax , depth , r.m_fMin , tmax , t , u , v ) )
+		return false;
+
+	if( intersect == 0 )
+		return true;
+
+	// only record the hit , the shading information is resolved once the closest hit is found
+	intersect->t = t;
+	intersect->bu = u;
+	intersect->bv = v;
+	intersect->primitive = const_cast<Curve*>(this);
+	return true;
+}
+
+// the recursive test of the segment in the space of the ray
+bool Curve::_intersect( const Point cp[4] , float u0 , float u1 , int depth , float tmin , float tmax , float& t , float& u , float& v ) const
+{
+	if( depth > 0 )
+	{
+		// both halves are tested , the closer hit wins
+		Point cps[7];
+		subdivideBezier( cp , cps );
+		const float us[3] = { u0 , ( u0 + u1 ) * 0.5f , u1 };
+		bool hit = false;
+		for( unsigned k = 0 ; k < 2 ; ++k )
+		{
+			const Point* piece = cps + 3 * k;
+			if( !overlapRay( piece , 0.5f * max( _width( us[k] ) , _width( us[k+1] ) ) , tmin , tmax ) )
+				continue;
+			if( _intersect( piece , us[k] , us[k+1] , depth - 1 , tmin , tmax , t , u , v ) )
+			{
+				hit = true;
+				tmax = t;
+			}
+		}
+		return hit;
+	}
+
+	// the piece is close to a line , the ray passes between the planes perpendicular to it at both ends
+	if( ( cp[1].y - cp[0].y ) * -cp[0].y + cp[0].x * ( cp[0].x - cp[1].x ) < 0.0f )
+		return false;
+	if( ( cp[2].y - cp[3].y ) * -cp[3].y + cp[3].x * ( cp[3].x - cp[2].x ) < 0.0f )
+		return false;
+
+	// the point of the line closest to the ray
+	const float sx = cp[3].x - cp[0].x;
+	const float sy = cp[3].y - cp[0].y;
+	const float denom = sx * sx + sy * sy;
+	if( denom == 0.0f )
+		return false;
+	const float w = clamp( -( cp[0].x * sx + cp[0].y * sy ) / denom , 0.0f , 1.0f );
+	const float hit_u = u0 * ( 1.0f - w ) + u1 * w;
+	const float hit_width = _width( hit_u );
+
+	// the ray has to pass within half of the width of the curve
+	Vector dpcdw;
+	const Point pc = evalBezier( cp , w , dpcdw );
+	const float dist2 = pc.x * pc.x + pc.y * pc.y;
+	if( dist2 > hit_width * hit_width * 0.25f )
+		return false;
+	if( pc.z < tmin || pc.z > tmax )
+		return false;
+
+	// the side of the hit across the strip
+	const float dist = sqrtf( dist2 );
+	const float edge = dpcdw.x * -pc.y + pc.x * dpcdw.y;
+	v = ( edge > 0.0f ) ? 0.5f + dist / hit_width : 0.5f - dist / hit_width;
+	u = hit_u;
+	t = pc.z;
+	return true;
+}
+
+// fill the shading information of the closest hit
+void Curve::ResolveHit( const Ray& r , Intersection* intersect ) const
+{
+	const float u = intersect->bu;
+	const float half_width = 0.5f * _width( u );
+
+	// the center of the curve at the hit
+	Vector dpdu;
+	const Point center = evalBezier( &m_set->m_ControlPoints[4*m_curve] , u , dpdu );
+	const Vector tangent = Normalize( dpdu );
+
+	// the strip is spanned by the tangent and the direction perpendicular to both the tangent and the ray
+	Vector side = Cross( r.m_Dir , tangent );
+	Vector facing;
+	if( side.SquaredLength() > 0.0f )
+	{
+		side = Normalize( side );
+		facing = Cross( side , tangent );
+	}
+	else
+		CoordinateSystem( tangent , side , facing );
+	if( Dot( facing , r.m_Dir ) > 0.0f )
+		facing = -facing;
+
+	// the offset of the hit across the strip , it is -1 and 1 at the edges
+	const float s = ( half_width > 0.0f ) ? clamp( Dot( r( intersect->t ) - center , side ) / half_width , -1.0f , 1.0f ) : 0.0f;
+	Vector normal = facing;
+	if( m_set->m_Type == CURVE_TUBE )
+	{
+		// the normal of a round tube turns from facing the ray at the center to the side at the edges
+		normal = Normalize( side * s + facing * sqrtf( max( 0.0f , 1.0f - s * s ) ) );
+		intersect->intersect = center + normal * half_width;
+	}
+	else
+		intersect->intersect = center + side * ( s * half_width );
+
+	// rays leave the curve beyond its width , the strip is only an approximation of the surface
+	intersect->error = Vector( 4.0f * half_width , 4.0f * half_width , 4.0f * half_width ) + PointError( intersect->intersect , 7 );
+	intersect->normal = normal;
+	intersect->gnormal = normal;
+	intersect->tangent = tangent;
+
+	// the parameter along the curve and across the strip
+	intersect->u = u;
+	intersect->v = intersect->bv;
+	intersect->dudx = intersect->dvdx = intersect->dudy = intersect->dvdy = 0.0f;
+	intersect->dpdx = intersect->dpdy = Vector( 0.0f , 0.0f , 0.0f );
+}
+
+// get the bounding box of the segment
+BBox Curve::GetBBox() const
+{
+	Point cp[4];
+	_controlPoints( cp );
+	return bezierBox( cp , 0.5f * max( _width( m_uMin ) , _width( m_uMax ) ) );
+}
+
+// get the bounding box of the part of the segment inside a bounding box
+BBox Curve::GetClippedBBox( const BBox& box ) const
+{
+	BBox result;
+	const Point* curve = &m_set->m_ControlPoints[4*m_curve];
+	for( unsigned k = 0 ; k < CURVE_CLIP_PIECES ; ++k )
+	{
+		const float u0 = m_uMin + ( m_uMax - m_uMin ) * k / CURVE_CLIP_PIECES;
+		const float u1 = m_uMin + ( m_uMax - m_uMin ) * ( k + 1 ) / CURVE_CLIP_PIECES;
+		const Point cp[4] = { blossomBezier( curve , u0 , u0 , u0 ) , blossomBezier( curve , u0 , u0 , u1 ) ,
+							  blossomBezier( curve , u0 , u1 , u1 ) , blossomBezier( curve , u1 , u1 , u1 ) };
+		const BBox piece = Overlap( bezierBox( cp , 0.5f * max( _width( u0 ) , _width( u1 ) ) ) , box );
+		if( piece.IsValid() )
+			result.Union( piece );
+	}
+	return result;
+}
+
+// get the surface area of the segment
+float Curve::SurfaceArea() const
+{
+	// the length is between the chord and the length of the control polygon
+	Point cp[4];
+	_controlPoints( cp );
+	const float polygon = Distance( cp[0] , cp[1] ) + Distance( cp[1] , cp[2] ) + Distance( cp[2] , cp[3] );
+	const float length = 0.5f * ( polygon + Distance( cp[0] , cp[3] ) );
+	return length * 0.5f * ( _width( m_uMin ) + _width( m_uMax ) );
+}
+
+// load the curves from file
+bool CurveSet::LoadCurves( const string& str , const Transform& transform )
+{
+	const string filename = GetFullPath( str );
+	MappedFile file;
+	if( false == file.Open( filename ) )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Failed to load curves from %s." , filename.c_str() ) );
+		return false;
+	}
+
+	// the widths are scaled by the average scaling of the transformation
+	const float scale = ( transform( Vector( 1.0f , 0.0f , 0.0f ) ).Length() + transform( Vector( 0.0f , 1.0f , 0.0f ) ).Length() +
+						  transform( Vector( 0.0f , 0.0f , 1.0f ) ).Length() ) / 3.0f;
+
+	// each line 'c' holds the four control points and the widths at both ends , other lines are skipped
+	const string text( file.GetData() , file.GetSize() );
+	const char* s = text.c_str();
+	while( *s )
+	{
+		const char* line = s;
+		while( *s && *s != '\n' )
+			++s;
+		if( *s )
+			++s;
+		while( *line == ' ' || *line == '\t' )
+			++line;
+		if( line[0] != 'c' || ( line[1] != ' ' && line[1] != '\t' ) )
+			continue;
+
+		float value[14];
+		const char* p = line + 1;
+		unsigned k = 0;
+		for( ; k < 14 ; ++k )
+		{
+			char* end;
+			value[k] = strtof( p , &end );
+			if( end == p || end > s )
+				break;
+			p = end;
+		}
+		if( k < 14 )
+		{
+			slog( WARNING , GENERAL , stringFormat( "A curve in %s doesn't have four control points and two widths, it is skipped." , filename.c_str() ) );
+			continue;
+		}
+
+		for( unsigned i = 0 ; i < 4 ; ++i )
+			m_ControlPoints.push_back( transform( Point( value[3*i] , value[3*i+1] , value[3*i+2] ) ) );
+		m_Widths.push_back( value[12] * scale );
+		m_Widths.push_back( value[13] * scale );
+	}
+
+	if( m_Widths.empty() )
+	{
+		slog( WARNING , GENERAL , stringFormat( "There is no curve in %s." , filename.c_str() ) );
+		return false;
+	}
+	m_Memory.Set( m_ControlPoints.capacity() * sizeof( Point ) + m_Widths.capacity() * sizeof( float ) );
+	return true;
+}
+
+// fill the segments into the triangle buffer of the scene
+void CurveSet::FillTriBuf( vector<Primitive*>& vec )
+{
+	// the segments are stored in one array , its capacity is reserved so that the pointers in the buffer stay valid
+	const unsigned count = (unsigned)m_Widths.size() / 2;
+	const unsigned pieces = 1u << m_Split;
+	m_Segments.clear();
+	m_Segments.reserve( (size_t)count * pieces );
+	for( unsigned i = 0 ; i < count ; ++i )
+	{
+		for( unsigned k = 0 ; k < pieces ; ++k )
+		{
+			m_Segments.push_back( Curve( (unsigned)vec.size() , this , i , (float)k / pieces , (float)( k + 1 ) / pieces ) );
+			m_Segments.back().SetLightLinks( m_LightLinks );
+			m_Segments.back().SetHidden( m_Hidden );
+			vec.push_back( &m_Segments.back() );
+		}
+	}
+	m_Memory.Set( m_ControlPoints.capacity() * sizeof( Point ) + m_Widths.capacity() * sizeof( float ) + m_Segments.capacity() * sizeof( Curve ) );
+}
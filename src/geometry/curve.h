@@ -0,0 +1,135 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#ifndef	SORT_CURVE
+#define	SORT_CURVE
+
+// include the header
+#include "primitive.h"
+#include "math/transform.h"
+#include "utility/enum.h"
+#include "utility/memstats.h"
+#include <vector>
+#include <memory>
+
+class	CurveSet;
+
+////////////////////////////////////////////////////////////////////////////////
+// definition of curve
+// note :	a curve is one segment of a cubic bezier curve , hair and fur are rendered
+//			with the segments as primitives in the leaves of accelerators instead of
+//			tessellating them into triangles. a segment is tested in the space of the
+//			ray , its bounds there are oriented along the ray and much tighter than the
+//			world space box of a thin diagonal strand.
+class	Curve : public Primitive
+{
+// public method
+public:
+	// constructor
+	// para 'pid'   : primitive id
+	// para 'set'   : the curves it belongs to
+	// para 'curve' : the id of the curve in the set
+	// para 'umin' , 'umax' : the range of the segment in the parameter of the curve
+	Curve( unsigned pid , const CurveSet* set , unsigned curve , float umin , float umax );
+
+	// get the intersection between a ray and the segment
+	// note : only the hit record is stored , it is resolved by ResolveHit afterward
+	bool	GetIntersect( const Ray& r , Intersection* intersect ) const;
+
+	// fill the shading information of the closest hit
+	void	ResolveHit( const Ray& r , Intersection* intersect ) const;
+
+	// get the bounding box of the segment
+	BBox	GetBBox() const;
+
+	// get the bounding box of the part of the segment inside a bounding box
+	// note : the segment is subdivided so that spatial splits cut thin diagonal strands into tight pieces
+	BBox	GetClippedBBox( const BBox& box ) const;
+
+	// get the surface area of the segment , it is the area of the strip
+	float	SurfaceArea() const;
+
+// private field
+private:
+	// the curves it belongs to
+	const CurveSet*	m_set;
+	// the id of the curve
+	unsigned		m_curve;
+	// the range of the segment in the parameter of the curve
+	float			m_uMin , m_uMax;
+
+	// get the control points of the segment in world space
+	void	_controlPoints( Point cp[4] ) const;
+	// get the width of the curve at a parameter
+	float	_width( float u ) const;
+	// the recursive test of the segment in the space of the ray
+	// para 'cp'     : the control points of the piece in the space of the ray
+	// para 'u0' , 'u1' : the range of the piece in the parameter of the curve
+	// para 'depth'  : the number of times the piece is subdivided further
+	// para 'tmin' , 'tmax' : the range of the ray
+	// para 't' , 'u' , 'v' : the hit , 'v' goes across the strip from 0 to 1 ( output )
+	bool	_intersect( const Point cp[4] , float u0 , float u1 , int depth , float tmin , float tmax , float& t , float& u , float& v ) const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// definition of curve set
+// note :	the curves of a model , e.g. the hair of a character , share one material.
+//			each curve is split into segments , which are the primitives of the scene.
+class	CurveSet
+{
+// public method
+public:
+	// constructor
+	// para 'name' : the name of the model
+	CurveSet( const string& name ) : m_Name(name) {}
+
+	// load the curves from file
+	// para 'str'       : the name of the file , each line 'c' holds four control points and the widths at both ends
+	// para 'transform' : the transformation of the curves
+	// result           : 'true' if loading is successful
+	bool	LoadCurves( const string& str , const Transform& transform );
+
+	// fill the segments into the triangle buffer of the scene , they are owned by the set
+	// para 'vec' : the buffer to be filled
+	void	FillTriBuf( vector<Primitive*>& vec );
+
+// public field
+public:
+	// the name of the model
+	const string	m_Name;
+	// the way the curves are intersected and shaded
+	CURVE_TYPE		m_Type = CURVE_TUBE;
+	// the number of times each curve is halved into segments
+	unsigned		m_Split = 2;
+	// the material of the curves
+	std::shared_ptr<Material>	m_Material;
+	// the light linking sets the curves receive light from , one bit for each set
+	unsigned		m_LightLinks = ~0u;
+	// the kinds of rays the curves are hidden from , one bit of RAY_TYPE for each kind
+	unsigned		m_Hidden = 0;
+
+	// the control points in world space , four for each curve
+	std::vector<Point>	m_ControlPoints;
+	// the widths at both ends of each curve , the width is interpolated in between
+	std::vector<float>	m_Widths;
+	// the segments of the curves
+	std::vector<Curve>	m_Segments;
+	// the memory taken by the curves
+	MemoryTracker		m_Memory{ MEM_MESH };
+};
+
+#endif
@@ -25,8 +25,13 @@ Intersection::Intersection()
 {
 	u = 0.0f;
 	v = 0.0f;
+	dudx = dvdx = dudy = dvdy = 0.0f;
+	bu = 0.0f;
+	bv = 0.0f;
 	t = FLT_MAX;
+	time = 0.0f;
 	primitive = 0;
+	instanced = 0;
 }
 
 // destructor
@@ -43,3 +48,43 @@ Spectrum Intersection::Le( const Vector& wo , float* directPdfA , float* emissio
 		return light->Le( *this , wo , directPdfA , emissionPdf );
 	return 0.0f;
 }
+
+// the ray leaving the surface along a direction
+Ray Intersection::SpawnRay( const Vector& w , unsigned depth ) const
+{
+	Ray r( SpawnOrigin( w ) , w , depth );
+	r.m_Time = time;
+	return r;
+}
+
+// the shadow ray from the surface to a point
+Ray Intersection::SpawnRayTo( const Point& p ) const
+{
+	const Point o = SpawnOrigin( p - intersect );
+	const Vector d = p - o;
+	const float len = d.Length();
+	Ray r( o , d / len , 0 , 0.0f , len * ( 1.0f - SHADOW_EPSILON ) );
+	r.m_Time = time;
+	return r;
+}
+
+// the origin of a ray leaving a surface
+Point OffsetRayOrigin( const Point& p , const Vector& error , const Vector& n , const Vector& w )
+{
+	// the offset reaches the plane bounding the error box along the normal
+	const float d = fabs( n.x ) * error.x + fabs( n.y ) * error.y + fabs( n.z ) * error.z;
+	Vector offset = d * n;
+	if( Dot( w , n ) < 0.0f )
+		offset = -offset;
+
+	// the sum is rounded , the components are moved one more float away from the surface
+	Point o = p + offset;
+	for( unsigned i = 0 ; i < 3 ; ++i )
+	{
+		if( offset[i] > 0.0f )
+			o[i] = NextFloatUp( o[i] );
+		else if( offset[i] < 0.0f )
+			o[i] = NextFloatDown( o[i] );
+	}
+	return o;
+}
@@ -20,12 +20,32 @@
 
 // include the header
 #include "math/point.h"
+#include "geometry/ray.h"
 #include "spectrum/spectrum.h"
 
 // pre-decleration class
 class Primitive;
 class Light;
 
+// the fraction of a shadow ray left before its end , the surface at the end is not hit by it
+static const float SHADOW_EPSILON = 0.0001f;
+
+// the origin of a ray leaving a surface , the point is pushed along the geometric normal just beyond its rounding error
+// para 'p'     : the point on the surface
+// para 'error' : the bound of the absolute error of the point
+// para 'n'     : the geometric normal of the surface , either side is fine
+// para 'w'     : the direction of the ray , it decides the side the point is pushed to
+// result       : the origin of the ray , the surface is never hit again right at it
+Point	OffsetRayOrigin( const Point& p , const Vector& error , const Vector& n , const Vector& w );
+
+// the bound of the absolute error of a point computed from values of its magnitude
+// para 'p' : the point
+// para 'n' : the number of float operations that the point takes
+inline Vector PointError( const Point& p , int n )
+{
+	return ErrorBound( n ) * Vector( fabs( p.x ) , fabs( p.y ) , fabs( p.z ) );
+}
+
 ///////////////////////////////////////////////////////////////////////
 //	definition of intersection
 class	Intersection
@@ -40,20 +60,43 @@ public :
 	// get the emissive
 	Spectrum Le( const Vector& wo , float* directPdfA = 0 , float* emissionPdf = 0 ) const;
 
+	// the origin of the rays leaving the surface along a direction
+	Point	SpawnOrigin( const Vector& w ) const { return OffsetRayOrigin( intersect , error , gnormal , w ); }
+	// the ray leaving the surface along a direction , it is traced at the time of the hit
+	// para 'w'     : the direction of the ray
+	// para 'depth' : the depth of the ray
+	Ray		SpawnRay( const Vector& w , unsigned depth = 0 ) const;
+	// the shadow ray from the surface to a point , it stops right before the point
+	Ray		SpawnRayTo( const Point& p ) const;
+
 // public field
 public:
 	// the interesection point
 	Point	intersect;
 	// the normal
 	Vector	normal;
+	// the normal of the geometry , it is not interpolated and only decides where rays leave the surface
+	Vector	gnormal;
+	// the bound of the absolute error of the interesection point , rays leave the surface beyond it
+	Vector	error;
 	// tangent vector
 	Vector	tangent;
 	// the uv coordinate
 	float	u , v;
+	// the change of the uv coordinate between neighbor pixels , they are zero if the ray has no differentials
+	float	dudx , dvdx , dudy , dvdy;
+	// the change of the position between neighbor pixels , they are zero if the ray has no differentials
+	Vector	dpdx , dpdy;
+	// the barycentric coordinate of the hit , it is recorded during traversal and used to resolve the hit
+	float	bu , bv;
 	// the delta distance from the orginal point
 	float	t;
+	// the time of the ray hitting the surface , rays leaving the surface are traced at the same time
+	float	time;
 	// the intersected primitive
 	Primitive* 	primitive;
+	// the triangle hit inside a mesh instance , it is only valid if 'primitive' is a mesh instance
+	Primitive*	instanced;
 };
 
 #endif
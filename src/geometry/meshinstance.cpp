@@ -0,0 +1,166 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header
+#include "meshinstance.h"
+#include "intersection.h"
+#include "accel/accelerator.h"
+
+// the bounding box of the corners of a box after transformation
+static BBox transformBox( const BBox& box , const Transform& transform )
+{
+	BBox r;
+	for( unsigned i = 0 ; i < 8 ; ++i )
+	{
+		const Point corner( ( i & 1 ) ? box.m_Max.x : box.m_Min.x , ( i & 2 ) ? box.m_Max.y : box.m_Min.y , ( i & 4 ) ? box.m_Max.z : box.m_Min.z );
+		r.Union( transform( corner ) );
+	}
+	return r;
+}
+
+// constructor
+MeshInstance::MeshInstance( unsigned pid , const Accelerator* blas , const vector<Primitive*>* triangles , Transform* transform , const Transform* end , Material* mat ):
+Primitive( pid , mat ) , m_blas( blas ) , m_triangles( triangles ) , m_transform( transform ) , m_isAffine( transform->IsAffine() ) , m_transformEnd( end ) , m_isMoving( end != nullptr )
+{
+	if( m_isAffine )
+		m_affine = AffineTransform( *transform );
+	if( m_isMoving )
+		m_affineEnd = AffineTransform( *end );
+}
+
+// take the transformations again
+void MeshInstance::UpdateTransform()
+{
+	m_isAffine = m_transform->IsAffine();
+	if( m_isAffine )
+		m_affine = AffineTransform( *m_transform );
+	if( m_isMoving )
+		m_affineEnd = AffineTransform( *m_transformEnd );
+	m_bbox.reset();
+}
+
+// get the transformation at a time of the frame
+const AffineTransform& MeshInstance::_transformAt( float time , AffineTransform& moved ) const
+{
+	if( !m_isMoving )
+		return m_affine;
+	moved = Lerp( m_affine , m_affineEnd , time );
+	return moved;
+}
+
+// get the intersection
+bool MeshInstance::GetIntersect( const Ray& r , Intersection* intersect ) const
+{
+	// transform the ray once for all triangles , the distance along the ray is not changed by the transformation
+	AffineTransform moved;
+	Ray ray = m_isAffine ? _transformAt( r.m_Time , moved ).invMatrix( r ) : m_transform->invMatrix( r );
+
+	if( intersect == 0 )
+		return m_blas->IsOccluded( ray );
+
+	// the bottom level structure only reports hits closer than the one in the intersection
+	if( !m_blas->GetIntersect( ray , intersect ) )
+		return false;
+
+	// the instance takes the place of the triangle so that its own material is used
+	intersect->instanced = intersect->primitive;
+	intersect->primitive = const_cast<MeshInstance*>(this);
+	return true;
+}
+
+// fill the shading information of the closest hit
+void MeshInstance::ResolveHit( const Ray& r , Intersection* intersect ) const
+{
+	// resolve the hit in the space of the prototype
+	AffineTransform moved;
+	const AffineTransform& affine = _transformAt( r.m_Time , moved );
+	Ray ray = m_isAffine ? affine.invMatrix( r ) : m_transform->invMatrix( r );
+	intersect->instanced->ResolveHit( ray , intersect );
+
+	// transform the intersection , the error of the point grows with the transformation
+	if( m_isAffine )
+	{
+		intersect->error = affine.matrix.TransformError( intersect->intersect , intersect->error );
+		intersect->intersect = affine(intersect->intersect);
+		intersect->normal = (affine.TransformNormal(intersect->normal)).Normalize();
+		intersect->gnormal = (affine.TransformNormal(intersect->gnormal)).Normalize();
+		intersect->tangent = (affine(intersect->tangent)).Normalize();
+		intersect->dpdx = affine(intersect->dpdx);
+		intersect->dpdy = affine(intersect->dpdy);
+		return;
+	}
+	intersect->error = m_transform->matrix.TransformError( intersect->intersect , intersect->error );
+	intersect->intersect = (*m_transform)(intersect->intersect);
+	intersect->normal = (m_transform->TransformNormal(intersect->normal)).Normalize();
+	intersect->gnormal = (m_transform->TransformNormal(intersect->gnormal)).Normalize();
+	intersect->tangent = ((*m_transform)(intersect->tangent)).Normalize();
+	intersect->dpdx = (*m_transform)(intersect->dpdx);
+	intersect->dpdy = (*m_transform)(intersect->dpdy);
+}
+
+// get the bounding box of the instance
+BBox MeshInstance::GetBBox() const
+{
+	// if there is no bounding box , cache it
+	if( !m_bbox )
+	{
+		m_bbox = std::unique_ptr<BBox>( new BBox() );
+
+		// transform the corners of the bounding box of the subset
+		BBox box;
+		for( auto tri : *m_triangles )
+			box.Union( tri->GetBBox() );
+		*m_bbox = transformBox( box , *m_transform );
+
+		// the points of a moving instance move on straight lines , they are covered by the boxes at both ends
+		if( m_isMoving )
+			m_bbox->Union( transformBox( box , *m_transformEnd ) );
+	}
+
+	return *m_bbox;
+}
+
+// get the bounding boxes of the instance at the start and the end of the frame
+bool MeshInstance::GetMotionBBox( BBox& start , BBox& end ) const
+{
+	if( !m_isMoving )
+		return false;
+
+	BBox box;
+	for( auto tri : *m_triangles )
+		box.Union( tri->GetBBox() );
+	start = transformBox( box , *m_transform );
+	end = transformBox( box , *m_transformEnd );
+	return true;
+}
+
+// get the surface area of the instance
+float MeshInstance::SurfaceArea() const
+{
+	float area = 0.0f;
+	for( auto tri : *m_triangles )
+	{
+		Point p0 , p1 , p2;
+		if( !tri->GetTriangleVertices( p0 , p1 , p2 ) )
+			continue;
+		p0 = (*m_transform)( p0 );
+		p1 = (*m_transform)( p1 );
+		p2 = (*m_transform)( p2 );
+		area += Cross( p1 - p0 , p2 - p0 ).Length() * 0.5f;
+	}
+	return area;
+}
@@ -0,0 +1,97 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#ifndef	SORT_MESHINSTANCE
+#define	SORT_MESHINSTANCE
+
+// include the header
+#include "primitive.h"
+#include "math/affine.h"
+
+// pre-declera class
+class Accelerator;
+
+////////////////////////////////////////////////////////////////////////////////
+// definition of mesh instance
+// note :	a mesh instance is one subset of an instanced mesh. the triangles of the
+//			subset are shared with the prototype mesh , they are organized in a bottom
+//			level acceleration structure shared by all instances. when performing
+//			intersection test , the ray is transformed into the space of the prototype
+//			once for the whole subset.
+class	MeshInstance : public Primitive
+{
+// public method
+public:
+	// constructor
+	// para 'pid'       : primitive id
+	// para 'blas'      : the bottom level acceleration structure of the subset
+	// para 'triangles' : the triangles of the subset in the space of the prototype
+	// para 'transform' : the transformation from the space of the prototype to world space
+	// para 'end'       : the affine transformation at the end of the frame , it is null if the instance doesn't move
+	// para 'mat'       : the material of the subset
+	MeshInstance( unsigned pid , const Accelerator* blas , const vector<Primitive*>* triangles , Transform* transform , const Transform* end , Material* mat );
+
+	// get the instersection between a ray and the instance
+	// note : only the hit record is stored , the triangle being hit in the prototype is kept
+	//		  in 'instanced' of the intersection
+	bool	GetIntersect( const Ray& r , Intersection* intersect ) const;
+
+	// fill the shading information of the closest hit in world space
+	void	ResolveHit( const Ray& r , Intersection* intersect ) const;
+
+	// get the bounding box of the instance , it covers the instance over the whole frame
+	BBox	GetBBox() const;
+	// discard the cached bounding box , the triangles of the prototype have moved
+	void	ClearBBoxCache() const { m_bbox.reset(); }
+
+	// take the transformations again , the instance or its prototype has moved
+	// note : the instance keeps moving or staying over the frame as it did before
+	void	UpdateTransform();
+
+	// get the bounding boxes of the instance at the start and the end of the frame
+	bool	GetMotionBBox( BBox& start , BBox& end ) const;
+
+	// get the surface area of the instance
+	float	SurfaceArea() const;
+
+// private field
+private:
+	// the bottom level acceleration structure
+	const Accelerator*			m_blas;
+	// the triangles of the subset
+	const vector<Primitive*>*	m_triangles;
+	// the transformation of the instance
+	Transform*					m_transform;
+	// the transformation with the normal matrix cached , it is only used if the transformation is affine
+	AffineTransform				m_affine;
+	bool						m_isAffine;
+	// the transformation at the end of the frame , the matrix in between is interpolated linearly
+	// note : both transformations of a moving instance are affine
+	const Transform*			m_transformEnd;
+	AffineTransform				m_affineEnd;
+	bool						m_isMoving;
+	// the bounding box , it is cached since it covers all triangles of the subset
+	mutable std::unique_ptr<BBox>	m_bbox;
+
+	// get the transformation at a time of the frame
+	// para 'time'  : the time of the frame
+	// para 'moved' : the storage of the interpolated transformation of a moving instance
+	// result       : the transformation , it is either 'm_affine' or 'moved'
+	const AffineTransform&	_transformAt( float time , AffineTransform& moved ) const;
+};
+
+#endif
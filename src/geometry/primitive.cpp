@@ -21,9 +21,10 @@
 #include "managers/matmanager.h"
 
 // get material
-std::shared_ptr<Material> Primitive::GetMaterial() const
+Material* Primitive::GetMaterial() const
 { 
+	static Material* defaultMat = MatManager::GetSingleton().GetDefaultMat().get();
 	if( m_mat == nullptr ) 
-		return MatManager::GetSingleton().GetDefaultMat();
+		return defaultMat;
 	return m_mat; 
 }
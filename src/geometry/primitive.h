@@ -22,11 +22,13 @@
 #include "bbox.h"
 #include "material/material.h"
 #include "intersection.h"
+#include "utility/enum.h"
 #include <memory>
 
 // pre-decleration
 class	Intersection;
 class	Light;
+struct	MediumInterface;
 
 //////////////////////////////////////////////////////////////////
 //	definition of primitive
@@ -35,7 +37,8 @@ class	Primitive
 // public method
 public:
 	// constructor from a id
-    Primitive( unsigned id , std::shared_ptr<Material> mat ) { m_primitive_id = id; m_mat = mat; light = 0; }
+	// note : the material is owned by the material manager or the mesh , it outlives the primitive
+    Primitive( unsigned id , Material* mat ) { m_primitive_id = id; m_mat = mat; light = 0; }
 	// destructor
 	virtual ~Primitive(){}
 
@@ -45,35 +48,96 @@ public:
     virtual bool GetIntersect( const BBox& box ) const { return true; }
 
 	// get the bounding box of the primitive
-	virtual const BBox&	GetBBox() const = 0;
+	// note : it is evaluated on each call for most primitives , accelerators keep their own copies during construction
+	virtual BBox	GetBBox() const = 0;
+	// discard the cached bounding box , it has to be called once the vertexes of the primitive are changed
+	virtual void	ClearBBoxCache() const {}
+	// get the bounding box of the part of the primitive inside a bounding box
+	// para 'box' : the bounding box to clip the primitive against
+	// result     : the bounding box of the clipped primitive, it is invalid if the primitive is totally outside
+	virtual BBox GetClippedBBox( const BBox& box ) const { return Overlap( GetBBox() , box ); }
+	// get the bounding boxes of a moving primitive at the start and the end of the frame
+	// note : the bounding box of 'GetBBox' covers the primitive over the whole frame
+	// para 'start' , 'end' : the bounding boxes , their linear interpolation covers the primitive at any time of the frame
+	// result               : false if the primitive doesn't move
+	virtual bool GetMotionBBox( BBox& start , BBox& end ) const { return false; }
 
 	// get surface area of the primitive
 	virtual float	SurfaceArea() const = 0;
 
+	// get the vertexes of the primitive in world space if it is a triangle
+	// para 'p0' , 'p1' , 'p2' : three vertexes of the triangle
+	// result                  : false if the primitive can't be tested as a world space triangle
+	virtual bool GetTriangleVertices( Point& p0 , Point& p1 , Point& p2 ) const { return false; }
+	// get the parameters of the primitive in world space if it is an analytic shape
+	// para 'center'          : the center of the shape
+	// para 'axis0' , 'axis1' : the local x and z axes of a planar shape divided by its half extents ,
+	//                          the x component of 'axis0' is the radius of a sphere
+	// result                 : the kind of the shape , it is PACKET_GENERIC if the primitive is no analytic shape
+	virtual PACKET_TYPE GetAnalyticShape( Point& center , Vector& axis0 , Vector& axis1 ) const { return PACKET_GENERIC; }
+	// fill the shading information of the closest hit
+	// note : primitives may only record 't' , 'bu' , 'bv' and 'primitive' during traversal , the rest of
+	//        the intersection is filled here once the closest hit is known
+	// para 'r'         : the ray hitting the primitive
+	// para 'intersect' : the intersection holding the hit record
+	virtual void ResolveHit( const Ray& r , Intersection* intersect ) const {}
+
 	// set primitive id
 	void	SetID( unsigned id ) { m_primitive_id = id; }
 	// get primitive id
 	unsigned GetID() const { return m_primitive_id; }
 
 	// get material
-    std::shared_ptr<Material> GetMaterial() const;
+    Material* GetMaterial() const;
 	// set material
-    void	SetMaterial( std::shared_ptr<Material>& mat ) { m_mat = mat; }
+    void	SetMaterial( Material* mat ) { m_mat = mat; }
 
 	// get light
 	Light* GetLight() const { return light; }
+	// bind light
+	void	BindLight( Light* l ) { light = l; }
+
+	// set the light linking sets the primitive receives light from , one bit for each set
+	void	SetLightLinks( unsigned links ) { m_lightLinks = links; }
+	// get the light linking sets the primitive receives light from
+	unsigned GetLightLinks() const { return m_lightLinks; }
+
+	// set the kinds of rays the primitive is hidden from , one bit of RAY_TYPE for each kind
+	void	SetHidden( unsigned hidden ) { m_hidden = (unsigned char)hidden; }
+	// get the kinds of rays the primitive is hidden from
+	unsigned GetHidden() const { return m_hidden; }
+	// whether the primitive is hidden from a kind of rays
+	bool	IsHiddenFrom( unsigned type ) const { return ( m_hidden & type ) != 0; }
+
+	// whether the primitive is cut away at some points by the opacity of its material , its hits are checked by 'IsCutAway'
+	virtual bool IsCutout() const { return false; }
+	// whether a hit of the primitive is cut away by the opacity of its material
+	// para 'bu' , 'bv' : the barycentric coordinate of the hit
+	virtual bool IsCutAway( float bu , float bv ) const { return false; }
+
+	// set the media on both sides of the primitive , they are owned by its model
+	void	SetMediumInterface( const MediumInterface* media ) { m_media = media; }
+	// get the media on both sides of the primitive , it is null if the primitive bounds no medium
+	const MediumInterface* GetMediumInterface() const { return m_media; }
 
 // protected field
 protected:
-	// bounding box
-    mutable std::unique_ptr<BBox> m_bbox;
 	// id for the primitive
 	unsigned		m_primitive_id;
-	// the material
-    std::shared_ptr<Material>	m_mat;
+	// the light linking sets the primitive receives light from , it takes the padding after the id
+	unsigned		m_lightLinks = ~0u;
+	// the material , a plain pointer keeps the reference count out of the shading of every hit
+    Material*	m_mat;
 
 	// the binded light
 	Light*		light;
+	// the media on both sides , rays passing through the primitive keep their medium if it is null
+	const MediumInterface*	m_media = nullptr;
+	// the kinds of rays the primitive is hidden from , it is seen by all rays by default
+	unsigned char	m_hidden = 0;
 };
 
+// the kind of a ray seen by the primitives , occlusion queries are always shadow rays
+inline unsigned RayType( const Ray& r , bool occlusion ) { return occlusion ? (unsigned)RAY_SHADOW : r.m_Type; }
+
 #endif
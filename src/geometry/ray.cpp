@@ -24,10 +24,9 @@ Ray::Ray()
 	m_Depth = 0;
 	m_fMin = 0.0f;
 	m_fMax = FLT_MAX;
-	m_fPdfW = 0.0f;
-	m_fPdfA = 0.0f;
-	m_we = 0.0f;
-	m_fCosAtCamera = 0.0f;
+	m_Time = 0.0f;
+	m_HasDifferentials = false;
+	m_Type = 0;
 }
 // constructor from a point and a direction
 Ray::Ray( const Point& p , const Vector& dir , unsigned depth , float fmin , float fmax)
@@ -37,27 +36,9 @@ Ray::Ray( const Point& p , const Vector& dir , unsigned depth , float fmin , flo
 	m_Depth = depth;
 	m_fMin = fmin;
 	m_fMax = fmax;
-	m_fPdfW = 0.0f;
-	m_fPdfA = 0.0f;
-	m_we = 0.0f;
-	m_fCosAtCamera = 0.0f;
-}
-// copy constructor
-Ray::Ray( const Ray& r )
-{
-	m_Ori = r.m_Ori;
-	m_Dir = r.m_Dir;
-	m_Depth = r.m_Depth;
-	m_fMin = r.m_fMin;
-	m_fMax = r.m_fMax;
-	m_fPdfW = r.m_fPdfW;
-	m_fPdfA = r.m_fPdfA;
-	m_we = r.m_we;
-	m_fCosAtCamera = r.m_fCosAtCamera;
-}
-// destructor
-Ray::~Ray()
-{
+	m_Time = 0.0f;
+	m_HasDifferentials = false;
+	m_Type = 0;
 }
 
 // operator to get a point on the ray
@@ -22,6 +22,7 @@
 #include "math/point.h"
 #include "float.h"
 #include "spectrum/spectrum.h"
+#include "utility/enum.h"
 
 ////////////////////////////////////////////////////////////////////////////
 class Ray
@@ -37,11 +38,6 @@ public:
 	// para 'fmin'  :	the minium range of the ray . It could be set a very small value to avoid false self intersection
 	// para 'fmax'  :	the maxium range of the ray . A ray with 'fmax' not equal to 0 is actually a line segment, usually used for shadow ray.
 	Ray( const Point& ori , const Vector& dir , unsigned depth = 0 , float fmin = 0.0f , float fmax = FLT_MAX );
-	// copy constructor
-	// para 'r' :	a ray to copy
-	Ray( const Ray& r );
-	// destructor
-	~Ray();
 	
 	// operator to get a point from the ray
 	// para 't' :	the distance from the retrive point if the direction of the ray is normalized.
@@ -61,10 +57,62 @@ public:
 	float	m_fMin;
 	float	m_fMax;
 
-	float	m_fPdfW;
-	float	m_fPdfA;
-	float	m_fCosAtCamera;
+	// the time of the ray , 0 is the start of the frame and 1 is the end of it , moving objects are placed at this time
+	float	m_Time;
 
+	// whether the ray carries differentials , camera rays have them and reflected rays keep them
+	bool	m_HasDifferentials;
+	// the kind of the ray , one of RAY_TYPE , objects hidden from it are skipped during traversal
+	unsigned char	m_Type;
+	// the origins and directions of the rays through the next pixels along x and y
+	// texture lookups are filtered over the footprint between them and the ray
+	Point	m_DxOri , m_DyOri;
+	Vector	m_DxDir , m_DyDir;
+};
+
+// importance of a primary ray , it is kept aside the ray since only bi-directional algorithms need it
+struct RayImportance
+{
+	// the pdf of the direction w.r.t solid angle
+	float	pdfW = 0.0f;
+	// the pdf of the viewing point w.r.t area
+	float	pdfA = 0.0f;
+	// the cosine between the ray and the forward direction of the camera
+	float	cosAtCamera = 0.0f;
 	// importance value of the ray
-	Spectrum m_we;
+	Spectrum we;
+};
+
+// lean ray used during the traversal of acceleration structures
+// the reciprocal of the direction is computed once per traversal instead of once per bounding box test ,
+// directions almost parallel to an axis get a huge reciprocal and are flagged in 'parallel' so that
+// both the scalar and the SIMD slab tests keep the same behavior with the original test against 'Ray'
+struct TraversalRay
+{
+	float		ori[3];			// origin of the ray
+	float		inv_dir[3];		// reciprocal of the direction of the ray
+	unsigned	neg[3];			// whether the direction is negative along each axis
+	unsigned	parallel;		// bit mask of axes that the direction is parallel to
+	float		tmin;			// the minimum range of the ray
+	float		tmax;			// the maximum range of the ray
+
+	// default constructor , the ray is not initialized
+	TraversalRay() {}
+	// constructor from a ray
+	// para 'r' :	the ray to be traversed
+	explicit TraversalRay( const Ray& r ){
+		parallel = 0;
+		for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+			const float d = r.m_Dir[axis];
+			ori[axis] = r.m_Ori[axis];
+			if( d < 0.00001f && d > -0.00001f ){
+				inv_dir[axis] = ( d < 0.0f ) ? -1e32f : 1e32f;
+				parallel |= 1 << axis;
+			}else
+				inv_dir[axis] = 1.0f / d;
+			neg[axis] = inv_dir[axis] < 0.0f ? 1 : 0;
+		}
+		tmin = r.m_fMin;
+		tmax = r.m_fMax;
+	}
 };
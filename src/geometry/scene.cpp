@@ -19,37 +19,152 @@
 #include "scene.h"
 #include "geometry/intersection.h"
 #include "accel/accelerator.h"
+#include "accel/accelcache.h"
+#include "accel/accelstats.h"
+#include "accel/gpuquery.h"
+#include "accel/primaryraster.h"
+#include "utility/telemetry.h"
 #include "utility/strhelper.h"
 #include "utility/path.h"
 #include "utility/samplemethod.h"
 #include "utility/sassert.h"
+#include "utility/multithread/threadpool.h"
 #include "managers/matmanager.h"
+#include "managers/texmanager.h"
 #include "light/light.h"
+#include "light/meshlight.h"
+#include "medium/medium.h"
 #include "shape/shape.h"
+#include "geometry/curve.h"
 #include "utility/sassert.h"
+#include "utility/xmlbinary.h"
+#include "managers/smmanager.h"
+#include "utility/fileprefetch.h"
+#include "utility/memoryfile.h"
+#include "managers/meshio/meshtransfer.h"
+#include "utility/profiler.h"
+#include "utility/statsreport.h"
+#include "managers/memmanager.h"
+#include <unordered_set>
+#include <algorithm>
+#include <sys/stat.h>
 
 // initialize default data
 void Scene::_init()
 {
 	m_pAccelerator = 0;
+	m_accelCache = false;
+	m_accelReorder = 0;
+	m_accelGpu = false;
+	m_gpuTree = 0;
+	m_gpuQuery = 0;
 	m_pLightsDis = 0;
+	m_pUnboundedDis = 0;
+	m_unboundedPower = 0.0f;
 	m_skyLight = 0;
+	m_ambientMedium = 0;
+	m_preprocessed = false;
+	m_needsTangent = false;
+	m_hasCutouts = false;
+	m_hasMotion = false;
+	m_version = 0;
 }
 
+// get the modification time and the size of a file , files in memory have their revisions instead of the time
+static bool _statSource( const string& str , long long& time , unsigned long long& size )
+{
+	if( MemoryFiles::IsMemoryFile( str ) )
+		return MemoryFiles::Stat( str , time , size );
+
+	struct stat st;
+	if( stat( str.c_str() , &st ) != 0 )
+		return false;
+	time = (long long)st.st_mtime;
+	size = (unsigned long long)st.st_size;
+	return true;
+}
+
+// whether a file changed since the scene was loaded from it
+static bool _sourceChanged( const string& str , long long time , unsigned long long size )
+{
+	long long cur_time = 0;
+	unsigned long long cur_size = 0;
+	return !_statSource( str , cur_time , cur_size ) || cur_time != time || cur_size != size;
+}
+
+// the text of an element in the scene file
+static string _elementText( const TiXmlElement* element )
+{
+	TiXmlPrinter printer;
+	element->Accept( &printer );
+	return printer.CStr();
+}
+
+// the text of everything except the lights , the light nodes don't touch the geometry of meshes
+static string _geometryText( const TiXmlNode* root )
+{
+	string text;
+	for( const TiXmlElement* child = root->FirstChildElement() ; child ; child = child->NextSiblingElement() )
+		if( strcmp( child->Value() , "Light" ) != 0 )
+			text += _elementText( child );
+	return text;
+}
+
+// the text of the geometry without the placement and the files of the models
+static string _layoutText( const TiXmlNode* root )
+{
+	string text;
+	for( const TiXmlElement* child = root->FirstChildElement() ; child ; child = child->NextSiblingElement() )
+	{
+		if( strcmp( child->Value() , "Light" ) == 0 )
+			continue;
+		if( strcmp( child->Value() , "Model" ) != 0 )
+		{
+			text += _elementText( child );
+			continue;
+		}
+
+		TiXmlElement model( *child );
+		model.RemoveAttribute( "filename" );
+		for( const char* placement : { "Transform" , "Motion" } )
+		{
+			while( TiXmlNode* node = model.FirstChild( placement ) )
+				model.RemoveChild( node );
+		}
+		text += _elementText( &model );
+	}
+	return text;
+}
+
+// the number of loadings of scenes , the primitives of each loading are new ones even if the files are the same
+static unsigned long long g_sceneVersions = 0;
+
 // load the scene from script file
 bool Scene::LoadScene( const string& str )
 {
+	SORT_PROFILE( "Scene::LoadScene" );
+
+	// the primitives loaded below are new ones even if the files are the same
+	m_version = ++g_sceneVersions;
+
 	// copy the filename
 	m_filename = str;
+	m_sources.clear();
+	m_lightSources.clear();
+	_addSource( str , SOURCE_SCENE );
 
 	// load the xml file
 	TiXmlDocument doc( str.c_str() );
-	doc.LoadFile();
-
-    sAssert( !doc.Error() , GENERAL );
+	if( !XmlBinary::Load( doc ) || doc.RootElement() == nullptr )
+	{
+        slog( WARNING , GENERAL , stringFormat( "%s. Scene file %s can't be loaded." , doc.ErrorDesc() , str.c_str() ) );
+		return false;
+	}
 
 	// get the root of xml
 	TiXmlNode*	root = doc.RootElement();
+	m_geometryText = _geometryText( root );
+	m_layoutText = _layoutText( root );
 
 	// get the resource path if there is
 	string oldpath = GetResourcePath();
@@ -60,17 +175,82 @@ bool Scene::LoadScene( const string& str )
 		if( path )	SetResourcePath( path );
 	}
 
-	// parse materials
-	TiXmlElement* material = root->FirstChildElement( "Material" );
-	while( material )
+	// shading buffers of meshes could be paged out with a budget in megabytes , so could the tiles of textures
+	element = root->FirstChildElement( "Paging" );
+	if( element )
+	{
+		const char* budget = element->Attribute( "budget" );
+		if( budget )	m_meshPager.SetBudget( (size_t)max( 0 , atoi( budget ) ) << 20 );
+
+		// the tiles of images are always read on demand , the budget only bounds the resident ones
+		const char* texture_budget = element->Attribute( "texture_budget" );
+		if( texture_budget )	TexManager::GetSingleton().SetCacheBudget( (size_t)max( 0 , atoi( texture_budget ) ) << 20 );
+
+		// the patches of subdivision surfaces are tessellated on demand too , the budget bounds the resident tessellations
+		const char* subdiv_budget = element->Attribute( "subdiv_budget" );
+		if( subdiv_budget )	m_subdivCache.SetBudget( (size_t)max( 0 , atoi( subdiv_budget ) ) << 20 );
+	}
+
+	// the meshes blender wrote into shared memory are mapped , the models refer to them in memory
+	element = root->FirstChildElement( "MeshTransfer" );
+	if( element && element->Attribute( "name" ) )
 	{
-		const char* mat_name = material->Attribute( "value" );
-		if( mat_name != 0 )
-			MatManager::GetSingleton().ParseMatFile( mat_name );
-		material = material->NextSiblingElement( "Material" );
+		const string transfer = element->Attribute( "name" );
+		_addSource( transfer , SOURCE_MODEL );
+		MeshTransfer::Map( transfer );
 	}
 
+	// the material libraries and the models are read ahead in the background , the models are read while the materials decode their images
+	_prefetchFiles( root );
+
+	// the material libraries decode their images while the models are read , the models only bind their materials afterward
+	TaskGraph loading;
+	loading.AddTask( [&](){
+		SORT_PROFILE( "ParseMaterials" );
+		for( const TiXmlElement* material = root->FirstChildElement( "Material" ) ; material ; material = material->NextSiblingElement( "Material" ) )
+		{
+			const char* mat_name = material->Attribute( "value" );
+			if( mat_name != 0 )
+				MatManager::GetSingleton().ParseMatFile( mat_name );
+		}
+	});
+
+	// the participating media are independent of both , the models refer to them by their names
+	loading.AddTask( [&](){
+		SORT_PROFILE( "ParseMedia" );
+		for( const TiXmlElement* node = root->FirstChildElement( "Medium" ) ; node ; node = node->NextSiblingElement( "Medium" ) )
+		{
+			const char* name = node->Attribute( "name" );
+			if( name == 0 || m_media.count( name ) )
+			{
+				slog( WARNING , GENERAL , stringFormat( "Medium %s is skipped, it has no name or the name is taken." , name ? name : "" ) );
+				continue;
+			}
+			Medium* medium = _createMedium( node );
+			if( medium == 0 )
+				continue;
+			m_media[name] = medium;
+
+			// the cameras are in the ambient medium , so is everything outside the models bounding other media
+			const char* ambient = node->Attribute( "ambient" );
+			if( ambient && atoi( ambient ) == 1 )
+				m_ambientMedium = medium;
+		}
+	});
+
 	// parse the triangle mesh
+	struct Model_Job{
+		TiXmlElement*	node;
+		TriMesh*		mesh;
+		string			filename;
+		Transform		transform;
+		bool			instance;	// whether an earlier model loads the same file
+		bool			weld;		// whether the vertexes of the mesh are welded
+		bool			compress;	// whether the vertex buffers of the mesh are compressed
+		bool			loaded;
+	};
+	vector<Model_Job> jobs;
+	std::unordered_set<string> model_names , model_files;
 	TiXmlElement* meshNode = root->FirstChildElement( "Model" );
 	while( meshNode )
 	{
@@ -85,92 +265,259 @@ bool Scene::LoadScene( const string& str )
                 slog( WARNING , GENERAL , stringFormat("Mesh defined in file %s doesn't have a model name, it will be skipped." , filename ) );
 				break;
 			}
-			if( nullptr != GetTriMesh( model_name ) ){
+			if( !model_names.insert( model_name ).second ){
                 slog( WARNING , GENERAL , stringFormat("A mesh with name %s already existed." , model_name ) );
 				break;
 			}
+			m_modelTexts[model_name] = _elementText( meshNode );
 
 			// load the transform matrix
-			Transform transform = _parseTransform( meshNode->FirstChildElement( "Transform" ) );
+			Model_Job job;
+			job.node = meshNode;
+			job.mesh = new TriMesh(model_name);
+			job.transform = _parseTransform( meshNode->FirstChildElement( "Transform" ) );
+
+			// only the file of the level of detail picked for the cameras is loaded , models sharing it are instanced
+			LodModel lod;
+			job.filename = _modelFile( meshNode , &lod );
+			if( !lod.distances.empty() )
+				m_lodModels.push_back( lod );
+			job.instance = !model_files.insert( GetFullPath( job.filename ) ).second;
+			if( !job.instance )
+				_addSource( GetFullPath( job.filename ) , SOURCE_MODEL );
+			const char* weld = meshNode->Attribute( "weld" );
+			job.weld = ( weld != 0 && atoi( weld ) == 1 );
+			const char* compress = meshNode->Attribute( "compress" );
+			job.compress = ( compress != 0 && atoi( compress ) == 1 );
+
+			// the triangles of a subdivided model are the control cage of a Catmull-Clark surface , the value is the deepest level
+			const char* subdiv = meshNode->Attribute( "subdiv" );
+			if( subdiv )
+			{
+				job.mesh->m_SubdivLevel = (unsigned)min( SUBDIV_MAX_LEVEL , max( 0 , atoi( subdiv ) ) );
+				job.mesh->m_SubdivCache = &m_subdivCache;
+			}
+			job.loaded = false;
+			jobs.push_back( job );
+		}
+
+		// get to the next model
+		meshNode = meshNode->NextSiblingElement( "Model" );
+	}
+
+	// models loading different files are independent , each of them is a task running next to the material libraries
+	for( unsigned i = 0 ; i < (unsigned)jobs.size() ; ++i )
+	{
+		if( jobs[i].instance )
+			continue;
+		loading.AddTask( [&jobs,i](){
+			SORT_PROFILE_ARG( "LoadModel" , i );
+			Model_Job& job = jobs[i];
+			job.loaded = job.mesh->LoadMesh( job.filename , job.transform );
 
-			// load the first mesh
-			TriMesh* mesh = new TriMesh(model_name);
-			if( mesh->LoadMesh( filename , transform ) )
+			// corners sharing all attributes are welded , the triangles could refer to them with compact indexes later
+			if( job.loaded && job.weld )
 			{
-				// reset the material if neccessary
-				TiXmlElement* meshMat = meshNode->FirstChildElement( "Material" );
-				if( meshMat )
+				job.mesh->m_pMemory->WeldVertices();
+				job.mesh->m_pMemory->UpdateMemoryUsage();
+			}
+		});
+	}
+	loading.Run();
+
+	unsigned coarser = 0;
+	for( const auto& lod : m_lodModels )
+		coarser += lod.level > 0 ? 1 : 0;
+	if( !m_lodModels.empty() )
+		slog( INFO , GENERAL , stringFormat( "%d of %d models with levels of detail are loaded at a coarser level." , (int)coarser , (int)m_lodModels.size() ) );
+
+	// instances refer to their prototypes , they are created in the order of the models
+	for( auto& job : jobs )
+	{
+		if( job.instance )
+			job.loaded = job.mesh->LoadMesh( job.filename , job.transform );
+		if( job.loaded )
+		{
+			job.mesh->BindMaterials();
+
+			// the motion over the frame , it is applied on top of the transform of the model
+			const TiXmlElement* motion = job.node->FirstChildElement( "Motion" );
+			if( motion && !job.mesh->SetMotion( _parseTransform( motion ) ) )
+				slog( WARNING , GENERAL , stringFormat( "Model %s doesn't move, only affine instances of models loaded earlier could move." , job.mesh->m_Name.c_str() ) );
+
+			// the light linking sets the model receives light from , it receives light from all of them by default
+			const TiXmlElement* link = job.node->FirstChildElement( "LightLink" );
+			if( link && link->Attribute( "include" ) )
+				job.mesh->m_LightLinks = _linkSets( link->Attribute( "include" ) );
+			else if( link && link->Attribute( "exclude" ) )
+				job.mesh->m_LightLinks = ~_linkSets( link->Attribute( "exclude" ) );
+
+			// the kinds of rays the model is hidden from , it is seen by all rays by default
+			job.mesh->m_Hidden = _hiddenRays( job.node->FirstChildElement( "Visibility" ) );
+
+			// the media inside and outside of the model , a boundary only separates them and scatters no light
+			const char* boundary = job.node->Attribute( "boundary" );
+			job.mesh->m_Media.inside = _findMedium( job.node->Attribute( "interior" ) );
+			job.mesh->m_Media.outside = _findMedium( job.node->Attribute( "exterior" ) );
+			job.mesh->m_Media.boundary = boundary && atoi( boundary ) == 1;
+			job.mesh->m_HasMedia = job.mesh->m_Media.inside || job.mesh->m_Media.outside || job.mesh->m_Media.boundary;
+
+			// reset the material if neccessary
+			TiXmlElement* meshMat = job.node->FirstChildElement( "Material" );
+			if( meshMat )
+			{
+				meshMat = meshMat->FirstChildElement( "MatSet" );
+				do
 				{
-					meshMat = meshMat->FirstChildElement( "MatSet" );
-					do
-					{
-						const char* set_name = meshMat->Attribute( "name" );
-						const char* mat_name = meshMat->Attribute( "mat" );
+					const char* set_name = meshMat->Attribute( "name" );
+					const char* mat_name = meshMat->Attribute( "mat" );
 
-						if( set_name != 0 && mat_name != 0 )
-							mesh->ResetMaterial( set_name , mat_name );
+					if( set_name != 0 && mat_name != 0 )
+						job.mesh->ResetMaterial( set_name , mat_name );
 
-						meshMat = meshMat->NextSiblingElement( "MatSet" );
-					}while( meshMat );
-				}
-				m_meshBuf.push_back( mesh );
+					meshMat = meshMat->NextSiblingElement( "MatSet" );
+				}while( meshMat );
 			}
-			else
-				delete mesh;
+			m_meshBuf.push_back( job.mesh );
 		}
+		else
+			delete job.mesh;
+	}
 
-		// get to the next model
-		meshNode = meshNode->NextSiblingElement( "Model" );
+	// the tangent pass is skipped unless a material of the scene needs tangents
+	bool needs_tangent = false;
+	for( auto mesh : m_meshBuf )
+		needs_tangent |= mesh->NeedsTangent();
+	m_needsTangent = needs_tangent;
+
+	// material libraries could be referred by the models too
+	for( const auto& mat_file : MatManager::GetSingleton().GetParsedFiles() )
+		_addSource( mat_file , SOURCE_MATERIAL );
+
+	// the vertex buffers are completed and compressed before any primitive reads them , instances share the buffers of their prototypes
+	vector<Model_Job*> prototypes;
+	for( auto& job : jobs )
+		if( job.loaded && !job.mesh->m_bInstanced )
+			prototypes.push_back( &job );
+	ParallelFor( 0 , (unsigned)prototypes.size() , 1 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; ++i )
+		{
+			BufferMemory* memory = prototypes[i]->mesh->m_pMemory.get();
+			if( needs_tangent )
+				memory->GenSmoothTagent();
+			if( prototypes[i]->compress )
+				memory->CompressVertices();
+			memory->UpdateMemoryUsage();
+		}
+	});
+	// parse the curves , hair and fur are intersected as curves instead of being tessellated into triangles
+	for( const TiXmlElement* curveNode = root->FirstChildElement( "Curves" ) ; curveNode ; curveNode = curveNode->NextSiblingElement( "Curves" ) )
+	{
+		const char* filename = curveNode->Attribute( "filename" );
+		const char* curve_name = curveNode->Attribute( "name" );
+		if( filename == 0 || curve_name == 0 )
+		{
+			slog( WARNING , GENERAL , "Curves without a file or a name are skipped." );
+			continue;
+		}
+
+		CurveSet* curves = new CurveSet( curve_name );
+		const char* type = curveNode->Attribute( "type" );
+		if( type && strcmp( type , "ribbon" ) == 0 )
+			curves->m_Type = CURVE_RIBBON;
+		const char* split = curveNode->Attribute( "split" );
+		if( split )
+			curves->m_Split = (unsigned)min( 8 , max( 0 , atoi( split ) ) );
+
+		const char* mat_name = curveNode->Attribute( "mat" );
+		if( mat_name )
+		{
+			curves->m_Material = MatManager::GetSingleton().FindMaterial( mat_name );
+			if( curves->m_Material == nullptr )
+				slog( WARNING , MATERIAL , stringFormat( "Material %s doesn't exist." , mat_name ) );
+		}
+		if( curves->m_Material == nullptr )
+			curves->m_Material = MatManager::GetSingleton().GetDefaultMat();
+
+		const TiXmlElement* link = curveNode->FirstChildElement( "LightLink" );
+		if( link && link->Attribute( "include" ) )
+			curves->m_LightLinks = _linkSets( link->Attribute( "include" ) );
+		else if( link && link->Attribute( "exclude" ) )
+			curves->m_LightLinks = ~_linkSets( link->Attribute( "exclude" ) );
+		curves->m_Hidden = _hiddenRays( curveNode->FirstChildElement( "Visibility" ) );
+
+		if( !curves->LoadCurves( filename , _parseTransform( curveNode->FirstChildElement( "Transform" ) ) ) )
+		{
+			delete curves;
+			continue;
+		}
+		_addSource( GetFullPath( filename ) , SOURCE_MODEL );
+		m_curveBuf.push_back( curves );
 	}
+
 	// generate triangle buffer after parsing from file
 	_generateTriBuf();
+
+	// emissive subsets of the models are mesh lights
+	for( auto& job : jobs )
+	{
+		TiXmlElement* emission = job.loaded ? job.node->FirstChildElement( "Emission" ) : nullptr;
+		if( emission == nullptr )
+			continue;
+		for( TiXmlElement* emitSet = emission->FirstChildElement( "EmitSet" ) ; emitSet ; emitSet = emitSet->NextSiblingElement( "EmitSet" ) )
+		{
+			const char* set_name = emitSet->Attribute( "name" );
+			const char* radiance = emitSet->Attribute( "intensity" );
+			if( radiance == 0 )
+				continue;
+
+			vector<Primitive*> triangles;
+			if( !job.mesh->GetSubsetTriangles( set_name ? set_name : "" , m_triBuf , triangles ) )
+			{
+				slog( WARNING , LIGHT , stringFormat( "Subset %s of model %s can't emit, only existing subsets of models loaded first could." , set_name ? set_name : "" , job.mesh->m_Name.c_str() ) );
+				continue;
+			}
+			if( triangles.empty() )
+				continue;
+
+			Light* light = new MeshLight( triangles , SpectrumFromStr( radiance ) );
+			light->SetupScene( this );
+			for( auto triangle : triangles )
+				triangle->BindLight( light );
+			m_lights.push_back( light );
+		}
+	}
 	
 	// parse the lights
 	TiXmlElement* lightNode = root->FirstChildElement( "Light" );
 	while( lightNode )
 	{
-		const char* type = lightNode->Attribute( "type" );
-		if( type != 0 )
+		Light* light = _createLight( lightNode );
+		if( light )
 		{
-			Light* light = CREATE_TYPE( type , Light );
-			if( light )
+			Shape* shape = light->GetShape();
+			if( shape )
 			{
-				// setup 
-				light->SetupScene( this );
-
-				// load the transform matrix
-				light->SetTransform( _parseTransform( lightNode->FirstChildElement( "Transform" ) ) );
-
-				// set the properties
-				TiXmlElement* prop = lightNode->FirstChildElement( "Property" );
-				while( prop )
-				{
-					const char* prop_name = prop->Attribute( "name" );
-					const char* prop_value = prop->Attribute( "value" );
-					if( prop_name != 0 && prop_value != 0 )
-						light->SetProperty( prop_name , prop_value );
-					prop = prop->NextSiblingElement( "Property" );
-				}
+				shape->SetID((unsigned)m_triBuf.size() );
+				m_triBuf.push_back( shape );
+			}
 
-				Shape* shape = light->GetShape();
-				if( shape )
-				{
-					shape->SetID((unsigned)m_triBuf.size() );
-					m_triBuf.push_back( shape );
-				}
+			if( strcmp( lightNode->Attribute( "type" ) , "skylight" ) == 0 )
+				m_skyLight = light;
 
-				if( strcmp( type , "skylight" ) == 0 )
-					m_skyLight = light;
+			m_lights.push_back( light );
+		}
 
-				m_lights.push_back( light );
-			}
-		}else
-            slog( WARNING , LIGHT , stringFormat( "Undefined light type %s" , type ) );
+		LightSource source;
+		source.text = _elementText( lightNode );
+		source.light = light;
+		m_lightSources.push_back( source );
 
 		// get to the next light
 		lightNode = lightNode->NextSiblingElement( "Light" );
 	}
 	_genLightDistribution();
+	_checkMotion();
 	
 	// get accelerator if there is, if there is no accelerator, intersection test is performed in a brute force way.
 	TiXmlElement* accelNode = root->FirstChildElement( "Accel" );
@@ -178,7 +525,46 @@ bool Scene::LoadScene( const string& str )
 	{
 		// set cooresponding type of accelerator
 		const char* type = accelNode->Attribute( "type" );
+#if !SORT_USE_EMBREE
+		if( type != 0 && strcmp( type , "embree" ) == 0 ){
+			slog( WARNING , SPATIAL_ACCELERATOR , "SORT is not built with Embree , bvh is used instead." );
+			type = "bvh";
+		}
+#endif
 		if( type != 0 )	m_pAccelerator = CREATE_TYPE( type , Accelerator );
+
+		// the built structure could be cached on disk, the type and the properties are part of the key of the cache
+		const char* cache = accelNode->Attribute( "cache" );
+		m_accelCache = ( cache != 0 && atoi( cache ) == 1 );
+		m_accelParams = ( type != 0 ) ? type : "";
+
+		// triangles of the same leaf could share cache lines once their data is reordered after the construction
+		const char* reorder = accelNode->Attribute( "reorder" );
+		m_accelReorder = ( reorder != 0 ) ? (unsigned)max( 0 , min( 2 , atoi( reorder ) ) ) : 0;
+
+		// streams of rays could be traced on the GPU while the hits are shaded on the CPU
+		const char* gpu = accelNode->Attribute( "gpu" );
+		m_accelGpu = ( gpu != 0 && atoi( gpu ) == 1 );
+#if !SORT_USE_CUDA
+		if( m_accelGpu )
+			slog( WARNING , SPATIAL_ACCELERATOR , "SORT is not built with CUDA , rays are traced on the CPU." );
+#endif
+
+		// set the properties
+		if( m_pAccelerator )
+		{
+			TiXmlElement* prop = accelNode->FirstChildElement( "Property" );
+			while( prop )
+			{
+				const char* prop_name = prop->Attribute( "name" );
+				const char* prop_value = prop->Attribute( "value" );
+				if( prop_name != 0 && prop_value != 0 ){
+					m_pAccelerator->SetProperty( prop_name , prop_value );
+					m_accelParams += string( ";" ) + prop_name + "=" + prop_value;
+				}
+				prop = prop->NextSiblingElement( "Property" );
+			}
+		}
 	}
 
 	// restore resource path
@@ -192,12 +578,178 @@ bool Scene::GetIntersect( const Ray& r , Intersection* intersect ) const
 {
 	if( intersect )
 		intersect->t = FLT_MAX;
+	SORT_STATS( ++AccelStats::Local().rays );
+	RenderTelemetry::CountRays( 1 );
+	RenderTelemetry::CountPathRays( 1 );
+
+	// brute force intersection test if there is no accelerator
+	const bool inter = ( m_pAccelerator == 0 ) ? _bfIntersect( r , intersect ) : m_pAccelerator->GetIntersect( r , intersect );
+
+	// shading information is only resolved for the closest hit
+	if( inter && intersect && intersect->primitive ){
+		intersect->time = r.m_Time;
+		intersect->primitive->ResolveHit( r , intersect );
+	}
+
+	return inter;
+}
+
+// get the intersection of a camera ray whose first hit is found by the raster pass
+bool Scene::GetPrimaryIntersect( const Ray& r , const Primary_Hit& hit , Intersection* intersect ) const
+{
+	intersect->t = FLT_MAX;
+	SORT_STATS( ++AccelStats::Local().rays );
+	RenderTelemetry::CountRays( 1 );
+	RenderTelemetry::CountPathRays( 1 );
+	if( hit.primitive == nullptr )
+		return false;
+
+	// the hit record of a triangle is complete , other primitives are tested again to fill theirs
+	if( hit.triangle ){
+		intersect->t = hit.t;
+		intersect->bu = hit.u;
+		intersect->bv = hit.v;
+		intersect->primitive = const_cast<Primitive*>( hit.primitive );
+	}else if( !hit.primitive->GetIntersect( r , intersect ) )
+		return false;
+
+	intersect->time = r.m_Time;
+	intersect->primitive->ResolveHit( r , intersect );
+	return true;
+}
+
+// find the first hits of a stream of camera rays
+void Scene::GetPrimaryHits( const Ray* rays , Primary_Hit* hits , unsigned count ) const
+{
+	// the rays are counted once the hits are resolved
+	Intersection* intersects = SORT_MALLOC_ARRAY( Intersection , count );
+	bool* results = SORT_MALLOC_ARRAY( bool , count );
+	for( unsigned i = 0 ; i < count ; ++i ){
+		new (&intersects[i]) Intersection();
+		intersects[i].t = FLT_MAX;
+	}
+	if( m_pAccelerator == 0 ){
+		for( unsigned i = 0 ; i < count ; ++i )
+			results[i] = _bfIntersect( rays[i] , &intersects[i] );
+	}else{
+		m_pAccelerator->GetIntersect( rays , intersects , results , count );
+	}
+
+	for( unsigned i = 0 ; i < count ; ++i ){
+		hits[i] = Primary_Hit();
+		if( !results[i] || intersects[i].primitive == nullptr )
+			continue;
+
+		// only the hits of world space triangles are complete without resolving them
+		Point p0 , p1 , p2;
+		hits[i].primitive = intersects[i].primitive;
+		hits[i].triangle = intersects[i].primitive->GetTriangleVertices( p0 , p1 , p2 );
+		hits[i].t = intersects[i].t;
+		hits[i].u = intersects[i].bu;
+		hits[i].v = intersects[i].bv;
+	}
+}
+
+// get the intersections between a stream of rays and the scene
+void Scene::GetIntersect( const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const
+{
+	for( unsigned i = 0 ; i < count ; ++i )
+		intersects[i].t = FLT_MAX;
+	SORT_STATS( AccelStats::Local().rays += count );
+	RenderTelemetry::CountRays( count );
+	RenderTelemetry::CountPathRays( count );
+
+	// brute force intersection test if there is no accelerator
+	if( m_pAccelerator == 0 ){
+		for( unsigned i = 0 ; i < count ; ++i )
+			results[i] = _bfIntersect( rays[i] , &intersects[i] );
+	}else{
+		m_pAccelerator->GetIntersect( rays , intersects , results , count );
+	}
+
+	_resolveHits( rays , intersects , results , count );
+}
+
+// shading information is only resolved for the closest hits
+void Scene::_resolveHits( const Ray* rays , Intersection* intersects , const bool* results , unsigned count ) const
+{
+	for( unsigned i = 0 ; i < count ; ++i ){
+		if( results[i] && intersects[i].primitive ){
+			intersects[i].time = rays[i].m_Time;
+			intersects[i].primitive->ResolveHit( rays[i] , &intersects[i] );
+		}
+	}
+}
+
+// start intersecting a stream of rays
+void Scene::SubmitIntersect( unsigned slot , const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const
+{
+#if SORT_USE_CUDA
+	if( m_gpuQuery ){
+		for( unsigned i = 0 ; i < count ; ++i )
+			intersects[i].t = FLT_MAX;
+		SORT_STATS( AccelStats::Local().rays += count );
+		RenderTelemetry::CountRays( count );
+		RenderTelemetry::CountPathRays( count );
+		m_gpuQuery->Submit( slot , rays , intersects , results , count );
+		return;
+	}
+#endif
+	GetIntersect( rays , intersects , results , count );
+}
+
+// start testing whether each ray in a stream is blocked
+void Scene::SubmitOccluded( unsigned slot , const Ray* rays , bool* results , unsigned count ) const
+{
+#if SORT_USE_CUDA
+	if( m_gpuQuery ){
+		SORT_STATS( AccelStats::Local().rays += count );
+		RenderTelemetry::CountRays( count );
+		m_gpuQuery->Submit( slot , rays , nullptr , results , count );
+		return;
+	}
+#endif
+	IsOccluded( rays , results , count );
+}
+
+// wait for the stream of a slot
+void Scene::WaitStream( unsigned slot ) const
+{
+#if SORT_USE_CUDA
+	if( m_gpuQuery ){
+		const GpuRayQuery::Batch& batch = m_gpuQuery->Wait( slot );
+		if( batch.intersects )
+			_resolveHits( batch.rays , batch.intersects , batch.results , batch.count );
+	}
+#endif
+}
+
+// whether the ray is blocked by anything in the scene
+bool Scene::IsOccluded( const Ray& r ) const
+{
+	SORT_STATS( ++AccelStats::Local().rays );
+	RenderTelemetry::CountRays( 1 );
 
 	// brute force intersection test if there is no accelerator
 	if( m_pAccelerator == 0 )
-		return _bfIntersect( r , intersect );
+		return _bfIntersect( r , 0 );
+
+	return m_pAccelerator->IsOccluded( r );
+}
+
+// whether each ray in a stream is blocked by anything in the scene
+void Scene::IsOccluded( const Ray* rays , bool* results , unsigned count ) const
+{
+	SORT_STATS( AccelStats::Local().rays += count );
+	RenderTelemetry::CountRays( count );
 
-	return m_pAccelerator->GetIntersect( r , intersect );
+	// brute force intersection test if there is no accelerator
+	if( m_pAccelerator == 0 ){
+		for( unsigned i = 0 ; i < count ; ++i )
+			results[i] = _bfIntersect( rays[i] , 0 );
+	}else{
+		m_pAccelerator->IsOccluded( rays , results , count );
+	}
 }
 
 // get the intersection between a ray and the scene in a brute force way
@@ -205,8 +757,11 @@ bool Scene::_bfIntersect( const Ray& r , Intersection* intersect ) const
 {
 	if( intersect ) intersect->t = FLT_MAX;
 	int n = (int)m_triBuf.size();
+	const unsigned type = RayType( r , intersect == nullptr );
 	for( int k = 0 ; k < n ; k++ )
 	{
+		if( m_triBuf[k]->IsHiddenFrom( type ) )
+			continue;
 		bool flag = m_triBuf[k]->GetIntersect( r , intersect );
 		if( flag && intersect == 0 )
 			return true;
@@ -221,16 +776,28 @@ bool Scene::_bfIntersect( const Ray& r , Intersection* intersect ) const
 void Scene::Release()
 {
 	SAFE_DELETE( m_pAccelerator );
+#if SORT_USE_CUDA
+	SAFE_DELETE( m_gpuQuery );
+#endif
+	SAFE_DELETE( m_gpuTree );
+	m_accelMemory.Set( 0 );
 	SAFE_DELETE( m_pLightsDis );
+	SAFE_DELETE( m_pUnboundedDis );
+	m_unboundedLights.clear();
+	m_unboundedPower = 0.0f;
+	m_lightTree.Release();
 
-	vector<Primitive*>::iterator it = m_triBuf.begin();
-	while( it != m_triBuf.end() )
-	{
-		delete *it;
-		it++;
-	}
+	// the primitives belong to the meshes , the curves and the area lights , they are released with them
 	m_triBuf.clear();
 
+	for( auto curves : m_curveBuf )
+		delete curves;
+	m_curveBuf.clear();
+
+	// pages refer to the memory of meshes
+	m_meshPager.Release();
+	m_subdivCache.Release();
+
 	vector<TriMesh*>::iterator tri_it = m_meshBuf.begin();
 	while( tri_it != m_meshBuf.end() )
 	{
@@ -246,6 +813,512 @@ void Scene::Release()
 		light_it++;
 	}
 	m_lights.clear();
+
+	for( auto& medium : m_media )
+		delete medium.second;
+	m_media.clear();
+
+	m_filename.clear();
+	m_sources.clear();
+	m_lightSources.clear();
+	m_geometryText.clear();
+	m_layoutText.clear();
+	m_modelTexts.clear();
+	m_movedMeshes.clear();
+	m_deformedMeshes.clear();
+	m_linkSets.clear();
+	m_lodModels.clear();
+	_init();
+}
+
+// create a light from its node in the scene file
+Light* Scene::_createLight( const TiXmlElement* node )
+{
+	const char* type = node->Attribute( "type" );
+	if( type == 0 )
+		return 0;
+
+	Light* light = CREATE_TYPE( type , Light );
+	if( light == 0 )
+	{
+        slog( WARNING , LIGHT , stringFormat( "Undefined light type %s" , type ) );
+		return 0;
+	}
+
+	// setup 
+	light->SetupScene( this );
+
+	// load the transform matrix
+	light->SetTransform( _parseTransform( node->FirstChildElement( "Transform" ) ) );
+
+	// the motion over the frame , it is applied on top of the placement of the light
+	const TiXmlElement* motion = node->FirstChildElement( "Motion" );
+	if( motion )
+		light->SetMotion( _parseTransform( motion ) );
+
+	// the light linking sets of the light
+	const char* link = node->Attribute( "link" );
+	if( link )
+		light->SetLinks( _linkSets( link ) );
+
+	// set the properties
+	const TiXmlElement* prop = node->FirstChildElement( "Property" );
+	while( prop )
+	{
+		const char* prop_name = prop->Attribute( "name" );
+		const char* prop_value = prop->Attribute( "value" );
+		if( prop_name != 0 && prop_value != 0 )
+			light->SetProperty( prop_name , prop_value );
+		prop = prop->NextSiblingElement( "Property" );
+	}
+	light->Prepare();
+	return light;
+}
+
+// create a participating medium from its node in the scene file
+Medium* Scene::_createMedium( const TiXmlElement* node )
+{
+	const char* type = node->Attribute( "type" );
+	Medium* medium = type ? CREATE_TYPE( type , Medium ) : 0;
+	if( medium == 0 )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Undefined medium type %s" , type ? type : "" ) );
+		return 0;
+	}
+
+	medium->SetTransform( _parseTransform( node->FirstChildElement( "Transform" ) ) );
+	for( const TiXmlElement* prop = node->FirstChildElement( "Property" ) ; prop ; prop = prop->NextSiblingElement( "Property" ) )
+	{
+		const char* prop_name = prop->Attribute( "name" );
+		const char* prop_value = prop->Attribute( "value" );
+		if( prop_name != 0 && prop_value != 0 )
+			medium->SetProperty( prop_name , prop_value );
+	}
+	medium->Prepare();
+	return medium;
+}
+
+// find a participating medium by its name
+const Medium* Scene::_findMedium( const char* name ) const
+{
+	if( name == 0 || name[0] == 0 )
+		return 0;
+	auto it = m_media.find( name );
+	if( it == m_media.end() )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Medium %s doesn't exist." , name ) );
+		return 0;
+	}
+	return it->second;
+}
+
+// the transmittance along a shadow ray
+Spectrum Scene::Transmittance( const Ray& r , const Medium* medium ) const
+{
+	Spectrum tr = 1.0f;
+	Ray ray = r;
+	ray.m_Type = RAY_SHADOW;
+	while( true )
+	{
+		Intersection inter;
+		const bool hit = GetIntersect( ray , &inter );
+		const MediumInterface* media = hit ? inter.primitive->GetMediumInterface() : 0;
+		if( hit && ( media == 0 || !media->boundary ) )
+			return 0.0f;
+		if( medium )
+			tr *= medium->Tr( ray , hit ? inter.t : ray.m_fMax );
+		if( !hit || tr.IsBlack() )
+			return tr;
+
+		// the rest of the ray starts behind the boundary
+		medium = media->GetMedium( ray.m_Dir , inter.gnormal );
+		const Point origin = inter.SpawnOrigin( ray.m_Dir );
+		if( ray.m_fMax < FLT_MAX )
+			ray.m_fMax = max( 0.0f , ray.m_fMax - Distance( ray.m_Ori , origin ) );
+		ray.m_Ori = origin;
+		ray.m_fMin = 0.0f;
+	}
+}
+
+// update the scene after its files are edited
+bool Scene::Update( const string& str )
+{
+	if( m_filename.empty() )
+		return false;
+	for( const auto& lod : m_lodModels )
+		if( _pickLod( lod ) != lod.level )
+			return false;
+
+	TiXmlDocument doc( str.c_str() );
+	if( !XmlBinary::Load( doc ) || doc.RootElement() == nullptr )
+		return false;
+	TiXmlNode* root = doc.RootElement();
+
+	// the primitives are only kept if the geometry is the same , models could move or have their vertexes deformed though
+	const string geometry = _geometryText( root );
+	bool models_changed = ( geometry != m_geometryText );
+	for( const auto& source : m_sources )
+		models_changed |= ( source.kind == SOURCE_MODEL && _sourceChanged( source.name , source.time , source.size ) );
+	if( models_changed && !_updateModels( root ) )
+		return false;
+	m_geometryText = geometry;
+
+	// the edited lights are created again , area lights have shapes in the acceleration structure , they can't be replaced
+	vector<const TiXmlElement*> light_nodes;
+	for( const TiXmlElement* node = root->FirstChildElement( "Light" ) ; node ; node = node->NextSiblingElement( "Light" ) )
+		light_nodes.push_back( node );
+	if( light_nodes.size() != m_lightSources.size() )
+		return false;
+
+	unsigned light_cnt = 0;
+	for( unsigned i = 0 ; i < (unsigned)light_nodes.size() ; ++i )
+	{
+		LightSource& source = m_lightSources[i];
+		const string text = _elementText( light_nodes[i] );
+		if( text == source.text )
+			continue;
+		if( source.light && source.light->GetShape() )
+			return false;
+
+		Light* light = _createLight( light_nodes[i] );
+		if( light && light->GetShape() )
+		{
+			delete light;
+			return false;
+		}
+
+		vector<Light*>::iterator it = std::find( m_lights.begin() , m_lights.end() , source.light );
+		if( it != m_lights.end() )
+		{
+			if( light )
+				*it = light;
+			else
+				m_lights.erase( it );
+		}
+		else if( light )
+			m_lights.push_back( light );
+
+		if( m_skyLight == source.light )
+			m_skyLight = 0;
+		if( light && strcmp( light_nodes[i]->Attribute( "type" ) , "skylight" ) == 0 )
+			m_skyLight = light;
+
+		delete source.light;
+		source.light = light;
+		source.text = text;
+		++light_cnt;
+	}
+	if( m_lights.empty() )
+		return false;
+	if( light_cnt > 0 ){
+		_genLightDistribution();
+		_checkMotion();
+	}
+
+	// only the edited materials in the material files are parsed again
+	unsigned mat_cnt = 0;
+	for( const auto& source : m_sources )
+		if( source.kind == SOURCE_MATERIAL && _sourceChanged( source.name , source.time , source.size ) )
+			mat_cnt += MatManager::GetSingleton().UpdateMatFile( source.name );
+
+	// tangents are only generated while loading , the scene is loaded again if an edited material needs them
+	bool needs_tangent = false;
+	for( auto mesh : m_meshBuf )
+		needs_tangent |= mesh->NeedsTangent();
+	if( needs_tangent && !m_needsTangent )
+		return false;
+
+	// so are the micromaps , an edited material could change which surfaces are cut away
+	bool cutout = m_hasCutouts;
+	for( auto mesh : m_meshBuf )
+		cutout |= mesh->HasOpacity();
+	if( mat_cnt > 0 && cutout )
+		return false;
+
+	// the files are recorded again so that the next update only finds the later edits
+	vector<SourceFile> sources;
+	sources.swap( m_sources );
+	for( const auto& source : sources )
+		_addSource( source.kind == SOURCE_SCENE ? str : source.name , source.kind );
+	m_filename = str;
+
+	slog( INFO , GENERAL , stringFormat( "Scene %s is updated, %d models are moved or deformed, %d lights and %d materials are parsed again." , str.c_str() , (int)m_movedMeshes.size() , light_cnt , mat_cnt ) );
+	return true;
+}
+
+// read the files of another scene ahead
+void Scene::Prefetch( const string& str )
+{
+	TiXmlDocument doc( str.c_str() );
+	if( !XmlBinary::Load( doc ) || doc.RootElement() == nullptr )
+		return;
+	const TiXmlNode* root = doc.RootElement();
+
+	// the files are relative to the resource path of that scene
+	const string oldpath = GetResourcePath();
+	const TiXmlElement* resource = root->FirstChildElement( "Resource" );
+	if( resource && resource->Attribute( "path" ) )
+		SetResourcePath( resource->Attribute( "path" ) );
+	_prefetchFiles( root );
+	SetResourcePath( oldpath );
+}
+
+// read the files of the scene ahead
+void Scene::_prefetchFiles( const TiXmlNode* root )
+{
+	vector<string> prefetch;
+	for( const TiXmlElement* node = root->FirstChildElement( "Material" ) ; node ; node = node->NextSiblingElement( "Material" ) )
+		if( node->Attribute( "value" ) )
+			prefetch.push_back( GetFullPath( node->Attribute( "value" ) ) );
+	for( const TiXmlElement* node = root->FirstChildElement( "Model" ) ; node ; node = node->NextSiblingElement( "Model" ) )
+		if( node->Attribute( "filename" ) )
+			prefetch.push_back( GetFullPath( _modelFile( node , nullptr ) ) );
+	for( const TiXmlElement* node = root->FirstChildElement( "Curves" ) ; node ; node = node->NextSiblingElement( "Curves" ) )
+		if( node->Attribute( "filename" ) )
+			prefetch.push_back( GetFullPath( node->Attribute( "filename" ) ) );
+	FilePrefetch::Prefetch( prefetch );
+}
+
+// move or deform the models
+bool Scene::_updateModels( const TiXmlNode* root )
+{
+	// everything else of the geometry has to be the same , so do the order of the primitives and the buffers of the meshes
+	if( _layoutText( root ) != m_layoutText || !m_lodModels.empty() || m_accelReorder || m_gpuQuery || m_meshPager.IsEnabled() || SMManager::GetSingleton().IsSceneSharing() )
+		return false;
+
+	std::unordered_map<string,TriMesh*> meshes;
+	for( auto mesh : m_meshBuf )
+		meshes[mesh->m_Name] = mesh;
+
+	// the files of the models are relative to the resource path of the scene
+	const string oldpath = GetResourcePath();
+	const TiXmlElement* resource = root->FirstChildElement( "Resource" );
+	if( resource && resource->Attribute( "path" ) )
+		SetResourcePath( resource->Attribute( "path" ) );
+
+	// a model changes if its node or its file does , a model loading another file deforms
+	struct ModelDelta{
+		const TiXmlElement*	node;
+		TriMesh*			mesh;
+		string				filename;
+		bool				changed;
+	};
+	vector<ModelDelta> models;
+	std::unordered_set<string> model_files , loaded_files;
+	for( const TiXmlElement* node = root->FirstChildElement( "Model" ) ; node ; node = node->NextSiblingElement( "Model" ) )
+	{
+		const char* name = node->Attribute( "name" );
+		auto it = name ? meshes.find( name ) : meshes.end();
+		if( node->Attribute( "filename" ) == 0 || it == meshes.end() )
+			continue;
+
+		ModelDelta model;
+		model.node = node;
+		model.mesh = it->second;
+		model.filename = GetFullPath( _modelFile( node , nullptr ) );
+		model.changed = ( _elementText( node ) != m_modelTexts[name] );
+		models.push_back( model );
+
+		// a prototype loading the file of another one would be an instance of it
+		if( !model.mesh->m_bInstanced )
+		{
+			model_files.insert( model.mesh->m_pMemory->m_filename );
+			if( !loaded_files.insert( model.filename ).second )
+			{
+				SetResourcePath( oldpath );
+				return false;
+			}
+		}
+	}
+	SetResourcePath( oldpath );
+
+	// the curves can't deform , neither can the meshes in the transfer region of blender
+	std::unordered_set<string> changed_files;
+	for( const auto& source : m_sources )
+	{
+		if( source.kind != SOURCE_MODEL || !_sourceChanged( source.name , source.time , source.size ) )
+			continue;
+		if( !model_files.count( source.name ) )
+			return false;
+		changed_files.insert( source.name );
+	}
+
+	// the vertexes of the prototypes are transformed or read again in world space , instances share them
+	std::unordered_set<TriMesh*> moved;
+	vector<TriMesh*> moved_meshes , deformed;
+	for( const auto& model : models )
+	{
+		TriMesh* mesh = model.mesh;
+		BufferMemory* memory = mesh->m_pMemory.get();
+		const bool deform = ( model.filename != memory->m_filename || changed_files.count( memory->m_filename ) );
+		if( mesh->m_bInstanced || ( !model.changed && !deform ) )
+			continue;
+
+		// the area of emissive triangles is kept by their lights , the patches of subdivided meshes are tessellated from the cage
+		if( mesh->m_Subdiv || model.node->FirstChildElement( "Emission" ) )
+			return false;
+
+		const Transform transform = _parseTransform( model.node->FirstChildElement( "Transform" ) );
+		if( deform )
+		{
+			const string oldfile = memory->m_filename;
+			const char* weld = model.node->Attribute( "weld" );
+			if( !MeshManager::GetSingleton().ReloadVertices( model.filename , mesh , transform , weld != 0 && atoi( weld ) == 1 ) )
+				return false;
+			for( auto& source : m_sources )
+				if( source.kind == SOURCE_MODEL && source.name == oldfile )
+					source.name = model.filename;
+			deformed.push_back( mesh );
+		}
+		else if( memcmp( transform.matrix.m , mesh->m_Transform.matrix.m , sizeof( transform.matrix.m ) ) != 0 )
+		{
+			if( !mesh->MoveTo( transform ) )
+				return false;
+		}
+		else
+			continue;
+		moved.insert( mesh );
+		moved_meshes.push_back( mesh );
+	}
+
+	// instances keep their transformations relative to the prototypes , they are placed again if their prototypes moved
+	for( const auto& model : models )
+	{
+		TriMesh* mesh = model.mesh;
+		TriMesh* prototype = mesh->m_pMemory->m_pPrototype;
+		if( !mesh->m_bInstanced || ( !model.changed && !moved.count( prototype ) ) )
+			continue;
+		if( model.filename != mesh->m_pMemory->m_filename )
+			return false;
+
+		// an instance keeps moving over the frame or staying , the primitives only refer to the transformations
+		const bool moving = mesh->m_bMoving;
+		if( !mesh->MoveTo( _parseTransform( model.node->FirstChildElement( "Transform" ) ) ) )
+			return false;
+		const TiXmlElement* motion = model.node->FirstChildElement( "Motion" );
+		if( motion )
+			mesh->SetMotion( _parseTransform( motion ) );
+		if( mesh->m_bMoving != moving )
+			return false;
+		mesh->UpdateInstances();
+		moved_meshes.push_back( mesh );
+	}
+
+	for( const auto& model : models )
+		m_modelTexts[model.mesh->m_Name] = _elementText( model.node );
+	m_movedMeshes.swap( moved_meshes );
+	m_deformedMeshes.swap( deformed );
+	return true;
+}
+
+// build the acceleration structures again
+void Scene::_rebuildMoved()
+{
+	SORT_PROFILE( "Scene::RebuildMoved" );
+
+	// the texture coordinates of deformed meshes could have changed , so could the micromaps
+	for( auto mesh : m_deformedMeshes )
+	{
+		if( mesh->HasOpacity() )
+			mesh->BakeMicromaps();
+	}
+
+	// the bottom level structures of the moved prototypes are refitted , their instances share them
+	const unsigned mesh_cnt = (unsigned)m_movedMeshes.size();
+	ParallelFor( 0 , mesh_cnt , 1 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; ++i )
+			m_movedMeshes[i]->BuildBlas();
+	});
+
+	// the top level structure is built again , it is refitted if its 'refit' property is set
+	if( m_pAccelerator )
+	{
+		SORT_PROFILE( "Accelerator::Build" );
+		m_pAccelerator->Build();
+		m_accelMemory.Set( m_pAccelerator->GetMemoryUsage() );
+	}
+
+	// the primitives are not the ones of the last rendering anymore , the power of distant lights depends on the bounds
+	m_version = ++g_sceneVersions;
+	m_BBox.InvalidBBox();
+	_genLightDistribution();
+	_checkMotion();
+
+	slog( INFO , GENERAL , stringFormat( "%d moved models and %d deformed ones are refitted." , mesh_cnt , (int)m_deformedMeshes.size() ) );
+	m_movedMeshes.clear();
+	m_deformedMeshes.clear();
+}
+
+// get the bits of light linking sets
+unsigned Scene::_linkSets( const string& names )
+{
+	unsigned bits = 0;
+	string rest = names;
+	while( !rest.empty() )
+	{
+		const string name = NextToken( rest , ' ' );
+		if( name.empty() )
+			continue;
+		auto it = m_linkSets.find( name );
+		if( it == m_linkSets.end() )
+		{
+			if( m_linkSets.size() >= 32 )
+			{
+				slog( WARNING , LIGHT , stringFormat( "Light linking set %s is ignored, there could be 32 sets at most." , name.c_str() ) );
+				continue;
+			}
+			it = m_linkSets.insert( std::make_pair( name , 1u << (unsigned)m_linkSets.size() ) ).first;
+		}
+		bits |= it->second;
+	}
+	return bits;
+}
+
+// get the kinds of rays a model is hidden from
+unsigned Scene::_hiddenRays( const TiXmlElement* node ) const
+{
+	static const std::pair<const char*,unsigned> kinds[] = {
+		{ "camera" , RAY_CAMERA } , { "shadow" , RAY_SHADOW } , { "diffuse" , RAY_DIFFUSE } , { "glossy" , RAY_GLOSSY }
+	};
+	unsigned hidden = 0;
+	for( const auto& kind : kinds )
+	{
+		const char* value = node ? node->Attribute( kind.first ) : nullptr;
+		if( value && atoi( value ) == 0 )
+			hidden |= kind.second;
+	}
+	return hidden;
+}
+
+// record a file the scene is loaded from
+void Scene::_addSource( const string& str , SourceKind kind )
+{
+	SourceFile source;
+	source.name = str;
+	source.kind = kind;
+	source.time = 0;
+	source.size = 0;
+
+	_statSource( str , source.time , source.size );
+	m_sources.push_back( source );
+}
+
+
+// whether the scene is still the same as the one in the files
+bool Scene::IsUpToDate( const string& str ) const
+{
+	if( m_filename.empty() || m_filename != str )
+		return false;
+
+	// the cameras could have moved so far that another level of detail is picked
+	for( const auto& lod : m_lodModels )
+		if( _pickLod( lod ) != lod.level )
+			return false;
+
+	for( const auto& source : m_sources )
+		if( _sourceChanged( source.name , source.time , source.size ) )
+			return false;
+	return true;
 }
 
 // generate triangle buffer
@@ -258,6 +1331,21 @@ void Scene::_generateTriBuf()
 		(*it)->FillTriBuf( m_triBuf );
 		it++;
 	}
+
+	// the segments of the curves follow the triangles
+	for( auto curves : m_curveBuf )
+		curves->FillTriBuf( m_triBuf );
+}
+
+// check whether anything in the scene moves
+void Scene::_checkMotion()
+{
+	bool motion = false;
+	for( auto mesh : m_meshBuf )
+		motion |= mesh->m_bMoving;
+	for( auto light : m_lights )
+		motion |= light->IsMoving();
+	m_hasMotion = motion;
 }
 
 // output log information
@@ -266,19 +1354,212 @@ void Scene::OutputLog() const
     slog( INFO , GENERAL , stringFormat("Triangle number is %d." , m_triBuf.size() ) );
 	if( m_pAccelerator )
 		m_pAccelerator->OutputLog();
+	m_meshPager.OutputLog();
+	m_subdivCache.OutputLog();
+}
+
+// add the scene and the acceleration structure to the report
+void Scene::CollectStats( StatsReport& report ) const
+{
+	report.Group( "scene" ).Add( "file" , m_filename ).Add( "meshes" , (unsigned)m_meshBuf.size() ).Add( "curves" , (unsigned)m_curveBuf.size() ).Add( "primitives" , (unsigned)m_triBuf.size() )
+		.Add( "lights" , (unsigned)m_lights.size() ).Add( "motion" , m_hasMotion );
+	m_subdivCache.CollectStats( report.Group( "subdivision" ) );
+
+	if( m_pAccelerator == nullptr )
+		return;
+	StatsGroup& accel = report.Group( "accelerator" );
+	m_pAccelerator->CollectStats( accel );
+	accel.Add( "memory_bytes" , (unsigned long long)m_pAccelerator->GetMemoryUsage() );
+#if SORT_ACCEL_STATS
+	const AccelStats total = AccelStats::Total();
+	accel.Add( "traversal_rays" , total.rays ).Add( "traversal_nodes" , total.nodes ).Add( "traversal_primitives" , total.primitives ).Add( "traversal_early_outs" , total.earlyOuts );
+#endif
 }
 
 // preprocess
 void Scene::PreProcess()
 {
+	// the scene of the last rendering is kept , only the structures of the models moved since are built again
+	if( m_preprocessed )
+	{
+		if( !m_movedMeshes.empty() )
+			_rebuildMoved();
+		return;
+	}
+	m_preprocessed = true;
+	m_movedMeshes.clear();
+	m_deformedMeshes.clear();
+	SORT_PROFILE( "Scene::PreProcess" );
+
+	// meshes are prepared independently , the micromaps of cut out triangles are baked before the bottom level acceleration
+	// structure of the mesh packs them , the structures of many meshes are built at the same time in the thread pool
+	const unsigned mesh_cnt = (unsigned)m_meshBuf.size();
+	vector<unsigned> cutout_cnt( mesh_cnt , 0 );
+	ParallelFor( 0 , mesh_cnt , 1 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; ++i )
+		{
+			SORT_PROFILE_ARG( "PrepareMesh" , i );
+			cutout_cnt[i] = m_meshBuf[i]->BakeMicromaps();
+			m_meshBuf[i]->BuildBlas();
+		}
+	});
+
+	unsigned cutouts = 0;
+	size_t micromap_bytes = 0;
+	for( unsigned i = 0 ; i < mesh_cnt ; ++i )
+	{
+		cutouts += cutout_cnt[i];
+		micromap_bytes += m_meshBuf[i]->m_MicromapMemory.Get();
+	}
+	m_hasCutouts = cutouts > 0;
+	if( m_hasCutouts )
+		slog( INFO , GENERAL , stringFormat( "%d triangles are cut out by the opacity of their materials , their micromaps take %.2f KB." , cutouts , micromap_bytes / 1024.0f ) );
+
 	// set uniform grid as acceleration structure as default
 	if( m_pAccelerator )
 	{
+		SORT_PROFILE( "Accelerator::Build" );
 		m_pAccelerator->SetPrimitives( &m_triBuf );
-		m_pAccelerator->Build();
+
+		// the structure built by another process rendering the same scene on the host is mapped if there is one
+		const bool shared = SMManager::GetSingleton().IsSceneSharing();
+		const unsigned long long key = ( m_accelCache || shared ) ? AccelCache::Key( m_triBuf , m_accelParams ) : 0;
+		if( !shared || !AccelCache::LoadShared( key , m_pAccelerator ) )
+		{
+			// load the acceleration structure from the cache next to the scene file if it is still valid
+			if( m_accelCache )
+			{
+				const string cache_file = m_filename + ".accel";
+				if( !AccelCache::Load( cache_file , key , m_pAccelerator ) )
+				{
+					m_pAccelerator->Build();
+					AccelCache::Save( cache_file , key , m_pAccelerator );
+				}
+			}
+			else
+				m_pAccelerator->Build();
+
+			if( shared )
+				AccelCache::SaveShared( key , m_pAccelerator );
+		}
+
+		if( m_accelReorder )
+			_reorderPrimitives();
+
+#if SORT_USE_CUDA
+		// the structure is flattened and uploaded once , only static triangles and analytic shapes in a binary BVH could be traced on the GPU
+		if( m_accelGpu )
+		{
+			m_gpuTree = new GpuTree();
+			m_gpuQuery = new GpuRayQuery();
+			if( m_pAccelerator->ExportGpuTree( *m_gpuTree ) && m_gpuQuery->Upload( *m_gpuTree ) ){
+				slog( INFO , SPATIAL_ACCELERATOR , stringFormat( "Streams of rays are traced on the GPU , the tree takes %.2f MB on the device." , m_gpuQuery->GetMemoryUsage() / ( 1024.0f * 1024.0f ) ) );
+			}else{
+				slog( WARNING , SPATIAL_ACCELERATOR , "The acceleration structure can't be traced on the GPU , rays are traced on the CPU." );
+				SAFE_DELETE( m_gpuQuery );
+				SAFE_DELETE( m_gpuTree );
+			}
+		}
+#endif
+	}
+
+	// the index data of triangles is not touched anymore , it is compacted once corners refer to unified vertexes
+	vector<TriMesh*>::iterator it = m_meshBuf.begin();
+	while( it != m_meshBuf.end() )
+	{
+		(*it)->CompactIndices( m_triBuf );
+		it++;
+	}
+
+	// the buffers of meshes are final now , processes rendering the same scene on the host keep one copy of them
+	if( SMManager::GetSingleton().IsSceneSharing() )
+	{
+		for( auto mesh : m_meshBuf )
+			mesh->ShareBuffers( m_triBuf );
+	}
+
+	if( m_pAccelerator )
+		m_accelMemory.Set( m_pAccelerator->GetMemoryUsage() );
+
+	// the shading buffers are final now , they are paged in again by the hits on the meshes
+	if( m_meshPager.IsEnabled() )
+	{
+		for( auto mesh : m_meshBuf )
+		{
+			if( !mesh->m_bInstanced )
+				m_meshPager.AddPage( mesh->m_pMemory.get() );
+		}
+		m_meshPager.Trim();
 	}
 }
 
+// reorder the data of triangles
+void Scene::_reorderPrimitives()
+{
+	vector<unsigned> order;
+	if( !m_pAccelerator->GetPrimitiveOrder( order ) )
+	{
+		slog( WARNING , SPATIAL_ACCELERATOR , "The acceleration structure doesn't report the order of primitives, they are not reordered." );
+		return;
+	}
+
+	// primitives not referenced by any leaf are placed after the others
+	vector<unsigned> rank( m_triBuf.size() , ~0u );
+	for( unsigned i = 0 ; i < (unsigned)order.size() ; i++ )
+		rank[order[i]] = i;
+
+	vector<TriMesh*>::iterator it = m_meshBuf.begin();
+	while( it != m_meshBuf.end() )
+	{
+		(*it)->ReorderTriangles( m_triBuf , rank , m_accelReorder == 2 );
+		it++;
+	}
+}
+
+// get the file of a model at the level of detail picked for the cameras
+string Scene::_modelFile( const TiXmlElement* node , LodModel* lod )
+{
+	const TiXmlElement* lod_node = node->FirstChildElement( "Lod" );
+	if( lod_node == nullptr )
+		return node->Attribute( "filename" );
+
+	// the coarser levels are listed by the distance they are used from , the model itself is the finest level
+	LodModel model;
+	model.origin = _parseTransform( node->FirstChildElement( "Transform" ) )( Point( 0.0f , 0.0f , 0.0f ) );
+	vector<string> files( 1 , node->Attribute( "filename" ) );
+	for( ; lod_node ; lod_node = lod_node->NextSiblingElement( "Lod" ) )
+	{
+		const char* filename = lod_node->Attribute( "filename" );
+		const char* distance = lod_node->Attribute( "distance" );
+		if( filename == 0 || distance == 0 )
+		{
+			slog( WARNING , GENERAL , stringFormat( "A level of detail of model %s without a file or a distance is skipped." , node->Attribute( "name" ) ? node->Attribute( "name" ) : "" ) );
+			continue;
+		}
+		files.push_back( filename );
+		model.distances.push_back( (float)atof( distance ) );
+	}
+	model.level = _pickLod( model );
+	if( lod )
+		*lod = model;
+	return files[model.level];
+}
+
+// pick the level of detail of a model
+unsigned Scene::_pickLod( const LodModel& lod ) const
+{
+	if( m_viewpoints.empty() )
+		return 0;
+	float distance = FLT_MAX;
+	for( const auto& eye : m_viewpoints )
+		distance = min( distance , Distance( eye , lod.origin ) );
+
+	unsigned level = 0;
+	while( level < (unsigned)lod.distances.size() && distance >= lod.distances[level] )
+		++level;
+	return level;
+}
+
 // parse transformation
 Transform Scene::_parseTransform( const TiXmlElement* node )
 {
@@ -333,6 +1614,33 @@ void Scene::_genLightDistribution()
 	SAFE_DELETE(m_pLightsDis);
 	m_pLightsDis = new Distribution1D( pdf , count );
 	delete[] pdf;
+
+	// build the light tree over lights with bounded emission
+	vector<const Light*> bounded;
+	vector<LightBounds> bounds;
+	vector<float> unbounded_pdf;
+	m_unboundedLights.clear();
+	m_unboundedPower = 0.0f;
+	for( unsigned i = 0 ; i < count ; i++ )
+	{
+		LightBounds b;
+		if( m_lights[i]->GetBounds( b ) )
+		{
+			bounded.push_back( m_lights[i] );
+			bounds.push_back( b );
+		}
+		else
+		{
+			m_unboundedLights.push_back( m_lights[i] );
+			unbounded_pdf.push_back( m_lights[i]->Power().GetIntensity() );
+			m_unboundedPower += unbounded_pdf.back();
+		}
+	}
+	m_lightTree.Build( bounded , bounds );
+	SAFE_DELETE(m_pUnboundedDis);
+	if( !m_unboundedLights.empty() )
+		m_pUnboundedDis = new Distribution1D( &unbounded_pdf[0] , (unsigned)unbounded_pdf.size() );
+	slog( DEBUG , LIGHT , stringFormat( "Light tree is built over %d lights with %d nodes, %d lights are picked by power." , (int)bounded.size() , m_lightTree.GetNodeCount() , (int)m_unboundedLights.size() ) );
 }
 
 // get sampled light
@@ -351,6 +1659,35 @@ const Light* Scene::SampleLight( float u , float* pdf ) const
 	return 0;
 }
 
+// get sampled light for a shading point
+const Light* Scene::SampleLight( float u , const Intersection& intersect , float* pdf ) const
+{
+	sAssert( u >= 0.0f && u <= 1.0f , SAMPLING );
+	if( pdf ) *pdf = 0.0f;
+	if( m_lightTree.IsEmpty() )
+		return SampleLight( u , pdf );
+
+	// pick the light tree or the unbounded lights by their power first , the random variable is remapped
+	const float tree_power = m_lightTree.GetPower();
+	const float p_tree = tree_power / ( tree_power + m_unboundedPower );
+	if( u < p_tree || m_pUnboundedDis == 0 )
+	{
+		float _pdf;
+		const Light* light = m_lightTree.Sample( min( u / p_tree , 0.99999994f ) , intersect.intersect , intersect.normal , &_pdf );
+		if( light && pdf ) *pdf = _pdf * p_tree;
+		return light;
+	}
+
+	float _pdf;
+	int id = m_pUnboundedDis->SampleDiscrete( min( ( u - p_tree ) / ( 1.0f - p_tree ) , 0.99999994f ) , &_pdf );
+	if( id >= 0 && id < (int)m_unboundedLights.size() && _pdf != 0.0f )
+	{
+		if( pdf ) *pdf = _pdf * ( 1.0f - p_tree );
+		return m_unboundedLights[id];
+	}
+	return 0;
+}
+
 // get light sample property
 float Scene::LightProperbility( unsigned i ) const
 {
@@ -382,3 +1719,16 @@ Spectrum Scene::Le( const Ray& ray ) const
 	}
 	return 0.0f;
 }
+
+// evaluate the sky along a stream of rays
+void Scene::Le( const Ray* rays , Spectrum* radiance , unsigned count ) const
+{
+	if( !m_skyLight )
+	{
+		for( unsigned i = 0 ; i < count ; ++i )
+			radiance[i] = 0.0f;
+		return;
+	}
+	for( unsigned i = 0 ; i < count ; ++i )
+		m_skyLight->Le( rays[i] , 0 , radiance[i] );
+}
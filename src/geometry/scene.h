@@ -21,14 +21,25 @@
 // include the header file
 #include "sort.h"
 #include <vector>
+#include <unordered_map>
 #include "trimesh.h"
 #include "spectrum/spectrum.h"
 #include "thirdparty/tinyxml/tinyxml.h"
+#include "utility/memstats.h"
+#include "managers/meshpager.h"
+#include "managers/subdivcache.h"
+#include "light/lighttree.h"
 
 // pre-decleration of classes
 class Accelerator;
 class Light;
+class CurveSet;
 class Distribution1D;
+class StatsReport;
+class GpuRayQuery;
+struct GpuTree;
+class Medium;
+struct Primary_Hit;
 
 ////////////////////////////////////////////////////////////////////////////
 // definition of scene class
@@ -53,13 +64,98 @@ public:
 	//			  of the triangles which will cost much!
 	bool	GetIntersect( const Ray& r , Intersection* intersect ) const;
 
+	// get the intersection of a camera ray whose first hit is found by the raster pass
+	// para 'r'         : the camera ray
+	// para 'hit'       : the first hit of the ray
+	// para 'intersect' : the intersection information between the ray and the scene
+	// result           : false if the ray misses the scene
+	bool	GetPrimaryIntersect( const Ray& r , const Primary_Hit& hit , Intersection* intersect ) const;
+
+	// find the first hits of a stream of camera rays without resolving them , they are resolved by 'GetPrimaryIntersect' later
+	// para 'rays'  : the camera rays
+	// para 'hits'  : the first hit of each ray
+	// para 'count' : the number of rays
+	void	GetPrimaryHits( const Ray* rays , Primary_Hit* hits , unsigned count ) const;
+
+	// get the intersections between a stream of rays and the scene
+	// para 'rays'       : the rays , coherent rays are traversed together
+	// para 'intersects' : the intersection information of each ray
+	// para 'results'    : whether each ray hits the scene
+	// para 'count'      : the number of rays
+	void	GetIntersect( const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const;
+
+	// whether the ray is blocked by anything in the scene
+	// para 'r' : the ray
+	// result   : true if there is any intersection between the ray and the scene
+	// note     : it is the query for shadow rays , it stops at the first
+	//			  intersection found without filling any information.
+	bool	IsOccluded( const Ray& r ) const;
+
+	// whether each ray in a stream is blocked by anything in the scene
+	// para 'rays'    : the shadow rays
+	// para 'results' : whether each ray is blocked
+	// para 'count'   : the number of rays
+	void	IsOccluded( const Ray* rays , bool* results , unsigned count ) const;
+
+	// start intersecting a stream of rays , the results are only valid after 'WaitStream' with the same slot
+	// para 'slot'       : 0 or 1 , each thread could have one stream in flight in each slot
+	// para 'rays'       : the rays , they have to be kept alive until the stream is waited for
+	// para 'intersects' : the intersection information of each ray
+	// para 'results'    : whether each ray hits the scene
+	// para 'count'      : the number of rays
+	// note              : the stream is traced on the GPU if it is enabled , otherwise it is done before returning
+	void	SubmitIntersect( unsigned slot , const Ray* rays , Intersection* intersects , bool* results , unsigned count ) const;
+
+	// start testing whether each ray in a stream is blocked , the results are only valid after 'WaitStream' with the same slot
+	// para 'slot'    : 0 or 1 , each thread could have one stream in flight in each slot
+	// para 'rays'    : the shadow rays , they have to be kept alive until the stream is waited for
+	// para 'results' : whether each ray is blocked
+	// para 'count'   : the number of rays
+	void	SubmitOccluded( unsigned slot , const Ray* rays , bool* results , unsigned count ) const;
+
+	// wait for the stream submitted to a slot , the hits of intersected streams are resolved here
+	// para 'slot' : the slot that the stream is submitted to
+	void	WaitStream( unsigned slot ) const;
+
+	// whether streams are traced asynchronously , it is worth splitting a stream so that tracing one part overlaps shading the other one
+	bool	IsStreamAsync() const { return m_gpuQuery != 0; }
+
 	// release the memory of the scene
 	void	Release();
 
+	// set the positions of the cameras , models with levels of detail pick them by the distance to the closest one
+	// para 'eyes' : the positions of the cameras
+	// note        : it has to be set before the scene is loaded , a loaded scene is out of date if any model would pick another level
+	void	SetViewpoints( const vector<Point>& eyes ) { m_viewpoints = eyes; }
+
+	// whether the scene is still the same as the one in the files
+	// para 'str' : the full name of the scene file
+	// result     : 'true' if the scene is loaded from the file and neither it nor the material and model files it refers to changed since
+	bool	IsUpToDate( const string& str ) const;
+
+	// update the scene after its files are edited , only the lights and the materials that changed are parsed again
+	// para 'str' : the full name of the scene file , it could be another file , e.g. the next frame of an animation
+	// result     : 'true' if the scene is updated , 'false' if the geometry or an area light changed and it has to be loaded again
+	// note       : the primitives are kept as they are , models could only move or have their vertexes deformed , the
+	//			    acceleration structures of the moved ones and the top level one are built again by 'PreProcess'
+	bool	Update( const string& str );
+
+	// read the files of another scene ahead in the background , e.g. the next frame of an animation
+	// para 'str' : the full name of the scene file
+	void	Prefetch( const string& str );
+
 	// output log information
 	void	OutputLog() const;
 
+	// add the scene and the acceleration structure to the statistics report
+	// para 'report' : the statistics report
+	void	CollectStats( StatsReport& report ) const;
+
 	// preprocess
+	// note     : with the 'cache' attribute of the 'Accel' node set to '1' , the acceleration
+	//			  structure is loaded from the file '<scene>.accel' if the geometry is unchanged.
+	//			  with the 'reorder' attribute set to '1' , the index data of triangles is reordered
+	//			  to match the order of leaves afterward , '2' renumbers the vertex data too.
 	void	PreProcess();
 
 	// get light
@@ -76,6 +172,10 @@ public:
 	{return m_skyLight;}
 	// get sampled light
 	const Light* SampleLight( float u , float* pdf ) const;
+	// get sampled light for a shading point , lights are picked with the light tree
+	// note     : bounded lights are picked by their importance to the point , the others by their power.
+	//			  it falls back to picking by power if there is no bounded light.
+	const Light* SampleLight( float u , const Intersection& intersect , float* pdf ) const;
 	// get the properbility of the sample
 	float LightProperbility( unsigned i ) const;
 	// get the number of lights
@@ -85,6 +185,12 @@ public:
 	const BBox& GetBBox() const;
 	// get triangle mesh with a specific name
 	TriMesh*	GetTriMesh( const string& name ) const;
+	// get the primitives of the scene
+	// note     : other acceleration structures could be built over them after preprocessing
+	vector<Primitive*>& GetPrimitives()
+	{ return m_triBuf; }
+	const vector<Primitive*>& GetPrimitives() const
+	{ return m_triBuf; }
 
 	// get file name
 	const string& GetFileName() const
@@ -92,11 +198,39 @@ public:
 
 	// evalute sky
 	Spectrum	Le( const Ray& ray ) const;
+	// evaluate the sky along a stream of rays
+	// para 'rays'     : the rays
+	// para 'radiance' : the radiance of the sky along each ray
+	// para 'count'    : the number of rays
+	void		Le( const Ray* rays , Spectrum* radiance , unsigned count ) const;
+
+	// whether any mesh or light moves in the shutter interval
+	bool	HasMotion() const
+	{ return m_hasMotion; }
+
+	// a number unique to every loading of the scene , the primitives are the same as long as it is
+	unsigned long long	GetVersion() const
+	{ return m_version; }
+
+	// whether there is any participating medium in the scene
+	bool	HasMedia() const
+	{ return !m_media.empty(); }
+	// get the medium the cameras are in , it is null if they are in vacuum
+	const Medium*	GetAmbientMedium() const
+	{ return m_ambientMedium; }
+	// the transmittance along a shadow ray
+	// para 'r'      : the shadow ray , its direction is normalized
+	// para 'medium' : the medium the ray starts in
+	// result        : the fraction of light reaching the end of the ray , surfaces only bounding media are passed through
+	//				   and any other surface blocks the ray
+	Spectrum	Transmittance( const Ray& r , const Medium* medium ) const;
 
 // private field
 private:
 	// the buffer for the triangle mesh
 	vector<TriMesh*>	m_meshBuf;
+	// the curves of hair and fur
+	vector<CurveSet*>	m_curveBuf;
 
 	// the triangle buffer for the scene
 	vector<Primitive*>	m_triBuf;
@@ -105,15 +239,91 @@ private:
 	vector<Light*>		m_lights;
 	// distribution of light power
 	Distribution1D*		m_pLightsDis;
+	// the light tree of lights with bounded emission
+	LightTree			m_lightTree;
+	// lights with unbounded emission , they are picked by their power
+	vector<const Light*>	m_unboundedLights;
+	// distribution of power of unbounded lights
+	Distribution1D*		m_pUnboundedDis;
+	// the total power of unbounded lights
+	float				m_unboundedPower;
 	// the sky light
 	Light*				m_skyLight;
 
 	// the acceleration structure for the scene
 	Accelerator*		m_pAccelerator;
+	// the memory taken by the acceleration structure
+	MemoryTracker		m_accelMemory{ MEM_ACCELERATOR };
+	// whether the acceleration structure is cached on disk
+	bool				m_accelCache;
+	// the type and the properties of the acceleration structure
+	string				m_accelParams;
+	// how the primitive data is reordered after the acceleration structure is built , 0 disables it
+	unsigned			m_accelReorder;
+	// whether streams of rays are traced on the GPU
+	bool				m_accelGpu;
+	// the acceleration structure flattened for the GPU and the queries running on it , they are null unless the GPU is used
+	GpuTree*			m_gpuTree;
+	GpuRayQuery*		m_gpuQuery;
+
+	// the pager of the shading buffers of meshes , it is only enabled for scenes larger than the memory
+	MeshPager			m_meshPager;
+	// the cache of the tessellated patches of subdivision surfaces
+	SubdivCache			m_subdivCache;
 
 	// the file name for the scene
 	string		m_filename;
 
+	// the files the scene is loaded from , with their modification time and size at loading
+	enum SourceKind{ SOURCE_SCENE , SOURCE_MATERIAL , SOURCE_MODEL };
+	struct SourceFile{
+		string				name;
+		SourceKind			kind;
+		long long			time;
+		unsigned long long	size;
+	};
+	vector<SourceFile>	m_sources;
+	// the text of everything in the scene file except the lights , the geometry is unchanged if it is the same
+	string				m_geometryText;
+	// the same text without the placement and the files of the models , the models could only move or deform if it is the same
+	string				m_layoutText;
+	// the text of each model in the scene file by its name
+	std::unordered_map<string,string>	m_modelTexts;
+	// the meshes moved or deformed by the last update and the deformed ones among them , they are refitted by the preprocessing
+	vector<TriMesh*>	m_movedMeshes;
+	vector<TriMesh*>	m_deformedMeshes;
+	// the text of each light in the scene file and the light created by it , it is null if the light is invalid
+	struct LightSource{
+		string				text;
+		Light*				light;
+	};
+	vector<LightSource>	m_lightSources;
+	// the bit of each light linking set , lights and models refer to the sets by their names
+	std::unordered_map<string,unsigned>	m_linkSets;
+	// the positions of the cameras
+	vector<Point>		m_viewpoints;
+	// a model with levels of detail , only the file of the picked level is loaded
+	struct LodModel{
+		Point				origin;		// the origin of the model in world space
+		vector<float>		distances;	// the distance to the cameras from which each coarser level is used
+		unsigned			level;		// the picked level , zero is the file of the model itself
+	};
+	vector<LodModel>	m_lodModels;
+	// the participating media , models refer to them by their names
+	std::unordered_map<string,Medium*>	m_media;
+	// the medium the cameras are in
+	const Medium*		m_ambientMedium;
+	// whether any material of the scene needs tangents , they are only generated while loading
+	bool				m_needsTangent;
+	// whether any triangle is cut out by the opacity of its material , the micromaps are only baked while loading
+	bool				m_hasCutouts;
+	// the scene is pre-processed only once , it could be rendered many times afterward
+	bool		m_preprocessed;
+	// whether any mesh or light moves in the shutter interval , the samples only have times if it is true
+	bool		m_hasMotion;
+	// the number unique to the loading of the scene , updated lights and materials keep it
+	unsigned long long	m_version;
+
 	// bounding box for the scene
 	mutable BBox	m_BBox;
 
@@ -124,17 +334,79 @@ private:
 	// result   : the intersection information between the ray and the scene
 	bool	_bfIntersect( const Ray& r , Intersection* intersect ) const;
 
+	// fill the shading information of the closest hits of a stream
+	// para 'rays'       : the rays
+	// para 'intersects' : the recorded hits of the rays
+	// para 'results'    : whether each ray hits the scene
+	// para 'count'      : the number of rays
+	void	_resolveHits( const Ray* rays , Intersection* intersects , const bool* results , unsigned count ) const;
+
 	// generate triangle buffer
 	void	_generateTriBuf();
 
+	// check whether anything in the scene moves , it is called whenever the meshes or the lights are created
+	void	_checkMotion();
+
 	// initialize default data
 	void	_init();
 
+	// record a file the scene is loaded from
+	// para 'str'  : the full name of the file
+	// para 'kind' : what the file holds
+	void	_addSource( const string& str , SourceKind kind );
+
+	// create a light from its node in the scene file
+	// para 'node' : the node of the light
+	// result      : the light , it is null if the type is unknown
+	Light*	_createLight( const TiXmlElement* node );
+
+	// create a participating medium from its node in the scene file
+	// para 'node' : the node of the medium
+	// result      : the medium , it is null if the type is unknown
+	Medium*	_createMedium( const TiXmlElement* node );
+	// find a participating medium by its name
+	// para 'name' : the name of the medium , it could be null
+	// result      : the medium , it is null if there is no such medium
+	const Medium*	_findMedium( const char* name ) const;
+
+	// get the bits of light linking sets , a bit is assigned to a set the first time its name shows up
+	// para 'names' : the names of the sets separated by spaces
+	// result      : one bit for each set
+	unsigned	_linkSets( const string& names );
+
+	// get the kinds of rays a model is hidden from , a kind is hidden if its attribute is 0
+	// para 'node' : the visibility node of the model , it could be null
+	// result      : one bit of RAY_TYPE for each hidden kind
+	unsigned	_hiddenRays( const TiXmlElement* node ) const;
+
 	// parse transformation
 	Transform	_parseTransform( const TiXmlElement* node );
 
+	// get the file of a model at the level of detail picked for the cameras
+	// para 'node' : the node of the model
+	// para 'lod'  : the levels of detail of the model ( output ) , it is left untouched if the model has none
+	// result      : the file of the model to be loaded
+	string		_modelFile( const TiXmlElement* node , LodModel* lod );
+	// pick the level of detail of a model , the finest level any camera needs is picked
+	// para 'lod' : the levels of detail of the model
+	unsigned	_pickLod( const LodModel& lod ) const;
+
 	// compute light cdf
 	void	_genLightDistribution();
+
+	// read the material libraries , the models and the curves of the scene ahead in the background
+	// para 'root' : the root of the scene file
+	void	_prefetchFiles( const TiXmlNode* root );
+
+	// move or deform the models as the scene file and the model files say
+	// para 'root' : the root of the scene file
+	// result      : false if anything else of the geometry changed , the scene has to be loaded again then
+	bool	_updateModels( const TiXmlNode* root );
+	// build the acceleration structures again after the models moved or deformed
+	void	_rebuildMoved();
+
+	// reorder the data of triangles in the order they are referenced by the leaves of the acceleration structure
+	void	_reorderPrimitives();
 };
 
 #endif
@@ -0,0 +1,37 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include the header
+#include "sky.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+
+// the largest faces of cube maps derived from the source data
+static const unsigned SKY_MAX_CUBE_SIZE = 1024;
+
+// prepare the sky for rendering
+void Sky::Prepare()
+{
+	m_cube.Release();
+	if( m_cubeSize == 0 )
+		return;
+
+	const unsigned size = ( m_cubeSize > 0 ) ? (unsigned)m_cubeSize : min( max( _cubeSize() , 8u ) , SKY_MAX_CUBE_SIZE );
+	m_cube.Build( [this]( const Vector& r ){ return _evaluate( r ); } , size );
+	slog( INFO , LIGHT , stringFormat( "Sky is resampled to a cube map with %d texels along the edges of the faces." , m_cube.GetSize() ) );
+}
@@ -23,6 +23,7 @@
 #include "utility/propertyset.h"
 #include "math/vector3.h"
 #include "math/transform.h"
+#include "skycubemap.h"
 
 class Point;
 
@@ -37,14 +38,22 @@ class	Sky : public PropertySet<Sky>
 // public method
 public:
 	// default constructor
-	Sky(){}
+	Sky(){ _registerProperty( "cube_size" , new CubeSizeProperty(this) ); }
 	// destructor
 	virtual ~Sky(){}
 
 	// evaluate value from sky
-	// para 'r' : the ray which misses all of the triangle in the scene
-	// result   : the spectrum in the sky
-	virtual Spectrum Evaluate( const Vector& r ) const = 0;
+	// para 'r'      : the ray which misses all of the triangle in the scene
+	// para 'spread' : the angle spanned by the footprint of the ray , the sky is filtered over it
+	// result        : the spectrum in the sky , it is looked up in the cube map once the sky is prepared
+	Spectrum Evaluate( const Vector& r , float spread = 0.0f ) const
+	{
+		const Vector local = m_transform.invMatrix( r );
+		return m_cube.IsValid() ? m_cube.Lookup( local , spread ) : _evaluate( local );
+	}
+
+	// prepare the sky for rendering , the sky is resampled to the cube map once all properties are set
+	void Prepare();
 
 	// get the average radiance
 	virtual Spectrum GetAverage() const = 0;
@@ -62,6 +71,33 @@ public:
 
 protected:
 	Transform m_transform;
+
+	// the sky resampled to the faces of a cube
+	SkyCubeMap	m_cube;
+	// the size of the faces of the cube map , it is derived from the sky if it is negative and zero disables the cube map
+	int			m_cubeSize = -1;
+
+	// evaluate the sky from its source data
+	// para 'r' : the direction in the space of the sky
+	// result   : the spectrum in the sky
+	virtual Spectrum _evaluate( const Vector& r ) const = 0;
+
+	// the size of the faces of the cube map matching the resolution of the source data
+	virtual unsigned _cubeSize() const = 0;
+
+// property handler
+	class CubeSizeProperty : public PropertyHandler<Sky>
+	{
+	public:
+		PH_CONSTRUCTOR(CubeSizeProperty,Sky);
+
+		// set value
+		void SetValue( const string& str )
+		{
+			Sky* sky = CAST_TARGET(Sky);
+			sky->m_cubeSize = atoi( str.c_str() );
+		}
+	};
 };
 
 #endif
\ No newline at end of file
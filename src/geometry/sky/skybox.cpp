@@ -40,8 +40,8 @@ void SkyBox::_release()
 {
 }
 
-// evaluate value from sky
-Spectrum SkyBox::Evaluate( const Vector& vec ) const
+// evaluate the sky from the images
+Spectrum SkyBox::_evaluate( const Vector& vec ) const
 {
 	float abs_x = fabs( vec.x );
 	float abs_y = fabs( vec.y );
@@ -94,6 +94,13 @@ Spectrum SkyBox::Evaluate( const Vector& vec ) const
 	return Spectrum();
 }
 
+// the size of the faces of the cube map
+unsigned SkyBox::_cubeSize() const
+{
+	return max( max( max( m_up.GetWidth() , m_down.GetWidth() ) , max( m_front.GetWidth() , m_back.GetWidth() ) ) ,
+				max( m_left.GetWidth() , m_right.GetWidth() ) );
+}
+
 // register property
 void SkyBox::_registerAllProperty()
 {
@@ -37,11 +37,6 @@ public:
 	// destructor
 	~SkyBox(){_release();}
 
-	// evaluate value from sky
-	// para 'r' : the ray which misses all of the triangle in the scene
-	// result   : the spectrum in the sky
-	virtual Spectrum Evaluate( const Vector& r ) const;
-
 	// get the average radiance
 	virtual Spectrum GetAverage() const;
 
@@ -61,6 +56,11 @@ private:
 	ImageTexture	m_left;
 	ImageTexture	m_right;
 
+	// evaluate the sky from the images
+	Spectrum _evaluate( const Vector& r ) const;
+	// the size of the faces of the cube map , it is the size of the largest image
+	unsigned _cubeSize() const;
+
 	// initialize
 	void _init();
 	// release
@@ -0,0 +1,186 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include the header
+#include "skycubemap.h"
+#include "math/simd/simd.h"
+#include "utility/define.h"
+#include "utility/multithread/threadpool.h"
+#include <math.h>
+
+// the number of texels in a face with 'n' texels along its edges
+static inline size_t _faceTexels( unsigned n )
+{
+	return (size_t)n * n;
+}
+
+// build the cube map
+void SkyCubeMap::Build( const std::function<Spectrum(const Vector&)>& radiance , unsigned size )
+{
+	Release();
+
+	m_size = 1;
+	while( m_size < size )
+		m_size <<= 1;
+
+	// every texel of the finest level averages four samples of the sky
+	const unsigned n = m_size;
+	m_levels.push_back( std::vector<float>( 6 * _faceTexels( n ) * 4 ) );
+	float* texels = m_levels[0].data();
+	ParallelFor( 0 , 6 * n , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned row = _start ; row < _end ; ++row )
+		{
+			const unsigned face = row / n;
+			const unsigned y = row % n;
+			for( unsigned x = 0 ; x < n ; ++x )
+			{
+				Spectrum c;
+				for( unsigned k = 0 ; k < 4 ; ++k )
+				{
+					const float s = ( x + 0.25f + 0.5f * ( k & 1 ) ) / n * 2.0f - 1.0f;
+					const float t = ( y + 0.25f + 0.5f * ( k >> 1 ) ) / n * 2.0f - 1.0f;
+					c += radiance( Normalize( _direction( face , s , t ) ) );
+				}
+				float* texel = texels + ( (size_t)row * n + x ) * 4;
+				texel[0] = c.GetR() * 0.25f;
+				texel[1] = c.GetG() * 0.25f;
+				texel[2] = c.GetB() * 0.25f;
+				texel[3] = 0.0f;
+			}
+		}
+	});
+
+	// the coarser levels average the texels of the finer ones
+	size_t bytes = m_levels[0].size() * sizeof( float );
+	for( unsigned fine = n ; fine > 1 ; fine >>= 1 )
+	{
+		const unsigned coarse = fine >> 1;
+		const std::vector<float>& src = m_levels.back();
+		std::vector<float> dst( 6 * _faceTexels( coarse ) * 4 );
+		for( unsigned face = 0 ; face < 6 ; ++face )
+			for( unsigned y = 0 ; y < coarse ; ++y )
+				for( unsigned x = 0 ; x < coarse ; ++x )
+				{
+					const float* p = src.data() + ( face * _faceTexels( fine ) + (size_t)( 2 * y ) * fine + 2 * x ) * 4;
+					float* q = dst.data() + ( face * _faceTexels( coarse ) + (size_t)y * coarse + x ) * 4;
+					for( unsigned c = 0 ; c < 4 ; ++c )
+						q[c] = 0.25f * ( p[c] + p[4+c] + p[fine*4+c] + p[fine*4+4+c] );
+				}
+		bytes += dst.size() * sizeof( float );
+		m_levels.push_back( std::move( dst ) );
+	}
+	m_memory.Set( bytes );
+}
+
+// release the texels
+void SkyCubeMap::Release()
+{
+	m_levels.clear();
+	m_size = 0;
+	m_memory.Set( 0 );
+}
+
+// get the radiance along a direction
+Spectrum SkyCubeMap::Lookup( const Vector& dir , float spread ) const
+{
+	unsigned face;
+	float s , t;
+	_project( dir , face , s , t );
+
+	// a texel of the finest level spans about half of pi over the size of the faces
+	const float level = ( spread > 0.0f ) ? log2f( spread * m_size * 2.0f * INV_PI ) : 0.0f;
+	if( level <= 0.0f )
+	{
+		const unsigned x = min( (unsigned)( ( s + 1.0f ) * 0.5f * m_size ) , m_size - 1 );
+		const unsigned y = min( (unsigned)( ( t + 1.0f ) * 0.5f * m_size ) , m_size - 1 );
+		const float* texel = m_levels[0].data() + ( face * _faceTexels( m_size ) + (size_t)y * m_size + x ) * 4;
+		return Spectrum( texel[0] , texel[1] , texel[2] );
+	}
+
+	// bilinear filtering of a level , the texels are blended as registers of four lanes
+	auto bilinear = [&]( unsigned l ){
+		const unsigned n = m_size >> l;
+		const float fx = clamp( ( s + 1.0f ) * 0.5f * n - 0.5f , 0.0f , (float)( n - 1 ) );
+		const float fy = clamp( ( t + 1.0f ) * 0.5f * n - 0.5f , 0.0f , (float)( n - 1 ) );
+		const unsigned x0 = (unsigned)fx , y0 = (unsigned)fy;
+		const unsigned x1 = min( x0 + 1 , n - 1 ) , y1 = min( y0 + 1 , n - 1 );
+		const float dx = fx - x0 , dy = fy - y0;
+		const float* texels = m_levels[l].data() + face * _faceTexels( n ) * 4;
+		const vfloat<4> top = vfloat<4>::Load( texels + ( (size_t)y0 * n + x0 ) * 4 ) * vfloat<4>( 1.0f - dx ) +
+							  vfloat<4>::Load( texels + ( (size_t)y0 * n + x1 ) * 4 ) * vfloat<4>( dx );
+		const vfloat<4> bottom = vfloat<4>::Load( texels + ( (size_t)y1 * n + x0 ) * 4 ) * vfloat<4>( 1.0f - dx ) +
+								 vfloat<4>::Load( texels + ( (size_t)y1 * n + x1 ) * 4 ) * vfloat<4>( dx );
+		return top * vfloat<4>( 1.0f - dy ) + bottom * vfloat<4>( dy );
+	};
+
+	const unsigned last = (unsigned)m_levels.size() - 1;
+	const unsigned l0 = min( (unsigned)level , last );
+	vfloat<4> c = bilinear( l0 );
+	if( l0 < last )
+	{
+		const float w = level - (float)l0;
+		c = c * vfloat<4>( 1.0f - w ) + bilinear( l0 + 1 ) * vfloat<4>( w );
+	}
+
+	float rgb[4];
+	c.Store( rgb );
+	return Spectrum( rgb[0] , rgb[1] , rgb[2] );
+}
+
+// project a direction onto a face
+void SkyCubeMap::_project( const Vector& dir , unsigned& face , float& s , float& t )
+{
+	const float ax = fabs( dir.x ) , ay = fabs( dir.y ) , az = fabs( dir.z );
+	if( ax >= ay && ax >= az && ax > 0.0f )
+	{
+		face = ( dir.x > 0.0f ) ? 0 : 1;
+		s = ( dir.x > 0.0f ? -dir.z : dir.z ) / ax;
+		t = -dir.y / ax;
+	}
+	else if( ay >= az && ay > 0.0f )
+	{
+		face = ( dir.y > 0.0f ) ? 2 : 3;
+		s = dir.x / ay;
+		t = ( dir.y > 0.0f ? dir.z : -dir.z ) / ay;
+	}
+	else if( az > 0.0f )
+	{
+		face = ( dir.z > 0.0f ) ? 4 : 5;
+		s = ( dir.z > 0.0f ? dir.x : -dir.x ) / az;
+		t = -dir.y / az;
+	}
+	else
+	{
+		face = 2;
+		s = t = 0.0f;
+	}
+}
+
+// the direction through a point of a face
+Vector SkyCubeMap::_direction( unsigned face , float s , float t )
+{
+	switch( face )
+	{
+	case 0: return Vector( 1.0f , -t , -s );
+	case 1: return Vector( -1.0f , -t , s );
+	case 2: return Vector( s , 1.0f , t );
+	case 3: return Vector( s , -1.0f , -t );
+	case 4: return Vector( s , -t , 1.0f );
+	default: return Vector( -s , -t , -1.0f );
+	}
+}
@@ -0,0 +1,81 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+// include the headers
+#include "spectrum/spectrum.h"
+#include "math/vector3.h"
+#include "utility/memstats.h"
+#include <functional>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////
+//	definition of sky cube map
+//	desc :	The radiance of a sky resampled to the six faces of a cube at a
+//			fixed resolution. A lookup projects the direction onto the face
+//			of its major axis , no trigonometric function is involved. Every
+//			face has a chain of mip levels , each one averages the texels of
+//			the finer one , so that lookups with wide footprints are filtered
+//			with a couple of fetches. Texels have four channels so that they
+//			are blended as SIMD registers.
+class	SkyCubeMap
+{
+// public method
+public:
+	// build the cube map
+	// para 'radiance' : the radiance of the sky along a unit direction in the space of the sky
+	// para 'size'     : the number of texels along an edge of a face , it is rounded up to a power of two
+	// note            : the rows of the faces are resampled in parallel
+	void	Build( const std::function<Spectrum(const Vector&)>& radiance , unsigned size );
+
+	// release the texels
+	void	Release();
+
+	// whether the cube map is built
+	bool	IsValid() const { return !m_levels.empty(); }
+
+	// get the number of texels along an edge of a face of the finest level
+	unsigned	GetSize() const { return m_size; }
+
+	// get the radiance along a direction
+	// para 'dir'    : the direction in the space of the sky , it doesn't need to be normalized
+	// para 'spread' : the angle spanned by the footprint of the lookup
+	// result        : the radiance , it is point sampled if the footprint is narrower than a texel of the finest level ,
+	//				   otherwise it is filtered trilinearly between the two levels around the footprint
+	Spectrum	Lookup( const Vector& dir , float spread ) const;
+
+// private field
+private:
+	// the number of texels along an edge of a face of the finest level
+	unsigned	m_size = 0;
+	// the texels of every level , four floats for each of them , face by face and row by row
+	std::vector<std::vector<float>>	m_levels;
+	// the memory of the texels
+	MemoryTracker	m_memory{ MEM_TEXTURE };
+
+// private method
+	// project a direction onto a face
+	// para 'dir'   : the direction
+	// para 'face'  : the face of the major axis of the direction ( output )
+	// para 's','t' : the coordinate on the face in [-1,1] ( output )
+	static void	_project( const Vector& dir , unsigned& face , float& s , float& t );
+
+	// the direction through a point of a face , it is not normalized
+	static Vector	_direction( unsigned face , float s , float t );
+};
@@ -0,0 +1,274 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header
+#include "skydistribution.h"
+#include "utility/define.h"
+#include "utility/sassert.h"
+#include "utility/multithread/threadpool.h"
+#include <sys/stat.h>
+#include <stdio.h>
+#include <algorithm>
+
+// version of the cache file layout , files of other versions are built again
+static const unsigned SKY_CACHE_VERSION = 1;
+static const char SKY_CACHE_MAGIC[4] = { 'S' , 'E' , 'N' , 'V' };
+
+// the tables are stored after the header at an aligned offset
+static const size_t SKY_CACHE_ALIGNMENT = 64;
+
+// the number of entries of a cumulative table in a slice of its guide table
+static const unsigned SKY_GUIDE_RATIO = 4;
+
+// header of the cache file
+struct SkyCacheHeader
+{
+	char				magic[4];
+	unsigned			version;
+	unsigned			nu;					// the number of texels in a row
+	unsigned			nv;					// the number of rows
+	unsigned			guideU;				// the number of slices in the guide tables of rows
+	unsigned			guideV;				// the number of slices in the guide table of the marginal distribution
+	long long			sourceTime;			// modification time of the image file
+	unsigned long long	sourceSize;			// size of the image file
+	unsigned long long	size;				// size of the tables in bytes
+};
+
+static const size_t SKY_CACHE_PAYLOAD = ( sizeof( SkyCacheHeader ) + SKY_CACHE_ALIGNMENT - 1 ) & ~( SKY_CACHE_ALIGNMENT - 1 );
+
+// the number of slices in the guide table of a cumulative table
+static unsigned _guideSize( unsigned count )
+{
+	return max( 1u , count / SKY_GUIDE_RATIO );
+}
+
+// build a cumulative table and its guide table
+// para 'f'     : the importance of the entries
+// para 'n'     : the number of entries
+// para 'cdf'   : the cumulative table , it has 'n+1' entries
+// para 'guide' : the guide table , it has 'g+1' entries
+// para 'g'     : the number of slices in the guide table
+// result       : the sum of the importance
+static float _build1D( const float* f , unsigned n , float* cdf , unsigned* guide , unsigned g )
+{
+	cdf[0] = 0.0f;
+	for( unsigned i = 0 ; i < n ; ++i )
+		cdf[i+1] = cdf[i] + f[i];
+	const float sum = cdf[n];
+
+	if( sum != 0.0f )
+		for( unsigned i = 0 ; i < n + 1 ; ++i )
+			cdf[i] /= sum;
+	else
+		for( unsigned i = 0 ; i < n + 1 ; ++i )
+			cdf[i] = (float)i / (float)n;
+
+	// each slice keeps the first entry not less than its start
+	unsigned j = 0;
+	for( unsigned k = 0 ; k <= g ; ++k )
+	{
+		const float t = (float)k / (float)g;
+		while( j < n && cdf[j] < t )
+			++j;
+		guide[k] = j;
+	}
+	return sum;
+}
+
+// invert a cumulative table
+// para 'cdf'   : the cumulative table
+// para 'n'     : the number of entries
+// para 'guide' : the guide table
+// para 'g'     : the number of slices in the guide table
+// para 'u'     : a canonical random variable
+// para 'pdf'   : the density of the sample
+// result       : the sample in [0,1)
+static float _sample1D( const float* cdf , unsigned n , const unsigned* guide , unsigned g , float u , float* pdf )
+{
+	sAssert( u <= 1.0f && u >= 0.0f , SAMPLING );
+
+	// the entry is searched in the slice of the sample and its neighbors , rounding the slice of the
+	// sample can't move the entry out of them , so the result is the same with searching the whole table
+	const unsigned k = min( (unsigned)( u * g ) , g - 1 );
+	const unsigned lo = guide[ ( k > 0 ) ? k - 1 : 0 ];
+	const unsigned hi = min( guide[ min( k + 2 , g ) ] , n );
+	const float* target = std::lower_bound( cdf + lo , cdf + hi + 1 , u );
+	unsigned offset = ( u <= 0.0f ) ? 0 : (unsigned)( target - cdf - 1 );
+
+	// special care needs to be payed to situation when u == 0.0f
+	if( offset == 0 )
+	{
+		while( offset < n && cdf[offset+1] == 0.0f )
+			offset++;
+	}
+	if( offset == n )
+	{
+		if( pdf ) *pdf = 0.0f;
+		return 0.0f;
+	}
+	if( pdf )
+		*pdf = ( cdf[offset+1] - cdf[offset] ) * n;
+	const float du = ( u - cdf[offset] ) / ( cdf[offset+1] - cdf[offset] );
+	return ( du + (float)offset ) / (float)n;
+}
+
+// build the distribution
+void SkyDistribution::Build( const float* data , unsigned nu , unsigned nv )
+{
+	sAssert( nu != 0 && nv != 0 , LIGHT );
+
+	m_file.Close();
+	m_nu = nu;
+	m_nv = nv;
+	m_guideU = _guideSize( nu );
+	m_guideV = _guideSize( nv );
+	m_memory.assign( _layout( nullptr ) , 0 );
+	_layout( m_memory.data() );
+
+	// the tables are only written here
+	float* row_cdf = const_cast<float*>( m_rowCdf );
+	float* row_sum = const_cast<float*>( m_rowSum );
+	unsigned* row_guide = const_cast<unsigned*>( m_rowGuide );
+
+	// the rows are independent
+	ParallelFor( 0 , nv , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; ++i )
+			row_sum[i] = _build1D( data + (size_t)i * nu , nu , row_cdf + (size_t)i * ( nu + 1 ) , row_guide + (size_t)i * ( m_guideU + 1 ) , m_guideU );
+	});
+	m_marginalSum = _build1D( m_rowSum , nv , const_cast<float*>( m_marginal ) , const_cast<unsigned*>( m_marginalGuide ) , m_guideV );
+	*(float*)m_memory.data() = m_marginalSum;
+}
+
+// map the distribution stored before
+bool SkyDistribution::Load( const string& filename , const string& source , unsigned nu , unsigned nv )
+{
+	struct stat st;
+	if( nu == 0 || nv == 0 || stat( source.c_str() , &st ) != 0 )
+		return false;
+
+	// the tables are looked up randomly , they are better loaded ahead
+	m_memory.clear();
+	m_memory.shrink_to_fit();
+	if( !m_file.Open( filename , false ) || m_file.GetSize() < SKY_CACHE_PAYLOAD )
+	{
+		m_file.Close();
+		return false;
+	}
+
+	SkyCacheHeader header;
+	memcpy( &header , m_file.GetData() , sizeof( header ) );
+	m_nu = nu;
+	m_nv = nv;
+	m_guideU = _guideSize( nu );
+	m_guideV = _guideSize( nv );
+	const size_t size = _layout( nullptr );
+	const bool valid = memcmp( header.magic , SKY_CACHE_MAGIC , sizeof( SKY_CACHE_MAGIC ) ) == 0 && header.version == SKY_CACHE_VERSION &&
+		header.nu == nu && header.nv == nv && header.guideU == m_guideU && header.guideV == m_guideV &&
+		header.sourceTime == (long long)st.st_mtime && header.sourceSize == (unsigned long long)st.st_size &&
+		header.size == size && m_file.GetSize() == SKY_CACHE_PAYLOAD + size;
+	if( !valid )
+	{
+		m_file.Close();
+		return false;
+	}
+
+	_layout( m_file.GetData() + SKY_CACHE_PAYLOAD );
+	m_marginalSum = *(const float*)( m_file.GetData() + SKY_CACHE_PAYLOAD );
+	return true;
+}
+
+// store the distribution
+bool SkyDistribution::Save( const string& filename , const string& source ) const
+{
+	struct stat st;
+	if( m_memory.empty() || stat( source.c_str() , &st ) != 0 )
+		return false;
+
+	SkyCacheHeader header;
+	memset( &header , 0 , sizeof( header ) );
+	memcpy( header.magic , SKY_CACHE_MAGIC , sizeof( SKY_CACHE_MAGIC ) );
+	header.version = SKY_CACHE_VERSION;
+	header.nu = m_nu;
+	header.nv = m_nv;
+	header.guideU = m_guideU;
+	header.guideV = m_guideV;
+	header.sourceTime = (long long)st.st_mtime;
+	header.sourceSize = (unsigned long long)st.st_size;
+	header.size = m_memory.size();
+
+	FILE* file = fopen( filename.c_str() , "wb" );
+	if( file == nullptr )
+		return false;
+
+	// a file written halfway has the wrong size , it is never taken as valid
+	char payload[SKY_CACHE_PAYLOAD] = { 0 };
+	memcpy( payload , &header , sizeof( header ) );
+	bool written = fwrite( payload , 1 , SKY_CACHE_PAYLOAD , file ) == SKY_CACHE_PAYLOAD &&
+		fwrite( m_memory.data() , 1 , m_memory.size() , file ) == m_memory.size();
+	written = ( fclose( file ) == 0 ) && written;
+	if( !written )
+		remove( filename.c_str() );
+	return written;
+}
+
+// get a sample point
+void SkyDistribution::SampleContinuous( float u , float v , float uv[2] , float* pdf ) const
+{
+	sAssert( IsValid() , LIGHT );
+
+	float pdf0 , pdf1;
+	uv[1] = _sample1D( m_marginal , m_nv , m_marginalGuide , m_guideV , v , &pdf1 );
+	const unsigned vi = min( (unsigned)( uv[1] * m_nv ) , m_nv - 1 );
+	uv[0] = _sample1D( m_rowCdf + (size_t)vi * ( m_nu + 1 ) , m_nu , m_rowGuide + (size_t)vi * ( m_guideU + 1 ) , m_guideU , u , &pdf0 );
+
+	if( pdf )
+		*pdf = pdf0 * pdf1;
+}
+
+// get the density of a point
+float SkyDistribution::Pdf( float u , float v ) const
+{
+	sAssert( IsValid() , LIGHT );
+
+	u = clamp( u , 0.0f , 1.0f );
+	v = clamp( v , 0.0f , 1.0f );
+
+	const unsigned iu = min( (unsigned)( u * m_nu ) , m_nu - 1 );
+	const unsigned iv = min( (unsigned)( v * m_nv ) , m_nv - 1 );
+	if( m_rowSum[iv] * m_marginalSum == 0.0f )
+		return 0.0f;
+	const float* cdf = m_rowCdf + (size_t)iv * ( m_nu + 1 );
+	return ( cdf[iu+1] - cdf[iu] ) * m_nu * ( m_marginal[iv+1] - m_marginal[iv] ) * m_nv;
+}
+
+// point the tables into a block of memory
+size_t SkyDistribution::_layout( const char* block )
+{
+	// the sum of the importance comes first , all tables have four-byte entries
+	size_t offset = sizeof( float );
+	auto take = [&]( size_t count ){
+		const char* p = block ? block + offset : nullptr;
+		offset += count * 4;
+		return p;
+	};
+	m_rowSum = (const float*)take( m_nv );
+	m_marginal = (const float*)take( m_nv + 1 );
+	m_rowCdf = (const float*)take( (size_t)m_nv * ( m_nu + 1 ) );
+	m_rowGuide = (const unsigned*)take( (size_t)m_nv * ( m_guideU + 1 ) );
+	m_marginalGuide = (const unsigned*)take( m_guideV + 1 );
+	return offset;
+}
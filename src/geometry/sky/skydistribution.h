@@ -0,0 +1,104 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+// include the headers
+#include "sort.h"
+#include "utility/mappedfile.h"
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////
+//	definition of sky distribution
+//	desc :	The importance of every texel of a sky image , the marginal
+//			distribution of the rows and the distribution of each row are
+//			kept as cumulative tables in one flat block of memory. Every
+//			table has a guide table mapping slices of the canonical range to
+//			the first entry of the slice , the inversion only searches the
+//			few entries of the slices around the sample instead of the whole
+//			table. The warp is the same with the inversion of the whole
+//			tables , so is its stratification. The block is stored next to
+//			the image once it is built and mapped in later runs , the image
+//			itself doesn't have to be read for sampling.
+class	SkyDistribution
+{
+// public method
+public:
+	// build the distribution
+	// para 'data' : the importance of the texels , row by row
+	// para 'nu'   : the number of texels in a row
+	// para 'nv'   : the number of rows
+	// note        : the rows are built in parallel
+	void	Build( const float* data , unsigned nu , unsigned nv );
+
+	// map the distribution stored before
+	// para 'filename' : name of the cache file
+	// para 'source'   : name of the image file
+	// para 'nu'       : the number of texels in a row
+	// para 'nv'       : the number of rows
+	// result          : 'true' if the file is valid for the image
+	bool	Load( const string& filename , const string& source , unsigned nu , unsigned nv );
+
+	// store the distribution
+	// para 'filename' : name of the cache file
+	// para 'source'   : name of the image file
+	// result          : 'true' if the file is written
+	bool	Save( const string& filename , const string& source ) const;
+
+	// whether the distribution is built or loaded
+	bool	IsValid() const { return m_marginal != nullptr; }
+
+	// get a sample point
+	// para 'u' , 'v' : canonical random variables
+	// para 'uv'      : the sampled point in the image
+	// para 'pdf'     : the density of the point with respect to the area of the image
+	void	SampleContinuous( float u , float v , float uv[2] , float* pdf ) const;
+
+	// get the density of a point
+	// para 'u' , 'v' : the point in the image
+	// result         : the density with respect to the area of the image
+	float	Pdf( float u , float v ) const;
+
+// private field
+private:
+	// the size of the image
+	unsigned		m_nu = 0;
+	unsigned		m_nv = 0;
+	// the number of slices in the guide tables of rows and the marginal table
+	unsigned		m_guideU = 0;
+	unsigned		m_guideV = 0;
+
+	// the tables , they point into the memory built or the mapped file
+	const float*	m_rowCdf = nullptr;			// 'nu+1' entries for every row
+	const float*	m_rowSum = nullptr;			// the importance of every row
+	const float*	m_marginal = nullptr;		// 'nv+1' entries
+	const unsigned*	m_rowGuide = nullptr;		// 'guideU+1' entries for every row
+	const unsigned*	m_marginalGuide = nullptr;	// 'guideV+1' entries
+	float			m_marginalSum = 0.0f;		// the importance of the image
+
+	// the memory of the tables if they are built
+	std::vector<char>	m_memory;
+	// the file of the tables if they are loaded
+	MappedFile			m_file;
+
+// private method
+private:
+	// point the tables into a block of memory
+	// para 'block' : the block laid out for the size of the image
+	// result       : the size of the block in bytes
+	size_t	_layout( const char* block );
+};
@@ -21,6 +21,8 @@
 #include "geometry/ray.h"
 #include "utility/samplemethod.h"
 #include "managers/memmanager.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
 
 IMPLEMENT_CREATOR( SkySphere );
 
@@ -28,19 +30,15 @@ IMPLEMENT_CREATOR( SkySphere );
 void SkySphere::_init()
 {
 	_registerAllProperty();
-	distribution = 0;
 }
 // release
 void SkySphere::_release()
 {
-	SAFE_DELETE(distribution);
 }
 
-// evaluate value from sky
-Spectrum SkySphere::Evaluate( const Vector& vec ) const
+// evaluate the sky from the image
+Spectrum SkySphere::_evaluate( const Vector& wi ) const
 {
-	Vector wi = m_transform.invMatrix(vec);
-
 	float theta = SphericalTheta( wi );
 	float phi = SphericalPhi( wi );
 
@@ -50,6 +48,12 @@ Spectrum SkySphere::Evaluate( const Vector& vec ) const
 	return m_sky.GetColor( u , v );
 }
 
+// the size of the faces of the cube map
+unsigned SkySphere::_cubeSize() const
+{
+	return m_sky.GetWidth() / 4;
+}
+
 // register property
 void SkySphere::_registerAllProperty()
 {
@@ -65,22 +69,32 @@ Spectrum SkySphere::GetAverage() const
 // generate 2d distribution
 void SkySphere::_generateDistribution2D()
 {
-	SAFE_DELETE(distribution);
-
 	unsigned nu = m_sky.GetWidth();
 	unsigned nv = m_sky.GetHeight();
 	sAssert( nu != 0 && nv != 0 , LIGHT );
-	float* data = new float[nu*nv];
-	for( unsigned i = 0 ; i < nv ; i++ )
-	{
-		unsigned offset = i * nu;
-		float sin_theta = sin( (float)i / (float)nv * PI );
 
-		for( unsigned j = 0 ; j < nu ; j++ )
-			data[offset+j] = max( 0.0f , m_sky.GetColor( (int)j , (int)i ).GetIntensity() * sin_theta );
+	// the texels of the image don't need to be read if the distribution is built before
+	const string cache_file = m_filename + ".sortenv";
+	if( m_distribution.Load( cache_file , m_filename , nu , nv ) )
+	{
+		slog( INFO , LIGHT , stringFormat( "Importance of sky %s is loaded from cache %s." , m_filename.c_str() , cache_file.c_str() ) );
+		return;
 	}
 
-	distribution = new Distribution2D( data , nu , nv );
+	float* data = new float[nu*nv];
+	ParallelFor( 0 , nv , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; i++ )
+		{
+			unsigned offset = i * nu;
+			float sin_theta = sin( (float)i / (float)nv * PI );
+
+			for( unsigned j = 0 ; j < nu ; j++ )
+				data[offset+j] = max( 0.0f , m_sky.GetColor( (int)j , (int)i ).GetIntensity() * sin_theta );
+		}
+	});
+
+	m_distribution.Build( data , nu , nv );
+	m_distribution.Save( cache_file , m_filename );
 
 	delete[] data;
 }
@@ -88,11 +102,11 @@ void SkySphere::_generateDistribution2D()
 // sample direction
 Vector SkySphere::sample_v( float u , float v , float* pdf , float* area_pdf ) const
 {
-	sAssert( distribution != 0 , LIGHT );
+	sAssert( m_distribution.IsValid() , LIGHT );
 
 	float uv[2] ;
 	float apdf = 0.0f;
-	distribution->SampleContinuous( u , v , uv , &apdf );
+	m_distribution.SampleContinuous( u , v , uv , &apdf );
 	if( area_pdf ) *area_pdf = apdf;
 	if( apdf == 0.0f )
 		return Vector();
@@ -127,5 +141,5 @@ float SkySphere::Pdf( const Point& p , const Vector& wi ) const
 	v = theta * INV_PI;
 	u = phi * INV_TWOPI;
 	
-	return distribution->Pdf( u , v ) / ( TWO_PI * PI * sin_theta );
+	return m_distribution.Pdf( u , v ) / ( TWO_PI * PI * sin_theta );
 }
@@ -20,8 +20,7 @@
 
 #include "sky.h"
 #include "texture/imagetexture.h"
-
-class Distribution2D;
+#include "skydistribution.h"
 
 ////////////////////////////////////////////////////////////////////////
 // definition of sky sphere
@@ -36,11 +35,6 @@ public:
 	// destructor
 	~SkySphere(){_release();}
 
-	// evaluate value from sky
-	// para 'r' : the ray which misses all of the triangle in the scene
-	// result   : the spectrum in the sky
-	virtual Spectrum Evaluate( const Vector& r ) const;
-
 	// get the average radiance
 	virtual Spectrum GetAverage() const;
 
@@ -53,7 +47,15 @@ public:
 // private field
 private:
 	ImageTexture	m_sky;
-	Distribution2D*	distribution;
+	// the name of the image file
+	string			m_filename;
+	// the importance of the image
+	SkyDistribution	m_distribution;
+
+	// evaluate the sky from the image
+	Spectrum _evaluate( const Vector& r ) const;
+	// the size of the faces of the cube map , a face covers a quarter of the width of the image
+	unsigned _cubeSize() const;
 
 	// initialize default value
 	void _init();
@@ -61,7 +63,7 @@ private:
 	void _release();
 	// register property
 	void _registerAllProperty();
-	// generate 2d distribution
+	// generate 2d distribution , it is loaded from the cache next to the image if it is still valid
 	void _generateDistribution2D();
 
 // property handler
@@ -74,6 +76,7 @@ private:
 		void SetValue( const string& str )
 		{
 			SkySphere* sky = CAST_TARGET(SkySphere);
+			sky->m_filename = str;
 			sky->m_sky.LoadImageFromFile( str );
 			sky->_generateDistribution2D();
 		}
@@ -0,0 +1,714 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include the header
+#include "subdivision.h"
+#include "trimesh.h"
+#include "triangle.h"
+#include "intersection.h"
+#include "managers/meshmanager.h"
+#include "managers/meshpager.h"
+#include "managers/subdivcache.h"
+#include <unordered_map>
+#include <algorithm>
+
+// a polygon mesh around a patch while it is subdivided , the faces descending from the patch are the first ones
+struct SubdivMesh
+{
+	// the vertexes and their texture coordinates , only those of the descendants of the patch are meaningful
+	std::vector<Point>			points;
+	std::vector<float>			uvs;
+	// the corners of the faces , the corners of face i are start[i] to start[i+1]
+	std::vector<unsigned>		start;
+	std::vector<unsigned>		corners;
+	// the number of faces descending from the patch
+	unsigned					descendants = 0;
+	// the parameters of the descendants , they are set from the first level on
+	std::vector<SubdivFrame>	frames;
+};
+
+// one level of Catmull-Clark subdivision , faces not touching the descendants of the patch are dropped
+// note : the faces kept around the descendants are enough to subdivide them again , the vertexes far
+//        from the patch have incomplete neighborhoods and wrong positions , but only dropped faces use them
+static void subdivideMesh( const SubdivMesh& in , SubdivMesh& out )
+{
+	const unsigned vnum = (unsigned)in.points.size();
+	const unsigned fnum = (unsigned)in.start.size() - 1;
+
+	// the face points are the centroids of the faces
+	std::vector<Point> fpoints( fnum );
+	std::vector<float> fuvs( 2 * fnum , 0.0f );
+	for( unsigned f = 0 ; f < fnum ; ++f )
+	{
+		const unsigned s = in.start[f] , n = in.start[f+1] - s;
+		Point c( 0.0f , 0.0f , 0.0f );
+		for( unsigned j = 0 ; j < n ; ++j )
+		{
+			c += in.points[in.corners[s+j]];
+			fuvs[2*f] += in.uvs[2*in.corners[s+j]];
+			fuvs[2*f+1] += in.uvs[2*in.corners[s+j]+1];
+		}
+		fpoints[f] = c / (float)n;
+		fuvs[2*f] /= (float)n;
+		fuvs[2*f+1] /= (float)n;
+	}
+
+	// the edges are found by their two vertexes , an edge of one face is on the boundary
+	std::unordered_map<unsigned long long,unsigned> lookup;
+	lookup.reserve( in.corners.size() );
+	std::vector<unsigned> edgeA , edgeB , edgeFaces , edgeCount;
+	std::vector<unsigned> cornerEdge( in.corners.size() );
+	for( unsigned f = 0 ; f < fnum ; ++f )
+	{
+		const unsigned s = in.start[f] , n = in.start[f+1] - s;
+		for( unsigned j = 0 ; j < n ; ++j )
+		{
+			const unsigned a = in.corners[s+j] , b = in.corners[s+(j+1)%n];
+			const unsigned long long key = ( (unsigned long long)min( a , b ) << 32 ) | max( a , b );
+			auto it = lookup.insert( std::make_pair( key , (unsigned)edgeA.size() ) );
+			const unsigned e = it.first->second;
+			if( it.second )
+			{
+				edgeA.push_back( a );
+				edgeB.push_back( b );
+				edgeFaces.push_back( f );
+				edgeFaces.push_back( ~0u );
+				edgeCount.push_back( 1 );
+			}
+			else if( edgeCount[e]++ == 1 )
+				edgeFaces[2*e+1] = f;
+			cornerEdge[s+j] = e;
+		}
+	}
+	const unsigned enum_ = (unsigned)edgeA.size();
+
+	// the edge points , boundary edges and edges of more than two faces are split in the middle
+	std::vector<Point> epoints( enum_ );
+	for( unsigned e = 0 ; e < enum_ ; ++e )
+	{
+		const Point mid = ( in.points[edgeA[e]] + in.points[edgeB[e]] ) * 0.5f;
+		epoints[e] = ( edgeCount[e] == 2 ) ? ( mid + ( fpoints[edgeFaces[2*e]] + fpoints[edgeFaces[2*e+1]] ) * 0.5f ) * 0.5f : mid;
+	}
+
+	// the vertex points , ( Q + 2R + ( n - 3 ) S ) / n inside and ( a + 6S + b ) / 8 on the boundary
+	std::vector<Point> faceSum( vnum , Point( 0.0f , 0.0f , 0.0f ) ) , edgeSum( vnum , Point( 0.0f , 0.0f , 0.0f ) ) , boundarySum( vnum , Point( 0.0f , 0.0f , 0.0f ) );
+	std::vector<unsigned> faceCnt( vnum , 0 ) , edgeCnt( vnum , 0 ) , boundaryCnt( vnum , 0 );
+	for( unsigned f = 0 ; f < fnum ; ++f )
+	{
+		for( unsigned c = in.start[f] ; c < in.start[f+1] ; ++c )
+		{
+			faceSum[in.corners[c]] += fpoints[f];
+			++faceCnt[in.corners[c]];
+		}
+	}
+	for( unsigned e = 0 ; e < enum_ ; ++e )
+	{
+		const unsigned a = edgeA[e] , b = edgeB[e];
+		const Point mid = ( in.points[a] + in.points[b] ) * 0.5f;
+		edgeSum[a] += mid;
+		edgeSum[b] += mid;
+		++edgeCnt[a];
+		++edgeCnt[b];
+		if( edgeCount[e] != 2 )
+		{
+			boundarySum[a] += in.points[b];
+			boundarySum[b] += in.points[a];
+			++boundaryCnt[a];
+			++boundaryCnt[b];
+		}
+	}
+
+	// the vertex points come first , followed by the edge points and the face points
+	const unsigned total = vnum + enum_ + fnum;
+	std::vector<Point> points( total );
+	std::vector<float> uvs( 2 * total );
+	for( unsigned v = 0 ; v < vnum ; ++v )
+	{
+		const Point& p = in.points[v];
+		const unsigned n = faceCnt[v];
+		if( boundaryCnt[v] == 0 && n >= 3 && n == edgeCnt[v] )
+			points[v] = ( faceSum[v] / (float)n + edgeSum[v] * ( 2.0f / n ) + p * (float)( n - 3 ) ) / (float)n;
+		else if( boundaryCnt[v] == 2 )
+			points[v] = ( boundarySum[v] + p * 6.0f ) * 0.125f;
+		else
+			points[v] = p;
+		uvs[2*v] = in.uvs[2*v];
+		uvs[2*v+1] = in.uvs[2*v+1];
+	}
+	for( unsigned e = 0 ; e < enum_ ; ++e )
+	{
+		points[vnum+e] = epoints[e];
+		uvs[2*(vnum+e)] = ( in.uvs[2*edgeA[e]] + in.uvs[2*edgeB[e]] ) * 0.5f;
+		uvs[2*(vnum+e)+1] = ( in.uvs[2*edgeA[e]+1] + in.uvs[2*edgeB[e]+1] ) * 0.5f;
+	}
+	for( unsigned f = 0 ; f < fnum ; ++f )
+	{
+		points[vnum+enum_+f] = fpoints[f];
+		uvs[2*(vnum+enum_+f)] = fuvs[2*f];
+		uvs[2*(vnum+enum_+f)+1] = fuvs[2*f+1];
+	}
+
+	// each face is split into one quad at each corner , the children of the descendants come first in their order
+	std::vector<unsigned> corners;
+	corners.reserve( 4 * in.corners.size() );
+	auto child = [&]( unsigned f , unsigned j , unsigned quad[4] ){
+		const unsigned s = in.start[f] , n = in.start[f+1] - s;
+		quad[0] = in.corners[s+j];
+		quad[1] = vnum + cornerEdge[s+j];
+		quad[2] = vnum + enum_ + f;
+		quad[3] = vnum + cornerEdge[s+(j+n-1)%n];
+	};
+	out.frames.clear();
+	for( unsigned f = 0 ; f < in.descendants ; ++f )
+	{
+		const unsigned n = in.start[f+1] - in.start[f];
+		for( unsigned j = 0 ; j < n ; ++j )
+		{
+			unsigned quad[4];
+			child( f , j , quad );
+			corners.insert( corners.end() , quad , quad + 4 );
+
+			// the child at a corner covers the quarter of the domain at the corner , its axes start from there
+			SubdivFrame frame = { { 0.0f , 0.0f } , { 1.0f , 0.0f } , { 0.0f , 1.0f } };
+			if( !in.frames.empty() )
+			{
+				const SubdivFrame& parent = in.frames[f];
+				float c[4][2];
+				for( unsigned k = 0 ; k < 2 ; ++k )
+				{
+					c[0][k] = parent.origin[k];
+					c[1][k] = parent.origin[k] + parent.axisS[k];
+					c[2][k] = parent.origin[k] + parent.axisS[k] + parent.axisT[k];
+					c[3][k] = parent.origin[k] + parent.axisT[k];
+				}
+				for( unsigned k = 0 ; k < 2 ; ++k )
+				{
+					frame.origin[k] = c[j][k];
+					frame.axisS[k] = ( c[(j+1)%4][k] - c[j][k] ) * 0.5f;
+					frame.axisT[k] = ( c[(j+3)%4][k] - c[j][k] ) * 0.5f;
+				}
+			}
+			out.frames.push_back( frame );
+		}
+	}
+	out.descendants = (unsigned)( corners.size() / 4 );
+
+	// the children of other faces are only kept if they share a vertex with the descendants
+	std::vector<char> marked( total , 0 );
+	for( unsigned c : corners )
+		marked[c] = 1;
+	for( unsigned f = in.descendants ; f < fnum ; ++f )
+	{
+		const unsigned n = in.start[f+1] - in.start[f];
+		for( unsigned j = 0 ; j < n ; ++j )
+		{
+			unsigned quad[4];
+			child( f , j , quad );
+			if( marked[quad[0]] || marked[quad[1]] || marked[quad[2]] || marked[quad[3]] )
+				corners.insert( corners.end() , quad , quad + 4 );
+		}
+	}
+
+	// the vertexes no face refers to are dropped
+	std::vector<unsigned> remap( total , ~0u );
+	out.points.clear();
+	out.uvs.clear();
+	for( unsigned& c : corners )
+	{
+		if( remap[c] == ~0u )
+		{
+			remap[c] = (unsigned)out.points.size();
+			out.points.push_back( points[c] );
+			out.uvs.push_back( uvs[2*c] );
+			out.uvs.push_back( uvs[2*c+1] );
+		}
+		c = remap[c];
+	}
+	out.corners.swap( corners );
+	out.start.resize( out.corners.size() / 4 + 1 );
+	for( unsigned f = 0 ; f < (unsigned)out.start.size() ; ++f )
+		out.start[f] = 4 * f;
+}
+
+// the size of the tessellation in bytes
+size_t SubdivGeometry::Bytes() const
+{
+	return sizeof( SubdivGeometry ) + positions.capacity() * sizeof( Point ) + normals.capacity() * sizeof( Vector ) + texcoords.capacity() * sizeof( float ) +
+		quads.capacity() * sizeof( unsigned ) + frames.capacity() * sizeof( SubdivFrame ) + boxes.capacity() * sizeof( BBox ) + cells.capacity() * sizeof( unsigned );
+}
+
+// constructor
+SubdivSurface::SubdivSurface( const TriMesh* mesh , unsigned level , SubdivCache* cache ):
+	m_mesh(mesh) , m_level(level) , m_cache(cache)
+{
+	_buildFaces();
+}
+
+// build the faces of the cage
+void SubdivSurface::_buildFaces()
+{
+	const auto& mem = m_mesh->m_pMemory;
+	auto same = []( const VertexIndex& a , const VertexIndex& b ){ return a.posIndex == b.posIndex && a.texIndex == b.texIndex; };
+
+	m_FaceStart.assign( 1 , 0 );
+	for( unsigned i = 0 ; i < (unsigned)mem->m_TrunkBuffer.size() ; ++i )
+	{
+		const auto& index = mem->m_TrunkBuffer[i]->m_IndexBuffer;
+		const unsigned triNum = (unsigned)( index.size() / 3 );
+		for( unsigned k = 0 ; k < triNum ; ++k )
+		{
+			// the loader splits a quad ( a , b , c , d ) into ( a , b , c ) and ( a , c , d ) , they are paired again
+			const VertexIndex* tri = &index[3*k];
+			const VertexIndex* next = ( k + 1 < triNum ) ? &index[3*k+3] : nullptr;
+			VertexIndex face[4] = { tri[0] , tri[1] , tri[2] };
+			unsigned n = 3;
+			if( next && same( next[0] , tri[0] ) && same( next[1] , tri[2] ) &&
+				next[2].posIndex != tri[0].posIndex && next[2].posIndex != tri[1].posIndex && next[2].posIndex != tri[2].posIndex )
+			{
+				face[n++] = next[2];
+				++k;
+			}
+
+			// degenerated faces break the topology of the cage , they are dropped
+			if( face[0].posIndex == face[1].posIndex || face[1].posIndex == face[2].posIndex || face[2].posIndex == face[0].posIndex )
+				continue;
+
+			for( unsigned j = 0 ; j < n ; ++j )
+			{
+				m_CornerPos.push_back( face[j].posIndex );
+				m_CornerTex.push_back( face[j].texIndex );
+			}
+			m_FaceStart.push_back( (unsigned)m_CornerPos.size() );
+			m_FaceTrunk.push_back( i );
+		}
+	}
+
+	// the faces around each position
+	const unsigned faceNum = (unsigned)m_FaceTrunk.size();
+	m_VertexStart.assign( mem->GetPositionCount() + 1 , 0 );
+	for( int pos : m_CornerPos )
+		++m_VertexStart[pos+1];
+	for( unsigned i = 1 ; i < (unsigned)m_VertexStart.size() ; ++i )
+		m_VertexStart[i] += m_VertexStart[i-1];
+	m_VertexFaces.resize( m_CornerPos.size() );
+	std::vector<unsigned> fill( m_VertexStart.begin() , m_VertexStart.end() - 1 );
+	for( unsigned f = 0 ; f < faceNum ; ++f )
+		for( unsigned c = m_FaceStart[f] ; c < m_FaceStart[f+1] ; ++c )
+			m_VertexFaces[fill[m_CornerPos[c]]++] = f;
+
+	m_Memory.Set( ( m_FaceStart.capacity() + m_FaceTrunk.capacity() + m_VertexStart.capacity() + m_VertexFaces.capacity() ) * sizeof( unsigned ) +
+				  ( m_CornerPos.capacity() + m_CornerTex.capacity() ) * sizeof( int ) );
+}
+
+// fill the patches into the triangle buffer
+void SubdivSurface::FillTriBuf( vector<Primitive*>& vec )
+{
+	const unsigned base = (unsigned)vec.size();
+	const unsigned faceNum = (unsigned)m_FaceTrunk.size();
+	for( unsigned f = 0 ; f < faceNum ; ++f )
+	{
+		m_Patches.emplace_back( base + f , this , f , m_mesh->m_Materials[m_FaceTrunk[f]].get() );
+		m_Patches.back().SetLightLinks( m_mesh->m_LightLinks );
+		m_Patches.back().SetHidden( m_mesh->m_Hidden );
+		m_Patches.back().SetMediumInterface( m_mesh->m_HasMedia ? &m_mesh->m_Media : nullptr );
+		vec.push_back( &m_Patches.back() );
+	}
+	m_cache->AddPatches( faceNum );
+}
+
+// tessellate the limit surface of a face
+std::unique_ptr<SubdivGeometry> SubdivSurface::Tessellate( unsigned face , unsigned level ) const
+{
+	const auto& mem = m_mesh->m_pMemory;
+	level = min( max( level , 1u ) , (unsigned)SUBDIV_MAX_LEVEL );
+
+	// the face and the faces around its corners are the support of its limit surface
+	std::vector<unsigned> faces( 1 , face );
+	for( unsigned c = m_FaceStart[face] ; c < m_FaceStart[face+1] ; ++c )
+	{
+		const int pos = m_CornerPos[c];
+		for( unsigned i = m_VertexStart[pos] ; i < m_VertexStart[pos+1] ; ++i )
+			if( std::find( faces.begin() , faces.end() , m_VertexFaces[i] ) == faces.end() )
+				faces.push_back( m_VertexFaces[i] );
+	}
+
+	// only the texture coordinates of the face itself are needed , the buffers could be paged out
+	MeshPageScope page( mem->m_page );
+	const bool textured = mem->m_iTBCount > 0;
+
+	SubdivMesh meshes[2];
+	SubdivMesh& cage = meshes[0];
+	std::vector<int> positions;
+	cage.start.push_back( 0 );
+	for( unsigned f : faces )
+	{
+		for( unsigned c = m_FaceStart[f] ; c < m_FaceStart[f+1] ; ++c )
+		{
+			const int pos = m_CornerPos[c];
+			unsigned v = (unsigned)( std::find( positions.begin() , positions.end() , pos ) - positions.begin() );
+			if( v == (unsigned)positions.size() )
+			{
+				positions.push_back( pos );
+				cage.points.push_back( mem->GetPosition( pos ) );
+				const bool uv = textured && f == face && m_CornerTex[c] >= 0;
+				cage.uvs.push_back( uv ? mem->m_TexCoordBuffer[2*m_CornerTex[c]] : 0.0f );
+				cage.uvs.push_back( uv ? mem->m_TexCoordBuffer[2*m_CornerTex[c]+1] : 0.0f );
+			}
+			cage.corners.push_back( v );
+		}
+		cage.start.push_back( (unsigned)cage.corners.size() );
+	}
+	cage.descendants = 1;
+
+	for( unsigned l = 0 ; l < level ; ++l )
+		subdivideMesh( meshes[l&1] , meshes[(l+1)&1] );
+	const SubdivMesh& mesh = meshes[level&1];
+
+	// the corners around each vertex
+	const unsigned vnum = (unsigned)mesh.points.size();
+	std::vector<unsigned> ringStart( vnum + 1 , 0 ) , ring( mesh.corners.size() );
+	for( unsigned c : mesh.corners )
+		++ringStart[c+1];
+	for( unsigned v = 0 ; v < vnum ; ++v )
+		ringStart[v+1] += ringStart[v];
+	std::vector<unsigned> fill( ringStart.begin() , ringStart.end() - 1 );
+	for( unsigned c = 0 ; c < (unsigned)mesh.corners.size() ; ++c )
+		ring[fill[mesh.corners[c]]++] = c;
+
+	std::unique_ptr<SubdivGeometry> geometry( new SubdivGeometry() );
+	geometry->level = level;
+	geometry->roots = m_FaceStart[face+1] - m_FaceStart[face];
+
+	// the vertexes of the descendants are pushed to the limit surface , ( n^2 S + 4 sum(e) + sum(d) ) / ( n ( n + 5 ) ) inside
+	// and ( a + 4S + b ) / 6 on the boundary , the normals are the average of the faces around them
+	std::vector<unsigned> remap( vnum , ~0u );
+	for( unsigned c = 0 ; c < 4 * mesh.descendants ; ++c )
+	{
+		const unsigned v = mesh.corners[c];
+		if( remap[v] != ~0u )
+			continue;
+		remap[v] = (unsigned)geometry->positions.size();
+
+		const Point& p = mesh.points[v];
+		const unsigned n = ringStart[v+1] - ringStart[v];
+		Point edges( 0.0f , 0.0f , 0.0f ) , diagonals( 0.0f , 0.0f , 0.0f ) , boundary( 0.0f , 0.0f , 0.0f );
+		Vector normal( 0.0f , 0.0f , 0.0f );
+		unsigned boundaryCnt = 0;
+		for( unsigned i = ringStart[v] ; i < ringStart[v+1] ; ++i )
+		{
+			const unsigned corner = ring[i] , base = corner & ~3u , j = corner & 3u;
+			const unsigned next = mesh.corners[base+(j+1)%4] , opposite = mesh.corners[base+(j+2)%4] , prev = mesh.corners[base+(j+3)%4];
+			edges += mesh.points[next];
+			diagonals += mesh.points[opposite];
+			normal += Cross( mesh.points[next] - p , mesh.points[prev] - p );
+
+			// an edge only found in one direction is on the boundary
+			bool nextShared = false , prevShared = false;
+			for( unsigned k = ringStart[v] ; k < ringStart[v+1] ; ++k )
+			{
+				const unsigned other = ring[k] & ~3u , jo = ring[k] & 3u;
+				nextShared |= mesh.corners[other+(jo+3)%4] == next;
+				prevShared |= mesh.corners[other+(jo+1)%4] == prev;
+			}
+			if( !nextShared ){ boundary += mesh.points[next]; ++boundaryCnt; }
+			if( !prevShared ){ boundary += mesh.points[prev]; ++boundaryCnt; }
+		}
+
+		Point limit = p;
+		if( boundaryCnt == 0 && n >= 3 )
+			limit = ( p * (float)( n * n ) + edges * 4.0f + diagonals ) / (float)( n * ( n + 5 ) );
+		else if( boundaryCnt == 2 )
+			limit = ( boundary + p * 4.0f ) / 6.0f;
+		geometry->positions.push_back( limit );
+		geometry->normals.push_back( normal.Length() > 0.0f ? Normalize( normal ) : normal );
+		geometry->texcoords.push_back( mesh.uvs[2*v] );
+		geometry->texcoords.push_back( mesh.uvs[2*v+1] );
+	}
+
+	// the leaves and their parameters
+	geometry->quads.resize( 4 * mesh.descendants );
+	for( unsigned c = 0 ; c < 4 * mesh.descendants ; ++c )
+		geometry->quads[c] = remap[mesh.corners[c]];
+	geometry->frames = mesh.frames;
+
+	// the boxes of the quad trees , the boxes of the leaves are merged level by level
+	const unsigned roots = geometry->roots;
+	unsigned offset[SUBDIV_MAX_LEVEL+2] = { 0 , 0 };
+	for( unsigned l = 1 ; l <= level ; ++l )
+		offset[l+1] = offset[l] + ( roots << ( 2 * ( l - 1 ) ) );
+	geometry->boxes.resize( offset[level+1] );
+	for( unsigned i = 0 ; i < mesh.descendants ; ++i )
+	{
+		BBox& box = geometry->boxes[offset[level]+i];
+		for( unsigned k = 0 ; k < 4 ; ++k )
+			box.Union( geometry->positions[geometry->quads[4*i+k]] );
+	}
+	for( unsigned l = level - 1 ; l >= 1 ; --l )
+	{
+		for( unsigned i = 0 ; i < offset[l+1] - offset[l] ; ++i )
+		{
+			BBox& box = geometry->boxes[offset[l]+i];
+			for( unsigned k = 0 ; k < 4 ; ++k )
+				box.Union( geometry->boxes[offset[l+1]+4*i+k] );
+		}
+	}
+
+	// the leaves covering the cells of the domains , hits are found again by their parameters
+	const unsigned cells = 1u << ( level - 1 );
+	geometry->cells.resize( mesh.descendants );
+	for( unsigned i = 0 ; i < mesh.descendants ; ++i )
+	{
+		const SubdivFrame& frame = geometry->frames[i];
+		const unsigned root = i / ( cells * cells );
+		const float s = frame.origin[0] + ( frame.axisS[0] + frame.axisT[0] ) * 0.5f;
+		const float t = frame.origin[1] + ( frame.axisS[1] + frame.axisT[1] ) * 0.5f;
+		const unsigned x = min( (unsigned)( s * cells ) , cells - 1 );
+		const unsigned y = min( (unsigned)( t * cells ) , cells - 1 );
+		geometry->cells[( root * cells + y ) * cells + x] = i;
+	}
+	return geometry;
+}
+
+// constructor
+SubdivPatch::SubdivPatch( unsigned pid , const SubdivSurface* surface , unsigned face , Material* mat ):
+	Primitive( pid , mat ) , m_surface(surface) , m_face(face)
+{
+	// the limit surface is inside the convex hull of the faces around the corners
+	const auto& mem = surface->m_mesh->m_pMemory;
+	for( unsigned c = surface->m_FaceStart[face] ; c < surface->m_FaceStart[face+1] ; ++c )
+	{
+		const int pos = surface->m_CornerPos[c];
+		for( unsigned i = surface->m_VertexStart[pos] ; i < surface->m_VertexStart[pos+1] ; ++i )
+		{
+			const unsigned f = surface->m_VertexFaces[i];
+			for( unsigned k = surface->m_FaceStart[f] ; k < surface->m_FaceStart[f+1] ; ++k )
+				m_bbox.Union( mem->GetPosition( surface->m_CornerPos[k] ) );
+		}
+	}
+}
+
+// pick the level of the tessellation
+unsigned SubdivPatch::_level( const Ray& r ) const
+{
+	const unsigned level = m_surface->m_level;
+	if( !r.m_HasDifferentials )
+		return level;
+
+	// the footprint of the ray where it enters the box , the leaves get about as small as it
+	const float t = max( Intersect( r , m_bbox ) , 0.0f );
+	const Point p = r( t );
+	const float footprint = max( Distance( r.m_DxOri + r.m_DxDir * t , p ) , Distance( r.m_DyOri + r.m_DyDir * t , p ) );
+
+	const auto& mem = m_surface->m_mesh->m_pMemory;
+	const unsigned first = m_surface->m_FaceStart[m_face] , n = m_surface->m_FaceStart[m_face+1] - first;
+	float size = 0.0f;
+	for( unsigned j = 0 ; j < n ; ++j )
+		size = max( size , Distance( mem->GetPosition( m_surface->m_CornerPos[first+j] ) , mem->GetPosition( m_surface->m_CornerPos[first+(j+1)%n] ) ) );
+
+	unsigned l = 1;
+	while( l < level && size > footprint * (float)( 1u << l ) )
+		++l;
+	return l;
+}
+
+// make sure the patch is tessellated
+const SubdivGeometry* SubdivPatch::_pin( const Ray& r ) const
+{
+	SubdivPatch* patch = const_cast<SubdivPatch*>( this );
+	m_surface->m_cache->Pin( patch , m_resident.load( std::memory_order_relaxed ) ? m_surface->m_level : _level( r ) );
+	return m_geometry.get();
+}
+
+// allow the patch to be evicted again
+void SubdivPatch::_unpin() const
+{
+	m_surface->m_cache->Unpin( const_cast<SubdivPatch*>( this ) );
+}
+
+// get the intersection between a ray and the patch
+bool SubdivPatch::GetIntersect( const Ray& r , Intersection* intersect ) const
+{
+	const SubdivGeometry* geometry = _pin( r );
+	const ShearedRay sr( r );
+	const unsigned level = geometry->level , roots = geometry->roots;
+	unsigned offset[SUBDIV_MAX_LEVEL+2] = { 0 , 0 };
+	for( unsigned l = 1 ; l <= level ; ++l )
+		offset[l+1] = offset[l] + ( roots << ( 2 * ( l - 1 ) ) );
+
+	// the quad trees are walked with a stack , closer hits shrink the range of the ray
+	float best = intersect ? min( intersect->t , r.m_fMax ) : r.m_fMax;
+	bool hit = false;
+	unsigned leaf = 0;
+	float a = 0.0f , b = 0.0f;
+	unsigned stack[3*SUBDIV_MAX_LEVEL+8][2];
+	unsigned sp = 0;
+	for( unsigned i = roots ; i > 0 ; --i )
+	{
+		stack[sp][0] = 1;
+		stack[sp++][1] = i - 1;
+	}
+	const Point* p = geometry->positions.data();
+	while( sp > 0 )
+	{
+		--sp;
+		const unsigned l = stack[sp][0] , i = stack[sp][1];
+		const float tmin = Intersect( r , geometry->boxes[offset[l]+i] );
+		if( tmin < 0.0f || tmin > best )
+			continue;
+
+		if( l < level )
+		{
+			for( unsigned k = 4 ; k > 0 ; --k )
+			{
+				stack[sp][0] = l + 1;
+				stack[sp++][1] = 4 * i + k - 1;
+			}
+			continue;
+		}
+
+		// a leaf is split into two triangles along the diagonal from its second to its last corner
+		const unsigned* q = &geometry->quads[4*i];
+		float t , u , v;
+		if( IntersectTriangle( sr , p[q[0]] , p[q[1]] , p[q[3]] , t , u , v ) && t > r.m_fMin && t < best )
+		{
+			best = t;
+			hit = true;
+			leaf = i;
+			a = u;
+			b = v;
+		}
+		if( IntersectTriangle( sr , p[q[2]] , p[q[3]] , p[q[1]] , t , u , v ) && t > r.m_fMin && t < best )
+		{
+			best = t;
+			hit = true;
+			leaf = i;
+			a = 1.0f - u;
+			b = 1.0f - v;
+		}
+		if( hit && intersect == 0 )
+			break;
+	}
+
+	// the parameters of the hit are recorded instead of the leaf , they stay valid if the patch is tessellated again
+	if( hit && intersect )
+	{
+		const SubdivFrame& frame = geometry->frames[leaf];
+		const unsigned cells = 1u << ( level - 1 );
+		const float s = frame.origin[0] + a * frame.axisS[0] + b * frame.axisT[0];
+		const float t = frame.origin[1] + a * frame.axisS[1] + b * frame.axisT[1];
+		intersect->t = best;
+		intersect->bu = (float)( leaf / ( cells * cells ) ) + min( max( s , 0.0f ) , 0.99999f );
+		intersect->bv = t;
+		intersect->primitive = const_cast<SubdivPatch*>( this );
+	}
+	_unpin();
+	return hit;
+}
+
+// fill the shading information of the closest hit
+void SubdivPatch::ResolveHit( const Ray& r , Intersection* intersect ) const
+{
+	const SubdivGeometry* geometry = _pin( r );
+
+	// the leaf covering the parameters of the hit
+	const unsigned root = (unsigned)intersect->bu;
+	const float s = intersect->bu - (float)root , t = intersect->bv;
+	const unsigned cells = 1u << ( geometry->level - 1 );
+	const unsigned x = min( (unsigned)max( s * cells , 0.0f ) , cells - 1 );
+	const unsigned y = min( (unsigned)max( t * cells , 0.0f ) , cells - 1 );
+	const unsigned leaf = geometry->cells[( root * cells + y ) * cells + x];
+	const SubdivFrame& frame = geometry->frames[leaf];
+	const float area = (float)( cells * cells );
+	const float ds = s - frame.origin[0] , dt = t - frame.origin[1];
+	const float a = min( max( ( ds * frame.axisS[0] + dt * frame.axisS[1] ) * area , 0.0f ) , 1.0f );
+	const float b = min( max( ( ds * frame.axisT[0] + dt * frame.axisT[1] ) * area , 0.0f ) , 1.0f );
+
+	// the triangle of the leaf holding the hit
+	const unsigned* q = &geometry->quads[4*leaf];
+	unsigned i0 = q[0] , i1 = q[1] , i2 = q[3];
+	float u = a , v = b;
+	if( a + b > 1.0f )
+	{
+		i0 = q[2] , i1 = q[3] , i2 = q[1];
+		u = 1.0f - a;
+		v = 1.0f - b;
+	}
+	const float w = 1.0f - u - v;
+
+	// the hit is interpolated from the vertexes like a triangle
+	const Point& p0 = geometry->positions[i0];
+	const Point& p1 = geometry->positions[i1];
+	const Point& p2 = geometry->positions[i2];
+	intersect->intersect = w * p0 + u * p1 + v * p2;
+	intersect->error = ErrorBound( 7 ) * Vector( fabs( w * p0.x ) + fabs( u * p1.x ) + fabs( v * p2.x ) ,
+												 fabs( w * p0.y ) + fabs( u * p1.y ) + fabs( v * p2.y ) ,
+												 fabs( w * p0.z ) + fabs( u * p1.z ) + fabs( v * p2.z ) );
+	intersect->gnormal = Normalize( Cross( p1 - p0 , p2 - p0 ) );
+
+	const Vector normal = w * geometry->normals[i0] + u * geometry->normals[i1] + v * geometry->normals[i2];
+	intersect->normal = normal.Length() > 0.0f ? Normalize( normal ) : intersect->gnormal;
+	Vector bitangent;
+	CoordinateSystem( intersect->normal , intersect->tangent , bitangent );
+
+	// the footprint of the pixel , the differential rays are intersected with the plane of the triangle
+	float dbu[2] = { 0.0f , 0.0f } , dbv[2] = { 0.0f , 0.0f };
+	intersect->dpdx = intersect->dpdy = Vector( 0.0f , 0.0f , 0.0f );
+	if( r.m_HasDifferentials )
+	{
+		const Vector e1 = p1 - p0;
+		const Vector e2 = p2 - p0;
+		for( unsigned k = 0 ; k < 2 ; ++k )
+		{
+			const Vector& dir = k ? r.m_DyDir : r.m_DxDir;
+			const Vector s1 = Cross( dir , e2 );
+			const float divisor = Dot( s1 , e1 );
+			if( fabs( divisor ) < 0.0000001f )
+				continue;
+			const Vector d = ( k ? r.m_DyOri : r.m_DxOri ) - p0;
+			dbu[k] = Dot( d , s1 ) / divisor - u;
+			dbv[k] = Dot( dir , Cross( d , e1 ) ) / divisor - v;
+		}
+		intersect->dpdx = dbu[0] * e1 + dbv[0] * e2;
+		intersect->dpdy = dbu[1] * e1 + dbv[1] * e2;
+	}
+
+	// the texture coordinates are subdivided linearly with the faces
+	const float* uv = geometry->texcoords.data();
+	const float u0 = uv[2*i0] , u1 = uv[2*i1] , u2 = uv[2*i2];
+	const float v0 = uv[2*i0+1] , v1 = uv[2*i1+1] , v2 = uv[2*i2+1];
+	intersect->u = w * u0 + u * u1 + v * u2;
+	intersect->v = w * v0 + u * v1 + v * v2;
+	intersect->dudx = dbu[0] * ( u1 - u0 ) + dbv[0] * ( u2 - u0 );
+	intersect->dvdx = dbu[0] * ( v1 - v0 ) + dbv[0] * ( v2 - v0 );
+	intersect->dudy = dbu[1] * ( u1 - u0 ) + dbv[1] * ( u2 - u0 );
+	intersect->dvdy = dbu[1] * ( v1 - v0 ) + dbv[1] * ( v2 - v0 );
+
+	_unpin();
+}
+
+// get the surface area , it is the area of the face of the control cage
+float SubdivPatch::SurfaceArea() const
+{
+	const auto& mem = m_surface->m_mesh->m_pMemory;
+	const unsigned first = m_surface->m_FaceStart[m_face] , n = m_surface->m_FaceStart[m_face+1] - first;
+	const Point p0 = mem->GetPosition( m_surface->m_CornerPos[first] );
+	float area = 0.0f;
+	for( unsigned j = 1 ; j + 1 < n ; ++j )
+		area += Cross( mem->GetPosition( m_surface->m_CornerPos[first+j] ) - p0 , mem->GetPosition( m_surface->m_CornerPos[first+j+1] ) - p0 ).Length() * 0.5f;
+	return area;
+}
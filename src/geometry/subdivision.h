@@ -0,0 +1,190 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#ifndef	SORT_SUBDIVISION
+#define	SORT_SUBDIVISION
+
+// include the header
+#include "primitive.h"
+#include "utility/memstats.h"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+
+// the deepest level patches could be subdivided to , a quad has 4^level leaves then
+#define SUBDIV_MAX_LEVEL	6
+
+class	TriMesh;
+class	SubdivSurface;
+class	SubdivCache;
+
+// the parameters of a leaf quad in the domain of the first level quad it descends from , the domain is the unit
+// square with the corner of the face at the origin , the corners of the leaf are 'origin' , 'origin + axisS' ,
+// 'origin + axisS + axisT' and 'origin + axisT'. the axes rotate with the order of corners of the quads.
+struct SubdivFrame
+{
+	float	origin[2];
+	float	axisS[2];
+	float	axisT[2];
+};
+
+// the tessellation of a patch , it is a uniform grid of quads on the limit surface
+struct SubdivGeometry
+{
+	// the level of the leaves
+	unsigned					level = 0;
+	// the number of first level quads , it is the number of corners of the face
+	unsigned					roots = 0;
+	// the vertexes on the limit surface with their normals and texture coordinates
+	std::vector<Point>			positions;
+	std::vector<Vector>			normals;
+	std::vector<float>			texcoords;
+	// four corners of each leaf , the children of a quad in one level are the quads 4i to 4i+3 in the next one
+	std::vector<unsigned>		quads;
+	// the parameters of each leaf
+	std::vector<SubdivFrame>	frames;
+	// the boxes of the quads of all levels , the first level is the first
+	std::vector<BBox>			boxes;
+	// the leaf covering each cell of a uniform grid in the domain of each first level quad
+	std::vector<unsigned>		cells;
+
+	// the size of the tessellation in bytes
+	size_t	Bytes() const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// definition of subdivision patch
+// note :	a patch is one face of the control cage of a Catmull-Clark surface. it is
+//			bounded by the convex hull of the faces around its corners , the limit
+//			surface is only tessellated once a ray reaches the box. the level is
+//			picked from the footprint of the ray and kept while the tessellation
+//			stays in the cache of the scene.
+class	SubdivPatch : public Primitive
+{
+// public method
+public:
+	// constructor
+	// para 'pid'     : primitive id
+	// para 'surface' : the subdivision surface it belongs to
+	// para 'face'    : the face of the control cage
+	// para 'mat'     : the material of the subset , it is owned by the mesh
+	SubdivPatch( unsigned pid , const SubdivSurface* surface , unsigned face , Material* mat );
+
+	// get the intersection between a ray and the patch
+	// note : only the hit record is stored , it is resolved by ResolveHit afterward
+	bool	GetIntersect( const Ray& r , Intersection* intersect ) const;
+
+	// fill the shading information of the closest hit
+	void	ResolveHit( const Ray& r , Intersection* intersect ) const;
+
+	// get the bounding box of the patch , it holds the faces around the corners
+	BBox	GetBBox() const { return m_bbox; }
+
+	// get the surface area , it is the area of the face of the control cage
+	float	SurfaceArea() const;
+
+// private field
+private:
+	// the surface it belongs to
+	const SubdivSurface*	m_surface;
+	// the face of the control cage
+	unsigned				m_face;
+	// the box of the faces around the corners
+	BBox					m_bbox;
+
+	// the tessellation , it is only valid while the patch is resident
+	std::unique_ptr<SubdivGeometry>	m_geometry;
+	// the number of rays reading the tessellation
+	mutable std::atomic<int>	m_pins{ 0 };
+	// whether the tessellation is in memory
+	std::atomic<bool>			m_resident{ false };
+	// whether the patch is used since the eviction last passed it
+	mutable std::atomic<bool>	m_referenced{ false };
+	// the neighbors in the list of resident patches , they are guarded by the mutex of the cache
+	SubdivPatch*				m_prev = nullptr;
+	SubdivPatch*				m_next = nullptr;
+
+	// pick the level of the tessellation from the footprint of a ray
+	unsigned	_level( const Ray& r ) const;
+	// make sure the patch is tessellated until it is unpinned
+	const SubdivGeometry*	_pin( const Ray& r ) const;
+	void					_unpin() const;
+
+friend	class	SubdivCache;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// definition of subdivision surface
+// desc :	The triangles of a subdivided mesh are the control cage of a Catmull-Clark
+//			surface. Quads triangulated by the loader are paired into quads again ,
+//			each face of the cage becomes one patch in the triangle buffer of the scene.
+//			The cage stays in the buffers of the mesh , only the faces and the faces
+//			around each vertex are kept here.
+class	SubdivSurface
+{
+// public method
+public:
+	// constructor
+	// para 'mesh'  : the mesh of the control cage
+	// para 'level' : the deepest level the patches are subdivided to
+	// para 'cache' : the cache holding the tessellated patches
+	SubdivSurface( const TriMesh* mesh , unsigned level , SubdivCache* cache );
+
+	// fill the patches into the triangle buffer
+	// para 'vec' : the buffer to be filled , the patches are owned by the surface
+	void	FillTriBuf( vector<Primitive*>& vec );
+
+	// tessellate the limit surface of a face
+	// para 'face'  : the face of the control cage
+	// para 'level' : the level of subdivision
+	// result       : the tessellation
+	std::unique_ptr<SubdivGeometry>	Tessellate( unsigned face , unsigned level ) const;
+
+	// get the number of patches
+	unsigned	GetPatchCount() const { return (unsigned)m_Patches.size(); }
+
+// private field
+private:
+	// the mesh of the control cage
+	const TriMesh*		m_mesh;
+	// the deepest level
+	unsigned			m_level;
+	// the cache of the tessellations
+	SubdivCache*		m_cache;
+	// the corners of the faces , the corners of face i are m_FaceStart[i] to m_FaceStart[i+1]
+	std::vector<unsigned>	m_FaceStart;
+	std::vector<int>		m_CornerPos;
+	std::vector<int>		m_CornerTex;
+	// the subset of each face
+	std::vector<unsigned>	m_FaceTrunk;
+	// the faces around each position , the faces of position i are m_VertexStart[i] to m_VertexStart[i+1]
+	std::vector<unsigned>	m_VertexStart;
+	std::vector<unsigned>	m_VertexFaces;
+	// the patches , their addresses stay valid while more are added
+	std::deque<SubdivPatch>	m_Patches;
+	// the memory of the faces
+	MemoryTracker			m_Memory{ MEM_SUBDIV };
+
+	// build the faces of the cage from the triangles of the mesh
+	void	_buildFaces();
+
+friend	class	SubdivPatch;
+};
+
+#endif
@@ -20,6 +20,26 @@
 #include "trimesh.h"
 #include "intersection.h"
 #include "utility/samplemethod.h"
+#include "managers/meshmanager.h"
+#include "managers/meshpager.h"
+
+// get the index of the position of a corner
+inline int Triangle::_posIndex( unsigned k ) const
+{
+	return ( m_IndexFormat == TRI_INDEX_SEPARATE ) ? m_Index[k].posIndex : _vertexIndex( k );
+}
+
+// get the index of the normal of a corner
+inline int Triangle::_norIndex( unsigned k ) const
+{
+	return ( m_IndexFormat == TRI_INDEX_SEPARATE ) ? m_Index[k].norIndex : _vertexIndex( k );
+}
+
+// get the index of the texture coordinate of a corner
+inline int Triangle::_texIndex( unsigned k ) const
+{
+	return ( m_IndexFormat == TRI_INDEX_SEPARATE ) ? m_Index[k].texIndex : _vertexIndex( k );
+}
 
 // check if the triangle is intersected with the ray
 bool Triangle::GetIntersect( const Ray& r , Intersection* intersect ) const
@@ -27,62 +47,109 @@ bool Triangle::GetIntersect( const Ray& r , Intersection* intersect ) const
 	// get the memory
 	// note : reference is not used here because it's not thread-safe
 	auto& mem = m_trimesh->m_pMemory;
-	int id0 = m_Index[0].posIndex;
-	int id1 = m_Index[1].posIndex;
-	int id2 = m_Index[2].posIndex;
+	int id0 = _posIndex( 0 );
+	int id1 = _posIndex( 1 );
+	int id2 = _posIndex( 2 );
 
 	// get three vertexes
-	const Point& p0 = mem->m_PositionBuffer[id0] ;
-	const Point& p1 = mem->m_PositionBuffer[id1] ;
-	const Point& p2 = mem->m_PositionBuffer[id2] ;
-
-	float delta = 0.0000001f;
-	Vector e1 = p1 - p0;
-	Vector e2 = p2 - p0;
-	Vector s1 = Cross( r.m_Dir , e2 );
-	float divisor = Dot( s1 , e1 );
-	if( fabs(divisor) < delta )
-		return false;
-	float invDivisor = 1.0f / divisor;
+	const Point p0 = mem->GetPosition( id0 );
+	const Point p1 = mem->GetPosition( id1 );
+	const Point p2 = mem->GetPosition( id2 );
 
-	Vector d = r.m_Ori - p0;
-	float u = Dot( d , s1 ) * invDivisor;
-	if( u < -delta || u > 1.0f + delta )
+	// the watertight test needs no tolerance , rays never slip through the edges between triangles
+	float t , u , v;
+	if( !IntersectTriangle( ShearedRay( r ) , p0 , p1 , p2 , t , u , v ) )
 		return false;
-	Vector s2 = Cross( d , e1 );
-	float v = Dot( r.m_Dir , s2 ) * invDivisor;
-	if( v < -delta || u + v > 1.0f + delta )
-		return false;
-	float t = Dot( e2 , s2 ) * invDivisor;
 	if( t < r.m_fMin || t > r.m_fMax )
 		return false;
 
 	if( intersect == 0 )
-		return t > r.m_fMin && t < r.m_fMax;
+		return t > r.m_fMin && t < r.m_fMax && !( IsCutout() && IsCutAway( u , v ) );
 
 	// if t is out of range , return false
 	if( t > intersect->t )
 		return false;
 
-	// store the intersection
-	intersect->intersect = r(t);
+	// hits cut away by the opacity of the material are ignored as if the ray passed through
+	if( IsCutout() && IsCutAway( u , v ) )
+		return false;
+
+	// only record the hit , the shading information is resolved once the closest hit is found
+	intersect->t = t;
+	intersect->bu = u;
+	intersect->bv = v;
+	intersect->primitive = const_cast<Triangle*>(this);
 
+    return t > 0.0f ;
+}
+
+// fill the shading information of the closest hit
+void Triangle::ResolveHit( const Ray& r , Intersection* intersect ) const
+{
+	const float u = intersect->bu;
+	const float v = intersect->bv;
+
+	// get the memory
+	// note : reference is not used here because it's not thread-safe
+	auto& mem = m_trimesh->m_pMemory;
 	float w = 1 - u - v;
 
+	// the hit is interpolated from the vertexes instead of moving along the ray , its error is bounded by their magnitudes
+	const Point p0 = mem->GetPosition( _posIndex( 0 ) );
+	const Point p1 = mem->GetPosition( _posIndex( 1 ) );
+	const Point p2 = mem->GetPosition( _posIndex( 2 ) );
+	intersect->intersect = w * p0 + u * p1 + v * p2;
+	intersect->error = ErrorBound( 7 ) * Vector( fabs( w * p0.x ) + fabs( u * p1.x ) + fabs( v * p2.x ) ,
+												 fabs( w * p0.y ) + fabs( u * p1.y ) + fabs( v * p2.y ) ,
+												 fabs( w * p0.z ) + fabs( u * p1.z ) + fabs( v * p2.z ) );
+	intersect->gnormal = Normalize( Cross( p1 - p0 , p2 - p0 ) );
+
+	// the shading buffers could be paged out , they are kept in memory until the hit is resolved
+	MeshPageScope page( mem->m_page );
+
 	// store normal if the info is available
-	id0 = m_Index[0].norIndex;
-	id1 = m_Index[1].norIndex;
-	id2 = m_Index[2].norIndex;
+	int id0 = _norIndex( 0 );
+	int id1 = _norIndex( 1 );
+	int id2 = _norIndex( 2 );
+
+	intersect->normal = ( w * mem->GetNormal( id0 ) + u * mem->GetNormal( id1 ) + v * mem->GetNormal( id2 )).Normalize();
+	if( mem->m_iTeBcount > 0 )
+		intersect->tangent = ( w * mem->GetTangent( id0 ) + u * mem->GetTangent( id1 ) + v * mem->GetTangent( id2 )).Normalize();
+	else
+	{
+		// no material of the scene depends on the orientation of the tangent
+		Vector bitangent;
+		CoordinateSystem( intersect->normal , intersect->tangent , bitangent );
+	}
 
-	intersect->normal = ( w * mem->m_NormalBuffer[id0] + u * mem->m_NormalBuffer[id1] + v * mem->m_NormalBuffer[id2]).Normalize();
-	intersect->tangent = ( w * mem->m_TangentBuffer[id0] + u * mem->m_TangentBuffer[id1] + v * mem->m_TangentBuffer[id2]).Normalize();
+	// the footprint of the pixel , the differential rays are intersected with the plane of the triangle
+	float dbu[2] = { 0.0f , 0.0f } , dbv[2] = { 0.0f , 0.0f };
+	intersect->dpdx = intersect->dpdy = Vector( 0.0f , 0.0f , 0.0f );
+	if( r.m_HasDifferentials )
+	{
+		const Vector e1 = p1 - p0;
+		const Vector e2 = p2 - p0;
+		for( unsigned k = 0 ; k < 2 ; ++k )
+		{
+			const Vector& dir = k ? r.m_DyDir : r.m_DxDir;
+			const Vector s1 = Cross( dir , e2 );
+			const float divisor = Dot( s1 , e1 );
+			if( fabs( divisor ) < 0.0000001f )
+				continue;
+			const Vector d = ( k ? r.m_DyOri : r.m_DxOri ) - p0;
+			dbu[k] = Dot( d , s1 ) / divisor - u;
+			dbv[k] = Dot( dir , Cross( d , e1 ) ) / divisor - v;
+		}
+		intersect->dpdx = dbu[0] * e1 + dbv[0] * e2;
+		intersect->dpdy = dbu[1] * e1 + dbv[1] * e2;
+	}
 
 	// store texture coordinate
 	if( mem->m_iTBCount > 0 )
 	{
-		id0 = 2*m_Index[0].texIndex;
-		id1 = 2*m_Index[1].texIndex;
-		id2 = 2*m_Index[2].texIndex;
+		id0 = 2*_texIndex( 0 );
+		id1 = 2*_texIndex( 1 );
+		id2 = 2*_texIndex( 2 );
 
 		float u0 = mem->m_TexCoordBuffer[id0];
 		float u1 = mem->m_TexCoordBuffer[id1];
@@ -92,43 +159,135 @@ bool Triangle::GetIntersect( const Ray& r , Intersection* intersect ) const
 		float v2 = mem->m_TexCoordBuffer[id2+1];
 		intersect->u = w * u0 + u * u1 + v * u2;
 		intersect->v = w * v0 + u * v1 + v * v2;
+
+		// the footprint in texture space
+		intersect->dudx = dbu[0] * ( u1 - u0 ) + dbv[0] * ( u2 - u0 );
+		intersect->dvdx = dbu[0] * ( v1 - v0 ) + dbv[0] * ( v2 - v0 );
+		intersect->dudy = dbu[1] * ( u1 - u0 ) + dbv[1] * ( u2 - u0 );
+		intersect->dvdy = dbu[1] * ( v1 - v0 ) + dbv[1] * ( v2 - v0 );
 	}else
 	{
 		intersect->u = 0.0f;
 		intersect->v = 0.0f;
+		intersect->dudx = intersect->dvdx = intersect->dudy = intersect->dvdy = 0.0f;
 	}
+}
 
-	intersect->t = t;
-	intersect->primitive = const_cast<Triangle*>(this);
+// get the texture coordinate at a point of the triangle
+void Triangle::_texCoord( float bu , float bv , float& u , float& v ) const
+{
+	const auto& mem = m_trimesh->m_pMemory;
+	if( mem->m_iTBCount == 0 )
+	{
+		u = v = 0.0f;
+		return;
+	}
 
-    return t > 0.0f ;
+	const int id0 = 2*_texIndex( 0 );
+	const int id1 = 2*_texIndex( 1 );
+	const int id2 = 2*_texIndex( 2 );
+	const float w = 1.0f - bu - bv;
+	u = w * mem->m_TexCoordBuffer[id0] + bu * mem->m_TexCoordBuffer[id1] + bv * mem->m_TexCoordBuffer[id2];
+	v = w * mem->m_TexCoordBuffer[id0+1] + bu * mem->m_TexCoordBuffer[id1+1] + bv * mem->m_TexCoordBuffer[id2+1];
+}
+
+// whether a hit of the triangle is cut away
+bool Triangle::IsCutAway( float bu , float bv ) const
+{
+	// most hits fall in micro-triangles that are known to be kept or cut away
+	const unsigned micro = MicroTriangle( bu , bv );
+	const unsigned long long word = m_trimesh->m_Micromaps[ MICROMAP_WORDS * m_micromap + micro / 32 ];
+	const unsigned state = (unsigned)( word >> ( 2 * ( micro % 32 ) ) ) & 3;
+	if( state != OPACITY_UNKNOWN )
+		return state == OPACITY_TRANSPARENT;
+
+	// the ones crossing the edge of the cutout evaluate the opacity , the texture coordinates could be paged out
+	MeshPageScope page( m_trimesh->m_pMemory->m_page );
+	float u , v;
+	_texCoord( bu , bv , u , v );
+	return GetMaterial()->IsCutAway( u , v );
+}
+
+// get the vertexes of the triangle in world space
+bool Triangle::GetTriangleVertices( Point& p0 , Point& p1 , Point& p2 ) const
+{
+	const auto& mem = m_trimesh->m_pMemory;
+	p0 = mem->GetPosition( _posIndex( 0 ) );
+	p1 = mem->GetPosition( _posIndex( 1 ) );
+	p2 = mem->GetPosition( _posIndex( 2 ) );
+	return true;
 }
 
 // get the bounding box of the triangle
-const BBox& Triangle::GetBBox() const
+// note : it is not cached , three vertexes are cheaper to read again than a box kept for every triangle
+BBox Triangle::GetBBox() const
 {
-	// if there is no bounding box , cache it
-	if( !m_bbox )
-	{
-        m_bbox = std::unique_ptr<BBox>( new BBox() );
-
-		// get the memory
-        auto& mem = m_trimesh->m_pMemory;
-		int id0 = m_Index[ 0 ].posIndex;
-		int id1 = m_Index[ 1 ].posIndex;
-		int id2 = m_Index[ 2 ].posIndex;
-
-		// get three vertexes
-		const Point& p0 = mem->m_PositionBuffer[id0] ;
-		const Point& p1 = mem->m_PositionBuffer[id1] ;
-		const Point& p2 = mem->m_PositionBuffer[id2] ;
-
-		m_bbox->Union( p0 );
-		m_bbox->Union( p1 );
-		m_bbox->Union( p2 );
+	// get the memory
+	auto& mem = m_trimesh->m_pMemory;
+
+	BBox box;
+	box.Union( mem->GetPosition( _posIndex( 0 ) ) );
+	box.Union( mem->GetPosition( _posIndex( 1 ) ) );
+	box.Union( mem->GetPosition( _posIndex( 2 ) ) );
+	return box;
+}
+
+// get the bounding box of the part of the triangle inside a bounding box
+BBox Triangle::GetClippedBBox( const BBox& box ) const
+{
+	auto& mem = m_trimesh->m_pMemory;
+	const Point p0 = mem->GetPosition( _posIndex( 0 ) );
+	const Point p1 = mem->GetPosition( _posIndex( 1 ) );
+	const Point p2 = mem->GetPosition( _posIndex( 2 ) );
+	return _clip( p0 , p1 , p2 , box );
+}
+
+// clip a triangle against a bounding box with Sutherland-Hodgman algorithm
+BBox Triangle::_clip( const Point& p0 , const Point& p1 , const Point& p2 , const BBox& box )
+{
+	// each clipping plane adds at most one vertex to the polygon
+	Point poly[2][9];
+	poly[0][0] = p0;
+	poly[0][1] = p1;
+	poly[0][2] = p2;
+	unsigned cnt = 3;
+	unsigned cur = 0;
+
+	for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+		for( unsigned side = 0 ; side < 2 ; ++side ){
+			const float plane = side ? box.m_Max[axis] : box.m_Min[axis];
+			const Point* in = poly[cur];
+			Point* out = poly[1-cur];
+			unsigned out_cnt = 0;
+			for( unsigned i = 0 ; i < cnt ; ++i ){
+				const Point& a = in[i];
+				const Point& b = in[(i+1)%cnt];
+				const bool a_in = side ? ( a[axis] <= plane ) : ( a[axis] >= plane );
+				const bool b_in = side ? ( b[axis] <= plane ) : ( b[axis] >= plane );
+				if( a_in )
+					out[out_cnt++] = a;
+				if( a_in != b_in ){
+					const float t = ( plane - a[axis] ) / ( b[axis] - a[axis] );
+					Point p = a + ( b - a ) * t;
+					p[axis] = plane;
+					out[out_cnt++] = p;
+				}
+			}
+			cnt = out_cnt;
+			cur = 1 - cur;
+
+			// the triangle is totally outside the bounding box
+			if( cnt == 0 )
+				return BBox();
+		}
 	}
 
-	return *m_bbox;
+	BBox result;
+	for( unsigned i = 0 ; i < cnt ; ++i )
+		result.Union( poly[cur][i] );
+
+	// avoid the result going beyond the box because of floating point error
+	return Overlap( result , box );
 }
 
 // get the surface area of the triangle
@@ -136,14 +295,14 @@ float Triangle::SurfaceArea() const
 {
 	// get the memory
 	auto& mem = m_trimesh->m_pMemory;
-	int id0 = m_Index[ 0 ].posIndex;
-	int id1 = m_Index[ 1 ].posIndex;
-	int id2 = m_Index[ 2 ].posIndex;
+	int id0 = _posIndex( 0 );
+	int id1 = _posIndex( 1 );
+	int id2 = _posIndex( 2 );
 
 	// get three vertexes
-	const Point& p0 = mem->m_PositionBuffer[id0] ;
-	const Point& p1 = mem->m_PositionBuffer[id1] ;
-	const Point& p2 = mem->m_PositionBuffer[id2] ;
+	const Point p0 = mem->GetPosition( id0 );
+	const Point p1 = mem->GetPosition( id1 );
+	const Point p2 = mem->GetPosition( id2 );
 	
 	Vector e0 = p1 - p0 ;
 	Vector e1 = p2 - p0 ;
@@ -171,10 +330,10 @@ bool Triangle::GetIntersect( const BBox& box ) const
 {
 	// get the memory
 	auto& mem = m_trimesh->m_pMemory;
-	int id0 = m_Index[ 0 ].posIndex;
-	int id1 = m_Index[ 1 ].posIndex;
-	int id2 = m_Index[ 2 ].posIndex;
-	Point tri[3] = { mem->m_PositionBuffer[id0] , mem->m_PositionBuffer[id1] , mem->m_PositionBuffer[id2] };
+	int id0 = _posIndex( 0 );
+	int id1 = _posIndex( 1 );
+	int id2 = _posIndex( 2 );
+	Point tri[3] = { mem->GetPosition( id0 ) , mem->GetPosition( id1 ) , mem->GetPosition( id2 ) };
 
 	float triMin , triMax;	// will intialize later
 	float boxMin = FLT_MAX, boxMax = -FLT_MAX;
@@ -19,11 +19,121 @@
 #define	SORT_TRIANGLE
 
 #include "primitive.h"
+#include "ray.h"
 
 // pre-decleration
 class TriMesh;
 struct VertexIndex;
 
+// ray prepared for the watertight triangle test of Woop et al.
+// the axis along which the direction is the longest becomes z and the direction is sheared to ( 0 , 0 , 1 ) ,
+// so that the test is done with 2D edge functions in the xy plane. The edge functions of an edge only depend
+// on its two vertexes , a ray never slips through the edge shared by two triangles.
+struct ShearedRay
+{
+	float		ori[3];			// origin of the ray
+	unsigned	kx , ky , kz;	// the axes becoming x , y and z
+	float		sx , sy , sz;	// the shear of the direction
+
+	// constructor from a ray
+	// para 'r' :	the ray to be tested
+	explicit ShearedRay( const Ray& r ){
+		const float ax = fabs( r.m_Dir.x ) , ay = fabs( r.m_Dir.y ) , az = fabs( r.m_Dir.z );
+		kz = ( ax > ay ) ? ( ( ax > az ) ? 0 : 2 ) : ( ( ay > az ) ? 1 : 2 );
+		kx = ( kz + 1 ) % 3;
+		ky = ( kx + 1 ) % 3;
+		sx = -r.m_Dir[kx] / r.m_Dir[kz];
+		sy = -r.m_Dir[ky] / r.m_Dir[kz];
+		sz = 1.0f / r.m_Dir[kz];
+		for( unsigned axis = 0 ; axis < 3 ; ++axis )
+			ori[axis] = r.m_Ori[axis];
+	}
+};
+
+// the conservative bound of the rounding error of the scaled distance of a hit , hits closer than it are rejected
+// para 'max_x' , 'max_y' , 'max_z' : the largest magnitudes of the sheared vertexes along each axis
+// para 'max_e'                     : the largest magnitude of the edge functions
+// para 'inv_det'                   : the reciprocal of the sum of the edge functions
+inline float WatertightErrorBound( float max_x , float max_y , float max_z , float max_e , float inv_det )
+{
+	const float delta_z = ErrorBound( 3 ) * max_z;
+	const float delta_x = ErrorBound( 5 ) * ( max_x + max_z );
+	const float delta_y = ErrorBound( 5 ) * ( max_y + max_z );
+	const float delta_e = 2.0f * ( ErrorBound( 2 ) * max_x * max_y + delta_y * max_x + delta_x * max_y );
+	return 3.0f * ( ErrorBound( 3 ) * max_e * max_z + delta_e * max_z + delta_z * max_e ) * fabs( inv_det );
+}
+
+// watertight intersection test between a ray and a triangle
+// note : a ray passing exactly through an edge or a vertex hits all triangles sharing it
+// para 'r'            : the sheared ray
+// para 'p0' , 'p1' , 'p2' : the vertexes of the triangle
+// para 't'            : the distance of the hit
+// para 'u' , 'v'      : the barycentric coordinates of the hit , they are the weights of 'p1' and 'p2'
+// result              : whether the triangle is hit in front of the origin , the range of the ray is not checked
+inline bool IntersectTriangle( const ShearedRay& r , const Point& p0 , const Point& p1 , const Point& p2 , float& t , float& u , float& v )
+{
+	// the vertexes are moved to the origin of the ray , then permuted and sheared
+	const Point* p[3] = { &p0 , &p1 , &p2 };
+	float x[3] , y[3] , z[3];
+	for( unsigned k = 0 ; k < 3 ; ++k ){
+		const float dx = (*p[k])[r.kx] - r.ori[r.kx];
+		const float dy = (*p[k])[r.ky] - r.ori[r.ky];
+		const float dz = (*p[k])[r.kz] - r.ori[r.kz];
+		x[k] = dx + r.sx * dz;
+		y[k] = dy + r.sy * dz;
+		z[k] = dz * r.sz;
+	}
+
+	// the hit is inside if the edge functions don't differ in sign
+	const float e0 = x[1] * y[2] - y[1] * x[2];
+	const float e1 = x[2] * y[0] - y[2] * x[0];
+	const float e2 = x[0] * y[1] - y[0] * x[1];
+	if( ( e0 < 0.0f || e1 < 0.0f || e2 < 0.0f ) && ( e0 > 0.0f || e1 > 0.0f || e2 > 0.0f ) )
+		return false;
+	const float det = e0 + e1 + e2;
+	if( det == 0.0f )
+		return false;
+
+	const float inv_det = 1.0f / det;
+	t = ( e0 * z[0] + e1 * z[1] + e2 * z[2] ) * inv_det;
+	u = e1 * inv_det;
+	v = e2 * inv_det;
+
+	// hits within the rounding error of the distance could be behind the origin
+	const float max_x = max( max( fabs( x[0] ) , fabs( x[1] ) ) , fabs( x[2] ) );
+	const float max_y = max( max( fabs( y[0] ) , fabs( y[1] ) ) , fabs( y[2] ) );
+	const float max_z = max( max( fabs( z[0] ) , fabs( z[1] ) ) , fabs( z[2] ) );
+	const float max_e = max( max( fabs( e0 ) , fabs( e1 ) ) , fabs( e2 ) );
+	return t > WatertightErrorBound( max_x , max_y , max_z , max_e , inv_det );
+}
+
+// the number of segments each edge of a triangle is divided into by its opacity micromap , there are the square of it micro-triangles
+static const unsigned MICROMAP_SEGMENTS = 8;
+// the number of 64-bit words taken by an opacity micromap , each micro-triangle takes two bits of OPACITY_STATE
+static const unsigned MICROMAP_WORDS = MICROMAP_SEGMENTS * MICROMAP_SEGMENTS * 2 / 64;
+
+// the micro-triangle of an opacity micromap a point of a triangle falls in
+// note : the micro-triangles are laid out in rows along 'v' , each row alternates the upright ones and the flipped ones between them
+// para 'u' , 'v' : the barycentric coordinate of the point , they are the weights of the second and the third vertex
+// result         : the index of the micro-triangle
+inline unsigned MicroTriangle( float u , float v )
+{
+	const int n = (int)MICROMAP_SEGMENTS;
+	const float fu = u * n , fv = v * n;
+	const int j = min( max( (int)fv , 0 ) , n - 1 );
+	const int i = min( max( (int)fu , 0 ) , n - 1 - j );
+	const bool flipped = ( i + j < n - 1 ) && ( fu - i ) + ( fv - j ) > 1.0f;
+	return (unsigned)( j * ( 2 * n - j ) + 2 * i + ( flipped ? 1 : 0 ) );
+}
+
+// the format of the index data referred by a triangle
+enum TRI_INDEX_FORMAT
+{
+	TRI_INDEX_SEPARATE = 0 ,	// separate indexes of position , normal and texture coordinate for each corner
+	TRI_INDEX_32 ,				// one 32-bit index of a unified vertex for each corner
+	TRI_INDEX_16 ,				// one 16-bit index of a unified vertex for each corner
+};
+
 //////////////////////////////////////////////////////////////////////////////////
 //	definition of triangle
 //	note: triangle is the only primitive supported by the system.
@@ -35,15 +145,16 @@ public:
 	// para 'pid'     : primitive id
 	// para 'trimesh' : the triangle mesh it belongs to
 	// para 'index'   : the index buffer
-    Triangle( unsigned pid , const TriMesh* mesh , const VertexIndex* index , std::shared_ptr<Material>& mat):
-		Primitive(pid,mat) , m_trimesh(mesh) , m_Index(index) {}
+	// para 'mat'     : the material of the subset , it is owned by the mesh
+    Triangle( unsigned pid , const TriMesh* mesh , const VertexIndex* index , Material* mat):
+		Primitive(pid,mat) , m_trimesh(mesh) , m_Index(index) , m_IndexFormat(TRI_INDEX_SEPARATE) {}
 	// destructor
 	~Triangle(){}
 
 	// check if the triangle is intersected with the ray
 	// para 'r' : the ray to check
 	// para 'intersect' : the result storing the intersection information
-	//					  the intersection is an optimized versiion
+	//					  only the hit record is stored , it is resolved by ResolveHit afterward
 	// result   : positive value if intersect
 	virtual bool GetIntersect( const Ray& r , Intersection* intersect ) const;
 
@@ -54,17 +165,71 @@ public:
 	bool GetIntersect( const BBox& box ) const;
 
 	// get the bounding box of the triangle
-	virtual const BBox&	GetBBox() const;
+	virtual BBox	GetBBox() const;
+
+	// get the bounding box of the part of the triangle inside a bounding box
+	// para 'box' : the bounding box to clip the triangle against
+	// result     : the bounding box of the clipped triangle, it is invalid if the triangle is totally outside
+	virtual BBox GetClippedBBox( const BBox& box ) const;
 
 	// get the surface area
 	virtual float SurfaceArea() const;
 
+	// get the vertexes of the triangle in world space
+	// para 'p0' , 'p1' , 'p2' : three vertexes of the triangle
+	// result                  : always true for triangles
+	virtual bool GetTriangleVertices( Point& p0 , Point& p1 , Point& p2 ) const;
+
+	// fill the shading information of the closest hit given its barycentric coordinate
+	// para 'r'         : the ray hitting the triangle
+	// para 'intersect' : the intersection holding the hit record
+	virtual void ResolveHit( const Ray& r , Intersection* intersect ) const;
+
+	// whether the triangle is cut away at some points by the opacity of its material , it has an opacity micromap then
+	virtual bool IsCutout() const { return m_micromap != ~0u; }
+	// whether a hit of the triangle is cut away , the opacity is only evaluated if the micromap doesn't know it
+	// para 'bu' , 'bv' : the barycentric coordinate of the hit
+	virtual bool IsCutAway( float bu , float bv ) const;
+
 // protected filed
 protected:
 	// the triangle mesh
 	const TriMesh*		m_trimesh;
-	// the index
-	const VertexIndex*	m_Index;
+	// the index , its format depends on 'm_IndexFormat'
+	union
+	{
+		const VertexIndex*		m_Index;
+		const unsigned*			m_Index32;
+		const unsigned short*	m_Index16;
+	};
+	// the format of the index
+	unsigned char		m_IndexFormat;
+	// the opacity micromap in the buffer of the mesh , it takes the padding after the format , the triangle is not cut out if it is ~0
+	unsigned			m_micromap = ~0u;
+
+	// get the index of the unified vertex of a corner
+	// para 'k' : the corner of the triangle
+	int _vertexIndex( unsigned k ) const
+	{ return ( m_IndexFormat == TRI_INDEX_16 ) ? (int)m_Index16[k] : (int)m_Index32[k]; }
+	// get the indexes of the position , normal and texture coordinate of a corner
+	// para 'k' : the corner of the triangle
+	int _posIndex( unsigned k ) const;
+	int _norIndex( unsigned k ) const;
+	int _texIndex( unsigned k ) const;
+
+	// get the texture coordinate at a point of the triangle , the shading buffers have to be paged in
+	// para 'bu' , 'bv' : the barycentric coordinate of the point
+	// para 'u' , 'v'   : the texture coordinate , it is zero if the mesh has none
+	void _texCoord( float bu , float bv , float& u , float& v ) const;
+
+	// clip a triangle against a bounding box
+	// para 'p0' , 'p1' , 'p2' : three vertexes of the triangle
+	// para 'box'              : the bounding box to clip the triangle against
+	// result                  : the bounding box of the clipped polygon
+	static BBox _clip( const Point& p0 , const Point& p1 , const Point& p2 , const BBox& box );
+
+// set friend class
+friend	class	TriMesh;
 };
 
 #endif
@@ -21,16 +21,26 @@
 #include "math/point.h"
 #include "managers/meshmanager.h"
 #include "geometry/triangle.h"
-#include "geometry/instancetri.h"
+#include "geometry/meshinstance.h"
+#include "geometry/subdivision.h"
+#include "accel/accelerator.h"
 #include "log/log.h"
 #include "managers/memmanager.h"
 #include "managers/matmanager.h"
+#include "managers/meshpager.h"
+#include "utility/multithread/threadpool.h"
+#include <algorithm>
 
 // default constructor
 TriMesh::TriMesh( const string& name ):m_Name(name)
 {
 }
 
+// destructor
+TriMesh::~TriMesh()
+{
+}
+
 // load the mesh
 bool TriMesh::LoadMesh( const string& str , Transform& transform )
 {
@@ -38,15 +48,59 @@ bool TriMesh::LoadMesh( const string& str , Transform& transform )
 	m_Transform = transform;
 
 	// load the mesh
-	bool flag = MeshManager::GetSingleton().LoadMesh( str , this );
-	if( false == flag )
-		return false;
+	return MeshManager::GetSingleton().LoadMesh( str , this );
+}
+
+// bind the materials of the subsets
+void TriMesh::BindMaterials()
+{
+	// the subsets of instances are the ones of the prototype , which are bound already
+	if( !m_bInstanced )
+	{
+		for( auto& trunk : m_pMemory->m_TrunkBuffer )
+		{
+			if( trunk->m_mat || trunk->m_matName.empty() )
+				continue;
+			trunk->m_mat = MatManager::GetSingleton().FindMaterial( trunk->m_matName );
+			if( 0 == trunk->m_mat )
+				slog( WARNING , MATERIAL , stringFormat("Material named %s not found, use default material in subset \"%s\" of model %s." , trunk->m_matName.c_str() , trunk->name.c_str() , m_Name.c_str() ) );
+		}
+	}
 
 	_copyMaterial();
+}
 
+// set the motion of an instanced mesh
+bool TriMesh::SetMotion( const Transform& motion )
+{
+	m_TransformEnd = motion * m_Transform;
+	m_bMoving = m_bInstanced && m_Transform.IsAffine() && m_TransformEnd.IsAffine();
+	return m_bMoving;
+}
+
+// move the mesh
+bool TriMesh::MoveTo( const Transform& transform )
+{
+	if( m_bInstanced )
+	{
+		m_Transform = transform * Inverse( m_pMemory->m_pPrototype->m_Transform );
+		return true;
+	}
+	if( m_pMemory->m_bCompressed || m_Subdiv )
+		return false;
+
+	m_pMemory->ApplyTransform( transform * Inverse( m_Transform ) );
+	m_Transform = transform;
 	return true;
 }
 
+// take the transformation again
+void TriMesh::UpdateInstances()
+{
+	for( auto& instance : m_Instances )
+		instance->UpdateTransform();
+}
+
 // copy materials
 void TriMesh::_copyMaterial()
 {
@@ -61,31 +115,332 @@ void TriMesh::_copyMaterial()
 void TriMesh::FillTriBuf( vector<Primitive*>& vec )
 {
 	unsigned base = (unsigned)vec.size();
-	if( m_bInstanced == false )
+	if( m_bInstanced == false && m_SubdivLevel > 0 )
 	{
-		// generate the triangles
+		// the triangles are the control cage , the limit surface is tessellated on demand
+		m_TriOffset = base;
+		m_Subdiv.reset( new SubdivSurface( this , m_SubdivLevel , m_SubdivCache ) );
+		m_Subdiv->FillTriBuf( vec );
+	}else if( m_bInstanced == false )
+	{
+		m_TriOffset = base;
+
+		// the triangles are stored in one array , its capacity is reserved so that the pointers in the buffer stay valid
 		unsigned trunkNum = (unsigned)m_pMemory->m_TrunkBuffer.size();
+		size_t triNum = 0;
+		for( unsigned i = 0 ; i < trunkNum ; i++ )
+			triNum += m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer.size() / 3;
+		m_Triangles.clear();
+		m_Triangles.reserve( triNum );
+
+		// generate the triangles
 		for( unsigned i = 0 ; i < trunkNum ; i++ )
 		{
 			unsigned trunkTriNum = (unsigned)m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer.size() / 3;
 			for( unsigned k = 0 ; k < trunkTriNum ; k++ )
-				vec.push_back( new Triangle( base+k , this , &(m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer[3*k]) , m_Materials[i]) );
+			{
+				m_Triangles.push_back( Triangle( base+k , this , &(m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer[3*k]) , m_Materials[i].get() ) );
+				m_Triangles.back().SetLightLinks( m_LightLinks );
+				m_Triangles.back().SetHidden( m_Hidden );
+				m_Triangles.back().SetMediumInterface( m_HasMedia ? &m_Media : nullptr );
+				vec.push_back( &m_Triangles.back() );
+			}
 			base += (unsigned)(m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer.size() / 3);
 		}
 	}else
 	{
-		// generate the triangles
+		// generate one instance for each subset , the triangles are shared with the prototype
+		TriMesh* prototype = m_pMemory->m_pPrototype;
+		if( prototype->m_SubdivLevel > 0 )
+		{
+			slog( WARNING , GENERAL , stringFormat( "Model %s is skipped, subdivided models can't be instanced." , m_Name.c_str() ) );
+			return;
+		}
 		unsigned trunkNum = (unsigned)m_pMemory->m_TrunkBuffer.size();
 		for( unsigned i = 0 ; i < trunkNum ; i++ )
 		{
-			unsigned trunkTriNum = (unsigned)(m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer.size() / 3);
-			for( unsigned k = 0 ; k < trunkTriNum ; k++ )
-				vec.push_back( new InstanceTriangle( base+k , this , &(m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer[3*k]) , &m_Transform , m_Materials[i] ) );
-			base += (unsigned)(m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer.size() / 3);
+			if( m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer.empty() )
+				continue;
+			Accelerator* blas = prototype->_getBlas( i , vec );
+			m_Instances.push_back( std::unique_ptr<MeshInstance>( new MeshInstance( (unsigned)vec.size() , blas , &prototype->m_BlasPrimitives[i] , &m_Transform , m_bMoving ? &m_TransformEnd : nullptr , m_Materials[i].get() ) ) );
+			m_Instances.back()->SetLightLinks( m_LightLinks );
+			m_Instances.back()->SetHidden( m_Hidden );
+			m_Instances.back()->SetMediumInterface( m_HasMedia ? &m_Media : nullptr );
+			vec.push_back( m_Instances.back().get() );
 		}
 	}
 }
 
+// get the bottom level acceleration structure of a subset
+Accelerator* TriMesh::_getBlas( unsigned trunk , const vector<Primitive*>& vec )
+{
+	unsigned trunkNum = (unsigned)m_pMemory->m_TrunkBuffer.size();
+	if( m_Blas.empty() )
+	{
+		m_Blas.resize( trunkNum );
+		m_BlasPrimitives.resize( trunkNum );
+	}
+
+	if( !m_Blas[trunk] )
+	{
+		// the triangles of the subset are right after the triangles of the previous subsets
+		unsigned offset = m_TriOffset;
+		for( unsigned i = 0 ; i < trunk ; i++ )
+			offset += (unsigned)(m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer.size() / 3);
+		unsigned trunkTriNum = (unsigned)(m_pMemory->m_TrunkBuffer[trunk]->m_IndexBuffer.size() / 3);
+		m_BlasPrimitives[trunk].assign( vec.begin() + offset , vec.begin() + offset + trunkTriNum );
+
+		// bvh always reports closer hits only , which is what mesh instances rely on , it is refitted once the mesh moves
+		m_Blas[trunk] = std::unique_ptr<Accelerator>( CREATE_TYPE( "bvh" , Accelerator ) );
+		m_Blas[trunk]->SetPrimitives( &m_BlasPrimitives[trunk] );
+		m_Blas[trunk]->SetProperty( "refit" , "1" );
+	}
+	return m_Blas[trunk].get();
+}
+
+// build the bottom level acceleration structures
+void TriMesh::BuildBlas()
+{
+	size_t bytes = 0;
+	for( auto& blas : m_Blas )
+	{
+		if( blas )
+		{
+			blas->Build();
+			bytes += blas->GetMemoryUsage();
+		}
+	}
+	m_BlasMemory.Set( bytes );
+}
+
+// reorder the index data of the triangles
+void TriMesh::ReorderTriangles( const vector<Primitive*>& vec , const vector<unsigned>& rank , bool vertices )
+{
+	// the triangles of instanced meshes belong to the prototype , subdivided meshes have patches instead
+	if( m_bInstanced || m_Subdiv )
+		return;
+
+	unsigned offset = m_TriOffset;
+	unsigned trunkNum = (unsigned)m_pMemory->m_TrunkBuffer.size();
+	for( unsigned i = 0 ; i < trunkNum ; i++ )
+	{
+		auto& trunk = m_pMemory->m_TrunkBuffer[i];
+		unsigned trunkTriNum = (unsigned)( trunk->m_IndexBuffer.size() / 3 );
+
+		// triangles of the subset stay in the subset , they are sorted by their ranks
+		vector<unsigned> order( trunkTriNum );
+		for( unsigned k = 0 ; k < trunkTriNum ; k++ )
+			order[k] = offset + k;
+		std::stable_sort( order.begin() , order.end() , [&]( unsigned a , unsigned b ){ return rank[a] < rank[b]; } );
+
+		MeshBuffer<VertexIndex> indices( trunk->m_IndexBuffer.size() );
+		for( unsigned k = 0 ; k < trunkTriNum ; k++ )
+		{
+			const Triangle* triangle = static_cast<const Triangle*>( vec[order[k]] );
+			for( unsigned j = 0 ; j < 3 ; j++ )
+				indices[3*k+j] = triangle->m_Index[j];
+		}
+		trunk->m_IndexBuffer.swap( indices );
+		for( unsigned k = 0 ; k < trunkTriNum ; k++ )
+			static_cast<Triangle*>( vec[order[k]] )->m_Index = &trunk->m_IndexBuffer[3*k];
+
+		offset += trunkTriNum;
+	}
+
+	if( vertices )
+		m_pMemory->ReorderVertices();
+}
+
+// replace the index data of the triangles with compact indexes
+void TriMesh::CompactIndices( const vector<Primitive*>& vec )
+{
+	// the triangles of instanced meshes belong to the prototype
+	if( m_bInstanced || m_Subdiv || !m_pMemory->HasUnifiedVertices() )
+		return;
+
+	const bool small = m_pMemory->GetPositionCount() <= 65536;
+	unsigned offset = m_TriOffset;
+	unsigned trunkNum = (unsigned)m_pMemory->m_TrunkBuffer.size();
+	for( unsigned i = 0 ; i < trunkNum ; i++ )
+	{
+		auto& trunk = m_pMemory->m_TrunkBuffer[i];
+		unsigned trunkTriNum = (unsigned)( trunk->m_IndexBuffer.size() / 3 );
+		if( small )
+		{
+			trunk->m_CompactIndex16.resize( trunk->m_IndexBuffer.size() );
+			for( unsigned k = 0 ; k < (unsigned)trunk->m_IndexBuffer.size() ; k++ )
+				trunk->m_CompactIndex16[k] = (unsigned short)trunk->m_IndexBuffer[k].posIndex;
+		}
+		else
+		{
+			trunk->m_CompactIndex32.resize( trunk->m_IndexBuffer.size() );
+			for( unsigned k = 0 ; k < (unsigned)trunk->m_IndexBuffer.size() ; k++ )
+				trunk->m_CompactIndex32[k] = (unsigned)trunk->m_IndexBuffer[k].posIndex;
+		}
+
+		// triangles may have been reordered , they are matched with their index data by address
+		for( unsigned k = 0 ; k < trunkTriNum ; k++ )
+		{
+			Triangle* triangle = static_cast<Triangle*>( vec[offset+k] );
+			const unsigned corner = (unsigned)( triangle->m_Index - trunk->m_IndexBuffer.data() );
+			if( small )
+			{
+				triangle->m_Index16 = &trunk->m_CompactIndex16[corner];
+				triangle->m_IndexFormat = TRI_INDEX_16;
+			}
+			else
+			{
+				triangle->m_Index32 = &trunk->m_CompactIndex32[corner];
+				triangle->m_IndexFormat = TRI_INDEX_32;
+			}
+		}
+		MeshBuffer<VertexIndex>().swap( trunk->m_IndexBuffer );
+
+		offset += trunkTriNum;
+	}
+	m_pMemory->UpdateMemoryUsage();
+}
+
+// replace the buffers of the mesh with copies shared with other processes on the host
+void TriMesh::ShareBuffers( const vector<Primitive*>& vec )
+{
+	// the buffers of instanced meshes belong to the prototype , the patches of subdivided meshes refer to the cage by position
+	if( m_bInstanced )
+		return;
+
+	// each triangle points to its corners in the index data of its subset , it is moved to the same corners in the shared copy
+	const auto& trunks = m_pMemory->m_TrunkBuffer;
+	vector<const VertexIndex*> separate( trunks.size() );
+	vector<const unsigned*> index32( trunks.size() );
+	vector<const unsigned short*> index16( trunks.size() );
+	for( unsigned i = 0 ; i < (unsigned)trunks.size() ; i++ )
+	{
+		separate[i] = trunks[i]->m_IndexBuffer.data();
+		index32[i] = trunks[i]->m_CompactIndex32.data();
+		index16[i] = trunks[i]->m_CompactIndex16.data();
+	}
+
+	m_pMemory->ShareBuffers();
+	if( m_Subdiv )
+		return;
+
+	unsigned offset = m_TriOffset;
+	for( unsigned i = 0 ; i < (unsigned)trunks.size() ; i++ )
+	{
+		// one of the index buffers holds the corners of the subset , the separate one is released once compacted
+		const auto& trunk = trunks[i];
+		const unsigned trunkTriNum = (unsigned)( std::max( trunk->m_IndexBuffer.size() , std::max( trunk->m_CompactIndex32.size() , trunk->m_CompactIndex16.size() ) ) / 3 );
+		for( unsigned k = 0 ; k < trunkTriNum ; k++ )
+		{
+			Triangle* triangle = static_cast<Triangle*>( vec[offset+k] );
+			if( triangle->m_IndexFormat == TRI_INDEX_16 )
+				triangle->m_Index16 = trunk->m_CompactIndex16.data() + ( triangle->m_Index16 - index16[i] );
+			else if( triangle->m_IndexFormat == TRI_INDEX_32 )
+				triangle->m_Index32 = trunk->m_CompactIndex32.data() + ( triangle->m_Index32 - index32[i] );
+			else
+				triangle->m_Index = trunk->m_IndexBuffer.data() + ( triangle->m_Index - separate[i] );
+		}
+		offset += trunkTriNum;
+	}
+}
+
+// whether any material of the mesh needs tangents
+bool TriMesh::NeedsTangent() const
+{
+	for( const auto& mat : m_Materials )
+		if( mat && mat->NeedsTangent() )
+			return true;
+	return false;
+}
+
+// whether any material of the mesh cuts surfaces away
+bool TriMesh::HasOpacity() const
+{
+	for( const auto& mat : m_Materials )
+		if( mat && mat->HasOpacity() )
+			return true;
+	return false;
+}
+
+// bake the opacity micromaps of the triangles
+unsigned TriMesh::BakeMicromaps()
+{
+	m_Micromaps.clear();
+	for( auto& triangle : m_Triangles )
+		triangle.m_micromap = ~0u;
+	m_MicromapMemory.Set( 0 );
+
+	// the triangles of instanced meshes belong to the prototype , subdivided meshes have patches instead
+	if( m_bInstanced || m_Subdiv || !HasOpacity() )
+		return 0;
+
+	// each micro-triangle is sampled at the lattice points on and inside it , neighbours share the points on their edges
+	const unsigned n = MICROMAP_SEGMENTS;
+	const unsigned s = 2;
+	const unsigned m = n * s;
+	const unsigned count = (unsigned)m_Triangles.size();
+	vector<unsigned long long> maps( (size_t)MICROMAP_WORDS * count , 0 );
+	vector<char> cutout( count , 0 );
+
+	MeshPageScope page( m_pMemory->m_page );
+	ParallelFor( 0 , count , 64 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		vector<char> kept( ( m + 1 ) * ( m + 1 ) );
+		for( unsigned k = chunk_start ; k < chunk_end ; ++k )
+		{
+			const Triangle& triangle = m_Triangles[k];
+			const Material* mat = triangle.GetMaterial();
+			if( !mat->HasOpacity() )
+				continue;
+
+			for( unsigned b = 0 ; b <= m ; ++b )
+				for( unsigned a = 0 ; a + b <= m ; ++a )
+				{
+					float u , v;
+					triangle._texCoord( (float)a / m , (float)b / m , u , v );
+					kept[ b * ( m + 1 ) + a ] = !mat->IsCutAway( u , v );
+				}
+
+			// the upright micro-triangle at ( i , j ) covers the samples below the diagonal of its square , the flipped one the rest
+			bool opaque = true;
+			unsigned long long* map = &maps[ (size_t)MICROMAP_WORDS * k ];
+			for( unsigned j = 0 ; j < n ; ++j )
+				for( unsigned i = 0 ; i + j < n ; ++i )
+					for( unsigned flipped = 0 ; flipped < 2 && ( flipped == 0 || i + j + 1 < n ) ; ++flipped )
+					{
+						unsigned kept_cnt = 0 , total = 0;
+						for( unsigned b = s * j ; b <= s * ( j + 1 ) ; ++b )
+							for( unsigned a = s * i ; a <= s * ( i + 1 ) ; ++a )
+							{
+								const unsigned d = ( a - s * i ) + ( b - s * j );
+								if( flipped ? d < s : d > s )
+									continue;
+								kept_cnt += kept[ b * ( m + 1 ) + a ];
+								++total;
+							}
+
+						const OPACITY_STATE state = ( kept_cnt == total ) ? OPACITY_OPAQUE : ( kept_cnt == 0 ) ? OPACITY_TRANSPARENT : OPACITY_UNKNOWN;
+						const unsigned micro = j * ( 2 * n - j ) + 2 * i + flipped;
+						map[ micro / 32 ] |= (unsigned long long)state << ( 2 * ( micro % 32 ) );
+						opaque &= ( state == OPACITY_OPAQUE );
+					}
+			cutout[k] = !opaque;
+		}
+	});
+
+	// only the triangles cut away somewhere keep their micromaps
+	unsigned cutout_cnt = 0;
+	for( unsigned k = 0 ; k < count ; ++k )
+	{
+		if( !cutout[k] )
+			continue;
+		m_Triangles[k].m_micromap = cutout_cnt++;
+		m_Micromaps.insert( m_Micromaps.end() , maps.begin() + (size_t)MICROMAP_WORDS * k , maps.begin() + (size_t)MICROMAP_WORDS * ( k + 1 ) );
+	}
+	m_Micromaps.shrink_to_fit();
+	m_MicromapMemory.Set( m_Micromaps.size() * sizeof( unsigned long long ) );
+	return cutout_cnt;
+}
+
 // reset material
 void TriMesh::ResetMaterial( const string& setname , const string& matname )
 {
@@ -111,6 +466,29 @@ void TriMesh::ResetMaterial( const string& setname , const string& matname )
 	m_Materials[id] = mat;
 }
 
+// get the triangles of a subset
+bool TriMesh::GetSubsetTriangles( const string& setname , const vector<Primitive*>& vec , vector<Primitive*>& triangles )
+{
+	if( m_bInstanced || m_Subdiv )
+		return false;
+
+	const int id = setname.empty() ? -1 : _getSubsetID( setname );
+	if( !setname.empty() && id < 0 )
+		return false;
+
+	// the triangles of each subset are right after the triangles of the previous subsets
+	unsigned offset = m_TriOffset;
+	unsigned trunkNum = (unsigned)m_pMemory->m_TrunkBuffer.size();
+	for( unsigned i = 0 ; i < trunkNum ; i++ )
+	{
+		unsigned trunkTriNum = (unsigned)( m_pMemory->m_TrunkBuffer[i]->m_IndexBuffer.size() / 3 );
+		if( id < 0 || (unsigned)id == i )
+			triangles.insert( triangles.end() , vec.begin() + offset , vec.begin() + offset + trunkTriNum );
+		offset += trunkTriNum;
+	}
+	return true;
+}
+
 // get the subset of the mesh
 int TriMesh::_getSubsetID( const string& setname )
 {
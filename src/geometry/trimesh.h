@@ -20,11 +20,18 @@
 
 // include the headers
 #include <vector>
+#include <memory>
 #include "primitive.h"
+#include "triangle.h"
 #include "managers/meshmanager.h"
-#include "math/transform.h"
+#include "math/transform.h"
+#include "medium/medium.h"
 
 class	Material;
+class	Accelerator;
+class	MeshInstance;
+class	SubdivSurface;
+class	SubdivCache;
 
 //////////////////////////////////////////////////////////////////////////////////
 //	definition of trimesh
@@ -34,23 +41,90 @@ class TriMesh
 public:
 	// default constructor
 	TriMesh(const string& name);
+	// destructor
+	~TriMesh();
     
 	// load the mesh from file
 	// para 'str'  : the name of the input file
 	// para 'transform' : the transformation of the mesh
 	// para 'type' : the type of the mesh file , default value is obj
 	// result      : 'true' if loading is successful
+	// note        : only the names of the materials are known afterward , they are bound by 'BindMaterials' , so
+	//				 meshes could be read while the material libraries are still parsed
 	bool LoadMesh( const string& str , Transform& transform );
 
+	// bind the materials of the subsets by their names
+	// note     : the material libraries have to be parsed , the prototype of an instanced mesh has to be bound first
+	void BindMaterials();
+
 	// fill buffer into vector
 	// para 'vec' : the buffer to filled
+	// note     : an instanced mesh fills one mesh instance for each subset instead of triangles , a subdivided
+	//			  mesh fills one patch for each face of its control cage , the primitives are owned by the mesh ,
+	//			  the buffer only refers to them
 	void FillTriBuf( vector<Primitive*>& vec );
 
+	// build the bottom level acceleration structures shared by the instances of the mesh
+	void BuildBlas();
+
+	// reorder the index data of the triangles in each subset by their ranks
+	// para 'vec'      : the triangle buffer holding the triangles of the mesh
+	// para 'rank'     : the rank of each primitive in the triangle buffer , triangles with the same rank keep their relative order
+	// para 'vertices' : whether the vertex data is renumbered in the new order of triangles too
+	// note     : the triangles themselves are not moved , so the primitives referenced by accelerators and their ids stay valid
+	void ReorderTriangles( const vector<Primitive*>& vec , const vector<unsigned>& rank , bool vertices );
+
+	// replace the index data of the triangles with one 32-bit or 16-bit index per corner
+	// para 'vec' : the triangle buffer holding the triangles of the mesh
+	// note     : it only applies if every corner refers to a unified vertex , e.g. after welding the vertexes ,
+	//			  the separate indexes are released afterward , so it is the last step touching the index data
+	void CompactIndices( const vector<Primitive*>& vec );
+
+	// replace the buffers of the mesh with copies shared with other processes on the host
+	// para 'vec' : the triangle buffer holding the triangles of the mesh
+	// note     : the buffers have to be final , the triangles are pointed to the shared index data
+	void ShareBuffers( const vector<Primitive*>& vec );
+
 	// reset material
 	// para 'setname' : the subset to set material
 	// para 'matname' : the material name
 	void ResetMaterial( const string& setname , const string& matname );
 
+	// get the triangles of a subset
+	// para 'setname'   : the subset , all of the triangles are returned if it is empty
+	// para 'vec'       : the triangle buffer holding the triangles of the mesh
+	// para 'triangles' : the triangles of the subset ( output )
+	// result           : false if the subset doesn't exist or the mesh is instanced , its triangles belong to the prototype
+	bool GetSubsetTriangles( const string& setname , const vector<Primitive*>& vec , vector<Primitive*>& triangles );
+
+	// whether any material of the mesh needs tangents
+	bool NeedsTangent() const;
+
+	// whether any material of the mesh cuts surfaces away by its opacity
+	bool HasOpacity() const;
+
+	// bake the opacity micromaps of the triangles cut away at some points by their materials
+	// note     : the opacity is sampled on a lattice of each triangle , a micro-triangle is only known to be kept or cut away
+	//			  if all samples on it agree , triangles kept everywhere have no micromap and are never checked during traversal
+	// result   : the number of triangles with micromaps
+	unsigned BakeMicromaps();
+
+	// set the motion of an instanced mesh , it moves the mesh from its transformation at the start of the frame to the one at the end
+	// para 'motion' : the motion applied on top of the transformation of the mesh
+	// result        : false if the mesh is not instanced or either transformation is not affine , the mesh doesn't move then
+	// note          : the vertexes of a mesh loading its file first are transformed already , only instances of it could move
+	bool SetMotion( const Transform& motion );
+
+	// move the mesh to another place , e.g. in the next frame of an animation
+	// para 'transform' : the transformation of the model in world space
+	// result           : false if the vertexes can't be transformed again , i.e. they are compressed or subdivided
+	// note             : the vertexes of a mesh loading its file first are transformed by the difference , its acceleration
+	//					  structures and its instances have to be updated afterward , instances only change their transformation
+	bool MoveTo( const Transform& transform );
+
+	// take the transformation again in the primitives of an instanced mesh after it or its prototype moved
+	void UpdateInstances();
+
 // private field
 public:
 	// the name of the model
@@ -62,17 +136,59 @@ public:
 	// whether the mesh is instanced
 	bool			m_bInstanced;
 
+	// the transformation at the end of the frame , it is only used if the mesh moves
+	Transform		m_TransformEnd;
+	bool			m_bMoving = false;
+
     // the memory for the mesh
     std::shared_ptr<BufferMemory>  m_pMemory;
     
 	// the materials for instanced mesh
     std::vector<std::shared_ptr<Material>>      m_Materials;
 
+	// the light linking sets the mesh receives light from , one bit for each set
+	unsigned		m_LightLinks = ~0u;
+	// the kinds of rays the mesh is hidden from , one bit of RAY_TYPE for each kind
+	unsigned		m_Hidden = 0;
+
+	// the media on both sides of the surface of the mesh
+	MediumInterface	m_Media;
+	// whether the mesh bounds any medium , its primitives refer to 'm_Media' only if it does
+	bool			m_HasMedia = false;
+
+	// offset of the triangles of the mesh in the triangle buffer of the scene
+	unsigned		m_TriOffset = 0;
+	// the triangles of the mesh in the order of the subsets , they take one allocation for the whole mesh
+	std::vector<Triangle>						m_Triangles;
+	// the opacity micromaps of the cut out triangles , each of them takes MICROMAP_WORDS words
+	std::vector<unsigned long long>				m_Micromaps;
+	// the memory taken by the opacity micromaps
+	MemoryTracker								m_MicromapMemory{ MEM_MESH };
+	// the instances of the subsets , they are only created for instanced meshes
+	std::vector<std::unique_ptr<MeshInstance>>	m_Instances;
+	// the triangles of each subset , they are only kept for meshes being instanced
+	std::vector<vector<Primitive*>>				m_BlasPrimitives;
+	// the bottom level acceleration structures of each subset , shared by all instances of the mesh
+	std::vector<std::unique_ptr<Accelerator>>	m_Blas;
+	// the memory taken by the bottom level acceleration structures
+	MemoryTracker								m_BlasMemory{ MEM_ACCELERATOR };
+
+	// the deepest level the triangles are subdivided to as the control cage of a Catmull-Clark surface , zero keeps the triangles
+	unsigned									m_SubdivLevel = 0;
+	// the cache of the tessellated patches , it belongs to the scene
+	SubdivCache*								m_SubdivCache = nullptr;
+	// the subdivision surface , it is only created for subdivided meshes
+	std::unique_ptr<SubdivSurface>				m_Subdiv;
+
 // private method
 	// get the subset of the mesh
 	int		_getSubsetID( const string& setname );
 	// copy materials
 	void	_copyMaterial();
+	// get the bottom level acceleration structure of a subset , it is created the first time it is requested
+	// para 'trunk' : the id of the subset
+	// para 'vec'   : the triangle buffer holding the triangles of the mesh
+	Accelerator*	_getBlas( unsigned trunk , const vector<Primitive*>& vec );
 
 // set friend class
 friend	class	MeshManager;
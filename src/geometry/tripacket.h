@@ -0,0 +1,327 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "primitive.h"
+#include "triangle.h"
+#include "ray.h"
+
+#if defined(SORT_SIMD_SSE)
+#include <xmmintrin.h>
+#endif
+
+//! @brief Get the kind of a primitive in packets and its world space data.
+//! @param pri      The primitive.
+//! @param p0       The first vertex of a triangle or the center of an analytic shape.
+//! @param e1       The second vertex of a triangle or the first axis of an analytic shape.
+//! @param e2       The third vertex of a triangle or the second axis of an analytic shape.
+//! @return         The kind of the primitive, it is PACKET_GENERIC if it is tested with its own intersection routine.
+inline PACKET_TYPE PacketType( const Primitive* pri , Point& p0 , Vector& e1 , Vector& e2 )
+{
+    Point p1 , p2;
+    if( pri->GetTriangleVertices( p0 , p1 , p2 ) ){
+        // the vertexes are kept as they are, edges rebuilt from them would break the watertight test
+        e1 = Vector( p1.x , p1.y , p1.z );
+        e2 = Vector( p2.x , p2.y , p2.z );
+        return PACKET_TRIANGLE;
+    }
+    return pri->GetAnalyticShape( p0 , e1 , e2 );
+}
+
+//! @brief Four primitives of the same kind with precomputed world space data stored in SoA layout.
+/**
+ * Leaves of accelerators store their primitives in packets so that one SIMD watertight
+ * test covers four triangles without touching the index and vertex buffers of the mesh.
+ * Spheres, disks and rectangles of area lights are stored the same way with their centers and
+ * axes and tested with their own SIMD loops. Only primitives of the same kind share a packet,
+ * so a leaf never mixes virtual calls with SIMD tests. Primitives that are neither triangles
+ * nor analytic shapes are kept in generic packets and tested with their own intersection routine.
+ */
+struct alignas(16) TrianglePacket
+{
+    float               p0[3][4];       /**< The first vertex of each triangle, or the center of each analytic shape. */
+    float               e1[3][4];       /**< The second vertex of each triangle, or the first axis of each analytic shape. */
+    float               e2[3][4];       /**< The third vertex of each triangle, or the second axis of each analytic shape. */
+    const Primitive*    primitive[4];   /**< The primitive of each lane, it is nullptr for empty lanes. */
+    unsigned            type;           /**< The kind of the primitives in the packet, it is one of PACKET_TYPE. */
+    unsigned            count;          /**< The number of lanes holding primitives, empty lanes are always the last ones. */
+    unsigned            hidden;         /**< The kinds of rays each lane is hidden from, eight bits for each lane. It takes the padding of the packet. */
+    unsigned            cutout;         /**< The lanes whose hits could be cut away by the opacity of the material, one bit for each lane. */
+
+    //! @brief Fill the packet with up to four primitives of the same kind.
+    //! @param pris     The primitives to be packed, all of them have to be of the same kind.
+    //! @param _count   The number of primitives, it is between one and four.
+    //! @return         False if the primitives are not of the same kind.
+    bool Pack( const Primitive* const* pris , unsigned _count ){
+        bool same = true;
+        count = _count;
+        hidden = 0;
+        cutout = 0;
+        for( unsigned i = 0 ; i < 4 ; ++i ){
+            Point v0;
+            Vector _e1 , _e2;
+            primitive[i] = ( i < count ) ? pris[i] : nullptr;
+            if( primitive[i] ){
+                hidden |= primitive[i]->GetHidden() << ( 8 * i );
+                cutout |= primitive[i]->IsCutout() ? ( 1 << i ) : 0;
+            }
+            const PACKET_TYPE lane = primitive[i] ? PacketType( primitive[i] , v0 , _e1 , _e2 ) : PACKET_GENERIC;
+            if( i == 0 )
+                type = lane;
+            else if( primitive[i] )
+                same &= ( lane == type );
+            // lanes without a triangle have all vertexes at the same point so that they are never hit
+            if( primitive[i] == nullptr || type == PACKET_GENERIC )
+                v0 = Point() , _e1 = _e2 = Vector();
+            for( unsigned axis = 0 ; axis < 3 ; ++axis ){
+                p0[axis][i] = v0[axis];
+                e1[axis][i] = _e1[axis];
+                e2[axis][i] = _e2[axis];
+            }
+        }
+        return same;
+    }
+
+    //! @brief Get the lanes hidden from a kind of rays.
+    //! @param type     The kind of the ray, it is one of RAY_TYPE.
+    //! @return         A bit mask of lanes to be skipped, it is zero for packets seen by all rays.
+    unsigned HiddenLanes( unsigned type ) const {
+        if( ( hidden & ( type * 0x01010101u ) ) == 0 )
+            return 0;
+        unsigned lanes = 0;
+        for( unsigned i = 0 ; i < 4 ; ++i )
+            lanes |= ( ( hidden >> ( 8 * i ) ) & type ) ? ( 1 << i ) : 0;
+        return lanes;
+    }
+
+    //! @brief Get the kinds of rays all primitives of the packet are hidden from.
+    //! @return         Bits of RAY_TYPE shared by all lanes holding primitives.
+    unsigned HiddenFromAll() const {
+        unsigned all = RAY_ALL;
+        for( unsigned i = 0 ; i < count ; ++i )
+            all &= hidden >> ( 8 * i );
+        return all & 0xff;
+    }
+};
+
+//! @brief Intersection test between a ray and the triangles of a packet.
+//!
+//! The arithmetic follows IntersectTriangle operation by operation, so the results of
+//! each lane are exactly the same with testing the triangle alone.
+//! @param packet   The triangle packet to be tested.
+//! @param r        The ray to be tested.
+//! @param t        The distance of the hit of each lane, it is only valid for lanes being hit.
+//! @param u        The first barycentric coordinate of the hit of each lane.
+//! @param v        The second barycentric coordinate of the hit of each lane.
+//! @return         A bit mask of lanes being hit within the range of the ray.
+inline unsigned IntersectPacket( const TrianglePacket& packet , const Ray& r , float t[4] , float u[4] , float v[4] )
+{
+    const ShearedRay sr( r );
+#if defined(SORT_SIMD_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps( -0.0f );
+    const __m128 sx = _mm_set1_ps( sr.sx ) , sy = _mm_set1_ps( sr.sy ) , sz = _mm_set1_ps( sr.sz );
+    const __m128 ox = _mm_set1_ps( sr.ori[sr.kx] ) , oy = _mm_set1_ps( sr.ori[sr.ky] ) , oz = _mm_set1_ps( sr.ori[sr.kz] );
+
+    // the vertexes are moved to the origin of the ray , then permuted and sheared
+    const float (*vertex[3])[4] = { packet.p0 , packet.e1 , packet.e2 };
+    __m128 x[3] , y[3] , z[3];
+    for( unsigned k = 0 ; k < 3 ; ++k ){
+        const __m128 dx = _mm_sub_ps( _mm_load_ps( vertex[k][sr.kx] ) , ox );
+        const __m128 dy = _mm_sub_ps( _mm_load_ps( vertex[k][sr.ky] ) , oy );
+        const __m128 dz = _mm_sub_ps( _mm_load_ps( vertex[k][sr.kz] ) , oz );
+        x[k] = _mm_add_ps( dx , _mm_mul_ps( sx , dz ) );
+        y[k] = _mm_add_ps( dy , _mm_mul_ps( sy , dz ) );
+        z[k] = _mm_mul_ps( dz , sz );
+    }
+
+    // the hit is inside if the edge functions don't differ in sign
+    const __m128 e0 = _mm_sub_ps( _mm_mul_ps( x[1] , y[2] ) , _mm_mul_ps( y[1] , x[2] ) );
+    const __m128 e1 = _mm_sub_ps( _mm_mul_ps( x[2] , y[0] ) , _mm_mul_ps( y[2] , x[0] ) );
+    const __m128 e2 = _mm_sub_ps( _mm_mul_ps( x[0] , y[1] ) , _mm_mul_ps( y[0] , x[1] ) );
+    const __m128 neg = _mm_or_ps( _mm_or_ps( _mm_cmplt_ps( e0 , zero ) , _mm_cmplt_ps( e1 , zero ) ) , _mm_cmplt_ps( e2 , zero ) );
+    const __m128 pos = _mm_or_ps( _mm_or_ps( _mm_cmpgt_ps( e0 , zero ) , _mm_cmpgt_ps( e1 , zero ) ) , _mm_cmpgt_ps( e2 , zero ) );
+    const __m128 det = _mm_add_ps( _mm_add_ps( e0 , e1 ) , e2 );
+    __m128 valid = _mm_andnot_ps( _mm_and_ps( neg , pos ) , _mm_cmpneq_ps( det , zero ) );
+
+    const __m128 inv = _mm_div_ps( _mm_set1_ps( 1.0f ) , det );
+    const __m128 _t = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( e0 , z[0] ) , _mm_mul_ps( e1 , z[1] ) ) , _mm_mul_ps( e2 , z[2] ) ) , inv );
+    const __m128 _u = _mm_mul_ps( e1 , inv );
+    const __m128 _v = _mm_mul_ps( e2 , inv );
+
+    // hits within the rounding error of the distance could be behind the origin , it is the same with WatertightErrorBound
+    const __m128 max_x = _mm_max_ps( _mm_max_ps( _mm_andnot_ps( sign , x[0] ) , _mm_andnot_ps( sign , x[1] ) ) , _mm_andnot_ps( sign , x[2] ) );
+    const __m128 max_y = _mm_max_ps( _mm_max_ps( _mm_andnot_ps( sign , y[0] ) , _mm_andnot_ps( sign , y[1] ) ) , _mm_andnot_ps( sign , y[2] ) );
+    const __m128 max_z = _mm_max_ps( _mm_max_ps( _mm_andnot_ps( sign , z[0] ) , _mm_andnot_ps( sign , z[1] ) ) , _mm_andnot_ps( sign , z[2] ) );
+    const __m128 max_e = _mm_max_ps( _mm_max_ps( _mm_andnot_ps( sign , e0 ) , _mm_andnot_ps( sign , e1 ) ) , _mm_andnot_ps( sign , e2 ) );
+    const __m128 g2 = _mm_set1_ps( ErrorBound( 2 ) ) , g3 = _mm_set1_ps( ErrorBound( 3 ) ) , g5 = _mm_set1_ps( ErrorBound( 5 ) );
+    const __m128 delta_z = _mm_mul_ps( g3 , max_z );
+    const __m128 delta_x = _mm_mul_ps( g5 , _mm_add_ps( max_x , max_z ) );
+    const __m128 delta_y = _mm_mul_ps( g5 , _mm_add_ps( max_y , max_z ) );
+    const __m128 delta_e = _mm_mul_ps( _mm_set1_ps( 2.0f ) , _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_mul_ps( g2 , max_x ) , max_y ) , _mm_mul_ps( delta_y , max_x ) ) , _mm_mul_ps( delta_x , max_y ) ) );
+    const __m128 delta_t = _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 3.0f ) , _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_mul_ps( g3 , max_e ) , max_z ) , _mm_mul_ps( delta_e , max_z ) ) , _mm_mul_ps( delta_z , max_e ) ) ) , _mm_andnot_ps( sign , inv ) );
+    valid = _mm_and_ps( valid , _mm_cmpgt_ps( _t , delta_t ) );
+    valid = _mm_and_ps( valid , _mm_and_ps( _mm_cmpnlt_ps( _t , _mm_set1_ps( r.m_fMin ) ) , _mm_cmpngt_ps( _t , _mm_set1_ps( r.m_fMax ) ) ) );
+
+    _mm_storeu_ps( t , _t );
+    _mm_storeu_ps( u , _u );
+    _mm_storeu_ps( v , _v );
+    return (unsigned)_mm_movemask_ps( valid );
+#else
+    unsigned mask = 0;
+    for( unsigned i = 0 ; i < 4 ; ++i ){
+        const Point p0( packet.p0[0][i] , packet.p0[1][i] , packet.p0[2][i] );
+        const Point p1( packet.e1[0][i] , packet.e1[1][i] , packet.e1[2][i] );
+        const Point p2( packet.e2[0][i] , packet.e2[1][i] , packet.e2[2][i] );
+        if( !IntersectTriangle( sr , p0 , p1 , p2 , t[i] , u[i] , v[i] ) )
+            continue;
+        if( t[i] < r.m_fMin || t[i] > r.m_fMax )
+            continue;
+        mask |= ( 1 << i );
+    }
+    return mask;
+#endif
+}
+
+//! @brief Intersection test between a ray and the spheres of a packet.
+//!
+//! The arithmetic follows Sphere::_getIntersect with the ray moved to the center of each sphere instead
+//! of transforming it into the local space of the sphere, which is the same since the transformation is rigid.
+//! @param packet   The packet of spheres, the first component of 'e1' is the radius.
+//! @param r        The ray to be tested.
+//! @param t        The distance of the hit of each lane, it is only valid for lanes being hit.
+//! @return         A bit mask of lanes being hit within the range of the ray.
+inline unsigned IntersectSpherePacket( const TrianglePacket& packet , const Ray& r , float t[4] )
+{
+    const unsigned lanes = ( 1 << packet.count ) - 1;
+#if defined(SORT_SIMD_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 dx = _mm_set1_ps( r.m_Dir.x ) , dy = _mm_set1_ps( r.m_Dir.y ) , dz = _mm_set1_ps( r.m_Dir.z );
+    const __m128 ox = _mm_sub_ps( _mm_set1_ps( r.m_Ori.x ) , _mm_load_ps( packet.p0[0] ) );
+    const __m128 oy = _mm_sub_ps( _mm_set1_ps( r.m_Ori.y ) , _mm_load_ps( packet.p0[1] ) );
+    const __m128 oz = _mm_sub_ps( _mm_set1_ps( r.m_Ori.z ) , _mm_load_ps( packet.p0[2] ) );
+    const __m128 radius = _mm_load_ps( packet.e1[0] );
+
+    // b = 2 * Dot( dir , o ) , c = Dot( o , o ) - radius * radius
+    const __m128 b = _mm_mul_ps( _mm_set1_ps( 2.0f ) , _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx , ox ) , _mm_mul_ps( dy , oy ) ) , _mm_mul_ps( dz , oz ) ) );
+    const __m128 c = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( ox , ox ) , _mm_mul_ps( oy , oy ) ) , _mm_mul_ps( oz , oz ) ) , _mm_mul_ps( radius , radius ) );
+    const __m128 delta = _mm_sub_ps( _mm_mul_ps( b , b ) , _mm_mul_ps( _mm_set1_ps( 4.0f ) , c ) );
+    __m128 valid = _mm_cmpge_ps( delta , zero );
+
+    // the nearer root is taken if it is in front of the origin of the ray
+    const __m128 sq = _mm_sqrt_ps( _mm_max_ps( delta , zero ) );
+    const __m128 min_t = _mm_mul_ps( _mm_sub_ps( _mm_sub_ps( zero , b ) , sq ) , _mm_set1_ps( 0.5f ) );
+    const __m128 max_t = _mm_mul_ps( _mm_add_ps( _mm_sub_ps( zero , b ) , sq ) , _mm_set1_ps( 0.5f ) );
+    const __m128 front = _mm_cmpgt_ps( min_t , zero );
+    const __m128 _t = _mm_or_ps( _mm_and_ps( front , min_t ) , _mm_andnot_ps( front , max_t ) );
+    valid = _mm_and_ps( valid , _mm_cmpgt_ps( _t , zero ) );
+    valid = _mm_and_ps( valid , _mm_and_ps( _mm_cmpnlt_ps( _t , _mm_set1_ps( r.m_fMin ) ) , _mm_cmpngt_ps( _t , _mm_set1_ps( r.m_fMax ) ) ) );
+
+    _mm_storeu_ps( t , _t );
+    return (unsigned)_mm_movemask_ps( valid ) & lanes;
+#else
+    unsigned mask = 0;
+    for( unsigned i = 0 ; i < 4 ; ++i ){
+        const Vector o = r.m_Ori - Point( packet.p0[0][i] , packet.p0[1][i] , packet.p0[2][i] );
+        const float radius = packet.e1[0][i];
+        const float b = 2.0f * Dot( r.m_Dir , o );
+        const float c = Dot( o , o ) - radius * radius;
+        const float delta = b * b - 4.0f * c;
+        if( !( delta >= 0.0f ) )
+            continue;
+        const float sq = sqrt( delta );
+        const float min_t = ( -b - sq ) * 0.5f;
+        const float max_t = ( -b + sq ) * 0.5f;
+        t[i] = ( min_t > 0.0f ) ? min_t : max_t;
+        if( t[i] <= 0.0f || t[i] < r.m_fMin || t[i] > r.m_fMax )
+            continue;
+        mask |= ( 1 << i );
+    }
+    return mask & lanes;
+#endif
+}
+
+//! @brief Intersection test between a ray and the disks or rectangles of a packet.
+//!
+//! The arithmetic follows the intersection routines of the planar shapes, the hit is projected on the
+//! world space axes of each shape instead of transforming the ray into its local space.
+//! @param packet   The packet of planar shapes, 'e1' and 'e2' are the local x and z axes divided by the half extents.
+//! @param r        The ray to be tested.
+//! @param disk     Whether the shapes are disks, they are rectangles otherwise.
+//! @param t        The distance of the hit of each lane, it is only valid for lanes being hit.
+//! @return         A bit mask of lanes being hit within the range of the ray.
+inline unsigned IntersectPlanarPacket( const TrianglePacket& packet , const Ray& r , bool disk , float t[4] )
+{
+    const unsigned lanes = ( 1 << packet.count ) - 1;
+#if defined(SORT_SIMD_SSE)
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 dx = _mm_set1_ps( r.m_Dir.x ) , dy = _mm_set1_ps( r.m_Dir.y ) , dz = _mm_set1_ps( r.m_Dir.z );
+    const __m128 ax = _mm_load_ps( packet.e1[0] ) , ay = _mm_load_ps( packet.e1[1] ) , az = _mm_load_ps( packet.e1[2] );
+    const __m128 bx = _mm_load_ps( packet.e2[0] ) , by = _mm_load_ps( packet.e2[1] ) , bz = _mm_load_ps( packet.e2[2] );
+    const __m128 ox = _mm_sub_ps( _mm_set1_ps( r.m_Ori.x ) , _mm_load_ps( packet.p0[0] ) );
+    const __m128 oy = _mm_sub_ps( _mm_set1_ps( r.m_Ori.y ) , _mm_load_ps( packet.p0[1] ) );
+    const __m128 oz = _mm_sub_ps( _mm_set1_ps( r.m_Ori.z ) , _mm_load_ps( packet.p0[2] ) );
+
+    // the normal of the plane is Cross( e2 , e1 ) , its length cancels out in the distance
+    const __m128 nx = _mm_sub_ps( _mm_mul_ps( by , az ) , _mm_mul_ps( bz , ay ) );
+    const __m128 ny = _mm_sub_ps( _mm_mul_ps( bz , ax ) , _mm_mul_ps( bx , az ) );
+    const __m128 nz = _mm_sub_ps( _mm_mul_ps( bx , ay ) , _mm_mul_ps( by , ax ) );
+    const __m128 dn = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx , nx ) , _mm_mul_ps( dy , ny ) ) , _mm_mul_ps( dz , nz ) );
+    const __m128 on = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ox , nx ) , _mm_mul_ps( oy , ny ) ) , _mm_mul_ps( oz , nz ) );
+    const __m128 _t = _mm_div_ps( _mm_sub_ps( _mm_setzero_ps() , on ) , dn );
+    __m128 valid = _mm_cmpneq_ps( dn , _mm_setzero_ps() );
+    valid = _mm_and_ps( valid , _mm_and_ps( _mm_cmpgt_ps( _t , _mm_set1_ps( r.m_fMin ) ) , _mm_cmpngt_ps( _t , _mm_set1_ps( r.m_fMax ) ) ) );
+
+    // the hit relative to the center , projected on the axes of the shape
+    const __m128 px = _mm_add_ps( ox , _mm_mul_ps( _t , dx ) );
+    const __m128 py = _mm_add_ps( oy , _mm_mul_ps( _t , dy ) );
+    const __m128 pz = _mm_add_ps( oz , _mm_mul_ps( _t , dz ) );
+    const __m128 u = _mm_add_ps( _mm_add_ps( _mm_mul_ps( px , ax ) , _mm_mul_ps( py , ay ) ) , _mm_mul_ps( pz , az ) );
+    const __m128 v = _mm_add_ps( _mm_add_ps( _mm_mul_ps( px , bx ) , _mm_mul_ps( py , by ) ) , _mm_mul_ps( pz , bz ) );
+    if( disk ){
+        valid = _mm_and_ps( valid , _mm_cmple_ps( _mm_add_ps( _mm_mul_ps( u , u ) , _mm_mul_ps( v , v ) ) , one ) );
+    }else{
+        const __m128 sign = _mm_set1_ps( -0.0f );
+        valid = _mm_and_ps( valid , _mm_and_ps( _mm_cmple_ps( _mm_andnot_ps( sign , u ) , one ) , _mm_cmple_ps( _mm_andnot_ps( sign , v ) , one ) ) );
+    }
+
+    _mm_storeu_ps( t , _t );
+    return (unsigned)_mm_movemask_ps( valid ) & lanes;
+#else
+    unsigned mask = 0;
+    for( unsigned i = 0 ; i < 4 ; ++i ){
+        const Vector a( packet.e1[0][i] , packet.e1[1][i] , packet.e1[2][i] );
+        const Vector b( packet.e2[0][i] , packet.e2[1][i] , packet.e2[2][i] );
+        const Vector o = r.m_Ori - Point( packet.p0[0][i] , packet.p0[1][i] , packet.p0[2][i] );
+        const Vector n = Cross( b , a );
+        const float dn = Dot( r.m_Dir , n );
+        if( dn == 0.0f )
+            continue;
+        t[i] = -Dot( o , n ) / dn;
+        if( !( t[i] > r.m_fMin ) || t[i] > r.m_fMax )
+            continue;
+        const Vector p = o + r.m_Dir * t[i];
+        const float u = Dot( p , a );
+        const float v = Dot( p , b );
+        if( disk ? ( u * u + v * v > 1.0f ) : ( fabs( u ) > 1.0f || fabs( v ) > 1.0f ) )
+            continue;
+        mask |= ( 1 << i );
+    }
+    return mask & lanes;
+#endif
+}
@@ -18,51 +18,125 @@
 #include "blenderimage.h"
 #include "utility/multithread/multithread.h"
 #include "managers/smmanager.h"
-#include <mutex>
+#include <half.h>
 
-// tile size
+// the tile size of the shared memory layout , render tasks could be of any size
 extern int g_iTileSize;
 
 // store pixel information
 void BlenderImage::StorePixel( int x , int y , const Spectrum& color , const RenderTask& rt )
 {
+	// for final update , the tile shows the average of the passes so far
+	const Spectrum average = _accumulatePixel( x , y , color );
+
 	if (!m_sharedMemory.bytes)
 		return;
+	_writePixel( x , y , average );
+}
+
+// store a pixel resolved from the filtered samples
+void BlenderImage::_resolvePixel( int x , int y , const Spectrum& color )
+{
+	const Spectrum average = _accumulatePixel( x , y , color );
+	if( m_sharedMemory.bytes )
+		_writePixel( x , y , average );
+}
+
+// resolve the pixels filtered in the current pass
+void BlenderImage::ResolveFilter()
+{
+	ImageSensor::ResolveFilter();
 
-	int tile_w = rt.size.x;
+	if( !m_sharedMemory.bytes || !m_filter.IsSplatting() )
+		return;
+	for( int i = 0 ; i < m_tilenum_x * m_tilenum_y ; ++i )
+		m_ring.Push( i );
+}
+
+// show the image of a preview level
+void BlenderImage::ShowPreview( unsigned stride )
+{
+	if( !m_sharedMemory.bytes )
+		return;
+
+	// the pixels of the grid are only stored in the first pass , filtered ones are not resolved until the pass is over
+	const bool filtered = m_filter.IsSplatting();
+	for( int i = 0 ; i < m_height ; ++i )
+	{
+		const int y = i - i % stride;
+		for( int j = 0 ; j < m_width ; ++j )
+		{
+			const int x = j - j % stride;
+			const unsigned cnt = m_pixelPassCnt[ y * m_width + x ];
+			const Spectrum color = filtered ? _previewPixel( x , y ) : ( cnt ? m_rendertarget.GetColor( x , y ) / (float)cnt : Spectrum() );
+			_writePixel( j , i , color );
+		}
+	}
+	for( int i = 0 ; i < m_tilenum_x * m_tilenum_y ; ++i )
+		m_ring.Push( i );
+}
+
+// write a pixel to its tile in the shared memory
+void BlenderImage::_writePixel( int x , int y , const Spectrum& color )
+{
+	// the tile of the shared memory holding the pixel
+	int tile_x = x - x % g_iTileSize;
+	int tile_y = y - y % g_iTileSize;
+	int tile_w = min( g_iTileSize , m_width - tile_x );
 	int tile_size = g_iTileSize * g_iTileSize;
-	int x_off = (int)(rt.ori.x / g_iTileSize);
-	int y_off = (int)(floor((m_height - 1 - rt.ori.y) / (float)g_iTileSize));
+	int x_off = (int)(tile_x / g_iTileSize);
+	int y_off = (int)(floor((m_height - 1 - tile_y) / (float)g_iTileSize));
 	int tile_offset = y_off * m_tilenum_x + x_off;
 	int offset = 4 * tile_offset * tile_size;
 
-	// get the data pointer
-	float* data = (float*)(m_sharedMemory.bytes + m_header_offset);
+	// get the data pointer , pixels are stored as four half floats
+	unsigned short* data = (unsigned short*)(m_sharedMemory.bytes + m_header_offset);
 
 	// get offset
-	int inner_offset = offset + 4 * (x - rt.ori.x + (g_iTileSize - 1 - (y - rt.ori.y)) * tile_w);
+	int inner_offset = offset + 4 * (x - tile_x + (g_iTileSize - 1 - (y - tile_y)) * tile_w);
 
 	// copy data
-	data[ inner_offset ] = color.GetR();
-	data[ inner_offset + 1 ] = color.GetG();
-	data[ inner_offset + 2 ] = color.GetB();
-	data[ inner_offset + 3 ] = 1.0f;
-
-	// for final update
-    {
-        lock_guard<PlatformSpinlockMutex> lock(m_mutex[x][y]);
-        Spectrum _color = m_rendertarget.GetColor(x,y);
-        m_rendertarget.SetColor(x, y, color+_color);
-    }
+	static const unsigned short one = half( 1.0f ).bits();
+	data[ inner_offset ] = half( color.GetR() ).bits();
+	data[ inner_offset + 1 ] = half( color.GetG() ).bits();
+	data[ inner_offset + 2 ] = half( color.GetB() ).bits();
+	data[ inner_offset + 3 ] = one;
 }
 
-// finish image tile
-void BlenderImage::FinishTile( int tile_x , int tile_y , const RenderTask& rt )
+// finish the pixels of a render task
+void BlenderImage::FinishTile( const RenderTask& rt )
 {
-	if (!m_sharedMemory.bytes)
+	// tiles of the preview levels are sent upscaled once the level is over , the finest level finishes the tiles
+	if( !m_sharedMemory.bytes || rt.previewStride > 1 )
 		return;
 
-	m_sharedMemory.bytes[tile_y * m_tilenum_x + tile_x] = 1;
+	// count the finished pixels in each tile overlapped by the task
+	const int r = rt.ori.x + rt.size.x;
+	const int b = rt.ori.y + rt.size.y;
+
+	// filtered pixels are only resolved after the pass , the tile shows them without the samples of the tasks around it until then
+	if( m_filter.IsSplatting() )
+	{
+		for( int i = rt.ori.y ; i < b ; ++i )
+			for( int j = rt.ori.x ; j < r ; ++j )
+				_writePixel( j , i , _previewPixel( j , i ) );
+	}
+	for( int tile_y = rt.ori.y - rt.ori.y % g_iTileSize ; tile_y < b ; tile_y += g_iTileSize )
+	{
+		for( int tile_x = rt.ori.x - rt.ori.x % g_iTileSize ; tile_x < r ; tile_x += g_iTileSize )
+		{
+			const int tile_r = min( tile_x + g_iTileSize , m_width );
+			const int tile_b = min( tile_y + g_iTileSize , m_height );
+			const int pixels = ( min( tile_r , r ) - max( tile_x , rt.ori.x ) ) * ( min( tile_b , b ) - max( tile_y , rt.ori.y ) );
+
+			const int x_off = tile_x / g_iTileSize;
+			const int y_off = ( m_height - 1 - tile_y ) / g_iTileSize;
+			const int tile_offset = y_off * m_tilenum_x + x_off;
+			// the tile is finished once more in every pass of progressive rendering
+			if( ( m_tilePixels[tile_offset] += pixels ) % ( ( tile_r - tile_x ) * ( tile_b - tile_y ) ) == 0 )
+				m_ring.Push( tile_offset );
+		}
+	}
 }
 
 // pre process
@@ -70,10 +144,16 @@ void BlenderImage::PreProcess()
 {
 	m_tilenum_x = (int)(ceil(m_width / (float)g_iTileSize));
 	m_tilenum_y = (int)(ceil(m_height / (float)g_iTileSize));
-	m_header_offset = m_tilenum_x * m_tilenum_y;
-	m_final_update_flag_offset = m_header_offset * g_iTileSize * g_iTileSize * 4 * sizeof(float) * 2 + m_header_offset + 1;
+	const int tile_cnt = m_tilenum_x * m_tilenum_y;
+	m_header_offset = TileRing::Size( tile_cnt );
+	m_final_update_flag_offset = tile_cnt * g_iTileSize * g_iTileSize * BLENDER_PIXEL_BYTES + m_header_offset + 1;
+	m_tilePixels.reset( new std::atomic<int>[tile_cnt] );
+	for( int i = 0 ; i < tile_cnt ; ++i )
+		m_tilePixels[i] = 0;
 
 	m_sharedMemory = SMManager::GetSingleton().GetSharedMemory("SORTBLEND_SHAREMEM");
+	if( m_sharedMemory.bytes )
+		m_ring.Init( m_sharedMemory.bytes , tile_cnt );
 
 	ImageSensor::PreProcess();
 }
@@ -81,22 +161,21 @@ void BlenderImage::PreProcess()
 // post process
 void BlenderImage::PostProcess()
 {
-	// perform a copy from render target to shared memory
-	float* data = (float*)(m_sharedMemory.bytes + m_header_offset + m_header_offset * g_iTileSize * g_iTileSize * 4 * sizeof(float));
+	// the passes are averaged first
+	ImageSensor::PostProcess();
 
-	int offset = 0;
-	for (int i = 0; i < (int)m_rendertarget.GetHeight(); ++i)
-		for (int j = 0; j < (int)m_rendertarget.GetWidth(); ++j)
-		{
-			const Spectrum& c = m_rendertarget.GetColor(j, m_rendertarget.GetHeight() - i - 1);
-			data[offset++] = c.GetR();
-			data[offset++] = c.GetG();
-			data[offset++] = c.GetB();
-			data[offset++] = 1.0f;
-		}
+	if (!m_sharedMemory.bytes)
+		return;
+
+	// the final pixels replace the ones of the tiles , every tile is sent once more
+	for (int i = 0; i < m_height; ++i){
+		const float* pixel = m_rendertarget.GetPixel( 0 , i );
+		for (int j = 0; j < m_width; ++j, pixel += RenderTarget::PIXEL_FLOATS)
+			_writePixel( j , i , Spectrum( pixel[0] , pixel[1] , pixel[2] ) );
+	}
+	for (int i = 0; i < m_tilenum_x * m_tilenum_y; ++i)
+		m_ring.Push( i );
 
 	// signal a final update
 	m_sharedMemory.bytes[m_final_update_flag_offset] = 1;
-
-	ImageSensor::PostProcess();
 }
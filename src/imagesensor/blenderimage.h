@@ -20,6 +20,10 @@
 #include "imagesensor.h"
 #include "texture/rendertarget.h"
 #include "managers/smmanager.h"
+#include "tilering.h"
+
+// the size of a pixel in the shared memory , it is stored as four half floats
+#define BLENDER_PIXEL_BYTES	8
 
 // generate output
 class BlenderImage : public ImageSensor
@@ -28,8 +32,14 @@ public:
 	// store pixel information
 	virtual void StorePixel( int x , int y , const Spectrum& color , const RenderTask& rt );
 
-	// finish image tile
-	virtual void FinishTile( int tile_x , int tile_y , const RenderTask& rt );
+	// finish the pixels of a render task , the tiles in shared memory are pushed to the ring once all of their pixels are finished
+	virtual void FinishTile( const RenderTask& rt );
+
+	// resolve the pixels filtered in the current pass , every tile is sent once more
+	virtual void ResolveFilter();
+
+	// show the image of a preview level upscaled to the whole image , every tile is sent once more
+	virtual void ShowPreview( unsigned stride );
 
 	// pre process
 	virtual void PreProcess();
@@ -42,6 +52,19 @@ private:
 	int				m_final_update_flag_offset;
 	int				m_tilenum_x;
 	int				m_tilenum_y;
+	// the number of finished pixels in each tile of the shared memory , it keeps growing over the passes
+	std::unique_ptr<std::atomic<int>[]>	m_tilePixels;
+	// the finished tiles read by the add-on
+	TileRing		m_ring;
 
 	SharedMemory	m_sharedMemory;
+
+	// write a pixel to its tile in the shared memory
+	// para 'x'     : x coordinate
+	// para 'y'     : y coordinate
+	// para 'color' : the color of the pixel
+	void _writePixel( int x , int y , const Spectrum& color );
+
+	// store a pixel resolved from the filtered samples , it is written to its tile too
+	virtual void _resolvePixel( int x , int y , const Spectrum& color );
 };
@@ -0,0 +1,208 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "denoiser.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "utility/multithread/threadpool.h"
+#include <vector>
+
+#if SORT_USE_OIDN
+	#include <OpenImageDenoise/oidn.hpp>
+#endif
+
+// set up the denoiser
+bool Denoiser::Init( const string& type , unsigned iterations )
+{
+	m_iterations = iterations ? min( iterations , 8u ) : 5;
+
+#if SORT_USE_OIDN
+	if( type == "auto" || type == "oidn" ){
+		m_type = DENOISER_OIDN;
+		return true;
+	}
+#endif
+	m_type = DENOISER_BILATERAL;
+	if( type == "auto" || type == "bilateral" )
+		return true;
+	if( type == "oidn" )
+		slog( WARNING , GENERAL , "SORT is not built with Open Image Denoise , the built-in denoiser is used." );
+	else
+		slog( WARNING , GENERAL , stringFormat( "Unknown denoiser %s , the built-in denoiser is used." , type.c_str() ) );
+	return false;
+}
+
+// denoise the image in place
+void Denoiser::Denoise( RenderTarget& color , const RenderTarget& albedo , const RenderTarget& normal ) const
+{
+#if SORT_USE_OIDN
+	if( m_type == DENOISER_OIDN && _denoiseOidn( color , albedo , normal ) )
+		return;
+#endif
+	if( m_type != DENOISER_NONE )
+		_denoiseBilateral( color , albedo , normal );
+}
+
+// denoise the image with the a-trous filter
+void Denoiser::_denoiseBilateral( RenderTarget& color , const RenderTarget& albedo , const RenderTarget& normal ) const
+{
+	const int w = (int)color.GetWidth();
+	const int h = (int)color.GetHeight();
+	const unsigned pixel_cnt = w * h;
+	if( pixel_cnt == 0 )
+		return;
+
+	// the lighting without the albedo , pixels missing an albedo , such as the background , keep their color
+	std::vector<Spectrum> irr( pixel_cnt ) , albedos( pixel_cnt ) , normals( pixel_cnt );
+	std::vector<float> lum( pixel_cnt );
+	std::vector<char> has_normal( pixel_cnt );
+	for( int i = 0 ; i < h ; ++i )
+		for( int j = 0 ; j < w ; ++j ){
+			const unsigned p = i * w + j;
+			const Spectrum a = albedo.GetColor( j , i );
+			albedos[p] = Spectrum( a.GetR() > 0.01f ? a.GetR() : 1.0f , a.GetG() > 0.01f ? a.GetG() : 1.0f , a.GetB() > 0.01f ? a.GetB() : 1.0f );
+			irr[p] = color.GetColor( j , i ) / albedos[p];
+			lum[p] = irr[p].GetIntensity();
+
+			// the normals of the samples in a pixel are averaged , they have to be normalized again
+			const Spectrum n = normal.GetColor( j , i );
+			const float len = sqrt( n.GetR() * n.GetR() + n.GetG() * n.GetG() + n.GetB() * n.GetB() );
+			has_normal[p] = len > 0.001f;
+			normals[p] = has_normal[p] ? n / len : Spectrum();
+		}
+
+	// the variance of the lighting is estimated in a small window around each pixel , it scales the color weight
+	std::vector<float> variance( pixel_cnt );
+	ParallelFor( 0 , h , 8 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		for( int i = chunk_start ; i < (int)chunk_end ; ++i )
+			for( int j = 0 ; j < w ; ++j ){
+				float sum = 0.0f , sqr_sum = 0.0f;
+				int cnt = 0;
+				for( int y = max( 0 , i - 2 ) ; y <= min( h - 1 , i + 2 ) ; ++y )
+					for( int x = max( 0 , j - 2 ) ; x <= min( w - 1 , j + 2 ) ; ++x ){
+						const float l = lum[ y * w + x ];
+						sum += l;
+						sqr_sum += l * l;
+						++cnt;
+					}
+				const float mean = sum / cnt;
+				variance[ i * w + j ] = max( 0.0f , sqr_sum / cnt - mean * mean );
+			}
+	});
+
+	// the weights of the cubic b-spline along each axis
+	static const float kernel[5] = { 1.0f / 16.0f , 1.0f / 4.0f , 3.0f / 8.0f , 1.0f / 4.0f , 1.0f / 16.0f };
+	const float sigma_lum = 4.0f;
+	const float sigma_albedo = 0.1f;
+	const float normal_power = 32.0f;
+
+	std::vector<Spectrum> irr_out( pixel_cnt );
+	std::vector<float> lum_out( pixel_cnt ) , variance_out( pixel_cnt );
+	for( unsigned it = 0 ; it < m_iterations ; ++it ){
+		const int step = 1 << it;
+		ParallelFor( 0 , h , 8 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+			for( int i = chunk_start ; i < (int)chunk_end ; ++i )
+				for( int j = 0 ; j < w ; ++j ){
+					const unsigned p = i * w + j;
+					const float lum_scale = 1.0f / ( sigma_lum * sqrt( variance[p] ) + 1e-4f );
+
+					Spectrum sum;
+					float weight_sum = 0.0f , variance_sum = 0.0f;
+					for( int dy = -2 ; dy <= 2 ; ++dy ){
+						const int y = i + dy * step;
+						if( y < 0 || y >= h )
+							continue;
+						for( int dx = -2 ; dx <= 2 ; ++dx ){
+							const int x = j + dx * step;
+							if( x < 0 || x >= w )
+								continue;
+							const unsigned q = y * w + x;
+
+							// pixels without a normal don't stop the filter
+							float weight = kernel[dx+2] * kernel[dy+2];
+							if( has_normal[p] && has_normal[q] ){
+								const float cos_n = normals[p].GetR() * normals[q].GetR() + normals[p].GetG() * normals[q].GetG() + normals[p].GetB() * normals[q].GetB();
+								weight *= pow( max( 0.0f , cos_n ) , normal_power );
+							}
+							const Spectrum da = albedos[p] - albedos[q];
+							weight *= exp( -( da.GetR() * da.GetR() + da.GetG() * da.GetG() + da.GetB() * da.GetB() ) / ( sigma_albedo * sigma_albedo ) );
+							weight *= exp( -fabs( lum[p] - lum[q] ) * lum_scale );
+
+							sum += irr[q] * weight;
+							weight_sum += weight;
+							variance_sum += weight * weight * variance[q];
+						}
+					}
+
+					// the pixel itself always has a positive weight
+					irr_out[p] = sum / weight_sum;
+					lum_out[p] = irr_out[p].GetIntensity();
+					variance_out[p] = variance_sum / ( weight_sum * weight_sum );
+				}
+		});
+		irr.swap( irr_out );
+		lum.swap( lum_out );
+		variance.swap( variance_out );
+	}
+
+	for( int i = 0 ; i < h ; ++i )
+		for( int j = 0 ; j < w ; ++j )
+			color.SetColor( j , i , irr[ i * w + j ] * albedos[ i * w + j ] );
+}
+
+#if SORT_USE_OIDN
+// denoise the image with Open Image Denoise
+bool Denoiser::_denoiseOidn( RenderTarget& color , const RenderTarget& albedo , const RenderTarget& normal ) const
+{
+	const int w = (int)color.GetWidth();
+	const int h = (int)color.GetHeight();
+
+	std::vector<float> colors( 3 * w * h ) , albedos( 3 * w * h ) , normals( 3 * w * h ) , output( 3 * w * h );
+	for( int i = 0 ; i < h ; ++i )
+		for( int j = 0 ; j < w ; ++j ){
+			const unsigned offset = 3 * ( i * w + j );
+			const Spectrum c = color.GetColor( j , i ) , a = albedo.GetColor( j , i ) , n = normal.GetColor( j , i );
+			colors[offset] = c.GetR(); colors[offset+1] = c.GetG(); colors[offset+2] = c.GetB();
+			albedos[offset] = a.GetR(); albedos[offset+1] = a.GetG(); albedos[offset+2] = a.GetB();
+			normals[offset] = n.GetR(); normals[offset+1] = n.GetG(); normals[offset+2] = n.GetB();
+		}
+
+	oidn::DeviceRef device = oidn::newDevice();
+	device.commit();
+	oidn::FilterRef filter = device.newFilter( "RT" );
+	filter.setImage( "color" , colors.data() , oidn::Format::Float3 , w , h );
+	filter.setImage( "albedo" , albedos.data() , oidn::Format::Float3 , w , h );
+	filter.setImage( "normal" , normals.data() , oidn::Format::Float3 , w , h );
+	filter.setImage( "output" , output.data() , oidn::Format::Float3 , w , h );
+	filter.set( "hdr" , true );
+	filter.commit();
+	filter.execute();
+
+	const char* message = nullptr;
+	if( device.getError( message ) != oidn::Error::None ){
+		slog( WARNING , GENERAL , stringFormat( "Open Image Denoise failed ( %s ) , the built-in denoiser is used." , message ? message : "unknown error" ) );
+		return false;
+	}
+
+	for( int i = 0 ; i < h ; ++i )
+		for( int j = 0 ; j < w ; ++j ){
+			const unsigned offset = 3 * ( i * w + j );
+			color.SetColor( j , i , output[offset] , output[offset+1] , output[offset+2] );
+		}
+	return true;
+}
+#endif
@@ -0,0 +1,61 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "utility/enum.h"
+#include "texture/rendertarget.h"
+
+// the denoiser runs on the final image guided by the albedo and the normal of the first hit.
+// the built-in one is an edge-avoiding a-trous filter , a cross bilateral filter whose footprint doubles in every
+// iteration. the albedo is divided out first so that textures stay sharp , the filter only blurs the lighting.
+// Intel Open Image Denoise is used instead if SORT is built with SORT_USE_OIDN defined as 1.
+class Denoiser
+{
+public:
+	// set up the denoiser
+	// para 'type'       : 'auto' , 'bilateral' or 'oidn' , 'auto' picks Open Image Denoise if it is available
+	// para 'iterations' : the number of iterations of the built-in filter , the default is picked if it is zero
+	// result            : false if the denoiser is unknown or not available , the built-in one is used then
+	bool Init( const string& type , unsigned iterations );
+
+	// whether the image is denoised
+	bool IsEnabled() const {
+		return m_type != DENOISER_NONE;
+	}
+
+	// denoise the image in place
+	// para 'color'  : the average radiance of each pixel
+	// para 'albedo' : the average albedo of the first hit of each pixel
+	// para 'normal' : the average shading normal of the first hit of each pixel
+	void Denoise( RenderTarget& color , const RenderTarget& albedo , const RenderTarget& normal ) const;
+
+private:
+	DENOISER_TYPE	m_type = DENOISER_NONE;
+	// the number of iterations of the a-trous filter , the footprint of the last one is 2^(m_iterations+1) pixels wide
+	unsigned		m_iterations = 5;
+
+	// denoise the image with the a-trous filter
+	void _denoiseBilateral( RenderTarget& color , const RenderTarget& albedo , const RenderTarget& normal ) const;
+
+#if SORT_USE_OIDN
+	// denoise the image with Open Image Denoise
+	// result : false if it failed , the image is not touched then
+	bool _denoiseOidn( RenderTarget& color , const RenderTarget& albedo , const RenderTarget& normal ) const;
+#endif
+};
@@ -0,0 +1,320 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "imagesensor.h"
+#include "accel/accelcache.h"
+#include "utility/sassert.h"
+#include "utility/strhelper.h"
+#include "log/log.h"
+#include <algorithm>
+
+extern int g_iTileSize;
+
+// min() takes its arguments by reference, the block size needs a definition
+const int ImageSensor::SPLAT_BLOCK_SIZE;
+
+// add radiance
+void ImageSensor::UpdatePixel( int x , int y , const Spectrum& color )
+{
+	const unsigned tid = ThreadId();
+	sAssert( tid < m_splats.size() , GENERAL );
+
+	std::unique_ptr<Spectrum[]>& block = m_splats[tid][ ( y / SPLAT_BLOCK_SIZE ) * m_splatBlockCntX + x / SPLAT_BLOCK_SIZE ];
+	if( !block ){
+		block.reset( new Spectrum[ SPLAT_BLOCK_SIZE * SPLAT_BLOCK_SIZE ] );
+		MemoryStats::Add( MEM_RENDER_TARGET , sizeof( Spectrum ) * SPLAT_BLOCK_SIZE * SPLAT_BLOCK_SIZE );
+	}
+	block[ ( y % SPLAT_BLOCK_SIZE ) * SPLAT_BLOCK_SIZE + x % SPLAT_BLOCK_SIZE ] += color;
+}
+
+// add the splats to the render target
+void ImageSensor::ResolveSplats()
+{
+	// blocks cover separated pixels , they are resolved in parallel
+	const unsigned block_cnt = m_splatBlockCntX * m_splatBlockCntY;
+	ParallelFor( 0 , block_cnt , 16 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		for( unsigned b = chunk_start ; b < chunk_end ; ++b ){
+			const int ox = ( b % m_splatBlockCntX ) * SPLAT_BLOCK_SIZE;
+			const int oy = ( b / m_splatBlockCntX ) * SPLAT_BLOCK_SIZE;
+			const int w = min( SPLAT_BLOCK_SIZE , m_width - ox );
+			const int h = min( SPLAT_BLOCK_SIZE , m_height - oy );
+			for( auto& splats : m_splats ){
+				if( !splats[b] )
+					continue;
+				for( int i = 0 ; i < h ; ++i ){
+					float* pixel = m_rendertarget.GetPixel( ox , oy + i );
+					for( int j = 0 ; j < w ; ++j , pixel += RenderTarget::PIXEL_FLOATS ){
+						const Spectrum& splat = splats[b][ i * SPLAT_BLOCK_SIZE + j ];
+						pixel[0] += splat.GetR();
+						pixel[1] += splat.GetG();
+						pixel[2] += splat.GetB();
+					}
+				}
+				splats[b].reset();
+				MemoryStats::Add( MEM_RENDER_TARGET , -(long long)( sizeof( Spectrum ) * SPLAT_BLOCK_SIZE * SPLAT_BLOCK_SIZE ) );
+			}
+		}
+	} );
+}
+
+// store the filtered samples of a render task
+void ImageSensor::StoreFilteredTile( const RenderTask& rt , int rows , const Spectrum* color , const float* weight )
+{
+	const unsigned tid = ThreadId();
+	sAssert( tid < m_filterSplats.size() , GENERAL );
+
+	const int apron = m_filter.GetApron();
+	const int stride = rt.size.x + 2 * apron;
+	for( int i = -apron ; i < rows + apron ; ++i ){
+		const int y = rt.ori.y + i;
+		if( y < 0 || y >= m_height )
+			continue;
+		for( int j = -apron ; j < rt.size.x + apron ; ++j ){
+			const int x = rt.ori.x + j;
+			if( x < 0 || x >= m_width )
+				continue;
+			const int src = ( i + apron ) * stride + j + apron;
+
+			// pixels of the task
+			if( i >= 0 && i < rows && j >= 0 && j < rt.size.x ){
+				const int dst = y * m_width + x;
+				m_filterSum[dst] += color[src];
+				m_filterWeight[dst] += weight[src];
+				m_filterStored[dst] = 1;
+				continue;
+			}
+
+			// pixels of the apron
+			if( weight[src] == 0.0f )
+				continue;
+			std::unique_ptr<FilterSplat[]>& block = m_filterSplats[tid][ ( y / SPLAT_BLOCK_SIZE ) * m_splatBlockCntX + x / SPLAT_BLOCK_SIZE ];
+			if( !block ){
+				block.reset( new FilterSplat[ SPLAT_BLOCK_SIZE * SPLAT_BLOCK_SIZE ] );
+				MemoryStats::Add( MEM_RENDER_TARGET , sizeof( FilterSplat ) * SPLAT_BLOCK_SIZE * SPLAT_BLOCK_SIZE );
+			}
+			FilterSplat& splat = block[ ( y % SPLAT_BLOCK_SIZE ) * SPLAT_BLOCK_SIZE + x % SPLAT_BLOCK_SIZE ];
+			splat.color += color[src];
+			splat.weight += weight[src];
+		}
+	}
+}
+
+// resolve the pixels filtered in the current pass
+void ImageSensor::ResolveFilter()
+{
+	if( !m_filter.IsSplatting() || m_filterSplats.empty() )
+		return;
+
+	// blocks cover separated pixels , they are resolved in parallel
+	const unsigned block_cnt = m_splatBlockCntX * m_splatBlockCntY;
+	ParallelFor( 0 , block_cnt , 16 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		for( unsigned b = chunk_start ; b < chunk_end ; ++b ){
+			const int ox = ( b % m_splatBlockCntX ) * SPLAT_BLOCK_SIZE;
+			const int oy = ( b / m_splatBlockCntX ) * SPLAT_BLOCK_SIZE;
+			const int w = min( SPLAT_BLOCK_SIZE , m_width - ox );
+			const int h = min( SPLAT_BLOCK_SIZE , m_height - oy );
+			for( auto& splats : m_filterSplats ){
+				if( !splats[b] )
+					continue;
+				for( int i = 0 ; i < h ; ++i )
+					for( int j = 0 ; j < w ; ++j ){
+						const FilterSplat& splat = splats[b][ i * SPLAT_BLOCK_SIZE + j ];
+						m_filterSum[ ( oy + i ) * m_width + ox + j ] += splat.color;
+						m_filterWeight[ ( oy + i ) * m_width + ox + j ] += splat.weight;
+					}
+				splats[b].reset();
+				MemoryStats::Add( MEM_RENDER_TARGET , -(long long)( sizeof( FilterSplat ) * SPLAT_BLOCK_SIZE * SPLAT_BLOCK_SIZE ) );
+			}
+
+			// only the rendered pixels are stored , the negative lobes of some filters could leave no weight in a pixel
+			for( int i = oy ; i < oy + h ; ++i )
+				for( int j = ox ; j < ox + w ; ++j ){
+					const int p = i * m_width + j;
+					if( m_filterStored[p] )
+						_resolvePixel( j , i , ( m_filterWeight[p] > 0.0f ) ? m_filterSum[p] / m_filterWeight[p] : Spectrum() );
+					m_filterSum[p] = Spectrum();
+					m_filterWeight[p] = 0.0f;
+					m_filterStored[p] = 0;
+				}
+		}
+	} );
+}
+
+// write the accumulated state of all pixels
+void ImageSensor::Serialize( AccelWriter& stream ) const
+{
+	stream.Write( m_width );
+	stream.Write( m_height );
+	stream.Write( m_passCnt );
+
+	// the pixels are written as they are kept in the render targets
+	const size_t float_cnt = (size_t)RenderTarget::PIXEL_FLOATS * m_width * m_height;
+	stream.Write( m_rendertarget.GetPixels() , float_cnt );
+	stream.Write( m_pixelPassCnt.data() , m_pixelPassCnt.size() );
+	stream.Write( m_lumSum.data() , m_lumSum.size() );
+	stream.Write( m_lumSqrSum.data() , m_lumSqrSum.size() );
+
+	stream.Write( m_aovMask );
+	for( unsigned k = 0 ; k < AOV_COUNT ; ++k )
+		if( m_aovMask & ( 1u << k ) )
+			stream.Write( m_aovs[k].GetPixels() , float_cnt );
+}
+
+// load the accumulated state of all pixels
+bool ImageSensor::Deserialize( AccelReader& stream )
+{
+	int width = 0 , height = 0;
+	unsigned pass_cnt = 0;
+	if( !stream.Read( width ) || !stream.Read( height ) || !stream.Read( pass_cnt ) || width != m_width || height != m_height )
+		return false;
+
+	const unsigned pixel_cnt = m_width * m_height;
+	std::vector<float> colors( RenderTarget::PIXEL_FLOATS * pixel_cnt );
+	std::vector<unsigned> pixel_pass_cnt( pixel_cnt );
+	std::vector<float> lum_sum( pixel_cnt ) , lum_sqr_sum( pixel_cnt );
+	if( !stream.Read( colors.data() , colors.size() ) || !stream.Read( pixel_pass_cnt.data() , pixel_cnt ) ||
+		!stream.Read( lum_sum.data() , pixel_cnt ) || !stream.Read( lum_sqr_sum.data() , pixel_cnt ) )
+		return false;
+
+	// the output variables have to be the same as the ones in the checkpoint
+	unsigned aov_mask = 0;
+	if( !stream.Read( aov_mask ) || aov_mask != m_aovMask )
+		return false;
+	unsigned aov_cnt = 0;
+	for( unsigned k = 0 ; k < AOV_COUNT ; ++k )
+		aov_cnt += ( aov_mask >> k ) & 1;
+	std::vector<float> aovs( RenderTarget::PIXEL_FLOATS * pixel_cnt * aov_cnt );
+	if( !stream.Read( aovs.data() , aovs.size() ) )
+		return false;
+
+	m_rendertarget.WriteRect( 0 , 0 , m_width , m_height , colors.data() , m_width );
+	const float* aov = aovs.data();
+	for( unsigned k = 0 ; k < AOV_COUNT ; ++k ){
+		if( !( m_aovMask & ( 1u << k ) ) )
+			continue;
+		m_aovs[k].WriteRect( 0 , 0 , m_width , m_height , aov , m_width );
+		aov += RenderTarget::PIXEL_FLOATS * pixel_cnt;
+	}
+	m_passCnt = pass_cnt;
+	m_pixelPassCnt.swap( pixel_pass_cnt );
+	m_lumSum.swap( lum_sum );
+	m_lumSqrSum.swap( lum_sqr_sum );
+	return true;
+}
+
+// discard the pixels of a rectangle
+void ImageSensor::ClearRect( const Vector2i& ori , const Vector2i& size )
+{
+	m_rendertarget.ClearRect( ori.x , ori.y , size.x , size.y );
+	for( unsigned k = 0 ; k < AOV_COUNT ; ++k )
+		if( m_aovMask & ( 1u << k ) )
+			m_aovs[k].ClearRect( ori.x , ori.y , size.x , size.y );
+	for( int i = ori.y ; i < ori.y + size.y ; ++i ){
+		const int row = i * m_width + ori.x;
+		std::fill( m_pixelPassCnt.begin() + row , m_pixelPassCnt.begin() + row + size.x , 0u );
+		std::fill( m_lumSum.begin() + row , m_lumSum.begin() + row + size.x , 0.0f );
+		std::fill( m_lumSqrSum.begin() + row , m_lumSqrSum.begin() + row + size.x , 0.0f );
+	}
+}
+
+// read the pixels of a rectangle and discard them
+void ImageSensor::TakeRect( const Vector2i& ori , const Vector2i& size , std::vector<float>& data )
+{
+	data.resize( (size_t)size.x * size.y * GetRectChannels() );
+	float* pixel = data.data();
+	for( int i = ori.y ; i < ori.y + size.y ; ++i )
+		for( int j = ori.x ; j < ori.x + size.x ; ++j ){
+			const float* color = m_rendertarget.GetPixel( j , i );
+			*pixel++ = color[0];
+			*pixel++ = color[1];
+			*pixel++ = color[2];
+			for( unsigned k = 0 ; k < AOV_COUNT ; ++k ){
+				if( !( m_aovMask & ( 1u << k ) ) )
+					continue;
+				const float* aov = m_aovs[k].GetPixel( j , i );
+				*pixel++ = aov[0];
+				*pixel++ = aov[1];
+				*pixel++ = aov[2];
+			}
+		}
+	ClearRect( ori , size );
+}
+
+// store the pixels of a task rendered by another process
+void ImageSensor::StoreRect( const RenderTask& rt , const float* data )
+{
+	const bool aov = HasAov();
+	Spectrum aovs[AOV_COUNT];
+	for( int i = rt.ori.y ; i < rt.ori.y + rt.size.y ; ++i )
+		for( int j = rt.ori.x ; j < rt.ori.x + rt.size.x ; ++j ){
+			StorePixel( j , i , Spectrum( data[0] , data[1] , data[2] ) , rt );
+			data += 3;
+			for( unsigned k = 0 ; k < AOV_COUNT ; ++k ){
+				if( !( m_aovMask & ( 1u << k ) ) )
+					continue;
+				aovs[k] = Spectrum( data[0] , data[1] , data[2] );
+				data += 3;
+			}
+			if( aov )
+				StoreAov( j , i , aovs );
+		}
+}
+
+// resolve the cost of the pixels and log the most expensive tiles
+void ImageSensor::_resolveCost()
+{
+	m_cost.SetSize( m_width , m_height );
+
+	// the cost of blocks of the largest tile size , they tell where the time of the rendering goes
+	const int tile_size = max( g_iTileSize , 1 );
+	const int tile_cnt_x = ( m_width + tile_size - 1 ) / tile_size;
+	const int tile_cnt_y = ( m_height + tile_size - 1 ) / tile_size;
+	std::vector<PixelCost> tiles( tile_cnt_x * tile_cnt_y );
+	PixelCost total;
+	for( int i = 0 ; i < m_height ; ++i )
+		for( int j = 0 ; j < m_width ; ++j ){
+			const PixelCost& cost = m_costs[ i * m_width + j ];
+			const float samples = (float)max( cost.samples , 1ull );
+			m_cost.SetColor( j , i , Spectrum( (float)( cost.seconds * 1000.0 ) , cost.rays / samples , cost.pathRays / samples ) );
+
+			PixelCost& tile = tiles[ ( i / tile_size ) * tile_cnt_x + j / tile_size ];
+			tile.seconds += cost.seconds;
+			tile.samples += cost.samples;
+			tile.rays += cost.rays;
+			tile.pathRays += cost.pathRays;
+			total.seconds += cost.seconds;
+			total.samples += cost.samples;
+			total.rays += cost.rays;
+			total.pathRays += cost.pathRays;
+		}
+	if( total.seconds <= 0.0 )
+		return;
+
+	const unsigned top_cnt = min( 5u , (unsigned)tiles.size() );
+	std::vector<unsigned> order( tiles.size() );
+	for( unsigned i = 0 ; i < order.size() ; ++i )
+		order[i] = i;
+	std::partial_sort( order.begin() , order.begin() + top_cnt , order.end() , [&]( unsigned a , unsigned b ){ return tiles[a].seconds > tiles[b].seconds; } );
+	slog( INFO , IMAGE , stringFormat( "Pixels took %.2fs of the render threads , %.2f rays and %.2f path segments per sample." ,
+		total.seconds , (double)total.rays / max( total.samples , 1ull ) , (double)total.pathRays / max( total.samples , 1ull ) ) );
+	for( unsigned i = 0 ; i < top_cnt ; ++i ){
+		const PixelCost& tile = tiles[ order[i] ];
+		slog( INFO , IMAGE , stringFormat( "Tile (%d,%d) took %.1f%% of the time , %.2f rays and %.2f path segments per sample." ,
+			( order[i] % tile_cnt_x ) * tile_size , ( order[i] / tile_cnt_x ) * tile_size , 100.0 * tile.seconds / total.seconds ,
+			(double)tile.rays / max( tile.samples , 1ull ) , (double)tile.pathRays / max( tile.samples , 1ull ) ) );
+	}
+}
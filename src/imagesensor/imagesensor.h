@@ -22,10 +22,17 @@
 #include "utility/propertyset.h"
 #include "texture/rendertarget.h"
 #include "utility/multithread/multithread.h"
-#include <mutex>
+#include "utility/multithread/threadpool.h"
+#include "utility/memstats.h"
+#include "pixelfilter.h"
+#include "denoiser.h"
+#include <vector>
+#include <memory>
 
 // pre-decleration
 class RenderTask;
+class AccelWriter;
+class AccelReader;
 
 // generate output
 class ImageSensor : public PropertySet<ImageSensor>
@@ -41,57 +48,441 @@ public:
 	{
 		m_rendertarget.SetSize(m_width, m_height);
 
-		m_mutex = new PlatformSpinlockMutex*[m_width];
-		for( int i = 0 ; i < m_width ; ++i )
-			m_mutex[i] = new PlatformSpinlockMutex[m_height];
+		// blocks of splats are only allocated once a thread writes to them
+		m_splatBlockCntX = ( m_width + SPLAT_BLOCK_SIZE - 1 ) / SPLAT_BLOCK_SIZE;
+		m_splatBlockCntY = ( m_height + SPLAT_BLOCK_SIZE - 1 ) / SPLAT_BLOCK_SIZE;
+		m_splats.clear();
+		m_splats.resize( ThreadPool::GetSingleton().GetThreadNum() );
+		for( auto& splats : m_splats )
+			splats.resize( m_splatBlockCntX * m_splatBlockCntY );
+
+		m_passCnt = 0;
+		m_lumSum.assign( m_width * m_height , 0.0f );
+		m_lumSqrSum.assign( m_width * m_height , 0.0f );
+		m_pixelPassCnt.assign( m_width * m_height , 0 );
+
+		// the denoiser is guided by the albedo and the normal of the first hit , they are rendered even if they are not written
+		m_aovMask = m_aovOutputMask;
+		if( m_denoiser.IsEnabled() )
+			m_aovMask |= ( 1u << AOV_ALBEDO ) | ( 1u << AOV_NORMAL );
+
+		// only the requested output variables take memory
+		unsigned aov_cnt = 0;
+		for( unsigned i = 0 ; i < AOV_COUNT ; ++i ){
+			if( m_aovMask & ( 1u << i ) ){
+				m_aovs[i].SetSize( m_width , m_height );
+				++aov_cnt;
+			}
+		}
+
+		// the samples of a pass are filtered into the sums of the weighted radiance and the weights first
+		size_t filter_size = 0;
+		m_filterSplats.clear();
+		if( m_filter.IsSplatting() ){
+			m_filterSum.assign( m_width * m_height , Spectrum() );
+			m_filterWeight.assign( m_width * m_height , 0.0f );
+			m_filterStored.assign( m_width * m_height , 0 );
+			m_filterSplats.resize( ThreadPool::GetSingleton().GetThreadNum() );
+			for( auto& splats : m_filterSplats )
+				splats.resize( m_splatBlockCntX * m_splatBlockCntY );
+			filter_size = sizeof( Spectrum ) + sizeof( float ) + sizeof( char );
+		}
+
+		// the cost of the pixels is only recorded if it is requested
+		m_costs.clear();
+		if( m_costOutput )
+			m_costs.resize( m_width * m_height );
+		const size_t cost_size = m_costOutput ? sizeof( PixelCost ) + sizeof( float ) * RenderTarget::PIXEL_FLOATS : 0;
+
+		// splat blocks are accounted once they are allocated
+		m_tracker.Set( (size_t)m_width * m_height * ( ( 1 + aov_cnt ) * sizeof( float ) * RenderTarget::PIXEL_FLOATS + 2 * sizeof( float ) + sizeof( unsigned ) + filter_size + cost_size ) );
 	}
 
 	// set image size
 	virtual void SetSensorSize( int w , int h )
 	{
-		m_width = w;
-		m_height = h;
+		m_width = m_fullWidth = w;
+		m_height = m_fullHeight = h;
+		m_regionX = m_regionY = 0;
+	}
+
+	// render only a region of the image , the pixels of the sensor are the ones in the region then
+	// para 'x' : the left of the region in the image
+	// para 'y' : the top of the region in the image
+	// para 'w' : the width of the region
+	// para 'h' : the height of the region
+	// result   : false if the region is outside of the image , the whole image is rendered then
+	bool SetRegion( int x , int y , int w , int h )
+	{
+		const int l = max( 0 , x ) , t = max( 0 , y );
+		const int r = min( m_fullWidth , x + w ) , b = min( m_fullHeight , y + h );
+		if( l >= r || t >= b )
+			return false;
+		m_regionX = l;
+		m_regionY = t;
+		m_width = r - l;
+		m_height = b - t;
+		return true;
+	}
+
+	// set the reconstruction filter of pixels
+	// para 'type'   : the name of the filter
+	// para 'radius' : the radius of the filter in pixels , the default one of the filter is used if it is not positive
+	void SetFilter( const string& type , float radius ){
+		m_filter.Init( type , radius );
+	}
+
+	// get the reconstruction filter of pixels
+	const PixelFilter& GetFilter() const {
+		return m_filter;
+	}
+
+	// set the denoiser of the final image
+	// para 'type'       : the name of the denoiser
+	// para 'iterations' : the number of iterations of the built-in denoiser , the default is used if it is zero
+	void SetDenoiser( const string& type , unsigned iterations ){
+		m_denoiser.Init( type , iterations );
 	}
 
-	// finish image tile
-	virtual void FinishTile( int tile_x , int tile_y , const RenderTask& rt ){}
+	// the pixels of the image are final once their tasks are finished , they could be written before the rendering is done
+	// note : it is only called in a single pass without radiance written to other pixels , after 'PreProcess'
+	virtual void BeginStreaming(){}
+
+	// finish the pixels of a render task , the task could cover any rectangle of the image
+	virtual void FinishTile( const RenderTask& rt ){}
+
+	// show the image of a preview level , every pixel takes the color of the rendered one at the top-left corner of its block
+	// para 'stride' : the stride of the grid of rendered pixels
+	// note          : it is called between the levels of the first pass , while no thread is rendering
+	virtual void ShowPreview( unsigned stride ){}
+
+	// store the filtered samples of a render task , it replaces 'StorePixel' if the filter splats samples to other pixels
+	// para 'rt'     : the render task
+	// para 'rows'   : the number of rendered rows of the task , the others are left after cancellation
+	// para 'color'  : the radiance of the samples weighted by the filter , it covers the pixels of the task and an apron of
+	//				   'GetApron' pixels around them
+	// para 'weight' : the sum of the weights of the samples in the same layout
+	// note          : the pixels of the task are only written by the task , the apron goes to the splats of the calling thread ,
+	//				   so no lock is needed. the pixels are resolved by 'ResolveFilter' once all tasks of the pass are finished.
+	void StoreFilteredTile( const RenderTask& rt , int rows , const Spectrum* color , const float* weight );
+
+	// resolve the pixels filtered in the current pass , it can only be called while no thread is rendering
+	virtual void ResolveFilter();
 
     // store pixel information
     virtual void StorePixel( int x , int y , const Spectrum& color , const RenderTask& rt ) = 0;
-    
+
+	// whether any arbitrary output variable is requested
+	bool HasAov() const {
+		return m_aovMask != 0;
+	}
+
+	// accumulate the output variables of the current pass , only the thread rendering the pixel in the pass calls it
+	// para 'x'   : x coordinate
+	// para 'y'   : y coordinate
+	// para 'aov' : the average of each output variable over the samples of the pixel , there are 'AOV_COUNT' of them
+	void StoreAov( int x , int y , const Spectrum* aov ){
+		for( unsigned i = 0 ; i < AOV_COUNT ; ++i )
+			if( m_aovMask & ( 1u << i ) )
+				m_aovs[i].SetColor( x , y , m_aovs[i].GetColor( x , y ) + aov[i] );
+	}
+
+	// whether the cost of rendering each pixel is recorded
+	bool HasCost() const {
+		return !m_costs.empty();
+	}
+
+	// add the cost of a pixel in the current pass , only the thread rendering the pixel in the pass calls it
+	// para 'x'         : x coordinate
+	// para 'y'         : y coordinate
+	// para 'seconds'   : the wall-clock time taken by the pixel
+	// para 'samples'   : the number of samples taken
+	// para 'rays'      : the number of rays traced , shadow rays included
+	// para 'path_rays' : the number of closest hit rays traced , they are the segments of the paths
+	void StoreCost( int x , int y , double seconds , unsigned samples , unsigned long long rays , unsigned long long path_rays ){
+		PixelCost& cost = m_costs[ y * m_width + x ];
+		cost.seconds += seconds;
+		cost.samples += samples;
+		cost.rays += rays;
+		cost.pathRays += path_rays;
+	}    
+	// finish a pass of progressive rendering
+	void FinishPass(){
+		ResolveFilter();
+		ResolveSplats();
+		++m_passCnt;
+	}
+
+	// add the radiance splatted by all threads to the render target , it can only be called while no thread is rendering
+	void ResolveSplats();
+
+	// get the number of finished passes
+	unsigned GetPassCount() const {
+		return m_passCnt;
+	}
+
+	// estimate the noise of the image
+	// result : the standard error of the mean luminance of each pixel relative to the luminance , averaged over all pixels
+	float EstimateNoise() const {
+		if( m_passCnt < 2 )
+			return FLT_MAX;
+		double noise = 0.0;
+		for( unsigned i = 0 ; i < m_lumSum.size() ; ++i )
+			noise += _pixelNoise( i );
+		return (float)( noise / max( (size_t)1 , m_lumSum.size() ) );
+	}
+
+	// estimate the noise of a rectangle of the image
+	// para 'ori'  : the top-left corner of the rectangle
+	// para 'size' : the size of the rectangle
+	// result      : the relative standard error averaged over the pixels of the rectangle , FLT_MAX before the second pass
+	float EstimateNoise( const Vector2i& ori , const Vector2i& size ) const {
+		if( m_passCnt < 2 )
+			return FLT_MAX;
+		double noise = 0.0;
+		for( int i = ori.y ; i < ori.y + size.y ; ++i )
+			for( int j = ori.x ; j < ori.x + size.x ; ++j )
+				noise += _pixelNoise( i * m_width + j );
+		return (float)( noise / max( 1 , size.x * size.y ) );
+	}
+
+	// get the average luminance of a pixel over the passes so far
+	// result : 0 if the pixel isn't rendered yet
+	float GetPixelLuminance( int x , int y ) const {
+		const unsigned cnt = m_pixelPassCnt[ y * m_width + x ];
+		return cnt ? m_lumSum[ y * m_width + x ] / (float)cnt : 0.0f;
+	}
+
+	// write the accumulated state of all pixels , it is used to checkpoint the rendering
+	// note          : splats are not included , they have to be resolved first
+	// para 'stream' : the stream to write to
+	void Serialize( AccelWriter& stream ) const;
+
+	// load the accumulated state of all pixels written by 'Serialize'
+	// para 'stream' : the stream to read from
+	// result        : false if the data doesn't match the image
+	bool Deserialize( AccelReader& stream );
+
+	// discard the pixels of a rectangle , they are rendered again after resuming
+	// para 'ori'  : the top left corner of the rectangle
+	// para 'size' : the size of the rectangle
+	void ClearRect( const Vector2i& ori , const Vector2i& size );
+
+	// get the number of floats of a pixel moved by 'TakeRect' and 'StoreRect' , the radiance and every rendered output variable
+	unsigned GetRectChannels() const {
+		unsigned cnt = 3;
+		for( unsigned k = 0 ; k < AOV_COUNT ; ++k )
+			cnt += ( m_aovMask & ( 1u << k ) ) ? 3 : 0;
+		return cnt;
+	}
+
+	// read the pixels of a rectangle stored by a single task and discard them , the task is rendered for another process
+	// para 'ori'  : the top left corner of the rectangle
+	// para 'size' : the size of the rectangle
+	// para 'data' : the 'GetRectChannels' floats of each pixel in the rectangle row by row
+	void TakeRect( const Vector2i& ori , const Vector2i& size , std::vector<float>& data );
+
+	// store the pixels of a task rendered by another process
+	// para 'rt'   : the render task , only its rectangle is stored
+	// para 'data' : the pixels in the layout of 'TakeRect'
+	void StoreRect( const RenderTask& rt , const float* data );
+
+	// keep the sum of the samples and the number of samples of each pixel , the partial results of several processes are merged afterward
+	// para 'samples' : the number of samples per pixel in each finished pass , zero disables it
+	// note : it has to be called before 'PostProcess'
+	void SetPartialSamples( float samples ){
+		m_partialSamples = samples;
+	}
+
 	// post process
     virtual void PostProcess(){
-		// delete the mutex
-		for( int i = 0 ; i < m_width ; ++i )
-			delete[] m_mutex[i];
-		delete[] m_mutex;
+		ResolveFilter();
+		ResolveSplats();
+
+		// the sums of a partial result are kept before averaging , every pass of a pixel takes the same number of samples
+		if( m_partialSamples > 0.0f ){
+			m_partialSum.SetSize( m_width , m_height );
+			m_partialCount.SetSize( m_width , m_height );
+			for( int i = 0 ; i < m_height ; ++i )
+				for( int j = 0 ; j < m_width ; ++j ){
+					m_partialSum.SetColor( j , i , m_rendertarget.GetColor( j , i ) * m_partialSamples );
+					m_partialCount.SetColor( j , i , Spectrum( m_pixelPassCnt[ i * m_width + j ] * m_partialSamples ) );
+				}
+		}
+
+		// the render target holds the sum of all passes , pixels are counted separately as a cancelled pass is not complete
+		for( int i = 0 ; i < m_height ; ++i )
+			for( int j = 0 ; j < m_width ; ++j ){
+				const unsigned cnt = m_pixelPassCnt[ i * m_width + j ];
+				if( cnt > 1 ){
+					m_rendertarget.SetColor( j , i , m_rendertarget.GetColor( j , i ) / (float)cnt );
+					for( unsigned k = 0 ; k < AOV_COUNT ; ++k )
+						if( m_aovMask & ( 1u << k ) )
+							m_aovs[k].SetColor( j , i , m_aovs[k].GetColor( j , i ) / (float)cnt );
+				}
+			}
+		m_splats.clear();
+		m_filterSplats.clear();
+
+		// the final image is denoised once the passes are averaged
+		if( m_denoiser.IsEnabled() )
+			m_denoiser.Denoise( m_rendertarget , m_aovs[AOV_ALBEDO] , m_aovs[AOV_NORMAL] );
+
+		if( HasCost() )
+			_resolveCost();
 	}
     
-    // get width
+    // get the width of the rendered region
     unsigned GetWidth() const {
         return m_width;
     }
     
-    // get height
+    // get the height of the rendered region
     unsigned GetHeight() const {
         return m_height;
     }
 
-	// add radiance
-	virtual void UpdatePixel(int x, int y, const Spectrum& color)
-	{
-        lock_guard<PlatformSpinlockMutex> lock(m_mutex[x][y]);
-		Spectrum _color = m_rendertarget.GetColor(x, y);
-		m_rendertarget.SetColor(x, y, _color + color);
-	}
+    // get the width of the whole image , cameras project to it
+    unsigned GetFullWidth() const {
+        return m_fullWidth;
+    }
+
+    // get the height of the whole image
+    unsigned GetFullHeight() const {
+        return m_fullHeight;
+    }
+
+    // get the left of the rendered region in the whole image
+    int GetRegionX() const {
+        return m_regionX;
+    }
+
+    // get the top of the rendered region in the whole image
+    int GetRegionY() const {
+        return m_regionY;
+    }
+
+	// add radiance , it goes to the splats of the calling thread until they are resolved
+	virtual void UpdatePixel(int x, int y, const Spectrum& color);
 
 protected:
+	// the size of the rendered region , all pixels of the sensor are in it
 	int m_width;
 	int m_height;
-    
-	// the mutex
-	PlatformSpinlockMutex**	m_mutex;
+	// the size of the whole image and the position of the region in it
+	int m_fullWidth = 0;
+	int m_fullHeight = 0;
+	int m_regionX = 0;
+	int m_regionY = 0;
+
+	// the size of a block of splats
+	static const int SPLAT_BLOCK_SIZE = 32;
+	// the number of blocks of splats in each direction
+	int m_splatBlockCntX = 0;
+	int m_splatBlockCntY = 0;
+	// the blocks of splats of each thread , radiance written to any pixel by light paths is added here without locking
+	std::vector< std::vector< std::unique_ptr<Spectrum[]> > > m_splats;
+
+	// the number of finished passes
+	unsigned m_passCnt = 0;
+	// the sum of the luminance of each pixel over all passes and the sum of its square , they are used to estimate noise
+	std::vector<float> m_lumSum;
+	std::vector<float> m_lumSqrSum;
+	// the number of passes that stored each pixel
+	std::vector<unsigned> m_pixelPassCnt;
+	// the memory taken by the render target and the per pixel statistics
+	MemoryTracker m_tracker{ MEM_RENDER_TARGET };
+
+	// accumulate the color of the current pass , only the thread rendering the pixel in the pass calls it , so no lock is needed
+	// para 'x'     : x coordinate
+	// para 'y'     : y coordinate
+	// para 'color' : the color of the pixel in the current pass
+	// result       : the average of the pixel over the passes so far , splats are not included until they are resolved
+	Spectrum _accumulatePixel( int x , int y , const Spectrum& color ){
+		const Spectrum sum = m_rendertarget.GetColor(x, y) + color;
+		m_rendertarget.SetColor(x, y, sum);
+
+		const float lum = color.GetIntensity();
+		m_lumSum[ y * m_width + x ] += lum;
+		m_lumSqrSum[ y * m_width + x ] += lum * lum;
+		return sum / (float)( ++m_pixelPassCnt[ y * m_width + x ] );
+	}
+
+	// the standard error of the mean luminance of a pixel relative to the luminance
+	// para 'i' : the index of the pixel
+	float _pixelNoise( unsigned i ) const {
+		// a resumed or cancelled pass could leave pixels with different numbers of passes
+		const float n = (float)max( 2u , m_pixelPassCnt[i] );
+		const float mean = m_lumSum[i] / n;
+		const float variance = max( 0.0f , ( m_lumSqrSum[i] - m_lumSum[i] * mean ) / ( n - 1.0f ) );
+		// dark pixels are not expected to be as accurate as bright ones
+		return sqrt( variance / n ) / ( mean + 0.01f );
+	}
+
+	// store a pixel of the current pass resolved from the filtered samples
+	// para 'x'     : x coordinate
+	// para 'y'     : y coordinate
+	// para 'color' : the filtered color of the pixel in the current pass
+	virtual void _resolvePixel( int x , int y , const Spectrum& color ){
+		_accumulatePixel( x , y , color );
+	}
+
+	// get the average of a pixel over the passes so far including the filtered samples of the current pass
+	// note : the samples of other tasks are not included until they are resolved
+	Spectrum _previewPixel( int x , int y ) const {
+		const int i = y * m_width + x;
+		const Spectrum current = ( m_filterWeight[i] > 0.0f ) ? m_filterSum[i] / m_filterWeight[i] : Spectrum();
+		return ( m_rendertarget.GetColor( x , y ) + current ) / (float)( m_pixelPassCnt[i] + 1 );
+	}
+
+	// the reconstruction filter of pixels
+	PixelFilter m_filter;
+	// the radiance of the samples of the current pass weighted by the filter and the sum of the weights of each pixel
+	std::vector<Spectrum> m_filterSum;
+	std::vector<float> m_filterWeight;
+	// whether each pixel is rendered in the current pass
+	std::vector<char> m_filterStored;
+	// the weighted samples splatted to the aprons of tasks , each thread has its own blocks like the splats of radiance
+	struct FilterSplat{
+		Spectrum	color;
+		float		weight = 0.0f;
+	};
+	std::vector< std::vector< std::unique_ptr<FilterSplat[]> > > m_filterSplats;
+
+	// the denoiser of the final image
+	Denoiser m_denoiser;
 
 	// the render target
 	RenderTarget m_rendertarget;
+
+	// the number of samples per pixel in each pass of a partial result , zero if the result is not partial
+	float m_partialSamples = 0.0f;
+	// the sum of the samples of each pixel and the number of them in a partial result
+	RenderTarget m_partialSum;
+	RenderTarget m_partialCount;
+
+	// the bits of the requested output variables
+	unsigned m_aovOutputMask = 0;
+	// the bits of the rendered output variables , the guides of the denoiser are rendered too
+	unsigned m_aovMask = 0;
+	// the sum of each requested output variable over the passes , they are averaged the same way as the render target
+	RenderTarget m_aovs[AOV_COUNT];
+
+	// the cost of a pixel summed over the passes
+	struct PixelCost{
+		double				seconds = 0.0;
+		unsigned long long	samples = 0;
+		unsigned long long	rays = 0;
+		unsigned long long	pathRays = 0;
+	};
+	// whether the cost of the pixels is requested
+	bool m_costOutput = false;
+	// the cost of each pixel , it is empty unless the cost is requested
+	std::vector<PixelCost> m_costs;
+	// the milliseconds taken by each pixel , the rays per sample and the closest hit rays per sample , the average path
+	// length , resolved after rendering. pixels rendered by other processes of a render farm take no time here.
+	RenderTarget m_cost;
+
+	// resolve the cost of the pixels and log the most expensive tiles
+	void _resolveCost();
 };
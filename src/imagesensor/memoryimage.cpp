@@ -0,0 +1,39 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "memoryimage.h"
+
+// store pixel information
+void MemoryImage::StorePixel( int x , int y , const Spectrum& color , const RenderTask& rt )
+{
+	_accumulatePixel( x , y , color );
+}
+
+// post process
+void MemoryImage::PostProcess()
+{
+	ImageSensor::PostProcess();
+
+	if( !m_pixels )
+		return;
+
+	// the rows of the render target are copied as they are , the fourth float is unused there and becomes an opaque alpha
+	m_rendertarget.ReadRect( 0 , 0 , m_width , m_height , m_pixels , m_width );
+	const size_t pixel_cnt = (size_t)m_width * m_height;
+	for( size_t i = 0 ; i < pixel_cnt ; ++i )
+		m_pixels[ RenderTarget::PIXEL_FLOATS * i + 3 ] = 1.0f;
+}
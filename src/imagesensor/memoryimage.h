@@ -0,0 +1,39 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "imagesensor.h"
+
+// the image is copied to a buffer of the application embedding the renderer once it is done
+class MemoryImage : public ImageSensor
+{
+public:
+	// constructor
+	// para 'pixels' : the buffer , four floats for each pixel of the rendered region in rows from the top
+	MemoryImage( float* pixels ) : m_pixels( pixels ) {}
+
+	// store pixel information
+	virtual void StorePixel( int x , int y , const Spectrum& color , const RenderTask& rt );
+
+	// post process
+	virtual void PostProcess();
+
+private:
+	// the buffer the image is copied to , it is owned by the application
+	float*	m_pixels;
+};
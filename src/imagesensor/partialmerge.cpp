@@ -0,0 +1,81 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "partialmerge.h"
+#include "managers/texio/exrio.h"
+#include "managers/texmanager.h"
+#include "texture/rendertarget.h"
+#include "log/log.h"
+
+// merge partial results
+bool PartialMerge::Merge( const string& output , const std::vector<string>& inputs )
+{
+	if( inputs.empty() )
+		return false;
+
+	// the sums are added in double precision , the order of the inputs hardly matters then
+	static const std::vector<string> channels = { "sum.R" , "sum.G" , "sum.B" , "samples.N" };
+	std::vector<double> total;
+	unsigned width = 0 , height = 0;
+	TexWriteOption option;
+	for( const string& input : inputs )
+	{
+		std::vector<float> data;
+		unsigned w = 0 , h = 0;
+		TexWriteOption window;
+		if( !ExrIO::ReadChannels( input , channels , data , w , h , window ) )
+			return false;
+
+		if( total.empty() )
+		{
+			width = w;
+			height = h;
+			option = window;
+			total.assign( data.size() , 0.0 );
+		}
+		else if( w != width || h != height || window.originX != option.originX || window.originY != option.originY )
+		{
+			slog( WARNING , IMAGE , stringFormat( "Partial result %s is of another image , it can't be merged." , input.c_str() ) );
+			return false;
+		}
+
+		for( size_t i = 0 ; i < data.size() ; ++i )
+			total[i] += data[i];
+	}
+
+	RenderTarget image;
+	image.SetSize( width , height );
+	for( unsigned i = 0 ; i < height ; ++i )
+		for( unsigned j = 0 ; j < width ; ++j )
+		{
+			const double* pixel = &total[ ( i * width + j ) * channels.size() ];
+			const double inv = ( pixel[3] > 0.0 ) ? 1.0 / pixel[3] : 0.0;
+			image.SetColor( j , i , (float)( pixel[0] * inv ) , (float)( pixel[1] * inv ) , (float)( pixel[2] * inv ) );
+		}
+
+	// the merged image is placed in the whole image the same way as the partial results
+	TexWriteOption write_option;
+	write_option.originX = option.originX;
+	write_option.originY = option.originY;
+	write_option.fullWidth = option.fullWidth;
+	write_option.fullHeight = option.fullHeight;
+	if( !TexManager::GetSingleton().Write( output , &image , write_option ) )
+		return false;
+
+	slog( INFO , IMAGE , stringFormat( "%d partial results are merged into %s." , (int)inputs.size() , output.c_str() ) );
+	return true;
+}
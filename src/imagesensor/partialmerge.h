@@ -0,0 +1,40 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//	definition of partial merge
+//	desc :	A frame could be rendered by several processes , each of
+//			them takes a separate range of the samples of the pixels.
+//			Their partial results keep the sum of the samples and the
+//			number of samples of every pixel , so the final image is
+//			the sum of all the sums divided by all the numbers , the
+//			same as if all samples were taken by one process.
+class	PartialMerge
+{
+// public method
+public:
+	// merge partial results into the final image
+	// para 'output' : the name of the final image
+	// para 'inputs' : the exr files of the partial results , they have to be of the same region of the same image
+	// result        : false if any of the partial results can't be merged
+	static bool Merge( const string& output , const std::vector<string>& inputs );
+};
@@ -0,0 +1,81 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "pixelfilter.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "utility/define.h"
+
+// set up the filter
+bool PixelFilter::Init( const string& type , float radius )
+{
+	bool known = true;
+	float default_radius = 0.5f;
+	if( type == "gaussian" ){
+		m_type = FILTER_GAUSSIAN;
+		default_radius = 1.5f;
+	}else if( type == "mitchell" ){
+		m_type = FILTER_MITCHELL;
+		default_radius = 2.0f;
+	}else if( type == "blackman_harris" ){
+		m_type = FILTER_BLACKMAN_HARRIS;
+		default_radius = 2.0f;
+	}else{
+		known = ( type == "box" );
+		if( !known )
+			slog( WARNING , GENERAL , stringFormat( "Unknown pixel filter %s , the box filter is used." , type.c_str() ) );
+		m_type = FILTER_BOX;
+	}
+
+	// a sample always contributes to its own pixel
+	m_radius = ( radius > 0.0f ) ? max( 0.5f , radius ) : default_radius;
+	m_invStep = TABLE_SIZE / m_radius;
+	for( unsigned i = 0 ; i < TABLE_SIZE ; ++i )
+		m_table[i] = _evaluate( ( i + 0.5f ) * m_radius / TABLE_SIZE );
+	return known;
+}
+
+// evaluate the one dimensional filter
+float PixelFilter::_evaluate( float x ) const
+{
+	switch( m_type )
+	{
+	case FILTER_GAUSSIAN:
+	{
+		// the gaussian is shifted down so that it falls to zero at the radius
+		const float alpha = 2.0f;
+		return max( 0.0f , exp( -alpha * x * x ) - exp( -alpha * m_radius * m_radius ) );
+	}
+	case FILTER_MITCHELL:
+	{
+		// the cubic of Mitchell and Netravali with B = C = 1/3 , it is scaled to cover the radius
+		const float B = 1.0f / 3.0f , C = 1.0f / 3.0f;
+		const float t = 2.0f * x / m_radius;
+		if( t < 1.0f )
+			return ( ( 12.0f - 9.0f * B - 6.0f * C ) * t * t * t + ( -18.0f + 12.0f * B + 6.0f * C ) * t * t + ( 6.0f - 2.0f * B ) ) / 6.0f;
+		return ( ( -B - 6.0f * C ) * t * t * t + ( 6.0f * B + 30.0f * C ) * t * t + ( -12.0f * B - 48.0f * C ) * t + ( 8.0f * B + 24.0f * C ) ) / 6.0f;
+	}
+	case FILTER_BLACKMAN_HARRIS:
+	{
+		// the window spans the diameter of the filter
+		const float t = 0.5f + 0.5f * x / m_radius;
+		return 0.35875f - 0.48829f * cos( TWO_PI * t ) + 0.14128f * cos( 2.0f * TWO_PI * t ) - 0.01168f * cos( 3.0f * TWO_PI * t );
+	}
+	default:
+		return 1.0f;
+	}
+}
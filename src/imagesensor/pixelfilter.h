@@ -0,0 +1,76 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "utility/enum.h"
+
+// the reconstruction filter of pixels , the radiance of a sample is splatted to all pixels within the radius weighted by the filter.
+// the filters are separable , the weights are looked up in a table of the one dimensional filter precomputed once it is set up.
+// the box filter of radius 0.5 is the plain average of the samples in each pixel , no sample contributes to another pixel then.
+class PixelFilter
+{
+public:
+	// the number of entries in the table of weights
+	static const unsigned TABLE_SIZE = 64;
+
+	// set up the filter , the default radius of the filter is picked if the radius is not positive
+	// para 'type'   : the name of the filter , 'box' , 'gaussian' , 'mitchell' or 'blackman_harris'
+	// para 'radius' : the radius of the filter in pixels
+	// result        : false if the filter is unknown , the box filter is kept then
+	bool Init( const string& type , float radius );
+
+	// whether samples contribute to other pixels
+	bool IsSplatting() const {
+		return m_type != FILTER_BOX || m_radius > 0.5f;
+	}
+
+	// get the radius of the filter in pixels
+	float GetRadius() const {
+		return m_radius;
+	}
+
+	// get the number of pixels around a tile covered by the samples in it
+	int GetApron() const {
+		return (int)ceil( m_radius - 0.5f );
+	}
+
+	// get the weight of a sample
+	// para 'dx' : the offset of the sample from the center of the pixel along x
+	// para 'dy' : the offset of the sample from the center of the pixel along y
+	// result    : the weight , it is zero outside of the radius
+	float Evaluate( float dx , float dy ) const {
+		const float x = fabs( dx ) * m_invStep;
+		const float y = fabs( dy ) * m_invStep;
+		if( x >= (float)TABLE_SIZE || y >= (float)TABLE_SIZE )
+			return 0.0f;
+		return m_table[(unsigned)x] * m_table[(unsigned)y];
+	}
+
+private:
+	FILTER_TYPE	m_type = FILTER_BOX;
+	float		m_radius = 0.5f;
+	// the number of table entries per pixel
+	float		m_invStep = TABLE_SIZE / 0.5f;
+	// the weights of the one dimensional filter at the centers of equal steps from 0 to the radius
+	float		m_table[TABLE_SIZE];
+
+	// evaluate the one dimensional filter
+	// para 'x' : the distance to the center , it is smaller than the radius
+	float _evaluate( float x ) const;
+};
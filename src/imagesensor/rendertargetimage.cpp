@@ -16,11 +16,35 @@
  */
 
 #include "rendertargetimage.h"
+#include "managers/texmanager.h"
+#include "managers/texio/exrio.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "utility/multithread/multithread.h"
+#include <sstream>
+
+extern int g_iTileSize;
+
+// the names of the output variables and their channels
+static const char* g_aovNames[AOV_COUNT] = { "albedo" , "normal" , "depth" , "direct" , "indirect" };
+static const char* g_aovChannels[AOV_COUNT] = { "RGB" , "XYZ" , "Z" , "RGB" , "RGB" };
+
+// constructor
+RenderTargetImage::RenderTargetImage()
+{
+	_registerAllProperty();
+}
+
+// destructor
+RenderTargetImage::~RenderTargetImage()
+{
+}
 
 // store pixel information
 void RenderTargetImage::StorePixel( int x , int y , const Spectrum& color , const RenderTask& rt )
 {
-	m_rendertarget.SetColor( x , y , color );
+	// the color is added , passes of progressive rendering and light paths of other pixels accumulate in the render target
+	_accumulatePixel( x , y , color );
 }
 
 // post process
@@ -28,8 +52,189 @@ void RenderTargetImage::PostProcess()
 {
 	ImageSensor::PostProcess();
 
-    if( !m_filename.empty() )
-        m_rendertarget.Output(m_filename);
-    else
-        m_rendertarget.Output("default.bmp");	
+    const string filename = m_filename.empty() ? "default.bmp" : m_filename;
+
+    // the image is written again if some of the tiles are missing , the ones of a cancelled rendering for example
+    if( m_tileStream ){
+        const bool complete = m_tileStream->Close();
+        m_tileStream.reset();
+        m_tilePixels.reset();
+        if( complete )
+            return;
+        slog( INFO , IMAGE , stringFormat( "Not all tiles of %s are streamed , the whole image is written." , filename.c_str() ) );
+    }
+
+    // exr files keep the output variables as layers , the other formats write them to separate files
+    TexWriteOption option = _writeOption();
+    const bool layered = TexTypeFromStr( filename ) == TT_EXR;
+    for( unsigned i = 0 ; i < AOV_COUNT ; ++i ){
+        if( !( m_aovOutputMask & ( 1u << i ) ) )
+            continue;
+        if( layered ){
+            TexLayer layer;
+            layer.name = g_aovNames[i];
+            layer.tex = &m_aovs[i];
+            layer.channels = g_aovChannels[i];
+            option.layers.push_back( layer );
+        }else{
+            const size_t dot = filename.find_last_of( '.' );
+            const string base = ( dot == string::npos ) ? filename : filename.substr( 0 , dot );
+            const string ext = ( dot == string::npos ) ? string() : filename.substr( dot );
+            TexManager::GetSingleton().Write( base + "_" + g_aovNames[i] + ext , &m_aovs[i] , _writeOption() );
+        }
+    }
+    // the cost keeps its measures in an exr layer , the other formats get a heat map of the time instead
+    if( HasCost() ){
+        if( layered ){
+            TexLayer layer;
+            layer.name = "cost";
+            layer.tex = &m_cost;
+            layer.channels = "TRP";
+            option.layers.push_back( layer );
+        }else{
+            const size_t dot = filename.find_last_of( '.' );
+            const string base = ( dot == string::npos ) ? filename : filename.substr( 0 , dot );
+            const string ext = ( dot == string::npos ) ? string() : filename.substr( dot );
+            RenderTarget heatmap;
+            _costHeatmap( heatmap );
+            TexManager::GetSingleton().Write( base + "_cost" + ext , &heatmap , _writeOption() );
+        }
+    }
+    // partial results keep the sums of the samples and the numbers of them in full precision , 'SORT merge' combines them
+    if( m_partialSamples > 0.0f ){
+        if( layered ){
+            TexLayer sum , count;
+            sum.name = "sum";
+            sum.tex = &m_partialSum;
+            sum.channels = "RGB";
+            count.name = "samples";
+            count.tex = &m_partialCount;
+            count.channels = "N";
+            option.layers.push_back( sum );
+            option.layers.push_back( count );
+        }else
+            slog( WARNING , IMAGE , stringFormat( "Partial results are only kept in exr files , %s can't be merged." , filename.c_str() ) );
+    }
+    TexManager::GetSingleton().Write( filename , &m_rendertarget , option );
+}
+
+// write the tiles of the image to the file once they are finished
+void RenderTargetImage::BeginStreaming()
+{
+    if( !m_stream )
+        return;
+
+    // only tiled exr files take tiles in any order , the other files are written at the end
+    const string filename = m_filename.empty() ? "default.bmp" : m_filename;
+    if( TexTypeFromStr( filename ) != TT_EXR ){
+        slog( WARNING , IMAGE , stringFormat( "Only exr files are streamed , %s is written once the rendering is done." , filename.c_str() ) );
+        return;
+    }
+    // the output variables and the denoised image are only complete at the end
+    if( m_aovOutputMask || m_costOutput || m_denoiser.IsEnabled() ){
+        slog( WARNING , IMAGE , "Images with output variables or denoising are not streamed , they are written once the rendering is done." );
+        return;
+    }
+
+    m_streamTileSize = m_option.tileSize ? (int)m_option.tileSize : g_iTileSize;
+    m_streamTileCntX = ( m_width + m_streamTileSize - 1 ) / m_streamTileSize;
+    const int tile_cnt = m_streamTileCntX * ( ( m_height + m_streamTileSize - 1 ) / m_streamTileSize );
+    m_tilePixels.reset( new std::atomic<int>[tile_cnt] );
+    for( int i = 0 ; i < tile_cnt ; ++i )
+        m_tilePixels[i] = 0;
+
+    m_tileStream.reset( new ExrTileStream() );
+    if( !m_tileStream->Open( filename , m_width , m_height , m_streamTileSize , _writeOption() ) ){
+        m_tileStream.reset();
+        m_tilePixels.reset();
+    }
+}
+
+// finish the pixels of a render task
+void RenderTargetImage::FinishTile( const RenderTask& rt )
+{
+    if( !m_tileStream )
+        return;
+
+    // count the finished pixels in each tile overlapped by the task , the tiles covered completely are written
+    const int r = rt.ori.x + rt.size.x;
+    const int b = rt.ori.y + rt.size.y;
+    for( int tile_y = rt.ori.y - rt.ori.y % m_streamTileSize ; tile_y < b ; tile_y += m_streamTileSize ){
+        for( int tile_x = rt.ori.x - rt.ori.x % m_streamTileSize ; tile_x < r ; tile_x += m_streamTileSize ){
+            const int tile_r = min( tile_x + m_streamTileSize , m_width );
+            const int tile_b = min( tile_y + m_streamTileSize , m_height );
+            const int pixels = ( min( tile_r , r ) - max( tile_x , rt.ori.x ) ) * ( min( tile_b , b ) - max( tile_y , rt.ori.y ) );
+
+            const int tx = tile_x / m_streamTileSize;
+            const int ty = tile_y / m_streamTileSize;
+            if( ( m_tilePixels[ ty * m_streamTileCntX + tx ] += pixels ) == ( tile_r - tile_x ) * ( tile_b - tile_y ) )
+                m_tileStream->WriteTile( &m_rendertarget , tx , ty );
+        }
+    }
+}
+
+// get the way the image is stored
+TexWriteOption RenderTargetImage::_writeOption() const
+{
+    // the rendered region keeps its position in the whole image
+    TexWriteOption option = m_option;
+    option.originX = m_regionX;
+    option.originY = m_regionY;
+    option.fullWidth = m_fullWidth;
+    option.fullHeight = m_fullHeight;
+    return option;
+}
+
+// request the output variables by their names
+void RenderTargetImage::_requestAov( const string& str )
+{
+    string names = str;
+    std::replace( names.begin() , names.end() , ',' , ' ' );
+
+    m_aovOutputMask = 0;
+    m_costOutput = false;
+    std::istringstream stream( names );
+    string name;
+    while( stream >> name ){
+        // the cost of the pixels is measured by the render tasks instead of the integrator
+        if( name == "cost" ){
+            m_costOutput = true;
+            continue;
+        }
+        unsigned i = 0;
+        while( i < AOV_COUNT && name != g_aovNames[i] )
+            ++i;
+        if( i < AOV_COUNT )
+            m_aovOutputMask |= 1u << i;
+        else
+            slog( WARNING , GENERAL , stringFormat( "There is no output variable named %s." , name.c_str() ) );
+    }
+}
+
+// map the time taken by the pixels to colors , from blue for the cheap pixels to red for the expensive ones
+void RenderTargetImage::_costHeatmap( RenderTarget& heatmap ) const
+{
+    heatmap.SetSize( m_width , m_height );
+
+    // a few outliers would leave the rest of the image blue , the time is normalized by the 99th percentile instead
+    std::vector<float> times( m_width * m_height );
+    for( int i = 0 ; i < m_height ; ++i )
+        for( int j = 0 ; j < m_width ; ++j )
+            times[ i * m_width + j ] = m_cost.GetColor( j , i ).GetR();
+    if( times.empty() )
+        return;
+    std::vector<float> sorted = times;
+    const size_t k = ( sorted.size() - 1 ) * 99 / 100;
+    std::nth_element( sorted.begin() , sorted.begin() + k , sorted.end() );
+    const float scale = sorted[k] > 0.0f ? 1.0f / sorted[k] : 0.0f;
+
+    for( int i = 0 ; i < m_height ; ++i )
+        for( int j = 0 ; j < m_width ; ++j ){
+            // blue , cyan , green , yellow and red along the time
+            const float t = min( times[ i * m_width + j ] * scale , 1.0f ) * 4.0f;
+            const float r = saturate( t - 2.0f );
+            const float g = t < 3.0f ? saturate( t ) : saturate( 4.0f - t );
+            const float b = saturate( 2.0f - t );
+            heatmap.SetColor( j , i , Spectrum( r , g , b ) );
+        }
 }
@@ -18,31 +18,67 @@
 #pragma once
 
 #include "imagesensor.h"
+#include "managers/texio/texio.h"
+#include <atomic>
+
+class ExrTileStream;
 
 // generate output
 class RenderTargetImage : public ImageSensor
 {
 public:
     // constructor
-    RenderTargetImage()
-    {
-        _registerAllProperty();
-    }
+    RenderTargetImage();
+    // destructor
+    ~RenderTargetImage();
 	// store pixel information
 	virtual void StorePixel( int x , int y , const Spectrum& color , const RenderTask& rt );
 
 	// post process
 	virtual void PostProcess();
 
+	// write the tiles of the image to the file once they are finished
+	virtual void BeginStreaming();
+
+	// finish the pixels of a render task
+	virtual void FinishTile( const RenderTask& rt );
+
 private:
     // filename
     string      m_filename;
+    // the way the image is stored in the file
+    TexWriteOption  m_option;
+    // whether finished tiles are written to the file during rendering
+    bool        m_stream = false;
+    // the file the finished tiles are written to , it is only created for exr files
+    std::unique_ptr<ExrTileStream>  m_tileStream;
+    // the size of the tiles in the file
+    int         m_streamTileSize = 0;
+    // the number of tiles in a row of the file
+    int         m_streamTileCntX = 0;
+    // the number of finished pixels in each tile of the file
+    std::unique_ptr<std::atomic<int>[]>  m_tilePixels;
     
     // register property
     void _registerAllProperty()
     {
         _registerProperty( "filename" , new FilenameProperty( this ) );
+        _registerProperty( "compression" , new CompressionProperty( this ) );
+        _registerProperty( "tile_size" , new TileSizeProperty( this ) );
+        _registerProperty( "aov" , new AovProperty( this ) );
+        _registerProperty( "stream" , new StreamProperty( this ) );
     }
+
+    // get the way the image is stored , it includes the position of the rendered region
+    TexWriteOption _writeOption() const;
+
+    // request the output variables by their names , 'cost' requests the cost of the pixels
+    // para 'str' : the names separated by spaces or commas
+    void _requestAov( const string& str );
+
+    // map the time taken by the pixels to colors
+    // para 'heatmap' : the heat map of the image
+    void _costHeatmap( RenderTarget& heatmap ) const;
     
     class FilenameProperty : public PropertyHandler<ImageSensor>
     {
@@ -56,4 +92,56 @@ private:
             rti->m_filename = str;
         }
     };
+
+    class CompressionProperty : public PropertyHandler<ImageSensor>
+    {
+    public:
+        PH_CONSTRUCTOR(CompressionProperty,ImageSensor);
+        
+        // set value
+        void SetValue( const string& str )
+        {
+            RenderTargetImage* rti = CAST_TARGET(RenderTargetImage);
+            rti->m_option.compression = str;
+        }
+    };
+    
+    class TileSizeProperty : public PropertyHandler<ImageSensor>
+    {
+    public:
+        PH_CONSTRUCTOR(TileSizeProperty,ImageSensor);
+        
+        // set value
+        void SetValue( const string& str )
+        {
+            RenderTargetImage* rti = CAST_TARGET(RenderTargetImage);
+            rti->m_option.tileSize = (unsigned)max( 0 , atoi( str.c_str() ) );
+        }
+    };
+    
+    class StreamProperty : public PropertyHandler<ImageSensor>
+    {
+    public:
+        PH_CONSTRUCTOR(StreamProperty,ImageSensor);
+        
+        // set value
+        void SetValue( const string& str )
+        {
+            RenderTargetImage* rti = CAST_TARGET(RenderTargetImage);
+            rti->m_stream = ( str == "true" || atoi( str.c_str() ) != 0 );
+        }
+    };
+    
+    class AovProperty : public PropertyHandler<ImageSensor>
+    {
+    public:
+        PH_CONSTRUCTOR(AovProperty,ImageSensor);
+        
+        // set value
+        void SetValue( const string& str )
+        {
+            RenderTargetImage* rti = CAST_TARGET(RenderTargetImage);
+            rti->_requestAov( str );
+        }
+    };
 };
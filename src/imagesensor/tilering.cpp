@@ -0,0 +1,66 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "tilering.h"
+#include <new>
+
+static_assert( sizeof( TileRingHeader ) == 64 && sizeof( TileRingEntry ) == 16 , "The layout of the ring is shared with the blender add-on." );
+
+// set up the ring at the beginning of the shared memory
+void TileRing::Init( char* mem , unsigned tile_cnt )
+{
+	m_header = new (mem) TileRingHeader();
+	m_versions = reinterpret_cast<std::atomic<unsigned>*>( mem + sizeof( TileRingHeader ) );
+	m_entries = reinterpret_cast<TileRingEntry*>( mem + sizeof( TileRingHeader ) + _versionSize( tile_cnt ) );
+	for( unsigned i = 0 ; i < tile_cnt ; ++i )
+		new (m_versions + i) std::atomic<unsigned>( 0 );
+	const unsigned capacity = Capacity( tile_cnt );
+	for( unsigned i = 0 ; i < capacity ; ++i )
+		new (m_entries + i) TileRingEntry();
+	m_seq = 0;
+
+	m_header->version = VERSION;
+	m_header->tileCount = tile_cnt;
+	m_header->capacity = capacity;
+	m_header->writeSeq.store( 0 , std::memory_order_relaxed );
+
+	// the add-on only trusts the ring once the magic number is visible
+	std::atomic_thread_fence( std::memory_order_release );
+	m_header->magic = MAGIC;
+}
+
+// push a finished tile
+void TileRing::Push( unsigned tile )
+{
+	if( !m_header )
+		return;
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	// the pixels of the tile are visible before its new version
+	const unsigned version = m_versions[tile].fetch_add( 1 , std::memory_order_release ) + 1;
+
+	// the entry is invalidated while it is rewritten , a reader of the old entry sees the sequence number change
+	TileRingEntry& entry = m_entries[ m_seq % m_header->capacity ];
+	entry.seq.store( 0 , std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	entry.tile = tile;
+	entry.version = version;
+	entry.seq.store( m_seq + 1 , std::memory_order_release );
+
+	m_header->writeSeq.store( ++m_seq , std::memory_order_release );
+}
@@ -0,0 +1,95 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <atomic>
+#include <mutex>
+
+// the header of the ring of finished tiles , it is at the beginning of the shared memory with the blender add-on
+// the layout of the shared memory is
+//	| ring header | tile versions | ring entries | tiles | progress , final update flag , render control |
+struct TileRingHeader
+{
+	unsigned							magic;		// 'SRTB' once the ring is set up
+	unsigned							version;	// the version of the protocol
+	unsigned							tileCount;	// the number of tiles in the image
+	unsigned							capacity;	// the number of entries in the ring
+	std::atomic<unsigned long long>		writeSeq;	// the number of pushed entries , it is stored with release semantics
+	char								padding[40];
+};
+
+// an entry of the ring , it tells that a tile is finished once more
+struct TileRingEntry
+{
+	std::atomic<unsigned long long>		seq;		// the sequence number of the entry plus one , 0 while it is written
+	unsigned							tile;		// the index of the tile
+	unsigned							version;	// the version of the tile when it is pushed
+};
+
+// a ring of finished tiles in shared memory , SORT produces and the blender add-on consumes the entries
+// the producer never waits for the consumer , a consumer falling behind by more than the capacity sees the
+// sequence numbers of overwritten entries change and falls back to compare the versions of all tiles.
+// a tile is pushed again every time it is finished in progressive rendering , the pixels of the latest pass
+// are always in its slot of the shared memory.
+class TileRing
+{
+public:
+	// the magic number and the version of the protocol
+	static const unsigned MAGIC = 0x42545253;
+	static const unsigned VERSION = 2;
+
+	// get the number of entries of the ring
+	// para 'tile_cnt' : the number of tiles in the image
+	// result          : the capacity , it has to match the one of the add-on
+	static unsigned Capacity( unsigned tile_cnt ){
+		return max( 64u , 2 * tile_cnt );
+	}
+
+	// get the size of the ring in the shared memory , the tiles follow it
+	// para 'tile_cnt' : the number of tiles in the image
+	// result          : the size in bytes , it is a multiple of eight
+	static unsigned Size( unsigned tile_cnt ){
+		return (unsigned)sizeof( TileRingHeader ) + _versionSize( tile_cnt ) + Capacity( tile_cnt ) * (unsigned)sizeof( TileRingEntry );
+	}
+
+	// set up the ring at the beginning of the shared memory
+	// para 'mem'      : the shared memory , it has to be aligned to eight bytes
+	// para 'tile_cnt' : the number of tiles in the image
+	void Init( char* mem , unsigned tile_cnt );
+
+	// push a finished tile , it could be called from any thread
+	// note       : the pixels of the tile have to be written before
+	// para 'tile' : the index of the tile
+	void Push( unsigned tile );
+
+private:
+	TileRingHeader*			m_header = nullptr;
+	std::atomic<unsigned>*	m_versions = nullptr;
+	TileRingEntry*			m_entries = nullptr;
+
+	// the sequence number of the next entry , entries are written in the order of it
+	unsigned long long		m_seq = 0;
+	// the ring has a single producer , finished tiles of all threads are pushed one by one
+	std::mutex				m_mutex;
+
+	// the size of the versions of the tiles , it is padded to eight bytes
+	static unsigned _versionSize( unsigned tile_cnt ){
+		return ( tile_cnt * (unsigned)sizeof( unsigned ) + 7 ) & ~7u;
+	}
+};
@@ -38,6 +38,81 @@ Spectrum AmbientOcclusion::Li( const Ray& r , const PixelSample& ps ) const
 		return 0.0f;
 
 	//return Spectrum((ip.normal.x + 1.0f)*0.5f, (ip.normal.y+1.0f)*0.5f, (ip.normal.z + 1.0f) * 0.5f);
+
+	// the rays of a hit are traced together
+	if( m_samples > 1 )
+	{
+		Ray* aorays = SORT_MALLOC_ARRAY( Ray , m_samples );
+		bool* occluded = SORT_MALLOC_ARRAY( bool , m_samples );
+		_occlusionRays( r , ip , aorays , m_samples );
+		scene.IsOccluded( aorays , occluded , m_samples );
+		return _occlusion( occluded , m_samples );
+	}
+
+	// the ray to be tested
+	Ray ray = _occlusionRay( r , ip );
+
+	Intersection aoip;
+	const bool hit = scene.GetIntersect( ray , &aoip );
+	return _occlusion( ray , hit , aoip );
+}
+
+// radiance along a stream of rays
+void AmbientOcclusion::LiStream( const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned count ) const
+{
+	Intersection* ips = SORT_MALLOC_ARRAY( Intersection , count );
+	Intersection* aoips = SORT_MALLOC_ARRAY( Intersection , count );
+	Ray* aorays = SORT_MALLOC_ARRAY( Ray , count );
+	unsigned* ids = SORT_MALLOC_ARRAY( unsigned , count );
+	bool* hits = SORT_MALLOC_ARRAY( bool , count );
+	bool* aohits = SORT_MALLOC_ARRAY( bool , count );
+	for( unsigned i = 0 ; i < count ; ++i ){
+		new (&ips[i]) Intersection();
+		new (&aoips[i]) Intersection();
+	}
+
+	// trace the camera rays together
+	scene.GetIntersect( rays , ips , hits , count );
+
+	// the occlusion rays of all hits are traced together
+	if( m_samples > 1 )
+	{
+		unsigned hitcount = 0;
+		for( unsigned i = 0 ; i < count ; ++i ){
+			radiance[i] = 0.0f;
+			if( rays[i].m_Depth <= max_recursive_depth && hits[i] )
+				ids[hitcount++] = i;
+		}
+
+		Ray* batch = SORT_MALLOC_ARRAY( Ray , hitcount * m_samples );
+		bool* occluded = SORT_MALLOC_ARRAY( bool , hitcount * m_samples );
+		for( unsigned k = 0 ; k < hitcount ; ++k )
+			_occlusionRays( rays[ids[k]] , ips[ids[k]] , batch + k * m_samples , m_samples );
+		scene.IsOccluded( batch , occluded , hitcount * m_samples );
+		for( unsigned k = 0 ; k < hitcount ; ++k )
+			radiance[ids[k]] = _occlusion( occluded + k * m_samples , m_samples );
+		return;
+	}
+
+	// occlusion rays are spawned in the same order with evaluating the rays one by one
+	unsigned aocount = 0;
+	for( unsigned i = 0 ; i < count ; ++i ){
+		radiance[i] = 0.0f;
+		if( rays[i].m_Depth > max_recursive_depth || !hits[i] )
+			continue;
+		new (&aorays[aocount]) Ray( _occlusionRay( rays[i] , ips[i] ) );
+		ids[aocount++] = i;
+	}
+
+	// trace the occlusion rays together
+	scene.GetIntersect( aorays , aoips , aohits , aocount );
+	for( unsigned k = 0 ; k < aocount ; ++k )
+		radiance[ids[k]] = _occlusion( aorays[k] , aohits[k] , aoips[k] );
+}
+
+// generate the occlusion ray at an intersection
+Ray AmbientOcclusion::_occlusionRay( const Ray& r , const Intersection& ip ) const
+{
 	Vector nn = ip.normal;
 	Vector tn = Normalize(Cross( nn , ip.tangent ));
 	Vector sn = Cross( tn , nn );
@@ -51,12 +126,60 @@ Spectrum AmbientOcclusion::Li( const Ray& r , const PixelSample& ps ) const
 	if (Dot(r.m_Dir, nn)>0.0f)
 		wi *= -1.0f;
 
-	// the ray to be tested
-	Ray ray( ip.intersect , wi , 0 , 0.001f , maxDistance );
+	Ray ray = ip.SpawnRay( wi );
+	ray.m_fMax = maxDistance;
+	return ray;
+}
+
+// generate a batch of occlusion rays at an intersection
+void AmbientOcclusion::_occlusionRays( const Ray& r , const Intersection& ip , Ray* rays , unsigned count ) const
+{
+	// the frame is shared by all rays , the incident direction is flipped along with it if necessary
+	Vector nn = ip.normal;
+	Vector tn = Normalize(Cross( nn , ip.tangent ));
+	Vector sn = Cross( tn , nn );
+	if (Dot(r.m_Dir, nn)>0.0f)
+	{
+		nn *= -1.0f;
+		tn *= -1.0f;
+		sn *= -1.0f;
+	}
 
+	// directions are generated in local space first , the transform to world space is a plain loop over the batch
+	float* x = SORT_MALLOC_ARRAY( float , count );
+	float* y = SORT_MALLOC_ARRAY( float , count );
+	float* z = SORT_MALLOC_ARRAY( float , count );
+	for( unsigned i = 0 ; i < count ; ++i )
+	{
+		const Vector _wi = CosSampleHemisphere( sort_canonical() , sort_canonical() );
+		x[i] = _wi.x;
+		y[i] = _wi.y;
+		z[i] = _wi.z;
+	}
+	for( unsigned i = 0 ; i < count ; ++i )
+	{
+		const Vector wi( x[i] * sn.x + y[i] * nn.x + z[i] * tn.x ,
+						 x[i] * sn.y + y[i] * nn.y + z[i] * tn.y ,
+						 x[i] * sn.z + y[i] * nn.z + z[i] * tn.z );
+		new (&rays[i]) Ray( ip.SpawnRay( wi ) );
+		rays[i].m_fMax = maxDistance;
+	}
+}
+
+// evaluate the occlusion of a batch of occlusion rays
+Spectrum AmbientOcclusion::_occlusion( const bool* occluded , unsigned count ) const
+{
+	unsigned visible = 0;
+	for( unsigned i = 0 ; i < count ; ++i )
+		visible += occluded[i] ? 0 : 1;
+	return (float)visible / (float)count;
+}
+
+// evaluate the occlusion along the occlusion ray
+Spectrum AmbientOcclusion::_occlusion( const Ray& ray , bool hit , const Intersection& aoip ) const
+{
 	// if there is no intersection, return 1.0 as full illumination
-	Intersection aoip;
-	if( !scene.GetIntersect( ray , &aoip ) )
+	if( !hit )
 		return 1.0f;
 
 	float distance = Distance( aoip.intersect , ray.m_Ori );
@@ -72,4 +195,5 @@ void AmbientOcclusion::OutputLog() const{
 void AmbientOcclusion::_registerAllProperty()
 {
 	_registerProperty( "max_distance" , new MaxDistanceProperty(this) );
+	_registerProperty( "ao_samples" , new SamplesProperty(this) );
 }
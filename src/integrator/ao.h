@@ -20,8 +20,15 @@
 // include the header file
 #include "integrator.h"
 
+// pre-declera classes
+class	Intersection;
+
 /////////////////////////////////////////////////////////////////////////////
 // definition of Ambient Occulusion
+// note : with more than one occlusion ray per hit , the rays of a hit are generated
+//		  in a batch and traced together through the any-hit query , the occlusion
+//		  is the fraction of blocked rays without the falloff by the distance of the
+//		  occluder , since any-hit queries don't find the nearest one.
 class	AmbientOcclusion : public Integrator
 {
 // public method
@@ -36,12 +43,42 @@ public:
 	// result       : radiance along the ray from the scene<F3>
 	virtual Spectrum	Li( const Ray& ray , const PixelSample& ps ) const;
 
+	// return the radiance of a stream of rays
+	// note : camera rays are traced together , so are the occlusion rays spawned from them
+	virtual void		LiStream( const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned count ) const;
+
 	// output log information
 	virtual void OutputLog() const;
 
 // private field
 private:
 	float	maxDistance = 10.0f;
+	// the number of occlusion rays of each hit
+	unsigned	m_samples = 1;
+
+	// generate the occlusion ray at an intersection
+	// para 'r'  : the ray hitting the scene
+	// para 'ip' : the intersection
+	// result    : the ray sampled in the hemisphere around the normal
+	Ray _occlusionRay( const Ray& r , const Intersection& ip ) const;
+
+	// generate a batch of occlusion rays at an intersection , they are cosine distributed around the normal
+	// para 'r'     : the ray hitting the scene
+	// para 'ip'    : the intersection
+	// para 'rays'  : the occlusion rays ( output )
+	// para 'count' : the number of rays to be generated
+	void _occlusionRays( const Ray& r , const Intersection& ip , Ray* rays , unsigned count ) const;
+
+	// evaluate the occlusion of a batch of occlusion rays
+	// para 'occluded' : whether each ray is blocked
+	// para 'count'    : the number of rays
+	Spectrum _occlusion( const bool* occluded , unsigned count ) const;
+
+	// evaluate the occlusion along the occlusion ray
+	// para 'ray'  : the occlusion ray
+	// para 'hit'  : whether the occlusion ray hits the scene
+	// para 'aoip' : the intersection of the occlusion ray
+	Spectrum _occlusion( const Ray& ray , bool hit , const Intersection& aoip ) const;
 
 	void _registerAllProperty();
 
@@ -57,4 +94,17 @@ private:
 				ao->maxDistance = (float)atof( str.c_str() );
 		}
 	};
+
+	// Occlusion rays per hit Property
+	class SamplesProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SamplesProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			AmbientOcclusion* ao = CAST_TARGET(AmbientOcclusion);
+			if( ao )
+				ao->m_samples = (unsigned)max( 1 , atoi( str.c_str() ) );
+		}
+	};
 };
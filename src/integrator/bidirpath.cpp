@@ -23,97 +23,100 @@
 #include "integratormethod.h"
 #include "camera/camera.h"
 #include "imagesensor/imagesensor.h"
+#include "utility/multithread/threadpool.h"
+#include "math/octahedral.h"
+#include "log/log.h"
 
 IMPLEMENT_CREATOR( BidirPathTracing );
 
+// pack a vertex of a light path
+void LVC_Vertex::Pack( const BDPT_Vertex& vert )
+{
+	p = vert.p;
+	throughput = vert.throughput;
+	u = vert.inter.u;
+	v = vert.inter.v;
+	vc = vert.vc;
+	vcm = vert.vcm;
+	primitive = vert.inter.primitive;
+	n = EncodeOctahedral( vert.n );
+	gn = EncodeOctahedral16( vert.inter.gnormal );
+	wi = EncodeOctahedral( vert.wi );
+
+	// the tangent is kept as an angle in a frame derived from the shading normal , anisotropic bsdfs are evaluated in the same frame again
+	Vector s , t;
+	CoordinateSystem( DecodeOctahedral( n ) , s , t );
+	const float phi = atan2( Dot( vert.inter.tangent , t ) , Dot( vert.inter.tangent , s ) );
+	tangent = (unsigned short)( (int)floor( ( phi / TWO_PI + 0.5f ) * 65536.0f + 0.5f ) & 0xffff );
+	depth = (unsigned short)vert.depth;
+	rr = (unsigned short)( saturate( vert.rr ) * 65535.0f + 0.5f );
+}
+
+// unpack the vertex
+void LVC_Vertex::Unpack( BDPT_Vertex& vert ) const
+{
+	vert.inter = Intersection();
+	vert.inter.intersect = p;
+	vert.inter.normal = DecodeOctahedral( n );
+	vert.inter.gnormal = DecodeOctahedral16( gn );
+	vert.inter.u = u;
+	vert.inter.v = v;
+	vert.inter.primitive = const_cast<Primitive*>( primitive );
+	Vector s , t;
+	CoordinateSystem( vert.inter.normal , s , t );
+	const float phi = ( tangent / 65536.0f - 0.5f ) * TWO_PI;
+	vert.inter.tangent = s * cos( phi ) + t * sin( phi );
+
+	// the error of the point is not kept , the bound is loose enough for transformed instances
+	vert.inter.error = PointError( p , 32 );
+
+	vert.p = p;
+	vert.n = vert.inter.normal;
+	vert.wi = DecodeOctahedral( wi );
+	vert.bsdf = primitive->GetMaterial()->GetBsdf( &vert.inter );
+	vert.throughput = throughput;
+	vert.vc = vc;
+	vert.vcm = vcm;
+	vert.rr = rr / 65535.0f;
+	vert.depth = depth;
+}
+
 // return the radiance of a specific direction
 Spectrum BidirPathTracing::Li( const Ray& ray , const PixelSample& ps ) const
 {
-	// pick a light randomly
+	// light paths of light tracing are traced before the pass , eye paths only see the lights directly
+	if( light_tracing_only )
+	{
+		Intersection inter;
+		if( false == scene.GetIntersect( ray , &inter ) )
+			return scene.Le( ray );
+		return inter.Le( -ray.m_Dir );
+	}
+
+	// eye paths connect to the light vertex cache , they only pick a light for themselves
+	// the vertices of the light path are kept in a buffer of the thread , it is not allocated again for every sample
 	float pdf;
-	const Light* light = scene.SampleLight( sort_canonical() , &pdf );
+	static thread_local vector<BDPT_Vertex> light_path;
+	light_path.clear();
+	const Light* light = m_bLVC ? scene.SampleLight( sort_canonical() , &pdf ) : _TraceLightPath( light_path , pdf );
 	if( light == 0 || pdf == 0.0f )
 		return 0.0f;
 
 	Spectrum li;
-
-	float	light_emission_pdf = 0.0f;
-	float	light_pdfa = 0.0f;
-	Ray		light_ray;
-    float   cosAtLight = 1.0f;
-	LightSample light_sample(true);
-	Spectrum le = light->sample_l( light_sample , light_ray , &light_emission_pdf , &light_pdfa , &cosAtLight );
-	
-	//-----------------------------------------------------------------------------------------------------
-	// Trace light path from light source
-	vector<BDPT_Vertex> light_path;
-	Ray wi = light_ray;
-	float vc = (light->IsDelta())?0.0f: MIS(cosAtLight / light_emission_pdf);
-	float vcm = MIS(light_pdfa / light_emission_pdf);
-	Spectrum throughput = le * cosAtLight / (light_emission_pdf * pdf);
-	float rr = 1.0f;
-	while ((int)light_path.size() < max_recursive_depth)
-	{
-		BDPT_Vertex vert;
-		if (false == scene.GetIntersect(wi, &vert.inter))
-			break;
-
-		const float distSqr = vert.inter.t * vert.inter.t;
-		const float cosIn = AbsDot( wi.m_Dir , vert.inter.normal );
-		if( light_path.size() > 0 || ( light_path.size() == 0 && !light->IsInfinite() ) )
-			vcm *= MIS( distSqr );
-		vcm /= MIS( cosIn );
-		vc /= MIS( cosIn );
-
-		rr = 1.0f;
-		if (throughput.GetIntensity() < 0.01f)
-			rr = 0.5f;
-
-		vert.p = vert.inter.intersect;
-		vert.n = vert.inter.normal;
-		vert.wi = -wi.m_Dir;
-		vert.bsdf = vert.inter.primitive->GetMaterial()->GetBsdf(&vert.inter);
-		vert.throughput = throughput;
-		vert.vcm = vcm;
-		vert.vc = vc;
-		vert.rr = rr;
-		vert.depth = (unsigned)(light_path.size() + 1);
-
-		light_path.push_back(vert);
-
-		//-----------------------------------------------------------------------------------------------------
-		// Path evaluation: light tracing
-		_ConnectCamera( vert , (unsigned)light_path.size() , light );
-
-		// russian roulette
-		if (sort_canonical() > rr)
-			break;
-
-		float bsdf_pdf;
-		Spectrum bsdf_value = vert.bsdf->sample_f(vert.wi, vert.wo, BsdfSample(true), &bsdf_pdf, BXDF_ALL);
-		bsdf_pdf *= rr;
-		const float cosOut = AbsDot(vert.wo, vert.n);
-		throughput *= bsdf_value * ( cosOut / bsdf_pdf );
-
-		if (bsdf_pdf == 0 || throughput.IsBlack())
-			break;
-
-		const float rev_bsdf_pdfw = vert.bsdf->Pdf( vert.wo , vert.wi ) * rr;
-		vc = MIS(cosOut/bsdf_pdf) * ( MIS(rev_bsdf_pdfw) * vc + vcm ) ;
-		vcm = MIS(1.0f/bsdf_pdf);
-
-		wi = Ray(vert.inter.intersect, vert.wo, 0, 0.001f);
-	}
+	Ray wi;
+	Spectrum throughput;
+	float vc , vcm , rr;
 
 	//-----------------------------------------------------------------------------------------------------
 	// Trace light path from eye point
 	const unsigned lps = (const unsigned)light_path.size();
 	const unsigned int total_pixel = camera->GetImageSensor()->GetWidth() * camera->GetImageSensor()->GetHeight();
+	const float path_ratio = m_bLVC ? m_lvcPathRatio : (float)total_pixel;
 	wi = ray;
 	throughput = 1.0f;
 	int light_path_len = 0;
 	vc = 0.0f;
-	vcm = MIS(total_pixel / ray.m_fPdfW);
+	vcm = MIS(path_ratio / camera->GetRayImportance( ray ).pdfW);
 	rr = 1.0f;
 	while (light_path_len <= (int)max_recursive_depth)
 	{
@@ -182,6 +185,8 @@ Spectrum BidirPathTracing::Li( const Ray& ray , const PixelSample& ps ) const
 
 		//-----------------------------------------------------------------------------------------------------
 		// Path evaluation: connect vertices
+		if( m_bLVC )
+			li += _ConnectCache( vert );
 		for (unsigned j = 0; j < lps; ++j)
 			li += _ConnectVertices( light_path[j] , vert , light );
 
@@ -204,12 +209,192 @@ Spectrum BidirPathTracing::Li( const Ray& ray , const PixelSample& ps ) const
 		vc = MIS( cosOut / bsdf_pdf ) * ( MIS( rev_bsdf_pdfw ) * vc + vcm );
 		vcm = MIS( 1.0f / bsdf_pdf );
 
-		wi = Ray(vert.inter.intersect, vert.wo, 0, 0.001f);
+		wi = vert.inter.SpawnRay( vert.wo );
 	}
 
 	return li;
 }
 
+// trace a light path and connect its vertices to the camera
+const Light* BidirPathTracing::_TraceLightPath( vector<BDPT_Vertex>& light_path , float& pdf ) const
+{
+	// pick a light randomly
+	const Light* light = scene.SampleLight( sort_canonical() , &pdf );
+	if( light == 0 || pdf == 0.0f )
+		return 0;
+
+	float	light_emission_pdf = 0.0f;
+	float	light_pdfa = 0.0f;
+	Ray		light_ray;
+    float   cosAtLight = 1.0f;
+	LightSample light_sample(true);
+	Spectrum le = light->sample_l( light_sample , light_ray , &light_emission_pdf , &light_pdfa , &cosAtLight );
+	
+	//-----------------------------------------------------------------------------------------------------
+	// Trace light path from light source
+	Ray wi = light_ray;
+	float vc = (light->IsDelta())?0.0f: MIS(cosAtLight / light_emission_pdf);
+	float vcm = MIS(light_pdfa / light_emission_pdf);
+	Spectrum throughput = le * cosAtLight / (light_emission_pdf * pdf);
+	float rr = 1.0f;
+	while ((int)light_path.size() < max_recursive_depth)
+	{
+		BDPT_Vertex vert;
+		if (false == scene.GetIntersect(wi, &vert.inter))
+			break;
+
+		const float distSqr = vert.inter.t * vert.inter.t;
+		const float cosIn = AbsDot( wi.m_Dir , vert.inter.normal );
+
+		// area lights may sample their points by solid angle , the density of sampling the light point directly depends on the first vertex
+		if( light_path.empty() && !light->IsDelta() && !light->IsInfinite() )
+			vcm = MIS( light->Pdf( vert.inter.SpawnOrigin( -wi.m_Dir ) , -wi.m_Dir ) * cosAtLight / ( distSqr * light_emission_pdf ) );
+		if( light_path.size() > 0 || ( light_path.size() == 0 && !light->IsInfinite() ) )
+			vcm *= MIS( distSqr );
+		vcm /= MIS( cosIn );
+		vc /= MIS( cosIn );
+
+		rr = 1.0f;
+		if (throughput.GetIntensity() < 0.01f)
+			rr = 0.5f;
+
+		vert.p = vert.inter.intersect;
+		vert.n = vert.inter.normal;
+		vert.wi = -wi.m_Dir;
+		vert.bsdf = vert.inter.primitive->GetMaterial()->GetBsdf(&vert.inter);
+		vert.throughput = throughput;
+		vert.vcm = vcm;
+		vert.vc = vc;
+		vert.rr = rr;
+		vert.depth = (unsigned)(light_path.size() + 1);
+
+		light_path.push_back(vert);
+
+		//-----------------------------------------------------------------------------------------------------
+		// Path evaluation: light tracing
+		_ConnectCamera( vert , (unsigned)light_path.size() , light );
+
+		// russian roulette
+		if (sort_canonical() > rr)
+			break;
+
+		float bsdf_pdf;
+		Spectrum bsdf_value = vert.bsdf->sample_f(vert.wi, vert.wo, BsdfSample(true), &bsdf_pdf, BXDF_ALL);
+		bsdf_pdf *= rr;
+		const float cosOut = AbsDot(vert.wo, vert.n);
+		throughput *= bsdf_value * ( cosOut / bsdf_pdf );
+
+		if (bsdf_pdf == 0 || throughput.IsBlack())
+			break;
+
+		const float rev_bsdf_pdfw = vert.bsdf->Pdf( vert.wo , vert.wi ) * rr;
+		vc = MIS(cosOut/bsdf_pdf) * ( MIS(rev_bsdf_pdfw) * vc + vcm ) ;
+		vcm = MIS(1.0f/bsdf_pdf);
+
+		wi = vert.inter.SpawnRay( vert.wo );
+	}
+
+	return light;
+}
+
+// trace the light paths of the light vertex cache for a pass
+void BidirPathTracing::BeginPass( unsigned spp )
+{
+	// light tracing splats every light path already
+	if( light_tracing_only )
+	{
+		m_bLVC = false;
+		_TraceLightPaths( spp );
+		return;
+	}
+	if( !m_bLVC )
+		return;
+
+	const unsigned total_pixel = camera->GetImageSensor()->GetWidth() * camera->GetImageSensor()->GetHeight();
+	m_lvcPassPathCnt = ( m_lvcPathCnt > 0 ) ? m_lvcPathCnt : total_pixel;
+	m_lvcPathRatio = (float)m_lvcPassPathCnt / (float)max( spp , 1u );
+
+	// light paths are traced in parallel , the vertices of each chunk are gathered in the order of the chunks
+	const unsigned grain = 256;
+	vector< vector<LVC_Vertex> > chunks( ParallelChunkCount( m_lvcPassPathCnt , grain ) );
+	ParallelFor( 0 , m_lvcPassPathCnt , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		vector<BDPT_Vertex> light_path;
+		for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+		{
+			// bsdfs of the light path are only needed while it is traced
+			MemScope mem_scope;
+			sort_reseed( i , SORT_RAND_PARALLEL , 0 );
+			float pdf;
+			light_path.clear();
+			_TraceLightPath( light_path , pdf );
+			for( const BDPT_Vertex& vert : light_path )
+			{
+				LVC_Vertex lv;
+				lv.Pack( vert );
+				chunks[chunk].push_back( lv );
+			}
+		}
+	});
+
+	size_t count = 0;
+	for( const auto& chunk : chunks )
+		count += chunk.size();
+	m_lightVertices.clear();
+	m_lightVertices.reserve( count );
+	for( const auto& chunk : chunks )
+		m_lightVertices.insert( m_lightVertices.end() , chunk.begin() , chunk.end() );
+
+	// by default , eye vertices connect to as many vertices as an average light path holds
+	m_lvcPassConnections = m_lvcConnections;
+	if( m_lvcPassConnections == 0 )
+		m_lvcPassConnections = max( 1u , (unsigned)( (float)count / (float)m_lvcPassPathCnt + 0.5f ) );
+	slog( DEBUG , INTEGRATOR , stringFormat( "Light vertex cache holds %d vertices of %d light paths, each eye vertex connects to %d of them." , (int)count , m_lvcPassPathCnt , m_lvcPassConnections ) );
+}
+
+// trace the light paths of light tracing for a pass
+void BidirPathTracing::_TraceLightPaths( unsigned spp )
+{
+	// there are as many light paths as pixel samples by default
+	const unsigned total_pixel = camera->GetImageSensor()->GetWidth() * camera->GetImageSensor()->GetHeight();
+	m_ltPassPathCnt = ( m_ltPathCnt > 0 ) ? m_ltPathCnt : total_pixel * max( spp , 1u );
+
+	// paths are split across the threads , each thread splats to its own blocks of pixels , they are added to the image after the pass
+	ParallelFor( 0 , m_ltPassPathCnt , 256 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		vector<BDPT_Vertex> light_path;
+		for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+		{
+			// bsdfs of the light path are only needed while it is traced
+			MemScope mem_scope;
+			sort_reseed( i , SORT_RAND_PARALLEL , 0 );
+			float pdf;
+			light_path.clear();
+			_TraceLightPath( light_path , pdf );
+		}
+	});
+	slog( DEBUG , INTEGRATOR , stringFormat( "Light tracing traces %d light paths in the pass." , m_ltPassPathCnt ) );
+}
+
+// connect an eye vertex to vertices picked from the light vertex cache
+Spectrum BidirPathTracing::_ConnectCache( const BDPT_Vertex& eye_vertex ) const
+{
+	const unsigned count = (unsigned)m_lightVertices.size();
+	if( count == 0 )
+		return 0.0f;
+
+	// vertices are picked uniformly , the sum is scaled to the connections of one light path in average
+	Spectrum li;
+	for( unsigned i = 0 ; i < m_lvcPassConnections ; ++i )
+	{
+		const LVC_Vertex& lv = m_lightVertices[ min( (unsigned)( sort_canonical() * count ) , count - 1 ) ];
+
+		MemScope mem_scope;
+		BDPT_Vertex vert;
+		lv.Unpack( vert );
+		li += _ConnectVertices( vert , eye_vertex , 0 );
+	}
+	return li * ( (float)count / ( (float)m_lvcPassPathCnt * (float)m_lvcPassConnections ) );
+}
+
 void BidirPathTracing::RequestSample( Sampler* sampler , PixelSample* ps , unsigned ps_num )
 {
 	Integrator::RequestSample( sampler, ps , ps_num );
@@ -251,7 +436,8 @@ Spectrum BidirPathTracing::_ConnectVertices( const BDPT_Vertex& p0 , const BDPT_
 		return li;
 
 	Visibility visible( scene );
-	visible.ray = Ray( p1.p , n_delta  , 0 , 0.001f , delta.Length() - 0.001f );
+	// both ends leave their surfaces beyond the rounding errors
+	visible.ray = p1.inter.SpawnRayTo( p0.inter.SpawnOrigin( -n_delta ) );
 	if( visible.IsVisible() == false )
 		return 0.0f;
 
@@ -305,6 +491,7 @@ void BidirPathTracing::_ConnectCamera(const BDPT_Vertex& light_vertex, int len ,
 	Spectrum we;
 	Point eye_point;
 	const Vector2i coord = camera->GetScreenCoord(light_vertex.inter.intersect, &camera_pdfW, &camera_pdfA , &cosAtCamera , &we , &eye_point , &visible );
+	visible.ray = light_vertex.inter.SpawnRayTo( eye_point );
 
 	const Vector delta = light_vertex.inter.intersect - eye_point;
 	const float invSqrLen = 1.0f / delta.SquaredLength();
@@ -327,20 +514,29 @@ void BidirPathTracing::_ConnectCamera(const BDPT_Vertex& light_vertex, int len ,
 	if( visible.IsVisible() == false )
 		return;
 
+	// radiance is splatted for every light path of the pass , they are weighted against eye paths with the number of light paths
 	const float total_pixel = (float)(camera->GetImageSensor()->GetWidth() * camera->GetImageSensor()->GetHeight());
+	const float path_cnt = m_bLVC ? (float)m_lvcPassPathCnt : light_tracing_only ? (float)m_ltPassPathCnt : sample_per_pixel * total_pixel;
+	const float path_ratio = m_bLVC ? m_lvcPathRatio : total_pixel;
 	const float gterm = cosAtCamera * cosAtLightVertex * invSqrLen;
-	Spectrum radiance = light_vertex.throughput * bsdf_value * we * gterm / (float)( sample_per_pixel * total_pixel * camera_pdfA );
+	Spectrum radiance = light_vertex.throughput * bsdf_value * we * gterm / ( path_cnt * camera_pdfA );
 
 	if( !light_tracing_only )
 	{
 		const float lightvert_pdfA = camera_pdfW * AbsDot( light_vertex.n, n_delta ) * invSqrLen ;
 		const float bsdf_rev_pdfw = light_vertex.bsdf->Pdf( -n_delta , light_vertex.wi ) * light_vertex.rr;
-		const float mis0 = ( light_vertex.vcm + light_vertex.vc * MIS( bsdf_rev_pdfw ) ) * MIS( lightvert_pdfA / total_pixel );
+		const float mis0 = ( light_vertex.vcm + light_vertex.vc * MIS( bsdf_rev_pdfw ) ) * MIS( lightvert_pdfA / path_ratio );
 		const float weight = 1.0f / ( 1.0f + mis0 );
 
 		radiance *= weight;
 	}
 
+	_Splat( coord , radiance );
+}
+
+// add the radiance of a light path connected to the camera to a pixel
+void BidirPathTracing::_Splat( const Vector2i& coord , const Spectrum& radiance ) const
+{
 	// update image sensor
 	ImageSensor* is = camera->GetImageSensor();
 	if (!is)
@@ -40,11 +40,42 @@ struct BDPT_Vertex
 	// MIS factors
 	float		vc = 0.0f;
 	float		vcm = 0.0f;
+	float		vm = 0.0f;			// only used in vertex merging
 
 	// depth of the vertex
     int			depth = 0;
 };
 
+// light vertex stored in the light vertex cache , it takes 64 bytes so that the vertices of a whole pass stay small.
+// directions are encoded with octahedral mapping , the intersection and the bsdf are created again once it is connected
+struct LVC_Vertex
+{
+	Point			p;                  // the position of the vertex
+	Spectrum		throughput;         // through put
+	float			u = 0.0f;           // the texture coordinate of the vertex
+	float			v = 0.0f;
+	float			vc = 0.0f;          // MIS factors
+	float			vcm = 0.0f;
+	const Primitive* primitive = nullptr;	// the primitive the vertex is on
+	unsigned		n = 0;              // the shading normal
+	unsigned		wi = 0;             // in direction
+	unsigned short	gn = 0;             // the geometric normal , it only needs 16 bits
+	unsigned short	tangent = 0;        // the angle of the shading tangent around the shading normal
+	unsigned short	depth = 0;          // depth of the vertex
+	unsigned short	rr = 0;             // russian roulette , it is quantized to 16 bits
+
+	// pack a vertex of a light path
+	// para 'vert' : the vertex
+	void	Pack( const BDPT_Vertex& vert );
+
+	// unpack the vertex , its bsdf is created in the memory arena of the thread
+	// note : the shading frame is the one the vertex is sampled in and the vertex is at the start of the frame , like light paths
+	// para 'vert' : the vertex ( output )
+	void	Unpack( BDPT_Vertex& vert ) const;
+};
+static_assert( sizeof( LVC_Vertex ) == 64 , "light vertices are expected to take 64 bytes" );
+
+// radiance reaching a pixel , it is splatted once the path is finished
 struct Pending_Sample
 {
 	Vector2i	coord;
@@ -55,6 +86,11 @@ struct Pending_Sample
 // definition of bidirectional path tracing
 // BDPT is not finished yet, there are bugs in the following code.
 // i'll try to finish it after i finish some more integrators.
+// note : with 'bdpt_lvc' set to '1' , a pool of light paths is traced in parallel before every
+//		  pass and stored in a light vertex cache , eye paths connect to vertices picked from the
+//		  cache randomly instead of tracing their own light paths. Please refer to the paper
+//		  "Light Transport Simulation with Vertex Connection and Merging" by Davidovic et al.
+//		  for further details. It works best with progressive rendering of few samples per pass.
 class BidirPathTracing : public Integrator
 {
 // public method
@@ -65,6 +101,9 @@ public:
 	// default constructor
 	BidirPathTracing() {
 		_registerProperty( "bdpt_mis" , new PTMISProperty(this) );
+		_registerProperty( "bdpt_lvc" , new LVCProperty(this) );
+		_registerProperty( "bdpt_lvc_paths" , new LVCPathsProperty(this) );
+		_registerProperty( "bdpt_lvc_connections" , new LVCConnectionsProperty(this) );
 	}
 
 	// return the radiance of a specific direction
@@ -79,14 +118,38 @@ public:
 	// support pending write
 	virtual bool SupportPendingWrite() { return true; }
 
+	// trace the light paths of the light vertex cache or light tracing for a pass
+	// para 'spp' : the number of samples per pixel in the pass
+	virtual void BeginPass( unsigned spp );
+
 // private field
 protected:
 	bool	light_tracing_only = false;		// only do light tracing
 	int		sample_per_pixel = 1;           // light sample per pixel
 
+	// the number of light paths of light tracing for every pass , it is the number of pixel samples by default
+	unsigned	m_ltPathCnt = 0;
+	// the number of light paths of light tracing for the current pass
+	unsigned	m_ltPassPathCnt = 0;
+
+	// trace the light paths of light tracing for a pass , they are split across the threads regardless of the tiles
+	// para 'spp' : the number of samples per pixel in the pass
+	void _TraceLightPaths( unsigned spp );
+
 	// compute G term
 	Spectrum	_Gterm( const BDPT_Vertex& p0 , const BDPT_Vertex& p1 ) const;
 
+	// trace a light path and connect its vertices to the camera
+	// para 'light_path' : the vertices of the light path ( output )
+	// para 'pdf'        : the probability of picking the light ( output )
+	// result            : the light the path starts from , it is null if no light is picked
+	const Light* _TraceLightPath( vector<BDPT_Vertex>& light_path , float& pdf ) const;
+
+	// connect an eye vertex to vertices picked from the light vertex cache
+	// para 'eye_vertex' : the eye vertex
+	// result            : the radiance of the connections , it estimates the connections to a whole light path
+	Spectrum _ConnectCache( const BDPT_Vertex& eye_vertex ) const;
+
 	// connect light sample
 	Spectrum _ConnectLight(const BDPT_Vertex& eye_vertex, const Light* light ) const;
 	
@@ -96,11 +159,32 @@ protected:
 	// connnect vertices
 	Spectrum _ConnectVertices( const BDPT_Vertex& light_vertex , const BDPT_Vertex& eye_vertex , const Light* light ) const;
 
+	// add the radiance of a light path connected to the camera to a pixel
+	// para 'coord'    : the pixel
+	// para 'radiance' : the radiance reaching the pixel
+	virtual void _Splat( const Vector2i& coord , const Spectrum& radiance ) const;
+
+	// use the light vertex cache
+	bool		m_bLVC = false;
+
 // private field
 private:
 	// use multiple importance sampling to sample direct illumination
 	bool	m_bMIS = true;
 
+	// the number of light paths traced for every pass , it is the number of pixels by default
+	unsigned	m_lvcPathCnt = 0;
+	// the number of cached vertices each eye vertex connects to , it is the average light path length by default
+	unsigned	m_lvcConnections = 0;
+	// the number of connections of the current pass
+	unsigned	m_lvcPassConnections = 1;
+	// the number of light paths traced for the current pass
+	unsigned	m_lvcPassPathCnt = 0;
+	// the number of light paths per eye path of a pixel , it weights light tracing against the other strategies
+	float		m_lvcPathRatio = 0.0f;
+	// the light vertices of the current pass
+	vector<LVC_Vertex>	m_lightVertices;
+
 	// Max Distance Property
 	class PTMISProperty : public PropertyHandler<Integrator>
 	{
@@ -114,6 +198,45 @@ private:
 		}
 	};
 
+	// Light vertex cache Property
+	class LVCProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(LVCProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			BidirPathTracing* bdpt = CAST_TARGET(BidirPathTracing);
+			if( bdpt )
+				bdpt->m_bLVC = (atoi( str.c_str() )==1);
+		}
+	};
+
+	// Light paths of light vertex cache Property
+	class LVCPathsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(LVCPathsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			BidirPathTracing* bdpt = CAST_TARGET(BidirPathTracing);
+			if( bdpt )
+				bdpt->m_lvcPathCnt = max( 0 , atoi( str.c_str() ) );
+		}
+	};
+
+	// Connections to light vertex cache Property
+	class LVCConnectionsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(LVCConnectionsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			BidirPathTracing* bdpt = CAST_TARGET(BidirPathTracing);
+			if( bdpt )
+				bdpt->m_lvcConnections = max( 0 , atoi( str.c_str() ) );
+		}
+	};
+
 	// mis factor
 	float MIS( float t ) const;
 };
@@ -24,10 +24,30 @@
 #include "light/light.h"
 #include "managers/memmanager.h"
 #include "sampler/sampler.h"
+#include "camera/camera.h"
+#include "imagesensor/imagesensor.h"
 #include "log/log.h"
 
 IMPLEMENT_CREATOR( DirectLight );
 
+// the radius in pixels neighbor reservoirs are picked in
+static const int RESTIR_SPATIAL_RADIUS = 16;
+// the candidate number of reused reservoirs is clamped relative to the new candidates , so that old samples fade out
+static const float RESTIR_MAX_HISTORY = 20.0f;
+
+// stream a candidate into the reservoir
+bool Light_Reservoir::Update( const Light* l , const LightSample& sample , float p , float w , float m )
+{
+	w_sum += w;
+	M += m;
+	if( w <= 0.0f || sort_canonical() * w_sum > w )
+		return false;
+	light = l;
+	ls = sample;
+	target = p;
+	return true;
+}
+
 // radiance along a specific ray direction
 Spectrum DirectLight::Li( const Ray& r , const PixelSample& ps ) const
 {
@@ -42,17 +62,218 @@ Spectrum DirectLight::Li( const Ray& r , const PixelSample& ps ) const
 
 	Spectrum li = ip.Le( -r.m_Dir );
 
+	if( m_restir )
+		return li + _restir( r , ip , ps );
+	if( m_adaptive )
+		return li + _adaptive( r , ip );
+
 	// eavluate direct light
 	unsigned light_num = scene.LightNum();
 	for( unsigned i = 0 ; i < light_num ; ++i )
 	{
 		const Light* light = scene.GetLight(i);
-		li += EvaluateDirect( r , scene , light , ip , LightSample(true) , BsdfSample(true), BXDF_TYPE( BXDF_ALL ) );
+		if( light->Illuminates( ip ) )
+			li += EvaluateDirect( r , scene , light , ip , LightSample(true) , BsdfSample(true), BXDF_TYPE( BXDF_ALL ) );
 	}
 
 	return li;
 }
 
+// gather the bounds of the lights
+void DirectLight::PreProcess()
+{
+	const unsigned light_num = scene.LightNum();
+	m_lightBounds.resize( light_num );
+	m_lightBounded.resize( light_num );
+	for( unsigned i = 0 ; i < light_num ; ++i )
+		m_lightBounded[i] = scene.GetLight(i)->GetBounds( m_lightBounds[i] ) ? 1 : 0;
+}
+
+// evaluate direct light with the shadow rays spread across lights by their importance
+Spectrum DirectLight::_adaptive( const Ray& r , const Intersection& ip ) const
+{
+	Spectrum li;
+
+	// lights without bounds can't be estimated , they take one sample each
+	const unsigned light_num = (unsigned)m_lightBounds.size();
+	float* importance = SORT_MALLOC_ARRAY( float , light_num );
+	float total = 0.0f;
+	for( unsigned i = 0 ; i < light_num ; ++i )
+	{
+		importance[i] = 0.0f;
+		if( !scene.GetLight(i)->Illuminates( ip ) )
+			continue;
+		if( m_lightBounded[i] )
+			importance[i] = LightTree::Importance( m_lightBounds[i] , ip.intersect , ip.normal );
+		else
+			li += EvaluateDirect( r , scene , scene.GetLight(i) , ip , LightSample(true) , BsdfSample(true), BXDF_TYPE( BXDF_ALL ) );
+		total += importance[i];
+	}
+	if( total <= 0.0f )
+		return li;
+
+	// the expected number of samples of a light is proportional to its importance , the fraction is taken with
+	// the same probability , so the estimate is unbiased for lights with any importance
+	for( unsigned i = 0 ; i < light_num ; ++i )
+	{
+		if( importance[i] <= 0.0f )
+			continue;
+		const Light* light = scene.GetLight(i);
+		float expected = m_shadowRays * importance[i] / total;
+		if( light->IsDelta() )
+			expected = min( expected , 1.0f );
+		const unsigned cnt = (unsigned)expected + ( ( sort_canonical() < expected - floor( expected ) ) ? 1 : 0 );
+		Spectrum radiance;
+		for( unsigned k = 0 ; k < cnt ; ++k )
+			radiance += EvaluateDirect( r , scene , light , ip , LightSample(true) , BsdfSample(true), BXDF_TYPE( BXDF_ALL ) );
+		li += radiance / expected;
+	}
+
+	return li;
+}
+
+// prepare the reservoirs of a pass
+void DirectLight::BeginPass( unsigned spp )
+{
+	if( !m_restir || camera == nullptr || camera->GetImageSensor() == nullptr )
+		return;
+
+	// the reservoirs of the last pass are reused by the current one
+	const unsigned width = camera->GetImageSensor()->GetWidth();
+	const unsigned height = camera->GetImageSensor()->GetHeight();
+	if( width != m_width || height != m_height )
+	{
+		m_width = width;
+		m_height = height;
+		m_reservoirs[0].assign( width * height , Light_Reservoir() );
+		m_reservoirs[1].assign( width * height , Light_Reservoir() );
+	}
+	m_current = 1 - m_current;
+	m_reservoirs[m_current].assign( width * height , Light_Reservoir() );
+}
+
+// the unshadowed contribution of a light sample
+Spectrum DirectLight::_contribution( const Intersection& ip , const Bsdf* bsdf , const Vector& wo , const Light* l , const LightSample& ls , Visibility* vis ) const
+{
+	Vector wi;
+	const Spectrum li = _incident( ip , l , ls , wi , vis );
+	if( li.IsBlack() )
+		return 0.0f;
+	return li * bsdf->f( wo , wi );
+}
+
+// the unshadowed radiance of a light sample weighted by the cosine factor
+Spectrum DirectLight::_incident( const Intersection& ip , const Light* l , const LightSample& ls , Vector& wi , Visibility* vis ) const
+{
+	if( !l->Illuminates( ip ) )
+		return 0.0f;
+
+	Visibility visibility( scene );
+	float light_pdf;
+	const Spectrum le = l->sample_l( ip , &ls , wi , 0 , &light_pdf , 0 , 0 , visibility );
+	if( vis )
+		vis->ray = visibility.ray;
+	const float dot = SatDot( wi , ip.normal );
+	if( light_pdf <= 0.0f || dot <= 0.0f || le.IsBlack() )
+		return 0.0f;
+	return le * ( dot / light_pdf );
+}
+
+// evaluate direct light with reservoir resampling
+Spectrum DirectLight::_restir( const Ray& r , const Intersection& ip , const PixelSample& ps ) const
+{
+	const Bsdf* bsdf = ip.primitive->GetMaterial()->GetBsdf( &ip );
+	const Vector wo = -r.m_Dir;
+	const Vector n = ( Dot( wo , ip.normal ) > 0.0f ) ? ip.normal : -ip.normal;
+	const float depth = ip.t;
+
+	// candidates are picked by the light tree , their target function is the luminance of the unshadowed contribution
+	// note : the bsdf is evaluated for all candidates in batches once they are sampled
+	const Light** lights = SORT_MALLOC_ARRAY( const Light* , m_candidates );
+	LightSample* samples = SORT_MALLOC_ARRAY( LightSample , m_candidates );
+	float* pick_pdfs = SORT_MALLOC_ARRAY( float , m_candidates );
+	Spectrum* incident = SORT_MALLOC_ARRAY( Spectrum , m_candidates );
+	Spectrum* f = SORT_MALLOC_ARRAY( Spectrum , m_candidates );
+	Vector* wi = SORT_MALLOC_ARRAY( Vector , m_candidates );
+	for( unsigned i = 0 ; i < m_candidates ; ++i )
+	{
+		lights[i] = scene.SampleLight( sort_canonical() , ip , &pick_pdfs[i] );
+		wi[i] = n;
+		incident[i] = 0.0f;
+		if( lights[i] == nullptr || pick_pdfs[i] <= 0.0f )
+			continue;
+		samples[i] = LightSample( true );
+		incident[i] = _incident( ip , lights[i] , samples[i] , wi[i] , nullptr );
+	}
+	bsdf->f( wo , wi , f , m_candidates );
+
+	Light_Reservoir reservoir;
+	for( unsigned i = 0 ; i < m_candidates ; ++i )
+	{
+		if( lights[i] == nullptr || pick_pdfs[i] <= 0.0f )
+		{
+			reservoir.M += 1.0f;
+			continue;
+		}
+		const float p = ( incident[i] * f[i] ).GetIntensity();
+		reservoir.Update( lights[i] , samples[i] , p , p / pick_pdfs[i] , 1.0f );
+	}
+
+	// the reservoirs of the pixel and its neighbors in the last pass are reused
+	// note : samples of the same pixel in a pass are not chained , it correlates them too much
+	const bool has_pixel = ps.pixel_x < m_width && ps.pixel_y < m_height;
+	if( has_pixel )
+	{
+		const float max_history = RESTIR_MAX_HISTORY * m_candidates;
+		const std::vector<Light_Reservoir>& previous = m_reservoirs[1-m_current];
+		for( unsigned i = 0 ; i <= m_spatialNeighbors ; ++i )
+		{
+			const Light_Reservoir* other;
+			if( i == 0 )
+				other = &previous[ps.pixel_y * m_width + ps.pixel_x];
+			else
+			{
+				const int x = (int)ps.pixel_x + (int)( ( 2.0f * sort_canonical() - 1.0f ) * RESTIR_SPATIAL_RADIUS );
+				const int y = (int)ps.pixel_y + (int)( ( 2.0f * sort_canonical() - 1.0f ) * RESTIR_SPATIAL_RADIUS );
+				if( x < 0 || y < 0 || x >= (int)m_width || y >= (int)m_height )
+					continue;
+				other = &previous[y * m_width + x];
+			}
+
+			// neighbors on different surfaces have different distributions of light , they are rejected
+			if( other->light == nullptr || other->M == 0.0f )
+				continue;
+			if( Dot( other->n , n ) < 0.9f || fabs( other->depth - depth ) > 0.1f * depth )
+				continue;
+
+			const float p = _contribution( ip , bsdf , wo , other->light , other->ls , nullptr ).GetIntensity();
+			const float m = min( other->M , max_history );
+			reservoir.Update( other->light , other->ls , p , p * other->W * m , m );
+		}
+	}
+
+	if( reservoir.light == nullptr || reservoir.target <= 0.0f || reservoir.M == 0.0f )
+		return 0.0f;
+	reservoir.W = reservoir.w_sum / ( reservoir.M * reservoir.target );
+
+	// only the picked sample is tested for visibility
+	// note : the reservoir is kept even if the sample is occluded , clearing it or its weight makes neighbors
+	//		  in penumbra brighter or darker , as the target function ignores visibility
+	Visibility visibility( scene );
+	Spectrum radiance = _contribution( ip , bsdf , wo , reservoir.light , reservoir.ls , &visibility );
+	if( !visibility.IsVisible() )
+		radiance = 0.0f;
+
+	// the last sample of the pixel is kept for the next pass
+	if( has_pixel )
+	{
+		reservoir.n = n;
+		reservoir.depth = depth;
+		m_reservoirs[m_current][ps.pixel_y * m_width + ps.pixel_x] = reservoir;
+	}
+	return radiance * reservoir.W;
+}
+
 // output log information
 void DirectLight::OutputLog() const{
     slog( INFO , INTEGRATOR , "Integrator algorithm : direct light integrator." );
@@ -136,4 +357,9 @@ void DirectLight::GenerateSample( const Sampler* sampler , PixelSample* samples
 void DirectLight::_registerAllProperty()
 {
 	_registerProperty( "sample_per_light" , new SamplerPerLightProperty(this) );
+	_registerProperty( "direct_adaptive" , new AdaptiveProperty(this) );
+	_registerProperty( "shadow_rays" , new ShadowRaysProperty(this) );
+	_registerProperty( "direct_restir" , new ReSTIRProperty(this) );
+	_registerProperty( "restir_candidates" , new CandidatesProperty(this) );
+	_registerProperty( "restir_neighbors" , new SpatialNeighborsProperty(this) );
 }
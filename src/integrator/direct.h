@@ -18,11 +18,54 @@
 #pragma once
 
 #include "integrator.h"
+#include "sampler/sample.h"
+#include "light/lighttree.h"
+#include <vector>
+
+class	Light;
+class	Bsdf;
+class	Visibility;
+class	Intersection;
+
+// weighted reservoir holding one light sample picked among the candidates it has seen
+struct Light_Reservoir
+{
+	const Light*	light = nullptr;	// the light of the picked sample
+	LightSample		ls;					// the sample on the light , it is shared by all shading points
+	float			target = 0.0f;		// the target function of the picked sample at the shading point
+	float			w_sum = 0.0f;		// the sum of the weights of the candidates
+	float			M = 0.0f;			// the number of candidates
+	float			W = 0.0f;			// the weight of the picked sample in the estimate
+	Vector			n;					// the normal at the shading point , it rejects dissimilar neighbors
+	float			depth = 0.0f;		// the distance from the camera to the shading point
+
+	// stream a candidate into the reservoir
+	// para 'l'      : the light of the candidate
+	// para 'sample' : the sample on the light
+	// para 'p'      : the target function of the candidate
+	// para 'w'      : the weight of the candidate
+	// para 'm'      : the number of candidates the candidate stands for
+	// result        : whether the candidate is picked
+	bool Update( const Light* l , const LightSample& sample , float p , float w , float m );
+};
 
 //////////////////////////////////////////////////////////////////////////////////////
 //	definition of direct light
 //	comparing with whitted ray tracing , direct light requires more samples per pixel
 //	and it supports soft shadow and area light.
+//	note : with reservoir resampling enabled , light candidates are resampled by their
+//		   unshadowed contribution and only the picked one is tested for visibility.
+//		   Each pixel keeps its reservoir , the next progressive pass combines it with
+//		   the reservoirs of the pixel and its neighbors ( spatiotemporal reuse ). The
+//		   samples are reused in the primary sample space of lights , so reservoirs of
+//		   different shading points share the same domain. Reuse is biased as neighbors
+//		   are normalized by their candidate numbers. Please refer to "Spatiotemporal
+//		   reservoir resampling for real-time ray tracing with dynamic direct lighting"
+//		   by Bitterli et al. for further details.
+//	note : with adaptive light sampling enabled , a budget of shadow rays is spread across
+//		   lights in proportion to the importance of their bounds to the shading point ,
+//		   lights that can't lit the point are skipped. Lights without bounds take one
+//		   sample each.
 class	DirectLight : public Integrator
 {
 // public method
@@ -53,13 +96,77 @@ public:
 	// para 'scene'   : the scene to be rendered
 	virtual void GenerateSample( const Sampler* sampler , PixelSample* samples , unsigned ps , const Scene& scene ) const;
 
+	// gather the bounds of the lights
+	virtual void PreProcess();
+
+	// prepare the reservoirs of a pass
+	// para 'spp' : the number of samples per pixel in the pass
+	virtual void BeginPass( unsigned spp );
+
 	// output log information
 	virtual void OutputLog() const;
 
+	// camera rays missing the scene only see the environment
+	virtual bool IsBackgroundOnMiss() const { return true; }
+
 // private field
 private:
 	unsigned		ls_per_light = 16; // light sample per pixel sample per light
 
+	// whether direct light is evaluated with reservoir resampling
+	bool			m_restir = false;
+	// the number of light candidates of each shading point
+	unsigned		m_candidates = 32;
+	// the number of neighbor reservoirs reused by each shading point
+	unsigned		m_spatialNeighbors = 4;
+
+	// whether the shadow rays are spread across lights by their importance
+	bool			m_adaptive = false;
+	// the number of shadow rays of each shading point in adaptive light sampling
+	unsigned		m_shadowRays = 8;
+	// the bounds of each light , lights without bounds are marked
+	std::vector<LightBounds>	m_lightBounds;
+	std::vector<char>			m_lightBounded;
+
+	// reservoirs of the previous pass and the current pass , one for each pixel
+	// the reservoirs of the current pass are only written by the samples of their pixels
+	mutable std::vector<Light_Reservoir>	m_reservoirs[2];
+	unsigned		m_current = 0;
+	unsigned		m_width = 0;
+	unsigned		m_height = 0;
+
+	// evaluate direct light with reservoir resampling
+	// para 'r'  : the ray hitting the shading point
+	// para 'ip' : the shading point
+	// para 'ps' : the pixel sample
+	// result    : the direct illumination
+	Spectrum _restir( const Ray& r , const Intersection& ip , const PixelSample& ps ) const;
+
+	// evaluate direct light with the shadow rays spread across lights by their importance
+	// para 'r'  : the ray hitting the shading point
+	// para 'ip' : the shading point
+	// result    : the direct illumination
+	Spectrum _adaptive( const Ray& r , const Intersection& ip ) const;
+
+	// the unshadowed contribution of a light sample
+	// para 'ip'   : the shading point
+	// para 'bsdf' : the bsdf at the shading point
+	// para 'wo'   : the direction toward the viewer
+	// para 'l'    : the light
+	// para 'ls'   : the sample on the light
+	// para 'vis'  : the shadow ray of the sample ( output )
+	// result      : the contribution divided by the pdf of the sample on the light
+	Spectrum _contribution( const Intersection& ip , const Bsdf* bsdf , const Vector& wo , const Light* l , const LightSample& ls , Visibility* vis ) const;
+
+	// the unshadowed radiance of a light sample weighted by the cosine factor , the bsdf is left out
+	// para 'ip'   : the shading point
+	// para 'l'    : the light
+	// para 'ls'   : the sample on the light
+	// para 'wi'   : the direction toward the sample ( output )
+	// para 'vis'  : the shadow ray of the sample ( output )
+	// result      : the radiance divided by the pdf of the sample on the light
+	Spectrum _incident( const Intersection& ip , const Light* l , const LightSample& ls , Vector& wi , Visibility* vis ) const;
+
 	SampleOffset*	light_sample_offsets = nullptr;	// light sample offset
 	SampleOffset*	bsdf_sample_offsets = nullptr;	// bsdf sample offset
 
@@ -78,4 +185,64 @@ private:
 				direct->ls_per_light = atoi( str.c_str() );
 		}
 	};
+
+	class AdaptiveProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(AdaptiveProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			DirectLight* direct = CAST_TARGET(DirectLight);
+			if( direct )
+				direct->m_adaptive = ( atoi( str.c_str() ) == 1 );
+		}
+	};
+
+	class ShadowRaysProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(ShadowRaysProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			DirectLight* direct = CAST_TARGET(DirectLight);
+			if( direct )
+				direct->m_shadowRays = (unsigned)max( 1 , atoi( str.c_str() ) );
+		}
+	};
+
+	class ReSTIRProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(ReSTIRProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			DirectLight* direct = CAST_TARGET(DirectLight);
+			if( direct )
+				direct->m_restir = ( atoi( str.c_str() ) == 1 );
+		}
+	};
+
+	class CandidatesProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(CandidatesProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			DirectLight* direct = CAST_TARGET(DirectLight);
+			if( direct )
+				direct->m_candidates = (unsigned)max( 1 , atoi( str.c_str() ) );
+		}
+	};
+
+	class SpatialNeighborsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SpatialNeighborsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			DirectLight* direct = CAST_TARGET(DirectLight);
+			if( direct )
+				direct->m_spatialNeighbors = (unsigned)max( 0 , atoi( str.c_str() ) );
+		}
+	};
 };
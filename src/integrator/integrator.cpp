@@ -17,6 +17,7 @@
 
 #include "integrator.h"
 #include "system.h"
+#include "geometry/scene.h"
 
 extern System g_System;
 
@@ -25,3 +26,45 @@ Integrator::Integrator()
 {
 	_registerProperty( "inte_max_recur_depth" , new MaxDepthProperty(this) );
 }
+
+// generate samples
+void Integrator::GenerateSample( const Sampler* sampler , PixelSample* samples , unsigned ps , const Scene& scene ) const
+{
+	float* data = SORT_MALLOC_ARRAY( float , 2 * ps )();
+	sampler->Generate2D( data , ps , true );
+	for( unsigned i = 0 ; i < ps ; ++i )
+	{
+		samples[i].img_u = data[2*i];
+		samples[i].img_v = data[2*i+1];
+	}
+
+	// shuffle the index
+	const unsigned seed = sort_rand();
+	sampler->Generate2D( data , ps );
+	for( unsigned i = 0 ; i < ps ; ++i )
+	{
+		unsigned sid = 2*PermuteIndex( i , ps , seed );
+		samples[i].dof_u = data[sid];
+		samples[i].dof_v = data[sid+1];
+	}
+
+	// the times in the shutter interval are only drawn if anything moves , static scenes consume the same samples as before
+	if( scene.HasMotion() )
+	{
+		const unsigned time_seed = sort_rand();
+		sampler->Generate1D( data , ps );
+		for( unsigned i = 0 ; i < ps ; ++i )
+			samples[i].time = data[PermuteIndex( i , ps , time_seed )];
+	}
+
+	// the dimensions requested by the integrator are generated once they are used
+	if( light_dimensions + bsdf_dimensions > 0 )
+	{
+		SampleBatch* batch = SORT_MALLOC( SampleBatch )( sampler , ps , light_dimensions , bsdf_dimensions );
+		for( unsigned i = 0 ; i < ps ; ++i )
+		{
+			samples[i].batch = batch;
+			samples[i].batch_id = i;
+		}
+	}
+}
@@ -27,6 +27,7 @@
 // pre-declera classes
 class	Ray;
 class	Scene;
+class	StatsGroup;
 
 ////////////////////////////////////////////////////////////////////////////
 //	definition of integrator
@@ -45,6 +46,19 @@ public:
 	// result       : radiance along the ray from the scene
 	virtual Spectrum	Li( const Ray& ray , const PixelSample& ps ) const = 0;
 
+	// return the radiance of a stream of rays
+	// para 'rays'     : rays with specific directions , they are the camera rays of one pixel
+	// para 'ps'       : the pixel sample of each ray
+	// para 'radiance' : radiance along each ray from the scene
+	// para 'count'    : the number of rays
+	// note            : integrators could override it to trace coherent rays together , by default
+	//					 the rays are evaluated one by one
+	virtual void		LiStream( const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned count ) const
+	{
+		for( unsigned i = 0 ; i < count ; ++i )
+			radiance[i] = Li( rays[i] , ps[i] );
+	}
+
 	// set sample per pixel
 	// para 'spp' : sample per pixel
 	void SetSamplePerPixel( unsigned spp ){ sample_per_pixel = spp; }
@@ -59,36 +73,30 @@ public:
 	// para 'samples' : the samples to be generated
 	// para 'ps'      : number of pixel sample to be generated
 	// para 'scene'   : the scene to be rendered
-	virtual void GenerateSample( const Sampler* sampler , PixelSample* samples , unsigned ps , const Scene& scene ) const
-	{
-		float* data = SORT_MALLOC_ARRAY( float , 2 * ps )();
-		sampler->Generate2D( data , ps , true );
-		for( unsigned i = 0 ; i < ps ; ++i )
-		{
-			samples[i].img_u = data[2*i];
-			samples[i].img_v = data[2*i+1];
-		}
-
-		// shuffle the index
-		const unsigned* shuffled_id = ShuffleIndex( ps );
-		sampler->Generate2D( data , ps );
-		for( unsigned i = 0 ; i < ps ; ++i )
-		{
-			unsigned sid = 2*shuffled_id[i];
-			samples[i].dof_u = data[sid];
-			samples[i].dof_v = data[sid+1];
-		}
-	}
+	virtual void GenerateSample( const Sampler* sampler , PixelSample* samples , unsigned ps , const Scene& scene ) const;
 
 	// request samples
 	virtual void RequestSample( Sampler* sampler , PixelSample* ps , unsigned ps_num ) {}
 
+	// request the sample dimensions of every pixel sample , the sampler generates each of them for all samples of a pixel
+	// para 'light' : the number of light sample dimensions
+	// para 'bsdf'  : the number of bsdf sample dimensions
+	void RequestDimensions( unsigned light , unsigned bsdf )
+	{
+		light_dimensions = light;
+		bsdf_dimensions = bsdf;
+	}
+
 	// pre-process before rendering
 	// by default , nothing is done in pre-process
 	// some integrator, such as Photon Mapping use pre-process step to
 	// generate some neccessary infomation by latter stage.
 	virtual void PreProcess() {}
 
+	// prepare a pass of rendering , it is called before the tiles of every pass are rendered
+	// para 'spp' : the number of samples per pixel in the pass
+	virtual void BeginPass( unsigned spp ) {}
+
 	// post process
 	virtual void PostProcess() {}
 
@@ -98,9 +106,20 @@ public:
 	// output log information
 	virtual void OutputLog() const {}
 
+	// add the statistics of the rendering to the report , it is called once the view is rendered
+	// para 'stats' : the group of the integrator in the statistics report
+	virtual void CollectStats( StatsGroup& stats ) const {}
+
 	// refresh tile in blender
 	virtual bool NeedRefreshTile() const { return true; }
 
+	// whether the radiance along a camera ray missing every primitive is the radiance of the environment along it ,
+	// tiles whose rays can't reach the scene are rendered without the integrator then
+	virtual bool IsBackgroundOnMiss() const { return false; }
+
+	// whether the integrator starts its paths from the first hits of the raster pass in 'PixelSample::primary'
+	virtual bool AcceptsPrimaryHits() const { return false; }
+
 // protected method
 protected:
 	// Camera
@@ -118,6 +137,10 @@ protected:
 	// light sample per pixel sample per light
 	unsigned sample_per_pixel;
 
+	// the sample dimensions of every pixel sample
+	unsigned light_dimensions = 0;
+	unsigned bsdf_dimensions = 0;
+
 	class MaxDepthProperty : public PropertyHandler<Integrator>
 	{
 	public:
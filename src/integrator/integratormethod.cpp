@@ -23,15 +23,40 @@
 #include "geometry/primitive.h"
 #include "material/material.h"
 #include "light/light.h"
+#include "medium/medium.h"
+#include "utility/rand.h"
+#include "accel/primarycache.h"
 
-// evaluate direct lighting
-Spectrum	EvaluateDirect( const Ray& r , const Scene& scene , const Light* light , const Intersection& ip , 
-							const LightSample& ls ,const BsdfSample& bs , BXDF_TYPE type )
+// the probability of tracing the shadow ray of a sample , samples dimmer than 'cull' survive in proportion to their contribution
+static inline float	shadowSurvival( float intensity , float cull )
+{
+	return ( cull > 0.0f && intensity < cull ) ? intensity / cull : 1.0f;
+}
+
+// evaluate direct lighting , 'product' combines the radiance of the light and the bsdf into the spectrum of the path
+template<class T , class Product>
+static T	evaluateDirect( const Ray& r , const Scene& scene , const Light* light , const Intersection& ip , 
+							const LightSample& ls ,const BsdfSample& bs , BXDF_TYPE type , const Medium* medium , float cull , const Primary_Hit* primary , const Product& product )
 {
+	// lights that can't reach the point are rejected before any ray is traced
+	if( !light->Illuminates( ip ) )
+		return T();
+
+	// the shadow ray towards a delta light from the first hit of a camera ray could be kept by the primary cache
+	const int slot = ( primary && primary->shadows && light->IsDelta() && !scene.HasMedia() ) ? primary->cache->ShadowSlot( light ) : -1;
+
 	// get bsdf
 	Bsdf* bsdf = ip.primitive->GetMaterial()->GetBsdf( &ip );
 
-	Spectrum radiance;
+	// the fraction of light passing along the shadow ray , it is attenuated by the media in scenes with them
+	const MediumInterface* media = ip.primitive ? ip.primitive->GetMediumInterface() : 0;
+	auto transmittance = [&]( const Ray& ray ) -> Spectrum {
+		if( !scene.HasMedia() )
+			return scene.IsOccluded( ray ) ? 0.0f : 1.0f;
+		return scene.Transmittance( ray , media ? media->GetMedium( ray.m_Dir , ip.gnormal ) : medium );
+	};
+
+	T radiance;
 	Visibility visibility(scene);
 	float light_pdf;
 	float bsdf_pdf;
@@ -40,17 +65,30 @@ Spectrum	EvaluateDirect( const Ray& r , const Scene& scene , const Light* light
 	Spectrum li = light->sample_l( ip , &ls , wi , 0 , &light_pdf , 0 , 0 , visibility );
 	if( light_pdf > 0.0f && !li.IsBlack() )
 	{
-		Spectrum f = bsdf->f( wo , wi , type );
+		// the pdf of the bsdf is only needed by MIS , it is evaluated along with the bsdf
+		Spectrum f = bsdf->EvalAndPdf( wo , wi , light->IsDelta() ? nullptr : &bsdf_pdf , type );
 		float dot = SatDot( wi , ip.normal );
-		if( f.IsBlack() == false && visibility.IsVisible() && dot > 0.0f )
+		if( f.IsBlack() == false && dot > 0.0f )
 		{
-			if( light->IsDelta() )
-				radiance = li * f * dot / light_pdf;
+			// the unoccluded contribution decides whether the shadow ray is traced at all
+			const float weight = ( light->IsDelta() ? 1.0f : MisFactor( 1 , light_pdf , 1 , bsdf_pdf ) ) * dot / light_pdf;
+			bool occluded;
+			if( slot >= 0 && PrimaryCache::LookupShadow( *primary , slot , occluded ) )
+			{
+				if( !occluded )
+					radiance = product( li , f ) * weight;
+			}
 			else
 			{
-				bsdf_pdf = bsdf->Pdf( wo , wi , type );
-				float power_hueristic = MisFactor( 1 , light_pdf , 1 , bsdf_pdf );
-				radiance = li * f * dot * power_hueristic / light_pdf;
+				const float survival = shadowSurvival( ( li * f ).GetIntensity() * weight , cull );
+				if( survival == 1.0f || sort_canonical() < survival )
+				{
+					const Spectrum tr = transmittance( visibility.ray );
+					if( slot >= 0 )
+						PrimaryCache::StoreShadow( *primary , slot , tr.IsBlack() );
+					if( !( li *= tr ).IsBlack() )
+						radiance = product( li , f ) * ( weight / survival );
+				}
 			}
 		}
 	}
@@ -65,7 +103,7 @@ Spectrum	EvaluateDirect( const Ray& r , const Scene& scene , const Light* light
 			if( bxdf_type )
 			{
 				float light_pdf;
-				light_pdf = light->Pdf( ip.intersect , wi );
+				light_pdf = light->Pdf( ip.SpawnOrigin( wi ) , wi );
 				if( light_pdf <= 0.0f )
 					return radiance;
 				weight = MisFactor( 1 , bsdf_pdf , 1 , light_pdf );
@@ -73,22 +111,89 @@ Spectrum	EvaluateDirect( const Ray& r , const Scene& scene , const Light* light
 			
 			Spectrum li;
 			Intersection _ip;
-			if( false == light->Le( Ray( ip.intersect , wi ) , &_ip , li ) )
+			visibility.ray = ip.SpawnRay( wi );
+			if( false == light->Le( visibility.ray , &_ip , li ) )
 				return radiance;
 
 			float dot = SatDot( wi , ip.normal );
-			visibility.ray = Ray( ip.intersect , wi , 0 , 0.001f , _ip.t - 0.001f );
-			if( dot > 0.0f && !li.IsBlack() && visibility.IsVisible() )
-				radiance += li * f * dot * weight / bsdf_pdf;
+			if( dot <= 0.0f || li.IsBlack() )
+				return radiance;
+
+			weight *= dot / bsdf_pdf;
+			const float survival = shadowSurvival( ( li * f ).GetIntensity() * weight , cull );
+			if( survival < 1.0f && sort_canonical() >= survival )
+				return radiance;
+
+			visibility.ray.m_fMax = _ip.t * ( 1.0f - SHADOW_EPSILON );
+			if( !( li *= transmittance( visibility.ray ) ).IsBlack() )
+				radiance += product( li , f ) * ( weight / survival );
 		}
 	}
 
 	return radiance;
 }
 
+// the product of the light and the bsdf of rgb paths
+struct RGB_Product
+{
+	Spectrum operator()( const Spectrum& li , const Spectrum& f ) const { return li * f; }
+};
+
+// the product of the light and the bsdf at the wavelengths of spectral paths
+template<int N>
+struct Sampled_Product
+{
+	const SampledWavelengths<N>& wl;
+	explicit Sampled_Product( const SampledWavelengths<N>& _wl ) : wl(_wl) {}
+	SampledSpectrum<N> operator()( const Spectrum& li , const Spectrum& f ) const { return UpsampleRGB( li , wl ) * UpsampleRGB( f , wl ); }
+};
+
+// evaluate direct lighting
+Spectrum	EvaluateDirect( const Ray& r , const Scene& scene , const Light* light , const Intersection& ip , 
+							const LightSample& ls ,const BsdfSample& bs , BXDF_TYPE type , const Medium* medium , float cull , const Primary_Hit* primary )
+{
+	return evaluateDirect<Spectrum>( r , scene , light , ip , ls , bs , type , medium , cull , primary , RGB_Product() );
+}
+
+// evaluate direct lighting at the wavelengths of a spectral path
+template<int N>
+SampledSpectrum<N>	EvaluateDirect( const Ray& r , const Scene& scene , const Light* light , const Intersection& ip , 
+									const LightSample& ls ,	const BsdfSample& bs , const SampledWavelengths<N>& wl , BXDF_TYPE type , const Medium* medium , float cull , const Primary_Hit* primary )
+{
+	return evaluateDirect< SampledSpectrum<N> >( r , scene , light , ip , ls , bs , type , medium , cull , primary , Sampled_Product<N>( wl ) );
+}
+
+template SampledSpectrum<4> EvaluateDirect<4>( const Ray& , const Scene& , const Light* , const Intersection& , const LightSample& , const BsdfSample& , const SampledWavelengths<4>& , BXDF_TYPE , const Medium* , float , const Primary_Hit* );
+template SampledSpectrum<8> EvaluateDirect<8>( const Ray& , const Scene& , const Light* , const Intersection& , const LightSample& , const BsdfSample& , const SampledWavelengths<8>& , BXDF_TYPE , const Medium* , float , const Primary_Hit* );
+
 // mutilpe importance sampling factors , power heuristic is used 
 float	MisFactor( int nf, float fPdf, int ng, float gPdf )
 {
 	float f = nf * fPdf, g = ng * gPdf;
     return (f*f) / (f*f + g*g);
 }
+
+// spawn the ray leaving the surface along 'wi'
+void	SpawnRay( const Ray& r , const Intersection& ip , const Vector& wi , Ray& next )
+{
+	const Vector n = ip.normal;
+	const Vector wo = -r.m_Dir;
+
+	// the differentials are only kept for reflection , refraction needs the index of refraction which is unknown here
+	const bool differentials = r.m_HasDifferentials && Dot( wo , n ) * Dot( wi , n ) > 0.0f;
+	if( differentials )
+	{
+		// the derivatives of the normal are ignored , the footprint grows a bit slower on curved surfaces
+		const Vector dwodx = -r.m_DxDir - wo;
+		const Vector dwody = -r.m_DyDir - wo;
+		next.m_DxOri = ip.intersect + ip.dpdx;
+		next.m_DyOri = ip.intersect + ip.dpdy;
+		next.m_DxDir = wi - dwodx + n * ( 2.0f * Dot( dwodx , n ) );
+		next.m_DyDir = wi - dwody + n * ( 2.0f * Dot( dwody , n ) );
+	}
+	next.m_HasDifferentials = differentials;
+	next.m_Ori = ip.SpawnOrigin( wi );
+	next.m_Dir = wi;
+	next.m_fMin = 0.0f;
+	next.m_Time = r.m_Time;
+}
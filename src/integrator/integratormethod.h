@@ -20,14 +20,37 @@
 // include the header
 #include "integrator.h"
 #include "utility/enum.h"
+#include "spectrum/sampledspectrum.h"
 
 // pre-decleration
 class Intersection;
 class Light;
+class Medium;
+struct Primary_Hit;
 
 // evaluate direct lighting
+// note : in scenes with participating media , the shadow rays leave the surface in the medium on their side
+//		  of it , 'medium' is the one they travel in if the surface bounds no medium
+// note : samples are rejected before their shadow rays are built if the product of the bsdf , the light and the
+//		  cosine is zero. The shadow ray of a sample whose unoccluded contribution is dimmer than 'cull' is only
+//		  traced with a probability proportional to the contribution and its result is divided by the probability ,
+//		  no sample is culled if 'cull' is zero.
+// note : 'primary' is the first hit of the camera ray if 'ip' is resolved from it , the shadow rays towards delta
+//		  lights are only traced once for it if the primary cache keeps them.
 Spectrum	EvaluateDirect( const Ray& r , const Scene& scene , const Light* light , const Intersection& ip , 
-							const LightSample& ls ,	const BsdfSample& bs , BXDF_TYPE type = BXDF_ALL );
+							const LightSample& ls ,	const BsdfSample& bs , BXDF_TYPE type = BXDF_ALL , const Medium* medium = 0 , float cull = 0.0f ,
+							const Primary_Hit* primary = 0 );
+
+// evaluate direct lighting at the wavelengths of a spectral path , the radiance of the light and the bsdf
+// are upsampled separately so that their product is spectral
+template<int N>
+SampledSpectrum<N>	EvaluateDirect( const Ray& r , const Scene& scene , const Light* light , const Intersection& ip , 
+									const LightSample& ls ,	const BsdfSample& bs , const SampledWavelengths<N>& wl , BXDF_TYPE type = BXDF_ALL , const Medium* medium = 0 , float cull = 0.0f ,
+									const Primary_Hit* primary = 0 );
 
 // mutilpe importance sampling factors
 float		MisFactor( int nf, float fPdf, int ng, float gPdf );
+
+// spawn the ray leaving the surface along 'wi' , its differentials follow the mirror reflection of the differentials of 'r'
+// at the hit so that textures of later hits are still filtered , 'next' may be 'r' itself
+void		SpawnRay( const Ray& r , const Intersection& ip , const Vector& wi , Ray& next );
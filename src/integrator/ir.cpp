@@ -22,73 +22,181 @@
 #include "geometry/scene.h"
 #include "light/light.h"
 #include "bsdf/bsdf.h"
+#include "utility/multithread/threadpool.h"
+#include "managers/memmanager.h"
+#include "log/log.h"
+#include <algorithm>
 
 IMPLEMENT_CREATOR( InstantRadiosity );
 
 // Preprocess
 void InstantRadiosity::PreProcess()
 {
-	m_pVirtualLightSources = new list<VirtualLightSource>[m_nLightPathSet];
+	m_virtualLightSources.clear();
+	m_virtualLightSources.resize( max( 0 , m_nLightPathSet ) );
+
+	// light paths are traced in parallel , the light sources of each chunk are gathered in the order of the chunks
+	const unsigned path_cnt = (unsigned)max( 0 , m_nLightPaths );
+	const unsigned grain = 16;
+	size_t total = 0;
+	for( unsigned set_id = 0 ; set_id < m_virtualLightSources.size() ; ++set_id )
+	{
+		VPL_Set& set = m_virtualLightSources[set_id];
+		vector< vector<VirtualLightSource> > chunks( ParallelChunkCount( path_cnt , grain ) );
+		ParallelFor( 0 , path_cnt , grain , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+			for( unsigned i = _start ; i < _end ; ++i )
+			{
+				// bsdfs of the light path are only needed while it is traced
+				MemScope mem_scope;
+				sort_reseed( i , SORT_RAND_PARALLEL , set_id );
+
+				// pick a light first
+				float light_pick_pdf;
+				const Light* light = scene.SampleLight( sort_canonical() , &light_pick_pdf );
+				if( light == 0 || light_pick_pdf == 0.0f )
+					continue;
+
+				// sample a ray from the light source
+				float	light_emission_pdf = 0.0f;
+				float	light_pdfa = 0.0f;
+				Ray		ray;
+				float   cosAtLight = 1.0f;
+				Spectrum le = light->sample_l( LightSample(true) , ray , &light_emission_pdf , &light_pdfa , &cosAtLight );
+				if( light_emission_pdf == 0.0f )
+					continue;
+
+				Spectrum throughput = le * cosAtLight / ( light_pick_pdf * light_emission_pdf );
+
+				int current_depth = 0;
+				Intersection intersect;
+				while( true )
+				{
+					if (false == scene.GetIntersect(ray, &intersect))
+						break;
+
+					VirtualLightSource ls;
+					ls.power = throughput;
+					ls.intersect = intersect;
+					ls.wi = -ray.m_Dir;
+					ls.depth = ++current_depth;
+
+					Bsdf* bsdf = intersect.primitive->GetMaterial()->GetBsdf(&intersect);
+
+					// the intensity of the light source is bounded by its bsdf toward the normal and the mirrored direction
+					const Vector n = ( Dot( ls.wi , intersect.normal ) > 0.0f ) ? intersect.normal : -intersect.normal;
+					const Vector mirrored = n * ( 2.0f * Dot( ls.wi , n ) ) - ls.wi;
+					ls.bound = ls.power.GetIntensity() * max( bsdf->f( n , ls.wi ).GetIntensity() , bsdf->f( mirrored , ls.wi ).GetIntensity() );
+					chunks[chunk].push_back( ls );
+
+					float bsdf_pdf;
+					Vector wo;
+					Spectrum bsdf_value = bsdf->sample_f(ls.wi, wo, BsdfSample(true), &bsdf_pdf, BXDF_ALL);
+
+					if( bsdf_pdf == 0.0f )
+						break;
+
+					// apply russian roulette
+					float continueProperbility = min( 1.0f , throughput.GetIntensity() );
+					if( sort_canonical() > continueProperbility )
+						break;
+					throughput /= continueProperbility;
+
+					// update throughput
+					throughput *= bsdf_value * ( AbsDot(wo, intersect.normal) / bsdf_pdf );
+
+					// update next ray
+					ray = intersect.SpawnRay( wo );
+				}
+			}
+		});
+
+		size_t count = 0;
+		for( const auto& chunk : chunks )
+			count += chunk.size();
+		set.lights.reserve( count );
+		for( const auto& chunk : chunks )
+			set.lights.insert( set.lights.end() , chunk.begin() , chunk.end() );
+		total += count;
+	}
 
-	for( int k = 0 ; k < m_nLightPathSet ; ++k )
+	// light cut trees of the sets are independent , they are built in parallel
+	size_t cluster_cnt = 0;
+	if( m_fLightCutError > 0.0f )
 	{
-		for( int i = 0 ; i < m_nLightPaths ; ++i )
-		{
-			// pick a light first
-			float light_pick_pdf;
-			const Light* light = scene.SampleLight( sort_canonical() , &light_pick_pdf );
-
-			// sample a ray from the light source
-			float	light_emission_pdf = 0.0f;
-			float	light_pdfa = 0.0f;
-			Ray		ray;
-			float   cosAtLight = 1.0f;
-			Spectrum le = light->sample_l( LightSample(true) , ray , &light_emission_pdf , &light_pdfa , &cosAtLight );
-
-			Spectrum throughput = le * cosAtLight / ( light_pick_pdf * light_emission_pdf );
-
-			int current_depth = 0;
-			Intersection intersect;
-			while( true )
+		ParallelFor( 0 , (unsigned)m_virtualLightSources.size() , 1 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+			for( unsigned k = _start ; k < _end ; ++k )
 			{
-				if (false == scene.GetIntersect(ray, &intersect))
-					break;
-
-				VirtualLightSource ls;
-				ls.power = throughput;
-				ls.intersect = intersect;
-				ls.wi = -ray.m_Dir;
-				ls.depth = ++current_depth;
-				m_pVirtualLightSources[k].push_back( ls );
-
-				float bsdf_pdf;
-				Vector wo;
-				Bsdf* bsdf = intersect.primitive->GetMaterial()->GetBsdf(&intersect);
-				Spectrum bsdf_value = bsdf->sample_f(ls.wi, wo, BsdfSample(true), &bsdf_pdf, BXDF_ALL);
-
-				if( bsdf_pdf == 0.0f )
-					break;
-
-				// apply russian roulette
-				float continueProperbility = min( 1.0f , throughput.GetIntensity() );
-				if( sort_canonical() > continueProperbility )
-					break;
-				throughput /= continueProperbility;
-
-				// update throughput
-				throughput *= bsdf_value * ( AbsDot(wo, intersect.normal) / bsdf_pdf );
-
-				// update next ray
-				ray = Ray(intersect.intersect, wo, 0, 0.001f);
+				VPL_Set& set = m_virtualLightSources[k];
+				if( set.lights.empty() )
+					continue;
+
+				vector<unsigned> ids( set.lights.size() );
+				for( unsigned i = 0 ; i < ids.size() ; ++i )
+					ids[i] = i;
+				set.clusters.reserve( 2 * set.lights.size() - 1 );
+				set.clusters.push_back( VPL_Cluster() );
+				_buildCluster( set , ids , 0 , (unsigned)ids.size() , 0 );
 			}
-		}
+		});
+		for( const VPL_Set& set : m_virtualLightSources )
+			cluster_cnt += set.clusters.size();
 	}
+
+	slog( DEBUG , INTEGRATOR , stringFormat( "Instant radiosity generates %d virtual light sources in %d sets, light cut trees hold %d clusters." , (int)total , (int)m_virtualLightSources.size() , (int)cluster_cnt ) );
+}
+
+// build the light cut tree of a set of virtual light sources
+void InstantRadiosity::_buildCluster( VPL_Set& set , vector<unsigned>& ids , unsigned _start , unsigned _end , unsigned node ) const
+{
+	if( _end - _start == 1 )
+	{
+		const VirtualLightSource& vpl = set.lights[ids[_start]];
+		VPL_Cluster& cluster = set.clusters[node];
+		cluster.bbox.Union( vpl.intersect.intersect );
+		cluster.power = vpl.power;
+		cluster.bound = vpl.bound;
+		cluster.representative = ids[_start];
+		cluster.min_depth = vpl.depth;
+		cluster.max_depth = vpl.depth;
+		return;
+	}
+
+	// the light sources are split at the median along the longest axis of their bounding box
+	BBox bbox;
+	for( unsigned i = _start ; i < _end ; ++i )
+		bbox.Union( set.lights[ids[i]].intersect.intersect );
+	const unsigned axis = bbox.MaxAxisId();
+	const unsigned mid = ( _start + _end ) / 2;
+	std::nth_element( ids.begin() + _start , ids.begin() + mid , ids.begin() + _end , [&]( unsigned a , unsigned b ){
+		return set.lights[a].intersect.intersect[axis] < set.lights[b].intersect.intersect[axis];
+	});
+
+	const unsigned child = (unsigned)set.clusters.size();
+	set.clusters.push_back( VPL_Cluster() );
+	set.clusters.push_back( VPL_Cluster() );
+	_buildCluster( set , ids , _start , mid , child );
+	_buildCluster( set , ids , mid , _end , child + 1 );
+
+	const VPL_Cluster& left = set.clusters[child];
+	const VPL_Cluster& right = set.clusters[child + 1];
+	VPL_Cluster& cluster = set.clusters[node];
+	cluster.bbox = bbox;
+	cluster.power = left.power + right.power;
+	cluster.bound = left.bound + right.bound;
+	cluster.child = child;
+	cluster.min_depth = min( left.min_depth , right.min_depth );
+	cluster.max_depth = max( left.max_depth , right.max_depth );
+
+	// the representative is picked by power , so the estimate of a cluster is the total of its light sources in average
+	const float left_power = left.power.GetIntensity();
+	const float right_power = right.power.GetIntensity();
+	cluster.representative = ( sort_canonical() * ( left_power + right_power ) < left_power ) ? left.representative : right.representative;
 }
 
 // PostProcess
 void InstantRadiosity::PostProcess()
 {
-	SAFE_DELETE_ARRAY(m_pVirtualLightSources);
+	m_virtualLightSources.clear();
 }
 
 // radiance along a specific ray direction
@@ -121,47 +229,13 @@ Spectrum InstantRadiosity::_li( const Ray& r , bool ignoreLe , float* first_inte
 	if( first_intersect_dist )
 		*first_intersect_dist = ip.t;
 
-	// pick a virtual light source randomly
+	// pick a virtual light source set randomly
 	const unsigned lps_id = min( m_nLightPathSet - 1 , (int)(sort_canonical() * m_nLightPathSet) );
-	list<VirtualLightSource> vps = m_pVirtualLightSources[lps_id];
 
 	Bsdf*	bsdf = ip.primitive->GetMaterial()->GetBsdf(&ip);
 
 	// evaluate indirect illumination
-	Spectrum indirectIllum;
-	list<VirtualLightSource>::const_iterator it = vps.begin();
-	while( it != vps.end() )
-	{
-		if( r.m_Depth + it->depth > max_recursive_depth )
-		{
-			++it;
-			continue;
-		}
-
-		Vector	delta = ip.intersect - it->intersect.intersect;
-		float	sqrLen = delta.SquaredLength();
-		float	len = sqrt( sqrLen );
-		Vector	n_delta = delta / len;
-
-		Bsdf* bsdf1 = it->intersect.primitive->GetMaterial()->GetBsdf(&(it->intersect));
-
-		float		gterm = AbsDot( n_delta , ip.normal ) * AbsDot( n_delta , it->intersect.normal ) / max( m_fMinSqrDist , sqrLen );
-		Spectrum	f0 = bsdf->f( -r.m_Dir , -n_delta );
-		Spectrum	f1 = bsdf1->f( n_delta , it->wi );
-
-		Spectrum	contr = gterm * f0 * f1 * it->power;
-		if( !contr.IsBlack() )
-		{
-			Visibility vis(scene);
-			vis.ray = Ray( it->intersect.intersect , n_delta , 0 , 0.001f , len - 0.001f );
-
-			if( vis.IsVisible() )
-				indirectIllum += contr;
-		}
-
-		++it;
-	}
-	radiance += indirectIllum / (float)m_nLightPaths;
+	radiance += _evaluateLightCut( ip , bsdf , -r.m_Dir , m_virtualLightSources[lps_id] , r.m_Depth ) / (float)m_nLightPaths;
 
 	if( m_fMinDist > 0.0f )
 	{
@@ -173,7 +247,8 @@ Spectrum InstantRadiosity::_li( const Ray& r , bool ignoreLe , float* first_inte
 		{
 			PixelSample ps;
 			float gather_dist;
-			Ray gather_ray( ip.intersect , wi , r.m_Depth + 1 , 0.001f , m_fMinDist - 0.001f );
+			Ray gather_ray = ip.SpawnRay( wi , r.m_Depth + 1 );
+			gather_ray.m_fMax = m_fMinDist;
 			Spectrum li = _li( gather_ray , true , &gather_dist );
 
 			if( !li.IsBlack() )
@@ -187,10 +262,154 @@ Spectrum InstantRadiosity::_li( const Ray& r , bool ignoreLe , float* first_inte
 	return radiance;
 }
 
+// evaluate the contribution of a virtual light source with unit power
+Spectrum InstantRadiosity::_evaluateVPL( const Intersection& ip , const Bsdf* bsdf , const Vector& wo , const VirtualLightSource& vpl ) const
+{
+	const Vector	delta = ip.intersect - vpl.intersect.intersect;
+	const float		sqrLen = delta.SquaredLength();
+	if( sqrLen == 0.0f )
+		return 0.0f;
+	const float		len = sqrt( sqrLen );
+	const Vector	n_delta = delta / len;
+
+	// the bsdf of the light source is only needed here
+	MemScope mem_scope;
+	const Bsdf* bsdf1 = vpl.intersect.primitive->GetMaterial()->GetBsdf(&(vpl.intersect));
+
+	const float		gterm = AbsDot( n_delta , ip.normal ) * AbsDot( n_delta , vpl.intersect.normal ) / max( m_fMinSqrDist , sqrLen );
+	const Spectrum	contr = gterm * bsdf->f( wo , -n_delta ) * bsdf1->f( n_delta , vpl.wi );
+	if( contr.IsBlack() )
+		return 0.0f;
+
+	Visibility vis(scene);
+	// the virtual light sources are shared by all times , they are tested against the scene at the time of the shading point
+	// both ends leave their surfaces beyond the rounding errors
+	vis.ray = vpl.intersect.SpawnRayTo( ip.SpawnOrigin( -n_delta ) );
+	vis.ray.m_Time = ip.time;
+	return vis.IsVisible() ? contr : 0.0f;
+}
+
+// evaluate a light cut of a set of virtual light sources
+Spectrum InstantRadiosity::_evaluateLightCut( const Intersection& ip , const Bsdf* bsdf , const Vector& wo , const VPL_Set& set , int depth ) const
+{
+	// every light source is evaluated without the tree
+	if( set.clusters.empty() )
+	{
+		Spectrum indirectIllum;
+		for( const VirtualLightSource& vpl : set.lights )
+		{
+			if( depth + vpl.depth <= max_recursive_depth )
+				indirectIllum += _evaluateVPL( ip , bsdf , wo , vpl ) * vpl.power;
+		}
+		return indirectIllum;
+	}
+
+	// the bsdf at the shading point is bounded the same way as the ones of the light sources
+	const Vector n = ( Dot( wo , ip.normal ) > 0.0f ) ? ip.normal : -ip.normal;
+	const Vector mirrored = n * ( 2.0f * Dot( wo , n ) ) - wo;
+	const float bsdf_bound = max( bsdf->f( wo , n ).GetIntensity() , bsdf->f( wo , mirrored ).GetIntensity() );
+	Vector t0 , t1;
+	CoordinateSystem( n , t0 , t1 );
+
+	// clusters in the cut along with their estimates and error bounds
+	struct Cut_Entry
+	{
+		unsigned	node;
+		Spectrum	unit;		// contribution of the representative with unit power
+		Spectrum	estimate;	// contribution of the whole cluster
+		float		error;		// upper bound of the error of the estimate
+	};
+	auto evaluate = [&]( unsigned node , unsigned parent_rep , const Spectrum& parent_unit ){
+		const VPL_Cluster& cluster = set.clusters[node];
+		Cut_Entry entry;
+		entry.node = node;
+		entry.error = 0.0f;
+		if( depth + cluster.min_depth > max_recursive_depth )
+			return entry;
+
+		// the representative of a cluster is the one of a child , it is not evaluated again
+		const VirtualLightSource& rep = set.lights[cluster.representative];
+		if( cluster.representative == parent_rep )
+			entry.unit = parent_unit;
+		else if( depth + rep.depth <= max_recursive_depth )
+			entry.unit = _evaluateVPL( ip , bsdf , wo , rep );
+		entry.estimate = entry.unit * cluster.power;
+		if( cluster.child == 0 )
+			return entry;
+
+		// the geometry term is bounded with the closest point of the bounding box and the largest cosine toward it
+		float sqr_dist = 0.0f;
+		for( unsigned axis = 0 ; axis < 3 ; ++axis )
+		{
+			const float d = max( 0.0f , max( cluster.bbox.m_Min[axis] - ip.intersect[axis] , ip.intersect[axis] - cluster.bbox.m_Max[axis] ) );
+			sqr_dist += d * d;
+		}
+		float lo[3] = { FLT_MAX , FLT_MAX , FLT_MAX };
+		float hi[3] = { -FLT_MAX , -FLT_MAX , -FLT_MAX };
+		for( unsigned i = 0 ; i < 8 ; ++i )
+		{
+			const Point corner( ( i & 1 ) ? cluster.bbox.m_Max.x : cluster.bbox.m_Min.x , ( i & 2 ) ? cluster.bbox.m_Max.y : cluster.bbox.m_Min.y , ( i & 4 ) ? cluster.bbox.m_Max.z : cluster.bbox.m_Min.z );
+			const Vector v = corner - ip.intersect;
+			const float local[3] = { Dot( v , t0 ) , Dot( v , t1 ) , Dot( v , n ) };
+			for( unsigned axis = 0 ; axis < 3 ; ++axis )
+			{
+				lo[axis] = min( lo[axis] , local[axis] );
+				hi[axis] = max( hi[axis] , local[axis] );
+			}
+		}
+		const float z = max( fabs( lo[2] ) , fabs( hi[2] ) );
+		const float x2 = ( lo[0] <= 0.0f && hi[0] >= 0.0f ) ? 0.0f : min( lo[0] * lo[0] , hi[0] * hi[0] );
+		const float y2 = ( lo[1] <= 0.0f && hi[1] >= 0.0f ) ? 0.0f : min( lo[1] * lo[1] , hi[1] * hi[1] );
+		const float len = sqrt( x2 + y2 + z * z );
+		const float cos_bound = ( len > 0.0f ) ? z / len : 1.0f;
+
+		entry.error = cluster.bound * bsdf_bound * cos_bound / max( max( m_fMinSqrDist , sqr_dist ) , 1e-6f );
+
+		// light sources deeper than the path allows are only left out once the cluster is refined
+		if( depth + cluster.max_depth > max_recursive_depth )
+			entry.error = FLT_MAX;
+		return entry;
+	};
+	auto less = []( const Cut_Entry& e0 , const Cut_Entry& e1 ){ return e0.error < e1.error; };
+
+	// the cluster with the largest error is refined until all errors are small enough compared with the total
+	vector<Cut_Entry> cut;
+	cut.reserve( m_nLightCutSize + 1 );
+	cut.push_back( evaluate( 0 , (unsigned)-1 , 0.0f ) );
+	Spectrum total = cut[0].estimate;
+	while( (int)cut.size() < m_nLightCutSize )
+	{
+		if( cut.front().error <= m_fLightCutError * total.GetIntensity() )
+			break;
+
+		std::pop_heap( cut.begin() , cut.end() , less );
+		const Cut_Entry entry = cut.back();
+		cut.pop_back();
+		total -= entry.estimate;
+
+		const VPL_Cluster& cluster = set.clusters[entry.node];
+		for( unsigned i = 0 ; i < 2 ; ++i )
+		{
+			const Cut_Entry child = evaluate( cluster.child + i , cluster.representative , entry.unit );
+			total += child.estimate;
+			cut.push_back( child );
+			std::push_heap( cut.begin() , cut.end() , less );
+		}
+	}
+
+	// estimates are summed again , the running total drifts with rounding errors
+	Spectrum indirectIllum;
+	for( const Cut_Entry& entry : cut )
+		indirectIllum += entry.estimate;
+	return indirectIllum;
+}
+
 // register property
 void InstantRadiosity::_registerAllProperty()
 {
 	_registerProperty( "light_path_num" , new LightPathNumProperty(this) );
 	_registerProperty( "light_path_set_num" , new LightPathSetProperty(this) );
 	_registerProperty( "min_distance" , new MinDistanceProperty(this) );
+	_registerProperty( "lightcut_error" , new LightCutErrorProperty(this) );
+	_registerProperty( "lightcut_size" , new LightCutSizeProperty(this) );
 }
@@ -20,6 +20,8 @@
 // include the header file
 #include "integrator.h"
 #include "geometry/intersection.h"
+#include "geometry/bbox.h"
+#include <vector>
 
 class Bsdf;
 
@@ -29,6 +31,26 @@ struct VirtualLightSource
 	Vector			wi;
 	Spectrum		power;
 	int				depth;
+	float			bound;			// upper bound of the intensity emitted by the light source in any direction
+};
+
+// node of the light cut tree , it is a cluster of virtual light sources
+struct VPL_Cluster
+{
+	BBox			bbox;			// bounding box of the virtual light sources in the cluster
+	Spectrum		power;			// total power of the virtual light sources in the cluster
+	float			bound = 0.0f;	// total bound of the intensity of the virtual light sources in the cluster
+	unsigned		representative;	// the virtual light source standing for the whole cluster
+	unsigned		child = 0;		// the first child , the second one follows it , it is 0 for a leaf
+	int				min_depth;		// the range of depth of the virtual light sources in the cluster
+	int				max_depth;
+};
+
+// a set of virtual light sources along with the light cut tree over them
+struct VPL_Set
+{
+	vector<VirtualLightSource>	lights;
+	vector<VPL_Cluster>			clusters;	// the first cluster is the root of the tree
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -39,6 +61,13 @@ struct VirtualLightSource
 //        will use those virtual light source to evaluate indirect
 //        illumination. Direct illumination is handled the same way in
 //        directlight integrator.
+//        Virtual light sources of each set are clustered in a binary tree.
+//        A shading point evaluates a cut of the tree instead of every
+//        light source , each cluster in the cut is represented by one of
+//        its light sources and clusters are refined until their error
+//        bound is below a fraction of the total estimate. Please refer to
+//        "Lightcuts: A Scalable Approach to Illumination" by Walter et al.
+//        for further details.
 class	InstantRadiosity : public Integrator
 {
 // public method
@@ -51,6 +80,8 @@ public:
 		m_fMinDist = 1.0f;
 		m_fMinSqrDist = 1.0f;
 		m_nLightPathSet = 1;
+		m_fLightCutError = 0.02f;
+		m_nLightCutSize = 1024;
 
 		_registerAllProperty();
 	}
@@ -79,8 +110,13 @@ private:
 	float	m_fMinDist;
 	float	m_fMinSqrDist;
 
+	// the error of the light cut relative to the total estimate , 0 evaluates all virtual light sources
+	float	m_fLightCutError;
+	// the maximum number of clusters in a light cut
+	int		m_nLightCutSize;
+
 	// container for light sources
-	list<VirtualLightSource>*	m_pVirtualLightSources;
+	vector<VPL_Set>	m_virtualLightSources;
 
 	// register property
 	void _registerAllProperty();
@@ -88,6 +124,31 @@ private:
 	// private method of li
 	Spectrum _li( const Ray& ray , bool ignoreLe = false , float* first_intersect_dist = 0 ) const;
 
+	// build the light cut tree of a set of virtual light sources
+	// para 'set'    : the set of virtual light sources
+	// para 'ids'    : the virtual light sources in the tree , they are reordered during construction
+	// para '_start' : the start offset of the virtual light sources in the cluster
+	// para '_end'   : the end offset of the virtual light sources in the cluster
+	// para 'node'   : the cluster to be built
+	void _buildCluster( VPL_Set& set , vector<unsigned>& ids , unsigned _start , unsigned _end , unsigned node ) const;
+
+	// evaluate the contribution of a virtual light source with unit power
+	// para 'ip'    : the shading point
+	// para 'bsdf'  : the bsdf at the shading point
+	// para 'wo'    : the direction from the shading point to the viewer
+	// para 'vpl'   : the virtual light source
+	// result       : the contribution , it is scaled by the power of the cluster the light source stands for
+	Spectrum _evaluateVPL( const Intersection& ip , const Bsdf* bsdf , const Vector& wo , const VirtualLightSource& vpl ) const;
+
+	// evaluate a light cut of a set of virtual light sources
+	// para 'ip'    : the shading point
+	// para 'bsdf'  : the bsdf at the shading point
+	// para 'wo'    : the direction from the shading point to the viewer
+	// para 'set'   : the set of virtual light sources
+	// para 'depth' : the depth of the shading point
+	// result       : the indirect illumination at the shading point
+	Spectrum _evaluateLightCut( const Intersection& ip , const Bsdf* bsdf , const Vector& wo , const VPL_Set& set , int depth ) const;
+
 	class LightPathNumProperty : public PropertyHandler<Integrator>
 	{
 	public:
@@ -124,4 +185,26 @@ private:
 				ir->m_nLightPathSet = (int)atof( str.c_str() );
 		}
 	};
+	class LightCutErrorProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(LightCutErrorProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			InstantRadiosity* ir = CAST_TARGET(InstantRadiosity);
+			if( ir )
+				ir->m_fLightCutError = max( 0.0f , (float)atof( str.c_str() ) );
+		}
+	};
+	class LightCutSizeProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(LightCutSizeProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			InstantRadiosity* ir = CAST_TARGET(InstantRadiosity);
+			if( ir )
+				ir->m_nLightCutSize = max( 1 , atoi( str.c_str() ) );
+		}
+	};
 };
@@ -0,0 +1,216 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header file
+#include "irradiancecaching.h"
+#include "integratormethod.h"
+#include "geometry/intersection.h"
+#include "geometry/scene.h"
+#include "light/light.h"
+#include "bsdf/bsdf.h"
+#include "camera/camera.h"
+#include "imagesensor/imagesensor.h"
+#include "utility/samplemethod.h"
+#include "utility/multithread/threadpool.h"
+#include "managers/memmanager.h"
+#include "log/log.h"
+
+IMPLEMENT_CREATOR( IrradianceCaching );
+
+// Preprocess
+void IrradianceCaching::PreProcess()
+{
+	// the radius of records is clamped , so that records are neither too dense in corners nor too sparse in open space
+	const BBox& bbox = scene.GetBBox();
+	const float diagonal = ( bbox.m_Max - bbox.m_Min ).Length();
+	m_minRadius = 0.01f * diagonal;
+	m_maxRadius = 0.5f * diagonal;
+	m_cache.Build( bbox , m_error );
+
+	if( camera == nullptr )
+		return;
+
+	// camera rays at a grid of pixels are traced in parallel , records are created where none is valid
+	const ImageSensor* sensor = camera->GetImageSensor();
+	const unsigned cols = ( sensor->GetWidth() + m_pixelSpacing - 1 ) / m_pixelSpacing;
+	const unsigned rows = ( sensor->GetHeight() + m_pixelSpacing - 1 ) / m_pixelSpacing;
+	ParallelFor( 0 , cols * rows , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		PixelSample ps;
+		ps.img_u = ps.img_v = 0.5f;
+		ps.dof_u = ps.dof_v = 0.0f;
+		for( unsigned i = _start ; i < _end ; ++i )
+		{
+			// bsdfs of the gather paths are only needed while the record is computed
+			MemScope mem_scope;
+			sort_reseed( i , SORT_RAND_PARALLEL , 0 );
+
+			const float x = (float)( ( i % cols ) * m_pixelSpacing );
+			const float y = (float)( ( i / cols ) * m_pixelSpacing );
+			const Ray ray = camera->GenerateRay( x , y , ps );
+			Intersection ip;
+			if( false == scene.GetIntersect( ray , &ip ) )
+				continue;
+
+			const Vector n = ( Dot( ray.m_Dir , ip.normal ) > 0.0f ) ? -ip.normal : ip.normal;
+			Spectrum e;
+			if( !m_cache.Interpolate( ip.intersect , n , e ) )
+				_createRecord( ip , n );
+		}
+	});
+
+	slog( DEBUG , INTEGRATOR , stringFormat( "Irradiance caching generates %d records in pre-processing, the octree holds %d nodes." , m_cache.GetRecordCount() , m_cache.GetNodeCount() ) );
+}
+
+// radiance along a specific ray direction
+Spectrum IrradianceCaching::Li( const Ray& r , const PixelSample& ps ) const
+{
+	if( r.m_Depth > max_recursive_depth )
+		return 0.0f;
+
+	// get the intersection between the ray and the scene
+	Intersection ip;
+	if( false == scene.GetIntersect( r , &ip ) )
+		return scene.Le( r );
+
+	Spectrum li = ip.Le( -r.m_Dir );
+
+	// evaluate direct light
+	unsigned light_num = scene.LightNum();
+	for( unsigned i = 0 ; i < light_num ; ++i )
+	{
+		const Light* light = scene.GetLight(i);
+		li += EvaluateDirect( r , scene , light , ip , LightSample(true) , BsdfSample(true) , BXDF_TYPE( BXDF_ALL ) );
+	}
+
+	// indirect illumination is the bsdf toward the normal scaled by the interpolated irradiance
+	const Vector n = ( Dot( r.m_Dir , ip.normal ) > 0.0f ) ? -ip.normal : ip.normal;
+	const Bsdf* bsdf = ip.primitive->GetMaterial()->GetBsdf( &ip );
+	const Spectrum f = bsdf->f( -r.m_Dir , n );
+	if( !f.IsBlack() )
+		li += f * _irradiance( ip , n );
+
+	return li;
+}
+
+// get the indirect irradiance at an intersection
+Spectrum IrradianceCaching::_irradiance( const Intersection& ip , const Vector& n ) const
+{
+	Spectrum e;
+	if( m_cache.Interpolate( ip.intersect , n , e ) )
+		return e;
+	return _createRecord( ip , n )->e;
+}
+
+// compute the record of indirect irradiance at an intersection
+const Irradiance_Record* IrradianceCaching::_createRecord( const Intersection& ip , const Vector& n ) const
+{
+	Vector t , s;
+	CoordinateSystem( n , t , s );
+
+	// the hemisphere is stratified , directions are distributed by the cosine
+	const unsigned strata = max( 1u , (unsigned)sqrt( (float)m_gatherSamples ) );
+	Spectrum sum;
+	float inv_distance = 0.0f;
+	for( unsigned i = 0 ; i < strata ; ++i )
+	{
+		for( unsigned j = 0 ; j < strata ; ++j )
+		{
+			// bsdfs of the gather path are released once it is traced
+			MemScope mem_scope;
+
+			const Vector d = CosSampleHemisphere( ( i + sort_canonical() ) / strata , ( j + sort_canonical() ) / strata );
+			const Vector wi = t * d.x + n * d.y + s * d.z;
+
+			float distance;
+			sum += _gather( ip.SpawnRay( wi ) , distance );
+			inv_distance += 1.0f / distance;
+		}
+	}
+
+	const unsigned count = strata * strata;
+	Irradiance_Record* record = new Irradiance_Record();
+	record->p = ip.intersect;
+	record->n = n;
+	record->e = sum * ( PI / count );
+	record->radius = ( inv_distance > 0.0f ) ? min( m_maxRadius , max( m_minRadius , count / inv_distance ) ) : m_maxRadius;
+	m_cache.Insert( record );
+	return record;
+}
+
+// radiance reflected toward a ray by path tracing
+Spectrum IrradianceCaching::_gather( const Ray& ray , float& distance ) const
+{
+	Spectrum	L = 0.0f;
+	Spectrum	throughput = 1.0f;
+	distance = FLT_MAX;
+
+	Ray r = ray;
+	for( int bounces = 0 ; bounces < max_recursive_depth ; ++bounces )
+	{
+		Intersection inter;
+		if( false == scene.GetIntersect( r , &inter ) )
+			break;
+		if( bounces == 0 )
+			distance = inter.t;
+
+		// evaluate the light
+		Bsdf*			bsdf = inter.primitive->GetMaterial()->GetBsdf(&inter);
+		float			light_pdf = 0.0f;
+		const Light*	light = scene.SampleLight( sort_canonical() , inter , &light_pdf );
+		if( light_pdf > 0.0f )
+			L += throughput * EvaluateDirect( r , scene , light , inter , LightSample(true) , BsdfSample(true) , BXDF_TYPE(BXDF_ALL) ) / light_pdf;
+
+		// sample the next direction using bsdf
+		float		path_pdf;
+		Vector		wi;
+		Spectrum f = bsdf->sample_f( -r.m_Dir , wi , BsdfSample(true) , &path_pdf , BXDF_ALL );
+		if( f.IsBlack() || path_pdf == 0.0f )
+			break;
+
+		// update path weight
+		throughput *= f * AbsDot( wi , inter.normal ) / path_pdf;
+		if( throughput.GetIntensity() == 0.0f )
+			break;
+
+		if( bounces > 2 && throughput.GetMaxComponent() < 0.1f )
+		{
+			float continueProperbility = max( 0.05f , 1.0f - throughput.GetMaxComponent() );
+			if( sort_canonical() < continueProperbility )
+				break;
+			throughput /= 1 - continueProperbility;
+		}
+
+		r = inter.SpawnRay( wi );
+	}
+
+	return L;
+}
+
+// output log information
+void IrradianceCaching::OutputLog() const
+{
+	slog( INFO , INTEGRATOR , "Integrator algorithm : Irradiance Caching." );
+	slog( DEBUG , INTEGRATOR , stringFormat( "Irradiance cache holds %d records in %d nodes." , m_cache.GetRecordCount() , m_cache.GetNodeCount() ) );
+}
+
+// register property
+void IrradianceCaching::_registerAllProperty()
+{
+	_registerProperty( "ic_error" , new ErrorProperty(this) );
+	_registerProperty( "ic_samples" , new GatherSamplesProperty(this) );
+	_registerProperty( "ic_spacing" , new PixelSpacingProperty(this) );
+}
@@ -0,0 +1,131 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+// include the header file
+#include "integrator.h"
+#include "accel/irradiancecache.h"
+
+class	Intersection;
+
+/////////////////////////////////////////////////////////////////////////////
+// definition of Irradiance Caching
+// note : Irradiance Caching is a fast approximation of diffuse interreflection.
+//        Indirect irradiance is only computed at sparse records by gathering
+//        the radiance of rays in the hemisphere with path tracing , it is
+//        interpolated from the records around a shading point instead.
+//        Records are generated in a parallel pre-processing pass at a grid of
+//        pixels , the final gather creates more records where none is valid.
+//        Direct illumination is handled the same way in direct light
+//        integrator. Every bsdf is treated as a diffuse one for indirect
+//        illumination , it is evaluated toward the normal and scaled by the
+//        irradiance , so glossy reflection of indirect light is not captured.
+//        Please refer to "A Ray Tracing Solution for Diffuse Interreflection"
+//        by Ward et al. for further details.
+class	IrradianceCaching : public Integrator
+{
+// public method
+public:
+	DEFINE_CREATOR( IrradianceCaching , Integrator , "ic" );
+
+	// default constructor
+	IrradianceCaching() { _registerAllProperty(); }
+
+	// return the radiance of a specific direction
+	// para 'scene' : scene containing geometry data
+	// para 'ray'   : ray with specific direction
+	// result       : radiance along the ray from the scene
+	virtual Spectrum	Li( const Ray& ray , const PixelSample& ps ) const;
+
+	// Preprocess: records of irradiance are generated at a grid of pixels
+	virtual void PreProcess();
+
+	// output log information
+	virtual void OutputLog() const;
+
+// private field
+private:
+	// the largest error of reusing a record
+	float			m_error = 0.2f;
+	// the number of rays gathering the irradiance of a record
+	unsigned		m_gatherSamples = 256;
+	// the distance in pixels between the camera rays generating records in pre-processing
+	unsigned		m_pixelSpacing = 8;
+
+	// the range of the radius of records , it is relative to the size of the scene
+	float			m_minRadius = 0.0f;
+	float			m_maxRadius = FLT_MAX;
+
+	// the cache of irradiance records
+	IrradianceCache	m_cache;
+
+	// register property
+	void _registerAllProperty();
+
+	// get the indirect irradiance at an intersection , a record is created if none is valid
+	// para 'ip' : the intersection
+	// para 'n'  : the normal facing the viewer
+	// result    : the indirect irradiance
+	Spectrum _irradiance( const Intersection& ip , const Vector& n ) const;
+
+	// compute the record of indirect irradiance at an intersection
+	// para 'ip' : the intersection
+	// para 'n'  : the normal facing the viewer
+	// result    : the record , it is inserted in the cache
+	const Irradiance_Record* _createRecord( const Intersection& ip , const Vector& n ) const;
+
+	// radiance reflected toward a ray by path tracing , emission of the first surface is ignored
+	// para 'ray'      : the gather ray
+	// para 'distance' : the distance to the first surface along the ray , it is infinite if there is none
+	// result          : the radiance along the ray without emission
+	Spectrum _gather( const Ray& ray , float& distance ) const;
+
+	class ErrorProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(ErrorProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			IrradianceCaching* ic = CAST_TARGET(IrradianceCaching);
+			if( ic )
+				ic->m_error = max( 0.01f , (float)atof( str.c_str() ) );
+		}
+	};
+	class GatherSamplesProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(GatherSamplesProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			IrradianceCaching* ic = CAST_TARGET(IrradianceCaching);
+			if( ic )
+				ic->m_gatherSamples = (unsigned)max( 1 , atoi( str.c_str() ) );
+		}
+	};
+	class PixelSpacingProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(PixelSpacingProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			IrradianceCaching* ic = CAST_TARGET(IrradianceCaching);
+			if( ic )
+				ic->m_pixelSpacing = (unsigned)max( 1 , atoi( str.c_str() ) );
+		}
+	};
+};
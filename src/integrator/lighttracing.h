@@ -20,9 +20,11 @@
 #include "bidirpath.h"
 
 ///////////////////////////////////////////////////////////////////////////////////
-// definition of bidirectional path tracing
-// BDPT is not finished yet, there are bugs in the following code.
-// i'll try to finish it after i finish some more integrators.
+// definition of light tracing
+// note : light paths are traced before every pass and split across the threads
+//		  regardless of the tiles of the camera , their vertices are splatted to
+//		  the blocks of pixels of each thread , which are added to the image after
+//		  the pass. Camera tiles only evaluate the lights seen directly.
 class LightTracing : public BidirPathTracing
 {
 // public method
@@ -31,9 +33,25 @@ public:
 
     LightTracing(){
 		light_tracing_only = true;
+		_registerProperty( "lt_paths" , new PathsProperty(this) );
 	}
 
 	// refresh tile in blender
 	// no need to refresh tiles
 	virtual bool NeedRefreshTile() const { return false; }
+
+// private field
+private:
+	// Light paths per pass Property
+	class PathsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(PathsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			LightTracing* lt = CAST_TARGET(LightTracing);
+			if( lt )
+				lt->m_ltPathCnt = max( 0 , atoi( str.c_str() ) );
+		}
+	};
 };
@@ -20,35 +20,190 @@
 #include "bsdf/bsdf.h"
 #include "geometry/scene.h"
 #include "integratormethod.h"
-#include "camera/camera.h"
+#include "camera/camera.h"
+#include "imagesensor/imagesensor.h"
 #include "log/log.h"
+#include "medium/medium.h"
+#include "light/light.h"
+#include "material/material.h"
+#include "utility/samplemethod.h"
+#include "utility/multithread/threadpool.h"
+#include "managers/memmanager.h"
 
 IMPLEMENT_CREATOR( PathTracing );
 
+// the maximum number of vertices of a path recorded in the guiding tree
+static const unsigned GUIDE_MAX_VERTICES = 64;
+
+// the ratio between the upper and the lower bound of the weight window of splitting and russian roulette
+static const float ADRRS_WINDOW_SIZE = 5.0f;
+// the maximum number of branches a path is split into at one vertex
+static const unsigned ADRRS_MAX_SPLIT = 8;
+// the smallest brightness estimate of a pixel relative to the image
+static const float ADRRS_MIN_PIXEL = 0.05f;
+
+// vertex of a path whose incident radiance is recorded in the guiding tree
+struct Guide_Vertex
+{
+	unsigned	leaf;			// the spatial leaf of the vertex
+	Vector		wi;				// the sampled direction
+	float		throughput;		// the intensity of the throughput after the vertex
+	float		pdf;			// the pdf of the sampled direction
+	float		radiance;		// the intensity of the radiance contributed by the rest of the path
+};
+
+// paths carrying rgb values
+struct RGB_Path
+{
+	typedef Spectrum Type;
+
+	// the spectrum of an rgb value of lights and bsdfs
+	Spectrum Lift( const Spectrum& s ) const { return s; }
+	// the rgb value of a spectrum of the path
+	Spectrum ToRGB( const Spectrum& s ) const { return s; }
+	// the brightness of a spectrum of the path
+	float Intensity( const Spectrum& s ) const { return s.GetIntensity(); }
+	// direct lighting at a vertex
+	Spectrum Direct( const Ray& r , const Scene& scene , const Light* light , const Intersection& ip , const LightSample& ls , const BsdfSample& bs , const Medium* medium , float cull , const Primary_Hit* primary ) const {
+		return EvaluateDirect( r , scene , light , ip , ls , bs , BXDF_TYPE(BXDF_ALL) , medium , cull , primary );
+	}
+};
+
+// paths carrying a set of wavelengths
+template<int N>
+struct Spectral_Path
+{
+	typedef SampledSpectrum<N> Type;
+
+	SampledWavelengths<N>	wl;		// the wavelengths of the path
+
+	explicit Spectral_Path( float u ) : wl( SampledWavelengths<N>::SampleHero( u ) ) {}
+
+	Type Lift( const Spectrum& s ) const { return UpsampleRGB( s , wl ); }
+	Spectrum ToRGB( const Type& s ) const { return ::ToRGB( s , wl ); }
+	float Intensity( const Type& s ) const { return ToRGB( s ).GetIntensity(); }
+	Type Direct( const Ray& r , const Scene& scene , const Light* light , const Intersection& ip , const LightSample& ls , const BsdfSample& bs , const Medium* medium , float cull , const Primary_Hit* primary ) const {
+		return EvaluateDirect( r , scene , light , ip , ls , bs , wl , BXDF_TYPE(BXDF_ALL) , medium , cull , primary );
+	}
+};
+
 // return the radiance of a specific direction
+Spectrum PathTracing::Li( const Ray& ray , const PixelSample& ps ) const
+{
+	// paths are split or terminated relative to the brightness of their pixel in the previous passes
+	float pixel = 0.0f;
+	if( m_adrrs && ps.pixel_x < m_estimateWidth && ps.pixel_y < m_estimateHeight )
+		pixel = m_pixelEstimates[ps.pixel_y * m_estimateWidth + ps.pixel_x];
+
+	Spectrum L;
+	if( m_spectral == 8 )
+	{
+		const Spectral_Path<8> path( sort_canonical() );
+		L = path.ToRGB( _li( path , ray , ps , 1.0f , 0 , pixel , scene.GetAmbientMedium() ) );
+	}
+	else if( m_spectral == 4 )
+	{
+		const Spectral_Path<4> path( sort_canonical() );
+		L = path.ToRGB( _li( path , ray , ps , 1.0f , 0 , pixel , scene.GetAmbientMedium() ) );
+	}
+	else
+		L = _li( RGB_Path() , ray , ps , 1.0f , 0 , pixel , scene.GetAmbientMedium() );
+
+	// everything not arriving directly is indirect radiance
+	if( ps.aov )
+		ps.aov[AOV_INDIRECT] = L - ps.aov[AOV_DIRECT];
+	return L;
+}
+
+// trace a path from a ray
 // note : there are one factor makes the method biased.
 //		there is a limitation on the number of vertexes in the path
-Spectrum PathTracing::Li( const Ray& ray , const PixelSample& ps ) const
+template<class P>
+typename P::Type PathTracing::_li( const P& path , const Ray& ray , const PixelSample& ps , typename P::Type throughput , int bounces , float pixel , const Medium* medium , bool branch ) const
 {
-	Spectrum	L = 0.0f;
-	Spectrum	throughput = 1.0f;
+	typedef typename P::Type	PathSpectrum;
+	PathSpectrum	L = 0.0f;
+
+	// incident radiance is only recorded while the tree is trained
+	Guide_Vertex	guide_vertices[GUIDE_MAX_VERTICES];
+	unsigned		guide_vertex_cnt = 0;
+	const bool		recording = m_guiding && m_recording;
+
+	// the first hit of the camera ray could be found by the raster pass already , the primary cache could keep the shadow rays from it too
+	const Primary_Hit* primary = ( bounces == 0 && !branch ) ? ps.primary : nullptr;
+	const Primary_Hit* shadows = primary;
 
-	int			bounces = 0;
 	Ray	r = ray;
 	while(true)
 	{
 		Intersection inter;
+		const bool hit = primary ? scene.GetPrimaryIntersect( r , *primary , &inter ) : scene.GetIntersect( r , &inter );
+		primary = nullptr;
+
+		// the ray could scatter in the medium before it reaches the surface , the next direction is sampled from the phase function
+		if( medium )
+		{
+			float t;
+			bool scattered;
+			throughput *= path.Lift( medium->Sample( r , hit ? inter.t : FLT_MAX , t , scattered ) );
+			if( path.Intensity( throughput ) == 0.0f )
+				break;
+			if( scattered )
+			{
+				const LightSample light_sample = branch ? LightSample(true) : ps.GetLightSample( bounces );
+				const BsdfSample phase_sample = branch ? BsdfSample(true) : ps.GetBsdfSample( 2 * bounces + 1 );
+				const Point p = r( t );
+				const PathSpectrum direct = throughput * _mediumDirect( path , r , p , medium , light_sample );
+				L += direct;
+				if( recording )
+				{
+					const float intensity = path.Intensity( direct );
+					for( unsigned i = 0 ; i < guide_vertex_cnt ; ++i )
+						guide_vertices[i].radiance += intensity;
+				}
+
+				float phase_pdf;
+				const Vector wi = medium->SamplePhase( -r.m_Dir , phase_sample.u , phase_sample.v , &phase_pdf );
+				const float time = r.m_Time;
+				r = Ray( p , wi );
+				r.m_Time = time;
+
+				if( ++bounces >= max_recursive_depth )
+					break;
+				continue;
+			}
+		}
 
 		// get the intersection between the ray and the scene
 		// if it's a light , accumulate the radiance and break
-		if( false == scene.GetIntersect( r , &inter ) )
+		if( false == hit )
 		{
-			if( bounces == 0 )
-				return scene.Le( r );
+			if( bounces == 0 ){
+				L = throughput * path.Lift( scene.Le( r ) );
+				if( ps.aov )
+					ps.aov[AOV_DIRECT] = path.ToRGB( L );
+				return L;
+			}
 			break;
 		}
 
-		if( bounces == 0 ) L+=inter.Le(-r.m_Dir);
+		// surfaces only bounding media are passed through , they are no vertices of the path
+		const MediumInterface* media = inter.primitive->GetMediumInterface();
+		if( media && media->boundary )
+		{
+			medium = media->GetMedium( r.m_Dir , inter.gnormal );
+			SpawnRay( r , inter , r.m_Dir , r );
+			shadows = nullptr;
+			continue;
+		}
+
+		if( bounces == 0 ) L+=throughput * path.Lift( inter.Le(-r.m_Dir) );
+
+		// the first hit of the camera ray fills the output variables
+		if( bounces == 0 && ps.aov ){
+			ps.aov[AOV_NORMAL] = Spectrum( inter.normal.x , inter.normal.y , inter.normal.z );
+			ps.aov[AOV_DEPTH] = inter.t;
+		}
 
 		// make sure there is intersected primitive
 		sAssert( inter.primitive != 0 , INTEGRATOR );
@@ -56,40 +211,144 @@ Spectrum PathTracing::Li( const Ray& ray , const PixelSample& ps ) const
 		// evaluate the light
 		Bsdf*			bsdf = inter.primitive->GetMaterial()->GetBsdf(&inter);
 		float			light_pdf = 0.0f;
-		LightSample		light_sample = (bounces==0)?ps.light_sample[0]:LightSample(true);
-		BsdfSample		bsdf_sample = (bounces==0)?ps.bsdf_sample[0]:BsdfSample(true);
-		const Light*	light = scene.SampleLight( light_sample.t , &light_pdf );
+		LightSample		light_sample = branch ? LightSample(true) : ps.GetLightSample( bounces );
+		BsdfSample		bsdf_sample = branch ? BsdfSample(true) : ps.GetBsdfSample( 2 * bounces );
+		const Light*	light = scene.SampleLight( light_sample.t , inter , &light_pdf );
 		if( light_pdf > 0.0f )
-			L += throughput * EvaluateDirect(	r  , scene , light , inter , light_sample ,
-												bsdf_sample , BXDF_TYPE(BXDF_ALL) ) / light_pdf;
+		{
+			// shadow rays of samples that are dim compared with the radiance of the path so far are culled by russian roulette
+			float cull = 0.0f;
+			if( m_shadowRoulette > 0.0f && bounces > 0 )
+			{
+				const float intensity = path.Intensity( throughput );
+				if( intensity > 0.0f )
+					cull = m_shadowRoulette * path.Intensity( L ) * light_pdf / intensity;
+			}
+
+			const PathSpectrum direct = throughput * path.Direct( r , scene , light , inter , light_sample , bsdf_sample , medium , cull , shadows ) / light_pdf;
+			L += direct;
+
+			// the radiance arrives at the previous vertices along the path
+			if( recording )
+			{
+				const float intensity = path.Intensity( direct );
+				for( unsigned i = 0 ; i < guide_vertex_cnt ; ++i )
+					guide_vertices[i].radiance += intensity;
+			}
+		}
+
+		// light scattered beneath the surface of translucent materials leaves it at the hit , the bxdfs are the coat over it
+		const Material* material = inter.primitive->GetMaterial();
+		const SubsurfaceProfile* profile = material->GetSubsurface();
+		if( profile && material->GetID() < m_subsurface.size() && m_subsurface[material->GetID()] )
+		{
+			const Spectrum mo = m_subsurface[material->GetID()]->Exitance( inter.intersect , *profile , m_sssError );
+			const PathSpectrum lo = throughput * path.Lift( profile->Lo( mo , Dot( -r.m_Dir , inter.normal ) ) );
+			L += lo;
+			if( recording )
+			{
+				const float intensity = path.Intensity( lo );
+				for( unsigned i = 0 ; i < guide_vertex_cnt ; ++i )
+					guide_vertices[i].radiance += intensity;
+			}
+		}
+
+		shadows = nullptr;
+
+		// the radiance so far is emitted by the first hit or reflected once
+		if( bounces == 0 && ps.aov )
+			ps.aov[AOV_DIRECT] = path.ToRGB( L );
+
+		// the path is split or terminated by its expected contribution to the pixel , the radiance leaving any
+		// vertex is estimated by the average brightness of the image
+		unsigned	split = 1;
+		if( pixel > 0.0f )
+		{
+			const float ratio = path.Intensity( throughput ) * m_radianceEstimate / pixel;
+			const float lower = 2.0f / ( 1.0f + ADRRS_WINDOW_SIZE );
+			const float upper = lower * ADRRS_WINDOW_SIZE;
+			if( ratio < lower )
+			{
+				const float survive = ratio / lower;
+				if( sort_canonical() >= survive )
+					break;
+				throughput /= survive;
+			}
+			else if( ratio > upper && bounces + 1 < max_recursive_depth )
+			{
+				split = min( ADRRS_MAX_SPLIT , (unsigned)ceil( ratio / upper ) );
+				throughput /= (float)split;
+			}
+		}
 
 		// sample the next direction using bsdf
 		float		path_pdf;
 		Vector		wi;
-		BXDF_TYPE	bxdf_type;
-		Spectrum f;
-		BsdfSample	_bsdf_sample = (bounces==0)?ps.bsdf_sample[1]:BsdfSample(true);
-		f = bsdf->sample_f( -r.m_Dir , wi , _bsdf_sample , &path_pdf , BXDF_ALL , &bxdf_type );
+		const Vector wo = -r.m_Dir;
+		BsdfSample	_bsdf_sample = branch ? BsdfSample(true) : ps.GetBsdfSample( 2 * bounces + 1 );
+		const unsigned leaf = m_guiding ? m_sdTree.Lookup( inter.intersect ) : 0;
+
+		// the other branches of a split path are traced separately
+		if( split > 1 )
+		{
+			for( unsigned i = 1 ; i < split ; ++i )
+			{
+				unsigned branch_type = RAY_NONE;
+				const Spectrum f = _sampleDirection( bsdf , wo , BsdfSample(true) , leaf , wi , path_pdf , branch_type );
+				if( f.IsBlack() || path_pdf == 0.0f )
+					continue;
+				Ray branch_ray = inter.SpawnRay( wi );
+				branch_ray.m_Type = branch_type;
+				const Medium* branch_medium = media ? media->GetMedium( wi , inter.gnormal ) : medium;
+				const PathSpectrum branch = _li( path , branch_ray , ps , throughput * path.Lift( f ) * AbsDot( wi , inter.normal ) / path_pdf , bounces + 1 , pixel , branch_medium , true );
+				L += branch;
+				if( recording )
+				{
+					const float intensity = path.Intensity( branch );
+					for( unsigned j = 0 ; j < guide_vertex_cnt ; ++j )
+						guide_vertices[j].radiance += intensity;
+				}
+			}
+		}
+
+		unsigned ray_type = RAY_NONE;
+		const Spectrum f = _sampleDirection( bsdf , wo , _bsdf_sample , leaf , wi , path_pdf , ray_type );
+
+		// the sampled direction of the first hit is an unbiased estimate of the albedo
+		if( bounces == 0 && ps.aov && !f.IsBlack() && path_pdf > 0.0f )
+			ps.aov[AOV_ALBEDO] = f * AbsDot( wi , inter.normal ) / path_pdf;
+
 		if( f.IsBlack() || path_pdf == 0.0f )
 			break;
 
 		// update path weight
-		throughput *= f * AbsDot( wi , inter.normal ) / path_pdf;
+		throughput *= path.Lift( f ) * AbsDot( wi , inter.normal ) / path_pdf;
 
-		if( throughput.GetIntensity() == 0.0f )
-			break;
+		if( path.Intensity( throughput ) == 0.0f )
+			break;
+
+		if( recording && guide_vertex_cnt < GUIDE_MAX_VERTICES )
+		{
+			Guide_Vertex& vertex = guide_vertices[guide_vertex_cnt++];
+			vertex.leaf = leaf;
+			vertex.wi = wi;
+			vertex.throughput = path.Intensity( throughput );
+			vertex.pdf = path_pdf;
+			vertex.radiance = 0.0f;
+		}
         
-		if( bounces > 3 && throughput.GetMaxComponent() < 0.1f )
+		if( pixel == 0.0f && bounces > 3 && throughput.GetMaxComponent() < 0.1f )
 		{
 			float continueProperbility = max( 0.05f , 1.0f - throughput.GetMaxComponent() );
 			if( sort_canonical() < continueProperbility )
 				break;
 			throughput /= 1 - continueProperbility;
-		}
+		}
         
-		r.m_Ori = inter.intersect;
-		r.m_Dir = wi;
-		r.m_fMin = 0.0001f;
+		SpawnRay( r , inter , wi , r );
+		r.m_Type = ray_type;
+		if( media )
+			medium = media->GetMedium( wi , inter.gnormal );
 
 		++bounces;
 
@@ -99,74 +358,290 @@ Spectrum PathTracing::Li( const Ray& ray , const PixelSample& ps ) const
 			break;
 	}
 
+	// the estimate of the radiance arriving at a vertex is the contribution after it divided by the throughput
+	for( unsigned i = 0 ; i < guide_vertex_cnt ; ++i )
+	{
+		const Guide_Vertex& vertex = guide_vertices[i];
+		m_sdTree.Record( vertex.leaf , vertex.wi , vertex.radiance / ( vertex.throughput * vertex.pdf ) );
+	}
+
 	return L;
 }
 
-// request samples
-void PathTracing::RequestSample( Sampler* sampler , PixelSample* ps , unsigned ps_num )
+// direct lighting at a scattering event in a medium
+template<class P>
+typename P::Type PathTracing::_mediumDirect( const P& path , const Ray& r , const Point& p , const Medium* medium , const LightSample& ls ) const
 {
-	for( unsigned i = 0 ; i < ps_num ; i++ )
+	// the light tree weights lights by the normal of surfaces , lights are picked by their power in media
+	float pick_pdf;
+	const Light* light = scene.SampleLight( ls.t , &pick_pdf );
+	if( light == 0 || pick_pdf <= 0.0f )
+		return 0.0f;
+
+	// the scattering event takes no space , the shadow ray starts right at it
+	Intersection ip;
+	ip.intersect = p;
+	ip.time = r.m_Time;
+	if( !light->Illuminates( ip ) )
+		return 0.0f;
+
+	Visibility visibility( scene );
+	Vector wi;
+	float pdf;
+	const Spectrum li = light->sample_l( ip , &ls , wi , 0 , &pdf , 0 , 0 , visibility );
+	if( pdf <= 0.0f || li.IsBlack() )
+		return 0.0f;
+	const Spectrum tr = scene.Transmittance( visibility.ray , medium );
+	if( tr.IsBlack() )
+		return 0.0f;
+	return path.Lift( li * tr * ( medium->Phase( -r.m_Dir , wi ) / ( pdf * pick_pdf ) ) );
+}
+
+// sample the next direction of a path
+Spectrum PathTracing::_sampleDirection( const Bsdf* bsdf , const Vector& wo , const BsdfSample& bs , unsigned leaf , Vector& wi , float& pdf , unsigned& type ) const
+{
+	// the ray is a diffuse one if a diffuse lobe is picked , specular lobes count as glossy ones
+	BXDF_TYPE lobe = BXDF_NONE;
+	auto rayType = [&](){ return ( lobe & BXDF_DIFFUSE ) ? RAY_DIFFUSE : RAY_GLOSSY; };
+
+	if( !m_guiding || !m_sdTree.IsTrained( leaf ) )
 	{
-		// the first half samples are used to sample bsdf for shading
-		// the second half samples are used to sample bsdf for direction
-		ps[i].bsdf_sample = new BsdfSample[ 2 ];
-		ps[i].light_sample = new LightSample[ 1 ];
+		const Spectrum f = bsdf->sample_f( wo , wi , bs , &pdf , BXDF_ALL , &lobe );
+		type = rayType();
+		return f;
 	}
 
-	ps[0].data = new float[ ps_num * 3 ];
+	// the direction is sampled from the mixture of the bsdf and the learnt distribution , the learnt one spreads like a diffuse lobe
+	if( sort_canonical() < m_bsdfFraction )
+	{
+		if( bsdf->sample_f( wo , wi , bs , &pdf , BXDF_ALL , &lobe ).IsBlack() || pdf == 0.0f )
+			return 0.0f;
+		type = rayType();
+	}
+	else
+	{
+		wi = m_sdTree.Sample( leaf , bs.u , bs.v , 0 );
+		type = RAY_DIFFUSE;
+	}
+	pdf = m_bsdfFraction * bsdf->Pdf( wo , wi ) + ( 1.0f - m_bsdfFraction ) * m_sdTree.Pdf( leaf , wi );
+	return bsdf->f( wo , wi );
 }
 
-// generate samples
-void PathTracing::GenerateSample( const Sampler* sampler , PixelSample* samples , unsigned ps , const Scene& scene ) const
+// train the guiding tree and update the brightness estimates between passes
+void PathTracing::BeginPass( unsigned spp )
 {
-	Integrator::GenerateSample( sampler , samples , ps , scene );
+	if( m_adrrs )
+		_updateEstimates();
 
-	if( sampler->RoundSize( ps ) == ps )
+	if( !m_guiding )
+		return;
+
+	if( !m_sdTreeBuilt )
+	{
+		m_sdTree.Build( scene.GetBBox() );
+		m_sdTreeBuilt = true;
+		m_iteration = 0;
+		m_iterationSamples = 0;
+	}
+	else if( m_iteration < m_guidingIterations && m_iterationSamples >= ( 1u << min( m_iteration , 31u ) ) )
 	{
-		float* data_1d = samples[0].data;
-		float* data_2d = samples[0].data + ps;
+		// the iteration is finished , the spatial threshold grows with the square root of the samples of the iteration
+		m_sdTree.Refine( 12000.0f * sqrt( (float)m_iterationSamples ) );
+		++m_iteration;
+		m_iterationSamples = 0;
+		slog( DEBUG , INTEGRATOR , stringFormat( "Path guiding finishes iteration %d, the tree holds %d spatial leaves and %d directional nodes." , m_iteration , m_sdTree.GetLeafCount() , m_sdTree.GetDirectionalNodeCount() ) );
+	}
+	m_recording = ( m_iteration < m_guidingIterations );
+	m_iterationSamples += spp;
+}
+
+// update the brightness estimates of pixels from the passes so far
+void PathTracing::_updateEstimates()
+{
+	m_estimateWidth = 0;
+	m_estimateHeight = 0;
+	m_radianceEstimate = 0.0f;
+	const ImageSensor* sensor = ( camera != nullptr ) ? camera->GetImageSensor() : nullptr;
+	if( sensor == nullptr || sensor->GetPassCount() == 0 )
+		return;
 
-		sampler->Generate1D( data_1d , ps );
-		sampler->Generate2D( data_2d , ps );
-		for( unsigned k = 0 ; k < ps ; ++k )
+	const unsigned width = sensor->GetWidth();
+	const unsigned height = sensor->GetHeight();
+	m_pixelEstimates.resize( width * height );
+	double sum = 0.0;
+	for( unsigned i = 0 ; i < height ; ++i )
+		for( unsigned j = 0 ; j < width ; ++j )
 		{
-			int two_k = 2*k;
-			samples[k].bsdf_sample[0].t = data_1d[k];
-			samples[k].bsdf_sample[0].u = data_2d[two_k];
-			samples[k].bsdf_sample[0].v = data_2d[two_k+1];
+			const float lum = sensor->GetPixelLuminance( j , i );
+			m_pixelEstimates[i * width + j] = lum;
+			sum += lum;
 		}
+	m_radianceEstimate = (float)( sum / max( 1u , width * height ) );
+	if( m_radianceEstimate <= 0.0f )
+		return;
+
+	// dark pixels would split paths without limit , their estimates are clamped
+	for( auto& lum : m_pixelEstimates )
+		lum = max( lum , ADRRS_MIN_PIXEL * m_radianceEstimate );
+	m_estimateWidth = width;
+	m_estimateHeight = height;
+}
+
+// request the sample dimensions
+void PathTracing::PreProcess()
+{
+	RequestDimensions( max_recursive_depth , 2 * max_recursive_depth );
+	_buildSubsurface();
+}
+
+// spread points over the surfaces of translucent materials and compute their irradiance
+void PathTracing::_buildSubsurface()
+{
+	m_subsurface.clear();
+
+	// only triangles get points , the other shapes of translucent materials have no light scattered beneath them
+	std::vector<std::vector<const Primitive*>> triangles;
+	for( const Primitive* primitive : scene.GetPrimitives() )
+	{
+		const Material* material = primitive->GetMaterial();
+		Point p0 , p1 , p2;
+		if( material == nullptr || material->GetSubsurface() == nullptr || !primitive->GetTriangleVertices( p0 , p1 , p2 ) )
+			continue;
+		if( material->GetID() >= triangles.size() )
+			triangles.resize( material->GetID() + 1 );
+		triangles[material->GetID()].push_back( primitive );
+	}
+	m_subsurface.resize( triangles.size() );
 
-		sampler->Generate1D( data_1d , ps );
-		sampler->Generate2D( data_2d , ps );
-		for( unsigned k = 0 ; k < ps ; ++k )
+	for( unsigned id = 0 ; id < triangles.size() ; ++id )
+	{
+		if( triangles[id].empty() )
+			continue;
+		const Material* material = triangles[id][0]->GetMaterial();
+
+		float total = 0.0f;
+		for( const Primitive* triangle : triangles[id] )
 		{
-			int two_k = 2*k;
-			samples[k].bsdf_sample[1].t = data_1d[k];
-			samples[k].bsdf_sample[1].u = data_2d[two_k];
-			samples[k].bsdf_sample[1].v = data_2d[two_k+1];
+			Point p0 , p1 , p2;
+			triangle->GetTriangleVertices( p0 , p1 , p2 );
+			total += 0.5f * Cross( p1 - p0 , p2 - p0 ).Length();
 		}
+		if( total <= 0.0f )
+			continue;
 
-		sampler->Generate1D( data_1d , ps );
-		sampler->Generate2D( data_2d , ps );
-		for( unsigned k = 0 ; k < ps ; ++k )
+		// the points are spread by the area , the number of points of a triangle is rounded randomly and every
+		// point stands for the same area , so that the area of the surface is kept by the points on average
+		sort_reseed( id , SORT_RAND_SERIAL , 0 );
+		const float density = m_sssPoints / total;
+		std::vector<Subsurface_Point> points;
+		std::vector<const Primitive*> owners;
+		for( const Primitive* triangle : triangles[id] )
 		{
-			int two_k = 2*k;
-			samples[k].light_sample[0].t = data_1d[k];
-			samples[k].light_sample[0].u = data_2d[two_k];
-			samples[k].light_sample[0].v = data_2d[two_k+1];
+			Point p0 , p1 , p2;
+			triangle->GetTriangleVertices( p0 , p1 , p2 );
+			const Vector cross = Cross( p1 - p0 , p2 - p0 );
+			const float area = 0.5f * cross.Length();
+			if( area <= 0.0f )
+				continue;
+			const unsigned count = (unsigned)( area * density + sort_canonical() );
+			for( unsigned i = 0 ; i < count ; ++i )
+			{
+				const float su = sqrt( sort_canonical() );
+				const float v = sort_canonical() * su;
+				Subsurface_Point point;
+				point.p = p0 + ( p1 - p0 ) * ( su - v ) + ( p2 - p0 ) * v;
+				point.n = Normalize( cross );
+				point.area = 1.0f / density;
+				points.push_back( point );
+				owners.push_back( triangle );
+			}
 		}
-	}else
+
+		const SubsurfaceProfile& profile = *material->GetSubsurface();
+		ParallelFor( 0 , (unsigned)points.size() , 64 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+			for( unsigned i = _start ; i < _end ; ++i )
+			{
+				sort_reseed( i , SORT_RAND_PARALLEL , id );
+
+				Subsurface_Point& point = points[i];
+				Intersection ip;
+				ip.intersect = point.p;
+				ip.normal = ip.gnormal = point.n;
+				ip.error = PointError( point.p , 7 );
+				ip.primitive = const_cast<Primitive*>( owners[i] );
+				point.e = _subsurfaceIrradiance( ip , profile );
+			}
+		});
+
+		m_subsurface[id].reset( new SubsurfaceCache() );
+		m_subsurface[id]->Build( std::move( points ) );
+		slog( DEBUG , INTEGRATOR , stringFormat( "Material %s has %d irradiance points in %d nodes for subsurface scattering." ,
+			material->GetName().c_str() , m_subsurface[id]->GetPointCount() , m_subsurface[id]->GetNodeCount() ) );
+	}
+}
+
+// the irradiance entering the surface of a translucent material
+Spectrum PathTracing::_subsurfaceIrradiance( const Intersection& ip , const SubsurfaceProfile& profile ) const
+{
+	const Vector& n = ip.gnormal;
+	Vector t , s;
+	CoordinateSystem( n , t , s );
+
+	// every light is sampled once in each stratum , the gather rays only count the light reflected by the surfaces they hit
+	const unsigned strata = max( 1u , (unsigned)sqrt( (float)m_sssSamples ) );
+	const unsigned light_num = scene.LightNum();
+	Spectrum direct , indirect;
+	for( unsigned i = 0 ; i < strata ; ++i )
 	{
-		for (unsigned k = 0; k < ps; ++k) 
+		for( unsigned j = 0 ; j < strata ; ++j )
 		{
-			samples[k].bsdf_sample[0] = BsdfSample(true);
-			samples[k].bsdf_sample[1] = BsdfSample(true);
-			samples[k].light_sample[0] = LightSample(true);
+			// bsdfs of the gather ray are released once it is traced
+			MemScope mem_scope;
+
+			for( unsigned k = 0 ; k < light_num ; ++k )
+			{
+				const Light* light = scene.GetLight( k );
+				if( !light->Illuminates( ip ) )
+					continue;
+				Visibility visibility( scene );
+				const LightSample ls( true );
+				Vector wi;
+				float pdf;
+				const Spectrum li = light->sample_l( ip , &ls , wi , 0 , &pdf , 0 , 0 , visibility );
+				const float cos = Dot( wi , n );
+				if( pdf > 0.0f && cos > 0.0f && !li.IsBlack() && visibility.IsVisible() )
+					direct += li * ( cos * profile.Ft( cos ) / pdf );
+			}
+
+			const Vector d = CosSampleHemisphere( ( i + sort_canonical() ) / strata , ( j + sort_canonical() ) / strata );
+			const Vector wi = t * d.x + n * d.y + s * d.z;
+			const Ray ray = ip.SpawnRay( wi );
+			Intersection inter;
+			if( false == scene.GetIntersect( ray , &inter ) )
+				continue;
+			float light_pdf = 0.0f;
+			const Light* light = scene.SampleLight( sort_canonical() , inter , &light_pdf );
+			if( light_pdf > 0.0f )
+				indirect += EvaluateDirect( ray , scene , light , inter , LightSample(true) , BsdfSample(true) , BXDF_TYPE(BXDF_ALL) ) * ( profile.Ft( d.y ) / light_pdf );
 		}
 	}
+
+	const unsigned count = strata * strata;
+	return ( direct + indirect * PI ) / (float)count;
 }
 
 // output log information
-void PathTracing::OutputLog() const{
+void PathTracing::OutputLog() const{
     slog( INFO , INTEGRATOR , "Integrator algorithm : path tracing." );
+    if( m_spectral )
+        slog( INFO , INTEGRATOR , stringFormat( "Paths carry %d wavelengths sampled with hero wavelength sampling." , m_spectral ) );
+    for( const auto& cache : m_subsurface )
+        if( cache )
+            slog( INFO , INTEGRATOR , stringFormat( "Subsurface scattering is evaluated over %d irradiance points." , cache->GetPointCount() ) );
+}
+
+// whether camera rays missing the scene only see the environment
+bool PathTracing::IsBackgroundOnMiss() const
+{
+	return scene.GetAmbientMedium() == nullptr;
 }
@@ -18,31 +18,285 @@
 #pragma once
 
 #include "integrator.h"
+#include "accel/sdtree.h"
+#include "accel/subsurfacecache.h"
+#include <vector>
+#include <memory>
+
+class	Bsdf;
+class	Medium;
+class	Intersection;
+class	SubsurfaceProfile;
 
 //////////////////////////////////////////////////////////////////////////////////////
 //	definition of direct light
+//	note : with path guiding enabled , the incident radiance at path vertices is learnt
+//		   in a spatial-directional tree and the next direction is sampled from a mixture
+//		   of the bsdf and the learnt distribution. Training is interleaved with the passes
+//		   of progressive rendering , the iteration 'i' takes 2^i samples per pixel , so
+//		   guiding only helps with progressive rendering of few samples per pass.
+//	note : with adjoint-driven russian roulette and splitting enabled , paths are terminated
+//		   or split at every vertex so that their expected contribution stays around the
+//		   brightness of their pixel in the previous passes. There is no radiance cache in
+//		   SORT , the radiance leaving a vertex is estimated by the average brightness of the
+//		   image. Please refer to "Adjoint-driven russian roulette and splitting in light
+//		   transport simulation" by Vorba and Krivanek for further details.
+//	note : with spectral rendering enabled , each path carries 4 or 8 wavelengths picked by hero wavelength
+//		   sampling instead of rgb values. The rgb values of lights and bsdfs are upsampled at the wavelengths
+//		   of the path at every vertex and the radiance is converted back to rgb at the end of the path.
+//	note : paths keep track of the participating medium they travel in , the medium switches at the surfaces
+//		   of models bounding media. Scattering events are sampled by the medium , heterogeneous ones use
+//		   delta tracking against a coarse majorant grid , and the shadow rays are attenuated by the media.
+//	note : light scattering beneath the surface of translucent materials is not traced , the irradiance of points spread
+//		   over the triangles of each of them is computed once before rendering and the exitance at a hit is the diffusion
+//		   profile integrated over the points of an octree. The front side of the triangles is taken as the outside.
 class	PathTracing : public Integrator
 {
 // public method
 public:
 	DEFINE_CREATOR( PathTracing , Integrator , "pt" );
 
+	// default constructor
+	PathTracing() {
+		_registerProperty( "pt_guiding" , new GuidingProperty(this) );
+		_registerProperty( "pt_guiding_iterations" , new GuidingIterationsProperty(this) );
+		_registerProperty( "pt_guiding_bsdf_fraction" , new GuidingBsdfFractionProperty(this) );
+		_registerProperty( "pt_adrrs" , new ADRRSProperty(this) );
+		_registerProperty( "pt_spectral" , new SpectralProperty(this) );
+		_registerProperty( "pt_shadow_roulette" , new ShadowRouletteProperty(this) );
+		_registerProperty( "pt_sss_points" , new SubsurfacePointsProperty(this) );
+		_registerProperty( "pt_sss_samples" , new SubsurfaceSamplesProperty(this) );
+		_registerProperty( "pt_sss_error" , new SubsurfaceErrorProperty(this) );
+	}
+
 	// return the radiance of a specific direction
 	// para 'scene' : scene containing geometry data
 	// para 'ray'   : ray with specific direction
 	// result       : radiance along the ray from the scene<F3>
 	virtual Spectrum	Li( const Ray& ray , const PixelSample& ps ) const;
 
-	// request samples
-	virtual void RequestSample( Sampler* sampler , PixelSample* ps , unsigned ps_num );
+	// request the sample dimensions of every bounce , one light sample and two bsdf samples for each ,
+	// the irradiance of the surfaces of translucent materials is computed too
+	virtual void PreProcess();
 
-	// generate samples
-	// para 'sampler' : the sampling method
-	// para 'samples' : the samples to be generated
-	// para 'ps'      : number of pixel sample to be generated
-	// para 'scene'   : the scene to be rendered
-	virtual void GenerateSample( const Sampler* sampler , PixelSample* samples , unsigned ps , const Scene& scene ) const;
+	// train the guiding tree and update the brightness estimates between passes
+	// para 'spp' : the number of samples per pixel in the pass
+	virtual void BeginPass( unsigned spp );
 
 	// output log information
 	virtual void OutputLog() const;
+
+	// camera rays missing the scene only see the environment , unless they scatter in the ambient medium
+	virtual bool IsBackgroundOnMiss() const;
+
+	// paths start from the first hits of the raster pass
+	virtual bool AcceptsPrimaryHits() const { return true; }
+
+// private field
+private:
+	// whether path guiding is enabled
+	bool		m_guiding = false;
+	// the number of training iterations , the tree is fixed after them
+	unsigned	m_guidingIterations = 8;
+	// the probability of sampling the bsdf instead of the guiding tree
+	float		m_bsdfFraction = 0.5f;
+
+	// the tree learning the incident radiance
+	SDTree		m_sdTree;
+	// the current training iteration
+	unsigned	m_iteration = 0;
+	// the number of samples per pixel taken in the current iteration
+	unsigned	m_iterationSamples = 0;
+	// whether the passes so far record radiance in the tree
+	bool		m_recording = false;
+	// whether the tree is initialized
+	bool		m_sdTreeBuilt = false;
+
+	// whether paths are split and terminated by their expected contribution
+	bool		m_adrrs = false;
+	// the average luminance of each pixel in the previous passes
+	std::vector<float>	m_pixelEstimates;
+	unsigned	m_estimateWidth = 0;
+	unsigned	m_estimateHeight = 0;
+	// the average luminance of the image , it estimates the radiance leaving any vertex
+	float		m_radianceEstimate = 0.0f;
+
+	// the number of wavelengths carried by each path , paths carry rgb values if it is 0
+	unsigned	m_spectral = 0;
+
+	// shadow rays whose unoccluded contribution is dimmer than this fraction of the radiance of the path so far are
+	// traced with a probability proportional to their contribution , it is disabled if it is 0
+	float		m_shadowRoulette = 0.0f;
+
+	// the octree of irradiance points of each translucent material , it is indexed by the id of the material
+	std::vector<std::unique_ptr<SubsurfaceCache>>	m_subsurface;
+	// the number of irradiance points spread over the surface of each translucent material
+	unsigned	m_sssPoints = 65536;
+	// the number of gather rays and light samples of each irradiance point
+	unsigned	m_sssSamples = 16;
+	// the largest solid angle of a node of the octree treated as one point
+	float		m_sssError = 0.05f;
+
+	// trace a path from a ray
+	// para 'path'       : the spectrum carried by the path , it is either rgb or a set of wavelengths
+	// para 'ray'        : the ray starting the path
+	// para 'ps'         : the pixel sample
+	// para 'throughput' : the throughput of the path before the ray
+	// para 'bounces'    : the number of bounces before the ray
+	// para 'pixel'      : the brightness estimate of the pixel , 0 if it is not available
+	// para 'medium'     : the medium the ray travels in , it is null in vacuum
+	// para 'branch'     : whether the path is a split branch , the dimensions of the pixel sample belong to the main path
+	// result            : the radiance contributed by the path , weighted by the throughput
+	template<class P>
+	typename P::Type _li( const P& path , const Ray& ray , const PixelSample& ps , typename P::Type throughput , int bounces , float pixel , const Medium* medium , bool branch = false ) const;
+
+	// direct lighting at a scattering event in a medium , lights are sampled without multiple importance sampling
+	// since emission found by the paths is only counted for camera rays
+	// para 'path'   : the spectrum carried by the path
+	// para 'r'      : the ray scattering in the medium
+	// para 'p'      : the scattering point
+	// para 'medium' : the medium
+	// para 'ls'     : the light sample
+	template<class P>
+	typename P::Type _mediumDirect( const P& path , const Ray& r , const Point& p , const Medium* medium , const LightSample& ls ) const;
+
+	// sample the next direction of a path from the bsdf or the guiding tree
+	// para 'bsdf' : the bsdf at the vertex
+	// para 'wo'   : the direction toward the previous vertex
+	// para 'bs'   : the sample
+	// para 'leaf' : the spatial leaf of the vertex in the guiding tree
+	// para 'wi'   : the sampled direction ( output )
+	// para 'pdf'  : the pdf of the sampled direction ( output )
+	// para 'type' : the kind of the ray leaving along the sampled direction , one of RAY_TYPE ( output )
+	// result      : the bsdf value of the sampled direction
+	Spectrum _sampleDirection( const Bsdf* bsdf , const Vector& wo , const BsdfSample& bs , unsigned leaf , Vector& wi , float& pdf , unsigned& type ) const;
+
+	// update the brightness estimates of pixels from the passes so far
+	void _updateEstimates();
+
+	// spread points over the surfaces of translucent materials and compute their irradiance
+	void _buildSubsurface();
+
+	// the irradiance entering the surface of a translucent material , it is the direct light and the light reflected once
+	// para 'ip'      : the point on the surface , its normal faces the outside
+	// para 'profile' : the diffusion profile of the material
+	Spectrum _subsurfaceIrradiance( const Intersection& ip , const SubsurfaceProfile& profile ) const;
+
+	// Path guiding property
+	class GuidingProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(GuidingProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PathTracing* pt = CAST_TARGET(PathTracing);
+			if( pt )
+				pt->m_guiding = (atoi( str.c_str() )==1);
+		}
+	};
+
+	// Training iterations property
+	class GuidingIterationsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(GuidingIterationsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PathTracing* pt = CAST_TARGET(PathTracing);
+			if( pt )
+				pt->m_guidingIterations = (unsigned)max( 0 , atoi( str.c_str() ) );
+		}
+	};
+
+	// Adjoint-driven russian roulette and splitting property
+	class ADRRSProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(ADRRSProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PathTracing* pt = CAST_TARGET(PathTracing);
+			if( pt )
+				pt->m_adrrs = (atoi( str.c_str() )==1);
+		}
+	};
+
+	// Spectral rendering property , it is the number of wavelengths of each path
+	class SpectralProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SpectralProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PathTracing* pt = CAST_TARGET(PathTracing);
+			const int n = atoi( str.c_str() );
+			if( pt )
+				pt->m_spectral = ( n >= 8 ) ? 8 : ( ( n > 0 ) ? 4 : 0 );
+		}
+	};
+
+	// Bsdf sampling fraction property
+	class GuidingBsdfFractionProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(GuidingBsdfFractionProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PathTracing* pt = CAST_TARGET(PathTracing);
+			if( pt )
+				pt->m_bsdfFraction = min( 1.0f , max( 0.0f , (float)atof( str.c_str() ) ) );
+		}
+	};
+
+	// Shadow ray roulette property
+	class ShadowRouletteProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(ShadowRouletteProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PathTracing* pt = CAST_TARGET(PathTracing);
+			if( pt )
+				pt->m_shadowRoulette = max( 0.0f , (float)atof( str.c_str() ) );
+		}
+	};
+
+	// Subsurface irradiance points property
+	class SubsurfacePointsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SubsurfacePointsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PathTracing* pt = CAST_TARGET(PathTracing);
+			if( pt )
+				pt->m_sssPoints = (unsigned)max( 1 , atoi( str.c_str() ) );
+		}
+	};
+
+	// Subsurface irradiance samples property
+	class SubsurfaceSamplesProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SubsurfaceSamplesProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PathTracing* pt = CAST_TARGET(PathTracing);
+			if( pt )
+				pt->m_sssSamples = (unsigned)max( 1 , atoi( str.c_str() ) );
+		}
+	};
+
+	// Subsurface octree error property
+	class SubsurfaceErrorProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SubsurfaceErrorProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PathTracing* pt = CAST_TARGET(PathTracing);
+			if( pt )
+				pt->m_sssError = max( 0.0f , (float)atof( str.c_str() ) );
+		}
+	};
 };
@@ -0,0 +1,281 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "sort.h"
+#include "pssmlt.h"
+#include "geometry/scene.h"
+#include "camera/camera.h"
+#include "imagesensor/imagesensor.h"
+#include "utility/samplemethod.h"
+#include "utility/multithread/threadpool.h"
+#include "log/log.h"
+#include <atomic>
+
+IMPLEMENT_CREATOR( PrimarySpaceMLT );
+
+// the streams of the paths , a path of the bootstrap is traced again by the chain starting from it
+static const unsigned PSSMLT_BOOTSTRAP_STREAM = 0;
+static const unsigned PSSMLT_CHAIN_STREAM = 1;
+
+// the contributions of the path traced on the current thread
+static Thread_Local vector<Pending_Sample>* g_contributions = nullptr;
+
+// a canonical number of the generator of the thread , the chain takes it while it replaces the canonical numbers of the thread
+static inline float chainCanonical()
+{
+	return ( sort_rand() >> 8 ) * ( 1.0f / (float)( 1 << 24 ) );
+}
+
+// the next number of the primary sample vector
+float PSSMLT_Chain::Next()
+{
+	if( m_index >= m_values.size() )
+		m_values.resize( m_index + 1 );
+	PSSMLT_Value& v = m_values[m_index++];
+
+	// numbers not taken since the last accepted large step are replaced by it
+	if( v.modified < m_lastLargeStep )
+	{
+		v.value = chainCanonical();
+		v.modified = m_lastLargeStep;
+	}
+
+	v.backup = v.value;
+	v.modifiedBackup = v.modified;
+	if( m_isLargeStep )
+		v.value = chainCanonical();
+	else
+	{
+		// the small mutations skipped by the number are applied at once , their sum is a wider normal distribution
+		const float steps = (float)( m_iteration - v.modified );
+		const float u0 = max( chainCanonical() , 1e-7f );
+		const float u1 = chainCanonical();
+		const float normal = sqrt( -2.0f * log( u0 ) ) * cos( TWO_PI * u1 );
+		v.value += normal * m_sigma * sqrt( steps );
+		v.value = min( v.value - floor( v.value ) , 0.99999994f );
+	}
+	v.modified = m_iteration;
+	return v.value;
+}
+
+// start a mutation
+void PSSMLT_Chain::StartIteration()
+{
+	++m_iteration;
+	m_isLargeStep = chainCanonical() < m_largeStep;
+	m_index = 0;
+}
+
+// keep the mutation
+void PSSMLT_Chain::Accept()
+{
+	if( m_isLargeStep )
+		m_lastLargeStep = m_iteration;
+}
+
+// restore the numbers before the mutation
+void PSSMLT_Chain::Reject()
+{
+	for( auto& v : m_values )
+	{
+		if( v.modified == m_iteration )
+		{
+			v.value = v.backup;
+			v.modified = v.modifiedBackup;
+		}
+	}
+	--m_iteration;
+}
+
+// prepare the chains
+void PrimarySpaceMLT::PreProcess()
+{
+	// each mutation takes one eye path and one light path , light paths are weighted against the others by the number of pixels
+	sample_per_pixel = 1;
+	light_tracing_only = false;
+	m_bLVC = false;
+
+	if( camera == nullptr )
+		return;
+	m_width = camera->GetImageSensor()->GetWidth();
+	m_height = camera->GetImageSensor()->GetHeight();
+	m_chains.clear();
+	m_mutationCnt = 0;
+	m_acceptedCnt = 0;
+}
+
+// mutate the paths of the chains for a pass
+void PrimarySpaceMLT::BeginPass( unsigned spp )
+{
+	if( m_width == 0 || m_height == 0 )
+		return;
+	if( m_chains.empty() )
+		_Bootstrap();
+	if( m_chains.empty() )
+		return;
+
+	// there are as many mutations as pixel samples , the contributions of each of them are scaled to the image
+	const unsigned long long mutations = (unsigned long long)m_width * m_height * max( spp , 1u );
+	const float scale = (float)( (double)m_brightness / (double)mutations );
+	const unsigned chain_cnt = (unsigned)m_chains.size();
+	ImageSensor* is = camera->GetImageSensor();
+	std::atomic<unsigned long long> accepted( 0 );
+	ParallelFor( 0 , chain_cnt , 1 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		vector<Pending_Sample> proposed;
+		for( unsigned c = chunk_start ; c < chunk_end ; ++c )
+		{
+			// every chain takes its own stream , it goes on from the previous pass
+			PSSMLT_Chain& chain = m_chains[c];
+			sort_set_state( chain.state );
+
+			unsigned long long chain_accepted = 0;
+			const unsigned long long cnt = mutations / chain_cnt + ( ( c < mutations % chain_cnt ) ? 1 : 0 );
+			for( unsigned long long k = 0 ; k < cnt ; ++k )
+			{
+				chain.StartIteration();
+				const float intensity = _Evaluate( chain , proposed );
+				const float a = ( chain.currentIntensity > 0.0f ) ? min( 1.0f , intensity / chain.currentIntensity ) : 1.0f;
+
+				// both paths are splatted by the probability of taking them , it is the expected value of the next state
+				if( a > 0.0f && intensity > 0.0f )
+					for( const auto& s : proposed )
+						is->UpdatePixel( s.coord.x , s.coord.y , s.radiance * ( a * scale / intensity ) );
+				if( a < 1.0f && chain.currentIntensity > 0.0f )
+					for( const auto& s : chain.current )
+						is->UpdatePixel( s.coord.x , s.coord.y , s.radiance * ( ( 1.0f - a ) * scale / chain.currentIntensity ) );
+
+				if( sort_canonical() < a )
+				{
+					chain.Accept();
+					chain.current.swap( proposed );
+					chain.currentIntensity = intensity;
+					++chain_accepted;
+				}
+				else
+					chain.Reject();
+			}
+
+			sort_get_state( chain.state );
+			accepted += chain_accepted;
+		}
+	});
+	m_mutationCnt += mutations;
+	m_acceptedCnt += accepted;
+
+	slog( DEBUG , INTEGRATOR , stringFormat( "Primary sample space MLT takes %lld mutations in the pass, %f of all mutations are accepted." , (long long)mutations , (double)m_acceptedCnt / (double)max( m_mutationCnt , 1ull ) ) );
+}
+
+// trace the paths of random numbers , pick the first paths of the chains by their contributions
+void PrimarySpaceMLT::_Bootstrap()
+{
+	// the paths are traced in parallel , each of them takes its own stream so that it could be traced again
+	vector<float> weights( m_bootstrapCnt );
+	ParallelFor( 0 , m_bootstrapCnt , 64 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		vector<Pending_Sample> contributions;
+		for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+		{
+			sort_set_stream( i , SORT_RAND_PARALLEL , PSSMLT_BOOTSTRAP_STREAM );
+			PSSMLT_Chain chain( m_sigma , m_largeStep );
+			weights[i] = _Evaluate( chain , contributions );
+		}
+	});
+
+	double sum = 0.0;
+	for( const auto w : weights )
+		sum += w;
+	m_brightness = (float)( sum / (double)m_bootstrapCnt );
+	if( m_brightness <= 0.0f )
+	{
+		slog( WARNING , INTEGRATOR , "No path of primary sample space MLT carries radiance to the camera, the image is black." );
+		return;
+	}
+
+	// the first paths of the chains are picked by their contributions with stratified numbers
+	const Distribution1D distribution( &weights[0] , m_bootstrapCnt );
+	const float offset = sort_canonical();
+	m_chains.assign( m_chainCnt , PSSMLT_Chain( m_sigma , m_largeStep ) );
+	ParallelFor( 0 , m_chainCnt , 16 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		for( unsigned c = chunk_start ; c < chunk_end ; ++c )
+		{
+			const unsigned index = distribution.SampleDiscrete( min( ( (float)c + offset ) / (float)m_chainCnt , 1.0f ) , nullptr );
+			sort_set_stream( index , SORT_RAND_PARALLEL , PSSMLT_BOOTSTRAP_STREAM );
+			PSSMLT_Chain& chain = m_chains[c];
+			chain.currentIntensity = _Evaluate( chain , chain.current );
+
+			// chains starting from the same path mutate it with their own streams
+			sort_set_stream( c , SORT_RAND_PARALLEL , PSSMLT_CHAIN_STREAM );
+			sort_get_state( chain.state );
+		}
+	});
+
+	slog( DEBUG , INTEGRATOR , stringFormat( "Primary sample space MLT starts %d chains from %d paths, the average intensity of a path is %f." , m_chainCnt , m_bootstrapCnt , m_brightness ) );
+}
+
+// trace the path of the primary sample vector of a chain
+float PrimarySpaceMLT::_Evaluate( PSSMLT_Chain& chain , vector<Pending_Sample>& contrib ) const
+{
+	// bsdfs of the path are only needed while it is traced
+	MemScope mem_scope;
+	contrib.clear();
+	g_contributions = &contrib;
+	sort_set_source( &chain );
+
+	// the first numbers pick the point on the image
+	PixelSample ps;
+	const float x = sort_canonical() * (float)m_width;
+	const float y = sort_canonical() * (float)m_height;
+	ps.pixel_x = min( (unsigned)x , m_width - 1 );
+	ps.pixel_y = min( (unsigned)y , m_height - 1 );
+	ps.img_u = min( x - (float)ps.pixel_x , 0.99999994f );
+	ps.img_v = min( y - (float)ps.pixel_y , 0.99999994f );
+	ps.dof_u = sort_canonical();
+	ps.dof_v = sort_canonical();
+	ps.time = scene.HasMotion() ? sort_canonical() : 0.0f;
+
+	const Ray ray = camera->GenerateRay( (float)ps.pixel_x , (float)ps.pixel_y , ps );
+	const Spectrum li = BidirPathTracing::Li( ray , ps );
+
+	sort_set_source( nullptr );
+	g_contributions = nullptr;
+
+	if( !li.IsBlack() )
+		contrib.push_back( Pending_Sample{ Vector2i( (int)ps.pixel_x , (int)ps.pixel_y ) , li } );
+
+	// the eye path estimates the radiance of its pixel and the light path estimates the image divided by the number
+	// of pixels , both are scaled by the number of pixels so that the image is the average of the paths
+	const float total_pixel = (float)( m_width * m_height );
+	float intensity = 0.0f;
+	for( auto& s : contrib )
+	{
+		s.radiance *= total_pixel;
+		intensity += s.radiance.GetIntensity();
+	}
+	return intensity;
+}
+
+// keep the radiance of a light path connected to the camera in the contributions of the path
+void PrimarySpaceMLT::_Splat( const Vector2i& coord , const Spectrum& radiance ) const
+{
+	if( g_contributions )
+		g_contributions->push_back( Pending_Sample{ coord , radiance } );
+}
+
+// output log information
+void PrimarySpaceMLT::OutputLog() const
+{
+	slog( INFO , INTEGRATOR , "Integrator algorithm : primary sample space Metropolis light transport." );
+}
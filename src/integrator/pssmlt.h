@@ -0,0 +1,200 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "bidirpath.h"
+#include "utility/rand.h"
+
+// a number of the primary sample vector , the number before the mutation is kept until it is accepted
+struct PSSMLT_Value
+{
+	float		value = 0.0f;		// the number
+	float		backup = 0.0f;		// the number before the current mutation
+	long long	modified = 0;		// the last iteration mutating the number
+	long long	modifiedBackup = 0;	// the last iteration mutating the number before the current mutation
+};
+
+// a Markov chain in primary sample space , it feeds the canonical random numbers taken by a path
+// note : numbers are only created and mutated once a path takes them , so the vector grows with the longest path
+class PSSMLT_Chain : public RandomSource
+{
+public:
+	// constructor
+	// para 'sigma'      : the standard deviation of small mutations
+	// para 'large_step' : the probability of a large step
+	PSSMLT_Chain( float sigma = 0.01f , float large_step = 0.3f ) : m_sigma(sigma) , m_largeStep(large_step) {}
+
+	// the next number of the primary sample vector , it is mutated first if it isn't in the current iteration
+	virtual float Next();
+
+	// start a mutation , it is a large step replacing all numbers or a small step around them
+	void StartIteration();
+
+	// keep the mutation
+	void Accept();
+
+	// restore the numbers before the mutation
+	void Reject();
+
+	// the contributions of the current path and the sum of their intensity
+	vector<Pending_Sample>	current;
+	float					currentIntensity = 0.0f;
+	// the state of the generator of the chain between passes
+	unsigned				state[SORT_RAND_STATE_SIZE];
+
+private:
+	vector<PSSMLT_Value>	m_values;					// the primary sample vector
+	long long				m_iteration = 0;			// the current iteration
+	long long				m_lastLargeStep = 0;		// the last accepted large step
+	bool					m_isLargeStep = true;		// whether the current iteration is a large step
+	unsigned				m_index = 0;				// the next number taken by the path
+	float					m_sigma;
+	float					m_largeStep;
+};
+
+///////////////////////////////////////////////////////////////////////////////////
+// definition of primary sample space Metropolis light transport
+// note : paths of bidirectional path tracing are mutated in the space of the random numbers they take.
+//		  Before the first pass , paths of random numbers are traced in parallel to estimate the brightness
+//		  of the image , the chains start from paths picked among them by their contributions. Before every
+//		  pass , the chains mutate their paths in parallel , each of them on one thread , and the contributions
+//		  of the paths are splatted to the blocks of pixels of the thread. The camera tiles do nothing.
+//		  Please refer to "A Simple and Robust Mutation Strategy for the Metropolis Light Transport Algorithm"
+//		  by Kelemen et al. for further details. It helps scenes lit through small openings most.
+class PrimarySpaceMLT : public BidirPathTracing
+{
+// public method
+public:
+	DEFINE_CREATOR( PrimarySpaceMLT , Integrator , "pssmlt" );
+
+	// default constructor
+	PrimarySpaceMLT() {
+		_registerProperty( "pssmlt_chains" , new ChainsProperty(this) );
+		_registerProperty( "pssmlt_bootstrap" , new BootstrapProperty(this) );
+		_registerProperty( "pssmlt_sigma" , new SigmaProperty(this) );
+		_registerProperty( "pssmlt_large_step" , new LargeStepProperty(this) );
+	}
+
+	// the camera tiles take nothing , all radiance is splatted by the chains
+	virtual Spectrum	Li( const Ray& ray , const PixelSample& ps ) const { return 0.0f; }
+
+	// every mutation takes one light path
+	virtual void RequestSample( Sampler* sampler , PixelSample* ps , unsigned ps_num ) {}
+
+	// prepare the chains
+	virtual void PreProcess();
+
+	// mutate the paths of the chains for a pass
+	// para 'spp' : the number of samples per pixel in the pass , there are as many mutations as pixel samples
+	virtual void BeginPass( unsigned spp );
+
+	// refresh tile in blender
+	// no need to refresh tiles
+	virtual bool NeedRefreshTile() const { return false; }
+
+	// output log information
+	virtual void OutputLog() const;
+
+// protected method
+protected:
+	// keep the radiance of a light path connected to the camera in the contributions of the path
+	virtual void _Splat( const Vector2i& coord , const Spectrum& radiance ) const;
+
+// private field
+private:
+	// the number of chains , it is 1024 by default
+	unsigned	m_chainCnt = 1024;
+	// the number of paths traced to estimate the brightness of the image
+	unsigned	m_bootstrapCnt = 100000;
+	// the standard deviation of small mutations
+	float		m_sigma = 0.01f;
+	// the probability of a large step
+	float		m_largeStep = 0.3f;
+
+	// the size of the image
+	unsigned	m_width = 0;
+	unsigned	m_height = 0;
+	// the average intensity of the contributions of a path
+	float		m_brightness = 0.0f;
+	// the chains , they are created in the first pass
+	vector<PSSMLT_Chain>	m_chains;
+	// the number of mutations and the accepted ones so far
+	unsigned long long		m_mutationCnt = 0;
+	unsigned long long		m_acceptedCnt = 0;
+
+	// trace the paths of random numbers , pick the first paths of the chains by their contributions
+	void _Bootstrap();
+
+	// trace the path of the primary sample vector of a chain
+	// para 'chain'   : the chain
+	// para 'contrib' : the contributions of the path , each pixel is weighted so that the image is the average of all paths
+	// result         : the sum of the intensity of the contributions
+	float _Evaluate( PSSMLT_Chain& chain , vector<Pending_Sample>& contrib ) const;
+
+	// Chains Property
+	class ChainsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(ChainsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PrimarySpaceMLT* mlt = CAST_TARGET(PrimarySpaceMLT);
+			if( mlt )
+				mlt->m_chainCnt = max( 1 , atoi( str.c_str() ) );
+		}
+	};
+
+	// Bootstrap Property
+	class BootstrapProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(BootstrapProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PrimarySpaceMLT* mlt = CAST_TARGET(PrimarySpaceMLT);
+			if( mlt )
+				mlt->m_bootstrapCnt = max( 1 , atoi( str.c_str() ) );
+		}
+	};
+
+	// Small mutation Property
+	class SigmaProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SigmaProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PrimarySpaceMLT* mlt = CAST_TARGET(PrimarySpaceMLT);
+			if( mlt )
+				mlt->m_sigma = max( 1e-5f , (float)atof( str.c_str() ) );
+		}
+	};
+
+	// Large step Property
+	class LargeStepProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(LargeStepProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			PrimarySpaceMLT* mlt = CAST_TARGET(PrimarySpaceMLT);
+			if( mlt )
+				mlt->m_largeStep = min( 1.0f , max( 0.0f , (float)atof( str.c_str() ) ) );
+		}
+	};
+};
@@ -0,0 +1,327 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "sort.h"
+#include "sppm.h"
+#include "integratormethod.h"
+#include "geometry/scene.h"
+#include "light/light.h"
+#include "bsdf/bsdf.h"
+#include "camera/camera.h"
+#include "imagesensor/imagesensor.h"
+#include "utility/multithread/threadpool.h"
+#include "log/log.h"
+
+IMPLEMENT_CREATOR( StochasticPPM );
+
+// visible points are the first surfaces with a lobe matching the type , glossy surfaces don't gather photons
+static const BXDF_TYPE SPPM_GATHER_TYPE = BXDF_TYPE( BXDF_ALL & ~BXDF_GLOSSY );
+
+// add a value to an atomic float , photons on different threads add their flux to the same visible point
+static inline void atomicAdd( std::atomic<float>& value , float delta )
+{
+	float old = value.load( std::memory_order_relaxed );
+	while( !value.compare_exchange_weak( old , old + delta , std::memory_order_relaxed ) );
+}
+
+// return the radiance of a specific direction
+Spectrum StochasticPPM::Li( const Ray& ray , const PixelSample& ps ) const
+{
+	const Spectrum direct = _tracePath( ray , &ps , nullptr );
+
+	// the photons gathered by the pixel in the finished iterations estimate the rest of the radiance
+	Spectrum indirect;
+	if( m_emittedCnt > 0 && ps.pixel_x < m_width && ps.pixel_y < m_height )
+	{
+		const SPPM_Pixel& pixel = m_pixels[ ps.pixel_y * m_width + ps.pixel_x ];
+		indirect = pixel.tau / ( (float)m_emittedCnt * PI * pixel.radius * pixel.radius );
+	}
+
+	// everything not arriving directly is indirect radiance
+	const Spectrum L = direct + indirect;
+	if( ps.aov )
+		ps.aov[AOV_INDIRECT] = L - ps.aov[AOV_DIRECT];
+	return L;
+}
+
+// allocate the statistics of the pixels
+void StochasticPPM::PreProcess()
+{
+	RequestDimensions( max_recursive_depth , 2 * max_recursive_depth );
+
+	if( camera == nullptr )
+		return;
+
+	// the radius is a small fraction of the scene by default , it shrinks per pixel anyway
+	if( m_baseRadius <= 0.0f )
+	{
+		const BBox& bbox = scene.GetBBox();
+		m_baseRadius = 0.005f * ( bbox.m_Max - bbox.m_Min ).Length();
+	}
+	m_baseRadius = max( m_baseRadius , 1e-7f );
+
+	const ImageSensor* sensor = camera->GetImageSensor();
+	m_width = sensor->GetWidth();
+	m_height = sensor->GetHeight();
+	const unsigned total_pixel = m_width * m_height;
+	m_pixels.reset( new SPPM_Pixel[total_pixel] );
+	for( unsigned i = 0 ; i < total_pixel ; ++i )
+	{
+		SPPM_Pixel& pixel = m_pixels[i];
+		pixel.radius = m_baseRadius;
+		for( unsigned k = 0 ; k < 3 ; ++k )
+			pixel.phi[k].store( 0.0f , std::memory_order_relaxed );
+		pixel.m.store( 0 , std::memory_order_relaxed );
+	}
+	m_iterationCnt = 0;
+	m_emittedCnt = 0;
+	m_memory.Set( sizeof( SPPM_Pixel ) * total_pixel );
+}
+
+// run the iterations of photon mapping of a pass
+void StochasticPPM::BeginPass( unsigned spp )
+{
+	if( !m_pixels )
+		return;
+
+	float radius = 0.0f;
+	for( unsigned i = 0 ; i < max( spp , 1u ) ; ++i )
+		radius = _iterate( i );
+
+	slog( DEBUG , INTEGRATOR , stringFormat( "Stochastic progressive photon mapping finishes %d iterations with %lld photons, the largest radius is %f." , m_iterationCnt , (long long)m_emittedCnt , radius ) );
+}
+
+// run one iteration of photon mapping
+float StochasticPPM::_iterate( unsigned iteration )
+{
+	// camera paths of all pixels find their visible points
+	const unsigned total_pixel = m_width * m_height;
+	ParallelFor( 0 , total_pixel , 64 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		PixelSample ps;
+		for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+		{
+			// only the intersection of the visible point is kept , its bsdf is created again by the photons
+			MemScope mem_scope;
+			sort_reseed( i , SORT_RAND_PARALLEL , 2 * iteration );
+
+			ps.img_u = sort_canonical();
+			ps.img_v = sort_canonical();
+			ps.dof_u = sort_canonical();
+			ps.dof_v = sort_canonical();
+			ps.time = scene.HasMotion() ? sort_canonical() : 0.0f;
+
+			SPPM_Pixel& pixel = m_pixels[i];
+			pixel.valid = false;
+			const Ray ray = camera->GenerateRay( (float)( i % m_width ) , (float)( i / m_width ) , ps );
+			_tracePath( ray , nullptr , &pixel );
+		}
+	});
+
+	// the grid is as fine as the largest radius , each visible point checks its own radius
+	vector<Point> points;
+	float radius = 0.0f;
+	m_owners.clear();
+	for( unsigned i = 0 ; i < total_pixel ; ++i )
+	{
+		if( !m_pixels[i].valid )
+			continue;
+		points.push_back( m_pixels[i].inter.intersect );
+		m_owners.push_back( i );
+		radius = max( radius , m_pixels[i].radius );
+	}
+	m_grid.Build( points , radius );
+	m_memory.Set( sizeof( SPPM_Pixel ) * total_pixel + ( sizeof( Point ) * 2 + sizeof( unsigned ) * 3 ) * points.size() );
+
+	// photons are traced in parallel , the visible points around their hits gather their flux
+	const unsigned photon_cnt = ( m_photonCnt > 0 ) ? m_photonCnt : total_pixel;
+	ParallelFor( 0 , photon_cnt , 256 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+		{
+			// bsdfs of the photon path are only needed while it is traced
+			MemScope mem_scope;
+			sort_reseed( i , SORT_RAND_PARALLEL , 2 * iteration + 1 );
+			_tracePhoton();
+		}
+	});
+	m_emittedCnt += photon_cnt;
+	++m_iterationCnt;
+
+	// the radius of each pixel shrinks with the photons it gathered , only a fraction 'alpha' of them is kept
+	ParallelFor( 0 , total_pixel , 1024 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+		{
+			SPPM_Pixel& pixel = m_pixels[i];
+			const unsigned m = pixel.m.load( std::memory_order_relaxed );
+			if( m > 0 )
+			{
+				const float n = pixel.n + m_alpha * (float)m;
+				const float ratio = n / ( pixel.n + (float)m );
+				const Spectrum phi( pixel.phi[0].load( std::memory_order_relaxed ) , pixel.phi[1].load( std::memory_order_relaxed ) , pixel.phi[2].load( std::memory_order_relaxed ) );
+				pixel.tau = ( pixel.tau + pixel.throughput * phi ) * ratio;
+				pixel.n = n;
+				pixel.radius *= sqrt( ratio );
+			}
+			for( unsigned k = 0 ; k < 3 ; ++k )
+				pixel.phi[k].store( 0.0f , std::memory_order_relaxed );
+			pixel.m.store( 0 , std::memory_order_relaxed );
+		}
+	});
+
+	// the grid is only needed by the photons of the iteration
+	m_grid.Release();
+	m_owners.clear();
+	m_memory.Set( sizeof( SPPM_Pixel ) * total_pixel );
+
+	return radius;
+}
+
+// trace a camera path through glossy surfaces to the first surface with a diffuse lobe
+Spectrum StochasticPPM::_tracePath( const Ray& ray , const PixelSample* ps , SPPM_Pixel* vp ) const
+{
+	Spectrum L;
+	Spectrum throughput = 1.0f;
+	Ray r = ray;
+	for( int bounces = 0 ; bounces < max_recursive_depth ; ++bounces )
+	{
+		Intersection inter;
+		if( false == scene.GetIntersect( r , &inter ) )
+		{
+			if( bounces == 0 )
+				L += scene.Le( r );
+			break;
+		}
+
+		if( bounces == 0 )
+		{
+			L += inter.Le( -r.m_Dir );
+
+			// the first hit of the camera ray fills the output variables
+			if( ps && ps->aov )
+			{
+				ps->aov[AOV_NORMAL] = Spectrum( inter.normal.x , inter.normal.y , inter.normal.z );
+				ps->aov[AOV_DEPTH] = inter.t;
+			}
+		}
+
+		// direct lighting is only evaluated while the tiles are rendered
+		const Bsdf* bsdf = inter.primitive->GetMaterial()->GetBsdf( &inter );
+		if( ps )
+		{
+			float			light_pdf = 0.0f;
+			LightSample		light_sample = ps->GetLightSample( bounces );
+			const Light*	light = scene.SampleLight( light_sample.t , inter , &light_pdf );
+			if( light_pdf > 0.0f )
+				L += throughput * EvaluateDirect( r , scene , light , inter , light_sample , ps->GetBsdfSample( 2 * bounces ) , BXDF_TYPE( BXDF_ALL ) ) / light_pdf;
+			if( bounces == 0 && ps->aov )
+				ps->aov[AOV_DIRECT] = L;
+		}
+
+		// the first surface with a diffuse lobe gathers photons
+		if( bsdf->NumComponents( SPPM_GATHER_TYPE ) > 0 )
+		{
+			if( vp )
+			{
+				vp->inter = inter;
+				vp->wo = -r.m_Dir;
+				vp->throughput = throughput;
+				vp->valid = true;
+			}
+			break;
+		}
+
+		// glossy surfaces reflect the path further
+		float		pdf = 0.0f;
+		Vector		wi;
+		const BsdfSample bsdf_sample = ps ? ps->GetBsdfSample( 2 * bounces + 1 ) : BsdfSample(true);
+		const Spectrum f = bsdf->sample_f( -r.m_Dir , wi , bsdf_sample , &pdf );
+		if( f.IsBlack() || pdf == 0.0f )
+			break;
+		throughput *= f * AbsDot( wi , inter.normal ) / pdf;
+
+		r = inter.SpawnRay( wi );
+	}
+	return L;
+}
+
+// trace a photon and add its flux to the visible points around its hits
+void StochasticPPM::_tracePhoton() const
+{
+	// pick a light randomly
+	float pick_pdf = 0.0f;
+	const Light* light = scene.SampleLight( sort_canonical() , &pick_pdf );
+	if( light == nullptr || pick_pdf == 0.0f )
+		return;
+
+	float	emission_pdf = 0.0f;
+	float	pdfa = 0.0f;
+	float	cosAtLight = 1.0f;
+	Ray		r;
+	const Spectrum le = light->sample_l( LightSample(true) , r , &emission_pdf , &pdfa , &cosAtLight );
+	if( emission_pdf == 0.0f || le.IsBlack() )
+		return;
+
+	Spectrum flux = le * cosAtLight / ( emission_pdf * pick_pdf );
+	for( int depth = 0 ; depth < max_recursive_depth ; ++depth )
+	{
+		Intersection inter;
+		if( false == scene.GetIntersect( r , &inter ) )
+			break;
+
+		// the first hit is lit directly , it is evaluated by the camera paths
+		const Vector wi = -r.m_Dir;
+		if( depth > 0 )
+		{
+			m_grid.Query( inter.intersect , [&]( unsigned slot ){
+				SPPM_Pixel& pixel = m_pixels[ m_owners[ m_grid.GetIndex( slot ) ] ];
+				if( ( pixel.inter.intersect - inter.intersect ).SquaredLength() > pixel.radius * pixel.radius )
+					return;
+
+				// the bsdf of the visible point is created again instead of being kept through the iteration
+				MemScope mem_scope;
+				const Bsdf* bsdf = pixel.inter.primitive->GetMaterial()->GetBsdf( &pixel.inter );
+				const Spectrum phi = flux * bsdf->f( pixel.wo , wi );
+				atomicAdd( pixel.phi[0] , phi.GetR() );
+				atomicAdd( pixel.phi[1] , phi.GetG() );
+				atomicAdd( pixel.phi[2] , phi.GetB() );
+				pixel.m.fetch_add( 1 , std::memory_order_relaxed );
+			});
+		}
+
+		const Bsdf* bsdf = inter.primitive->GetMaterial()->GetBsdf( &inter );
+		float	pdf = 0.0f;
+		Vector	wo;
+		const Spectrum f = bsdf->sample_f( wi , wo , BsdfSample(true) , &pdf );
+		if( f.IsBlack() || pdf == 0.0f )
+			break;
+
+		// photons are terminated as their flux drops , the survivors keep the flux they had
+		const Spectrum next = flux * f * AbsDot( wo , inter.normal ) / pdf;
+		const float q = max( 0.0f , 1.0f - next.GetIntensity() / flux.GetIntensity() );
+		if( sort_canonical() < q )
+			break;
+		flux = next / ( 1.0f - q );
+
+		r = inter.SpawnRay( wo );
+	}
+}
+
+// output log information
+void StochasticPPM::OutputLog() const
+{
+	slog( INFO , INTEGRATOR , "Integrator algorithm : stochastic progressive photon mapping." );
+	slog( INFO , INTEGRATOR , stringFormat( "Every iteration traces %d photons, the radius shrinks with alpha %f." , ( m_photonCnt > 0 ) ? m_photonCnt : m_width * m_height , m_alpha ) );
+}
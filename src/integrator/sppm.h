@@ -0,0 +1,163 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "integrator.h"
+#include "geometry/intersection.h"
+#include "accel/hashgrid.h"
+#include "utility/memstats.h"
+#include <atomic>
+#include <memory>
+
+// the statistics and the visible point of a pixel
+struct SPPM_Pixel
+{
+	// statistics of the finished iterations
+	float					radius = 0.0f;		// the gathering radius
+	float					n = 0.0f;			// the number of photons gathered so far , it is reduced with the radius
+	Spectrum				tau;				// the flux of the photons gathered so far
+
+	// the visible point of the current iteration
+	Intersection			inter;				// the first hit with a diffuse lobe along the camera path
+	Vector					wo;					// the direction toward the camera
+	Spectrum				throughput;			// the through put of the camera path
+	bool					valid = false;		// whether the camera path found a visible point
+
+	// photons gathered by the visible point in the current iteration , they are added from all threads
+	std::atomic<float>		phi[3];
+	std::atomic<unsigned>	m;
+};
+
+///////////////////////////////////////////////////////////////////////////////////
+// definition of stochastic progressive photon mapping
+// note : every sample per pixel of a pass is an iteration of photon mapping. Before the tiles of
+//		  a pass are rendered , each iteration traces a camera path for every pixel to its visible
+//		  point , the first surface with a diffuse lobe , and hashes the visible points in a uniform
+//		  grid. Photons traced in parallel add their flux to the visible points around them , then
+//		  the radius of each pixel shrinks with the photons it gathered. The tiles add the direct
+//		  lighting of the camera paths to the photon estimate of their pixels. Unlike vertex merging ,
+//		  the memory only depends on the number of pixels , no matter how many photons are traced.
+//		  Please refer to "Stochastic Progressive Photon Mapping" by Hachisuka and Jensen for details.
+class StochasticPPM : public Integrator
+{
+// public method
+public:
+	DEFINE_CREATOR( StochasticPPM , Integrator , "sppm" );
+
+	// default constructor
+	StochasticPPM() {
+		_registerProperty( "sppm_radius" , new RadiusProperty(this) );
+		_registerProperty( "sppm_alpha" , new AlphaProperty(this) );
+		_registerProperty( "sppm_photons" , new PhotonsProperty(this) );
+	}
+
+	// return the radiance of a specific direction
+	// para 'ray'   : ray with specific direction
+	// para 'ps'    : the pixel sample
+	// result       : radiance along the ray from the scene
+	virtual Spectrum	Li( const Ray& ray , const PixelSample& ps ) const;
+
+	// allocate the statistics of the pixels
+	virtual void PreProcess();
+
+	// run the iterations of photon mapping of a pass
+	// para 'spp' : the number of samples per pixel in the pass , it is the number of iterations
+	virtual void BeginPass( unsigned spp );
+
+	// output log information
+	virtual void OutputLog() const;
+
+// private field
+private:
+	// the gathering radius of the first iteration , it is derived from the size of the scene by default
+	float		m_baseRadius = 0.0f;
+	// the fraction of the photons of an iteration kept while the radius shrinks
+	float		m_alpha = 0.666667f;
+	// the number of photons traced for every iteration , it is the number of pixels by default
+	unsigned	m_photonCnt = 0;
+
+	// the size of the image
+	unsigned	m_width = 0;
+	unsigned	m_height = 0;
+	// the statistics of the pixels
+	std::unique_ptr<SPPM_Pixel[]>	m_pixels;
+	// the grid over the visible points of the current iteration
+	HashGrid						m_grid;
+	// the pixels of the points in the grid
+	vector<unsigned>				m_owners;
+	// the number of finished iterations
+	unsigned						m_iterationCnt = 0;
+	// the number of photons traced in the finished iterations
+	unsigned long long				m_emittedCnt = 0;
+	// the memory of the pixels and the grid
+	MemoryTracker					m_memory{ MEM_PHOTON };
+
+	// run one iteration of photon mapping
+	// para 'iteration' : the index of the iteration in the pass
+	// result           : the largest radius of the visible points
+	float _iterate( unsigned iteration );
+
+	// trace a camera path through glossy surfaces to the first surface with a diffuse lobe
+	// para 'ray' : the camera ray
+	// para 'ps'  : the pixel sample , it is null while visible points are traced
+	// para 'vp'  : the pixel whose visible point is recorded , it is null while tiles are rendered
+	// result     : the radiance emitted by the first hit and the direct lighting along the path
+	Spectrum _tracePath( const Ray& ray , const PixelSample* ps , SPPM_Pixel* vp ) const;
+
+	// trace a photon and add its flux to the visible points around its hits
+	void _tracePhoton() const;
+
+	// Radius Property
+	class RadiusProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(RadiusProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			StochasticPPM* sppm = CAST_TARGET(StochasticPPM);
+			if( sppm )
+				sppm->m_baseRadius = max( 0.0f , (float)atof( str.c_str() ) );
+		}
+	};
+
+	// Radius reduction Property
+	class AlphaProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(AlphaProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			StochasticPPM* sppm = CAST_TARGET(StochasticPPM);
+			if( sppm )
+				sppm->m_alpha = min( 1.0f , max( 0.0f , (float)atof( str.c_str() ) ) );
+		}
+	};
+
+	// Photons Property
+	class PhotonsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(PhotonsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			StochasticPPM* sppm = CAST_TARGET(StochasticPPM);
+			if( sppm )
+				sppm->m_photonCnt = max( 0 , atoi( str.c_str() ) );
+		}
+	};
+};
@@ -0,0 +1,464 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "sort.h"
+#include "vcm.h"
+#include "geometry/scene.h"
+#include "light/light.h"
+#include "bsdf/bsdf.h"
+#include "camera/camera.h"
+#include "imagesensor/imagesensor.h"
+#include "utility/multithread/threadpool.h"
+#include "log/log.h"
+
+IMPLEMENT_CREATOR( VertexConnectionMerging );
+
+// return the radiance of a specific direction
+Spectrum VertexConnectionMerging::Li( const Ray& ray , const PixelSample& ps ) const
+{
+	// the eye path picks a light for itself , lights hit by it are all counted
+	float pick_pdf = 0.0f;
+	const Light* light = scene.SampleLight( sort_canonical() , &pick_pdf );
+
+	Spectrum li;
+	Ray wi = ray;
+	Spectrum throughput = 1.0f;
+	float vc = 0.0f;
+	float vm = 0.0f;
+	float vcm = MIS( m_pathRatio / camera->GetRayImportance( ray ).pdfW );
+	int depth = 0;
+	while( depth <= max_recursive_depth )
+	{
+		BDPT_Vertex vert;
+		vert.depth = depth;
+		if( false == scene.GetIntersect( wi , &vert.inter ) )
+		{
+			const Light* sky = scene.GetSkyLight();
+			if( depth == 0 )
+				li += scene.Le( wi );
+			else if( sky )
+			{
+				float emissionPdf;
+				float directPdfA;
+				const Spectrum le = sky->Le( vert.inter , -wi.m_Dir , &directPdfA , &emissionPdf );
+				const float pick = sky->PickPDF();
+				li += throughput * le / ( 1.0f + MIS( directPdfA * pick ) * vcm + MIS( emissionPdf * pick ) * vc );
+			}
+			break;
+		}
+
+		const float distSqr = vert.inter.t * vert.inter.t;
+		const float cosIn = AbsDot( wi.m_Dir , vert.inter.normal );
+		vcm *= MIS( distSqr );
+		vcm /= MIS( cosIn );
+		vc /= MIS( cosIn );
+		vm /= MIS( cosIn );
+
+		//-----------------------------------------------------------------------------------------------------
+		// Path evaluation: it hits a light source
+		const Light* hit = vert.inter.primitive->GetLight();
+		if( hit )
+		{
+			if( depth == 0 )
+				li += vert.inter.Le( -wi.m_Dir );
+			else
+			{
+				float emissionPdf;
+				float directPdfA;
+				const Spectrum le = vert.inter.Le( -wi.m_Dir , &directPdfA , &emissionPdf );
+				const float pick = hit->PickPDF();
+				li += throughput * le / ( 1.0f + MIS( directPdfA * pick ) * vcm + MIS( emissionPdf * pick ) * vc );
+			}
+		}
+
+		vert.p = vert.inter.intersect;
+		vert.n = vert.inter.normal;
+		vert.wi = -wi.m_Dir;
+		vert.bsdf = vert.inter.primitive->GetMaterial()->GetBsdf( &vert.inter );
+		vert.throughput = throughput;
+		vert.vc = vc;
+		vert.vcm = vcm;
+		vert.vm = vm;
+		vert.rr = ( throughput.GetIntensity() < 0.01f ) ? 0.5f : 1.0f;
+
+		//-----------------------------------------------------------------------------------------------------
+		// Path evaluation: connect light sample , light vertices and merge with light vertices
+		if( light && pick_pdf > 0.0f )
+			li += _ConnectLight( vert , light , pick_pdf );
+		li += _ConnectPool( vert );
+		li += _MergeVertices( vert );
+
+		++depth;
+		if( !_SampleScattering( vert , throughput , vc , vcm , vm ) )
+			break;
+		wi = vert.inter.SpawnRay( vert.wo );
+	}
+
+	return li;
+}
+
+// trace the light paths and build the grid of light vertices for a pass
+void VertexConnectionMerging::BeginPass( unsigned spp )
+{
+	const unsigned total_pixel = camera->GetImageSensor()->GetWidth() * camera->GetImageSensor()->GetHeight();
+	m_passPathCnt = ( m_pathCnt > 0 ) ? m_pathCnt : total_pixel;
+	m_pathRatio = (float)m_passPathCnt / (float)max( spp , 1u );
+
+	// the radius shrinks with the number of passes
+	if( m_baseRadius <= 0.0f )
+	{
+		const BBox& bbox = scene.GetBBox();
+		m_baseRadius = 0.003f * 0.5f * ( bbox.m_Max - bbox.m_Min ).Length();
+	}
+	m_radius = max( m_baseRadius * pow( (float)( m_passCnt + 1 ) , 0.5f * ( m_alpha - 1.0f ) ) , 1e-7f );
+	++m_passCnt;
+
+	// merging weighted against connection by the number of light paths it takes in the disk of the radius
+	const float eta = PI * m_radius * m_radius * (float)m_passPathCnt;
+	m_vmNormalization = 1.0f / eta;
+	m_misVmWeight = MIS( eta );
+	m_misVcWeight = MIS( 1.0f / eta );
+
+	// light paths are traced in parallel , the vertices of each chunk are gathered in the order of the chunks
+	struct Pool_Chunk
+	{
+		vector<LVC_Vertex>	vertices;
+		vector<VCM_Photon>	photons;
+		vector<Point>		points;
+	};
+	const unsigned grain = 256;
+	vector<Pool_Chunk> chunks( ParallelChunkCount( m_passPathCnt , grain ) );
+	ParallelFor( 0 , m_passPathCnt , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		Pool_Chunk& pool = chunks[chunk];
+		vector<BDPT_Vertex> light_path;
+		for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+		{
+			// bsdfs of the light path are only needed while it is traced
+			MemScope mem_scope;
+			sort_reseed( i , SORT_RAND_PARALLEL , 0 );
+			light_path.clear();
+			_TraceLightPath( light_path );
+			for( const BDPT_Vertex& vert : light_path )
+			{
+				LVC_Vertex lv;
+				lv.Pack( vert );
+				pool.vertices.push_back( lv );
+
+				VCM_Photon photon;
+				photon.wi = vert.wi;
+				photon.throughput = vert.throughput;
+				photon.vcm = vert.vcm;
+				photon.vm = vert.vm;
+				photon.depth = vert.depth;
+				pool.photons.push_back( photon );
+				pool.points.push_back( vert.p );
+			}
+		}
+	});
+
+	size_t count = 0;
+	for( const auto& chunk : chunks )
+		count += chunk.vertices.size();
+	vector<VCM_Photon> photons;
+	vector<Point> points;
+	m_lightVertices.clear();
+	m_lightVertices.reserve( count );
+	photons.reserve( count );
+	points.reserve( count );
+	for( const auto& chunk : chunks )
+	{
+		m_lightVertices.insert( m_lightVertices.end() , chunk.vertices.begin() , chunk.vertices.end() );
+		photons.insert( photons.end() , chunk.photons.begin() , chunk.photons.end() );
+		points.insert( points.end() , chunk.points.begin() , chunk.points.end() );
+	}
+
+	// photons are stored in the order of the grid so that range queries read contiguous memory
+	m_grid.Build( points , m_radius );
+	m_photons.resize( count );
+	ParallelFor( 0 , (unsigned)count , 4096 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		for( unsigned slot = chunk_start ; slot < chunk_end ; ++slot )
+			m_photons[slot] = photons[ m_grid.GetIndex( slot ) ];
+	});
+
+	// by default , eye vertices connect to as many vertices as an average light path holds
+	m_passConnections = m_connections;
+	if( m_passConnections == 0 )
+		m_passConnections = max( 1u , (unsigned)( (float)count / (float)m_passPathCnt + 0.5f ) );
+
+	slog( DEBUG , INTEGRATOR , stringFormat( "Pass %d of vertex connection and merging holds %d light vertices of %d light paths, merging radius is %f." , m_passCnt , (int)count , m_passPathCnt , m_radius ) );
+}
+
+// trace a light path and connect its vertices to the camera
+void VertexConnectionMerging::_TraceLightPath( vector<BDPT_Vertex>& light_path ) const
+{
+	// pick a light randomly
+	float pick_pdf;
+	const Light* light = scene.SampleLight( sort_canonical() , &pick_pdf );
+	if( light == 0 || pick_pdf == 0.0f )
+		return;
+
+	float	emission_pdf = 0.0f;
+	float	pdfa = 0.0f;
+	float	cosAtLight = 1.0f;
+	Ray		wi;
+	const Spectrum le = light->sample_l( LightSample(true) , wi , &emission_pdf , &pdfa , &cosAtLight );
+	if( emission_pdf == 0.0f || le.IsBlack() )
+		return;
+
+	// the probability of picking the light is a part of the pdfs of the light sample
+	emission_pdf *= pick_pdf;
+	pdfa *= pick_pdf;
+
+	Spectrum throughput = le * cosAtLight / emission_pdf;
+	float vc = ( light->IsDelta() ) ? 0.0f : MIS( cosAtLight / emission_pdf );
+	float vcm = MIS( pdfa / emission_pdf );
+	float vm = vc * m_misVcWeight;
+	while( (int)light_path.size() < max_recursive_depth )
+	{
+		BDPT_Vertex vert;
+		if( false == scene.GetIntersect( wi , &vert.inter ) )
+			break;
+
+		const float distSqr = vert.inter.t * vert.inter.t;
+		const float cosIn = AbsDot( wi.m_Dir , vert.inter.normal );
+
+		// area lights may sample their points by solid angle , the density of sampling the light point directly depends on the first vertex
+		if( light_path.empty() && !light->IsDelta() && !light->IsInfinite() )
+			vcm = MIS( light->Pdf( vert.inter.SpawnOrigin( -wi.m_Dir ) , -wi.m_Dir ) * pick_pdf * cosAtLight / ( distSqr * emission_pdf ) );
+		if( light_path.size() > 0 || !light->IsInfinite() )
+			vcm *= MIS( distSqr );
+		vcm /= MIS( cosIn );
+		vc /= MIS( cosIn );
+		vm /= MIS( cosIn );
+
+		vert.p = vert.inter.intersect;
+		vert.n = vert.inter.normal;
+		vert.wi = -wi.m_Dir;
+		vert.bsdf = vert.inter.primitive->GetMaterial()->GetBsdf( &vert.inter );
+		vert.throughput = throughput;
+		vert.vc = vc;
+		vert.vcm = vcm;
+		vert.vm = vm;
+		vert.rr = ( throughput.GetIntensity() < 0.01f ) ? 0.5f : 1.0f;
+		vert.depth = (int)light_path.size() + 1;
+		light_path.push_back( vert );
+
+		//-----------------------------------------------------------------------------------------------------
+		// Path evaluation: light tracing
+		_ConnectCamera( vert );
+
+		if( !_SampleScattering( light_path.back() , throughput , vc , vcm , vm ) )
+			break;
+		wi = vert.inter.SpawnRay( light_path.back().wo );
+	}
+}
+
+// sample the next direction of a path
+bool VertexConnectionMerging::_SampleScattering( BDPT_Vertex& vert , Spectrum& throughput , float& vc , float& vcm , float& vm ) const
+{
+	// russian roulette
+	if( sort_canonical() > vert.rr )
+		return false;
+
+	float bsdf_pdf;
+	const Spectrum bsdf_value = vert.bsdf->sample_f( vert.wi , vert.wo , BsdfSample(true) , &bsdf_pdf , BXDF_ALL );
+	bsdf_pdf *= vert.rr;
+	if( bsdf_pdf == 0.0f || bsdf_value.IsBlack() )
+		return false;
+
+	const float cosOut = AbsDot( vert.wo , vert.n );
+	throughput *= bsdf_value * ( cosOut / bsdf_pdf );
+	if( throughput.IsBlack() )
+		return false;
+
+	const float rev_bsdf_pdfw = vert.bsdf->Pdf( vert.wo , vert.wi ) * vert.rr;
+	vc = MIS( cosOut / bsdf_pdf ) * ( MIS( rev_bsdf_pdfw ) * vc + vcm + m_misVmWeight );
+	vm = MIS( cosOut / bsdf_pdf ) * ( MIS( rev_bsdf_pdfw ) * vm + vcm * m_misVcWeight + 1.0f );
+	vcm = MIS( 1.0f / bsdf_pdf );
+	return true;
+}
+
+// connect a light vertex to the camera
+void VertexConnectionMerging::_ConnectCamera( const BDPT_Vertex& light_vertex ) const
+{
+	if( light_vertex.depth > max_recursive_depth )
+		return;
+
+	Visibility visible( scene );
+	float camera_pdfA;
+	float camera_pdfW;
+	float cosAtCamera;
+	Spectrum we;
+	Point eye_point;
+	const Vector2i coord = camera->GetScreenCoord( light_vertex.inter.intersect , &camera_pdfW , &camera_pdfA , &cosAtCamera , &we , &eye_point , &visible );
+	visible.ray = light_vertex.inter.SpawnRayTo( eye_point );
+
+	const Vector delta = light_vertex.inter.intersect - eye_point;
+	const float invSqrLen = 1.0f / delta.SquaredLength();
+	const Vector n_delta = delta * sqrt( invSqrLen );
+	const float cosAtLightVertex = AbsDot( light_vertex.n , n_delta );
+
+	if( Dot( delta , camera->GetForward() ) <= 0.0f )
+		return;
+
+	ImageSensor* is = camera->GetImageSensor();
+	if( !is || coord.x < 0 || coord.y < 0 || coord.x >= (int)is->GetWidth() || coord.y >= (int)is->GetHeight() || camera_pdfW == 0.0f )
+		return;
+
+	const Spectrum bsdf_value = light_vertex.bsdf->f( light_vertex.wi , -n_delta );
+	if( bsdf_value.IsBlack() )
+		return;
+
+	if( visible.IsVisible() == false )
+		return;
+
+	// radiance is splatted for every light path of the pass
+	const float gterm = cosAtCamera * cosAtLightVertex * invSqrLen;
+	Spectrum radiance = light_vertex.throughput * bsdf_value * we * gterm / ( (float)m_passPathCnt * camera_pdfA );
+
+	const float lightvert_pdfA = camera_pdfW * cosAtLightVertex * invSqrLen;
+	const float bsdf_rev_pdfw = light_vertex.bsdf->Pdf( -n_delta , light_vertex.wi ) * light_vertex.rr;
+	const float w_light = ( m_misVmWeight + light_vertex.vcm + light_vertex.vc * MIS( bsdf_rev_pdfw ) ) * MIS( lightvert_pdfA / m_pathRatio );
+	radiance /= 1.0f + w_light;
+
+	is->UpdatePixel( coord.x , coord.y , radiance );
+}
+
+// connect an eye vertex to a sample on a light
+Spectrum VertexConnectionMerging::_ConnectLight( const BDPT_Vertex& eye_vertex , const Light* light , float pick_pdf ) const
+{
+	if( eye_vertex.depth >= max_recursive_depth )
+		return 0.0f;
+
+	const LightSample sample(true);
+	Vector wi;
+	Visibility visibility( scene );
+	float directPdfW = 0.0f;
+	float emissionPdfW;
+	float cosAtLight;
+	Spectrum li = light->sample_l( eye_vertex.inter , &sample , wi , 0 , &directPdfW , &emissionPdfW , &cosAtLight , visibility );
+	if( directPdfW == 0.0f || li.IsBlack() )
+		return 0.0f;
+
+	const float cosAtEyeVertex = AbsDot( eye_vertex.n , wi );
+	li *= eye_vertex.throughput * eye_vertex.bsdf->f( eye_vertex.wi , wi ) * ( cosAtEyeVertex / ( directPdfW * pick_pdf ) );
+	if( li.IsBlack() )
+		return 0.0f;
+
+	if( visibility.IsVisible() == false )
+		return 0.0f;
+
+	const float eye_bsdf_pdfw = eye_vertex.bsdf->Pdf( eye_vertex.wi , wi ) * eye_vertex.rr;
+	const float eye_bsdf_rev_pdfw = eye_vertex.bsdf->Pdf( wi , eye_vertex.wi ) * eye_vertex.rr;
+
+	const float w_light = light->IsDelta() ? 0.0f : MIS( eye_bsdf_pdfw / ( directPdfW * pick_pdf ) );
+	const float w_camera = MIS( cosAtEyeVertex * emissionPdfW / ( cosAtLight * directPdfW ) ) * ( m_misVmWeight + eye_vertex.vcm + eye_vertex.vc * MIS( eye_bsdf_rev_pdfw ) );
+
+	return li / ( w_light + 1.0f + w_camera );
+}
+
+// connect an eye vertex to vertices picked from the pool
+Spectrum VertexConnectionMerging::_ConnectPool( const BDPT_Vertex& eye_vertex ) const
+{
+	const unsigned count = (unsigned)m_lightVertices.size();
+	if( count == 0 )
+		return 0.0f;
+
+	// vertices are picked uniformly , the sum is scaled to the connections of one light path in average
+	Spectrum li;
+	for( unsigned i = 0 ; i < m_passConnections ; ++i )
+	{
+		const LVC_Vertex& lv = m_lightVertices[ min( (unsigned)( sort_canonical() * count ) , count - 1 ) ];
+
+		MemScope mem_scope;
+		BDPT_Vertex vert;
+		lv.Unpack( vert );
+		li += _ConnectVertices( vert , eye_vertex );
+	}
+	return li * ( (float)count / ( (float)m_passPathCnt * (float)m_passConnections ) );
+}
+
+// connect a light vertex and an eye vertex
+Spectrum VertexConnectionMerging::_ConnectVertices( const BDPT_Vertex& p0 , const BDPT_Vertex& p1 ) const
+{
+	if( p0.depth + p1.depth >= max_recursive_depth )
+		return 0.0f;
+
+	const Vector delta = p0.p - p1.p;
+	const float invDistcSqr = 1.0f / delta.SquaredLength();
+	const Vector n_delta = delta * sqrt( invDistcSqr );
+
+	const float cosAtP0 = AbsDot( p0.n , n_delta );
+	const float cosAtP1 = AbsDot( p1.n , n_delta );
+	const Spectrum g = p1.bsdf->f( p1.wi , n_delta ) * p0.bsdf->f( -n_delta , p0.wi ) * ( cosAtP0 * cosAtP1 * invDistcSqr );
+	if( g.IsBlack() )
+		return 0.0f;
+
+	const float p0_bsdf_pdfw = p0.bsdf->Pdf( p0.wi , -n_delta ) * p0.rr;
+	const float p0_bsdf_rev_pdfw = p0.bsdf->Pdf( -n_delta , p0.wi ) * p0.rr;
+	const float p1_bsdf_pdfw = p1.bsdf->Pdf( p1.wi , n_delta ) * p1.rr;
+	const float p1_bsdf_rev_pdfw = p1.bsdf->Pdf( n_delta , p1.wi ) * p1.rr;
+
+	const float p0_a = p1_bsdf_pdfw * cosAtP0 * invDistcSqr;
+	const float p1_a = p0_bsdf_pdfw * cosAtP1 * invDistcSqr;
+
+	const float mis_0 = MIS( p0_a ) * ( m_misVmWeight + p0.vcm + p0.vc * MIS( p0_bsdf_rev_pdfw ) );
+	const float mis_1 = MIS( p1_a ) * ( m_misVmWeight + p1.vcm + p1.vc * MIS( p1_bsdf_rev_pdfw ) );
+
+	const Spectrum li = p0.throughput * p1.throughput * g / ( mis_0 + 1.0f + mis_1 );
+	if( li.IsBlack() )
+		return li;
+
+	Visibility visible( scene );
+	// both ends leave their surfaces beyond the rounding errors
+	visible.ray = p1.inter.SpawnRayTo( p0.inter.SpawnOrigin( -n_delta ) );
+	if( visible.IsVisible() == false )
+		return 0.0f;
+
+	return li;
+}
+
+// merge an eye vertex with the light vertices around it
+Spectrum VertexConnectionMerging::_MergeVertices( const BDPT_Vertex& eye_vertex ) const
+{
+	if( m_photons.empty() )
+		return 0.0f;
+
+	Spectrum li;
+	m_grid.Query( eye_vertex.p , [&]( unsigned slot ){
+		const VCM_Photon& photon = m_photons[slot];
+		if( photon.depth + eye_vertex.depth > max_recursive_depth )
+			return;
+
+		const Spectrum f = eye_vertex.bsdf->f( eye_vertex.wi , photon.wi );
+		if( f.IsBlack() )
+			return;
+
+		const float eye_bsdf_pdfw = eye_vertex.bsdf->Pdf( eye_vertex.wi , photon.wi ) * eye_vertex.rr;
+		const float eye_bsdf_rev_pdfw = eye_vertex.bsdf->Pdf( photon.wi , eye_vertex.wi ) * eye_vertex.rr;
+		const float w_light = photon.vcm * m_misVcWeight + photon.vm * MIS( eye_bsdf_pdfw );
+		const float w_camera = eye_vertex.vcm * m_misVcWeight + eye_vertex.vm * MIS( eye_bsdf_rev_pdfw );
+		li += f * photon.throughput / ( w_light + 1.0f + w_camera );
+	});
+	return li * eye_vertex.throughput * m_vmNormalization;
+}
+
+// output log information
+void VertexConnectionMerging::OutputLog() const
+{
+	slog( INFO , INTEGRATOR , "Integrator algorithm : vertex connection and merging." );
+}
@@ -0,0 +1,195 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "bidirpath.h"
+#include "accel/hashgrid.h"
+
+// light vertex found by range queries for vertex merging
+struct VCM_Photon
+{
+	Vector		wi;                 // in direction
+	Spectrum	throughput;         // through put
+	float		vcm = 0.0f;         // MIS factors
+	float		vm = 0.0f;
+	int			depth = 0;          // depth of the vertex
+};
+
+///////////////////////////////////////////////////////////////////////////////////
+// definition of vertex connection and merging
+// note : vertex merging is combined with bidirectional path tracing with multiple importance
+//		  sampling. Before every pass , a pool of light paths is traced in parallel , their
+//		  vertices are splatted to the camera and stored in a hashed uniform grid. Eye vertices
+//		  connect to vertices picked from the pool and merge with the vertices around them , the
+//		  merging radius shrinks pass after pass so that the result converges. Please refer to the
+//		  paper "Light Transport Simulation with Vertex Connection and Merging" by Georgiev et al.
+//		  and "Implementing Vertex Connection and Merging" for further details. It works best
+//		  with progressive rendering of few samples per pass.
+class VertexConnectionMerging : public Integrator
+{
+// public method
+public:
+	DEFINE_CREATOR( VertexConnectionMerging , Integrator , "vcm" );
+
+	// default constructor
+	VertexConnectionMerging() {
+		_registerProperty( "vcm_radius" , new RadiusProperty(this) );
+		_registerProperty( "vcm_alpha" , new AlphaProperty(this) );
+		_registerProperty( "vcm_paths" , new PathsProperty(this) );
+		_registerProperty( "vcm_connections" , new ConnectionsProperty(this) );
+	}
+
+	// return the radiance of a specific direction
+	// para 'ray'   : ray with specific direction
+	// para 'ps'    : the pixel sample
+	// result       : radiance along the ray from the scene
+	virtual Spectrum	Li( const Ray& ray , const PixelSample& ps ) const;
+
+	// trace the light paths and build the grid of light vertices for a pass
+	// para 'spp' : the number of samples per pixel in the pass
+	virtual void BeginPass( unsigned spp );
+
+	// support pending write
+	virtual bool SupportPendingWrite() { return true; }
+
+	// output log information
+	virtual void OutputLog() const;
+
+// private field
+private:
+	// the merging radius of the first pass , it is derived from the size of the scene by default
+	float		m_baseRadius = 0.0f;
+	// the rate the merging radius shrinks in
+	float		m_alpha = 0.75f;
+	// the number of light paths traced for every pass , it is the number of pixels by default
+	unsigned	m_pathCnt = 0;
+	// the number of pool vertices each eye vertex connects to , it is the average light path length by default
+	unsigned	m_connections = 0;
+
+	// the number of finished passes
+	unsigned	m_passCnt = 0;
+	// the merging radius of the current pass
+	float		m_radius = 0.0f;
+	// the number of light paths traced for the current pass
+	unsigned	m_passPathCnt = 0;
+	// the number of connections of the current pass
+	unsigned	m_passConnections = 1;
+	// the number of light paths per eye path of a pixel , it weights light tracing against the other strategies
+	float		m_pathRatio = 0.0f;
+	// normalization of merging
+	float		m_vmNormalization = 0.0f;
+	// MIS factors weighting merging and connection against each other
+	float		m_misVmWeight = 0.0f;
+	float		m_misVcWeight = 0.0f;
+
+	// the light vertices of the current pass , they are used for connection
+	vector<LVC_Vertex>	m_lightVertices;
+	// the light vertices in the order of the slots of the grid , they are used for merging
+	vector<VCM_Photon>	m_photons;
+	// the grid over the light vertices
+	HashGrid			m_grid;
+
+	// trace a light path and connect its vertices to the camera
+	// para 'light_path' : the vertices of the light path ( output )
+	void _TraceLightPath( vector<BDPT_Vertex>& light_path ) const;
+
+	// connect a light vertex to the camera
+	// para 'light_vertex' : the light vertex
+	void _ConnectCamera( const BDPT_Vertex& light_vertex ) const;
+
+	// connect an eye vertex to a sample on a light
+	// para 'eye_vertex' : the eye vertex
+	// para 'light'      : the light picked for the eye path
+	// para 'pick_pdf'   : the probability of picking the light
+	Spectrum _ConnectLight( const BDPT_Vertex& eye_vertex , const Light* light , float pick_pdf ) const;
+
+	// connect an eye vertex to vertices picked from the pool
+	// para 'eye_vertex' : the eye vertex
+	// result            : the radiance of the connections , it estimates the connections to a whole light path
+	Spectrum _ConnectPool( const BDPT_Vertex& eye_vertex ) const;
+
+	// connect a light vertex and an eye vertex
+	Spectrum _ConnectVertices( const BDPT_Vertex& light_vertex , const BDPT_Vertex& eye_vertex ) const;
+
+	// merge an eye vertex with the light vertices around it
+	// para 'eye_vertex' : the eye vertex
+	// result            : the radiance of merging
+	Spectrum _MergeVertices( const BDPT_Vertex& eye_vertex ) const;
+
+	// sample the next direction of a path , MIS factors of the vertex are updated
+	// para 'vert'       : the vertex
+	// para 'throughput' : the through put of the path
+	// para 'vc' , 'vcm' , 'vm' : MIS factors of the path
+	// result            : false if the path is terminated
+	bool _SampleScattering( BDPT_Vertex& vert , Spectrum& throughput , float& vc , float& vcm , float& vm ) const;
+
+	// mis factor
+	float MIS( float t ) const { return t * t; }
+
+	// Merging radius Property
+	class RadiusProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(RadiusProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			VertexConnectionMerging* vcm = CAST_TARGET(VertexConnectionMerging);
+			if( vcm )
+				vcm->m_baseRadius = max( 0.0f , (float)atof( str.c_str() ) );
+		}
+	};
+
+	// Radius reduction Property
+	class AlphaProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(AlphaProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			VertexConnectionMerging* vcm = CAST_TARGET(VertexConnectionMerging);
+			if( vcm )
+				vcm->m_alpha = min( 1.0f , max( 0.0f , (float)atof( str.c_str() ) ) );
+		}
+	};
+
+	// Light paths Property
+	class PathsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(PathsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			VertexConnectionMerging* vcm = CAST_TARGET(VertexConnectionMerging);
+			if( vcm )
+				vcm->m_pathCnt = max( 0 , atoi( str.c_str() ) );
+		}
+	};
+
+	// Connections Property
+	class ConnectionsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(ConnectionsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			VertexConnectionMerging* vcm = CAST_TARGET(VertexConnectionMerging);
+			if( vcm )
+				vcm->m_connections = max( 0 , atoi( str.c_str() ) );
+		}
+	};
+};
@@ -0,0 +1,381 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header file
+#include "wavefrontpt.h"
+#include "geometry/intersection.h"
+#include "geometry/scene.h"
+#include "bsdf/bsdf.h"
+#include "light/light.h"
+#include "material/shadingqueue.h"
+#include "integratormethod.h"
+#include "log/log.h"
+#include "utility/statsreport.h"
+#include <algorithm>
+#include <chrono>
+
+IMPLEMENT_CREATOR( WavefrontPathTracing );
+
+static const unsigned WAVEFRONT_MIN_PART = 256;		// streams traced asynchronously are only split if both parts have at least this many rays
+static const unsigned WAVEFRONT_SORT_MIN = 64;		// streams with fewer live rays than this are not sorted
+static const unsigned WAVEFRONT_SORT_CONTROL = 8;	// one stream out of this many is left unsorted to measure the time of the unsorted order
+
+// the key of a ray and its index in the stream
+struct Ray_Key
+{
+	unsigned long long	key;
+	unsigned			index;
+};
+
+// spread the lower 10 bits of a value so that there are two zero bits between each of them
+static inline unsigned long long expandBits( unsigned v )
+{
+	unsigned long long x = v & 0x3ff;
+	x = ( x | ( x << 16 ) ) & 0x30000ff;
+	x = ( x | ( x << 8 ) ) & 0x300f00f;
+	x = ( x | ( x << 4 ) ) & 0x30c30c3;
+	x = ( x | ( x << 2 ) ) & 0x9249249;
+	return x;
+}
+
+// nanoseconds since an arbitrary point
+static inline unsigned long long nanoseconds()
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// radiance along a stream of rays
+void WavefrontPathTracing::LiStream( const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned count ) const
+{
+	// the states of the live paths , they are compacted after each bounce
+	Path_State* paths = SORT_MALLOC_ARRAY( Path_State , count );
+	Path_State* sorted_paths = m_sort ? SORT_MALLOC_ARRAY( Path_State , count ) : 0;
+	Ray* bounce_rays = SORT_MALLOC_ARRAY( Ray , count );
+	Intersection* inters = SORT_MALLOC_ARRAY( Intersection , count );
+	bool* alive = SORT_MALLOC_ARRAY( bool , count );
+	Bsdf** bsdfs = SORT_MALLOC_ARRAY( Bsdf* , count );
+
+	// each hit spawns at most two shadow rays , one samples the light and the other one samples the bsdf
+	Shadow_Ray* shadows = SORT_MALLOC_ARRAY( Shadow_Ray , 2 * count );
+	Ray* shadow_rays = SORT_MALLOC_ARRAY( Ray , 2 * count );
+	bool* occluded = SORT_MALLOC_ARRAY( bool , 2 * count );
+
+	for( unsigned i = 0 ; i < count ; ++i ){
+		radiance[i] = 0.0f;
+		new (&paths[i]) Path_State();
+		paths[i].ray = rays[i];
+		paths[i].throughput = 1.0f;
+		paths[i].id = i;
+	}
+
+	unsigned live = count;
+	for( int bounces = 0 ; live > 0 ; ++bounces )
+	{
+		// the rays of the bounces are scattered in all directions , they are sorted so that neighbor rays visit the same nodes
+		// note : camera rays are coherent already , the order of the tiles is kept for them
+		bool timed = false;
+		bool control = false;
+		if( m_sort && bounces > 0 && live >= WAVEFRONT_SORT_MIN ){
+			control = ( m_streams++ % WAVEFRONT_SORT_CONTROL ) == WAVEFRONT_SORT_CONTROL - 1;
+			_sortPaths( paths , sorted_paths , live , control );
+			timed = !scene.IsStreamAsync();
+		}
+
+		// intersect the rays of all live paths together
+		for( unsigned k = 0 ; k < live ; ++k ){
+			new (&bounce_rays[k]) Ray( paths[k].ray );
+			new (&inters[k]) Intersection();
+		}
+
+		// if the stream is traced asynchronously , it is split in two parts so that one part is traced while the other one is shaded
+		const unsigned parts = ( scene.IsStreamAsync() && live >= 2 * WAVEFRONT_MIN_PART ) ? 2 : 1;
+		const unsigned split[3] = { 0 , ( parts == 2 ) ? live / 2 : live , live };
+		const unsigned long long start = timed ? nanoseconds() : 0;
+		for( unsigned p = 0 ; p < parts ; ++p )
+			scene.SubmitIntersect( p , bounce_rays + split[p] , inters + split[p] , alive + split[p] , split[p+1] - split[p] );
+
+		// only synchronous streams are timed , the intersection of asynchronous ones overlaps shading
+		if( timed ){
+			const unsigned long long elapsed = nanoseconds() - start;
+			( control ? m_controlNs : m_sortedNs ) += elapsed;
+			( control ? m_controlRays : m_sortedRays ) += live;
+		}
+
+		// the shadow rays of a part are submitted as soon as it is shaded
+		unsigned shadow_cnt = 0;
+		unsigned shadow_split[3] = { 0 , 0 , 0 };
+		for( unsigned p = 0 ; p < parts ; ++p ){
+			scene.WaitStream( p );
+			_shadeHits( bounces , ps , radiance , paths , inters , alive , bsdfs , split[p] , split[p+1] , shadows , shadow_cnt );
+
+			shadow_split[p+1] = shadow_cnt;
+			for( unsigned s = shadow_split[p] ; s < shadow_cnt ; ++s )
+				new (&shadow_rays[s]) Ray( shadows[s].ray );
+			scene.SubmitOccluded( p , shadow_rays + shadow_split[p] , occluded + shadow_split[p] , shadow_cnt - shadow_split[p] );
+		}
+
+		// gather the radiance of the shadow rays that are not blocked
+		for( unsigned p = 0 ; p < parts ; ++p )
+			scene.WaitStream( p );
+		for( unsigned s = 0 ; s < shadow_cnt ; ++s ){
+			if( !occluded[s] )
+				radiance[shadows[s].id] += shadows[s].radiance;
+		}
+
+		// keep the live paths at the front
+		unsigned next = 0;
+		for( unsigned k = 0 ; k < live ; ++k ){
+			if( alive[k] )
+				paths[next++] = paths[k];
+		}
+		live = next;
+	}
+}
+
+// the bin of a ray
+unsigned long long WavefrontPathTracing::_binOf( const Ray& r , const BBox& bbox ) const
+{
+	// the morton code of the cell of the origin
+	unsigned long long code = 0;
+	if( m_originBits > 0 ){
+		const float cells = (float)( 1u << m_originBits );
+		unsigned q[3];
+		for( int i = 0 ; i < 3 ; ++i ){
+			const float extent = bbox.m_Max[i] - bbox.m_Min[i];
+			const float t = ( extent > 0.0f ) ? ( r.m_Ori[i] - bbox.m_Min[i] ) / extent : 0.0f;
+			q[i] = (unsigned)min( cells - 1.0f , max( 0.0f , t * cells ) );
+		}
+		code = ( expandBits( q[0] ) << 2 ) | ( expandBits( q[1] ) << 1 ) | expandBits( q[2] );
+	}
+
+	// the octant of the direction , followed by its quantized magnitudes
+	unsigned long long dir = ( ( r.m_Dir.x < 0.0f ) ? 4 : 0 ) | ( ( r.m_Dir.y < 0.0f ) ? 2 : 0 ) | ( ( r.m_Dir.z < 0.0f ) ? 1 : 0 );
+	if( m_directionBits > 0 ){
+		const float cells = (float)( 1u << m_directionBits );
+		for( int i = 0 ; i < 3 ; ++i )
+			dir = ( dir << m_directionBits ) | (unsigned)min( cells - 1.0f , fabs( r.m_Dir[i] ) * cells );
+	}
+
+	return ( code << ( 3 + 3 * m_directionBits ) ) | dir;
+}
+
+// sort the live paths by the bins of their rays
+void WavefrontPathTracing::_sortPaths( Path_State*& paths , Path_State*& scratch , unsigned live , bool control ) const
+{
+	const unsigned long long start = nanoseconds();
+
+	const BBox& bbox = scene.GetBBox();
+	Ray_Key* keys = SORT_MALLOC_ARRAY( Ray_Key , live );
+	for( unsigned k = 0 ; k < live ; ++k ){
+		keys[k].key = _binOf( paths[k].ray , bbox );
+		keys[k].index = k;
+	}
+
+	// the coherence of a stream is the number of neighbor rays sharing their bins
+	unsigned before = 0;
+	for( unsigned k = 1 ; k < live ; ++k )
+		before += ( keys[k].key == keys[k-1].key );
+	m_coherentBefore += before;
+	m_pairs += live - 1;
+
+	// the streams left unsorted are the control group
+	if( control ){
+		m_coherentAfter += before;
+		return;
+	}
+
+	std::sort( keys , keys + live , []( const Ray_Key& a , const Ray_Key& b ){ return a.key < b.key || ( a.key == b.key && a.index < b.index ); } );
+
+	unsigned after = 0;
+	for( unsigned k = 0 ; k < live ; ++k ){
+		scratch[k] = paths[keys[k].index];
+		after += ( k > 0 && keys[k].key == keys[k-1].key );
+	}
+	m_coherentAfter += after;
+	std::swap( paths , scratch );
+
+	m_sortNs += nanoseconds() - start;
+}
+
+// shade the hits of a part of the stream
+void WavefrontPathTracing::_shadeHits( int bounces , const PixelSample* ps , Spectrum* radiance , Path_State* paths , const Intersection* inters ,
+									   bool* alive , Bsdf** bsdfs , unsigned begin , unsigned end , Shadow_Ray* shadows , unsigned& shadow_cnt ) const
+{
+	// paths leaving the scene end here
+	if( bounces == 0 ){
+		for( unsigned k = begin ; k < end ; ++k ){
+			if( !alive[k] )
+				radiance[paths[k].id] = scene.Le( paths[k].ray );
+		}
+	}
+
+	// the hits are grouped by their materials , the bsdfs of each material are evaluated together
+	ShadingQueue queue;
+	queue.Build( inters + begin , alive + begin , end - begin );
+	queue.Shade( inters + begin , bsdfs + begin );
+
+	// shade the hits in the same order , shadow rays are only spawned here
+	const unsigned* order = queue.GetOrder();
+	for( unsigned h = 0 ; h < queue.GetHitCount() ; ++h )
+	{
+		const unsigned k = begin + order[h];
+		Path_State& path = paths[k];
+		const Intersection& inter = inters[k];
+		const Ray& r = path.ray;
+
+		if( bounces == 0 ) radiance[path.id] += inter.Le( -r.m_Dir );
+
+		// sample the light
+		const Bsdf*		bsdf = bsdfs[k];
+		float			light_pdf = 0.0f;
+		LightSample		light_sample = ps[path.id].GetLightSample( bounces );
+		BsdfSample		bsdf_sample = ps[path.id].GetBsdfSample( 2 * bounces );
+		const Light*	light = scene.SampleLight( light_sample.t , inter , &light_pdf );
+		if( light_pdf > 0.0f )
+			_sampleDirect( r , light , inter , bsdf , light_sample , bsdf_sample , path.throughput / light_pdf , path.id , shadows , shadow_cnt );
+
+		// sample the next direction using bsdf
+		alive[k] = false;
+		float		path_pdf;
+		Vector		wi;
+		BXDF_TYPE	bxdf_type;
+		BsdfSample	_bsdf_sample = ps[path.id].GetBsdfSample( 2 * bounces + 1 );
+		const Spectrum f = bsdf->sample_f( -r.m_Dir , wi , _bsdf_sample , &path_pdf , BXDF_ALL , &bxdf_type );
+		if( f.IsBlack() || path_pdf == 0.0f )
+			continue;
+
+		// update path weight
+		path.throughput *= f * AbsDot( wi , inter.normal ) / path_pdf;
+		if( path.throughput.GetIntensity() == 0.0f )
+			continue;
+
+		if( bounces > 3 && path.throughput.GetMaxComponent() < 0.1f )
+		{
+			float continueProperbility = max( 0.05f , 1.0f - path.throughput.GetMaxComponent() );
+			if( sort_canonical() < continueProperbility )
+				continue;
+			path.throughput /= 1 - continueProperbility;
+		}
+
+		// note : the path length is limited , the same with path tracing
+		if( bounces + 1 >= max_recursive_depth )
+			continue;
+
+		SpawnRay( path.ray , inter , wi , path.ray );
+		path.ray.m_Type = ( bxdf_type & BXDF_DIFFUSE ) ? RAY_DIFFUSE : RAY_GLOSSY;
+		alive[k] = true;
+	}
+}
+
+// sample direct lighting , it is the same estimator with 'EvaluateDirect'
+void WavefrontPathTracing::_sampleDirect( const Ray& r , const Light* light , const Intersection& ip , const Bsdf* bsdf , const LightSample& ls ,
+										  const BsdfSample& bs , const Spectrum& weight , unsigned id , Shadow_Ray* shadows , unsigned& count ) const
+{
+	// lights that can't reach the point are rejected before any ray is traced
+	if( !light->Illuminates( ip ) )
+		return;
+
+	Visibility visibility(scene);
+	float light_pdf;
+	float bsdf_pdf;
+	const Vector wo = -r.m_Dir;
+	Vector wi;
+	const Spectrum li = light->sample_l( ip , &ls , wi , 0 , &light_pdf , 0 , 0 , visibility );
+	if( light_pdf > 0.0f && !li.IsBlack() )
+	{
+		const Spectrum f = bsdf->f( wo , wi );
+		const float dot = SatDot( wi , ip.normal );
+		if( f.IsBlack() == false && dot > 0.0f )
+		{
+			Shadow_Ray& shadow = shadows[count++];
+			new (&shadow) Shadow_Ray();
+			shadow.ray = visibility.ray;
+			shadow.id = id;
+			if( light->IsDelta() )
+				shadow.radiance = weight * li * f * dot / light_pdf;
+			else
+			{
+				bsdf_pdf = bsdf->Pdf( wo , wi );
+				float power_hueristic = MisFactor( 1 , light_pdf , 1 , bsdf_pdf );
+				shadow.radiance = weight * li * f * dot * power_hueristic / light_pdf;
+			}
+		}
+	}
+
+	if( light->IsDelta() )
+		return;
+
+	BXDF_TYPE bxdf_type;
+	const Spectrum f = bsdf->sample_f( wo , wi , bs , &bsdf_pdf , BXDF_ALL , &bxdf_type );
+	if( f.IsBlack() || bsdf_pdf == 0.0f )
+		return;
+
+	float mis = 1.0f;
+	if( bxdf_type )
+	{
+		const float pdf = light->Pdf( ip.SpawnOrigin( wi ) , wi );
+		if( pdf <= 0.0f )
+			return;
+		mis = MisFactor( 1 , bsdf_pdf , 1 , pdf );
+	}
+
+	Spectrum le;
+	Intersection _ip;
+	const Ray ray = ip.SpawnRay( wi );
+	if( false == light->Le( ray , &_ip , le ) )
+		return;
+
+	const float dot = SatDot( wi , ip.normal );
+	if( dot > 0.0f && !le.IsBlack() )
+	{
+		Shadow_Ray& shadow = shadows[count++];
+		new (&shadow) Shadow_Ray();
+		shadow.ray = ray;
+		shadow.ray.m_fMax = _ip.t * ( 1.0f - SHADOW_EPSILON );
+		shadow.radiance = weight * le * f * dot * mis / bsdf_pdf;
+		shadow.id = id;
+	}
+}
+
+// output log information
+void WavefrontPathTracing::OutputLog() const{
+    slog( INFO , INTEGRATOR , "Integrator algorithm : wavefront path tracing." );
+}
+
+// add the statistics of ray sorting to the report
+void WavefrontPathTracing::CollectStats( StatsGroup& stats ) const
+{
+	const unsigned long long pairs = m_pairs;
+	const double before = pairs ? (double)m_coherentBefore / pairs : 0.0;
+	const double after = pairs ? (double)m_coherentAfter / pairs : 0.0;
+	const unsigned long long sorted_rays = m_sortedRays;
+	const unsigned long long control_rays = m_controlRays;
+	const double sorted_ns = sorted_rays ? (double)m_sortedNs / sorted_rays : 0.0;
+	const double control_ns = control_rays ? (double)m_controlNs / control_rays : 0.0;
+	const double speedup = ( sorted_ns > 0.0 ) ? control_ns / sorted_ns : 0.0;
+
+	stats.Add( "type" , "wavefront_pt" ).Add( "ray_sorting" , m_sort ).Add( "sort_origin_bits" , m_originBits ).Add( "sort_direction_bits" , m_directionBits )
+		.Add( "sorted_streams" , (unsigned long long)m_streams ).Add( "coherence_before" , before ).Add( "coherence_after" , after )
+		.Add( "sort_ms" , m_sortNs / 1.0e6 ).Add( "sorted_ns_per_ray" , sorted_ns ).Add( "unsorted_ns_per_ray" , control_ns ).Add( "traversal_speedup" , speedup );
+
+	if( !m_sort || pairs == 0 )
+		return;
+	slog( INFO , PERFORMANCE , stringFormat( "Ray sorting: %llu streams, coherence of neighbor rays %.1f%% -> %.1f%%, %.1f ms spent sorting." ,
+		(unsigned long long)m_streams , before * 100.0 , after * 100.0 , m_sortNs / 1.0e6 ) );
+	if( sorted_rays && control_rays )
+		slog( INFO , PERFORMANCE , stringFormat( "Intersection of bounce rays: %.1f ns per sorted ray, %.1f ns per unsorted ray, %.2fx speedup." , sorted_ns , control_ns , speedup ) );
+}
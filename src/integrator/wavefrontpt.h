@@ -0,0 +1,186 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "pathtracing.h"
+#include <atomic>
+
+// pre-declera classes
+class	Intersection;
+class	Bsdf;
+class	Light;
+
+//////////////////////////////////////////////////////////////////////////////////////
+//	definition of wavefront path tracing
+//	desc :	Instead of following one path to its end before starting the next one , all paths
+//			of a stream advance one bounce at a time in stages. The rays of all live paths are
+//			intersected together , the hits are shaded group by group of their materials and the
+//			shadow rays spawned by shading are tested together afterward. The estimator is the
+//			same with path tracing , so are the samples it requests.
+//	note :	the rays of the bounces after the camera rays are sorted before they are intersected ,
+//			by the morton code of the cell of their origins in the bounding box of the scene and the
+//			octant of their directions , so that rays sent to the same region of the scene are
+//			traversed one after another. One stream out of 'WAVEFRONT_SORT_CONTROL' is left unsorted
+//			so that the traversal time of both orders could be compared in the statistics.
+class	WavefrontPathTracing : public PathTracing
+{
+// public method
+public:
+	DEFINE_CREATOR( WavefrontPathTracing , Integrator , "wavefront_pt" );
+
+	// default constructor
+	WavefrontPathTracing() {
+		_registerProperty( "wf_sort" , new SortProperty(this) );
+		_registerProperty( "wf_sort_origin_bits" , new SortOriginBitsProperty(this) );
+		_registerProperty( "wf_sort_direction_bits" , new SortDirectionBitsProperty(this) );
+	}
+
+	// return the radiance of a stream of rays
+	// para 'rays'     : the camera rays , each of them starts a path
+	// para 'ps'       : the pixel sample of each ray
+	// para 'radiance' : radiance along each ray from the scene
+	// para 'count'    : the number of rays
+	virtual void		LiStream( const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned count ) const;
+
+	// output log information
+	virtual void OutputLog() const;
+
+	// the camera rays are traced as a stream , the first hits of the raster pass are not used
+	virtual bool AcceptsPrimaryHits() const { return false; }
+
+	// add the statistics of ray sorting to the report , they are logged too
+	virtual void CollectStats( StatsGroup& stats ) const;
+
+// private field
+private:
+	// whether the rays of the bounces are sorted before they are intersected
+	bool		m_sort = true;
+	// the number of bits of each axis of the cells of origins , the bounding box of the scene is split into 2^(3*bits) cells
+	unsigned	m_originBits = 4;
+	// the number of bits of each axis of directions inside an octant , the octant is the only direction code if it is 0
+	unsigned	m_directionBits = 0;
+
+	// the statistics of sorting , they are counted by all threads
+	mutable std::atomic<unsigned long long>	m_streams{ 0 };				// streams of bounce rays
+	mutable std::atomic<unsigned long long>	m_pairs{ 0 };				// pairs of neighbor rays in the sorted streams
+	mutable std::atomic<unsigned long long>	m_coherentBefore{ 0 };		// pairs sharing their bin before sorting
+	mutable std::atomic<unsigned long long>	m_coherentAfter{ 0 };		// pairs sharing their bin after sorting
+	mutable std::atomic<unsigned long long>	m_sortNs{ 0 };				// the time of sorting
+	mutable std::atomic<unsigned long long>	m_sortedRays{ 0 };			// rays of the sorted streams traced synchronously
+	mutable std::atomic<unsigned long long>	m_sortedNs{ 0 };			// the time of intersecting them
+	mutable std::atomic<unsigned long long>	m_controlRays{ 0 };			// rays of the unsorted streams traced synchronously
+	mutable std::atomic<unsigned long long>	m_controlNs{ 0 };			// the time of intersecting them
+
+// private method
+private:
+	// the state of a path between two bounces
+	struct Path_State
+	{
+		Ray			ray;			// the ray to be traced in the next bounce
+		Spectrum	throughput;		// the weight of the path so far
+		unsigned	id;				// the index of the camera ray in the stream
+	};
+
+	// a shadow ray with the radiance it carries if it is not blocked
+	struct Shadow_Ray
+	{
+		Ray			ray;			// the shadow ray
+		Spectrum	radiance;		// the weighted radiance arriving along the ray
+		unsigned	id;				// the index of the camera ray in the stream
+	};
+
+	// shade the hits of a part of the stream , the paths that go on are marked alive again
+	// para 'bounces'    : the number of bounces so far
+	// para 'ps'         : the pixel sample of each camera ray
+	// para 'radiance'   : radiance along each camera ray
+	// para 'paths'      : the states of the live paths
+	// para 'inters'     : the intersections of the rays of the paths
+	// para 'alive'      : whether each ray hits anything , it tells whether each path goes on afterward
+	// para 'bsdfs'      : the bsdfs of the hits
+	// para 'begin'      : the first path of the part
+	// para 'end'        : the path after the last one of the part
+	// para 'shadows'    : the shadow rays , the ones of the part are appended
+	// para 'shadow_cnt' : the number of the shadow rays
+	void _shadeHits( int bounces , const PixelSample* ps , Spectrum* radiance , Path_State* paths , const Intersection* inters ,
+					 bool* alive , Bsdf** bsdfs , unsigned begin , unsigned end , Shadow_Ray* shadows , unsigned& shadow_cnt ) const;
+
+	// sample direct lighting at an intersection , the visibility tests are deferred
+	// para 'r'       : the ray hitting the intersection
+	// para 'light'   : the light to be sampled
+	// para 'ip'      : the intersection
+	// para 'bsdf'    : the bsdf at the intersection
+	// para 'ls'      : the sample of the light
+	// para 'bs'      : the sample of the bsdf
+	// para 'weight'  : the weight of the radiance , it includes the throughput and the pdf of picking the light
+	// para 'id'      : the index of the camera ray in the stream
+	// para 'shadows' : the shadow rays , at most two are appended
+	// para 'count'   : the number of the shadow rays
+	void _sampleDirect( const Ray& r , const Light* light , const Intersection& ip , const Bsdf* bsdf , const LightSample& ls ,
+						const BsdfSample& bs , const Spectrum& weight , unsigned id , Shadow_Ray* shadows , unsigned& count ) const;
+
+	// the bin of a ray , the morton code of the cell of its origin followed by the code of its direction
+	// para 'r'    : the ray
+	// para 'bbox' : the bounding box of the scene
+	unsigned long long _binOf( const Ray& r , const BBox& bbox ) const;
+
+	// sort the live paths by the bins of their rays
+	// para 'paths'   : the states of the live paths , they are reordered
+	// para 'scratch' : the storage of the reordered states , it holds as many states as 'paths'
+	// para 'live'    : the number of live paths
+	// para 'control' : whether the stream is left unsorted , the coherence is still measured
+	void _sortPaths( Path_State*& paths , Path_State*& scratch , unsigned live , bool control ) const;
+
+	// Ray sorting property
+	class SortProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SortProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			WavefrontPathTracing* pt = CAST_TARGET(WavefrontPathTracing);
+			if( pt )
+				pt->m_sort = (atoi( str.c_str() )==1);
+		}
+	};
+
+	// Bits of the cells of origins property
+	class SortOriginBitsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SortOriginBitsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			WavefrontPathTracing* pt = CAST_TARGET(WavefrontPathTracing);
+			if( pt )
+				pt->m_originBits = (unsigned)min( 10 , max( 0 , atoi( str.c_str() ) ) );
+		}
+	};
+
+	// Bits of directions property
+	class SortDirectionBitsProperty : public PropertyHandler<Integrator>
+	{
+	public:
+		PH_CONSTRUCTOR(SortDirectionBitsProperty,Integrator);
+		void SetValue( const string& str )
+		{
+			WavefrontPathTracing* pt = CAST_TARGET(WavefrontPathTracing);
+			if( pt )
+				pt->m_directionBits = (unsigned)min( 6 , max( 0 , atoi( str.c_str() ) ) );
+		}
+	};
+};
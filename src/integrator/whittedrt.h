@@ -39,4 +39,7 @@ public:
 
 	// output log information
 	virtual void OutputLog() const;
+
+	// camera rays missing the scene only see the environment
+	virtual bool IsBackgroundOnMiss() const { return true; }
 };
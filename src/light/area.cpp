@@ -60,8 +60,7 @@ Spectrum AreaLight::sample_l( const Intersection& intersect , const LightSample*
         *emissionPdf = UniformHemispherePdf() / shape->SurfaceArea();
 
 	// setup visibility tester
-    const float delta = 0.01f;
-	visibility.ray = Ray( intersect.intersect , dirToLight , 0 , delta , len - delta );
+	visibility.ray = intersect.SpawnRayTo( ps );
 
 	return intensity;
 }
@@ -79,8 +78,9 @@ Spectrum AreaLight::sample_l( const LightSample& ls , Ray& r , float* pdfW , flo
     if( cosAtLight )
         *cosAtLight = SatDot( r.m_Dir , n );
     
-    // to avoid self intersection
-    r.m_fMin = 0.01f;
+    // the ray leaves the surface beyond the rounding error of the sampled point
+    r.m_Ori = OffsetRayOrigin( r.m_Ori , PointError( r.m_Ori , 7 ) , Normalize( n ) , r.m_Dir );
+    r.m_fMin = 0.0f;
     
     return intensity;
 }
@@ -100,6 +100,17 @@ Spectrum AreaLight::Power() const
 	return shape->SurfaceArea() * intensity.GetIntensity() * TWO_PI;
 }
 
+// get the bounds of the emission of the light
+bool AreaLight::GetBounds( LightBounds& bounds ) const
+{
+	sAssert( shape , LIGHT );
+	bounds.bbox = shape->GetBBox();
+	bounds.cosThetaO = shape->GetNormalBounds( bounds.axis );
+	bounds.cosThetaE = 0.0f;
+	bounds.power = Power().GetIntensity();
+	return true;
+}
+
 // register property
 void AreaLight::_registerAllProperty()
 {
@@ -117,7 +128,10 @@ Spectrum AreaLight::Le( const Intersection& intersect , const Vector& wo , float
 	if( cos == 0.0f )
 		return 0.0f;
 
-	if( directPdfA )
+	// the density of sampling the point directly from the vertex the ray hitting the light starts from
+	if( directPdfA && intersect.t > 0.0f )
+		*directPdfA = shape->Pdf( intersect.intersect + wo * intersect.t , -wo ) * cos / ( intersect.t * intersect.t );
+	else if( directPdfA )
 		*directPdfA = 1.0f / shape->SurfaceArea();
 
 	if( emissionPdf )
@@ -31,6 +31,8 @@ public:
 
 	// default constructor
 	AreaLight(){_init();}
+	// destructor , the shape belongs to the light
+	~AreaLight(){ SAFE_DELETE( shape ); }
 
 	// sample ray from light
 	// para 'intersect' : intersection information
@@ -65,6 +67,9 @@ public:
 	// get the shape of light
 	virtual Shape* GetShape() const { return shape; }
 
+	// get the bounds of the emission of the light
+	virtual bool GetBounds( LightBounds& bounds ) const;
+
 // private field
 private:
 	// the shape binded to the area light
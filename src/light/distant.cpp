@@ -46,8 +46,7 @@ Spectrum DistantLight::sample_l( const Intersection& intersect , const LightSamp
     if( cosAtLight )
         *cosAtLight = 1.0f;
 
-    const float delta = 0.01f;
-	visibility.ray = Ray( intersect.intersect , dirToLight , 0 , delta );
+	visibility.ray = intersect.SpawnRay( dirToLight );
 
 	return intensity;
 }
@@ -0,0 +1,37 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include the header
+#include "light.h"
+#include "geometry/intersection.h"
+#include <atomic>
+
+// get a number no other light has
+unsigned long long Light::_newKey()
+{
+	static std::atomic<unsigned long long> keys( 0 );
+	return ++keys;
+}
+
+// whether the light could contribute to a shading point
+bool Light::Illuminates( const Intersection& intersect ) const
+{
+	if( m_links != 0 && intersect.primitive && ( m_links & intersect.primitive->GetLightLinks() ) == 0 )
+		return false;
+	return _influences( intersect.intersect , intersect.time );
+}
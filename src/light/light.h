@@ -24,6 +24,7 @@
 #include "utility/creator.h"
 #include "utility/strhelper.h"
 #include "geometry/scene.h"
+#include "lighttree.h"
 #include "math/vector3.h"
 
 // pre-decleration
@@ -43,7 +44,7 @@ public:
 	// whether it's visible from the light source
 	bool	IsVisible() const
 	{
-		return !scene.GetIntersect( ray , 0 );
+		return !scene.IsOccluded( ray );
 	}
 
 // public field
@@ -68,6 +69,27 @@ public:
 	// set transformation
 	virtual void	SetTransform( const Transform& transform ) {light2world = transform;}
 
+	// set the motion of the light , it moves the light from its placement at the start of the frame to the one at the end
+	// note : only the positions of point lights and spot lights follow it
+	void	SetMotion( const Transform& motion ) {m_motion = motion; m_moving = true;}
+
+	// whether the light moves in the shutter interval
+	bool	IsMoving() const {return m_moving;}
+
+	// set the light linking sets of the light , one bit for each set , the light illuminates everything if it is zero
+	void	SetLinks( unsigned links ) {m_links = links;}
+
+	// a number unique to every light created by the process , an edited light is created again and gets another one
+	unsigned long long	GetKey() const {return m_key;}
+
+	// whether the light could contribute to a shading point , lights failing it are skipped before any shadow ray is traced
+	// note : the primitive of the intersection has to receive light from one of the linking sets of the light , and the
+	//		  point has to be inside the influence bounds of the light
+	bool	Illuminates( const Intersection& intersect ) const;
+
+	// prepare the light for rendering , it is called once all properties of the light are set
+	virtual void Prepare() {}
+
 	// total power of the light
 	virtual Spectrum Power() const = 0;
 
@@ -84,6 +106,11 @@ public:
 	// the pdf for specific sampled directioin
 	virtual float Pdf( const Point& p , const Vector& wi ) const { return 1.0f; }
 
+	// get the bounds of the emission of the light
+	// para 'bounds' : the bounds of the light ( output )
+	// result        : false if the emission is not bounded , such lights are picked by their power
+	virtual bool GetBounds( LightBounds& bounds ) const { return false; }
+
 	// sample ray from light
 	// para 'intersect' : intersection information
 	// para 'wi'		: input vector in world space
@@ -124,6 +151,27 @@ protected:
 	// pdf of picking the light
 	float		pickProp;
 
+	// the motion of the light over the frame
+	Transform	m_motion;
+	bool		m_moving = false;
+
+	// the light linking sets of the light
+	unsigned	m_links = 0;
+	// the distance the light reaches , points farther away receive nothing from it
+	float		m_influence = FLT_MAX;
+	// the number unique to the light
+	const unsigned long long	m_key = _newKey();
+
+	// get a number no other light has
+	static unsigned long long _newKey();
+
+	// whether a point at a time of the frame is inside the influence bounds of the light
+	virtual bool _influences( const Point& p , float time ) const { return true; }
+
+	// the position of a point of the light at a time of the frame , the point moves linearly
+	Point	_moving( const Point& p , float time ) const
+	{ return m_moving ? p + ( m_motion( p ) - p ) * time : p; }
+
 	// register property
 	void _registerAllProperty()
 	{
@@ -145,6 +193,22 @@ protected:
 		}
 	};
 
+	// property handler of the distance the light reaches , it is registered by lights with bounded influence
+	class InfluenceProperty : public PropertyHandler<Light>
+	{
+	public:
+		// constructor
+		PH_CONSTRUCTOR(InfluenceProperty,Light);
+
+		// set value
+		void SetValue( const string& str )
+		{
+			Light* light = CAST_TARGET(Light);
+			const float influence = (float)atof( str.c_str() );
+			light->m_influence = ( influence > 0.0f ) ? influence : FLT_MAX;
+		}
+	};
+
 	// set light intensity
 	virtual void _setIntensity( const Spectrum& e )
 	{ intensity = e; }
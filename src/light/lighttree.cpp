@@ -0,0 +1,313 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header file
+#include "lighttree.h"
+#include "light.h"
+#include <algorithm>
+
+// the number of buckets evaluated along each axis during construction
+static const unsigned LIGHT_TREE_BUCKETS = 12;
+
+// clamp a cosine to the valid range
+static inline float _clampCos( float c )
+{
+	return min( max( c , -1.0f ) , 1.0f );
+}
+
+// square root of a value that could be slightly negative because of floating point error
+static inline float _safeSqrt( float x )
+{
+	return sqrt( max( x , 0.0f ) );
+}
+
+// cosine of max( 0 , a - b )
+static inline float _cosSubClamped( float sin_a , float cos_a , float sin_b , float cos_b )
+{
+	if( cos_a > cos_b )
+		return 1.0f;
+	return cos_a * cos_b + sin_a * sin_b;
+}
+
+// sine of max( 0 , a - b )
+static inline float _sinSubClamped( float sin_a , float cos_a , float sin_b , float cos_b )
+{
+	if( cos_a > cos_b )
+		return 0.0f;
+	return sin_a * cos_b - cos_a * sin_b;
+}
+
+// merge the bounds of two sets of lights
+static LightBounds _union( const LightBounds& a , const LightBounds& b )
+{
+	LightBounds r;
+	r.bbox = a.bbox;
+	r.bbox.Union( b.bbox );
+	r.power = a.power + b.power;
+	r.cosThetaE = min( a.cosThetaE , b.cosThetaE );
+
+	// the smallest cone containing both cones of normals
+	const float theta_a = acos( _clampCos( a.cosThetaO ) );
+	const float theta_b = acos( _clampCos( b.cosThetaO ) );
+	const float theta_d = acos( _clampCos( Dot( a.axis , b.axis ) ) );
+	if( min( theta_d + theta_b , PI ) <= theta_a )
+	{
+		r.axis = a.axis;
+		r.cosThetaO = a.cosThetaO;
+		return r;
+	}
+	if( min( theta_d + theta_a , PI ) <= theta_b )
+	{
+		r.axis = b.axis;
+		r.cosThetaO = b.cosThetaO;
+		return r;
+	}
+
+	const float theta_o = ( theta_a + theta_d + theta_b ) * 0.5f;
+	Vector wr = Cross( a.axis , b.axis );
+	if( theta_o >= PI || wr.SquaredLength() == 0.0f )
+	{
+		r.axis = a.axis;
+		r.cosThetaO = -1.0f;
+		return r;
+	}
+
+	// rotate the axis of the first cone toward the second one
+	wr.Normalize();
+	const float theta_r = theta_o - theta_a;
+	r.axis = Normalize( a.axis * cos( theta_r ) + Cross( wr , a.axis ) * sin( theta_r ) );
+	r.cosThetaO = cos( theta_o );
+	return r;
+}
+
+// the measure of the directions the lights could emit in , weighted by the cosine
+static float _orientationCost( const LightBounds& b )
+{
+	const float theta_o = acos( _clampCos( b.cosThetaO ) );
+	const float theta_e = acos( _clampCos( b.cosThetaE ) );
+	const float theta_w = min( theta_o + theta_e , PI );
+	const float sin_o = sin( theta_o );
+	const float cos_o = cos( theta_o );
+	return TWO_PI * ( 1.0f - cos_o ) + PI * 0.5f * ( 2.0f * theta_w * sin_o - cos( theta_o - 2.0f * theta_w ) - 2.0f * theta_o * sin_o + cos_o );
+}
+
+// build the light tree
+void LightTree::Build( const std::vector<const Light*>& lights , const std::vector<LightBounds>& bounds )
+{
+	Release();
+
+	std::vector<Light_Item> items;
+	for( unsigned i = 0 ; i < (unsigned)lights.size() ; ++i )
+	{
+		if( bounds[i].power <= 0.0f || !bounds[i].bbox.IsValid() )
+			continue;
+		Light_Item item;
+		item.bounds = bounds[i];
+		item.centroid = bounds[i].bbox.m_Min + ( bounds[i].bbox.m_Max - bounds[i].bbox.m_Min ) * 0.5f;
+		item.light = (unsigned)m_lights.size();
+		items.push_back( item );
+		m_lights.push_back( lights[i] );
+	}
+	if( items.empty() )
+		return;
+
+	m_nodes.reserve( 2 * items.size() - 1 );
+	_build( items , 0 , (unsigned)items.size() );
+}
+
+// release the tree
+void LightTree::Release()
+{
+	m_nodes.clear();
+	m_lights.clear();
+}
+
+// build the sub-tree of a range of lights
+unsigned LightTree::_build( std::vector<Light_Item>& items , unsigned _start , unsigned _end )
+{
+	const unsigned id = (unsigned)m_nodes.size();
+	m_nodes.push_back( Light_Node() );
+
+	if( _end - _start == 1 )
+	{
+		m_nodes[id].bounds = items[_start].bounds;
+		m_nodes[id].light = items[_start].light;
+		m_nodes[id].right = 0;
+		return id;
+	}
+
+	LightBounds bounds = items[_start].bounds;
+	BBox centroids;
+	centroids.Union( items[_start].centroid );
+	for( unsigned i = _start + 1 ; i < _end ; ++i )
+	{
+		bounds = _union( bounds , items[i].bounds );
+		centroids.Union( items[i].centroid );
+	}
+
+	// pick the split with the lowest surface area orientation heuristic over buckets of centroids
+	float best_cost = FLT_MAX;
+	unsigned best_axis = 0 , best_split = 0;
+	const float max_extent = bounds.bbox.Delta( bounds.bbox.MaxAxisId() );
+	for( unsigned axis = 0 ; axis < 3 ; ++axis )
+	{
+		const float extent = centroids.Delta( axis );
+		if( extent <= 0.0f )
+			continue;
+
+		LightBounds buckets[LIGHT_TREE_BUCKETS];
+		bool filled[LIGHT_TREE_BUCKETS] = { false };
+		for( unsigned i = _start ; i < _end ; ++i )
+		{
+			unsigned b = (unsigned)( LIGHT_TREE_BUCKETS * ( items[i].centroid[axis] - centroids.m_Min[axis] ) / extent );
+			b = min( b , LIGHT_TREE_BUCKETS - 1 );
+			buckets[b] = filled[b] ? _union( buckets[b] , items[i].bounds ) : items[i].bounds;
+			filled[b] = true;
+		}
+
+		// thin boxes are penalized along their short axes
+		const float kr = max_extent / max( bounds.bbox.Delta( axis ) , 1e-6f );
+		for( unsigned split = 1 ; split < LIGHT_TREE_BUCKETS ; ++split )
+		{
+			LightBounds left , right;
+			bool has_left = false , has_right = false;
+			for( unsigned b = 0 ; b < split ; ++b )
+			{
+				if( !filled[b] ) continue;
+				left = has_left ? _union( left , buckets[b] ) : buckets[b];
+				has_left = true;
+			}
+			for( unsigned b = split ; b < LIGHT_TREE_BUCKETS ; ++b )
+			{
+				if( !filled[b] ) continue;
+				right = has_right ? _union( right , buckets[b] ) : buckets[b];
+				has_right = true;
+			}
+			if( !has_left || !has_right )
+				continue;
+
+			const float cost = kr * ( left.power * _orientationCost( left ) * left.bbox.SurfaceArea() +
+									  right.power * _orientationCost( right ) * right.bbox.SurfaceArea() );
+			if( cost < best_cost )
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_split = split;
+			}
+		}
+	}
+
+	unsigned mid;
+	if( best_cost > 0.0f && best_cost < FLT_MAX )
+	{
+		const float extent = centroids.Delta( best_axis );
+		const float min_c = centroids.m_Min[best_axis];
+		Light_Item* middle = std::partition( &items[_start] , &items[_end-1] + 1 , [&]( const Light_Item& item ){
+			const unsigned b = min( (unsigned)( LIGHT_TREE_BUCKETS * ( item.centroid[best_axis] - min_c ) / extent ) , LIGHT_TREE_BUCKETS - 1 );
+			return b < best_split;
+		} );
+		mid = (unsigned)( middle - &items[0] );
+	}
+	else
+	{
+		// the heuristic doesn't tell the lights apart , for example all lights are points on a line
+		const unsigned axis = centroids.MaxAxisId();
+		mid = ( _start + _end ) / 2;
+		std::nth_element( &items[_start] , &items[mid] , &items[_end-1] + 1 , [&]( const Light_Item& a , const Light_Item& b ){
+			return a.centroid[axis] < b.centroid[axis];
+		} );
+	}
+
+	m_nodes[id].bounds = bounds;
+	m_nodes[id].light = ~0u;
+	_build( items , _start , mid );
+	const unsigned right = _build( items , mid , _end );
+	m_nodes[id].right = right;
+	return id;
+}
+
+// the importance of lights to a shading point
+float LightTree::Importance( const LightBounds& bounds , const Point& p , const Vector& n )
+{
+	const Point pc = bounds.bbox.m_Min + ( bounds.bbox.m_Max - bounds.bbox.m_Min ) * 0.5f;
+	const float half_diagonal = ( bounds.bbox.m_Max - pc ).SquaredLength();
+	const float d2 = ( p - pc ).SquaredLength();
+
+	// the cone of directions from the point to the bounding sphere of the box
+	float cos_b = -1.0f;
+	if( d2 > half_diagonal )
+		cos_b = _safeSqrt( 1.0f - half_diagonal / d2 );
+	const float sin_b = _safeSqrt( 1.0f - cos_b * cos_b );
+
+	// the angle between the axis and the direction to the point , reduced by the spread of normals and the bounding cone
+	Vector wi = p - pc;
+	const float len = wi.Length();
+	wi = ( len > 0.0f ) ? wi / len : bounds.axis;
+	const float cos_w = _clampCos( Dot( bounds.axis , wi ) );
+	const float sin_w = _safeSqrt( 1.0f - cos_w * cos_w );
+	const float sin_o = _safeSqrt( 1.0f - bounds.cosThetaO * bounds.cosThetaO );
+	const float cos_x = _cosSubClamped( sin_w , cos_w , sin_o , bounds.cosThetaO );
+	const float sin_x = _sinSubClamped( sin_w , cos_w , sin_o , bounds.cosThetaO );
+	const float cos_p = _cosSubClamped( sin_x , cos_x , sin_b , cos_b );
+	if( cos_p <= bounds.cosThetaE )
+		return 0.0f;
+
+	// the angle between the normal at the point and the direction to the lights
+	const float cos_i = AbsDot( wi , n );
+	const float sin_i = _safeSqrt( 1.0f - cos_i * cos_i );
+	const float cos_pi = _cosSubClamped( sin_i , cos_i , sin_b , cos_b );
+
+	// the distance is not less than the size of the box , lights close to the point are not over-weighted
+	return max( bounds.power * cos_p * cos_pi / max( max( d2 , half_diagonal ) , 1e-6f ) , 0.0f );
+}
+
+// pick a light for a shading point
+const Light* LightTree::Sample( float u , const Point& p , const Vector& n , float* pdf ) const
+{
+	if( pdf ) *pdf = 0.0f;
+	if( m_nodes.empty() || Importance( m_nodes[0].bounds , p , n ) <= 0.0f )
+		return 0;
+
+	unsigned id = 0;
+	float prob = 1.0f;
+	while( m_nodes[id].light == ~0u )
+	{
+		const Light_Node& node = m_nodes[id];
+		const float left = Importance( m_nodes[id+1].bounds , p , n );
+		const float right = Importance( m_nodes[node.right].bounds , p , n );
+		if( left + right <= 0.0f )
+			return 0;
+
+		// the random variable is remapped in the picked child
+		const float p_left = left / ( left + right );
+		if( u < p_left )
+		{
+			u = min( u / p_left , 0.99999994f );
+			prob *= p_left;
+			id = id + 1;
+		}
+		else
+		{
+			u = min( ( u - p_left ) / ( 1.0f - p_left ) , 0.99999994f );
+			prob *= 1.0f - p_left;
+			id = node.right;
+		}
+	}
+
+	if( pdf ) *pdf = prob;
+	return m_lights[m_nodes[id].light];
+}
@@ -0,0 +1,115 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "geometry/bbox.h"
+#include "math/vector3.h"
+#include <vector>
+
+// pre-decleration
+class Light;
+
+// the bounds of the emission of a light
+struct LightBounds
+{
+	// the bounding box of the emitting points
+	BBox	bbox;
+	// the axis of the cone bounding the emitting normals of the light
+	Vector	axis = Vector( 0.0f , 1.0f , 0.0f );
+	// the cosine of the spread angle of the normals around the axis
+	float	cosThetaO = 1.0f;
+	// the cosine of the maximum emitting angle off the normals
+	float	cosThetaE = 0.0f;
+	// the total power of the light
+	float	power = 0.0f;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////
+//	definition of light tree
+//	desc :	A bounding volume hierarchy over lights with bounded emission , every node bounds
+//			the positions , the emitting directions and the power of the lights below it.
+//			Lights are picked by descending the tree , each child is chosen with the importance
+//			of its bounds to the shading point , so that lights far away or facing away from
+//			the shading point are rarely picked. Please refer to the paper
+//			"Importance Sampling of Many Lights With Adaptive Tree Splitting" by Conty and Kulla
+//			for further details. The adaptive splitting is not implemented , one light is picked.
+class LightTree
+{
+// public method
+public:
+	// build the light tree
+	// para 'lights' : the lights with bounded emission
+	// para 'bounds' : the bounds of each light , lights without power are left out
+	void	Build( const std::vector<const Light*>& lights , const std::vector<LightBounds>& bounds );
+
+	// release the tree
+	void	Release();
+
+	// pick a light for a shading point
+	// para 'u'   : a canonical random variable
+	// para 'p'   : the shading point
+	// para 'n'   : the normal at the shading point
+	// para 'pdf' : the probability of picking the light
+	// result     : the picked light , it is null if no light in the tree could lit the point
+	const Light*	Sample( float u , const Point& p , const Vector& n , float* pdf ) const;
+
+	// whether there is no light in the tree
+	bool	IsEmpty() const { return m_nodes.empty(); }
+
+	// the total power of the lights in the tree
+	float	GetPower() const { return m_nodes.empty() ? 0.0f : m_nodes[0].bounds.power; }
+
+	// the number of nodes in the tree
+	unsigned	GetNodeCount() const { return (unsigned)m_nodes.size(); }
+
+	// the importance of lights to a shading point
+	// para 'bounds' : the bounds of the lights
+	// para 'p'      : the shading point
+	// para 'n'      : the normal at the shading point
+	// result        : the estimated contribution of the lights to the point , it is zero only if the lights can't lit it
+	static float	Importance( const LightBounds& bounds , const Point& p , const Vector& n );
+
+// private field
+private:
+	// node of the light tree , the left child is right after its parent
+	struct Light_Node
+	{
+		LightBounds	bounds;		// the bounds of the lights in the sub-tree
+		unsigned	light;		// the index of the light if it is a leaf , otherwise ~0u
+		unsigned	right;		// the index of the right child if it is an interior node
+	};
+	// a light to be placed in the tree
+	struct Light_Item
+	{
+		LightBounds	bounds;		// the bounds of the light
+		Point		centroid;	// the center of the bounding box of the light
+		unsigned	light;		// the index of the light
+	};
+	std::vector<Light_Node>		m_nodes;
+	std::vector<const Light*>	m_lights;
+
+// private method
+private:
+	// build the sub-tree of a range of lights
+	// para 'items'  : the lights , they are reordered during construction
+	// para '_start' : the start offset of the lights
+	// para '_end'   : the end offset of the lights
+	// result        : the index of the root of the sub-tree
+	unsigned	_build( std::vector<Light_Item>& items , unsigned _start , unsigned _end );
+
+};
@@ -0,0 +1,231 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include the header
+#include "meshlight.h"
+#include "geometry/intersection.h"
+#include "sampler/sample.h"
+#include "utility/rand.h"
+
+// constructor
+MeshLight::MeshLight( const std::vector<Primitive*>& triangles , const Spectrum& radiance )
+{
+	intensity = radiance;
+
+	// all triangles emit the same radiance , the weights of them are their areas
+	std::vector<float> areas;
+	for( auto triangle : triangles )
+	{
+		m_triangles.push_back( triangle );
+		areas.push_back( _faceNormal( triangle ).Length() * 0.5f );
+		m_area += areas.back();
+	}
+	m_distribution = std::unique_ptr<AliasTable>( new AliasTable( areas.data() , (unsigned)areas.size() ) );
+}
+
+// get the normal of the emitting side of a triangle
+Vector MeshLight::_faceNormal( const Primitive* triangle )
+{
+	Point p0 , p1 , p2;
+	if( !triangle->GetTriangleVertices( p0 , p1 , p2 ) )
+		return Vector( 0.0f , 0.0f , 0.0f );
+	return Cross( p1 - p0 , p2 - p0 );
+}
+
+// sample a point on the light
+bool MeshLight::_samplePoint( const LightSample& ls , Point& p , Vector& n ) const
+{
+	const int id = m_distribution->SampleDiscrete( ls.t , 0 );
+	if( id < 0 )
+		return false;
+
+	// the point is uniformly distributed in the triangle
+	Point p0 , p1 , p2;
+	m_triangles[id]->GetTriangleVertices( p0 , p1 , p2 );
+	const float su = sqrt( ls.u );
+	const float b1 = ls.v * su;
+	const float b2 = 1.0f - su;
+	p = p0 + ( p1 - p0 ) * b1 + ( p2 - p0 ) * b2;
+	n = Normalize( Cross( p1 - p0 , p2 - p0 ) );
+	return true;
+}
+
+// sample ray from light
+Spectrum MeshLight::sample_l( const Intersection& intersect , const LightSample* ls , Vector& dirToLight , float* distance , float* pdfW , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const
+{
+	sAssert( ls != 0 , LIGHT );
+
+	Point ps;
+	Vector normal;
+	if( !_samplePoint( *ls , ps , normal ) )
+	{
+		if( pdfW ) *pdfW = 0.0f;
+		return 0.0f;
+	}
+
+	const Vector dlt = ps - intersect.intersect;
+	const float len = dlt.Length();
+	if( len == 0.0f )
+	{
+		if( pdfW ) *pdfW = 0.0f;
+		return 0.0f;
+	}
+	dirToLight = dlt / len;
+
+	// the point is picked with the density of one over the total area , it is converted to solid angle
+	const float cos = Dot( -dirToLight , normal );
+	if( pdfW )
+		*pdfW = ( cos > 0.0f ) ? len * len / ( m_area * cos ) : 0.0f;
+	if( cos <= 0.0f )
+		return 0.0f;
+
+	if( cosAtLight )
+		*cosAtLight = cos;
+
+	if( distance )
+		*distance = len;
+
+	// product of pdf of sampling a point w.r.t surface area and a direction w.r.t direction
+	if( emissionPdf )
+		*emissionPdf = UniformHemispherePdf() / m_area;
+
+	// setup visibility tester
+	visibility.ray = intersect.SpawnRayTo( ps );
+
+	return intensity;
+}
+
+// sample a ray from light
+Spectrum MeshLight::sample_l( const LightSample& ls , Ray& r , float* pdfW , float* pdfA , float* cosAtLight ) const
+{
+	Point ps;
+	Vector normal;
+	if( !_samplePoint( ls , ps , normal ) )
+	{
+		if( pdfW ) *pdfW = 0.0f;
+		return 0.0f;
+	}
+
+	// the direction is uniformly distributed in the hemisphere of the emitting side
+	Vector t , b;
+	CoordinateSystem( normal , t , b );
+	const Vector d = UniformSampleHemisphere( sort_canonical() , sort_canonical() );
+	r.m_Ori = ps;
+	r.m_Dir = t * d.x + normal * d.y + b * d.z;
+	r.m_fMax = FLT_MAX;
+
+	if( pdfW )
+		*pdfW = UniformHemispherePdf() / m_area;
+
+	if( pdfA )
+		*pdfA = 1.0f / m_area;
+
+	if( cosAtLight )
+		*cosAtLight = SatDot( r.m_Dir , normal );
+
+	// the ray leaves the surface beyond the rounding error of the interpolated point
+	r.m_Ori = OffsetRayOrigin( ps , PointError( ps , 7 ) , normal , r.m_Dir );
+	r.m_fMin = 0.0f;
+
+	return intensity;
+}
+
+// sample light density
+Spectrum MeshLight::Le( const Intersection& intersect , const Vector& wo , float* directPdfA , float* emissionPdf ) const
+{
+	sAssert( intersect.primitive != 0 , LIGHT );
+
+	// only the side the vertexes wind counter-clockwise emits
+	const float cos = SatDot( wo , Normalize( _faceNormal( intersect.primitive ) ) );
+	if( cos == 0.0f )
+		return 0.0f;
+
+	// triangles are picked by their areas , so every point has the same density
+	if( directPdfA )
+		*directPdfA = 1.0f / m_area;
+
+	if( emissionPdf )
+		*emissionPdf = UniformHemispherePdf() / m_area;
+
+	return intensity;
+}
+
+// get intersection between the light and the ray
+bool MeshLight::Le( const Ray& ray , Intersection* intersect , Spectrum& radiance ) const
+{
+	sAssert( intersect != 0 , LIGHT );
+
+	// the triangles are part of the scene , the closest hit has to be one of them
+	// note : the ray is expected to leave its surface beyond the rounding error , see Intersection::SpawnRay
+	if( !scene->GetIntersect( ray , intersect ) || intersect->primitive == 0 || intersect->primitive->GetLight() != this )
+		return false;
+
+	radiance = Le( *intersect , -ray.m_Dir , 0 , 0 );
+	return true;
+}
+
+// the pdf for specific sampled directioin
+float MeshLight::Pdf( const Point& p , const Vector& wi ) const
+{
+	Intersection intersect;
+	Spectrum radiance;
+	if( !Le( Ray( p , wi ) , &intersect , radiance ) )
+		return 0.0f;
+
+	const float cos = Dot( -wi , Normalize( _faceNormal( intersect.primitive ) ) );
+	if( cos <= 0.0f )
+		return 0.0f;
+	return intersect.t * intersect.t / ( m_area * cos );
+}
+
+// total power of the light
+Spectrum MeshLight::Power() const
+{
+	return m_area * intensity.GetIntensity() * TWO_PI;
+}
+
+// get the bounds of the emission of the light
+bool MeshLight::GetBounds( LightBounds& bounds ) const
+{
+	if( m_triangles.empty() )
+		return false;
+
+	// the axis of the normals is their average weighted by the areas
+	Vector axis( 0.0f , 0.0f , 0.0f );
+	for( auto triangle : m_triangles )
+	{
+		bounds.bbox.Union( triangle->GetBBox() );
+		axis += _faceNormal( triangle );
+	}
+
+	bounds.cosThetaO = -1.0f;
+	if( axis.Length() > 0.0f )
+	{
+		bounds.axis = Normalize( axis );
+		bounds.cosThetaO = 1.0f;
+		for( auto triangle : m_triangles )
+		{
+			const Vector n = _faceNormal( triangle );
+			if( n.Length() > 0.0f )
+				bounds.cosThetaO = min( bounds.cosThetaO , Dot( bounds.axis , Normalize( n ) ) );
+		}
+	}
+	bounds.cosThetaE = 0.0f;
+	bounds.power = Power().GetIntensity();
+	return true;
+}
@@ -0,0 +1,91 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "light.h"
+#include "utility/samplemethod.h"
+#include <memory>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//	definition of mesh light
+//	desc :	The triangles of an emissive subset of a mesh form one light. Each triangle emits the same radiance
+//			from the side its vertexes wind counter-clockwise , its points are sampled uniformly. Triangles are
+//			picked in constant time with an alias table weighted by their areas times the emission , which is
+//			the same for all of them , so they are picked by their areas.
+class	MeshLight : public Light
+{
+// public method
+public:
+	// constructor
+	// para 'triangles' : the triangles of the emissive subset , they are bound to the light
+	// para 'radiance'  : the emitted radiance
+	MeshLight( const std::vector<Primitive*>& triangles , const Spectrum& radiance );
+
+	// sample ray from light
+	// para 'intersect' : intersection information
+	// para 'dirToLight': input vector in world space
+	// para 'pdf'		: property density function value of the input vector
+	// para 'visibility': visibility tester
+	Spectrum sample_l( const Intersection& intersect , const LightSample* ls , Vector& dirToLight , float* distance , float* pdfw , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const override;
+
+	// sample a ray from light
+	// para 'ls'       : light sample
+	// para 'r'       : the light vector
+	// para 'pdf'      : the properbility density function
+	Spectrum sample_l( const LightSample& ls , Ray& r , float* pdfW , float* pdfA , float* cosAtLight ) const override;
+
+	// sample light density
+	Spectrum Le( const Intersection& intersect , const Vector& wo , float* directPdfA , float* emissionPdf ) const override;
+
+	// get intersection between the light and the ray
+	// note : the ray is tested against the whole scene , it only hits the light if no other surface blocks it
+	bool Le( const Ray& ray , Intersection* intersect , Spectrum& radiance ) const override;
+
+	// the pdf for specific sampled directioin
+	float Pdf( const Point& p , const Vector& wi ) const override;
+
+	// total power of the light
+	Spectrum Power() const override;
+
+	// it's not a delta light
+	bool	IsDelta() const override { return false; }
+
+	// get the bounds of the emission of the light
+	bool	GetBounds( LightBounds& bounds ) const override;
+
+// private field
+private:
+	// the triangles of the light
+	std::vector<const Primitive*>	m_triangles;
+	// the distribution of picking the triangles
+	std::unique_ptr<AliasTable>		m_distribution;
+	// the total area of the triangles
+	float							m_area = 0.0f;
+
+	// sample a point on the light
+	// para 'ls' : the light sample , 't' picks the triangle and 'u' , 'v' pick the point in it
+	// para 'p'  : the sampled point ( output )
+	// para 'n'  : the normal of the emitting side at the point ( output )
+	// result    : false if the light has no area
+	bool	_samplePoint( const LightSample& ls , Point& p , Vector& n ) const;
+
+	// get the normal of the emitting side of a triangle , it is not normalized
+	static Vector	_faceNormal( const Primitive* triangle );
+};
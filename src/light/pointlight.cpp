@@ -26,8 +26,9 @@ IMPLEMENT_CREATOR( PointLight );
 // sample ray from light
 Spectrum PointLight::sample_l( const Intersection& intersect , const LightSample* ls , Vector& dirToLight , float* distance , float* pdfw , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const
 {
-    // Get light position
-	const Vector _dirToLight = light_pos - intersect.intersect;
+    // Get light position at the time of the intersection
+	const Point pos = _moving( light_pos , intersect.time );
+	const Vector _dirToLight = pos - intersect.intersect;
     
     // Normalize vec
     const float sqrLen = _dirToLight.SquaredLength();
@@ -35,8 +36,7 @@ Spectrum PointLight::sample_l( const Intersection& intersect , const LightSample
 	dirToLight = _dirToLight / len;
     
     // setup visibility ray
-    const float delta = 0.01f;
-	visibility.ray = Ray( light_pos , -dirToLight , 0 , 0.0f , len - delta );
+	visibility.ray = intersect.SpawnRayTo( pos );
 
     // direction pdf from 'intersect' to light source w.r.t solid angle
     if( pdfw )
@@ -51,6 +51,10 @@ Spectrum PointLight::sample_l( const Intersection& intersect , const LightSample
     // product of pdf of sampling a point w.r.t surface area and a direction w.r.t direction
     if( emissionPdf )
         *emissionPdf = UniformSpherePdf();
+
+	// nothing arrives beyond the distance the light reaches
+	if( len > m_influence )
+		return 0.0f;
     
 	return intensity;
 }
@@ -61,7 +65,8 @@ Spectrum PointLight::sample_l( const LightSample& ls , Ray& r , float* pdfW , fl
     // sample a new ray
 	r.m_fMin = 0.0f;
 	r.m_fMax = FLT_MAX;
-	r.m_Ori = light_pos;
+	// the ray leaves the light at the time it is given
+	r.m_Ori = _moving( light_pos , r.m_Time );
 	r.m_Dir = UniformSampleSphere( ls.u , ls.v );
 
     // product of pdf of sampling a point w.r.t surface area and a direction w.r.t direction
@@ -83,4 +88,5 @@ void PointLight::_registerAllProperty()
 {
 	Light::_registerAllProperty();
 	_registerProperty( "pos" , new PosProperty(this) );
+	_registerProperty( "influence" , new InfluenceProperty(this) );
 }
@@ -50,6 +50,23 @@ public:
 	virtual Spectrum Power() const
 	{return 4 * PI * intensity;}
 
+	// get the bounds of the emission of the light , it emits in all directions
+	virtual bool GetBounds( LightBounds& bounds ) const
+	{
+		bounds.bbox = BBox( light_pos , light_pos );
+		bounds.bbox.Union( _moving( light_pos , 1.0f ) );
+		bounds.cosThetaO = -1.0f;
+		bounds.cosThetaE = 0.0f;
+		bounds.power = Power().GetIntensity();
+		return true;
+	}
+
+// protected method
+protected:
+	// whether a point is inside the influence bounds , it is the sphere the light reaches
+	bool _influences( const Point& p , float time ) const override
+	{ return m_influence == FLT_MAX || ( p - _moving( light_pos , time ) ).SquaredLength() <= m_influence * m_influence; }
+
 // private field
 private:
     // light position
@@ -51,8 +51,7 @@ Spectrum SkyLight::sample_l( const Intersection& intersect , const LightSample*
     }
 
 	// setup visibility tester
-    const float delta = 0.01f;
-	visibility.ray = Ray( intersect.intersect , dirToLight , 0 , delta , FLT_MAX );
+	visibility.ray = intersect.SpawnRay( dirToLight );
 
 	return sky->Evaluate( dirToLight );
 }
@@ -128,7 +127,12 @@ bool SkyLight::Le( const Ray& ray , Intersection* intersect , Spectrum& radiance
 	if( intersect && intersect->t != FLT_MAX )
 		return false;
 
-	radiance = sky->Evaluate( ray.m_Dir );
+	// rays with differentials filter the sky over the angle between them and their neighbors
+	float spread = 0.0f;
+	if( ray.m_HasDifferentials )
+		spread = max( ( ray.m_DxDir - ray.m_Dir ).Length() , ( ray.m_DyDir - ray.m_Dir ).Length() );
+
+	radiance = sky->Evaluate( ray.m_Dir , spread );
 	return true;
 }
 
@@ -157,6 +161,7 @@ void SkyLight::_registerAllProperty()
 	_registerProperty( "back" , new PropertyPasser( this ) );
 	_registerProperty( "image" , new PropertyPasser( this ) );
 	_registerProperty( "transform" , new TransformProperty( this ) );
+	_registerProperty( "cube_size" , new PropertyPasser( this ) );
 }
 
 // the pdf for specific sampled directioin
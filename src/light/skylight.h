@@ -58,6 +58,9 @@ public:
 	// whether the light is an infinite light
 	virtual bool IsInfinite() const { return true; }
 
+	// prepare the sky , it is resampled to a cube map
+	virtual void Prepare() { if( sky ) sky->Prepare(); }
+
 	// total power of the light
 	virtual Spectrum Power() const;
 
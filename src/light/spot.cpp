@@ -26,8 +26,9 @@ IMPLEMENT_CREATOR( SpotLight );
 // sample ray from light
 Spectrum SpotLight::sample_l( const Intersection& intersect , const LightSample* ls , Vector& dirToLight , float* distance , float* pdfw , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const
 {
-    // direction to light
-	const Vector _dirToLight = light_pos - intersect.intersect;
+    // direction to light at the time of the intersection
+	const Point pos = _moving( light_pos , intersect.time );
+	const Vector _dirToLight = pos - intersect.intersect;
     
     // Normalize vec
     const float sqrLen = _dirToLight.SquaredLength();
@@ -49,8 +50,11 @@ Spectrum SpotLight::sample_l( const Intersection& intersect , const LightSample*
         *distance = len;
     
     // update visility
-    const float delta = 0.01f;
-    visibility.ray = Ray( light_pos , -dirToLight , 0 , delta , len - delta );
+    visibility.ray = intersect.SpawnRayTo( pos );
+
+	// nothing arrives beyond the distance the light reaches
+	if( len > m_influence )
+		return 0.0f;
     
 	const float falloff = SatDot( dirToLight , -light_dir );
 	if( falloff <= cos_total_range )
@@ -70,7 +74,8 @@ Spectrum SpotLight::sample_l( const LightSample& ls , Ray& r , float* pdfW , flo
     // udpate ray
 	r.m_fMin = 0.0f;
 	r.m_fMax = FLT_MAX;
-	r.m_Ori = light_pos;
+	// the ray leaves the light at the time it is given
+	r.m_Ori = _moving( light_pos , r.m_Time );
     
     // sample a light direction
 	const Vector local_dir = UniformSampleCone( ls.u , ls.v , cos_total_range );
@@ -108,6 +113,7 @@ void SpotLight::_registerAllProperty()
 	_registerProperty( "falloff_start" , new FalloffStartProperty(this) );
 	_registerProperty( "range" , new RangeProperty(this) );
 	_registerProperty( "dir" , new DirProperty(this) );
+	_registerProperty( "influence" , new InfluenceProperty(this) );
 }
 
 // initialize default value
@@ -46,12 +46,35 @@ public:
 	virtual Spectrum Power() const
 	{return 4 * PI * intensity * ( 1.0f - 0.5f * ( cos_falloff_start + cos_total_range ) ) ;}
 
+	// get the bounds of the emission of the light , it emits within the cone around its direction
+	virtual bool GetBounds( LightBounds& bounds ) const
+	{
+		bounds.bbox = BBox( light_pos , light_pos );
+		bounds.bbox.Union( _moving( light_pos , 1.0f ) );
+		bounds.axis = light_dir;
+		bounds.cosThetaO = 1.0f;
+		bounds.cosThetaE = cos_total_range;
+		bounds.power = Power().GetIntensity();
+		return true;
+	}
+
 	// sample a ray from light
 	// para 'ls'       : light sample
 	// para 'r'       : the light vector
 	// para 'pdf'      : the properbility density function
 	virtual Spectrum sample_l( const LightSample& ls , Ray& r , float* pdfW , float* pdfA , float* cosAtLight ) const;
 
+// protected method
+protected:
+	// whether a point is inside the influence bounds , it is the part of the cone within the distance the light reaches
+	bool _influences( const Point& p , float time ) const override
+	{
+		const Vector d = p - _moving( light_pos , time );
+		if( m_influence != FLT_MAX && d.SquaredLength() > m_influence * m_influence )
+			return false;
+		return Dot( d , light_dir ) > cos_total_range * d.Length();
+	}
+
 // private field
 private:
     // light position
@@ -19,6 +19,11 @@
 #include <vector>
 #include <memory>
 #include <time.h>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 
 static vector<unique_ptr<LogDispatcher>> logDispatcher;
 static bool logLevel = true;
@@ -26,23 +31,229 @@ static bool logType = true;
 static bool logTime = true;
 static bool logLineInfo = false;
 static LOG_LEVEL logDefaultLevel = LOG_LEVEL::LOG_DEBUG;     // By default, debug information is avoided.
+static std::mutex logMutex;                                     // Messages of different threads are not interleaved.
+static std::atomic<bool> logClosed( false );                    // Whether the log thread is finished at exit , messages are written directly then.
+
+// the number of warnings logged by a call site , the following ones are only counted
+static const unsigned LOG_SITE_LIMIT = 10;
+// the number of call sites counted , sites beyond it are never suppressed
+static const unsigned LOG_SITE_SLOTS = 1024;
+
+namespace {
+// a message waiting for the log thread
+struct LogMessage{
+    std::atomic<LogMessage*>    next{nullptr};
+    LOG_LEVEL                   level = LOG_LEVEL::LOG_INFO;
+    LOG_TYPE                    type = LOG_TYPE::LOG_GENERAL;
+    string                      str;
+    const char*                 file = "";
+    int                         line = 0;
+    time_t                      time = 0;
+};
+
+// the intrusive multiple producer single consumer queue of Dmitry Vyukov , a producer only exchanges the head and links
+// the previous one to its message , the log thread takes the messages from the tail
+class LogQueue{
+public:
+    LogQueue() : m_head( &m_stub ) , m_tail( &m_stub ) {}
+
+    // push a message , it could be called by any thread
+    void push( LogMessage* message ){
+        message->next.store( nullptr , std::memory_order_relaxed );
+        LogMessage* prev = m_head.exchange( message , std::memory_order_acq_rel );
+        prev->next.store( message , std::memory_order_release );
+    }
+
+    // pop the oldest message , it is only called by the log thread
+    // a message being pushed is not visible yet , the queue looks empty until the producer links it
+    LogMessage* pop(){
+        LogMessage* tail = m_tail;
+        LogMessage* next = tail->next.load( std::memory_order_acquire );
+        if( tail == &m_stub ){
+            if( next == nullptr )
+                return nullptr;
+            m_tail = next;
+            tail = next;
+            next = next->next.load( std::memory_order_acquire );
+        }
+        if( next ){
+            m_tail = next;
+            return tail;
+        }
+        if( tail != m_head.load( std::memory_order_acquire ) )
+            return nullptr;
+        push( &m_stub );
+        next = tail->next.load( std::memory_order_acquire );
+        if( next ){
+            m_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<LogMessage*>    m_head;
+    LogMessage*                 m_tail;
+    LogMessage                  m_stub;
+};
+
+// a call site of warnings
+struct LogSite{
+    std::atomic<unsigned long long> key{0};
+    std::atomic<const char*>        file{nullptr};
+    std::atomic<int>                line{0};
+    std::atomic<unsigned>           count{0};
+};
+
+// the log thread writing the queued messages to the dispatchers
+class LogWriter{
+public:
+    ~LogWriter(){
+        // the warnings suppressed at each call site are reported once at exit
+        for( auto& site : m_sites ){
+            const unsigned count = site.count.load();
+            if( count > LOG_SITE_LIMIT && site.file.load() )
+                sortLog( LOG_LEVEL::LOG_INFO , LOG_TYPE::LOG_GENERAL , to_string( count - LOG_SITE_LIMIT ) + " more warnings were suppressed at " +
+                    string( site.file.load() ) + ":" + to_string( site.line.load() ) + "." , site.file.load() , site.line.load() );
+        }
+
+        if( m_thread.joinable() ){
+            m_stop = true;
+            m_wake.notify_all();
+            m_thread.join();
+        }
+        logClosed = true;
+    }
+
+    // queue a message , the log thread is started by the first one
+    void push( LogMessage* message ){
+        std::call_once( m_started , [this](){
+            m_thread = std::thread( [this](){ run(); } );
+        } );
+        ++m_pushed;
+        m_queue.push( message );
+        m_wake.notify_one();
+    }
+
+    // wait until the messages pushed so far are written
+    void flush(){
+        const unsigned long long pushed = m_pushed.load();
+        while( m_written.load() < pushed ){
+            m_wake.notify_one();
+            std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+        }
+    }
+
+    // count a warning of a call site , false if it is suppressed
+    // para 'suppressing' : whether it is the last warning logged by the site
+    bool count( const char* file , int line , bool& suppressing ){
+        const unsigned long long key = ( ( (unsigned long long)(size_t)file * 1000003ull ) ^ (unsigned long long)line ) | 1ull;
+        for( unsigned i = 0 ; i < LOG_SITE_SLOTS ; ++i ){
+            LogSite& site = m_sites[ ( key + i ) % LOG_SITE_SLOTS ];
+            unsigned long long current = site.key.load();
+            if( current == 0 && site.key.compare_exchange_strong( current , key ) ){
+                site.file = file;
+                site.line = line;
+                current = key;
+            }
+            if( current != key )
+                continue;
+            const unsigned count = ++site.count;
+            suppressing = ( count == LOG_SITE_LIMIT );
+            return count <= LOG_SITE_LIMIT;
+        }
+        suppressing = false;
+        return true;
+    }
+
+private:
+    LogQueue                        m_queue;
+    std::thread                     m_thread;
+    std::once_flag                  m_started;
+    std::atomic<bool>               m_stop{false};
+    std::atomic<unsigned long long> m_pushed{0};
+    std::atomic<unsigned long long> m_written{0};
+    std::mutex                      m_wakeMutex;
+    std::condition_variable         m_wake;
+    LogSite                         m_sites[LOG_SITE_SLOTS];
+
+    // write the messages until the writer is destroyed , the messages left are written before it finishes
+    void run(){
+        while( true ){
+            bool written = false;
+            while( LogMessage* message = m_queue.pop() ){
+                {
+                    std::lock_guard<std::mutex> lock( logMutex );
+                    for( const auto& it : logDispatcher )
+                        it->dispatch( message->level , message->type , message->str.c_str() , message->file , message->line , message->time );
+                }
+                delete message;
+                ++m_written;
+                written = true;
+            }
+            if( written )
+                continue;
+            if( m_stop && m_written.load() == m_pushed.load() )
+                return;
+
+            // a producer doesn't lock the mutex , the timeout catches a lost wake up
+            std::unique_lock<std::mutex> lock( m_wakeMutex );
+            m_wake.wait_for( lock , std::chrono::milliseconds( 5 ) );
+        }
+    }
+};
+}
+
+// it is destroyed before the dispatchers , later messages are written directly
+static LogWriter logWriter;
 
 void addLogDispatcher( LogDispatcher* logdispatcher ){
+    std::lock_guard<std::mutex> lock( logMutex );
     logDispatcher.push_back( unique_ptr<LogDispatcher>(logdispatcher) );
 }
 
 void sortLog( LOG_LEVEL level , LOG_TYPE type , const string& str , const char* file , const int line ){
     if( level < logDefaultLevel )
         return;
-    for( const auto& it : logDispatcher )
-        it->dispatch( level , type , str.c_str() , file , line );
+
+    // messages logged by the destructors after the log thread finished are written directly
+    if( logClosed.load() ){
+        std::lock_guard<std::mutex> lock( logMutex );
+        for( const auto& it : logDispatcher )
+            it->dispatch( level , type , str.c_str() , file , line , time( 0 ) );
+        return;
+    }
+
+    // warnings repeated by render threads , like the ones of missing data , don't flood the log
+    bool suppressing = false;
+    if( level == LOG_LEVEL::LOG_WARNING && !logWriter.count( file , line , suppressing ) )
+        return;
+    const string text = suppressing ? str + " Further warnings of this call site are suppressed." : str;
+
+    LogMessage* message = new LogMessage();
+    message->level = level;
+    message->type = type;
+    message->str = text;
+    message->file = file;
+    message->line = line;
+    message->time = time( 0 );
+    logWriter.push( message );
+
+    // errors could be followed by a crash , they are written before returning
+    if( level >= LOG_LEVEL::LOG_ERROR )
+        logWriter.flush();
+}
+
+// wait until the messages are written
+void flushLog(){
+    logWriter.flush();
 }
 
-void LogDispatcher::dispatch( LOG_LEVEL level , LOG_TYPE type , const char* str , const char* file , const int line ){
-    output(format( level , type , str , file , line ));
+void LogDispatcher::dispatch( LOG_LEVEL level , LOG_TYPE type , const char* str , const char* file , const int line , time_t t ){
+    output(format( level , type , str , file , line , t ));
 }
 
-const string logTimeString(){
+const string logTimeString( time_t t ){
     if( !logTime )
         return "";
     
@@ -51,7 +262,6 @@ const string logTimeString(){
         return string( size - s.size(), '0' ) + s;
     };
     
-    time_t t = time(0);
     struct tm * now = localtime( &t );
     return "[" + tostr(now->tm_year + 1900 , 4) + '-' + tostr(now->tm_mon + 1) + '-' + tostr( now->tm_mday) + ' ' + tostr(now->tm_hour) + ':' + tostr(now->tm_min) + ':' + tostr( now->tm_sec) + "]";
 }
@@ -84,12 +294,12 @@ const string lineInfoString( const char* file , int line ){
 }
 
 // format log header
-const string LogDispatcher::formatHead( LOG_LEVEL level , LOG_TYPE type , const char* file , const int line ) const{
-    return logTimeString() + levelToString(level) + typeToString( type ) + lineInfoString( file , line ) + "\t";
+const string LogDispatcher::formatHead( LOG_LEVEL level , LOG_TYPE type , const char* file , const int line , time_t t ) const{
+    return logTimeString( t ) + levelToString(level) + typeToString( type ) + lineInfoString( file , line ) + "\t";
 }
 
-const string LogDispatcher::format( LOG_LEVEL level , LOG_TYPE type , const char* str , const char* file , const int line ) const{
-    return formatHead( level , type , file , line ) + string(str);
+const string LogDispatcher::format( LOG_LEVEL level , LOG_TYPE type , const char* str , const char* file , const int line , time_t t ) const{
+    return formatHead( level , type , file , line , t ) + string(str);
 }
 
 void StdOutLogDispatcher::output( const string& s ){
@@ -19,6 +19,7 @@
 
 #include "utility/singleton.h"
 #include <fstream>
+#include <time.h>
 
 #define slog( level , type , s ) sortLog( LOG_LEVEL::LOG_##level , LOG_TYPE::LOG_##type , s , __FILE__ , __LINE__ )
 
@@ -43,18 +44,18 @@ enum class LOG_TYPE{
 
 class LogDispatcher{
 public:
-    // dispatch a log
-    void dispatch( LOG_LEVEL level , LOG_TYPE type , const char* str , const char* file , const int line );
+    // dispatch a log , 't' is the time it was logged at
+    void dispatch( LOG_LEVEL level , LOG_TYPE type , const char* str , const char* file , const int line , time_t t );
     
     // output result
     virtual void output( const string& s ) = 0;
     
 private:
     // format log
-    const string format( LOG_LEVEL level , LOG_TYPE type , const char* str , const char* file , const int line ) const;
+    const string format( LOG_LEVEL level , LOG_TYPE type , const char* str , const char* file , const int line , time_t t ) const;
     
     // format log header
-    const string formatHead( LOG_LEVEL level , LOG_TYPE type , const char* file , const int line ) const;
+    const string formatHead( LOG_LEVEL level , LOG_TYPE type , const char* file , const int line , time_t t ) const;
 };
 
 class FileLogDispatcher : public LogDispatcher {
@@ -73,5 +74,9 @@ public:
     void output( const string& s ) override ;
 };
 
+// messages are queued without blocking and written to the dispatchers by a background thread , errors are written before it returns
+// a call site only logs a limited number of warnings , the rest of them are counted and reported at exit
 void sortLog( LOG_LEVEL level , LOG_TYPE type , const string& str , const char* file , const int line );
 void addLogDispatcher( LogDispatcher* logdispatcher );
+// wait until all messages logged so far are written
+void flushLog();
@@ -19,12 +19,40 @@
 #include "sort.h"
 #include "system.h"
 #include "log/log.h"
+#include "utility/xmlbinary.h"
+#include "sampler/samplerbench.h"
+#include "utility/renderbench.h"
+#include "utility/kernelbench.h"
+#include "imagesensor/partialmerge.h"
+#include "utility/cpuinfo.h"
+#include "utility/strhelper.h"
+#include "thirdparty/tinyxml/tinyxml.h"
+#include <csignal>
+#include <sstream>
 
 // the global system
-System g_System;
+extern System g_System;
 
 extern bool g_bBlenderMode;
 
+// the first interrupt cancels the rendering and the partial image is still written , the second one kills the process
+static void cancelHandler( int sig )
+{
+	RenderControl::GetSingleton().Cancel();
+	signal( sig , SIG_DFL );
+}
+
+#if defined(SORT_IN_LINUX) || defined(SORT_IN_MAC)
+// SIGUSR1 pauses the rendering and SIGUSR2 resumes it
+static void pauseHandler( int sig )
+{
+	if( sig == SIGUSR1 )
+		RenderControl::GetSingleton().Pause();
+	else
+		RenderControl::GetSingleton().Resume();
+}
+#endif
+
 // the main func
 #ifdef SORT_IN_WINDOWS
 int __cdecl main( int argc , char** argv )
@@ -35,13 +63,6 @@ int main( int argc , char** argv )
     addLogDispatcher(new StdOutLogDispatcher());
     addLogDispatcher(new FileLogDispatcher("log.txt"));
     
-	// check if there is file argument
-	if( argc < 2 )
-	{
-		cout<<"Miss file argument."<<endl;
-		return 0;
-	}
-
     string commandline = "Command line arguments: \t";
     for( int i = 0 ; i < argc ; ++i ){
         commandline += string(argv[i]);
@@ -49,19 +70,226 @@ int main( int argc , char** argv )
     }
     
     slog( INFO , GENERAL , commandline );
+
+	// the statistics of the rendering are written to the file after '--stats-json' in json , the option could be anywhere
+	// and it is removed from the arguments before they are parsed
+	for( int i = 1 ; i + 1 < argc ; ++i )
+	{
+		if( strcmp( argv[i] , "--stats-json" ) != 0 )
+			continue;
+		g_System.SetStatsFile( argv[i+1] );
+		for( int j = i ; j + 2 < argc ; ++j )
+			argv[j] = argv[j+2];
+		argc -= 2;
+		break;
+	}
+
+	// check if there is file argument
+	if( argc < 2 )
+	{
+		cout<<"Miss file argument."<<endl;
+		return 0;
+	}
     slog( INFO , GENERAL , "Number of CPU cores " + to_string(NumSystemCores()) );
+    slog( INFO , GENERAL , stringFormat( "The processor supports %s, the program is compiled for %s." , GetCpuIsaName( GetCpuIsa() ) , GetCpuIsaName( GetCompiledIsa() ) ) );
+
+	// compare samplers without any scene , the arguments after it are the samplers and the largest sample count
+	if( strcmp( argv[1] , "samplerbench" ) == 0 )
+	{
+		vector<string> samplers;
+		std::istringstream stream( ( argc > 2 ) ? argv[2] : "regular,random,stratified,sobol,halton,pmj02" );
+		string type;
+		while( std::getline( stream , type , ',' ) )
+			if( !type.empty() )
+				samplers.push_back( type );
+
+		const unsigned max_count = ( argc > 3 ) ? max( atoi( argv[3] ) , 16 ) : 4096;
+		SamplerBenchmark benchmark( max_count , 64 );
+		benchmark.Run( samplers );
+		return 0;
+	}
+
+	// time the core kernels without any scene , the arguments after it are the kernels and the seconds each of them is run for
+	if( strcmp( argv[1] , "kernelbench" ) == 0 )
+	{
+		vector<string> kernels;
+		std::istringstream stream( ( argc > 2 ) ? argv[2] : "" );
+		string name;
+		while( std::getline( stream , name , ',' ) )
+			if( !name.empty() )
+				kernels.push_back( name );
+
+		KernelBenchmark benchmark( ( argc > 3 ) ? atof( argv[3] ) : 0.2 );
+		benchmark.Run( kernels );
+		return 0;
+	}
+
+	// merge the partial results of the same image rendered with separate ranges of samples , the arguments after it are the
+	// final image and the partial results
+	if( strcmp( argv[1] , "merge" ) == 0 )
+	{
+		if( argc < 4 )
+		{
+			cout<<"Usage : SORT merge <output image> <partial result> ..."<<endl;
+			return 0;
+		}
+		const bool merged = PartialMerge::Merge( argv[2] , vector<string>( argv + 3 , argv + argc ) );
+		return merged ? 0 : 1;
+	}
+
+	// the render control is created before any handler could touch it
+	RenderControl::GetSingleton();
+	signal( SIGINT , cancelHandler );
+	signal( SIGTERM , cancelHandler );
+#if defined(SORT_IN_LINUX) || defined(SORT_IN_MAC)
+	signal( SIGUSR1 , pauseHandler );
+	signal( SIGUSR2 , pauseHandler );
+#endif
+
+	// render the reference scenes of a suite and report the times , the arguments after it are the suite , the report and
+	// the report of an earlier run to compare with
+	if( strcmp( argv[1] , "renderbench" ) == 0 )
+	{
+		RenderBenchmark benchmark( ( argc > 2 ) ? argv[2] : "suite.txt" );
+		const int result = benchmark.Run( ( argc > 3 ) ? argv[3] : "sort_bench.json" , ( argc > 4 ) ? argv[4] : "" );
+		g_System.Uninit();
+		flushLog();
+		return result;
+	}
+
+	// keep the process alive and render the settings files read from the standard input one by one , each line is
+	// 'render <settings file>' or 'quit'. the threads stay alive and the scene is only loaded again once its files change.
+	// a line 'SORT_JOB_DONE <settings file>' or 'SORT_JOB_FAILED <settings file>' is printed after each rendering.
+	if( strcmp( argv[1] , "server" ) == 0 )
+	{
+		g_bBlenderMode = ( argc > 2 && strcmp( argv[2] , "blendermode" ) == 0 );
+
+		string line;
+		while( std::getline( std::cin , line ) )
+		{
+			std::istringstream command( line );
+			string op , file;
+			command >> op;
+			std::getline( command >> std::ws , file );
+			if( op == "quit" )
+				break;
+			if( op != "render" || file.empty() )
+			{
+				slog( WARNING , GENERAL , stringFormat( "Unknown command '%s' of the render server." , line.c_str() ) );
+				continue;
+			}
+
+			// the first interrupt only cancels the current rendering
+			signal( SIGINT , cancelHandler );
+			signal( SIGTERM , cancelHandler );
+
+			slog( INFO , GENERAL , "Scene file (" + file + ")" );
+			const bool done = g_System.Setup( file.c_str() );
+			if( done )
+			{
+				g_System.Render();
+				g_System.OutputLog();
+			}
+			g_System.Reset();
+
+			// the messages of the job are written before its result , the client reads the output up to it
+			flushLog();
+			cout<<( done ? "SORT_JOB_DONE " : "SORT_JOB_FAILED " )<<file<<endl;
+		}
+
+		g_System.Uninit();
+		return 0;
+	}
+
     slog( INFO , GENERAL , "Scene file (" + std::string(argv[1]) + ")" );
-    
+
+	// convert a render setting , scene or material file into the binary encoding instead of rendering
+	if( argc > 3 && strcmp( argv[2] , "binaryxml" ) == 0 )
+	{
+		TiXmlDocument doc( argv[1] );
+		if( XmlBinary::Load( doc ) && XmlBinary::Save( doc , argv[3] ) )
+			slog( INFO , GENERAL , stringFormat( "%s is converted into binary file %s." , argv[1] , argv[3] ) );
+		else
+			slog( WARNING , GENERAL , stringFormat( "Failed to convert %s into binary file %s." , argv[1] , argv[3] ) );
+		return 0;
+	}
+
+	// render the frames from the one after 'frames' to the one after it in one process , each run of '#' in the names of the
+	// setting file , the scene file and the output files is replaced by the frame. the scene is only loaded again if anything
+	// but the placement and the vertexes of its models changed , the files of the next frame are read while a frame is rendered.
+	if( argc > 4 && strcmp( argv[2] , "frames" ) == 0 )
+	{
+		const int first = atoi( argv[3] );
+		const int last = atoi( argv[4] );
+		int failed = 0;
+		for( int frame = first ; frame <= last ; ++frame )
+		{
+			const string setting = FrameName( argv[1] , frame );
+			slog( INFO , GENERAL , stringFormat( "Frame %d (%s)" , frame , setting.c_str() ) );
+
+			g_System.SetFrame( frame );
+			if( g_System.Setup( setting.c_str() ) )
+			{
+				if( frame < last )
+					g_System.PrefetchFrame( argv[1] , frame + 1 );
+				g_System.Render();
+				g_System.OutputLog();
+			}
+			else
+				++failed;
+
+			// an interrupt cancels the rest of the frames too
+			const bool cancelled = RenderControl::GetSingleton().IsCancelled();
+			g_System.Reset();
+			if( cancelled )
+				break;
+		}
+
+		g_System.Uninit();
+		return failed ? 1 : 0;
+	}
+
 	// enable blender mode if possible
+	bool benchmark = false;
+	string farm_worker;
 	if (argc > 2)
 	{
 		if (strcmp(argv[2], "blendermode") == 0)
 			g_bBlenderMode = true;
+		// compare accelerators instead of rendering, the arguments after it are the accelerators and the number of rays
+		else if (strcmp(argv[2], "accelbench") == 0)
+			benchmark = true;
+		// render the image along with the workers of a render farm connecting to the port after it , 7878 by default
+		else if (strcmp(argv[2], "coordinator") == 0)
+			g_System.SetFarmPort( (unsigned short)( ( argc > 3 ) ? atoi( argv[3] ) : 7878 ) );
+		// render tasks of the coordinator 'host:port' after it , the scene files have to be accessible by the same paths
+		else if (strcmp(argv[2], "worker") == 0 && argc > 3)
+			farm_worker = argv[3];
 	}
 
 	// setup the system
 	if( g_System.Setup( argv[1] ) )
 	{
+		if( benchmark )
+		{
+			const string types = ( argc > 3 ) ? argv[3] : "bvh,qbvh,obvh,lbvh,kd_tree,octree,uniform_grid";
+			const unsigned ray_num = ( argc > 4 ) ? max( atoi( argv[4] ) , 1 ) : 65536;
+			g_System.BenchmarkAccelerators( types , ray_num );
+			g_System.Uninit();
+			return 0;
+		}
+
+		if( !farm_worker.empty() )
+		{
+			const size_t colon = farm_worker.find_last_of( ':' );
+			const string host = ( colon == string::npos ) ? farm_worker : farm_worker.substr( 0 , colon );
+			const int port = ( colon == string::npos ) ? 7878 : atoi( farm_worker.c_str() + colon + 1 );
+			g_System.RenderFarmWorker( host , (unsigned short)port );
+			g_System.OutputLog();
+			g_System.Uninit();
+			return 0;
+		}
+
 		// do ray tracing
 		g_System.Render();
 
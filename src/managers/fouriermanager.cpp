@@ -0,0 +1,108 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+// include the header
+#include "fouriermanager.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+
+// header of a Fourier bsdf file , all values are 4 bytes and of the same endian with the system
+struct FourierFileHeader
+{
+	char	magic[8];
+	int		flags;
+	int		nMu;
+	int		nCoeffs;
+	int		nMax;
+	int		nChannels;
+	int		nBases;
+	int		unused0[3];
+	float	eta;
+	int		unused1[4];
+};
+static_assert( sizeof( FourierFileHeader ) == 64 , "Fourier bsdf header has to be 64 bytes." );
+
+static const char FOURIER_MAGIC[8] = { 'S' , 'C' , 'A' , 'T' , 'F' , 'U' , 'N' , '\x01' };
+
+// load the table of a Fourier bsdf file
+std::shared_ptr<const FourierTable> FourierManager::Load( const string& filename )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	auto it = m_tables.find( filename );
+	if( it != m_tables.end() )
+		return it->second;
+
+	auto table = std::make_shared<FourierTable>();
+	if( !_map( *table , filename ) ){
+		slog( WARNING , MATERIAL , stringFormat( "Failed to load fourier bsdf %s." , filename.c_str() ) );
+		return nullptr;
+	}
+	slog( INFO , MATERIAL , stringFormat( "Fourier bsdf %s is mapped, %d elevations and %d coefficients at most." , filename.c_str() , table->nMu , table->nMax ) );
+
+	m_tables.emplace( filename , table );
+	return table;
+}
+
+// map a Fourier bsdf file and point the table into it
+bool FourierManager::_map( FourierTable& table , const string& filename ) const
+{
+	// the coefficients are looked up all over the place , the whole file is loaded ahead
+	if( !table.m_file.Open( filename , false ) || table.m_file.GetSize() < sizeof( FourierFileHeader ) )
+		return false;
+
+	FourierFileHeader header;
+	memcpy( &header , table.m_file.GetData() , sizeof( header ) );
+	if( memcmp( header.magic , FOURIER_MAGIC , sizeof( FOURIER_MAGIC ) ) != 0 || header.flags != 1 || header.nMu <= 1 ||
+		header.nCoeffs <= 0 || header.nMax <= 0 || ( header.nChannels != 1 && header.nChannels != 3 ) )
+		return false;
+	if( header.nMax > FOURIER_MAX_ORDER ){
+		slog( WARNING , MATERIAL , stringFormat( "Fourier bsdf %s has %d coefficients, at most %d are supported." , filename.c_str() , header.nMax , FOURIER_MAX_ORDER ) );
+		return false;
+	}
+
+	const size_t sqMu = (size_t)header.nMu * header.nMu;
+	const size_t size = sizeof( header ) + sizeof( float ) * ( header.nMu + sqMu + header.nCoeffs ) + sizeof( int ) * 2 * sqMu;
+	if( table.m_file.GetSize() < size )
+		return false;
+
+	// all arrays are of 4 bytes values following the header , they are aligned in the mapped file
+	const char* data = table.m_file.GetData() + sizeof( header );
+	table.eta = header.eta;
+	table.nMax = header.nMax;
+	table.nChannels = header.nChannels;
+	table.nMu = header.nMu;
+	table.mu = (const float*)data;
+	table.cdf = table.mu + header.nMu;
+	table.offsetAndLength = (const int*)( table.cdf + sqMu );
+	table.a = (const float*)( table.offsetAndLength + 2 * sqMu );
+
+	table.a0.resize( sqMu );
+	for( size_t i = 0 ; i < sqMu ; ++i ){
+		const int offset = table.offsetAndLength[2*i] , m = table.offsetAndLength[2*i+1];
+		if( offset < 0 || m < 0 || m > header.nMax || (size_t)offset + (size_t)m * header.nChannels > (size_t)header.nCoeffs )
+			return false;
+		table.a0[i] = ( m > 0 ) ? table.a[offset] : 0.0f;
+	}
+
+	table.recip.resize( header.nMax );
+	table.recip[0] = 0.0f;
+	for( int i = 1 ; i < header.nMax ; ++i )
+		table.recip[i] = 1.0f / (float) i;
+
+	table.m_tracker.Set( table.m_file.GetSize() + sizeof( float ) * ( table.a0.size() + table.recip.size() ) );
+	return true;
+}
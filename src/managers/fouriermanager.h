@@ -0,0 +1,58 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+#pragma once
+
+#include "utility/singleton.h"
+#include "bsdf/fouriertable.h"
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+//////////////////////////////////////////////////////////////////
+//	definition of fourier manager
+//	desc :	Fourier bsdf files are mapped and shared by all materials
+//			referring to the same file, the tables are never modified
+//			once they are loaded.
+class FourierManager : public Singleton<FourierManager>
+{
+// public method
+public:
+	// load the table of a Fourier bsdf file , the table is shared if the file is loaded already
+	// para 'filename' : name of the Fourier bsdf file
+	// result          : the table , nullptr if the file is not a valid Fourier bsdf file
+	std::shared_ptr<const FourierTable> Load( const string& filename );
+
+// private data
+private:
+	// the tables keyed by the file name
+	unordered_map< string , std::shared_ptr<const FourierTable> > m_tables;
+	// materials may be loaded by several threads
+	std::mutex m_mutex;
+
+// private method
+private:
+	// private default constructor
+	FourierManager(){}
+
+	// map a Fourier bsdf file and point the table into it
+	// para 'table'     : the table to be loaded
+	// para 'filename'  : name of the Fourier bsdf file
+	// result           : true if the file is valid
+	bool _map( FourierTable& table , const string& filename ) const;
+
+	friend class Singleton<FourierManager>;
+};
@@ -27,10 +27,44 @@
 #include "utility/creator.h"
 #include "material/matte.h"
 #include "log/log.h"
+#include "utility/xmlbinary.h"
+#include "utility/strhelper.h"
+#include "material/shadingstats.h"
+#include "utility/profiler.h"
+#include <algorithm>
+
+// collect the image files referred by the image nodes under an element
+static void _collectImages( const TiXmlElement* element , std::vector<string>& files )
+{
+	for( const TiXmlElement* prop = element->FirstChildElement( "Property" ) ; prop ; prop = prop->NextSiblingElement( "Property" ) )
+	{
+		const char* node = prop->Attribute( "node" );
+		if( node && strcmp( node , "SORTNodeImage" ) == 0 )
+		{
+			for( const TiXmlElement* sub = prop->FirstChildElement( "Property" ) ; sub ; sub = sub->NextSiblingElement( "Property" ) )
+			{
+				const char* name = sub->Attribute( "name" );
+				const char* value = sub->Attribute( "value" );
+				if( name && value && strcmp( name , "Filename" ) == 0 )
+					files.push_back( value );
+			}
+		}
+		_collectImages( prop , files );
+	}
+}
+
+// the text of a material in the file , an edited material has a different one
+static string _materialText( const TiXmlElement* element )
+{
+	TiXmlPrinter printer;
+	element->Accept( &printer );
+	return printer.CStr();
+}
 
 // find specific material
 std::shared_ptr<Material> MatManager::FindMaterial( const string& mat_name ) const
 {
+	std::lock_guard<std::recursive_mutex> lock( m_matMutex );
     std::unordered_map< string , std::shared_ptr<Material> >::const_iterator it = m_matPool.find( mat_name );
     return it == m_matPool.end() ? nullptr : it->second;
 }
@@ -45,10 +79,17 @@ std::shared_ptr<Material> MatManager::GetDefaultMat()
 // parse material file and add the materials into the manager
 unsigned MatManager::ParseMatFile( const string& str )
 {
-	// load the xml file
+	SORT_PROFILE( "MatManager::ParseMatFile" );
+	std::lock_guard<std::recursive_mutex> lock( m_matMutex );
+
+	// a material library referred by many models is only parsed once
 	const string& full_filename_path = GetFullPath(str).c_str();
+	if( !m_parsedFiles.insert( full_filename_path ).second )
+		return 0;
+
+	// load the xml file
 	TiXmlDocument doc( full_filename_path.c_str() );
-	doc.LoadFile();
+	XmlBinary::Load( doc );
 
 	// if there is error , return false
 	if( doc.Error() )
@@ -60,6 +101,16 @@ unsigned MatManager::ParseMatFile( const string& str )
 	// get the root of xml
 	TiXmlNode*	root = doc.RootElement();
 
+	// images of all new materials are decoded together before the nodes read them one by one
+	std::vector<string> images;
+	for( const TiXmlElement* material = root->FirstChildElement( "Material" ) ; material ; material = material->NextSiblingElement( "Material" ) )
+	{
+		const char* name = material->Attribute( "name" );
+		if( name && FindMaterial( name ) == 0 )
+			_collectImages( material , images );
+	}
+	TexManager::GetSingleton().Prefetch( images );
+
 	// parse materials
 	TiXmlElement* material = root->FirstChildElement( "Material" );
 	while( material )
@@ -79,10 +130,12 @@ unsigned MatManager::ParseMatFile( const string& str )
 
         std::shared_ptr<Material> mat = std::make_shared<Material>();
 		mat->SetName(name);
+		mat->SetID( (unsigned)m_matPool.size() + 1 );
 		mat->ParseMaterial( material );
 
 		// push the material
 		m_matPool.insert( make_pair( name , mat ) );
+		m_matText[name] = _materialText( material );
 
 		// parse the next material
 		material = material->NextSiblingElement( "Material" );
@@ -91,8 +144,103 @@ unsigned MatManager::ParseMatFile( const string& str )
 	return 0;
 }
 
+// release all materials
+void MatManager::Release()
+{
+	std::lock_guard<std::recursive_mutex> lock( m_matMutex );
+	m_matPool.clear();
+	m_matText.clear();
+	m_parsedFiles.clear();
+}
+
+// parse the edited material file again
+unsigned MatManager::UpdateMatFile( const string& str )
+{
+	std::lock_guard<std::recursive_mutex> lock( m_matMutex );
+
+	TiXmlDocument doc( str.c_str() );
+	XmlBinary::Load( doc );
+	if( doc.Error() )
+	{
+        slog( WARNING , MATERIAL , stringFormat( "%s. Material \"%s\" file load failed" , doc.ErrorDesc() , str.c_str() ) );
+		return 0;
+	}
+
+	// only the materials with different text are parsed again , the exporter writes the whole file for any edit
+	std::vector<TiXmlElement*> edited;
+	std::vector<string> images;
+	for( TiXmlElement* material = doc.RootElement()->FirstChildElement( "Material" ) ; material ; material = material->NextSiblingElement( "Material" ) )
+	{
+		const char* name = material->Attribute( "name" );
+		if( name == nullptr )
+			continue;
+		auto it = m_matText.find( name );
+		if( it != m_matText.end() && it->second == _materialText( material ) )
+			continue;
+		edited.push_back( material );
+		_collectImages( material , images );
+	}
+	TexManager::GetSingleton().Prefetch( images );
+
+	for( auto material : edited )
+	{
+		const string name = material->Attribute( "name" );
+		std::shared_ptr<Material> mat = FindMaterial( name );
+		if( mat )
+			mat->ReloadMaterial( material );
+		else
+		{
+			mat = std::make_shared<Material>();
+			mat->SetName(name);
+			mat->SetID( (unsigned)m_matPool.size() + 1 );
+			mat->ParseMaterial( material );
+			m_matPool.insert( make_pair( name , mat ) );
+		}
+		m_matText[name] = _materialText( material );
+	}
+
+	return (unsigned)edited.size();
+}
+
 // get material number
 unsigned MatManager::GetMatCount() const
 {
+	std::lock_guard<std::recursive_mutex> lock( m_matMutex );
 	return (unsigned)m_matPool.size();
 }
+
+// output the shading statistics of the materials
+void MatManager::OutputLog() const
+{
+	const std::vector<ShadingCounter> total = ShadingStats::Total();
+
+	// the default material takes id 0
+	std::vector< std::pair< string , const Material* > > materials;
+	materials.push_back( make_pair( string( "default" ) , nullptr ) );
+	{
+		std::lock_guard<std::recursive_mutex> lock( m_matMutex );
+		for( auto& it : m_matPool )
+			materials.push_back( make_pair( it.first , it.second.get() ) );
+	}
+
+	auto counter = [&]( const Material* mat ) -> const ShadingCounter& {
+		return total[ min( mat ? mat->GetID() : 0u , (unsigned)SHADING_STATS_MATERIALS - 1 ) ];
+	};
+	std::sort( materials.begin() , materials.end() , [&]( const std::pair< string , const Material* >& a , const std::pair< string , const Material* >& b ){
+		return counter( a.second ).ticks > counter( b.second ).ticks;
+	} );
+
+	unsigned long long ticks = 0;
+	for( const ShadingCounter& c : total )
+		ticks += c.ticks;
+	slog( INFO , PERFORMANCE , stringFormat( "Shading statistics: %llu cycles in total." , ticks ) );
+
+	for( auto& it : materials ){
+		const ShadingCounter& c = counter( it.second );
+		if( c.bsdfs == 0 && c.evaluations == 0 )
+			continue;
+		const MaterialCost cost = it.second ? it.second->GetCost() : MaterialCost();
+		slog( INFO , PERFORMANCE , stringFormat( "Material %s: %.1f%% of the cycles, %llu bsdfs, %llu evaluations, %.0f cycles per bsdf, %d nodes, %d textures, %d bxdfs." ,
+			it.first.c_str() , 100.0 * c.ticks / max( ticks , 1ULL ) , c.bsdfs , c.evaluations , (double)c.ticks / max( c.bsdfs , 1ULL ) , cost.nodes , cost.textures , cost.bxdfs ) );
+	}
+}
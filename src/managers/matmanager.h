@@ -21,7 +21,9 @@
 #include "utility/singleton.h"
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
+#include <mutex>
 
 // pre-decleration
 class Material;
@@ -50,15 +52,39 @@ public:
 	// parse material file and add the materials into the manager
 	// para 'str' : name of the material file
 	// result     : the number of materials in the file
+	// note       : a file is only parsed once , models referring to the same material library share its materials
 	unsigned	ParseMatFile( const string& str );
 
 	// get material number
 	unsigned	GetMatCount() const;
 
+	// get the material files parsed already
+	const std::unordered_set< string >& GetParsedFiles() const { return m_parsedFiles; }
+
+	// release all materials , the material files are parsed again afterward
+	void		Release();
+
+	// parse the material file again after it is edited
+	// para 'str' : the full name of the material file , it is one of the parsed files
+	// result     : the number of materials parsed again
+	// note       : only the edited materials are parsed again , they are updated in place so that the primitives referring to
+	//				them see the new ones. materials new in the file are added.
+	unsigned	UpdateMatFile( const string& str );
+
+	// output the shading statistics of the materials , the most expensive ones go first
+	// note : the statistics are only counted with SORT_SHADING_STATS enabled
+	void		OutputLog() const;
+
 // private field
 private:
 	// material pool
     std::unordered_map< string , std::shared_ptr<Material> >	m_matPool;
+	// models could be loaded concurrently , the pool is guarded by the mutex
+	mutable std::recursive_mutex	m_matMutex;
+	// the material files parsed already
+	std::unordered_set< string >	m_parsedFiles;
+	// the text of each material in its file , edited materials are found by it
+	std::unordered_map< string , string >	m_matText;
 
 	friend class Singleton<MatManager>;
 };
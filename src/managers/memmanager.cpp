@@ -17,75 +17,121 @@
 
 // include the headers
 #include "memmanager.h"
-#include "utility/define.h"
 #include "log/log.h"
 #include "utility/strhelper.h"
 
-// default constructor
-MemManager::MemManager()
+// chunks are aligned to cache lines , it covers the alignment of all simd types
+static const size_t MEM_CHUNK_ALIGN = 64;
+
+// the arena of the current thread
+Thread_Local MemArena*	MemManager::ms_threadArena = nullptr;
+Thread_Local int		MemManager::ms_threadArenaId = -1;
+
+// move to the next chunk large enough for the allocation
+void* MemArena::_allocSlow( size_t size , size_t align )
+{
+	// chunks left behind by a rewind are reused , the ones too small for the allocation are skipped until the next rewind
+	size_t next = ( m_current < m_chunks.size() ) ? m_current + 1 : 0;
+	while( next < m_chunks.size() && m_chunks[next].m_size < size )
+		++next;
+
+	if( next == m_chunks.size() ){
+		// chunks double in size so that the number of chunks stays small for arenas used heavily
+		const size_t shift = min( m_chunks.size() , (size_t)16 );
+		Chunk chunk;
+		chunk.m_size = max( min( m_chunkSize << shift , max( m_maxChunkSize , m_chunkSize ) ) , size );
+		chunk.m_memory = (char*)sort_aligned_malloc( chunk.m_size , max( align , MEM_CHUNK_ALIGN ) );
+		sAssertMsg( nullptr != chunk.m_memory , GENERAL , stringFormat( "Failed to allocate a chunk of %lld bytes in memory manager." , (long long)chunk.m_size ) );
+		m_chunks.push_back( chunk );
+		m_committed += chunk.m_size;
+		m_tracker.Set( m_committed );
+	}
+
+	// the skipped chunks count as allocated until the arena is rewound
+	_updatePeak();
+	for( size_t i = ( m_current < m_chunks.size() ) ? m_current : 0 ; i < next ; ++i )
+		m_base += m_chunks[i].m_size;
+	m_current = next;
+	m_offset = size;
+	return m_chunks[next].m_memory;
+}
+
+// make sure the first chunk holds at least 'size' bytes
+void MemArena::Reserve( size_t size )
+{
+	if( m_chunks.size() != 1 || m_chunks[0].m_size < size ){
+		Release();
+		Chunk chunk;
+		chunk.m_size = size;
+		chunk.m_memory = (char*)sort_aligned_malloc( size , MEM_CHUNK_ALIGN );
+		sAssertMsg( nullptr != chunk.m_memory , GENERAL , stringFormat( "Failed to allocate a chunk of %lld bytes in memory manager." , (long long)size ) );
+		m_chunks.push_back( chunk );
+		m_committed = size;
+		m_tracker.Set( m_committed );
+	}
+	Clear();
+}
+
+// free all chunks
+void MemArena::Release()
 {
-	// 16mb memory for default
-	PreMalloc( 1024 * 1024 * 1024 );
+	for( auto& chunk : m_chunks )
+		sort_aligned_free( chunk.m_memory );
+	m_chunks.clear();
+	m_committed = 0;
+	m_tracker.Set( 0 );
+	Clear();
 }
 
 // destructor
 MemManager::~MemManager()
 {
-	_deallocAllMemory();
+	m_MemPool.clear();
+}
+
+// get the arena
+MemArena& MemManager::_getArena( unsigned id )
+{
+	std::lock_guard<std::mutex> lock( m_MemPoolMutex );
+	std::unique_ptr<MemArena>& arena = m_MemPool[id];
+	if( !arena )
+		arena.reset( new MemArena() );
+	return *arena;
 }
 
 // pre-allocate memory
-void MemManager::PreMalloc( unsigned size , unsigned id )
+void MemManager::PreMalloc( size_t size , unsigned id )
 {
 	// if size is equal to zero , just return
 	if( size == 0 )
 		return;
 
-	Memory* mem = _getMemory( id );
-
-	if( mem != 0 )
-	{
-		if( size != mem->m_size )
-			DeAlloc( id );
-		else
-		{
-			ClearMem( id );
-			return;
-		}
-	}
-
-	// create new memory
-	mem = new Memory();
-	mem->m_memory = new char[size];
-	// reset offset
-	mem->m_offset = 0;
-	// set size
-	mem->m_size = size;
-
-	// push it into the map
-	m_MemPool.insert( make_pair( id , mem ) );
+	_getArena( id ).Reserve( size );
 }
 
 // clear the allocated memory
 void MemManager::ClearMem( unsigned id )
 {
-	Memory* mem = _getMemory( id );
-	if( mem == 0 )
-        slog( WARNING , GENERAL , stringFormat( "Can't clear memory, because there is no memory with id %d." , id ) );
-
-	//reset the offset
-	mem->m_offset = 0;
+	_getArena( id ).Clear();
 }
 
 // de-allocate memory
 void MemManager::DeAlloc( unsigned id )
 {
-	Memory* mem = _getMemory( id );
-	if( mem == 0 )
-        slog( WARNING , GENERAL , stringFormat( "Can't delete memory, because there is no memory with id %d." , id ) );
-
-	// reset offset and size
-	delete mem;
+	// the arena itself is kept , threads could still cache a pointer to it
+	_getArena( id ).Release();
+}
 
-	m_MemPool.erase( id );
+// output the high water mark and the committed memory of the arenas
+void MemManager::OutputLog()
+{
+	std::lock_guard<std::mutex> lock( m_MemPoolMutex );
+	size_t peak = 0 , max_peak = 0 , committed = 0;
+	for( auto& it : m_MemPool ){
+		peak += it.second->GetPeak();
+		max_peak = max( max_peak , it.second->GetPeak() );
+		committed += it.second->GetCommitted();
+	}
+	slog( INFO , PERFORMANCE , stringFormat( "Memory manager : %d arenas, high water mark %.2f MB ( %.2f MB in the largest arena ), %.2f MB committed." ,
+		(int)m_MemPool.size() , peak / ( 1024.0 * 1024.0 ) , max_peak / ( 1024.0 * 1024.0 ) , committed / ( 1024.0 * 1024.0 ) ) );
 }
@@ -20,47 +20,143 @@
 // include the header
 #include "utility/singleton.h"
 #include "utility/multithread/multithread.h"
+#include "utility/define.h"
 #include "log/log.h"
 #include "utility/strhelper.h"
+#include "utility/memstats.h"
 #include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
 
-struct Memory
+//////////////////////////////////////////////////////////////////////////////////
+// definition of memory arena
+// desc :	Memory arena is a bump allocator over a list of chunks. Allocation just
+//			moves the offset in the current chunk forward , a new chunk is taken
+//			once the current one is exhausted. Rewinding the arena keeps the chunks
+//			so that they are reused by later allocations without touching the heap.
+//			Chunks are only taken when memory is asked for and their sizes grow with
+//			the number of chunks , the footprint of an arena follows its actual use.
+//			The chunks are written by the thread using the arena , which places their
+//			pages on its numa node once threads are pinned.
+//			An arena is only used by one thread at a time , there is no lock at all.
+class	MemArena
 {
-	char*		m_memory;
-	unsigned	m_offset;
-	unsigned	m_size;
+public:
+	// position in the arena , the arena could be rewound to it
+	struct Marker
+	{
+		size_t	m_chunk = 0;
+		size_t	m_offset = 0;
+		size_t	m_base = 0;
+	};
+
+	// constructor
+	// para 'chunk_size' : the size of the first chunk , later chunks double it up to 'max_chunk_size'
+	// para 'max_chunk_size' : the maximum size of chunks taken when the arena grows
+	MemArena( size_t chunk_size = 64 * 1024 , size_t max_chunk_size = 16 * 1024 * 1024 ) : m_chunkSize( chunk_size ) , m_maxChunkSize( max_chunk_size ) {}
+	// destructor
+	~MemArena() { Release(); }
+
+	// allocate memory
+	// para 'size'  : the size of the memory in bytes
+	// para 'align' : the alignment of the memory , it has to be a power of two
+	void* Alloc( size_t size , size_t align )
+	{
+		if( m_current < m_chunks.size() ){
+			Chunk& chunk = m_chunks[m_current];
+			const size_t offset = ( m_offset + align - 1 ) & ~( align - 1 );
+			if( offset + size <= chunk.m_size ){
+				m_offset = offset + size;
+				return chunk.m_memory + offset;
+			}
+		}
+		return _allocSlow( size , align );
+	}
+
+	// allocate an array of objects , memory is aligned to the alignment of the type
+	// para 'count' : the number of objects
+	template< typename T >
+	T* Alloc( size_t count ) { return (T*)Alloc( sizeof( T ) * count , alignof( T ) ); }
 
-	Memory()
+	// get the current position of the arena
+	Marker GetMarker() const
 	{
-		m_memory=0;
-		m_offset=0;
-		m_size=0;
+		Marker marker;
+		marker.m_chunk = m_current;
+		marker.m_offset = m_offset;
+		marker.m_base = m_base;
+		return marker;
 	}
-	~Memory()
+
+	// rewind the arena , memory allocated after the marker is released
+	// para 'marker' : the position returned by GetMarker
+	void Rewind( const Marker& marker )
 	{
-		delete[] m_memory;
-		m_offset=0;
-		m_size=0;
+		_updatePeak();
+		m_current = marker.m_chunk;
+		m_offset = marker.m_offset;
+		m_base = marker.m_base;
 	}
+
+	// release all memory allocated from the arena , chunks are kept for reuse
+	void Clear() { Rewind( Marker() ); }
+
+	// make sure the first chunk holds at least 'size' bytes , it is the only chunk afterward
+	// para 'size' : the size of the first chunk in bytes
+	void Reserve( size_t size );
+
+	// free all chunks
+	void Release();
+
+	// get the number of bytes allocated from the arena , alignment padding included
+	size_t GetOffset() const { return m_base + m_offset; }
+	// get the maximum number of bytes allocated from the arena at once
+	size_t GetPeak() const { return max( m_peak , GetOffset() ); }
+	// get the number of bytes taken by the chunks of the arena
+	size_t GetCommitted() const { return m_committed; }
+
+private:
+	// a chunk of memory
+	struct Chunk
+	{
+		char*	m_memory;
+		size_t	m_size;
+	};
+
+	std::vector<Chunk>	m_chunks;		// the chunks of the arena
+	size_t				m_current = 0;	// the chunk allocations are taken from
+	size_t				m_offset = 0;	// the offset in the current chunk
+	size_t				m_base = 0;		// the total size of the chunks before the current one
+	size_t				m_peak = 0;		// the high water mark of allocated bytes
+	size_t				m_committed = 0;// the total size of the chunks
+	MemoryTracker		m_tracker{ MEM_ARENA };	// the chunks accounted in memory statistics
+	size_t				m_chunkSize;	// the size of the first chunk
+	size_t				m_maxChunkSize;	// the maximum size of new chunks
+
+	// move to the next chunk large enough for the allocation , a new chunk is allocated if there isn't
+	void* _allocSlow( size_t size , size_t align );
+
+	// record the allocated bytes in the high water mark
+	void _updatePeak() { m_peak = max( m_peak , GetOffset() ); }
 };
 
 //////////////////////////////////////////////////////////////////////////////////
 // definition of memory manager
-// desc :	Memory manager could allocate small memory space efficiently. Actually
-//			it would pre-allocate some memmory space , it will return alloacted space 
-//			when asked for memory space , not really allocate it so that to save
-//			more time on allocating memory.
+// desc :	Memory manager could allocate small memory space efficiently. Each thread
+//			allocates from its own arena , the arena of the current thread is cached
+//			in thread local storage so that allocations don't look up or lock anything.
+//			Arenas with explicit ids are also supported for memory shared by a build
+//			step , they are not thread safe.
 class	MemManager : public Singleton<MemManager>
 {
 // public method
 public:
-	// default constructor
-	MemManager();
 	// destructor
 	~MemManager();
 
-	// pre-allocate memory
-	void PreMalloc( unsigned size , unsigned id = 0 );
+	// pre-allocate memory , the memory is contiguous as long as allocations fit in it
+	void PreMalloc( size_t size , unsigned id = 0 );
 
 	// clear the allocated memory
 	void ClearMem( unsigned id=0 );
@@ -68,69 +164,84 @@ public:
 	// de-allocate memory
 	void DeAlloc( unsigned id=0 );
 
+	// get the arena of the current thread
+	MemArena& ThreadArena()
+	{
+		const int tid = ThreadId();
+		if( ms_threadArena == nullptr || ms_threadArenaId != tid ){
+			ms_threadArena = &_getArena( (unsigned)tid );
+			ms_threadArenaId = tid;
+		}
+		return *ms_threadArena;
+	}
+
 	// get pointer and set the offset
 	template< typename T >
-	T* GetPtr(unsigned count , unsigned id=0)
+	T* GetPtr(size_t count , unsigned id=0)
 	{
-		// get the memory pointer first
-		Memory* mem = _getMemory(id);
-
-        sAssertMsg( nullptr != mem , GENERAL , stringFormat( "No memory with id %d." , id ) );
-        sAssertMsg( sizeof( T ) * count + mem->m_offset <= mem->m_size , GENERAL , stringFormat( "There is not enough memory in memory manager.(mem id:%d)" , id ) );
-        
-		unsigned addr = mem->m_offset;
-		mem->m_offset += sizeof(T) * count;
-		return (T*)(mem->m_memory + addr);
+		return _getArena(id).Alloc<T>(count);
 	}
 
 	// get the offset of the memory
-	unsigned GetOffset( unsigned id=0 ) const
+	size_t GetOffset( unsigned id=0 )
 	{
-		Memory* mem = _getMemory(id);
-        sAssertMsg( nullptr != mem , GENERAL , stringFormat( "No memory with id %d. " , id ) );
-		return mem->m_offset;
+		return _getArena(id).GetOffset();
 	}
 
+	// output the high water mark and the committed memory of the arenas
+	void OutputLog();
+
 // private field
 private:
-	// the memories
-	unordered_map<unsigned,Memory*> m_MemPool;
+	// the arenas , they are never deleted before the manager so that cached pointers stay valid
+	unordered_map<unsigned,std::unique_ptr<MemArena>> m_MemPool;
+	// the mutex protecting the map of arenas
+	std::mutex	m_MemPoolMutex;
 
-	// get memory
-	Memory*	_getMemory( unsigned id ) const
-	{
-		unordered_map<unsigned,Memory*>::const_iterator it = m_MemPool.find(id);
-		if( it != m_MemPool.end() )
-			return it->second;
-		return nullptr;
-	}
+	// the arena of the current thread and the thread id it belongs to
+	static Thread_Local MemArena*	ms_threadArena;
+	static Thread_Local int			ms_threadArenaId;
 
-	// dealloc all memory
-	void _deallocAllMemory()
-	{
-		unordered_map<unsigned,Memory*>::const_iterator it = m_MemPool.begin();
-		while( it != m_MemPool.end() )
-		{
-			delete it->second;
-			it++;
-		}
-		m_MemPool.clear();
-	}
+	// default constructor
+	MemManager() {}
+
+	// get the arena , it is created if there isn't one with the id
+	MemArena& _getArena( unsigned id );
 
 	friend class Singleton<MemManager>;
 };
 
+//////////////////////////////////////////////////////////////////////////////////
+// definition of memory scope
+// desc :	Memory allocated from the arena of the current thread during the lifetime
+//			of the scope is released once the scope ends.
+class	MemScope
+{
+public:
+	// constructor
+	MemScope() : m_arena( MemManager::GetSingleton().ThreadArena() ) , m_marker( m_arena.GetMarker() ) {}
+	// destructor
+	~MemScope() { m_arena.Rewind( m_marker ); }
+
+private:
+	MemArena&			m_arena;	// the arena of the thread
+	MemArena::Marker	m_marker;	// the position of the arena when the scope started
+
+	MemScope( const MemScope& ) = delete;
+	MemScope& operator=( const MemScope& ) = delete;
+};
+
 // allocate memory
-#define	SORT_MALLOC(T) SORT_MALLOC_ID(T,ThreadId())
+#define	SORT_MALLOC(T) new (MemManager::GetSingleton().ThreadArena().Alloc<T>(1)) T
 #define SORT_MALLOC_ID(T,id) new (MemManager::GetSingleton().GetPtr<T>(1,id)) T
-#define SORT_MALLOC_ARRAY(T,c) SORT_MALLOC_ARRAY_ID( T , c , ThreadId() )
+#define SORT_MALLOC_ARRAY(T,c) new (MemManager::GetSingleton().ThreadArena().Alloc<T>(c)) T
 #define	SORT_MALLOC_ARRAY_ID(T,c,id) new (MemManager::GetSingleton().GetPtr<T>(c,id)) T
 
 // get sort memory
 #define	SORT_MEMORY_ID(T,id) MemManager::GetSingleton().GetPtr<T>(0,id)
 
 // premalloc memory
-inline void SORT_PREMALLOC(unsigned size , unsigned id=0)
+inline void SORT_PREMALLOC(size_t size , unsigned id=0)
 {
 	MemManager::GetSingleton().PreMalloc(size,id);
 }
@@ -148,7 +259,7 @@ inline void SORT_DEALLOC(unsigned id=0)
 }
 
 // get the offset
-inline unsigned SORT_OFFSET(unsigned id=0)
+inline size_t SORT_OFFSET(unsigned id=0)
 {
 	return MemManager::GetSingleton().GetOffset(id);
 }
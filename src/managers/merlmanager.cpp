@@ -0,0 +1,161 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header
+#include "merlmanager.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include <fstream>
+#include <sys/stat.h>
+
+// resolution of the MERL table
+static const int MERL_SAMPLING_RES_THETA_H = 90;
+static const int MERL_SAMPLING_RES_THETA_D = 90;
+static const int MERL_SAMPLING_RES_PHI_D = 180;
+static const unsigned MERL_SAMPLING_COUNT = MERL_SAMPLING_RES_THETA_H * MERL_SAMPLING_RES_THETA_D * MERL_SAMPLING_RES_PHI_D;
+static const double MERL_SCALE[3] = { 0.0006666666666667 , 0.000766666666666667 , 0.0011066666666666667 };
+
+// version of the converted file layout , files of other versions are converted again
+static const unsigned MERL_CACHE_VERSION = 1;
+static const char MERL_CACHE_MAGIC[4] = { 'S' , 'M' , 'R' , 'L' };
+
+// the values start at a cache line in the converted file
+static const size_t MERL_CACHE_PAYLOAD = 64;
+
+// header of the converted file
+struct MerlCacheHeader
+{
+	char				magic[4];
+	unsigned			version;
+	unsigned			elementSize;	// size of each value , float or half
+	unsigned			count;			// number of values in each channel
+	long long			sourceTime;		// modification time of the MERL file
+	unsigned long long	sourceSize;		// size of the MERL file
+};
+
+// fill the header describing the MERL file and the layout
+static bool _fillHeader( MerlCacheHeader& header , const string& source , bool half )
+{
+	struct stat st;
+	if( stat( source.c_str() , &st ) != 0 )
+		return false;
+
+	memset( &header , 0 , sizeof( header ) );
+	memcpy( header.magic , MERL_CACHE_MAGIC , sizeof( MERL_CACHE_MAGIC ) );
+	header.version = MERL_CACHE_VERSION;
+	header.elementSize = half ? sizeof( unsigned short ) : sizeof( float );
+	header.count = MERL_SAMPLING_COUNT;
+	header.sourceTime = (long long)st.st_mtime;
+	header.sourceSize = (unsigned long long)st.st_size;
+	return true;
+}
+
+// load the table of a MERL file
+std::shared_ptr<const MerlTable> MerlManager::Load( const string& filename , bool half )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	const string key = filename + ( half ? ":half" : ":float" );
+	auto it = m_tables.find( key );
+	if( it != m_tables.end() )
+		return it->second;
+
+	auto table = std::make_shared<MerlTable>();
+	table->m_half = half;
+	table->m_count = MERL_SAMPLING_COUNT;
+	const string converted = filename + ( half ? ".sortmerlh" : ".sortmerl" );
+	if( _mapConverted( *table , converted , filename ) ){
+		slog( INFO , MATERIAL , stringFormat( "Merl brdf %s is mapped from %s." , filename.c_str() , converted.c_str() ) );
+	}else if( !_convert( *table , converted , filename ) ){
+		slog( WARNING , MATERIAL , stringFormat( "Failed to load merl brdf %s." , filename.c_str() ) );
+		return nullptr;
+	}
+	table->m_tracker.Set( ( half ? sizeof( unsigned short ) : sizeof( float ) ) * 3 * (size_t)MERL_SAMPLING_COUNT );
+	table->buildSampling();
+
+	m_tables.emplace( key , table );
+	return table;
+}
+
+// map the converted file of a MERL file
+bool MerlManager::_mapConverted( MerlTable& table , const string& filename , const string& source ) const
+{
+	MerlCacheHeader expected;
+	if( !_fillHeader( expected , source , table.m_half ) )
+		return false;
+
+	// the table is looked up all over the place , the whole file is loaded ahead instead of reading it sequentially
+	if( !table.m_file.Open( filename , false ) )
+		return false;
+	const size_t size = (size_t)expected.elementSize * 3 * expected.count;
+	if( table.m_file.GetSize() != MERL_CACHE_PAYLOAD + size || memcmp( table.m_file.GetData() , &expected , sizeof( expected ) ) != 0 ){
+		slog( DEBUG , MATERIAL , stringFormat( "Converted merl brdf %s is ignored, it is outdated or of another version." , filename.c_str() ) );
+		table.m_file.Close();
+		return false;
+	}
+
+	table.m_data = table.m_file.GetData() + MERL_CACHE_PAYLOAD;
+	return true;
+}
+
+// read a MERL file and convert it
+bool MerlManager::_convert( MerlTable& table , const string& filename , const string& source ) const
+{
+	ifstream file( source.c_str() , ios::binary );
+	if( false == file.is_open() )
+		return false;
+
+	int dims[3];
+	file.read( (char*)dims , sizeof( int ) * 3 );
+	if( !file || dims[0] != MERL_SAMPLING_RES_THETA_H || dims[1] != MERL_SAMPLING_RES_THETA_D || dims[2] != MERL_SAMPLING_RES_PHI_D )
+		return false;
+
+	// the doubles are read one channel at a time , only the converted values stay in memory
+	const size_t element = table.m_half ? sizeof( unsigned short ) : sizeof( float );
+	table.m_buffer.resize( element * 3 * MERL_SAMPLING_COUNT );
+	std::vector<double> channel( MERL_SAMPLING_COUNT );
+	for( unsigned c = 0 ; c < 3 ; ++c ){
+		file.read( (char*)&channel[0] , sizeof( double ) * MERL_SAMPLING_COUNT );
+		if( !file )
+			return false;
+		for( unsigned i = 0 ; i < MERL_SAMPLING_COUNT ; ++i ){
+			const float v = (float)( channel[i] * MERL_SCALE[c] );
+			const size_t k = (size_t)c * MERL_SAMPLING_COUNT + i;
+			if( table.m_half )
+				( (unsigned short*)&table.m_buffer[0] )[k] = half( v ).bits();
+			else
+				( (float*)&table.m_buffer[0] )[k] = v;
+		}
+	}
+	table.m_data = &table.m_buffer[0];
+
+	// the converted file is mapped by the next runs , the table is still valid if it can't be written
+	MerlCacheHeader header;
+	if( _fillHeader( header , source , table.m_half ) ){
+		char payload[MERL_CACHE_PAYLOAD] = { 0 };
+		memcpy( payload , &header , sizeof( header ) );
+		ofstream out( filename.c_str() , ios::binary );
+		out.write( payload , MERL_CACHE_PAYLOAD );
+		out.write( &table.m_buffer[0] , table.m_buffer.size() );
+		if( !out ){
+			out.close();
+			remove( filename.c_str() );
+			slog( DEBUG , MATERIAL , stringFormat( "Failed to write converted merl brdf %s." , filename.c_str() ) );
+		}
+	}
+	return true;
+}
@@ -0,0 +1,69 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "utility/singleton.h"
+#include "bsdf/merltable.h"
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+//////////////////////////////////////////////////////////////////
+//	definition of merl manager
+//	desc :	A MERL file holds about 35 MB of doubles, materials referring
+//			to the same file share one table of it. The table is converted
+//			to float or half once and saved next to the MERL file, later
+//			runs map the converted file instead of reading the doubles.
+class MerlManager : public Singleton<MerlManager>
+{
+// public method
+public:
+	// load the table of a MERL file , the table is shared if the file is loaded already
+	// para 'filename' : name of the MERL file
+	// para 'half'     : whether the values are stored as half
+	// result          : the table , nullptr if the file is not a valid MERL file
+	std::shared_ptr<const MerlTable> Load( const string& filename , bool half );
+
+// private data
+private:
+	// the tables keyed by the file name and the precision
+	unordered_map< string , std::shared_ptr<const MerlTable> > m_tables;
+	// materials may be loaded by several threads
+	std::mutex m_mutex;
+
+// private method
+private:
+	// private default constructor
+	MerlManager(){}
+
+	// map the converted file of a MERL file
+	// para 'table'     : the table to be loaded
+	// para 'filename'  : name of the converted file
+	// para 'source'    : name of the MERL file
+	// result           : true if the converted file is up to date and mapped
+	bool _mapConverted( MerlTable& table , const string& filename , const string& source ) const;
+
+	// read a MERL file and convert it , the converted file is written next to it
+	// para 'table'     : the table to be loaded
+	// para 'filename'  : name of the converted file
+	// para 'source'    : name of the MERL file
+	// result           : true if the MERL file is valid
+	bool _convert( MerlTable& table , const string& filename , const string& source ) const;
+
+	friend class Singleton<MerlManager>;
+};
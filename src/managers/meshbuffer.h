@@ -0,0 +1,222 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+// include the headers
+#include "sort.h"
+#include "utility/hugepage.h"
+#include <iterator>
+#include <utility>
+#include <string.h>
+
+/////////////////////////////////////////////////////////////////////////
+//	definition of mesh buffer
+//	desc :	Buffers of vertex data are large and read randomly during
+//			rendering , they are placed with HugePages. The elements are plain
+//			data and they are moved with memcpy. Once the buffers of a mesh are
+//			final , a buffer could be turned into a read-only view of a copy
+//			shared with other processes on the host. Resizing a shared buffer
+//			copies its elements into private memory first , the elements of a
+//			shared buffer must not be written otherwise.
+template< class T >
+class	MeshBuffer
+{
+// public method
+public:
+	typedef T			value_type;
+	typedef T*			iterator;
+	typedef const T*	const_iterator;
+
+	// constructors
+	MeshBuffer() {}
+	explicit MeshBuffer( size_t count ) { resize( count ); }
+	MeshBuffer( const MeshBuffer& other ) { _assign( other.m_data , other.m_size ); }
+	MeshBuffer( MeshBuffer&& other ) { swap( other ); }
+
+	// destructor
+	~MeshBuffer() { _free(); }
+
+	// assignment
+	MeshBuffer& operator = ( const MeshBuffer& other )
+	{
+		if( this != &other )
+		{
+			clear();
+			_assign( other.m_data , other.m_size );
+		}
+		return *this;
+	}
+	MeshBuffer& operator = ( MeshBuffer&& other )
+	{
+		swap( other );
+		return *this;
+	}
+
+	// the number of elements
+	size_t	size() const { return m_size; }
+	bool	empty() const { return m_size == 0; }
+	size_t	capacity() const { return m_capacity; }
+
+	// access the elements
+	T*			data() { return m_data; }
+	const T*	data() const { return m_data; }
+	T&			operator[]( size_t i ) { return m_data[i]; }
+	const T&	operator[]( size_t i ) const { return m_data[i]; }
+	iterator		begin() { return m_data; }
+	iterator		end() { return m_data + m_size; }
+	const_iterator	begin() const { return m_data; }
+	const_iterator	end() const { return m_data + m_size; }
+
+	// make room for elements
+	// para 'count' : the number of elements
+	void	reserve( size_t count )
+	{
+		if( count > m_capacity || m_shared )
+			_realloc( count > m_size ? count : m_size );
+	}
+
+	// change the number of elements , new elements are default constructed
+	// para 'count' : the number of elements
+	void	resize( size_t count )
+	{
+		if( count > m_capacity || m_shared )
+			_realloc( count );
+		for( size_t i = m_size ; i < count ; ++i )
+			new ( m_data + i ) T();
+		m_size = count;
+	}
+
+	// append an element
+	void	push_back( const T& value )
+	{
+		if( m_size == m_capacity || m_shared )
+		{
+			// the value could be an element of the buffer itself
+			const T copy = value;
+			_realloc( m_size < 8 ? 16 : 2 * m_size );
+			m_data[m_size++] = copy;
+			return;
+		}
+		m_data[m_size++] = value;
+	}
+
+	// insert a range of elements
+	// para 'pos'   : the position to insert at
+	// para 'first' : the first element of the range
+	// para 'last'  : the end of the range
+	template< class InputIt >
+	iterator	insert( const_iterator pos , InputIt first , InputIt last )
+	{
+		const size_t offset = pos - m_data;
+		const size_t count = (size_t)std::distance( first , last );
+		if( m_size + count > m_capacity || m_shared )
+			_realloc( m_size + count > 2 * m_size ? m_size + count : 2 * m_size );
+		if( offset < m_size )
+			memmove( (void*)( m_data + offset + count ) , m_data + offset , sizeof( T ) * ( m_size - offset ) );
+		for( size_t i = 0 ; first != last ; ++first , ++i )
+			new ( m_data + offset + i ) T( *first );
+		m_size += count;
+		return m_data + offset;
+	}
+
+	// remove all elements and free the memory
+	void	clear()
+	{
+		_free();
+		m_data = nullptr;
+		m_size = m_capacity = 0;
+		m_shared = false;
+	}
+
+	// exchange the elements with another buffer
+	void	swap( MeshBuffer& other )
+	{
+		std::swap( m_data , other.m_data );
+		std::swap( m_size , other.m_size );
+		std::swap( m_capacity , other.m_capacity );
+		std::swap( m_shared , other.m_shared );
+	}
+
+	// replace the elements with a read-only copy shared with other processes
+	// para 'shared' : the copy of the elements , it has to outlive the buffer
+	void	Adopt( const T* shared ) { Adopt( shared , m_size ); }
+
+	// replace the elements with read-only ones owned elsewhere , by other processes or by the application embedding the renderer
+	// para 'shared' : the elements , they have to outlive the buffer
+	// para 'count'  : the number of elements
+	void	Adopt( const T* shared , size_t count )
+	{
+		clear();
+		m_data = const_cast<T*>( shared );
+		m_size = m_capacity = count;
+		m_shared = true;
+	}
+
+	// whether the elements are owned elsewhere
+	bool	IsShared() const { return m_shared; }
+
+	// the private memory taken by the elements
+	size_t	GetMemoryUsage() const { return m_shared ? 0 : sizeof( T ) * m_size; }
+
+// private field
+private:
+	T*		m_data = nullptr;
+	size_t	m_size = 0;
+	size_t	m_capacity = 0;
+	// whether the elements are a shared copy , it is never freed by the buffer
+	bool	m_shared = false;
+
+	// move the elements into a private allocation
+	// para 'capacity' : the number of elements the allocation holds , the elements after it are dropped
+	void	_realloc( size_t capacity )
+	{
+		if( capacity == 0 )
+		{
+			clear();
+			return;
+		}
+		T* data = (T*)HugePages::Alloc( sizeof( T ) * capacity , alignof( T ) > 64 ? alignof( T ) : 64 );
+		if( data == nullptr )
+			throw std::bad_alloc();
+		if( m_size > capacity )
+			m_size = capacity;
+		if( m_size )
+			memcpy( (void*)data , m_data , sizeof( T ) * m_size );
+		_free();
+		m_data = data;
+		m_capacity = capacity;
+		m_shared = false;
+	}
+
+	// copy elements into an empty buffer
+	void	_assign( const T* data , size_t count )
+	{
+		if( count == 0 )
+			return;
+		_realloc( count );
+		memcpy( (void*)m_data , data , sizeof( T ) * count );
+		m_size = count;
+	}
+
+	// free the private allocation
+	void	_free()
+	{
+		if( !m_shared )
+			HugePages::Free( m_data );
+	}
+};
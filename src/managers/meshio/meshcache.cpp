@@ -0,0 +1,248 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header
+#include "meshcache.h"
+#include "managers/meshmanager.h"
+#include "managers/matmanager.h"
+#include "accel/accelcache.h"
+#include "utility/mappedfile.h"
+#include "log/log.h"
+#include <fstream>
+#include <sys/stat.h>
+#include <stddef.h>
+
+// version of the cache file layout , caches of other versions are ignored
+static const unsigned MESH_CACHE_VERSION = 1;
+static const char MESH_CACHE_MAGIC[4] = { 'S' , 'M' , 'S' , 'H' };
+
+// the buffers are stored as blobs aligned to cache lines in the file
+static const size_t MESH_CACHE_ALIGNMENT = 64;
+
+// header of the cache file , the payload follows it at an aligned offset
+struct MeshCacheHeader
+{
+	char				magic[4];
+	unsigned			version;
+	unsigned			elementSize[4];		// size of point , vector , float and vertex index , the layout of the blobs depends on them
+	long long			sourceTime;			// modification time of the model file
+	unsigned long long	sourceSize;			// size of the model file
+	float				transform[32];		// the matrix and the inverse matrix applied to the mesh
+	unsigned long long	size;				// size of the payload in bytes
+	unsigned long long	checksum;			// hash of the payload , truncated or corrupted files are detected with it
+};
+
+static const size_t MESH_CACHE_PAYLOAD = ( sizeof( MeshCacheHeader ) + MESH_CACHE_ALIGNMENT - 1 ) & ~( MESH_CACHE_ALIGNMENT - 1 );
+
+// fill the part of the header describing the model file and the layout
+static bool _fillHeader( MeshCacheHeader& header , const string& source , const Transform& transform )
+{
+	struct stat st;
+	if( stat( source.c_str() , &st ) != 0 )
+		return false;
+
+	memset( &header , 0 , sizeof( header ) );
+	memcpy( header.magic , MESH_CACHE_MAGIC , sizeof( MESH_CACHE_MAGIC ) );
+	header.version = MESH_CACHE_VERSION;
+	header.elementSize[0] = sizeof( Point );
+	header.elementSize[1] = sizeof( Vector );
+	header.elementSize[2] = sizeof( float );
+	header.elementSize[3] = sizeof( VertexIndex );
+	header.sourceTime = (long long)st.st_mtime;
+	header.sourceSize = (unsigned long long)st.st_size;
+	memcpy( header.transform , transform.matrix.m , sizeof( float ) * 16 );
+	memcpy( header.transform + 16 , transform.invMatrix.m , sizeof( float ) * 16 );
+	return true;
+}
+
+// pad the payload so that the next blob is aligned
+static void _align( AccelWriter& writer )
+{
+	static const char zeros[MESH_CACHE_ALIGNMENT] = { 0 };
+	const size_t offset = MESH_CACHE_PAYLOAD + writer.GetData().size();
+	writer.Write( zeros , ( MESH_CACHE_ALIGNMENT - offset % MESH_CACHE_ALIGNMENT ) % MESH_CACHE_ALIGNMENT );
+}
+
+// skip the padding before an aligned blob
+static bool _align( AccelReader& reader , size_t& offset )
+{
+	char zeros[MESH_CACHE_ALIGNMENT];
+	const size_t padding = ( MESH_CACHE_ALIGNMENT - ( MESH_CACHE_PAYLOAD + offset ) % MESH_CACHE_ALIGNMENT ) % MESH_CACHE_ALIGNMENT;
+	offset += padding;
+	return reader.Read( zeros , padding );
+}
+
+// write a string
+static void _writeString( AccelWriter& writer , const string& str )
+{
+	writer.Write( (unsigned)str.size() );
+	writer.Write( str.c_str() , str.size() );
+}
+
+// read a string
+static bool _readString( AccelReader& reader , size_t& offset , size_t limit , string& str )
+{
+	unsigned len = 0;
+	if( !reader.Read( len ) || len > limit - offset )
+		return false;
+	str.resize( len );
+	offset += sizeof( unsigned ) + len;
+	return len == 0 || reader.Read( &str[0] , len );
+}
+
+// write an aligned blob of a buffer
+template< class T >
+static void _writeBlob( AccelWriter& writer , const MeshBuffer<T>& buffer )
+{
+	writer.Write( (unsigned long long)buffer.size() );
+	_align( writer );
+	writer.Write( buffer.data() , buffer.size() );
+}
+
+// read an aligned blob into a buffer
+template< class T >
+static bool _readBlob( AccelReader& reader , size_t& offset , size_t limit , MeshBuffer<T>& buffer )
+{
+	unsigned long long count = 0;
+	if( !reader.Read( count ) )
+		return false;
+	offset += sizeof( count );
+	if( !_align( reader , offset ) || count > ( limit - offset ) / sizeof( T ) )
+		return false;
+	buffer.resize( (size_t)count );
+	offset += sizeof( T ) * (size_t)count;
+	return reader.Read( buffer.data() , (size_t)count );
+}
+
+// load the buffers of a mesh from a cache file
+bool MeshCache::Load( const string& filename , const string& source , const Transform& transform , std::shared_ptr<BufferMemory>& mem )
+{
+	MeshCacheHeader expected;
+	if( !_fillHeader( expected , source , transform ) )
+		return false;
+
+	// map the whole file into memory
+	MappedFile file;
+	if( !file.Open( filename ) || file.GetSize() < MESH_CACHE_PAYLOAD )
+		return false;
+
+	MeshCacheHeader header;
+	memcpy( &header , file.GetData() , sizeof( header ) );
+	const char* payload = file.GetData() + MESH_CACHE_PAYLOAD;
+	const size_t size = file.GetSize() - MESH_CACHE_PAYLOAD;
+	if( memcmp( &header , &expected , offsetof( MeshCacheHeader , size ) ) != 0 ){
+		slog( DEBUG , GENERAL , stringFormat( "Mesh cache %s is ignored, it is outdated or not a cache of the current version." , filename.c_str() ) );
+		return false;
+	}
+	if( header.size != size || header.checksum != AccelCache::Hash( payload , size ) ){
+		slog( WARNING , GENERAL , stringFormat( "Mesh cache %s is corrupted." , filename.c_str() ) );
+		return false;
+	}
+
+	// the material libraries referred by the model are parsed again
+	AccelReader reader( payload , size );
+	size_t offset = 0;
+	unsigned count = 0;
+	bool valid = reader.Read( count );
+	offset += sizeof( count );
+	for( unsigned i = 0 ; valid && i < count ; ++i ){
+		string name;
+		valid = _readString( reader , offset , size , name );
+		if( valid ){
+			MatManager::GetSingleton().ParseMatFile( name );
+			mem->m_MatLibs.push_back( name );
+		}
+	}
+
+	valid = valid && _readBlob( reader , offset , size , mem->m_PositionBuffer ) && _readBlob( reader , offset , size , mem->m_NormalBuffer ) &&
+			_readBlob( reader , offset , size , mem->m_TangentBuffer ) && _readBlob( reader , offset , size , mem->m_TexCoordBuffer ) &&
+			reader.Read( count );
+	offset += sizeof( count );
+	for( unsigned i = 0 ; valid && i < count ; ++i ){
+		string name , mat_name;
+		valid = _readString( reader , offset , size , name ) && _readString( reader , offset , size , mat_name );
+		if( !valid )
+			break;
+		auto trunk = std::make_shared<Trunk>( name );
+		valid = _readBlob( reader , offset , size , trunk->m_IndexBuffer );
+		trunk->m_matName = mat_name;
+		mem->m_TrunkBuffer.push_back( trunk );
+	}
+
+	// the vertex indices are trusted during rendering , they are checked once here
+	const long long pos_count = (long long)mem->m_PositionBuffer.size();
+	const long long nor_count = (long long)mem->m_NormalBuffer.size();
+	const long long tex_count = (long long)mem->m_TexCoordBuffer.size() / 2;
+	valid = valid && reader.IsComplete() && ( mem->m_TangentBuffer.empty() || mem->m_TangentBuffer.size() == mem->m_NormalBuffer.size() );
+	for( unsigned i = 0 ; valid && i < mem->m_TrunkBuffer.size() ; ++i ){
+		for( const auto& index : mem->m_TrunkBuffer[i]->m_IndexBuffer ){
+			if( index.posIndex < 0 || index.posIndex >= pos_count || index.norIndex >= nor_count || index.texIndex >= tex_count ){
+				valid = false;
+				break;
+			}
+		}
+	}
+	if( !valid ){
+		slog( WARNING , GENERAL , stringFormat( "Failed to load mesh cache %s." , filename.c_str() ) );
+		return false;
+	}
+
+	mem->m_filename = source;
+	slog( INFO , GENERAL , stringFormat( "Mesh %s is loaded from cache %s." , source.c_str() , filename.c_str() ) );
+	return true;
+}
+
+// store the buffers of a mesh in a cache file
+bool MeshCache::Save( const string& filename , const string& source , const Transform& transform , const BufferMemory& mem )
+{
+	MeshCacheHeader header;
+	if( !_fillHeader( header , source , transform ) )
+		return false;
+
+	AccelWriter writer;
+	writer.Write( (unsigned)mem.m_MatLibs.size() );
+	for( const auto& name : mem.m_MatLibs )
+		_writeString( writer , name );
+	_writeBlob( writer , mem.m_PositionBuffer );
+	_writeBlob( writer , mem.m_NormalBuffer );
+	_writeBlob( writer , mem.m_TangentBuffer );
+	_writeBlob( writer , mem.m_TexCoordBuffer );
+	writer.Write( (unsigned)mem.m_TrunkBuffer.size() );
+	for( const auto& trunk : mem.m_TrunkBuffer ){
+		_writeString( writer , trunk->name );
+		_writeString( writer , trunk->m_matName );
+		_writeBlob( writer , trunk->m_IndexBuffer );
+	}
+	const std::vector<char>& payload = writer.GetData();
+	header.size = payload.size();
+	header.checksum = AccelCache::Hash( payload.data() , payload.size() );
+
+	std::ofstream file( filename.c_str() , std::ios::binary | std::ios::trunc );
+	if( file.is_open() ){
+		char padded[MESH_CACHE_PAYLOAD] = { 0 };
+		memcpy( padded , &header , sizeof( header ) );
+		file.write( padded , MESH_CACHE_PAYLOAD );
+		file.write( payload.data() , payload.size() );
+	}
+	if( !file.is_open() || !file ){
+		slog( WARNING , GENERAL , stringFormat( "Failed to write mesh cache %s." , filename.c_str() ) );
+		return false;
+	}
+
+	slog( INFO , GENERAL , stringFormat( "Mesh %s is stored in cache %s." , source.c_str() , filename.c_str() ) );
+	return true;
+}
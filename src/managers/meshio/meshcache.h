@@ -0,0 +1,55 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+// include the header
+#include "sort.h"
+#include "math/transform.h"
+#include <memory>
+
+// pre-decleration class
+class	BufferMemory;
+
+///////////////////////////////////////////////////////////////////////
+//	definition of mesh cache
+//	desc :	Parsing a large model and generating its normals and tangents
+//			takes most of the scene loading time. The buffers of a loaded
+//			mesh are stored in a versioned binary file next to the model,
+//			the file is mapped back on the next run instead of parsing the
+//			model again. A cache is only used if the model file and the
+//			transformation of the mesh are unchanged since it was written.
+class	MeshCache
+{
+// public method
+public:
+	// load the buffers of a mesh from a cache file
+	// para 'filename'  : name of the cache file
+	// para 'source'    : name of the model file
+	// para 'transform' : the transformation applied to the mesh
+	// para 'mem'       : the memory to store , it is left partially filled if loading fails
+	// result           : true if the buffers are loaded from the cache
+	static bool Load( const string& filename , const string& source , const Transform& transform , std::shared_ptr<BufferMemory>& mem );
+
+	// store the buffers of a mesh in a cache file
+	// para 'filename'  : name of the cache file
+	// para 'source'    : name of the model file
+	// para 'transform' : the transformation applied to the mesh
+	// para 'mem'       : the loaded buffers , normals and texture coordinates are generated already
+	// result           : true if the cache file is written
+	static bool Save( const string& filename , const string& source , const Transform& transform , const BufferMemory& mem );
+};
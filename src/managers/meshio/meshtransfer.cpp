@@ -0,0 +1,159 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header
+#include "meshtransfer.h"
+#include "managers/smmanager.h"
+#include "utility/memoryfile.h"
+#include "utility/strhelper.h"
+#include "log/log.h"
+#include <string.h>
+
+static const char MESH_TRANSFER_MAGIC[4] = { 'S' , 'X' , 'F' , 'R' };
+static const unsigned MESH_TRANSFER_VERSION = 1;
+
+// the prefix of the names of the meshes in the region
+static const char* MESH_TRANSFER_PREFIX = "mem:transfer/";
+
+// header of the region
+struct MeshTransferHeader
+{
+	char				magic[4];
+	unsigned			version;
+	unsigned			meshCnt;
+	unsigned			reserved;
+	unsigned long long	size;		// size of the region in bytes
+};
+
+// a mesh in the region
+struct MeshTransferMesh
+{
+	unsigned long long	name;
+	unsigned long long	positions;
+	unsigned long long	normals;
+	unsigned long long	texcoords;
+	unsigned long long	indices;
+	unsigned long long	trunks;
+	unsigned			vertexCnt;
+	unsigned			triangleCnt;
+	unsigned			trunkCnt;
+	unsigned			reserved;
+};
+
+// the triangles of a material in the region
+struct MeshTransferTrunk
+{
+	unsigned long long	material;
+	unsigned			triangleCnt;
+	unsigned			reserved;
+};
+
+static_assert( sizeof( MeshTransferHeader ) == 24 && sizeof( MeshTransferMesh ) == 64 && sizeof( MeshTransferTrunk ) == 16 , "the layout is shared with the blender add-on" );
+
+// the region mapped last time
+static string g_transferName;
+
+// whether an array lies in the region , missing arrays are fine
+// para 'offset' : the offset of the array
+// para 'bytes'  : the size of the array
+// para 'size'   : the size of the region
+static bool _inRegion( unsigned long long offset , unsigned long long bytes , unsigned long long size )
+{
+	return offset == 0 || ( offset % 4 == 0 && offset <= size && bytes <= size - offset );
+}
+
+// get a name in the region
+// para 'data'   : the region
+// para 'offset' : the offset of the name
+// para 'size'   : the size of the region
+// para 'name'   : the name
+static bool _readName( const char* data , unsigned long long offset , unsigned long long size , string& name )
+{
+	if( offset == 0 ){
+		name.clear();
+		return true;
+	}
+	if( offset >= size )
+		return false;
+	const char* end = (const char*)memchr( data + offset , 0 , (size_t)( size - offset ) );
+	if( end == nullptr )
+		return false;
+	name.assign( data + offset , end );
+	return true;
+}
+
+// map the region and register its meshes
+bool MeshTransfer::Map( const string& name )
+{
+	// the meshes of the last region are dropped along with the scene using them
+	MemoryFiles::Remove( MESH_TRANSFER_PREFIX );
+	if( !g_transferName.empty() )
+		SMManager::GetSingleton().ReleaseSharedMemory( g_transferName );
+	g_transferName = name;
+
+	const SharedMemory sm = SMManager::GetSingleton().OpenReadOnlySharedMemory( name );
+	const MeshTransferHeader* header = (const MeshTransferHeader*)sm.bytes;
+	if( header == nullptr || sm.size < sizeof( MeshTransferHeader ) || memcmp( header->magic , MESH_TRANSFER_MAGIC , sizeof( MESH_TRANSFER_MAGIC ) ) != 0 ||
+		header->version != MESH_TRANSFER_VERSION || header->size > sm.size ||
+		!_inRegion( sizeof( MeshTransferHeader ) , (unsigned long long)header->meshCnt * sizeof( MeshTransferMesh ) , header->size ) )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Mesh transfer %s can't be mapped or it is not of the current version." , name.c_str() ) );
+		return false;
+	}
+
+	const char* data = sm.bytes;
+	const unsigned long long size = header->size;
+	const MeshTransferMesh* meshes = (const MeshTransferMesh*)( data + sizeof( MeshTransferHeader ) );
+	unsigned registered = 0;
+	for( unsigned i = 0 ; i < header->meshCnt ; ++i )
+	{
+		const MeshTransferMesh& src = meshes[i];
+		const unsigned long long vertex_cnt = src.vertexCnt , triangle_cnt = src.triangleCnt;
+		string mesh_name;
+		bool valid = _readName( data , src.name , size , mesh_name ) && !mesh_name.empty() && src.positions != 0 && src.indices != 0 &&
+					 _inRegion( src.positions , 12 * vertex_cnt , size ) && _inRegion( src.normals , 12 * vertex_cnt , size ) &&
+					 _inRegion( src.texcoords , 8 * vertex_cnt , size ) && _inRegion( src.indices , 12 * triangle_cnt , size ) &&
+					 _inRegion( src.trunks , (unsigned long long)src.trunkCnt * sizeof( MeshTransferTrunk ) , size );
+
+		MemoryMesh mesh;
+		const MeshTransferTrunk* trunks = (const MeshTransferTrunk*)( data + src.trunks );
+		for( unsigned k = 0 ; valid && src.trunks && k < src.trunkCnt ; ++k )
+		{
+			MemoryTrunk trunk;
+			trunk.triangleCnt = trunks[k].triangleCnt;
+			valid = _readName( data , trunks[k].material , size , trunk.material );
+			mesh.trunks.push_back( trunk );
+		}
+		if( !valid )
+		{
+			slog( WARNING , GENERAL , stringFormat( "Mesh %d of transfer %s is broken, it is skipped." , (int)i , name.c_str() ) );
+			continue;
+		}
+
+		mesh.positions = (const float*)( data + src.positions );
+		mesh.normals = src.normals ? (const float*)( data + src.normals ) : nullptr;
+		mesh.texcoords = src.texcoords ? (const float*)( data + src.texcoords ) : nullptr;
+		mesh.indices = (const unsigned*)( data + src.indices );
+		mesh.vertexCnt = src.vertexCnt;
+		mesh.triangleCnt = src.triangleCnt;
+		MemoryFiles::SetMesh( MESH_TRANSFER_PREFIX + mesh_name , mesh );
+		++registered;
+	}
+
+	slog( INFO , GENERAL , stringFormat( "%d meshes are mapped from transfer %s , %.2f MB." , (int)registered , name.c_str() , size / 1048576.0f ) );
+	return true;
+}
@@ -0,0 +1,52 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+// include the header
+#include "sort.h"
+
+///////////////////////////////////////////////////////////////////////
+//	definition of mesh transfer
+//	desc :	Blender writes the vertex and index arrays of all meshes of a
+//			scene into one binary region of shared memory instead of OBJ
+//			files. The region is mapped read-only and every mesh in it is
+//			registered as a mesh in memory named 'mem:transfer/<name>',
+//			the models of the scene refer to them by these names. The
+//			arrays are read in place , nothing is parsed.
+//
+//			All numbers are little endian , offsets are in bytes from the
+//			start of the region and arrays are aligned to 16 bytes.
+//			header   : 'SXFR' , version , mesh count , zero , region size
+//			mesh     : offsets of the name , positions , normals , texture
+//					   coordinates , indexes and trunks as 64 bits , zero
+//					   for missing ones , then the number of vertexes ,
+//					   triangles and trunks and a zero as 32 bits
+//			trunk    : offset of the material name as 64 bits , then the
+//					   number of triangles and a zero as 32 bits
+//			names are zero terminated , positions and normals are three
+//			floats , texture coordinates two floats and indexes three
+//			unsigned 32 bits integers for each triangle.
+class	MeshTransfer
+{
+// public method
+public:
+	// map the region and register its meshes , the meshes of the region mapped before are dropped
+	// para 'name' : the name of the mapping on Windows , the file backing it on the other platforms
+	// result      : false if the region can't be mapped or it is broken
+	static bool Map( const string& name );
+};
@@ -17,16 +17,15 @@
 
 // include the header
 #include "objloader.h"
-#include <fstream>
 #include "math/point.h"
 #include "math/vector3.h"
 #include "managers/meshmanager.h"
 #include "utility/strhelper.h"
 #include "managers/matmanager.h"
 #include "log/log.h"
-
-// the maxmium length of a single line
-static const unsigned LINE_MAXLENGTH = 4096;
+#include "utility/mappedfile.h"
+#include "utility/multithread/threadpool.h"
+#include <stdlib.h>
 
 #define CHECK_INDEX(index) {\
 	if( index.posIndex < 0 )\
@@ -45,111 +44,300 @@ static const unsigned LINE_MAXLENGTH = 4096;
 		index.texIndex = 0;\
 	}\
 }
-	
-// load obj from file
-bool ObjLoader::LoadMesh( const string& str , std::shared_ptr<BufferMemory>& mem )
+
+// the size of the text parsed by one task , smaller files are parsed in one go
+static const size_t OBJ_PIECE_SIZE = 1024 * 1024;
+
+// a statement of the file that has to be replayed in order after parsing
+struct ObjEvent
 {
-	ifstream file( str.c_str() );
+	enum Type { GROUP , MTLLIB , USEMTL , FACES };
+	Type	type;
+	string	name;			// the name of the group , material library or material
+	size_t	_start = 0;		// the range of the indices of consecutive faces in the piece
+	size_t	_end = 0;
+};
 
-	// if the specific file is not loaded return false
-	if( false == file.is_open() )
-		return false;
+// the elements parsed from a piece of the file
+struct ObjPiece
+{
+	const char*			_start;
+	const char*			_end;
+	vector<Point>		positions;
+	vector<Vector>		normals;
+	vector<float>		texcoords;
+	vector<VertexIndex>	indices;
+	vector<ObjEvent>	events;
+};
 
-	mem->m_filename = str;
+static inline bool _isBlank( char c ) { return c == ' ' || c == '\t'; }
+static inline bool _isDigit( char c ) { return c >= '0' && c <= '9'; }
+static inline bool _isSpace( char c ) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
 
-	// current trunk
-    std::shared_ptr<Trunk>	trunk = nullptr;
+// skip the blanks and the line breaks before the next token , tokens never cross the end of the piece
+static inline void _skipSpace( const char*& s , const char* e )
+{
+	while( s < e && _isSpace( *s ) )
+		++s;
+}
+
+// get the next token
+static inline void _nextToken( const char*& s , const char* e , const char*& token , size_t& len )
+{
+	_skipSpace( s , e );
+	token = s;
+	while( s < e && !_isSpace( *s ) )
+		++s;
+	len = s - token;
+}
+
+// whether the token equals a string
+static inline bool _tokenIs( const char* token , size_t len , const char* str )
+{
+	return strlen( str ) == len && memcmp( token , str , len ) == 0;
+}
+
+// parse a float , plain decimals are converted exactly with a single rounded division , others fall back to strtof
+static float _parseFloat( const char*& s , const char* e )
+{
+	const char* token;
+	size_t len;
+	_nextToken( s , e , token , len );
 
-	while( true )
+	static const float pow10[] = { 1e0f , 1e1f , 1e2f , 1e3f , 1e4f , 1e5f , 1e6f , 1e7f , 1e8f , 1e9f };
+	const char* c = token;
+	const char* end = token + len;
+	const bool negative = ( c < end && *c == '-' );
+	if( c < end && ( *c == '-' || *c == '+' ) )
+		++c;
+	unsigned mantissa = 0;
+	unsigned digits = 0 , fraction = 0;
+	for( ; c < end && _isDigit( *c ) && digits < 9 ; ++c , ++digits )
+		mantissa = mantissa * 10 + ( *c - '0' );
+	if( c < end && *c == '.' ){
+		for( ++c ; c < end && _isDigit( *c ) && digits < 9 ; ++c , ++digits , ++fraction )
+			mantissa = mantissa * 10 + ( *c - '0' );
+	}
+	// both the mantissa and the power of ten are exact floats , so the quotient is rounded once like strtof does
+	if( c == end && digits > 0 && mantissa < ( 1u << 24 ) ){
+		const float f = (float)mantissa / pow10[fraction];
+		return negative ? -f : f;
+	}
+
+	char buf[64];
+	len = min( len , sizeof( buf ) - 1 );
+	memcpy( buf , token , len );
+	buf[len] = 0;
+	return strtof( buf , 0 );
+}
+
+// parse an integer like atoi does , it stops at the first character that is not a digit
+static inline int _parseInt( const char*& s , const char* e )
+{
+	bool negative = false;
+	if( s < e && ( *s == '-' || *s == '+' ) )
+		negative = ( *s++ == '-' );
+	int value = 0;
+	while( s < e && _isDigit( *s ) )
+		value = value * 10 + ( *s++ - '0' );
+	return negative ? -value : value;
+}
+
+// parse a vertex index in the form of 'p' , 'p/t' , 'p//n' or 'p/t/n' , it matches VertexIndexFromStr
+static VertexIndex _parseVertexIndex( const char*& s , const char* e )
+{
+	const char* token;
+	size_t len;
+	_nextToken( s , e , token , len );
+	const char* end = token + len;
+
+	VertexIndex vi;
+	const char* c = token;
+	vi.posIndex = _parseInt( c , end ) - 1;
+	while( c < end && *c != '/' )
+		++c;
+	if( c == end )
+		return vi;
+
+	// the texture coordinate index
+	++c;
+	vi.texIndex = ( c < end && *c != '/' ) ? ( _parseInt( c , end ) - 1 ) : -1;
+	while( c < end && *c != '/' )
+		++c;
+	if( c == end )
+		return vi;
+
+	// the normal index
+	++c;
+	vi.norIndex = ( c < end ) ? ( _parseInt( c , end ) - 1 ) : -1;
+	return vi;
+}
+
+// parse a piece of the file , the piece starts at the beginning of a line and ends after a line break
+static void _parsePiece( ObjPiece& piece )
+{
+	const char* s = piece._start;
+	const char* e = piece._end;
+	while( s < e )
 	{
-		string prefix;
-		file>>prefix;
+		// the end of the current line
+		const char* line_end = (const char*)memchr( s , '\n' , e - s );
+		line_end = line_end ? line_end : e;
 
-		if( strcmp( prefix.c_str() , "g" ) == 0 )
-		{
-			// create a new trunk
-			string trunkname;
-			file>>trunkname;
-            trunk = std::make_shared<Trunk>( trunkname );
-			mem->m_TrunkBuffer.push_back( trunk );
-		}else if( strcmp( prefix.c_str() , "mtllib" ) == 0 )
+		while( s < line_end && _isBlank( *s ) )
+			++s;
+		const char* prefix;
+		size_t len;
+		_nextToken( s , line_end , prefix , len );
+
+		if( _tokenIs( prefix , len , "v" ) )
 		{
-			string name;
-			file>>name;
-			MatManager::GetSingleton().ParseMatFile( name );
-		}else if( strcmp( prefix.c_str() , "usemtl" ) == 0 )
+			Point p;
+			p.x = _parseFloat( s , line_end );
+			p.y = _parseFloat( s , line_end );
+			p.z = _parseFloat( s , line_end );
+			piece.positions.push_back( p );
+		}else if( _tokenIs( prefix , len , "f" ) )
 		{
-			string name;
-			file>>name;
-			if( trunk )
+			// consecutive faces are merged into one event
+			if( piece.events.empty() || piece.events.back().type != ObjEvent::FACES ){
+				ObjEvent ev;
+				ev.type = ObjEvent::FACES;
+				ev._start = ev._end = piece.indices.size();
+				piece.events.push_back( ev );
+			}
+
+			VertexIndex vi0 = _parseVertexIndex( s , line_end );
+			VertexIndex vi1 = _parseVertexIndex( s , line_end );
+			VertexIndex vi2 = _parseVertexIndex( s , line_end );
+			piece.indices.push_back( vi0 );
+			piece.indices.push_back( vi1 );
+			piece.indices.push_back( vi2 );
+
+			// check if there is another index
+			while( s < line_end && _isBlank( *s ) )
+				++s;
+			if( s < line_end && _isDigit( *s ) )
 			{
-				trunk->m_mat = MatManager::GetSingleton().FindMaterial( name );
-				if( 0 == trunk->m_mat )
-                    slog( WARNING , MATERIAL , stringFormat("Material named %s not found, use default material in subset \"%s\"." , name.c_str() , str.c_str() ) );
+				VertexIndex vi3 = _parseVertexIndex( s , line_end );
+				piece.indices.push_back( vi0 );
+				piece.indices.push_back( vi2 );
+				piece.indices.push_back( vi3 );
 			}
-		}else if( strcmp( prefix.c_str() , "v" ) == 0 )
-		{
-			Point p;
-			file>>p.x;
-			file>>p.y;
-			file>>p.z;
-			mem->m_PositionBuffer.push_back( p );	
-		}else if( strcmp( prefix.c_str() , "vn" ) == 0 )
+			piece.events.back()._end = piece.indices.size();
+		}else if( _tokenIs( prefix , len , "vn" ) )
 		{
 			Vector v;
-			file>>v.x;
-			file>>v.y;
-			file>>v.z;
-			mem->m_NormalBuffer.push_back( v );
-		}else if( strcmp( prefix.c_str() , "vt" ) == 0 )
+			v.x = _parseFloat( s , line_end );
+			v.y = _parseFloat( s , line_end );
+			v.z = _parseFloat( s , line_end );
+			piece.normals.push_back( v );
+		}else if( _tokenIs( prefix , len , "vt" ) )
 		{
-			float u , v;
-			file>>u;
-			file>>v;
-			mem->m_TexCoordBuffer.push_back( u );
-			mem->m_TexCoordBuffer.push_back( v );
-		}else if( strcmp( prefix.c_str() , "f" ) == 0 && trunk != 0 )
+			piece.texcoords.push_back( _parseFloat( s , line_end ) );
+			piece.texcoords.push_back( _parseFloat( s , line_end ) );
+		}else if( _tokenIs( prefix , len , "g" ) || _tokenIs( prefix , len , "mtllib" ) || _tokenIs( prefix , len , "usemtl" ) )
 		{
-			string strIndex;
-			file>>strIndex;
-			VertexIndex vi0 = VertexIndexFromStr( strIndex );
-			//CHECK_INDEX(vi0);
-			trunk->m_IndexBuffer.push_back( vi0 );
-			file>>strIndex;
-			VertexIndex vi1 = VertexIndexFromStr( strIndex );
-			//CHECK_INDEX(vi1);
-			trunk->m_IndexBuffer.push_back( vi1 );
-			file>>strIndex;
-			VertexIndex vi2 = VertexIndexFromStr( strIndex );
-			//CHECK_INDEX(vi2);
-			trunk->m_IndexBuffer.push_back( vi2 );
-
-			// check if there is another index
-			char t = file.peek();
-			while( t == ' ' || t == '\t' )
-			{
-				file.get();
-				t = file.peek();
-			}
-			if( t >= '0' && t <= '9' )
-			{
-				file>>strIndex;
-				VertexIndex vi3 = VertexIndexFromStr( strIndex );
-				//CHECK_INDEX(vi3);
-				trunk->m_IndexBuffer.push_back( vi0 );
-				trunk->m_IndexBuffer.push_back( vi2 );
-				trunk->m_IndexBuffer.push_back( vi3 );
-			}
+			ObjEvent ev;
+			ev.type = ( prefix[0] == 'g' ) ? ObjEvent::GROUP : ( prefix[0] == 'm' ) ? ObjEvent::MTLLIB : ObjEvent::USEMTL;
+			const char* name;
+			_nextToken( s , line_end , name , len );
+			ev.name.assign( name , len );
+			piece.events.push_back( ev );
 		}
 
 		// skip the rest of the line
-		file.ignore( LINE_MAXLENGTH , '\n' );
+		s = line_end + 1;
+	}
+}
+
+// load obj from file
+bool ObjLoader::LoadMesh( const string& str , std::shared_ptr<BufferMemory>& mem )
+{
+	// the file is mapped instead of being read through a stream
+	MappedFile file;
+	if( false == file.Open( str ) )
+		return false;
+
+	mem->m_filename = str;
 
-		if( file.eof() )
-			break;
+	// split the file into pieces at line breaks
+	const char* data = file.GetData();
+	const char* data_end = data + file.GetSize();
+	const unsigned piece_cnt = ParallelChunkCount( (unsigned)( file.GetSize() / OBJ_PIECE_SIZE ) + 1 , 1 );
+	vector<ObjPiece> pieces( piece_cnt );
+	const char* cur = data;
+	for( unsigned i = 0 ; i < piece_cnt ; ++i )
+	{
+		const char* target = ( i == piece_cnt - 1 ) ? data_end : max( cur , data + file.GetSize() / piece_cnt * ( i + 1 ) );
+		const char* line_break = ( target < data_end ) ? (const char*)memchr( target , '\n' , data_end - target ) : 0;
+		pieces[i]._start = cur;
+		pieces[i]._end = line_break ? line_break + 1 : data_end;
+		cur = pieces[i]._end;
+	}
+
+	// parse the pieces in parallel
+	ParallelFor( 0 , piece_cnt , 1 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; ++i )
+			_parsePiece( pieces[i] );
+	});
+
+	// merge the pieces in order
+	size_t positions = 0 , normals = 0 , texcoords = 0;
+	vector<size_t> group_indices;
+	for( const auto& piece : pieces )
+	{
+		positions += piece.positions.size();
+		normals += piece.normals.size();
+		texcoords += piece.texcoords.size();
+		for( const auto& ev : piece.events )
+		{
+			if( ev.type == ObjEvent::GROUP )
+				group_indices.push_back( 0 );
+			else if( ev.type == ObjEvent::FACES && !group_indices.empty() )
+				group_indices.back() += ev._end - ev._start;
+		}
 	}
+	mem->m_PositionBuffer.reserve( positions );
+	mem->m_NormalBuffer.reserve( normals );
+	mem->m_TexCoordBuffer.reserve( texcoords );
+	mem->m_TrunkBuffer.reserve( group_indices.size() );
 
-	file.close();
+	// current trunk
+    std::shared_ptr<Trunk>	trunk = nullptr;
+	for( auto& piece : pieces )
+	{
+		mem->m_PositionBuffer.insert( mem->m_PositionBuffer.end() , piece.positions.begin() , piece.positions.end() );
+		mem->m_NormalBuffer.insert( mem->m_NormalBuffer.end() , piece.normals.begin() , piece.normals.end() );
+		mem->m_TexCoordBuffer.insert( mem->m_TexCoordBuffer.end() , piece.texcoords.begin() , piece.texcoords.end() );
+		vector<Point>().swap( piece.positions );
+		vector<Vector>().swap( piece.normals );
+		vector<float>().swap( piece.texcoords );
+
+		for( const auto& ev : piece.events )
+		{
+			if( ev.type == ObjEvent::GROUP )
+			{
+				// create a new trunk
+				trunk = std::make_shared<Trunk>( ev.name );
+				trunk->m_IndexBuffer.reserve( group_indices[mem->m_TrunkBuffer.size()] );
+				mem->m_TrunkBuffer.push_back( trunk );
+			}else if( ev.type == ObjEvent::MTLLIB )
+			{
+				MatManager::GetSingleton().ParseMatFile( ev.name );
+				mem->m_MatLibs.push_back( ev.name );
+			}else if( ev.type == ObjEvent::USEMTL )
+			{
+				if( trunk )
+					trunk->m_matName = ev.name;
+			}else if( trunk )
+			{
+				// faces before the first group are dropped
+				trunk->m_IndexBuffer.insert( trunk->m_IndexBuffer.end() , piece.indices.begin() + ev._start , piece.indices.begin() + ev._end );
+			}
+		}
+		vector<VertexIndex>().swap( piece.indices );
+	}
 
 	return true;
 }
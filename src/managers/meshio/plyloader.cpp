@@ -19,25 +19,291 @@
 #include "plyloader.h"
 #include "managers/meshmanager.h"
 #include "thirdparty/ply/ply.h"
+#include "utility/mappedfile.h"
+#include "log/log.h"
+#include <stddef.h>
+#include <algorithm>
 
-static char x_prop[] = "x";
-static char y_prop[] = "y";
-static char z_prop[] = "z";
-static char vertex_index_prop[] = "vertex_indices";
-
-static PlyProperty vert_props[] = 
+// the attributes of a vertex , properties missing in the file are left untouched
+struct PlyVertex
 {
-  {x_prop, PLY_FLOAT, PLY_FLOAT, 0, 0, 0, 0, 0},
-  {y_prop, PLY_FLOAT, PLY_FLOAT, 4, 0, 0, 0, 0},
-  {z_prop, PLY_FLOAT, PLY_FLOAT, 8, 0, 0, 0, 0},
+	float	pos[3];
+	float	nor[3];
+	float	uv[2];
 };
 
-static PlyProperty face_props[] = 
+// the attribute a vertex property is read into
+enum PLY_VERTEX_ATTR
 {
-  {vertex_index_prop, PLY_UINT, PLY_UINT, 4 , 1, 4, PLY_UINT, 0},
+	PVA_NONE = -1 ,
+	PVA_X , PVA_Y , PVA_Z ,
+	PVA_NX , PVA_NY , PVA_NZ ,
+	PVA_U , PVA_V ,
+	PVA_NUM
 };
 
-// load obj from file
+// get the attribute of a vertex property
+static int _vertexAttr( const char* name )
+{
+	static const char* names[][3] = {
+		{ "x" , 0 , 0 } , { "y" , 0 , 0 } , { "z" , 0 , 0 } ,
+		{ "nx" , 0 , 0 } , { "ny" , 0 , 0 } , { "nz" , 0 , 0 } ,
+		{ "u" , "s" , "texture_u" } , { "v" , "t" , "texture_v" } ,
+	};
+	for( int attr = 0 ; attr < PVA_NUM ; ++attr )
+		for( int k = 0 ; k < 3 && names[attr][k] ; ++k )
+			if( equal_strings( name , names[attr][k] ) )
+				return attr;
+	return PVA_NONE;
+}
+
+// the offset of an attribute in the vertex
+static int _vertexAttrOffset( int attr )
+{
+	return ( attr < PVA_NX ) ? (int)( offsetof( PlyVertex , pos ) + sizeof( float ) * attr ) :
+		   ( attr < PVA_U ) ? (int)( offsetof( PlyVertex , nor ) + sizeof( float ) * ( attr - PVA_NX ) ) :
+		   (int)( offsetof( PlyVertex , uv ) + sizeof( float ) * ( attr - PVA_U ) );
+}
+
+// whether the property holds the indices of a face
+static bool _isFaceIndices( const char* name )
+{
+	return equal_strings( name , "vertex_indices" ) || equal_strings( name , "vertex_index" );
+}
+
+// which of the optional attributes the vertex element has
+static void _findVertexAttrs( PlyElement* elem , bool& normals , bool& texcoords )
+{
+	int found = 0;
+	for( int k = 0 ; k < elem->nprops ; ++k ){
+		const int attr = _vertexAttr( elem->props[k]->name );
+		if( attr != PVA_NONE && !elem->props[k]->is_list )
+			found |= 1 << attr;
+	}
+	const int nor_mask = ( 1 << PVA_NX ) | ( 1 << PVA_NY ) | ( 1 << PVA_NZ );
+	const int uv_mask = ( 1 << PVA_U ) | ( 1 << PVA_V );
+	normals = ( found & nor_mask ) == nor_mask;
+	texcoords = ( found & uv_mask ) == uv_mask;
+}
+
+// push a vertex into the buffers
+static void _pushVertex( BufferMemory& mem , const PlyVertex& v , bool normals , bool texcoords )
+{
+	mem.m_PositionBuffer.push_back( Point( v.pos[0] , v.pos[1] , v.pos[2] ) );
+	if( normals )
+		mem.m_NormalBuffer.push_back( Vector( v.nor[0] , v.nor[1] , v.nor[2] ) );
+	if( texcoords ){
+		mem.m_TexCoordBuffer.push_back( v.uv[0] );
+		mem.m_TexCoordBuffer.push_back( v.uv[1] );
+	}
+}
+
+// push a polygon into the index buffer as a triangle fan
+static void _pushPolygon( Trunk& trunk , const unsigned* index , unsigned count , bool normals , bool texcoords )
+{
+	for( unsigned i = 1 ; i + 1 < count ; i++ )
+	{
+		const unsigned ids[3] = { index[0] , index[i] , index[i+1] };
+		for( unsigned k = 0 ; k < 3 ; ++k )
+		{
+			VertexIndex vid;
+			vid.posIndex = ids[k];
+			vid.norIndex = normals ? ids[k] : -1;
+			vid.texIndex = texcoords ? ids[k] : -1;
+			trunk.m_IndexBuffer.push_back( vid );
+		}
+	}
+}
+
+// the size of the scalar types in the file
+static const size_t _typeSize[] = { 0 , 1 , 2 , 4 , 1 , 2 , 4 , 4 , 8 };
+
+// whether the scalar type is a valid type of the file
+static inline bool _validType( int type )
+{
+	return type > PLY_START_TYPE && type < PLY_END_TYPE;
+}
+
+// read a scalar of a binary file
+// para 'swap' : whether the byte order of the file differs from the machine
+template< class T >
+static inline T _readScalar( const char* data , int type , bool swap )
+{
+	if( !_validType( type ) )
+		return (T)0;
+	char bytes[8];
+	memcpy( bytes , data , _typeSize[type] );
+	if( swap )
+		std::reverse( bytes , bytes + _typeSize[type] );
+
+	switch( type )
+	{
+	case PLY_CHAR: return (T)*(const signed char*)bytes;
+	case PLY_UCHAR: return (T)*(const unsigned char*)bytes;
+	case PLY_SHORT: { short v; memcpy( &v , bytes , sizeof( v ) ); return (T)v; }
+	case PLY_USHORT: { unsigned short v; memcpy( &v , bytes , sizeof( v ) ); return (T)v; }
+	case PLY_INT: { int v; memcpy( &v , bytes , sizeof( v ) ); return (T)v; }
+	case PLY_UINT: { unsigned v; memcpy( &v , bytes , sizeof( v ) ); return (T)v; }
+	case PLY_FLOAT: { float v; memcpy( &v , bytes , sizeof( v ) ); return (T)v; }
+	case PLY_DOUBLE: { double v; memcpy( &v , bytes , sizeof( v ) ); return (T)v; }
+	}
+	return (T)0;
+}
+
+// load a binary file straight from a mapping of the file
+// para 'swap' : whether the byte order of the file differs from the machine
+// result      : false if the data doesn't match the header
+static bool _loadBinary( PlyFile* ply , const string& str , BufferMemory& mem , Trunk& trunk , bool swap )
+{
+	MappedFile file;
+	if( !file.Open( str ) )
+		return false;
+
+	// the data starts after the line ending the header
+	const char* begin = file.GetData();
+	const char* end = begin + file.GetSize();
+	const char* header_end = 0;
+	for( const char* c = begin ; c + 10 <= end && header_end == 0 ; ++c ){
+		c = (const char*)memchr( c , 'e' , end - c );
+		if( c == 0 )
+			break;
+		if( c + 10 <= end && memcmp( c , "end_header" , 10 ) == 0 && ( c == begin || c[-1] == '\n' ) )
+			header_end = c + 10;
+	}
+	if( header_end == 0 )
+		return false;
+	while( header_end < end && *header_end != '\n' )
+		++header_end;
+	if( header_end == end )
+		return false;
+	const char* data = header_end + 1;
+
+	for( int i = 0 ; i < ply->nelems ; ++i )
+	{
+		PlyElement* elem = ply->elems[i];
+		const bool is_vertex = equal_strings( "vertex" , elem->name ) != 0;
+		const bool is_face = equal_strings( "face" , elem->name ) != 0;
+
+		// the layout of the scalar properties of a record , list properties break it
+		int stride = 0;
+		bool fixed = true;
+		int attr_offset[PVA_NUM] , attr_type[PVA_NUM];
+		for( int attr = 0 ; attr < PVA_NUM ; ++attr )
+			attr_offset[attr] = -1 , attr_type[attr] = 0;
+		for( int k = 0 ; k < elem->nprops ; ++k ){
+			const PlyProperty* prop = elem->props[k];
+			if( prop->is_list || !_validType( prop->external_type ) ){
+				fixed = false;
+				break;
+			}
+			const int attr = is_vertex ? _vertexAttr( prop->name ) : PVA_NONE;
+			if( attr != PVA_NONE && attr_offset[attr] < 0 ){
+				attr_offset[attr] = stride;
+				attr_type[attr] = prop->external_type;
+			}
+			stride += _typeSize[prop->external_type];
+		}
+
+		if( is_vertex )
+		{
+			if( !fixed || elem->num < 0 || (size_t)( end - data ) / max( stride , 1 ) < (size_t)elem->num )
+				return false;
+			bool normals , texcoords;
+			_findVertexAttrs( elem , normals , texcoords );
+
+			const size_t base = mem.m_PositionBuffer.size();
+			mem.m_PositionBuffer.resize( base + elem->num );
+			if( !swap && attr_offset[PVA_X] == 0 && attr_offset[PVA_Y] == 4 && attr_offset[PVA_Z] == 8 && stride == 12 &&
+				attr_type[PVA_X] == PLY_FLOAT && attr_type[PVA_Y] == PLY_FLOAT && attr_type[PVA_Z] == PLY_FLOAT )
+			{
+				// the positions are tightly packed native floats , no conversion is needed
+				for( int j = 0 ; j < elem->num ; ++j ){
+					float xyz[3];
+					memcpy( xyz , data + 12 * (size_t)j , 12 );
+					mem.m_PositionBuffer[base + j] = Point( xyz[0] , xyz[1] , xyz[2] );
+				}
+			}else
+			{
+				for( int j = 0 ; j < elem->num ; ++j ){
+					const char* record = data + (size_t)stride * j;
+					Point& p = mem.m_PositionBuffer[base + j];
+					p.x = ( attr_offset[PVA_X] < 0 ) ? 0.0f : _readScalar<float>( record + attr_offset[PVA_X] , attr_type[PVA_X] , swap );
+					p.y = ( attr_offset[PVA_Y] < 0 ) ? 0.0f : _readScalar<float>( record + attr_offset[PVA_Y] , attr_type[PVA_Y] , swap );
+					p.z = ( attr_offset[PVA_Z] < 0 ) ? 0.0f : _readScalar<float>( record + attr_offset[PVA_Z] , attr_type[PVA_Z] , swap );
+				}
+			}
+			if( normals ){
+				mem.m_NormalBuffer.resize( base + elem->num );
+				for( int j = 0 ; j < elem->num ; ++j ){
+					const char* record = data + (size_t)stride * j;
+					Vector& n = mem.m_NormalBuffer[base + j];
+					n.x = _readScalar<float>( record + attr_offset[PVA_NX] , attr_type[PVA_NX] , swap );
+					n.y = _readScalar<float>( record + attr_offset[PVA_NY] , attr_type[PVA_NY] , swap );
+					n.z = _readScalar<float>( record + attr_offset[PVA_NZ] , attr_type[PVA_NZ] , swap );
+				}
+			}
+			if( texcoords ){
+				mem.m_TexCoordBuffer.resize( 2 * ( base + elem->num ) );
+				for( int j = 0 ; j < elem->num ; ++j ){
+					const char* record = data + (size_t)stride * j;
+					mem.m_TexCoordBuffer[2 * ( base + j )] = _readScalar<float>( record + attr_offset[PVA_U] , attr_type[PVA_U] , swap );
+					mem.m_TexCoordBuffer[2 * ( base + j ) + 1] = _readScalar<float>( record + attr_offset[PVA_V] , attr_type[PVA_V] , swap );
+				}
+			}
+			data += (size_t)stride * elem->num;
+			continue;
+		}
+
+		if( fixed )
+		{
+			// other elements without lists are skipped as a whole block
+			if( elem->num < 0 || ( stride > 0 && (size_t)( end - data ) / stride < (size_t)elem->num ) )
+				return false;
+			data += (size_t)stride * elem->num;
+			continue;
+		}
+
+		// records with lists are walked one by one
+		bool normals = !mem.m_NormalBuffer.empty() , texcoords = !mem.m_TexCoordBuffer.empty();
+		if( is_face )
+			trunk.m_IndexBuffer.reserve( trunk.m_IndexBuffer.size() + 3 * elem->num );
+		vector<unsigned> index;
+		for( int j = 0 ; j < elem->num ; ++j )
+		{
+			for( int k = 0 ; k < elem->nprops ; ++k )
+			{
+				const PlyProperty* prop = elem->props[k];
+				if( !_validType( prop->external_type ) )
+					return false;
+				const size_t size = _typeSize[prop->external_type];
+				if( !prop->is_list ){
+					if( (size_t)( end - data ) < size )
+						return false;
+					data += size;
+					continue;
+				}
+
+				if( !_validType( prop->count_external ) || (size_t)( end - data ) < (size_t)_typeSize[prop->count_external] )
+					return false;
+				const long long count = _readScalar<long long>( data , prop->count_external , swap );
+				data += _typeSize[prop->count_external];
+				if( count < 0 || (size_t)( end - data ) / size < (size_t)count )
+					return false;
+				if( is_face && _isFaceIndices( prop->name ) ){
+					index.resize( (size_t)count );
+					for( long long t = 0 ; t < count ; ++t )
+						index[t] = _readScalar<unsigned>( data + size * t , prop->external_type , swap );
+					if( count >= 3 )
+						_pushPolygon( trunk , &index[0] , (unsigned)count , normals , texcoords );
+				}
+				data += size * count;
+			}
+		}
+	}
+	return true;
+}
+
+// load ply from file
 bool PlyLoader::LoadMesh( const string& str , std::shared_ptr<BufferMemory>& mem )
 {
 	// some variable that will be used later
@@ -61,60 +327,84 @@ bool PlyLoader::LoadMesh( const string& str , std::shared_ptr<BufferMemory>& mem
     std::shared_ptr<Trunk>	trunk = std::make_shared<Trunk>("default");
 	mem->m_TrunkBuffer.push_back( trunk );
 
-	for ( int i = 0; i < nelems; i++) 
+	// binary files are read in bulk straight from the mapped file, the generic reader doesn't swap bytes
+	const unsigned short probe = 1;
+	const int native_type = ( *(const unsigned char*)&probe == 1 ) ? PLY_BINARY_LE : PLY_BINARY_BE;
+	bool loaded = true;
+	if( file_type == PLY_BINARY_LE || file_type == PLY_BINARY_BE )
 	{
-		/* get the description of the first element */
-		elem_name = elist[i];
-		PlyProperty** properties = ply_get_element_description (ply, elem_name, &num_elems, &nprops);
-
-		if (equal_strings ("vertex", elem_name))
+		loaded = _loadBinary( ply , str , *mem , *trunk , file_type != native_type );
+		if( !loaded )
+            slog( WARNING , GENERAL , stringFormat( "Ply file %s is truncated or its data doesn't match its header." , str.c_str() ) );
+	}
+	else
+	{
+		for ( int i = 0; i < nelems; i++) 
 		{
-			ply_get_property (ply, elem_name, &vert_props[0]);
-			ply_get_property (ply, elem_name, &vert_props[1]);
-			ply_get_property (ply, elem_name, &vert_props[2]);
+			/* get the description of the first element */
+			elem_name = elist[i];
+			PlyProperty** properties = ply_get_element_description (ply, elem_name, &num_elems, &nprops);
 
-			for ( int j = 0; j < num_elems; j++) 
+			if (equal_strings ("vertex", elem_name))
 			{
-				Point p;
-				ply_get_element(ply, (void *)&p);
-				mem->m_PositionBuffer.push_back( p );
-			}
-		}
+				bool normals , texcoords;
+				_findVertexAttrs( ply->elems[i] , normals , texcoords );
+				for( int k = 0 ; k < nprops ; k++ )
+				{
+					const int attr = _vertexAttr( properties[k]->name );
+					if( attr == PVA_NONE || properties[k]->is_list || ( attr >= PVA_NX && attr < PVA_U && !normals ) || ( attr >= PVA_U && !texcoords ) )
+						continue;
+					PlyProperty prop = { properties[k]->name , PLY_FLOAT , PLY_FLOAT , _vertexAttrOffset( attr ) , 0 , 0 , 0 , 0 };
+					ply_get_property (ply, elem_name, &prop);
+				}
 
-		/* if we're on face elements, read them in */
-		if (equal_strings ("face", elem_name)) 
-		{
-			/* set up for getting face elements */
-			ply_get_property (ply, elem_name, &face_props[0]);
+				mem->m_PositionBuffer.reserve( mem->m_PositionBuffer.size() + num_elems );
+				if( normals )
+					mem->m_NormalBuffer.reserve( mem->m_NormalBuffer.size() + num_elems );
+				if( texcoords )
+					mem->m_TexCoordBuffer.reserve( mem->m_TexCoordBuffer.size() + 2 * num_elems );
+				for ( int j = 0; j < num_elems; j++) 
+				{
+					PlyVertex v = {};
+					ply_get_element(ply, (void *)&v);
+					_pushVertex( *mem , v , normals , texcoords );
+				}
+			}
 
-			/* grab all the face elements */
-			for ( int j = 0; j < num_elems; j++)
+			/* if we're on face elements, read them in */
+			if (equal_strings ("face", elem_name)) 
 			{
-				PlyIndex index;
-				ply_get_element (ply, (void *)&index);
+				/* set up for getting face elements */
+				for( int k = 0 ; k < nprops ; k++ )
+				{
+					if( !_isFaceIndices( properties[k]->name ) )
+						continue;
+					PlyProperty prop = { properties[k]->name , PLY_UINT , PLY_UINT , offsetof( PlyIndex , index ) , 1 , PLY_UINT , PLY_UINT , offsetof( PlyIndex , count ) };
+					ply_get_property (ply, elem_name, &prop);
+					break;
+				}
+
+				// each face has at least one triangle , polygons grow the buffer
+				trunk->m_IndexBuffer.reserve( trunk->m_IndexBuffer.size() + 3 * num_elems );
 
-				int curId = 1;
-				for( unsigned i = 0 ; i < index.count - 2 ; i++ )
+				/* grab all the face elements */
+				const bool normals = !mem->m_NormalBuffer.empty() , texcoords = !mem->m_TexCoordBuffer.empty();
+				for ( int j = 0; j < num_elems; j++)
 				{
-					VertexIndex vid;
-					vid.posIndex = index.index[0];
-					trunk->m_IndexBuffer.push_back( vid );
-					vid.posIndex = index.index[curId];
-					trunk->m_IndexBuffer.push_back( vid );
-					vid.posIndex = index.index[curId+1];
-					trunk->m_IndexBuffer.push_back( vid );
-
-					curId++;
+					PlyIndex index;
+					ply_get_element (ply, (void *)&index);
+					if( index.count >= 3 )
+						_pushPolygon( *trunk , index.index , index.count , normals , texcoords );
 				}
 			}
-		}
 
-		for( int k = 0 ; k < nprops ; k++ )
-		{
-			delete[] properties[k]->name;
-			delete properties[k];
+			for( int k = 0 ; k < nprops ; k++ )
+			{
+				delete[] properties[k]->name;
+				delete properties[k];
+			}
+			delete[] properties;
 		}
-		delete[] properties;
 	}
 
 	for( int i = 0 ; i < nelems ; i++ )
@@ -124,5 +414,5 @@ bool PlyLoader::LoadMesh( const string& str , std::shared_ptr<BufferMemory>& mem
 	// close ply file
 	ply_free_file( ply );
 
-	return true;
+	return loaded;
 }
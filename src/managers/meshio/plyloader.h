@@ -37,8 +37,9 @@ struct PlyIndex
 	}
 	~PlyIndex()
 	{
+		// the list is allocated by the ply reader with malloc
 		count = 0;
-		delete[] index;
+		free( index );
 	}
 };
 
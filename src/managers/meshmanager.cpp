@@ -20,11 +20,15 @@
 #include "utility/strhelper.h"
 #include "meshio/objloader.h"
 #include "meshio/plyloader.h"
+#include "meshio/meshcache.h"
+#include "managers/smmanager.h"
 #include "geometry/trimesh.h"
 #include "geometry/triangle.h"
 #include "utility/path.h"
+#include "utility/memoryfile.h"
 #include "bsdf/bsdf.h"
 #include "log/log.h"
+#include "utility/multithread/threadpool.h"
 
 // default constructor
 MeshManager::MeshManager()
@@ -49,16 +53,21 @@ std::shared_ptr<MeshLoader>	MeshManager::_getMeshLoader( MESH_TYPE type ) const
 	return nullptr;
 }
 
+// release the geometry data
+void MeshManager::Release()
+{
+	std::lock_guard<std::mutex> lock( m_BuffersMutex );
+	m_Buffers.clear();
+}
+
 // load the mesh from file
 bool MeshManager::LoadMesh( const string& filename , TriMesh* mesh )
 {
 	// get full resource filename
 	string str = GetFullPath( filename );
 
-	// get the mesh type
-	MESH_TYPE type = MeshTypeFromStr( str );
-
 	// find the mesh memory first
+	std::unique_lock<std::mutex> lock( m_BuffersMutex );
     unordered_map< string , std::shared_ptr<BufferMemory> >::const_iterator it = m_Buffers.find( str );
 	while( it != m_Buffers.end() )
 	{
@@ -73,61 +82,274 @@ bool MeshManager::LoadMesh( const string& filename , TriMesh* mesh )
 
 		return true;
 	}
-	
-	// get the mesh loader first
-	auto loader = _getMeshLoader( type );
+	lock.unlock();
 
-	bool read = false;
-	if( loader )
+	shared_ptr<BufferMemory> mem;
+	if( !_readMesh( str , mesh , mem ) )
+		return false;
+
+	mesh->m_bInstanced = false;
+	mesh->m_pMemory = mem;
+
+	// and insert it into the map
+	lock.lock();
+	m_Buffers.emplace( str , std::move( mem ) );
+	return true;
+}
+
+// whether the triangles of two subsets refer to the same vertexes , the indexes of the first one could be compacted already
+static bool _sameCorners( const Trunk& trunk , const Trunk& other )
+{
+	const auto& corners = other.m_IndexBuffer;
+	if( trunk.m_IndexBuffer.size() == corners.size() && trunk.m_CompactIndex16.empty() && trunk.m_CompactIndex32.empty() )
 	{
-		// create the new memory
-        shared_ptr<BufferMemory> mem = std::make_shared<BufferMemory>();
+		for( size_t k = 0 ; k < corners.size() ; k++ )
+		{
+			const VertexIndex& vi = trunk.m_IndexBuffer[k];
+			if( vi.posIndex != corners[k].posIndex || vi.norIndex != corners[k].norIndex || vi.texIndex != corners[k].texIndex )
+				return false;
+		}
+		return true;
+	}
+
+	// compacted corners refer to unified vertexes
+	const size_t count = std::max( trunk.m_CompactIndex16.size() , trunk.m_CompactIndex32.size() );
+	if( count != corners.size() )
+		return false;
+	for( size_t k = 0 ; k < count ; k++ )
+	{
+		const int index = trunk.m_CompactIndex16.empty() ? (int)trunk.m_CompactIndex32[k] : (int)trunk.m_CompactIndex16[k];
+		if( corners[k].posIndex != index || corners[k].norIndex != index || corners[k].texIndex != index )
+			return false;
+	}
+	return true;
+}
 
+// read the vertexes of a mesh again
+bool MeshManager::ReloadVertices( const string& filename , TriMesh* mesh , const Transform& transform , bool weld )
+{
+	BufferMemory* memory = mesh->m_pMemory.get();
+	if( mesh->m_bInstanced || memory->m_bCompressed )
+		return false;
+
+	// the buffers are read for a mesh standing in for the prototype , they are never registered
+	const string str = GetFullPath( filename );
+	TriMesh frame( mesh->m_Name );
+	frame.m_Transform = transform;
+	shared_ptr<BufferMemory> mem;
+	if( !_readMesh( str , &frame , mem ) )
+		return false;
+	if( weld )
+		mem->WeldVertices();
+
+	// the triangles refer to the vertexes by their indexes , so the same indexes have to refer to the same vertexes
+	if( mem->m_PositionBuffer.size() != memory->m_PositionBuffer.size() || mem->m_NormalBuffer.size() != memory->m_NormalBuffer.size() ||
+		mem->m_TexCoordBuffer.size() != memory->m_TexCoordBuffer.size() || mem->m_TrunkBuffer.size() != memory->m_TrunkBuffer.size() )
+		return false;
+	for( size_t i = 0 ; i < mem->m_TrunkBuffer.size() ; i++ )
+	{
+		if( !_sameCorners( *memory->m_TrunkBuffer[i] , *mem->m_TrunkBuffer[i] ) )
+			return false;
+	}
+
+	if( !memory->m_TangentBuffer.empty() )
+		mem->GenSmoothTagent();
+	memory->m_PositionBuffer.swap( mem->m_PositionBuffer );
+	memory->m_NormalBuffer.swap( mem->m_NormalBuffer );
+	memory->m_TangentBuffer.swap( mem->m_TangentBuffer );
+	memory->m_TexCoordBuffer.swap( mem->m_TexCoordBuffer );
+	memory->m_filename = str;
+	memory->UpdateMemoryUsage();
+	mesh->m_Transform = transform;
+	return true;
+}
+
+// read the buffers of a mesh
+bool MeshManager::_readMesh( const string& str , TriMesh* mesh , shared_ptr<BufferMemory>& mem )
+{
+	// meshes handed over in memory have no loader and are never cached
+	if( MemoryFiles::IsMemoryFile( str ) )
+		return _loadMemoryMesh( str , mesh , mem );
+
+	// get the mesh loader first
+	auto loader = _getMeshLoader( MeshTypeFromStr( str ) );
+	if( !loader )
+		return false;
+
+	// the buffers of the mesh are loaded from the cache next to the model if it is still valid
+	const string cache_file = str + ".sortmesh";
+	mem = std::make_shared<BufferMemory>();
+	const bool cached = MeshCache::Load( cache_file , str , mesh->m_Transform , mem );
+	bool read = true;
+	if( !cached )
+	{
 		// load the mesh from file
+		mem = std::make_shared<BufferMemory>();
 		read = loader->LoadMesh( str , mem );
+	}
+
+	// reset count
+	mem->CalculateCount();
+	if( !read )
+		return false;
+
+	if( cached )
+	{
+		// the cached buffers are transformed and complete already
+		mem->m_pPrototype = mesh;
+	}
+	else
+	{
+		// apply the transformation
+		mem->ApplyTransform( mesh );
+
+		// if there is no normal or texture coordinate , generate them
+		// because the rendering method requires all of the data
+		// note : tangents are only generated once the scene knows that a material needs them
+		mem->GenSmoothNormal();
+		mem->GenTexCoord();
+		MeshCache::Save( cache_file , str , mesh->m_Transform , *mem );
+	}
+	mem->m_filename = str;
+	mem->UpdateMemoryUsage();
+	return true;
+}
+
+// load a mesh handed over in memory
+bool MeshManager::_loadMemoryMesh( const string& str , TriMesh* mesh , shared_ptr<BufferMemory>& mem )
+{
+	MemoryMesh src;
+	if( !MemoryFiles::GetMesh( str , src ) || src.positions == nullptr || src.indices == nullptr )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Mesh %s is not in memory." , str.c_str() ) );
+		return false;
+	}
 
-		// reset count
-		mem->CalculateCount();
+	static_assert( sizeof( Point ) == 3 * sizeof( float ) && sizeof( Vector ) == 3 * sizeof( float ) , "positions and normals are read in place" );
 
-		// set the pointer
-		if( read )
+	// the arrays come from another application , a broken index would crash the rendering much later
+	for( size_t k = 0 ; k < 3 * (size_t)src.triangleCnt ; k++ )
+	{
+		if( src.indices[k] >= src.vertexCnt )
 		{
-			// apply the transformation
-			mem->ApplyTransform( mesh );
+			slog( WARNING , GENERAL , stringFormat( "Mesh %s refers to vertex %u of %u vertexes, it is skipped." , str.c_str() , src.indices[k] , src.vertexCnt ) );
+			return false;
+		}
+	}
 
-			// if there is no normal or texture coordinate or tagent , generate them
-			// because the rendering method requires all of the data
-			mem->GenSmoothNormal();
-			mem->GenTexCoord();
-			mem->GenSmoothTagent();
+	mem = std::make_shared<BufferMemory>();
+	mem->m_filename = str;
 
-			mesh->m_bInstanced = false;
-			mesh->m_pMemory = mem;
+	// the vertex arrays are read in place unless they have to be transformed
+	const bool identity = mesh->m_Transform.IdIdentity();
+	if( identity )
+	{
+		mem->m_PositionBuffer.Adopt( (const Point*)src.positions , src.vertexCnt );
+		if( src.normals )
+			mem->m_NormalBuffer.Adopt( (const Vector*)src.normals , src.vertexCnt );
+	}
+	else
+	{
+		mem->m_PositionBuffer.insert( mem->m_PositionBuffer.end() , (const Point*)src.positions , (const Point*)src.positions + src.vertexCnt );
+		if( src.normals )
+			mem->m_NormalBuffer.insert( mem->m_NormalBuffer.end() , (const Vector*)src.normals , (const Vector*)src.normals + src.vertexCnt );
+	}
+	if( src.texcoords )
+		mem->m_TexCoordBuffer.Adopt( src.texcoords , 2 * (size_t)src.vertexCnt );
 
-			// and insert it into the map
-			m_Buffers.insert( make_pair( str , mem ) );
+	// the indexes are converted , each corner refers to the same vertex in all arrays
+	if( src.trunks.empty() )
+	{
+		MemoryTrunk all;
+		all.material = src.material;
+		all.triangleCnt = src.triangleCnt;
+		src.trunks.push_back( all );
+	}
+	size_t first = 0;
+	for( const MemoryTrunk& range : src.trunks )
+	{
+		const size_t count = std::min( (size_t)range.triangleCnt , (size_t)src.triangleCnt - first );
+		auto trunk = std::make_shared<Trunk>( range.material.empty() ? str : range.material );
+		trunk->m_IndexBuffer.resize( 3 * count );
+		for( size_t k = 0 ; k < 3 * count ; k++ )
+		{
+			VertexIndex& vi = trunk->m_IndexBuffer[k];
+			vi.posIndex = (int)src.indices[ 3 * first + k ];
+			vi.norIndex = src.normals ? vi.posIndex : -1;
+			vi.texIndex = src.texcoords ? vi.posIndex : -1;
 		}
+		trunk->m_matName = range.material;
+		mem->m_TrunkBuffer.push_back( trunk );
+		first += count;
 	}
 
-	return read;
+	mem->CalculateCount();
+	if( identity )
+		mem->m_pPrototype = mesh;
+	else
+		mem->ApplyTransform( mesh );
+	mem->GenSmoothNormal();
+	mem->GenTexCoord();
+	mem->UpdateMemoryUsage();
+	return true;
 }
 
 // apply transform
 void BufferMemory::ApplyTransform( TriMesh* mesh )
 {
-	vector<Point>::iterator p_it = m_PositionBuffer.begin();
+	ApplyTransform( mesh->m_Transform );
+	m_pPrototype = mesh;
+}
+
+// transform the vertex buffers
+void BufferMemory::ApplyTransform( const Transform& transform )
+{
+	// the elements of adopted or shared buffers are read-only
+	m_PositionBuffer.reserve( m_PositionBuffer.size() );
+	m_NormalBuffer.reserve( m_NormalBuffer.size() );
+	m_TangentBuffer.reserve( m_TangentBuffer.size() );
+
+	auto p_it = m_PositionBuffer.begin();
 	while( p_it != m_PositionBuffer.end() )
 	{
-		*p_it = (mesh->m_Transform)(*p_it);
+		*p_it = transform(*p_it);
 		p_it++;
 	}
-	vector<Vector>::iterator n_it = m_NormalBuffer.begin();
+	auto n_it = m_NormalBuffer.begin();
 	while( n_it != m_NormalBuffer.end() )
 	{
-		*n_it = (mesh->m_Transform.invMatrix.Transpose())(*n_it);	// use inverse transpose matrix here
+		*n_it = transform.TransformNormal( *n_it );	// use inverse transpose matrix here
 		n_it++;
 	}
-	m_pPrototype = mesh;
+	for( auto& tangent : m_TangentBuffer )
+		tangent = Normalize( transform( tangent ) );
+}
+
+// gather the triangles adjacent to each vertex , the triangles of a vertex are kept in ascending order
+// para 'trunks'  : the trunks of the mesh
+// para 'count'   : the number of vertexes
+// para 'member'  : the index of the vertex in the vertex index
+// para 'offsets' : the offset of the triangles of each vertex , there is one more offset at the end
+// para 'adj'     : the triangles adjacent to the vertexes
+static void _gatherAdjacency( const vector<std::shared_ptr<Trunk>>& trunks , unsigned count , int VertexIndex::* member , vector<unsigned>& offsets , vector<unsigned>& adj )
+{
+	// count the triangles of each vertex first so that all lists are packed in one buffer
+	offsets.assign( count + 1 , 0 );
+	for( const auto& trunk : trunks )
+		for( unsigned k = 0 ; k < 3 * trunk->m_iTriNum ; k++ )
+			++offsets[ trunk->m_IndexBuffer[k].*member + 1 ];
+	for( unsigned i = 0 ; i < count ; i++ )
+		offsets[i+1] += offsets[i];
+
+	adj.resize( offsets[count] );
+	vector<unsigned> cursor( offsets.begin() , offsets.end() - 1 );
+	unsigned base = 0;
+	for( const auto& trunk : trunks )
+	{
+		for( unsigned k = 0 ; k < 3 * trunk->m_iTriNum ; k++ )
+			adj[ cursor[ trunk->m_IndexBuffer[k].*member ]++ ] = base + k / 3;
+		base += trunk->m_iTriNum;
+	}
 }
 
 // generate normal for the triangle mesh
@@ -136,37 +358,38 @@ void BufferMemory::_genFlatNormal()
 	if( m_iNBCount != 0 )
 		return;
 
-	// generate the triangles
-	unsigned totalTriNum = 0;
+	// generate the triangles , triangles are independent
 	unsigned trunkNum = (unsigned)m_TrunkBuffer.size();
+	m_NormalBuffer.resize( m_iTriNum );
 	unsigned base = 0;
 	for( unsigned i = 0 ; i < trunkNum ; i++ )
 	{
         auto& trunk = m_TrunkBuffer[i];
-		for( unsigned k = 0 ; k < trunk->m_iTriNum ; k++ )
-		{
-			unsigned offset = 3*k;
-			unsigned id0 = trunk->m_IndexBuffer[offset].posIndex;
-			unsigned id1 = trunk->m_IndexBuffer[offset+1].posIndex;
-			unsigned id2 = trunk->m_IndexBuffer[offset+2].posIndex;
-
-			// get the vertexes
-			Vector v0 = m_PositionBuffer[id0] - m_PositionBuffer[id1];
-			Vector v1 = m_PositionBuffer[id2] - m_PositionBuffer[id1];
-
-			// set the normal
-			Vector n = Cross( v1 , v0 );
-			n.Normalize();
-			m_NormalBuffer.push_back( n );
-
-			trunk->m_IndexBuffer[offset].norIndex = base+k;
-			trunk->m_IndexBuffer[offset+1].norIndex = base+k;
-			trunk->m_IndexBuffer[offset+2].norIndex = base+k;
-		}
-		totalTriNum += trunk->m_iTriNum;
+		ParallelFor( 0 , trunk->m_iTriNum , 1024 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+			for( unsigned k = _start ; k < _end ; k++ )
+			{
+				unsigned offset = 3*k;
+				unsigned id0 = trunk->m_IndexBuffer[offset].posIndex;
+				unsigned id1 = trunk->m_IndexBuffer[offset+1].posIndex;
+				unsigned id2 = trunk->m_IndexBuffer[offset+2].posIndex;
+
+				// get the vertexes
+				Vector v0 = m_PositionBuffer[id0] - m_PositionBuffer[id1];
+				Vector v1 = m_PositionBuffer[id2] - m_PositionBuffer[id1];
+
+				// set the normal
+				Vector n = Cross( v1 , v0 );
+				n.Normalize();
+				m_NormalBuffer[base+k] = n;
+
+				trunk->m_IndexBuffer[offset].norIndex = base+k;
+				trunk->m_IndexBuffer[offset+1].norIndex = base+k;
+				trunk->m_IndexBuffer[offset+2].norIndex = base+k;
+			}
+		});
 		base += trunk->m_iTriNum;
 	}
-	m_iNBCount = totalTriNum;
+	m_iNBCount = base;
 }
 
 void BufferMemory::GenSmoothNormal()
@@ -178,55 +401,29 @@ void BufferMemory::GenSmoothNormal()
 	_genFlatNormal();
 
 	// get the adjacency information
-	vector<unsigned>* adjacency = new vector<unsigned>[m_iVBCount];
-	// generate the triangles
-	unsigned trunkNum = (unsigned)m_TrunkBuffer.size();
-	unsigned base = 0;
-	for( unsigned i = 0 ; i < trunkNum ; i++ )
-	{
-		auto& trunk = m_TrunkBuffer[i];
-		for( unsigned k = 0 ; k < trunk->m_iTriNum ; k++ )
+	vector<unsigned> offsets , adjacency;
+	_gatherAdjacency( m_TrunkBuffer , m_iVBCount , &VertexIndex::posIndex , offsets , adjacency );
+	for( auto& trunk : m_TrunkBuffer )
+		for( unsigned k = 0 ; k < 3 * trunk->m_iTriNum ; k++ )
+			trunk->m_IndexBuffer[k].norIndex = trunk->m_IndexBuffer[k].posIndex;
+
+	// generate smooth normal , vertexes are independent
+	MeshBuffer<Vector> smoothNormal( m_iVBCount );
+	ParallelFor( 0 , m_iVBCount , 1024 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; i++ )
 		{
-			unsigned offset = 3 * k;
-			unsigned id0 = trunk->m_IndexBuffer[offset].posIndex;
-			unsigned id1 = trunk->m_IndexBuffer[offset+1].posIndex;
-			unsigned id2 = trunk->m_IndexBuffer[offset+2].posIndex;
-
-			adjacency[id0].push_back( base + k );
-			adjacency[id1].push_back( base + k );
-			adjacency[id2].push_back( base + k );
-
-			trunk->m_IndexBuffer[offset].norIndex = trunk->m_IndexBuffer[offset].posIndex;
-			trunk->m_IndexBuffer[offset+1].norIndex = trunk->m_IndexBuffer[offset+1].posIndex;
-			trunk->m_IndexBuffer[offset+2].norIndex = trunk->m_IndexBuffer[offset+2].posIndex;
-		}
-		base += trunk->m_iTriNum;
-	}
+			Vector n;
+			for( unsigned j = offsets[i] ; j < offsets[i+1] ; j++ )
+				n += m_NormalBuffer[adjacency[j]];
 
-	// generate smooth normal
-	vector<Vector> smoothNormal;
-	for( unsigned i = 0 ; i < m_iVBCount ; i++ )
-	{
-		Vector n;
+			if( offsets[i] != offsets[i+1] )
+				n.Normalize();
 
-		vector<unsigned>::iterator it = adjacency[i].begin();
-		while( it != adjacency[i].end() )
-		{
-			n += m_NormalBuffer[*it];
-			it++;
+			smoothNormal[i] = n;
 		}
-
-		if( 0 != adjacency[i].size() )
-		{
-			n.Normalize();
-		}
-
-		smoothNormal.push_back(n);
-	}
-	m_NormalBuffer = smoothNormal;
+	});
+	m_NormalBuffer.swap( smoothNormal );
 	m_iNBCount = (unsigned)m_NormalBuffer.size();
-
-	delete[] adjacency;
 }
 
 // generate tagent for the triangle mesh
@@ -235,57 +432,40 @@ void BufferMemory::GenSmoothTagent()
 	if( m_iTeBcount != 0 )
 		return;
 
-	// generate tagent for each triangle
-	vector<Vector> tagents;
+	// generate tagent for each triangle , triangles are independent
+	vector<Vector> tagents( m_iTriNum );
 	const unsigned trunkNum = (unsigned)m_TrunkBuffer.size();
-	for( unsigned i = 0 ; i < trunkNum ; i++ )
-	{
-        auto& trunk = m_TrunkBuffer[i];
-		for( unsigned k = 0 ; k < trunk->m_iTriNum ; k++ )
-			tagents.push_back( _genTagentForTri( trunk , k ) );
-	}
-
-	// set the adjacency information
-	vector<unsigned>* adjacency = new vector<unsigned>[m_iNBCount];
 	unsigned base = 0;
 	for( unsigned i = 0 ; i < trunkNum ; i++ )
 	{
-		auto& trunk = m_TrunkBuffer[i];
-		for( unsigned k = 0 ; k < trunk->m_iTriNum ; k++ )
-		{
-			unsigned offset = 3 * k;
-			unsigned id0 = trunk->m_IndexBuffer[offset].norIndex;
-			unsigned id1 = trunk->m_IndexBuffer[offset+1].norIndex;
-			unsigned id2 = trunk->m_IndexBuffer[offset+2].norIndex;
-
-			adjacency[id0].push_back( base + k );
-			adjacency[id1].push_back( base + k );
-			adjacency[id2].push_back( base + k );
-		}
+        auto& trunk = m_TrunkBuffer[i];
+		ParallelFor( 0 , trunk->m_iTriNum , 1024 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+			for( unsigned k = _start ; k < _end ; k++ )
+				tagents[base+k] = _genTagentForTri( trunk , k );
+		});
 		base += trunk->m_iTriNum;
 	}
 
-	// generate smooth normal
-	for( unsigned i = 0 ; i < m_iNBCount ; i++ )
-	{
-		Vector t;
+	// set the adjacency information
+	vector<unsigned> offsets , adjacency;
+	_gatherAdjacency( m_TrunkBuffer , m_iNBCount , &VertexIndex::norIndex , offsets , adjacency );
 
-		vector<unsigned>::iterator it = adjacency[i].begin();
-		while( it != adjacency[i].end() )
+	// generate smooth tangent , vertexes are independent
+	m_TangentBuffer.resize( m_iNBCount );
+	ParallelFor( 0 , m_iNBCount , 1024 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; i++ )
 		{
-			t += tagents[*it];
-			it++;
-		}
+			Vector t;
+			for( unsigned j = offsets[i] ; j < offsets[i+1] ; j++ )
+				t += tagents[adjacency[j]];
 
-		if( 0 != adjacency[i].size() )
-			t.Normalize();
+			if( offsets[i] != offsets[i+1] )
+				t.Normalize();
 
-		m_TangentBuffer.push_back(t);
-	}
+			m_TangentBuffer[i] = t;
+		}
+	});
 	m_iTeBcount = (unsigned)m_TangentBuffer.size();
-
-	// free the memory
-	delete[] adjacency;
 }
 
 // generate tagent vector for a triangle
@@ -334,6 +514,249 @@ Vector BufferMemory::_genTagentForTri( const std::shared_ptr<Trunk>& trunk , uns
 	return ( dv2 * dp1 - dv1 * dp2 ) * invdet;
 }
 
+// renumber an index by the order it is first referenced
+static void _renumberIndex( int& index , vector<unsigned>& remap , unsigned& count )
+{
+	if( index < 0 || index >= (int)remap.size() )
+		return;
+	if( remap[index] == ~0u )
+		remap[index] = count++;
+	index = (int)remap[index];
+}
+
+// move the elements of a buffer to their new indexes , each index covers 'stride' elements
+template< class T >
+static void _permuteBuffer( MeshBuffer<T>& buffer , vector<unsigned>& remap , unsigned count , unsigned stride )
+{
+	if( buffer.size() != remap.size() * stride )
+		return;
+	for( unsigned i = 0 ; i < (unsigned)remap.size() ; i++ )
+	{
+		if( remap[i] == ~0u )
+			remap[i] = count++;
+	}
+	MeshBuffer<T> permuted( buffer.size() );
+	for( unsigned i = 0 ; i < (unsigned)remap.size() ; i++ )
+		for( unsigned k = 0 ; k < stride ; k++ )
+			permuted[ remap[i] * stride + k ] = buffer[ i * stride + k ];
+	buffer.swap( permuted );
+}
+
+// renumber the vertexes
+void BufferMemory::ReorderVertices()
+{
+	vector<unsigned> posRemap( GetPositionCount() , ~0u );
+	vector<unsigned> norRemap( m_bCompressed ? m_OctNormalBuffer.size() : m_NormalBuffer.size() , ~0u );
+	vector<unsigned> texRemap( m_TexCoordBuffer.size() / 2 , ~0u );
+	unsigned posCount = 0 , norCount = 0 , texCount = 0;
+	for( auto& trunk : m_TrunkBuffer )
+	{
+		for( auto& index : trunk->m_IndexBuffer )
+		{
+			_renumberIndex( index.posIndex , posRemap , posCount );
+			_renumberIndex( index.norIndex , norRemap , norCount );
+			_renumberIndex( index.texIndex , texRemap , texCount );
+		}
+	}
+
+	// tangents share the indexes of normals
+	vector<unsigned> tanRemap = norRemap;
+	if( m_bCompressed )
+	{
+		_permuteBuffer( m_QuantPositionBuffer , posRemap , posCount , 1 );
+		_permuteBuffer( m_OctNormalBuffer , norRemap , norCount , 1 );
+		_permuteBuffer( m_OctTangentBuffer , tanRemap , norCount , 1 );
+	}
+	else
+	{
+		_permuteBuffer( m_PositionBuffer , posRemap , posCount , 1 );
+		_permuteBuffer( m_NormalBuffer , norRemap , norCount , 1 );
+		_permuteBuffer( m_TangentBuffer , tanRemap , norCount , 1 );
+	}
+	_permuteBuffer( m_TexCoordBuffer , texRemap , texCount , 2 );
+}
+
+// the attributes of a corner , corners with the same attributes are welded into one vertex
+struct WeldKey
+{
+	float	data[11];
+
+	bool operator == ( const WeldKey& key ) const { return memcmp( data , key.data , sizeof( data ) ) == 0; }
+};
+struct WeldKeyHash
+{
+	size_t operator()( const WeldKey& key ) const
+	{
+		// FNV-1a over the bits of the attributes
+		const unsigned char* bytes = (const unsigned char*)key.data;
+		unsigned long long hash = 0xcbf29ce484222325ULL;
+		for( unsigned i = 0 ; i < sizeof( key.data ) ; i++ )
+			hash = ( hash ^ bytes[i] ) * 0x100000001b3ULL;
+		return (size_t)hash;
+	}
+};
+
+// merge the corners with identical attributes
+void BufferMemory::WeldVertices()
+{
+	const bool hasNormal = !m_NormalBuffer.empty();
+	const bool hasTangent = !m_TangentBuffer.empty();
+	const bool hasTexCoord = !m_TexCoordBuffer.empty();
+
+	size_t corners = 0;
+	for( auto& trunk : m_TrunkBuffer )
+		corners += trunk->m_IndexBuffer.size();
+
+	MeshBuffer<Point>	positions;
+	MeshBuffer<Vector>	normals , tangents;
+	MeshBuffer<float>	texcoords;
+	positions.reserve( m_PositionBuffer.size() );
+	std::unordered_map<WeldKey,int,WeldKeyHash> vertexes( corners );
+	for( auto& trunk : m_TrunkBuffer )
+	{
+		for( auto& index : trunk->m_IndexBuffer )
+		{
+			// missing attributes are zero , tangents share the indexes of normals
+			WeldKey key;
+			memset( key.data , 0 , sizeof( key.data ) );
+			const Point p = m_PositionBuffer[index.posIndex];
+			const Vector n = ( hasNormal && index.norIndex >= 0 ) ? m_NormalBuffer[index.norIndex] : Vector();
+			const Vector t = ( hasTangent && index.norIndex >= 0 ) ? m_TangentBuffer[index.norIndex] : Vector();
+			const float u = ( hasTexCoord && index.texIndex >= 0 ) ? m_TexCoordBuffer[2*index.texIndex] : 0.0f;
+			const float v = ( hasTexCoord && index.texIndex >= 0 ) ? m_TexCoordBuffer[2*index.texIndex+1] : 0.0f;
+			for( unsigned axis = 0 ; axis < 3 ; axis++ )
+			{
+				key.data[axis] = p[axis];
+				key.data[3+axis] = n[axis];
+				key.data[6+axis] = t[axis];
+			}
+			key.data[9] = u;
+			key.data[10] = v;
+
+			auto it = vertexes.find( key );
+			if( it == vertexes.end() )
+			{
+				it = vertexes.emplace( key , (int)positions.size() ).first;
+				positions.push_back( p );
+				if( hasNormal )
+					normals.push_back( n );
+				if( hasTangent )
+					tangents.push_back( t );
+				if( hasTexCoord )
+				{
+					texcoords.push_back( u );
+					texcoords.push_back( v );
+				}
+			}
+			index.posIndex = it->second;
+			index.norIndex = hasNormal ? it->second : -1;
+			index.texIndex = hasTexCoord ? it->second : -1;
+		}
+	}
+
+	m_PositionBuffer.swap( positions );
+	m_NormalBuffer.swap( normals );
+	m_TangentBuffer.swap( tangents );
+	m_TexCoordBuffer.swap( texcoords );
+	CalculateCount();
+
+	slog( INFO , GENERAL , stringFormat( "%d corners of mesh %s are welded into %d vertexes." , (int)corners , m_filename.c_str() , m_iVBCount ) );
+}
+
+// whether the three indexes of every corner refer to the same vertex
+bool BufferMemory::HasUnifiedVertices() const
+{
+	for( auto& trunk : m_TrunkBuffer )
+	{
+		for( auto& index : trunk->m_IndexBuffer )
+		{
+			if( index.posIndex != index.norIndex || index.posIndex != index.texIndex )
+				return false;
+		}
+	}
+	return true;
+}
+
+// compress the vertex buffers
+void BufferMemory::CompressVertices()
+{
+	if( m_bCompressed )
+		return;
+	const size_t bytes = sizeof( Point ) * m_PositionBuffer.size() + sizeof( Vector ) * ( m_NormalBuffer.size() + m_TangentBuffer.size() );
+
+	// the bounds of the mesh are split into 65535 steps along each axis
+	BBox bounds;
+	for( auto& p : m_PositionBuffer )
+		bounds.Union( p );
+	m_QuantOrigin = bounds.m_Min;
+	m_QuantStep = m_PositionBuffer.empty() ? Vector() : ( bounds.m_Max - bounds.m_Min ) / 65535.0f;
+
+	m_QuantPositionBuffer.resize( m_PositionBuffer.size() );
+	m_OctNormalBuffer.resize( m_NormalBuffer.size() );
+	m_OctTangentBuffer.resize( m_TangentBuffer.size() );
+	ParallelFor( 0 , (unsigned)m_PositionBuffer.size() , 4096 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; i++ )
+		{
+			unsigned short q[3];
+			for( unsigned axis = 0 ; axis < 3 ; axis++ )
+			{
+				const float step = m_QuantStep[axis];
+				const float t = ( step > 0.0f ) ? ( m_PositionBuffer[i][axis] - m_QuantOrigin[axis] ) / step : 0.0f;
+				q[axis] = (unsigned short)min( max( t + 0.5f , 0.0f ) , 65535.0f );
+			}
+			m_QuantPositionBuffer[i].x = q[0];
+			m_QuantPositionBuffer[i].y = q[1];
+			m_QuantPositionBuffer[i].z = q[2];
+		}
+	});
+	ParallelFor( 0 , (unsigned)m_NormalBuffer.size() , 4096 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; i++ )
+			m_OctNormalBuffer[i] = EncodeOctahedral( m_NormalBuffer[i] );
+	});
+	ParallelFor( 0 , (unsigned)m_TangentBuffer.size() , 4096 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; i++ )
+			m_OctTangentBuffer[i] = EncodeOctahedral( m_TangentBuffer[i] );
+	});
+
+	MeshBuffer<Point>().swap( m_PositionBuffer );
+	MeshBuffer<Vector>().swap( m_NormalBuffer );
+	MeshBuffer<Vector>().swap( m_TangentBuffer );
+	m_bCompressed = true;
+
+	const size_t compressed = sizeof( QuantizedPoint ) * m_QuantPositionBuffer.size() + sizeof( unsigned ) * ( m_OctNormalBuffer.size() + m_OctTangentBuffer.size() );
+	slog( INFO , GENERAL , stringFormat( "Vertex buffers of mesh %s are compressed from %.2f MB to %.2f MB." , m_filename.c_str() , bytes / 1048576.0f , compressed / 1048576.0f ) );
+}
+
+// replace a buffer with the copy shared with other processes
+template< class T >
+static void _shareBuffer( MeshBuffer<T>& buffer )
+{
+	if( buffer.empty() || buffer.IsShared() )
+		return;
+	const void* shared = SMManager::GetSingleton().ShareSceneData( buffer.data() , sizeof( T ) * buffer.size() );
+	if( shared )
+		buffer.Adopt( (const T*)shared );
+}
+
+// replace the buffers with copies shared with other processes on the host
+void BufferMemory::ShareBuffers()
+{
+	_shareBuffer( m_PositionBuffer );
+	_shareBuffer( m_NormalBuffer );
+	_shareBuffer( m_TangentBuffer );
+	_shareBuffer( m_TexCoordBuffer );
+	_shareBuffer( m_QuantPositionBuffer );
+	_shareBuffer( m_OctNormalBuffer );
+	_shareBuffer( m_OctTangentBuffer );
+	for( auto& trunk : m_TrunkBuffer )
+	{
+		_shareBuffer( trunk->m_IndexBuffer );
+		_shareBuffer( trunk->m_CompactIndex32 );
+		_shareBuffer( trunk->m_CompactIndex16 );
+	}
+	UpdateMemoryUsage();
+}
+
 // generate texture coordinate
 void BufferMemory::GenTexCoord()
 {
@@ -342,7 +765,7 @@ void BufferMemory::GenTexCoord()
 
 	// find the center of the mesh
 	Point center;
-	vector<Point>::iterator it = m_PositionBuffer.begin();
+	auto it = m_PositionBuffer.begin();
 	while( it != m_PositionBuffer.end() )
 	{
 		center = center + *it;
@@ -350,6 +773,7 @@ void BufferMemory::GenTexCoord()
 	}
 	center /= (float)m_PositionBuffer.size();
 
+	m_TexCoordBuffer.reserve( 2 * m_PositionBuffer.size() );
 	it = m_PositionBuffer.begin();
 	while( it != m_PositionBuffer.end() )
 	{
@@ -27,12 +27,18 @@
 #include "math/point.h"
 #include "math/vector3.h"
 #include "math/transform.h"
+#include "math/octahedral.h"
 #include "material/material.h"
+#include "utility/memstats.h"
+#include "utility/hugepage.h"
+#include "meshbuffer.h"
 #include <memory>
+#include <mutex>
 
 // pre-declera class
 class MeshLoader;
 class TriMesh;
+struct MeshPage;
 
 // index for a vertex
 struct VertexIndex
@@ -50,6 +56,13 @@ struct VertexIndex
 	~VertexIndex(){}
 };
 
+// position quantized to 16 bits per axis relative to the bounds of the mesh
+struct QuantizedPoint
+{
+	unsigned short	x , y , z;
+};
+
+
 // trunk (submesh)
 // a trunk only contains index information
 class Trunk
@@ -59,11 +72,17 @@ public:
 	// the name for the current trunk
 	string	name;
 	// index buffer
-	vector<VertexIndex>	m_IndexBuffer;
+	MeshBuffer<VertexIndex>	m_IndexBuffer;
+	// compact index buffers , one index per corner once the corners refer to unified vertexes
+	// note : 16-bit indexes are used if the mesh has no more than 65536 vertexes , the other buffer is empty
+	MeshBuffer<unsigned>		m_CompactIndex32;
+	MeshBuffer<unsigned short>	m_CompactIndex16;
 	// the triangle number
 	unsigned	m_iTriNum;
 	// the material
     std::shared_ptr<Material>	m_mat;
+	// the name of the material , loaders only keep the name and the mesh binds it once the material libraries are parsed
+	string	m_matName;
 
 	// constructor
 	// para 'str' : name for the trunk
@@ -77,15 +96,27 @@ class BufferMemory
 // public data
 public:
 	// the vertex buffer
-	vector<Point>	m_PositionBuffer;
+	MeshBuffer<Point>	m_PositionBuffer;
 	// the normal buffer
-	vector<Vector>	m_NormalBuffer;
+	MeshBuffer<Vector>	m_NormalBuffer;
 	// the tagent buffer
-	vector<Vector>	m_TangentBuffer;
+	MeshBuffer<Vector>	m_TangentBuffer;
 	// the texture coordinate buffer
-	vector<float>	m_TexCoordBuffer;
+	MeshBuffer<float>	m_TexCoordBuffer;
+	// the compressed vertex buffers , they replace the position , normal and tangent buffers once the mesh is compressed
+	// note : normals and tangents are encoded with octahedral mapping in 32 bits
+	MeshBuffer<QuantizedPoint>	m_QuantPositionBuffer;
+	MeshBuffer<unsigned>		m_OctNormalBuffer;
+	MeshBuffer<unsigned>		m_OctTangentBuffer;
+	// the corner of the bounds and the size of a quantization step along each axis
+	Point			m_QuantOrigin;
+	Vector			m_QuantStep;
+	// whether the vertex buffers are compressed
+	bool			m_bCompressed;
 	// the trunk buffer
     vector<std::shared_ptr<Trunk>>	m_TrunkBuffer;
+	// the material libraries referred by the model
+	vector<string>	m_MatLibs;
 	// the size for three buffers
 	unsigned		m_iVBCount , m_iNBCount , m_iTeBcount , m_iTBCount;
 	// the number of triangles 
@@ -96,6 +127,10 @@ public:
 	TriMesh*		m_pPrototype;
 	// the name for the file
 	std::string		m_filename;
+	// the memory taken by the buffers
+	MemoryTracker	m_tracker{ MEM_MESH };
+	// the page of the shading buffers if they could be paged out
+	MeshPage*		m_page;
 
 	// set default data for the buffer memory
 	BufferMemory()
@@ -107,10 +142,32 @@ public:
 		m_iTriNum = 0;
 		m_pPrototype = 0;
 		m_iTrunkNum = 0;
+		m_page = 0;
+		m_bCompressed = false;
 	}
 
+	// get the position , normal and tangent of a vertex , they are decoded if the mesh is compressed
+	// para 'id' : the index of the vertex
+	Point GetPosition( int id ) const
+	{
+		if( !m_bCompressed )
+			return m_PositionBuffer[id];
+		const QuantizedPoint& q = m_QuantPositionBuffer[id];
+		return Point( m_QuantOrigin.x + m_QuantStep.x * q.x , m_QuantOrigin.y + m_QuantStep.y * q.y , m_QuantOrigin.z + m_QuantStep.z * q.z );
+	}
+	Vector GetNormal( int id ) const
+	{ return m_bCompressed ? DecodeOctahedral( m_OctNormalBuffer[id] ) : m_NormalBuffer[id]; }
+	Vector GetTangent( int id ) const
+	{ return m_bCompressed ? DecodeOctahedral( m_OctTangentBuffer[id] ) : m_TangentBuffer[id]; }
+	// the number of positions in the vertex buffer
+	unsigned GetPositionCount() const
+	{ return (unsigned)( m_bCompressed ? m_QuantPositionBuffer.size() : m_PositionBuffer.size() ); }
+
 	// apply transform
 	void ApplyTransform( TriMesh* mesh );
+	// transform the positions , normals and tangents , buffers shared with others are copied first
+	// note : the buffers can't be compressed
+	void ApplyTransform( const Transform& transform );
 
 	// calculate buffer number
 	void CalculateCount()
@@ -130,12 +187,40 @@ public:
 		}
 	}
 
+	// account the memory of the buffers , buffers shared with other processes are not counted
+	void UpdateMemoryUsage()
+	{
+		size_t bytes = m_PositionBuffer.GetMemoryUsage() + m_NormalBuffer.GetMemoryUsage() + m_TangentBuffer.GetMemoryUsage() + m_TexCoordBuffer.GetMemoryUsage();
+		bytes += m_QuantPositionBuffer.GetMemoryUsage() + m_OctNormalBuffer.GetMemoryUsage() + m_OctTangentBuffer.GetMemoryUsage();
+		for( auto& trunk : m_TrunkBuffer )
+			bytes += trunk->m_IndexBuffer.GetMemoryUsage() + trunk->m_CompactIndex32.GetMemoryUsage() + trunk->m_CompactIndex16.GetMemoryUsage();
+		m_tracker.Set( bytes );
+	}
+
+	// replace the vertex and index buffers with copies shared with other processes on the host
+	// note : the buffers have to be final , the triangles pointing into the index buffers are moved by the mesh
+	void ShareBuffers();
+
 	// generate normal for the triangle mesh
 	void	GenSmoothNormal();
 	// generate tagent for the triangle mesh
+	// note : without tangents , triangles build an arbitrary tangent around the shading normal
 	void	GenSmoothTagent();
 	// generate texture coordinate
 	void	GenTexCoord();
+	// renumber the vertexes in the order they are first referenced by the triangles
+	// note : vertexes not referenced by any triangle are kept at the end of the buffers
+	void	ReorderVertices();
+	// merge the corners with identical position , normal , tangent and texture coordinate into unified vertexes
+	// note : afterward the three indexes of every corner are the same , buffers are renumbered in the order
+	//		  vertexes are first referenced
+	void	WeldVertices();
+	// whether the three indexes of every corner refer to the same vertex
+	bool	HasUnifiedVertices() const;
+	// replace the position , normal and tangent buffers with compressed ones
+	// note : positions are quantized to 16 bits relative to the bounds of the mesh , normals and tangents
+	//		  are encoded in 32 bits , the buffers can't be generated or transformed afterward
+	void	CompressVertices();
 
 // private method
 private:
@@ -158,8 +243,25 @@ public:
 	// para 'str'  : name of the file
 	// para 'mesh' : triangle mesh
 	// result      : 'true' if loading is successful
+	// note        : it is thread-safe , but the first mesh loading a file becomes the prototype
+	//				 of its instances , so meshes sharing a file should be loaded in order
 	bool LoadMesh( const string& str , TriMesh* mesh );
 
+	// read the vertexes of a mesh again , e.g. from the file of another frame of an animation
+	// para 'str'       : name of the file
+	// para 'mesh'      : the triangle mesh loading its file first , its transformation is replaced too
+	// para 'transform' : the transformation of the mesh
+	// para 'weld'      : whether the vertexes of the mesh are welded
+	// result           : false if the triangles in the file are not the same ones or the buffers are compressed ,
+	//					  the mesh is not touched then
+	// note             : only the positions , normals , tangents and texture coordinates are replaced , instances of
+	//					  the mesh share them
+	bool ReloadVertices( const string& str , TriMesh* mesh , const Transform& transform , bool weld );
+
+	// release the geometry data , the model files are loaded again afterward
+	// note        : meshes loaded already keep their own geometry data
+	void Release();
+
 // private field
 private:
 	// the mesh loaders
@@ -167,6 +269,8 @@ private:
 
 	// the memory for meshes
     unordered_map< string , std::shared_ptr<BufferMemory> > m_Buffers;
+	// the mutex guarding the memory for meshes , models could be loaded concurrently
+	std::mutex	m_BuffersMutex;
 
 // private method
 private:
@@ -176,5 +280,17 @@ private:
 	// get the mesh loader
 	std::shared_ptr<MeshLoader>	_getMeshLoader( MESH_TYPE type ) const;
 
+	// read the buffers of a mesh from its file , the buffers are transformed and completed but not registered
+	// para 'str'  : the full name of the file
+	// para 'mesh' : the triangle mesh , it becomes the prototype of the buffers
+	// para 'mem'  : the buffers of the mesh ( output )
+	bool	_readMesh( const string& str , TriMesh* mesh , std::shared_ptr<BufferMemory>& mem );
+
+	// load a mesh handed over in memory , its arrays are read in place if the mesh is not transformed
+	// para 'str'  : the name of the mesh
+	// para 'mesh' : the triangle mesh
+	// para 'mem'  : the buffers of the mesh ( output )
+	bool	_loadMemoryMesh( const string& str , TriMesh* mesh , std::shared_ptr<BufferMemory>& mem );
+
 	friend class Singleton<MeshManager>;
 };
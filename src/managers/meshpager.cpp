@@ -0,0 +1,203 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header file
+#include "meshpager.h"
+#include "meshmanager.h"
+#include "log/log.h"
+#include <algorithm>
+
+// seek in the page file , it could be larger than 2GB
+static bool _seek( FILE* file , long long offset )
+{
+#if defined(SORT_IN_WINDOWS)
+	return _fseeki64( file , offset , SEEK_SET ) == 0;
+#else
+	return fseeko( file , (off_t)offset , SEEK_SET ) == 0;
+#endif
+}
+
+// write a buffer to the page file
+template< class T >
+static bool _writeBuffer( FILE* file , const MeshBuffer<T>& buffer )
+{
+	return buffer.empty() || fwrite( buffer.data() , sizeof( T ) , buffer.size() , file ) == buffer.size();
+}
+
+// read a buffer back from the page file
+template< class T >
+static bool _readBuffer( FILE* file , MeshBuffer<T>& buffer , size_t count )
+{
+	buffer.resize( count );
+	return count == 0 || fread( buffer.data() , sizeof( T ) , count , file ) == count;
+}
+
+// read the buffers of a page back from the page file
+// note : the buffers have the size of the page even if reading fails , so that the indexes of triangles stay valid
+static bool _readPage( FILE* file , const MeshPage* page )
+{
+	BufferMemory* mem = page->mem;
+	const bool seek = _seek( file , page->offset );
+	const bool normals = _readBuffer( file , mem->m_NormalBuffer , page->counts[0] ) && seek;
+	const bool tangents = _readBuffer( file , mem->m_TangentBuffer , page->counts[1] ) && normals;
+	const bool texcoords = _readBuffer( file , mem->m_TexCoordBuffer , page->counts[2] ) && tangents;
+	const bool octNormals = _readBuffer( file , mem->m_OctNormalBuffer , page->counts[3] ) && texcoords;
+	return _readBuffer( file , mem->m_OctTangentBuffer , page->counts[4] ) && octNormals;
+}
+
+// destructor
+MeshPager::~MeshPager()
+{
+	Release();
+}
+
+// move the shading buffers of a mesh into the page file
+bool MeshPager::AddPage( BufferMemory* mem )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	if( mem->m_page )
+		return true;
+
+	if( m_file == nullptr )
+	{
+		m_file = tmpfile();
+		if( m_file == nullptr )
+		{
+			slog( WARNING , GENERAL , "Failed to create the page file of meshes, they are kept in memory." );
+			return false;
+		}
+	}
+
+	// the counts of the buffers are kept in the memory , they are used to read the buffers back
+	if( !_seek( m_file , m_fileSize ) || !_writeBuffer( m_file , mem->m_NormalBuffer ) || !_writeBuffer( m_file , mem->m_TangentBuffer ) ||
+		!_writeBuffer( m_file , mem->m_TexCoordBuffer ) || !_writeBuffer( m_file , mem->m_OctNormalBuffer ) ||
+		!_writeBuffer( m_file , mem->m_OctTangentBuffer ) || fflush( m_file ) != 0 )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Failed to write the buffers of mesh %s into the page file, they are kept in memory." , mem->m_filename.c_str() ) );
+		return false;
+	}
+
+	std::unique_ptr<MeshPage> page( new MeshPage() );
+	page->pager = this;
+	page->mem = mem;
+	page->offset = m_fileSize;
+	page->counts[0] = mem->m_NormalBuffer.size();
+	page->counts[1] = mem->m_TangentBuffer.size();
+	page->counts[2] = mem->m_TexCoordBuffer.size();
+	page->counts[3] = mem->m_OctNormalBuffer.size();
+	page->counts[4] = mem->m_OctTangentBuffer.size();
+	page->bytes = sizeof( Vector ) * ( page->counts[0] + page->counts[1] ) + sizeof( float ) * page->counts[2] + sizeof( unsigned ) * ( page->counts[3] + page->counts[4] );
+	m_fileSize += (long long)page->bytes;
+	m_resident += page->bytes;
+	mem->m_page = page.get();
+	m_pages.push_back( std::move( page ) );
+	return true;
+}
+
+// evict the least recently used pages
+void MeshPager::Trim()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	_trim( nullptr );
+}
+
+// read the buffers of a page back from the page file
+void MeshPager::_pageIn( MeshPage* page )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	// another thread could have paged it in already
+	if( page->resident.load() )
+		return;
+
+	if( !_readPage( m_file , page ) )
+		slog( CRITICAL , GENERAL , stringFormat( "Failed to read the buffers of mesh %s from the page file." , page->mem->m_filename.c_str() ) );
+	page->mem->UpdateMemoryUsage();
+	m_resident += page->bytes;
+	m_clock.fetch_add( 1 );
+	page->stamp.store( m_clock.load() );
+	page->resident.store( true );
+
+	// the page being paged in is pinned , other pages make room for it
+	_trim( page );
+}
+
+// evict the least recently used pages until the budget is met
+void MeshPager::_trim( const MeshPage* keep )
+{
+	std::vector<MeshPage*> candidates;
+	for( auto& page : m_pages )
+	{
+		if( page.get() != keep && page->resident.load() )
+			candidates.push_back( page.get() );
+	}
+	std::sort( candidates.begin() , candidates.end() , []( const MeshPage* a , const MeshPage* b ){ return a->stamp.load() < b->stamp.load(); } );
+
+	for( auto page : candidates )
+	{
+		if( m_resident <= m_budget )
+			break;
+		_evictPage( page );
+	}
+}
+
+// free the buffers of a page unless it is pinned
+bool MeshPager::_evictPage( MeshPage* page )
+{
+	// a thread pins the page before it checks the residence , while the residence is cleared here before checking
+	// the pins , so either the pin is seen here or the thread sees the page not resident and waits for the lock
+	page->resident.store( false );
+	if( page->pins.load() != 0 )
+	{
+		page->resident.store( true );
+		return false;
+	}
+
+	BufferMemory* mem = page->mem;
+	MeshBuffer<Vector>().swap( mem->m_NormalBuffer );
+	MeshBuffer<Vector>().swap( mem->m_TangentBuffer );
+	MeshBuffer<float>().swap( mem->m_TexCoordBuffer );
+	MeshBuffer<unsigned>().swap( mem->m_OctNormalBuffer );
+	MeshBuffer<unsigned>().swap( mem->m_OctTangentBuffer );
+	mem->UpdateMemoryUsage();
+	m_resident -= page->bytes;
+	++m_evictions;
+	return true;
+}
+
+// output log information
+void MeshPager::OutputLog() const
+{
+	if( m_pages.empty() )
+		return;
+	slog( INFO , PERFORMANCE , stringFormat( "Shading buffers of %d meshes take %.2f MB in the page file, %.2f MB are resident with a budget of %.2f MB. They are paged in %d times and evicted %d times." ,
+		(int)m_pages.size() , m_fileSize / 1048576.0f , m_resident / 1048576.0f , m_budget / 1048576.0f , (int)m_clock.load() , (int)m_evictions ) );
+}
+
+// remove all pages
+void MeshPager::Release()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	for( auto& page : m_pages )
+		page->mem->m_page = nullptr;
+	m_pages.clear();
+	m_resident = 0;
+	m_fileSize = 0;
+	if( m_file )
+		fclose( m_file );
+	m_file = nullptr;
+}
@@ -0,0 +1,151 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+// include the headers
+#include "sort.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdio.h>
+
+// pre-declera class
+class BufferMemory;
+class MeshPager;
+
+// the shading buffers of a mesh that could be paged out of memory
+struct MeshPage
+{
+	// the pager owning the page
+	MeshPager*		pager = nullptr;
+	// the mesh memory holding the buffers
+	BufferMemory*	mem = nullptr;
+	// the offset of the buffers in the page file
+	long long		offset = 0;
+	// the number of elements in the normal , tangent and texture coordinate buffers , followed by the compressed
+	// normal and tangent buffers
+	size_t			counts[5] = { 0 , 0 , 0 , 0 , 0 };
+	// the size of the buffers in bytes
+	size_t			bytes = 0;
+	// the number of hits being resolved with the buffers
+	std::atomic<int>				pins{ 0 };
+	// whether the buffers are in memory
+	std::atomic<bool>				resident{ true };
+	// the last time the page is used , it is measured in page-ins of the pager
+	std::atomic<unsigned long long>	stamp{ 0 };
+};
+
+/////////////////////////////////////////////////////////////////////////
+//	definition of mesh pager
+//	desc :	Scenes larger than the memory of a machine are rendered with
+//			their shading buffers paged out. Normals , tangents and texture
+//			coordinates are only read once the closest hit of a ray is found,
+//			the traversal reads positions and the precomputed packets of the
+//			accelerators , so those stay in memory. The shading buffers of each
+//			mesh are written to a temporary page file after preprocessing and
+//			freed , a hit on the mesh pages them in again. Buffers not used
+//			recently are evicted whenever the resident pages exceed the budget.
+class	MeshPager
+{
+// public method
+public:
+	// destructor
+	~MeshPager();
+
+	// set the budget
+	// para 'bytes' : the maximum size of resident shading buffers , zero disables paging
+	void	SetBudget( size_t bytes ) { m_budget = bytes; }
+
+	// whether paging is enabled
+	bool	IsEnabled() const { return m_budget > 0; }
+
+	// move the shading buffers of a mesh into the page file
+	// para 'mem' : the memory of the mesh , its buffers stay in memory until the budget is exceeded
+	// result     : 'false' if the page file can't be written , the buffers are never paged out then
+	bool	AddPage( BufferMemory* mem );
+
+	// evict the least recently used pages until the resident pages fit in the budget
+	void	Trim();
+
+	// make sure the buffers of a page are in memory until the page is unpinned
+	// para 'page' : the page to be pinned
+	// note        : it is thread-safe , the lock is only taken if the page is not resident
+	void	Pin( MeshPage* page )
+	{
+		// the order of pinning and checking the residence matters , see '_evictPage'
+		page->pins.fetch_add( 1 );
+		page->stamp.store( m_clock.load( std::memory_order_relaxed ) , std::memory_order_relaxed );
+		if( !page->resident.load() )
+			_pageIn( page );
+	}
+
+	// allow the buffers of a page to be evicted again
+	// para 'page' : the pinned page
+	void	Unpin( MeshPage* page ) { page->pins.fetch_sub( 1 ); }
+
+	// output log information
+	void	OutputLog() const;
+
+	// remove all pages
+	// note : evicted buffers are not read back , the meshes are expected to be released afterward
+	void	Release();
+
+// private field
+private:
+	// the maximum size of resident buffers
+	size_t		m_budget = 0;
+	// the size of resident buffers
+	size_t		m_resident = 0;
+	// the pages
+	std::vector<std::unique_ptr<MeshPage>>	m_pages;
+	// the page file , it is deleted automatically once it is closed
+	FILE*		m_file = nullptr;
+	// the size of the page file
+	long long	m_fileSize = 0;
+	// the mutex guarding paging
+	std::mutex	m_mutex;
+	// the number of page-ins , it is the clock of the recency of pages
+	std::atomic<unsigned long long>	m_clock{ 0 };
+	// the number of evictions
+	unsigned long long	m_evictions = 0;
+
+// private method
+private:
+	// read the buffers of a page back from the page file and make room for them
+	void	_pageIn( MeshPage* page );
+	// evict the least recently used pages until the budget is met
+	// para 'keep' : the page that is not evicted
+	void	_trim( const MeshPage* keep );
+	// free the buffers of a page unless it is pinned
+	// result : 'true' if the page is evicted
+	bool	_evictPage( MeshPage* page );
+};
+
+// the buffers of a page are kept in memory during the lifetime of the scope
+class	MeshPageScope
+{
+public:
+	// pin the page , nothing happens if the mesh is not paged
+	MeshPageScope( MeshPage* page ) : m_page(page) { if( m_page ) m_page->pager->Pin( m_page ); }
+	// unpin the page
+	~MeshPageScope() { if( m_page ) m_page->pager->Unpin( m_page ); }
+
+private:
+	MeshPage*	m_page;
+};
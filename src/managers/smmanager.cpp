@@ -16,6 +16,42 @@
  */
 
 #include "smmanager.h"
+#include "accel/accelcache.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string.h>
+
+static const char SCENE_DATA_MAGIC[4] = { 'S' , 'S' , 'H' , 'M' };
+static const unsigned SCENE_DATA_VERSION = 1;
+
+// the header takes the first page of a segment , the data after it is mapped read-only
+static const size_t SCENE_DATA_OFFSET = 4096;
+
+// the longest time to wait for another process filling a segment
+static const int SCENE_DATA_TIMEOUT = 60000;
+
+// header of a segment of scene data
+struct SceneDataHeader
+{
+	char				magic[4];
+	unsigned			version;
+	unsigned long long	size;		// size of the data in bytes
+	std::atomic<int>	ready;		// one once the creator filled the data , negative if it gave up
+	std::atomic<int>	users;		// the number of processes mapping the segment
+};
+
+// name of the segment of some scene data
+static string _segmentName( unsigned long long key )
+{
+#if defined(SORT_IN_WINDOWS)
+	return stringFormat( "Local\\sort.%016llx" , key );
+#else
+	return stringFormat( "/sort.%016llx" , key );
+#endif
+}
 
 SMManager::SMManager()
 {
@@ -33,6 +69,16 @@ SMManager::~SMManager()
 		// restart from the first one
 		it = m_SharedMemory.begin();
 	}
+
+	// the last process mapping a segment of scene data removes its name
+	for( auto& segment : m_SceneData )
+	{
+		SceneDataHeader* header = (SceneDataHeader*)segment.second.sharedmemory.bytes;
+		if( header->users.fetch_sub( 1 ) == 1 )
+			segment.second.UnlinkSharedMemory();
+		segment.second.ReleaseSharedMemory();
+	}
+	m_SceneData.clear();
 }
 
 // Initialize shared memory
@@ -85,3 +131,138 @@ SharedMemory SMManager::GetSharedMemory(const string& sm_name)
 
 	return SharedMemory();
 }
+
+// map the memory blender wrote data into
+SharedMemory SMManager::OpenReadOnlySharedMemory(const string& sm_name)
+{
+	// the memory of the same name could be written again since it was mapped last time
+	ReleaseSharedMemory(sm_name);
+
+	PlatformSharedMemory sm;
+	if (!sm.OpenReadOnlySharedMemory(sm_name))
+		return SharedMemory();
+
+	m_SharedMemory.insert(make_pair(sm_name, sm));
+	return sm.sharedmemory;
+}
+
+// map the scene data published by another process
+const char* SMManager::OpenSceneData( unsigned long long key , size_t& size )
+{
+	std::lock_guard<std::mutex> lock( m_SceneMutex );
+	bool found = false;
+	return _openSceneData( key , size , found );
+}
+
+// map an existing segment of scene data
+const char* SMManager::_openSceneData( unsigned long long key , size_t& size , bool& found )
+{
+	// the segment could be mapped by this process already
+	auto it = m_SceneData.find( key );
+	found = it != m_SceneData.end();
+	if( found )
+	{
+		size = (size_t)( (const SceneDataHeader*)it->second.sharedmemory.bytes )->size;
+		return it->second.sharedmemory.bytes + SCENE_DATA_OFFSET;
+	}
+
+	PlatformSharedMemory sm;
+	const string name = _segmentName( key );
+	found = sm.OpenNamedSharedMemory( name );
+	if( !found )
+		return nullptr;
+
+	SceneDataHeader* header = (SceneDataHeader*)sm.sharedmemory.bytes;
+	bool valid = sm.sharedmemory.size >= SCENE_DATA_OFFSET && memcmp( header->magic , SCENE_DATA_MAGIC , sizeof( SCENE_DATA_MAGIC ) ) == 0 &&
+				 header->version == SCENE_DATA_VERSION && header->size <= sm.sharedmemory.size - SCENE_DATA_OFFSET;
+	if( valid )
+	{
+		// the creator is still filling the segment , it takes no longer than reading the data
+		header->users.fetch_add( 1 );
+		int waited = 0;
+		while( header->ready.load() == 0 && waited++ < SCENE_DATA_TIMEOUT )
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		valid = header->ready.load() > 0;
+		if( !valid && header->users.fetch_sub( 1 ) == 1 )
+			sm.UnlinkSharedMemory();
+	}
+	if( !valid )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Shared memory %s is ignored, it is not filled or not scene data of the current version." , name.c_str() ) );
+		sm.ReleaseSharedMemory();
+		return nullptr;
+	}
+
+	sm.ProtectSharedMemory( SCENE_DATA_OFFSET );
+	size = (size_t)header->size;
+	m_SceneBytes += size;
+	m_SceneData.emplace( key , sm );
+	return sm.sharedmemory.bytes + SCENE_DATA_OFFSET;
+}
+
+// publish scene data for other processes
+const char* SMManager::PublishSceneData( unsigned long long key , size_t size , const std::function<bool(char*)>& fill )
+{
+	std::lock_guard<std::mutex> lock( m_SceneMutex );
+
+	// another process could publish the data right between opening and creating the segment , it is opened again then
+	PlatformSharedMemory sm;
+	const string name = _segmentName( key );
+	for( int attempt = 0 ; attempt < 2 ; ++attempt )
+	{
+		size_t existing = 0;
+		bool found = false;
+		const char* data = _openSceneData( key , existing , found );
+		if( found )
+			return ( data && existing == size ) ? data : nullptr;
+		if( sm.CreateNamedSharedMemory( name , SCENE_DATA_OFFSET + size ) )
+			break;
+	}
+	if( sm.sharedmemory.bytes == nullptr )
+		return nullptr;
+
+	SceneDataHeader* header = new ( sm.sharedmemory.bytes ) SceneDataHeader();
+	memcpy( header->magic , SCENE_DATA_MAGIC , sizeof( SCENE_DATA_MAGIC ) );
+	header->version = SCENE_DATA_VERSION;
+	header->size = size;
+	header->users.store( 1 );
+	header->ready.store( 0 );
+
+	// processes waiting for the data give up at once if it can't be filled
+	if( !fill( sm.sharedmemory.bytes + SCENE_DATA_OFFSET ) )
+	{
+		header->ready.store( -1 );
+		sm.UnlinkSharedMemory();
+		sm.ReleaseSharedMemory();
+		return nullptr;
+	}
+	header->ready.store( 1 );
+
+	sm.ProtectSharedMemory( SCENE_DATA_OFFSET );
+	m_SceneBytes += size;
+	m_PublishedBytes += size;
+	m_SceneData.emplace( key , sm );
+	return sm.sharedmemory.bytes + SCENE_DATA_OFFSET;
+}
+
+// share a block of data identified by its content
+const void* SMManager::ShareSceneData( const void* data , size_t size )
+{
+	// the hash only tells the content apart most likely , the shared copy is compared with the data
+	const unsigned long long key = AccelCache::Hash( data , size ) ^ ( (unsigned long long)size * 0x9e3779b97f4a7c15ULL );
+	const char* shared = PublishSceneData( key , size , [&]( char* dst ){
+		memcpy( dst , data , size );
+		return true;
+	});
+	return ( shared && memcmp( shared , data , size ) == 0 ) ? shared : nullptr;
+}
+
+// output log information
+void SMManager::OutputLog() const
+{
+	std::lock_guard<std::mutex> lock( m_SceneMutex );
+	if( !m_SceneSharing )
+		return;
+	slog( INFO , PERFORMANCE , stringFormat( "%.2f MB of scene data in %d segments are shared with other processes, %.2f MB of them are published by this process." ,
+		m_SceneBytes / 1048576.0f , (int)m_SceneData.size() , m_PublishedBytes / 1048576.0f ) );
+}
@@ -19,10 +19,20 @@
 
 #include "utility/singleton.h"
 #include <unordered_map>
+#include <functional>
+#include <mutex>
 #include "platform/sharedmemory/sharedmemory.h"
 
 /////////////////////////////////////////////////////////////
 // definition of shared memory manager
+// desc :	Besides the memory shared with blender , several processes
+//			rendering the same scene on one host could share their scene
+//			data. Each block of data lives in a segment named after a key
+//			identifying it , the first process loading it creates and fills
+//			the segment while the later ones map it read-only instead of
+//			keeping their own copies. The name of a segment is removed once
+//			the last process mapping it exits , segments of crashed processes
+//			are left behind until the host restarts.
 class	SMManager : public Singleton<SMManager>
 {
 public:
@@ -38,10 +48,56 @@ public:
 	// Get Shared Memory
 	SharedMemory GetSharedMemory(const string& sm_name);
 
+	// map the memory blender wrote data into for this process , it is read-only and released like the other shared memory
+	// para 'sm_name' : the name of the mapping on Windows , the file backing it on the other platforms
+	SharedMemory OpenReadOnlySharedMemory(const string& sm_name);
+
+	// enable sharing the scene data with other processes on the host
+	void SetSceneSharing( bool enabled ) { m_SceneSharing = enabled; }
+
+	// whether the scene data is shared with other processes
+	bool IsSceneSharing() const { return m_SceneSharing; }
+
+	// map the scene data published by another process
+	// para 'key'  : the identity of the data
+	// para 'size' : the size of the data in bytes
+	// result      : the read-only data , it is nullptr if no process published it
+	const char* OpenSceneData( unsigned long long key , size_t& size );
+
+	// publish scene data for other processes , the data published by another process first is mapped instead
+	// para 'key'  : the identity of the data
+	// para 'size' : the size of the data in bytes
+	// para 'fill' : writes the data into the segment , it is only called if this process creates the segment
+	// result      : the read-only data , it is nullptr if it can't be shared
+	const char* PublishSceneData( unsigned long long key , size_t size , const std::function<bool(char*)>& fill );
+
+	// share a block of data identified by its content
+	// para 'data' : the data
+	// para 'size' : the size of the data in bytes
+	// result      : the read-only copy of the data , it is nullptr if it can't be shared
+	const void* ShareSceneData( const void* data , size_t size );
+
+	// output log information
+	void OutputLog() const;
+
 private:
 	// the map for shared memory
 	std::unordered_map< string, PlatformSharedMemory > m_SharedMemory;
 
+	// whether the scene data is shared
+	bool	m_SceneSharing = false;
+	// the segments of scene data mapped by this process
+	std::unordered_map< unsigned long long , PlatformSharedMemory > m_SceneData;
+	// the size of the scene data mapped and created by this process
+	size_t	m_SceneBytes = 0;
+	size_t	m_PublishedBytes = 0;
+	// the mutex guarding the segments of scene data , data is loaded by many threads
+	mutable std::mutex	m_SceneMutex;
+
+	// map an existing segment of scene data , it waits for the creator to fill it
+	// para 'found' : whether there is a segment of the key , it could be left unfilled by a crashed process
+	const char* _openSceneData( unsigned long long key , size_t& size , bool& found );
+
 	// private constructor
 	SMManager();
 
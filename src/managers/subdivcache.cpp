@@ -0,0 +1,146 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include the header file
+#include "subdivcache.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "utility/statsreport.h"
+
+// tessellate a patch
+void SubdivCache::_tessellate( SubdivPatch* patch , unsigned level )
+{
+	// the tessellation is done outside the lock , other threads keep tracing meanwhile
+	std::unique_ptr<SubdivGeometry> geometry = patch->m_surface->Tessellate( patch->m_face , level );
+	const size_t bytes = geometry->Bytes();
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	// another thread could have tessellated it already
+	if( patch->m_resident.load() )
+	{
+		++m_discards;
+		return;
+	}
+
+	patch->m_geometry = std::move( geometry );
+	m_resident += bytes;
+	++m_residentPatches;
+	++m_tessellations;
+	patch->m_referenced.store( false );
+	_pushFront( patch );
+	patch->m_resident.store( true );
+
+	// the patch being tessellated is pinned , other patches make room for it
+	_trim( patch );
+	m_tracker.Set( m_resident );
+}
+
+// evict patches not used recently until the budget is met
+void SubdivCache::_trim( const SubdivPatch* keep )
+{
+	if( m_budget == 0 )
+		return;
+
+	// the list is walked from the tail like a clock , patches used since the last pass get a second chance
+	SubdivPatch* patch = m_tail;
+	for( unsigned i = 0 , count = m_residentPatches ; i < count && patch && m_resident > m_budget ; ++i )
+	{
+		SubdivPatch* prev = patch->m_prev;
+		if( patch == keep || patch->m_referenced.exchange( false ) || !_evictPatch( patch ) )
+		{
+			_unlink( patch );
+			_pushFront( patch );
+		}
+		patch = prev;
+	}
+}
+
+// free the tessellation of a patch unless it is pinned
+bool SubdivCache::_evictPatch( SubdivPatch* patch )
+{
+	// a thread pins the patch before it checks the residence , while the residence is cleared here before checking
+	// the pins , so either the pin is seen here or the thread sees the patch not resident and tessellates it again
+	patch->m_resident.store( false );
+	if( patch->m_pins.load() != 0 )
+	{
+		patch->m_resident.store( true );
+		return false;
+	}
+
+	m_resident -= patch->m_geometry->Bytes();
+	patch->m_geometry.reset();
+	_unlink( patch );
+	--m_residentPatches;
+	++m_evictions;
+	return true;
+}
+
+// unlink a patch from the list of resident patches
+void SubdivCache::_unlink( SubdivPatch* patch )
+{
+	if( patch->m_prev )
+		patch->m_prev->m_next = patch->m_next;
+	else
+		m_head = patch->m_next;
+	if( patch->m_next )
+		patch->m_next->m_prev = patch->m_prev;
+	else
+		m_tail = patch->m_prev;
+	patch->m_prev = patch->m_next = nullptr;
+}
+
+// link a patch as the head of the list of resident patches
+void SubdivCache::_pushFront( SubdivPatch* patch )
+{
+	patch->m_prev = nullptr;
+	patch->m_next = m_head;
+	if( m_head )
+		m_head->m_prev = patch;
+	else
+		m_tail = patch;
+	m_head = patch;
+}
+
+// forget all patches
+void SubdivCache::Release()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_head = m_tail = nullptr;
+	m_residentPatches = 0;
+	m_patches = 0;
+	m_resident = 0;
+	m_tessellations = m_discards = m_evictions = 0;
+	m_tracker.Set( 0 );
+}
+
+// output log information
+void SubdivCache::OutputLog() const
+{
+	if( m_patches == 0 )
+		return;
+	slog( INFO , PERFORMANCE , stringFormat( "%d subdivision patches are tessellated %d times, %.2f MB are resident with a budget of %.2f MB. They are evicted %d times and %d tessellations are discarded." ,
+		(int)m_patches , (int)m_tessellations , m_resident / 1048576.0f , m_budget / 1048576.0f , (int)m_evictions , (int)m_discards ) );
+}
+
+// add the usage of the cache to the report
+void SubdivCache::CollectStats( StatsGroup& stats ) const
+{
+	stats.Add( "patches" , m_patches ).Add( "resident_bytes" , (unsigned long long)m_resident ).Add( "budget_bytes" , (unsigned long long)m_budget )
+		 .Add( "tessellations" , (unsigned long long)m_tessellations ).Add( "discards" , (unsigned long long)m_discards ).Add( "evictions" , (unsigned long long)m_evictions );
+}
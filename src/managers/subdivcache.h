@@ -0,0 +1,119 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+// include the headers
+#include "sort.h"
+#include "geometry/subdivision.h"
+#include "utility/memstats.h"
+#include <mutex>
+#include <atomic>
+
+class StatsGroup;
+
+/////////////////////////////////////////////////////////////////////////
+//	definition of subdivision cache
+//	desc :	Subdivided meshes only keep their control cages , the patches
+//			are tessellated once a ray reaches them. The tessellations are
+//			kept for later rays , those not used recently are evicted whenever
+//			the resident ones exceed the budget and tessellated again on the
+//			next hit. Patches are tessellated without holding the lock , two
+//			threads reaching the same patch could both tessellate it , only
+//			the first one is kept.
+class	SubdivCache
+{
+// public method
+public:
+	// set the budget
+	// para 'bytes' : the maximum size of resident tessellations , zero keeps all of them once they are tessellated
+	// note         : pinned patches are never evicted , they could exceed the budget a little
+	void	SetBudget( size_t bytes ) { m_budget = bytes; }
+
+	// make sure a patch is tessellated until it is unpinned
+	// para 'patch' : the patch to be pinned
+	// para 'level' : the level it is tessellated to if it is not resident , a resident patch keeps its level
+	// note         : it is thread-safe , the lock is only taken if the patch is not resident
+	void	Pin( SubdivPatch* patch , unsigned level )
+	{
+		// the order of pinning and checking the residence matters , see '_evictPatch'
+		patch->m_pins.fetch_add( 1 );
+		if( !patch->m_resident.load() )
+			_tessellate( patch , level );
+	}
+
+	// allow a patch to be evicted again
+	// para 'patch' : the pinned patch
+	void	Unpin( SubdivPatch* patch )
+	{
+		patch->m_referenced.store( true , std::memory_order_relaxed );
+		patch->m_pins.fetch_sub( 1 );
+	}
+
+	// add the patches of a surface
+	// para 'count' : the number of patches
+	void	AddPatches( unsigned count ) { m_patches += count; }
+
+	// forget all patches
+	// note : the tessellations belong to the patches , they are released with the meshes afterward
+	void	Release();
+
+	// output log information
+	void	OutputLog() const;
+
+	// add the usage of the cache to a group of the statistics report
+	// para 'stats' : the group of the subdivision surfaces
+	void	CollectStats( StatsGroup& stats ) const;
+
+// private field
+private:
+	// the maximum size of resident tessellations
+	size_t		m_budget = (size_t)256 << 20;
+	// the size of resident tessellations
+	size_t		m_resident = 0;
+	// the number of patches
+	unsigned	m_patches = 0;
+	// the list of resident patches , the most recently tessellated patch is the head
+	SubdivPatch*	m_head = nullptr;
+	SubdivPatch*	m_tail = nullptr;
+	// the number of resident patches
+	unsigned	m_residentPatches = 0;
+	// the mutex guarding the list
+	std::mutex	m_mutex;
+	// the number of tessellations kept , discarded and evicted
+	unsigned long long	m_tessellations = 0;
+	unsigned long long	m_discards = 0;
+	unsigned long long	m_evictions = 0;
+	// the memory of resident tessellations
+	MemoryTracker	m_tracker{ MEM_SUBDIV };
+
+// private method
+private:
+	// tessellate a patch and make room for it
+	void	_tessellate( SubdivPatch* patch , unsigned level );
+	// evict patches not used recently until the budget is met
+	// para 'keep' : the patch that is not evicted
+	void	_trim( const SubdivPatch* keep );
+	// free the tessellation of a patch unless it is pinned
+	// result : 'true' if the patch is evicted
+	bool	_evictPatch( SubdivPatch* patch );
+	// unlink a patch from the list of resident patches
+	void	_unlink( SubdivPatch* patch );
+	// link a patch as the head of the list of resident patches
+	void	_pushFront( SubdivPatch* patch );
+};
@@ -0,0 +1,762 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header file
+#include "texcache.h"
+#include "texmanager.h"
+#include "log/log.h"
+#include "utility/define.h"
+#include "utility/strhelper.h"
+#include "utility/statsreport.h"
+#include "utility/multithread/threadpool.h"
+#include "managers/smmanager.h"
+#include "accel/accelcache.h"
+#include "texio/blockcodec.h"
+#include <sys/stat.h>
+#include <half.h>
+#include <string.h>
+
+// integer simd instructions decode the texels of 8-bit channels
+#if defined(SORT_SIMD_SSE) && ( defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) )
+	#define TEX_SIMD_DECODE
+	#include <emmintrin.h>
+#endif
+
+// version of the tile file layout , files of other versions are converted again
+static const unsigned TEX_CACHE_VERSION = 2;
+static const char TEX_CACHE_MAGIC[4] = { 'S' , 'T' , 'E' , 'X' };
+
+// the tiles are stored after the header at an aligned offset
+static const size_t TEX_CACHE_ALIGNMENT = 64;
+
+// the number of texels in a tile , tiles on the border of a level are padded to the full size
+static const size_t TEX_TILE_TEXELS = TEX_TILE_SIZE * TEX_TILE_SIZE;
+
+// the number of blocks in both dimensions of a tile of a block-compressed image , they are stored row by row
+static const unsigned TEX_TILE_BLOCKS = TEX_TILE_SIZE / TEX_BLOCK_SIZE;
+
+// the number of blocks every thread keeps decoded , it has to be four for the blocks of a bilinear lookup to be kept together
+#define TEX_DECODED_BLOCKS	4
+
+// header of the tile file , the tiles of all levels follow it , level by level and row by row
+struct TexCacheHeader
+{
+	char				magic[4];
+	unsigned			version;
+	unsigned			elementSize;		// size of a texel in bytes , or of a block for block-compressed formats
+	unsigned			tileSize;			// number of texels in both dimensions of a tile
+	long long			sourceTime;			// modification time of the image file
+	unsigned long long	sourceSize;			// size of the image file
+	unsigned			width;
+	unsigned			height;
+	float				average[3];			// the average color of the image
+	unsigned			format;				// the format of the texels
+};
+
+static const size_t TEX_CACHE_PAYLOAD = ( sizeof( TexCacheHeader ) + TEX_CACHE_ALIGNMENT - 1 ) & ~( TEX_CACHE_ALIGNMENT - 1 );
+
+// the tiles pinned by each thread , a thread only switches its hint if it looks up another tile of the images sharing it
+static Thread_Local TexTile* g_hints[TEX_TILE_HINTS];
+
+// a block decoded by a thread , the tiles of an image are never changed so the block is found again by its position alone
+struct DecodedBlock
+{
+	const TiledImage*	image;
+	unsigned			tile;
+	unsigned			block;
+	// the texels row by row , four bytes each
+	unsigned			texels[16];
+};
+
+// the blocks decoded by each thread , neighbouring blocks go to different entries
+static Thread_Local DecodedBlock g_blocks[TEX_DECODED_BLOCKS];
+
+// the values of 8-bit channels
+static const struct ByteTable
+{
+	float value[256];
+	ByteTable()
+	{
+		// it matches the conversion of the image loaders
+		for( unsigned i = 0 ; i < 256 ; ++i )
+			value[i] = (float)i / 255.0f;
+	}
+} g_bytes;
+
+// the size of a texel in bytes , or of a block of texels for block-compressed formats
+static unsigned _texelBytes( TEX_FORMAT format )
+{
+	switch( format )
+	{
+	case TF_BC1:
+	case TF_BC4:
+	case TF_BC5:
+	case TF_BC7:
+		return BlockBytes( format );
+	case TF_RGB16F:
+		return 3 * sizeof( half );
+	case TF_RGBA8:
+		return 4;
+	case TF_RG8:
+		return 2;
+	case TF_R8:
+		return 1;
+	default:
+		return 3 * sizeof( float );
+	}
+}
+
+// the size of a tile in bytes
+static size_t _tileBytes( TEX_FORMAT format )
+{
+	return IsBlockFormat( format ) ? _texelBytes( format ) * TEX_TILE_BLOCKS * TEX_TILE_BLOCKS : _texelBytes( format ) * TEX_TILE_TEXELS;
+}
+
+// quantize a channel to eight bits
+static inline unsigned char _toByte( float v )
+{
+	return (unsigned char)( saturate( v ) * 255.0f + 0.5f );
+}
+
+// decode a texel
+// para 'format' : the format of the texel
+// para 'src'    : the memory of the texel
+// result        : the color of the texel
+static inline Spectrum _decode( TEX_FORMAT format , const unsigned char* src )
+{
+	switch( format )
+	{
+	case TF_RGB16F:
+	{
+		unsigned short bits[3];
+		memcpy( bits , src , sizeof( bits ) );
+		half r , g , b;
+		r.setBits( bits[0] );
+		g.setBits( bits[1] );
+		b.setBits( bits[2] );
+		return Spectrum( (float)r , (float)g , (float)b );
+	}
+	case TF_RGBA8:
+		return Spectrum( g_bytes.value[src[0]] , g_bytes.value[src[1]] , g_bytes.value[src[2]] );
+	case TF_RG8:
+		return Spectrum( g_bytes.value[src[0]] , g_bytes.value[src[1]] , 0.0f );
+	case TF_R8:
+		return Spectrum( g_bytes.value[src[0]] );
+	default:
+	{
+		float rgb[3];
+		memcpy( rgb , src , sizeof( rgb ) );
+		return Spectrum( rgb[0] , rgb[1] , rgb[2] );
+	}
+	}
+}
+
+// encode a texel
+// para 'format' : the format of the texel
+// para 'c'      : the color of the texel
+// para 'dst'    : the memory of the texel
+static void _encode( TEX_FORMAT format , const Spectrum& c , unsigned char* dst )
+{
+	switch( format )
+	{
+	case TF_RGB16F:
+	{
+		const unsigned short bits[3] = { half( c.GetR() ).bits() , half( c.GetG() ).bits() , half( c.GetB() ).bits() };
+		memcpy( dst , bits , sizeof( bits ) );
+		break;
+	}
+	case TF_RGBA8:
+		dst[0] = _toByte( c.GetR() );
+		dst[1] = _toByte( c.GetG() );
+		dst[2] = _toByte( c.GetB() );
+		dst[3] = 255;
+		break;
+	case TF_RG8:
+		dst[0] = _toByte( c.GetR() );
+		dst[1] = _toByte( c.GetG() );
+		break;
+	case TF_R8:
+		dst[0] = _toByte( c.GetR() );
+		break;
+	default:
+	{
+		const float rgb[3] = { c.GetR() , c.GetG() , c.GetB() };
+		memcpy( dst , rgb , sizeof( rgb ) );
+		break;
+	}
+	}
+}
+
+// whether a texel is kept exactly by a format
+static inline bool _isExact( TEX_FORMAT format , const Spectrum& c )
+{
+	unsigned char texel[3 * sizeof( float )];
+	_encode( format , c , texel );
+	const Spectrum d = _decode( format , texel );
+	return d.GetR() == c.GetR() && d.GetG() == c.GetG() && d.GetB() == c.GetB();
+}
+
+// pick the smallest format keeping the full resolution image exactly
+// para 'mem' : the decoded image
+// result     : the format of the tiles
+static TEX_FORMAT _pickFormat( const ImgMemory& mem )
+{
+	// block-compressed images keep their blocks
+	if( IsBlockFormat( mem.m_format ) && !mem.m_blocks.empty() )
+		return mem.m_format;
+
+	// images of 8-bit channels start from one channel and widen it until every texel fits
+	TEX_FORMAT format = ( mem.m_format == TF_RGBA8 ) ? TF_R8 : mem.m_format;
+	const size_t count = (size_t)mem.m_iWidth * mem.m_iHeight;
+	for( size_t i = 0 ; i < count && format != TF_RGB32F ; ++i )
+	{
+		const Spectrum& c = mem.m_ImgMem[i];
+		while( format != TF_RGB32F && !_isExact( format , c ) )
+		{
+			if( format == TF_R8 )
+				format = TF_RG8;
+			else if( format == TF_RG8 )
+				format = TF_RGBA8;
+			else
+				format = TF_RGB32F;
+		}
+	}
+	return format;
+}
+
+#if defined(TEX_SIMD_DECODE)
+// decode a texel into the first three lanes of a register
+// para 'format' : the format of the texel
+// para 'src'    : the memory of the texel
+// result        : the color of the texel , the last lane is undefined
+static inline __m128 _decodeSimd( TEX_FORMAT format , const unsigned char* src )
+{
+	int bits;
+	switch( format )
+	{
+	case TF_RGBA8:
+		memcpy( &bits , src , sizeof( bits ) );
+		break;
+	case TF_RG8:
+		bits = src[0] | ( src[1] << 8 );
+		break;
+	case TF_R8:
+		return _mm_set1_ps( g_bytes.value[src[0]] );
+	default:
+	{
+		const Spectrum c = _decode( format , src );
+		return _mm_setr_ps( c.GetR() , c.GetG() , c.GetB() , 0.0f );
+	}
+	}
+
+	// the bytes are widened to four integers , dividing them matches the table exactly
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i v = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( bits ) , zero ) , zero );
+	return _mm_div_ps( _mm_cvtepi32_ps( v ) , _mm_set1_ps( 255.0f ) );
+}
+#endif
+
+// seek in the tile file , it could be larger than 2GB
+static bool _seek( FILE* file , long long offset )
+{
+#if defined(SORT_IN_WINDOWS)
+	return _fseeki64( file , offset , SEEK_SET ) == 0;
+#else
+	return fseeko( file , (off_t)offset , SEEK_SET ) == 0;
+#endif
+}
+
+// build the levels of an image , every level has half of the size of the previous one , rounded up
+// result : the number of tiles in all levels
+static unsigned _buildLevels( unsigned width , unsigned height , std::vector<TexLevel>& levels )
+{
+	unsigned tiles = 0;
+	levels.clear();
+	while( true )
+	{
+		TexLevel level;
+		level.width = width;
+		level.height = height;
+		level.tilesX = ( width + TEX_TILE_SIZE - 1 ) / TEX_TILE_SIZE;
+		level.tilesY = ( height + TEX_TILE_SIZE - 1 ) / TEX_TILE_SIZE;
+		level.firstTile = tiles;
+		tiles += level.tilesX * level.tilesY;
+		levels.push_back( level );
+
+		if( width == 1 && height == 1 )
+			break;
+		width = ( width + 1 ) / 2;
+		height = ( height + 1 ) / 2;
+	}
+	return tiles;
+}
+
+// write the tiles of a level of a block-compressed image , blocks outside of the level repeat its border
+// para 'blocks' : the blocks of the level if the image file has them , the others are encoded from the texels
+static bool _writeBlockLevel( FILE* file , TEX_FORMAT format , const Spectrum* texels , const unsigned char* blocks , unsigned width , unsigned height )
+{
+	const unsigned bytes = _texelBytes( format );
+	const unsigned blocksX = ( width + TEX_BLOCK_SIZE - 1 ) / TEX_BLOCK_SIZE;
+	const unsigned blocksY = ( height + TEX_BLOCK_SIZE - 1 ) / TEX_BLOCK_SIZE;
+	std::unique_ptr<unsigned char[]> tile( new unsigned char[ _tileBytes( format ) ] );
+	for( unsigned ty = 0 ; ty < blocksY ; ty += TEX_TILE_BLOCKS )
+		for( unsigned tx = 0 ; tx < blocksX ; tx += TEX_TILE_BLOCKS )
+		{
+			ParallelFor( 0 , TEX_TILE_BLOCKS , 4 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+				unsigned char encoded[16 * 4];
+				for( unsigned y = _start ; y < _end ; ++y )
+					for( unsigned x = 0 ; x < TEX_TILE_BLOCKS ; ++x )
+					{
+						const unsigned bx = min( tx + x , blocksX - 1 ) , by = min( ty + y , blocksY - 1 );
+						unsigned char* dst = tile.get() + ( y * TEX_TILE_BLOCKS + x ) * bytes;
+						if( blocks )
+						{
+							memcpy( dst , blocks + ( (size_t)by * blocksX + bx ) * bytes , bytes );
+							continue;
+						}
+						for( unsigned i = 0 ; i < 16 ; ++i )
+						{
+							const Spectrum& c = texels[ (size_t)min( by * TEX_BLOCK_SIZE + i / TEX_BLOCK_SIZE , height - 1 ) * width + min( bx * TEX_BLOCK_SIZE + i % TEX_BLOCK_SIZE , width - 1 ) ];
+							_encode( TF_RGBA8 , c , encoded + 4 * i );
+						}
+						EncodeBlock( format , encoded , dst );
+					}
+			});
+			if( fwrite( tile.get() , _tileBytes( format ) , 1 , file ) != 1 )
+				return false;
+		}
+	return true;
+}
+
+// write the tiles of a level , texels outside of the level repeat its border
+static bool _writeLevel( FILE* file , TEX_FORMAT format , const Spectrum* texels , unsigned width , unsigned height )
+{
+	const unsigned bytes = _texelBytes( format );
+	std::unique_ptr<unsigned char[]> tile( new unsigned char[ bytes * TEX_TILE_TEXELS ] );
+	for( unsigned ty = 0 ; ty < height ; ty += TEX_TILE_SIZE )
+		for( unsigned tx = 0 ; tx < width ; tx += TEX_TILE_SIZE )
+		{
+			for( unsigned y = 0 ; y < TEX_TILE_SIZE ; ++y )
+			{
+				const Spectrum* row = texels + (size_t)min( ty + y , height - 1 ) * width;
+				for( unsigned x = 0 ; x < TEX_TILE_SIZE ; ++x )
+					_encode( format , row[ min( tx + x , width - 1 ) ] , tile.get() + ( y * TEX_TILE_SIZE + x ) * bytes );
+			}
+			if( fwrite( tile.get() , bytes , TEX_TILE_TEXELS , file ) != TEX_TILE_TEXELS )
+				return false;
+		}
+	return true;
+}
+
+// filter a level down to the next one with a box filter , the last row or column is repeated for odd sizes
+static void _downsample( const Spectrum* src , unsigned width , unsigned height , std::vector<Spectrum>& dst )
+{
+	const unsigned w = ( width + 1 ) / 2;
+	const unsigned h = ( height + 1 ) / 2;
+	std::vector<Spectrum> next( (size_t)w * h );
+	ParallelFor( 0 , h , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned y = _start ; y < _end ; ++y )
+		{
+			const Spectrum* row0 = src + (size_t)( 2 * y ) * width;
+			const Spectrum* row1 = src + (size_t)min( 2 * y + 1 , height - 1 ) * width;
+			for( unsigned x = 0 ; x < w ; ++x )
+			{
+				const unsigned x0 = 2 * x;
+				const unsigned x1 = min( 2 * x + 1 , width - 1 );
+				next[ (size_t)y * w + x ] = ( row0[x0] + row0[x1] + row1[x0] + row1[x1] ) * 0.25f;
+			}
+		}
+	});
+	dst.swap( next );
+}
+
+// write the header and the tiles of an image
+// note : the header is written after the tiles , a conversion interrupted halfway is never taken as valid
+static bool _writeTiles( FILE* file , const TexCacheHeader& header , const ImgMemory& mem )
+{
+	TexCacheHeader empty;
+	memset( &empty , 0 , sizeof( empty ) );
+	static const char zeros[TEX_CACHE_PAYLOAD] = { 0 };
+	if( fwrite( zeros , 1 , TEX_CACHE_PAYLOAD , file ) != TEX_CACHE_PAYLOAD )
+		return false;
+
+	// only two levels are kept in memory during the conversion
+	const Spectrum* texels = mem.m_ImgMem.get();
+	unsigned width = mem.m_iWidth;
+	unsigned height = mem.m_iHeight;
+	std::vector<Spectrum> level;
+	const TEX_FORMAT format = (TEX_FORMAT)header.format;
+	while( true )
+	{
+		// the blocks of the image file are taken as they are , the lower levels of block-compressed images are encoded again
+		const unsigned char* blocks = ( width == mem.m_iWidth && height == mem.m_iHeight && !mem.m_blocks.empty() ) ? mem.m_blocks.data() : nullptr;
+		const bool written = IsBlockFormat( format ) ? _writeBlockLevel( file , format , texels , blocks , width , height ) : _writeLevel( file , format , texels , width , height );
+		if( !written )
+			return false;
+		if( width == 1 && height == 1 )
+			break;
+		_downsample( texels , width , height , level );
+		texels = level.data();
+		width = ( width + 1 ) / 2;
+		height = ( height + 1 ) / 2;
+	}
+
+	return _seek( file , 0 ) && fwrite( &header , sizeof( header ) , 1 , file ) == 1 && fflush( file ) == 0;
+}
+
+// destructor
+TiledImage::~TiledImage()
+{
+	if( m_file )
+		fclose( m_file );
+}
+
+// get a texel of the image
+Spectrum TiledImage::GetTexel( unsigned level , unsigned x , unsigned y ) const
+{
+	if( IsBlockFormat( m_format ) )
+	{
+		const unsigned texel = _blockTexel( level , x , y );
+		return _decode( TF_RGBA8 , (const unsigned char*)&texel );
+	}
+	return _decode( m_format , _texel( _pinTile( level , x , y ) , x , y ) );
+}
+
+// blend four encoded texels
+// para 'format'       : the format of the texels
+// para 't00,t10,...'  : the top left , top right , bottom left and bottom right texels
+// para 'ds,dt'        : the weights of the right and bottom texels
+// result              : the blended color
+// note                : the channels are blended in the same order with the scalar code of 'GetBilinear' , so both of them give the same result
+static inline Spectrum _blend( TEX_FORMAT format , const unsigned char* t00 , const unsigned char* t10 , const unsigned char* t01 , const unsigned char* t11 , float ds , float dt )
+{
+#if defined(TEX_SIMD_DECODE)
+	const __m128 ws0 = _mm_set1_ps( 1.0f - ds ) , ws1 = _mm_set1_ps( ds );
+	const __m128 top = _mm_add_ps( _mm_mul_ps( _decodeSimd( format , t00 ) , ws0 ) , _mm_mul_ps( _decodeSimd( format , t10 ) , ws1 ) );
+	const __m128 bottom = _mm_add_ps( _mm_mul_ps( _decodeSimd( format , t01 ) , ws0 ) , _mm_mul_ps( _decodeSimd( format , t11 ) , ws1 ) );
+	float c[4];
+	_mm_storeu_ps( c , _mm_add_ps( _mm_mul_ps( top , _mm_set1_ps( 1.0f - dt ) ) , _mm_mul_ps( bottom , _mm_set1_ps( dt ) ) ) );
+	return Spectrum( c[0] , c[1] , c[2] );
+#else
+	return ( _decode( format , t00 ) * ( 1.0f - ds ) + _decode( format , t10 ) * ds ) * ( 1.0f - dt ) +
+		( _decode( format , t01 ) * ( 1.0f - ds ) + _decode( format , t11 ) * ds ) * dt;
+#endif
+}
+
+// bilinearly blend four texels of a level
+Spectrum TiledImage::GetBilinear( unsigned level , unsigned x0 , unsigned y0 , unsigned x1 , unsigned y1 , float ds , float dt ) const
+{
+	// the blocks of the texels are decoded once , the texels are copied out as the blocks of wrapped lookups could share an entry
+	if( IsBlockFormat( m_format ) )
+	{
+		const unsigned t00 = _blockTexel( level , x0 , y0 ) , t10 = _blockTexel( level , x1 , y0 );
+		const unsigned t01 = _blockTexel( level , x0 , y1 ) , t11 = _blockTexel( level , x1 , y1 );
+		return _blend( TF_RGBA8 , (const unsigned char*)&t00 , (const unsigned char*)&t10 , (const unsigned char*)&t01 , (const unsigned char*)&t11 , ds , dt );
+	}
+
+#if defined(TEX_SIMD_DECODE)
+	// the texels of most lookups are in one tile , it is only pinned once and the channels are blended together
+	if( x0 / TEX_TILE_SIZE == x1 / TEX_TILE_SIZE && y0 / TEX_TILE_SIZE == y1 / TEX_TILE_SIZE )
+	{
+		const unsigned char* texels = _pinTile( level , x0 , y0 );
+		return _blend( m_format , _texel( texels , x0 , y0 ) , _texel( texels , x1 , y0 ) , _texel( texels , x0 , y1 ) , _texel( texels , x1 , y1 ) , ds , dt );
+	}
+#endif
+
+	return ( GetTexel( level , x0 , y0 ) * ( 1.0f - ds ) + GetTexel( level , x1 , y0 ) * ds ) * ( 1.0f - dt ) +
+		( GetTexel( level , x0 , y1 ) * ( 1.0f - ds ) + GetTexel( level , x1 , y1 ) * ds ) * dt;
+}
+
+// get a texel of a block-compressed image
+unsigned TiledImage::_blockTexel( unsigned level , unsigned x , unsigned y ) const
+{
+	// the block is only decoded if the thread didn't decode it last , the tile is not pinned otherwise
+	const TexLevel& l = m_levels[level];
+	const unsigned tile = l.firstTile + ( y / TEX_TILE_SIZE ) * l.tilesX + x / TEX_TILE_SIZE;
+	const unsigned block = ( ( y % TEX_TILE_SIZE ) / TEX_BLOCK_SIZE ) * TEX_TILE_BLOCKS + ( x % TEX_TILE_SIZE ) / TEX_BLOCK_SIZE;
+	DecodedBlock& decoded = g_blocks[ ( ( x / TEX_BLOCK_SIZE ) & 1 ) | ( ( ( y / TEX_BLOCK_SIZE ) & 1 ) << 1 ) ];
+	if( decoded.image != this || decoded.tile != tile || decoded.block != block )
+	{
+		DecodeBlock( m_format , _pinTile( level , x , y ) + block * m_texelBytes , (unsigned char*)decoded.texels );
+		decoded.image = this;
+		decoded.tile = tile;
+		decoded.block = block;
+	}
+	return decoded.texels[ ( y % TEX_BLOCK_SIZE ) * TEX_BLOCK_SIZE + x % TEX_BLOCK_SIZE ];
+}
+
+// pin the tile of a texel as the hint of the thread
+const unsigned char* TiledImage::_pinTile( unsigned level , unsigned x , unsigned y ) const
+{
+	const TexLevel& l = m_levels[level];
+	const unsigned index = l.firstTile + ( y / TEX_TILE_SIZE ) * l.tilesX + x / TEX_TILE_SIZE;
+	if( m_shared )
+		return m_shared + m_tileBytes * index;
+	TexTile* tile = &m_tiles[index];
+
+	// the hint of the thread keeps the tile pinned , lookups in the same tile don't pin it again
+	TexTile*& hint = g_hints[ m_id & ( TEX_TILE_HINTS - 1 ) ];
+	if( hint != tile )
+	{
+		m_cache->Pin( tile );
+		if( hint )
+			hint->image->m_cache->Unpin( hint );
+		hint = tile;
+	}
+	return tile->texels.get();
+}
+
+// destructor
+TexCache::~TexCache()
+{
+	m_images.clear();
+}
+
+// open the tiled conversion of an image
+TiledImage* TexCache::Load( const string& filename , const string& source )
+{
+	struct stat st;
+	if( stat( source.c_str() , &st ) != 0 )
+		return nullptr;
+
+	FILE* file = fopen( filename.c_str() , "rb" );
+	if( file == nullptr )
+		return nullptr;
+
+	TexCacheHeader header;
+	bool valid = fread( &header , sizeof( header ) , 1 , file ) == 1 && memcmp( header.magic , TEX_CACHE_MAGIC , sizeof( TEX_CACHE_MAGIC ) ) == 0 &&
+		header.version == TEX_CACHE_VERSION && header.format <= TF_BC7 && header.elementSize == _texelBytes( (TEX_FORMAT)header.format ) && header.tileSize == TEX_TILE_SIZE &&
+		header.sourceTime == (long long)st.st_mtime && header.sourceSize == (unsigned long long)st.st_size && header.width > 0 && header.height > 0;
+
+	// truncated files are detected by their size , the tiles themselves are only read once they are used
+	struct stat tile_st;
+	std::vector<TexLevel> levels;
+	valid = valid && stat( filename.c_str() , &tile_st ) == 0 &&
+		(unsigned long long)tile_st.st_size == TEX_CACHE_PAYLOAD + _tileBytes( (TEX_FORMAT)header.format ) * (unsigned long long)_buildLevels( header.width , header.height , levels );
+	if( !valid )
+	{
+		fclose( file );
+		return nullptr;
+	}
+
+	TiledImage* image = _addImage( file , source , header.width , header.height , Spectrum( header.average[0] , header.average[1] , header.average[2] ) , (TEX_FORMAT)header.format );
+	_shareTiles( image , AccelCache::Hash( &header , sizeof( header ) ) ^ AccelCache::Hash( source.c_str() , source.size() ) );
+	return image;
+}
+
+// convert an image into a tile file
+TiledImage* TexCache::Create( const string& filename , const string& source , const ImgMemory& mem )
+{
+	if( mem.m_iWidth == 0 || mem.m_iHeight == 0 || !mem.m_ImgMem )
+		return nullptr;
+
+	const Spectrum average = mem.GetAverage();
+
+	TexCacheHeader header;
+	memset( &header , 0 , sizeof( header ) );
+	memcpy( header.magic , TEX_CACHE_MAGIC , sizeof( TEX_CACHE_MAGIC ) );
+	header.version = TEX_CACHE_VERSION;
+	header.format = _pickFormat( mem );
+	header.elementSize = _texelBytes( (TEX_FORMAT)header.format );
+	header.tileSize = TEX_TILE_SIZE;
+	header.width = mem.m_iWidth;
+	header.height = mem.m_iHeight;
+	header.average[0] = average.GetR();
+	header.average[1] = average.GetG();
+	header.average[2] = average.GetB();
+	struct stat st;
+	if( stat( source.c_str() , &st ) == 0 )
+	{
+		header.sourceTime = (long long)st.st_mtime;
+		header.sourceSize = (unsigned long long)st.st_size;
+	}
+
+	// the file next to the image is reused in later runs , a temporary file only lives during the run
+	FILE* file = fopen( filename.c_str() , "w+b" );
+	if( file && !_writeTiles( file , header , mem ) )
+	{
+		fclose( file );
+		remove( filename.c_str() );
+		file = nullptr;
+	}
+	if( file == nullptr )
+	{
+		file = tmpfile();
+		if( file == nullptr || !_writeTiles( file , header , mem ) )
+		{
+			if( file )
+				fclose( file );
+			slog( WARNING , IMAGE , stringFormat( "Failed to write the tiles of image %s, it is kept in memory." , source.c_str() ) );
+			return nullptr;
+		}
+		slog( WARNING , IMAGE , stringFormat( "Can't write %s, the tiles of the image are kept in a temporary file." , filename.c_str() ) );
+	}
+
+	TiledImage* image = _addImage( file , source , mem.m_iWidth , mem.m_iHeight , average , (TEX_FORMAT)header.format );
+	_shareTiles( image , AccelCache::Hash( &header , sizeof( header ) ) ^ AccelCache::Hash( source.c_str() , source.size() ) );
+	return image;
+}
+
+// place all tiles of an image in memory shared with other processes on the host
+void TexCache::_shareTiles( TiledImage* image , unsigned long long key )
+{
+	if( !SMManager::GetSingleton().IsSceneSharing() )
+		return;
+
+	// the process converting or opening the image first reads all of its tiles , the others map them
+	const size_t bytes = image->m_tileBytes * image->m_tileCount;
+	image->m_shared = (const unsigned char*)SMManager::GetSingleton().PublishSceneData( key , bytes , [&]( char* dst ){
+		return _seek( image->m_file , (long long)TEX_CACHE_PAYLOAD ) && fread( dst , bytes , 1 , image->m_file ) == 1;
+	});
+	if( image->m_shared == nullptr )
+		slog( WARNING , IMAGE , stringFormat( "Failed to share the tiles of image %s, they are read on demand." , image->m_filename.c_str() ) );
+}
+
+// add an image with an opened tile file
+TiledImage* TexCache::_addImage( FILE* file , const string& source , unsigned width , unsigned height , const Spectrum& average , TEX_FORMAT format )
+{
+	std::unique_ptr<TiledImage> image( new TiledImage() );
+	image->m_cache = this;
+	image->m_filename = source;
+	image->m_file = file;
+	image->m_average = average;
+	image->m_format = format;
+	image->m_texelBytes = _texelBytes( format );
+	image->m_tileBytes = _tileBytes( format );
+	image->m_tileCount = _buildLevels( width , height , image->m_levels );
+	image->m_tiles.reset( new TexTile[ image->m_tileCount ] );
+	for( unsigned i = 0 ; i < image->m_tileCount ; ++i )
+	{
+		image->m_tiles[i].image = image.get();
+		image->m_tiles[i].index = i;
+	}
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+	image->m_id = (unsigned)m_images.size();
+	m_fileSize += (long long)( TEX_CACHE_PAYLOAD + image->m_tileBytes * image->m_tileCount );
+	m_images.push_back( std::move( image ) );
+	return m_images.back().get();
+}
+
+// read the texels of a tile
+void TexCache::_pageIn( TexTile* tile )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	// another thread could have read it already
+	if( tile->resident.load() )
+		return;
+
+	const TiledImage* image = tile->image;
+	tile->texels.reset( new unsigned char[ image->m_tileBytes ] );
+	if( !_seek( image->m_file , (long long)( TEX_CACHE_PAYLOAD + image->m_tileBytes * tile->index ) ) ||
+		fread( tile->texels.get() , image->m_tileBytes , 1 , image->m_file ) != 1 )
+		slog( CRITICAL , IMAGE , stringFormat( "Failed to read a tile of image %s." , image->m_filename.c_str() ) );
+
+	m_resident += image->m_tileBytes;
+	++m_residentTiles;
+	++m_pageIns;
+	tile->referenced.store( false );
+	_pushFront( tile );
+	tile->resident.store( true );
+
+	// the tile being read is pinned , other tiles make room for it
+	_trim( tile );
+	m_tracker.Set( m_resident );
+}
+
+// evict tiles not used recently until the budget is met
+void TexCache::_trim( const TexTile* keep )
+{
+	if( m_budget == 0 )
+		return;
+
+	// the list is walked from the tail like a clock , tiles used since the last pass get a second chance
+	TexTile* tile = m_tail;
+	for( unsigned i = 0 , count = m_residentTiles ; i < count && tile && m_resident > m_budget ; ++i )
+	{
+		TexTile* prev = tile->prev;
+		if( tile == keep || tile->referenced.exchange( false ) || !_evictTile( tile ) )
+		{
+			_unlink( tile );
+			_pushFront( tile );
+		}
+		tile = prev;
+	}
+}
+
+// free the texels of a tile unless it is pinned
+bool TexCache::_evictTile( TexTile* tile )
+{
+	// a thread pins the tile before it checks the residence , while the residence is cleared here before checking
+	// the pins , so either the pin is seen here or the thread sees the tile not resident and waits for the lock
+	tile->resident.store( false );
+	if( tile->pins.load() != 0 )
+	{
+		tile->resident.store( true );
+		return false;
+	}
+
+	tile->texels.reset();
+	_unlink( tile );
+	m_resident -= tile->image->m_tileBytes;
+	--m_residentTiles;
+	++m_evictions;
+	return true;
+}
+
+// unlink a tile from the list of resident tiles
+void TexCache::_unlink( TexTile* tile )
+{
+	if( tile->prev )
+		tile->prev->next = tile->next;
+	else
+		m_head = tile->next;
+	if( tile->next )
+		tile->next->prev = tile->prev;
+	else
+		m_tail = tile->prev;
+	tile->prev = tile->next = nullptr;
+}
+
+// link a tile as the head of the list of resident tiles
+void TexCache::_pushFront( TexTile* tile )
+{
+	tile->prev = nullptr;
+	tile->next = m_head;
+	if( m_head )
+		m_head->prev = tile;
+	else
+		m_tail = tile;
+	m_head = tile;
+}
+
+// output log information
+void TexCache::OutputLog() const
+{
+	if( m_images.empty() )
+		return;
+	slog( INFO , PERFORMANCE , stringFormat( "Tiles of %d images take %.2f MB in files, %.2f MB are resident with a budget of %.2f MB. Tiles are read %d times and evicted %d times." ,
+		(int)m_images.size() , m_fileSize / 1048576.0f , m_resident / 1048576.0f , m_budget / 1048576.0f , (int)m_pageIns , (int)m_evictions ) );
+}
+
+// add the usage of the cache to the report
+void TexCache::CollectStats( StatsGroup& stats ) const
+{
+	stats.Add( "cached_images" , (unsigned)m_images.size() ).Add( "file_bytes" , (unsigned long long)m_fileSize ).Add( "resident_bytes" , (unsigned long long)m_resident )
+		 .Add( "budget_bytes" , (unsigned long long)m_budget ).Add( "page_ins" , (unsigned long long)m_pageIns ).Add( "evictions" , (unsigned long long)m_evictions );
+}
@@ -0,0 +1,274 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+// include the headers
+#include "sort.h"
+#include "spectrum/spectrum.h"
+#include "utility/memstats.h"
+#include "utility/enum.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdio.h>
+
+// the number of texels in both dimensions of a tile
+#define TEX_TILE_SIZE	64
+// the number of tiles every thread keeps pinned as hints , it has to be power of two
+#define TEX_TILE_HINTS	8
+
+// pre-declera class
+class ImgMemory;
+class TexCache;
+class TiledImage;
+
+// a square of texels in one level of a tiled image
+struct TexTile
+{
+	// the image owning the tile
+	const TiledImage*	image = nullptr;
+	// the index of the tile in the file
+	unsigned			index = 0;
+	// the encoded texels , they are only valid while the tile is resident
+	std::unique_ptr<unsigned char[]>	texels;
+	// the number of lookups reading the texels
+	std::atomic<int>	pins{ 0 };
+	// whether the texels are in memory
+	std::atomic<bool>	resident{ false };
+	// whether the tile is used since the eviction last passed it
+	std::atomic<bool>	referenced{ false };
+	// the neighbors in the list of resident tiles , they are guarded by the mutex of the cache
+	TexTile*			prev = nullptr;
+	TexTile*			next = nullptr;
+};
+
+// the size of one level in a tiled image
+struct TexLevel
+{
+	unsigned	width = 0;
+	unsigned	height = 0;
+	// the number of tiles in both dimensions
+	unsigned	tilesX = 0;
+	unsigned	tilesY = 0;
+	// the index of the first tile of the level
+	unsigned	firstTile = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////
+//	definition of tiled image
+//	desc :	An image stored as a mip pyramid of tiles in a file. The tiles
+//			are read into memory by the texture cache once they are looked
+//			up , the images themselves only keep the layout of the pyramid.
+class	TiledImage
+{
+// public method
+public:
+	// destructor
+	~TiledImage();
+
+	// get the size of a level
+	// para 'level' : the level , zero is the full resolution image
+	unsigned	GetWidth( unsigned level = 0 ) const { return m_levels[level].width; }
+	unsigned	GetHeight( unsigned level = 0 ) const { return m_levels[level].height; }
+
+	// get the number of levels , the last level has only one texel
+	unsigned	GetLevelCount() const { return (unsigned)m_levels.size(); }
+
+	// get the average color of the full resolution image
+	const Spectrum&	GetAverage() const { return m_average; }
+
+	// get a texel of the image
+	// para 'level' : the level of the texel
+	// para 'x'     : x coordinate , it has to be inside the level
+	// para 'y'     : y coordinate , it has to be inside the level
+	// result       : the color of the texel
+	// note         : it is thread-safe , the tile of the texel is brought in if it is not resident
+	Spectrum	GetTexel( unsigned level , unsigned x , unsigned y ) const;
+
+	// bilinearly blend four texels of a level
+	// para 'level'  : the level of the texels
+	// para 'x0,x1'  : x coordinates of the left and right texels , they have to be inside the level
+	// para 'y0,y1'  : y coordinates of the top and bottom texels , they have to be inside the level
+	// para 'ds,dt'  : the weights of the right and bottom texels
+	// result        : the blended color
+	// note          : texels in the same tile are decoded and blended with simd instructions , so are the texels of blocks once they are decoded
+	Spectrum	GetBilinear( unsigned level , unsigned x0 , unsigned y0 , unsigned x1 , unsigned y1 , float ds , float dt ) const;
+
+// private field
+private:
+	// the cache reading the tiles
+	TexCache*			m_cache = nullptr;
+	// the identity of the image , hints of threads are picked with it
+	unsigned			m_id = 0;
+	// the name of the image file
+	string				m_filename;
+	// the levels
+	std::vector<TexLevel>	m_levels;
+	// the tiles of all levels
+	std::unique_ptr<TexTile[]>	m_tiles;
+	// the format of the texels
+	TEX_FORMAT			m_format = TF_RGB32F;
+	// the size of a texel , or a block of block-compressed formats , and a tile in bytes
+	unsigned			m_texelBytes = 0;
+	size_t				m_tileBytes = 0;
+	// the number of tiles
+	unsigned			m_tileCount = 0;
+	// the file of the tiles
+	FILE*				m_file = nullptr;
+	// the tiles in memory shared with other processes , they are always resident and never read from the file
+	const unsigned char*	m_shared = nullptr;
+	// the average color
+	Spectrum			m_average;
+
+	// pin the tile of a texel as the hint of the thread
+	// result : the encoded texels of the tile
+	const unsigned char*	_pinTile( unsigned level , unsigned x , unsigned y ) const;
+
+	// get a texel of a block-compressed image , its block is decoded unless the thread decoded it last
+	// result : the texel in the layout of 'TF_RGBA8'
+	unsigned	_blockTexel( unsigned level , unsigned x , unsigned y ) const;
+
+	// get the encoded texel in a tile
+	const unsigned char*	_texel( const unsigned char* texels , unsigned x , unsigned y ) const
+	{
+		return texels + ( ( y % TEX_TILE_SIZE ) * TEX_TILE_SIZE + x % TEX_TILE_SIZE ) * m_texelBytes;
+	}
+
+	friend class TexCache;
+};
+
+/////////////////////////////////////////////////////////////////////////
+//	definition of texture cache
+//	desc :	Decoded images take twelve bytes per texel , a scene of many
+//			large textures doesn't fit in memory if they are all kept. Each
+//			image is converted to a tiled mip pyramid stored next to the image
+//			file on first use , the conversion is reused in later runs as long
+//			as the image is unchanged. Texels are stored in the smallest format
+//			holding the full resolution image exactly , one to four bytes for
+//			images of 8-bit channels and six bytes for half float images , they
+//			are decoded once they are looked up. Block-compressed images keep
+//			their blocks , every thread decodes the last blocks it looked up
+//			and the lower levels are compressed in the same format. Only the tiles being looked up are read
+//			into memory , tiles not used recently are evicted whenever the
+//			resident tiles exceed the budget. Every thread keeps the last tiles
+//			it used pinned as hints , lookups hitting them take no lock and
+//			touch no shared state. If the scene data is shared with other
+//			processes on the host , all tiles of an image are read once into
+//			shared memory instead and the budget doesn't apply to them.
+class	TexCache
+{
+// public method
+public:
+	// destructor
+	~TexCache();
+
+	// set the budget
+	// para 'bytes' : the maximum size of resident tiles , zero keeps all tiles once they are read
+	// note         : the tiles pinned as hints of threads are never evicted , they could exceed the budget a little
+	void	SetBudget( size_t bytes ) { m_budget = bytes; }
+
+	// open the tiled conversion of an image
+	// para 'filename' : name of the tile file
+	// para 'source'   : name of the image file
+	// result          : the image , it is nullptr if the file is missing or out of date
+	TiledImage*	Load( const string& filename , const string& source );
+
+	// convert an image into a tile file
+	// para 'filename' : name of the tile file , a temporary file is used if it can't be written
+	// para 'source'   : name of the image file
+	// para 'mem'      : the decoded image
+	// result          : the image , it is nullptr if no file could be written
+	TiledImage*	Create( const string& filename , const string& source , const ImgMemory& mem );
+
+	// make sure the texels of a tile are in memory until the tile is unpinned
+	// para 'tile' : the tile to be pinned
+	// note        : it is thread-safe , the lock is only taken if the tile is not resident
+	void	Pin( TexTile* tile )
+	{
+		// the order of pinning and checking the residence matters , see '_evictTile'
+		tile->pins.fetch_add( 1 );
+		if( !tile->resident.load() )
+			_pageIn( tile );
+	}
+
+	// allow a tile to be evicted again
+	// para 'tile' : the pinned tile
+	void	Unpin( TexTile* tile )
+	{
+		tile->referenced.store( true , std::memory_order_relaxed );
+		tile->pins.fetch_sub( 1 );
+	}
+
+	// output log information
+	void	OutputLog() const;
+
+	// add the usage of the cache to a group of the statistics report
+	// para 'stats' : the group of the textures
+	void	CollectStats( StatsGroup& stats ) const;
+
+// private field
+private:
+	// the maximum size of resident tiles
+	size_t		m_budget = (size_t)1024 << 20;
+	// the size of resident tiles
+	size_t		m_resident = 0;
+	// the images
+	std::vector<std::unique_ptr<TiledImage>>	m_images;
+	// the size of all tile files
+	long long	m_fileSize = 0;
+	// the list of resident tiles , the most recently read tile is the head
+	TexTile*	m_head = nullptr;
+	TexTile*	m_tail = nullptr;
+	// the number of resident tiles
+	unsigned	m_residentTiles = 0;
+	// the mutex guarding the list and reading tiles
+	std::mutex	m_mutex;
+	// the number of tiles read and evicted
+	unsigned long long	m_pageIns = 0;
+	unsigned long long	m_evictions = 0;
+	// the memory of resident tiles
+	MemoryTracker	m_tracker{ MEM_TEXTURE };
+
+// private method
+private:
+	// add an image with an opened tile file
+	// para 'file'    : the tile file , the image owns it afterward
+	// para 'source'  : name of the image file
+	// para 'width'   : width of the image
+	// para 'height'  : height of the image
+	// para 'average' : the average color of the image
+	// para 'format'  : the format of the texels
+	TiledImage*	_addImage( FILE* file , const string& source , unsigned width , unsigned height , const Spectrum& average , TEX_FORMAT format );
+	// place all tiles of an image in memory shared with other processes on the host if it is enabled
+	// para 'image' : the image
+	// para 'key'   : the identity of the tiles
+	void	_shareTiles( TiledImage* image , unsigned long long key );
+	// read the texels of a tile and make room for them
+	void	_pageIn( TexTile* tile );
+	// evict tiles not used recently until the budget is met
+	// para 'keep' : the tile that is not evicted
+	void	_trim( const TexTile* keep );
+	// free the texels of a tile unless it is pinned
+	// result : 'true' if the tile is evicted
+	bool	_evictTile( TexTile* tile );
+	// unlink a tile from the list of resident tiles
+	void	_unlink( TexTile* tile );
+	// link a tile as the head of the list of resident tiles
+	void	_pushFront( TexTile* tile );
+};
@@ -0,0 +1,585 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header file
+#include "blockcodec.h"
+#include "managers/texmanager.h"
+#include "utility/multithread/threadpool.h"
+#include <string.h>
+
+// the bits of a 128-bit block , they are read and written from the lowest bit of the first byte
+struct BlockBits
+{
+	unsigned long long	bits[2] = { 0 , 0 };
+	// the position of the next bit
+	unsigned			pos = 0;
+
+	// read a number of bits , it is never more than eight
+	unsigned	Read( unsigned count )
+	{
+		if( count == 0 )
+			return 0;
+		const unsigned shift = pos & 63;
+		unsigned long long v = bits[pos >> 6] >> shift;
+		if( shift + count > 64 )
+			v |= bits[1] << ( 64 - shift );
+		pos += count;
+		return (unsigned)( v & ( ( 1ull << count ) - 1 ) );
+	}
+
+	// write a number of bits
+	void	Write( unsigned v , unsigned count )
+	{
+		for( unsigned i = 0 ; i < count ; ++i , ++pos )
+			bits[pos >> 6] |= (unsigned long long)( ( v >> i ) & 1 ) << ( pos & 63 );
+	}
+};
+
+// the layout of a bc7 mode
+struct Bc7Mode
+{
+	unsigned char	subsets;
+	unsigned char	partitionBits;
+	unsigned char	rotationBits;
+	unsigned char	selectionBits;
+	unsigned char	colorBits;
+	unsigned char	alphaBits;
+	unsigned char	endpointPBits;
+	unsigned char	sharedPBits;
+	unsigned char	indexBits;
+	unsigned char	index2Bits;
+};
+
+static const Bc7Mode g_bc7Modes[8] = {
+	{ 3 , 4 , 0 , 0 , 4 , 0 , 1 , 0 , 3 , 0 } ,
+	{ 2 , 6 , 0 , 0 , 6 , 0 , 0 , 1 , 3 , 0 } ,
+	{ 3 , 6 , 0 , 0 , 5 , 0 , 0 , 0 , 2 , 0 } ,
+	{ 2 , 6 , 0 , 0 , 7 , 0 , 1 , 0 , 2 , 0 } ,
+	{ 1 , 0 , 2 , 1 , 5 , 6 , 0 , 0 , 2 , 3 } ,
+	{ 1 , 0 , 2 , 0 , 7 , 8 , 0 , 0 , 2 , 2 } ,
+	{ 1 , 0 , 0 , 0 , 7 , 7 , 1 , 0 , 4 , 0 } ,
+	{ 2 , 6 , 0 , 0 , 5 , 5 , 1 , 0 , 2 , 0 } ,
+};
+
+// the weights of the interpolated values of bc7 , in 64ths
+static const unsigned char g_bc7Weights2[4] = { 0 , 21 , 43 , 64 };
+static const unsigned char g_bc7Weights3[8] = { 0 , 9 , 18 , 27 , 37 , 46 , 55 , 64 };
+static const unsigned char g_bc7Weights4[16] = { 0 , 4 , 9 , 13 , 17 , 21 , 26 , 30 , 34 , 38 , 43 , 47 , 51 , 55 , 60 , 64 };
+
+// the partitions of two subsets , a set bit puts the texel in the second subset
+static const unsigned short g_bc7Partitions2[64] = {
+	0xcccc , 0x8888 , 0xeeee , 0xecc8 , 0xc880 , 0xfeec , 0xfec8 , 0xec80 , 0xc800 , 0xffec , 0xfe80 , 0xe800 , 0xffe8 , 0xff00 , 0xfff0 , 0xf000 ,
+	0xf710 , 0x008e , 0x7100 , 0x08ce , 0x008c , 0x7310 , 0x3100 , 0x8cce , 0x088c , 0x3110 , 0x6666 , 0x366c , 0x17e8 , 0x0ff0 , 0x718e , 0x399c ,
+	0xaaaa , 0xf0f0 , 0x5a5a , 0x33cc , 0x3c3c , 0x55aa , 0x9696 , 0xa55a , 0x73ce , 0x13c8 , 0x324c , 0x3bdc , 0x6996 , 0xc33c , 0x9966 , 0x0660 ,
+	0x0272 , 0x04e4 , 0x4e40 , 0x2720 , 0xc936 , 0x936c , 0x39c6 , 0x639c , 0x9336 , 0x9cc6 , 0x817e , 0xe718 , 0xccf0 , 0x0fcc , 0x7744 , 0xee22 ,
+};
+
+// the partitions of three subsets
+static const unsigned char g_bc7Partitions3[64][16] = {
+	{ 0,0,1,1,0,0,1,1,0,2,2,1,2,2,2,2 } , { 0,0,0,1,0,0,1,1,2,2,1,1,2,2,2,1 } , { 0,0,0,0,2,0,0,1,2,2,1,1,2,2,1,1 } , { 0,2,2,2,0,0,2,2,0,0,1,1,0,1,1,1 } ,
+	{ 0,0,0,0,0,0,0,0,1,1,2,2,1,1,2,2 } , { 0,0,1,1,0,0,1,1,0,0,2,2,0,0,2,2 } , { 0,0,2,2,0,0,2,2,1,1,1,1,1,1,1,1 } , { 0,0,1,1,0,0,1,1,2,2,1,1,2,2,1,1 } ,
+	{ 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2 } , { 0,0,0,0,1,1,1,1,1,1,1,1,2,2,2,2 } , { 0,0,0,0,1,1,1,1,2,2,2,2,2,2,2,2 } , { 0,0,1,2,0,0,1,2,0,0,1,2,0,0,1,2 } ,
+	{ 0,1,1,2,0,1,1,2,0,1,1,2,0,1,1,2 } , { 0,1,2,2,0,1,2,2,0,1,2,2,0,1,2,2 } , { 0,0,1,1,0,1,1,2,1,1,2,2,1,2,2,2 } , { 0,0,1,1,2,0,0,1,2,2,0,0,2,2,2,0 } ,
+	{ 0,0,0,1,0,0,1,1,0,1,1,2,1,1,2,2 } , { 0,1,1,1,0,0,1,1,2,0,0,1,2,2,0,0 } , { 0,0,0,0,1,1,2,2,1,1,2,2,1,1,2,2 } , { 0,0,2,2,0,0,2,2,0,0,2,2,1,1,1,1 } ,
+	{ 0,1,1,1,0,1,1,1,0,2,2,2,0,2,2,2 } , { 0,0,0,1,0,0,0,1,2,2,2,1,2,2,2,1 } , { 0,0,0,0,0,0,1,1,0,1,2,2,0,1,2,2 } , { 0,0,0,0,1,1,0,0,2,2,1,0,2,2,1,0 } ,
+	{ 0,1,2,2,0,1,2,2,0,0,1,1,0,0,0,0 } , { 0,0,1,2,0,0,1,2,1,1,2,2,2,2,2,2 } , { 0,1,1,0,1,2,2,1,1,2,2,1,0,1,1,0 } , { 0,0,0,0,0,1,1,0,1,2,2,1,1,2,2,1 } ,
+	{ 0,0,2,2,1,1,0,2,1,1,0,2,0,0,2,2 } , { 0,1,1,0,0,1,1,0,2,0,0,2,2,2,2,2 } , { 0,0,1,1,0,1,2,2,0,1,2,2,0,0,1,1 } , { 0,0,0,0,2,0,0,0,2,2,1,1,2,2,2,1 } ,
+	{ 0,0,0,0,0,0,0,2,1,1,2,2,1,2,2,2 } , { 0,2,2,2,0,0,2,2,0,0,1,2,0,0,1,1 } , { 0,0,1,1,0,0,1,2,0,0,2,2,0,2,2,2 } , { 0,1,2,0,0,1,2,0,0,1,2,0,0,1,2,0 } ,
+	{ 0,0,0,0,1,1,1,1,2,2,2,2,0,0,0,0 } , { 0,1,2,0,1,2,0,1,2,0,1,2,0,1,2,0 } , { 0,1,2,0,2,0,1,2,1,2,0,1,0,1,2,0 } , { 0,0,1,1,2,2,0,0,1,1,2,2,0,0,1,1 } ,
+	{ 0,0,1,1,1,1,2,2,2,2,0,0,0,0,1,1 } , { 0,1,0,1,0,1,0,1,2,2,2,2,2,2,2,2 } , { 0,0,0,0,0,0,0,0,2,1,2,1,2,1,2,1 } , { 0,0,2,2,1,1,2,2,0,0,2,2,1,1,2,2 } ,
+	{ 0,0,2,2,0,0,1,1,0,0,2,2,0,0,1,1 } , { 0,2,2,0,1,2,2,1,0,2,2,0,1,2,2,1 } , { 0,1,0,1,2,2,2,2,2,2,2,2,0,1,0,1 } , { 0,0,0,0,2,1,2,1,2,1,2,1,2,1,2,1 } ,
+	{ 0,1,0,1,0,1,0,1,0,1,0,1,2,2,2,2 } , { 0,2,2,2,0,1,1,1,0,2,2,2,0,1,1,1 } , { 0,0,0,2,1,1,1,2,0,0,0,2,1,1,1,2 } , { 0,0,0,0,2,1,1,2,2,1,1,2,2,1,1,2 } ,
+	{ 0,2,2,2,0,1,1,1,0,1,1,1,0,2,2,2 } , { 0,0,0,2,1,1,1,2,1,1,1,2,0,0,0,2 } , { 0,1,1,0,0,1,1,0,0,1,1,0,2,2,2,2 } , { 0,0,0,0,0,0,0,0,2,1,1,2,2,1,1,2 } ,
+	{ 0,1,1,0,0,1,1,0,2,2,2,2,2,2,2,2 } , { 0,0,2,2,0,0,1,1,0,0,1,1,0,0,2,2 } , { 0,0,2,2,1,1,2,2,1,1,2,2,0,0,2,2 } , { 0,0,0,0,0,0,0,0,0,0,0,0,2,1,1,2 } ,
+	{ 0,0,0,2,0,0,0,1,0,0,0,2,0,0,0,1 } , { 0,2,2,2,1,2,2,2,0,2,2,2,1,2,2,2 } , { 0,1,0,1,2,2,2,2,2,2,2,2,2,2,2,2 } , { 0,1,1,1,2,0,1,1,2,2,0,1,2,2,2,0 } ,
+};
+
+// the anchor texels of the second subset of two subsets , and of the second and third subsets of three subsets , their indices have one bit less
+static const unsigned char g_bc7Anchors2[64] = {
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15 , 15, 2, 8, 2, 2, 8, 8,15, 2, 8, 2, 2, 8, 8, 2, 2 ,
+	15,15, 6, 8, 2, 8,15,15, 2, 8, 2, 2, 2,15,15, 6 ,  6, 2, 6, 8,15,15, 2, 2,15,15,15,15,15, 2, 2,15 ,
+};
+static const unsigned char g_bc7Anchors3a[64] = {
+	 3, 3,15,15, 8, 3,15,15, 8, 8, 6, 6, 6, 5, 3, 3 ,  3, 3, 8,15, 3, 3, 6,10, 5, 8, 8, 6, 8, 5,15,15 ,
+	 8,15, 3, 5, 6,10, 8,15,15, 3,15, 5,15,15,15,15 ,  3,15, 5, 5, 5, 8, 5,10, 5,10, 8,13,15,12, 3, 3 ,
+};
+static const unsigned char g_bc7Anchors3b[64] = {
+	15, 8, 8, 3,15,15, 3, 8,15,15,15,15,15,15,15, 8 , 15, 8,15, 3,15, 8,15, 8, 3,15, 6,10,15,15,10, 8 ,
+	15, 3,15,10,10, 8, 9,10, 6,15, 8,15, 3, 6, 6, 8 , 15, 3,15,15,15,15,15,15,15,15,15,15, 3,15,15, 8 ,
+};
+
+// expand a quantized value to eight bits by repeating its highest bits
+static inline unsigned char _expand( unsigned v , unsigned bits )
+{
+	v <<= 8 - bits;
+	return (unsigned char)( v | ( v >> bits ) );
+}
+
+// interpolate two end points by a weight in 64ths
+static inline unsigned char _interpolate( unsigned e0 , unsigned e1 , unsigned w )
+{
+	return (unsigned char)( ( ( 64 - w ) * e0 + w * e1 + 32 ) >> 6 );
+}
+
+// the weight of an index of bc7
+static inline unsigned _weight( unsigned bits , unsigned index )
+{
+	return ( bits == 2 ) ? g_bc7Weights2[index] : ( bits == 3 ) ? g_bc7Weights3[index] : g_bc7Weights4[index];
+}
+
+// the squared distance of two texels
+static inline unsigned _distance( const unsigned char* a , const unsigned char* b , unsigned channels )
+{
+	unsigned d = 0;
+	for( unsigned c = 0 ; c < channels ; ++c )
+		d += ( (int)a[c] - (int)b[c] ) * ( (int)a[c] - (int)b[c] );
+	return d;
+}
+
+// the end points of a block , the corners of the bounding box on the diagonal along which the texels vary
+// para 'texels'    : the sixteen texels of the block , four bytes each
+// para 'channels'  : the number of channels taken
+// para 'endpoints' : the two end points
+static void _boundingEndpoints( const unsigned char* texels , unsigned channels , unsigned char endpoints[2][4] )
+{
+	int mean[4] = { 0 , 0 , 0 , 0 };
+	for( unsigned c = 0 ; c < channels ; ++c )
+	{
+		endpoints[0][c] = 255;
+		endpoints[1][c] = 0;
+		for( unsigned i = 0 ; i < 16 ; ++i )
+		{
+			endpoints[0][c] = std::min( endpoints[0][c] , texels[4 * i + c] );
+			endpoints[1][c] = std::max( endpoints[1][c] , texels[4 * i + c] );
+			mean[c] += texels[4 * i + c];
+		}
+	}
+
+	// channels decreasing along the widest channel take the other diagonal
+	unsigned widest = 0;
+	for( unsigned c = 1 ; c < channels ; ++c )
+		if( endpoints[1][c] - endpoints[0][c] > endpoints[1][widest] - endpoints[0][widest] )
+			widest = c;
+	for( unsigned c = 0 ; c < channels ; ++c )
+	{
+		int covariance = 0;
+		for( unsigned i = 0 ; i < 16 ; ++i )
+			covariance += ( 16 * texels[4 * i + c] - mean[c] ) * ( 16 * texels[4 * i + widest] - mean[widest] );
+		if( covariance < 0 )
+			std::swap( endpoints[0][c] , endpoints[1][c] );
+	}
+}
+
+// the colors of a bc1 block
+static void _bc1Palette( unsigned c0 , unsigned c1 , unsigned char palette[4][4] )
+{
+	const unsigned colors[2] = { c0 , c1 };
+	for( unsigned i = 0 ; i < 2 ; ++i )
+	{
+		palette[i][0] = _expand( colors[i] >> 11 , 5 );
+		palette[i][1] = _expand( ( colors[i] >> 5 ) & 63 , 6 );
+		palette[i][2] = _expand( colors[i] & 31 , 5 );
+		palette[i][3] = 255;
+	}
+	for( unsigned c = 0 ; c < 3 ; ++c )
+	{
+		// the second color is black in the mode of three colors , it is transparent as well
+		if( c0 > c1 )
+		{
+			palette[2][c] = (unsigned char)( ( 2 * palette[0][c] + palette[1][c] ) / 3 );
+			palette[3][c] = (unsigned char)( ( palette[0][c] + 2 * palette[1][c] ) / 3 );
+		}
+		else
+		{
+			palette[2][c] = (unsigned char)( ( palette[0][c] + palette[1][c] ) / 2 );
+			palette[3][c] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = ( c0 > c1 ) ? 255 : 0;
+}
+
+// the values of a bc4 block
+static void _bc4Palette( unsigned a0 , unsigned a1 , unsigned char palette[8] )
+{
+	palette[0] = (unsigned char)a0;
+	palette[1] = (unsigned char)a1;
+	if( a0 > a1 )
+	{
+		for( unsigned i = 2 ; i < 8 ; ++i )
+			palette[i] = (unsigned char)( ( ( 8 - i ) * a0 + ( i - 1 ) * a1 ) / 7 );
+	}
+	else
+	{
+		for( unsigned i = 2 ; i < 6 ; ++i )
+			palette[i] = (unsigned char)( ( ( 6 - i ) * a0 + ( i - 1 ) * a1 ) / 5 );
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+// decode a bc1 block
+static void _decodeBc1( const unsigned char* block , unsigned char* texels )
+{
+	unsigned char palette[4][4];
+	_bc1Palette( block[0] | ( block[1] << 8 ) , block[2] | ( block[3] << 8 ) , palette );
+	const unsigned indices = block[4] | ( block[5] << 8 ) | ( block[6] << 16 ) | ( (unsigned)block[7] << 24 );
+	for( unsigned i = 0 ; i < 16 ; ++i )
+		memcpy( texels + 4 * i , palette[ ( indices >> ( 2 * i ) ) & 3 ] , 4 );
+}
+
+// decode a bc4 block into one channel of the texels
+static void _decodeBc4( const unsigned char* block , unsigned char* texels , unsigned channel )
+{
+	unsigned char palette[8];
+	_bc4Palette( block[0] , block[1] , palette );
+	unsigned long long indices = 0;
+	for( unsigned i = 0 ; i < 6 ; ++i )
+		indices |= (unsigned long long)block[2 + i] << ( 8 * i );
+	for( unsigned i = 0 ; i < 16 ; ++i )
+		texels[4 * i + channel] = palette[ ( indices >> ( 3 * i ) ) & 7 ];
+}
+
+// decode a bc7 block
+static void _decodeBc7( const unsigned char* block , unsigned char* texels )
+{
+	// the mode is the number of zeros before the first set bit , blocks of the reserved mode are transparent black
+	unsigned mode = 0;
+	while( mode < 8 && !( block[0] & ( 1 << mode ) ) )
+		++mode;
+	if( mode == 8 )
+	{
+		memset( texels , 0 , 16 * 4 );
+		return;
+	}
+	const Bc7Mode& m = g_bc7Modes[mode];
+
+	BlockBits bits;
+	for( unsigned i = 0 ; i < 16 ; ++i )
+		bits.bits[i >> 3] |= (unsigned long long)block[i] << ( 8 * ( i & 7 ) );
+	bits.pos = mode + 1;
+	const unsigned partition = bits.Read( m.partitionBits );
+	const unsigned rotation = bits.Read( m.rotationBits );
+	const unsigned selection = bits.Read( m.selectionBits );
+
+	// the end points are stored channel by channel , the p-bits are the lowest bits of them
+	unsigned char endpoints[3][2][4];
+	for( unsigned c = 0 ; c < 4 ; ++c )
+		for( unsigned s = 0 ; s < m.subsets ; ++s )
+			for( unsigned e = 0 ; e < 2 ; ++e )
+				endpoints[s][e][c] = (unsigned char)bits.Read( c < 3 ? m.colorBits : m.alphaBits );
+	unsigned colorBits = m.colorBits , alphaBits = m.alphaBits;
+	if( m.endpointPBits || m.sharedPBits )
+	{
+		for( unsigned s = 0 ; s < m.subsets ; ++s )
+		{
+			const unsigned shared = m.sharedPBits ? bits.Read( 1 ) : 0;
+			for( unsigned e = 0 ; e < 2 ; ++e )
+			{
+				const unsigned p = m.endpointPBits ? bits.Read( 1 ) : shared;
+				for( unsigned c = 0 ; c < 4 ; ++c )
+					endpoints[s][e][c] = (unsigned char)( ( endpoints[s][e][c] << 1 ) | p );
+			}
+		}
+		++colorBits;
+		++alphaBits;
+	}
+	for( unsigned s = 0 ; s < m.subsets ; ++s )
+		for( unsigned e = 0 ; e < 2 ; ++e )
+		{
+			for( unsigned c = 0 ; c < 3 ; ++c )
+				endpoints[s][e][c] = _expand( endpoints[s][e][c] , colorBits );
+			endpoints[s][e][3] = m.alphaBits ? _expand( endpoints[s][e][3] , alphaBits ) : 255;
+		}
+
+	// the subsets of the texels , the first texel of every subset is an anchor
+	unsigned char subsets[16];
+	for( unsigned i = 0 ; i < 16 ; ++i )
+		subsets[i] = ( m.subsets == 2 ) ? ( ( g_bc7Partitions2[partition] >> i ) & 1 ) : ( m.subsets == 3 ) ? g_bc7Partitions3[partition][i] : 0;
+	bool anchors[16] = { true };
+	if( m.subsets == 2 )
+		anchors[ g_bc7Anchors2[partition] ] = true;
+	else if( m.subsets == 3 )
+		anchors[ g_bc7Anchors3a[partition] ] = anchors[ g_bc7Anchors3b[partition] ] = true;
+
+	unsigned char indices[16] , indices2[16] = { 0 };
+	for( unsigned i = 0 ; i < 16 ; ++i )
+		indices[i] = (unsigned char)bits.Read( m.indexBits - ( anchors[i] ? 1 : 0 ) );
+	if( m.index2Bits )
+		for( unsigned i = 0 ; i < 16 ; ++i )
+			indices2[i] = (unsigned char)bits.Read( m.index2Bits - ( i == 0 ? 1 : 0 ) );
+
+	for( unsigned i = 0 ; i < 16 ; ++i )
+	{
+		// the second indices are for the alpha channel unless the selection bit swaps them
+		unsigned wc = _weight( m.indexBits , indices[i] ) , wa = wc;
+		if( m.index2Bits )
+		{
+			wa = _weight( m.index2Bits , indices2[i] );
+			if( selection )
+				std::swap( wc , wa );
+		}
+		const unsigned char (&ep)[2][4] = endpoints[ subsets[i] ];
+		unsigned char* t = texels + 4 * i;
+		for( unsigned c = 0 ; c < 3 ; ++c )
+			t[c] = _interpolate( ep[0][c] , ep[1][c] , wc );
+		t[3] = _interpolate( ep[0][3] , ep[1][3] , wa );
+		if( rotation )
+			std::swap( t[3] , t[ rotation - 1 ] );
+	}
+}
+
+// encode a bc1 block
+static void _encodeBc1( const unsigned char* texels , unsigned char* block )
+{
+	unsigned char endpoints[2][4];
+	_boundingEndpoints( texels , 3 , endpoints );
+
+	// the larger color goes first for the block to have four colors , they are only equal if all texels quantize to the same color
+	const auto pack = []( const unsigned char* c ){
+		return (unsigned)( ( ( ( c[0] * 31 + 127 ) / 255 ) << 11 ) | ( ( ( c[1] * 63 + 127 ) / 255 ) << 5 ) | ( ( c[2] * 31 + 127 ) / 255 ) );
+	};
+	const unsigned c0 = std::max( pack( endpoints[0] ) , pack( endpoints[1] ) ) , c1 = std::min( pack( endpoints[0] ) , pack( endpoints[1] ) );
+	unsigned char palette[4][4];
+	_bc1Palette( c0 , c1 , palette );
+
+	unsigned indices = 0;
+	if( c0 != c1 )
+	{
+		for( unsigned i = 0 ; i < 16 ; ++i )
+		{
+			unsigned best = 0 , best_distance = _distance( texels + 4 * i , palette[0] , 3 );
+			for( unsigned j = 1 ; j < 4 ; ++j )
+			{
+				const unsigned d = _distance( texels + 4 * i , palette[j] , 3 );
+				if( d < best_distance )
+				{
+					best = j;
+					best_distance = d;
+				}
+			}
+			indices |= best << ( 2 * i );
+		}
+	}
+
+	block[0] = (unsigned char)c0;
+	block[1] = (unsigned char)( c0 >> 8 );
+	block[2] = (unsigned char)c1;
+	block[3] = (unsigned char)( c1 >> 8 );
+	for( unsigned i = 0 ; i < 4 ; ++i )
+		block[4 + i] = (unsigned char)( indices >> ( 8 * i ) );
+}
+
+// encode one channel of the texels into a bc4 block
+static void _encodeBc4( const unsigned char* texels , unsigned channel , unsigned char* block )
+{
+	unsigned char lo = 255 , hi = 0;
+	for( unsigned i = 0 ; i < 16 ; ++i )
+	{
+		lo = std::min( lo , texels[4 * i + channel] );
+		hi = std::max( hi , texels[4 * i + channel] );
+	}
+
+	// the block has eight values unless all texels are equal , they are the first value then
+	unsigned char palette[8];
+	_bc4Palette( hi , lo , palette );
+	unsigned long long indices = 0;
+	if( hi != lo )
+	{
+		for( unsigned i = 0 ; i < 16 ; ++i )
+		{
+			unsigned best = 0 , best_distance = 256;
+			for( unsigned j = 0 ; j < 8 ; ++j )
+			{
+				const unsigned d = (unsigned)std::abs( (int)texels[4 * i + channel] - (int)palette[j] );
+				if( d < best_distance )
+				{
+					best = j;
+					best_distance = d;
+				}
+			}
+			indices |= (unsigned long long)best << ( 3 * i );
+		}
+	}
+
+	block[0] = hi;
+	block[1] = lo;
+	for( unsigned i = 0 ; i < 6 ; ++i )
+		block[2 + i] = (unsigned char)( indices >> ( 8 * i ) );
+}
+
+// encode a bc7 block in mode 6 , one subset of seven bits per channel and a p-bit per end point
+static void _encodeBc7( const unsigned char* texels , unsigned char* block )
+{
+	unsigned char bounds[2][4];
+	_boundingEndpoints( texels , 4 , bounds );
+
+	// the p-bit of an end point is the one quantizing it closer
+	unsigned quantized[2][4] , pbits[2];
+	unsigned char endpoints[2][4];
+	for( unsigned e = 0 ; e < 2 ; ++e )
+	{
+		unsigned best_distance = ~0u;
+		for( unsigned p = 0 ; p < 2 ; ++p )
+		{
+			unsigned q[4];
+			unsigned char v[4];
+			for( unsigned c = 0 ; c < 4 ; ++c )
+			{
+				q[c] = std::min( ( bounds[e][c] + 1 - p ) / 2 , 127u );
+				v[c] = (unsigned char)( ( q[c] << 1 ) | p );
+			}
+			const unsigned d = _distance( bounds[e] , v , 4 );
+			if( d < best_distance )
+			{
+				best_distance = d;
+				pbits[e] = p;
+				memcpy( quantized[e] , q , sizeof( q ) );
+				memcpy( endpoints[e] , v , sizeof( v ) );
+			}
+		}
+	}
+
+	unsigned char palette[16][4];
+	for( unsigned j = 0 ; j < 16 ; ++j )
+		for( unsigned c = 0 ; c < 4 ; ++c )
+			palette[j][c] = _interpolate( endpoints[0][c] , endpoints[1][c] , g_bc7Weights4[j] );
+	unsigned char indices[16];
+	for( unsigned i = 0 ; i < 16 ; ++i )
+	{
+		unsigned best = 0 , best_distance = ~0u;
+		for( unsigned j = 0 ; j < 16 ; ++j )
+		{
+			const unsigned d = _distance( texels + 4 * i , palette[j] , 4 );
+			if( d < best_distance )
+			{
+				best = j;
+				best_distance = d;
+			}
+		}
+		indices[i] = (unsigned char)best;
+	}
+
+	// the highest bit of the anchor index is implicitly zero , the end points are swapped otherwise , the weights are symmetric
+	if( indices[0] & 8 )
+	{
+		std::swap( quantized[0] , quantized[1] );
+		std::swap( pbits[0] , pbits[1] );
+		for( unsigned i = 0 ; i < 16 ; ++i )
+			indices[i] = (unsigned char)( 15 - indices[i] );
+	}
+
+	BlockBits bits;
+	bits.Write( 1 << 6 , 7 );
+	for( unsigned c = 0 ; c < 4 ; ++c )
+	{
+		bits.Write( quantized[0][c] , 7 );
+		bits.Write( quantized[1][c] , 7 );
+	}
+	bits.Write( pbits[0] , 1 );
+	bits.Write( pbits[1] , 1 );
+	for( unsigned i = 0 ; i < 16 ; ++i )
+		bits.Write( indices[i] , i == 0 ? 3 : 4 );
+	for( unsigned i = 0 ; i < 16 ; ++i )
+		block[i] = (unsigned char)( bits.bits[i >> 3] >> ( 8 * ( i & 7 ) ) );
+}
+
+// decode a block
+void DecodeBlock( TEX_FORMAT format , const unsigned char* block , unsigned char* texels )
+{
+	switch( format )
+	{
+	case TF_BC1:
+		_decodeBc1( block , texels );
+		break;
+	case TF_BC4:
+		_decodeBc4( block , texels , 0 );
+		for( unsigned i = 0 ; i < 16 ; ++i )
+		{
+			texels[4 * i + 1] = texels[4 * i + 2] = texels[4 * i];
+			texels[4 * i + 3] = 255;
+		}
+		break;
+	case TF_BC5:
+		_decodeBc4( block , texels , 0 );
+		_decodeBc4( block + 8 , texels , 1 );
+		for( unsigned i = 0 ; i < 16 ; ++i )
+		{
+			texels[4 * i + 2] = 0;
+			texels[4 * i + 3] = 255;
+		}
+		break;
+	default:
+		_decodeBc7( block , texels );
+		break;
+	}
+}
+
+// encode a block
+void EncodeBlock( TEX_FORMAT format , const unsigned char* texels , unsigned char* block )
+{
+	switch( format )
+	{
+	case TF_BC1:
+		_encodeBc1( texels , block );
+		break;
+	case TF_BC4:
+		_encodeBc4( texels , 0 , block );
+		break;
+	case TF_BC5:
+		_encodeBc4( texels , 0 , block );
+		_encodeBc4( texels , 1 , block + 8 );
+		break;
+	default:
+		_encodeBc7( texels , block );
+		break;
+	}
+}
+
+// take the blocks of a block-compressed image
+bool ReadBlockImage( std::shared_ptr<ImgMemory>& mem , TEX_FORMAT format , unsigned width , unsigned height , const unsigned char* blocks , size_t size )
+{
+	const unsigned blocksX = ( width + TEX_BLOCK_SIZE - 1 ) / TEX_BLOCK_SIZE;
+	const unsigned blocksY = ( height + TEX_BLOCK_SIZE - 1 ) / TEX_BLOCK_SIZE;
+	const unsigned bytes = BlockBytes( format );
+	if( width == 0 || height == 0 || size < (size_t)blocksX * blocksY * bytes )
+		return false;
+
+	mem->m_iWidth = width;
+	mem->m_iHeight = height;
+	mem->m_format = format;
+	mem->m_blocks.assign( blocks , blocks + (size_t)blocksX * blocksY * bytes );
+
+	// the decoded image is only used for the average and the lower levels of the mip pyramid
+	mem->m_ImgMem = MakeHugePageArray<Spectrum>( (size_t)width * height );
+	ParallelFor( 0 , blocksY , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		unsigned char texels[16 * 4];
+		for( unsigned by = _start ; by < _end ; ++by )
+			for( unsigned bx = 0 ; bx < blocksX ; ++bx )
+			{
+				DecodeBlock( format , blocks + ( (size_t)by * blocksX + bx ) * bytes , texels );
+				for( unsigned i = 0 ; i < 16 ; ++i )
+				{
+					const unsigned x = bx * TEX_BLOCK_SIZE + i % TEX_BLOCK_SIZE;
+					const unsigned y = by * TEX_BLOCK_SIZE + i / TEX_BLOCK_SIZE;
+					if( x < width && y < height )
+						mem->m_ImgMem[ (size_t)y * width + x ] = Spectrum( texels[4 * i] / 255.0f , texels[4 * i + 1] / 255.0f , texels[4 * i + 2] / 255.0f );
+				}
+			}
+	});
+	return true;
+}
@@ -0,0 +1,68 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#ifndef	SORT_BLOCKCODEC
+#define	SORT_BLOCKCODEC
+
+// include the header file
+#include "sort.h"
+#include "utility/enum.h"
+#include <memory>
+
+class ImgMemory;
+
+// the number of texels in both dimensions of a block
+#define TEX_BLOCK_SIZE	4
+
+// whether the texels of a format are compressed in blocks of 4x4 texels
+inline bool IsBlockFormat( TEX_FORMAT format )
+{
+	return format == TF_BC1 || format == TF_BC4 || format == TF_BC5 || format == TF_BC7;
+}
+
+// the size of a block in bytes
+// para 'format' : the block-compressed format
+inline unsigned BlockBytes( TEX_FORMAT format )
+{
+	return ( format == TF_BC1 || format == TF_BC4 ) ? 8 : 16;
+}
+
+// decode a block
+// para 'format' : the format of the block
+// para 'block'  : the memory of the block
+// para 'texels' : the sixteen texels of the block row by row , four bytes each
+// note          : bc4 is decoded to grey texels and bc5 to texels with zero blue channel , the alpha channel is ignored by the renderer
+void	DecodeBlock( TEX_FORMAT format , const unsigned char* block , unsigned char* texels );
+
+// encode a block
+// para 'format' : the format of the block
+// para 'texels' : the sixteen texels of the block row by row , four bytes each
+// para 'block'  : the memory of the block
+// note          : the end points are corners of the bounding box of the texels , bc7 blocks are always encoded in mode 6
+void	EncodeBlock( TEX_FORMAT format , const unsigned char* texels , unsigned char* block );
+
+// take the blocks of a block-compressed image , they are kept in the memory and decoded as well
+// para 'mem'    : the memory for the image
+// para 'format' : the format of the blocks
+// para 'width'  : width of the image
+// para 'height' : height of the image
+// para 'blocks' : the blocks , row by row from the top of the image
+// para 'size'   : the size of the blocks in bytes
+// result        : 'true' if there are enough blocks for the image
+bool	ReadBlockImage( std::shared_ptr<ImgMemory>& mem , TEX_FORMAT format , unsigned width , unsigned height , const unsigned char* blocks , size_t size );
+
+#endif
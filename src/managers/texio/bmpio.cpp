@@ -59,7 +59,7 @@ __attribute__((aligned(1)))
 BitMapInfoHeader;
 
 // output the bmp file
-bool BmpIO::Write( const string& str , const Texture* tex )
+bool BmpIO::Write( const string& str , const Texture* tex , const TexWriteOption& option )
 {
 	// check if 'str' and 'tex' are valid
 	if( str.empty() || tex == 0 )
@@ -199,7 +199,8 @@ bool BmpIO::Read( const string& str , std::shared_ptr<ImgMemory>& mem )
 
 	// allocate the memory
 	char* data = new char[bytes];
-    mem->m_ImgMem = std::unique_ptr<Spectrum[]>(new Spectrum[w*h]);
+    mem->m_ImgMem = MakeHugePageArray<Spectrum>( w * h );
+    mem->m_format = TF_RGBA8;
 	// read the data
 	file.read( (char*)data , bytes * sizeof( char ) );
 	for( int i = 0 ; i < h ; i++ )
@@ -34,9 +34,10 @@ public:
 	// output the texture into bmp file
 	// para 'str' : the name of the outputed bmp file
 	// para 'tex' :	the texture for outputing
+	// para 'option' : the way the pixels are stored , it is ignored by the formats not supporting it
 	// result     : 'true' if saving is successful
 	// note		  : all of the image we out put is 24-bits
-	bool Write( const string& str , const Texture* tex ) override;
+	bool Write( const string& str , const Texture* tex , const TexWriteOption& option ) override;
 
 	// read data from file
 	// para 'str' : the name of the input entity
@@ -0,0 +1,100 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header
+#include "ddsio.h"
+#include "blockcodec.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include <fstream>
+#include <iterator>
+
+// the four characters of a code in a dds file
+#define DDS_FOURCC( a , b , c , d )	( (unsigned)(a) | ( (unsigned)(b) << 8 ) | ( (unsigned)(c) << 16 ) | ( (unsigned)(d) << 24 ) )
+
+// the size of the magic number and the header , the extended header of dxgi formats follows it
+static const size_t DDS_HEADER_SIZE = 4 + 124;
+static const size_t DDS_DX10_HEADER_SIZE = 20;
+
+// read a little-endian number
+static inline unsigned _read32( const unsigned char* p )
+{
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (unsigned)p[3] << 24 );
+}
+
+// the block-compressed format of a dxgi format , the srgb and typeless variants share the blocks of the unorm ones
+static TEX_FORMAT _dxgiFormat( unsigned dxgi )
+{
+	switch( dxgi )
+	{
+	case 70: case 71: case 72:
+		return TF_BC1;
+	case 79: case 80:
+		return TF_BC4;
+	case 82: case 83:
+		return TF_BC5;
+	case 97: case 98: case 99:
+		return TF_BC7;
+	default:
+		return TF_RGB32F;
+	}
+}
+
+// read data from file
+bool DdsIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
+{
+	std::ifstream file( name.c_str() , std::ios::binary );
+	if( !file.is_open() )
+		return false;
+	const std::vector<unsigned char> data( ( std::istreambuf_iterator<char>( file ) ) , std::istreambuf_iterator<char>() );
+	if( data.size() < DDS_HEADER_SIZE || _read32( &data[0] ) != DDS_FOURCC( 'D' , 'D' , 'S' , ' ' ) || _read32( &data[4] ) != 124 )
+		return false;
+
+	const unsigned height = _read32( &data[12] );
+	const unsigned width = _read32( &data[16] );
+	const unsigned fourcc = _read32( &data[84] );
+
+	// only the formats of 4x4 blocks of unsigned channels are read
+	size_t offset = DDS_HEADER_SIZE;
+	TEX_FORMAT format = TF_RGB32F;
+	if( fourcc == DDS_FOURCC( 'D' , 'X' , 'T' , '1' ) )
+		format = TF_BC1;
+	else if( fourcc == DDS_FOURCC( 'A' , 'T' , 'I' , '1' ) || fourcc == DDS_FOURCC( 'B' , 'C' , '4' , 'U' ) )
+		format = TF_BC4;
+	else if( fourcc == DDS_FOURCC( 'A' , 'T' , 'I' , '2' ) || fourcc == DDS_FOURCC( 'B' , 'C' , '5' , 'U' ) )
+		format = TF_BC5;
+	else if( fourcc == DDS_FOURCC( 'D' , 'X' , '1' , '0' ) && data.size() >= DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE )
+	{
+		format = _dxgiFormat( _read32( &data[DDS_HEADER_SIZE] ) );
+		offset += DDS_DX10_HEADER_SIZE;
+	}
+	if( !IsBlockFormat( format ) )
+	{
+		slog( WARNING , IMAGE , stringFormat( "The format of dds file %s is not supported, only bc1, bc4, bc5 and bc7 are." , name.c_str() ) );
+		return false;
+	}
+
+	// the first level is right after the headers
+	return ReadBlockImage( mem , format , width , height , data.data() + offset , data.size() - offset );
+}
+
+// output the texture into dds file
+bool DdsIO::Write( const string& name , const Texture* tex , const TexWriteOption& option )
+{
+	slog( WARNING , IMAGE , stringFormat( "Can't write %s, dds files are only read." , name.c_str() ) );
+	return false;
+}
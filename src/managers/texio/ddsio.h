@@ -0,0 +1,51 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#ifndef	SORT_DDSIO
+#define	SORT_DDSIO
+
+// include the header file
+#include "texio.h"
+
+////////////////////////////////////////////////////////////////////////////
+// definition of ddsio
+// load the block-compressed dds file from file system into texture , the
+// blocks are kept compressed once the image is tiled. Only the first level
+// of bc1 , bc4 , bc5 and bc7 images is read , the lower levels of the mip
+// pyramid are filtered from it like those of other images.
+class DdsIO : public TexIO
+{
+// public method
+public:
+	// default constructor
+	DdsIO(){m_TexType=TT_DDS;}
+
+	// output the texture into dds file
+	// para 'str' : the name of the outputed dds file
+	// para 'tex' :	the texture for outputing
+	// para 'option' : the way the pixels are stored , it is ignored by the formats not supporting it
+	// result     : it is always 'false' , block-compressed images are only read
+	bool Write( const string& str , const Texture* tex , const TexWriteOption& option ) override;
+
+	// read data from file
+	// para 'str' : the name of the input entity
+	// para 'mem' : the memory for the image
+	// result     :	'true' if the input file is parsed successfully
+    bool Read( const string& str , std::shared_ptr<ImgMemory>& mem ) override;
+};
+
+#endif
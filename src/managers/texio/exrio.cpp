@@ -18,13 +18,19 @@
 // include the header
 #include "exrio.h"
 #include "texture/texture.h"
+#include "texture/rendertarget.h"
 #include <ImfInputFile.h>
+#include <ImfChannelList.h>
 #include <ImathBox.h>
 #include "managers/texmanager.h"
 #include <half.h>
 #include <ImfRgba.h>
 #include <ImfRgbaFile.h>
+#include <ImfOutputFile.h>
+#include <ImfTiledOutputFile.h>
+#include <ImfThreading.h>
 #include "log/log.h"
+#include "utility/multithread/threadpool.h"
 
 using namespace Imf;
 using namespace Imath;
@@ -38,26 +44,26 @@ bool ExrIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
 		mem->m_iWidth  = dw.max.x - dw.min.x + 1;
 		mem->m_iHeight = dw.max.y - dw.min.y + 1;
 
-		half *rgb = new half[3 * mem->m_iWidth * mem->m_iHeight];
+		unsigned total = mem->m_iWidth * mem->m_iHeight;
+        mem->m_ImgMem = MakeHugePageArray<Spectrum>( total );
+
+		// the channels are decoded into the pixels directly , the spectrum is three packed floats
+		static_assert( sizeof( Spectrum ) == 3 * sizeof( float ) , "Pixels are decoded into spectrums directly." );
+		const size_t xstride = sizeof( Spectrum );
+		const size_t ystride = xstride * mem->m_iWidth;
+		char* base = (char*)mem->m_ImgMem.get() - dw.min.x * xstride - dw.min.y * ystride;
 
 		FrameBuffer frameBuffer;
-		frameBuffer.insert("R", Slice(HALF, (char *)rgb,
-			3*sizeof(half), mem->m_iWidth * 3 * sizeof(half), 1, 1, 0.0));
-		frameBuffer.insert("G", Slice(HALF, (char *)rgb+sizeof(half),
-			3*sizeof(half), mem->m_iWidth * 3 * sizeof(half), 1, 1, 0.0));
-		frameBuffer.insert("B", Slice(HALF, (char *)rgb+2*sizeof(half),
-			3*sizeof(half), mem->m_iWidth * 3 * sizeof(half), 1, 1, 0.0));
+		frameBuffer.insert("R", Slice(FLOAT, base, xstride, ystride, 1, 1, 0.0));
+		frameBuffer.insert("G", Slice(FLOAT, base+sizeof(float), xstride, ystride, 1, 1, 0.0));
+		frameBuffer.insert("B", Slice(FLOAT, base+2*sizeof(float), xstride, ystride, 1, 1, 0.0));
 
 		file.setFrameBuffer(frameBuffer);
 		file.readPixels(dw.min.y, dw.max.y);
 
-		unsigned total = mem->m_iWidth * mem->m_iHeight;
-        mem->m_ImgMem = std::unique_ptr<Spectrum[]>( new Spectrum[ total ] );
-
-		for( unsigned i = 0 ; i < total ; i++ )
-			mem->m_ImgMem[i] = Spectrum( rgb[3*i] , rgb[3*i+1] , rgb[3*i+2] );
-
-		SAFE_DELETE_ARRAY( rgb );
+		// half channels keep their precision once the image is tiled
+		const Channel* channel = file.header().channels().findChannel( "R" );
+		mem->m_format = ( channel && channel->type == HALF ) ? TF_RGB16F : TF_RGB32F;
 
 		return true;
     }catch (const std::exception &e) {
@@ -68,35 +74,287 @@ bool ExrIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
 	return true;
 }
 
-// output the texture into bmp file
-bool ExrIO::Write( const string& name , const Texture* tex )
+// read channels of an exr file
+bool ExrIO::ReadChannels( const string& name , const std::vector<string>& channels , std::vector<float>& data , unsigned& width , unsigned& height , TexWriteOption& option )
+{
+	try {
+		InputFile file( name.c_str() );
+		const Box2i dw = file.header().dataWindow();
+		const Box2i display = file.header().displayWindow();
+		width = dw.max.x - dw.min.x + 1;
+		height = dw.max.y - dw.min.y + 1;
+		option.originX = dw.min.x - display.min.x;
+		option.originY = dw.min.y - display.min.y;
+		option.fullWidth = display.max.x - display.min.x + 1;
+		option.fullHeight = display.max.y - display.min.y + 1;
+
+		const size_t cnt = channels.size();
+		data.assign( (size_t)width * height * cnt , 0.0f );
+		const size_t xstride = sizeof( float ) * cnt;
+		const size_t ystride = xstride * width;
+		char* base = (char*)data.data() - dw.min.x * xstride - dw.min.y * ystride;
+
+		FrameBuffer frameBuffer;
+		for( size_t k = 0 ; k < cnt ; ++k ){
+			if( !file.header().channels().findChannel( channels[k].c_str() ) ){
+				slog( WARNING , IMAGE , stringFormat( "Channel %s is missing in image file \"%s\"." , channels[k].c_str() , name.c_str() ) );
+				return false;
+			}
+			frameBuffer.insert( channels[k].c_str() , Slice( FLOAT , base + k * sizeof( float ) , xstride , ystride , 1 , 1 , 0.0 ) );
+		}
+		file.setFrameBuffer( frameBuffer );
+		file.readPixels( dw.min.y , dw.max.y );
+		return true;
+	}catch (const std::exception &e) {
+		slog( WARNING , IMAGE , stringFormat("Unable to read image file \"%s\": %s" , name.c_str() , e.what() ) );
+		return false;
+	}
+}
+
+// get the compression of exr files from its name
+// para 'name'        : the name of the compression
+// para 'compression' : the compression
+// result             : 'false' if the compression is not supported
+static bool _exrCompression( const string& name , Compression& compression )
 {
-	unsigned totalXRes = tex->GetWidth();
-	unsigned totalYRes = tex->GetHeight();
-	unsigned total = totalXRes * totalYRes;
-
-	Rgba *hrgba = new Rgba[total];
-    for (unsigned i = 0; i < total; ++i)
-	{
-		unsigned x = i % totalXRes;
-		unsigned y = i / totalXRes;
-		Spectrum c = tex->GetColor( x , y );
-		hrgba[i] = Rgba( c.GetR() , c.GetG() , c.GetB() , 1.f);
+	static const std::pair<const char*,Compression> compressions[] = {
+		{ "none" , NO_COMPRESSION } , { "rle" , RLE_COMPRESSION } , { "zips" , ZIPS_COMPRESSION } , { "zip" , ZIP_COMPRESSION } ,
+		{ "piz" , PIZ_COMPRESSION } , { "pxr24" , PXR24_COMPRESSION } , { "b44" , B44_COMPRESSION } , { "b44a" , B44A_COMPRESSION } };
+	for( const auto& c : compressions ){
+		if( name == c.first ){
+			compression = c.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+// get the data window of the pixels of an exr file
+// para 'width'  : the width of the pixels
+// para 'height' : the height of the pixels
+// para 'option' : the way the pixels are stored , they could be a region of a larger image
+static Box2i _exrDataWindow( unsigned width , unsigned height , const TexWriteOption& option )
+{
+	const int x = ( option.fullWidth > 0 ) ? (int)option.originX : 0;
+	const int y = ( option.fullHeight > 0 ) ? (int)option.originY : 0;
+	return Box2i( V2i( x , y ) , V2i( x + (int)width - 1 , y + (int)height - 1 ) );
+}
+
+// get the display window of an exr file , it covers the whole image
+static Box2i _exrDisplayWindow( unsigned width , unsigned height , const TexWriteOption& option )
+{
+	const int w = ( option.fullWidth > 0 ) ? (int)option.fullWidth : (int)width;
+	const int h = ( option.fullHeight > 0 ) ? (int)option.fullHeight : (int)height;
+	return Box2i( V2i( 0 , 0 ) , V2i( w - 1 , h - 1 ) );
+}
+
+// convert a row of pixels kept in four floats to half floats , OpenEXR only converts the pixels it reads , not the ones it writes
+static void _exrConvertRow( const float* src , unsigned width , Rgba* dst )
+{
+	for( unsigned x = 0 ; x < width ; ++x , src += RenderTarget::PIXEL_FLOATS )
+		dst[x] = Rgba( src[0] , src[1] , src[2] , 1.f );
+}
+
+// output the texture into exr file
+bool ExrIO::Write( const string& name , const Texture* tex , const TexWriteOption& option )
+{
+	const unsigned width = tex->GetWidth();
+	const unsigned height = tex->GetHeight();
+
+	// the texture is only read , so rows of pixels are converted on all threads
+	// textures keeping their pixels in rows of four floats are read directly instead of a virtual call for each pixel
+	const float* direct = tex->GetPixels();
+	std::unique_ptr<Rgba[]> hrgba( new Rgba[width * height] );
+	ParallelFor( 0 , height , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned y = _start ; y < _end ; ++y ){
+			if( direct ){
+				_exrConvertRow( direct + (size_t)RenderTarget::PIXEL_FLOATS * y * width , width , &hrgba[ y * width ] );
+				continue;
+			}
+			for( unsigned x = 0 ; x < width ; ++x ){
+				const Spectrum c = tex->GetColor( x , y );
+				hrgba[ y * width + x ] = Rgba( c.GetR() , c.GetG() , c.GetB() , 1.f );
+			}
+		}
+	});
+
+	Compression compression = PIZ_COMPRESSION;
+	if( !_exrCompression( option.compression , compression ) )
+		slog( WARNING , IMAGE , stringFormat( "Compression \"%s\" is not supported in exr files, piz is used instead." , option.compression.c_str() ) );
+
+	// the layers are converted the same way , they keep the precision of floats
+	// the ones keeping their pixels in rows of four floats are read by OpenEXR directly without a copy
+	std::vector<std::unique_ptr<float[]>> layers;
+	for( const auto& layer : option.layers ){
+		const unsigned cnt = (unsigned)min( layer.channels.size() , (size_t)3 );
+		if( layer.tex->GetPixels() ){
+			layers.push_back( nullptr );
+			continue;
+		}
+		float* pixels = new float[ width * height * cnt ];
+		layers.push_back( std::unique_ptr<float[]>( pixels ) );
+		ParallelFor( 0 , height , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+			for( unsigned y = _start ; y < _end ; ++y ){
+				for( unsigned x = 0 ; x < width ; ++x ){
+					const Spectrum c = layer.tex->GetColor( x , y );
+					const float rgb[3] = { c.GetR() , c.GetG() , c.GetB() };
+					for( unsigned k = 0 ; k < cnt ; ++k )
+						pixels[ ( y * width + x ) * cnt + k ] = rgb[k];
+				}
+			}
+		});
+	}
+
+	// blocks of scanlines or tiles are compressed by the threads of OpenEXR while the finished ones are written in order
+	if( globalThreadCount() != (int)ThreadPool::GetSingleton().GetThreadNum() )
+		setGlobalThreadCount( ThreadPool::GetSingleton().GetThreadNum() );
+
+	// the pixels of a region are placed in the data window of the whole image
+	const Box2i data_window = _exrDataWindow( width , height , option );
+	const Box2i display_window = _exrDisplayWindow( width , height , option );
+	const size_t origin = data_window.min.x + (size_t)data_window.min.y * width;
+	Header header( display_window , data_window , 1.0f , V2f( 0.0f , 0.0f ) , 1.0f , INCREASING_Y , compression );
+	if( option.tileSize > 0 )
+		header.setTileDescription( TileDescription( option.tileSize , option.tileSize , ONE_LEVEL ) );
+
+	FrameBuffer frameBuffer;
+	const size_t pixel_bytes = sizeof( float ) * RenderTarget::PIXEL_FLOATS;
+	const char* rgba[] = { "R" , "G" , "B" , "A" };
+	for( unsigned k = 0 ; k < 4 ; ++k ){
+		header.channels().insert( rgba[k] , Channel( HALF ) );
+		frameBuffer.insert( rgba[k] , Slice( HALF , (char*)( &hrgba[0].r + k ) - origin * sizeof( Rgba ) , sizeof( Rgba ) , sizeof( Rgba ) * width ) );
+	}
+	for( unsigned i = 0 ; i < layers.size() ; ++i ){
+		const TexLayer& layer = option.layers[i];
+		const unsigned cnt = (unsigned)min( layer.channels.size() , (size_t)3 );
+		for( unsigned k = 0 ; k < cnt ; ++k ){
+			const string channel = layer.name + "." + layer.channels[k];
+			header.channels().insert( channel.c_str() , Channel( FLOAT ) );
+			if( layers[i] )
+				frameBuffer.insert( channel.c_str() , Slice( FLOAT , (char*)( layers[i].get() + k ) - origin * sizeof( float ) * cnt , sizeof( float ) * cnt , sizeof( float ) * cnt * width ) );
+			else
+				frameBuffer.insert( channel.c_str() , Slice( FLOAT , (char*)( layer.tex->GetPixels() + k ) - origin * pixel_bytes , pixel_bytes , pixel_bytes * width ) );
+		}
+	}
+
+	try {
+		if( option.tileSize > 0 ){
+			TiledOutputFile file( name.c_str() , header );
+			file.setFrameBuffer( frameBuffer );
+			file.writeTiles( 0 , file.numXTiles() - 1 , 0 , file.numYTiles() - 1 );
+		}else{
+			OutputFile file( name.c_str() , header );
+			file.setFrameBuffer( frameBuffer );
+			file.writePixels( height );
+		}
+	}
+	catch (const std::exception &e) {
+		slog( WARNING , IMAGE , stringFormat("Unable to write image file \"%s\": %s" , name.c_str() , e.what() ) );
+		return false;
+	}
+
+	return true;
+}
+
+// the file is only created by 'Open'
+ExrTileStream::ExrTileStream()
+{
+}
+
+// the file is closed
+ExrTileStream::~ExrTileStream()
+{
+	Close();
+}
+
+// create the file
+bool ExrTileStream::Open( const string& name , unsigned width , unsigned height , unsigned tileSize , const TexWriteOption& option )
+{
+	Compression compression = PIZ_COMPRESSION;
+	if( !_exrCompression( option.compression , compression ) )
+		slog( WARNING , IMAGE , stringFormat( "Compression \"%s\" is not supported in exr files, piz is used instead." , option.compression.c_str() ) );
+
+	// the tiles are stored in the order they are finished
+	Header header( _exrDisplayWindow( width , height , option ) , _exrDataWindow( width , height , option ) , 1.0f , V2f( 0.0f , 0.0f ) , 1.0f , RANDOM_Y , compression );
+	header.setTileDescription( TileDescription( tileSize , tileSize , ONE_LEVEL ) );
+	const char* rgba[] = { "R" , "G" , "B" , "A" };
+	for( unsigned k = 0 ; k < 4 ; ++k )
+		header.channels().insert( rgba[k] , Channel( HALF ) );
+
+	try {
+		m_file.reset( new TiledOutputFile( name.c_str() , header ) );
+	}
+	catch (const std::exception &e) {
+		slog( WARNING , IMAGE , stringFormat("Unable to write image file \"%s\": %s" , name.c_str() , e.what() ) );
+		return false;
+	}
+	m_name = name;
+	m_width = width;
+	m_height = height;
+	m_tileSize = tileSize;
+	const V2i origin = _exrDataWindow( width , height , option ).min;
+	m_originX = origin.x;
+	m_originY = origin.y;
+	m_written = 0;
+	return true;
+}
+
+// write a tile
+bool ExrTileStream::WriteTile( const Texture* tex , unsigned tx , unsigned ty )
+{
+	if( !m_file )
+		return false;
+
+	// the pixels are converted before taking the lock , only the compression is serialized
+	const unsigned ox = tx * m_tileSize;
+	const unsigned oy = ty * m_tileSize;
+	const unsigned w = min( m_tileSize , m_width - ox );
+	const unsigned h = min( m_tileSize , m_height - oy );
+	std::unique_ptr<Rgba[]> pixels( new Rgba[w * h] );
+	const float* direct = tex->GetPixels();
+	for( unsigned y = 0 ; y < h ; ++y ){
+		if( direct ){
+			_exrConvertRow( direct + (size_t)RenderTarget::PIXEL_FLOATS * ( ( oy + y ) * m_width + ox ) , w , &pixels[ y * w ] );
+			continue;
+		}
+		for( unsigned x = 0 ; x < w ; ++x ){
+			const Spectrum c = tex->GetColor( ox + x , oy + y );
+			pixels[ y * w + x ] = Rgba( c.GetR() , c.GetG() , c.GetB() , 1.f );
+		}
 	}
-	
-    Box2i displayWindow(V2i(0,0), V2i(totalXRes-1, totalYRes-1));
-    Box2i dataWindow(V2i(0, 0), V2i(totalXRes - 1, totalYRes - 1));
-
-    try {
-        RgbaOutputFile file(name.c_str(), displayWindow, dataWindow, WRITE_RGBA);
-        file.setFrameBuffer(hrgba, 1, totalXRes);
-        file.writePixels(totalYRes);
-    }
-    catch (const std::exception &e) {
-        slog( WARNING , IMAGE , stringFormat("Unable to write image file \"%s\": %s" , name.c_str() , e.what() ) );
-    }
 
-    delete[] hrgba;
+	// the frame buffer is addressed by the coordinates in the whole image
+	char* base = (char*)pixels.get() - ( m_originX + ox + (size_t)( m_originY + oy ) * w ) * sizeof( Rgba );
+	FrameBuffer frameBuffer;
+	const char* rgba[] = { "R" , "G" , "B" , "A" };
+	for( unsigned k = 0 ; k < 4 ; ++k )
+		frameBuffer.insert( rgba[k] , Slice( HALF , base + k * sizeof( half ) , sizeof( Rgba ) , sizeof( Rgba ) * w ) );
 
+	std::lock_guard<std::mutex> lock( m_mutex );
+	try {
+		m_file->setFrameBuffer( frameBuffer );
+		m_file->writeTile( tx , ty );
+	}
+	catch (const std::exception &e) {
+		slog( WARNING , IMAGE , stringFormat("Unable to write a tile of image file \"%s\": %s" , m_name.c_str() , e.what() ) );
+		return false;
+	}
+	++m_written;
 	return true;
 }
+
+// close the file
+bool ExrTileStream::Close()
+{
+	if( !m_file )
+		return false;
+	const bool complete = m_written == (unsigned)( m_file->numXTiles() * m_file->numYTiles() );
+	try {
+		m_file.reset();
+	}
+	catch (const std::exception &e) {
+		slog( WARNING , IMAGE , stringFormat("Unable to write image file \"%s\": %s" , m_name.c_str() , e.what() ) );
+		return false;
+	}
+	return complete;
+}
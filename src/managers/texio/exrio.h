@@ -20,6 +20,9 @@
 
 // include the header file
 #include "texio.h"
+#include <mutex>
+
+namespace Imf { class TiledOutputFile; }
 
 ////////////////////////////////////////////////////////////////////////////
 // definition of bmpio
@@ -35,14 +38,71 @@ public:
 	// output the texture into bmp file
 	// para 'str' : the name of the outputed bmp file
 	// para 'tex' :	the texture for outputing
+	// para 'option' : the way the pixels are stored , it is ignored by the formats not supporting it
 	// result     : 'true' if saving is successful
-	bool Write( const string& str , const Texture* tex ) override;
+	bool Write( const string& str , const Texture* tex , const TexWriteOption& option ) override;
 
 	// read data from file
 	// para 'str' : the name of the input entity
 	// para 'mem' : the memory for the image
 	// result     :	'true' if the input file is parsed successfully
     bool Read( const string& str , std::shared_ptr<ImgMemory>& mem ) override;
+
+	// read channels of an exr file in full precision
+	// para 'str'      : the name of the file
+	// para 'channels' : the names of the channels
+	// para 'data'     : the channels of each pixel of the data window one after another
+	// para 'width'    : the width of the data window
+	// para 'height'   : the height of the data window
+	// para 'option'   : the position of the data window in the whole image is written to it
+	// result          : 'false' if the file can't be read or any of the channels is missing
+	static bool ReadChannels( const string& str , const std::vector<string>& channels , std::vector<float>& data , unsigned& width , unsigned& height , TexWriteOption& option );
+};
+
+////////////////////////////////////////////////////////////////////////////
+// definition of ExrTileStream
+// the tiles of an exr file are written one by one as they are finished , in any order.
+// they are stored in the file in the order they are written , the offsets of them are only written once it is closed.
+class ExrTileStream
+{
+public:
+	// constructor and destructor , the file is closed once it is destroyed
+	ExrTileStream();
+	~ExrTileStream();
+
+	// create the file
+	// para 'str'      : the name of the file
+	// para 'width'    : the width of the image
+	// para 'height'   : the height of the image
+	// para 'tileSize' : the size of the tiles
+	// para 'option'   : the way the pixels are stored , the layers are not streamed
+	// result          : 'false' if the file can't be created
+	bool Open( const string& str , unsigned width , unsigned height , unsigned tileSize , const TexWriteOption& option );
+
+	// write a tile , it could be called by any thread
+	// para 'tex' : the texture holding the pixels of the tile
+	// para 'tx'  : the column of the tile
+	// para 'ty'  : the row of the tile
+	// result     : 'false' if the tile is not written
+	bool WriteTile( const Texture* tex , unsigned tx , unsigned ty );
+
+	// close the file
+	// result : 'true' if all the tiles are written
+	bool Close();
+
+private:
+	std::unique_ptr<Imf::TiledOutputFile>	m_file;
+	string		m_name;
+	unsigned	m_width = 0;
+	unsigned	m_height = 0;
+	unsigned	m_tileSize = 0;
+	// the position of the pixels in the whole image
+	int			m_originX = 0;
+	int			m_originY = 0;
+	// the number of tiles written
+	unsigned	m_written = 0;
+	// the file is only written by one thread at a time
+	std::mutex	m_mutex;
 };
 
 #endif
@@ -33,7 +33,7 @@ bool HdrIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
 	mem->m_iHeight = result.height;
 
 	int totalsize = result.width * result.height;
-    mem->m_ImgMem = std::unique_ptr<Spectrum[]>( new Spectrum[ totalsize ] );
+    mem->m_ImgMem = MakeHugePageArray<Spectrum>( totalsize );
 
 	for( int i = 0 ; i < totalsize; ++i )
 		mem->m_ImgMem[i] = Spectrum( result.cols[3*i] , result.cols[3*i+1], result.cols[3*i+2] );
@@ -45,7 +45,7 @@ bool HdrIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
 }
 
 // output the texture into bmp file
-bool HdrIO::Write( const string& name , const Texture* tex )
+bool HdrIO::Write( const string& name , const Texture* tex , const TexWriteOption& option )
 {
 	std::ofstream hdr(name.c_str(), std::ios::binary);
 
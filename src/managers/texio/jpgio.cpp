@@ -35,7 +35,8 @@ bool JpgIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
 	mem->m_iHeight = height;
 
 	// TGA pixels are in BGRA format.
-	mem->m_ImgMem = std::unique_ptr<Spectrum[]>( new Spectrum[width * height] );
+	mem->m_ImgMem = MakeHugePageArray<Spectrum>( width * height );
+	mem->m_format = TF_RGBA8;
 
 	for (int i = 0; i < height; i++)
 		for (int j = 0; j < width; j++)
@@ -54,7 +55,7 @@ bool JpgIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
 }
 
 // output the texture into bmp file
-bool JpgIO::Write( const string& name , const Texture* tex )
+bool JpgIO::Write( const string& name , const Texture* tex , const TexWriteOption& option )
 {
 	const int channel = 3;
 	int width = tex->GetWidth();
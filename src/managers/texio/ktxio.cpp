@@ -0,0 +1,103 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header
+#include "ktxio.h"
+#include "blockcodec.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+// the identifier and the header of a ktx file , the key and value pairs follow it
+static const unsigned char KTX_IDENTIFIER[12] = { 0xab , 'K' , 'T' , 'X' , ' ' , '1' , '1' , 0xbb , '\r' , '\n' , 0x1a , '\n' };
+static const size_t KTX_HEADER_SIZE = 64;
+static const unsigned KTX_ENDIANNESS = 0x04030201;
+
+// read a little-endian number
+static inline unsigned _read32( const unsigned char* p )
+{
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (unsigned)p[3] << 24 );
+}
+
+// the block-compressed format of an internal format of opengl , the srgb variants share the blocks of the linear ones
+static TEX_FORMAT _glFormat( unsigned internal )
+{
+	switch( internal )
+	{
+	case 0x83f0: case 0x83f1: case 0x8c4c: case 0x8c4d:	// GL_COMPRESSED_RGB(A)_S3TC_DXT1_EXT and srgb
+		return TF_BC1;
+	case 0x8dbb:										// GL_COMPRESSED_RED_RGTC1
+		return TF_BC4;
+	case 0x8dbd:										// GL_COMPRESSED_RG_RGTC2
+		return TF_BC5;
+	case 0x8e8c: case 0x8e8d:							// GL_COMPRESSED_(SRGB_ALPHA/RGBA)_BPTC_UNORM
+		return TF_BC7;
+	default:
+		return TF_RGB32F;
+	}
+}
+
+// read data from file
+bool KtxIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
+{
+	std::ifstream file( name.c_str() , std::ios::binary );
+	if( !file.is_open() )
+		return false;
+	const std::vector<unsigned char> data( ( std::istreambuf_iterator<char>( file ) ) , std::istreambuf_iterator<char>() );
+	if( data.size() < KTX_HEADER_SIZE || memcmp( data.data() , KTX_IDENTIFIER , sizeof( KTX_IDENTIFIER ) ) != 0 || _read32( &data[12] ) != KTX_ENDIANNESS )
+		return false;
+
+	const TEX_FORMAT format = _glFormat( _read32( &data[28] ) );
+	const unsigned width = _read32( &data[36] );
+	const unsigned height = std::max( _read32( &data[40] ) , 1u );
+	const unsigned depth = _read32( &data[44] );
+	const unsigned faces = _read32( &data[52] );
+	const size_t keyValueBytes = _read32( &data[60] );
+	if( !IsBlockFormat( format ) || depth > 1 || faces > 1 )
+	{
+		slog( WARNING , IMAGE , stringFormat( "The format of ktx file %s is not supported, only 2d bc1, bc4, bc5 and bc7 images are." , name.c_str() ) );
+		return false;
+	}
+
+	// the rows are taken from the top of the image as most tools write them , blocks flipped upside down can't be turned over
+	size_t offset = KTX_HEADER_SIZE;
+	while( offset + 4 <= KTX_HEADER_SIZE + keyValueBytes && offset + 4 <= data.size() )
+	{
+		const size_t size = _read32( &data[offset] );
+		const char* pair = (const char*)&data[offset + 4];
+		if( size > strlen( "KTXorientation" ) + 1 && offset + 4 + size <= data.size() && strncmp( pair , "KTXorientation" , size ) == 0 &&
+			string( pair , size ).find( "T=u" ) != string::npos )
+			slog( WARNING , IMAGE , stringFormat( "The rows of ktx file %s start from the bottom, the image is upside down." , name.c_str() ) );
+		offset += 4 + ( ( size + 3 ) & ~(size_t)3 );
+	}
+	offset = KTX_HEADER_SIZE + keyValueBytes;
+
+	// the first level is preceded by its size
+	if( offset + 4 > data.size() )
+		return false;
+	const size_t size = std::min( (size_t)_read32( &data[offset] ) , data.size() - offset - 4 );
+	return ReadBlockImage( mem , format , width , height , data.data() + offset + 4 , size );
+}
+
+// output the texture into ktx file
+bool KtxIO::Write( const string& name , const Texture* tex , const TexWriteOption& option )
+{
+	slog( WARNING , IMAGE , stringFormat( "Can't write %s, ktx files are only read." , name.c_str() ) );
+	return false;
+}
@@ -36,7 +36,8 @@ bool PngIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
     // TGA pixels are in BGRA format.
     mem->m_iWidth = width;
     mem->m_iHeight = height;
-    mem->m_ImgMem = std::unique_ptr<Spectrum[]>( new Spectrum[ width * height ] );
+    mem->m_ImgMem = MakeHugePageArray<Spectrum>( width * height );
+    mem->m_format = TF_RGBA8;
 
     for( unsigned i = 0 ; i < height ; i++ )
 		for( unsigned j = 0 ; j < width ; j++ )
@@ -52,7 +53,7 @@ bool PngIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
 }
 
 // output the texture into bmp file
-bool PngIO::Write( const string& name , const Texture* tex )
+bool PngIO::Write( const string& name , const Texture* tex , const TexWriteOption& option )
 {
     std::vector<unsigned char> image; //the raw pixels
     
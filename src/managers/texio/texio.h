@@ -21,11 +21,39 @@
 #include "sort.h"
 #include "utility/enum.h"
 #include <memory>
+#include <vector>
 
 // pre-declare texture class
 class Texture;
 class ImgMemory;
 
+// a named layer stored in the same file as an image
+struct TexLayer
+{
+	// the name of the layer
+	string			name;
+	// the pixels of the layer , it has the same size as the image
+	const Texture*	tex = nullptr;
+	// the names of the channels , there is one letter for each of the first components of the pixels
+	string			channels;
+};
+
+// the way an image is stored in its file
+struct TexWriteOption
+{
+	// the compression of the pixels , it could be 'none' , 'rle' , 'zips' , 'zip' , 'piz' , 'pxr24' , 'b44' or 'b44a' for exr files
+	string		compression = "piz";
+	// the size of the tiles the pixels are stored in , 0 stores them in scanlines
+	unsigned	tileSize = 0;
+	// the layers stored with the image , only exr files keep them
+	std::vector<TexLayer>	layers;
+	// the pixels could be a region of a larger image , exr files keep its position and the size of the whole image
+	unsigned	originX = 0;
+	unsigned	originY = 0;
+	unsigned	fullWidth = 0;
+	unsigned	fullHeight = 0;
+};
+
 ////////////////////////////////////////////////////////////////////////////
 // definition of TexIO
 // TexIO is an abstract class that is responsible for outputing texture
@@ -47,8 +75,9 @@ public:
 	// output the file in different ways
 	// para 'str' : the name of the output entity
 	// para 'tex' : the texture for outputing
+	// para 'option' : the way the pixels are stored , it is ignored by the formats not supporting it
 	// result     : 'true' if outputing is successed
-	virtual bool Write( const string& str , const Texture* tex ) = 0;
+	virtual bool Write( const string& str , const Texture* tex , const TexWriteOption& option ) = 0;
 
 	// read data from file
 	// para 'str' : the name of the input entity
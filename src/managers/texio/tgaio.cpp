@@ -41,7 +41,8 @@ bool TgaIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
 	mem->m_iHeight = img.height;
 
     // TGA pixels are in BGRA format.
-    mem->m_ImgMem = std::unique_ptr<Spectrum[]>( new Spectrum[ img.width * img.height ] );
+    mem->m_ImgMem = MakeHugePageArray<Spectrum>( img.width * img.height );
+    mem->m_format = TF_RGBA8;
 
 	for( int i = 0 ; i < img.height ; i++ )
 		for( int j = 0 ; j < img.width ; j++ )
@@ -65,7 +66,7 @@ bool TgaIO::Read( const string& name , std::shared_ptr<ImgMemory>& mem )
 }
 
 // output the texture into bmp file
-bool TgaIO::Write( const string& name , const Texture* tex )
+bool TgaIO::Write( const string& name , const Texture* tex , const TexWriteOption& option )
 {
     int width = tex->GetWidth();
     int height = tex->GetHeight();
@@ -23,6 +23,8 @@
 #include "texio/pngio.h"
 #include "texio/jpgio.h"
 #include "texio/hdrio.h"
+#include "texio/ddsio.h"
+#include "texio/ktxio.h"
 #include "texture/imagetexture.h"
 #include "utility/strhelper.h"
 #include "utility/define.h"
@@ -32,6 +34,9 @@
 #include "texture/constanttexture.h"
 #include "texture/imagetexture.h"
 #include "log/log.h"
+#include "utility/multithread/threadpool.h"
+#include "utility/fileprefetch.h"
+#include "utility/profiler.h"
 
 // default constructor
 TexManager::TexManager()
@@ -43,10 +48,12 @@ TexManager::TexManager()
     m_TexIOVec.push_back( std::unique_ptr<TexIO>(new PngIO()) );
     m_TexIOVec.push_back( std::unique_ptr<TexIO>(new JpgIO()) );
     m_TexIOVec.push_back( std::unique_ptr<TexIO>(new HdrIO()) );
+    m_TexIOVec.push_back( std::unique_ptr<TexIO>(new DdsIO()) );
+    m_TexIOVec.push_back( std::unique_ptr<TexIO>(new KtxIO()) );
 }
 
 // output texture
-bool TexManager::Write( const string& filename , const Texture* tex )
+bool TexManager::Write( const string& filename , const Texture* tex , const TexWriteOption& option )
 {
 	// get full path name
 	string str = GetFullPath( filename );
@@ -58,7 +65,7 @@ bool TexManager::Write( const string& filename , const Texture* tex )
     const std::unique_ptr<TexIO>& io = FindTexIO( type );
 
 	if( io != nullptr )
-		io->Write( str , tex );
+		io->Write( str , tex , option );
 	
 	return true;
 }
@@ -69,46 +76,144 @@ bool TexManager::Read( const string& filename , ImageTexture* tex )
 	// get full path name
 	string str = filename;
 
-	// get the type
-	TEX_TYPE type = TexTypeFromStr( str );
-
 	// try to find the image first , if it's already existed in the system , just set a pointer
-    auto it = m_ImgContainer.find( str );
-	if( it != m_ImgContainer.end() )
+	if( _find( str , tex ) )
+		return true;
+
+	return _load( str ) && _find( str , tex );
+}
+
+// decode images on all threads before they are read
+void TexManager::Prefetch( const std::vector<string>& files )
+{
+	// every image is only decoded once , even if it is referred by many textures
+	std::vector<string> pending;
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		std::unordered_set<string> unique;
+		for( const auto& str : files )
+		{
+			if( m_TiledContainer.count( str ) || m_ImgContainer.count( str ) || m_Failed.count( str ) || !unique.insert( str ).second )
+				continue;
+			pending.push_back( str );
+		}
+	}
+	if( pending.size() < 2 )
+		return;
+
+	// the files of all images are read ahead , so the images decoded later don't wait for the disk
+	std::vector<string> prefetch;
+	for( const auto& str : pending )
 	{
-		tex->m_pMemory = it->second;
-		tex->m_iTexWidth = it->second->m_iWidth;
-		tex->m_iTexHeight = it->second->m_iHeight;
+		prefetch.push_back( str + ".sorttex" );
+		prefetch.push_back( str );
+	}
+	FilePrefetch::Prefetch( prefetch );
+
+	// each image is a job , the conversion of an image splits into more jobs by itself
+	ParallelFor( 0 , (unsigned)pending.size() , 1 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+		for( unsigned i = _start ; i < _end ; ++i )
+			_load( pending[i] );
+	});
+}
+
+// set an image in the containers to a texture
+bool TexManager::_find( const string& str , ImageTexture* tex ) const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
 
+	auto tit = m_TiledContainer.find( str );
+	if( tit != m_TiledContainer.end() )
+	{
+		if( tex )
+		{
+			tex->m_pTiled = tit->second;
+			tex->m_iTexWidth = tit->second->GetWidth();
+			tex->m_iTexHeight = tit->second->GetHeight();
+		}
 		return true;
 	}
+	auto it = m_ImgContainer.find( str );
+	if( it != m_ImgContainer.end() )
+	{
+		if( tex )
+		{
+			tex->m_pMemory = it->second;
+			tex->m_iTexWidth = it->second->m_iWidth;
+			tex->m_iTexHeight = it->second->m_iHeight;
+		}
+		return true;
+	}
+	return false;
+}
 
-	// find the specific texio first
-    const std::unique_ptr<TexIO>& io = FindTexIO( type );
+// decode an image and insert it into the containers
+bool TexManager::_load( const string& str )
+{
+	SORT_PROFILE( "TexManager::Load" );
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if( m_Failed.count( str ) )
+			return false;
+	}
 
-	bool read = false;
-	if( io != nullptr )
+	// find the specific texio first
+	const std::unique_ptr<TexIO>& io = FindTexIO( TexTypeFromStr( str ) );
+	if( io == nullptr )
+		return false;
+
+	// the tiles are read from the conversion next to the image if it is still valid
+	const string cache_file = str + ".sorttex";
+	std::shared_ptr<ImgMemory> mem;
+	TiledImage* tiled = m_TexCache.Load( cache_file , str );
+	if( tiled == nullptr )
 	{
 		// create a new memory
-        std::shared_ptr<ImgMemory> mem = std::make_shared<ImgMemory>();
+		mem = std::make_shared<ImgMemory>();
 
 		// read the data
-		read = io->Read( str , mem );
-
-		if( read )
+		if( !io->Read( str , mem ) )
+		{
+			slog( WARNING , IMAGE , stringFormat("Can't load image file %s." , str.c_str() ) );
+			std::lock_guard<std::mutex> lock( m_mutex );
+			m_Failed.insert( str );
+			return false;
+		}
+
+		// the decoded image is only needed during the conversion
+		tiled = m_TexCache.Create( cache_file , str , *mem );
+		if( tiled )
+			mem.reset();
+		else
 		{
-			// set the texture
-			tex->m_pMemory = mem;
-			tex->m_iTexWidth = mem->m_iWidth;
-			tex->m_iTexHeight = mem->m_iHeight;
-			
-			// insert it into the container
-			m_ImgContainer.insert( make_pair( str , mem ) );
-		}else
-            slog( WARNING , IMAGE , stringFormat("Can't load image file Ts." , str.c_str() ) );
+			// the decoded texels are looked up directly , the blocks are not needed any more
+			std::vector<unsigned char>().swap( mem->m_blocks );
+			mem->m_tracker.Set( sizeof( Spectrum ) * mem->m_iWidth * mem->m_iHeight );
+		}
 	}
 
-	return read;
+	// insert it into the container
+	std::lock_guard<std::mutex> lock( m_mutex );
+	if( tiled )
+		m_TiledContainer.emplace( str , tiled );
+	else
+		m_ImgContainer.emplace( str , std::move( mem ) );
+	return true;
+}
+
+// get the average color of the image
+Spectrum ImgMemory::GetAverage() const
+{
+	// rows are summed in parallel
+	Spectrum average = ParallelReduce( 0 , m_iHeight , 16 , Spectrum() , [&]( unsigned _start , unsigned _end ){
+		Spectrum sum;
+		for( unsigned i = _start ; i < _end ; ++i )
+			for( unsigned j = 0 ; j < m_iWidth ; ++j )
+				sum += m_ImgMem[ i * m_iWidth + j ];
+		return sum;
+	} , []( const Spectrum& a , const Spectrum& b ){ return a + b; } );
+
+	return average / (float)( m_iWidth * m_iHeight );
 }
 
 // find correct texio
@@ -22,9 +22,14 @@
 #include "utility/enum.h"
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <mutex>
 #include <memory>
 #include "spectrum/spectrum.h"
 #include "managers/texio/texio.h"
+#include "utility/memstats.h"
+#include "utility/hugepage.h"
+#include "texcache.h"
 
 class Texture;
 class ImageTexture;
@@ -32,9 +37,17 @@ class ImageTexture;
 class ImgMemory
 {
 public:
-    std::unique_ptr<Spectrum[]>	m_ImgMem;
+    HugePageArray<Spectrum>     m_ImgMem;
 	unsigned                    m_iWidth;
 	unsigned                    m_iHeight;
+	// the precision of the image file , the texels are stored in it once the image is tiled
+	TEX_FORMAT                  m_format = TF_RGB32F;
+	// the blocks of the full resolution image if the file is block-compressed , 'm_format' is the format of them
+	std::vector<unsigned char>  m_blocks;
+	MemoryTracker               m_tracker{ MEM_TEXTURE };
+
+	// get the average color of the image
+	Spectrum GetAverage() const;
 };
 
 //////////////////////////////////////////////////////////////////
@@ -43,7 +56,10 @@ public:
 //			Other textures will not be managed here. And it's also
 //			responsible for deallocating image memory. Two image 
 //			texture will share the same image data if they are
-//			loaded from the same image file.
+//			loaded from the same image file. Images are converted into
+//			tiled mip pyramids on first use and their tiles are read by
+//			the texture cache on demand , an image is only kept in memory
+//			as a whole if the conversion fails.
 class TexManager : public Singleton<TexManager>
 {
 // public method
@@ -51,15 +67,30 @@ public:
 	// output the img
 	// para 'str' :	name of the output entity
 	// para 'tex' : texture of the output
-	// para 'type': the way we output the texture
+	// para 'option' : the way the pixels are stored in the file
 	// result     : 'true' if the texture is output successfully
-	bool Write( const string& str , const Texture* tex );
+	bool Write( const string& str , const Texture* tex , const TexWriteOption& option = TexWriteOption() );
 
 	// load the image from file , if the specific image is already existed in the current system , just return the pointer
 	// para 'str'  : name of the image file
 	// para 'tex'  : output to the texture
 	// result      : 'true' if loading is successful
 	bool Read( const string& str , ImageTexture* tex );
+
+	// decode images on all threads before they are read
+	// para 'files' : names of the image files , images already loaded or failed to load are skipped
+	// note         : the images are only decoded and converted here , textures still get them through 'Read'
+	void Prefetch( const std::vector<string>& files );
+
+	// set the budget of the texture cache
+	// para 'bytes' : the maximum size of resident tiles , zero keeps all tiles once they are read
+	void SetCacheBudget( size_t bytes ) { m_TexCache.SetBudget( bytes ); }
+
+	// output log information
+	void OutputLog() const { m_TexCache.OutputLog(); }
+
+	// add the usage of the texture cache to a group of the statistics report
+	void CollectStats( StatsGroup& stats ) const { m_TexCache.CollectStats( stats ); }
     
 // private data
 private:
@@ -69,6 +100,17 @@ private:
 
 	// map a string to the image memory
     unordered_map< string , std::shared_ptr<ImgMemory> > m_ImgContainer;
+	// map a string to the tiled image
+    unordered_map< string , TiledImage* > m_TiledContainer;
+
+	// names of the images failed to load , they are not decoded again
+	unordered_set< string > m_Failed;
+
+	// the cache of tiled images
+	TexCache	m_TexCache;
+
+	// the mutex guarding the containers , images could be decoded by many threads
+	mutable std::mutex	m_mutex;
 
 // private method
 private:
@@ -78,5 +120,17 @@ private:
 	// find correct texio
     const std::unique_ptr<TexIO>&	FindTexIO( TEX_TYPE tt ) const;
 
+	// set an image in the containers to a texture
+	// para 'str' : name of the image file
+	// para 'tex' : the texture , it could be nullptr to check the existence only
+	// result     : 'true' if the image is in the containers
+	bool	_find( const string& str , ImageTexture* tex ) const;
+
+	// decode an image and insert it into the containers
+	// para 'str' : name of the image file
+	// result     : 'true' if the image is loaded
+	// note       : it is thread-safe , the decoding happens outside of the lock
+	bool	_load( const string& str );
+
 	friend class Singleton<TexManager>;
 };
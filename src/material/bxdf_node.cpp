@@ -22,6 +22,7 @@
 #include "bsdf/microfacet.h"
 #include "managers/memmanager.h"
 #include "bsdf/bsdf.h"
+#include "material_program.h"
 
 IMPLEMENT_CREATOR( LayeredBxdfNode );
 IMPLEMENT_CREATOR( LambertNode );
@@ -31,6 +32,117 @@ IMPLEMENT_CREATOR( OrenNayarNode );
 IMPLEMENT_CREATOR( MicrofacetReflectionNode );
 IMPLEMENT_CREATOR( MicrofacetRefractionNode );
 
+// distributions and visibility terms of compiled microfacet nodes
+enum MF_DIST_TYPE { MF_DIST_BLINN , MF_DIST_BECKMANN , MF_DIST_GGX };
+enum MF_VIS_TYPE { MF_VIS_NEUMANN , MF_VIS_KELEMEN , MF_VIS_SCHLICK , MF_VIS_SMITH , MF_VIS_SMITH_JOINT_APPROX , MF_VIS_COOK_TORRANCE , MF_VIS_IMPLICIT };
+
+// resolve the distribution from its name , GGX is default
+static unsigned mfDistType( const string& name )
+{
+	if( name == "Blinn" )
+		return MF_DIST_BLINN;
+	if( name == "Beckmann" )
+		return MF_DIST_BECKMANN;
+	return MF_DIST_GGX;
+}
+
+// resolve the visibility term from its name , implicit visibility term is default
+static unsigned mfVisType( const string& name )
+{
+	if( name == "Neumann" )
+		return MF_VIS_NEUMANN;
+	if( name == "Kelemen" )
+		return MF_VIS_KELEMEN;
+	if( name == "Schlick" )
+		return MF_VIS_SCHLICK;
+	if( name == "Smith" )
+		return MF_VIS_SMITH;
+	if( name == "SmithJointApprox" )
+		return MF_VIS_SMITH_JOINT_APPROX;
+	if( name == "CookTorrance" )
+		return MF_VIS_COOK_TORRANCE;
+	return MF_VIS_IMPLICIT;
+}
+
+// the size of the slot of any distribution and any visibility term
+static unsigned mfSlotSize()
+{
+	const unsigned dist = max( MaterialProgram::SlotSize<Blinn>() , max( MaterialProgram::SlotSize<Beckmann>() , MaterialProgram::SlotSize<GGX>() ) );
+	unsigned vis = max( MaterialProgram::SlotSize<VisNeumann>() , MaterialProgram::SlotSize<VisKelemen>() );
+	vis = max( vis , max( MaterialProgram::SlotSize<VisSchlick>() , MaterialProgram::SlotSize<VisSmith>() ) );
+	vis = max( vis , max( MaterialProgram::SlotSize<VisSmithJointApprox>() , MaterialProgram::SlotSize<VisCookTorrance>() ) );
+	vis = max( vis , MaterialProgram::SlotSize<VisImplicit>() );
+	return dist + vis;
+}
+
+// construct the distribution and the visibility term in the slot
+static void mfConstruct( char*& slot , unsigned dist_type , unsigned vis_type , float rn , MicroFacetDistribution*& dist , VisTerm*& vis )
+{
+	char* dist_slot = slot;
+	char* vis_slot = slot + max( MaterialProgram::SlotSize<Blinn>() , max( MaterialProgram::SlotSize<Beckmann>() , MaterialProgram::SlotSize<GGX>() ) );
+	switch( dist_type )
+	{
+	case MF_DIST_BLINN:		dist = MaterialProgram::Construct<Blinn>( dist_slot , rn ); break;
+	case MF_DIST_BECKMANN:	dist = MaterialProgram::Construct<Beckmann>( dist_slot , rn ); break;
+	default:				dist = MaterialProgram::Construct<GGX>( dist_slot , rn ); break;
+	}
+	switch( vis_type )
+	{
+	case MF_VIS_NEUMANN:			vis = MaterialProgram::Construct<VisNeumann>( vis_slot ); break;
+	case MF_VIS_KELEMEN:			vis = MaterialProgram::Construct<VisKelemen>( vis_slot ); break;
+	case MF_VIS_SCHLICK:			vis = MaterialProgram::Construct<VisSchlick>( vis_slot , rn ); break;
+	case MF_VIS_SMITH:				vis = MaterialProgram::Construct<VisSmith>( vis_slot , rn ); break;
+	case MF_VIS_SMITH_JOINT_APPROX:	vis = MaterialProgram::Construct<VisSmithJointApprox>( vis_slot , rn ); break;
+	case MF_VIS_COOK_TORRANCE:		vis = MaterialProgram::Construct<VisCookTorrance>( vis_slot ); break;
+	default:						vis = MaterialProgram::Construct<VisImplicit>( vis_slot ); break;
+	}
+	slot += mfSlotSize();
+}
+
+// the size of the slot of any common microfacet reflection
+static unsigned mfReflectionSlotSize()
+{
+	const unsigned ct = max( MaterialProgram::SlotSize<MicroFacetReflectionBlinnCookTorrance>() , max( MaterialProgram::SlotSize<MicroFacetReflectionBeckmannCookTorrance>() , MaterialProgram::SlotSize<MicroFacetReflectionGGXCookTorrance>() ) );
+	return max( ct , MaterialProgram::SlotSize<MicroFacetReflectionGGXSmithJoint>() );
+}
+
+// the size of the slot of any common microfacet refraction
+static unsigned mfRefractionSlotSize()
+{
+	const unsigned ct = max( MaterialProgram::SlotSize<MicroFacetRefractionBlinnCookTorrance>() , MaterialProgram::SlotSize<MicroFacetRefractionGGXCookTorrance>() );
+	return max( ct , MaterialProgram::SlotSize<MicroFacetRefractionGGXSmithJoint>() );
+}
+
+// construct a common microfacet reflection with its terms held by value , nullptr is returned for the other combinations
+static Bxdf* mfReflectionConstruct( char* slot , unsigned dist_type , unsigned vis_type , float rn , const Spectrum& reflectance , const FresnelConductor& fresnel )
+{
+	if( vis_type == MF_VIS_COOK_TORRANCE )
+	{
+		switch( dist_type )
+		{
+		case MF_DIST_BLINN:		return MaterialProgram::Construct<MicroFacetReflectionBlinnCookTorrance>( slot , reflectance , fresnel , Blinn( rn ) , VisCookTorrance() );
+		case MF_DIST_BECKMANN:	return MaterialProgram::Construct<MicroFacetReflectionBeckmannCookTorrance>( slot , reflectance , fresnel , Beckmann( rn ) , VisCookTorrance() );
+		default:				return MaterialProgram::Construct<MicroFacetReflectionGGXCookTorrance>( slot , reflectance , fresnel , GGX( rn ) , VisCookTorrance() );
+		}
+	}
+	if( dist_type == MF_DIST_GGX && vis_type == MF_VIS_SMITH_JOINT_APPROX )
+		return MaterialProgram::Construct<MicroFacetReflectionGGXSmithJoint>( slot , reflectance , fresnel , GGX( rn ) , VisSmithJointApprox( rn ) );
+	return nullptr;
+}
+
+// construct a common microfacet refraction with its terms held by value , nullptr is returned for the other combinations
+static Bxdf* mfRefractionConstruct( char* slot , unsigned dist_type , unsigned vis_type , float rn , const Spectrum& reflectance , float in_eta , float ext_eta )
+{
+	const FresnelDielectric fresnel( in_eta , ext_eta );
+	if( vis_type == MF_VIS_COOK_TORRANCE && dist_type == MF_DIST_BLINN )
+		return MaterialProgram::Construct<MicroFacetRefractionBlinnCookTorrance>( slot , reflectance , fresnel , Blinn( rn ) , VisCookTorrance() , in_eta , ext_eta );
+	if( vis_type == MF_VIS_COOK_TORRANCE && dist_type == MF_DIST_GGX )
+		return MaterialProgram::Construct<MicroFacetRefractionGGXCookTorrance>( slot , reflectance , fresnel , GGX( rn ) , VisCookTorrance() , in_eta , ext_eta );
+	if( vis_type == MF_VIS_SMITH_JOINT_APPROX && dist_type == MF_DIST_GGX )
+		return MaterialProgram::Construct<MicroFacetRefractionGGXSmithJoint>( slot , reflectance , fresnel , GGX( rn ) , VisSmithJointApprox( rn ) , in_eta , ext_eta );
+	return nullptr;
+}
+
 LayeredBxdfNode::LayeredBxdfNode(){
     for( int i = 0 ; i < MAX_BXDF_COUNT ; ++i ){
         m_props.insert( make_pair( "Bxdf" + to_string(i) , &bxdfs[i] ) );
@@ -67,6 +179,14 @@ void LayeredBxdfNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
         bxdfs[i].UpdateBsdf(bsdf, weights[i].GetPropertyValue(bsdf).ToSpectrum());
 }
 
+// the weight of each layer is its own weight , the same as 'UpdateBSDF'
+void LayeredBxdfNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+    for( int i = 0 ; i < MAX_BXDF_COUNT ; ++i )
+        if( bxdfs[i].node )
+            bxdfs[i].CompileBxdf( program , weights[i].CompileValue( program ) );
+}
+
 // check validation
 bool BxdfNode::CheckValidation()
 {
@@ -95,9 +215,23 @@ void LambertNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
 	bsdf->AddBxdf( lambert );
 }
 
+void LambertNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	const unsigned inputs[] = { baseColor.CompileValue( program ) };
+	program.AddBxdf( this , weight , inputs , 1 , MaterialProgram::SlotSize<Lambert>() );
+}
+
+void LambertNode::EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs )
+{
+	Lambert* lambert = MaterialProgram::Construct<Lambert>( slot , r[inputs[0]].ToSpectrum() );
+	lambert->m_weight = weight;
+	bsdf->AddBxdf( lambert );
+}
+
 MerlNode::MerlNode()
 {
 	m_props.insert( make_pair( "Filename" , &merlfile ) );
+	m_props.insert( make_pair( "Half" , &halfprec ) );
 }
 
 void MerlNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
@@ -106,6 +240,18 @@ void MerlNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
 	bsdf->AddBxdf( &merl );
 }
 
+// the measured data is shared by all hits , there is nothing to construct
+void MerlNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	program.AddBxdf( this , weight , nullptr , 0 , 0 );
+}
+
+void MerlNode::EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs )
+{
+	merl.m_weight = weight;
+	bsdf->AddBxdf( &merl );
+}
+
 // post process
 void MerlNode::PostProcess()
 {
@@ -113,7 +259,7 @@ void MerlNode::PostProcess()
 		return;
 
 	if( merlfile.str.empty() == false )
-		merl.LoadData( merlfile.str );
+		merl.LoadData( merlfile.str , halfprec.str == "true" || halfprec.str == "1" );
 }
 
 FourierBxdfNode::FourierBxdfNode()
@@ -127,6 +273,18 @@ void FourierBxdfNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
     bsdf->AddBxdf( &fourierBxdf );
 }
 
+// the table is shared by all hits , there is nothing to construct
+void FourierBxdfNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+    program.AddBxdf( this , weight , nullptr , 0 , 0 );
+}
+
+void FourierBxdfNode::EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs )
+{
+    fourierBxdf.m_weight = weight;
+    bsdf->AddBxdf( &fourierBxdf );
+}
+
 // post process
 void FourierBxdfNode::PostProcess()
 {
@@ -150,6 +308,19 @@ void OrenNayarNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
 	bsdf->AddBxdf( orennayar );
 }
 
+void OrenNayarNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	const unsigned inputs[] = { baseColor.CompileValue( program ) , roughness.CompileValue( program ) };
+	program.AddBxdf( this , weight , inputs , 2 , MaterialProgram::SlotSize<OrenNayar>() );
+}
+
+void OrenNayarNode::EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs )
+{
+	OrenNayar* orennayar = MaterialProgram::Construct<OrenNayar>( slot , r[inputs[0]].ToSpectrum() , r[inputs[1]].x );
+	orennayar->m_weight = weight;
+	bsdf->AddBxdf( orennayar );
+}
+
 MicrofacetReflectionNode::MicrofacetReflectionNode()
 {
 	m_props.insert( make_pair( "BaseColor" , &baseColor ) );
@@ -189,7 +360,38 @@ void MicrofacetReflectionNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
 
 	Fresnel* frenel = SORT_MALLOC( FresnelConductor )( eta.GetPropertyValue(bsdf).ToSpectrum() , k.GetPropertyValue(bsdf).ToSpectrum() );
 
-	MicroFacetReflection* mf = SORT_MALLOC(MicroFacetReflection)( baseColor.GetPropertyValue(bsdf).ToSpectrum() , frenel , dist , vis);
+	MicroFacetReflection* mf = SORT_MALLOC(MicroFacetReflection)( baseColor.GetPropertyValue(bsdf).ToSpectrum() , *frenel , *dist , *vis);
+	mf->m_weight = weight;
+	bsdf->AddBxdf( mf );
+}
+
+void MicrofacetReflectionNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	m_distType = mfDistType( mf_dist.str );
+	m_visType = mfVisType( mf_vis.str );
+
+	const unsigned inputs[] = { baseColor.CompileValue( program ) , roughness.CompileValue( program ) , eta.CompileValue( program ) , k.CompileValue( program ) };
+	const unsigned size = max( mfSlotSize() + MaterialProgram::SlotSize<FresnelConductor>() + MaterialProgram::SlotSize<MicroFacetReflection>() , mfReflectionSlotSize() );
+	program.AddBxdf( this , weight , inputs , 4 , size );
+}
+
+void MicrofacetReflectionNode::EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs )
+{
+	const float rn = clamp( r[inputs[1]].x , 0.001f , 1.0f );
+	const FresnelConductor fresnel( r[inputs[2]].ToSpectrum() , r[inputs[3]].ToSpectrum() );
+
+	// the terms of the common combinations are called statically , the others are constructed separately
+	Bxdf* mf = mfReflectionConstruct( slot , m_distType , m_visType , rn , r[inputs[0]].ToSpectrum() , fresnel );
+	if( !mf )
+	{
+		MicroFacetDistribution* dist = 0;
+		VisTerm* vis = 0;
+		mfConstruct( slot , m_distType , m_visType , rn , dist , vis );
+
+		Fresnel* frenel = MaterialProgram::Construct<FresnelConductor>( slot , fresnel );
+
+		mf = MaterialProgram::Construct<MicroFacetReflection>( slot , r[inputs[0]].ToSpectrum() , *frenel , *dist , *vis );
+	}
 	mf->m_weight = weight;
 	bsdf->AddBxdf( mf );
 }
@@ -235,7 +437,39 @@ void MicrofacetRefractionNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
 	float ext_eta = ext_ior.GetPropertyValue(bsdf).x;
 	Fresnel* frenel = SORT_MALLOC( FresnelDielectric )( in_eta , ext_eta );
 
-	MicroFacetRefraction* mf = SORT_MALLOC(MicroFacetRefraction)( baseColor.GetPropertyValue(bsdf).ToSpectrum() , frenel , dist , vis , in_eta , ext_eta );
+	MicroFacetRefraction* mf = SORT_MALLOC(MicroFacetRefraction)( baseColor.GetPropertyValue(bsdf).ToSpectrum() , *frenel , *dist , *vis , in_eta , ext_eta );
+	mf->m_weight = weight;
+	bsdf->AddBxdf( mf );
+}
+
+void MicrofacetRefractionNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	m_distType = mfDistType( mf_dist.str );
+	m_visType = mfVisType( mf_vis.str );
+
+	const unsigned inputs[] = { baseColor.CompileValue( program ) , roughness.CompileValue( program ) , in_ior.CompileValue( program ) , ext_ior.CompileValue( program ) };
+	const unsigned size = max( mfSlotSize() + MaterialProgram::SlotSize<FresnelDielectric>() + MaterialProgram::SlotSize<MicroFacetRefraction>() , mfRefractionSlotSize() );
+	program.AddBxdf( this , weight , inputs , 4 , size );
+}
+
+void MicrofacetRefractionNode::EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs )
+{
+	const float rn = clamp( r[inputs[1]].x , 0.05f , 1.0f );
+	const float in_eta = r[inputs[2]].x;
+	const float ext_eta = r[inputs[3]].x;
+
+	// the terms of the common combinations are called statically , the others are constructed separately
+	Bxdf* mf = mfRefractionConstruct( slot , m_distType , m_visType , rn , r[inputs[0]].ToSpectrum() , in_eta , ext_eta );
+	if( !mf )
+	{
+		MicroFacetDistribution* dist = 0;
+		VisTerm* vis = 0;
+		mfConstruct( slot , m_distType , m_visType , rn , dist , vis );
+
+		Fresnel* frenel = MaterialProgram::Construct<FresnelDielectric>( slot , in_eta , ext_eta );
+
+		mf = MaterialProgram::Construct<MicroFacetRefraction>( slot , r[inputs[0]].ToSpectrum() , *frenel , *dist , *vis , in_eta , ext_eta );
+	}
 	mf->m_weight = weight;
 	bsdf->AddBxdf( mf );
 }
@@ -43,6 +43,8 @@ public:
     LayeredBxdfNode();
     // update bsdf
     void UpdateBSDF( Bsdf* bsdf , Spectrum weight = 1.0f ) override;
+    // compile the bxdfs of the layers
+    void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
     // check validation
     bool CheckValidation() override;
     
@@ -63,6 +65,11 @@ public:
 	// update bsdf
     void UpdateBSDF( Bsdf* bsdf , Spectrum weight = 1.0f ) override;
 
+    // compile the bxdf of the node
+    void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+    // construct the bxdf of the node
+    void EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs ) override;
+
 private:
 	MaterialNodeProperty	baseColor;
 };
@@ -79,11 +86,17 @@ public:
 	// update bsdf
     void UpdateBSDF( Bsdf* bsdf , Spectrum weight = 1.0f ) override;
 
+    // compile the bxdf of the node
+    void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+    // construct the bxdf of the node
+    void EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs ) override;
+
 	// post process
     void PostProcess() override;
 
 private:
 	MaterialNodePropertyString	merlfile;
+	MaterialNodePropertyString	halfprec;	// the data is stored as half if it's 'true'
 
 	// the merl data
 	Merl merl;
@@ -100,6 +113,11 @@ public:
     
     // update bsdf
     void UpdateBSDF( Bsdf* bsdf , Spectrum weight = 1.0f ) override;
+
+    // compile the bxdf of the node
+    void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+    // construct the bxdf of the node
+    void EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs ) override;
     
     // post process
     void PostProcess() override;
@@ -123,6 +141,11 @@ public:
 	// update bsdf
     void UpdateBSDF( Bsdf* bsdf , Spectrum weight = 1.0f ) override;
 
+    // compile the bxdf of the node
+    void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+    // construct the bxdf of the node
+    void EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs ) override;
+
 private:
 	MaterialNodeProperty	baseColor;
 	MaterialNodeProperty	roughness;
@@ -139,6 +162,11 @@ public:
 	// update bsdf
     void UpdateBSDF( Bsdf* bsdf , Spectrum weight = 1.0f ) override;
 
+    // compile the bxdf of the node
+    void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+    // construct the bxdf of the node
+    void EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs ) override;
+
 private:
 	MaterialNodeProperty	baseColor;
 	MaterialNodeProperty	roughness;
@@ -146,6 +174,10 @@ private:
 	MaterialNodeProperty	k;
 	MaterialNodePropertyString	mf_dist;
 	MaterialNodePropertyString	mf_vis;
+
+	// the distribution and the visibility term , they are resolved from their names when compiling
+	unsigned	m_distType = 0;
+	unsigned	m_visType = 0;
 };
 
 // Microfacet node
@@ -159,6 +191,11 @@ public:
 	// update bsdf
     void UpdateBSDF( Bsdf* bsdf , Spectrum weight = 1.0f ) override;
 
+    // compile the bxdf of the node
+    void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+    // construct the bxdf of the node
+    void EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs ) override;
+
 private:
 	MaterialNodeProperty	baseColor;
 	MaterialNodeProperty	roughness;
@@ -166,4 +203,8 @@ private:
 	MaterialNodeProperty	ext_ior;
 	MaterialNodePropertyString	mf_dist;
 	MaterialNodePropertyString	mf_vis;
+
+	// the distribution and the visibility term , they are resolved from their names when compiling
+	unsigned	m_distType = 0;
+	unsigned	m_visType = 0;
 };
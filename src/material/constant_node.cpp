@@ -16,14 +16,22 @@
  */
 
 #include "constant_node.h"
+#include "material_program.h"
 #include "geometry/intersection.h"
 #include "bsdf/bsdf.h"
+#include "managers/memmanager.h"
 
 IMPLEMENT_CREATOR( GridTexNode );
 IMPLEMENT_CREATOR( CheckBoxTexNode );
 IMPLEMENT_CREATOR( ImageTexNode );
 IMPLEMENT_CREATOR( ConstantColorNode );
 
+// compile the value of the node
+unsigned ConstantNode::CompileValue( MaterialProgram& program )
+{
+	return program.AddNode( this );
+}
+
 GridTexNode::GridTexNode()
 {
 	m_props.insert( make_pair( "Color1" , &src0 ) );
@@ -33,9 +41,8 @@ GridTexNode::GridTexNode()
 // get property value
 MaterialPropertyValue GridTexNode::GetNodeValue( Bsdf* bsdf )
 {
-	// get intersection
-	const Intersection* intesection = bsdf->GetIntersection();
-	return FromSpectrum( grid_tex.GetColorFromUV( intesection->u * 10.0f , intesection->v * 10.0f ) );
+	const TexLookup& lookup = bsdf->GetTexLookup();
+	return FromSpectrum( grid_tex.GetColorFromUV( lookup.u * 10.0f , lookup.v * 10.0f ) );
 }
 
 // post process
@@ -71,9 +78,8 @@ CheckBoxTexNode::CheckBoxTexNode()
 // get property value
 MaterialPropertyValue CheckBoxTexNode::GetNodeValue( Bsdf* bsdf )
 {
-	// get intersection
-	const Intersection* intesection = bsdf->GetIntersection();
-	return FromSpectrum( checkbox_tex.GetColorFromUV( intesection->u * 10.0f , intesection->v * 10.0f ) );
+	const TexLookup& lookup = bsdf->GetTexLookup();
+	return FromSpectrum( checkbox_tex.GetColorFromUV( lookup.u * 10.0f , lookup.v * 10.0f ) );
 }
 
 // post process
@@ -108,9 +114,25 @@ ImageTexNode::ImageTexNode()
 // get property value
 MaterialPropertyValue ImageTexNode::GetNodeValue( Bsdf* bsdf )
 {
-	// get intersection
-	const Intersection* intesection = bsdf->GetIntersection();
-	return FromSpectrum( image_tex.GetColorFromUV( intesection->u , intesection->v ) );
+	const TexLookup& l = bsdf->GetTexLookup();
+	return FromSpectrum( image_tex.GetColor( l.u , l.v , l.dudx , l.dvdx , l.dudy , l.dvdy ) );
+}
+
+// get the values of the image for hits of a material together
+void ImageTexNode::GetNodeValues( Bsdf* const* bsdfs , unsigned count , MaterialPropertyValue* values , unsigned stride )
+{
+	// the lookups and their colors are only needed in the scope
+	MemScope mem_scope;
+	MemArena& arena = MemManager::GetSingleton().ThreadArena();
+	TexLookup* lookups = arena.Alloc<TexLookup>( count );
+	Spectrum* colors = arena.Alloc<Spectrum>( count );
+	for( unsigned i = 0 ; i < count ; ++i )
+		lookups[i] = bsdfs[i]->GetTexLookup();
+
+	image_tex.GetColors( lookups , colors , count );
+
+	for( unsigned i = 0 ; i < count ; ++i )
+		new (&values[ i * stride ]) MaterialPropertyValue( FromSpectrum( colors[i] ) );
 }
 
 // post process
@@ -135,6 +157,12 @@ MaterialPropertyValue ConstantColorNode::GetNodeValue( Bsdf* bsdf )
 	return src.GetPropertyValue(bsdf);
 }
 
+// compile the value of the node
+unsigned ConstantColorNode::CompileValue( MaterialProgram& program )
+{
+	return src.CompileValue( program );
+}
+
 // check validation
 bool ConstantColorNode::CheckValidation()
 {
@@ -28,6 +28,9 @@ class ConstantNode : public MaterialNode
 public:
     // get node type
     MAT_NODE_TYPE getNodeType() override { return MAT_NODE_CONSTANT | MaterialNode::getNodeType(); }
+
+    // compile the value of the node , textures are evaluated by the node at the intersection
+    unsigned CompileValue( MaterialProgram& program ) override;
 };
 
 // Grid texture Node
@@ -92,6 +95,9 @@ public:
 	// get property value
 	virtual MaterialPropertyValue	GetNodeValue( Bsdf* bsdf );
 
+	// get the values of the image for hits of a material together , the lookups are filtered as a batch
+	virtual void	GetNodeValues( Bsdf* const* bsdfs , unsigned count , MaterialPropertyValue* values , unsigned stride );
+
 	// post process
 	virtual void PostProcess();
 
@@ -113,6 +119,9 @@ public:
 	// get property value
 	virtual MaterialPropertyValue	GetNodeValue( Bsdf* bsdf );
 
+	// compile the value of the node
+	unsigned CompileValue( MaterialProgram& program ) override;
+
 	// check validation
 	virtual bool CheckValidation();
 
@@ -18,25 +18,127 @@
 // include header file
 #include "material.h"
 #include "bsdf/bsdf.h"
+#include "geometry/intersection.h"
 #include "managers/memmanager.h"
 #include "log/log.h"
+#include "shadingstats.h"
+#include "thirdparty/tinyxml/tinyxml.h"
 
 Bsdf* Material::GetBsdf( const Intersection* intersect ) const
 {
-	Bsdf* bsdf = SORT_MALLOC(Bsdf)( intersect );
-	root.UpdateBSDF(bsdf);
+	SHADING_STATS( ShadingTimer timer( m_id , 1 ) );
+
+	// materials not parsed from file , like the default one , walk the node tree
+	if( !m_program->IsValid() ){
+		Bsdf* bsdf = SORT_MALLOC(Bsdf)( intersect );
+		bsdf->SetStochastic( m_stochastic );
+	bsdf->SetMaterialID( m_id );
+		root->UpdateBSDF(bsdf);
+		return bsdf;
+	}
+
+	// materials without textures share the bxdfs constructed once they are parsed
+	if( m_program->IsBaked() ){
+		Bsdf* bsdf = SORT_MALLOC(Bsdf)( intersect );
+		bsdf->SetStochastic( m_stochastic );
+		bsdf->SetMaterialID( m_id );
+		m_program->AddBaked( bsdf );
+		return bsdf;
+	}
+
+	// the bsdf and all of its bxdfs are in one block of the thread arena , the bxdfs are
+	// constructed once the bsdf is evaluated , hits that are never shaded sample no texture
+	const size_t offset = ( sizeof( Bsdf ) + 15 ) & ~(size_t)15;
+	char* memory = (char*)MemManager::GetSingleton().ThreadArena().Alloc( offset + m_program->GetStorageSize() , 16 );
+	Bsdf* bsdf = new (memory) Bsdf( intersect );
+	bsdf->SetStochastic( m_stochastic );
+		bsdf->SetMaterialID( m_id );
+	bsdf->Defer( m_program.get() , memory + offset );
 	return bsdf;
 }
 
+// get the bsdfs of hits of the material together
+void Material::GetBsdfs( const Intersection* inters , const unsigned* hits , unsigned count , Bsdf** bsdfs ) const
+{
+	// bsdfs created one by one are counted by themselves
+	if( !m_program->IsValid() || m_program->IsBaked() ){
+		for( unsigned i = 0 ; i < count ; ++i )
+			bsdfs[hits[i]] = GetBsdf( &inters[hits[i]] );
+		return;
+	}
+
+	SHADING_STATS( ShadingTimer timer( m_id , count ) );
+
+	// every bsdf is still one block of the thread arena , the program fills all of them together
+	const size_t offset = ( sizeof( Bsdf ) + 15 ) & ~(size_t)15;
+	Bsdf** batch = SORT_MALLOC_ARRAY( Bsdf* , count );
+	char** storage = SORT_MALLOC_ARRAY( char* , count );
+	for( unsigned i = 0 ; i < count ; ++i ){
+		char* memory = (char*)MemManager::GetSingleton().ThreadArena().Alloc( offset + m_program->GetStorageSize() , 16 );
+		batch[i] = bsdfs[hits[i]] = new (memory) Bsdf( &inters[hits[i]] );
+		batch[i]->SetStochastic( m_stochastic );
+		batch[i]->SetMaterialID( m_id );
+		storage[i] = memory + offset;
+	}
+	m_program->ExecuteBatch( batch , storage , count );
+}
+
+// whether the surface is cut away at a point
+bool Material::IsCutAway( float u , float v ) const
+{
+	// only the texture coordinate is seen by the nodes of the opacity , there is no footprint during traversal
+	Intersection inter;
+	inter.normal = Vector( 0.0f , 1.0f , 0.0f );
+	inter.tangent = Vector( 1.0f , 0.0f , 0.0f );
+	inter.u = u;
+	inter.v = v;
+	Bsdf bsdf( &inter );
+	return root->GetOpacity( &bsdf ) < 0.5f;
+}
+
+// parse the material again
+void Material::ReloadMaterial( TiXmlElement* element )
+{
+	root.reset( new OutputNode() );
+	m_program.reset( new MaterialProgram() );
+	m_cost = MaterialCost();
+	m_subsurface.reset();
+	ParseMaterial( element );
+}
+
 // parse material
 void Material::ParseMaterial( TiXmlElement* element )
 {
 	// parse node property
-	root.ParseProperty( element , &root );
+	root->ParseProperty( element , root.get() );
+	m_stochastic = root->IsStochastic();
+
+	// light scatters beneath the surface of translucent materials
+	const TiXmlElement* subsurface = element->FirstChildElement( "Subsurface" );
+	if( subsurface ){
+		m_subsurface.reset( new SubsurfaceProfile() );
+		m_subsurface->Parse( subsurface );
+	}
 
 	// check validation
-	if( !root.CheckValidation() )
+	if( !root->CheckValidation() )
         slog( WARNING , MATERIAL , stringFormat( "Material %s is not valid , a default material will be used." , name.c_str() ) );
 	else
-		root.PostProcess();
+		root->PostProcess();
+
+	// the output node is not counted
+	m_cost.nodes = root->GetNodeCount() - 1;
+
+	// flatten the node tree once , invalid materials are compiled into the default bxdf
+	if( !m_program->Compile( *root ) ){
+		slog( WARNING , MATERIAL , stringFormat( "Material %s is too complex to be compiled , its node tree will be evaluated for every hit." , name.c_str() ) );
+		return;
+	}
+
+	// the cost is estimated by the compiled program , folded constants cost nothing
+	m_cost.textures = m_program->GetOperationCount( MAT_OP_NODE );
+	m_cost.bxdfs = m_program->GetOperationCount( MAT_OP_BXDF );
+	m_cost.instructions = m_program->GetInstructionCount();
+	slog( INFO , MATERIAL , stringFormat( "Material %s has %d nodes , it fetches %d textures and constructs %d bxdfs with %d instructions and %d registers%s." ,
+		name.c_str() , m_cost.nodes , m_cost.textures , m_cost.bxdfs , m_cost.instructions , m_program->GetRegisterCount() , m_program->IsBaked() ? ", its bxdfs are baked" : "" ) );
 }
@@ -21,10 +21,21 @@
 #include "utility/creator.h"
 #include "spectrum/spectrum.h"
 #include "material_node.h"
+#include "material_program.h"
+#include "subsurface.h"
 
 class Bsdf;
 class Intersection;
 
+// static estimation of the cost of shading a hit of a material , it is known once the material is parsed
+struct MaterialCost
+{
+	unsigned	nodes = 0;			// the number of nodes in the node tree
+	unsigned	textures = 0;		// the number of texture fetches of every hit
+	unsigned	bxdfs = 0;			// the number of bxdfs constructed for every hit
+	unsigned	instructions = 0;	// the number of instructions executed for every hit
+};
+
 ///////////////////////////////////////////////////////////
 // definition of material
 class Material
@@ -36,21 +47,68 @@ public:
 	// get bsdf
 	virtual Bsdf* GetBsdf( const Intersection* intersect ) const;
 
+	// get the bsdfs of hits of the material together , the program is executed once for all of them
+	// para 'inters' : the intersections
+	// para 'hits'   : the indices of the intersections of the material
+	// para 'count'  : the number of hits
+	// para 'bsdfs'  : the bsdf of each intersection is written at its index
+	virtual void GetBsdfs( const Intersection* inters , const unsigned* hits , unsigned count , Bsdf** bsdfs ) const;
+
 	// set name
 	void SetName( const string& n ) { name = n; }
 	// get name of the material
 	const string& GetName() const { return name; }
 
+	// set the id of the material , it is assigned by the material manager
+	void SetID( unsigned id ) { m_id = id; }
+	// get the id of the material , the default material takes 0
+	unsigned GetID() const { return m_id; }
+
+	// get the static estimation of the cost of the material
+	const MaterialCost& GetCost() const { return m_cost; }
+
 	// set root
-	MaterialNode* GetRootNode() { return &root; }
+	MaterialNode* GetRootNode() { return root.get(); }
 
 	// parse material
 	void	ParseMaterial( TiXmlElement* element );
 
+	// parse the material again after it is edited , the primitives referring to it see the new one
+	// note : it can't be called during rendering
+	void	ReloadMaterial( TiXmlElement* element );
+
+	// whether the material needs tangents following the texture coordinates of meshes
+	virtual bool NeedsTangent() const { return root->NeedsTangent(); }
+
+	// whether the material cuts surfaces away at some points by its opacity
+	virtual bool HasOpacity() const { return root->HasOpacity(); }
+	// whether the surface is cut away at a point , it is a binary alpha test of the opacity against one half
+	// para 'u' , 'v' : the texture coordinate of the point
+	bool	IsCutAway( float u , float v ) const;
+
+	// get the diffusion profile of the material , it is null if light doesn't scatter beneath the surface
+	// note : the bxdfs of the material are the coat over the translucent body
+	const SubsurfaceProfile* GetSubsurface() const { return m_subsurface.get(); }
+
 private:
 	// the name for the material
 	string			name;
 
+	// the id of the material , the ids are dense so that hits can be grouped by them
+	unsigned		m_id = 0;
+
 	// the root node of the material
-	mutable OutputNode	root;
+	std::unique_ptr<OutputNode>	root{ new OutputNode() };
+
+	// whether only the sampled bxdf is evaluated in importance sampling
+	bool			m_stochastic = false;
+
+	// the flat program compiled from the node tree , it is executed for every hit
+	std::unique_ptr<MaterialProgram>	m_program{ new MaterialProgram() };
+
+	// the static estimation of the cost
+	MaterialCost		m_cost;
+
+	// the diffusion profile of the translucent body beneath the surface
+	std::unique_ptr<SubsurfaceProfile>	m_subsurface;
 };
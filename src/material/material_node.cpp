@@ -16,6 +16,7 @@
  */
 
 #include "material_node.h"
+#include "material_program.h"
 #include "managers/memmanager.h"
 #include "bsdf/bsdf.h"
 #include "bsdf/lambert.h"
@@ -58,12 +59,33 @@ void MaterialNodeProperty::UpdateBsdf( Bsdf* bsdf , Spectrum weight ){
         node->UpdateBSDF( bsdf , weight );
 }
 
+// compile the value of the property
+unsigned MaterialNodeProperty::CompileValue( MaterialProgram& program )
+{
+	if( node )
+		return node->CompileValue( program );
+	return program.AddConstant( value );
+}
+
+// compile the bxdfs of the sub node
+void MaterialNodeProperty::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	if( node )
+		node->CompileBxdf( program , weight );
+}
+
 // set node property
 void MaterialNodePropertyString::SetNodeProperty( const string& prop )
 {
 	str = prop;
 }
 
+// compile the value of the property
+unsigned MaterialNodePropertyString::CompileValue( MaterialProgram& program )
+{
+	return program.AddConstant( MaterialPropertyValue() );
+}
+
 // parse property or socket
 void MaterialNode::ParseProperty( TiXmlElement* element , MaterialNode* node )
 {
@@ -134,6 +156,27 @@ bool MaterialNode::CheckValidation()
 	return m_node_valid;
 }
 
+// the number of nodes in the sub-tree
+unsigned MaterialNode::GetNodeCount() const
+{
+	unsigned count = 1;
+	for( auto it : m_props ){
+		if( it.second->node )
+			count += it.second->node->GetNodeCount();
+	}
+	return count;
+}
+
+// whether the sub-tree needs tangents
+bool MaterialNode::NeedsTangent()
+{
+    for( auto it : m_props ){
+		if( it.second->node && it.second->node->NeedsTangent() )
+			return true;
+	}
+	return false;
+}
+
 // get sub tree node type
 MAT_NODE_TYPE MaterialNode::getNodeType()
 {
@@ -150,6 +193,13 @@ MAT_NODE_TYPE MaterialNode::getNodeType()
 	return type;
 }
 
+// get the values of the node for hits of a material together
+void MaterialNode::GetNodeValues( Bsdf* const* bsdfs , unsigned count , MaterialPropertyValue* values , unsigned stride )
+{
+	for( unsigned i = 0 ; i < count ; ++i )
+		new (&values[ i * stride ]) MaterialPropertyValue( GetNodeValue( bsdfs[i] ) );
+}
+
 // post process
 void MaterialNode::PostProcess()
 {
@@ -176,6 +226,22 @@ void MaterialNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
 	}
 }
 
+// compile the value of the node
+unsigned MaterialNode::CompileValue( MaterialProgram& program )
+{
+	return program.AddConstant( GetNodeValue( 0 ) );
+}
+
+// compile the bxdfs of the sub-tree
+void MaterialNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	// the sub nodes are visited in the same order as 'UpdateBSDF' does
+    for( auto it : m_props ){
+		if( it.second->node )
+			it.second->node->CompileBxdf( program , weight );
+	}
+}
+
 MaterialNode::~MaterialNode()
 {
     for( auto it : m_props )
@@ -186,6 +252,10 @@ OutputNode::OutputNode()
 {
 	// register node property
 	m_props.insert( make_pair( "Surface" , &output ) );
+	m_props.insert( make_pair( "Stochastic" , &stochastic ) );
+	m_props.insert( make_pair( "Opacity" , &opacity ) );
+
+	opacity.value = MaterialPropertyValue( 1.0f );
 }
 
 // update bsdf
@@ -205,6 +275,23 @@ void OutputNode::UpdateBSDF( Bsdf* bsdf , Spectrum weight )
 		output.node->UpdateBSDF( bsdf );
 }
 
+// compile the bxdfs of the material
+void OutputNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	if( !m_node_valid )
+		program.AddBxdf( this , weight , nullptr , 0 , MaterialProgram::SlotSize<Lambert>() );
+	else if( output.node )
+		output.node->CompileBxdf( program , program.AddConstant( MaterialPropertyValue( 1.0f ) ) );
+}
+
+// construct the default bxdf of invalid materials
+void OutputNode::EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs )
+{
+	Lambert* lambert = MaterialProgram::Construct<Lambert>( slot , Spectrum( 0.3f , 0.0f , 0.0f ) );
+	lambert->m_weight = weight;
+	bsdf->AddBxdf( lambert );
+}
+
 // check validation
 bool OutputNode::CheckValidation()
 {
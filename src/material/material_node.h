@@ -27,6 +27,7 @@
 
 class Bsdf;
 class MaterialNode;
+class MaterialProgram;
 class TiXmlElement;
 class Fresnel;
 class MicroFacetDistribution;
@@ -57,6 +58,12 @@ public:
     // update bsdf, for layered brdf
     void UpdateBsdf( Bsdf* bsdf , Spectrum weight );
 
+	// compile the value of the property , the register holding it is returned
+	virtual unsigned CompileValue( MaterialProgram& program );
+
+	// compile the bxdfs of the sub node
+	void CompileBxdf( MaterialProgram& program , unsigned weight );
+
 	// sub node if it has value
 	MaterialNode*	node;
 
@@ -73,6 +80,9 @@ public:
 	// get node property
 	virtual MaterialPropertyValue GetPropertyValue( Bsdf* bsdf ) { return MaterialPropertyValue(); }
 
+	// compile the value of the property , strings have no value
+	unsigned CompileValue( MaterialProgram& program ) override;
+
 	// color value
 	string	str;
 };
@@ -100,6 +110,32 @@ public:
 	// get property value, this should never be called
 	virtual MaterialPropertyValue	GetNodeValue( Bsdf* bsdf ) { return 0.0f; }
 
+	// get the values of the node for hits of a material together
+	// para 'bsdfs'  : the bsdfs , the node is evaluated at their intersections
+	// para 'count'  : the number of bsdfs
+	// para 'values' : the value of the first hit , the values of the others follow it
+	// para 'stride' : the distance between the values of two hits
+	// note          : the values are constructed in place , by default the hits are evaluated one by one
+	virtual void	GetNodeValues( Bsdf* const* bsdfs , unsigned count , MaterialPropertyValue* values , unsigned stride );
+
+	// compile the value of the node into the program
+	// para 'program' : the program of the material
+	// result         : the register holding the value
+	virtual unsigned CompileValue( MaterialProgram& program );
+
+	// compile the bxdfs of the sub-tree into the program
+	// para 'program' : the program of the material
+	// para 'weight'  : the register holding the weight of the sub-tree
+	virtual void CompileBxdf( MaterialProgram& program , unsigned weight );
+
+	// construct the bxdf of a compiled bxdf instruction and add it to the bsdf
+	// para 'bsdf'   : the bsdf
+	// para 'slot'   : the memory reserved for the bxdf when compiling
+	// para 'weight' : the weight of the bxdf
+	// para 'r'      : the registers of the program
+	// para 'inputs' : the registers holding the inputs of the bxdf
+	virtual void EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs ) {}
+
 	// post process
 	virtual void PostProcess();
 
@@ -109,6 +145,13 @@ public:
 	// get node type
 	virtual MAT_NODE_TYPE getNodeType();
 
+	// the number of nodes in the sub-tree , including the node itself
+	unsigned GetNodeCount() const;
+
+	// whether the sub-tree needs tangents following the texture coordinates , isotropic
+	// bxdfs don't depend on the rotation of the shading frame around the normal
+	virtual bool NeedsTangent();
+
 protected:
 	// node properties
 	std::unordered_map< string , MaterialNodeProperty * > m_props;
@@ -135,12 +178,28 @@ public:
 	// update bsdf
     void UpdateBSDF( Bsdf* bsdf , Spectrum weight = 1.0f ) override;
 
+	// compile the bxdfs of the material
+	void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+
+	// construct the default bxdf of invalid materials
+	void EmitBxdf( Bsdf* bsdf , char* slot , const Spectrum& weight , const MaterialPropertyValue* r , const unsigned* inputs ) override;
+
 	// get node type
     MAT_NODE_TYPE getNodeType() override { return MAT_NODE_OUTPUT | MaterialNode::getNodeType(); }
 
 	// check validation
     bool CheckValidation() override;
 
+	// whether only the sampled bxdf is evaluated in importance sampling
+	bool IsStochastic() const { return stochastic.str == "true" || stochastic.str == "1"; }
+
+	// whether surfaces are cut away at some points by the opacity
+	bool HasOpacity() const { return opacity.node != 0 || opacity.value.x < 1.0f; }
+	// get the opacity at a point of a surface , only its first channel is used
+	float GetOpacity( Bsdf* bsdf ) { return opacity.GetPropertyValue( bsdf ).x; }
+
 private:
-	MaterialNodeProperty	output;
+	MaterialNodeProperty		output;
+	MaterialNodePropertyString	stochastic;	// only the sampled bxdf is evaluated in sampling if it's 'true'
+	MaterialNodeProperty		opacity;	// surfaces are cut away where it is below one half , they are opaque by default
 };
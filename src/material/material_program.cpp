@@ -0,0 +1,349 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "material_program.h"
+#include "bsdf/bsdf.h"
+#include "bsdf/bxdf.h"
+#include "geometry/intersection.h"
+#include "utility/sassert.h"
+#include "managers/memmanager.h"
+#include <algorithm>
+
+// the number of registers an operation reads , the last source of scaling is a channel instead of a register
+static unsigned _sourceCount( MATERIAL_OP op )
+{
+	switch( op )
+	{
+	case MAT_OP_ADD:		return 2;
+	case MAT_OP_INVERSE:	return 1;
+	case MAT_OP_LERP:		return 3;
+	case MAT_OP_BLEND:		return 4;
+	case MAT_OP_MULTIPLY:	return 2;
+	case MAT_OP_SCALE:		return 2;
+	case MAT_OP_BXDF:		return MAX_MATERIAL_SOURCE;
+	default:				return 0;
+	}
+}
+
+// evaluate an operation on registers
+static inline MaterialPropertyValue _operate( MATERIAL_OP op , const MaterialPropertyValue* r , const unsigned* s )
+{
+	switch( op )
+	{
+	case MAT_OP_ADD:		return r[s[0]] + r[s[1]];
+	case MAT_OP_INVERSE:	return MaterialPropertyValue( 1.0f ) - r[s[0]];
+	case MAT_OP_LERP:		return r[s[0]] * ( 1.0f - r[s[2]].x ) + r[s[1]] * r[s[2]].x;
+	case MAT_OP_BLEND:		return r[s[0]] * r[s[2]].x + r[s[1]] * r[s[3]].x;
+	case MAT_OP_MULTIPLY:	return r[s[0]] * r[s[1]];
+	case MAT_OP_SCALE:		return FromSpectrum( r[s[0]].ToSpectrum() * r[s[1]][s[2]] );
+	default:				return MaterialPropertyValue();
+	}
+}
+
+// destructor
+MaterialProgram::~MaterialProgram()
+{
+	_releaseBaked();
+}
+
+// compile the node tree of a material
+bool MaterialProgram::Compile( MaterialNode& root )
+{
+	_releaseBaked();
+	m_instructions.clear();
+	m_defines.clear();
+	m_registerCnt = 0;
+	m_storageSize = 0;
+
+	// the weight of the whole material is one
+	root.CompileBxdf( *this , AddConstant( MaterialPropertyValue( 1.0f ) ) );
+	_eliminate();
+
+	m_valid = ( m_registerCnt <= MAX_MATERIAL_REGISTER );
+	if( !m_valid )
+		m_instructions.clear();
+	else
+		_bake();
+	return m_valid;
+}
+
+// construct the bxdfs once if no instruction reads a texture
+void MaterialProgram::_bake()
+{
+	for( const MaterialInstruction& inst : m_instructions )
+		if( inst.op == MAT_OP_NODE )
+			return;
+
+	// the bxdfs don't depend on the intersection , any frame collects them
+	Intersection inter;
+	inter.normal = Vector( 0.0f , 1.0f , 0.0f );
+	inter.tangent = Vector( 1.0f , 0.0f , 0.0f );
+	Bsdf bsdf( &inter );
+
+	m_baked.reset( new char[ m_storageSize + 1 ] );
+	Execute( &bsdf , m_baked.get() );
+	for( unsigned i = 0 ; i < bsdf.GetBxdfCount() ; ++i )
+		m_bakedBxdfs.push_back( bsdf.GetBxdf( i ) );
+}
+
+// release the baked bxdfs
+void MaterialProgram::_releaseBaked()
+{
+	// bxdfs like the measured ones are owned by their nodes , only the ones in the slots are destructed
+	const char* storage = m_baked.get();
+	for( Bxdf* bxdf : m_bakedBxdfs )
+		if( (const char*)bxdf >= storage && (const char*)bxdf < storage + m_storageSize )
+			bxdf->~Bxdf();
+	m_bakedBxdfs.clear();
+	m_baked.reset();
+}
+
+// the number of instructions of an operation
+unsigned MaterialProgram::GetOperationCount( MATERIAL_OP op ) const
+{
+	return (unsigned)std::count_if( m_instructions.begin() , m_instructions.end() , [op]( const MaterialInstruction& inst ){ return inst.op == op; } );
+}
+
+// add the baked bxdfs to a bsdf
+void MaterialProgram::AddBaked( Bsdf* bsdf ) const
+{
+	for( Bxdf* bxdf : m_bakedBxdfs )
+		bsdf->AddBxdf( bxdf );
+}
+
+// evaluate the program
+void MaterialProgram::Execute( Bsdf* bsdf , char* storage ) const
+{
+	// registers are always written before they are read , they are not initialized
+	alignas(16) char buffer[ sizeof( MaterialPropertyValue ) * MAX_MATERIAL_REGISTER ];
+	MaterialPropertyValue* r = reinterpret_cast<MaterialPropertyValue*>( buffer );
+
+	for( const MaterialInstruction& inst : m_instructions )
+	{
+		const unsigned* s = inst.src;
+		switch( inst.op )
+		{
+		case MAT_OP_CONSTANT:
+			new (&r[inst.dst]) MaterialPropertyValue( inst.value );
+			break;
+		case MAT_OP_NODE:
+			new (&r[inst.dst]) MaterialPropertyValue( inst.node->GetNodeValue( bsdf ) );
+			break;
+		case MAT_OP_SCALE:
+			new (&r[inst.dst]) MaterialPropertyValue( FromSpectrum( r[s[0]].ToSpectrum() * r[s[1]][s[2]] ) );
+			break;
+		case MAT_OP_BXDF:
+			{
+				// bxdfs without weight are not added at all
+				const Spectrum weight = r[s[0]].ToSpectrum();
+				if( !weight.IsBlack() )
+					inst.node->EmitBxdf( bsdf , storage + inst.slot , weight , r , s + 1 );
+			}
+			break;
+		default:
+			new (&r[inst.dst]) MaterialPropertyValue( _operate( inst.op , r , s ) );
+			break;
+		}
+	}
+}
+
+// evaluate the program for hits of the material together
+void MaterialProgram::ExecuteBatch( Bsdf* const* bsdfs , char* const* storage , unsigned count ) const
+{
+	// the registers of each hit are next to each other , the same layout with 'Execute'
+	MaterialPropertyValue* registers = (MaterialPropertyValue*)MemManager::GetSingleton().ThreadArena().Alloc( sizeof( MaterialPropertyValue ) * m_registerCnt * count , 16 );
+
+	for( const MaterialInstruction& inst : m_instructions )
+	{
+		// nodes evaluate all hits at once , image nodes filter their lookups together
+		if( inst.op == MAT_OP_NODE )
+		{
+			inst.node->GetNodeValues( bsdfs , count , registers + inst.dst , m_registerCnt );
+			continue;
+		}
+
+		const unsigned* s = inst.src;
+		for( unsigned i = 0 ; i < count ; ++i )
+		{
+			MaterialPropertyValue* r = registers + i * m_registerCnt;
+			switch( inst.op )
+			{
+			case MAT_OP_CONSTANT:
+				new (&r[inst.dst]) MaterialPropertyValue( inst.value );
+				break;
+			case MAT_OP_BXDF:
+				{
+					const Spectrum weight = r[s[0]].ToSpectrum();
+					if( !weight.IsBlack() )
+						inst.node->EmitBxdf( bsdfs[i] , storage[i] + inst.slot , weight , r , s + 1 );
+				}
+				break;
+			default:
+				new (&r[inst.dst]) MaterialPropertyValue( _operate( inst.op , r , s ) );
+				break;
+			}
+		}
+	}
+}
+
+// add an instruction writing a new register
+MaterialInstruction& MaterialProgram::_addInstruction( MATERIAL_OP op )
+{
+	m_instructions.push_back( MaterialInstruction() );
+	MaterialInstruction& inst = m_instructions.back();
+	inst.op = op;
+	inst.dst = m_registerCnt++;
+	m_defines.push_back( (unsigned)m_instructions.size() - 1 );
+	return inst;
+}
+
+// whether a register holds a constant while compiling
+bool MaterialProgram::_isConstant( unsigned reg , MaterialPropertyValue& value ) const
+{
+	const MaterialInstruction& inst = m_instructions[ m_defines[reg] ];
+	if( inst.op != MAT_OP_CONSTANT )
+		return false;
+	value = inst.value;
+	return true;
+}
+
+// add an instruction writing a constant
+unsigned MaterialProgram::AddConstant( const MaterialPropertyValue& value )
+{
+	MaterialInstruction& inst = _addInstruction( MAT_OP_CONSTANT );
+	inst.value = value;
+	return inst.dst;
+}
+
+// add an instruction computing a value
+unsigned MaterialProgram::AddOperation( MATERIAL_OP op , unsigned src0 , unsigned src1 , unsigned src2 , unsigned src3 )
+{
+	sAssert( op != MAT_OP_BXDF && op != MAT_OP_NODE && op != MAT_OP_CONSTANT , MATERIAL );
+	const unsigned src[] = { src0 , src1 , src2 , src3 };
+
+	// operations on constants are folded into a constant
+	MaterialPropertyValue r[4];
+	bool folded = true;
+	for( unsigned i = 0 ; i < _sourceCount( op ) ; ++i )
+		folded &= _isConstant( src[i] , r[i] );
+	if( folded ){
+		const unsigned s[] = { 0 , 1 , ( op == MAT_OP_SCALE ) ? src2 : 2 , 3 };
+		return AddConstant( _operate( op , r , s ) );
+	}
+
+	// interpolating or scaling by a constant one or zero doesn't need an instruction
+	MaterialPropertyValue c;
+	if( op == MAT_OP_LERP && _isConstant( src2 , c ) && ( c.x == 0.0f || c.x == 1.0f ) )
+		return ( c.x == 0.0f ) ? src0 : src1;
+	if( op == MAT_OP_SCALE && _isConstant( src1 , c ) && c[src2] == 1.0f )
+		return src0;
+	if( op == MAT_OP_SCALE && _isConstant( src1 , c ) && c[src2] == 0.0f )
+		return AddConstant( MaterialPropertyValue( 0.0f ) );
+
+	MaterialInstruction& inst = _addInstruction( op );
+	for( unsigned i = 0 ; i < 4 ; ++i )
+		inst.src[i] = src[i];
+	return inst.dst;
+}
+
+// add an instruction evaluating a node
+unsigned MaterialProgram::AddNode( MaterialNode* node )
+{
+	MaterialInstruction& inst = _addInstruction( MAT_OP_NODE );
+	inst.node = node;
+	return inst.dst;
+}
+
+// add an instruction adding a bxdf to the bsdf
+void MaterialProgram::AddBxdf( MaterialNode* node , unsigned weight , const unsigned* inputs , unsigned input_cnt , unsigned size )
+{
+	sAssert( input_cnt < MAX_MATERIAL_SOURCE , MATERIAL );
+
+	// bxdfs with a constant zero weight are never added , neither is their slot
+	MaterialPropertyValue w;
+	if( _isConstant( weight , w ) && w.ToSpectrum().IsBlack() )
+		return;
+
+	MaterialInstruction inst;
+	inst.op = MAT_OP_BXDF;
+	inst.node = node;
+	inst.src[0] = weight;
+	for( unsigned i = 0 ; i < input_cnt ; ++i )
+		inst.src[i+1] = inputs[i];
+	for( unsigned i = input_cnt + 1 ; i < MAX_MATERIAL_SOURCE ; ++i )
+		inst.src[i] = weight;
+	inst.slot = m_storageSize;
+	m_instructions.push_back( inst );
+
+	m_storageSize += ( size + 15 ) & ~15u;
+}
+
+// drop the instructions whose values are never read and reuse the registers
+void MaterialProgram::_eliminate()
+{
+	// the values read by bxdfs are live , so are the values they are computed from
+	std::vector<bool> live( m_registerCnt , false );
+	for( auto it = m_instructions.rbegin() ; it != m_instructions.rend() ; ++it ){
+		if( it->op != MAT_OP_BXDF && !live[it->dst] )
+			continue;
+		for( unsigned i = 0 ; i < _sourceCount( it->op ) ; ++i )
+			live[it->src[i]] = true;
+	}
+
+	std::vector<MaterialInstruction> instructions;
+	for( const MaterialInstruction& inst : m_instructions ){
+		if( inst.op == MAT_OP_BXDF || live[inst.dst] )
+			instructions.push_back( inst );
+	}
+
+	// the last instruction reading each register
+	std::vector<unsigned> last( m_registerCnt , 0 );
+	for( unsigned i = 0 ; i < instructions.size() ; ++i ){
+		for( unsigned k = 0 ; k < _sourceCount( instructions[i].op ) ; ++k )
+			last[instructions[i].src[k]] = i;
+	}
+
+	// registers are released once they are read the last time , an instruction may write the register it releases
+	std::vector<unsigned> mapping( m_registerCnt , 0 );
+	std::vector<unsigned> released;
+	unsigned count = 0;
+	for( unsigned i = 0 ; i < instructions.size() ; ++i ){
+		MaterialInstruction& inst = instructions[i];
+		const unsigned cnt = _sourceCount( inst.op );
+		for( unsigned k = 0 ; k < cnt ; ++k ){
+			const unsigned reg = inst.src[k];
+			inst.src[k] = mapping[reg];
+			if( last[reg] == i && std::find( released.begin() , released.end() , mapping[reg] ) == released.end() )
+				released.push_back( mapping[reg] );
+		}
+		if( inst.op == MAT_OP_BXDF )
+			continue;
+
+		const unsigned reg = inst.dst;
+		if( released.empty() ){
+			inst.dst = count++;
+		}else{
+			inst.dst = released.back();
+			released.pop_back();
+		}
+		mapping[reg] = inst.dst;
+	}
+
+	m_instructions.swap( instructions );
+	m_registerCnt = count;
+	m_defines.clear();
+}
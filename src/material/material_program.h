@@ -0,0 +1,178 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "material_node.h"
+#include <vector>
+#include <memory>
+
+class Bsdf;
+class Bxdf;
+
+// the maximum number of registers of a compiled material , materials needing more are evaluated by walking the node tree
+#define MAX_MATERIAL_REGISTER	64
+// the maximum number of registers an instruction reads
+#define MAX_MATERIAL_SOURCE		6
+
+// operations of compiled materials
+enum MATERIAL_OP
+{
+	MAT_OP_CONSTANT = 0,	// r[dst] = value
+	MAT_OP_ADD,				// r[dst] = r[src0] + r[src1]
+	MAT_OP_INVERSE,			// r[dst] = 1 - r[src0]
+	MAT_OP_LERP,			// r[dst] = r[src0] * ( 1 - r[src2].x ) + r[src1] * r[src2].x
+	MAT_OP_BLEND,			// r[dst] = r[src0] * r[src2].x + r[src1] * r[src3].x
+	MAT_OP_MULTIPLY,		// r[dst] = r[src0] * r[src1]
+	MAT_OP_NODE,			// r[dst] = the value of the node , textures are sampled by their nodes
+	MAT_OP_SCALE,			// r[dst] = r[src0] * r[src1][src2] , it scales the weight of bxdfs by one channel of a value
+	MAT_OP_BXDF,			// the node adds its bxdf to the bsdf , the weight is in r[src0] and the inputs are in the other sources
+};
+
+// an instruction of a compiled material
+struct MaterialInstruction
+{
+	MATERIAL_OP				op = MAT_OP_CONSTANT;
+	unsigned				dst = 0;
+	unsigned				src[MAX_MATERIAL_SOURCE] = {};
+	MaterialPropertyValue	value;
+	MaterialNode*			node = nullptr;
+	unsigned				slot = 0;	// offset of the memory of the bxdf in the storage of the bsdf
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+// definition of material program
+// desc :	The node tree of a material is flattened into a linear list of instructions
+//			once it is parsed. Values are computed into registers on the stack , bxdfs
+//			are constructed in slots laid out at compile time right after the bsdf , so
+//			shading a hit takes one allocation from the arena and no lookup by name.
+//			Operations on constants are folded while compiling , bxdfs with a constant
+//			zero weight are dropped along with the values only they read , and the
+//			registers of the live values are reused once they are read the last time.
+//			Programs reading no texture are baked , their bxdfs are constructed once
+//			and shared by all hits.
+class MaterialProgram
+{
+public:
+	// destructor releasing the baked bxdfs
+	~MaterialProgram();
+
+	// compile the node tree of a material
+	// para 'root' : the output node of the material
+	// result      : 'true' if the tree fits in the registers
+	bool	Compile( MaterialNode& root );
+
+	// whether the material is compiled
+	bool	IsValid() const { return m_valid; }
+
+	// the size of the slots of bxdfs in bytes
+	unsigned GetStorageSize() const { return m_storageSize; }
+
+	// the number of instructions executed for every hit
+	unsigned GetInstructionCount() const { return (unsigned)m_instructions.size(); }
+
+	// the number of registers used
+	unsigned GetRegisterCount() const { return m_registerCnt; }
+
+	// the number of instructions of an operation , like the texture fetches or the bxdfs of the material
+	// para 'op' : the operation
+	unsigned GetOperationCount( MATERIAL_OP op ) const;
+
+	// whether the bxdfs are baked , the program doesn't need to be executed for any hit
+	bool	IsBaked() const { return m_baked != nullptr; }
+
+	// add the baked bxdfs to a bsdf
+	// para 'bsdf' : the bsdf to fill
+	void	AddBaked( Bsdf* bsdf ) const;
+
+	// evaluate the program
+	// para 'bsdf'    : the bsdf to fill , textures are evaluated at its intersection
+	// para 'storage' : the memory of the slots of bxdfs
+	void	Execute( Bsdf* bsdf , char* storage ) const;
+
+	// evaluate the program for hits of the material together , each instruction is executed for all of them before the next one
+	// para 'bsdfs'   : the bsdfs to fill
+	// para 'storage' : the memory of the slots of bxdfs of each bsdf
+	// para 'count'   : the number of bsdfs
+	void	ExecuteBatch( Bsdf* const* bsdfs , char* const* storage , unsigned count ) const;
+
+	// add an instruction writing a constant
+	// result : the register holding the constant
+	unsigned AddConstant( const MaterialPropertyValue& value );
+
+	// add an instruction computing a value
+	// para 'op'   : the operation , it can't be a bxdf
+	// para 'srcx' : the registers read by the operation
+	// result      : the register holding the value
+	unsigned AddOperation( MATERIAL_OP op , unsigned src0 , unsigned src1 = 0 , unsigned src2 = 0 , unsigned src3 = 0 );
+
+	// add an instruction evaluating a node
+	// para 'node' : the node computing the value
+	// result      : the register holding the value
+	unsigned AddNode( MaterialNode* node );
+
+	// add an instruction adding a bxdf to the bsdf
+	// para 'node'      : the node constructing the bxdf
+	// para 'weight'    : the register holding the weight
+	// para 'inputs'    : the registers holding the inputs of the node
+	// para 'input_cnt' : the number of inputs
+	// para 'size'      : the size of the memory the node constructs the bxdf in
+	void	AddBxdf( MaterialNode* node , unsigned weight , const unsigned* inputs , unsigned input_cnt , unsigned size );
+
+	// the size of a slot holding an object , slots are aligned to 16 bytes
+	template< class T >
+	static unsigned SlotSize() { return ( sizeof( T ) + 15 ) & ~15u; }
+
+	// construct an object in a slot and move to the memory after it
+	template< class T , class... Args >
+	static T* Construct( char*& slot , Args&&... args )
+	{
+		T* object = new (slot) T( std::forward<Args>(args)... );
+		slot += SlotSize<T>();
+		return object;
+	}
+
+private:
+	std::vector<MaterialInstruction>	m_instructions;		// the instructions of the program
+	unsigned							m_registerCnt = 0;	// the number of registers used
+	unsigned							m_storageSize = 0;	// the size of the slots of bxdfs
+	bool								m_valid = false;	// whether the program is compiled
+
+	// the bxdfs of a program reading no texture , they are constructed once it is compiled
+	std::unique_ptr<char[]>				m_baked;
+	std::vector<Bxdf*>					m_bakedBxdfs;
+
+	// the instruction writing each register while compiling , registers are renumbered once the program is compiled
+	std::vector<unsigned>				m_defines;
+
+	// add an instruction writing a new register
+	MaterialInstruction& _addInstruction( MATERIAL_OP op );
+
+	// whether a register holds a constant while compiling
+	// para 'reg'   : the register
+	// para 'value' : the constant if it is one
+	bool	_isConstant( unsigned reg , MaterialPropertyValue& value ) const;
+
+	// drop the instructions whose values are never read and reuse the registers
+	void	_eliminate();
+
+	// construct the bxdfs once if no instruction reads a texture
+	void	_bake();
+
+	// release the baked bxdfs
+	void	_releaseBaked();
+};
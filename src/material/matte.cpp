@@ -20,13 +20,17 @@
 #include "bsdf/bsdf.h"
 #include "bsdf/lambert.h"
 #include "managers/memmanager.h"
+#include "shadingstats.h"
 
 IMPLEMENT_CREATOR( Matte );
 
 // get bsdf
 Bsdf* Matte::GetBsdf( const Intersection* intersect ) const
 {
+	SHADING_STATS( ShadingTimer timer( GetID() , 1 ) );
+
 	Bsdf* bsdf = SORT_MALLOC(Bsdf)( intersect );
+	bsdf->SetMaterialID( GetID() );
 	Lambert* lambert = SORT_MALLOC(Lambert)( m_color );
     lambert->m_weight = 1.0f;
 	bsdf->AddBxdf( lambert );
@@ -16,6 +16,7 @@
  */
 
 #include "operation_node.h"
+#include "material_program.h"
 
 IMPLEMENT_CREATOR( InverseNode );
 IMPLEMENT_CREATOR( AddNode );
@@ -51,6 +52,14 @@ MaterialPropertyValue AddNode::GetNodeValue( Bsdf* bsdf )
 	return src0.GetPropertyValue(bsdf) + src1.GetPropertyValue(bsdf);
 }
 
+// compile the value of the node
+unsigned AddNode::CompileValue( MaterialProgram& program )
+{
+	const unsigned a = src0.CompileValue( program );
+	const unsigned b = src1.CompileValue( program );
+	return program.AddOperation( MAT_OP_ADD , a , b );
+}
+
 // inverse node
 InverseNode::InverseNode()
 {
@@ -76,6 +85,12 @@ MaterialPropertyValue InverseNode::GetNodeValue( Bsdf* bsdf )
     return MaterialPropertyValue(1.0f) - src.GetPropertyValue(bsdf);
 }
 
+// compile the value of the node
+unsigned InverseNode::CompileValue( MaterialProgram& program )
+{
+    return program.AddOperation( MAT_OP_INVERSE , src.CompileValue( program ) );
+}
+
 LerpNode::LerpNode()
 {
 	m_props.insert( make_pair( "Color1" , &src0 ) );
@@ -104,6 +119,25 @@ MaterialPropertyValue LerpNode::GetNodeValue( Bsdf* bsdf )
 	return src0.GetPropertyValue(bsdf) * ( 1.0f - f ) + src1.GetPropertyValue(bsdf) * f;
 }
 
+// compile the value of the node
+unsigned LerpNode::CompileValue( MaterialProgram& program )
+{
+	const unsigned f = factor.CompileValue( program );
+	const unsigned a = src0.CompileValue( program );
+	const unsigned b = src1.CompileValue( program );
+	return program.AddOperation( MAT_OP_LERP , a , b , f );
+}
+
+// compile the bxdfs of the sub-tree
+void LerpNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	const unsigned f = factor.CompileValue( program );
+	if( src0.node )
+		src0.node->CompileBxdf( program , program.AddOperation( MAT_OP_SCALE , weight , program.AddOperation( MAT_OP_INVERSE , f ) , 0 ) );
+	if( src1.node )
+		src1.node->CompileBxdf( program , program.AddOperation( MAT_OP_SCALE , weight , f , 0 ) );
+}
+
 // check validation
 bool LerpNode::CheckValidation()
 {
@@ -149,6 +183,28 @@ MaterialPropertyValue BlendNode::GetNodeValue( Bsdf* bsdf )
 	return src0.GetPropertyValue(bsdf) * f0 + src1.GetPropertyValue(bsdf) * f1;
 }
 
+// compile the value of the node
+unsigned BlendNode::CompileValue( MaterialProgram& program )
+{
+	const unsigned f0 = factor0.CompileValue( program );
+	const unsigned f1 = factor1.CompileValue( program );
+	const unsigned a = src0.CompileValue( program );
+	const unsigned b = src1.CompileValue( program );
+	return program.AddOperation( MAT_OP_BLEND , a , b , f0 , f1 );
+}
+
+// compile the bxdfs of the sub-tree
+void BlendNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	// the weight of the second bxdf is the second channel of its factor , the same as 'UpdateBSDF'
+	const unsigned f0 = factor0.CompileValue( program );
+	const unsigned f1 = factor1.CompileValue( program );
+	if( src0.node )
+		src0.node->CompileBxdf( program , program.AddOperation( MAT_OP_SCALE , weight , f0 , 0 ) );
+	if( src1.node )
+		src1.node->CompileBxdf( program , program.AddOperation( MAT_OP_SCALE , weight , f1 , 1 ) );
+}
+
 // check validation
 bool BlendNode::CheckValidation()
 {
@@ -191,6 +247,26 @@ MaterialPropertyValue MutiplyNode::GetNodeValue( Bsdf* bsdf )
 	return src0.GetPropertyValue(bsdf) * src1.GetPropertyValue(bsdf);
 }
 
+// compile the value of the node
+unsigned MutiplyNode::CompileValue( MaterialProgram& program )
+{
+	const unsigned a = src0.CompileValue( program );
+	const unsigned b = src1.CompileValue( program );
+	return program.AddOperation( MAT_OP_MULTIPLY , a , b );
+}
+
+// compile the bxdfs of the sub-tree , the type of the sources is only checked once here
+void MutiplyNode::CompileBxdf( MaterialProgram& program , unsigned weight )
+{
+	MAT_NODE_TYPE type0 = (src0.node)?src0.node->getNodeType():MAT_NODE_CONSTANT;
+	MAT_NODE_TYPE type1 = (src1.node)?src1.node->getNodeType():MAT_NODE_CONSTANT;
+
+	if( type0 & MAT_NODE_BXDF )
+		src0.node->CompileBxdf( program , program.AddOperation( MAT_OP_SCALE , weight , src1.CompileValue( program ) , 0 ) );
+	else if( type1 & MAT_NODE_BXDF )
+		src1.node->CompileBxdf( program , program.AddOperation( MAT_OP_SCALE , weight , src0.CompileValue( program ) , 0 ) );
+}
+
 // check validation
 bool MutiplyNode::CheckValidation()
 {
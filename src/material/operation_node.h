@@ -38,6 +38,9 @@ public:
 	// get property value
     MaterialPropertyValue	GetNodeValue( Bsdf* bsdf ) override;
 
+	// compile the value of the node
+	unsigned CompileValue( MaterialProgram& program ) override;
+
 	// check validation
 	bool CheckValidation() override;
 
@@ -57,6 +60,9 @@ public:
     
     // get property value
     MaterialPropertyValue	GetNodeValue( Bsdf* bsdf ) override;
+
+    // compile the value of the node
+    unsigned CompileValue( MaterialProgram& program ) override;
     
     // check validation
     bool CheckValidation() override;
@@ -81,6 +87,12 @@ public:
 	// get property value
     MaterialPropertyValue	GetNodeValue( Bsdf* bsdf ) override;
 
+	// compile the value of the node
+	unsigned CompileValue( MaterialProgram& program ) override;
+
+	// compile the bxdfs of the sub-tree
+	void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+
 	// check validation
     bool CheckValidation() override;
 
@@ -105,6 +117,12 @@ public:
 	// get property value
     MaterialPropertyValue	GetNodeValue( Bsdf* bsdf ) override;
 
+	// compile the value of the node
+	unsigned CompileValue( MaterialProgram& program ) override;
+
+	// compile the bxdfs of the sub-tree
+	void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+
 	// check validation
     bool CheckValidation() override;
 
@@ -130,6 +148,12 @@ public:
 	// get property value
     MaterialPropertyValue	GetNodeValue( Bsdf* bsdf ) override;
 
+	// compile the value of the node
+	unsigned CompileValue( MaterialProgram& program ) override;
+
+	// compile the bxdfs of the sub-tree
+	void CompileBxdf( MaterialProgram& program , unsigned weight ) override;
+
 	// check validation
 	bool CheckValidation() override;
 
@@ -0,0 +1,78 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "shadingqueue.h"
+#include "material.h"
+#include "geometry/intersection.h"
+#include "geometry/primitive.h"
+#include "managers/memmanager.h"
+
+// group the hits by their materials
+void ShadingQueue::Build( const Intersection* inters , const bool* hit , unsigned count )
+{
+	// the ids are dense , the histogram only needs to cover the largest one in the stream
+	unsigned* ids = SORT_MALLOC_ARRAY( unsigned , count );
+	const Material** materials = SORT_MALLOC_ARRAY( const Material* , count );
+	unsigned max_id = 0;
+	m_hitCnt = 0;
+	for( unsigned k = 0 ; k < count ; ++k ){
+		if( hit && !hit[k] )
+			continue;
+		materials[k] = inters[k].primitive->GetMaterial();
+		ids[k] = materials[k]->GetID();
+		max_id = max( max_id , ids[k] );
+		++m_hitCnt;
+	}
+
+	unsigned* offset = SORT_MALLOC_ARRAY( unsigned , max_id + 2 );
+	for( unsigned i = 0 ; i < max_id + 2 ; ++i )
+		offset[i] = 0;
+	for( unsigned k = 0 ; k < count ; ++k ){
+		if( !hit || hit[k] )
+			++offset[ ids[k] + 1 ];
+	}
+
+	// the groups are the non-empty bins
+	m_groupCnt = 0;
+	for( unsigned i = 1 ; i < max_id + 2 ; ++i )
+		m_groupCnt += ( offset[i] > 0 ) ? 1 : 0;
+	m_groupOffset = SORT_MALLOC_ARRAY( unsigned , m_groupCnt + 1 );
+	m_groupMaterial = SORT_MALLOC_ARRAY( const Material* , m_groupCnt );
+	unsigned g = 0;
+	for( unsigned i = 1 ; i < max_id + 2 ; ++i ){
+		if( offset[i] > 0 )
+			m_groupOffset[g++] = offset[i-1];
+		offset[i] += offset[i-1];
+	}
+	m_groupOffset[m_groupCnt] = m_hitCnt;
+
+	// the sort is stable , hits keep their order in the stream inside a group
+	m_order = SORT_MALLOC_ARRAY( unsigned , m_hitCnt );
+	for( unsigned k = 0 ; k < count ; ++k ){
+		if( !hit || hit[k] )
+			m_order[ offset[ ids[k] ]++ ] = k;
+	}
+	for( unsigned i = 0 ; i < m_groupCnt ; ++i )
+		m_groupMaterial[i] = materials[ m_order[ m_groupOffset[i] ] ];
+}
+
+// get the bsdfs of all hits
+void ShadingQueue::Shade( const Intersection* inters , Bsdf** bsdfs ) const
+{
+	for( unsigned g = 0 ; g < m_groupCnt ; ++g )
+		m_groupMaterial[g]->GetBsdfs( inters , m_order + m_groupOffset[g] , m_groupOffset[g+1] - m_groupOffset[g] , bsdfs );
+}
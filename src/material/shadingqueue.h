@@ -0,0 +1,67 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+class Intersection;
+class Material;
+class Bsdf;
+
+//////////////////////////////////////////////////////////////////////////////////
+// definition of shading queue
+// desc :	Hits of a stream of rays usually land on different materials one after
+//			another. The queue groups them by the ids of their materials with a
+//			counting sort and evaluates the program of each material for its whole
+//			group at once , so shading stays on one material at a time. Hits keep
+//			their order in the stream inside a group. All memory is taken from the
+//			arena of the thread.
+class ShadingQueue
+{
+public:
+	// group the hits by their materials
+	// para 'inters' : the intersections
+	// para 'hit'    : whether each ray hits anything , nullptr if all of them do
+	// para 'count'  : the number of intersections
+	void	Build( const Intersection* inters , const bool* hit , unsigned count );
+
+	// get the bsdfs of all hits , the bsdf of an intersection is written at its index
+	// para 'inters' : the intersections the queue is built with
+	// para 'bsdfs'  : the bsdfs , the ones of missed rays are not touched
+	void	Shade( const Intersection* inters , Bsdf** bsdfs ) const;
+
+	// the number of hits
+	unsigned GetHitCount() const { return m_hitCnt; }
+
+	// the indices of the intersections of all hits , grouped by materials
+	const unsigned* GetOrder() const { return m_order; }
+
+	// the number of groups , each of them holds the hits of one material
+	unsigned GetGroupCount() const { return m_groupCnt; }
+
+	// the hits of a group are in [ GetGroupOffset( g ) , GetGroupOffset( g + 1 ) ) of the order
+	unsigned GetGroupOffset( unsigned g ) const { return m_groupOffset[g]; }
+
+	// the material of a group
+	const Material* GetGroupMaterial( unsigned g ) const { return m_groupMaterial[g]; }
+
+private:
+	unsigned*			m_order = nullptr;			// the indices of the hits grouped by materials
+	unsigned			m_hitCnt = 0;				// the number of hits
+	unsigned*			m_groupOffset = nullptr;	// the first hit of each group , one more for the end
+	const Material**	m_groupMaterial = nullptr;	// the material of each group
+	unsigned			m_groupCnt = 0;				// the number of groups
+};
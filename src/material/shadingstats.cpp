@@ -0,0 +1,60 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+#include "shadingstats.h"
+#include "utility/define.h"
+#include <mutex>
+
+// counters of each thread
+static Thread_Local ShadingCounter g_localStats[SHADING_STATS_MATERIALS];
+
+// counters of the finished threads
+static ShadingCounter g_totalStats[SHADING_STATS_MATERIALS];
+static std::mutex g_statsMutex;
+
+// merge a counter into another one
+static void _merge( ShadingCounter& dst , const ShadingCounter& src )
+{
+    dst.bsdfs += src.bsdfs;
+    dst.evaluations += src.evaluations;
+    dst.ticks += src.ticks;
+}
+
+// counters of a material in the current thread
+ShadingCounter& ShadingStats::Local( unsigned id )
+{
+    return g_localStats[ min( id , (unsigned)SHADING_STATS_MATERIALS - 1 ) ];
+}
+
+// merge the counters of the current thread into the total
+void ShadingStats::Flush()
+{
+    std::lock_guard<std::mutex> lock( g_statsMutex );
+    for( unsigned i = 0 ; i < SHADING_STATS_MATERIALS ; ++i ){
+        _merge( g_totalStats[i] , g_localStats[i] );
+        g_localStats[i] = ShadingCounter();
+    }
+}
+
+// get the total
+std::vector<ShadingCounter> ShadingStats::Total()
+{
+    std::lock_guard<std::mutex> lock( g_statsMutex );
+    std::vector<ShadingCounter> total( g_totalStats , g_totalStats + SHADING_STATS_MATERIALS );
+    for( unsigned i = 0 ; i < SHADING_STATS_MATERIALS ; ++i )
+        _merge( total[i] , g_localStats[i] );
+    return total;
+}
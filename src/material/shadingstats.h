@@ -0,0 +1,104 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+#pragma once
+
+#include "sort.h"
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+//! @brief Statements only compiled with SORT_SHADING_STATS enabled.
+//!
+//! Timing is wrapped in it so that shading pays nothing for the counters in regular builds.
+#if SORT_SHADING_STATS
+#define SHADING_STATS(...)  __VA_ARGS__
+#else
+#define SHADING_STATS(...)
+#endif
+
+//! The number of materials counted separately, materials with larger ids are counted in the last one.
+#define SHADING_STATS_MATERIALS 1024
+
+//! @brief Counters of the shading work of a material.
+/**
+ * There is no member initializer since it is a thread local variable, they are zero-initialized with it.
+ */
+struct ShadingCounter
+{
+    unsigned long long  bsdfs;          /**< Number of bsdfs created for hits of the material. */
+    unsigned long long  evaluations;    /**< Number of evaluations, samplings and pdf queries of the bsdfs. */
+    unsigned long long  ticks;          /**< Cycles spent on creating and evaluating the bsdfs. */
+};
+
+//! @brief Per-material shading statistics.
+/**
+ * Each thread counts in its own copy indexed by the material id so that there is no synchronization
+ * during shading, the copy of a render thread is merged into the total once the thread finishes. The
+ * time is measured by the cycle counter of the processor, it is cheap enough to wrap every bsdf call.
+ */
+class ShadingStats
+{
+public:
+    //! The current value of the cycle counter.
+    static unsigned long long Ticks()
+    {
+#if defined(_MSC_VER) || defined(__i386__) || defined(__x86_64__)
+        return __rdtsc();
+#else
+        return (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    //! Counters of a material in the current thread.
+    //! @param id   The id of the material.
+    static ShadingCounter& Local( unsigned id );
+
+    //! Merge the counters of the current thread into the total and clear them.
+    static void Flush();
+
+    //! The total along with the counters of the current thread, indexed by the material id.
+    static std::vector<ShadingCounter> Total();
+};
+
+//! @brief Count the cycles of a scope to a material.
+class ShadingTimer
+{
+public:
+    //! @brief Start timing.
+    //! @param id           The id of the material.
+    //! @param bsdfs        The number of bsdfs created in the scope, a bsdf is evaluated in it if it is zero.
+    ShadingTimer( unsigned id , unsigned bsdfs ) : m_counter( ShadingStats::Local( id ) ) , m_start( ShadingStats::Ticks() )
+    {
+        if( bsdfs )
+            m_counter.bsdfs += bsdfs;
+        else
+            ++m_counter.evaluations;
+    }
+
+    //! Stop timing.
+    ~ShadingTimer() { m_counter.ticks += ShadingStats::Ticks() - m_start; }
+
+private:
+    ShadingCounter&     m_counter;  /**< The counters of the material. */
+    unsigned long long  m_start;    /**< The cycle counter when the scope starts. */
+};
@@ -0,0 +1,86 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include header file
+#include "subsurface.h"
+#include "utility/strhelper.h"
+#include "thirdparty/tinyxml/tinyxml.h"
+
+// parse the profile
+void SubsurfaceProfile::Parse( const TiXmlElement* element )
+{
+	const char* sigma_a = element->Attribute( "sigma_a" );
+	if( sigma_a )
+		m_sigmaA = SpectrumFromStr( sigma_a );
+	const char* sigma_s = element->Attribute( "sigma_s" );
+	if( sigma_s )
+		m_sigmaS = SpectrumFromStr( sigma_s );
+	const char* eta = element->Attribute( "eta" );
+	if( eta )
+		m_eta = max( 1.0f , (float)atof( eta ) );
+	const char* scale = element->Attribute( "scale" );
+	_update( scale ? max( 1e-6f , (float)atof( scale ) ) : 1.0f );
+}
+
+// derive the terms of the dipole
+void SubsurfaceProfile::_update( float scale )
+{
+	// the polynomial fit of the diffuse fresnel reflectance by Egan and Hilgeman
+	m_fdr = -1.440f / ( m_eta * m_eta ) + 0.710f / m_eta + 0.668f + 0.0636f * m_eta;
+	const float A = ( 1.0f + m_fdr ) / ( 1.0f - m_fdr );
+
+	const float sigma_a[3] = { m_sigmaA.GetR() , m_sigmaA.GetG() , m_sigmaA.GetB() };
+	const float sigma_s[3] = { m_sigmaS.GetR() , m_sigmaS.GetG() , m_sigmaS.GetB() };
+	for( int i = 0 ; i < 3 ; ++i )
+	{
+		const float sa = max( 0.0f , sigma_a[i] ) * scale;
+		const float ss = max( 0.0f , sigma_s[i] ) * scale;
+		const float st = max( 1e-6f , sa + ss );
+		m_alpha[i] = ss / st;
+		m_sigmaTr[i] = sqrt( 3.0f * sa * st );
+		m_zr[i] = 1.0f / st;
+		m_zv[i] = m_zr[i] * ( 1.0f + 4.0f * A / 3.0f );
+	}
+}
+
+// the diffuse reflectance of the dipole
+Spectrum SubsurfaceProfile::Rd( float sqr_distance ) const
+{
+	float rd[3];
+	for( int i = 0 ; i < 3 ; ++i )
+	{
+		const float dr = sqrt( sqr_distance + m_zr[i] * m_zr[i] );
+		const float dv = sqrt( sqr_distance + m_zv[i] * m_zv[i] );
+		const float tr = m_sigmaTr[i];
+		rd[i] = m_alpha[i] * 0.25f * INV_PI * ( m_zr[i] * ( tr * dr + 1.0f ) * exp( -tr * dr ) / ( dr * dr * dr ) +
+												 m_zv[i] * ( tr * dv + 1.0f ) * exp( -tr * dv ) / ( dv * dv * dv ) );
+	}
+	return Spectrum( rd[0] , rd[1] , rd[2] );
+}
+
+// the fraction of the light crossing the boundary
+float SubsurfaceProfile::Ft( float cos ) const
+{
+	// the light refracts into the denser material , it is never reflected totally
+	const float cos_i = min( 1.0f , fabs( cos ) );
+	const float sin_t = sqrt( max( 0.0f , 1.0f - cos_i * cos_i ) ) / m_eta;
+	const float cos_t = sqrt( max( 0.0f , 1.0f - sin_t * sin_t ) );
+	const float rparl = ( m_eta * cos_i - cos_t ) / ( m_eta * cos_i + cos_t );
+	const float rperp = ( cos_i - m_eta * cos_t ) / ( cos_i + m_eta * cos_t );
+	return 1.0f - 0.5f * ( rparl * rparl + rperp * rperp );
+}
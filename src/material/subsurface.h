@@ -0,0 +1,74 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "spectrum/spectrum.h"
+#include "utility/define.h"
+
+class TiXmlElement;
+
+///////////////////////////////////////////////////////////
+// the dipole diffusion profile of a translucent material , light enters the surface , scatters many times inside and leaves
+// it somewhere else. The diffuse reflectance of the dipole is the one proposed in "A Practical Model for Subsurface Light
+// Transport" by Jensen et al. , it is integrated over the irradiance of points on the surface as in "A Rapid Hierarchical
+// Rendering Technique for Translucent Materials" by Jensen and Buhler.
+// note : the coefficients are in the unit of the inverse of 'scale' , they are converted to the unit of the scene once parsed.
+class SubsurfaceProfile
+{
+public:
+	// default constructor , the profile of skin measured in millimeters
+	SubsurfaceProfile() { _update( 1.0f ); }
+
+	// parse the profile from the 'Subsurface' element of a material
+	// para 'element' : the element , the attributes 'sigma_a' , 'sigma_s' , 'eta' and 'scale' are optional
+	void	Parse( const TiXmlElement* element );
+
+	// the fraction of the flux entering the surface at a point leaving it at a distance
+	// para 'sqr_distance' : the squared distance between the points
+	// result              : the diffuse reflectance per unit area
+	Spectrum Rd( float sqr_distance ) const;
+
+	// the fraction of the light crossing the boundary
+	// para 'cos' : the cosine between the direction outside the surface and the normal
+	float	Ft( float cos ) const;
+
+	// the radiance leaving the surface from the exitance of the points around it
+	// para 'mo'  : the exitance , the sum of the diffuse reflectance weighted by the irradiance and the area of the points
+	// para 'cos' : the cosine between the outgoing direction and the normal
+	Spectrum Lo( const Spectrum& mo , float cos ) const { return mo * ( Ft( cos ) * INV_PI / ( 1.0f - m_fdr ) ); }
+
+private:
+	// the absorption and reduced scattering coefficients , the default ones are measured from skin in millimeters
+	Spectrum	m_sigmaA = Spectrum( 0.032f , 0.17f , 0.48f );
+	Spectrum	m_sigmaS = Spectrum( 0.74f , 0.88f , 1.01f );
+	// the relative index of refraction of the material
+	float		m_eta = 1.3f;
+
+	// the terms of the dipole of each channel , they are derived from the coefficients
+	float		m_sigmaTr[3];		// the effective transport coefficient
+	float		m_zr[3];			// the depth of the real source
+	float		m_zv[3];			// the height of the virtual source
+	float		m_alpha[3];			// the reduced albedo
+	// the average diffuse fresnel reflectance at the boundary
+	float		m_fdr = 0.0f;
+
+	// derive the terms of the dipole from the coefficients
+	// para 'scale' : the number of the units of the coefficients in one unit of the scene
+	void	_update( float scale );
+};
@@ -0,0 +1,84 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header
+#include "affine.h"
+
+// default constructor
+AffineMatrix::AffineMatrix()
+{
+	for( int i = 0 ; i < 4 ; i++ )
+		for( int j = 0 ; j < 4 ; j++ )
+			c[i][j] = ( i == j && i < 3 ) ? 1.0f : 0.0f;
+}
+
+// constructor from a 4x4 matrix
+AffineMatrix::AffineMatrix( const Matrix& m )
+{
+	for( int i = 0 ; i < 4 ; i++ )
+	{
+		c[i][0] = m.m[i];
+		c[i][1] = m.m[4+i];
+		c[i][2] = m.m[8+i];
+		c[i][3] = 0.0f;
+	}
+}
+
+// the bound of the absolute error of a transformed point , it is the same with the one of Matrix
+Vector AffineMatrix::TransformError( const Point& p , const Vector& error ) const
+{
+	const float g = ErrorBound( 3 );
+	Vector r;
+	for( int i = 0 ; i < 3 ; i++ )
+		r[i] = ( 1.0f + g ) * ( fabs( c[0][i] ) * error.x + fabs( c[1][i] ) * error.y + fabs( c[2][i] ) * error.z ) +
+			   g * ( fabs( c[0][i] * p.x ) + fabs( c[1][i] * p.y ) + fabs( c[2][i] * p.z ) + fabs( c[3][i] ) );
+	return r;
+}
+
+// constructor from a transform
+AffineTransform::AffineTransform( const Transform& t ):
+matrix( t.matrix ) , invMatrix( t.invMatrix ) , normalMatrix( t.invMatrix.Transpose() )
+{
+	// the translation of the inverse matrix is in the last row after transposing , which is dropped
+}
+
+// interpolate two affine transforms
+AffineTransform Lerp( const AffineTransform& a , const AffineTransform& b , float t )
+{
+	AffineTransform r;
+	for( int i = 0 ; i < 4 ; i++ )
+		for( int j = 0 ; j < 3 ; j++ )
+			r.matrix.c[i][j] = a.matrix.c[i][j] + ( b.matrix.c[i][j] - a.matrix.c[i][j] ) * t;
+
+	// the rows of the inverse of the 3x3 part are the cross products of its columns over the determinant
+	const Vector c0( r.matrix.c[0][0] , r.matrix.c[0][1] , r.matrix.c[0][2] );
+	const Vector c1( r.matrix.c[1][0] , r.matrix.c[1][1] , r.matrix.c[1][2] );
+	const Vector c2( r.matrix.c[2][0] , r.matrix.c[2][1] , r.matrix.c[2][2] );
+	const Vector trans( r.matrix.c[3][0] , r.matrix.c[3][1] , r.matrix.c[3][2] );
+	const float inv_det = 1.0f / Dot( c0 , Cross( c1 , c2 ) );
+	const Vector rows[3] = { Cross( c1 , c2 ) * inv_det , Cross( c2 , c0 ) * inv_det , Cross( c0 , c1 ) * inv_det };
+	for( int i = 0 ; i < 3 ; i++ )
+	{
+		for( int j = 0 ; j < 3 ; j++ )
+		{
+			r.invMatrix.c[j][i] = rows[i][j];
+			r.normalMatrix.c[i][j] = rows[i][j];
+		}
+		r.invMatrix.c[3][i] = -Dot( rows[i] , trans );
+	}
+	return r;
+}
@@ -0,0 +1,150 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#ifndef	SORT_AFFINE
+#define	SORT_AFFINE
+
+// include the header
+#include "transform.h"
+
+////////////////////////////////////////////////////////////////////
+//	definition of affine matrix
+// note : the matrix has no projective row , it is the upper 3x4 part of a 4x4 matrix.
+//		  the columns are stored instead of the rows , a point is the sum of the scaled
+//		  columns , which takes no shuffling with SSE. the columns are summed in the same
+//		  order with the one of Matrix , so the results are exactly the same.
+class	AffineMatrix
+{
+// public method
+public:
+	// default constructor , initialize an identity matrix
+	AffineMatrix();
+	// constructor from a 4x4 matrix , the last row is ignored
+	// para 'm' : the matrix whose upper 3x4 part is taken
+	explicit AffineMatrix( const Matrix& m );
+
+	// transform a point
+	// para 'p' : the point to transform
+	// result   : the transformed point
+	Point operator * ( const Point& p ) const
+	{
+#if defined(SORT_SIMD_SSE)
+		alignas(16) float r[4];
+		const __m128 xy = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( c[0] ) , _mm_set1_ps( p.x ) ) , _mm_mul_ps( _mm_loadu_ps( c[1] ) , _mm_set1_ps( p.y ) ) );
+		_mm_store_ps( r , _mm_add_ps( _mm_add_ps( xy , _mm_mul_ps( _mm_loadu_ps( c[2] ) , _mm_set1_ps( p.z ) ) ) , _mm_loadu_ps( c[3] ) ) );
+		return Point( r[0] , r[1] , r[2] );
+#else
+		return Point( p.x * c[0][0] + p.y * c[1][0] + p.z * c[2][0] + c[3][0] ,
+					  p.x * c[0][1] + p.y * c[1][1] + p.z * c[2][1] + c[3][1] ,
+					  p.x * c[0][2] + p.y * c[1][2] + p.z * c[2][2] + c[3][2] );
+#endif
+	}
+	Point operator () ( const Point& p ) const { return *this * p; }
+
+	// transform a vector
+	// para 'v' : the vector to transform
+	// result   : transformed vector
+	// note     : normals are transformed by the normal matrix of AffineTransform
+	Vector operator * ( const Vector& v ) const
+	{
+#if defined(SORT_SIMD_SSE)
+		alignas(16) float r[4];
+		const __m128 xy = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( c[0] ) , _mm_set1_ps( v.x ) ) , _mm_mul_ps( _mm_loadu_ps( c[1] ) , _mm_set1_ps( v.y ) ) );
+		_mm_store_ps( r , _mm_add_ps( xy , _mm_mul_ps( _mm_loadu_ps( c[2] ) , _mm_set1_ps( v.z ) ) ) );
+		return Vector( r[0] , r[1] , r[2] );
+#else
+		return Vector( v.x * c[0][0] + v.y * c[1][0] + v.z * c[2][0] ,
+					   v.x * c[0][1] + v.y * c[1][1] + v.z * c[2][1] ,
+					   v.x * c[0][2] + v.y * c[1][2] + v.z * c[2][2] );
+#endif
+	}
+	Vector operator () ( const Vector& v ) const { return *this * v; }
+
+	// the bound of the absolute error of a transformed point
+	// para 'p'     : the point to transform
+	// para 'error' : the bound of the absolute error the point already carries
+	// result       : the bound of the absolute error of the transformed point
+	Vector TransformError( const Point& p , const Vector& error ) const;
+
+	// transform a ray
+	// para 'r' : the ray to transform
+	// result   : transformd ray
+	Ray operator * ( const Ray& r ) const
+	{
+		Ray ray( *this * r.m_Ori , *this * r.m_Dir , r.m_Depth , r.m_fMin , r.m_fMax );
+		ray.m_Time = r.m_Time;
+		if( r.m_HasDifferentials )
+		{
+			ray.m_HasDifferentials = true;
+			ray.m_DxOri = *this * r.m_DxOri;
+			ray.m_DyOri = *this * r.m_DyOri;
+			ray.m_DxDir = *this * r.m_DxDir;
+			ray.m_DyDir = *this * r.m_DyDir;
+		}
+		return ray;
+	}
+	Ray operator () ( const Ray& r ) const { return *this * r; }
+
+// public field
+public:
+	// the four columns of the matrix , the last float of each column is always zero
+	float c[4][4];
+};
+
+////////////////////////////////////////////////////////////////////
+//	definition of affine transform
+// note : it is built from a transform whose matrices are affine , the normal matrix ,
+//		  the inverse transpose of the matrix , is cached so that it is not transposed
+//		  every time a normal is transformed.
+class	AffineTransform
+{
+// public method
+public:
+	// default constructor , initialize an identity transform
+	AffineTransform(){}
+	// constructor from a transform
+	// para 't' : the transform , it should be affine
+	explicit AffineTransform( const Transform& t );
+
+	// the operator for transformation
+	Point	operator()( const Point& p ) const { return matrix * p; }
+	Vector	operator()( const Vector& v ) const { return matrix * v; }
+	Ray		operator()( const Ray& r ) const { return matrix * r; }
+
+	// transform a normal , the result is not normalized
+	// para 'n' : the normal to transform
+	// result   : the transformed normal
+	Vector	TransformNormal( const Vector& n ) const { return normalMatrix * n; }
+
+// public field
+public:
+	// the matrix for tranformation
+	AffineMatrix	matrix;
+	// the inverse of the original matrix
+	AffineMatrix	invMatrix;
+	// the inverse transpose of the original matrix , its translation is zero
+	AffineMatrix	normalMatrix;
+};
+
+// interpolate two affine transforms , the matrices are interpolated linearly so that points move on straight lines
+// para 'a' : the transform at 't' equal to 0
+// para 'b' : the transform at 't' equal to 1
+// para 't' : the interpolation weight
+// result   : the interpolated transform , its inverse and normal matrix are evaluated again
+AffineTransform	Lerp( const AffineTransform& a , const AffineTransform& b , float t );
+
+#endif
@@ -0,0 +1,161 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <string.h>
+#include "simd/simd.h"
+
+/*
+description :
+	Polynomial approximations of the transcendental functions used by the sampling code.
+	sincos , atan2 and acos are templates of the value type , they take plain floats as
+	well as vfloat<N> , there is no branch in them so that a loop calling them with floats
+	could still be vectorized by the compiler. exp and log need the bits of the floats ,
+	they only take plain floats. The coefficients are the ones of Cephes.
+
+	The functions are only used in place of the ones of libm with SORT_FAST_MATH , the
+	wrappers at the end of the file pick one of them at compile time.
+*/
+
+// sine and cosine of an angle at the same time , the absolute error is below 1e-7 for the
+// angles of a few turns , the range reduction loses precision for very large angles
+// para 'x' : the angle in radians
+// para 's' : the sine of the angle
+// para 'c' : the cosine of the angle
+template<class T>
+inline void FastSinCos( const T& x , T& s , T& c )
+{
+	// the quadrant of the angle , rounded to the nearest one
+	const auto q = ToInt( x * T( 0.63661977236f ) + Select( x < T( 0.0f ) , T( -0.5f ) , T( 0.5f ) ) );
+	const T fq = ToFloat( q );
+
+	// the angle within [-pi/4,pi/4] , pi/2 is subtracted in three parts to keep the precision
+	const T r = ( ( x - fq * T( 1.5703125f ) ) - fq * T( 4.837512969970703125e-4f ) ) - fq * T( 7.54978995489188216e-8f );
+	const T r2 = r * r;
+	const T ps = r + r * r2 * ( ( T( -1.9515295891e-4f ) * r2 + T( 8.3321608736e-3f ) ) * r2 + T( -1.6666654611e-1f ) );
+	const T pc = T( 1.0f ) - T( 0.5f ) * r2 + r2 * r2 * ( ( T( 2.443315711809948e-5f ) * r2 + T( -1.388731625493765e-3f ) ) * r2 + T( 4.166664568298827e-2f ) );
+
+	// odd quadrants swap sine and cosine , the signs follow the quadrant
+	const auto swap = ( q & 1 ) == 0;
+	const T ss = Select( swap , ps , pc );
+	const T cc = Select( swap , pc , ps );
+	s = Select( ( q & 2 ) == 0 , ss , -ss );
+	c = Select( ( ( q + 1 ) & 2 ) == 0 , cc , -cc );
+}
+
+// arc tangent of y/x in the quadrant of the point , the error is within 3 ulp
+// para 'y' : the y coordinate of the point
+// para 'x' : the x coordinate of the point
+// result   : the angle within [-pi,pi] , it is zero at the origin
+template<class T>
+inline T FastAtan2( const T& y , const T& x )
+{
+	const T ax = Abs( x );
+	const T ay = Abs( y );
+	const auto steep = ay > ax;
+	const T num = Select( steep , ax , ay );
+	const T den = Select( steep , ay , ax );
+
+	// the ratio is within [0,1] , the ones above tan(pi/8) are moved around zero by the formula of the difference of angles
+	const T a = num / Select( den == T( 0.0f ) , T( 1.0f ) , den );
+	const auto far = a > T( 0.4142135623730950f );
+	const T t = Select( far , ( a - T( 1.0f ) ) / ( a + T( 1.0f ) ) , a );
+	const T z = t * t;
+	T r = ( ( ( ( T( 8.05374449538e-2f ) * z + T( -1.38776856032e-1f ) ) * z + T( 1.99777106478e-1f ) ) * z + T( -3.33329491539e-1f ) ) * z ) * t + t;
+	r = r + Select( far , T( 0.78539816339744830f ) , T( 0.0f ) );
+
+	// back to the quadrant of the point
+	r = Select( steep , T( 1.57079632679489662f ) - r , r );
+	r = Select( x < T( 0.0f ) , T( 3.14159265358979324f ) - r , r );
+	return Select( y < T( 0.0f ) , -r , r );
+}
+
+// arc cosine , the absolute error is below 4e-7
+// para 'x' : the cosine of the angle , it should be within [-1,1]
+// result   : the angle within [0,pi]
+template<class T>
+inline T FastAcos( const T& x )
+{
+	// the arc sine of the inputs away from zero is evaluated at sqrt((1-|x|)/2) with acos(x) = 2asin(sqrt((1-x)/2))
+	const T ax = Abs( x );
+	const auto large = ax > T( 0.5f );
+	const T z = Select( large , Sqrt( ( T( 1.0f ) - ax ) * T( 0.5f ) ) , x );
+	const T z2 = z * z;
+	const T p = ( ( ( ( T( 4.2163199048e-2f ) * z2 + T( 2.4181311049e-2f ) ) * z2 + T( 4.5470025998e-2f ) ) * z2 + T( 7.4953002686e-2f ) ) * z2 + T( 1.6666752422e-1f ) ) * z2 * z + z;
+
+	const T l = T( 2.0f ) * p;
+	const T lr = Select( x < T( 0.0f ) , T( 3.14159265358979324f ) - l , l );
+	return Select( large , lr , T( 1.57079632679489662f ) - p );
+}
+
+// the exponential function , the error is within 1 ulp
+// para 'x' : the exponent , it is clamped to the range of normal floats
+// result   : e to the power of x
+inline float FastExp( float x )
+{
+	x = x > 88.0f ? 88.0f : ( x < -87.0f ? -87.0f : x );
+
+	// e^x = 2^n * e^r with r within [-ln2/2,ln2/2] , ln2 is subtracted in two parts to keep the precision
+	const float fn = (float)(int)( x * 1.44269504088896341f + ( x < 0.0f ? -0.5f : 0.5f ) );
+	const float r = ( x - fn * 0.693359375f ) - fn * -2.12194440e-4f;
+	const float p = ( ( ( ( ( 1.9875691500e-4f * r + 1.3981999507e-3f ) * r + 8.3334519073e-3f ) * r + 4.1665795894e-2f ) * r + 1.6666665459e-1f ) * r + 5.0000001201e-1f ) * r * r + r + 1.0f;
+
+	// 2^n is built from its bits
+	const int bits = ( (int)fn + 127 ) << 23;
+	float scale;
+	memcpy( &scale , &bits , sizeof( float ) );
+	return p * scale;
+}
+
+// the natural logarithm , the error is within 1 ulp
+// para 'x' : a positive normal float
+// result   : the natural logarithm of x
+inline float FastLog( float x )
+{
+	// x = m * 2^e with m within [sqrt(1/2),sqrt(2))
+	int bits;
+	memcpy( &bits , &x , sizeof( float ) );
+	float e = (float)( ( bits >> 23 ) - 126 );
+	bits = ( bits & 0x007fffff ) | 0x3f000000;
+	float m;
+	memcpy( &m , &bits , sizeof( float ) );
+	const bool low = m < 0.707106781186547524f;
+	e = low ? e - 1.0f : e;
+	m = low ? m + m - 1.0f : m - 1.0f;
+
+	const float z = m * m;
+	float y = ( ( ( ( ( ( ( ( 7.0376836292e-2f * m - 1.1514610310e-1f ) * m + 1.1676998740e-1f ) * m - 1.2420140846e-1f ) * m + 1.4249322787e-1f ) * m - 1.6668057665e-1f ) * m + 2.0000714765e-1f ) * m - 2.4999993993e-1f ) * m + 3.3333331174e-1f ) * m * z;
+	y += -2.12194440e-4f * e - 0.5f * z;
+	return m + y + 0.693359375f * e;
+}
+
+// the functions used by the sampling code , the approximations are taken with SORT_FAST_MATH
+#if defined(SORT_FAST_MATH)
+inline void SinCos( float x , float& s , float& c ) { FastSinCos( x , s , c ); }
+inline float Atan2( float y , float x ) { return FastAtan2( y , x ); }
+inline float Acos( float x ) { return FastAcos( x ); }
+inline float Exp( float x ) { return FastExp( x ); }
+inline float Log( float x ) { return FastLog( x ); }
+#else
+inline void SinCos( float x , float& s , float& c ) { s = sinf( x ); c = cosf( x ); }
+inline float Atan2( float y , float x ) { return atan2f( y , x ); }
+inline float Acos( float x ) { return acosf( x ); }
+inline float Exp( float x ) { return expf( x ); }
+inline float Log( float x ) { return logf( x ); }
+#endif
@@ -52,6 +52,19 @@ Matrix::Matrix( float _11 , float _12 , float _13 , float _14 ,
 Matrix Matrix::operator *( const Matrix& mat) const
 {
 	float data[16];
+#if defined(SORT_SIMD_SSE)
+	// each row of the result is a combination of the rows of 'mat'
+	const __m128 r0 = _mm_loadu_ps( mat.m ) , r1 = _mm_loadu_ps( mat.m + 4 ) , r2 = _mm_loadu_ps( mat.m + 8 ) , r3 = _mm_loadu_ps( mat.m + 12 );
+	for( int i = 0 ; i < 4 ; i++ )
+	{
+		const float* row = m + i * 4;
+		__m128 r = _mm_mul_ps( _mm_set1_ps( row[0] ) , r0 );
+		r = _mm_add_ps( r , _mm_mul_ps( _mm_set1_ps( row[1] ) , r1 ) );
+		r = _mm_add_ps( r , _mm_mul_ps( _mm_set1_ps( row[2] ) , r2 ) );
+		r = _mm_add_ps( r , _mm_mul_ps( _mm_set1_ps( row[3] ) , r3 ) );
+		_mm_storeu_ps( data + i * 4 , r );
+	}
+#else
 	for( int i = 0 ; i < 4 ; i++ )
 	{
 		for( int j = 0 ; j < 4 ; j++ )
@@ -63,37 +76,11 @@ Matrix Matrix::operator *( const Matrix& mat) const
 				data[offset] += m[i*4+k]*mat.m[k*4+j];
 		}
 	}
+#endif
 
 	return Matrix(data);
 }
 
-// transform point
-Point Matrix::operator *( const Point& p ) const
-{
-	float x = p.x * m[0] + p.y * m[1] + p.z * m[2] + m[3];
-	float y = p.x * m[4] + p.y * m[5] + p.z * m[6] + m[7];
-	float z = p.x * m[8] + p.y * m[9] + p.z * m[10] + m[11];
-	float w = p.x * m[12] + p.y * m[13] + p.z * m[14] + m[15];
-
-	// if w is one , just return the point
-	// note it is very common that w is one
-	if( w == 1.0f )
-		return Point( x , y , z );
-
-	return Point( x , y , z ) / w;
-}
-
-// transform vector
-Vector Matrix::operator *( const Vector& v ) const
-{
-	float _x = v.x * m[0] + v.y * m[1] + v.z * m[2];
-	float _y = v.x * m[4] + v.y * m[5] + v.z * m[6];
-	float _z = v.x * m[8] + v.y * m[9] + v.z * m[10];
-
-	// return the result
-	return Vector( _x , _y , _z );
-}
-
 // create a transpose matrix
 Matrix Matrix::Transpose() const
 {
@@ -156,3 +143,18 @@ bool Matrix::HasScale() const
 	return !( IS_ONE(l0) && IS_ONE(l1) && IS_ONE(l2) );
 #undef IS_ONE
 }
+
+// the bound of the absolute error of a transformed point
+Vector Matrix::TransformError( const Point& p , const Vector& error ) const
+{
+	// each component is a sum of three products and the translation , the error of the point is scaled by the matrix
+	const float g = ErrorBound( 3 );
+	Vector r;
+	for( int i = 0 ; i < 3 ; i++ )
+	{
+		const float* row = m + 4 * i;
+		r[i] = ( 1.0f + g ) * ( fabs( row[0] ) * error.x + fabs( row[1] ) * error.y + fabs( row[2] ) * error.z ) +
+			   g * ( fabs( row[0] * p.x ) + fabs( row[1] * p.y ) + fabs( row[2] * p.z ) + fabs( row[3] ) );
+	}
+	return r;
+}
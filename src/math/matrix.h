@@ -20,6 +20,10 @@
 
 #include "geometry/ray.h"
 
+#if defined(SORT_SIMD_SSE)
+#include <xmmintrin.h>
+#endif
+
 ////////////////////////////////////////////////////////////////////
 //	definition of matrix
 class	Matrix
@@ -47,28 +51,93 @@ public:
 	// transform a point
 	// para 'p' : the point to transform
 	// result   : the transformed point
-	Point operator * ( const Point& p ) const;
+	Point operator * ( const Point& p ) const
+	{
+		float r[4];
+		TransformPoint( p , r );
+
+		// if w is one , just return the point
+		// note it is very common that w is one
+		if( r[3] == 1.0f )
+			return Point( r[0] , r[1] , r[2] );
+
+		return Point( r[0] , r[1] , r[2] ) / r[3];
+	}
 	Point operator () ( const Point& p ) const { return *this * p; }
 
 	// transform a vector
 	// para 'v' : the vector to transform
 	// result   : transformed vector
 	// note     : a matrix transformation applied to a normal is invalid
-	Vector operator * ( const Vector& v ) const;
+	Vector operator * ( const Vector& v ) const
+	{
+		float r[4];
+		TransformVector( v , r );
+		return Vector( r[0] , r[1] , r[2] );
+	}
 	Vector operator () ( const Vector& v ) const { return *this * v; }
 
+	// the bound of the absolute error of a transformed point , the matrix is taken as affine
+	// para 'p'     : the point to transform
+	// para 'error' : the bound of the absolute error the point already carries
+	// result       : the bound of the absolute error of the transformed point
+	Vector TransformError( const Point& p , const Vector& error ) const;
+
 	// transform a ray
 	// para 'r' : the ray to transform
 	// result   : transformd ray
 	Ray operator * ( const Ray& r ) const
 	{
-		return Ray( *this * r.m_Ori , *this * r.m_Dir , r.m_Depth , r.m_fMin , r.m_fMax );
+		Ray ray( *this * r.m_Ori , *this * r.m_Dir , r.m_Depth , r.m_fMin , r.m_fMax );
+		ray.m_Time = r.m_Time;
+		if( r.m_HasDifferentials )
+		{
+			ray.m_HasDifferentials = true;
+			ray.m_DxOri = *this * r.m_DxOri;
+			ray.m_DyOri = *this * r.m_DyOri;
+			ray.m_DxDir = *this * r.m_DxDir;
+			ray.m_DyDir = *this * r.m_DyDir;
+		}
+		return ray;
 	}
 	Ray operator () ( const Ray& r ) const
 	{
 		return *this * r;
 	}
 
+	// transform a point , 'r' holds the homogeneous result with w in the last float
+	void TransformPoint( const Point& p , float r[4] ) const
+	{
+#if defined(SORT_SIMD_SSE)
+		// the columns are summed in the same order with the scalar version , the results are exactly the same
+		__m128 c0 = _mm_loadu_ps( m ) , c1 = _mm_loadu_ps( m + 4 ) , c2 = _mm_loadu_ps( m + 8 ) , c3 = _mm_loadu_ps( m + 12 );
+		_MM_TRANSPOSE4_PS( c0 , c1 , c2 , c3 );
+		const __m128 xy = _mm_add_ps( _mm_mul_ps( c0 , _mm_set1_ps( p.x ) ) , _mm_mul_ps( c1 , _mm_set1_ps( p.y ) ) );
+		_mm_storeu_ps( r , _mm_add_ps( _mm_add_ps( xy , _mm_mul_ps( c2 , _mm_set1_ps( p.z ) ) ) , c3 ) );
+#else
+		r[0] = p.x * m[0] + p.y * m[1] + p.z * m[2] + m[3];
+		r[1] = p.x * m[4] + p.y * m[5] + p.z * m[6] + m[7];
+		r[2] = p.x * m[8] + p.y * m[9] + p.z * m[10] + m[11];
+		r[3] = p.x * m[12] + p.y * m[13] + p.z * m[14] + m[15];
+#endif
+	}
+
+	// transform a vector , the last float of 'r' is of no use
+	void TransformVector( const Vector& v , float r[4] ) const
+	{
+#if defined(SORT_SIMD_SSE)
+		__m128 c0 = _mm_loadu_ps( m ) , c1 = _mm_loadu_ps( m + 4 ) , c2 = _mm_loadu_ps( m + 8 ) , c3 = _mm_loadu_ps( m + 12 );
+		_MM_TRANSPOSE4_PS( c0 , c1 , c2 , c3 );
+		const __m128 xy = _mm_add_ps( _mm_mul_ps( c0 , _mm_set1_ps( v.x ) ) , _mm_mul_ps( c1 , _mm_set1_ps( v.y ) ) );
+		_mm_storeu_ps( r , _mm_add_ps( xy , _mm_mul_ps( c2 , _mm_set1_ps( v.z ) ) ) );
+#else
+		r[0] = v.x * m[0] + v.y * m[1] + v.z * m[2];
+		r[1] = v.x * m[4] + v.y * m[5] + v.z * m[6];
+		r[2] = v.x * m[8] + v.y * m[9] + v.z * m[10];
+		r[3] = 0.0f;
+#endif
+	}
+
 	// transpose the matrix
 	Matrix Transpose() const;
 	// determinant of the matrix
@@ -78,6 +147,8 @@ public:
 
 	// whether the matrix have scale factor
 	bool	HasScale() const;
+	// whether the matrix is affine , the last row is ( 0 , 0 , 0 , 1 )
+	bool	IsAffine() const { return m[12] == 0.0f && m[13] == 0.0f && m[14] == 0.0f && m[15] == 1.0f; }
 
 // public field
 public:
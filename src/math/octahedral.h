@@ -0,0 +1,87 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "vector3.h"
+
+// encode a unit vector in 32 bits with octahedral mapping
+// the vector is projected onto the octahedron , the lower half is folded over the upper one and the
+// two coordinates are stored as 16-bit signed normalized integers
+// para 'v' : the unit vector to encode
+// result   : the encoded vector
+inline unsigned EncodeOctahedral( const Vector& v )
+{
+	const float l1 = fabs( v.x ) + fabs( v.y ) + fabs( v.z );
+	if( l1 <= 0.0f )
+		return 0;
+
+	float x = v.x / l1;
+	float y = v.y / l1;
+	if( v.z < 0.0f )
+	{
+		const float ox = ( 1.0f - fabs( y ) ) * ( x >= 0.0f ? 1.0f : -1.0f );
+		y = ( 1.0f - fabs( x ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+		x = ox;
+	}
+
+	// both coordinates are in [-1,1] after the projection
+	const short qx = (short)floor( x * 32767.0f + 0.5f );
+	const short qy = (short)floor( y * 32767.0f + 0.5f );
+	return (unsigned)(unsigned short)qx | ( (unsigned)(unsigned short)qy << 16 );
+}
+
+// decode a vector encoded with octahedral mapping
+// para 'e' : the encoded vector
+// result   : the unit vector , a zero encoding decodes to the z axis
+inline Vector DecodeOctahedral( unsigned e )
+{
+	float x = (short)( e & 0xffff ) / 32767.0f;
+	float y = (short)( e >> 16 ) / 32767.0f;
+	const float z = 1.0f - fabs( x ) - fabs( y );
+	if( z < 0.0f )
+	{
+		const float ox = ( 1.0f - fabs( y ) ) * ( x >= 0.0f ? 1.0f : -1.0f );
+		y = ( 1.0f - fabs( x ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+		x = ox;
+	}
+	return Normalize( Vector( x , y , z ) );
+}
+
+// encode a unit vector in 16 bits with octahedral mapping
+// note : it is the same mapping as the 32-bit encoding with 8-bit coordinates , good for vectors that don't need much precision
+// para 'v' : the unit vector to encode
+// result   : the encoded vector
+inline unsigned short EncodeOctahedral16( const Vector& v )
+{
+	const unsigned e = EncodeOctahedral( v );
+	const float x = (short)( e & 0xffff ) / 32767.0f;
+	const float y = (short)( e >> 16 ) / 32767.0f;
+	const signed char qx = (signed char)floor( x * 127.0f + 0.5f );
+	const signed char qy = (signed char)floor( y * 127.0f + 0.5f );
+	return (unsigned short)( (unsigned)(unsigned char)qx | ( (unsigned)(unsigned char)qy << 8 ) );
+}
+
+// decode a vector encoded with 16-bit octahedral mapping
+// para 'e' : the encoded vector
+// result   : the unit vector , a zero encoding decodes to the z axis
+inline Vector DecodeOctahedral16( unsigned short e )
+{
+	const short qx = (short)( (signed char)( e & 0xff ) * 32767 / 127 );
+	const short qy = (short)( (signed char)( e >> 8 ) * 32767 / 127 );
+	return DecodeOctahedral( (unsigned)(unsigned short)qx | ( (unsigned)(unsigned short)qy << 16 ) );
+}
@@ -0,0 +1,79 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "sort.h"
+
+//! @file simd.h
+//! @brief Lane-width templated SIMD types for batched kernels.
+//!
+//! vfloat<N> , vint<N> and vbool<N> have the same interface for every width. A kernel is written once as
+//! a template of N and instantiated with the widths it needs. The widths with native registers on the
+//! target are specialized at compile time , SSE for 4 lanes , AVX2 for 8 lanes and AVX-512 for 16 lanes.
+//! All other widths , or all of them without those instruction sets , use the generic arrays of lanes.
+
+#include "vgeneric.h"
+#include "vsse.h"
+#include "vavx2.h"
+#include "vavx512.h"
+#include "vec3.h"
+
+//! @brief The widest lane count with native registers on the target.
+#if defined(SORT_SIMD_AVX512)
+static const int SIMD_NATIVE_WIDTH = 16;
+#elif defined(SORT_SIMD_AVX2)
+static const int SIMD_NATIVE_WIDTH = 8;
+#else
+static const int SIMD_NATIVE_WIDTH = 4;
+#endif
+
+//! @brief Whether any lane of the mask is set.
+template<int N>
+inline bool Any( const vbool<N>& m ){ return Movemask( m ) != 0; }
+//! @brief Whether all lanes of the mask are set , there are fewer than 32 lanes.
+template<int N>
+inline bool All( const vbool<N>& m ){ return Movemask( m ) == ( 1u << N ) - 1; }
+//! @brief Whether no lane of the mask is set.
+template<int N>
+inline bool None( const vbool<N>& m ){ return Movemask( m ) == 0; }
+
+//! @brief The minimum of all lanes.
+template<int N>
+inline float ReduceMin( const vfloat<N>& a ){
+    float r = a[0];
+    for( int i = 1 ; i < N ; ++i )
+        r = ( a[i] < r ) ? a[i] : r;
+    return r;
+}
+//! @brief The maximum of all lanes.
+template<int N>
+inline float ReduceMax( const vfloat<N>& a ){
+    float r = a[0];
+    for( int i = 1 ; i < N ; ++i )
+        r = ( a[i] > r ) ? a[i] : r;
+    return r;
+}
+//! @brief The sum of all lanes.
+template<int N>
+inline float ReduceAdd( const vfloat<N>& a ){
+    float r = a[0];
+    for( int i = 1 ; i < N ; ++i )
+        r += a[i];
+    return r;
+}
@@ -0,0 +1,123 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "vgeneric.h"
+
+#if defined(SORT_SIMD_AVX2)
+
+#include <immintrin.h>
+
+//! @brief Eight lane mask in an AVX register , each lane is either all ones or all zeros.
+template<>
+struct vbool<8>
+{
+    static const int size = 8;
+    __m256 v;
+
+    vbool(){}
+    vbool( __m256 m ) : v(m) {}
+    vbool( bool b ) : v( _mm256_castsi256_ps( _mm256_set1_epi32( b ? -1 : 0 ) ) ) {}
+    bool operator[]( int i ) const { return ( _mm256_movemask_ps( v ) >> i ) & 1; }
+
+    vbool operator&( const vbool& m ) const { return _mm256_and_ps( v , m.v ); }
+    vbool operator|( const vbool& m ) const { return _mm256_or_ps( v , m.v ); }
+    vbool operator^( const vbool& m ) const { return _mm256_xor_ps( v , m.v ); }
+    vbool operator!() const { return _mm256_xor_ps( v , _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) ) ); }
+};
+
+//! @brief Eight integers in an AVX register.
+template<>
+struct vint<8>
+{
+    static const int size = 8;
+    __m256i v;
+
+    vint(){}
+    vint( __m256i s ) : v(s) {}
+    vint( int s ) : v( _mm256_set1_epi32( s ) ) {}
+    static vint Load( const int* p ){ return _mm256_loadu_si256( (const __m256i*)p ); }
+    void Store( int* p ) const { _mm256_storeu_si256( (__m256i*)p , v ); }
+    int operator[]( int i ) const { int r[8]; Store( r ); return r[i]; }
+
+    vint operator+( const vint& s ) const { return _mm256_add_epi32( v , s.v ); }
+    vint operator-( const vint& s ) const { return _mm256_sub_epi32( v , s.v ); }
+    vint operator*( const vint& s ) const { return _mm256_mullo_epi32( v , s.v ); }
+    vint operator&( const vint& s ) const { return _mm256_and_si256( v , s.v ); }
+    vint operator|( const vint& s ) const { return _mm256_or_si256( v , s.v ); }
+    vint operator^( const vint& s ) const { return _mm256_xor_si256( v , s.v ); }
+
+    vbool<8> operator==( const vint& s ) const { return _mm256_castsi256_ps( _mm256_cmpeq_epi32( v , s.v ) ); }
+    vbool<8> operator<( const vint& s ) const { return _mm256_castsi256_ps( _mm256_cmpgt_epi32( s.v , v ) ); }
+    vbool<8> operator>( const vint& s ) const { return _mm256_castsi256_ps( _mm256_cmpgt_epi32( v , s.v ) ); }
+};
+
+//! @brief Eight floats in an AVX register.
+template<>
+struct vfloat<8>
+{
+    static const int size = 8;
+    __m256 v;
+
+    vfloat(){}
+    vfloat( __m256 s ) : v(s) {}
+    vfloat( float s ) : v( _mm256_set1_ps( s ) ) {}
+    static vfloat Load( const float* p ){ return _mm256_loadu_ps( p ); }
+    void Store( float* p ) const { _mm256_storeu_ps( p , v ); }
+    float operator[]( int i ) const { float r[8]; Store( r ); return r[i]; }
+
+    vfloat operator+( const vfloat& s ) const { return _mm256_add_ps( v , s.v ); }
+    vfloat operator-( const vfloat& s ) const { return _mm256_sub_ps( v , s.v ); }
+    vfloat operator*( const vfloat& s ) const { return _mm256_mul_ps( v , s.v ); }
+    vfloat operator/( const vfloat& s ) const { return _mm256_div_ps( v , s.v ); }
+    vfloat operator-() const { return _mm256_xor_ps( v , _mm256_set1_ps( -0.0f ) ); }
+
+    vbool<8> operator==( const vfloat& s ) const { return _mm256_cmp_ps( v , s.v , _CMP_EQ_OQ ); }
+    vbool<8> operator!=( const vfloat& s ) const { return _mm256_cmp_ps( v , s.v , _CMP_NEQ_UQ ); }
+    vbool<8> operator<( const vfloat& s ) const { return _mm256_cmp_ps( v , s.v , _CMP_LT_OQ ); }
+    vbool<8> operator<=( const vfloat& s ) const { return _mm256_cmp_ps( v , s.v , _CMP_LE_OQ ); }
+    vbool<8> operator>( const vfloat& s ) const { return _mm256_cmp_ps( v , s.v , _CMP_GT_OQ ); }
+    vbool<8> operator>=( const vfloat& s ) const { return _mm256_cmp_ps( v , s.v , _CMP_GE_OQ ); }
+};
+
+inline unsigned Movemask( const vbool<8>& m ){
+    return (unsigned)_mm256_movemask_ps( m.v );
+}
+
+inline vfloat<8> Select( const vbool<8>& m , const vfloat<8>& t , const vfloat<8>& f ){
+    return _mm256_blendv_ps( f.v , t.v , m.v );
+}
+inline vint<8> Select( const vbool<8>& m , const vint<8>& t , const vint<8>& f ){
+    return _mm256_castps_si256( _mm256_blendv_ps( _mm256_castsi256_ps( f.v ) , _mm256_castsi256_ps( t.v ) , m.v ) );
+}
+
+inline vfloat<8> Gather( const float* base , const vint<8>& idx ){ return _mm256_i32gather_ps( base , idx.v , 4 ); }
+inline vint<8> Gather( const int* base , const vint<8>& idx ){ return _mm256_i32gather_epi32( base , idx.v , 4 ); }
+
+inline vfloat<8> Min( const vfloat<8>& a , const vfloat<8>& b ){ return _mm256_min_ps( a.v , b.v ); }
+inline vfloat<8> Max( const vfloat<8>& a , const vfloat<8>& b ){ return _mm256_max_ps( a.v , b.v ); }
+inline vfloat<8> Abs( const vfloat<8>& a ){ return _mm256_andnot_ps( _mm256_set1_ps( -0.0f ) , a.v ); }
+inline vfloat<8> Sqrt( const vfloat<8>& a ){ return _mm256_sqrt_ps( a.v ); }
+inline vfloat<8> ToFloat( const vint<8>& a ){ return _mm256_cvtepi32_ps( a.v ); }
+inline vint<8> ToInt( const vfloat<8>& a ){ return _mm256_cvttps_epi32( a.v ); }
+#if defined(__FMA__)
+inline vfloat<8> Madd( const vfloat<8>& a , const vfloat<8>& b , const vfloat<8>& c ){ return _mm256_fmadd_ps( a.v , b.v , c.v ); }
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "vgeneric.h"
+
+#if defined(SORT_SIMD_AVX512)
+
+#include <immintrin.h>
+
+//! @brief Sixteen lane mask in an AVX-512 mask register , one bit per lane.
+template<>
+struct vbool<16>
+{
+    static const int size = 16;
+    __mmask16 v;
+
+    vbool(){}
+    vbool( __mmask16 m ) : v(m) {}
+    vbool( bool b ) : v( b ? 0xffff : 0 ) {}
+    bool operator[]( int i ) const { return ( v >> i ) & 1; }
+
+    vbool operator&( const vbool& m ) const { return (__mmask16)( v & m.v ); }
+    vbool operator|( const vbool& m ) const { return (__mmask16)( v | m.v ); }
+    vbool operator^( const vbool& m ) const { return (__mmask16)( v ^ m.v ); }
+    vbool operator!() const { return (__mmask16)( ~v ); }
+};
+
+//! @brief Sixteen integers in an AVX-512 register.
+template<>
+struct vint<16>
+{
+    static const int size = 16;
+    __m512i v;
+
+    vint(){}
+    vint( __m512i s ) : v(s) {}
+    vint( int s ) : v( _mm512_set1_epi32( s ) ) {}
+    static vint Load( const int* p ){ return _mm512_loadu_si512( p ); }
+    void Store( int* p ) const { _mm512_storeu_si512( p , v ); }
+    int operator[]( int i ) const { int r[16]; Store( r ); return r[i]; }
+
+    vint operator+( const vint& s ) const { return _mm512_add_epi32( v , s.v ); }
+    vint operator-( const vint& s ) const { return _mm512_sub_epi32( v , s.v ); }
+    vint operator*( const vint& s ) const { return _mm512_mullo_epi32( v , s.v ); }
+    vint operator&( const vint& s ) const { return _mm512_and_si512( v , s.v ); }
+    vint operator|( const vint& s ) const { return _mm512_or_si512( v , s.v ); }
+    vint operator^( const vint& s ) const { return _mm512_xor_si512( v , s.v ); }
+
+    vbool<16> operator==( const vint& s ) const { return _mm512_cmpeq_epi32_mask( v , s.v ); }
+    vbool<16> operator<( const vint& s ) const { return _mm512_cmplt_epi32_mask( v , s.v ); }
+    vbool<16> operator>( const vint& s ) const { return _mm512_cmpgt_epi32_mask( v , s.v ); }
+};
+
+//! @brief Sixteen floats in an AVX-512 register.
+template<>
+struct vfloat<16>
+{
+    static const int size = 16;
+    __m512 v;
+
+    vfloat(){}
+    vfloat( __m512 s ) : v(s) {}
+    vfloat( float s ) : v( _mm512_set1_ps( s ) ) {}
+    static vfloat Load( const float* p ){ return _mm512_loadu_ps( p ); }
+    void Store( float* p ) const { _mm512_storeu_ps( p , v ); }
+    float operator[]( int i ) const { float r[16]; Store( r ); return r[i]; }
+
+    vfloat operator+( const vfloat& s ) const { return _mm512_add_ps( v , s.v ); }
+    vfloat operator-( const vfloat& s ) const { return _mm512_sub_ps( v , s.v ); }
+    vfloat operator*( const vfloat& s ) const { return _mm512_mul_ps( v , s.v ); }
+    vfloat operator/( const vfloat& s ) const { return _mm512_div_ps( v , s.v ); }
+    vfloat operator-() const { return _mm512_castsi512_ps( _mm512_xor_si512( _mm512_castps_si512( v ) , _mm512_set1_epi32( (int)0x80000000 ) ) ); }
+
+    vbool<16> operator==( const vfloat& s ) const { return _mm512_cmp_ps_mask( v , s.v , _CMP_EQ_OQ ); }
+    vbool<16> operator!=( const vfloat& s ) const { return _mm512_cmp_ps_mask( v , s.v , _CMP_NEQ_UQ ); }
+    vbool<16> operator<( const vfloat& s ) const { return _mm512_cmp_ps_mask( v , s.v , _CMP_LT_OQ ); }
+    vbool<16> operator<=( const vfloat& s ) const { return _mm512_cmp_ps_mask( v , s.v , _CMP_LE_OQ ); }
+    vbool<16> operator>( const vfloat& s ) const { return _mm512_cmp_ps_mask( v , s.v , _CMP_GT_OQ ); }
+    vbool<16> operator>=( const vfloat& s ) const { return _mm512_cmp_ps_mask( v , s.v , _CMP_GE_OQ ); }
+};
+
+inline unsigned Movemask( const vbool<16>& m ){
+    return (unsigned)m.v;
+}
+
+// the blend takes the second operand where the mask is set
+inline vfloat<16> Select( const vbool<16>& m , const vfloat<16>& t , const vfloat<16>& f ){ return _mm512_mask_blend_ps( m.v , f.v , t.v ); }
+inline vint<16> Select( const vbool<16>& m , const vint<16>& t , const vint<16>& f ){ return _mm512_mask_blend_epi32( m.v , f.v , t.v ); }
+
+inline vfloat<16> Gather( const float* base , const vint<16>& idx ){ return _mm512_i32gather_ps( idx.v , base , 4 ); }
+inline vint<16> Gather( const int* base , const vint<16>& idx ){ return _mm512_i32gather_epi32( idx.v , base , 4 ); }
+
+inline vfloat<16> Min( const vfloat<16>& a , const vfloat<16>& b ){ return _mm512_min_ps( a.v , b.v ); }
+inline vfloat<16> Max( const vfloat<16>& a , const vfloat<16>& b ){ return _mm512_max_ps( a.v , b.v ); }
+inline vfloat<16> Abs( const vfloat<16>& a ){ return _mm512_castsi512_ps( _mm512_and_si512( _mm512_castps_si512( a.v ) , _mm512_set1_epi32( 0x7fffffff ) ) ); }
+inline vfloat<16> Sqrt( const vfloat<16>& a ){ return _mm512_sqrt_ps( a.v ); }
+inline vfloat<16> ToFloat( const vint<16>& a ){ return _mm512_cvtepi32_ps( a.v ); }
+inline vint<16> ToInt( const vfloat<16>& a ){ return _mm512_cvttps_epi32( a.v ); }
+inline vfloat<16> Madd( const vfloat<16>& a , const vfloat<16>& b , const vfloat<16>& c ){ return _mm512_fmadd_ps( a.v , b.v , c.v ); }
+
+#endif
@@ -0,0 +1,63 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "math/vector3.h"
+
+//! @brief Three SIMD values in SoA layout , lane i of x , y and z is the i-th vector.
+//!
+//! T is one of vfloat<N> , it is also valid with plain float so that kernels can be checked against
+//! their scalar version.
+template<class T>
+struct Vec3
+{
+    T x , y , z;
+
+    Vec3(){}
+    Vec3( const T& _x , const T& _y , const T& _z ) : x(_x) , y(_y) , z(_z) {}
+    //! @brief Broadcast a vector to every lane.
+    explicit Vec3( const Vector& v ) : x(v.x) , y(v.y) , z(v.z) {}
+
+    Vec3 operator+( const Vec3& v ) const { return Vec3( x + v.x , y + v.y , z + v.z ); }
+    Vec3 operator-( const Vec3& v ) const { return Vec3( x - v.x , y - v.y , z - v.z ); }
+    Vec3 operator*( const Vec3& v ) const { return Vec3( x * v.x , y * v.y , z * v.z ); }
+    Vec3 operator*( const T& s ) const { return Vec3( x * s , y * s , z * s ); }
+    Vec3 operator-() const { return Vec3( -x , -y , -z ); }
+};
+
+template<class T>
+inline T Dot( const Vec3<T>& v0 , const Vec3<T>& v1 ){
+    return v0.x * v1.x + v0.y * v1.y + v0.z * v1.z;
+}
+
+template<class T>
+inline Vec3<T> Cross( const Vec3<T>& v0 , const Vec3<T>& v1 ){
+    return Vec3<T>( v0.y * v1.z - v0.z * v1.y , v0.z * v1.x - v0.x * v1.z , v0.x * v1.y - v0.y * v1.x );
+}
+
+template<class M , class T>
+inline Vec3<T> Select( const M& m , const Vec3<T>& t , const Vec3<T>& f ){
+    return Vec3<T>( Select( m , t.x , f.x ) , Select( m , t.y , f.y ) , Select( m , t.z , f.z ) );
+}
+
+//! @brief Load the i-th lane from idx[i] of three float arrays in SoA layout.
+template<int N>
+inline Vec3< vfloat<N> > Gather( const float* x , const float* y , const float* z , const vint<N>& idx ){
+    return Vec3< vfloat<N> >( Gather( x , idx ) , Gather( y , idx ) , Gather( z , idx ) );
+}
@@ -0,0 +1,172 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <math.h>
+#include "sort.h"
+
+//! @brief A mask of N lanes, it is the result of comparing SIMD values.
+//!
+//! The generic templates keep every lane in an array and are the fallback of any width that has no
+//! native registers on the target, the compiler is still free to vectorize the loops.
+template<int N>
+struct vbool
+{
+    static const int size = N;  /**< Number of lanes. */
+    bool v[N];                  /**< The value of each lane. */
+
+    vbool(){}
+    vbool( bool b ){
+        for( int i = 0 ; i < N ; ++i ) v[i] = b;
+    }
+    bool operator[]( int i ) const { return v[i]; }
+
+    vbool operator&( const vbool& m ) const { vbool r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] && m.v[i]; return r; }
+    vbool operator|( const vbool& m ) const { vbool r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] || m.v[i]; return r; }
+    vbool operator^( const vbool& m ) const { vbool r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] != m.v[i]; return r; }
+    vbool operator!() const { vbool r; for( int i = 0 ; i < N ; ++i ) r.v[i] = !v[i]; return r; }
+};
+
+//! @brief N 32-bit signed integers.
+template<int N>
+struct vint
+{
+    static const int size = N;  /**< Number of lanes. */
+    int v[N];                   /**< The value of each lane. */
+
+    vint(){}
+    vint( int s ){
+        for( int i = 0 ; i < N ; ++i ) v[i] = s;
+    }
+    static vint Load( const int* p ){ vint r; for( int i = 0 ; i < N ; ++i ) r.v[i] = p[i]; return r; }
+    void Store( int* p ) const { for( int i = 0 ; i < N ; ++i ) p[i] = v[i]; }
+    int operator[]( int i ) const { return v[i]; }
+
+    vint operator+( const vint& s ) const { vint r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] + s.v[i]; return r; }
+    vint operator-( const vint& s ) const { vint r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] - s.v[i]; return r; }
+    vint operator*( const vint& s ) const { vint r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] * s.v[i]; return r; }
+    vint operator&( const vint& s ) const { vint r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] & s.v[i]; return r; }
+    vint operator|( const vint& s ) const { vint r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] | s.v[i]; return r; }
+    vint operator^( const vint& s ) const { vint r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] ^ s.v[i]; return r; }
+
+    vbool<N> operator==( const vint& s ) const { vbool<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] == s.v[i]; return r; }
+    vbool<N> operator<( const vint& s ) const { vbool<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] < s.v[i]; return r; }
+    vbool<N> operator>( const vint& s ) const { vbool<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] > s.v[i]; return r; }
+};
+
+//! @brief N single precision floats.
+template<int N>
+struct vfloat
+{
+    static const int size = N;  /**< Number of lanes. */
+    float v[N];                 /**< The value of each lane. */
+
+    vfloat(){}
+    vfloat( float s ){
+        for( int i = 0 ; i < N ; ++i ) v[i] = s;
+    }
+    static vfloat Load( const float* p ){ vfloat r; for( int i = 0 ; i < N ; ++i ) r.v[i] = p[i]; return r; }
+    void Store( float* p ) const { for( int i = 0 ; i < N ; ++i ) p[i] = v[i]; }
+    float operator[]( int i ) const { return v[i]; }
+
+    vfloat operator+( const vfloat& s ) const { vfloat r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] + s.v[i]; return r; }
+    vfloat operator-( const vfloat& s ) const { vfloat r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] - s.v[i]; return r; }
+    vfloat operator*( const vfloat& s ) const { vfloat r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] * s.v[i]; return r; }
+    vfloat operator/( const vfloat& s ) const { vfloat r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] / s.v[i]; return r; }
+    vfloat operator-() const { vfloat r; for( int i = 0 ; i < N ; ++i ) r.v[i] = -v[i]; return r; }
+
+    vbool<N> operator==( const vfloat& s ) const { vbool<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] == s.v[i]; return r; }
+    vbool<N> operator!=( const vfloat& s ) const { vbool<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] != s.v[i]; return r; }
+    vbool<N> operator<( const vfloat& s ) const { vbool<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] < s.v[i]; return r; }
+    vbool<N> operator<=( const vfloat& s ) const { vbool<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] <= s.v[i]; return r; }
+    vbool<N> operator>( const vfloat& s ) const { vbool<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] > s.v[i]; return r; }
+    vbool<N> operator>=( const vfloat& s ) const { vbool<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = v[i] >= s.v[i]; return r; }
+};
+
+//! @brief Bit mask of the lanes being set, lane i is the i-th bit.
+template<int N>
+inline unsigned Movemask( const vbool<N>& m ){
+    unsigned r = 0;
+    for( int i = 0 ; i < N ; ++i )
+        r |= ( m.v[i] ? 1u : 0u ) << i;
+    return r;
+}
+
+//! @brief Pick the lanes of 't' where the mask is set and the lanes of 'f' elsewhere.
+template<int N>
+inline vfloat<N> Select( const vbool<N>& m , const vfloat<N>& t , const vfloat<N>& f ){
+    vfloat<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = m.v[i] ? t.v[i] : f.v[i]; return r;
+}
+template<int N>
+inline vint<N> Select( const vbool<N>& m , const vint<N>& t , const vint<N>& f ){
+    vint<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = m.v[i] ? t.v[i] : f.v[i]; return r;
+}
+
+//! @brief The scalar version , it lets kernels be instantiated with plain floats.
+inline float Select( bool m , float t , float f ){
+    return m ? t : f;
+}
+
+//! @brief Load base[idx[i]] into lane i.
+template<int N>
+inline vfloat<N> Gather( const float* base , const vint<N>& idx ){
+    vfloat<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = base[idx.v[i]]; return r;
+}
+template<int N>
+inline vint<N> Gather( const int* base , const vint<N>& idx ){
+    vint<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = base[idx.v[i]]; return r;
+}
+
+template<int N>
+inline vfloat<N> Min( const vfloat<N>& a , const vfloat<N>& b ){
+    vfloat<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = ( a.v[i] < b.v[i] ) ? a.v[i] : b.v[i]; return r;
+}
+template<int N>
+inline vfloat<N> Max( const vfloat<N>& a , const vfloat<N>& b ){
+    vfloat<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = ( a.v[i] > b.v[i] ) ? a.v[i] : b.v[i]; return r;
+}
+template<int N>
+inline vfloat<N> Abs( const vfloat<N>& a ){
+    vfloat<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = fabsf( a.v[i] ); return r;
+}
+template<int N>
+inline vfloat<N> Sqrt( const vfloat<N>& a ){
+    vfloat<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = sqrtf( a.v[i] ); return r;
+}
+inline float Abs( float a ){ return fabsf( a ); }
+inline float Sqrt( float a ){ return sqrtf( a ); }
+
+//! @brief a * b + c , it is a fused operation only where the target has one.
+template<int N>
+inline vfloat<N> Madd( const vfloat<N>& a , const vfloat<N>& b , const vfloat<N>& c ){
+    return a * b + c;
+}
+
+//! @brief Convert integers to floats.
+template<int N>
+inline vfloat<N> ToFloat( const vint<N>& a ){
+    vfloat<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = (float)a.v[i]; return r;
+}
+//! @brief Convert floats to integers , they are truncated towards zero.
+template<int N>
+inline vint<N> ToInt( const vfloat<N>& a ){
+    vint<N> r; for( int i = 0 ; i < N ; ++i ) r.v[i] = (int)a.v[i]; return r;
+}
+inline float ToFloat( int a ){ return (float)a; }
+inline int ToInt( float a ){ return (int)a; }
@@ -0,0 +1,146 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "vgeneric.h"
+
+#if defined(SORT_SIMD_SSE2)
+
+#include <emmintrin.h>
+#if defined(SORT_SIMD_SSE42)
+#include <smmintrin.h>
+#endif
+
+//! @brief Four lane mask in an SSE register , each lane is either all ones or all zeros.
+template<>
+struct vbool<4>
+{
+    static const int size = 4;
+    __m128 v;
+
+    vbool(){}
+    vbool( __m128 m ) : v(m) {}
+    vbool( bool b ) : v( _mm_castsi128_ps( _mm_set1_epi32( b ? -1 : 0 ) ) ) {}
+    bool operator[]( int i ) const { return ( _mm_movemask_ps( v ) >> i ) & 1; }
+
+    vbool operator&( const vbool& m ) const { return _mm_and_ps( v , m.v ); }
+    vbool operator|( const vbool& m ) const { return _mm_or_ps( v , m.v ); }
+    vbool operator^( const vbool& m ) const { return _mm_xor_ps( v , m.v ); }
+    vbool operator!() const { return _mm_xor_ps( v , _mm_castsi128_ps( _mm_set1_epi32( -1 ) ) ); }
+};
+
+//! @brief Four integers in an SSE register.
+template<>
+struct vint<4>
+{
+    static const int size = 4;
+    __m128i v;
+
+    vint(){}
+    vint( __m128i s ) : v(s) {}
+    vint( int s ) : v( _mm_set1_epi32( s ) ) {}
+    static vint Load( const int* p ){ return _mm_loadu_si128( (const __m128i*)p ); }
+    void Store( int* p ) const { _mm_storeu_si128( (__m128i*)p , v ); }
+    int operator[]( int i ) const { int r[4]; Store( r ); return r[i]; }
+
+    vint operator+( const vint& s ) const { return _mm_add_epi32( v , s.v ); }
+    vint operator-( const vint& s ) const { return _mm_sub_epi32( v , s.v ); }
+    vint operator*( const vint& s ) const {
+#if defined(SORT_SIMD_SSE42)
+        return _mm_mullo_epi32( v , s.v );
+#else
+        // SSE2 only multiplies the even lanes , the odd lanes are shifted down and multiplied separately
+        const __m128i even = _mm_mul_epu32( v , s.v );
+        const __m128i odd = _mm_mul_epu32( _mm_srli_epi64( v , 32 ) , _mm_srli_epi64( s.v , 32 ) );
+        return _mm_unpacklo_epi32( _mm_shuffle_epi32( even , _MM_SHUFFLE( 0 , 0 , 2 , 0 ) ) , _mm_shuffle_epi32( odd , _MM_SHUFFLE( 0 , 0 , 2 , 0 ) ) );
+#endif
+    }
+    vint operator&( const vint& s ) const { return _mm_and_si128( v , s.v ); }
+    vint operator|( const vint& s ) const { return _mm_or_si128( v , s.v ); }
+    vint operator^( const vint& s ) const { return _mm_xor_si128( v , s.v ); }
+
+    vbool<4> operator==( const vint& s ) const { return _mm_castsi128_ps( _mm_cmpeq_epi32( v , s.v ) ); }
+    vbool<4> operator<( const vint& s ) const { return _mm_castsi128_ps( _mm_cmplt_epi32( v , s.v ) ); }
+    vbool<4> operator>( const vint& s ) const { return _mm_castsi128_ps( _mm_cmpgt_epi32( v , s.v ) ); }
+};
+
+//! @brief Four floats in an SSE register.
+template<>
+struct vfloat<4>
+{
+    static const int size = 4;
+    __m128 v;
+
+    vfloat(){}
+    vfloat( __m128 s ) : v(s) {}
+    vfloat( float s ) : v( _mm_set1_ps( s ) ) {}
+    static vfloat Load( const float* p ){ return _mm_loadu_ps( p ); }
+    void Store( float* p ) const { _mm_storeu_ps( p , v ); }
+    float operator[]( int i ) const { float r[4]; Store( r ); return r[i]; }
+
+    vfloat operator+( const vfloat& s ) const { return _mm_add_ps( v , s.v ); }
+    vfloat operator-( const vfloat& s ) const { return _mm_sub_ps( v , s.v ); }
+    vfloat operator*( const vfloat& s ) const { return _mm_mul_ps( v , s.v ); }
+    vfloat operator/( const vfloat& s ) const { return _mm_div_ps( v , s.v ); }
+    vfloat operator-() const { return _mm_xor_ps( v , _mm_set1_ps( -0.0f ) ); }
+
+    vbool<4> operator==( const vfloat& s ) const { return _mm_cmpeq_ps( v , s.v ); }
+    vbool<4> operator!=( const vfloat& s ) const { return _mm_cmpneq_ps( v , s.v ); }
+    vbool<4> operator<( const vfloat& s ) const { return _mm_cmplt_ps( v , s.v ); }
+    vbool<4> operator<=( const vfloat& s ) const { return _mm_cmple_ps( v , s.v ); }
+    vbool<4> operator>( const vfloat& s ) const { return _mm_cmpgt_ps( v , s.v ); }
+    vbool<4> operator>=( const vfloat& s ) const { return _mm_cmpge_ps( v , s.v ); }
+};
+
+inline unsigned Movemask( const vbool<4>& m ){
+    return (unsigned)_mm_movemask_ps( m.v );
+}
+
+inline vfloat<4> Select( const vbool<4>& m , const vfloat<4>& t , const vfloat<4>& f ){
+#if defined(SORT_SIMD_SSE42)
+    return _mm_blendv_ps( f.v , t.v , m.v );
+#else
+    return _mm_or_ps( _mm_and_ps( m.v , t.v ) , _mm_andnot_ps( m.v , f.v ) );
+#endif
+}
+inline vint<4> Select( const vbool<4>& m , const vint<4>& t , const vint<4>& f ){
+    const __m128i mi = _mm_castps_si128( m.v );
+    return _mm_or_si128( _mm_and_si128( mi , t.v ) , _mm_andnot_si128( mi , f.v ) );
+}
+
+// there is no gather instruction before AVX2 , the lanes are loaded one by one
+inline vfloat<4> Gather( const float* base , const vint<4>& idx ){
+    int i[4];
+    idx.Store( i );
+    return _mm_setr_ps( base[i[0]] , base[i[1]] , base[i[2]] , base[i[3]] );
+}
+inline vint<4> Gather( const int* base , const vint<4>& idx ){
+    int i[4];
+    idx.Store( i );
+    return _mm_setr_epi32( base[i[0]] , base[i[1]] , base[i[2]] , base[i[3]] );
+}
+
+inline vfloat<4> Min( const vfloat<4>& a , const vfloat<4>& b ){ return _mm_min_ps( a.v , b.v ); }
+inline vfloat<4> Max( const vfloat<4>& a , const vfloat<4>& b ){ return _mm_max_ps( a.v , b.v ); }
+inline vfloat<4> Abs( const vfloat<4>& a ){ return _mm_andnot_ps( _mm_set1_ps( -0.0f ) , a.v ); }
+inline vfloat<4> Sqrt( const vfloat<4>& a ){ return _mm_sqrt_ps( a.v ); }
+inline vfloat<4> ToFloat( const vint<4>& a ){ return _mm_cvtepi32_ps( a.v ); }
+inline vint<4> ToInt( const vfloat<4>& a ){ return _mm_cvttps_epi32( a.v ); }
+
+#endif
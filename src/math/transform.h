@@ -49,6 +49,18 @@ public:
 	bool	IdIdentity() const;
 	// whether there is scale factor in the matrix
 	bool	HasScale() const;
+	// whether the transform is affine , AffineTransform could be used instead then
+	bool	IsAffine() const { return matrix.IsAffine() && invMatrix.IsAffine(); }
+
+	// transform a normal with the inverse transpose of the matrix , the result is not normalized
+	// note : the transposed matrix is not built , AffineTransform caches it if it is used many times
+	Vector	TransformNormal( const Vector& n ) const
+	{
+		const float* inv = invMatrix.m;
+		return Vector( n.x * inv[0] + n.y * inv[4] + n.z * inv[8] ,
+					   n.x * inv[1] + n.y * inv[5] + n.z * inv[9] ,
+					   n.x * inv[2] + n.y * inv[6] + n.z * inv[10] );
+	}
 
 	// the operator for transformation
 	Point	operator()( const Point& p ) const { return this->matrix * p; }
@@ -224,7 +236,7 @@ inline Vector operator* ( const Transform& t , const Vector& v )
 // transform a ray
 inline Ray	operator* ( const Transform& t , const Ray& r )
 {
-	return Ray( t(r.m_Ori) , t(r.m_Dir) , r.m_Depth , r.m_fMin , r.m_fMax );
+	return t.matrix( r );
 }
 
 #endif
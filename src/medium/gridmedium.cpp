@@ -0,0 +1,298 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include the header
+#include "gridmedium.h"
+#include "utility/rand.h"
+#include "utility/path.h"
+#include "log/log.h"
+#include <fstream>
+#include <float.h>
+
+IMPLEMENT_CREATOR( GridMedium );
+
+// the header of a volume file of Mitsuba , 'VOL' and the version byte are followed by it
+struct Vol_Header
+{
+	int		encoding;		// 1 for float32 voxels
+	int		res[3];			// the resolution along each axis
+	int		channels;		// the number of channels of each voxel
+	float	bounds[6];		// the minimum and the maximum of the bounding box
+};
+
+// load the voxels and build the majorant grid
+void GridMedium::Prepare()
+{
+	Point bmin , bmax;
+	if( m_filename.empty() || !_load( GetFullPath( m_filename ) , bmin , bmax ) )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Failed to load volume file %s, the medium is empty." , m_filename.c_str() ) );
+		m_res[0] = m_res[1] = m_res[2] = 1;
+		m_density.assign( 1 , 0.0f );
+		bmin = Point( 0.0f , 0.0f , 0.0f );
+		bmax = Point( 1.0f , 1.0f , 1.0f );
+	}
+
+	const Vector extent = bmax - bmin;
+	m_world2unit = Scale( 1.0f / extent.x , 1.0f / extent.y , 1.0f / extent.z ) * Translate( -bmin.x , -bmin.y , -bmin.z ) * m_world2grid;
+	_buildMajorants();
+}
+
+// load the voxels from a volume file
+bool GridMedium::_load( const string& filename , Point& bmin , Point& bmax )
+{
+	ifstream file( filename.c_str() , ios::binary );
+	if( false == file.is_open() )
+		return false;
+
+	char magic[4];
+	Vol_Header header;
+	file.read( magic , 4 );
+	file.read( (char*)&header , sizeof( header ) );
+	if( !file || magic[0] != 'V' || magic[1] != 'O' || magic[2] != 'L' || magic[3] != 3 || header.encoding != 1 || header.channels <= 0 )
+		return false;
+	if( header.res[0] <= 0 || header.res[1] <= 0 || header.res[2] <= 0 )
+		return false;
+	bmin = Point( header.bounds[0] , header.bounds[1] , header.bounds[2] );
+	bmax = Point( header.bounds[3] , header.bounds[4] , header.bounds[5] );
+	if( !( bmax.x > bmin.x && bmax.y > bmin.y && bmax.z > bmin.z ) )
+		return false;
+
+	// only the first channel is kept , the voxels are read one slice at a time
+	for( unsigned axis = 0 ; axis < 3 ; ++axis )
+		m_res[axis] = (unsigned)header.res[axis];
+	const size_t slice = (size_t)m_res[0] * m_res[1];
+	m_density.resize( slice * m_res[2] );
+	std::vector<float> buffer( slice * header.channels );
+	for( unsigned z = 0 ; z < m_res[2] ; ++z )
+	{
+		file.read( (char*)&buffer[0] , sizeof( float ) * buffer.size() );
+		if( !file )
+			return false;
+		for( size_t i = 0 ; i < slice ; ++i )
+			m_density[z * slice + i] = max( 0.0f , buffer[i * header.channels] );
+	}
+	return true;
+}
+
+// build the bounds of the extinction in the majorant grid
+void GridMedium::_buildMajorants()
+{
+	const unsigned R = GRID_MAJORANT_RES;
+	m_majorant.assign( R * R * R , 0.0f );
+	m_minorant.assign( R * R * R , 0.0f );
+
+	// the voxels interpolated anywhere in a cell , the centers of the voxels are at half of their indices
+	unsigned lo[3][R] , hi[3][R];
+	for( unsigned axis = 0 ; axis < 3 ; ++axis )
+		for( unsigned c = 0 ; c < R ; ++c )
+		{
+			const float n = (float)m_res[axis];
+			lo[axis][c] = (unsigned)min( (int)m_res[axis] - 1 , max( 0 , (int)floor( c * n / R - 0.5f ) ) );
+			hi[axis][c] = (unsigned)min( (int)m_res[axis] - 1 , max( 0 , (int)floor( ( c + 1 ) * n / R - 0.5f ) + 1 ) );
+		}
+
+	unsigned empty = 0;
+	for( unsigned z = 0 ; z < R ; ++z )
+		for( unsigned y = 0 ; y < R ; ++y )
+			for( unsigned x = 0 ; x < R ; ++x )
+			{
+				float dmin = FLT_MAX , dmax = 0.0f;
+				for( unsigned k = lo[2][z] ; k <= hi[2][z] ; ++k )
+					for( unsigned j = lo[1][y] ; j <= hi[1][y] ; ++j )
+						for( unsigned i = lo[0][x] ; i <= hi[0][x] ; ++i )
+						{
+							const float d = m_density[( (size_t)k * m_res[1] + j ) * m_res[0] + i];
+							dmin = min( dmin , d );
+							dmax = max( dmax , d );
+						}
+				const unsigned cell = ( z * R + y ) * R + x;
+				m_majorant[cell] = dmax * m_scale;
+				m_minorant[cell] = dmin * m_scale;
+				empty += ( dmax == 0.0f ) ? 1 : 0;
+			}
+
+	slog( INFO , GENERAL , stringFormat( "Volume %s has %dx%dx%d voxels, %d of %d cells of its majorant grid are empty." ,
+		m_filename.c_str() , m_res[0] , m_res[1] , m_res[2] , empty , R * R * R ) );
+}
+
+// the extinction at a point in the unit cube
+float GridMedium::_extinction( const Point& p ) const
+{
+	int i[3];
+	float f[3];
+	for( unsigned axis = 0 ; axis < 3 ; ++axis )
+	{
+		const float x = p[axis] * m_res[axis] - 0.5f;
+		const float fl = floor( x );
+		i[axis] = (int)fl;
+		f[axis] = x - fl;
+	}
+
+	// the voxels beyond the borders repeat the ones on the borders
+	auto voxel = [&]( int x , int y , int z ){
+		x = min( (int)m_res[0] - 1 , max( 0 , x ) );
+		y = min( (int)m_res[1] - 1 , max( 0 , y ) );
+		z = min( (int)m_res[2] - 1 , max( 0 , z ) );
+		return m_density[( (size_t)z * m_res[1] + y ) * m_res[0] + x];
+	};
+	const float d00 = voxel( i[0] , i[1] , i[2] ) * ( 1.0f - f[0] ) + voxel( i[0] + 1 , i[1] , i[2] ) * f[0];
+	const float d10 = voxel( i[0] , i[1] + 1 , i[2] ) * ( 1.0f - f[0] ) + voxel( i[0] + 1 , i[1] + 1 , i[2] ) * f[0];
+	const float d01 = voxel( i[0] , i[1] , i[2] + 1 ) * ( 1.0f - f[0] ) + voxel( i[0] + 1 , i[1] , i[2] + 1 ) * f[0];
+	const float d11 = voxel( i[0] , i[1] + 1 , i[2] + 1 ) * ( 1.0f - f[0] ) + voxel( i[0] + 1 , i[1] + 1 , i[2] + 1 ) * f[0];
+	const float d0 = d00 * ( 1.0f - f[1] ) + d10 * f[1];
+	const float d1 = d01 * ( 1.0f - f[1] ) + d11 * f[1];
+	return ( d0 * ( 1.0f - f[2] ) + d1 * f[2] ) * m_scale;
+}
+
+// march a ray through the cells of the majorant grid
+template<class F>
+void GridMedium::_march( const Ray& r , float tmax , F visit ) const
+{
+	// the range of the ray inside the unit cube
+	float t0 = r.m_fMin , t1 = tmax;
+	for( unsigned axis = 0 ; axis < 3 ; ++axis )
+	{
+		if( r.m_Dir[axis] == 0.0f )
+		{
+			if( r.m_Ori[axis] < 0.0f || r.m_Ori[axis] > 1.0f )
+				return;
+			continue;
+		}
+		const float inv = 1.0f / r.m_Dir[axis];
+		float tnear = -r.m_Ori[axis] * inv;
+		float tfar = ( 1.0f - r.m_Ori[axis] ) * inv;
+		if( tnear > tfar )
+			swap( tnear , tfar );
+		t0 = max( t0 , tnear );
+		t1 = min( t1 , tfar );
+	}
+	if( t0 >= t1 )
+		return;
+
+	// the cells are visited by a three dimensional digital differential analyzer
+	const int R = GRID_MAJORANT_RES;
+	const Point p = r( t0 );
+	int cell[3] , step[3];
+	float next[3] , delta[3];
+	for( unsigned axis = 0 ; axis < 3 ; ++axis )
+	{
+		cell[axis] = min( R - 1 , max( 0 , (int)( p[axis] * R ) ) );
+		const float d = r.m_Dir[axis];
+		if( d > 0.0f )
+		{
+			next[axis] = t0 + ( (float)( cell[axis] + 1 ) / R - p[axis] ) / d;
+			delta[axis] = 1.0f / ( R * d );
+			step[axis] = 1;
+		}
+		else if( d < 0.0f )
+		{
+			next[axis] = t0 + ( (float)cell[axis] / R - p[axis] ) / d;
+			delta[axis] = -1.0f / ( R * d );
+			step[axis] = -1;
+		}
+		else
+		{
+			next[axis] = FLT_MAX;
+			delta[axis] = 0.0f;
+			step[axis] = 0;
+		}
+	}
+
+	float t = t0;
+	while( true )
+	{
+		const unsigned axis = ( next[0] < next[1] ) ? ( ( next[0] < next[2] ) ? 0 : 2 ) : ( ( next[1] < next[2] ) ? 1 : 2 );
+		const float tend = min( next[axis] , t1 );
+		if( tend > t && !visit( t , tend , (unsigned)( ( cell[2] * R + cell[1] ) * R + cell[0] ) ) )
+			return;
+		if( tend >= t1 )
+			return;
+		t = tend;
+		cell[axis] += step[axis];
+		if( cell[axis] < 0 || cell[axis] >= R )
+			return;
+		next[axis] += delta[axis];
+	}
+}
+
+// the transmittance along a ray
+Spectrum GridMedium::Tr( const Ray& r , float tmax ) const
+{
+	const Ray local = m_world2unit( r );
+	float tr = 1.0f;
+	_march( local , tmax , [&]( float t0 , float t1 , unsigned cell ){
+		// the minimum of the cell is integrated analytically , only the residual is tracked
+		const float control = m_minorant[cell];
+		const float residual = m_majorant[cell] - control;
+		tr *= expf( -control * ( t1 - t0 ) );
+		if( residual > 0.0f )
+		{
+			float t = t0;
+			while( true )
+			{
+				t -= log( 1.0f - sort_canonical() ) / residual;
+				if( t >= t1 )
+					break;
+				tr *= 1.0f - ( _extinction( local( t ) ) - control ) / residual;
+			}
+		}
+
+		// the tracking stops early with russian roulette once little light is left
+		if( tr < 0.1f )
+		{
+			if( sort_canonical() < 0.5f )
+			{
+				tr = 0.0f;
+				return false;
+			}
+			tr *= 2.0f;
+		}
+		return true;
+	});
+	return tr;
+}
+
+// sample the next scattering event along a ray
+Spectrum GridMedium::Sample( const Ray& r , float tmax , float& t , bool& scattered ) const
+{
+	const Ray local = m_world2unit( r );
+	scattered = false;
+	_march( local , tmax , [&]( float t0 , float t1 , unsigned cell ){
+		// the exponential distribution is memoryless , the tracking restarts at the border of every cell
+		const float majorant = m_majorant[cell];
+		if( majorant <= 0.0f )
+			return true;
+		float d = t0;
+		while( true )
+		{
+			d -= log( 1.0f - sort_canonical() ) / majorant;
+			if( d >= t1 )
+				return true;
+			if( _extinction( local( d ) ) > sort_canonical() * majorant )
+			{
+				scattered = true;
+				t = d;
+				return false;
+			}
+		}
+	});
+
+	// delta tracking samples the real collisions exactly , only the albedo is left in the weight
+	return scattered ? m_albedo : Spectrum( 1.0f );
+}
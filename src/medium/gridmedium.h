@@ -0,0 +1,128 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "medium.h"
+#include <vector>
+
+// the number of cells of the majorant grid along each axis
+#define	GRID_MAJORANT_RES	16
+
+//////////////////////////////////////////////////////////////////////////////////////
+//	definition of heterogeneous medium on a dense voxel grid
+//	note : the densities are read from a volume file of Mitsuba , only the first channel of
+//		   the voxels is used. The extinction is grey , it is the density times 'density_scale' ,
+//		   the albedo colors the scattered light.
+//	note : a coarse grid keeps the bounds of the extinction in its cells. Scattering events are
+//		   sampled by delta tracking against the majorant of each cell the ray passes through and
+//		   the transmittance is estimated by residual ratio tracking , the minimum of a cell is the
+//		   control extinction integrated analytically. Empty cells are skipped at once , so sparse
+//		   volumes don't need small steps.
+class	GridMedium : public Medium
+{
+// public method
+public:
+	DEFINE_CREATOR( GridMedium , Medium , "grid" );
+
+	// default constructor
+	GridMedium(){ _registerAllProperty(); }
+
+	// set the transformation from the space of the voxels to world space
+	void	SetTransform( const Transform& transform ) { m_world2grid = transform.GetInversed(); }
+
+	// load the voxels and build the majorant grid
+	void	Prepare();
+
+	// the transmittance along a ray
+	Spectrum Tr( const Ray& r , float tmax ) const;
+
+	// sample the next scattering event along a ray
+	Spectrum Sample( const Ray& r , float tmax , float& t , bool& scattered ) const;
+
+// private field
+private:
+	// the volume file
+	string		m_filename;
+	// the extinction coefficient of unit density
+	float		m_scale = 1.0f;
+	// the ratio of the scattering coefficient to the extinction coefficient
+	Spectrum	m_albedo = 1.0f;
+
+	// the transformation from world space to the space of the voxels
+	Transform	m_world2grid;
+	// the transformation from world space to the unit cube covered by the voxels
+	Transform	m_world2unit;
+
+	// the resolution of the voxels
+	unsigned	m_res[3] = { 0 , 0 , 0 };
+	// the densities of the voxels , x is the fastest axis
+	std::vector<float>	m_density;
+	// the bounds of the extinction in each cell of the majorant grid
+	std::vector<float>	m_majorant;
+	std::vector<float>	m_minorant;
+
+	// load the voxels from a volume file
+	bool	_load( const string& filename , Point& bmin , Point& bmax );
+	// build the bounds of the extinction in the majorant grid
+	void	_buildMajorants();
+	// the extinction at a point in the unit cube , the densities are interpolated trilinearly
+	float	_extinction( const Point& p ) const;
+	// march a ray through the cells of the majorant grid
+	// para 'r'     : the ray in the unit cube
+	// para 'tmax'  : the distance to stop at
+	// para 'visit' : called with the range of the ray in each cell and the index of the cell , the marching stops once it returns false
+	template<class F>
+	void	_march( const Ray& r , float tmax , F visit ) const;
+
+	// register property
+	void _registerAllProperty()
+	{
+		_registerProperty( "file" , new FileProperty(this) );
+		_registerProperty( "density_scale" , new ScaleProperty(this) );
+		_registerProperty( "albedo" , new AlbedoProperty(this) );
+	}
+
+	class FileProperty : public PropertyHandler<Medium>
+	{
+	public:
+		PH_CONSTRUCTOR(FileProperty,Medium);
+		void SetValue( const string& str )
+		{
+			CAST_TARGET(GridMedium)->m_filename = str;
+		}
+	};
+	class ScaleProperty : public PropertyHandler<Medium>
+	{
+	public:
+		PH_CONSTRUCTOR(ScaleProperty,Medium);
+		void SetValue( const string& str )
+		{
+			CAST_TARGET(GridMedium)->m_scale = max( 0.0f , (float)atof( str.c_str() ) );
+		}
+	};
+	class AlbedoProperty : public PropertyHandler<Medium>
+	{
+	public:
+		PH_CONSTRUCTOR(AlbedoProperty,Medium);
+		void SetValue( const string& str )
+		{
+			CAST_TARGET(GridMedium)->m_albedo = SpectrumFromStr( str );
+		}
+	};
+};
@@ -0,0 +1,66 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include the header
+#include "homogeneous.h"
+#include "utility/rand.h"
+#include <float.h>
+
+IMPLEMENT_CREATOR( HomogeneousMedium );
+
+// the component of a spectrum in one channel
+static float channelOf( const Spectrum& s , unsigned channel )
+{
+	return ( channel == 0 ) ? s.GetR() : ( ( channel == 1 ) ? s.GetG() : s.GetB() );
+}
+
+// the transmittance along a ray
+Spectrum HomogeneousMedium::Tr( const Ray& r , float tmax ) const
+{
+	return Exp( ( m_sigmaA + m_sigmaS ) * -( tmax - r.m_fMin ) );
+}
+
+// sample the next scattering event along a ray
+Spectrum HomogeneousMedium::Sample( const Ray& r , float tmax , float& t , bool& scattered ) const
+{
+	const Spectrum sigma_t = m_sigmaA + m_sigmaS;
+	const unsigned channel = min( 2u , (unsigned)( sort_canonical() * 3.0f ) );
+	const float sigma = channelOf( sigma_t , channel );
+
+	// the distance is sampled from the exponential falloff of the channel
+	const float d = ( sigma > 0.0f ) ? -log( 1.0f - sort_canonical() ) / sigma : FLT_MAX;
+	const float dmax = tmax - r.m_fMin;
+	scattered = d < dmax;
+	const float dist = scattered ? d : dmax;
+	const Spectrum tr = Exp( sigma_t * -dist );
+
+	// the pdf is the average of the pdfs of all channels
+	const Spectrum density = scattered ? sigma_t * tr : tr;
+	const float pdf = ( density.GetR() + density.GetG() + density.GetB() ) / 3.0f;
+	if( pdf <= 0.0f )
+	{
+		scattered = false;
+		return 0.0f;
+	}
+	if( scattered )
+	{
+		t = r.m_fMin + d;
+		return tr * m_sigmaS / pdf;
+	}
+	return tr / pdf;
+}
@@ -0,0 +1,75 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "medium.h"
+
+//////////////////////////////////////////////////////////////////////////////////////
+//	definition of homogeneous medium
+//	note : the coefficients could differ between the channels , the distance to the next
+//		   scattering event is sampled from one channel picked at random and weighted by the
+//		   average pdf of all channels.
+class	HomogeneousMedium : public Medium
+{
+// public method
+public:
+	DEFINE_CREATOR( HomogeneousMedium , Medium , "homogeneous" );
+
+	// default constructor
+	HomogeneousMedium(){ _registerAllProperty(); }
+
+	// the transmittance along a ray
+	Spectrum Tr( const Ray& r , float tmax ) const;
+
+	// sample the next scattering event along a ray
+	Spectrum Sample( const Ray& r , float tmax , float& t , bool& scattered ) const;
+
+// private field
+private:
+	// the absorption coefficient
+	Spectrum	m_sigmaA = 0.0f;
+	// the scattering coefficient
+	Spectrum	m_sigmaS = 0.0f;
+
+	// register property
+	void _registerAllProperty()
+	{
+		_registerProperty( "sigma_a" , new SigmaAProperty(this) );
+		_registerProperty( "sigma_s" , new SigmaSProperty(this) );
+	}
+
+	class SigmaAProperty : public PropertyHandler<Medium>
+	{
+	public:
+		PH_CONSTRUCTOR(SigmaAProperty,Medium);
+		void SetValue( const string& str )
+		{
+			CAST_TARGET(HomogeneousMedium)->m_sigmaA = SpectrumFromStr( str );
+		}
+	};
+	class SigmaSProperty : public PropertyHandler<Medium>
+	{
+	public:
+		PH_CONSTRUCTOR(SigmaSProperty,Medium);
+		void SetValue( const string& str )
+		{
+			CAST_TARGET(HomogeneousMedium)->m_sigmaS = SpectrumFromStr( str );
+		}
+	};
+};
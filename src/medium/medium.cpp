@@ -0,0 +1,53 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+// include the header
+#include "medium.h"
+
+// the phase function of Henyey and Greenstein
+float HGPhase( float cos_theta , float g )
+{
+	// 'cos_theta' is measured against the direction toward the previous vertex , forward scattering turns it around
+	const float denom = 1.0f + g * g + 2.0f * g * cos_theta;
+	return INV_FOUR_PI * ( 1.0f - g * g ) / ( denom * sqrt( max( denom , 0.0f ) ) );
+}
+
+// sample a direction from the phase function of Henyey and Greenstein
+Vector SampleHGPhase( const Vector& wo , float g , float u , float v , float* pdf )
+{
+	// the cosine against the direction the ray travelled along is inverted from the cdf of the phase function
+	float cos_theta;
+	if( fabs( g ) < 0.001f )
+		cos_theta = 1.0f - 2.0f * u;
+	else
+	{
+		const float sqr = ( 1.0f - g * g ) / ( 1.0f - g + 2.0f * g * u );
+		cos_theta = ( 1.0f + g * g - sqr * sqr ) / ( 2.0f * g );
+	}
+	cos_theta = min( 1.0f , max( -1.0f , cos_theta ) );
+	const float sin_theta = sqrt( max( 0.0f , 1.0f - cos_theta * cos_theta ) );
+	const float phi = TWO_PI * v;
+
+	const Vector forward = -wo;
+	Vector t0 , t1;
+	CoordinateSystem( forward , t0 , t1 );
+	const Vector wi = sin_theta * cos( phi ) * t0 + sin_theta * sin( phi ) * t1 + cos_theta * forward;
+	if( pdf )
+		*pdf = HGPhase( -cos_theta , g );
+	return wi;
+}
@@ -0,0 +1,116 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "utility/propertyset.h"
+#include "utility/creator.h"
+#include "spectrum/spectrum.h"
+#include "math/transform.h"
+
+// the phase function of Henyey and Greenstein
+// para 'cos_theta' : the cosine between the directions toward the previous and the next vertices
+// para 'g'         : the mean cosine of the scattering , it is positive for forward scattering
+float	HGPhase( float cos_theta , float g );
+
+// sample a direction from the phase function of Henyey and Greenstein
+// para 'wo'     : the direction toward the previous vertex
+// para 'g'      : the mean cosine of the scattering
+// para 'u' , 'v': the canonical samples
+// para 'pdf'    : the pdf of the sampled direction , it is the value of the phase function ( output )
+// result        : the direction toward the next vertex
+Vector	SampleHGPhase( const Vector& wo , float g , float u , float v , float* pdf );
+
+//////////////////////////////////////////////////////////////////////////////////////
+//	definition of participating medium
+//	note : distances along rays are the parameters of the rays , the directions have to be normalized
+//		   so that they are the distances in world space. Random numbers are drawn from the thread
+//		   generator since the number of steps of the tracking is unbounded.
+class	Medium : public PropertySet<Medium>
+{
+// public method
+public:
+	// default constructor
+	Medium(){ _registerAllProperty(); }
+	// destructor
+	virtual ~Medium(){}
+
+	// set the transformation from the space of the medium to world space
+	virtual void	SetTransform( const Transform& transform ) {}
+
+	// prepare the medium for rendering , it is called once all properties are set
+	virtual void	Prepare() {}
+
+	// the transmittance along a ray
+	// para 'r'    : the ray
+	// para 'tmax' : the distance to stop at
+	// result      : the fraction of light passing through the medium , it is an unbiased estimate in heterogeneous media
+	virtual Spectrum Tr( const Ray& r , float tmax ) const = 0;
+
+	// sample the next scattering event along a ray
+	// para 'r'         : the ray
+	// para 'tmax'      : the distance of the surface hit by the ray , FLT_MAX if it escapes
+	// para 't'         : the distance of the scattering event ( output ) , it is only set if the ray scatters
+	// para 'scattered' : whether the ray scatters before 'tmax' ( output )
+	// result           : the weight of the path , the transmittance and the scattering coefficient divided by their pdf
+	virtual Spectrum Sample( const Ray& r , float tmax , float& t , bool& scattered ) const = 0;
+
+	// the phase function at a scattering event
+	// para 'wo' : the direction toward the previous vertex
+	// para 'wi' : the direction toward the next vertex
+	float	Phase( const Vector& wo , const Vector& wi ) const { return HGPhase( Dot( wo , wi ) , m_g ); }
+	// sample the phase function , the weight of the sampled direction is always one
+	Vector	SamplePhase( const Vector& wo , float u , float v , float* pdf ) const { return SampleHGPhase( wo , m_g , u , v , pdf ); }
+
+// protected field
+protected:
+	// the mean cosine of the phase function
+	float	m_g = 0.0f;
+
+// private method
+private:
+	// register property
+	void _registerAllProperty()
+	{
+		_registerProperty( "g" , new GProperty(this) );
+	}
+
+	class GProperty : public PropertyHandler<Medium>
+	{
+	public:
+		PH_CONSTRUCTOR(GProperty,Medium);
+		void SetValue( const string& str )
+		{
+			// the phase function is singular at -1 and 1
+			m_target->m_g = min( 0.99f , max( -0.99f , (float)atof( str.c_str() ) ) );
+		}
+	};
+};
+
+// the media on both sides of a surface , the side is decided by the geometric normal
+struct MediumInterface
+{
+	const Medium*	inside = nullptr;		// the medium behind the surface
+	const Medium*	outside = nullptr;		// the medium the geometric normal points to
+	bool			boundary = false;		// whether the surface only bounds the media , it scatters no light
+
+	// the medium a ray leaving the surface travels in
+	// para 'w' : the direction of the ray
+	// para 'n' : the geometric normal of the surface
+	const Medium*	GetMedium( const Vector& w , const Vector& n ) const { return Dot( w , n ) > 0.0f ? outside : inside; }
+};
@@ -21,6 +21,8 @@
 
 #include "sharedmemory.h"
 #include "log/log.h"
+#include "utility/strhelper.h"
+#include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 
@@ -36,6 +38,7 @@
 // default constructor
 MmapSharedMemory::MmapSharedMemory()
 {
+    fd = -1;
 }
 
 void MmapSharedMemory::CreateSharedMemory( const string& name , int size , unsigned type )
@@ -61,6 +64,96 @@ void MmapSharedMemory::ReleaseSharedMemory()
         munmap(sharedmemory.bytes, sharedmemory.size);
     if( fd != -1 )
         close(fd);
+    sharedmemory = SharedMemory();
+    fd = -1;
+}
+
+// Create a named segment that other processes on the host could open
+bool MmapSharedMemory::CreateNamedSharedMemory( const string& name , size_t size )
+{
+    // the creation fails if another process created the segment first
+    fd = shm_open( name.c_str() , O_RDWR | O_CREAT | O_EXCL , 0600 );
+    if( fd == -1 )
+        return false;
+    segment = name;
+
+    void* bytes = MAP_FAILED;
+    if( ftruncate( fd , (off_t)size ) == 0 )
+        bytes = mmap( 0 , size , PROT_READ | PROT_WRITE , MAP_SHARED , fd , 0 );
+    if( bytes == MAP_FAILED )
+    {
+        slog( WARNING , GENERAL , stringFormat( "Failed to create shared memory %s." , name.c_str() ) );
+        UnlinkSharedMemory();
+        ReleaseSharedMemory();
+        return false;
+    }
+
+    sharedmemory.bytes = (char*)bytes;
+    sharedmemory.size = size;
+    return true;
+}
+
+// Open a named segment created by another process
+bool MmapSharedMemory::OpenNamedSharedMemory( const string& name )
+{
+    fd = shm_open( name.c_str() , O_RDWR , 0 );
+    if( fd == -1 )
+        return false;
+    segment = name;
+
+    // the creator sizes the segment right after creating it , it could be caught in between
+    struct stat st;
+    for( int i = 0 ; i < 1000 && fstat( fd , &st ) == 0 && st.st_size == 0 ; ++i )
+        usleep( 1000 );
+
+    void* bytes = MAP_FAILED;
+    if( fstat( fd , &st ) == 0 && st.st_size > 0 )
+        bytes = mmap( 0 , (size_t)st.st_size , PROT_READ | PROT_WRITE , MAP_SHARED , fd , 0 );
+    if( bytes == MAP_FAILED )
+    {
+        ReleaseSharedMemory();
+        return false;
+    }
+
+    sharedmemory.bytes = (char*)bytes;
+    sharedmemory.size = (size_t)st.st_size;
+    return true;
+}
+
+// Open the memory another process wrote data into for this one
+bool MmapSharedMemory::OpenReadOnlySharedMemory( const string& name )
+{
+    fd = open( name.c_str() , O_RDONLY , 0 );
+    if( fd == -1 )
+        return false;
+
+    void* bytes = MAP_FAILED;
+    struct stat st;
+    if( fstat( fd , &st ) == 0 && st.st_size > 0 )
+        bytes = mmap( 0 , (size_t)st.st_size , PROT_READ , MAP_SHARED , fd , 0 );
+    if( bytes == MAP_FAILED )
+    {
+        ReleaseSharedMemory();
+        return false;
+    }
+
+    sharedmemory.bytes = (char*)bytes;
+    sharedmemory.size = (size_t)st.st_size;
+    return true;
+}
+
+// Make the part of the segment after an offset read-only
+void MmapSharedMemory::ProtectSharedMemory( size_t offset )
+{
+    if( sharedmemory.bytes != 0 && offset < sharedmemory.size )
+        mprotect( sharedmemory.bytes + offset , sharedmemory.size - offset , PROT_READ );
+}
+
+// Remove the name of the segment
+void MmapSharedMemory::UnlinkSharedMemory()
+{
+    if( !segment.empty() )
+        shm_unlink( segment.c_str() );
 }
 
 #endif
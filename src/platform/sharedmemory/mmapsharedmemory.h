@@ -34,12 +34,37 @@ public:
 	// Release share memory resource
 	void ReleaseSharedMemory();
 
+	// Create a named segment that other processes on the host could open
+	// para 'name' : name of the segment
+	// para 'size' : size of the segment in bytes
+	// result      : 'false' if the name is taken already or the segment can't be created
+	bool CreateNamedSharedMemory(const string& name, size_t size);
+
+	// Open a named segment created by another process , it is mapped for reading and writing
+	// para 'name' : name of the segment
+	// result      : 'false' if there is no segment of the name
+	bool OpenNamedSharedMemory(const string& name);
+
+	// Open the memory another process wrote data into for this one , it is mapped read-only
+	// para 'name' : the file the memory is backed by
+	// result      : 'false' if there is no such file
+	bool OpenReadOnlySharedMemory(const string& name);
+
+	// Make the part of the segment after an offset read-only
+	// para 'offset' : the offset in bytes , it has to be aligned to pages
+	void ProtectSharedMemory(size_t offset);
+
+	// Remove the name of the segment , processes mapping it keep their mappings
+	void UnlinkSharedMemory();
+
 	// shared memory data
 	SharedMemory	sharedmemory;
 
 // platform dependent fields, still invisible from others
 private:
     int fd;
+    // the name of the segment , it is empty for the file mapped by blender
+    string segment;
 };
 
 #endif
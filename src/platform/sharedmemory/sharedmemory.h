@@ -26,7 +26,7 @@
 struct SharedMemory
 {
 	char*	bytes;
-	int		size;
+	size_t	size;
 
 	SharedMemory()
 	{
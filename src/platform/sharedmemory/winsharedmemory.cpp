@@ -69,6 +69,80 @@ void WinSharedMemory::ReleaseSharedMemory()
 		CloseHandle(hMapFile);
 		hMapFile = 0;
 	}
+	sharedmemory = SharedMemory();
+}
+
+// Create a named segment that other processes on the host could open
+bool WinSharedMemory::CreateNamedSharedMemory( const string& name , size_t size )
+{
+	const unsigned long long size64 = size;
+	hMapFile = CreateFileMapping( INVALID_HANDLE_VALUE , NULL , PAGE_READWRITE , (DWORD)( size64 >> 32 ) , (DWORD)( size64 & 0xffffffff ) , name.c_str() );
+	if (hMapFile == NULL)
+		return false;
+
+	// the creation fails if another process created the segment first
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(hMapFile);
+		hMapFile = 0;
+		return false;
+	}
+
+	sharedmemory.bytes = (char*)MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (sharedmemory.bytes == NULL)
+	{
+		slog( WARNING , GENERAL , stringFormat( "Failed to create shared memory %s." , name.c_str() ) );
+		ReleaseSharedMemory();
+		return false;
+	}
+	sharedmemory.size = size;
+	return true;
+}
+
+// Open a named segment created by another process
+bool WinSharedMemory::OpenNamedSharedMemory( const string& name )
+{
+	hMapFile = OpenFileMapping( FILE_MAP_ALL_ACCESS , FALSE , name.c_str() );
+	if (hMapFile == NULL)
+		return false;
+
+	// the size of the segment is the size of the whole view
+	sharedmemory.bytes = (char*)MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (sharedmemory.bytes == NULL || VirtualQuery(sharedmemory.bytes, &info, sizeof(info)) == 0)
+	{
+		ReleaseSharedMemory();
+		return false;
+	}
+	sharedmemory.size = info.RegionSize;
+	return true;
+}
+
+// Open the memory another process wrote data into for this one
+bool WinSharedMemory::OpenReadOnlySharedMemory( const string& name )
+{
+	hMapFile = OpenFileMapping( FILE_MAP_READ , FALSE , name.c_str() );
+	if (hMapFile == NULL)
+		return false;
+
+	// the size of the memory is the size of the whole view , the data tells its own size
+	sharedmemory.bytes = (char*)MapViewOfFile(hMapFile, FILE_MAP_READ, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (sharedmemory.bytes == NULL || VirtualQuery(sharedmemory.bytes, &info, sizeof(info)) == 0)
+	{
+		ReleaseSharedMemory();
+		return false;
+	}
+	sharedmemory.size = info.RegionSize;
+	return true;
+}
+
+// Make the part of the segment after an offset read-only
+void WinSharedMemory::ProtectSharedMemory( size_t offset )
+{
+	DWORD old = 0;
+	if (sharedmemory.bytes && offset < sharedmemory.size)
+		VirtualProtect(sharedmemory.bytes + offset, sharedmemory.size - offset, PAGE_READONLY, &old);
 }
 
 #endif
@@ -36,6 +36,29 @@ public:
 	// Release share memory resource
 	void ReleaseSharedMemory();
 
+	// Create a named segment that other processes on the host could open
+	// para 'name' : name of the segment
+	// para 'size' : size of the segment in bytes
+	// result      : 'false' if the name is taken already or the segment can't be created
+	bool CreateNamedSharedMemory(const string& name, size_t size);
+
+	// Open a named segment created by another process , it is mapped for reading and writing
+	// para 'name' : name of the segment
+	// result      : 'false' if there is no segment of the name
+	bool OpenNamedSharedMemory(const string& name);
+
+	// Open the memory another process wrote data into for this one , it is mapped read-only
+	// para 'name' : name of the mapping object
+	// result      : 'false' if there is no mapping of the name
+	bool OpenReadOnlySharedMemory(const string& name);
+
+	// Make the part of the segment after an offset read-only
+	// para 'offset' : the offset in bytes , it has to be aligned to pages
+	void ProtectSharedMemory(size_t offset);
+
+	// Remove the name of the segment , the segment is gone once the last process closes it anyway
+	void UnlinkSharedMemory() {}
+
 	// shared memory data
 	SharedMemory	sharedmemory;
 
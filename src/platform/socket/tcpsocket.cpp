@@ -0,0 +1,236 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "tcpsocket.h"
+#include "utility/strhelper.h"
+
+#if defined(SORT_IN_WINDOWS)
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	typedef int socklen_t;
+	#define SORT_INVALID_SOCKET	(SocketHandle)INVALID_SOCKET
+	#define sort_close_socket	closesocket
+	#define SORT_SHUTDOWN_BOTH	SD_BOTH
+#else
+	#include <sys/types.h>
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <arpa/inet.h>
+	#include <netdb.h>
+	#include <unistd.h>
+	#define SORT_INVALID_SOCKET	-1
+	#define sort_close_socket	close
+	#define SORT_SHUTDOWN_BOTH	SHUT_RDWR
+#endif
+#include <string.h>
+#include <mutex>
+
+// winsock is started once for the process
+static bool startupSockets()
+{
+#if defined(SORT_IN_WINDOWS)
+	static std::once_flag flag;
+	static bool started = false;
+	std::call_once( flag , [](){
+		WSADATA data;
+		started = ( WSAStartup( MAKEWORD( 2 , 2 ) , &data ) == 0 );
+	} );
+	return started;
+#else
+	return true;
+#endif
+}
+
+// default constructor
+TcpSocket::TcpSocket() : m_socket( SORT_INVALID_SOCKET )
+{
+}
+
+// destructor
+TcpSocket::~TcpSocket()
+{
+	Close();
+}
+
+// listen to a port
+bool TcpSocket::Listen( unsigned short port )
+{
+	Close();
+	if( !startupSockets() )
+		return false;
+
+	m_socket = (SocketHandle)socket( AF_INET , SOCK_STREAM , IPPROTO_TCP );
+	if( m_socket == SORT_INVALID_SOCKET )
+		return false;
+
+	// the port of the last run could still be in TIME_WAIT
+	int reuse = 1;
+	setsockopt( m_socket , SOL_SOCKET , SO_REUSEADDR , (const char*)&reuse , sizeof( reuse ) );
+
+	sockaddr_in addr;
+	memset( &addr , 0 , sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_ANY );
+	addr.sin_port = htons( port );
+	if( bind( m_socket , (const sockaddr*)&addr , sizeof( addr ) ) != 0 || listen( m_socket , 64 ) != 0 )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+// accept a connection
+bool TcpSocket::Accept( TcpSocket& client , unsigned timeout )
+{
+	if( m_socket == SORT_INVALID_SOCKET )
+		return false;
+
+	// the listening socket is polled , so that the thread accepting connections could be stopped
+	fd_set fds;
+	FD_ZERO( &fds );
+	FD_SET( m_socket , &fds );
+	timeval tv;
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = ( timeout % 1000 ) * 1000;
+	if( select( (int)m_socket + 1 , &fds , nullptr , nullptr , &tv ) <= 0 )
+		return false;
+
+	const SocketHandle s = (SocketHandle)accept( m_socket , nullptr , nullptr );
+	if( s == SORT_INVALID_SOCKET )
+		return false;
+
+	// messages are small and answered at once , they are not delayed to be merged
+	int nodelay = 1;
+	setsockopt( s , IPPROTO_TCP , TCP_NODELAY , (const char*)&nodelay , sizeof( nodelay ) );
+
+	client.Close();
+	client.m_socket = s;
+	return true;
+}
+
+// connect to a listening socket
+bool TcpSocket::Connect( const string& host , unsigned short port )
+{
+	Close();
+	if( !startupSockets() )
+		return false;
+
+	addrinfo hints;
+	memset( &hints , 0 , sizeof( hints ) );
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	addrinfo* result = nullptr;
+	if( getaddrinfo( host.c_str() , to_string( port ).c_str() , &hints , &result ) != 0 )
+		return false;
+
+	// the first address accepting the connection is taken
+	for( addrinfo* info = result ; info && m_socket == SORT_INVALID_SOCKET ; info = info->ai_next )
+	{
+		m_socket = (SocketHandle)socket( info->ai_family , info->ai_socktype , info->ai_protocol );
+		if( m_socket == SORT_INVALID_SOCKET )
+			continue;
+		if( connect( m_socket , info->ai_addr , (socklen_t)info->ai_addrlen ) != 0 )
+			Close();
+	}
+	freeaddrinfo( result );
+	if( m_socket == SORT_INVALID_SOCKET )
+		return false;
+
+	int nodelay = 1;
+	setsockopt( m_socket , IPPROTO_TCP , TCP_NODELAY , (const char*)&nodelay , sizeof( nodelay ) );
+	return true;
+}
+
+// send the whole buffer
+bool TcpSocket::Send( const void* data , size_t size )
+{
+	const char* bytes = (const char*)data;
+	while( size > 0 )
+	{
+		// the process is not killed by SIGPIPE if the other side is gone
+#if defined(SORT_IN_LINUX)
+		const int sent = (int)send( m_socket , bytes , size , MSG_NOSIGNAL );
+#else
+		const int sent = (int)send( m_socket , bytes , (int)min( size , (size_t)( 1 << 30 ) ) , 0 );
+#endif
+		if( sent <= 0 )
+			return false;
+		bytes += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+// receive until the buffer is full
+bool TcpSocket::Receive( void* data , size_t size )
+{
+	char* bytes = (char*)data;
+	while( size > 0 )
+	{
+		const int received = (int)recv( m_socket , bytes , (int)min( size , (size_t)( 1 << 30 ) ) , 0 );
+		if( received <= 0 )
+			return false;
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+// stop sending and receiving
+void TcpSocket::Shutdown()
+{
+	if( m_socket != SORT_INVALID_SOCKET )
+		shutdown( m_socket , SORT_SHUTDOWN_BOTH );
+}
+
+// close the socket
+void TcpSocket::Close()
+{
+	if( m_socket != SORT_INVALID_SOCKET )
+		sort_close_socket( m_socket );
+	m_socket = SORT_INVALID_SOCKET;
+}
+
+// whether the socket is open
+bool TcpSocket::IsOpen() const
+{
+	return m_socket != SORT_INVALID_SOCKET;
+}
+
+// get the port of the listening socket
+unsigned short TcpSocket::GetPort() const
+{
+	sockaddr_in addr;
+	socklen_t len = sizeof( addr );
+	if( m_socket == SORT_INVALID_SOCKET || getsockname( m_socket , (sockaddr*)&addr , &len ) != 0 )
+		return 0;
+	return ntohs( addr.sin_port );
+}
+
+// get the address of the other side
+string TcpSocket::GetPeerName() const
+{
+	sockaddr_in addr;
+	socklen_t len = sizeof( addr );
+	if( m_socket == SORT_INVALID_SOCKET || getpeername( m_socket , (sockaddr*)&addr , &len ) != 0 )
+		return "unknown";
+	return stringFormat( "%s:%d" , inet_ntoa( addr.sin_addr ) , (int)ntohs( addr.sin_port ) );
+}
@@ -0,0 +1,95 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+
+#if defined(SORT_IN_WINDOWS)
+typedef unsigned long long	SocketHandle;		// SOCKET of winsock
+#else
+typedef int					SocketHandle;		// file descriptor
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//	definition of tcp socket
+//	desc :	A blocking TCP connection or listening socket over the
+//			sockets of the operating system. Sending and receiving
+//			always transfer the whole buffer , a failed transfer means
+//			the connection is lost and the socket should be closed.
+class	TcpSocket
+{
+// public method
+public:
+	// default constructor
+	TcpSocket();
+	// destructor , the socket is closed
+	~TcpSocket();
+
+	// listen to a port on all network interfaces
+	// para 'port' : the port , zero picks any free port
+	// result      : false if the port can't be bound
+	bool	Listen( unsigned short port );
+
+	// accept a connection of the listening socket
+	// para 'client'  : the accepted connection
+	// para 'timeout' : the maximum time to wait in milliseconds
+	// result         : false if no connection is accepted within the time
+	bool	Accept( TcpSocket& client , unsigned timeout );
+
+	// connect to a listening socket
+	// para 'host' : the name or the address of the host
+	// para 'port' : the port
+	// result      : false if the connection fails
+	bool	Connect( const string& host , unsigned short port );
+
+	// send the whole buffer
+	// para 'data' : the buffer
+	// para 'size' : the size of the buffer in bytes
+	// result      : false if the connection is lost
+	bool	Send( const void* data , size_t size );
+
+	// receive until the buffer is full
+	// para 'data' : the buffer
+	// para 'size' : the number of bytes to receive
+	// result      : false if the connection is lost or closed by the other side
+	bool	Receive( void* data , size_t size );
+
+	// stop sending and receiving , the threads blocked on the socket return with a failure
+	void	Shutdown();
+
+	// close the socket
+	void	Close();
+
+	// whether the socket is open
+	bool	IsOpen() const;
+
+	// get the port of the listening socket
+	unsigned short	GetPort() const;
+
+	// get the address of the other side of the connection
+	string	GetPeerName() const;
+
+// private field
+private:
+	// the socket of the operating system
+	SocketHandle	m_socket;
+
+	// the socket can't be copied , it would be closed twice
+	TcpSocket( const TcpSocket& );
+	TcpSocket& operator = ( const TcpSocket& );
+};
@@ -0,0 +1,143 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "bluenoise.h"
+#include "sort.h"
+#include "utility/rand.h"
+#include <vector>
+#include <math.h>
+#include <float.h>
+
+// the void and cluster method on a torus , ones are dots of the pattern
+class VoidAndCluster
+{
+public:
+	VoidAndCluster() : m_pattern( PIXEL_CNT , 0 ) , m_energy( PIXEL_CNT , 0.0f ) , m_kernel( PIXEL_CNT )
+	{
+		// the energy of a dot spreads with a gaussian filter of sigma 1.5
+		for( unsigned y = 0 ; y < BLUE_NOISE_SIZE ; ++y )
+		{
+			for( unsigned x = 0 ; x < BLUE_NOISE_SIZE ; ++x )
+			{
+				const float dx = (float)min( x , BLUE_NOISE_SIZE - x );
+				const float dy = (float)min( y , BLUE_NOISE_SIZE - y );
+				m_kernel[ y * BLUE_NOISE_SIZE + x ] = expf( -( dx * dx + dy * dy ) / ( 2.0f * 1.5f * 1.5f ) );
+			}
+		}
+	}
+
+	// generate the ranks of the pixels
+	void Generate( float* mask )
+	{
+		// the initial pattern of random dots is relaxed by moving the tightest cluster to the largest void
+		const unsigned initial = PIXEL_CNT / 10;
+		for( unsigned i = 0 ; i < initial ; )
+		{
+			const unsigned p = sort_rand() % PIXEL_CNT;
+			if( !m_pattern[p] ){
+				_toggle( p );
+				++i;
+			}
+		}
+		while( true )
+		{
+			const unsigned cluster = _find( 1 );
+			_toggle( cluster );
+			const unsigned void_pixel = _find( 0 );
+			if( void_pixel == cluster ){
+				_toggle( cluster );
+				break;
+			}
+			_toggle( void_pixel );
+		}
+		const std::vector<char> relaxed = m_pattern;
+		const std::vector<float> relaxed_energy = m_energy;
+
+		// the dots of the initial pattern are ranked by removing the tightest cluster one at a time
+		for( unsigned rank = initial ; rank > 0 ; --rank )
+		{
+			const unsigned cluster = _find( 1 );
+			_toggle( cluster );
+			mask[cluster] = (float)( rank - 1 );
+		}
+
+		// the rest are ranked by filling the largest void one at a time
+		m_pattern = relaxed;
+		m_energy = relaxed_energy;
+		for( unsigned rank = initial ; rank < PIXEL_CNT ; ++rank )
+		{
+			const unsigned void_pixel = _find( 0 );
+			_toggle( void_pixel );
+			mask[void_pixel] = (float)rank;
+		}
+
+		for( unsigned i = 0 ; i < PIXEL_CNT ; ++i )
+			mask[i] = ( mask[i] + 0.5f ) / (float)PIXEL_CNT;
+	}
+
+private:
+	static const unsigned PIXEL_CNT = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+
+	std::vector<char>	m_pattern;
+	std::vector<float>	m_energy;
+	std::vector<float>	m_kernel;
+
+	// add or remove a dot
+	void _toggle( unsigned p )
+	{
+		const float sign = m_pattern[p] ? -1.0f : 1.0f;
+		m_pattern[p] = !m_pattern[p];
+		const unsigned px = p % BLUE_NOISE_SIZE , py = p / BLUE_NOISE_SIZE;
+		for( unsigned y = 0 ; y < BLUE_NOISE_SIZE ; ++y )
+		{
+			const unsigned ky = ( ( y + BLUE_NOISE_SIZE - py ) % BLUE_NOISE_SIZE ) * BLUE_NOISE_SIZE;
+			for( unsigned x = 0 ; x < BLUE_NOISE_SIZE ; ++x )
+				m_energy[ y * BLUE_NOISE_SIZE + x ] += sign * m_kernel[ ky + ( x + BLUE_NOISE_SIZE - px ) % BLUE_NOISE_SIZE ];
+		}
+	}
+
+	// find the tightest cluster among the dots or the largest void among the other pixels
+	unsigned _find( char dot ) const
+	{
+		unsigned best = 0;
+		float best_energy = dot ? -FLT_MAX : FLT_MAX;
+		for( unsigned i = 0 ; i < PIXEL_CNT ; ++i )
+		{
+			if( m_pattern[i] != dot )
+				continue;
+			if( dot ? ( m_energy[i] > best_energy ) : ( m_energy[i] < best_energy ) )
+			{
+				best_energy = m_energy[i];
+				best = i;
+			}
+		}
+		return best;
+	}
+};
+
+// get the blue noise mask
+const float* BlueNoiseMask()
+{
+	static std::vector<float> mask;
+	static bool generated = [](){
+		mask.resize( BLUE_NOISE_SIZE * BLUE_NOISE_SIZE );
+		VoidAndCluster().Generate( mask.data() );
+		return true;
+	}();
+	(void)generated;
+	return mask.data();
+}
@@ -0,0 +1,26 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+// the size of the blue noise mask , it is tiled over the image
+static const unsigned BLUE_NOISE_SIZE = 64;
+
+// get the blue noise mask , the values are the ranks of the void and cluster method ( Ulichney 1993 ) normalized to [0,1) ,
+// the mask is generated the first time it is used
+// result : the values of BLUE_NOISE_SIZE by BLUE_NOISE_SIZE pixels , row by row
+const float* BlueNoiseMask();
@@ -0,0 +1,78 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header file
+#include "halton.h"
+#include "lowdiscrepancy.h"
+#include "utility/sassert.h"
+
+IMPLEMENT_CREATOR( HaltonSampler );
+
+// the permutations of three digits
+static const unsigned char g_Permutation3[6][3] = {
+	{ 0 , 1 , 2 } , { 0 , 2 , 1 } , { 1 , 0 , 2 } , { 1 , 2 , 0 } , { 2 , 0 , 1 } , { 2 , 1 , 0 }
+};
+
+// generate sample in one dimension
+void HaltonSampler::Generate1D( float* sample , unsigned num , bool accept_uniform ) const
+{
+	DitherScope dither( this , sample , num , 1 );
+
+	sAssert( sample != 0 , SAMPLING );
+
+	// the first dimension in base two is the van der Corput sequence
+	const unsigned seed = MixBits( sort_rand() );
+	for( unsigned i = 0 ; i < num ; ++i )
+		sample[i] = FixedToCanonical( OwenScramble( ReverseBits( i ) , seed ) );
+	ShuffleSamples( sample , num , 1 );
+}
+
+// generate sample in two dimension
+void HaltonSampler::Generate2D( float* sample , unsigned num , bool accept_uniform ) const
+{
+	DitherScope dither( this , sample , num , 2 );
+
+	sAssert( sample != 0 , SAMPLING );
+
+	const unsigned seed_x = MixBits( sort_rand() );
+	const unsigned seed_y = MixBits( sort_rand() );
+	for( unsigned i = 0 ; i < num ; ++i )
+	{
+		sample[2*i] = FixedToCanonical( OwenScramble( ReverseBits( i ) , seed_x ) );
+		sample[2*i+1] = _scrambledRadicalInverse3( i , seed_y );
+	}
+	ShuffleSamples( sample , num , 2 );
+}
+
+// the radical inverse in base three with Owen scrambling
+float HaltonSampler::_scrambledRadicalInverse3( unsigned i , unsigned seed )
+{
+	// each digit is permuted by a permutation picked with the digits before it , the digits after the index
+	// runs out are permuted too , three to the power of fifteen is below the precision of floats
+	double result = 0.0;
+	double inv = 1.0 / 3.0;
+	unsigned h = seed;
+	for( unsigned k = 0 ; k < 15 ; ++k )
+	{
+		const unsigned digit = i % 3;
+		i /= 3;
+		result += g_Permutation3[ MixBits( h ) % 6 ][ digit ] * inv;
+		h = MixBits( h ^ ( ( digit + 1 ) * 0x9e3779b9 ) );
+		inv /= 3.0;
+	}
+	return std::min( (float)result , LD_ONE_MINUS_EPSILON );
+}
@@ -0,0 +1,58 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#ifndef	SORT_HALTON
+#define	SORT_HALTON
+
+#include "sampler.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// definition of halton sampler
+// desc :	Points of the Halton sequence in base two and three , the digits of every call are
+//			Owen scrambled with a new seed , so that any number of dimensions could be drawn
+//			from it. Any number of samples is well distributed , it doesn't need rounding.
+class HaltonSampler : public Sampler
+{
+// public method
+public:
+	DEFINE_CREATOR( HaltonSampler , Sampler , "halton" );
+
+	// default constructor
+	HaltonSampler(){}
+	// destructor
+	~HaltonSampler(){}
+
+	// generate sample in one dimension
+	// para 'sample' : the memory to save the sampled data
+	// para 'num'    : the number of samples to be generated
+	virtual void Generate1D( float* sample , unsigned num , bool accept_uniform = false ) const;
+
+	// generate sample in two dimension
+	// para 'sample' : the memory to save the sampled data
+	// para 'num'    : the number of samples to be generated
+	virtual void Generate2D( float* sample , unsigned num , bool accept_uniform = false ) const;
+
+// private method
+private:
+	// the radical inverse in base three with Owen scrambling
+	// para 'i'    : the index of the point
+	// para 'seed' : the seed of the scrambling
+	// result      : the scrambled point in [0,1)
+	static float _scrambledRadicalInverse3( unsigned i , unsigned seed );
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "utility/rand.h"
+#include <algorithm>
+
+// the largest float smaller than one , low discrepancy points are clamped to it
+static const float LD_ONE_MINUS_EPSILON = 0.99999994f;
+
+// reverse the bits of an integer
+inline unsigned ReverseBits( unsigned x )
+{
+	x = ( x << 16 ) | ( x >> 16 );
+	x = ( ( x & 0x00ff00ff ) << 8 ) | ( ( x & 0xff00ff00 ) >> 8 );
+	x = ( ( x & 0x0f0f0f0f ) << 4 ) | ( ( x & 0xf0f0f0f0 ) >> 4 );
+	x = ( ( x & 0x33333333 ) << 2 ) | ( ( x & 0xcccccccc ) >> 2 );
+	x = ( ( x & 0x55555555 ) << 1 ) | ( ( x & 0xaaaaaaaa ) >> 1 );
+	return x;
+}
+
+// the finalizer of MurmurHash3 , it maps a seed to a well distributed number
+inline unsigned MixBits( unsigned h )
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+// Owen scrambling in base two , every bit is flipped depending on the bits above it ( Laine and Karras , Burley 2020 )
+// para 'x'    : the bits of a point in [0,1) as a fixed point number
+// para 'seed' : the seed of the scrambling
+inline unsigned OwenScramble( unsigned x , unsigned seed )
+{
+	x = ReverseBits( x );
+	x += seed;
+	x ^= x * 0x6c50b47c;
+	x ^= x * 0xb82f1e52;
+	x ^= x * 0xc7afe638;
+	x ^= x * 0x8d22f6e6;
+	return ReverseBits( x );
+}
+
+// the second dimension of the Sobol sequence , the first one is the van der Corput sequence , 'ReverseBits'
+inline unsigned SobolSecondDimension( unsigned i )
+{
+	unsigned r = 0;
+	for( unsigned v = 1u << 31 ; i ; i >>= 1 , v ^= v >> 1 )
+		if( i & 1 )
+			r ^= v;
+	return r;
+}
+
+// convert a fixed point number to a float in [0,1)
+inline float FixedToCanonical( unsigned x )
+{
+	return ( x >> 8 ) * ( 1.0f / (float)( 1 << 24 ) );
+}
+
+// shuffle the samples , samples generated by different calls are paired by their indices , the points of low
+// discrepancy sequences are correlated across calls without it
+// para 'sample' : the samples to be shuffled
+// para 'num'    : the number of samples
+// para 'dim'    : the dimension of each sample
+inline void ShuffleSamples( float* sample , unsigned num , unsigned dim )
+{
+	for( unsigned i = num ; i > 1 ; --i )
+	{
+		const unsigned j = sort_rand() % i;
+		for( unsigned k = 0 ; k < dim ; ++k )
+			std::swap( sample[ ( i - 1 ) * dim + k ] , sample[ j * dim + k ] );
+	}
+}
@@ -0,0 +1,149 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header file
+#include "pmj02.h"
+#include "lowdiscrepancy.h"
+#include "utility/sassert.h"
+
+IMPLEMENT_CREATOR( PMJ02Sampler );
+
+// the number of points in a table , it has to be a power of two
+static const unsigned PMJ02_TABLE_SIZE = 1024;
+// the number of tables
+static const unsigned PMJ02_TABLE_CNT = 16;
+
+// default constructor
+PMJ02Sampler::PMJ02Sampler()
+{
+	m_tables.resize( 2 * PMJ02_TABLE_SIZE * PMJ02_TABLE_CNT );
+	for( unsigned t = 0 ; t < PMJ02_TABLE_CNT ; ++t )
+		while( !_generateTable( &m_tables[ 2 * PMJ02_TABLE_SIZE * t ] ) );
+}
+
+// generate a table of the sequence
+bool PMJ02Sampler::_generateTable( unsigned* points )
+{
+	// the strata of the elementary intervals of area 2^-level , 2^a by 2^(level-a) of them for each a in [0,level]
+	std::vector<char> occupied( 1 , 0 );
+	std::vector<unsigned> free_x , free_y;
+	unsigned level = 0;
+	auto stratum = [&]( unsigned x , unsigned y , unsigned a ){
+		const unsigned cx = (unsigned)( (unsigned long long)x >> ( 32 - a ) );
+		const unsigned cy = (unsigned)( (unsigned long long)y >> ( 32 - level + a ) );
+		return ( a << level ) + ( cx << ( level - a ) ) + cy;
+	};
+	auto occupy = [&]( unsigned x , unsigned y ){
+		for( unsigned a = 0 ; a <= level ; ++a )
+			occupied[ stratum( x , y , a ) ] = 1;
+	};
+
+	for( unsigned k = 0 ; k < PMJ02_TABLE_SIZE ; ++k )
+	{
+		// the strata are finer once the number of points reaches a power of two
+		if( ( 1u << level ) <= k )
+		{
+			++level;
+			occupied.assign( ( level + 1 ) << level , 0 );
+			for( unsigned j = 0 ; j < k ; ++j )
+				occupy( points[2*j] , points[2*j+1] );
+		}
+
+		// the free columns and rows are visited in random order
+		const unsigned cnt = 1u << level;
+		free_x.clear();
+		free_y.clear();
+		for( unsigned c = 0 ; c < cnt ; ++c )
+		{
+			if( !occupied[ ( level << level ) + c ] )
+				free_x.push_back( c );
+			if( !occupied[ c ] )
+				free_y.push_back( c );
+		}
+		for( unsigned i = (unsigned)free_x.size() ; i > 1 ; --i )
+			std::swap( free_x[i-1] , free_x[ sort_rand() % i ] );
+		for( unsigned i = (unsigned)free_y.size() ; i > 1 ; --i )
+			std::swap( free_y[i-1] , free_y[ sort_rand() % i ] );
+
+		// the point is jittered in a cell whose strata of all elementary intervals are free
+		bool found = false;
+		for( unsigned i = 0 ; i < free_x.size() && !found ; ++i )
+		{
+			for( unsigned j = 0 ; j < free_y.size() && !found ; ++j )
+			{
+				const unsigned shift = 32 - level;
+				const unsigned jitter_mask = (unsigned)( ( 1ull << shift ) - 1 );
+				const unsigned x = (unsigned)( (unsigned long long)free_x[i] << shift ) | ( sort_rand() & jitter_mask );
+				const unsigned y = (unsigned)( (unsigned long long)free_y[j] << shift ) | ( sort_rand() & jitter_mask );
+
+				found = true;
+				for( unsigned a = 1 ; a < level && found ; ++a )
+					found = !occupied[ stratum( x , y , a ) ];
+				if( found )
+				{
+					points[2*k] = x;
+					points[2*k+1] = y;
+					occupy( x , y );
+				}
+			}
+		}
+		if( !found )
+			return false;
+	}
+	return true;
+}
+
+// generate sample in one dimension
+void PMJ02Sampler::Generate1D( float* sample , unsigned num , bool accept_uniform ) const
+{
+	DitherScope dither( this , sample , num , 1 );
+
+	sAssert( sample != 0 , SAMPLING );
+
+	// samples beyond the size of a table take another one
+	for( unsigned offset = 0 ; offset < num ; offset += PMJ02_TABLE_SIZE )
+	{
+		const unsigned* points = &m_tables[ 2 * PMJ02_TABLE_SIZE * ( sort_rand() % PMJ02_TABLE_CNT ) ];
+		const unsigned mask = sort_rand();
+		const unsigned cnt = std::min( num - offset , PMJ02_TABLE_SIZE );
+		for( unsigned i = 0 ; i < cnt ; ++i )
+			sample[offset+i] = FixedToCanonical( points[2*i] ^ mask );
+	}
+	ShuffleSamples( sample , num , 1 );
+}
+
+// generate sample in two dimension
+void PMJ02Sampler::Generate2D( float* sample , unsigned num , bool accept_uniform ) const
+{
+	DitherScope dither( this , sample , num , 2 );
+
+	sAssert( sample != 0 , SAMPLING );
+
+	for( unsigned offset = 0 ; offset < num ; offset += PMJ02_TABLE_SIZE )
+	{
+		const unsigned* points = &m_tables[ 2 * PMJ02_TABLE_SIZE * ( sort_rand() % PMJ02_TABLE_CNT ) ];
+		const unsigned mask_x = sort_rand();
+		const unsigned mask_y = sort_rand();
+		const unsigned cnt = std::min( num - offset , PMJ02_TABLE_SIZE );
+		for( unsigned i = 0 ; i < cnt ; ++i )
+		{
+			sample[2*(offset+i)] = FixedToCanonical( points[2*i] ^ mask_x );
+			sample[2*(offset+i)+1] = FixedToCanonical( points[2*i+1] ^ mask_y );
+		}
+	}
+	ShuffleSamples( sample , num , 2 );
+}
@@ -0,0 +1,61 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#ifndef	SORT_PMJ02
+#define	SORT_PMJ02
+
+#include "sampler.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// definition of progressive multi-jittered (0,2) sampler
+// desc :	Progressive multi-jittered (0,2) sequences ( Christensen et al. 2018 ) , the first 2^k
+//			points of them are stratified in every elementary interval of area 2^-k. A few tables
+//			of the sequences are generated once , every call takes the points of a random table
+//			and scrambles them with random xor masks , which keeps the stratification.
+class PMJ02Sampler : public Sampler
+{
+// public method
+public:
+	DEFINE_CREATOR( PMJ02Sampler , Sampler , "pmj02" );
+
+	// default constructor
+	PMJ02Sampler();
+	// destructor
+	~PMJ02Sampler(){}
+
+	// generate sample in one dimension
+	// para 'sample' : the memory to save the sampled data
+	// para 'num'    : the number of samples to be generated
+	virtual void Generate1D( float* sample , unsigned num , bool accept_uniform = false ) const;
+
+	// generate sample in two dimension
+	// para 'sample' : the memory to save the sampled data
+	// para 'num'    : the number of samples to be generated
+	virtual void Generate2D( float* sample , unsigned num , bool accept_uniform = false ) const;
+
+// private field
+private:
+	// the points of the tables as fixed point numbers , x and y of each point are next to each other
+	std::vector<unsigned>	m_tables;
+
+	// generate a table of the sequence
+	// para 'points' : the memory to save the points
+	// result        : false if the sequence comes to a dead end , it should be generated again
+	static bool _generateTable( unsigned* points );
+};
+
+#endif
@@ -25,21 +25,19 @@ IMPLEMENT_CREATOR( RandomSampler );
 // generate sample in one dimension
 void RandomSampler::Generate1D( float* sample , unsigned num , bool accept_uniform ) const
 {
+	DitherScope dither( this , sample , num , 1 );
+
 	sAssert( sample != 0 , SAMPLING );
 
-	for( unsigned i = 0 ; i < num ; ++i )
-		sample[i] = sort_canonical();
+	sort_canonical( sample , num );
 }
 
 // generate sample in two dimension
 void RandomSampler::Generate2D( float* sample , unsigned num , bool accept_uniform ) const
 {
+	DitherScope dither( this , sample , num , 2 );
+
 	sAssert( sample != 0 , SAMPLING );
 
-	int count = 2 * num;
-	for( int i = 0 ; i < count ; i += 2 )
-	{
-		sample[i] = sort_canonical();
-		sample[i+1] = sort_canonical();
-	}
+	sort_canonical( sample , 2 * num );
 }
@@ -24,6 +24,8 @@ IMPLEMENT_CREATOR( RegularSampler );
 // generate sample in one dimension
 void RegularSampler::Generate1D( float* sample , unsigned num , bool accept_uniform ) const
 {
+	DitherScope dither( this , sample , num , 1 );
+
 	sAssert( sample != 0 , SAMPLING );
 
 	for( unsigned i = 0 ; i < num ; ++i )
@@ -40,6 +42,8 @@ void RegularSampler::Generate1D( float* sample , unsigned num , bool accept_unif
 // generate sample in two dimension
 void RegularSampler::Generate2D( float* sample , unsigned num , bool accept_uniform ) const
 {
+	DitherScope dither( this , sample , num , 2 );
+
 	sAssert( sample != 0 , SAMPLING );
 
 	unsigned n = (unsigned)sqrt((float)num);
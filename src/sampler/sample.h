@@ -22,6 +22,9 @@
 #include <vector>
 #include "utility/rand.h"
 #include "utility/define.h"
+#include "spectrum/spectrum.h"
+
+struct Primary_Hit;
 
 // Light Sample
 class	LightSample
@@ -78,6 +81,56 @@ public:
 	}
 };
 
+class Sampler;
+
+// the sample dimensions of a batch of pixel samples , the sampler generates a dimension for the whole batch
+// once any sample of it uses the dimension , so the dimensions never used by short paths cost nothing.
+// The numbers are kept as the sampler fills them , the 1d numbers of a dimension are contiguous and so are
+// the 2d ones , they are read by ( sample , dimension ) without being copied into sample structures.
+class SampleBatch
+{
+public:
+	// constructor , the samples are allocated in the memory arena of the thread
+	// para 'sampler'    : the sampling method , dimensions are random if it rounds the number of samples differently
+	// para 'num'        : the number of pixel samples in the batch
+	// para 'light_dims' : the number of light sample dimensions of each pixel sample
+	// para 'bsdf_dims'  : the number of bsdf sample dimensions of each pixel sample
+	SampleBatch( const Sampler* sampler , unsigned num , unsigned light_dims , unsigned bsdf_dims );
+
+	// get the light sample of a pixel sample in a dimension , it's random beyond the dimensions of the batch
+	// para 'id'  : the index of the pixel sample in the batch
+	// para 'dim' : the dimension
+	LightSample GetLightSample( unsigned id , unsigned dim );
+
+	// get the bsdf sample of a pixel sample in a dimension , it's random beyond the dimensions of the batch
+	// para 'id'  : the index of the pixel sample in the batch
+	// para 'dim' : the dimension
+	BsdfSample GetBsdfSample( unsigned id , unsigned dim );
+
+	// get the 1d numbers of all samples in a dimension , light dimensions come before bsdf dimensions
+	// para 'dim' : the dimension
+	// result     : the number of each sample , nullptr beyond the dimensions of the batch
+	const float* Get1D( unsigned dim );
+
+	// get the 2d numbers of all samples in a dimension , light dimensions come before bsdf dimensions
+	// para 'dim' : the dimension
+	// result     : the two numbers of each sample , nullptr beyond the dimensions of the batch
+	const float* Get2D( unsigned dim );
+
+private:
+	const Sampler*	m_sampler;
+	unsigned		m_num;
+	unsigned		m_lightDims;
+	unsigned		m_bsdfDims;
+	float*			m_t;			// the 1d numbers , 'm_num' of them in each dimension
+	float*			m_uv;			// the 2d numbers , '2*m_num' of them in each dimension
+	bool*			m_generated;	// whether the numbers of each dimension are generated
+
+	// generate the numbers of a dimension for the batch if they are not yet
+	// para 'dim': the dimension , it's the same in all pixels no matter which dimensions are used before
+	void _generate( unsigned dim );
+};
+
 // light sample offset
 class SampleOffset
 {
@@ -93,20 +146,33 @@ class PixelSample
 public:
 	float				img_u , img_v;	// the range of the float2 should be (0,0) <-> (1,1)
 	float				dof_u , dof_v;	// the range of the float2 should be (-1,-1) <-> (1,1)
+	float				time;			// the position in the shutter interval , it is in [0,1) and zero if nothing in the scene moves
+	unsigned			pixel_x , pixel_y;	// the pixel the sample belongs to
 	LightSample*		light_sample;
 	BsdfSample*			bsdf_sample;
 	vector<unsigned>	light_dimension;
 	vector<unsigned>	bsdf_dimension;
 	float*				data;		// the data to used
+	SampleBatch*		batch;		// the dimensions requested by the integrator
+	unsigned			batch_id;	// the index of the sample in the batch
+	Spectrum*			aov;		// the output variables of the sample , it is null if none is requested
+	const Primary_Hit*	primary;	// the first hit of the camera ray found by the raster pass , it is null if the ray is traced
 
 	// default constructor
 	PixelSample()
 	{
 		img_u = 0.0f;
 		img_v = 0.0f;
+		time = 0.0f;
+		pixel_x = 0;
+		pixel_y = 0;
 		light_sample = 0;
 		bsdf_sample = 0;
 		data = 0;
+		batch = 0;
+		batch_id = 0;
+		aov = 0;
+		primary = 0;
 	}
 	~PixelSample()
 	{
@@ -114,6 +180,16 @@ public:
 		SAFE_DELETE_ARRAY( bsdf_sample );
 		SAFE_DELETE_ARRAY( data );
 	}
+	// get the light sample in a dimension , it's random beyond the dimensions requested by the integrator
+	LightSample GetLightSample( unsigned dim ) const
+	{
+		return batch ? batch->GetLightSample( batch_id , dim ) : LightSample( true );
+	}
+	// get the bsdf sample in a dimension , it's random beyond the dimensions requested by the integrator
+	BsdfSample GetBsdfSample( unsigned dim ) const
+	{
+		return batch ? batch->GetBsdfSample( batch_id , dim ) : BsdfSample( true );
+	}
 	// request more samples
 	unsigned RequestMoreLightSample( unsigned num )
 	{
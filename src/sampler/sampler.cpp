@@ -17,6 +17,19 @@
 
 // include the header file
 #include "sampler.h"
+#include "bluenoise.h"
+#include "lowdiscrepancy.h"
+#include "utility/sassert.h"
+#include <math.h>
+
+// the pixel whose samples are being generated by the thread , and the number of dimensions generated for it
+static Thread_Local unsigned g_pixelX = 0;
+static Thread_Local unsigned g_pixelY = 0;
+static Thread_Local unsigned g_sample = 0;
+static Thread_Local unsigned g_dimension = 0;
+
+// the image and lens samples take the dimensions before the batch
+static const unsigned SAMPLE_BATCH_DIMENSION = 4;
 
 // default constructor
 Sampler::Sampler()
@@ -27,3 +40,151 @@ Sampler::Sampler()
 Sampler::~Sampler()
 {
 }
+
+// enable blue noise dithering
+void Sampler::EnableBlueNoise()
+{
+	m_blueNoise = true;
+
+	// the mask is generated before the threads use it
+	BlueNoiseMask();
+}
+
+// start generating the samples of a pixel
+void Sampler::StartPixel( unsigned x , unsigned y , unsigned sample )
+{
+	g_pixelX = x;
+	g_pixelY = y;
+	g_sample = sample;
+	g_dimension = 0;
+}
+
+// continue generating the samples of a pixel from a dimension
+void Sampler::SetDimension( unsigned dim )
+{
+	g_dimension = dim;
+}
+
+// the random numbers of the dimension are shared by all pixels
+DitherScope::DitherScope( const Sampler* sampler , float* sample , unsigned num , unsigned dim )
+{
+	if( !sampler->IsBlueNoise() )
+		return;
+	sAssert( dim <= 2 , SAMPLING );
+
+	m_sample = sample;
+	m_num = num;
+	m_dim = dim;
+	sort_get_state( m_state );
+	sort_set_stream( g_dimension , SORT_RAND_DITHER , g_sample );
+
+	// each dimension looks the mask up with its own offset , otherwise the dimensions of a pixel would be shifted together
+	const float* mask = BlueNoiseMask();
+	for( unsigned d = 0 ; d < dim ; ++d )
+	{
+		const unsigned h = MixBits( g_dimension++ );
+		const unsigned x = ( g_pixelX + ( h & 0xffff ) ) % BLUE_NOISE_SIZE;
+		const unsigned y = ( g_pixelY + ( h >> 16 ) ) % BLUE_NOISE_SIZE;
+		m_shift[d] = mask[ y * BLUE_NOISE_SIZE + x ] + sort_canonical();
+	}
+}
+
+// shift the samples by the blue noise mask at the pixel
+DitherScope::~DitherScope()
+{
+	if( !m_sample )
+		return;
+
+	for( unsigned d = 0 ; d < m_dim ; ++d )
+	{
+		for( unsigned i = 0 ; i < m_num ; ++i )
+		{
+			const float v = m_sample[ i * m_dim + d ] + m_shift[d];
+			m_sample[ i * m_dim + d ] = min( v - floorf( v ) , LD_ONE_MINUS_EPSILON );
+		}
+	}
+	sort_set_state( m_state );
+}
+
+// constructor
+SampleBatch::SampleBatch( const Sampler* sampler , unsigned num , unsigned light_dims , unsigned bsdf_dims )
+	:m_sampler(sampler),m_num(num),m_lightDims(light_dims),m_bsdfDims(bsdf_dims)
+{
+	const unsigned dims = light_dims + bsdf_dims;
+	m_t = SORT_MALLOC_ARRAY( float , 3 * num * dims );
+	m_uv = m_t + num * dims;
+
+	// the arena only constructs the first item of an array , the flags are cleared one by one
+	m_generated = SORT_MALLOC_ARRAY( bool , dims );
+	for( unsigned i = 0 ; i < dims ; ++i )
+		m_generated[i] = false;
+}
+
+// get the light sample of a pixel sample in a dimension
+LightSample SampleBatch::GetLightSample( unsigned id , unsigned dim )
+{
+	if( dim >= m_lightDims )
+		return LightSample( true );
+
+	_generate( dim );
+	LightSample ls;
+	ls.t = m_t[ dim * m_num + id ];
+	ls.u = m_uv[ 2 * ( dim * m_num + id ) ];
+	ls.v = m_uv[ 2 * ( dim * m_num + id ) + 1 ];
+	return ls;
+}
+
+// get the bsdf sample of a pixel sample in a dimension
+BsdfSample SampleBatch::GetBsdfSample( unsigned id , unsigned dim )
+{
+	if( dim >= m_bsdfDims )
+		return BsdfSample( true );
+
+	dim += m_lightDims;
+	_generate( dim );
+	BsdfSample bs;
+	bs.t = m_t[ dim * m_num + id ];
+	bs.u = m_uv[ 2 * ( dim * m_num + id ) ];
+	bs.v = m_uv[ 2 * ( dim * m_num + id ) + 1 ];
+	return bs;
+}
+
+// get the 1d numbers of all samples in a dimension
+const float* SampleBatch::Get1D( unsigned dim )
+{
+	if( dim >= m_lightDims + m_bsdfDims )
+		return nullptr;
+	_generate( dim );
+	return m_t + dim * m_num;
+}
+
+// get the 2d numbers of all samples in a dimension
+const float* SampleBatch::Get2D( unsigned dim )
+{
+	if( dim >= m_lightDims + m_bsdfDims )
+		return nullptr;
+	_generate( dim );
+	return m_uv + 2 * dim * m_num;
+}
+
+// generate the numbers of a dimension for the batch
+void SampleBatch::_generate( unsigned dim )
+{
+	if( m_generated[dim] )
+		return;
+	m_generated[dim] = true;
+
+	float* t = m_t + dim * m_num;
+	float* uv = m_uv + 2 * dim * m_num;
+
+	// samplers like jittered sampling only take rounded numbers of samples
+	if( m_sampler->RoundSize( m_num ) != m_num )
+	{
+		sort_canonical( t , m_num );
+		sort_canonical( uv , 2 * m_num );
+		return;
+	}
+	Sampler::SetDimension( SAMPLE_BATCH_DIMENSION + 3 * dim );
+	m_sampler->Generate1D( t , m_num );
+	m_sampler->Generate2D( uv , m_num );
+}
@@ -51,17 +51,93 @@ public:
 	// para 'sample' : the memory to save the sampled data
 	// para 'num'    : the number of samples to be generated
 	virtual void Generate2D( float* sample , unsigned num , bool accept_uniform = false ) const = 0;
+
+	// enable blue noise dithering , every dimension of a pixel is shifted toroidally by the value of a blue noise mask
+	// at the pixel , so the error of low sample counts is spread over the image as blue noise
+	void EnableBlueNoise();
+
+	// whether the samples are dithered by blue noise
+	bool IsBlueNoise() const { return m_blueNoise; }
+
+	// start generating the samples of a pixel , the dimensions of the calling thread are counted from it
+	// para 'x' , 'y' : the coordinate of the pixel
+	// para 'sample'  : the index of the first sample to be generated in the pixel
+	static void StartPixel( unsigned x , unsigned y , unsigned sample );
+
+	// continue generating the samples of the current pixel from a dimension
+	// para 'dim' : the dimension of the next generated samples
+	static void SetDimension( unsigned dim );
+
+// protected field
+protected:
+	// whether the samples are dithered by blue noise
+	bool	m_blueNoise = false;
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+// definition of dither scope
+// desc :	Samplers generate each dimension inside a scope. With blue noise dithering,
+//			the random numbers taken in the scope are shared by all pixels , so is a
+//			random toroidal shift of the dimension. Once the scope ends , the samples of
+//			each pixel are shifted by the mask at the pixel , neighbor pixels differ by
+//			the blue noise only ( Georgiev and Fajardo 2016 ). Nothing is done without it.
+class DitherScope
+{
+public:
+	// para 'sampler' : the sampler generating the samples
+	// para 'sample'  : the samples to be generated
+	// para 'num'     : the number of samples
+	// para 'dim'     : the dimension of each sample , one or two
+	DitherScope( const Sampler* sampler , float* sample , unsigned num , unsigned dim );
+	~DitherScope();
+
+private:
+	float*		m_sample = nullptr;
+	unsigned	m_num = 0;
+	unsigned	m_dim = 0;
+	float		m_shift[2];
+	unsigned	m_state[SORT_RAND_STATE_SIZE];	// the generator of the thread , it continues after the scope
+
+	DitherScope( const DitherScope& ) = delete;
+	DitherScope& operator=( const DitherScope& ) = delete;
 };
 
-// generate shuffle index
-inline const unsigned* ShuffleIndex( unsigned size )
+// permute an index with a hash , the indices of a seed form a random permutation without any memory ( Kensler 2013 )
+// para 'i'    : the index to be permuted
+// para 'size' : the number of indices
+// para 'seed' : the seed of the permutation , usually a random number picked for each pixel
+// result      : the permuted index
+inline unsigned PermuteIndex( unsigned i , unsigned size , unsigned seed )
 {
-	unsigned* shuffle = SORT_MALLOC_ARRAY( unsigned , size );
-	for( unsigned i = 0 ; i < size ; i++ )
-		shuffle[i] = i;
-	std::random_shuffle( shuffle , shuffle + size );
-	
-	return shuffle;
+	// the hash is a bijection in the smallest power of two above the size , indices out of range are hashed again
+	unsigned w = size - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+	do
+	{
+		i ^= seed;
+		i *= 0xe170893d;
+		i ^= seed >> 16;
+		i ^= ( i & w ) >> 4;
+		i ^= seed >> 8;
+		i *= 0x0929eb3f;
+		i ^= seed >> 23;
+		i ^= ( i & w ) >> 1;
+		i *= 1 | seed >> 27;
+		i *= 0x6935fa69;
+		i ^= ( i & w ) >> 11;
+		i *= 0x74dcb303;
+		i ^= ( i & w ) >> 2;
+		i *= 0x9e501cc3;
+		i ^= ( i & w ) >> 2;
+		i *= 0xc860a3df;
+		i &= w;
+		i ^= i >> 5;
+	}while( i >= size );
+	return ( i + seed ) % size;
 }
 
 #endif
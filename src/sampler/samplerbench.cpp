@@ -0,0 +1,164 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "samplerbench.h"
+#include "sampler.h"
+#include "utility/creator.h"
+#include "utility/samplemethod.h"
+#include "log/log.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+
+// the light of the lit Lambert surface , a spherical cap tilted from the normal of the surface
+static const float LIGHT_TILT = 0.5236f;        // 30 degrees
+static const float LIGHT_HALF_ANGLE = 0.3491f;  // 20 degrees
+
+// the number of samples generated in every timing
+static const unsigned TIMED_SAMPLES = 1 << 22;
+
+// the largest count whose star discrepancy is measured , it takes quadratic time
+static const unsigned DISCREPANCY_MAX_COUNT = 1024;
+
+// constructor
+SamplerBenchmark::SamplerBenchmark( unsigned max_count , unsigned trials ) : m_trials( max( trials , 1u ) )
+{
+    for( unsigned count = 16 ; count <= max_count ; count *= 4 )
+        m_counts.push_back( count );
+}
+
+// measure each sampler
+void SamplerBenchmark::Run( const std::vector<std::string>& types )
+{
+    const double exact = PI * sin( LIGHT_HALF_ANGLE ) * sin( LIGHT_HALF_ANGLE ) * cos( LIGHT_TILT );
+
+    for( const std::string& type : types ){
+        Sampler* sampler = CREATE_TYPE( type , Sampler );
+        if( sampler == nullptr ){
+            slog( WARNING , PERFORMANCE , stringFormat( "Sampler '%s' is not supported, it is skipped in the benchmark." , type.c_str() ) );
+            continue;
+        }
+
+        // the slope of the error against the sample count in log space
+        double sx = 0.0 , sy = 0.0 , sxx = 0.0 , sxy = 0.0;
+        unsigned fitted = 0;
+
+        for( const unsigned requested : m_counts ){
+            const unsigned count = sampler->RoundSize( requested );
+            const double ns_1d = timeGenerate( sampler , count , 1 );
+            const double ns_2d = timeGenerate( sampler , count , 2 );
+
+            std::vector<float> points( 2 * count );
+            double discrepancy = 0.0 , mse = 0.0;
+            unsigned measured = 0;
+            for( unsigned t = 0 ; t < m_trials ; ++t ){
+                sampler->Generate2D( &points[0] , count );
+                if( count <= DISCREPANCY_MAX_COUNT ){
+                    discrepancy += starDiscrepancy( &points[0] , count );
+                    ++measured;
+                }
+                const double error = litLambert( &points[0] , count ) - exact;
+                mse += error * error;
+            }
+            const double rmse = sqrt( mse / m_trials ) / exact;
+
+            if( measured )
+                slog( INFO , PERFORMANCE , stringFormat( "Sampler '%s' with %d samples takes %.2f ns per 1D sample and %.2f ns per 2D sample, star discrepancy %.5f, relative RMSE of the lit Lambert surface %.5f." ,
+                    type.c_str() , count , ns_1d , ns_2d , discrepancy / measured , rmse ) );
+            else
+                slog( INFO , PERFORMANCE , stringFormat( "Sampler '%s' with %d samples takes %.2f ns per 1D sample and %.2f ns per 2D sample, relative RMSE of the lit Lambert surface %.5f." ,
+                    type.c_str() , count , ns_1d , ns_2d , rmse ) );
+
+            if( rmse > 0.0 ){
+                const double x = log( (double)count ) , y = log( rmse );
+                sx += x; sy += y; sxx += x * x; sxy += x * y;
+                ++fitted;
+            }
+        }
+
+        // random sampling converges at -0.5 , stratified sampling of a discontinuous integrand at -0.75
+        const double denom = fitted * sxx - sx * sx;
+        if( fitted > 1 && denom > 0.0 )
+            slog( INFO , PERFORMANCE , stringFormat( "Sampler '%s' converges at the rate of %.3f." , type.c_str() , ( fitted * sxy - sx * sy ) / denom ) );
+
+        delete sampler;
+    }
+}
+
+// time the generation of samples
+double SamplerBenchmark::timeGenerate( const Sampler* sampler , unsigned count , unsigned dim ) const
+{
+    std::vector<float> samples( dim * count );
+    const unsigned rounds = max( TIMED_SAMPLES / count , 1u );
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    for( unsigned i = 0 ; i < rounds ; ++i ){
+        if( dim == 1 )
+            sampler->Generate1D( &samples[0] , count );
+        else
+            sampler->Generate2D( &samples[0] , count );
+    }
+    const std::chrono::duration<double,std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count() / ( (double)rounds * count );
+}
+
+// star discrepancy of a 2D point set
+double SamplerBenchmark::starDiscrepancy( const float* points , unsigned count )
+{
+    std::vector<unsigned> order( count );
+    for( unsigned i = 0 ; i < count ; ++i )
+        order[i] = i;
+    std::sort( order.begin() , order.end() , [&]( unsigned a , unsigned b ){ return points[2*a] < points[2*b]; } );
+
+    // the boxes are swept along x with the y coordinates of the points on their left kept sorted , a box holding too many
+    // points is closed and the one holding too few is open , the extreme boxes have their corners at the coordinates of points
+    std::vector<float> ys;
+    ys.reserve( count );
+    double discrepancy = 0.0;
+    const double inv = 1.0 / count;
+    for( unsigned i = 0 ; i <= count ; ){
+        const double x = ( i < count ) ? points[ 2 * order[i] ] : 1.0;
+        for( const float y : ys )
+            discrepancy = max( discrepancy , x * y - ( std::lower_bound( ys.begin() , ys.end() , y ) - ys.begin() ) * inv );
+        discrepancy = max( discrepancy , x - ys.size() * inv );
+        if( i == count )
+            break;
+
+        // the points sharing the coordinate are inside the closed box
+        for( ; i < count && points[ 2 * order[i] ] == x ; ++i )
+            ys.insert( std::upper_bound( ys.begin() , ys.end() , points[ 2 * order[i] + 1 ] ) , points[ 2 * order[i] + 1 ] );
+        for( const float y : ys )
+            discrepancy = max( discrepancy , ( std::upper_bound( ys.begin() , ys.end() , y ) - ys.begin() ) * inv - x * y );
+    }
+    return discrepancy;
+}
+
+// estimate the irradiance of the lit Lambert surface
+double SamplerBenchmark::litLambert( const float* points , unsigned count )
+{
+    const float cos_half_angle = cos( LIGHT_HALF_ANGLE );
+    const Vector light_dir( sin( LIGHT_TILT ) , cos( LIGHT_TILT ) , 0.0f );
+
+    // the pdf of cosine weighted sampling cancels the cosine factor , each direction hitting the light of unit radiance counts PI
+    unsigned hits = 0;
+    for( unsigned i = 0 ; i < count ; ++i ){
+        const Vector wi = CosSampleHemisphere( points[2*i] , points[2*i+1] );
+        if( Dot( wi , light_dir ) >= cos_half_angle )
+            ++hits;
+    }
+    return PI * hits / count;
+}
@@ -0,0 +1,69 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <vector>
+
+class Sampler;
+
+//! @brief Benchmark comparing samplers on speed and error.
+/**
+ * Changes to a sampler used to be judged by full renders. The benchmark measures each requested sampler
+ * alone instead. The time of Generate1D and Generate2D is measured at several sample counts. The quality of
+ * the 2D samples is measured in two ways. The first is the star discrepancy of the point sets. The second is
+ * the error of a lit Lambert surface. The surface is lit by a spherical light tilted from its normal, and the
+ * directions are drawn by cosine weighted sampling. Its irradiance has a closed form, so the RMSE over many
+ * trials gives the convergence rate of the sampler on an integrand with a discontinuity that is not aligned
+ * with the axes.
+ */
+class SamplerBenchmark
+{
+public:
+    //! @brief Constructor.
+    //! @param max_count    The largest number of samples per pixel tested, counts go from 16 up to it by powers of four.
+    //! @param trials       The number of trials of each count in the error measurements.
+    SamplerBenchmark( unsigned max_count , unsigned trials );
+
+    //! @brief Measure each sampler.
+    //! @param types        Type names of the samplers to be compared.
+    void Run( const std::vector<std::string>& types );
+
+private:
+    std::vector<unsigned>   m_counts;       /**< The sample counts tested. */
+    unsigned                m_trials;       /**< The number of trials of each count. */
+
+    //! @brief Time the generation of samples.
+    //! @param sampler      The sampler to be tested.
+    //! @param count        The number of samples generated at a time.
+    //! @param dim          The dimension of the samples, one or two.
+    //! @return             The time spent on each sample in nanoseconds.
+    double timeGenerate( const Sampler* sampler , unsigned count , unsigned dim ) const;
+
+    //! @brief Star discrepancy of a 2D point set, every box anchored at the origin with its corner at the coordinates of the points is checked.
+    //! @param points       The points, two numbers for each point.
+    //! @param count        The number of points.
+    //! @return             The star discrepancy.
+    static double starDiscrepancy( const float* points , unsigned count );
+
+    //! @brief Estimate the irradiance of the lit Lambert surface.
+    //! @param points       The 2D samples drawing the directions.
+    //! @param count        The number of samples.
+    //! @return             The estimation of the irradiance.
+    static double litLambert( const float* points , unsigned count );
+};
@@ -0,0 +1,53 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// include the header file
+#include "sobol.h"
+#include "lowdiscrepancy.h"
+#include "utility/sassert.h"
+
+IMPLEMENT_CREATOR( SobolSampler );
+
+// generate sample in one dimension
+void SobolSampler::Generate1D( float* sample , unsigned num , bool accept_uniform ) const
+{
+	DitherScope dither( this , sample , num , 1 );
+
+	sAssert( sample != 0 , SAMPLING );
+
+	const unsigned seed = MixBits( sort_rand() );
+	for( unsigned i = 0 ; i < num ; ++i )
+		sample[i] = FixedToCanonical( OwenScramble( ReverseBits( i ) , seed ) );
+	ShuffleSamples( sample , num , 1 );
+}
+
+// generate sample in two dimension
+void SobolSampler::Generate2D( float* sample , unsigned num , bool accept_uniform ) const
+{
+	DitherScope dither( this , sample , num , 2 );
+
+	sAssert( sample != 0 , SAMPLING );
+
+	const unsigned seed_x = MixBits( sort_rand() );
+	const unsigned seed_y = MixBits( sort_rand() );
+	for( unsigned i = 0 ; i < num ; ++i )
+	{
+		sample[2*i] = FixedToCanonical( OwenScramble( ReverseBits( i ) , seed_x ) );
+		sample[2*i+1] = FixedToCanonical( OwenScramble( SobolSecondDimension( i ) , seed_y ) );
+	}
+	ShuffleSamples( sample , num , 2 );
+}
@@ -0,0 +1,51 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#ifndef	SORT_SOBOL
+#define	SORT_SOBOL
+
+#include "sampler.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// definition of sobol sampler
+// desc :	The first two dimensions of the Sobol sequence are a (0,2)-sequence , the points of
+//			every call are Owen scrambled with a new seed , so that any number of dimensions
+//			could be drawn from it. The first 2^k points are stratified in every elementary
+//			interval of area 2^-k , the sample count doesn't need to be rounded.
+class SobolSampler : public Sampler
+{
+// public method
+public:
+	DEFINE_CREATOR( SobolSampler , Sampler , "sobol" );
+
+	// default constructor
+	SobolSampler(){}
+	// destructor
+	~SobolSampler(){}
+
+	// generate sample in one dimension
+	// para 'sample' : the memory to save the sampled data
+	// para 'num'    : the number of samples to be generated
+	virtual void Generate1D( float* sample , unsigned num , bool accept_uniform = false ) const;
+
+	// generate sample in two dimension
+	// para 'sample' : the memory to save the sampled data
+	// para 'num'    : the number of samples to be generated
+	virtual void Generate2D( float* sample , unsigned num , bool accept_uniform = false ) const;
+};
+
+#endif
@@ -19,6 +19,7 @@
 #include "stratified.h"
 #include "utility/sassert.h"
 #include "utility/rand.h"
+#include "lowdiscrepancy.h"
 #include <math.h>
 
 IMPLEMENT_CREATOR( StratifiedSampler );
@@ -26,28 +27,38 @@ IMPLEMENT_CREATOR( StratifiedSampler );
 // generate sample in one dimension
 void StratifiedSampler::Generate1D( float* sample , unsigned num , bool accept_uniform ) const
 {
+	DitherScope dither( this , sample , num , 1 );
+
 	sAssert( sample != 0 , SAMPLING );
 
+	// the jitters are generated in batch first , the strata are filled in a loop without dependency
+	sort_canonical( sample , num );
+	const float inv = 1.0f / (float)num;
 	for( unsigned i = 0 ; i < num ; ++i )
-		sample[i] = ( (float)i + sort_canonical() ) / (float)num ;
+		sample[i] = min( ( (float)i + sample[i] ) * inv , LD_ONE_MINUS_EPSILON );
 }
 
 // generate sample in two dimension
 void StratifiedSampler::Generate2D( float* sample , unsigned num , bool accept_uniform ) const
 {
+	DitherScope dither( this , sample , num , 2 );
+
 	sAssert( sample != 0 , SAMPLING );
 	
 	unsigned n = (unsigned)sqrt((float)num);
 	sAssert( n * n == num , SAMPLING );
-	unsigned dn = 2 * n;
 
+	// the jitters are generated in batch first , each row of strata is filled in a loop without dependency
+	sort_canonical( sample , 2 * num );
+	const float inv = 1.0f / (float)n;
 	for( unsigned i = 0 ; i < n ; ++i )
 	{
-		unsigned offset = dn * i;
-		for( unsigned j = 0 ; j < dn ; j+=2 )
+		float* row = sample + 2 * n * i;
+		const float y = (float)i;
+		for( unsigned j = 0 ; j < n ; ++j )
 		{
-			sample[offset+j] = ( (float)j/2 + sort_canonical() ) / (float)n ;
-			sample[offset+j+1] = ( (float)i + sort_canonical() ) / (float)n ;
+			row[2*j] = min( ( (float)j + row[2*j] ) * inv , LD_ONE_MINUS_EPSILON );
+			row[2*j+1] = min( ( y + row[2*j+1] ) * inv , LD_ONE_MINUS_EPSILON );
 		}
 	}
 }
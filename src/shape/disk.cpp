@@ -28,6 +28,18 @@ IMPLEMENT_CREATOR( Disk );
 // sample a point on shape
 Point Disk::sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n , float* pdf ) const
 {
+	// there is no exact solid angle sampling of a disk , the square bounding it is sampled instead and
+	// the points outside the disk are rejected , the directions toward the disk keep the same pdf
+	const SphericalRectangle rect = _sphericalRect( radius , radius , p );
+	if( _bySolidAngle( rect ) )
+	{
+		const Point lp = _sampleSolidAngle( rect , ls , p , wi , n , pdf );
+		const Point local = transform.invMatrix( lp );
+		if( pdf && local.x * local.x + local.z * local.z > radius * radius )
+			*pdf = 0.0f;
+		return lp;
+	}
+
 	float u , v;
 	UniformSampleDisk( ls.u , ls.v , u , v );
 
@@ -58,11 +70,18 @@ void Disk::sample_l( const LightSample& ls , Ray& r , Vector& n , float* pdf ) c
 	r.m_Ori = transform(Point( u * radius , 0.0f , v * radius ));
 	Vector wi = UniformSampleHemisphere(sort_canonical() , sort_canonical());
 	r.m_Dir = transform(wi);
-	n = transform.invMatrix.Transpose()( Vector( 0.0f , 1.0f , 0.0f ) );
+	n = transform.TransformNormal( Vector( 0.0f , 1.0f , 0.0f ) );
 
 	if( pdf ) *pdf = 1.0f / ( radius * radius * PI * TWO_PI );
 }
 
+// get the pdf of specific direction
+float Disk::Pdf( const Point& p , const Vector& wi ) const
+{
+	const SphericalRectangle rect = _sphericalRect( radius , radius , p );
+	return _bySolidAngle( rect ) ? _solidAnglePdf( rect , p , wi ) : Shape::Pdf( p , wi );
+}
+
 // the surface area of the shape
 float Disk::SurfaceArea() const
 {
@@ -86,26 +105,25 @@ float Disk::_getIntersect( const Ray& ray , Point& p , float limit , Intersectio
 	if( intersect )
 	{
 		intersect->t = t;
-		intersect->intersect = transform( p );
-		intersect->normal = transform.invMatrix.Transpose()(Vector( 0.0f , 1.0f , 0.0f ));
-		intersect->tangent = transform(Vector( 0.0f , 0.0f , 1.0f ));
-		intersect->primitive = const_cast<Disk*>(this);
+		_resolveHit( p , intersect );
 	}
 
 	return t;
 }
 
-// get the bounding box of the primitive
-const BBox&	Disk::GetBBox() const
+// get the parameters of the shape in world space
+PACKET_TYPE Disk::GetAnalyticShape( Point& center , Vector& axis0 , Vector& axis1 ) const
 {
-	if( !m_bbox )
-	{
-        m_bbox = std::unique_ptr<BBox>( new BBox() );
-		m_bbox->Union( transform( Point( radius , 0.0f , radius ) ) );
-		m_bbox->Union( transform( Point( radius , 0.0f , -radius ) ) );
-		m_bbox->Union( transform( Point( -radius , 0.0f , radius ) ) );
-		m_bbox->Union( transform( Point( -radius , 0.0f , -radius ) ) );
-	}
+	return _planarShape( PACKET_DISK , radius , radius , center , axis0 , axis1 );
+}
 
-	return *m_bbox;
+// get the bounding box of the primitive
+BBox	Disk::GetBBox() const
+{
+	BBox box;
+	box.Union( transform( Point( radius , 0.0f , radius ) ) );
+	box.Union( transform( Point( radius , 0.0f , -radius ) ) );
+	box.Union( transform( Point( -radius , 0.0f , radius ) ) );
+	box.Union( transform( Point( -radius , 0.0f , -radius ) ) );
+	return box;
 }
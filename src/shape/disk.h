@@ -45,15 +45,21 @@ public:
 	// para 'pdf'      : the properbility density function
 	void sample_l( const LightSample& ls , Ray& r , Vector& n , float* pdf ) const override;
 
+	// get the pdf of specific direction
+	float Pdf( const Point& p , const Vector& wi ) const override;
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 	// methods inheriting from Primitive ( for geometry )
 
 	// get the bounding box of the primitive
-	const BBox&	GetBBox() const override;
+	BBox	GetBBox() const override;
 
 	// the surface area of the shape
 	float SurfaceArea() const override;
 
+	// get the parameters of the shape in world space
+	PACKET_TYPE GetAnalyticShape( Point& center , Vector& axis0 , Vector& axis1 ) const override;
+
 protected:
 	// get intersected point between the ray and the shape
 	float _getIntersect( const Ray& ray , Point& p , float limit = FLT_MAX , Intersection* inter = 0 ) const override;
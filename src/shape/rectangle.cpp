@@ -25,9 +25,13 @@ IMPLEMENT_CREATOR( Rectangle );
 
 // sample a point on shape
 Point Rectangle::sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n , float* pdf ) const
-{
-    const float halfx = sizex * 0.5f;
-    const float halfy = sizey * 0.5f;
+{
+    const float halfx = sizex * 0.5f;
+    const float halfy = sizey * 0.5f;
+
+	const SphericalRectangle rect = _sphericalRect( halfx , halfy , p );
+	if( _bySolidAngle( rect ) )
+		return _sampleSolidAngle( rect , ls , p , wi , n , pdf );
     
 	float u = 2 * ls.u - 1.0f;
 	float v = 2 * ls.v - 1.0f;
@@ -60,11 +64,18 @@ void Rectangle::sample_l( const LightSample& ls , Ray& r , Vector& n , float* pd
 	r.m_fMax = FLT_MAX;
 	r.m_Ori = transform( Point( halfx * u , 0.0f , halfy * v ) );
 	r.m_Dir = transform( UniformSampleHemisphere( sort_canonical() , sort_canonical() ) );
-	n = transform.invMatrix.Transpose()( Vector( 0.0f , 1.0f , 0.0f ) );
+	n = transform.TransformNormal( Vector( 0.0f , 1.0f , 0.0f ) );
 
 	if( pdf ) *pdf = 1.0f / ( SurfaceArea() * TWO_PI );
 }
 
+// get the pdf of specific direction
+float Rectangle::Pdf( const Point& p , const Vector& wi ) const
+{
+	const SphericalRectangle rect = _sphericalRect( sizex * 0.5f , sizey * 0.5f , p );
+	return _bySolidAngle( rect ) ? _solidAnglePdf( rect , p , wi ) : Shape::Pdf( p , wi );
+}
+
 // the surface area of the shape
 float Rectangle::SurfaceArea() const
 {
@@ -92,28 +103,27 @@ float Rectangle::_getIntersect( const Ray& ray , Point& p , float limit , Inters
 	if( intersect )
 	{
 		intersect->t = t;
-		intersect->intersect = transform( p );
-		intersect->normal = transform.invMatrix.Transpose()(Vector( 0.0f , 1.0f , 0.0f ));
-		intersect->tangent = transform(Vector( 0.0f , 0.0f , 1.0f ));
-		intersect->primitive = const_cast<Rectangle*>(this);
+		_resolveHit( p , intersect );
 	}
 
 	return t;
 }
 
+// get the parameters of the shape in world space
+PACKET_TYPE Rectangle::GetAnalyticShape( Point& center , Vector& axis0 , Vector& axis1 ) const
+{
+	return _planarShape( PACKET_RECTANGLE , sizex * 0.5f , sizey * 0.5f , center , axis0 , axis1 );
+}
+
 // get the bounding box of the primitive
-const BBox&	Rectangle::GetBBox() const
-{
-    const float halfx = sizex * 0.5f;
+BBox	Rectangle::GetBBox() const
+{
+    const float halfx = sizex * 0.5f;
     const float halfy = sizey * 0.5f;
-	if( !m_bbox )
-	{
-        m_bbox = std::unique_ptr<BBox>( new BBox() );
-		m_bbox->Union( transform( Point( halfx , 0.0f , halfy ) ) );
-		m_bbox->Union( transform( Point( halfx , 0.0f , -halfy ) ) );
-		m_bbox->Union( transform( Point( -halfx , 0.0f , halfy ) ) );
-		m_bbox->Union( transform( Point( -halfx , 0.0f , -halfy ) ) );
-	}
-
-	return *m_bbox;
+	BBox box;
+	box.Union( transform( Point( halfx , 0.0f , halfy ) ) );
+	box.Union( transform( Point( halfx , 0.0f , -halfy ) ) );
+	box.Union( transform( Point( -halfx , 0.0f , halfy ) ) );
+	box.Union( transform( Point( -halfx , 0.0f , -halfy ) ) );
+	return box;
 }
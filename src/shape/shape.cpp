@@ -17,6 +17,8 @@
 
 #include "shape.h"
 #include "geometry/intersection.h"
+#include "sampler/sample.h"
+#include "utility/samplemethod.h"
 
 // get the pdf of specific direction
 float Shape::Pdf( const Point& p , const Vector& wi ) const
@@ -34,6 +36,46 @@ float Shape::Pdf( const Point& p , const Vector& wi ) const
 	return delta.SquaredLength() / ( SurfaceArea() * dot );
 }
 
+// get the cone bounding the normals of the shape
+float Shape::GetNormalBounds( Vector& axis ) const
+{
+	axis = Normalize( transform( Vector( 0.0f , 1.0f , 0.0f ) ) );
+	return 1.0f;
+}
+
+// get the rectangle bounding a planar shape seen from a point
+SphericalRectangle Shape::_sphericalRect( float halfx , float halfz , const Point& p ) const
+{
+	return SphericalRectangle( p , transform( Point( -halfx , 0.0f , -halfz ) ) , transform( Vector( 2.0f * halfx , 0.0f , 0.0f ) ) , transform( Vector( 0.0f , 0.0f , 2.0f * halfz ) ) );
+}
+
+// whether a planar shape is sampled by the solid angle of its rectangle
+bool Shape::_bySolidAngle( const SphericalRectangle& rect )
+{
+	// it also rejects the points in the plane of the shape , whose solid angle is not a number
+	return rect.SolidAngle() > 1e-3f;
+}
+
+// sample a point on a planar shape by the solid angle of its rectangle
+Point Shape::_sampleSolidAngle( const SphericalRectangle& rect , const LightSample& ls , const Point& p , Vector& wi , Vector& n , float* pdf ) const
+{
+	const Point lp = rect.Sample( ls.u , ls.v );
+	n = transform( Vector( 0.0f , 1.0f , 0.0f ) );
+	wi = Normalize( lp - p );
+
+	// only the front side emits
+	if( pdf )
+		*pdf = ( Dot( -wi , n ) > 0.0f ) ? 1.0f / rect.SolidAngle() : 0.0f;
+
+	return lp;
+}
+
+// get the pdf of a direction sampled by the solid angle of the rectangle bounding a planar shape
+float Shape::_solidAnglePdf( const SphericalRectangle& rect , const Point& p , const Vector& wi ) const
+{
+	return GetIntersect( Ray( p , wi ) , 0 ) ? 1.0f / rect.SolidAngle() : 0.0f;
+}
+
 // get intersection between the light surface and the ray
 bool Shape::GetIntersect( const Ray& ray , Intersection* intersect ) const
 {
@@ -46,3 +88,37 @@ bool Shape::GetIntersect( const Ray& ray , Intersection* intersect ) const
 
 	return true;
 }
+
+// fill the shading information of the closest hit
+void Shape::ResolveHit( const Ray& ray , Intersection* intersect ) const
+{
+	const Ray local = transform.invMatrix( ray );
+	_resolveHit( local( intersect->t ) , intersect );
+}
+
+// fill the intersection at a point of the shape
+void Shape::_resolveHit( const Point& p , Intersection* intersect ) const
+{
+	// the point is moved onto the plane of the shape , only the transformation rounds it then
+	const Point lp( p.x , 0.0f , p.z );
+	intersect->intersect = transform( lp );
+	intersect->error = transform.matrix.TransformError( lp , Vector( 0.0f , 0.0f , 0.0f ) );
+	intersect->normal = transform.TransformNormal( Vector( 0.0f , 1.0f , 0.0f ) );
+	intersect->gnormal = Normalize( intersect->normal );
+	intersect->tangent = transform( Vector( 0.0f , 0.0f , 1.0f ) );
+	intersect->primitive = const_cast<Shape*>( this );
+}
+
+// get the world space parameters of a planar shape
+PACKET_TYPE Shape::_planarShape( PACKET_TYPE type , float halfx , float halfz , Point& center , Vector& axis0 , Vector& axis1 ) const
+{
+	// degenerated shapes are never hit , they are left to their own routine
+	if( halfx <= 0.0f || halfz <= 0.0f )
+		return PACKET_GENERIC;
+
+	// the transformation is rigid , the local axes keep their lengths in world space
+	center = transform( Point( 0.0f , 0.0f , 0.0f ) );
+	axis0 = transform( Vector( 1.0f , 0.0f , 0.0f ) ) / halfx;
+	axis1 = transform( Vector( 0.0f , 0.0f , 1.0f ) ) / halfz;
+	return type;
+}
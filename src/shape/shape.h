@@ -23,6 +23,7 @@
 #include "math/vector3.h"
 
 class LightSample;
+class SphericalRectangle;
 class Ray;
 class Intersection;
 class Light;
@@ -64,8 +65,10 @@ public:
 	// get the pdf of specific direction
 	virtual float Pdf( const Point& p , const Vector& wi ) const;
 
-	// bind light
-	void	BindLight( Light* l ) { light = l; }
+	// get the cone bounding the normals of the shape , planar shapes emit around their transformed y axis
+	// para 'axis' : the axis of the cone ( output )
+	// result      : the cosine of the spread angle of the normals around the axis
+	virtual float GetNormalBounds( Vector& axis ) const;
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 	// methods inheriting from Primitive ( for geometry )
@@ -73,8 +76,11 @@ public:
 	// get intersection between the light surface and the ray
 	virtual bool GetIntersect( const Ray& ray , Intersection* intersect ) const;
 	//
+	// fill the shading information of the closest hit , accelerators testing the shape in packets only record the distance
+	virtual void ResolveHit( const Ray& ray , Intersection* intersect ) const;
+	//
 	// get the bounding box of the primitive
-	virtual const BBox&	GetBBox() const = 0;
+	virtual BBox	GetBBox() const = 0;
 	//
 	// get surface area of the primitive
 	virtual float	SurfaceArea() const = 0;
@@ -89,4 +95,34 @@ protected:
 
 	// get intersected point between the ray and the shape
 	virtual float _getIntersect( const Ray& ray , Point& p , float limit = FLT_MAX , Intersection* inter = 0 ) const = 0;
+
+	// fill the intersection at a point of the shape , planar shapes share the normal of their plane
+	// para 'p'         : the intersected point in local space
+	// para 'intersect' : the intersection to be filled
+	virtual void _resolveHit( const Point& p , Intersection* intersect ) const;
+
+	// get the world space parameters of a planar shape lying in the xz plane around the origin in local space
+	// para 'type'  : the kind of the planar shape
+	// para 'halfx' : half of the size along x
+	// para 'halfz' : half of the size along z
+	// the other parameters and the result are the same with 'GetAnalyticShape'
+	PACKET_TYPE _planarShape( PACKET_TYPE type , float halfx , float halfz , Point& center , Vector& axis0 , Vector& axis1 ) const;
+
+	// get the rectangle bounding a planar shape seen from a point , planar shapes lie in the xz plane around the origin in local space
+	// para 'halfx' : half of the size along x
+	// para 'halfz' : half of the size along z
+	// para 'p'     : the point the shape is seen from
+	SphericalRectangle _sphericalRect( float halfx , float halfz , const Point& p ) const;
+
+	// whether a planar shape is sampled by the solid angle of its rectangle , small ones are sampled by area
+	// since the solid angle loses its precision and area sampling is about as good for them
+	static bool _bySolidAngle( const SphericalRectangle& rect );
+
+	// sample a point on a planar shape by the solid angle of its rectangle
+	// para 'rect' : the rectangle bounding the shape
+	// the other parameters and the result are the same with 'sample_l'
+	Point _sampleSolidAngle( const SphericalRectangle& rect , const LightSample& ls , const Point& p , Vector& wi , Vector& n , float* pdf ) const;
+
+	// get the pdf of a direction sampled by the solid angle of the rectangle bounding a planar shape
+	float _solidAnglePdf( const SphericalRectangle& rect , const Point& p , const Vector& wi ) const;
 };
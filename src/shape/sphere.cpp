@@ -29,42 +29,59 @@ IMPLEMENT_CREATOR( Sphere );
 
 // sample a point on shape
 Point Sphere::sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n , float* pdf ) const
-{
-    sAssertMsg(false, SAMPLING, "N is not filled in Sphere::sample_l");
-    
-	Point center = transform( Point( 0.0f , 0.0f , 0.0f ) );
-	Vector delta = center - p;
-	Vector dir = Normalize( delta );
-	Vector wcx , wcy;
-	CoordinateSystem( dir , wcx , wcy );
-
-	Matrix m( 	wcx.x , dir.x , wcy.x , 0.0f ,
-				wcx.y , dir.y , wcy.y , 0.0f ,
-				wcx.z , dir.z , wcy.z , 0.0f ,
-				0.0f , 0.0f , 0.0f , 0.0f );
+{
+	// the transformation of the sphere is rigid , the radius is the same in world space
+	const Point center = transform( Point( 0.0f , 0.0f , 0.0f ) );
+	const Vector delta = center - p;
+	const float sq_dist = delta.SquaredLength();
 
-	float sq_sin_theta = radius * radius / delta.SquaredLength();
-	float cos_theta = sqrt( max( 0.0f , 1.0f - sq_sin_theta ) );
+	// points inside the sphere see all of it , it is sampled by area
+	if( sq_dist <= radius * radius )
+	{
+		const Vector local = UniformSampleSphere( ls.u , ls.v );
+		const Point lp = center + transform( local ) * radius;
+		n = transform.TransformNormal( local );
+		const Vector dlt = lp - p;
+		wi = Normalize( dlt );
+		if( pdf )
+		{
+			const float dot = AbsDot( wi , n );
+			*pdf = ( dot > 0.0f ) ? dlt.SquaredLength() / ( SurfaceArea() * dot ) : 0.0f;
+		}
+		return lp;
+	}
 
-	wi = UniformSampleCone( ls.u , ls.v , cos_theta );
-	wi = m(wi);
+	// the cone of directions toward the sphere is sampled uniformly
+	const Vector dir = delta / sqrt( sq_dist );
+	Vector wcx , wcy;
+	CoordinateSystem( dir , wcx , wcy );
+	const float cos_theta = sqrt( max( 0.0f , 1.0f - radius * radius / sq_dist ) );
+	const Vector local = UniformSampleCone( ls.u , ls.v , cos_theta );
+	wi = wcx * local.x + dir * local.y + wcy * local.z;
 
 	if( pdf ) *pdf = UniformConePdf( cos_theta );
 
-	Point _p;
-	Ray r = transform.invMatrix(Ray( p , wi ));
-	if( _getIntersect( r , _p , FLT_MAX ) < 0.0f )
-		_p = r( Dot( delta , wi ) );
-	
-	return transform(_p);
+	// the nearer intersection with the sphere , the grazing directions may miss it slightly due to precision and take the closest point instead
+	const float b = Dot( delta , wi );
+	const float t = b - sqrt( max( 0.0f , b * b - sq_dist + radius * radius ) );
+	const Point lp = p + wi * t;
+	n = Normalize( lp - center );
+
+	return lp;
 }
 
 // get pdf of specific direction
 float Sphere::Pdf( const Point& p ,  const Vector& wi ) const
 {
-	Point center;
-	float sin_theta_sq = radius * radius / ( p - center ).SquaredLength();
-	float cos_theta = sqrt( max( 0.0f , 1.0f - sin_theta_sq ) );
+	const Point center = transform( Point( 0.0f , 0.0f , 0.0f ) );
+	const Vector delta = center - p;
+	const float sq_dist = delta.SquaredLength();
+	if( sq_dist <= radius * radius )
+		return Shape::Pdf( p , wi );
+
+	const float cos_theta = sqrt( max( 0.0f , 1.0f - radius * radius / sq_dist ) );
+	if( Dot( delta , wi ) < cos_theta * sqrt( sq_dist ) )
+		return 0.0f;
 	return UniformConePdf( cos_theta );
 }
 
@@ -107,18 +124,39 @@ float Sphere::_getIntersect( const Ray& r , Point& p , float limit , Intersectio
 	if( intersect )
 	{
 		intersect->t = t;
-		Vector n = Normalize(Vector( p.x , p.y , p.z ));
-		Vector v0 , v1;
-		CoordinateSystem( n , v0 , v1 );
-		intersect->intersect = transform(p);
-		intersect->normal = transform.invMatrix.Transpose()(n);
-		intersect->tangent = transform(v0);
-		intersect->primitive = const_cast<Sphere*>(this);
+		_resolveHit( p , intersect );
 	}
 
 	return t;
 }
 
+// fill the intersection at a point of the sphere
+void Sphere::_resolveHit( const Point& p , Intersection* intersect ) const
+{
+	Vector n = Normalize(Vector( p.x , p.y , p.z ));
+	Vector v0 , v1;
+	CoordinateSystem( n , v0 , v1 );
+
+	// the point is projected back onto the sphere , it is then within a few roundings of the surface
+	const Point lp = Point( 0.0f , 0.0f , 0.0f ) + n * radius;
+	intersect->intersect = transform( lp );
+	intersect->error = transform.matrix.TransformError( lp , PointError( lp , 5 ) );
+	intersect->normal = transform.TransformNormal( n );
+	intersect->gnormal = Normalize( intersect->normal );
+	intersect->tangent = transform(v0);
+	intersect->primitive = const_cast<Sphere*>(this);
+}
+
+// get the parameters of the sphere in world space
+PACKET_TYPE Sphere::GetAnalyticShape( Point& center , Vector& axis0 , Vector& axis1 ) const
+{
+	// the transformation of the sphere is rigid , the radius is the same in world space
+	center = transform( Point( 0.0f , 0.0f , 0.0f ) );
+	axis0 = Vector( radius , radius , radius );
+	axis1 = Vector( 0.0f , 0.0f , 0.0f );
+	return PACKET_SPHERE;
+}
+
 // sample a ray from light
 void Sphere::sample_l( const LightSample& ls , Ray& r , Vector& n , float* pdf ) const
 {
@@ -129,23 +167,19 @@ void Sphere::sample_l( const LightSample& ls , Ray& r , Vector& n , float* pdf )
 	r.m_Dir = UniformSampleSphere( sort_canonical() , sort_canonical() );
 	if( Dot( r.m_Dir , Vector( r.m_Ori.x , r.m_Ori.y , r.m_Ori.z ) ) < 0.0f )
 		r.m_Dir = -r.m_Dir;
-	n = transform.invMatrix.Transpose()( Vector( normalized_dir.x , normalized_dir.y , normalized_dir.z ) );
+	n = transform.TransformNormal( Vector( normalized_dir.x , normalized_dir.y , normalized_dir.z ) );
 
 	if( pdf ) *pdf = 1.0f / ( 8.0f * PI * PI * radius * radius );
 }
 
 // get the bounding box of the primitive
-const BBox&	Sphere::GetBBox() const
+BBox	Sphere::GetBBox() const
 {
 	Point center = transform( Point( 0.0f , 0.0f , 0.0f ) );
 
-	if( !m_bbox )
-	{
-        m_bbox = std::unique_ptr<BBox>( new BBox() );
-		Vector vec_r = Vector( radius , radius , radius );
-		m_bbox->m_Min = center - vec_r ;
-		m_bbox->m_Max = center + vec_r ;
-	}
-
-	return *m_bbox;
+	BBox box;
+	Vector vec_r = Vector( radius , radius , radius );
+	box.m_Min = center - vec_r ;
+	box.m_Max = center + vec_r ;
+	return box;
 }
@@ -48,17 +48,28 @@ public:
 	// get the pdf of specific direction
 	float Pdf( const Point& p , const Vector& wi ) const override;
 
+	// get the cone bounding the normals of the shape , the sphere faces all directions
+	// para 'axis' : the axis of the cone ( output )
+	// result      : the cosine of the spread angle of the normals around the axis
+	float GetNormalBounds( Vector& axis ) const override { axis = Vector( 0.0f , 1.0f , 0.0f ); return -1.0f; }
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 	// methods inheriting from Primitive ( for geometry )
 
 	// get the bounding box of the primitive
-	const BBox&	GetBBox() const override;
+	BBox	GetBBox() const override;
 
 	// the surface area of the shape
 	float SurfaceArea() const override;
+
+	// get the parameters of the shape in world space
+	PACKET_TYPE GetAnalyticShape( Point& center , Vector& axis0 , Vector& axis1 ) const override;
     
 // private method
 private:
 	// get intersection between a ray and the sphere
 	float	_getIntersect( const Ray& ray , Point& p , float limit = FLT_MAX , Intersection* inter = 0 ) const override;
+
+	// fill the intersection at a point of the sphere
+	void	_resolveHit( const Point& p , Intersection* intersect ) const override;
 };
@@ -26,6 +26,10 @@ IMPLEMENT_CREATOR( Square );
 // sample a point on shape
 Point Square::sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n , float* pdf ) const
 {
+	const SphericalRectangle rect = _sphericalRect( radius , radius , p );
+	if( _bySolidAngle( rect ) )
+		return _sampleSolidAngle( rect , ls , p , wi , n , pdf );
+
 	float u = 2 * ls.u - 1.0f;
 	float v = 2 * ls.v - 1.0f;
 	Point lp = transform( Point( radius * u , 0.0f , radius * v ) );
@@ -54,11 +58,18 @@ void Square::sample_l( const LightSample& ls , Ray& r , Vector& n , float* pdf )
 	r.m_fMax = FLT_MAX;
 	r.m_Ori = transform( Point( radius * u , 0.0f , radius * v ) );
 	r.m_Dir = transform( UniformSampleHemisphere( sort_canonical() , sort_canonical() ) );
-	n = transform.invMatrix.Transpose()( Vector( 0.0f , 1.0f , 0.0f ) );
+	n = transform.TransformNormal( Vector( 0.0f , 1.0f , 0.0f ) );
 
 	if( pdf ) *pdf = 1.0f / ( SurfaceArea() * TWO_PI );
 }
 
+// get the pdf of specific direction
+float Square::Pdf( const Point& p , const Vector& wi ) const
+{
+	const SphericalRectangle rect = _sphericalRect( radius , radius , p );
+	return _bySolidAngle( rect ) ? _solidAnglePdf( rect , p , wi ) : Shape::Pdf( p , wi );
+}
+
 // the surface area of the shape
 float Square::SurfaceArea() const
 {
@@ -84,26 +95,25 @@ float Square::_getIntersect( const Ray& ray , Point& p , float limit , Intersect
 	if( intersect )
 	{
 		intersect->t = t;
-		intersect->intersect = transform( p );
-		intersect->normal = transform.invMatrix.Transpose()(Vector( 0.0f , 1.0f , 0.0f ));
-		intersect->tangent = transform(Vector( 0.0f , 0.0f , 1.0f ));
-		intersect->primitive = const_cast<Square*>(this);
+		_resolveHit( p , intersect );
 	}
 
 	return t;
 }
 
-// get the bounding box of the primitive
-const BBox&	Square::GetBBox() const
+// get the parameters of the shape in world space
+PACKET_TYPE Square::GetAnalyticShape( Point& center , Vector& axis0 , Vector& axis1 ) const
 {
-	if( !m_bbox )
-	{
-        m_bbox = std::unique_ptr<BBox>( new BBox() );
-		m_bbox->Union( transform( Point( radius , 0.0f , radius ) ) );
-		m_bbox->Union( transform( Point( radius , 0.0f , -radius ) ) );
-		m_bbox->Union( transform( Point( -radius , 0.0f , radius ) ) );
-		m_bbox->Union( transform( Point( -radius , 0.0f , -radius ) ) );
-	}
+	return _planarShape( PACKET_RECTANGLE , radius , radius , center , axis0 , axis1 );
+}
 
-	return *m_bbox;
+// get the bounding box of the primitive
+BBox	Square::GetBBox() const
+{
+	BBox box;
+	box.Union( transform( Point( radius , 0.0f , radius ) ) );
+	box.Union( transform( Point( radius , 0.0f , -radius ) ) );
+	box.Union( transform( Point( -radius , 0.0f , radius ) ) );
+	box.Union( transform( Point( -radius , 0.0f , -radius ) ) );
+	return box;
 }
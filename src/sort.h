@@ -35,9 +35,59 @@ using namespace std;
 	#define SORT_IN_MAC
 #endif
 
+// find the available simd instruction set
+#if defined(__SSE__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 )
+	#define SORT_SIMD_SSE
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+	#define SORT_SIMD_SSE2
+#endif
+#if defined(__SSE4_2__)
+	#define SORT_SIMD_SSE42
+#endif
+#if defined(__AVX__)
+	#define SORT_SIMD_AVX
+#endif
+#if defined(__AVX2__)
+	#define SORT_SIMD_AVX2
+#endif
+#if defined(__AVX512F__)
+	#define SORT_SIMD_AVX512
+#endif
+
 // enable debug by default
 #define	SORT_DEBUG
 
+// traversal statistics of accelerators are compiled away unless it is defined as 1
+#ifndef SORT_ACCEL_STATS
+	#define SORT_ACCEL_STATS 0
+#endif
+
+// per-material shading statistics are compiled away unless it is defined as 1
+#ifndef SORT_SHADING_STATS
+	#define SORT_SHADING_STATS 0
+#endif
+
+// zones of the profiler are compiled away unless it is defined as 1
+#ifndef SORT_PROFILER
+	#define SORT_PROFILER 0
+#endif
+
+// the final image is only denoised by Intel Open Image Denoise if it is defined as 1 , it has to be installed then
+#ifndef SORT_USE_OIDN
+	#define SORT_USE_OIDN 0
+#endif
+
+// the 'embree' accelerator is only backed by Intel Embree if it is defined as 1 , it has to be installed then
+#ifndef SORT_USE_EMBREE
+	#define SORT_USE_EMBREE 0
+#endif
+
+// streams of rays could only be traced on the GPU if it is defined as 1 , CUDA has to be installed then
+#ifndef SORT_USE_CUDA
+	#define SORT_USE_CUDA 0
+#endif
+
 #include <math.h>
 
 #if defined(_MSC_VER) && (_MSC_VER >= 1800) 
@@ -20,22 +20,6 @@
 #include "utility/define.h"
 #include "material/material_node.h"
 
-// default constructor
-RGBSpectrum::RGBSpectrum()
-{
-	m_r = 0.0f;
-	m_g = 0.0f;
-	m_b = 0.0f;
-}
-
-// constructor from three float
-RGBSpectrum::RGBSpectrum( float r , float g , float b )
-{
-	m_r = r;
-	m_g = g;
-	m_b = b;
-}
-
 // constructor from three unsigned char
 RGBSpectrum::RGBSpectrum( unsigned char r , unsigned char g , unsigned char b )
 {
@@ -44,14 +28,6 @@ RGBSpectrum::RGBSpectrum( unsigned char r , unsigned char g , unsigned char b )
 	m_b = (float)b / 255.0f;
 }
 
-// constructor from one float
-RGBSpectrum::RGBSpectrum( float g )
-{
-	m_r = g;
-	m_g = g;
-	m_b = g;
-}
-
 // constructor from one unsigned
 RGBSpectrum::RGBSpectrum( unsigned char g )
 {
@@ -60,11 +36,6 @@ RGBSpectrum::RGBSpectrum( unsigned char g )
 	m_b = m_r;
 }
 
-// destructor
-RGBSpectrum::~RGBSpectrum()
-{
-}
-
 // get the color
 unsigned int RGBSpectrum::GetColor() const
 {
@@ -85,96 +56,7 @@ void RGBSpectrum::SetColor( unsigned int color )
 	m_b = ((float)( ( color >> 0 ) & 255 )) / 255.0f;
 }
 
-// + operator
-RGBSpectrum RGBSpectrum::operator + ( const RGBSpectrum& c ) const
-{
-	float r = m_r + c.m_r;
-	float g = m_g + c.m_g;
-	float b = m_b + c.m_b;
-
-	return RGBSpectrum( r , g , b );
-}
-
-// - operator
-RGBSpectrum RGBSpectrum::operator - ( const RGBSpectrum& c ) const
-{
-	float r = m_r - c.m_r;
-	float g = m_g - c.m_g;
-	float b = m_b - c.m_b;
-
-	return RGBSpectrum( r , g , b );
-}
-
-// * operator
-RGBSpectrum RGBSpectrum::operator * ( const RGBSpectrum& c ) const
-{
-	float r = m_r * c.m_r;
-	float g = m_g * c.m_g;
-	float b = m_b * c.m_b;
-
-	return RGBSpectrum( r , g , b );
-}
-
-// / operator
-RGBSpectrum RGBSpectrum::operator / ( const RGBSpectrum& c ) const
-{
-	float r = m_r / c.m_r;
-	float g = m_g / c.m_g;
-	float b = m_b / c.m_b;
-
-	return RGBSpectrum( r , g , b );
-}
-
-// + operator
-RGBSpectrum RGBSpectrum::operator + ( float t ) const
-{
-	float r = t + m_r;
-	float g = t + m_g;
-	float b = t + m_b;
-
-	return RGBSpectrum( r , g , b );
-}
-
-// - operator
-RGBSpectrum RGBSpectrum::operator - ( float t ) const
-{
-	float r = m_r - t ;
-	float g = m_g - t ;
-	float b = m_b - t ;
-
-	return RGBSpectrum( r , g , b );
-}
-
-// + operator
-RGBSpectrum RGBSpectrum::operator * ( float t ) const
-{
-	float r = t * m_r;
-	float g = t * m_g ;
-	float b = t * m_b ;
-
-	return RGBSpectrum( r , g , b );
-}
-
-// / operator
-RGBSpectrum RGBSpectrum::operator / ( float t ) const
-{
-	float r = m_r / t;
-	float g = m_g / t;
-	float b = m_b / t;
-
-	return RGBSpectrum( r , g , b );
-}
-
-// get each component
-float RGBSpectrum::GetR() const { 
-	return m_r;
-}
-float RGBSpectrum::GetG() const { 
-	return m_g;
-}
-float RGBSpectrum::GetB() const { 
-	return m_b;
-}
+// get the maximum component
 float RGBSpectrum::GetMaxComponent() const{
     return max( m_r , max( m_b , m_g ) );
 }
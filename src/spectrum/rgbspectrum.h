@@ -28,17 +28,15 @@ class	RGBSpectrum
 // public method
 public:
 	// default constructor
-	RGBSpectrum();
+	RGBSpectrum() : m_r(0.0f) , m_g(0.0f) , m_b(0.0f) {}
 	// constructor from three float
-	RGBSpectrum( float r , float g , float b );
+	RGBSpectrum( float r , float g , float b ) : m_r(r) , m_g(g) , m_b(b) {}
 	// constructor from three unsigned char
 	RGBSpectrum( unsigned char r , unsigned char g , unsigned char b );
 	// constructor from one float
-	RGBSpectrum( float g );
+	RGBSpectrum( float g ) : m_r(g) , m_g(g) , m_b(g) {}
 	// constructor from and unsigned char
 	RGBSpectrum( unsigned char g );
-	// destructor
-	~RGBSpectrum();
 
 	// get the color
 	unsigned int GetColor() const;
@@ -49,24 +47,24 @@ public:
 		m_r = r; m_g = g ; m_b = b;
 	}
 	// get each component
-	float	GetR() const; 
-	float	GetG() const; 
-	float	GetB() const;
+	float	GetR() const { return m_r; }
+	float	GetG() const { return m_g; }
+	float	GetB() const { return m_b; }
     float   GetMaxComponent() const;
 
 	// clamp the spectrum
-	RGBSpectrum Clamp( float low = 0.0f , float high = 0.0f ) const;
+	RGBSpectrum Clamp( float low = 0.0f , float high = 1.0f ) const;
 
-	// operators
-	RGBSpectrum operator+( const RGBSpectrum& c ) const;
-	RGBSpectrum operator-( const RGBSpectrum& c ) const;
-	RGBSpectrum operator*( const RGBSpectrum& c ) const;
-	RGBSpectrum operator/( const RGBSpectrum& c ) const;
+	// operators , they are defined in the header so that the arithmetic of every bounce can be inlined
+	RGBSpectrum operator+( const RGBSpectrum& c ) const { return RGBSpectrum( m_r + c.m_r , m_g + c.m_g , m_b + c.m_b ); }
+	RGBSpectrum operator-( const RGBSpectrum& c ) const { return RGBSpectrum( m_r - c.m_r , m_g - c.m_g , m_b - c.m_b ); }
+	RGBSpectrum operator*( const RGBSpectrum& c ) const { return RGBSpectrum( m_r * c.m_r , m_g * c.m_g , m_b * c.m_b ); }
+	RGBSpectrum operator/( const RGBSpectrum& c ) const { return RGBSpectrum( m_r / c.m_r , m_g / c.m_g , m_b / c.m_b ); }
 
-	RGBSpectrum operator+( float t ) const;
-	RGBSpectrum operator-( float t ) const;
-	RGBSpectrum operator*( float t ) const;
-	RGBSpectrum operator/( float t ) const;
+	RGBSpectrum operator+( float t ) const { return RGBSpectrum( t + m_r , t + m_g , t + m_b ); }
+	RGBSpectrum operator-( float t ) const { return RGBSpectrum( m_r - t , m_g - t , m_b - t ); }
+	RGBSpectrum operator*( float t ) const { return RGBSpectrum( t * m_r , t * m_g , t * m_b ); }
+	RGBSpectrum operator/( float t ) const { return RGBSpectrum( m_r / t , m_g / t , m_b / t ); }
 
 	RGBSpectrum& operator+= ( const RGBSpectrum& c ) { *this = *this + c ; return *this; }
 	RGBSpectrum& operator-= ( const RGBSpectrum& c ) { *this = *this - c ; return *this; }
@@ -125,6 +123,11 @@ inline RGBSpectrum operator*( float t , const RGBSpectrum& s )
 {
 	return s * t;
 }
+// the exponential of each component
+inline RGBSpectrum Exp( const RGBSpectrum& s )
+{
+	return RGBSpectrum( expf( s.GetR() ) , expf( s.GetG() ) , expf( s.GetB() ) );
+}
 
 #endif
 
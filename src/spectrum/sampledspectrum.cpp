@@ -0,0 +1,97 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "sampledspectrum.h"
+
+// number of samples of the basis spectra in the paper , they are evenly spaced over the range
+static const unsigned SMITS_BIN_CNT = 10;
+
+// the basis spectra of Smits
+static const float SMITS_BASIS[SPECTRAL_BASIS_CNT][SMITS_BIN_CNT] = {
+    { 1.0000f , 1.0000f , 0.9999f , 0.9993f , 0.9992f , 0.9998f , 1.0000f , 1.0000f , 1.0000f , 1.0000f } ,  // white
+    { 0.9710f , 0.9426f , 1.0007f , 1.0007f , 1.0007f , 1.0007f , 0.1564f , 0.0000f , 0.0000f , 0.0000f } ,  // cyan
+    { 1.0000f , 1.0000f , 0.9685f , 0.2229f , 0.0000f , 0.0458f , 0.8369f , 1.0000f , 1.0000f , 0.9959f } ,  // magenta
+    { 0.0001f , 0.0000f , 0.1088f , 0.6651f , 1.0000f , 1.0000f , 0.9996f , 0.9586f , 0.9685f , 0.9840f } ,  // yellow
+    { 0.1012f , 0.0515f , 0.0000f , 0.0000f , 0.0000f , 0.0000f , 0.8325f , 1.0149f , 1.0149f , 1.0149f } ,  // red
+    { 0.0000f , 0.0000f , 0.0273f , 0.7937f , 1.0000f , 0.9418f , 0.1719f , 0.0000f , 0.0000f , 0.0025f } ,  // green
+    { 1.0000f , 1.0000f , 0.8916f , 0.3323f , 0.0000f , 0.0000f , 0.0003f , 0.0369f , 0.0483f , 0.0496f } ,  // blue
+};
+
+// piecewise gaussian of the analytic color matching functions
+static double cmfLobe( double lambda , double mu , double sigma0 , double sigma1 )
+{
+    const double t = ( lambda - mu ) / ( lambda < mu ? sigma0 : sigma1 );
+    return exp( -0.5 * t * t );
+}
+
+// the tables , they are built before main is entered
+struct Spectral_Tables
+{
+    float   basis[SPECTRAL_BASIS_CNT][SPECTRAL_TABLE_SIZE];
+    float   response[3][SPECTRAL_TABLE_SIZE];
+
+    Spectral_Tables(){
+        // the basis spectra are linearly interpolated between the bins
+        for( unsigned i = 0 ; i < SPECTRAL_TABLE_SIZE ; ++i ){
+            const float x = (float)i / ( SPECTRAL_TABLE_SIZE - 1 ) * ( SMITS_BIN_CNT - 1 );
+            const unsigned bin = min( (unsigned)x , SMITS_BIN_CNT - 2 );
+            const float t = x - bin;
+            for( unsigned k = 0 ; k < SPECTRAL_BASIS_CNT ; ++k )
+                basis[k][i] = SMITS_BASIS[k][bin] * ( 1.0f - t ) + SMITS_BASIS[k][bin+1] * t;
+        }
+
+        // the xyz color matching functions are converted to linear sRGB
+        const double xyz_to_rgb[3][3] = {
+            {  3.2404542 , -1.5371385 , -0.4985314 } ,
+            { -0.9692660 ,  1.8760108 ,  0.0415560 } ,
+            {  0.0556434 , -0.2040259 ,  1.0572252 } ,
+        };
+        double rgb[3][SPECTRAL_TABLE_SIZE];
+        double sum[3] = { 0.0 , 0.0 , 0.0 };
+        for( unsigned i = 0 ; i < SPECTRAL_TABLE_SIZE ; ++i ){
+            const double l = SPECTRAL_LAMBDA_MIN + i;
+            const double xyz[3] = {
+                1.056 * cmfLobe( l , 599.8 , 37.9 , 31.0 ) + 0.362 * cmfLobe( l , 442.0 , 16.0 , 26.7 ) - 0.065 * cmfLobe( l , 501.1 , 20.4 , 26.2 ) ,
+                0.821 * cmfLobe( l , 568.8 , 46.9 , 40.5 ) + 0.286 * cmfLobe( l , 530.9 , 16.3 , 31.1 ) ,
+                1.217 * cmfLobe( l , 437.0 , 11.8 , 36.0 ) + 0.681 * cmfLobe( l , 459.0 , 26.0 , 13.8 ) ,
+            };
+            for( unsigned c = 0 ; c < 3 ; ++c ){
+                rgb[c][i] = xyz_to_rgb[c][0] * xyz[0] + xyz_to_rgb[c][1] * xyz[1] + xyz_to_rgb[c][2] * xyz[2];
+                sum[c] += rgb[c][i];
+            }
+        }
+
+        // a constant spectrum of one averages to one in each channel
+        for( unsigned c = 0 ; c < 3 ; ++c )
+            for( unsigned i = 0 ; i < SPECTRAL_TABLE_SIZE ; ++i )
+                response[c][i] = (float)( rgb[c][i] * SPECTRAL_TABLE_SIZE / sum[c] );
+    }
+};
+static const Spectral_Tables g_spectralTables;
+
+// the table of a basis spectrum
+const float* SpectralTables::Basis( SPECTRAL_BASIS basis )
+{
+    return g_spectralTables.basis[basis];
+}
+
+// the table of the response of a color channel
+const float* SpectralTables::Response( unsigned channel )
+{
+    return g_spectralTables.response[channel];
+}
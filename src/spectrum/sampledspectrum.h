@@ -0,0 +1,167 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "spectrum.h"
+#include "math/simd/simd.h"
+
+static const float      SPECTRAL_LAMBDA_MIN = 380.0f;   /**< The shortest wavelength sampled by paths in nanometers. */
+static const float      SPECTRAL_LAMBDA_MAX = 720.0f;   /**< The longest wavelength sampled by paths in nanometers. */
+static const unsigned   SPECTRAL_TABLE_SIZE = 341;      /**< Number of entries of the spectral tables , one per nanometer. */
+
+//! @brief The basis spectra that rgb values are upsampled with.
+enum SPECTRAL_BASIS
+{
+    SPECTRAL_BASIS_WHITE = 0,
+    SPECTRAL_BASIS_CYAN,
+    SPECTRAL_BASIS_MAGENTA,
+    SPECTRAL_BASIS_YELLOW,
+    SPECTRAL_BASIS_RED,
+    SPECTRAL_BASIS_GREEN,
+    SPECTRAL_BASIS_BLUE,
+    SPECTRAL_BASIS_CNT
+};
+
+//! @brief Tables of the basis spectra and of the rgb response of each wavelength.
+/**
+ * The basis spectra are the ones of "An RGB to Spectrum Conversion for Reflectances" by Brian Smits,
+ * an rgb value is a positive combination of white and up to two of the others. The rgb response is the
+ * CIE 1931 observer fitted by Wyman et al. in "Simple Analytic Approximations to the CIE XYZ Color Matching
+ * Functions" , converted to linear sRGB and normalized so that a constant spectrum of one is white. Both are
+ * built at startup with one entry per nanometer.
+ */
+class SpectralTables
+{
+public:
+    //! @brief The table of a basis spectrum.
+    static const float* Basis( SPECTRAL_BASIS basis );
+
+    //! @brief The table of the response of a color channel , 0 for red , 1 for green and 2 for blue.
+    //!
+    //! The response is scaled by the wavelength range so that a spectrum sampled at uniform wavelengths is
+    //! converted to rgb by averaging its values weighted by the response.
+    static const float* Response( unsigned channel );
+};
+
+//! @brief The wavelengths carried by one path.
+//!
+//! With hero wavelength sampling only the first wavelength is sampled, the others are spread over the
+//! range at equal distances from it so that all of them share the same uniform pdf. Please refer to
+//! "Hero Wavelength Spectral Sampling" by Wilkie et al. for further details.
+template<int N>
+struct SampledWavelengths
+{
+    vfloat<N>   lambda;     /**< The wavelengths in nanometers. */
+    vint<N>     index;      /**< The entry of each wavelength in the spectral tables. */
+
+    //! @brief Sample the wavelengths of a path.
+    //! @param u    A canonical random number picking the hero wavelength.
+    static SampledWavelengths SampleHero( float u ){
+        const float range = SPECTRAL_LAMBDA_MAX - SPECTRAL_LAMBDA_MIN;
+        float l[N];
+        int i[N];
+        for( int k = 0 ; k < N ; ++k ){
+            float offset = ( u + (float)k / N ) * range;
+            if( offset >= range )
+                offset -= range;
+            l[k] = SPECTRAL_LAMBDA_MIN + offset;
+            i[k] = min( (int)( offset + 0.5f ) , (int)SPECTRAL_TABLE_SIZE - 1 );
+        }
+        SampledWavelengths wl;
+        wl.lambda = vfloat<N>::Load( l );
+        wl.index = vint<N>::Load( i );
+        return wl;
+    }
+};
+
+//! @brief Spectrum sampled at the wavelengths of a path, all of them are in one SIMD register.
+template<int N>
+class SampledSpectrum
+{
+public:
+    SampledSpectrum() : m_v( 0.0f ) {}
+    SampledSpectrum( float s ) : m_v( s ) {}
+    SampledSpectrum( const vfloat<N>& v ) : m_v( v ) {}
+
+    SampledSpectrum operator+( const SampledSpectrum& s ) const { return m_v + s.m_v; }
+    SampledSpectrum operator-( const SampledSpectrum& s ) const { return m_v - s.m_v; }
+    SampledSpectrum operator*( const SampledSpectrum& s ) const { return m_v * s.m_v; }
+    SampledSpectrum operator/( const SampledSpectrum& s ) const { return m_v / s.m_v; }
+    SampledSpectrum operator*( float t ) const { return m_v * vfloat<N>( t ); }
+    SampledSpectrum operator/( float t ) const { return m_v / vfloat<N>( t ); }
+
+    SampledSpectrum& operator+=( const SampledSpectrum& s ){ m_v = m_v + s.m_v; return *this; }
+    SampledSpectrum& operator*=( const SampledSpectrum& s ){ m_v = m_v * s.m_v; return *this; }
+    SampledSpectrum& operator*=( float t ){ m_v = m_v * vfloat<N>( t ); return *this; }
+    SampledSpectrum& operator/=( float t ){ m_v = m_v / vfloat<N>( t ); return *this; }
+
+    //! Whether the spectrum is zero at all wavelengths.
+    bool IsBlack() const { return None( m_v > vfloat<N>( 0.0f ) ); }
+    //! The largest value among the wavelengths.
+    float GetMaxComponent() const { return ReduceMax( m_v ); }
+    //! The values at the wavelengths.
+    const vfloat<N>& GetValues() const { return m_v; }
+
+private:
+    vfloat<N>   m_v;
+};
+
+//! @brief Upsample an rgb value at the wavelengths of a path.
+//!
+//! The spectrum is linear in the rgb value, so reflectances and emitted radiance are upsampled the same way.
+template<int N>
+inline SampledSpectrum<N> UpsampleRGB( const Spectrum& rgb , const SampledWavelengths<N>& wl )
+{
+    const float r = rgb.GetR() , g = rgb.GetG() , b = rgb.GetB();
+    float w , c0 , c1;
+    SPECTRAL_BASIS b0 , b1;
+    if( r <= g && r <= b ){
+        w = r;
+        if( g <= b ){ b0 = SPECTRAL_BASIS_CYAN; c0 = g - r; b1 = SPECTRAL_BASIS_BLUE; c1 = b - g; }
+        else{ b0 = SPECTRAL_BASIS_CYAN; c0 = b - r; b1 = SPECTRAL_BASIS_GREEN; c1 = g - b; }
+    }else if( g <= r && g <= b ){
+        w = g;
+        if( r <= b ){ b0 = SPECTRAL_BASIS_MAGENTA; c0 = r - g; b1 = SPECTRAL_BASIS_BLUE; c1 = b - r; }
+        else{ b0 = SPECTRAL_BASIS_MAGENTA; c0 = b - g; b1 = SPECTRAL_BASIS_RED; c1 = r - b; }
+    }else{
+        w = b;
+        if( r <= g ){ b0 = SPECTRAL_BASIS_YELLOW; c0 = r - b; b1 = SPECTRAL_BASIS_GREEN; c1 = g - r; }
+        else{ b0 = SPECTRAL_BASIS_YELLOW; c0 = g - b; b1 = SPECTRAL_BASIS_RED; c1 = r - g; }
+    }
+
+    vfloat<N> v = Gather( SpectralTables::Basis( SPECTRAL_BASIS_WHITE ) , wl.index ) * vfloat<N>( w );
+    if( c0 > 0.0f )
+        v = v + Gather( SpectralTables::Basis( b0 ) , wl.index ) * vfloat<N>( c0 );
+    if( c1 > 0.0f )
+        v = v + Gather( SpectralTables::Basis( b1 ) , wl.index ) * vfloat<N>( c1 );
+    return v;
+}
+
+//! @brief Convert a spectrum sampled at the wavelengths of a path to rgb.
+//!
+//! It is an unbiased estimate of the rgb value of the full spectrum since the wavelengths are uniformly sampled.
+template<int N>
+inline Spectrum ToRGB( const SampledSpectrum<N>& s , const SampledWavelengths<N>& wl )
+{
+    const vfloat<N>& v = s.GetValues();
+    const float r = ReduceAdd( v * Gather( SpectralTables::Response( 0 ) , wl.index ) );
+    const float g = ReduceAdd( v * Gather( SpectralTables::Response( 1 ) , wl.index ) );
+    const float b = ReduceAdd( v * Gather( SpectralTables::Response( 2 ) , wl.index ) );
+    return Spectrum( r , g , b ) / (float)N;
+}
@@ -28,6 +28,7 @@
 #include "utility/creator.h"
 #include "sampler/sampler.h"
 #include "utility/multithread/multithread.h"
+#include "utility/multithread/renderkernel.h"
 #include <ImfHeader.h>
 #include "utility/strhelper.h"
 #include "camera/camera.h"
@@ -35,13 +36,37 @@
 #include "sampler/stratified.h"
 #include <time.h>
 #include "managers/smmanager.h"
+#include "imagesensor/tilering.h"
+#include "imagesensor/memoryimage.h"
 #include "math/vector2.h"
 #include "geometry/sky/sky.h"
 #include "shape/shape.h"
+#include "accel/accelbench.h"
+#include "accel/accelstats.h"
+#include "material/shadingstats.h"
+#include <sstream>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include "utility/checkpoint.h"
+#include "utility/rand.h"
+#include "accel/accelcache.h"
+#include "utility/memstats.h"
+#include "utility/hugepage.h"
+#include "utility/fileprefetch.h"
+#include "utility/profiler.h"
+#include "utility/xmlbinary.h"
+#include "utility/telemetry.h"
+#include "utility/statsreport.h"
+#include "utility/spacefilling.h"
 
 extern bool g_bBlenderMode;
 extern int  g_iTileSize;
 
+// the global system , it is defined here so that applications embedding the renderer get it without the executable
+System g_System;
+
 // constructor
 System::System()
 {
@@ -55,9 +80,47 @@ void System::_preInit()
 	m_camera = 0;
 	m_uRenderingTime = 0;
 	m_uPreProcessingTime = 0;
+	m_uLoadingTime = 0;
 	m_thread_num = 1;
+	m_threadAffinity = THREAD_AFFINITY_NONE;
+	m_tileSize = g_iTileSize;
+	m_tileSplitSize = 0;
+	m_tileStarvation = 0;
+	m_tileOrder = TILE_ORDER_SPIRAL;
+	m_tileFocus = Vector2f( 0.5f , 0.5f );
+	m_pixelOrder = PIXEL_ORDER_SCANLINE;
+	m_adaptiveThreshold = 0.0f;
+	m_adaptiveBatch = 0;
+	m_sampleCnt = 0;
+	m_progressive = false;
+	m_passSamples = 1;
+	m_previewLevels = 0;
+	m_timeBudget = 0;
+	m_noiseThreshold = 0.0f;
+	m_samplesDone = 0;
+	m_sampleFirst = 0;
+	m_partial = false;
+	m_usePrimaryRaster = false;
+	m_primaryCachePattern = 0;
+	m_primaryCacheMemory = 256;
+	m_primaryCacheShadows = false;
+	m_checkpointInterval = 600000;
+	m_telemetryInterval = 1000;
+	m_renderStart = 0;
+	m_lastTelemetry = 0;
+	m_checkpointKey = 0;
+	m_lastCheckpoint = 0;
+	m_totalTask = 0;
+	m_taskDone = 0;
+	m_farmPort = 0;
+	m_farmHalfPixels = false;
+	m_farmEnabled = false;
+	m_farmView = -1;
+	m_farmPass = -1;
 	m_pProgress = 0;
     m_imagesensor = 0;
+	m_viewIndex = 0;
+	m_outputBuffer = 0;
 }
 
 // render the image
@@ -69,15 +132,54 @@ void System::Render()
 	// set timer before rendering
 	Timer::GetSingleton().StartTimer();
 
-	// push rendering task
-	_pushRenderTask();
-	// execute rendering tasks
-	_executeRenderingTasks();
+	// workers of the render farm connect at any time while the views are rendered
+	if( m_farmPort > 0 )
+	{
+		m_farm.reset( new FarmCoordinator() );
+		if( !m_farm->Start( m_farmPort , _farmKey() , m_farmHalfPixels ) )
+			m_farm.reset();
+	}
+
+	// execute rendering tasks of all views , the scene is only pre-processed once for them
+	for( unsigned i = 0 ; i < m_views.size() && !RenderControl::GetSingleton().IsCancelled() ; ++i )
+	{
+		m_viewIndex = i;
+		m_camera = m_views[i].camera;
+		m_imagesensor = m_views[i].imagesensor;
+		if( m_views.size() > 1 )
+			slog( INFO , GENERAL , stringFormat( "Rendering view %d of %d." , i + 1 , (int)m_views.size() ) );
+		_executeRenderingTasks();
+	}
+
+	if( m_farm )
+	{
+		m_farm->Stop();
+		m_farm.reset();
+	}
 	
 	// stop timer
 	m_uRenderingTime = Timer::GetSingleton().StopTimer();
 }
 
+// compare acceleration structures instead of rendering
+void System::BenchmarkAccelerators( const string& types , unsigned ray_num )
+{
+	// the accelerator in the scene file generates the ray sets
+	PreProcess();
+	if( m_imagesensor == 0 || m_camera == 0 )
+		return;
+
+	vector<string> accels;
+	std::istringstream stream( types );
+	string type;
+	while( std::getline( stream , type , ',' ) )
+		if( !type.empty() )
+			accels.push_back( type );
+
+	AccelBenchmark benchmark( m_Scene , m_camera , m_imagesensor->GetWidth() , m_imagesensor->GetHeight() , ray_num );
+	benchmark.Run( accels );
+}
+
 // load the scene
 bool System::LoadScene( const string& filename )
 {
@@ -103,7 +205,10 @@ void System::PreProcess()
 	}
 
 	// preprocess scene
-	m_Scene.PreProcess();
+	{
+		SORT_PROFILE( "System::PreProcess" );
+		m_Scene.PreProcess();
+	}
 
 	// stop timer
 	Timer::GetSingleton().StopTimer();
@@ -121,13 +226,7 @@ unsigned System::GetRenderingTime() const
 // output progress
 void System::_outputProgress()
 {
-	// get the number of tasks done
-	unsigned taskDone = 0;
-	for( unsigned i = 0; i < m_totalTask; ++i )
-		taskDone += m_taskDone[i];
-
-	// output progress
-	unsigned progress = (unsigned)( (float)(taskDone) / (float)m_totalTask * 100 );
+	unsigned progress = (unsigned)( _progress() * 100 );
 
 	if (!g_bBlenderMode)
 		cout<< progress<<"\rProgress: ";
@@ -137,6 +236,61 @@ void System::_outputProgress()
     cout<<endl;
 }
 
+// get the finished part of the rendering
+float System::_progress() const
+{
+	// get the number of tasks done
+	unsigned taskDone = 0;
+	for( unsigned i = 0; i < m_totalTask; ++i )
+		taskDone += m_taskDone[i];
+
+	// passes of progressive rendering count by their samples
+	float done = (float)(taskDone) / (float)max( 1u , m_totalTask );
+	if( m_progressive )
+		done = min( 1.0f , ( m_samplesDone - m_sampleFirst + done * m_passSamples ) / (float)m_iSamplePerPixel );
+	return done;
+}
+
+// update the live progress and throughput
+void System::_publishTelemetry( bool force )
+{
+	if( !force && Timer::GetSingleton().GetRunningTime() - m_lastTelemetry < m_telemetryInterval )
+		return;
+	std::unique_lock<std::mutex> lock( m_telemetryMutex , std::try_to_lock );
+	if( !lock.owns_lock() )
+		return;
+	const unsigned long now = Timer::GetSingleton().GetRunningTime();
+	if( !force && now - m_lastTelemetry < m_telemetryInterval )
+		return;
+	m_lastTelemetry = now;
+
+	// the time left is the measured cost of the finished tasks spread over the work left
+	const float done = _progress();
+	const double seconds = ( now - m_renderStart ) / 1000.0;
+	const ThreadThroughput total = RenderTelemetry::GetTotal();
+	const double eta = ( done > 0.0f ) ? total.busy / max( 1u , RenderTelemetry::GetThreadCount() ) * ( 1.0 - done ) / done : -1.0;
+
+	if( !g_bBlenderMode ){
+		const double s = max( seconds , 1e-3 );
+		const unsigned eta_s = ( eta >= 0.0 ) ? (unsigned)( eta + 0.5 ) : 0;
+		cout << stringFormat( "Progress: %d%% , %.2f M samples/s , %.2f M rays/s , %.1f tiles/s , ETA %02d:%02d:%02d   \r" ,
+			(int)( done * 100 ) , total.samples / s * 1e-6 , total.rays / s * 1e-6 , total.tasks / s , eta_s / 3600 , eta_s / 60 % 60 , eta_s % 60 ) << flush;
+	}else if( m_pProgress )
+		*m_pProgress = (char)( done * 100 );
+
+	if( !m_telemetryFile.empty() )
+		RenderTelemetry::WriteFile( m_telemetryFile , done , seconds , eta );
+}
+
+// called by the render thread finishing a task
+void System::_taskFinished()
+{
+	// tiles are checkpointed while rendering , passes of progressive rendering are checkpointed between passes
+	if( !m_checkpointFile.empty() && !m_progressive )
+		_checkpointTick();
+	_publishTelemetry( false );
+}
+
 // output log information
 void System::OutputLog() const
 {
@@ -145,6 +299,46 @@ void System::OutputLog() const
     
     slog( INFO , PERFORMANCE , stringFormat( "Time spent on pre-processing %d ms. Time spent on rendering %d ms" , m_uPreProcessingTime , m_uRenderingTime ) );
     slog( INFO , PERFORMANCE , stringFormat( "Rendering time : %fs." , GetRenderingTime()/1000.0f ) );
+    MemManager::GetSingleton().OutputLog();
+    TexManager::GetSingleton().OutputLog();
+    MemoryStats::OutputLog();
+    HugePages::OutputLog();
+    FilePrefetch::OutputLog();
+    SMManager::GetSingleton().OutputLog();
+    RenderTelemetry::OutputLog( ( m_uRenderingTime - m_renderStart ) / 1000.0 );
+    if( !m_memoryReportFile.empty() )
+        MemoryStats::WriteJson( m_memoryReportFile );
+    if( !m_statsFile.empty() )
+        _writeStats();
+#if SORT_PROFILER
+    Profiler::OutputLog();
+    if( !m_profileFile.empty() )
+        Profiler::Export( m_profileFile );
+#endif
+}
+
+// write the statistics of all subsystems , they are the numbers of the log in one document
+void System::_writeStats() const
+{
+    StatsReport report;
+    const double seconds = ( m_uRenderingTime - m_renderStart ) / 1000.0;
+    report.Group( "render" ).Add( "integrator" , m_integratorType ).Add( "spp" , m_iSamplePerPixel ).Add( "views" , (unsigned)m_views.size() )
+        .Add( "width" , m_imagesensor ? m_imagesensor->GetWidth() : 0u ).Add( "height" , m_imagesensor ? m_imagesensor->GetHeight() : 0u )
+        .Add( "threads" , m_thread_num ).Add( "progressive" , m_progressive ).Add( "cancelled" , RenderControl::GetSingleton().IsCancelled() );
+    report.Group( "timing" ).Add( "load_ms" , m_uLoadingTime ).Add( "preprocess_ms" , m_uPreProcessingTime ).Add( "render_ms" , m_uRenderingTime );
+    m_Scene.CollectStats( report );
+    report.Group( "integrator" ) = m_integratorStats;
+
+    // the shadow rays are the ones not extending any path
+    const ThreadThroughput total = RenderTelemetry::GetTotal();
+    const double samples = (double)max( total.samples , 1ull );
+    report.Group( "rays" ).Add( "samples" , total.samples ).Add( "rays" , total.rays ).Add( "path_rays" , total.pathRays )
+        .Add( "shadow_rays" , total.rays - min( total.rays , total.pathRays ) ).Add( "rays_per_sample" , total.rays / samples )
+        .Add( "path_rays_per_sample" , total.pathRays / samples ).Add( "mrays_per_s" , total.rays / max( seconds , 1e-3 ) * 1e-6 );
+    RenderTelemetry::CollectStats( report , seconds );
+    MemoryStats::CollectStats( report.Group( "memory" ) );
+    TexManager::GetSingleton().CollectStats( report.Group( "textures" ) );
+    report.Write( m_statsFile );
 }
 
 // uninitialize 3rd party library
@@ -153,26 +347,124 @@ void System::_uninit3rdParty()
 	Imf::staticUninitialize();
 }
 
+// release the scene
+void System::_releaseScene()
+{
+	m_Scene.Release();
+	MatManager::GetSingleton().Release();
+	MeshManager::GetSingleton().Release();
+}
+
+// get the name of a file of the frame
+string System::_frameName( const string& str ) const
+{
+	return m_frame < 0 ? str : FrameName( str , m_frame );
+}
+
+// read the files of a frame ahead
+void System::PrefetchFrame( const char* str , int frame )
+{
+	const string full_name = GetFullPath( FrameName( str , frame ) );
+	TiXmlDocument doc( full_name.c_str() );
+	if( !XmlBinary::Load( doc ) || doc.RootElement() == nullptr )
+		return;
+	const TiXmlElement* element = doc.RootElement()->FirstChildElement( "Scene" );
+	if( element == 0 || element->Attribute( "value" ) == 0 )
+		return;
+	m_Scene.Prefetch( GetFullPath( FrameName( element->Attribute( "value" ) , frame ) ) );
+}
+
+// release the cameras and the image sensors of all views
+void System::_releaseViews()
+{
+    for( RenderView& view : m_views )
+    {
+        delete view.imagesensor;
+        delete view.camera;
+    }
+    m_views.clear();
+    m_imagesensor = 0;
+    m_camera = 0;
+}
+
+// release the states of the rendering
+void System::Reset( bool keep_scene )
+{
+    if( !keep_scene )
+        _releaseScene();
+    _releaseViews();
+    SAFE_DELETE(m_pSampler);
+    SAFE_DELETE(m_kernel);
+    SAFE_DELETE_ARRAY(m_taskDone);
+
+    // the shared memory is created again with the size of the next image
+    RenderControl::GetSingleton().SetControlByte( nullptr );
+    RenderControl::GetSingleton().Reset();
+    SMManager::GetSingleton().ReleaseSharedMemory("SORTBLEND_SHAREMEM");
+
+    m_integratorProperty.clear();
+    m_checkpointFile.clear();
+    m_checkpointParams.clear();
+    m_memoryReportFile.clear();
+    m_profileFile.clear();
+#if SORT_PROFILER
+    Profiler::EnableCounters( false );
+#endif
+    m_telemetryFile.clear();
+    m_resumedTasks.clear();
+    sort_set_deterministic( false );
+    sort_set_seed( 0 );
+
+    _preInit();
+}
+
 // uninitialize
 void System::Uninit()
 {
     // relase the memory
-    m_Scene.Release();
+    _releaseScene();
 
     // delete the data
-    SAFE_DELETE(m_imagesensor);
-    SAFE_DELETE(m_camera);
+    _releaseViews();
     SAFE_DELETE(m_pSampler);
+    SAFE_DELETE(m_kernel);
     SAFE_DELETE_ARRAY(m_taskDone);
 
+    // stop the worker threads of the thread pool
+    ThreadPool::GetSingleton().Release();
+
 	_uninit3rdParty();
 }
 
+// find the first hits of the camera rays by the raster pass or keep them across passes
+void System::_preparePrimaryHits( const Integrator* integrator )
+{
+	// the first hits of the camera rays are found by the raster pass if the integrator starts its paths from them
+	m_primaryRaster.Release();
+	if( m_usePrimaryRaster && integrator->AcceptsPrimaryHits() )
+	{
+		SORT_PROFILE( "PrimaryRaster::Build" );
+		if( m_primaryRaster.Build( m_Scene , m_camera , m_imagesensor->GetWidth() , m_imagesensor->GetHeight() ) )
+			m_primaryRaster.OutputLog();
+		else
+			slog( WARNING , GENERAL , "The raster pass needs a pinhole perspective camera and a static scene , camera rays are traced instead." );
+	}
+
+	// the camera rays only repeat in the passes of progressive rendering , the records of the previous rendering are kept if they match
+	const bool primary_cache = m_primaryCachePattern > 0 && integrator->AcceptsPrimaryHits();
+	if( primary_cache && !m_progressive )
+		slog( WARNING , GENERAL , "The primary cache is only used in progressive rendering , it is disabled." );
+	if( !primary_cache || !m_progressive )
+		m_primaryCache.Release();
+	else if( !m_primaryCache.Build( m_Scene , m_camera , m_imagesensor->GetWidth() , m_imagesensor->GetHeight() , m_primaryCachePattern , m_primaryCacheMemory , m_primaryCacheShadows ) )
+		slog( WARNING , GENERAL , "The primary cache needs a camera without DOF , a static scene and the memory of one point per pixel , it is disabled." );
+}
+
 // push rendering task
-void System::_pushRenderTask()
+void System::_pushRenderTask( unsigned spp , unsigned stride , unsigned covered )
 {
 	// Push render task into the queue
-	unsigned tilesize = g_iTileSize;
+	unsigned tilesize = _pickTileSize();
 	unsigned taskid = 0;
 	
 	// get the number of total task
@@ -180,55 +472,145 @@ void System::_pushRenderTask()
 	for( unsigned i = 0 ; i < m_imagesensor->GetHeight() ; i += tilesize )
 		for( unsigned j = 0 ; j < m_imagesensor->GetWidth() ; j += tilesize )
 			++m_totalTask;
+	SAFE_DELETE_ARRAY(m_taskDone);
 	m_taskDone = new bool[m_totalTask];
 	memset( m_taskDone , 0 , m_totalTask * sizeof(bool) );
 
-	RenderTask rt(m_Scene,m_pSampler,m_camera,m_taskDone,m_iSamplePerPixel);
+	RenderTask rt(m_Scene,m_pSampler,m_camera,m_taskDone,spp);
+	rt.adaptiveThreshold = m_adaptiveThreshold;
+	rt.adaptiveBatch = m_adaptiveBatch;
+	rt.sampleOffset = m_samplesDone;
+	rt.pixelOrder = m_pixelOrder;
+	rt.kernel = m_kernel;
+	rt.previewStride = stride;
+	rt.previewCovered = covered;
+	rt.primaryRaster = m_primaryRaster.IsBuilt() ? &m_primaryRaster : nullptr;
+	rt.primaryCache = m_primaryCache.IsBuilt() ? &m_primaryCache : nullptr;
 
 	//int tile_num_x = ceil(m_imagesensor->GetWidth() / (float)tilesize);
 	//int tile_num_y = ceil(m_imagesensor->GetHeight() / (float)tilesize);
 	Vector2i tile_num = Vector2i( (int)ceil(m_imagesensor->GetWidth() / (float)tilesize) , (int)ceil(m_imagesensor->GetHeight() / (float)tilesize) );
 
-	// start tile from center instead of top-left corner
-	Vector2i cur_pos( tile_num / 2 );
-	int cur_dir = 0;
-	int cur_len = 0;
-	int cur_dir_len = 1;
-	const Vector2i dir[4] = { Vector2i( 0 , -1 ) , Vector2i( -1 , 0 ) , Vector2i( 0 , 1 ) , Vector2i( 1 , 0 ) };
+	// the workers take the tiles in this order , the blocks of the hilbert spiral are four tiles wide
+	std::vector<Vector2i> order;
+	if( m_tileOrder == TILE_ORDER_HILBERT )
+		order = HilbertOrder( tile_num );
+	else if( m_tileOrder == TILE_ORDER_HILBERT_SPIRAL )
+		order = HilbertSpiralOrder( tile_num , 4 );
+	else if( m_tileOrder == TILE_ORDER_PRIORITY )
+		order = _priorityOrder( tile_num , tilesize );
+	else
+		order = SpiralOrder( tile_num );
 
-	while (true)
+	// the order of prioritized tiles changes over the passes , their ids are kept in scanline order for the costs and checkpoints
+	const bool prioritized = m_tileOrder == TILE_ORDER_PRIORITY;
+	rt.taskCost = prioritized ? m_taskCost.get() : nullptr;
+	for( const Vector2i& cur_pos : order )
 	{
-		// only process node inside the image region
-		if (cur_pos.x >= 0 && cur_pos.x < tile_num.x && cur_pos.y >= 0 && cur_pos.y < tile_num.y )
+		rt.taskId = prioritized ? (unsigned)( cur_pos.y * tile_num.x + cur_pos.x ) : taskid++;
+		rt.ori.x = cur_pos.x * tilesize;
+		rt.ori.y = cur_pos.y * tilesize;
+		rt.size.x = (tilesize < (m_imagesensor->GetWidth() - rt.ori.x)) ? tilesize : (m_imagesensor->GetWidth() - rt.ori.x);
+		rt.size.y = (tilesize < (m_imagesensor->GetHeight() - rt.ori.y)) ? tilesize : (m_imagesensor->GetHeight() - rt.ori.y);
+
+		// tiles finished before resuming are kept , the others are rendered from scratch
+		const bool resumed = rt.taskId < m_resumedTasks.size();
+		if( resumed && m_resumedTasks[rt.taskId] )
+			m_taskDone[rt.taskId] = true;
+		else
 		{
-			rt.taskId = taskid++;
-			rt.ori.x = cur_pos.x * tilesize;
-			rt.ori.y = cur_pos.y * tilesize;
-			rt.size.x = (tilesize < (m_imagesensor->GetWidth() - rt.ori.x)) ? tilesize : (m_imagesensor->GetWidth() - rt.ori.x);
-			rt.size.y = (tilesize < (m_imagesensor->GetHeight() - rt.ori.y)) ? tilesize : (m_imagesensor->GetHeight() - rt.ori.y);
+			if( resumed )
+				m_imagesensor->ClearRect( rt.ori , rt.size );
 
 			// create new pixel samples
-			rt.pixelSamples = new PixelSample[m_iSamplePerPixel];
+			rt.pixelSamples = new PixelSample[spp];
 
 			// push the render task
-            RenderTaskQueue::GetSingleton().PushTask( rt );
+			RenderTaskScheduler::GetSingleton().PushTask( rt );
 		}
+	}
+}
+
+// sort the tiles by their priorities
+std::vector<Vector2i> System::_priorityOrder( const Vector2i& tile_num , unsigned tilesize )
+{
+	const unsigned width = m_imagesensor->GetWidth();
+	const unsigned height = m_imagesensor->GetHeight();
+	const unsigned cnt = tile_num.x * tile_num.y;
 
-		// turn to the next direction
-		if (cur_len >= cur_dir_len)
+	// the costs measured in the last pass over the same tiles , they are measured again in this pass
+	const bool measured = m_taskCostCnt == cnt && m_imagesensor->GetPassCount() > 0;
+	std::vector<float> cost( cnt , 1.0f );
+	if( measured )
+	{
+		// tiles rendered by the render farm or before resuming are not measured , they take the average cost
+		double total = 0.0;
+		unsigned total_cnt = 0;
+		for( unsigned i = 0 ; i < cnt ; ++i )
 		{
-			cur_dir = (cur_dir + 1) % 4;
-			cur_len = 0;
-			cur_dir_len += 1 - cur_dir % 2;
+			cost[i] = (float)m_taskCost[i].load();
+			total += cost[i];
+			total_cnt += cost[i] > 0.0f;
 		}
+		const float average = total_cnt ? (float)( total / total_cnt ) : 1.0f;
+		for( float& c : cost )
+			c = ( c > 0.0f ) ? c : average;
+	}
+	if( m_taskCostCnt != cnt )
+	{
+		m_taskCost.reset( new std::atomic<unsigned long long>[cnt] );
+		m_taskCostCnt = cnt;
+	}
+	for( unsigned i = 0 ; i < cnt ; ++i )
+		m_taskCost[i] = 0;
 
-		cur_pos += dir[cur_dir];
+	// the visible error of a tile is its noise , weighted down away from the focus point , the noise is unknown before the second pass
+	const bool noisy = m_imagesensor->GetPassCount() >= 2;
+	const Vector2f focus( m_tileFocus.x * width , m_tileFocus.y * height );
+	const float diagonal = sqrt( (float)( width * width + height * height ) );
+	std::vector<std::pair<float,float>> priority( cnt );
+	for( int y = 0 ; y < tile_num.y ; ++y )
+		for( int x = 0 ; x < tile_num.x ; ++x )
+		{
+			const Vector2i ori( x * tilesize , y * tilesize );
+			const Vector2i size( min( tilesize , width - ori.x ) , min( tilesize , height - ori.y ) );
+			const float dx = ( ori.x + size.x * 0.5f - focus.x ) / diagonal;
+			const float dy = ( ori.y + size.y * 0.5f - focus.y ) / diagonal;
+			const float closeness = 1.0f / ( 1.0f + 16.0f * ( dx * dx + dy * dy ) );
 
-		++cur_len;
+			const unsigned i = y * tile_num.x + x;
+			const float error = noisy ? closeness * m_imagesensor->EstimateNoise( ori , size ) : closeness;
+			priority[i] = std::make_pair( error / cost[i] , closeness );
+		}
 
-		if( (cur_pos.x < 0 || cur_pos.x >= tile_num.x ) && (cur_pos.y < 0 || cur_pos.y >= tile_num.y ) )
-			return;
-	}
+	// ties , like the tiles of the first pass or converged ones , are broken by the distance to the focus point
+	std::vector<unsigned> rank( cnt );
+	for( unsigned i = 0 ; i < cnt ; ++i )
+		rank[i] = i;
+	std::stable_sort( rank.begin() , rank.end() , [&]( unsigned a , unsigned b ){ return priority[a] > priority[b]; } );
+
+	std::vector<Vector2i> order;
+	order.reserve( cnt );
+	for( unsigned i : rank )
+		order.push_back( Vector2i( i % tile_num.x , i / tile_num.x ) );
+	return order;
+}
+
+// pick the size of render tiles
+unsigned System::_pickTileSize()
+{
+	if( m_tileSize > 0 )
+		return m_tileSize;
+
+	// about eight tiles per thread keep the load balanced , small tiles are avoided for the coherence of the rays in a tile
+	const float pixels = (float)m_imagesensor->GetWidth() * (float)m_imagesensor->GetHeight();
+	unsigned tilesize = (unsigned)sqrtf( pixels / ( 8.0f * m_thread_num ) );
+	tilesize = max( 16u , min( (unsigned)g_iTileSize , tilesize - tilesize % 8 ) );
+	slog( INFO , GENERAL , stringFormat( "Tile size is %d." , tilesize ) );
+
+	// passes of progressive rendering use the same size
+	m_tileSize = tilesize;
+	return tilesize;
 }
 
 // do ray tracing in a multithread enviroment
@@ -237,29 +619,328 @@ void System::_executeRenderingTasks()
     m_imagesensor->PreProcess();
 
     std::shared_ptr<Integrator> integrator(_allocateIntegrator());
-	integrator->PreProcess();
+	// the camera is set up first , integrators could trace camera rays in pre-processing
 	integrator->SetupCamera(m_camera);
+	sort_reseed( 0 , SORT_RAND_SERIAL , 0 );
+	{
+		SORT_PROFILE( "Integrator::PreProcess" );
+		integrator->PreProcess();
+	}
+
+	_preparePrimaryHits( integrator.get() );
+
+	// the render loop is specialized for the types of the view if there is a kernel of them
+	SAFE_DELETE(m_kernel);
+	m_kernel = CREATE_TYPE( m_views[m_viewIndex].kernel , RenderKernel );
+	if( m_kernel && !m_kernel->Accepts( m_camera , integrator.get() , m_imagesensor ) )
+		SAFE_DELETE(m_kernel);
+	slog( INFO , GENERAL , stringFormat( m_kernel ? "Render kernel %s is specialized for the view." : "Render kernel %s is generic." , m_views[m_viewIndex].kernel.c_str() ) );
 
-	// pre allocate memory for the specific thread
-	for( unsigned i = 0 ; i < m_thread_num ; ++i )
-		MemManager::GetSingleton().PreMalloc( 1024 * 1024 * 64 , i );
+	// radiance written to other pixels is weighted by the sample number per pixel , which is unknown with adaptive sampling
+	if( m_adaptiveThreshold > 0.0f && integrator->SupportPendingWrite() )
+	{
+		slog( WARNING , GENERAL , "Adaptive sampling is not supported by the integrator , it is disabled." );
+		m_adaptiveThreshold = 0.0f;
+	}
+	m_sampleCnt = 0;
+	m_samplesDone = m_sampleFirst;
+
+	if( !m_checkpointFile.empty() )
+	{
+		// tiles checkpointed during rendering could hold radiance written by light paths of other tiles
+		if( !m_progressive && integrator->SupportPendingWrite() )
+		{
+			slog( WARNING , GENERAL , "Checkpoints of the integrator are only supported in progressive rendering , they are disabled." );
+			m_checkpointFile.clear();
+		}
+		// filtered pixels are only resolved after the whole pass , so are the tiles
+		else if( !m_progressive && m_imagesensor->GetFilter().IsSplatting() )
+		{
+			slog( WARNING , GENERAL , "Checkpoints of filtered pixels are only supported in progressive rendering , they are disabled." );
+			m_checkpointFile.clear();
+		}
+		else
+			_loadCheckpoint();
+	}
     
-    std::vector< std::unique_ptr<PlatformThreadUnit> > threads;
-    for( unsigned i = 0 ; i < m_thread_num ; ++i )
-        threads.push_back( std::unique_ptr<PlatformThreadUnit>( new PlatformThreadUnit( i , integrator ) ) );
+    // workers of the render farm only send back the pixels of their tasks , radiance written to other pixels is not included
+    m_farmEnabled = ( m_farm != nullptr );
+    if( m_farmEnabled && ( integrator->SupportPendingWrite() || m_imagesensor->GetFilter().IsSplatting() ) )
+    {
+        slog( WARNING , GENERAL , "The render farm doesn't support the integrator or the filter , the view is rendered locally." );
+        m_farmEnabled = false;
+    }
 
-    // start all threads
-    for_each( threads.begin() , threads.end() , []( std::unique_ptr<PlatformThreadUnit>& thread ) { thread->BeginThread(); } );
+    // finished pixels are final in a single pass without radiance written to other pixels
+    if( !m_progressive && !integrator->SupportPendingWrite() && !m_imagesensor->GetFilter().IsSplatting() )
+        m_imagesensor->BeginStreaming();
 
-	// wait for all the threads to be finished
-    for_each( threads.begin() , threads.end() , []( std::unique_ptr<PlatformThreadUnit>& thread ) { thread->Join(); } );
+    SORT_STATS( AccelStats::Reset() );
+
+    // throughput is measured from the first task on
+    RenderTelemetry::Reset( m_thread_num );
+    m_renderStart = Timer::GetSingleton().GetRunningTime();
+    m_lastTelemetry = m_renderStart;
+
+    if( m_progressive )
+        _renderProgressive( integrator );
+    else
+        _renderPass( integrator , m_iSamplePerPixel );
 
     // Output progress
     _outputProgress();
+    if( !m_telemetryFile.empty() )
+        RenderTelemetry::WriteFile( m_telemetryFile , _progress() , ( Timer::GetSingleton().GetRunningTime() - m_renderStart ) / 1000.0 , 0.0 );
+
+    if( RenderControl::GetSingleton().IsCancelled() )
+        slog( WARNING , GENERAL , "Rendering is cancelled , the partially rendered image is written." );
+
+    // a cancelled rendering is resumed later , the checkpoint of a finished one is useless after the last view
+    if( !m_checkpointFile.empty() )
+    {
+        if( RenderControl::GetSingleton().IsCancelled() )
+            _saveCheckpoint( true );
+        else if( m_viewIndex + 1 == m_views.size() )
+            remove( m_checkpointFile.c_str() );
+    }
+
+    // every pass of a pixel takes the same number of samples except the last one of progressive rendering , which is rounded up by the sampler
+    if( m_partial )
+    {
+        const unsigned passes = m_progressive ? m_imagesensor->GetPassCount() : 1;
+        const unsigned samples = m_progressive ? m_samplesDone - m_sampleFirst : m_iSamplePerPixel;
+        m_imagesensor->SetPartialSamples( (float)samples / (float)max( 1u , passes ) );
+    }
+
+    if( m_adaptiveThreshold > 0.0f )
+        slog( INFO , GENERAL , stringFormat( "Adaptive sampling takes %f samples per pixel in average." , (double)m_sampleCnt / ( m_imagesensor->GetWidth() * m_imagesensor->GetHeight() ) ) );
+
+    // the time of the threads on tasks , scheduling , storing tiles and waiting for the others
+    RenderTelemetry::OutputUtilization( ( Timer::GetSingleton().GetRunningTime() - m_renderStart ) / 1000.0 );
+
+    // traversal statistics of all threads
+    SORT_STATS( AccelStats::OutputLog() );
+
+    // the statistics of the integrator are kept for the report , it is released with the view
+    m_integratorStats = StatsGroup();
+    integrator->CollectStats( m_integratorStats );
+    m_primaryRaster.Release();
+    m_primaryCache.OutputLog();
 
+    // shading statistics of all materials
+    SHADING_STATS( MatManager::GetSingleton().OutputLog() );
+
+    // the image is resolved , denoised and written to the output files
+    SORT_PROFILE( "ImageSensor::PostProcess" );
     m_imagesensor->PostProcess();
 }
 
+// render one pass over the whole image
+void System::_renderPass( std::shared_ptr<Integrator> integrator , unsigned spp , unsigned stride , unsigned covered )
+{
+    // the streams of the light paths of a pass are keyed by the samples taken before it , the finer preview levels continue the pass
+    if( covered == 0 )
+    {
+        sort_set_epoch( m_samplesDone );
+        sort_reseed( 1 , SORT_RAND_SERIAL , 0 );
+        integrator->BeginPass( spp );
+    }
+    _pushRenderTask( spp , stride , covered );
+
+    // tiles are checkpointed and the live progress is updated as tasks are finished
+    RenderTaskScheduler::GetSingleton().SetTaskCallback( [this](){ _taskFinished(); } );
+
+    // deal the tasks to the threads , idle threads steal tasks from the others , the workers of the render farm take an extra deque
+    RenderTaskScheduler::GetSingleton().Start( m_thread_num + ( m_farmEnabled ? 1 : 0 ) , m_tileSplitSize , m_tileStarvation );
+    if( m_farmEnabled )
+    {
+        FarmTask pass;
+        pass.view = m_viewIndex;
+        pass.spp = spp;
+        pass.sampleOffset = m_samplesDone;
+        pass.adaptiveThreshold = m_adaptiveThreshold;
+        pass.adaptiveBatch = m_adaptiveBatch;
+        m_farm->BeginPass( pass , m_thread_num , integrator , m_imagesensor );
+    }
+
+    // render on all threads of the thread pool , it returns after all the threads are finished
+    ThreadPool::GetSingleton().RunOnAllThreads( [&]( unsigned tid ) {
+        PlatformThreadUnit thread( tid , integrator );
+        thread.RunThread();
+    } );
+
+    // the pass is over once the workers return their tasks , the tasks of lost workers are rendered locally
+    for( bool finished = !m_farmEnabled ; !finished ; )
+    {
+        finished = m_farm->EndPass();
+        PlatformThreadUnit thread( 0 , integrator );
+        thread.RunThread();
+        if( !finished )
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+
+    // the threads finished before the last one were idle
+    RenderTelemetry::FinishPass();
+
+    m_sampleCnt += RenderTaskScheduler::GetSingleton().GetSampleCount();
+    RenderTaskScheduler::GetSingleton().Clear();
+    m_resumedTasks.clear();
+}
+
+// render the first pass from coarse to fine grids of pixels
+void System::_renderPreview( std::shared_ptr<Integrator> integrator , unsigned spp )
+{
+    // every level renders the pixels of its grid left by the coarser one , the pixels of all levels make up one pass
+    unsigned covered = 0;
+    for( unsigned stride = 1u << m_previewLevels ; stride > 0 ; covered = stride , stride /= 2 )
+    {
+        _renderPass( integrator , spp , stride , covered );
+        if( RenderControl::GetSingleton().IsCancelled() )
+            return;
+        if( stride > 1 )
+            m_imagesensor->ShowPreview( stride );
+    }
+}
+
+// render passes until one of the termination conditions is met
+void System::_renderProgressive( std::shared_ptr<Integrator> integrator )
+{
+    // the samples of a resumed rendering are loaded from the checkpoint already
+    const unsigned samples_end = m_sampleFirst + m_iSamplePerPixel;
+    while( m_samplesDone < samples_end )
+    {
+        // the first pass of a preview takes one sample per pixel , radiance written to other pixels isn't previewed
+        const bool preview = m_previewLevels > 0 && m_imagesensor->GetPassCount() == 0 && !m_farmEnabled && !integrator->SupportPendingWrite();
+
+        // the last pass only renders the samples left , rounded up by the sampler
+        const unsigned spp = m_pSampler->RoundSize( min( preview ? 1u : m_passSamples , samples_end - m_samplesDone ) );
+        if( preview )
+            _renderPreview( integrator , spp );
+        else
+            _renderPass( integrator , spp );
+        if( RenderControl::GetSingleton().IsCancelled() )
+            break;
+        m_imagesensor->FinishPass();
+        m_samplesDone += spp;
+
+        _outputProgress();
+
+        if( !m_checkpointFile.empty() && Timer::GetSingleton().GetRunningTime() - m_lastCheckpoint >= m_checkpointInterval )
+            _saveCheckpoint( true );
+
+        if( m_timeBudget > 0 && Timer::GetSingleton().GetRunningTime() - m_renderStart >= m_timeBudget ){
+            slog( INFO , GENERAL , stringFormat( "Time budget is reached after %d samples per pixel." , m_samplesDone ) );
+            break;
+        }
+        if( m_noiseThreshold > 0.0f && m_imagesensor->GetPassCount() > 1 ){
+            const float noise = m_imagesensor->EstimateNoise();
+            slog( DEBUG , GENERAL , stringFormat( "Estimated noise is %f after %d samples per pixel." , noise , m_samplesDone ) );
+            if( noise <= m_noiseThreshold ){
+                slog( INFO , GENERAL , stringFormat( "Noise threshold is reached after %d samples per pixel." , m_samplesDone ) );
+                break;
+            }
+        }
+    }
+}
+
+// resume the rendering from the checkpoint
+void System::_loadCheckpoint()
+{
+	// tiles of another size don't match the finished tiles in the checkpoint
+	string params = m_checkpointParams;
+	// the pixels of another region are not the ones in the checkpoint
+	params += stringFormat( "region %d %d %d %d" , m_imagesensor->GetRegionX() , m_imagesensor->GetRegionY() , m_imagesensor->GetWidth() , m_imagesensor->GetHeight() );
+	// each view has its own checkpoint , only the one of the view being rendered is kept
+	params += stringFormat( "view %d" , m_viewIndex );
+	if( !m_progressive )
+		params += stringFormat( "tile size %d order %d" , _pickTileSize() , m_tileOrder );
+	m_checkpointKey = AccelCache::Key( m_Scene.GetPrimitives() , params );
+	m_lastCheckpoint = Timer::GetSingleton().GetRunningTime();
+
+	vector<char> payload;
+	if( !RenderCheckpoint::Load( m_checkpointFile , m_checkpointKey , payload ) )
+		return;
+
+	AccelReader stream( payload.data() , payload.size() );
+	unsigned samples_done = 0 , task_cnt = 0 , rng_cnt = 0;
+	vector<char> tasks;
+	vector<unsigned> rng;
+	bool valid = stream.Read( samples_done ) && stream.Read( task_cnt );
+	if( valid ){
+		tasks.resize( task_cnt );
+		valid = stream.Read( tasks.data() , task_cnt ) && m_imagesensor->Deserialize( stream ) && stream.Read( rng_cnt );
+	}
+	if( valid ){
+		rng.resize( rng_cnt * SORT_RAND_STATE_SIZE );
+		valid = stream.Read( rng.data() , rng.size() ) && stream.IsComplete();
+	}
+	if( !valid ){
+		// the image sensor could be partially loaded
+		m_imagesensor->ClearRect( Vector2i( 0 , 0 ) , Vector2i( m_imagesensor->GetWidth() , m_imagesensor->GetHeight() ) );
+		slog( WARNING , GENERAL , stringFormat( "Failed to resume from checkpoint %s." , m_checkpointFile.c_str() ) );
+		return;
+	}
+
+	m_samplesDone = samples_done;
+	m_resumedTasks.swap( tasks );
+
+	// the generators continue their sequences , otherwise the same samples could be taken again after resuming
+	ThreadPool::GetSingleton().RunOnAllThreads( [&]( unsigned tid ){
+		if( tid < rng_cnt )
+			sort_set_state( &rng[ tid * SORT_RAND_STATE_SIZE ] );
+	} );
+
+	slog( INFO , GENERAL , stringFormat( "Rendering is resumed from checkpoint %s." , m_checkpointFile.c_str() ) );
+}
+
+// write a checkpoint
+void System::_saveCheckpoint( bool idle )
+{
+	SORT_PROFILE( "System::SaveCheckpoint" );
+	AccelWriter stream;
+	stream.Write( m_samplesDone );
+
+	// tiles are only recorded without progressive rendering , the pixels are read after the finished tiles
+	const unsigned task_cnt = m_progressive ? 0 : m_totalTask;
+	vector<char> tasks( task_cnt );
+	for( unsigned i = 0 ; i < task_cnt ; ++i )
+		tasks[i] = m_taskDone[i];
+	std::atomic_thread_fence( std::memory_order_acquire );
+	stream.Write( task_cnt );
+	stream.Write( tasks.data() , task_cnt );
+	if( idle )
+	{
+		m_imagesensor->ResolveFilter();
+		m_imagesensor->ResolveSplats();
+	}
+	m_imagesensor->Serialize( stream );
+
+	// the generators of busy threads can't be touched
+	const unsigned rng_cnt = idle ? ThreadPool::GetSingleton().GetThreadNum() : 0;
+	vector<unsigned> rng( rng_cnt * SORT_RAND_STATE_SIZE );
+	if( idle )
+		ThreadPool::GetSingleton().RunOnAllThreads( [&]( unsigned tid ){
+			sort_get_state( &rng[ tid * SORT_RAND_STATE_SIZE ] );
+		} );
+	stream.Write( rng_cnt );
+	stream.Write( rng.data() , rng.size() );
+
+	if( RenderCheckpoint::Save( m_checkpointFile , m_checkpointKey , stream.GetData() ) )
+		slog( INFO , GENERAL , stringFormat( "Checkpoint is written to %s." , m_checkpointFile.c_str() ) );
+	m_lastCheckpoint = Timer::GetSingleton().GetRunningTime();
+}
+
+// write a checkpoint if the interval has passed
+void System::_checkpointTick()
+{
+	if( Timer::GetSingleton().GetRunningTime() - m_lastCheckpoint < m_checkpointInterval )
+		return;
+
+	std::unique_lock<std::mutex> lock( m_checkpointMutex , std::try_to_lock );
+	if( lock.owns_lock() && Timer::GetSingleton().GetRunningTime() - m_lastCheckpoint >= m_checkpointInterval )
+		_saveCheckpoint( false );
+}
+
 // allocate integrator
 Integrator*	System::_allocateIntegrator()
 {
@@ -281,36 +962,243 @@ Integrator*	System::_allocateIntegrator()
 	return integrator;
 }
 
+// get the key of the render farm
+unsigned long long System::_farmKey()
+{
+	string params = m_integratorType + stringFormat( " spp %d views %d" , m_iSamplePerPixel , (int)m_views.size() );
+	for( const RenderView& view : m_views )
+		params += stringFormat( " %d %d %d %d" , view.imagesensor->GetRegionX() , view.imagesensor->GetRegionY() , view.imagesensor->GetWidth() , view.imagesensor->GetHeight() );
+	return AccelCache::Key( m_Scene.GetPrimitives() , params );
+}
+
+// render the tasks of the render farm coordinator
+void System::RenderFarmWorker( const string& host , unsigned short port )
+{
+	PreProcess();
+	Timer::GetSingleton().StartTimer();
+
+	const unsigned long long key = _farmKey();
+	m_farmView = -1;
+	m_farmPass = -1;
+	RenderTelemetry::Reset( m_thread_num );
+
+	// every thread keeps its own connection , the coordinator sees them as separate workers
+	std::atomic<unsigned> task_cnt( 0 );
+	ThreadPool::GetSingleton().RunOnAllThreads( [&]( unsigned tid ) {
+		task_cnt += FarmWorker::Run( host , port , key , [this]( const FarmTask& task , std::vector<float>& data , unsigned long long& samples ){
+			return _renderFarmTask( task , data , samples );
+		} );
+	} );
+	m_farmIntegrator.reset();
+
+	m_uRenderingTime = Timer::GetSingleton().StopTimer();
+	slog( INFO , GENERAL , stringFormat( "Render farm worker rendered %d tasks." , (int)task_cnt.load() ) );
+}
+
+// render a task of the render farm coordinator
+bool System::_renderFarmTask( const FarmTask& task , std::vector<float>& data , unsigned long long& samples )
+{
+	std::shared_ptr<Integrator> integrator;
+	{
+		// the coordinator serves the next view or pass once all tasks of the current one are returned , so no thread is rendering
+		std::lock_guard<std::mutex> lock( m_farmMutex );
+		if( (int)task.view != m_farmView )
+		{
+			if( task.view >= m_views.size() )
+				return false;
+			m_farmView = task.view;
+			m_farmPass = -1;
+			m_camera = m_views[task.view].camera;
+			m_imagesensor = m_views[task.view].imagesensor;
+			m_imagesensor->PreProcess();
+
+			m_farmIntegrator.reset( _allocateIntegrator() );
+			if( !m_farmIntegrator )
+				return false;
+			m_farmIntegrator->SetupCamera( m_camera );
+			sort_reseed( 0 , SORT_RAND_SERIAL , 0 );
+			m_farmIntegrator->PreProcess();
+			_preparePrimaryHits( m_farmIntegrator.get() );
+		}
+		if( (int)task.pass != m_farmPass )
+		{
+			m_farmPass = task.pass;
+			sort_set_epoch( task.sampleOffset );
+			sort_reseed( 1 , SORT_RAND_SERIAL , 0 );
+			m_farmIntegrator->BeginPass( task.spp );
+		}
+		integrator = m_farmIntegrator;
+	}
+
+	RenderTask rt( m_Scene , m_pSampler , m_camera , nullptr , task.spp );
+	rt.taskId = task.taskId;
+	rt.ori = task.ori;
+	rt.size = task.size;
+	rt.adaptiveThreshold = task.adaptiveThreshold;
+	rt.adaptiveBatch = task.adaptiveBatch;
+	rt.sampleOffset = task.sampleOffset;
+	rt.pixelOrder = m_pixelOrder;
+	rt.primaryRaster = m_primaryRaster.IsBuilt() ? &m_primaryRaster : nullptr;
+	rt.primaryCache = m_primaryCache.IsBuilt() ? &m_primaryCache : nullptr;
+	if( task.spp == 0 || rt.ori.x < 0 || rt.ori.y < 0 || rt.size.x <= 0 || rt.size.y <= 0 ||
+		rt.ori.x + rt.size.x > (int)m_imagesensor->GetWidth() || rt.ori.y + rt.size.y > (int)m_imagesensor->GetHeight() )
+		return false;
+	rt.pixelSamples = new PixelSample[task.spp];
+	samples = rt.Execute( integrator.get() );
+	RenderTask::DestoryRenderTask( rt );
+
+	// a cancelled task is not complete , the coordinator renders it again
+	if( RenderControl::GetSingleton().IsCancelled() )
+		return false;
+	m_imagesensor->TakeRect( rt.ori , rt.size , data );
+	return true;
+}
+
+// create an image sensor with the settings of the rendering
+ImageSensor* System::_createImageSensor( TiXmlNode* root , TiXmlElement* output , const string& filename , string& type )
+{
+	ImageSensor* imagesensor = 0;
+	if( m_outputBuffer && m_views.empty() )
+	{
+		imagesensor = new MemoryImage( m_outputBuffer );
+		type = "memory";
+	}
+	else if( g_bBlenderMode )
+	{
+		imagesensor = new BlenderImage();
+		type = "blender";
+	}
+	else
+	{
+		imagesensor = new RenderTargetImage();
+		type = "rendertarget";
+	}
+
+	// get the render target
+	TiXmlElement* element = root->FirstChildElement( "RenderTargetSize" );
+	if( element )
+	{
+		const char* str_width = element->Attribute("w");
+		const char* str_height = element->Attribute("h");
+		imagesensor->SetSensorSize( atoi( str_width ) , atoi( str_height ) );
+	}else
+		imagesensor->SetSensorSize( 1920 , 1080 );
+
+	// only a region of the image is rendered , the tiles and the pixels kept are the ones in it
+	element = root->FirstChildElement( "RenderRegion" );
+	if( element )
+	{
+		int x = 0 , y = 0 , w = 0 , h = 0;
+		element->QueryIntAttribute( "x" , &x );
+		element->QueryIntAttribute( "y" , &y );
+		element->QueryIntAttribute( "w" , &w );
+		element->QueryIntAttribute( "h" , &h );
+		if( !imagesensor->SetRegion( x , y , w , h ) )
+			slog( WARNING , GENERAL , "The render region is outside of the image , the whole image is rendered." );
+	}
+
+	// the pixels are reconstructed by the filter , samples are splatted to the pixels within its radius
+	element = root->FirstChildElement("Filter");
+	if( element && element->Attribute("type") )
+	{
+		const char* str_radius = element->Attribute("radius");
+		imagesensor->SetFilter( element->Attribute("type") , str_radius ? (float)atof( str_radius ) : 0.0f );
+	}
+
+	// the final image is denoised guided by the albedo and the normal of the first hit
+	element = root->FirstChildElement("Denoiser");
+	if( element )
+	{
+		const char* str_type = element->Attribute("type");
+		const char* str_iterations = element->Attribute("iterations");
+		imagesensor->SetDenoiser( str_type ? str_type : "auto" , str_iterations ? (unsigned)max( 0 , atoi( str_iterations ) ) : 0 );
+	}
+
+	if( output ){
+		if( !filename.empty() )
+			imagesensor->SetProperty("filename", filename);
+
+		// the compression and the tiles only apply to exr files
+		const char* compression = output->Attribute("compression");
+		if( compression )
+			imagesensor->SetProperty("compression", compression);
+		const char* tile_size = output->Attribute("tile_size");
+		if( tile_size )
+			imagesensor->SetProperty("tile_size", tile_size);
+
+		// the output variables are rendered along with the image
+		const char* aov = output->Attribute("aov");
+		if( aov )
+			imagesensor->SetProperty("aov", aov);
+
+		// finished tiles of exr files are written during rendering
+		const char* stream = output->Attribute("stream");
+		if( stream )
+			imagesensor->SetProperty("stream", stream);
+	}
+
+	return imagesensor;
+}
+
 // setup system from file
 bool System::Setup( const char* str )
 {
-    // setup image sensor first of all
-    if( g_bBlenderMode )
-        m_imagesensor = new BlenderImage();
-    else
-        m_imagesensor = new RenderTargetImage();
-    
 	// load the xml file
 	string full_name = GetFullPath(str);
 	TiXmlDocument doc( full_name.c_str() );
-	doc.LoadFile();
-	
-    sAssert( !doc.Error() , GENERAL );
+	if( !XmlBinary::Load( doc ) || doc.RootElement() == nullptr )
+	{
+        slog( WARNING , GENERAL , stringFormat( "%s. Render setting file %s can't be loaded." , doc.ErrorDesc() , full_name.c_str() ) );
+		return false;
+	}
 	
 	// get the root of xml
 	TiXmlNode*	root = doc.RootElement();
 	
-	// try to load the scene , note: only the first node matters
-	TiXmlElement* element = root->FirstChildElement( "Scene" );
-	if( element )
+	// the thread pool is needed while loading the scene already , threads could be pinned with the attribute 'affinity' being 'compact' or 'scatter'
+	TiXmlElement* thread_element = root->FirstChildElement("ThreadNum");
+	if( thread_element )
+	{
+		m_thread_num = atoi(thread_element->Attribute("name"));
+		const char* affinity = thread_element->Attribute("affinity");
+		if( affinity && strcmp( affinity , "compact" ) == 0 )
+			m_threadAffinity = THREAD_AFFINITY_COMPACT;
+		else if( affinity && strcmp( affinity , "scatter" ) == 0 )
+			m_threadAffinity = THREAD_AFFINITY_SCATTER;
+	}
+	ThreadPool::GetSingleton().Init( m_thread_num , m_threadAffinity );
+
+	// large scene buffers could be placed on huge pages , it has to be set before the scene is loaded
+	TiXmlElement* huge_page_element = root->FirstChildElement("HugePages");
+	if( huge_page_element && huge_page_element->Attribute("mode") )
 	{
-		const char* str_scene = element->Attribute( "value" );
-		if( str_scene )
-			LoadScene(str_scene);
+		const char* mode = huge_page_element->Attribute("mode");
+		if( strcmp( mode , "transparent" ) == 0 )
+			HugePages::SetMode( HUGE_PAGE_TRANSPARENT );
+		else if( strcmp( mode , "explicit" ) == 0 )
+			HugePages::SetMode( HUGE_PAGE_EXPLICIT );
 		else
-			return false;
-	}else
+			HugePages::SetMode( HUGE_PAGE_OFF );
+	}
+
+	// processes rendering the same scene on the host could keep one copy of the scene data , it has to be set before the scene is loaded
+	TiXmlElement* shared_element = root->FirstChildElement("SharedScene");
+	if( shared_element && shared_element->Attribute("value") )
+		SMManager::GetSingleton().SetSceneSharing( atoi( shared_element->Attribute("value") ) == 1 );
+
+	// the cycles , instructions , cache , TLB and branch misses of the zones are counted by the processor with 'counters' , it
+	// has to be set before the scene is loaded
+#if SORT_PROFILER
+	TiXmlElement* profile_element = root->FirstChildElement("Profile");
+	if( profile_element && profile_element->Attribute("counters") && strcmp( profile_element->Attribute("counters") , "true" ) == 0 )
+		Profiler::EnableCounters( true );
+#endif
+
+	// the scene is loaded once the cameras are created , note: only the first node matters
+	TiXmlElement* element = root->FirstChildElement( "Scene" );
+	if( element == 0 || element->Attribute( "value" ) == 0 )
 		return false;
+	const string str_scene = _frameName( element->Attribute( "value" ) );
 	
 	// get the integrater
 	element = root->FirstChildElement( "Integrator" );
@@ -335,16 +1223,6 @@ bool System::Setup( const char* str )
 	}else
 		return false;
 	
-	// get the render target
-	element = root->FirstChildElement( "RenderTargetSize" );
-	if( element )
-	{
-		const char* str_width = element->Attribute("w");
-		const char* str_height = element->Attribute("h");
-		m_imagesensor->SetSensorSize( atoi( str_width ) , atoi( str_height ) );
-	}else
-		m_imagesensor->SetSensorSize( 1920 , 1080 );
-	
 	// get sampler
 	element = root->FirstChildElement( "Sampler" );
 	if( element )
@@ -359,21 +1237,235 @@ bool System::Setup( const char* str )
 		// create sampler
 		m_pSampler = CREATE_TYPE( str_type , Sampler );
 		m_iSamplePerPixel = m_pSampler->RoundSize(round);
+
+		// adaptive sampling takes samples in batches of 'batch' until the relative error of a pixel is below 'adaptive'
+		const char* str_adaptive = element->Attribute("adaptive");
+		if( str_adaptive )
+		{
+			m_adaptiveThreshold = max( 0.0f , (float)atof( str_adaptive ) );
+			const char* str_batch = element->Attribute("batch");
+			m_adaptiveBatch = m_pSampler->RoundSize( max( 1 , str_batch ? atoi( str_batch ) : 16 ) );
+
+			// the pixels without early termination take whole batches
+			m_iSamplePerPixel = ( ( m_iSamplePerPixel + m_adaptiveBatch - 1 ) / m_adaptiveBatch ) * m_adaptiveBatch;
+		}
+
+		// samples of neighbor pixels are dithered by blue noise , it makes previews of few samples look smoother
+		const char* str_bluenoise = element->Attribute("bluenoise");
+		if( str_bluenoise && ( strcmp( str_bluenoise , "true" ) == 0 || atoi( str_bluenoise ) != 0 ) )
+			m_pSampler->EnableBlueNoise();
 	}else{
 		// user stratified sampler as default sampler
 		m_pSampler = new StratifiedSampler();
 		m_iSamplePerPixel = m_pSampler->RoundSize(16);
 	}
 	
-	element = root->FirstChildElement("Camera");
+	// render the image in passes of 'pass' samples , it stops after a time budget in seconds or once the noise is below the threshold
+	element = root->FirstChildElement("Progressive");
 	if( element )
 	{
+		m_progressive = true;
+		const char* str_pass = element->Attribute("pass");
+		if( str_pass )
+			m_passSamples = max( 1 , atoi( str_pass ) );
+		// the first pass is previewed at 1/2 to 1/2^n of the resolution
+		const char* str_preview = element->Attribute("preview");
+		if( str_preview )
+			m_previewLevels = (unsigned)min( 6 , max( 0 , atoi( str_preview ) ) );
+		const char* str_time = element->Attribute("time");
+		if( str_time )
+			m_timeBudget = (unsigned)max( 0.0f , (float)atof( str_time ) * 1000.0f );
+		const char* str_noise = element->Attribute("noise");
+		if( str_noise )
+			m_noiseThreshold = max( 0.0f , (float)atof( str_noise ) );
+	}
+
+	// the image only depends on the settings with deterministic rendering , it doesn't depend on the threads taking the tiles
+	element = root->FirstChildElement("Deterministic");
+	if( element )
+		sort_set_deterministic( true );
+
+	// the first hits of the camera rays are found by rasterizing the primitives of the scene into bins of pixels
+	element = root->FirstChildElement("PrimaryRaster");
+	if( element )
+		m_usePrimaryRaster = true;
+
+	// the first hits of the camera rays are kept across the passes of progressive rendering , the samples of a pixel take the points
+	// of a fixed pattern of 'pattern' points then , the pattern is shrunk until the hits fit into 'memory' megabytes , the shadow rays
+	// from the hits towards delta lights are kept as well with 'shadows' , they survive renderings of the server editing other lights
+	element = root->FirstChildElement("PrimaryCache");
+	if( element )
+	{
+		m_primaryCachePattern = 16;
+		const char* str_pattern = element->Attribute("pattern");
+		if( str_pattern )
+			m_primaryCachePattern = (unsigned)max( 1 , atoi( str_pattern ) );
+		const char* str_memory = element->Attribute("memory");
+		if( str_memory )
+			m_primaryCacheMemory = (unsigned)max( 1 , atoi( str_memory ) );
+		const char* str_shadows = element->Attribute("shadows");
+		m_primaryCacheShadows = str_shadows && ( strcmp( str_shadows , "true" ) == 0 || atoi( str_shadows ) != 0 );
+	}
+
+	// only the samples from 'first' to 'first + count' are taken with the streams of 'seed' , the partial result keeps the sums of the
+	// samples and the numbers of them in an exr file , the partial results of other ranges are merged into the image by 'SORT merge'
+	const unsigned image_spp = m_iSamplePerPixel;
+	element = root->FirstChildElement("SampleRange");
+	if( element )
+	{
+		m_partial = true;
+		const char* str_first = element->Attribute("first");
+		m_sampleFirst = str_first ? (unsigned)max( 0 , atoi( str_first ) ) : 0;
+		const char* str_count = element->Attribute("count");
+		if( str_count )
+			m_iSamplePerPixel = m_pSampler->RoundSize( max( 1 , atoi( str_count ) ) );
+		const char* str_seed = element->Attribute("seed");
+		sort_set_seed( str_seed ? strtoull( str_seed , nullptr , 10 ) : 0 );
+
+		// the samples of a range only depend on their indices , so the ranges never overlap
+		sort_set_deterministic( true );
+
+		// the pixels of the ranges are weighted by their numbers of samples , which aren't known with adaptive sampling
+		if( m_adaptiveThreshold > 0.0f )
+		{
+			slog( WARNING , GENERAL , "Adaptive sampling is not supported by partial results , it is disabled." );
+			m_adaptiveThreshold = 0.0f;
+		}
+	}
+
+	// the memory used by each subsystem is written to the file after rendering
+	element = root->FirstChildElement("MemoryReport");
+	if( element && element->Attribute("file") )
+		m_memoryReportFile = GetFullPath( element->Attribute("file") );
+
+	// the zones of loading , pre-processing , tiles and output are written to the trace file after rendering
+	element = root->FirstChildElement("Profile");
+	if( element && element->Attribute("file") )
+	{
+		m_profileFile = GetFullPath( element->Attribute("file") );
+		if( !SORT_PROFILER )
+			slog( WARNING , PERFORMANCE , "The profiler is compiled out , SORT has to be built with SORT_PROFILER to write the trace." );
+	}
+
+	// the live progress and throughput are written to the file every 'interval' seconds , '.prom' files are in the Prometheus text format
+	element = root->FirstChildElement("Telemetry");
+	if( element )
+	{
+		if( element->Attribute("file") )
+			m_telemetryFile = GetFullPath( element->Attribute("file") );
+		const char* str_interval = element->Attribute("interval");
+		if( str_interval )
+			m_telemetryInterval = (unsigned)max( 100.0f , (float)atof( str_interval ) * 1000.0f );
+	}
+
+	// the workers of the render farm send the pixels as 'float' or 'half' floats , half floats take half the bandwidth
+	element = root->FirstChildElement("FarmTransport");
+	if( element && element->Attribute("pixels") )
+		m_farmHalfPixels = ( strcmp( element->Attribute("pixels") , "half" ) == 0 );
+
+	// the rendering is checkpointed every 'interval' seconds and resumed from the file after a restart
+	element = root->FirstChildElement("Checkpoint");
+	if( element )
+	{
+		const char* str_file = element->Attribute("file");
+		m_checkpointFile = str_file ? str_file : "sort.checkpoint";
+		const char* str_interval = element->Attribute("interval");
+		if( str_interval )
+			m_checkpointInterval = (unsigned)max( 1.0f , (float)atof( str_interval ) * 1000.0f );
+
+		// the settings except the threads, memory and checkpointing identify the rendering , the scene file is included too
+		TiXmlPrinter printer;
+		for( TiXmlElement* child = root->FirstChildElement() ; child ; child = child->NextSiblingElement() )
+			if( strcmp( child->Value() , "ThreadNum" ) != 0 && strcmp( child->Value() , "Checkpoint" ) != 0 &&
+				strcmp( child->Value() , "MemoryReport" ) != 0 && strcmp( child->Value() , "HugePages" ) != 0 &&
+				strcmp( child->Value() , "Telemetry" ) != 0 && strcmp( child->Value() , "SharedScene" ) != 0 &&
+				strcmp( child->Value() , "Profile" ) != 0 )
+				child->Accept( &printer );
+		m_checkpointParams = printer.CStr();
+
+		TiXmlElement* scene_element = root->FirstChildElement( "Scene" );
+		if( scene_element && scene_element->Attribute( "value" ) )
+		{
+			std::ifstream scene_file( GetFullPath( scene_element->Attribute( "value" ) ).c_str() , std::ios::binary );
+			std::stringstream scene_stream;
+			scene_stream << scene_file.rdbuf();
+			m_checkpointParams += scene_stream.str();
+		}
+	}
+
+	// the size of render tiles could be 'auto' , tiles are split at the end of rendering with the attribute 'split' being the minimum size
+	element = root->FirstChildElement("TileSize");
+	if( element )
+	{
+		const char* str_size = element->Attribute("value");
+		if( str_size )
+			m_tileSize = ( strcmp( str_size , "auto" ) == 0 ) ? 0 : max( 1 , atoi( str_size ) );
+		const char* str_split = element->Attribute("split");
+		if( str_split )
+			m_tileSplitSize = max( 0 , atoi( str_split ) );
+		const char* str_starvation = element->Attribute("starvation");
+		if( str_starvation )
+			m_tileStarvation = max( 0 , atoi( str_starvation ) );
+
+		// tiles and the pixels in them could follow space-filling curves , so that consecutive ones touch the same geometry and textures
+		const char* str_order = element->Attribute("order");
+		if( str_order )
+		{
+			if( strcmp( str_order , "hilbert" ) == 0 )
+				m_tileOrder = TILE_ORDER_HILBERT;
+			else if( strcmp( str_order , "hilbert_spiral" ) == 0 )
+				m_tileOrder = TILE_ORDER_HILBERT_SPIRAL;
+			else if( strcmp( str_order , "priority" ) == 0 )
+				m_tileOrder = TILE_ORDER_PRIORITY;
+			else
+			{
+				if( strcmp( str_order , "spiral" ) != 0 )
+					slog( WARNING , GENERAL , stringFormat( "Tile order %s is not supported , tiles are rendered in a spiral." , str_order ) );
+				m_tileOrder = TILE_ORDER_SPIRAL;
+			}
+		}
+		// the focus point of the priority order , (0,0) is the top-left corner and (1,1) the bottom-right one
+		const char* str_focus = element->Attribute("focus");
+		if( str_focus )
+		{
+			string focus = str_focus;
+			const string x = NextToken( focus , ' ' );
+			const string y = NextToken( focus , ' ' );
+			m_tileFocus.x = clamp( (float)atof( x.c_str() ) , 0.0f , 1.0f );
+			m_tileFocus.y = clamp( (float)atof( y.c_str() ) , 0.0f , 1.0f );
+		}
+		const char* str_pixels = element->Attribute("pixels");
+		if( str_pixels )
+		{
+			if( strcmp( str_pixels , "morton" ) == 0 )
+				m_pixelOrder = PIXEL_ORDER_MORTON;
+			else
+			{
+				if( strcmp( str_pixels , "scanline" ) != 0 )
+					slog( WARNING , GENERAL , stringFormat( "Pixel order %s is not supported , pixels are rendered in scanlines." , str_pixels ) );
+				m_pixelOrder = PIXEL_ORDER_SCANLINE;
+			}
+		}
+	}
+
+	// each camera renders a view of the scene to its own output file , the output file of the settings is shared by the
+	// cameras without one , the index of the view is appended to its name then
+	TiXmlElement* output = root->FirstChildElement("OutputFile");
+	for( element = root->FirstChildElement("Camera") ; element ; element = element->NextSiblingElement("Camera") )
+	{
+		// the image of blender is only for one view
+		if( g_bBlenderMode && !m_views.empty() )
+		{
+			slog( WARNING , GENERAL , "Only the first camera is rendered in blender." );
+			break;
+		}
+
 		const char* str_camera = element->Attribute("type");
 	
 		// create the camera
-		m_camera = CREATE_TYPE(str_camera,Camera);
+		Camera* camera = CREATE_TYPE(str_camera,Camera);
 		
-		if( !m_camera )
+		if( !camera )
 			return false;
 		
 		// set the properties
@@ -383,32 +1475,80 @@ bool System::Setup( const char* str )
 			const char* prop_name = prop->Attribute( "name" );
 			const char* prop_value = prop->Attribute( "value" );
 			if( prop_name != 0 && prop_value != 0 )
-				m_camera->SetProperty( prop_name , prop_value );
+				camera->SetProperty( prop_name , prop_value );
 			prop = prop->NextSiblingElement( "Property" );
 		}
+
+		TiXmlElement* view_output = element->FirstChildElement("OutputFile");
+		string filename;
+		if( view_output && view_output->Attribute("name") )
+			filename = _frameName( view_output->Attribute("name") );
+		else if( output && output->Attribute("name") )
+		{
+			view_output = output;
+			filename = _frameName( output->Attribute("name") );
+			if( !m_views.empty() )
+			{
+				const size_t dot = filename.find_last_of( '.' );
+				const size_t pos = ( dot == string::npos || filename.find_first_of( "/\\" , dot ) != string::npos ) ? filename.size() : dot;
+				filename.insert( pos , stringFormat( "_%d" , (int)m_views.size() ) );
+			}
+		}
+
+		RenderView view;
+		view.camera = camera;
+		string sensor_type;
+		view.imagesensor = _createImageSensor( root , view_output , filename , sensor_type );
+		view.kernel = string( str_camera ) + "/" + m_integratorType + "/" + sensor_type;
+		m_views.push_back( view );
 	}
+	if( m_views.empty() )
+		return false;
 
-	element = root->FirstChildElement("OutputFile");
-	if( element )
-        m_imagesensor->SetProperty("filename", element->Attribute("name"));
+	for( RenderView& view : m_views )
+	{
+		// setup image sensor
+		view.camera->SetImageSensor( view.imagesensor );
 
-	element = root->FirstChildElement("ThreadNum");
-	if( element )
-		m_thread_num = atoi(element->Attribute("name"));
+		// the samples of a pixel share its footprint , each of them only covers a part of it , partial results take the samples of the whole image
+		view.camera->SetDifferentialScale( max( 0.125f , 1.0f / sqrtf( (float)image_spp ) ) );
+
+		// preprocess camera
+		view.camera->PreProcess();
+	}
+	m_camera = m_views[0].camera;
+	m_imagesensor = m_views[0].imagesensor;
 
-	// setup image sensor
-    m_camera->SetImageSensor(m_imagesensor);
+	// models with levels of detail pick them by the distance to the cameras
+	vector<Point> eyes;
+	for( const RenderView& view : m_views )
+		eyes.push_back( view.camera->GetEye() );
+	m_Scene.SetViewpoints( eyes );
 
-    // preprocess camera
-    m_camera->PreProcess();
+	// the scene of the last rendering in the same process is reused if none of its files changed , the edited
+	// lights and materials are parsed again if the geometry is the same
+	Timer::GetSingleton().StartTimer();
+	if( m_Scene.IsUpToDate( GetFullPath( str_scene ) ) )
+		slog( INFO , GENERAL , stringFormat( "Scene %s is unchanged, it is reused." , str_scene.c_str() ) );
+	else if( !m_Scene.Update( GetFullPath( str_scene ) ) )
+	{
+		_releaseScene();
+		if( !LoadScene(str_scene) )
+		{
+			Timer::GetSingleton().StopTimer();
+			_releaseScene();
+			return false;
+		}
+	}
+	m_uLoadingTime = Timer::GetSingleton().StopTimer();
     
 	// create shared memory
 	int x_tile = (int)(ceil(m_imagesensor->GetWidth() / (float)g_iTileSize));
 	int y_tile = (int)(ceil(m_imagesensor->GetHeight() / (float)g_iTileSize));
-	int header_size = x_tile * y_tile;
-	int size = header_size * g_iTileSize * g_iTileSize * 4 * sizeof(float) * 2	// image size
-			+ header_size								// header size
-			+ 2;										// progress data and final update flag
+	int tile_cnt = x_tile * y_tile;
+	int size = tile_cnt * g_iTileSize * g_iTileSize * BLENDER_PIXEL_BYTES		// tiles
+			+ TileRing::Size( tile_cnt )						// ring of finished tiles
+			+ 3;										// progress data , final update flag and render control
 
 	// create shared memory
 	const SharedMemory& sm = SMManager::GetSingleton().CreateSharedMemory("SORTBLEND_SHAREMEM", size, SharedMmeory_All);
@@ -419,7 +1559,10 @@ bool System::Setup( const char* str )
 		memset(sm.bytes, 0, sm.size);
 
 		// setup progess pointer
-		m_pProgress = sm.bytes + sm.size - 2;
+		m_pProgress = sm.bytes + sm.size - 3;
+
+		// the add-on cancels or pauses the rendering with the last byte
+		RenderControl::GetSingleton().SetControlByte( sm.bytes + sm.size - 1 );
 	}
 
 	return true;
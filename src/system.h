@@ -22,12 +22,21 @@
 #include "integrator/integrator.h"
 #include "imagesensor/blenderimage.h"
 #include "imagesensor/rendertargetimage.h"
+#include "utility/multithread/threadpool.h"
+#include "utility/renderfarm.h"
+#include "utility/statsreport.h"
+#include "accel/primaryraster.h"
+#include "accel/primarycache.h"
+#include <mutex>
 
 // declare classes
 class Camera;
 class Sampler;
+class RenderKernel;
 class PixelSample;
 class SORTOutput;
+class TiXmlNode;
+class TiXmlElement;
 
 /////////////////////////////////////////////////////////////////////
 //	definition of the system
@@ -42,6 +51,10 @@ public:
 	void PreProcess();
 	// render the image
 	void Render();
+	// compare acceleration structures instead of rendering
+	// para 'types'   : the accelerators separated by ',' , each could be followed by properties like 'bvh:sbvh=1'
+	// para 'ray_num' : the number of camera rays
+	void BenchmarkAccelerators( const string& types , unsigned ray_num );
 	// output the render target
 	void OutputRT();
 
@@ -55,10 +68,30 @@ public:
 
 	// get elapsed time
 	unsigned GetRenderingTime() const;
+	// get the time of pre-processing in milliseconds
+	unsigned GetPreProcessingTime() const { return m_uPreProcessingTime; }
 
 	// output log information
 	void OutputLog() const;
 
+	// set the file the statistics of each rendering are written to in json , empty disables it
+	// note : it is kept by 'Reset' , every rendering of the process replaces the file
+	void SetStatsFile( const string& filename ) { m_statsFile = filename; }
+
+	// render a frame of an animation , each run of '#' in the names of the scene file and the output files is replaced by it
+	// para 'frame' : the frame , a negative one keeps the names as they are
+	// note : it is kept by 'Reset' , the scene of the last frame is updated by 'Setup' if only its models moved or deformed
+	void SetFrame( int frame ) { m_frame = frame; }
+	// read the files of a frame ahead in the background , e.g. the next one while the current one is rendered
+	// para 'str'   : the setting file
+	// para 'frame' : the frame
+	void PrefetchFrame( const char* str , int frame );
+
+	// release the states of the rendering , the scene is kept for the next rendering
+	// para 'keep_scene' : whether the scene is kept , the next 'Setup' loads it again from its files otherwise
+	// note : the next 'Setup' reuses the scene if the files it is loaded from are unchanged
+	void Reset( bool keep_scene = true );
+
 	// uninitialize
 	void Uninit();
 
@@ -67,16 +100,51 @@ public:
 	// set resource path
 	void SetResourcePath( const string& str ) { m_ResourcePath = str; }
 
+	// get the number of threads used for rendering
+	unsigned GetThreadNum() const { return m_thread_num; }
+
+	// serve tasks of the rendering to the workers of a render farm , it has to be set before 'Render'
+	// para 'port' : the port the workers connect to , zero renders the image locally
+	void SetFarmPort( unsigned short port ) { m_farmPort = port; }
+
+	// copy the image of the first view to a buffer instead of writing it to its file , it has to be set before 'Setup'
+	// para 'pixels' : four floats for each pixel of the rendered region , it is dropped by 'Reset'
+	void SetOutputBuffer( float* pixels ) { m_outputBuffer = pixels; }
+	// render the tasks of the coordinator of a render farm instead of the whole image , it is set up by the same settings
+	// para 'host' : the host of the coordinator
+	// para 'port' : the port of the coordinator
+	void RenderFarmWorker( const string& host , unsigned short port );
+
 //private field:
 private:
-    // image sensor
+	// a camera along with the image sensor its image is rendered to
+	struct RenderView
+	{
+		Camera*			camera;
+		ImageSensor*	imagesensor;
+		// the name of the render kernel for the types of the camera , the integrator and the image sensor
+		string			kernel;
+	};
+	// the views rendered one after another , they share the scene
+	vector<RenderView>	m_views;
+	// the render loop specialized for the types of the view being rendered , the generic one is used if it is null
+	RenderKernel*	m_kernel = nullptr;
+	// the index of the view being rendered
+	unsigned		m_viewIndex;
+
+    // image sensor of the view being rendered
     ImageSensor*    m_imagesensor;
 
-	// the camera for the system
+	// the camera of the view being rendered
 	Camera*			m_camera;
+	// the buffer the image of the first view is copied to , the image is written to its file if it is null
+	float*			m_outputBuffer;
 
 	unsigned		m_totalTask;
 	bool*			m_taskDone;
+	// the time spent on each tile in the last pass in microseconds , tiles are indexed in scanline order , it is only measured for the priority order
+	std::unique_ptr<std::atomic<unsigned long long>[]>	m_taskCost;
+	unsigned		m_taskCostCnt = 0;
 	char*			m_pProgress;
 
 	// the integrator type
@@ -88,17 +156,39 @@ private:
 		string _property;
 	};
 	vector<Property>	m_integratorProperty;
+	// the statistics of the integrator of the last rendered view
+	StatsGroup			m_integratorStats;
+	// whether the first hits of the camera rays are found by rasterizing the scene instead of tracing them
+	bool			m_usePrimaryRaster;
+	// the bins of the raster pass of the view being rendered
+	PrimaryRaster	m_primaryRaster;
+	// the number of points of the pattern of each pixel of the primary cache , it is disabled if it is zero
+	unsigned		m_primaryCachePattern;
+	// the memory budget of the primary cache in megabytes
+	unsigned		m_primaryCacheMemory;
+	// whether the primary cache keeps the shadow rays towards delta lights too
+	bool			m_primaryCacheShadows;
+	// the first hits of the camera rays kept across the passes of progressive rendering , they are kept for the next rendering too
+	PrimaryCache	m_primaryCache;
 	// the scene for rendering
 	Scene			m_Scene;
 	// the sampler
 	Sampler*		m_pSampler;
 	// sample number per pixel
 	unsigned		m_iSamplePerPixel;
+	// pixels stop taking samples once the relative error is below it , zero disables adaptive sampling
+	float			m_adaptiveThreshold;
+	// sample number per pixel in each batch of adaptive sampling
+	unsigned		m_adaptiveBatch;
+	// the number of samples taken in all pixels
+	unsigned long long	m_sampleCnt;
 
 	// rendering time
 	unsigned		m_uRenderingTime;
 	// pre-processing time
 	unsigned		m_uPreProcessingTime;
+	// the time of loading the scene , it is zero if the scene of the last rendering is reused
+	unsigned		m_uLoadingTime;
 
 	// path for the resource
 	string			m_ResourcePath;
@@ -106,17 +196,159 @@ private:
 
 	// number of thread to allocate
 	unsigned		m_thread_num;
+	// how the threads are pinned to cpus
+	THREAD_AFFINITY	m_threadAffinity;
+
+	// size of render tiles , zero means it is picked from the resolution and the number of threads
+	unsigned		m_tileSize;
+	// minimum size of tiles split at the end of rendering , zero disables splitting
+	unsigned		m_tileSplitSize;
+	// tiles are split once fewer tiles than it are queued , zero means the number of threads
+	unsigned		m_tileStarvation;
+	// the order tiles are dealt to the threads , one of TILE_ORDER
+	unsigned		m_tileOrder;
+	// the point tiles of the priority order are rendered around first in coordinates relative to the image size , blender passes the point the artist looks at
+	Vector2f		m_tileFocus;
+	// the order of the pixels in each tile , one of PIXEL_ORDER
+	unsigned		m_pixelOrder;
+
+	// whether the image is rendered in passes over the whole image
+	bool			m_progressive;
+	// sample number per pixel in each pass
+	unsigned		m_passSamples;
+	// the number of preview levels of the first pass , the coarsest one renders every 2^n-th pixel along each axis , zero disables previewing
+	unsigned		m_previewLevels;
+	// rendering stops after the first pass exceeding the time budget in milliseconds , zero means no limit
+	unsigned		m_timeBudget;
+	// rendering stops once the estimated noise is below it , zero means no limit
+	float			m_noiseThreshold;
+	// sample number per pixel rendered in the finished passes , it starts from the first sample of a partial result
+	unsigned		m_samplesDone;
+	// the first sample of the pixels taken by a partial result of the image
+	unsigned		m_sampleFirst;
+	// whether only a range of the samples is taken , the sums of the samples are kept to be merged with other ranges
+	bool			m_partial;
+
+	// the checkpoint file , empty disables checkpointing
+	string			m_checkpointFile;
+	// the interval between two checkpoints in milliseconds
+	unsigned		m_checkpointInterval;
+	// the settings identifying the rendering , they are hashed with the scene into the key of checkpoints
+	string			m_checkpointParams;
+
+	// the file the memory usage of each subsystem is written to in json , empty disables it
+	string			m_memoryReportFile;
+	// the file the zones of the profiler are written to in the Chrome trace event format , empty disables it
+	string			m_profileFile;
+	// the file the statistics of all subsystems are written to in json , empty disables it
+	string			m_statsFile;
+	// the frame of the animation being rendered , the names of the files are kept if it is negative
+	int				m_frame = -1;
+	// the file the live progress and throughput are written to , empty disables it
+	string			m_telemetryFile;
+	// the interval between two updates of the live progress in milliseconds
+	unsigned		m_telemetryInterval;
+	// the running time when the rendering starts and when the live progress was updated last time
+	unsigned long	m_renderStart;
+	unsigned long	m_lastTelemetry;
+	// only one thread updates the live progress at a time
+	std::mutex		m_telemetryMutex;
+	// the key of the checkpoint of the current rendering
+	unsigned long long	m_checkpointKey;
+	// the rendering time when the last checkpoint was written
+	unsigned long	m_lastCheckpoint;
+	// only one thread writes a checkpoint at a time
+	std::mutex		m_checkpointMutex;
+	// the tiles finished before the rendering is resumed , they are not rendered again
+	vector<char>	m_resumedTasks;
+
+	// the port the render farm coordinator listens to , zero means the image is only rendered locally
+	unsigned short	m_farmPort;
+	// the coordinator serving tasks to the workers of the render farm
+	std::unique_ptr<FarmCoordinator>	m_farm;
+	// whether the workers of the render farm send the pixels as half floats
+	bool			m_farmHalfPixels;
+	// whether the workers of the render farm take tasks of the view being rendered
+	bool			m_farmEnabled;
+	// the view and the pass rendered by this process as a worker of the render farm , they change once all threads are idle
+	std::mutex		m_farmMutex;
+	int				m_farmView;
+	int				m_farmPass;
+	std::shared_ptr<Integrator>	m_farmIntegrator;
 
 	// pre-Initialize
 	void	_preInit();
+	// release the scene along with its materials and geometry data
+	void	_releaseScene();
+	// release the cameras and the image sensors of all views
+	void	_releaseViews();
+	// get the name of a file of the frame being rendered
+	// para 'str' : the name in the settings , it is kept as it is unless a frame is set
+	string	_frameName( const string& str ) const;
+	// create an image sensor with the settings of the rendering
+	// para 'root'     : the root of the render settings
+	// para 'output'   : the element of the output file , it could be null
+	// para 'filename' : the name of the output file
+	// para 'type'     : the type of the image sensor , it names the render kernel of the view
+	ImageSensor*	_createImageSensor( TiXmlNode* root , TiXmlElement* output , const string& filename , string& type );
 	// output progress
 	void	_outputProgress();
+	// write the statistics of all subsystems to the statistics file
+	void	_writeStats() const;
+	// get the finished part of the rendering from 0 to 1
+	float	_progress() const;
+	// update the live progress and throughput , it could be called by any render thread
+	// para 'force' : whether it is updated even if the interval hasn't passed
+	void	_publishTelemetry( bool force );
+	// called by the render thread finishing a task
+	void	_taskFinished();
+	// pick the size of render tiles
+	unsigned	_pickTileSize();
 	// uninitialize 3rd party library
 	void	_uninit3rdParty();
 	// do ray tracing in a multithread enviroment
 	void	_executeRenderingTasks();
+	// render one pass over the whole image
+	// para 'integrator' : the integrator
+	// para 'spp'        : the sample number per pixel of the pass
+	// para 'stride'     : only the pixels on a grid of the stride are rendered , it is larger than one for the levels of the preview
+	// para 'covered'    : the stride of the coarser preview level , its pixels are rendered already , zero starts a new pass
+	void	_renderPass( std::shared_ptr<Integrator> integrator , unsigned spp , unsigned stride = 1 , unsigned covered = 0 );
+	// render the first pass from coarse to fine grids of pixels , each level is shown upscaled before the finer one is rendered
+	// para 'integrator' : the integrator
+	// para 'spp'        : the sample number per pixel of the pass
+	void	_renderPreview( std::shared_ptr<Integrator> integrator , unsigned spp );
+	// render passes until one of the termination conditions is met
+	// para 'integrator' : the integrator
+	void	_renderProgressive( std::shared_ptr<Integrator> integrator );
+	// find the first hits of the camera rays by the raster pass or keep them across passes if the integrator accepts them
+	// para 'integrator' : the integrator of the view
+	void	_preparePrimaryHits( const Integrator* integrator );
 	// push rendering task
-	void	_pushRenderTask();
+	// para 'spp'     : the sample number per pixel of the tasks
+	// para 'stride'  : the stride of the grid of pixels rendered by the tasks
+	// para 'covered' : the stride of the grid of pixels rendered already
+	void	_pushRenderTask( unsigned spp , unsigned stride , unsigned covered );
+	// sort the tiles by their priorities , the tiles reducing the most visible error per second come first
+	// para 'tile_num'  : the number of tiles along each axis
+	// para 'tilesize'  : the size of the tiles
+	// result           : the tiles in the order they are rendered
+	std::vector<Vector2i>	_priorityOrder( const Vector2i& tile_num , unsigned tilesize );
+	// resume the rendering from the checkpoint if there is one of the same rendering
+	void	_loadCheckpoint();
+	// write a checkpoint
+	// para 'idle' : whether the render threads are idle , the states of their random number generators are only saved then
+	void	_saveCheckpoint( bool idle );
+	// write a checkpoint if the interval has passed since the last one , it could be called by any render thread
+	void	_checkpointTick();
 	// allocate integrator
 	Integrator*	_allocateIntegrator();
+	// get the key of the scene and the settings shared by the coordinator and the workers of the render farm
+	unsigned long long	_farmKey();
+	// render a task of the render farm coordinator as a worker
+	// para 'task'    : the task
+	// para 'data'    : the pixels of the task
+	// para 'samples' : the number of samples taken
+	// result         : false if the task isn't finished
+	bool	_renderFarmTask( const FarmTask& task , std::vector<float>& data , unsigned long long& samples );
 };
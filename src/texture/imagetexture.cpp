@@ -35,11 +35,15 @@ void ImageTexture::_init()
 Spectrum ImageTexture::GetColor( int x , int y ) const
 {
 	// if there is no image, just crash
-	sAssert( m_pMemory != 0 && m_pMemory->m_ImgMem != 0 , IMAGE );
+	sAssert( m_pTiled != nullptr || ( m_pMemory != 0 && m_pMemory->m_ImgMem != 0 ) , IMAGE );
 
 	// filter the texture coordinate
 	_texCoordFilter( x , y );
 
+	// the tile of the texel is brought in by the texture cache
+	if( m_pTiled )
+		return m_pTiled->GetTexel( 0 , x , y );
+
 	// get the offset
 	int offset = y * m_iTexWidth + x;
 
@@ -47,10 +51,81 @@ Spectrum ImageTexture::GetColor( int x , int y ) const
 	return m_pMemory->m_ImgMem[ offset ];
 }
 
+// get texture value filtered over the footprint of a pixel
+Spectrum ImageTexture::GetColor( float u , float v , float dudx , float dvdx , float dudy , float dvdy ) const
+{
+	// the axes of the footprint in texels of the full resolution image
+	const float xu = dudx * m_iTexWidth , xv = dvdx * m_iTexHeight;
+	const float yu = dudy * m_iTexWidth , yv = dvdy * m_iTexHeight;
+	const float lx = sqrtf( xu * xu + xv * xv );
+	const float ly = sqrtf( yu * yu + yv * yv );
+	const float major = max( lx , ly );
+	const float minor = min( lx , ly );
+
+	// magnified textures and images without mip levels are point sampled
+	if( m_pTiled == nullptr || major <= 1.0f )
+		return GetColorFromUV( u , v );
+
+	// footprints seen at grazing angles are long and thin , a single lookup as wide as the major axis blurs them
+	// too much across the minor axis , so the lookups are spread along the major axis instead
+	const unsigned probes = (unsigned)min( ceilf( major / max( minor , 1.0f ) ) , (float)TEX_MAX_ANISOTROPY );
+	const float width = max( major / probes , minor );
+	const float du = ( lx > ly ) ? dudx : dudy;
+	const float dv = ( lx > ly ) ? dvdx : dvdy;
+
+	// the level with texels as wide as the lookups , it is blended with the next coarser one
+	const float level = min( log2f( max( width , 1.0f ) ) , (float)( m_pTiled->GetLevelCount() - 1 ) );
+	const unsigned l0 = (unsigned)level;
+	const float t = ( l0 + 1 < m_pTiled->GetLevelCount() ) ? level - (float)l0 : 0.0f;
+
+	Spectrum color;
+	for( unsigned i = 0 ; i < probes ; ++i )
+	{
+		const float offset = ( i + 0.5f ) / probes - 0.5f;
+		const float pu = u + offset * du;
+		const float pv = v + offset * dv;
+		color += ( t > 0.0f ) ? _bilinear( l0 , pu , pv ) * ( 1.0f - t ) + _bilinear( l0 + 1 , pu , pv ) * t : _bilinear( l0 , pu , pv );
+	}
+	return color / (float)probes;
+}
+
+// get texture values of many lookups filtered over their footprints
+void ImageTexture::GetColors( const TexLookup* lookups , Spectrum* colors , unsigned count ) const
+{
+	for( unsigned i = 0 ; i < count ; ++i )
+	{
+		const TexLookup& l = lookups[i];
+		colors[i] = GetColor( l.u , l.v , l.dudx , l.dvdx , l.dudy , l.dvdy );
+	}
+}
+
+// bilinearly filter a mip level
+Spectrum ImageTexture::_bilinear( unsigned level , float u , float v ) const
+{
+	const unsigned w = m_pTiled->GetWidth( level );
+	const unsigned h = m_pTiled->GetHeight( level );
+
+	// texel centers are at half integers , the same as point sampling
+	const float s = u * w - 0.5f;
+	const float t = v * h - 0.5f;
+	const float fs = floorf( s );
+	const float ft = floorf( t );
+	const float ds = s - fs;
+	const float dt = t - ft;
+
+	int x0 = (int)fs , y0 = (int)ft;
+	int x1 = x0 + 1 , y1 = y0 + 1;
+	_texCoordFilter( x0 , y0 , w , h );
+	_texCoordFilter( x1 , y1 , w , h );
+
+	return m_pTiled->GetBilinear( level , x0 , y0 , x1 , y1 , ds , dt );
+}
+
 // release the texture memory
 void ImageTexture::Release()
 {
 	m_pMemory = 0;
+	m_pTiled = nullptr;
 	m_iTexWidth = 0;
 	m_iTexHeight = 0;
 }
@@ -85,19 +160,16 @@ Spectrum ImageTexture::GetAverage() const
 // compute average radiance
 void ImageTexture::_average()
 {
+	// the average of tiled images is computed during the conversion
+	if( m_pTiled )
+	{
+		m_Average = m_pTiled->GetAverage();
+		return;
+	}
+
 	// if there is no image, just crash
 	if( m_pMemory == 0 || m_pMemory->m_ImgMem == 0 )
 		return;
 
-	Spectrum average;
-	for( unsigned i = 0 ; i < m_iTexHeight ; ++i )
-		for( unsigned j = 0 ; j < m_iTexWidth ; ++j )
-		{
-			// get the offset
-			int offset = i * m_iTexWidth + j;
-			// get the color
-			average += m_pMemory->m_ImgMem[ offset ];
-		}
-
-	m_Average = average / (float)( m_iTexWidth * m_iTexHeight );
+	m_Average = m_pMemory->GetAverage();
 }
@@ -22,6 +22,9 @@
 #include "texture.h"
 #include "managers/texmanager.h"
 
+// the maximum number of lookups along the footprint of a pixel
+#define TEX_MAX_ANISOTROPY	8
+
 ///////////////////////////////////////////////////////////////
 // definition of image texture
 class ImageTexture : public Texture 
@@ -57,6 +60,23 @@ public:
 		return GetColor( w , h );
 	}
 
+	// get texture value filtered over the footprint of a pixel
+	// para 'u' , 'v'     : texture coordinate
+	// para 'dudx' , 'dvdx' : the change of the texture coordinate to the next pixel along x
+	// para 'dudy' , 'dvdy' : the change of the texture coordinate to the next pixel along y
+	// result             : spectrum value , it is filtered trilinearly between two mip levels if the footprint
+	//						is wider than a texel , otherwise the texture is point sampled. Long footprints take
+	//						up to 'TEX_MAX_ANISOTROPY' lookups along their major axis.
+	Spectrum GetColor( float u , float v , float dudx , float dvdx , float dudy , float dvdy ) const;
+
+	// get texture values of many lookups filtered over their footprints
+	// para 'lookups' : the lookups
+	// para 'colors'  : the filtered values of the lookups
+	// para 'count'   : the number of lookups
+	// note           : it gives the same values with filtering the lookups one by one , lookups of hits
+	//					close to each other mostly stay in the tiles pinned by the previous ones
+	void GetColors( const TexLookup* lookups , Spectrum* colors , unsigned count ) const;
+
 	// it means nothing to set the size of the image file
 	// set the size of the texture
 	virtual void	SetSize( unsigned w , unsigned h ){}
@@ -65,14 +85,16 @@ public:
 	virtual void Release();
 
 	// whether the image is valid
-	bool IsValid() { return (bool)m_pMemory; }
+	bool IsValid() { return m_pTiled != nullptr || (bool)m_pMemory; }
 
 	// get average color
 	Spectrum GetAverage() const;
 
 // private field
 private:
-	// array saving the color of image
+	// the tiles of the image , they are read by the texture cache on demand
+	TiledImage*	m_pTiled = nullptr;
+	// array saving the color of image , it is only used if the image can't be tiled
     std::shared_ptr<ImgMemory>	m_pMemory;
 
 	// the average radiance of the texture
@@ -83,6 +105,8 @@ private:
 	void	_init();
 	// compute average radiance
 	void	_average();
+	// bilinearly filter a mip level
+	Spectrum	_bilinear( unsigned level , float u , float v ) const;
 
 	// set texture manager as a friend
 	friend class TexManager;
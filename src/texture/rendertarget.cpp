@@ -18,21 +18,109 @@
 // include the header file
 #include "rendertarget.h"
 #include "log/log.h"
+#include "utility/hugepage.h"
+#include <cstring>
+
+// release the memory
+void RenderTarget::Release()
+{
+	HugePages::Free( m_pixels );
+	m_pixels = nullptr;
+	m_iTexWidth = 0;
+	m_iTexHeight = 0;
+}
+
+// set the size for the render target
+void RenderTarget::SetSize( unsigned w , unsigned h )
+{
+	if( w == 0 )
+		slog( WARNING , IMAGE , "Width of the texture is 0." );
+	if( h == 0 )
+		slog( WARNING , IMAGE , "Height of the texture is 0." );
+
+	Release();
+	m_iTexWidth = w;
+	m_iTexHeight = h;
+
+	const size_t bytes = sizeof( float ) * PIXEL_FLOATS * w * h;
+	m_pixels = (float*)HugePages::Alloc( bytes );
+	sAssertMsg( m_pixels || bytes == 0 , IMAGE , "Failed to allocate the pixels of the render target." );
+	memset( m_pixels , 0 , bytes );
+}
+
+// get the color
+Spectrum RenderTarget::GetColor( int x , int y ) const
+{
+	sAssertMsg( m_pixels , IMAGE , "No memory in the render target, can't get color." );
+
+	// coordinates in range are read directly , the filter is only for the ones out of range
+	if( (unsigned)x >= m_iTexWidth || (unsigned)y >= m_iTexHeight )
+		_texCoordFilter( x , y );
+
+	const float* pixel = GetPixel( x , y );
+	return Spectrum( pixel[0] , pixel[1] , pixel[2] );
+}
 
 // set the color
 void RenderTarget::SetColor( int x , int y , float r , float g , float b )
 {
 	// check if there is memory
-    sAssertMsg( m_pData , IMAGE , "There is no data in render target , can't set color" );
-    
-	// use filter first
-	_texCoordFilter( x , y );
+	sAssertMsg( m_pixels , IMAGE , "There is no data in render target , can't set color" );
+
+	if( (unsigned)x >= m_iTexWidth || (unsigned)y >= m_iTexHeight )
+		_texCoordFilter( x , y );
+
+	float* pixel = GetPixel( x , y );
+	pixel[0] = r;
+	pixel[1] = g;
+	pixel[2] = b;
+}
 
-	// get the offset
-	unsigned offset = y * m_iTexWidth + x;
+// copy a rectangle of pixels from a buffer
+void RenderTarget::WriteRect( int x , int y , int w , int h , const float* src , unsigned stride )
+{
+	sAssert( x >= 0 && y >= 0 && x + w <= (int)m_iTexWidth && y + h <= (int)m_iTexHeight , IMAGE );
+	if( w <= 0 )
+		return;
 
-	// set the color
-	m_pData[offset].SetColor( r , g , b );
+	// the rows of the rectangle are contiguous in both buffers
+	const size_t row_bytes = sizeof( float ) * PIXEL_FLOATS * w;
+	if( stride == m_iTexWidth && w == (int)m_iTexWidth ){
+		memcpy( GetPixel( x , y ) , src , row_bytes * h );
+		return;
+	}
+	for( int i = 0 ; i < h ; ++i )
+		memcpy( GetPixel( x , y + i ) , src + (size_t)PIXEL_FLOATS * stride * i , row_bytes );
 }
 
+// copy a rectangle of pixels to a buffer
+void RenderTarget::ReadRect( int x , int y , int w , int h , float* dst , unsigned stride ) const
+{
+	sAssert( x >= 0 && y >= 0 && x + w <= (int)m_iTexWidth && y + h <= (int)m_iTexHeight , IMAGE );
+	if( w <= 0 )
+		return;
 
+	const size_t row_bytes = sizeof( float ) * PIXEL_FLOATS * w;
+	if( stride == m_iTexWidth && w == (int)m_iTexWidth ){
+		memcpy( dst , GetPixel( x , y ) , row_bytes * h );
+		return;
+	}
+	for( int i = 0 ; i < h ; ++i )
+		memcpy( dst + (size_t)PIXEL_FLOATS * stride * i , GetPixel( x , y + i ) , row_bytes );
+}
+
+// set a rectangle of pixels to black
+void RenderTarget::ClearRect( int x , int y , int w , int h )
+{
+	sAssert( x >= 0 && y >= 0 && x + w <= (int)m_iTexWidth && y + h <= (int)m_iTexHeight , IMAGE );
+	if( w <= 0 )
+		return;
+
+	const size_t row_bytes = sizeof( float ) * PIXEL_FLOATS * w;
+	if( w == (int)m_iTexWidth ){
+		memset( GetPixel( x , y ) , 0 , row_bytes * h );
+		return;
+	}
+	for( int i = 0 ; i < h ; ++i )
+		memset( GetPixel( x , y + i ) , 0 , row_bytes );
+}
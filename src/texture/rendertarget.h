@@ -18,18 +18,38 @@
 #pragma once
 
 // include the header file
-#include "compositetexture.h"
+#include "texture.h"
 
 /////////////////////////////////////////////////////////////////////////
 //	definition of render target
 //	all of the generated image will be rendered to render target.
-class	RenderTarget : public ComTexture
+//	pixels are kept in rows of four floats , the fourth one is padding kept at zero.
+//	the rows are aligned so that a pixel never straddles a cache line , whole rows
+//	and rectangles of pixels are copied with memcpy instead of a call for each pixel.
+class	RenderTarget : public Texture
 {
 //public method
 public:
+	// the number of floats of a pixel
+	static const unsigned PIXEL_FLOATS = 4;
+
 	// constructor and destructor
 	RenderTarget(){}
-	~RenderTarget(){}
+	~RenderTarget(){ Release(); }
+
+	// release the memory
+	void Release();
+
+	// set the size for the render target , all pixels are black
+	// para 'w' : width of the render target
+	// para 'h' : height of the render target
+	virtual void SetSize( unsigned w , unsigned h );
+
+	// get color from render target
+	// para 'x' : x coordinate
+	// para 'y' : y coordinate
+	// result   : the color of the pixel , coordinates out of range are filtered
+	virtual Spectrum GetColor( int x , int y ) const;
 
 	// para 'x' : x coordinate
 	// para 'y' : y coordinate
@@ -45,4 +65,46 @@ public:
 	{
 		SetColor( x , y , c.GetR() , c.GetG() , c.GetB() );
 	}
+
+	// the pixels in rows of four floats
+	virtual const float* GetPixels() const { return m_pixels; }
+
+	// the pixel at a position , the coordinates have to be in range
+	// para 'x' : x coordinate
+	// para 'y' : y coordinate
+	float* GetPixel( int x , int y ) { return m_pixels + PIXEL_FLOATS * ( (size_t)y * m_iTexWidth + x ); }
+	const float* GetPixel( int x , int y ) const { return m_pixels + PIXEL_FLOATS * ( (size_t)y * m_iTexWidth + x ); }
+
+	// copy a rectangle of pixels from a buffer , the rectangle has to be in range
+	// para 'x'      : x coordinate of the top left corner
+	// para 'y'      : y coordinate of the top left corner
+	// para 'w'      : width of the rectangle
+	// para 'h'      : height of the rectangle
+	// para 'src'    : the pixels in rows of four floats
+	// para 'stride' : the number of pixels between the rows of the buffer
+	void WriteRect( int x , int y , int w , int h , const float* src , unsigned stride );
+
+	// copy a rectangle of pixels to a buffer , the rectangle has to be in range
+	// para 'x'      : x coordinate of the top left corner
+	// para 'y'      : y coordinate of the top left corner
+	// para 'w'      : width of the rectangle
+	// para 'h'      : height of the rectangle
+	// para 'dst'    : the pixels in rows of four floats
+	// para 'stride' : the number of pixels between the rows of the buffer
+	void ReadRect( int x , int y , int w , int h , float* dst , unsigned stride ) const;
+
+	// set a rectangle of pixels to black , the rectangle has to be in range
+	// para 'x' : x coordinate of the top left corner
+	// para 'y' : y coordinate of the top left corner
+	// para 'w' : width of the rectangle
+	// para 'h' : height of the rectangle
+	void ClearRect( int x , int y , int w , int h );
+
+// private field
+private:
+	// the pixels , they are aligned to a cache line
+	float*	m_pixels = nullptr;
+
+	RenderTarget( const RenderTarget& ) = delete;
+	RenderTarget& operator=( const RenderTarget& ) = delete;
 };
@@ -65,34 +65,45 @@ void Texture::SetTexCoordFilter( TEXCOORDFILTER mode )
 
 // do texture coordinate filter
 void Texture::_texCoordFilter( int& x , int& y ) const
+{
+	_texCoordFilter( x , y , m_iTexWidth , m_iTexHeight );
+}
+
+// wrap a coordinate by repeating the image , the sign of the coordinate selects the result by a mask instead of a branch
+static inline int _warpCoord( int x , int n )
+{
+	const int neg = x >> 31;
+	const int r = ( ( x ^ neg ) - neg ) % n;
+	return r + ( neg & ( n - 1 - 2 * r ) );
+}
+
+// wrap a coordinate by mirroring the image every other time , without branches either
+static inline int _mirrorCoord( int x , int n )
+{
+	int neg = x >> 31;
+	x += neg & ( 1 - 2 * x );
+	x = x % ( 2 * n ) - n;
+	neg = x >> 31;
+	x += neg & ( 1 - 2 * x );
+	return n - 1 - x;
+}
+
+// do texture coordinate filter with the size of a mip level
+void Texture::_texCoordFilter( int& x , int& y , unsigned w , unsigned h ) const
 {
 	switch( m_TexCoordFilter )
 	{
 	case TCF_WARP:
-		if( x >= 0 ) 
-			x = x % m_iTexWidth;
-		else
-			x = m_iTexWidth - ( -x ) % m_iTexWidth - 1;
-		if( y >= 0 )
-			y = y % m_iTexHeight;
-		else
-			y = m_iTexHeight - ( -y ) % m_iTexHeight - 1;
+		x = _warpCoord( x , (int)w );
+		y = _warpCoord( y , (int)h );
 		break;
 	case TCF_CLAMP:
-		x = min( (int)m_iTexWidth - 1 , max( x , 0 ) );
-		y = min( (int)m_iTexHeight - 1 , max( y , 0 ) );
+		x = min( (int)w - 1 , max( x , 0 ) );
+		y = min( (int)h - 1 , max( y , 0 ) );
 		break;
 	case TCF_MIRROR:
-		x = ( x >= 0 )?x:(1-x);
-		x = x % ( 2 * m_iTexWidth );
-		x -= m_iTexWidth;
-		x = ( x >= 0 )?x:(1-x);
-		x = m_iTexWidth - 1 - x;
-		y = ( y >= 0 )?y:(1-y);
-		y = y % ( 2 * m_iTexHeight );
-		y -= m_iTexHeight;
-		y = ( y >= 0 )?y:(1-y);
-		y = m_iTexHeight - 1 - y;
+		x = _mirrorCoord( x , (int)w );
+		y = _mirrorCoord( y , (int)h );
 		break;
 	}
 }
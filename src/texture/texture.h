@@ -28,6 +28,14 @@
 class ComTexture;
 class Intersection;
 
+// a lookup filtered over the footprint of a pixel
+struct TexLookup
+{
+	float u , v;			// texture coordinate
+	float dudx , dvdx;		// the change of the texture coordinate to the next pixel along x
+	float dudy , dvdy;		// the change of the texture coordinate to the next pixel along y
+};
+
 //////////////////////////////////////////////////////////////
 // definition of class Texture
 class Texture : public PropertySet<Texture>
@@ -94,6 +102,10 @@ public:
 	// whether the texture is valid
 	virtual bool IsValid() { return true; }
 
+	// the pixels of the texture in rows of four floats
+	// result : the pixels , it is nullptr if the texture is only read by GetColor
+	virtual const float* GetPixels() const { return nullptr; }
+
 // protected field
 protected:
 	// the size of the texture
@@ -112,6 +124,8 @@ protected:
 
 	// do texture filter
 	void _texCoordFilter( int& u , int&v ) const;
+	// do texture filter with the size of a mip level
+	void _texCoordFilter( int& u , int&v , unsigned w , unsigned h ) const;
 
 // set friend class
 friend ComTexture operator-( float t , const Texture& tex );
@@ -1,10 +1,14 @@
-// Hand-crafted version of config/IlmBaseConfig.h for Windows
+// Hand-crafted version of config/IlmBaseConfig.h for Windows , POSIX threads are used on the other platforms
 //
 // Define and set to 1 if the target system has POSIX thread support
 // and you want IlmBase to use it for multithreaded file I/O.
 //
 
+#if !defined _WIN32 && !defined _WIN64
+#define HAVE_PTHREAD 1
+#else
 #undef HAVE_PTHREAD
+#endif
 
 //
 // Define and set to 1 if the target system supports POSIX semaphores
@@ -12,5 +16,9 @@
 // own semaphore implementation.
 //
 
+#if !defined _WIN32 && !defined _WIN64 && !defined __APPLE__
+#define HAVE_POSIX_SEMAPHORES 1
+#else
 #undef HAVE_POSIX_SEMAPHORES
+#endif
 
@@ -2372,8 +2372,17 @@ int get_prop_type(char *type_name)
 {
   int i;
 
+  /* sized type names used by newer writers */
+  static const char *sized_names[] = {
+    "invalid",
+    "int8", "int16", "int32",
+    "uint8", "uint16", "uint32",
+    "float32", "float64",
+  };
+
   for (i = PLY_START_TYPE + 1; i < PLY_END_TYPE; i++)
-    if (equal_strings (type_name, type_names[i]))
+    if (equal_strings (type_name, type_names[i]) ||
+        equal_strings (type_name, sized_names[i]))
       return (i);
 
   /* if we get here, we didn't find the type */
@@ -719,7 +719,11 @@ static BPMNode* bpmnode_create(BPMLists* lists, int weight, unsigned index, BPMN
   return result;
 }
 
+#if defined(_MSC_VER)
 static int __cdecl bpmnode_compare(const void* a, const void* b)
+#else
+static int bpmnode_compare(const void* a, const void* b)
+#endif
 {
   int wa = ((const BPMNode*)a)->weight;
   int wb = ((const BPMNode*)b)->weight;
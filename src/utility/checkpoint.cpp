@@ -0,0 +1,104 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "checkpoint.h"
+#include "accel/accelcache.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include <fstream>
+#include <stdio.h>
+
+static const char CHECKPOINT_MAGIC[4] = { 'S' , 'C' , 'K' , 'P' };
+static const unsigned CHECKPOINT_VERSION = 2;
+
+// header of the checkpoint file
+struct CheckpointHeader
+{
+	char				magic[4];
+	unsigned			version;
+	unsigned long long	key;
+	unsigned long long	size;		// size of the payload in bytes
+	unsigned long long	checksum;	// hash of the payload
+};
+
+// write the checkpoint
+bool RenderCheckpoint::Save( const string& filename , unsigned long long key , const std::vector<char>& payload )
+{
+	CheckpointHeader header;
+	memcpy( header.magic , CHECKPOINT_MAGIC , sizeof( CHECKPOINT_MAGIC ) );
+	header.version = CHECKPOINT_VERSION;
+	header.key = key;
+	header.size = payload.size();
+	header.checksum = AccelCache::Hash( payload.data() , payload.size() );
+
+	const string temp = filename + ".tmp";
+	{
+		std::ofstream file( temp.c_str() , std::ios::binary | std::ios::trunc );
+		if( file.is_open() ){
+			file.write( (const char*)&header , sizeof( header ) );
+			file.write( payload.data() , payload.size() );
+		}
+		if( !file.is_open() || !file ){
+			slog( WARNING , GENERAL , stringFormat( "Failed to write checkpoint %s." , temp.c_str() ) );
+			return false;
+		}
+	}
+
+	// rename doesn't replace existing files on Windows
+	remove( filename.c_str() );
+	if( rename( temp.c_str() , filename.c_str() ) != 0 ){
+		slog( WARNING , GENERAL , stringFormat( "Failed to write checkpoint %s." , filename.c_str() ) );
+		return false;
+	}
+	return true;
+}
+
+// load the checkpoint
+bool RenderCheckpoint::Load( const string& filename , unsigned long long key , std::vector<char>& payload )
+{
+	std::ifstream file( filename.c_str() , std::ios::binary | std::ios::ate );
+	if( !file.is_open() )
+		return false;
+	const size_t size = (size_t)file.tellg();
+	CheckpointHeader header;
+	if( size < sizeof( header ) )
+		return false;
+	file.seekg( 0 );
+	file.read( (char*)&header , sizeof( header ) );
+
+	if( memcmp( header.magic , CHECKPOINT_MAGIC , sizeof( CHECKPOINT_MAGIC ) ) != 0 || header.version != CHECKPOINT_VERSION ){
+		slog( DEBUG , GENERAL , stringFormat( "Checkpoint %s is ignored, it is not a checkpoint of the current version." , filename.c_str() ) );
+		return false;
+	}
+	if( header.key != key ){
+		slog( INFO , GENERAL , stringFormat( "Checkpoint %s is ignored, it belongs to a different scene or different settings." , filename.c_str() ) );
+		return false;
+	}
+	if( header.size != size - sizeof( header ) ){
+		slog( WARNING , GENERAL , stringFormat( "Checkpoint %s is corrupted." , filename.c_str() ) );
+		return false;
+	}
+
+	payload.resize( (size_t)header.size );
+	if( header.size )
+		file.read( &payload[0] , (size_t)header.size );
+	if( !file || header.checksum != AccelCache::Hash( payload.data() , payload.size() ) ){
+		slog( WARNING , GENERAL , stringFormat( "Checkpoint %s is corrupted." , filename.c_str() ) );
+		return false;
+	}
+	return true;
+}
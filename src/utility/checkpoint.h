@@ -0,0 +1,48 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//	definition of render checkpoint
+//	desc :	A versioned file holding the state of an unfinished
+//			rendering. The payload is written by the system , it is
+//			only loaded back if the key of the file matches , which is
+//			a hash of the scene and the rendering settings. The file is
+//			written to a temporary one first and renamed afterward , so
+//			a process killed while writing never leaves a broken file.
+class	RenderCheckpoint
+{
+// public method
+public:
+	// write the checkpoint
+	// para 'filename' : the name of the checkpoint file
+	// para 'key'      : the key of the rendering
+	// para 'payload'  : the state of the rendering
+	// result          : true if the file is written
+	static bool Save( const string& filename , unsigned long long key , const std::vector<char>& payload );
+
+	// load the checkpoint
+	// para 'filename' : the name of the checkpoint file
+	// para 'key'      : the expected key of the rendering
+	// para 'payload'  : the state of the rendering
+	// result          : true if there is a valid checkpoint of the same rendering
+	static bool Load( const string& filename , unsigned long long key , std::vector<char>& payload );
+};
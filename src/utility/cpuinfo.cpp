@@ -0,0 +1,131 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "cpuinfo.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define SORT_CPU_X86
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+#if defined(SORT_CPU_X86)
+// cpuid of a leaf and sub-leaf , the registers are eax , ebx , ecx and edx
+static void cpuid( unsigned leaf , unsigned subleaf , unsigned regs[4] )
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex( r , (int)leaf , (int)subleaf );
+    for( int i = 0 ; i < 4 ; ++i )
+        regs[i] = (unsigned)r[i];
+#else
+    __cpuid_count( leaf , subleaf , regs[0] , regs[1] , regs[2] , regs[3] );
+#endif
+}
+
+// the register states enabled by the operating system
+static unsigned long long xgetbv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv( 0 );
+#else
+    unsigned eax , edx;
+    __asm__ __volatile__( "xgetbv" : "=a"( eax ) , "=d"( edx ) : "c"( 0 ) );
+    return ( (unsigned long long)edx << 32 ) | eax;
+#endif
+}
+
+// detect the instruction set with cpuid
+static CPU_ISA detectCpuIsa()
+{
+    unsigned regs[4];
+    cpuid( 0 , 0 , regs );
+    const unsigned max_leaf = regs[0];
+
+    cpuid( 1 , 0 , regs );
+    const unsigned ecx1 = regs[2] , edx1 = regs[3];
+    if( ( edx1 & ( 1u << 26 ) ) == 0 )
+        return CPU_ISA_GENERIC;
+    if( ( ecx1 & ( 1u << 20 ) ) == 0 )
+        return CPU_ISA_SSE2;
+
+    // AVX registers are only usable if the operating system saves the xmm and ymm states
+    const bool osxsave = ( ecx1 & ( 1u << 27 ) ) != 0;
+    const unsigned long long xcr0 = osxsave ? xgetbv() : 0;
+    if( ( ecx1 & ( 1u << 28 ) ) == 0 || ( xcr0 & 0x6 ) != 0x6 )
+        return CPU_ISA_SSE42;
+
+    if( max_leaf < 7 )
+        return CPU_ISA_AVX;
+    cpuid( 7 , 0 , regs );
+    const unsigned ebx7 = regs[1];
+    const bool fma = ( ecx1 & ( 1u << 12 ) ) != 0;
+    if( ( ebx7 & ( 1u << 5 ) ) == 0 || !fma )
+        return CPU_ISA_AVX;
+
+    // AVX-512 needs the opmask and the upper zmm states as well
+    if( ( ebx7 & ( 1u << 16 ) ) == 0 || ( xcr0 & 0xe6 ) != 0xe6 )
+        return CPU_ISA_AVX2;
+    return CPU_ISA_AVX512;
+}
+#endif
+
+// the best instruction set of the processor
+CPU_ISA GetCpuIsa()
+{
+#if defined(SORT_CPU_X86)
+    static const CPU_ISA isa = detectCpuIsa();
+    return isa;
+#else
+    return CPU_ISA_GENERIC;
+#endif
+}
+
+// the instruction set the program is compiled for
+CPU_ISA GetCompiledIsa()
+{
+#if defined(SORT_SIMD_AVX512)
+    return CPU_ISA_AVX512;
+#elif defined(SORT_SIMD_AVX2)
+    return CPU_ISA_AVX2;
+#elif defined(SORT_SIMD_AVX)
+    return CPU_ISA_AVX;
+#elif defined(SORT_SIMD_SSE42)
+    return CPU_ISA_SSE42;
+#elif defined(SORT_SIMD_SSE2)
+    return CPU_ISA_SSE2;
+#else
+    return CPU_ISA_GENERIC;
+#endif
+}
+
+// the name of an instruction set
+const char* GetCpuIsaName( CPU_ISA isa )
+{
+    switch( isa ){
+    case CPU_ISA_SSE2:      return "SSE2";
+    case CPU_ISA_SSE42:     return "SSE4.2";
+    case CPU_ISA_AVX:       return "AVX";
+    case CPU_ISA_AVX2:      return "AVX2";
+    case CPU_ISA_AVX512:    return "AVX-512";
+    default:                return "generic";
+    }
+}
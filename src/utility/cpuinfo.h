@@ -0,0 +1,52 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "sort.h"
+
+//! @brief Instruction sets that kernels have variants for, each one includes the previous ones.
+enum CPU_ISA
+{
+    CPU_ISA_GENERIC = 0,    /**< No SIMD instruction set is detected, it is the case for other architectures than x86. */
+    CPU_ISA_SSE2,           /**< SSE and SSE2, every x86-64 processor supports them. */
+    CPU_ISA_SSE42,          /**< Up to SSE4.2. */
+    CPU_ISA_AVX,            /**< AVX with its registers saved by the operating system. */
+    CPU_ISA_AVX2,           /**< AVX2 and FMA. */
+    CPU_ISA_AVX512,         /**< AVX-512 foundation with its registers saved by the operating system. */
+};
+
+//! @brief The best instruction set of the processor running the program.
+//!
+//! It is detected with cpuid the first time it is queried. Kernels that have variants for wider
+//! instruction sets than the ones the program is compiled for choose one of them with it.
+CPU_ISA GetCpuIsa();
+
+//! @brief The instruction set the program is compiled for, kernels without a variant run with it.
+CPU_ISA GetCompiledIsa();
+
+//! @brief The name of an instruction set.
+const char* GetCpuIsaName( CPU_ISA isa );
+
+// functions with it can use the instructions of AVX even if the program is compiled for an older
+// instruction set , they should only be called if GetCpuIsa reports AVX or later
+#if defined(__GNUC__) || defined(__clang__)
+    #define SORT_TARGET_AVX __attribute__((target("avx")))
+#else
+    #define SORT_TARGET_AVX
+#endif
@@ -18,11 +18,19 @@
 #pragma once
 
 #include "sort.h"
+#include <float.h>
+#include <stdint.h>
+#include <cmath>
+
+#if defined(SORT_IN_WINDOWS)
+#include <malloc.h>
+#endif
 
 #define	PI		3.1415926f
 #define	TWO_PI	6.2831852f
 #define	INV_PI	0.3183099f
 #define INV_TWOPI 0.15915494f
+#define INV_FOUR_PI 0.07957747f
 
 // some useful macro
 #define SAFE_DELETE(p) { if(p) { delete p; p = 0; } }
@@ -34,6 +42,27 @@
 #define Thread_Local __thread
 #endif
 
+// aligned memory allocation
+inline void* sort_aligned_malloc( size_t size , size_t alignment )
+{
+#if defined(SORT_IN_WINDOWS)
+	return _aligned_malloc( size , alignment );
+#else
+	void* ptr = 0;
+	if( posix_memalign( &ptr , alignment , size ) != 0 )
+		return 0;
+	return ptr;
+#endif
+}
+inline void sort_aligned_free( void* ptr )
+{
+#if defined(SORT_IN_WINDOWS)
+	_aligned_free( ptr );
+#else
+	free( ptr );
+#endif
+}
+
 // math macros
 #define saturate(x) max(0.0f,min(1.0f,x))
 inline float clamp( float x , float mi , float ma )
@@ -42,3 +71,39 @@ inline float clamp( float x , float mi , float ma )
 	if( x < mi ) x = mi;
 	return x;
 }
+
+// the bound of the relative rounding error of 'n' float operations , it is the gamma of Higham
+// note : each operation rounds its exact result within half of FLT_EPSILON
+inline float ErrorBound( int n )
+{
+	const float eps = FLT_EPSILON * 0.5f;
+	return ( n * eps ) / ( 1.0f - n * eps );
+}
+
+// the next float towards positive infinity , infinities and nans are kept
+inline float NextFloatUp( float v )
+{
+	if( std::isinf( v ) && v > 0.0f )
+		return v;
+	if( v == -0.0f )
+		v = 0.0f;
+	uint32_t bits;
+	memcpy( &bits , &v , sizeof( float ) );
+	bits = ( v >= 0.0f ) ? bits + 1 : bits - 1;
+	memcpy( &v , &bits , sizeof( float ) );
+	return v;
+}
+
+// the next float towards negative infinity , infinities and nans are kept
+inline float NextFloatDown( float v )
+{
+	if( std::isinf( v ) && v < 0.0f )
+		return v;
+	if( v == 0.0f )
+		v = -0.0f;
+	uint32_t bits;
+	memcpy( &bits , &v , sizeof( float ) );
+	bits = ( v > 0.0f ) ? bits - 1 : bits + 1;
+	memcpy( &v , &bits , sizeof( float ) );
+	return v;
+}
@@ -26,9 +26,53 @@ enum TEX_TYPE
     TT_PNG = 3,
 	TT_JPG = 4,
 	TT_HDR = 5,
+	TT_DDS = 6,
+	TT_KTX = 7,
 	TT_NONE ,
 };
 
+// storage format of texels
+enum TEX_FORMAT
+{
+	TF_RGB32F = 0,		// three floats
+	TF_RGB16F ,			// three half floats
+	TF_RGBA8 ,			// four bytes , the alpha channel is reserved
+	TF_RG8 ,			// two bytes , the blue channel is zero
+	TF_R8 ,				// one byte shared by all channels
+	TF_BC1 ,			// blocks of 4x4 texels in eight bytes , two colors of 5:6:5 bits interpolated
+	TF_BC4 ,			// blocks of 4x4 texels in eight bytes , one channel shared by all channels
+	TF_BC5 ,			// blocks of 4x4 texels in sixteen bytes , two channels and the blue channel is zero
+	TF_BC7 ,			// blocks of 4x4 texels in sixteen bytes , eight modes of up to three color lines
+};
+
+// arbitrary output variables of an image , they are parts of the radiance or properties of the first hit of the camera rays
+enum AOV_TYPE
+{
+	AOV_ALBEDO = 0,		// the reflectance of the first hit
+	AOV_NORMAL ,		// the shading normal of the first hit in world space
+	AOV_DEPTH ,			// the distance from the camera to the first hit , it is kept in every channel
+	AOV_DIRECT ,		// the radiance of emitters seen directly or reflected once
+	AOV_INDIRECT ,		// the radiance reflected more than once
+	AOV_COUNT
+};
+
+// the reconstruction filter of pixels
+enum FILTER_TYPE
+{
+	FILTER_BOX = 0,			// the average of the samples in the pixel
+	FILTER_GAUSSIAN ,		// the gaussian falling to zero at the radius
+	FILTER_MITCHELL ,		// the cubic of Mitchell and Netravali , it sharpens the image with its negative lobes
+	FILTER_BLACKMAN_HARRIS	// the window of Blackman and Harris , it is close to a gaussian with less blurring
+};
+
+// the denoiser of the final image
+enum DENOISER_TYPE
+{
+	DENOISER_NONE = 0,		// the image is kept as it is
+	DENOISER_BILATERAL ,	// the built-in edge-avoiding a-trous filter
+	DENOISER_OIDN			// Intel Open Image Denoise
+};
+
 // mesh file type
 enum MESH_TYPE
 {
@@ -59,6 +103,73 @@ enum BXDF_TYPE
 	BXDF_ALL = BXDF_ALL_REFLECTION | BXDF_ALL_TRANSMISSION 
 };
 
+// the concrete type of a bxdf , the bsdf calls the tagged ones through their final types instead of the virtual functions
+enum BXDF_CLOSURE
+{
+	BXDF_CLOSURE_GENERIC = 0,							// any other bxdf , it is called virtually
+	BXDF_CLOSURE_LAMBERT ,
+	BXDF_CLOSURE_ORENNAYAR ,
+	BXDF_CLOSURE_MF_REFLECTION_BLINN_COOKTORRANCE ,		// microfacet reflection with a conductor fresnel term
+	BXDF_CLOSURE_MF_REFLECTION_BECKMANN_COOKTORRANCE ,
+	BXDF_CLOSURE_MF_REFLECTION_GGX_COOKTORRANCE ,
+	BXDF_CLOSURE_MF_REFLECTION_GGX_SMITHJOINT ,
+	BXDF_CLOSURE_MF_REFRACTION_BLINN_COOKTORRANCE ,		// microfacet refraction with a dielectric fresnel term
+	BXDF_CLOSURE_MF_REFRACTION_GGX_COOKTORRANCE ,
+	BXDF_CLOSURE_MF_REFRACTION_GGX_SMITHJOINT ,
+};
+
+// the kind of a ray , objects could be hidden from some of them , one bit for each kind
+enum RAY_TYPE
+{
+	RAY_NONE = 0,			// rays of no kind see everything
+	RAY_CAMERA = 1,			// rays from the camera
+	RAY_SHADOW = 2,			// rays towards lights and any other occlusion query
+	RAY_DIFFUSE = 4,		// rays scattered by diffuse lobes
+	RAY_GLOSSY = 8,			// rays scattered by glossy and specular lobes
+	RAY_ALL = RAY_CAMERA | RAY_SHADOW | RAY_DIFFUSE | RAY_GLOSSY
+};
+
+// the state of a micro-triangle of an opacity micromap , it takes two bits
+enum OPACITY_STATE
+{
+	OPACITY_TRANSPARENT = 0,	// the micro-triangle is cut away everywhere
+	OPACITY_OPAQUE ,			// the micro-triangle is kept everywhere
+	OPACITY_UNKNOWN ,			// the opacity of the material is evaluated at the hit
+};
+
+// the kind of primitives in a packet of an accelerator leaf , each kind is tested with its own loop
+enum PACKET_TYPE
+{
+	PACKET_TRIANGLE = 0,	// world space triangles
+	PACKET_SPHERE ,
+	PACKET_DISK ,
+	PACKET_RECTANGLE ,		// rectangles and squares
+	PACKET_GENERIC ,		// any other primitive , it is tested with its own intersection routine
+};
+
+// the way a curve is intersected and shaded , both are intersected as a strip facing the ray
+enum CURVE_TYPE
+{
+	CURVE_RIBBON = 0,	// a flat strip , its normal faces the ray
+	CURVE_TUBE ,		// a thick tube , its normal is bent across the strip as if it were round
+};
+
+// the order render tiles are dealt to the threads , tiles rendered one after another share the geometry and textures they touch
+enum TILE_ORDER
+{
+	TILE_ORDER_SPIRAL = 0,		// a center-out spiral , the center of the image is previewed first
+	TILE_ORDER_HILBERT ,		// a hilbert curve over the image , consecutive tiles are always neighbours
+	TILE_ORDER_HILBERT_SPIRAL ,	// blocks of tiles in a center-out spiral , the tiles of each block follow a hilbert curve
+	TILE_ORDER_PRIORITY ,		// tiles close to the focus point , noisy and cheap in the previous pass come first
+};
+
+// the order of the pixels in a render tile
+enum PIXEL_ORDER
+{
+	PIXEL_ORDER_SCANLINE = 0,	// rows of pixels from the top
+	PIXEL_ORDER_MORTON ,		// a morton curve , pixels rendered one after another stay in small squares
+};
+
 // camera type
 enum CAMERA_TYPE
 {
@@ -0,0 +1,148 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "fileprefetch.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "utility/memoryfile.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_set>
+#include <fstream>
+
+#if defined(SORT_IN_MAC) || defined(SORT_IN_LINUX)
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// the number of io threads , opening a file on a network file system mostly waits for the server
+static const unsigned PREFETCH_THREADS = 4;
+
+namespace {
+// the io threads and the files waiting for them , the threads are finished at exit
+struct PrefetchQueue
+{
+    std::mutex                          mutex;
+    std::condition_variable             cv;
+    std::deque<std::string>             files;
+    std::unordered_set<std::string>     requested;
+    std::vector<std::thread>            threads;
+    bool                                stop = false;
+    unsigned                            fileCnt = 0;
+    unsigned long long                  bytes = 0;
+
+    ~PrefetchQueue(){
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stop = true;
+            files.clear();
+        }
+        cv.notify_all();
+        for( auto& thread : threads )
+            thread.join();
+    }
+};
+}
+
+static PrefetchQueue& prefetchQueue()
+{
+    static PrefetchQueue queue;
+    return queue;
+}
+
+// read a file into the page cache , the size of the file is returned
+static unsigned long long prefetchFile( const std::string& filename )
+{
+#if defined(SORT_IN_LINUX)
+    const int fd = open( filename.c_str() , O_RDONLY );
+    if( fd == -1 )
+        return 0;
+    struct stat st;
+    const unsigned long long size = ( fstat( fd , &st ) == 0 && st.st_size > 0 ) ? (unsigned long long)st.st_size : 0;
+    // the kernel starts reading the whole file without waiting for it
+    if( size > 0 )
+        posix_fadvise( fd , 0 , 0 , POSIX_FADV_WILLNEED );
+    close( fd );
+    return size;
+#else
+    std::ifstream file( filename.c_str() , std::ios::binary );
+    if( !file.is_open() )
+        return 0;
+    std::vector<char> buffer( 1 << 20 );
+    unsigned long long size = 0;
+    while( file.read( buffer.data() , buffer.size() ) || file.gcount() > 0 )
+        size += (unsigned long long)file.gcount();
+    return size;
+#endif
+}
+
+// the loop of an io thread
+static void prefetchLoop( PrefetchQueue& queue )
+{
+    std::unique_lock<std::mutex> lock( queue.mutex );
+    while( true )
+    {
+        queue.cv.wait( lock , [&](){ return queue.stop || !queue.files.empty(); } );
+        if( queue.stop )
+            return;
+        const std::string filename = queue.files.front();
+        queue.files.pop_front();
+
+        lock.unlock();
+        const unsigned long long size = prefetchFile( filename );
+        lock.lock();
+        if( size > 0 )
+        {
+            ++queue.fileCnt;
+            queue.bytes += size;
+        }
+    }
+}
+
+// read files ahead in the background
+void FilePrefetch::Prefetch( const std::vector<std::string>& files )
+{
+    PrefetchQueue& queue = prefetchQueue();
+    {
+        std::lock_guard<std::mutex> lock( queue.mutex );
+        // files in memory are never read from the disk
+        for( const auto& filename : files )
+            if( !filename.empty() && !MemoryFiles::IsMemoryFile( filename ) && queue.requested.insert( filename ).second )
+                queue.files.push_back( filename );
+        if( queue.files.empty() )
+            return;
+
+        // the threads are only started once there is something to read
+        while( queue.threads.size() < PREFETCH_THREADS )
+            queue.threads.push_back( std::thread( [&queue](){ prefetchLoop( queue ); } ) );
+    }
+    queue.cv.notify_all();
+}
+
+// output the prefetched files
+void FilePrefetch::OutputLog()
+{
+    PrefetchQueue& queue = prefetchQueue();
+    std::lock_guard<std::mutex> lock( queue.mutex );
+    if( queue.requested.empty() )
+        return;
+    slog( INFO , PERFORMANCE , stringFormat( "Prefetched %d of %d files referred by the scene , %.2f MB are read ahead." ,
+        (int)queue.fileCnt , (int)queue.requested.size() , queue.bytes / 1048576.0 ) );
+}
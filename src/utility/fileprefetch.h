@@ -0,0 +1,41 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <string>
+#include <vector>
+
+//! @brief Asynchronous read-ahead of the files a scene refers to.
+/**
+ * Models and images are read from the disk one after another by the loaders, on network file systems every
+ * one of those reads waits for the round trips of the previous ones. The files named by the scene and its
+ * material libraries are handed to a few IO threads as soon as they are known, the threads ask the kernel
+ * to read them into the page cache in the background while the loaders parse and decode the files before.
+ * Linux advises the kernel with posix_fadvise, the other platforms read the files through once.
+ */
+class FilePrefetch
+{
+public:
+    //! @brief Read files ahead in the background, it returns immediately.
+    //! @param files    The names of the files, missing files and files prefetched before are skipped.
+    static void Prefetch( const std::vector<std::string>& files );
+
+    //! Output the number of prefetched files to the performance log.
+    static void OutputLog();
+};
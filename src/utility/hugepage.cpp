@@ -0,0 +1,184 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "hugepage.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <fstream>
+#include <string>
+#include <stdio.h>
+
+#if defined(SORT_IN_LINUX)
+#include <sys/mman.h>
+#endif
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// a buffer mapped for huge pages
+struct HugePageBlock
+{
+    void*   base;       // the start of the mapping
+    size_t  mapped;     // the size of the mapping
+    size_t  size;       // the size of the huge page aligned range advised or mapped
+    bool    expl;       // whether it is mapped from the explicit huge page pool
+};
+
+static std::atomic<int>     g_hugePageMode( HUGE_PAGE_OFF );
+
+// buffers on huge pages , the regular allocations are not recorded
+static std::mutex                                   g_hugePageMutex;
+static std::unordered_map<void*,HugePageBlock>      g_hugePageBlocks;
+static size_t                                       g_requestedBytes = 0;   // bytes of buffers that requested huge pages
+static size_t                                       g_explicitBytes = 0;    // bytes obtained from the explicit pool
+static size_t                                       g_explicitFailures = 0; // buffers falling back to transparent huge pages
+
+// set the way buffers are allocated
+void HugePages::SetMode( HUGE_PAGE_MODE mode )
+{
+#if !defined(SORT_IN_LINUX)
+    if( mode != HUGE_PAGE_OFF )
+        slog( WARNING , GENERAL , "Huge pages are only supported on Linux, buffers are allocated with regular pages." );
+    mode = HUGE_PAGE_OFF;
+#endif
+    g_hugePageMode = mode;
+}
+
+// the current huge page mode
+HUGE_PAGE_MODE HugePages::GetMode()
+{
+    return (HUGE_PAGE_MODE)g_hugePageMode.load();
+}
+
+// allocate a buffer
+void* HugePages::Alloc( size_t size , size_t alignment )
+{
+    const HUGE_PAGE_MODE mode = GetMode();
+    if( mode == HUGE_PAGE_OFF || size < HUGE_PAGE_SIZE )
+        return sort_aligned_malloc( size , alignment );
+
+#if defined(SORT_IN_LINUX)
+    const size_t rounded = ( size + HUGE_PAGE_SIZE - 1 ) & ~( HUGE_PAGE_SIZE - 1 );
+    HugePageBlock block = { nullptr , 0 , rounded , false };
+    void* ptr = nullptr;
+
+#if defined(MAP_HUGETLB)
+    // the pool is reserved by the administrator , the mapping fails if it is exhausted
+    if( mode == HUGE_PAGE_EXPLICIT ){
+        void* mapped = mmap( nullptr , rounded , PROT_READ | PROT_WRITE , MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB , -1 , 0 );
+        if( mapped != MAP_FAILED ){
+            block.base = ptr = mapped;
+            block.mapped = rounded;
+            block.expl = true;
+        }
+    }
+#endif
+
+    // the mapping is over-allocated by one huge page so that the buffer starts at a huge page boundary
+    if( ptr == nullptr ){
+        void* mapped = mmap( nullptr , rounded + HUGE_PAGE_SIZE , PROT_READ | PROT_WRITE , MAP_PRIVATE | MAP_ANONYMOUS , -1 , 0 );
+        if( mapped == MAP_FAILED )
+            return sort_aligned_malloc( size , alignment );
+        block.base = mapped;
+        block.mapped = rounded + HUGE_PAGE_SIZE;
+        ptr = (void*)( ( (size_t)mapped + HUGE_PAGE_SIZE - 1 ) & ~( HUGE_PAGE_SIZE - 1 ) );
+#if defined(MADV_HUGEPAGE)
+        madvise( ptr , rounded , MADV_HUGEPAGE );
+#endif
+    }
+
+    std::lock_guard<std::mutex> lock( g_hugePageMutex );
+    g_hugePageBlocks[ptr] = block;
+    g_requestedBytes += rounded;
+    if( block.expl )
+        g_explicitBytes += rounded;
+    else if( mode == HUGE_PAGE_EXPLICIT )
+        ++g_explicitFailures;
+    return ptr;
+#else
+    return sort_aligned_malloc( size , alignment );
+#endif
+}
+
+// free a buffer allocated by Alloc
+void HugePages::Free( void* ptr )
+{
+    if( ptr == nullptr )
+        return;
+
+#if defined(SORT_IN_LINUX)
+    {
+        std::lock_guard<std::mutex> lock( g_hugePageMutex );
+        auto it = g_hugePageBlocks.find( ptr );
+        if( it != g_hugePageBlocks.end() ){
+            const HugePageBlock block = it->second;
+            g_hugePageBlocks.erase( it );
+            g_requestedBytes -= block.size;
+            if( block.expl )
+                g_explicitBytes -= block.size;
+            munmap( block.base , block.mapped );
+            return;
+        }
+    }
+#endif
+
+    sort_aligned_free( ptr );
+}
+
+// output the huge page usage
+void HugePages::OutputLog()
+{
+    const HUGE_PAGE_MODE mode = GetMode();
+    if( mode == HUGE_PAGE_OFF )
+        return;
+
+    const double mb = 1024.0 * 1024.0;
+    std::lock_guard<std::mutex> lock( g_hugePageMutex );
+    slog( INFO , PERFORMANCE , stringFormat( "Huge pages are requested for %.2f MB of buffers." , g_requestedBytes / mb ) );
+    if( mode == HUGE_PAGE_EXPLICIT )
+        slog( INFO , PERFORMANCE , stringFormat( "%.2f MB are mapped from the explicit huge page pool, %d buffers fell back to transparent huge pages." , g_explicitBytes / mb , (int)g_explicitFailures ) );
+
+#if defined(SORT_IN_LINUX)
+    // the kernel reports the transparent huge pages backing each mapping , the buffers are looked up by their address
+    std::ifstream smaps( "/proc/self/smaps" );
+    if( !smaps.is_open() ){
+        slog( INFO , PERFORMANCE , "Transparent huge page usage is unknown, /proc/self/smaps can't be read." );
+        return;
+    }
+    size_t thp_bytes = 0;
+    bool in_buffer = false;
+    std::string line;
+    while( std::getline( smaps , line ) ){
+        size_t start , end;
+        if( sscanf( line.c_str() , "%zx-%zx" , &start , &end ) == 2 && line.find( ':' ) > line.find( ' ' ) ){
+            in_buffer = false;
+            for( auto& it : g_hugePageBlocks ){
+                const size_t ptr = (size_t)it.first;
+                if( !it.second.expl && ptr < end && ptr + it.second.size > start ){
+                    in_buffer = true;
+                    break;
+                }
+            }
+        }else if( in_buffer && line.compare( 0 , 14 , "AnonHugePages:" ) == 0 ){
+            thp_bytes += (size_t)atoll( line.c_str() + 14 ) * 1024;
+        }
+    }
+    slog( INFO , PERFORMANCE , stringFormat( "%.2f MB of the buffers are backed by transparent huge pages." , thp_bytes / mb ) );
+#endif
+}
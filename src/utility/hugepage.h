@@ -0,0 +1,120 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "define.h"
+#include <memory>
+#include <new>
+#include <type_traits>
+
+//! @brief The way large read-mostly buffers are backed by huge pages.
+enum HUGE_PAGE_MODE
+{
+    HUGE_PAGE_OFF = 0,          /**< Buffers are allocated with the regular aligned allocation. */
+    HUGE_PAGE_TRANSPARENT,      /**< Buffers are aligned to 2 MB and the kernel is advised to back them with transparent huge pages. */
+    HUGE_PAGE_EXPLICIT,         /**< Buffers are mapped from the reserved huge page pool, transparent huge pages are the fallback. */
+};
+
+//! @brief Allocation of large read-mostly buffers on 2 MB huge pages.
+/**
+ * Vertex buffers, image textures and the nodes of acceleration structures are read randomly by secondary
+ * rays, with 4 KB pages most of those reads miss the TLB once the scene is larger than a few megabytes.
+ * Buffers of at least 2 MB are placed on huge pages if it is enabled, smaller ones and all buffers on
+ * platforms without huge pages fall back to the regular aligned allocation. Whether the kernel actually
+ * backed the buffers with huge pages is reported in the log since neither mode is guaranteed to get them.
+ */
+class HugePages
+{
+public:
+    //! @brief Set the way buffers are allocated, it only affects buffers allocated afterward.
+    //! @param mode     The huge page mode.
+    static void SetMode( HUGE_PAGE_MODE mode );
+
+    //! The current huge page mode.
+    static HUGE_PAGE_MODE GetMode();
+
+    //! @brief Allocate a buffer.
+    //! @param size         The size of the buffer in bytes.
+    //! @param alignment    The alignment of the buffer, it is at most 4 KB.
+    //! @return             The buffer, it is nullptr if the allocation fails.
+    static void* Alloc( size_t size , size_t alignment = 64 );
+
+    //! @brief Free a buffer allocated by Alloc.
+    //! @param ptr      The buffer, it could be nullptr.
+    static void Free( void* ptr );
+
+    //! Output the huge page usage to the performance log.
+    static void OutputLog();
+};
+
+//! @brief Allocator of standard containers placing their elements with HugePages.
+template< class T >
+class HugePageAllocator
+{
+public:
+    typedef T value_type;
+
+    HugePageAllocator() {}
+    template< class U >
+    HugePageAllocator( const HugePageAllocator<U>& ) {}
+
+    //! @brief Allocate memory for elements.
+    //! @param n    The number of elements.
+    T* allocate( size_t n ){
+        void* ptr = HugePages::Alloc( sizeof( T ) * n , alignof( T ) > 64 ? alignof( T ) : 64 );
+        if( ptr == nullptr )
+            throw std::bad_alloc();
+        return (T*)ptr;
+    }
+
+    //! @brief Free memory of elements.
+    void deallocate( T* ptr , size_t ){ HugePages::Free( ptr ); }
+
+    template< class U >
+    bool operator==( const HugePageAllocator<U>& ) const { return true; }
+    template< class U >
+    bool operator!=( const HugePageAllocator<U>& ) const { return false; }
+};
+
+//! @brief Deleter of arrays allocated by HugePages::MakeArray.
+struct HugePageDeleter
+{
+    template< class T >
+    void operator()( T* ptr ) const { HugePages::Free( ptr ); }
+};
+
+//! Array of trivially destructible elements placed with HugePages.
+template< class T >
+using HugePageArray = std::unique_ptr<T[],HugePageDeleter>;
+
+//! @brief Allocate an array of default constructed elements with HugePages.
+//!
+//! The elements are never destructed, only trivially destructible types are supported.
+//! @param count    The number of elements.
+//! @return         The array, it is empty if the allocation fails.
+template< class T >
+HugePageArray<T> MakeHugePageArray( size_t count )
+{
+    static_assert( std::is_trivially_destructible<T>::value , "Elements of huge page arrays are never destructed." );
+    T* ptr = (T*)HugePages::Alloc( sizeof( T ) * count , alignof( T ) > 64 ? alignof( T ) : 64 );
+    if( ptr )
+        for( size_t i = 0 ; i < count ; ++i )
+            new ( ptr + i ) T();
+    return HugePageArray<T>( ptr );
+}
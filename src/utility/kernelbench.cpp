@@ -0,0 +1,309 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "kernelbench.h"
+#include "geometry/triangle.h"
+#include "geometry/trimesh.h"
+#include "geometry/intersection.h"
+#include "geometry/bbox.h"
+#include "bsdf/bsdf.h"
+#include "bsdf/lambert.h"
+#include "bsdf/orennayar.h"
+#include "bsdf/microfacet.h"
+#include "sampler/sample.h"
+#include "texture/imagetexture.h"
+#include "texture/rendertarget.h"
+#include "managers/texmanager.h"
+#include "utility/samplemethod.h"
+#include "utility/rand.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+
+// the number of inputs of every kernel , they are reused in turn and stay in the caches like the hot data of a render
+static const unsigned INPUT_COUNT = 4096;
+
+// the number of times each kernel is timed , the median of them is reported along with the fastest one
+static const unsigned REPETITIONS = 7;
+
+// the image read by the texture kernels , it is written to the working directory and removed afterward
+static const char* TEXTURE_FILE = "sort_kernelbench.exr";
+static const unsigned TEXTURE_SIZE = 1024;
+
+// the result of a kernel is written here so that the compiler can't drop the work
+static volatile float g_sink = 0.0f;
+
+// a random point in the box from -1 to 1
+static Point randomPoint()
+{
+    return Point( sort_canonical() * 2.0f - 1.0f , sort_canonical() * 2.0f - 1.0f , sort_canonical() * 2.0f - 1.0f );
+}
+
+// constructor
+KernelBenchmark::KernelBenchmark( double seconds ) : m_seconds( max( seconds , 0.001 ) )
+{
+}
+
+// time the kernels
+void KernelBenchmark::Run( const std::vector<std::string>& filters )
+{
+    // the inputs are the same in every run
+    sort_set_deterministic( true );
+    sort_reseed( 0 , 0 , 0 );
+    std::vector<Kernel> kernels;
+
+    // triangles in the unit box , each ray aims at a point around its triangle so that about half of them hit
+    TriMesh mesh( "kernelbench" );
+    mesh.m_pMemory = std::make_shared<BufferMemory>();
+    std::vector<VertexIndex> indices( 3 * INPUT_COUNT );
+    std::vector<Triangle> triangles;
+    std::vector<Ray> tri_rays;
+    triangles.reserve( INPUT_COUNT );
+    for( unsigned i = 0 ; i < INPUT_COUNT ; ++i ){
+        const Point center = randomPoint();
+        Point p[3];
+        for( unsigned k = 0 ; k < 3 ; ++k ){
+            p[k] = center + ( randomPoint() - Point() ) * 0.2f;
+            indices[ 3 * i + k ].posIndex = (int)mesh.m_pMemory->m_PositionBuffer.size();
+            mesh.m_pMemory->m_PositionBuffer.push_back( p[k] );
+        }
+        triangles.push_back( Triangle( i , &mesh , &indices[ 3 * i ] , nullptr ) );
+
+        const float u = sort_canonical() * 2.0f - 0.5f , v = sort_canonical() * 2.0f - 0.5f;
+        const Point target = p[0] + ( p[1] - p[0] ) * u + ( p[2] - p[0] ) * v * ( 1.0f - u );
+        const Point ori = center + Normalize( randomPoint() - Point() ) * 3.0f;
+        tri_rays.push_back( Ray( ori , Normalize( target - ori ) ) );
+    }
+    kernels.push_back( { "triangle" , [&]( unsigned n ){
+        unsigned hits = 0;
+        Intersection intersect;
+        for( unsigned i = 0 ; i < n ; ++i ){
+            intersect.t = FLT_MAX;
+            hits += triangles[ i % INPUT_COUNT ].GetIntersect( tri_rays[ i % INPUT_COUNT ] , &intersect );
+        }
+        return (float)hits;
+    } } );
+    kernels.push_back( { "triangle_shadow" , [&]( unsigned n ){
+        unsigned hits = 0;
+        for( unsigned i = 0 ; i < n ; ++i )
+            hits += triangles[ i % INPUT_COUNT ].GetIntersect( tri_rays[ i % INPUT_COUNT ] , nullptr );
+        return (float)hits;
+    } } );
+
+    // boxes in the unit box , the rays start outside of them and aim at the points around them
+    std::vector<BBox> boxes;
+    std::vector<Ray> box_rays;
+    std::vector<TraversalRay> traversal_rays;
+    for( unsigned i = 0 ; i < INPUT_COUNT ; ++i ){
+        const Point a = randomPoint() , b = randomPoint();
+        boxes.push_back( BBox( Point( min( a.x , b.x ) , min( a.y , b.y ) , min( a.z , b.z ) ) , Point( max( a.x , b.x ) , max( a.y , b.y ) , max( a.z , b.z ) ) ) );
+        const Point ori = Point() + Normalize( randomPoint() - Point() ) * 4.0f;
+        box_rays.push_back( Ray( ori , Normalize( randomPoint() * 1.5f - ori ) ) );
+        traversal_rays.push_back( TraversalRay( box_rays.back() ) );
+    }
+    kernels.push_back( { "bbox" , [&]( unsigned n ){
+        float sum = 0.0f;
+        for( unsigned i = 0 ; i < n ; ++i )
+            sum += Intersect( box_rays[ i % INPUT_COUNT ] , boxes[ i % INPUT_COUNT ] );
+        return sum;
+    } } );
+    kernels.push_back( { "bbox_traversal" , [&]( unsigned n ){
+        float sum = 0.0f;
+        for( unsigned i = 0 ; i < n ; ++i )
+            sum += Intersect( traversal_rays[ i % INPUT_COUNT ] , boxes[ i % INPUT_COUNT ] );
+        return sum;
+    } } );
+
+    // a bsdf with one bxdf of each kind at a point facing up , the directions are in both hemispheres
+    Intersection shading_point;
+    shading_point.normal = Vector( 0.0f , 1.0f , 0.0f );
+    shading_point.tangent = Vector( 1.0f , 0.0f , 0.0f );
+    const Spectrum color( 0.8f , 0.6f , 0.4f );
+    const FresnelConductor conductor( Spectrum( 0.37f ) , Spectrum( 2.82f ) );
+    const FresnelDielectric dielectric( 1.5f , 1.0f );
+    std::vector<std::pair<std::string,std::unique_ptr<Bxdf>>> bxdfs;
+    bxdfs.emplace_back( "lambert" , std::unique_ptr<Bxdf>( new Lambert( color ) ) );
+    bxdfs.emplace_back( "orennayar" , std::unique_ptr<Bxdf>( new OrenNayar( color , 0.5f ) ) );
+    bxdfs.emplace_back( "mf_reflection_blinn" , std::unique_ptr<Bxdf>( new MicroFacetReflectionBlinnCookTorrance( color , conductor , Blinn( 0.3f ) , VisCookTorrance() ) ) );
+    bxdfs.emplace_back( "mf_reflection_beckmann" , std::unique_ptr<Bxdf>( new MicroFacetReflectionBeckmannCookTorrance( color , conductor , Beckmann( 0.3f ) , VisCookTorrance() ) ) );
+    bxdfs.emplace_back( "mf_reflection_ggx" , std::unique_ptr<Bxdf>( new MicroFacetReflectionGGXSmithJoint( color , conductor , GGX( 0.3f ) , VisSmithJointApprox( 0.3f ) ) ) );
+    bxdfs.emplace_back( "mf_refraction_ggx" , std::unique_ptr<Bxdf>( new MicroFacetRefractionGGXSmithJoint( color , dielectric , GGX( 0.3f ) , VisSmithJointApprox( 0.3f ) , 1.5f , 1.0f ) ) );
+    std::vector<std::unique_ptr<Bsdf>> bsdfs;
+    for( auto& bxdf : bxdfs ){
+        bxdf.second->m_weight = Spectrum( 1.0f );
+        bsdfs.emplace_back( new Bsdf( &shading_point ) );
+        bsdfs.back()->AddBxdf( bxdf.second.get() );
+    }
+    std::vector<Vector> wos , wis;
+    std::vector<BsdfSample> bsdf_samples;
+    for( unsigned i = 0 ; i < INPUT_COUNT ; ++i ){
+        wos.push_back( UniformSampleSphere( sort_canonical() , sort_canonical() ) );
+        wos.back().y = fabs( wos.back().y );
+        wis.push_back( UniformSampleSphere( sort_canonical() , sort_canonical() ) );
+        bsdf_samples.push_back( BsdfSample( true ) );
+    }
+    for( unsigned k = 0 ; k < bsdfs.size() ; ++k ){
+        const Bsdf* bsdf = bsdfs[k].get();
+        kernels.push_back( { "bsdf_f_" + bxdfs[k].first , [&,bsdf]( unsigned n ){
+            float sum = 0.0f;
+            for( unsigned i = 0 ; i < n ; ++i )
+                sum += bsdf->f( wos[ i % INPUT_COUNT ] , wis[ i % INPUT_COUNT ] ).GetIntensity();
+            return sum;
+        } } );
+        kernels.push_back( { "bsdf_sample_" + bxdfs[k].first , [&,bsdf]( unsigned n ){
+            float sum = 0.0f;
+            for( unsigned i = 0 ; i < n ; ++i ){
+                Vector wi;
+                float pdf = 0.0f;
+                sum += bsdf->sample_f( wos[ i % INPUT_COUNT ] , wi , bsdf_samples[ i % INPUT_COUNT ] , &pdf ).GetIntensity() + pdf;
+            }
+            return sum;
+        } } );
+    }
+
+    // the random number generator , one by one and in batches
+    kernels.push_back( { "rng" , []( unsigned n ){
+        float sum = 0.0f;
+        for( unsigned i = 0 ; i < n ; ++i )
+            sum += sort_canonical();
+        return sum;
+    } } );
+    kernels.push_back( { "rng_batch" , []( unsigned n ){
+        float batch[64];
+        float sum = 0.0f;
+        for( unsigned i = 0 ; i < n ; i += 64 ){
+            sort_canonical( batch , 64 );
+            sum += batch[0];
+        }
+        return sum;
+    } } );
+
+    // distributions of the size of a light list and of an environment map
+    std::vector<float> weights( 1024 * 512 );
+    for( float& w : weights )
+        w = sort_canonical() * sort_canonical();
+    std::unique_ptr<Distribution1D> distribution1d( new Distribution1D( &weights[0] , 1024 ) );
+    std::unique_ptr<Distribution2D> distribution2d( new Distribution2D( &weights[0] , 1024 , 512 ) );
+    std::vector<float> us( 2 * INPUT_COUNT );
+    sort_canonical( &us[0] , (unsigned)us.size() );
+    kernels.push_back( { "distribution1d_discrete" , [&]( unsigned n ){
+        float sum = 0.0f;
+        for( unsigned i = 0 ; i < n ; ++i ){
+            float pdf;
+            sum += distribution1d->SampleDiscrete( us[ i % INPUT_COUNT ] , &pdf ) + pdf;
+        }
+        return sum;
+    } } );
+    kernels.push_back( { "distribution1d_continuous" , [&]( unsigned n ){
+        float sum = 0.0f;
+        for( unsigned i = 0 ; i < n ; ++i ){
+            float pdf;
+            sum += distribution1d->SampleContinuous( us[ i % INPUT_COUNT ] , &pdf ) + pdf;
+        }
+        return sum;
+    } } );
+    kernels.push_back( { "distribution2d" , [&]( unsigned n ){
+        float sum = 0.0f;
+        for( unsigned i = 0 ; i < n ; ++i ){
+            float uv[2] , pdf;
+            const unsigned j = 2 * ( i % INPUT_COUNT );
+            distribution2d->SampleContinuous( us[j] , us[j+1] , uv , &pdf );
+            sum += uv[0] + uv[1] + pdf;
+        }
+        return sum;
+    } } );
+
+    // an image with some detail in every mip level , it is read like the textures of a scene
+    RenderTarget image;
+    image.SetSize( TEXTURE_SIZE , TEXTURE_SIZE );
+    for( unsigned y = 0 ; y < TEXTURE_SIZE ; ++y )
+        for( unsigned x = 0 ; x < TEXTURE_SIZE ; ++x )
+            image.SetColor( x , y , Spectrum( (float)( ( x ^ y ) & 255 ) / 255.0f , (float)x / TEXTURE_SIZE , (float)y / TEXTURE_SIZE ) );
+    ImageTexture texture;
+    const bool textured = TexManager::GetSingleton().Write( TEXTURE_FILE , &image ) && texture.LoadImageFromFile( TEXTURE_FILE );
+    if( !textured )
+        slog( WARNING , PERFORMANCE , "The image of the texture kernels can't be written , they are skipped." );
+    std::vector<float> footprints( INPUT_COUNT );
+    for( float& f : footprints )
+        f = 1.0f / (float)( 1 << ( 6 + (unsigned)( sort_canonical() * 4.0f ) ) );
+    if( textured ){
+        kernels.push_back( { "image_point" , [&]( unsigned n ){
+            float sum = 0.0f;
+            for( unsigned i = 0 ; i < n ; ++i ){
+                const unsigned j = 2 * ( i % INPUT_COUNT );
+                sum += texture.GetColor( us[j] , us[j+1] ).GetIntensity();
+            }
+            return sum;
+        } } );
+        kernels.push_back( { "image_filtered" , [&]( unsigned n ){
+            float sum = 0.0f;
+            for( unsigned i = 0 ; i < n ; ++i ){
+                const unsigned j = 2 * ( i % INPUT_COUNT );
+                const float f = footprints[ i % INPUT_COUNT ];
+                sum += texture.GetColor( us[j] , us[j+1] , f , 0.0f , 0.0f , f * 0.5f ).GetIntensity();
+            }
+            return sum;
+        } } );
+    }
+
+    sort_set_deterministic( false );
+
+    for( const Kernel& kernel : kernels ){
+        bool selected = filters.empty();
+        for( const std::string& filter : filters )
+            selected |= kernel.name.find( filter ) != std::string::npos;
+        if( !selected )
+            continue;
+
+        double best , median;
+        measure( kernel , best , median );
+        slog( INFO , PERFORMANCE , stringFormat( "Kernel '%s' takes %.2f ns per operation, the median of %d runs is %.2f ns." , kernel.name.c_str() , best , REPETITIONS , median ) );
+    }
+
+    texture.Release();
+    remove( TEXTURE_FILE );
+    remove( ( std::string( TEXTURE_FILE ) + ".sorttex" ).c_str() );
+}
+
+// time a kernel
+void KernelBenchmark::measure( const Kernel& kernel , double& best , double& median ) const
+{
+    // the number of operations is doubled until one run takes a tenth of the time , the caches are warmed up meanwhile
+    unsigned ops = 1024;
+    for( ; ; ops *= 2 ){
+        const auto start = std::chrono::steady_clock::now();
+        g_sink = g_sink + kernel.run( ops );
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if( elapsed.count() >= m_seconds * 0.1 || ops >= ( 1u << 30 ) )
+            break;
+    }
+    ops = (unsigned)min( ops * 10.0 , (double)( 1u << 31 ) );
+
+    std::vector<double> times;
+    for( unsigned r = 0 ; r < REPETITIONS ; ++r ){
+        const auto start = std::chrono::steady_clock::now();
+        g_sink = g_sink + kernel.run( ops );
+        const std::chrono::duration<double,std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        times.push_back( elapsed.count() / ops );
+    }
+    std::sort( times.begin() , times.end() );
+    best = times.front();
+    median = times[ times.size() / 2 ];
+}
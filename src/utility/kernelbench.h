@@ -0,0 +1,61 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+//! @brief Micro-benchmark timing the core kernels one by one.
+/**
+ * The render benchmark tells whether a change makes the renderer faster, but a change to the layout or the
+ * SIMD code of one kernel is lost in the noise of a full render. The benchmark runs each kernel alone over
+ * inputs generated beforehand, so that neither the random numbers nor the memory allocation are timed. The
+ * kernels are the triangle test, the slab test of bounding boxes, evaluating and sampling the bsdf with each
+ * kind of bxdf, the random number generator, the piecewise constant distributions and the lookups of an
+ * image texture. Every kernel is run for a fixed time several times, the fastest and the median time of one
+ * operation are reported in nanoseconds.
+ */
+class KernelBenchmark
+{
+public:
+    //! @brief Constructor.
+    //! @param seconds      The time each kernel is run for in every repetition.
+    explicit KernelBenchmark( double seconds );
+
+    //! @brief Time the kernels.
+    //! @param filters      Only the kernels whose names contain any of them are timed, all kernels are timed if it is empty.
+    void Run( const std::vector<std::string>& filters );
+
+private:
+    //! @brief One kernel to be timed.
+    struct Kernel
+    {
+        std::string                     name;   /**< Name of the kernel in the report. */
+        std::function<float(unsigned)>  run;    /**< Run the kernel on the inputs, the argument is the number of operations and the result keeps the compiler from dropping the work. */
+    };
+
+    double              m_seconds;      /**< The time each kernel is run for in every repetition. */
+
+    //! @brief Time a kernel.
+    //! @param kernel       The kernel.
+    //! @param best         The fastest time of one operation in nanoseconds.
+    //! @param median       The median time of one operation in nanoseconds.
+    void measure( const Kernel& kernel , double& best , double& median ) const;
+};
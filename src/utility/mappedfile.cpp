@@ -0,0 +1,85 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "mappedfile.h"
+#include <fstream>
+
+#if defined(SORT_IN_MAC) || defined(SORT_IN_LINUX)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// map a file
+bool MappedFile::Open( const std::string& filename , bool sequential )
+{
+    Close();
+
+#if defined(SORT_IN_MAC) || defined(SORT_IN_LINUX)
+    const int fd = open( filename.c_str() , O_RDONLY );
+    if( fd == -1 )
+        return false;
+    struct stat st;
+    if( fstat( fd , &st ) != 0 || st.st_size <= 0 ){
+        close( fd );
+        return false;
+    }
+    const size_t size = (size_t)st.st_size;
+    void* mapped = mmap( 0 , size , PROT_READ , MAP_PRIVATE , fd , 0 );
+    close( fd );
+    if( mapped == MAP_FAILED )
+        return false;
+
+    // the file is usually read from the beginning to the end once , tables looked up randomly are better loaded ahead
+    madvise( mapped , size , sequential ? MADV_SEQUENTIAL : MADV_WILLNEED );
+    m_data = (const char*)mapped;
+    m_size = size;
+    m_mapped = true;
+#else
+    std::ifstream file( filename.c_str() , std::ios::binary | std::ios::ate );
+    if( !file.is_open() )
+        return false;
+    const size_t size = (size_t)file.tellg();
+    if( size == 0 )
+        return false;
+    m_buffer.resize( size );
+    file.seekg( 0 );
+    file.read( &m_buffer[0] , size );
+    if( !file ){
+        m_buffer.clear();
+        return false;
+    }
+    m_data = &m_buffer[0];
+    m_size = size;
+#endif
+    return true;
+}
+
+// unmap the file
+void MappedFile::Close()
+{
+#if defined(SORT_IN_MAC) || defined(SORT_IN_LINUX)
+    if( m_mapped )
+        munmap( (void*)m_data , m_size );
+#endif
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+}
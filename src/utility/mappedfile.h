@@ -0,0 +1,59 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <string>
+#include <vector>
+
+//! @brief Read-only view of a whole file in memory.
+/**
+ * The file is memory-mapped on platforms supporting it, the pages are loaded by the kernel on demand
+ * and shared with the page cache instead of being copied. Other platforms read the whole file into a buffer.
+ */
+class MappedFile
+{
+public:
+    //! Destructor unmapping the file.
+    ~MappedFile() { Close(); }
+
+    //! @brief Map a file.
+    //! @param filename     The name of the file.
+    //! @param sequential   Whether the file is read from the beginning to the end, otherwise all of it is loaded ahead.
+    //! @return             True if the file is mapped, an empty file is never mapped.
+    bool Open( const std::string& filename , bool sequential = true );
+
+    //! Unmap the file.
+    void Close();
+
+    //! The content of the file, it is not null-terminated.
+    const char* GetData() const { return m_data; }
+
+    //! The size of the file in bytes.
+    size_t GetSize() const { return m_size; }
+
+    MappedFile() {}
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+private:
+    const char*         m_data = nullptr;   /**< The content of the file. */
+    size_t              m_size = 0;         /**< The size of the file. */
+    bool                m_mapped = false;   /**< Whether the content is mapped or read into the buffer. */
+    std::vector<char>   m_buffer;           /**< The content read from the file if it can't be mapped. */
+};
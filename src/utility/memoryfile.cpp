@@ -0,0 +1,129 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "memoryfile.h"
+#include "utility/sassert.h"
+#include "log/log.h"
+#include <unordered_map>
+#include <mutex>
+
+namespace {
+// a registered file , it is either a text or a mesh
+struct MemoryFile
+{
+    std::string     text;
+    MemoryMesh      mesh;
+    bool            isMesh = false;
+    long long       revision = 0;
+};
+
+// the registered files , models are loaded concurrently , so the files are guarded by the mutex
+struct MemoryFileTable
+{
+    std::mutex                                      mutex;
+    std::unordered_map<std::string,MemoryFile>      files;
+    long long                                       revision = 0;
+};
+
+MemoryFileTable& fileTable(){
+    static MemoryFileTable table;
+    return table;
+}
+}
+
+// whether a name refers to a file in memory
+bool MemoryFiles::IsMemoryFile( const std::string& name )
+{
+    return name.compare( 0 , 4 , "mem:" ) == 0;
+}
+
+// register the text of a file
+void MemoryFiles::SetText( const std::string& name , const std::string& text )
+{
+    sAssertMsg( IsMemoryFile( name ) , GENERAL , "The names of files in memory start with 'mem:'." );
+    MemoryFileTable& table = fileTable();
+    std::lock_guard<std::mutex> lock( table.mutex );
+    MemoryFile& file = table.files[name];
+    file.text = text;
+    file.mesh = MemoryMesh();
+    file.isMesh = false;
+    file.revision = ++table.revision;
+}
+
+// get the text of a file
+bool MemoryFiles::GetText( const std::string& name , std::string& text )
+{
+    MemoryFileTable& table = fileTable();
+    std::lock_guard<std::mutex> lock( table.mutex );
+    auto it = table.files.find( name );
+    if( it == table.files.end() || it->second.isMesh )
+        return false;
+    text = it->second.text;
+    return true;
+}
+
+// register a mesh
+void MemoryFiles::SetMesh( const std::string& name , const MemoryMesh& mesh )
+{
+    sAssertMsg( IsMemoryFile( name ) , GENERAL , "The names of files in memory start with 'mem:'." );
+    MemoryFileTable& table = fileTable();
+    std::lock_guard<std::mutex> lock( table.mutex );
+    MemoryFile& file = table.files[name];
+    file.text.clear();
+    file.mesh = mesh;
+    file.isMesh = true;
+    file.revision = ++table.revision;
+}
+
+// get a mesh
+bool MemoryFiles::GetMesh( const std::string& name , MemoryMesh& mesh )
+{
+    MemoryFileTable& table = fileTable();
+    std::lock_guard<std::mutex> lock( table.mutex );
+    auto it = table.files.find( name );
+    if( it == table.files.end() || !it->second.isMesh )
+        return false;
+    mesh = it->second.mesh;
+    return true;
+}
+
+// get the revision and the size of a file
+bool MemoryFiles::Stat( const std::string& name , long long& revision , unsigned long long& size )
+{
+    MemoryFileTable& table = fileTable();
+    std::lock_guard<std::mutex> lock( table.mutex );
+    auto it = table.files.find( name );
+    if( it == table.files.end() )
+        return false;
+    revision = it->second.revision;
+    size = it->second.isMesh ? it->second.mesh.triangleCnt : it->second.text.size();
+    return true;
+}
+
+// remove the files with a prefix
+void MemoryFiles::Remove( const std::string& prefix )
+{
+    MemoryFileTable& table = fileTable();
+    std::lock_guard<std::mutex> lock( table.mutex );
+    for( auto it = table.files.begin() ; it != table.files.end() ; ){
+        if( it->first.compare( 0 , prefix.size() , prefix ) == 0 )
+            it = table.files.erase( it );
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,97 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "sort.h"
+#include <string>
+#include <memory>
+#include <vector>
+
+//! @brief A range of consecutive triangles of a mesh in memory sharing a material.
+struct MemoryTrunk
+{
+    std::string     material;               /**< The name of the material, the default material if it is empty. */
+    unsigned        triangleCnt = 0;        /**< The number of triangles. */
+};
+
+//! @brief A mesh handed over in memory, the arrays are owned by the application embedding the renderer.
+/**
+ * The arrays are read in place without a copy as long as the mesh is not transformed, they have to stay valid and
+ * unchanged until the scene referring to the mesh is released. Only the indexes are converted, so are the positions
+ * and normals of transformed meshes.
+ */
+struct MemoryMesh
+{
+    const float*    positions = nullptr;    /**< Three floats for each vertex. */
+    const float*    normals = nullptr;      /**< Three floats for each vertex, smooth normals are generated if it is nullptr. */
+    const float*    texcoords = nullptr;    /**< Two floats for each vertex, they are generated if it is nullptr. */
+    const unsigned* indices = nullptr;      /**< Three indexes of vertexes for each triangle. */
+    unsigned        vertexCnt = 0;          /**< The number of vertexes. */
+    unsigned        triangleCnt = 0;        /**< The number of triangles. */
+    std::string     material;               /**< The name of the material of all triangles, the default material if it is empty. */
+    std::vector<MemoryTrunk>    trunks;     /**< The triangles of each material in order, 'material' is taken for all triangles if it is empty. */
+};
+
+//! @brief Files handed over in memory instead of being written to disk and parsed back.
+/**
+ * An application embedding the renderer registers the render settings, scenes, material libraries and meshes under
+ * names starting with 'mem:'. They are referred to like any other file, every place a file is read by its name finds
+ * the registered one first. Each registration bumps the revision of the file, it takes the place of the modification
+ * time, so a scene whose files are all unchanged is still reused by the next rendering.
+ */
+class MemoryFiles
+{
+public:
+    //! @brief Whether a name refers to a file in memory.
+    //! @param name     The name of the file.
+    static bool IsMemoryFile( const std::string& name );
+
+    //! @brief Register the text of a file, it replaces the previous one with the same name.
+    //! @param name     The name of the file, it has to start with 'mem:'.
+    //! @param text     The text of the file.
+    static void SetText( const std::string& name , const std::string& text );
+
+    //! @brief Get the text of a file.
+    //! @param name     The name of the file.
+    //! @param text     The text of the file.
+    //! @return         False if there is no text with the name.
+    static bool GetText( const std::string& name , std::string& text );
+
+    //! @brief Register a mesh, it replaces the previous one with the same name.
+    //! @param name     The name of the mesh, it has to start with 'mem:'.
+    //! @param mesh     The arrays of the mesh.
+    static void SetMesh( const std::string& name , const MemoryMesh& mesh );
+
+    //! @brief Get a mesh.
+    //! @param name     The name of the mesh.
+    //! @param mesh     The arrays of the mesh.
+    //! @return         False if there is no mesh with the name.
+    static bool GetMesh( const std::string& name , MemoryMesh& mesh );
+
+    //! @brief Get the revision and the size of a file, they tell whether it changed.
+    //! @param name     The name of the file.
+    //! @param revision The number of registrations so far when the file was registered.
+    //! @param size     The size of the text or the number of triangles of the mesh.
+    //! @return         False if there is no file with the name.
+    static bool Stat( const std::string& name , long long& revision , unsigned long long& size );
+
+    //! @brief Remove all files with names starting with a prefix.
+    //! @param prefix   The prefix of the names.
+    static void Remove( const std::string& prefix );
+};
@@ -0,0 +1,101 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "memstats.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "utility/statsreport.h"
+#include <atomic>
+#include <fstream>
+
+// the current usage and the peak of each category , they are never destroyed before the buffers they account
+static std::atomic<long long> g_currentMemory[MEM_CATEGORY_CNT];
+static std::atomic<long long> g_peakMemory[MEM_CATEGORY_CNT];
+
+// names of the categories in the log and in the json file
+static const char* g_categoryNames[MEM_CATEGORY_CNT] = { "mesh" , "texture" , "accelerator" , "merl" , "fourier" , "arena" , "render_target" , "photon" , "subdivision" };
+
+// account memory to a category
+void MemoryStats::Add( MEMORY_CATEGORY category , long long bytes )
+{
+    if( bytes == 0 )
+        return;
+    const long long current = ( g_currentMemory[category] += bytes );
+    long long peak = g_peakMemory[category].load();
+    while( current > peak && !g_peakMemory[category].compare_exchange_weak( peak , current ) );
+}
+
+// the number of bytes currently used by a category
+long long MemoryStats::GetCurrent( MEMORY_CATEGORY category )
+{
+    return g_currentMemory[category].load();
+}
+
+// the maximum number of bytes used by a category at once
+long long MemoryStats::GetPeak( MEMORY_CATEGORY category )
+{
+    return g_peakMemory[category].load();
+}
+
+// output the usage of all categories
+void MemoryStats::OutputLog()
+{
+    const double mb = 1024.0 * 1024.0;
+    long long current = 0 , peak = 0;
+    for( int i = 0 ; i < MEM_CATEGORY_CNT ; ++i ){
+        slog( INFO , PERFORMANCE , stringFormat( "Memory of %s : %.2f MB, peak %.2f MB." , g_categoryNames[i] , GetCurrent( (MEMORY_CATEGORY)i ) / mb , GetPeak( (MEMORY_CATEGORY)i ) / mb ) );
+        current += GetCurrent( (MEMORY_CATEGORY)i );
+        peak += GetPeak( (MEMORY_CATEGORY)i );
+    }
+    // peaks of categories are not reached at the same time , their sum is an upper bound
+    slog( INFO , PERFORMANCE , stringFormat( "Memory in total : %.2f MB, at most %.2f MB at peak." , current / mb , peak / mb ) );
+}
+
+// write the usage of all categories in json
+bool MemoryStats::WriteJson( const std::string& filename )
+{
+    std::ofstream file( filename.c_str() , std::ios::trunc );
+    if( !file.is_open() ){
+        slog( WARNING , GENERAL , stringFormat( "Failed to write memory report %s." , filename.c_str() ) );
+        return false;
+    }
+
+    file << "{\n";
+    for( int i = 0 ; i < MEM_CATEGORY_CNT ; ++i )
+        file << "    \"" << g_categoryNames[i] << "\": { \"current\": " << GetCurrent( (MEMORY_CATEGORY)i ) << ", \"peak\": " << GetPeak( (MEMORY_CATEGORY)i ) << " },\n";
+    long long current = 0 , peak = 0;
+    for( int i = 0 ; i < MEM_CATEGORY_CNT ; ++i ){
+        current += GetCurrent( (MEMORY_CATEGORY)i );
+        peak += GetPeak( (MEMORY_CATEGORY)i );
+    }
+    file << "    \"total\": { \"current\": " << current << ", \"peak\": " << peak << " }\n";
+    file << "}\n";
+    return (bool)file;
+}
+
+// add the usage of all categories to the report
+void MemoryStats::CollectStats( StatsGroup& stats )
+{
+    long long current = 0 , peak = 0;
+    for( int i = 0 ; i < MEM_CATEGORY_CNT ; ++i ){
+        stats.Add( std::string( g_categoryNames[i] ) + "_bytes" , GetCurrent( (MEMORY_CATEGORY)i ) );
+        stats.Add( std::string( g_categoryNames[i] ) + "_peak_bytes" , GetPeak( (MEMORY_CATEGORY)i ) );
+        current += GetCurrent( (MEMORY_CATEGORY)i );
+        peak += GetPeak( (MEMORY_CATEGORY)i );
+    }
+    stats.Add( "total_bytes" , current ).Add( "total_peak_bytes" , peak );
+}
@@ -0,0 +1,104 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <string>
+
+class StatsGroup;
+
+//! @brief Subsystems the memory of a render is accounted to.
+enum MEMORY_CATEGORY
+{
+    MEM_MESH = 0,           /**< Vertex and index buffers of meshes. */
+    MEM_TEXTURE,            /**< Pixels of image textures. */
+    MEM_ACCELERATOR,        /**< Nodes and primitive lists of the acceleration structure. */
+    MEM_MERL,               /**< Measured data of MERL brdfs. */
+    MEM_FOURIER,            /**< Tables of Fourier bsdfs. */
+    MEM_ARENA,              /**< Chunks of the arenas of the memory manager. */
+    MEM_RENDER_TARGET,      /**< Pixels, per pixel statistics and splats of the image sensor. */
+    MEM_PHOTON,             /**< Visible points and photon statistics of photon mapping. */
+    MEM_SUBDIV,             /**< Control cages and tessellated patches of subdivision surfaces. */
+    MEM_CATEGORY_CNT
+};
+
+//! @brief Accounting of the memory used by each subsystem.
+/**
+ * Subsystems report the size of their large buffers when they are allocated or released, the current
+ * usage and the peak of each category are tracked with atomic counters so that buffers could be reported
+ * from any thread. The peak usage tells how much memory a render takes before scheduling it on a machine.
+ * Small allocations are not reported, the numbers are a lower bound of the memory of the process.
+ */
+class MemoryStats
+{
+public:
+    //! @brief Account memory to a category.
+    //! @param category The category of the memory.
+    //! @param bytes    The number of bytes allocated, it is negative if the memory is released.
+    static void Add( MEMORY_CATEGORY category , long long bytes );
+
+    //! The number of bytes currently used by a category.
+    static long long GetCurrent( MEMORY_CATEGORY category );
+
+    //! The maximum number of bytes used by a category at once.
+    static long long GetPeak( MEMORY_CATEGORY category );
+
+    //! Output the usage of all categories to the performance log.
+    static void OutputLog();
+
+    //! @brief Write the usage of all categories in JSON.
+    //! @param filename The name of the file.
+    //! @return         False if the file can't be written.
+    static bool WriteJson( const std::string& filename );
+
+    //! @brief Add the usage of all categories to a group of the statistics report.
+    //! @param stats    The group of the memory.
+    static void CollectStats( StatsGroup& stats );
+};
+
+//! @brief Memory accounted to a category for the lifetime of its owner.
+//!
+//! The owner keeps the tracker next to its buffers and updates the size whenever they change, the memory
+//! is released from the category once the owner is destroyed.
+class MemoryTracker
+{
+public:
+    //! @brief Constructor.
+    //! @param category The category the memory is accounted to.
+    explicit MemoryTracker( MEMORY_CATEGORY category ) : m_category(category) {}
+
+    //! Destructor releasing the memory from the category.
+    ~MemoryTracker() { Set( 0 ); }
+
+    //! @brief Update the size of the tracked memory.
+    //! @param bytes    The current size of the buffers of the owner.
+    void Set( size_t bytes ){
+        MemoryStats::Add( m_category , (long long)bytes - (long long)m_bytes );
+        m_bytes = bytes;
+    }
+
+    //! The size of the tracked memory.
+    size_t Get() const { return m_bytes; }
+
+private:
+    MEMORY_CATEGORY m_category;     /**< The category the memory is accounted to. */
+    size_t          m_bytes = 0;    /**< The size of the tracked memory. */
+
+    MemoryTracker( const MemoryTracker& ) = delete;
+    MemoryTracker& operator=( const MemoryTracker& ) = delete;
+};
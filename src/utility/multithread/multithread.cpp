@@ -16,59 +16,210 @@
  */
 
 #include "multithread.h"
+#include "renderkernel.h"
 #include "integrator/integrator.h"
 #include "sampler/sampler.h"
 #include "camera/camera.h"
 #include "imagesensor/imagesensor.h"
+#include "geometry/ray.h"
+#include "geometry/scene.h"
+#include "accel/primaryraster.h"
+#include "accel/primarycache.h"
+#include "utility/rand.h"
+#include "utility/telemetry.h"
+#include "utility/profiler.h"
+#include "utility/spacefilling.h"
+#include <vector>
+#include <thread>
+#include <chrono>
 
-extern int g_iTileSize;
+// whether the primary rays of a region of the image can't reach the bounding box of the scene
+bool RegionMissesScene( const Camera* camera , const BBox& bbox , const Vector2i& ori , const Vector2i& rb )
+{
+    Point eye;
+    Vector corners[4];
+    if( !camera->GetFrustum( ori.x , ori.y , rb.x , rb.y , eye , corners ) )
+        return false;
+
+    // a scene without primitives is missed by every ray
+    if( bbox.m_Min.x > bbox.m_Max.x )
+        return true;
+
+    // the sides of the frustum face inward , the direction through the center of the region is inside all of them
+    const Vector center = corners[0] + corners[1] + corners[2] + corners[3];
+    for( int i = 0 ; i < 4 ; ++i )
+    {
+        Vector n = Cross( corners[i] , corners[(i+1)%4] );
+        if( Dot( n , center ) < 0.0f )
+            n = -n;
+
+        bool outside = true;
+        for( int k = 0 ; k < 8 && outside ; ++k )
+        {
+            const Point p( ( k & 1 ) ? bbox.m_Max.x : bbox.m_Min.x , ( k & 2 ) ? bbox.m_Max.y : bbox.m_Min.y , ( k & 4 ) ? bbox.m_Max.z : bbox.m_Min.z );
+            outside = Dot( n , p - eye ) < 0.0f;
+        }
+        if( outside )
+            return true;
+    }
+    return false;
+}
 
 // execute the task
-void RenderTask::Execute( std::shared_ptr<Integrator> integrator )
+unsigned long long RenderTask::Execute( Integrator* integrator )
+{
+    // the kernel specialized for the types of the view runs the loop without virtual calls
+    return ( kernel ? *kernel : RenderKernel::Generic() ).Execute( *this , integrator );
+}
+
+// block the thread while paused
+bool RenderControl::CheckPoint() const
+{
+    while( IsPaused() && !IsCancelled() )
+        std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+    return !IsCancelled();
+}
+
+// deal the tasks to the workers
+void RenderTaskScheduler::Start( unsigned worker_cnt , unsigned split_size , unsigned starvation )
 {
-    ImageSensor* is = camera->GetImageSensor();
-    if( !is )
+    m_workerCnt = ( worker_cnt == 0 ) ? 1 : worker_cnt;
+    m_splitSize = split_size;
+    m_starvation = (int)( ( starvation == 0 ) ? m_workerCnt : starvation );
+    m_deques.reset( new WorkStealingDeque<RenderTask>[m_workerCnt] );
+
+    const unsigned task_cnt = (unsigned)m_tasks.size();
+    m_queued = (int)task_cnt;
+    m_unfinished = (int)task_cnt;
+    m_samples = 0;
+    m_pending.reset( new std::atomic<int>[task_cnt] );
+    for( unsigned i = 0 ; i < task_cnt ; ++i )
+        m_pending[i] = 1;
+
+    // a worker only pushes split pieces while fewer tasks than the threshold are queued , three more pieces have to fit then
+    unsigned capacity = ( task_cnt + m_workerCnt - 1 ) / m_workerCnt;
+    if( m_splitSize > 0 && capacity < (unsigned)m_starvation + 3 )
+        capacity = (unsigned)m_starvation + 3;
+    for( unsigned i = 0 ; i < m_workerCnt ; ++i )
+        m_deques[i].Reset( capacity );
+
+    // tasks are dealt in turn and pushed backward , so that the bottom of each deque holds its first task in the tile order
+    for( unsigned i = task_cnt ; i > 0 ; --i )
+        m_deques[ ( i - 1 ) % m_workerCnt ].Push( &m_tasks[i - 1] );
+}
+
+// pop task
+RenderTask* RenderTaskScheduler::PopTask( unsigned worker )
+{
+    while( true )
+    {
+        if( RenderTask* task = TryPopTask( worker ) )
+            return task;
+
+        // without splitting no task is pushed once started , so all tasks are taken if every deque is empty
+        // otherwise the executing tasks could still be split , the worker waits until all of them are finished
+        if( m_splitSize == 0 || m_unfinished.load() == 0 )
+            return nullptr;
+        std::this_thread::yield();
+    }
+}
+
+// try to pop a task
+RenderTask* RenderTaskScheduler::TryPopTask( unsigned worker )
+{
+    RenderTask* task = m_deques[worker].Pop();
+    for( unsigned i = 1 ; !task && i < m_workerCnt ; ++i )
+        task = m_deques[ ( worker + i ) % m_workerCnt ].Steal();
+
+    // the tasks given back are rare , they are taken once the deques are empty
+    if( !task && m_returnedCnt.load() > 0 )
+    {
+        std::lock_guard<std::mutex> lock( m_piecesMutex );
+        if( !m_returned.empty() )
+        {
+            task = m_returned.back();
+            m_returned.pop_back();
+            --m_returnedCnt;
+        }
+    }
+    if( !task )
+        return nullptr;
+
+    // the queue is about to run dry , the task is shared with the starving workers
+    if( --m_queued < m_starvation && m_splitSize > 0 )
+        _splitTask( worker , *task );
+    return task;
+}
+
+// give back a popped task
+void RenderTaskScheduler::ReturnTask( RenderTask* task )
+{
+    std::lock_guard<std::mutex> lock( m_piecesMutex );
+    m_returned.push_back( task );
+    ++m_returnedCnt;
+    ++m_queued;
+}
+
+// split the task
+void RenderTaskScheduler::_splitTask( unsigned worker , RenderTask& task )
+{
+    const int nx = ( task.size.x >= (int)( 2 * m_splitSize ) ) ? 2 : 1;
+    const int ny = ( task.size.y >= (int)( 2 * m_splitSize ) ) ? 2 : 1;
+    if( nx * ny == 1 )
         return;
-    
-    // request samples
-    integrator->RequestSample( sampler , pixelSamples , samplePerPixel );
-    
-	Vector2i rb = ori + size;
-    
-    unsigned tid = ThreadId();
-    for( int i = ori.y ; i < rb.y ; i++ )
+
+    const Vector2i half( task.size.x / nx , task.size.y / ny );
+    const int pieces = nx * ny - 1;
+    m_pending[task.taskId] += pieces;
+    m_unfinished += pieces;
+    m_queued += pieces;
+
+    // the worker keeps the first quarter , the others are pushed to its deque
+    for( int i = 1 ; i <= pieces ; ++i )
     {
-        for( int j = ori.x ; j < rb.x ; j++ )
+        const int x = i % nx;
+        const int y = i / nx;
+
+        RenderTask* piece = nullptr;
         {
-            // clear managed memory after each pixel
-            MemManager::GetSingleton().ClearMem(tid);
-            
-            // generate samples to be used later
-            integrator->GenerateSample( sampler , pixelSamples, samplePerPixel , scene );
-            
-            // the radiance
-            Spectrum radiance;
-
-            for( unsigned k = 0 ; k < samplePerPixel ; ++k )
-            {
-                // generate rays
-                Ray r = camera->GenerateRay( (float)j , (float)i , pixelSamples[k] );
-                // accumulate the radiance
-                radiance += integrator->Li( r , pixelSamples[k] );
-            }
-            radiance /= (float)samplePerPixel;
-            
-            // store the pixel
-            is->StorePixel( j , i , radiance , *this );
+            std::lock_guard<std::mutex> lock( m_piecesMutex );
+            m_pieces.push_back( task );
+            piece = &m_pieces.back();
         }
+        piece->ori = task.ori + Vector2i( x * half.x , y * half.y );
+        piece->size.x = ( x == nx - 1 ) ? task.size.x - x * half.x : half.x;
+        piece->size.y = ( y == ny - 1 ) ? task.size.y - y * half.y : half.y;
+        piece->pixelSamples = new PixelSample[task.samplePerPixel];
+        m_deques[worker].Push( piece );
+    }
+    task.size = half;
+}
+
+// finish task
+void RenderTaskScheduler::FinishTask( const RenderTask& task )
+{
+    // a tile is not complete if the rendering is cancelled , its progress is not updated then
+    if( --m_pending[task.taskId] == 0 && !RenderControl::GetSingleton().IsCancelled() )
+    {
+        // the pixels of the tile are visible to the threads reading the progress
+        std::atomic_thread_fence( std::memory_order_release );
+        task.taskDone[task.taskId] = true;
     }
-    
-	if( integrator->NeedRefreshTile() )
-	{
-		int x_off = ori.x / g_iTileSize;
-		int y_off = (is->GetHeight() - 1 - ori.y ) / g_iTileSize ;
-		is->FinishTile( x_off, y_off, *this );
-	}
-    
-    taskDone[taskId] = true;
+    --m_unfinished;
+
+    if( m_taskCallback )
+        m_taskCallback();
+}
+
+// release all tasks
+void RenderTaskScheduler::Clear()
+{
+    m_tasks.clear();
+    m_pieces.clear();
+    m_returned.clear();
+    m_returnedCnt = 0;
+    m_deques.reset();
+    m_pending.reset();
+    m_taskCallback = nullptr;
+    m_workerCnt = 0;
 }
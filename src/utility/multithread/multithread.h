@@ -25,9 +25,18 @@ unsigned NumSystemCores();
 // get the thread id
 int ThreadId();
 
-#include <list>
+// set the thread id of the current thread , it is only called once a thread starts
+void SetThreadId( int tid );
+
+#include <vector>
 #include <memory>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <functional>
 #include "utility/singleton.h"
+#include "utility/enum.h"
+#include "wsdeque.h"
 #include "sampler/sample.h"
 #include "math/vector2.h"
 
@@ -37,6 +46,9 @@ class Sampler;
 class Camera;
 class RenderTarget;
 class ImageSensor;
+class PrimaryRaster;
+class PrimaryCache;
+class RenderKernel;
 
 class RenderTask
 {
@@ -48,17 +60,41 @@ public:
     // the task id
     unsigned		taskId = 0;
     bool*			taskDone = nullptr;	// used to show the progress
+    // the time spent on each task in microseconds , it is indexed by the task id and only measured if it isn't null
+    std::atomic<unsigned long long>*	taskCost = nullptr;
     
     // the pixel sample
     PixelSample*	pixelSamples = nullptr;
     unsigned		samplePerPixel = 0;
+
+    // adaptive sampling , samples are taken in batches until the relative error of the pixel is below the threshold
+    // it is disabled if the threshold is zero or the batch is not smaller than the sample number per pixel
+    float			adaptiveThreshold = 0.0f;
+    unsigned		adaptiveBatch = 0;
+
+    // the number of samples per pixel taken before the task , they key the random numbers of deterministic rendering
+    unsigned		sampleOffset = 0;
+
+    // the order of the pixels in the tile , one of PIXEL_ORDER
+    unsigned		pixelOrder = PIXEL_ORDER_SCANLINE;
+
+    // the task only renders the pixels on a grid of the stride , skipping the ones on the grid of the coarser preview level
+    // both grids start at the top-left corner of the image , they are one and zero out of previewing
+    unsigned		previewStride = 1;
+    unsigned		previewCovered = 0;
     
     // the sampler
     Sampler*		sampler = nullptr;
     // the camera
     Camera*			camera = nullptr;
+    // the raster pass finding the first hits of the camera rays , the rays are traced if it is null
+    const PrimaryRaster*	primaryRaster = nullptr;
+    // the first hits of the camera rays kept across the passes of progressive rendering , the samples take the points of its pattern
+    PrimaryCache*	primaryCache = nullptr;
     // the scene description
     const Scene&	scene;
+    // the render loop specialized for the types of the view , the generic one is used if it is null
+    const RenderKernel*	kernel = nullptr;
     
     // constructor
     RenderTask( Scene& sc , Sampler* samp , Camera* cam , bool* td, unsigned spp )
@@ -67,7 +103,15 @@ public:
     }
     
     // execute the task
-    void Execute( std::shared_ptr<Integrator> integrator );
+    // para 'integrator' : the integrator of the view
+    // result            : the number of samples taken
+    unsigned long long Execute( Integrator* integrator );
+
+    // render the task with the types of the view , it is defined in 'renderkernel.h'
+    // para 'integrator' : the integrator of the view , it is of the type 'IntegratorT'
+    // result            : the number of samples taken
+    template< class CameraT , class IntegratorT , class SensorT >
+    unsigned long long Render( Integrator* integrator );
     
     static void DestoryRenderTask( RenderTask& rt )
     {
@@ -75,35 +119,167 @@ public:
     }
 };
 
-class RenderTaskQueue : public Singleton<RenderTaskQueue>
+//////////////////////////////////////////////////////////////////////
+//	definition of render task scheduler
+//	desc :	Each worker thread owns a lock-free work stealing deque of
+//			render tasks. Tasks are dealt to the workers in the order
+//			they are pushed , so every worker renders its tiles in the
+//			tile order of the image. Idle workers steal the tiles at the back of
+//			the order from the others.
+//			Once fewer tasks than the starvation threshold are queued ,
+//			popped tasks are split into quarters until they reach the
+//			minimum split size , so that the last expensive tiles are
+//			shared by all threads instead of leaving most of them idle.
+//			Workers of the render farm pull tasks from an extra deque ,
+//			the tasks of the lost ones are given back and taken again.
+class RenderTaskScheduler : public Singleton<RenderTaskScheduler>
 {
 // public method
 public:
-    // Add Task
-    void PushTask( RenderTask task ){
-        m_taskList.push_back(task);
+    // Add task , it can only be called before the scheduler starts
+    void PushTask( const RenderTask& task ){
+        m_tasks.push_back(task);
     }
-    
+
+    // Deal the tasks to the workers
+    // para 'worker_cnt' : the number of worker threads
+    // para 'split_size' : the minimum size of split tasks , zero disables splitting
+    // para 'starvation' : tasks are split once fewer tasks than it are queued , zero means the number of workers
+    void Start( unsigned worker_cnt , unsigned split_size = 0 , unsigned starvation = 0 );
+
     // Pop task
-    RenderTask PopTask(){
-        RenderTask t = m_taskList.front();
-        m_taskList.pop_front();
-        return t;
+    // para 'worker' : the id of the worker thread
+    // result        : the task to execute , nullptr if all tasks are finished
+    RenderTask* PopTask( unsigned worker );
+
+    // Try to pop a task without waiting for the executing tasks to be split
+    // para 'worker' : the id of the worker , the owner of its deque has to be the only caller at a time
+    // result        : the task to execute , nullptr if no task is queued now
+    RenderTask* TryPopTask( unsigned worker );
+
+    // Give back a popped task that wasn't executed , it is taken again by any worker
+    // para 'task' : the task , the worker executing it on a node of the render farm is lost for example
+    void ReturnTask( RenderTask* task );
+
+    // Finish task , the progress of the original tile is updated once all of its pieces are finished
+    // para 'task' : the executed task
+    void FinishTask( const RenderTask& task );
+
+    // Set the function called after each task is finished , it is called by the render threads
+    // para 'callback' : the function , it is reset when the scheduler is cleared
+    void SetTaskCallback( const std::function<void()>& callback ){
+        m_taskCallback = callback;
     }
-    
-    // Is the queue empty
-    bool IsEmpty() const{
-        return m_taskList.empty();
+
+    // Count the samples taken by a task
+    // para 'cnt' : the number of samples
+    void AddSamples( unsigned long long cnt ){
+        m_samples += cnt;
     }
-    
-    // private field
+
+    // Get the number of samples taken since the scheduler started
+    unsigned long long GetSampleCount() const {
+        return m_samples.load();
+    }
+
+    // Release all tasks , it can only be called after all workers stop
+    void Clear();
+
+// private field
 private:
-    std::list<RenderTask> m_taskList;
-    
+    // all of the tasks
+    std::vector<RenderTask> m_tasks;
+    // the deque of each worker
+    std::unique_ptr<WorkStealingDeque<RenderTask>[]> m_deques;
+    // the number of workers
+    unsigned m_workerCnt = 0;
+    // the minimum size of split tasks
+    unsigned m_splitSize = 0;
+    // the starvation threshold
+    int m_starvation = 0;
+    // the number of tasks in the deques
+    std::atomic<int> m_queued{0};
+    // the number of tasks not finished yet , including the executing ones
+    std::atomic<int> m_unfinished{0};
+    // the number of samples taken
+    std::atomic<unsigned long long> m_samples{0};
+    // the function called after each task
+    std::function<void()> m_taskCallback;
+    // the number of unfinished pieces of each original task
+    std::unique_ptr<std::atomic<int>[]> m_pending;
+    // the pieces of split tasks , a deque keeps the addresses of the pieces valid while growing
+    std::deque<RenderTask> m_pieces;
+    std::mutex m_piecesMutex;
+    // the tasks given back , they are guarded by the mutex of the pieces
+    std::vector<RenderTask*> m_returned;
+    std::atomic<int> m_returnedCnt{0};
+
+    // split the task into quarters and push the other pieces to the deque of the worker
+    void _splitTask( unsigned worker , RenderTask& task );
+
     // private constructor
-    RenderTaskQueue(){}
-    
-    friend class Singleton<RenderTaskQueue>;
+    RenderTaskScheduler(){}
+
+    friend class Singleton<RenderTaskScheduler>;
+};
+
+//////////////////////////////////////////////////////////////////////
+//	definition of render control
+//	desc :	Cooperative cancellation and pausing of the rendering.
+//			Render threads check it between tiles and between the
+//			scanlines of a tile , so the pixels rendered before
+//			cancellation are kept. Cancel , Pause and Resume only touch
+//			atomic flags , they could be called from signal handlers.
+//			The Blender add-on controls the rendering through a byte in
+//			the shared memory instead.
+class RenderControl : public Singleton<RenderControl>
+{
+// public method
+public:
+    // states written into the control byte
+    enum CONTROL_STATE { CONTROL_RUN = 0 , CONTROL_CANCEL = 1 , CONTROL_PAUSE = 2 };
+
+    // Cancel the rendering , it can't be resumed afterward
+    void Cancel(){ m_cancelled = true; }
+
+    // Pause the rendering
+    void Pause(){ m_paused = true; }
+
+    // Resume the paused rendering
+    void Resume(){ m_paused = false; }
+
+    // Clear the states of the last rendering before the next one in the same process
+    void Reset(){ m_cancelled = false; m_paused = false; }
+
+    // Whether the rendering is cancelled
+    bool IsCancelled() const {
+        return m_cancelled.load() || ( m_control && *m_control == CONTROL_CANCEL );
+    }
+
+    // Whether the rendering is paused
+    bool IsPaused() const {
+        return m_paused.load() || ( m_control && *m_control == CONTROL_PAUSE );
+    }
+
+    // Block the calling thread while the rendering is paused
+    // result : false if the rendering is cancelled , the thread should stop then
+    bool CheckPoint() const;
+
+    // Set the control byte written by another process
+    // para 'control' : the byte holding one of the states , nullptr to detach it
+    void SetControlByte( const volatile char* control ){ m_control = control; }
+
+// private field
+private:
+    std::atomic<bool> m_cancelled{false};
+    std::atomic<bool> m_paused{false};
+    // the control byte in shared memory
+    const volatile char* m_control = nullptr;
+
+    // private constructor
+    RenderControl(){}
+
+    friend class Singleton<RenderControl>;
 };
 
 #include "stdthread.h"
@@ -0,0 +1,44 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "renderkernel.h"
+#include "camera/perspective.h"
+#include "camera/ortho.h"
+#include "integrator/pathtracing.h"
+#include "integrator/direct.h"
+#include "imagesensor/rendertargetimage.h"
+#include "imagesensor/blenderimage.h"
+#include "imagesensor/memoryimage.h"
+
+// the kernel of the base types
+const RenderKernel& RenderKernel::Generic()
+{
+    static const RenderKernelT<Camera,Integrator,ImageSensor> kernel;
+    return kernel;
+}
+
+// the kernels of the common views , every kernel is compiled apart , so only the ones worth it are registered
+DEFINE_RENDER_KERNEL( PerspectivePtFileKernel , PerspectiveCamera , PathTracing , RenderTargetImage , "perspective/pt/rendertarget" );
+DEFINE_RENDER_KERNEL( PerspectivePtBlenderKernel , PerspectiveCamera , PathTracing , BlenderImage , "perspective/pt/blender" );
+DEFINE_RENDER_KERNEL( PerspectivePtMemoryKernel , PerspectiveCamera , PathTracing , MemoryImage , "perspective/pt/memory" );
+DEFINE_RENDER_KERNEL( PerspectiveDirectFileKernel , PerspectiveCamera , DirectLight , RenderTargetImage , "perspective/direct/rendertarget" );
+DEFINE_RENDER_KERNEL( PerspectiveDirectBlenderKernel , PerspectiveCamera , DirectLight , BlenderImage , "perspective/direct/blender" );
+DEFINE_RENDER_KERNEL( PerspectiveDirectMemoryKernel , PerspectiveCamera , DirectLight , MemoryImage , "perspective/direct/memory" );
+DEFINE_RENDER_KERNEL( OrthoPtFileKernel , OrthoCamera , PathTracing , RenderTargetImage , "ortho/pt/rendertarget" );
+DEFINE_RENDER_KERNEL( OrthoPtBlenderKernel , OrthoCamera , PathTracing , BlenderImage , "ortho/pt/blender" );
+DEFINE_RENDER_KERNEL( OrthoDirectFileKernel , OrthoCamera , DirectLight , RenderTargetImage , "ortho/direct/rendertarget" );
+DEFINE_RENDER_KERNEL( OrthoDirectBlenderKernel , OrthoCamera , DirectLight , BlenderImage , "ortho/direct/blender" );
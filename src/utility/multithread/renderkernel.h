@@ -0,0 +1,392 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "multithread.h"
+#include "integrator/integrator.h"
+#include "sampler/sampler.h"
+#include "camera/camera.h"
+#include "imagesensor/imagesensor.h"
+#include "geometry/ray.h"
+#include "geometry/scene.h"
+#include "accel/primaryraster.h"
+#include "accel/primarycache.h"
+#include "utility/rand.h"
+#include "utility/telemetry.h"
+#include "utility/profiler.h"
+#include "utility/spacefilling.h"
+#include "utility/creator.h"
+#include <vector>
+#include <chrono>
+#include <typeinfo>
+#include <type_traits>
+
+//////////////////////////////////////////////////////////////////////
+//	definition of render kernel
+//	desc :	The render loop of a task is a template over the types of
+//			the camera , the integrator and the image sensor of the view.
+//			Kernels of concrete types call the cameras , integrators
+//			and image sensors through their final types , the calls made
+//			for every sample and pixel could be inlined then. Kernels are
+//			registered by the names of the types like
+//			'perspective/pt/rendertarget' , views of any other types
+//			take the generic kernel of the base types with virtual calls.
+class RenderKernel
+{
+public:
+    // destructor
+    virtual ~RenderKernel(){}
+
+    // whether the objects of a view are of the types of the kernel
+    // para 'camera'     : the camera of the view
+    // para 'integrator' : the integrator of the view
+    // para 'sensor'     : the image sensor of the view
+    virtual bool Accepts( const Camera* camera , const Integrator* integrator , const ImageSensor* sensor ) const = 0;
+
+    // render a task
+    // para 'task'       : the task to render
+    // para 'integrator' : the integrator
+    // result            : the number of samples taken
+    virtual unsigned long long Execute( RenderTask& task , Integrator* integrator ) const = 0;
+
+    // the kernel of the base types , it renders views of any types
+    static const RenderKernel& Generic();
+};
+
+// the kernel of the types of a view
+template< class CameraT , class IntegratorT , class SensorT >
+class RenderKernelT : public RenderKernel
+{
+public:
+    // whether the objects of a view are of the types of the kernel , objects of derived types are not
+    bool Accepts( const Camera* camera , const Integrator* integrator , const ImageSensor* sensor ) const override {
+        return typeid( *camera ) == typeid( CameraT ) && typeid( *integrator ) == typeid( IntegratorT ) && typeid( *sensor ) == typeid( SensorT );
+    }
+
+    // render a task
+    unsigned long long Execute( RenderTask& task , Integrator* integrator ) const override {
+        return task.Render<CameraT,IntegratorT,SensorT>( integrator );
+    }
+};
+
+// register the kernel of the types of a view
+// para 'T' : the name of the kernel class
+// para 'C' : the type of the camera
+// para 'I' : the type of the integrator
+// para 'S' : the type of the image sensor
+// para 'N' : the names of the types joined by '/'
+#define DEFINE_RENDER_KERNEL( T , C , I , S , N ) \
+    class T : public RenderKernelT<C,I,S> { public: DEFINE_CREATOR( T , RenderKernel , N ); }; \
+    IMPLEMENT_CREATOR( T )
+
+// the calls of the kernels made for every batch of samples or pixel , the base types are called virtually and the
+// concrete ones directly by the qualified names of their methods , the kernels only take objects of the exact types
+inline void kernelGenerateSample( const Integrator* integrator , const Sampler* sampler , PixelSample* samples , unsigned ps , const Scene& scene ){
+    integrator->GenerateSample( sampler , samples , ps , scene );
+}
+template< class T >
+inline void kernelGenerateSample( const T* integrator , const Sampler* sampler , PixelSample* samples , unsigned ps , const Scene& scene ){
+    integrator->T::GenerateSample( sampler , samples , ps , scene );
+}
+
+inline void kernelGenerateRays( const Camera* camera , float x , float y , const PixelSample* ps , Ray* rays , unsigned count ){
+    camera->GenerateRays( x , y , ps , rays , count );
+}
+template< class T >
+inline void kernelGenerateRays( const T* camera , float x , float y , const PixelSample* ps , Ray* rays , unsigned count ){
+    camera->T::GenerateRays( x , y , ps , rays , count );
+}
+
+inline void kernelLiStream( const Integrator* integrator , const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned count ){
+    integrator->LiStream( rays , ps , radiance , count );
+}
+template< class T >
+inline void kernelLiStream( const T* integrator , const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned count ){
+    // integrators keeping the stream of the base class evaluate the rays one by one , their 'Li' is called directly
+    typedef void ( Integrator::*BaseStream )( const Ray* , const PixelSample* , Spectrum* , unsigned ) const;
+    if( std::is_same< decltype( &T::LiStream ) , BaseStream >::value ){
+        for( unsigned i = 0 ; i < count ; ++i )
+            radiance[i] = integrator->T::Li( rays[i] , ps[i] );
+    }else
+        integrator->T::LiStream( rays , ps , radiance , count );
+}
+
+inline void kernelStorePixel( ImageSensor* sensor , int x , int y , const Spectrum& color , const RenderTask& rt ){
+    sensor->StorePixel( x , y , color , rt );
+}
+template< class T >
+inline void kernelStorePixel( T* sensor , int x , int y , const Spectrum& color , const RenderTask& rt ){
+    sensor->T::StorePixel( x , y , color , rt );
+}
+
+// whether the primary rays of a region of the image can't reach the bounding box of the scene
+// note : the test is conservative , the box is only outside the frustum if all of its corners are behind one of its sides
+bool RegionMissesScene( const Camera* camera , const BBox& bbox , const Vector2i& ori , const Vector2i& rb );
+
+// render the task with the types of the view
+template< class CameraT , class IntegratorT , class SensorT >
+unsigned long long RenderTask::Render( Integrator* integrator )
+{
+    SensorT* is = static_cast<SensorT*>( camera->GetImageSensor() );
+    if( !is )
+        return 0;
+    const CameraT* cam = static_cast<const CameraT*>( camera );
+    const IntegratorT* inte = static_cast<const IntegratorT*>( integrator );
+    SORT_PROFILE_ARG( "RenderTask" , taskId );
+
+    // the cost of the task is measured for the live throughput
+    const auto start_time = std::chrono::steady_clock::now();
+    const unsigned long long start_rays = RenderTelemetry::LocalRays();
+    const unsigned long long start_path_rays = RenderTelemetry::LocalPathRays();
+    
+    // request samples
+    integrator->RequestSample( sampler , pixelSamples , samplePerPixel );
+    
+	Vector2i rb = ori + size;
+    
+    std::vector<Ray> rays( samplePerPixel );
+    std::vector<Spectrum> radiances( samplePerPixel );
+
+    // the output variables of every sample , they are averaged the same way as the radiance
+    const bool aov = is->HasAov();
+    std::vector<Spectrum> aovs( aov ? samplePerPixel * AOV_COUNT : 0 );
+    const RenderControl& control = RenderControl::GetSingleton();
+    const bool adaptive = adaptiveThreshold > 0.0f && adaptiveBatch > 0 && adaptiveBatch < samplePerPixel;
+    const unsigned batch = adaptive ? adaptiveBatch : samplePerPixel;
+    unsigned long long sample_cnt = 0;
+
+    // tiles whose rays can't reach the scene only see the environment , their samples skip the integrator
+    const bool background = integrator->IsBackgroundOnMiss() && RegionMissesScene( camera , scene.GetBBox() , ori , rb );
+    if( background )
+        RenderTelemetry::CountBackgroundTask( ThreadId() );
+
+    // the first hits of the camera rays of the other tiles could be found among the primitives listed for each pixel ,
+    // the candidates are only listed once a pixel needs them as the first hits could be kept from earlier passes
+    const bool raster = primaryRaster && !background;
+    const bool cached = primaryCache && !background;
+    Primary_Tile raster_tile;
+    bool raster_listed = false;
+    std::vector<Primary_Hit> primary_hits( ( raster || cached ) ? samplePerPixel : 0 );
+    unsigned long long cache_reused = 0 , cache_traced = 0;
+
+    // the cost of each pixel is only measured if it is requested , reading the clock per pixel is not free
+    const bool cost = is->HasCost();
+
+    // samples are splatted to the pixels around them by the filter , the task keeps the ones of its apron until it's finished
+    const PixelFilter& filter = is->GetFilter();
+    const bool filtered = filter.IsSplatting();
+    const int apron = filtered ? filter.GetApron() : 0;
+    const int stride = size.x + 2 * apron;
+    std::vector<Spectrum> filter_color( filtered ? stride * ( size.y + 2 * apron ) : 0 );
+    std::vector<float> filter_weight( filter_color.size() , 0.0f );
+
+    // pixels are visited in scanlines or along a morton curve over the smallest power-of-two square covering the tile ,
+    // the pixels of the square outside the tile are skipped
+    const bool morton = pixelOrder == PIXEL_ORDER_MORTON;
+    unsigned side = 1;
+    while( morton && ( side < (unsigned)size.x || side < (unsigned)size.y ) )
+        side *= 2;
+    const unsigned visits = morton ? side * side : (unsigned)( size.x * size.y );
+    const unsigned span = morton ? side : (unsigned)size.x;
+    std::vector<int> row_pixels( size.y , 0 );
+    for( unsigned first = 0 ; first < visits ; first += span )
+    {
+        // the pixels rendered so far are kept on cancellation
+        if( !control.CheckPoint() )
+            break;
+
+        for( unsigned p = first ; p < first + span ; p++ )
+        {
+            const Vector2i local = morton ? MortonPoint( p ) : Vector2i( (int)( p % size.x ) , (int)( p / size.x ) );
+            if( local.x >= size.x || local.y >= size.y )
+                continue;
+            const int i = ori.y + local.y;
+            const int j = ori.x + local.x;
+            ++row_pixels[local.y];
+
+            // pixels off the grid of the preview level are left to the finer levels , the ones of the coarser level are done
+            if( ( j % previewStride ) || ( i % previewStride ) || ( previewCovered && j % previewCovered == 0 && i % previewCovered == 0 ) )
+                continue;
+
+            // managed memory allocated for the pixel is released once it's done
+            MemScope mem_scope;
+
+            std::chrono::steady_clock::time_point pixel_time;
+            unsigned long long pixel_rays = 0 , pixel_path_rays = 0;
+            if( cost ){
+                pixel_time = std::chrono::steady_clock::now();
+                pixel_rays = RenderTelemetry::LocalRays();
+                pixel_path_rays = RenderTelemetry::LocalPathRays();
+            }
+
+            // running mean and variance of the luminance of the samples ( Welford's algorithm )
+            Spectrum radiance;
+            Spectrum aov_sum[AOV_COUNT];
+            unsigned n = 0;
+            float mean = 0.0f;
+            float m2 = 0.0f;
+            while( n < samplePerPixel )
+            {
+                // the random numbers of a batch only depend on the pixel and the samples in deterministic rendering
+                sort_reseed( j , i , sampleOffset + n );
+
+                // generate samples to be used later , rays of background tiles only need their positions in the pixel
+                Sampler::StartPixel( j , i , sampleOffset + n );
+                if( background )
+                {
+                    float* data = SORT_MALLOC_ARRAY( float , 2 * batch )();
+                    sampler->Generate2D( data , batch , true );
+                    for( unsigned k = 0 ; k < batch ; ++k )
+                    {
+                        pixelSamples[k].img_u = data[2*k];
+                        pixelSamples[k].img_v = data[2*k+1];
+                    }
+                }
+                else
+                    kernelGenerateSample( inte , sampler , pixelSamples , batch , scene );
+
+                // the samples of the primary cache take the points of its pattern , so that their camera rays repeat across passes
+                for( unsigned k = 0 ; primaryCache && k < batch ; ++k )
+                    primaryCache->Jitter( j , i , sampleOffset + n + k , pixelSamples[k].img_u , pixelSamples[k].img_v );
+
+                // generate rays , they are traced together as they are very coherent
+                for( unsigned k = 0 ; k < batch ; ++k )
+                {
+                    pixelSamples[k].pixel_x = j;
+                    pixelSamples[k].pixel_y = i;
+                    pixelSamples[k].aov = aov ? &aovs[k * AOV_COUNT] : nullptr;
+                }
+                kernelGenerateRays( cam , (float)j , (float)i , pixelSamples , &rays[0] , batch );
+                if( aov )
+                    std::fill( aovs.begin() , aovs.begin() + batch * AOV_COUNT , Spectrum() );
+                if( background )
+                {
+                    // the environment is seen directly
+                    scene.Le( &rays[0] , &radiances[0] , batch );
+                    for( unsigned k = 0 ; aov && k < batch ; ++k )
+                        aovs[ k * AOV_COUNT + AOV_DIRECT ] = radiances[k];
+                }
+                else
+                {
+                    // the whole batch is traced again if any of its points is not traced yet
+                    bool found = cached;
+                    for( unsigned k = 0 ; found && k < batch ; ++k )
+                        found = primaryCache->Lookup( j , i , sampleOffset + n + k , primary_hits[k] );
+                    if( found )
+                        cache_reused += batch;
+                    else if( raster )
+                    {
+                        if( !raster_listed )
+                            primaryRaster->BuildTile( ori , size , raster_tile );
+                        raster_listed = true;
+                        primaryRaster->Trace( raster_tile , j , i , &rays[0] , &primary_hits[0] , batch );
+                    }
+                    else if( cached )
+                        scene.GetPrimaryHits( &rays[0] , &primary_hits[0] , batch );
+                    if( cached && !found )
+                    {
+                        for( unsigned k = 0 ; k < batch ; ++k )
+                            primaryCache->Store( j , i , sampleOffset + n + k , primary_hits[k] );
+                        cache_traced += batch;
+                    }
+                    for( unsigned k = 0 ; ( raster || cached ) && k < batch ; ++k )
+                        pixelSamples[k].primary = &primary_hits[k];
+                    kernelLiStream( inte , &rays[0] , pixelSamples , &radiances[0] , batch );
+                }
+
+                // accumulate the radiance
+                for( unsigned k = 0 ; k < batch ; ++k )
+                {
+                    radiance += radiances[k];
+                    for( unsigned a = 0 ; aov && a < AOV_COUNT ; ++a )
+                        aov_sum[a] += aovs[ k * AOV_COUNT + a ];
+
+                    if( filtered )
+                    {
+                        const float sx = j + pixelSamples[k].img_u - 0.5f;
+                        const float sy = i + pixelSamples[k].img_v - 0.5f;
+                        const int x0 = max( ori.x - apron , (int)ceil( sx - filter.GetRadius() ) );
+                        const int x1 = min( rb.x + apron - 1 , (int)floor( sx + filter.GetRadius() ) );
+                        const int y0 = max( ori.y - apron , (int)ceil( sy - filter.GetRadius() ) );
+                        const int y1 = min( rb.y + apron - 1 , (int)floor( sy + filter.GetRadius() ) );
+                        for( int y = y0 ; y <= y1 ; ++y )
+                            for( int x = x0 ; x <= x1 ; ++x )
+                            {
+                                const float w = filter.Evaluate( sx - x , sy - y );
+                                const int idx = ( y - ori.y + apron ) * stride + x - ori.x + apron;
+                                filter_color[idx] += radiances[k] * w;
+                                filter_weight[idx] += w;
+                            }
+                    }
+
+                    const float lum = radiances[k].GetIntensity();
+                    const float delta = lum - mean;
+                    mean += delta / (float)( ++n );
+                    m2 += delta * ( lum - mean );
+                }
+
+                // stop once the 95% confidence interval of the mean is narrow enough , the first batch alone is not trusted
+                if( adaptive && n > batch )
+                {
+                    const float std_err = sqrt( m2 / (float)( n - 1 ) / (float)n );
+                    if( 1.96f * std_err <= adaptiveThreshold * ( mean + 0.001f ) )
+                        break;
+                }
+            }
+            radiance /= (float)n;
+            sample_cnt += n;
+            
+            // store the pixel , filtered pixels are stored once the task is finished
+            if( !filtered )
+                kernelStorePixel( is , j , i , radiance , *this );
+            if( aov ){
+                for( unsigned a = 0 ; a < AOV_COUNT ; ++a )
+                    aov_sum[a] /= (float)n;
+                is->StoreAov( j , i , aov_sum );
+            }
+            if( cost ){
+                const std::chrono::duration<double> pixel_seconds = std::chrono::steady_clock::now() - pixel_time;
+                is->StoreCost( j , i , pixel_seconds.count() , n , RenderTelemetry::LocalRays() - pixel_rays , RenderTelemetry::LocalPathRays() - pixel_path_rays );
+            }
+        }
+    }
+
+    // only the leading rows rendered completely are kept in filtered tiles on cancellation
+    int rows = 0;
+    while( rows < size.y && row_pixels[rows] == size.x )
+        ++rows;
+
+    RenderTaskScheduler::GetSingleton().AddSamples( sample_cnt );
+    if( primaryCache )
+        primaryCache->Count( cache_reused , cache_traced );
+    const auto image_time = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> seconds = image_time - start_time;
+    RenderTelemetry::FinishTask( ThreadId() , sample_cnt , RenderTelemetry::LocalRays() - start_rays , RenderTelemetry::LocalPathRays() - start_path_rays , seconds.count() );
+    if( taskCost )
+        taskCost[taskId] += (unsigned long long)( seconds.count() * 1e6 );
+
+    // storing the tile in the image sensor is timed apart from the task , it could wait for the other threads
+    if( filtered )
+        is->StoreFilteredTile( *this , rows , filter_color.data() , filter_weight.data() );
+
+    // the tile is not complete after cancellation , the whole image is updated at the end instead
+	if( !control.IsCancelled() && integrator->NeedRefreshTile() )
+		is->FinishTile( *this );
+    RenderTelemetry::AddImageTime( ThreadId() , std::chrono::duration<double>( std::chrono::steady_clock::now() - image_time ).count() );
+    return sample_cnt;
+}
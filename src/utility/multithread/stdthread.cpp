@@ -18,6 +18,10 @@
 #include "stdthread.h"
 
 #include "managers/memmanager.h"
+#include "accel/accelstats.h"
+#include "material/shadingstats.h"
+#include "utility/telemetry.h"
+#include <chrono>
 
 // thread id
 static Thread_Local int g_ThreadId = 0;
@@ -28,45 +32,48 @@ int ThreadId()
 	return g_ThreadId;
 }
 
-// get the number of cpu cores in the system
-unsigned NumSystemCores()
+// set the thread id
+void SetThreadId( int tid )
 {
-	return std::thread::hardware_concurrency();
+	g_ThreadId = tid;
 }
 
-// critical section
-PlatformSpinlockMutex g_mutex;
-
-void RenderThreadStd::BeginThread()
+// get the number of cpu cores in the system
+unsigned NumSystemCores()
 {
-	m_thread = std::thread([&]() {
-		// setup lts
-        g_ThreadId = m_tid;
-
-		// run the thread
-		RunThread();
-	});
+	return std::thread::hardware_concurrency();
 }
 
 // Run the thread
 void RenderThreadStd::RunThread()
 {
-	while (true)
+	// counters left by the preprocessing on the same thread are not part of the rendering
+	SORT_STATS( AccelStats::Local() = AccelStats() );
+
+	// Get new tasks from the scheduler until all of them are taken
+	// the time between two tasks is spent on scheduling , the last pop only waits for the tasks of the others to be split
+	RenderTaskScheduler& scheduler = RenderTaskScheduler::GetSingleton();
+	const RenderControl& control = RenderControl::GetSingleton();
+	auto schedule_start = std::chrono::steady_clock::now();
+	while (RenderTask* task = scheduler.PopTask(m_tid))
 	{
-		g_mutex.lock();
-		if (RenderTaskQueue::GetSingleton().IsEmpty())
-		{
-			g_mutex.unlock();
-			break;
-		}
-		// Get a new task from the task queue
-		RenderTask task = RenderTaskQueue::GetSingleton().PopTask();
-		g_mutex.unlock();
+		RenderTelemetry::AddSchedulingTime( ThreadId() , std::chrono::duration<double>( std::chrono::steady_clock::now() - schedule_start ).count() );
 
-		// execute the task
-		task.Execute(m_pIntegrator);
+		// execute the task , the left tasks are only drained after cancellation
+		if( control.CheckPoint() )
+			task->Execute( m_pIntegrator.get() );
+		schedule_start = std::chrono::steady_clock::now();
+		scheduler.FinishTask(*task);
 
 		// Destroy the task
-		RenderTask::DestoryRenderTask(task);
+		RenderTask::DestoryRenderTask(*task);
 	}
+	RenderTelemetry::AddIdleTime( ThreadId() , std::chrono::duration<double>( std::chrono::steady_clock::now() - schedule_start ).count() );
+	RenderTelemetry::ThreadDrained( ThreadId() );
+
+	// merge traversal statistics of the thread
+	SORT_STATS( AccelStats::Flush() );
+
+	// merge shading statistics of the thread
+	SHADING_STATS( ShadingStats::Flush() );
 }
@@ -21,33 +21,29 @@
 
 #include <thread>
 #include <atomic>
+#include <memory>
 
 class Integrator;
 
 // get the thread id
 int ThreadId();
 
+// set the thread id of the current thread
+void SetThreadId( int tid );
+
 class RenderThreadStd
 {
 // public method
 public:
     // Constructor
+    // para 'tid' : the id of the thread executing the render tasks , it runs on a thread of the thread pool
     RenderThreadStd( unsigned tid , std::shared_ptr<Integrator> integrator ) : m_tid(tid) , m_pIntegrator( integrator ) {}
     
-	// Begin thread
-	void BeginThread();
-    
-	// Run the thread
+	// Run the render tasks until all of them are taken
 	void RunThread();
-
-	// Whether the thread is finished
-	void Join() {
-		return m_thread.join();
-	}
     
 // private field
 private:
-    std::thread m_thread;
     unsigned    m_tid = 0;
     
 // the rendering data
@@ -0,0 +1,361 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "threadpool.h"
+#include "multithread.h"
+#include "utility/define.h"
+#include "utility/sassert.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "utility/rand.h"
+#include <fstream>
+#include <sstream>
+
+#if defined(SORT_IN_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(SORT_IN_WINDOWS)
+#include <windows.h>
+#endif
+
+static const unsigned PARALLEL_CHUNKS_PER_THREAD = 4;	// chunks per thread , more chunks balance the load better
+
+// get the cpus the process could run on , grouped by their numa nodes
+static std::vector< std::vector<unsigned> > _cpusPerNode()
+{
+	std::vector< std::vector<unsigned> > nodes;
+#if defined(SORT_IN_LINUX)
+	cpu_set_t allowed;
+	CPU_ZERO( &allowed );
+	if( sched_getaffinity( 0 , sizeof( allowed ) , &allowed ) != 0 )
+		return nodes;
+
+	// numa nodes are listed in sysfs , each of them with a list of cpu ranges like '0-15,32-47'
+	for( unsigned node = 0 ; node < 64 ; ++node )
+	{
+		std::ifstream file( "/sys/devices/system/node/node" + std::to_string( node ) + "/cpulist" );
+		if( !file.is_open() )
+			continue;
+		std::string range;
+		std::vector<unsigned> cpus;
+		while( std::getline( file , range , ',' ) )
+		{
+			unsigned first = 0 , last = 0;
+			char dash = 0;
+			std::istringstream stream( range );
+			if( !( stream >> first ) )
+				continue;
+			last = ( stream >> dash >> last ) ? last : first;
+			for( unsigned cpu = first ; cpu <= last && cpu < CPU_SETSIZE ; ++cpu )
+				if( CPU_ISSET( cpu , &allowed ) )
+					cpus.push_back( cpu );
+		}
+		if( !cpus.empty() )
+			nodes.push_back( cpus );
+	}
+
+	// all cpus are treated as one node without numa information
+	if( nodes.empty() )
+	{
+		std::vector<unsigned> cpus;
+		for( unsigned cpu = 0 ; cpu < CPU_SETSIZE ; ++cpu )
+			if( CPU_ISSET( cpu , &allowed ) )
+				cpus.push_back( cpu );
+		nodes.push_back( cpus );
+	}
+#elif defined(SORT_IN_WINDOWS)
+	DWORD_PTR process_mask = 0 , system_mask = 0;
+	if( GetProcessAffinityMask( GetCurrentProcess() , &process_mask , &system_mask ) )
+	{
+		std::vector<unsigned> cpus;
+		for( unsigned cpu = 0 ; cpu < sizeof( DWORD_PTR ) * 8 ; ++cpu )
+			if( process_mask & ( (DWORD_PTR)1 << cpu ) )
+				cpus.push_back( cpu );
+		nodes.push_back( cpus );
+	}
+#endif
+	return nodes;
+}
+
+// pin a thread to a cpu
+static bool _pinThread( std::thread& thread , unsigned cpu )
+{
+#if defined(SORT_IN_LINUX)
+	cpu_set_t set;
+	CPU_ZERO( &set );
+	CPU_SET( cpu , &set );
+	return pthread_setaffinity_np( thread.native_handle() , sizeof( set ) , &set ) == 0;
+#elif defined(SORT_IN_WINDOWS)
+	return SetThreadAffinityMask( (HANDLE)thread.native_handle() , (DWORD_PTR)1 << cpu ) != 0;
+#else
+	// there is no way to pin threads on mac , affinity is only a hint there
+	return false;
+#endif
+}
+
+// start the worker threads
+void ThreadPool::Init( unsigned thread_num , THREAD_AFFINITY affinity )
+{
+	// renderings in the same process share the workers
+	if( !m_stop && thread_num == GetThreadNum() && affinity == m_affinity )
+		return;
+
+	Release();
+
+	m_stop = false;
+	m_affinity = affinity;
+	for( unsigned i = 1 ; i < thread_num ; ++i )
+		m_workers.push_back( std::thread( &ThreadPool::_workerLoop , this , i , m_generation ) );
+
+	if( affinity != THREAD_AFFINITY_NONE )
+		_pinWorkers( affinity );
+}
+
+// pin the worker threads to cpus
+void ThreadPool::_pinWorkers( THREAD_AFFINITY affinity )
+{
+	if( m_workers.empty() )
+		return;
+
+	const std::vector< std::vector<unsigned> > nodes = _cpusPerNode();
+	std::vector<unsigned> order;
+	if( affinity == THREAD_AFFINITY_COMPACT )
+	{
+		for( const auto& node : nodes )
+			order.insert( order.end() , node.begin() , node.end() );
+	}
+	else
+	{
+		// take one cpu from each node in turn
+		for( unsigned i = 0 ; ; ++i )
+		{
+			bool any = false;
+			for( const auto& node : nodes )
+			{
+				if( i < node.size() )
+				{
+					order.push_back( node[i] );
+					any = true;
+				}
+			}
+			if( !any )
+				break;
+		}
+	}
+
+	// the main thread is not pinned , the first cpu in the order is left for it
+	unsigned pinned = 0;
+	for( unsigned i = 0 ; i < (unsigned)m_workers.size() && !order.empty() ; ++i )
+		pinned += _pinThread( m_workers[i] , order[ ( i + 1 ) % order.size() ] ) ? 1 : 0;
+
+	if( pinned == m_workers.size() )
+		slog( INFO , GENERAL , stringFormat( "%d worker threads are pinned to cpus in %d numa nodes." , pinned , (int)nodes.size() ) );
+	else
+		slog( WARNING , GENERAL , stringFormat( "Only %d of %d worker threads are pinned to cpus." , pinned , (int)m_workers.size() ) );
+}
+
+// execute a function on every thread
+void ThreadPool::RunOnAllThreads( const std::function<void(unsigned)>& func )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_broadcast = func;
+		m_broadcastDone = 0;
+		++m_generation;
+	}
+	m_condition.notify_all();
+
+	func( 0 );
+	WaitUntil( [&](){ return m_broadcastDone.load() == (unsigned)m_workers.size(); } );
+}
+
+// stop all worker threads
+void ThreadPool::Release()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_stop = true;
+		m_jobs.clear();
+	}
+	m_condition.notify_all();
+	for( auto& worker : m_workers )
+		worker.join();
+	m_workers.clear();
+}
+
+// add a job
+void ThreadPool::Submit( const std::function<void()>& job )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_jobs.push_back( job );
+	}
+	m_condition.notify_one();
+}
+
+// execute one pending job
+bool ThreadPool::RunPendingJob()
+{
+	std::function<void()> job;
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if( m_jobs.empty() )
+			return false;
+		job = m_jobs.front();
+		m_jobs.pop_front();
+	}
+	job();
+	return true;
+}
+
+// the loop of a worker thread
+void ThreadPool::_workerLoop( unsigned tid , unsigned generation )
+{
+	SetThreadId( (int)tid );
+	sort_seed();
+
+	while( true )
+	{
+		std::function<void()> job;
+		std::function<void(unsigned)> broadcast;
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			m_condition.wait( lock , [&](){ return m_stop || m_generation != generation || !m_jobs.empty(); } );
+			if( m_stop )
+				return;
+
+			// the function executed by every thread goes before other jobs
+			if( m_generation != generation )
+			{
+				generation = m_generation;
+				broadcast = m_broadcast;
+			}
+			else
+			{
+				job = m_jobs.front();
+				m_jobs.pop_front();
+			}
+		}
+
+		if( broadcast )
+		{
+			broadcast( tid );
+			++m_broadcastDone;
+		}
+		else
+			job();
+	}
+}
+
+// get the number of chunks
+unsigned ParallelChunkCount( unsigned count , unsigned grain )
+{
+	const unsigned thread_num = ThreadPool::GetSingleton().GetThreadNum();
+	if( thread_num <= 1 || count == 0 )
+		return 1;
+	grain = max( grain , 1u );
+	return max( 1u , min( ( count + grain - 1 ) / grain , thread_num * PARALLEL_CHUNKS_PER_THREAD ) );
+}
+
+// split a range into consecutive chunks and process them in the thread pool
+void ParallelFor( unsigned _start , unsigned _end , unsigned grain , const std::function<void(unsigned,unsigned,unsigned)>& func )
+{
+	if( _end <= _start )
+		return;
+
+	const unsigned count = _end - _start;
+	const unsigned chunk_cnt = ParallelChunkCount( count , grain );
+	if( chunk_cnt == 1 ){
+		func( 0u , _start , _end );
+		return;
+	}
+
+	// helpers submitted to the pool could start after all chunks are done , so the state they touch is shared with them
+	struct Loop_State{
+		std::atomic<unsigned>	next{0};
+		std::atomic<unsigned>	done{0};
+	};
+	std::shared_ptr<Loop_State> state( new Loop_State() );
+	const std::function<void(unsigned,unsigned,unsigned)>* chunk_func = &func;
+	const std::function<void()> run_chunks = [=](){
+		unsigned chunk;
+		while( ( chunk = state->next++ ) < chunk_cnt ){
+			(*chunk_func)( chunk , _start + (unsigned)( (unsigned long long)count * chunk / chunk_cnt ) , _start + (unsigned)( (unsigned long long)count * ( chunk + 1 ) / chunk_cnt ) );
+			++state->done;
+		}
+	};
+
+	ThreadPool& pool = ThreadPool::GetSingleton();
+	const unsigned helpers = min( chunk_cnt , pool.GetThreadNum() ) - 1;
+	for( unsigned i = 0 ; i < helpers ; ++i )
+		pool.Submit( run_chunks );
+	run_chunks();
+	pool.WaitUntil( [&](){ return state->done.load() == chunk_cnt; } );
+}
+
+// execute two functions in the thread pool
+void ParallelInvoke( const std::function<void()>& first , const std::function<void()>& second )
+{
+	ParallelFor( 0 , 2 , 1 , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		for( unsigned i = chunk_start ; i < chunk_end ; ++i )
+			( i == 0 ) ? first() : second();
+	});
+}
+
+// add a task
+unsigned TaskGraph::AddTask( const std::function<void()>& func , const std::vector<unsigned>& dependencies )
+{
+	const unsigned id = (unsigned)m_tasks.size();
+	std::unique_ptr<Task> task( new Task() );
+	task->func = func;
+	for( auto dependency : dependencies ){
+		sAssert( dependency < id , GENERAL );
+		m_tasks[dependency]->successors.push_back( id );
+		++task->dependencyCnt;
+	}
+	m_tasks.push_back( std::move( task ) );
+	return id;
+}
+
+// execute all tasks
+void TaskGraph::Run()
+{
+	m_finished = 0;
+	for( auto& task : m_tasks )
+		task->pending = task->dependencyCnt;
+
+	ThreadPool& pool = ThreadPool::GetSingleton();
+	for( unsigned i = 0 ; i < (unsigned)m_tasks.size() ; ++i ){
+		if( m_tasks[i]->dependencyCnt == 0 )
+			pool.Submit( [this,i](){ _execute( i ); } );
+	}
+	pool.WaitUntil( [&](){ return m_finished.load() == (unsigned)m_tasks.size(); } );
+}
+
+// execute a task
+void TaskGraph::_execute( unsigned id )
+{
+	Task& task = *m_tasks[id];
+	task.func();
+
+	ThreadPool& pool = ThreadPool::GetSingleton();
+	for( auto successor : task.successors ){
+		if( --m_tasks[successor]->pending == 0 )
+			pool.Submit( [this,successor](){ _execute( successor ); } );
+	}
+	++m_finished;
+}
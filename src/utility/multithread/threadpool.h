@@ -0,0 +1,204 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "utility/singleton.h"
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+// placement of the worker threads on cpus
+enum THREAD_AFFINITY
+{
+	THREAD_AFFINITY_NONE = 0 ,		// the operating system places the threads
+	THREAD_AFFINITY_COMPACT ,		// threads fill the cpus of one numa node before the next one
+	THREAD_AFFINITY_SCATTER ,		// threads are spread across the numa nodes in turn
+};
+
+//////////////////////////////////////////////////////////////////////
+//	definition of thread pool
+//	desc :	Worker threads of the pool live as long as the system , they
+//			execute the jobs of parallel loops and task graphs during
+//			preprocessing. A thread waiting for its jobs executes other
+//			pending jobs meanwhile , so parallel loops could be nested.
+//			The k-th worker takes the thread id k+1 while the main thread
+//			keeps 0 , so that each of them has its own memory in the
+//			memory manager. Rendering runs on the same threads , so
+//			they are created once for the whole lifetime of the system.
+//			Workers could be pinned to cpus , the main thread is never
+//			pinned since threads created by it inherit its affinity.
+class ThreadPool : public Singleton<ThreadPool>
+{
+// public method
+public:
+	// start the worker threads
+	// para 'thread_num' : the total number of threads working on jobs , including the main thread
+	// para 'affinity'   : how the worker threads are pinned to cpus
+	// note : the running workers are kept if neither the number of threads nor the affinity changes
+	void Init( unsigned thread_num , THREAD_AFFINITY affinity = THREAD_AFFINITY_NONE );
+
+	// stop and join all worker threads , pending jobs are dropped
+	void Release();
+
+	// get the total number of threads working on jobs , including the calling thread
+	unsigned GetThreadNum() const { return (unsigned)m_workers.size() + 1; }
+
+	// add a job to be executed by any thread
+	// para 'job' : the job
+	void Submit( const std::function<void()>& job );
+
+	// execute a function on every thread of the pool at the same time , it returns after all of them finish
+	// para 'func' : the function , its parameter is the thread id , the calling thread runs it with the id 0
+	// note : it can't be nested , the workers are busy with the function until it returns
+	void RunOnAllThreads( const std::function<void(unsigned)>& func );
+
+	// execute one pending job on the current thread
+	// result : false if there is no pending job
+	bool RunPendingJob();
+
+	// wait until the condition is met , pending jobs are executed meanwhile
+	// para 'done' : the condition
+	template< class Func >
+	void WaitUntil( const Func& done ){
+		while( !done() ){
+			if( !RunPendingJob() )
+				std::this_thread::yield();
+		}
+	}
+
+// private field
+private:
+	// the worker threads
+	std::vector<std::thread>			m_workers;
+	// the pending jobs
+	std::deque<std::function<void()>>	m_jobs;
+	// the mutex guarding the pending jobs
+	std::mutex							m_mutex;
+	// idle workers wait on it for new jobs
+	std::condition_variable				m_condition;
+	// whether the workers are asked to stop
+	bool								m_stop = false;
+	// how the running workers are pinned to cpus
+	THREAD_AFFINITY						m_affinity = THREAD_AFFINITY_NONE;
+	// the function every thread executes once , it changes with the generation
+	std::function<void(unsigned)>		m_broadcast;
+	// the generation of the function executed by every thread
+	unsigned							m_generation = 0;
+	// the number of workers finished the function of the current generation
+	std::atomic<unsigned>				m_broadcastDone{0};
+
+	// private constructor
+	ThreadPool(){}
+	// destructor
+	~ThreadPool(){ Release(); }
+
+	// the loop of a worker thread
+	// para 'tid'        : the thread id of the worker
+	// para 'generation' : the generation of the function executed by every thread when the worker starts
+	void _workerLoop( unsigned tid , unsigned generation );
+
+	// pin the worker threads to cpus
+	// para 'affinity' : how the worker threads are pinned
+	void _pinWorkers( THREAD_AFFINITY affinity );
+
+	friend class Singleton<ThreadPool>;
+};
+
+// get the number of chunks a range is split into by ParallelFor
+// para 'count' : the number of elements in the range
+// para 'grain' : the minimum number of elements in a chunk
+// result       : the number of chunks , it is 1 if the range is not worth splitting
+unsigned ParallelChunkCount( unsigned count , unsigned grain );
+
+// split a range into consecutive chunks and process them in the thread pool , it returns after all chunks are processed
+// para '_start' , '_end' : the range
+// para 'grain'           : the minimum number of elements in a chunk
+// para 'func'            : the function processing one chunk , its parameters are the chunk id and the range of the chunk
+void ParallelFor( unsigned _start , unsigned _end , unsigned grain , const std::function<void(unsigned,unsigned,unsigned)>& func );
+
+// execute two functions in the thread pool , it returns after both of them are finished
+// para 'first'  : the first function
+// para 'second' : the second function
+// note : an idle thread takes one of them , the calling thread executes both of them if there is none
+void ParallelInvoke( const std::function<void()>& first , const std::function<void()>& second );
+
+// reduce a range in parallel
+// para '_start' , '_end' : the range
+// para 'grain'           : the minimum number of elements in a chunk
+// para 'identity'        : the result of an empty range
+// para 'map'             : the function computing the partial result of a range
+// para 'reduce'          : the function combining two partial results
+// result                 : the result of the whole range
+// note : partial results are combined in the order of the chunks , so the result doesn't depend on the scheduling
+template< class T , class Map , class Reduce >
+T ParallelReduce( unsigned _start , unsigned _end , unsigned grain , const T& identity , const Map& map , const Reduce& reduce )
+{
+	if( _end <= _start )
+		return identity;
+	std::vector<T> partial( ParallelChunkCount( _end - _start , grain ) , identity );
+	ParallelFor( _start , _end , grain , [&]( unsigned chunk , unsigned chunk_start , unsigned chunk_end ){
+		partial[chunk] = map( chunk_start , chunk_end );
+	});
+	T result = identity;
+	for( const auto& value : partial )
+		result = reduce( result , value );
+	return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+//	definition of task graph
+//	desc :	Tasks are executed in the thread pool as soon as all of the
+//			tasks they depend on are finished.
+class TaskGraph
+{
+// public method
+public:
+	// add a task
+	// para 'func'         : the task
+	// para 'dependencies' : the ids of the tasks that have to be finished first , they have to be added already
+	// result              : the id of the task
+	unsigned AddTask( const std::function<void()>& func , const std::vector<unsigned>& dependencies = std::vector<unsigned>() );
+
+	// execute all tasks , it returns after all of them are finished
+	void Run();
+
+// private field
+private:
+	// a task and its dependencies
+	struct Task
+	{
+		std::function<void()>	func;
+		std::vector<unsigned>	successors;			// the tasks depending on it
+		unsigned				dependencyCnt = 0;	// the number of tasks it depends on
+		std::atomic<unsigned>	pending{0};			// the number of tasks it still waits for
+	};
+	// all of the tasks
+	std::vector<std::unique_ptr<Task>>	m_tasks;
+	// the number of finished tasks
+	std::atomic<unsigned>				m_finished{0};
+
+	// execute a task and submit its successors that are ready
+	// para 'id' : the id of the task
+	void _execute( unsigned id );
+};
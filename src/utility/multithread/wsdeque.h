@@ -0,0 +1,113 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "utility/sassert.h"
+#include <atomic>
+#include <memory>
+
+//////////////////////////////////////////////////////////////////////
+//	definition of work stealing deque
+//	desc :	A lock-free Chase-Lev deque with a fixed capacity. Only the
+//			owner thread pushes and pops at the bottom, other threads
+//			steal from the top. The memory orders follow the paper
+//			"Correct and Efficient Work-Stealing for Weak Memory Models".
+template< class T >
+class	WorkStealingDeque
+{
+// public method
+public:
+	// reset the deque , it is not thread safe
+	// para 'capacity' : maximum number of elements in the deque at the same time
+	void	Reset( unsigned capacity )
+	{
+		m_capacity = ( capacity == 0 ) ? 1 : capacity;
+		m_buffer.reset( new std::atomic<T*>[m_capacity] );
+		m_top.store( 0 , std::memory_order_relaxed );
+		m_bottom.store( 0 , std::memory_order_relaxed );
+	}
+
+	// push an element at the bottom , it is only called by the owner
+	// para 'element' : the element to push , the deque never grows beyond its capacity
+	void	Push( T* element )
+	{
+		const long long b = m_bottom.load( std::memory_order_relaxed );
+		sAssert( b - m_top.load( std::memory_order_acquire ) < (long long)m_capacity , GENERAL );
+		m_buffer[ b % m_capacity ].store( element , std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+		m_bottom.store( b + 1 , std::memory_order_relaxed );
+	}
+
+	// pop the element at the bottom , it is only called by the owner
+	// result : the popped element , nullptr if the deque is empty
+	T*		Pop()
+	{
+		const long long b = m_bottom.load( std::memory_order_relaxed ) - 1;
+		m_bottom.store( b , std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		long long t = m_top.load( std::memory_order_relaxed );
+
+		T* element = nullptr;
+		if( t <= b )
+		{
+			element = m_buffer[ b % m_capacity ].load( std::memory_order_relaxed );
+			// the last element could be stolen at the same time
+			if( t == b )
+			{
+				if( !m_top.compare_exchange_strong( t , t + 1 , std::memory_order_seq_cst , std::memory_order_relaxed ) )
+					element = nullptr;
+				m_bottom.store( b + 1 , std::memory_order_relaxed );
+			}
+		}
+		else
+			m_bottom.store( b + 1 , std::memory_order_relaxed );
+		return element;
+	}
+
+	// steal the element at the top , it could be called by any thread
+	// result : the stolen element , nullptr if the deque is empty
+	// note   : it retries when other threads take the same element first , so nullptr always means empty
+	T*		Steal()
+	{
+		while( true )
+		{
+			long long t = m_top.load( std::memory_order_acquire );
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+			const long long b = m_bottom.load( std::memory_order_acquire );
+			if( t >= b )
+				return nullptr;
+
+			T* element = m_buffer[ t % m_capacity ].load( std::memory_order_relaxed );
+			if( m_top.compare_exchange_strong( t , t + 1 , std::memory_order_seq_cst , std::memory_order_relaxed ) )
+				return element;
+		}
+	}
+
+// private field
+private:
+	// the top and the bottom are padded into separated cache lines , thieves only touch the top in most cases
+	std::atomic<long long>				m_top{0};
+	char								m_padTop[64];
+	std::atomic<long long>				m_bottom{0};
+	char								m_padBottom[64];
+	// the elements
+	std::unique_ptr<std::atomic<T*>[]>	m_buffer;
+	// the capacity of the buffer
+	unsigned							m_capacity = 0;
+};
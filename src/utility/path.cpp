@@ -18,6 +18,7 @@
 // include header file
 #include "path.h"
 #include "system.h"
+#include "memoryfile.h"
 
 #if defined(SORT_IN_WINDOWS)
 #include <windows.h>
@@ -67,6 +68,9 @@ string GetExecutableDir()
 // get full path
 string GetFullPath( const string& str )
 {
+	// files in memory are not in the resource path
+	if( MemoryFiles::IsMemoryFile( str ) )
+		return str;
 	return GetResourcePath() + str;
 }
 
@@ -0,0 +1,359 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "profiler.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "utility/define.h"
+#include "utility/multithread/multithread.h"
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <atomic>
+
+#if defined(SORT_IN_LINUX)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// the number of zones kept per thread , the oldest ones are overwritten beyond it
+static const size_t PROFILE_RING_SIZE = 1 << 16;
+
+// the names of the hardware events in the trace
+static const char* PROFILE_COUNTER_NAMES[PC_COUNT] = { "cycles" , "instructions" , "l1d_misses" , "llc_misses" , "dtlb_misses" , "branch_misses" };
+
+// whether the hardware events are counted in the zones started from now on
+static std::atomic<bool> g_countersEnabled( false );
+
+namespace {
+// a finished zone
+struct ProfileEvent
+{
+    const char*         name;
+    long long           arg;
+    unsigned long long  begin;
+    unsigned long long  end;
+    bool                counted;    // whether the events of the zone are kept in the counters of the ring
+};
+
+// the ring buffer of a thread , it outlives the thread so that the zones are still exported after it finished
+struct ProfileRing
+{
+    std::vector<ProfileEvent>   events;
+    unsigned long long          count = 0;  // the number of zones recorded , the next one is at 'count % PROFILE_RING_SIZE'
+    unsigned                    index = 0;  // the index of the thread in the trace
+    int                         sortTid = 0;// the id of the thread in sort when it recorded the first zone
+
+    // the events counted in the zones , it is only allocated once the counters of the thread are opened
+    std::vector<ProfileCounters>    counters;
+    bool                            counterOpened = false;  // whether opening the counters has been tried
+    int                             counterFd[PC_COUNT];    // the file descriptors of the events , -1 if it isn't counted
+    int                             counterLeader = -1;     // the file descriptor of the first open event , it leads the group
+    int                             counterSlot[PC_COUNT];  // the index of each event in the values of the group , -1 if it isn't counted
+    unsigned                        counterNum = 0;         // the number of events in the group
+
+    ProfileRing()
+    {
+        for( int i = 0 ; i < PC_COUNT ; ++i )
+            counterFd[i] = counterSlot[i] = -1;
+    }
+    ~ProfileRing()
+    {
+#if defined(SORT_IN_LINUX)
+        for( int i = 0 ; i < PC_COUNT ; ++i )
+            if( counterFd[i] >= 0 )
+                close( counterFd[i] );
+#endif
+    }
+};
+
+// the ring buffers of all threads
+struct ProfileRegistry
+{
+    std::mutex                                  mutex;
+    std::vector<std::unique_ptr<ProfileRing>>   rings;
+    unsigned long long                          origin = Profiler::Now();
+    unsigned                                    counterMask = 0;    // the events counted by any thread
+    bool                                        counterWarned = false;
+};
+}
+
+static ProfileRegistry& profileRegistry()
+{
+    static ProfileRegistry registry;
+    return registry;
+}
+
+// the ring buffer of the current thread , it is registered by the first zone of the thread
+static ProfileRing& localRing()
+{
+    static Thread_Local ProfileRing* ring = nullptr;
+    if( ring == nullptr )
+    {
+        ProfileRegistry& registry = profileRegistry();
+        std::lock_guard<std::mutex> lock( registry.mutex );
+        registry.rings.push_back( std::unique_ptr<ProfileRing>( new ProfileRing() ) );
+        ring = registry.rings.back().get();
+        ring->events.resize( PROFILE_RING_SIZE );
+        ring->index = (unsigned)registry.rings.size() - 1;
+        ring->sortTid = ThreadId();
+    }
+    return *ring;
+}
+
+// the current time in nanoseconds
+unsigned long long Profiler::Now()
+{
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// count the hardware events from now on
+void Profiler::EnableCounters( bool enable )
+{
+#if !defined(SORT_IN_LINUX)
+    if( enable )
+        slog( WARNING , PERFORMANCE , "Hardware counters are only supported on Linux , the zones are only timed." );
+#else
+    g_countersEnabled = enable;
+#endif
+}
+
+// open the counters of the current thread , the events are grouped so that they are scheduled on the processor together
+static void openCounters( ProfileRing& ring )
+{
+    ring.counterOpened = true;
+#if defined(SORT_IN_LINUX)
+    static const struct { unsigned type; unsigned long long config; } events[PC_COUNT] = {
+        { PERF_TYPE_HARDWARE , PERF_COUNT_HW_CPU_CYCLES } ,
+        { PERF_TYPE_HARDWARE , PERF_COUNT_HW_INSTRUCTIONS } ,
+        { PERF_TYPE_HW_CACHE , PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ) } ,
+        { PERF_TYPE_HARDWARE , PERF_COUNT_HW_CACHE_MISSES } ,
+        { PERF_TYPE_HW_CACHE , PERF_COUNT_HW_CACHE_DTLB | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ) } ,
+        { PERF_TYPE_HARDWARE , PERF_COUNT_HW_BRANCH_MISSES } ,
+    };
+
+    // only the user space of the calling thread is counted , it is allowed without privileges with the default paranoia of the kernel
+    int error = 0;
+    for( int i = 0 ; i < PC_COUNT ; ++i )
+    {
+        perf_event_attr attr;
+        memset( &attr , 0 , sizeof( attr ) );
+        attr.size = sizeof( attr );
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        const int fd = (int)syscall( SYS_perf_event_open , &attr , 0 , -1 , ring.counterLeader , 0 );
+        if( fd < 0 )
+        {
+            error = errno;
+            continue;
+        }
+        if( ring.counterLeader < 0 )
+            ring.counterLeader = fd;
+        ring.counterFd[i] = fd;
+        ring.counterSlot[i] = (int)ring.counterNum++;
+    }
+
+    ProfileRegistry& registry = profileRegistry();
+    std::lock_guard<std::mutex> lock( registry.mutex );
+    for( int i = 0 ; i < PC_COUNT ; ++i )
+        if( ring.counterSlot[i] >= 0 )
+            registry.counterMask |= 1u << i;
+    if( ring.counterNum )
+        ring.counters.resize( PROFILE_RING_SIZE );
+    if( ring.counterNum < PC_COUNT && !registry.counterWarned )
+    {
+        registry.counterWarned = true;
+        if( ring.counterNum == 0 )
+            slog( WARNING , PERFORMANCE , stringFormat( "Hardware counters can't be opened , %s , the zones are only timed." , strerror( error ) ) );
+        else
+            slog( WARNING , PERFORMANCE , stringFormat( "Only %d of %d hardware counters can be opened , %s." , (int)ring.counterNum , (int)PC_COUNT , strerror( error ) ) );
+    }
+#endif
+}
+
+// read the events counted by the current thread
+bool Profiler::ReadCounters( ProfileCounters& counters )
+{
+    if( !g_countersEnabled )
+        return false;
+    ProfileRing& ring = localRing();
+    if( !ring.counterOpened )
+        openCounters( ring );
+    if( ring.counterNum == 0 )
+        return false;
+
+#if defined(SORT_IN_LINUX)
+    // the group is read at once , the values are scaled up if the events were multiplexed with others on the processor
+    unsigned long long values[ 3 + PC_COUNT ];
+    if( read( ring.counterLeader , values , sizeof( unsigned long long ) * ( 3 + ring.counterNum ) ) <= 0 )
+        return false;
+    const double scale = ( values[2] > 0 && values[2] < values[1] ) ? (double)values[1] / values[2] : 1.0;
+    for( int i = 0 ; i < PC_COUNT ; ++i )
+        counters.value[i] = ring.counterSlot[i] >= 0 ? (unsigned long long)( values[ 3 + ring.counterSlot[i] ] * scale ) : 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+// record a finished zone
+void Profiler::Record( const char* name , long long arg , unsigned long long begin , unsigned long long end , const ProfileCounters* counters )
+{
+    ProfileRing& ring = localRing();
+    const size_t index = ring.count % PROFILE_RING_SIZE;
+
+    // the events of the zone are the difference to the ones counted when it started
+    ProfileCounters now;
+    const bool counted = counters && ReadCounters( now );
+    if( counted )
+        for( int i = 0 ; i < PC_COUNT ; ++i )
+            ring.counters[index].value[i] = now.value[i] - std::min( now.value[i] , counters->value[i] );
+
+    ring.events[index] = { name , arg , begin , end , counted };
+    ++ring.count;
+}
+
+// the zones kept by a ring buffer from the oldest one , the counters are null if the events of a zone weren't counted
+template< class Func >
+static void forEachEvent( const ProfileRing& ring , Func func )
+{
+    const unsigned long long first = ( ring.count > PROFILE_RING_SIZE ) ? ring.count - PROFILE_RING_SIZE : 0;
+    for( unsigned long long i = first ; i < ring.count ; ++i )
+    {
+        const ProfileEvent& event = ring.events[ i % PROFILE_RING_SIZE ];
+        func( event , event.counted ? &ring.counters[ i % PROFILE_RING_SIZE ] : nullptr );
+    }
+}
+
+// write the zones to a trace file
+bool Profiler::Export( const std::string& filename )
+{
+    ProfileRegistry& registry = profileRegistry();
+    std::lock_guard<std::mutex> lock( registry.mutex );
+    std::ofstream file( filename.c_str() );
+    if( !file.is_open() )
+    {
+        slog( WARNING , PERFORMANCE , stringFormat( "Profile trace %s can't be written." , filename.c_str() ) );
+        return false;
+    }
+
+    // the zones are complete events in microseconds from the start of the process , the threads are named by their ids in sort
+    unsigned long long zone_cnt = 0;
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"SORT\"}}";
+    for( const auto& ring : registry.rings )
+    {
+        file << stringFormat( ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}" , (int)ring->index , ring->sortTid );
+        forEachEvent( *ring , [&]( const ProfileEvent& event , const ProfileCounters* counters ){
+            file << stringFormat( ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f" , event.name , (int)ring->index ,
+                ( event.begin - std::min( event.begin , registry.origin ) ) / 1000.0 , ( event.end - event.begin ) / 1000.0 );
+
+            // the counted events are arguments of the zone , the instructions per cycle are derived if both are counted
+            std::string args;
+            if( event.arg >= 0 )
+                args += stringFormat( ",\"id\":%lld" , event.arg );
+            if( counters )
+            {
+                for( int i = 0 ; i < PC_COUNT ; ++i )
+                    if( registry.counterMask & ( 1u << i ) )
+                        args += stringFormat( ",\"%s\":%llu" , PROFILE_COUNTER_NAMES[i] , counters->value[i] );
+                if( counters->value[PC_CYCLES] > 0 && ( registry.counterMask & ( 1u << PC_INSTRUCTIONS ) ) )
+                    args += stringFormat( ",\"ipc\":%.3f" , (double)counters->value[PC_INSTRUCTIONS] / counters->value[PC_CYCLES] );
+            }
+            if( !args.empty() )
+                file << ",\"args\":{" << args.substr( 1 ) << "}";
+            file << "}";
+            ++zone_cnt;
+        } );
+    }
+    file << "\n]}\n";
+    if( !file )
+        return false;
+
+    slog( INFO , PERFORMANCE , stringFormat( "Profile trace of %d zones on %d threads is written to %s." , (int)zone_cnt , (int)registry.rings.size() , filename.c_str() ) );
+    return true;
+}
+
+// output the total time of the zones
+void Profiler::OutputLog()
+{
+    ProfileRegistry& registry = profileRegistry();
+    std::lock_guard<std::mutex> lock( registry.mutex );
+    if( registry.rings.empty() )
+        return;
+
+    // zones are summed by their names , the same literal could have different pointers in different translation units
+    struct Total
+    {
+        unsigned long long  count = 0;
+        unsigned long long  time = 0;
+        unsigned long long  counted = 0;            // the number of zones with counted events
+        unsigned long long  value[PC_COUNT] = {};   // the events counted in them
+    };
+    std::map<std::string , Total> totals;
+    for( const auto& ring : registry.rings )
+        forEachEvent( *ring , [&]( const ProfileEvent& event , const ProfileCounters* counters ){
+            Total& total = totals[event.name];
+            ++total.count;
+            total.time += event.end - event.begin;
+            if( counters )
+            {
+                ++total.counted;
+                for( int i = 0 ; i < PC_COUNT ; ++i )
+                    total.value[i] += counters->value[i];
+            }
+        } );
+
+    std::vector<std::pair<std::string , Total>> sorted( totals.begin() , totals.end() );
+    std::sort( sorted.begin() , sorted.end() , []( const std::pair<std::string , Total>& a , const std::pair<std::string , Total>& b ){
+        return a.second.time > b.second.time;
+    } );
+    slog( INFO , PERFORMANCE , "Profile zones by their total time over all threads:" );
+    for( const auto& zone : sorted )
+    {
+        slog( INFO , PERFORMANCE , stringFormat( "    %-28s %10.3f ms in %llu zones" , zone.first.c_str() , zone.second.time / 1e6 , zone.second.count ) );
+        if( zone.second.counted == 0 )
+            continue;
+
+        // the misses are relative to a thousand instructions so that zones of different lengths are comparable
+        const unsigned long long* value = zone.second.value;
+        const bool has_instructions = ( registry.counterMask & ( 1u << PC_INSTRUCTIONS ) ) && value[PC_INSTRUCTIONS] > 0;
+        std::string line;
+        if( has_instructions && ( registry.counterMask & ( 1u << PC_CYCLES ) ) && value[PC_CYCLES] > 0 )
+            line += stringFormat( " , IPC %.2f" , (double)value[PC_INSTRUCTIONS] / value[PC_CYCLES] );
+        for( int i = PC_L1D_MISSES ; i < PC_COUNT ; ++i )
+        {
+            if( !( registry.counterMask & ( 1u << i ) ) )
+                continue;
+            if( has_instructions )
+                line += stringFormat( " , %s %.2f/ki" , PROFILE_COUNTER_NAMES[i] , value[i] * 1000.0 / value[PC_INSTRUCTIONS] );
+            else
+                line += stringFormat( " , %s %llu" , PROFILE_COUNTER_NAMES[i] , value[i] );
+        }
+        if( !line.empty() )
+            slog( INFO , PERFORMANCE , stringFormat( "    %-28s %s" , "" , line.substr( 3 ).c_str() ) );
+    }
+}
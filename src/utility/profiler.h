@@ -0,0 +1,120 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <string>
+
+//! @brief Time the rest of the scope as a zone of the profiler.
+//!
+//! Zones are only compiled with SORT_PROFILER enabled, they are nothing at all in regular builds. The name
+//! has to be a string literal since only the pointer is kept, 'SORT_PROFILE_ARG' attaches an integer like
+//! the id of a tile to the zone.
+#if SORT_PROFILER
+#define SORT_PROFILE_JOIN2(a,b)     a##b
+#define SORT_PROFILE_JOIN(a,b)      SORT_PROFILE_JOIN2(a,b)
+#define SORT_PROFILE(name)          ProfileZone SORT_PROFILE_JOIN( _profile_zone_ , __LINE__ )( name )
+#define SORT_PROFILE_ARG(name,arg)  ProfileZone SORT_PROFILE_JOIN( _profile_zone_ , __LINE__ )( name , (long long)(arg) )
+#else
+#define SORT_PROFILE(name)
+#define SORT_PROFILE_ARG(name,arg)
+#endif
+
+//! @brief The hardware events counted in the zones once the counters are enabled.
+enum PROFILE_COUNTER
+{
+    PC_CYCLES = 0 ,
+    PC_INSTRUCTIONS ,
+    PC_L1D_MISSES ,         // read misses of the level 1 data cache
+    PC_LLC_MISSES ,         // misses of the last level cache
+    PC_DTLB_MISSES ,        // read misses of the data TLB
+    PC_BRANCH_MISSES ,      // mispredicted branches
+    PC_COUNT
+};
+
+//! @brief The hardware events counted by a thread.
+struct ProfileCounters
+{
+    unsigned long long  value[PC_COUNT];
+};
+
+//! @brief Hierarchical profiler of scoped zones.
+/**
+ * Every thread records its finished zones into its own ring buffer, there is no synchronization while
+ * recording and the oldest zones of a thread are overwritten once its buffer is full. Zones are nested by
+ * their time spans, the trace written in the Chrome trace event format shows them as a flame graph per
+ * thread in chrome://tracing or Perfetto. The time is taken from the steady clock in nanoseconds.
+ */
+class Profiler
+{
+public:
+    //! The current time in nanoseconds.
+    static unsigned long long Now();
+
+    //! @brief Count the hardware events of every thread in the zones started from now on.
+    //!
+    //! The counters are only supported through 'perf_event_open' on Linux. Every thread opens its own group
+    //! of counters with its first zone, events the processor or the kernel don't expose are left out.
+    //! @param enable   Whether the events are counted.
+    static void EnableCounters( bool enable );
+
+    //! @brief Read the hardware events counted by the current thread so far.
+    //! @param counters     The events counted so far.
+    //! @return             False if the events are not counted.
+    static bool ReadCounters( ProfileCounters& counters );
+
+    //! @brief Record a finished zone of the current thread.
+    //! @param name     The name of the zone, it has to outlive the profiler.
+    //! @param arg      The argument of the zone, it is not written if negative.
+    //! @param begin    The time the zone started.
+    //! @param end      The time the zone finished.
+    //! @param counters The events counted when the zone started, the zone has no events if it is null.
+    static void Record( const char* name , long long arg , unsigned long long begin , unsigned long long end , const ProfileCounters* counters = nullptr );
+
+    //! @brief Write the zones of all threads to a file in the Chrome trace event format.
+    //! @param filename     The name of the file.
+    //! @return             False if the file can't be written.
+    //! @note   No thread should record zones at the same time.
+    static bool Export( const std::string& filename );
+
+    //! Output the total time of the zones by their names to the performance log.
+    static void OutputLog();
+};
+
+//! @brief A zone recorded once the scope is left.
+class ProfileZone
+{
+public:
+    //! @brief Start the zone.
+    //! @param name     The name of the zone, it has to be a string literal.
+    //! @param arg      The argument of the zone.
+    explicit ProfileZone( const char* name , long long arg = -1 ) : m_name( name ) , m_arg( arg ) , m_counted( Profiler::ReadCounters( m_counters ) ) , m_begin( Profiler::Now() ) {}
+
+    //! Record the zone.
+    ~ProfileZone() { Profiler::Record( m_name , m_arg , m_begin , Profiler::Now() , m_counted ? &m_counters : nullptr ); }
+
+    ProfileZone( const ProfileZone& ) = delete;
+    ProfileZone& operator=( const ProfileZone& ) = delete;
+
+private:
+    const char*         m_name;     /**< The name of the zone. */
+    long long           m_arg;      /**< The argument of the zone. */
+    ProfileCounters     m_counters; /**< The events counted when the zone started. */
+    bool                m_counted;  /**< Whether the events are counted in the zone. */
+    unsigned long long  m_begin;    /**< The time the zone started. */
+};
@@ -24,83 +24,166 @@
 #include <time.h>
 #endif
 
-// Random Number Method Definitions
-#define M 397
-#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
-#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
-#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
-
-// variables used for random number generation
-static const int N = 624;
-static Thread_Local unsigned long mt[N]; /* the array for the state vector  */
-static Thread_Local int mti;
-static Thread_Local bool seed_setup = false;
+// PCG32 ( XSH RR ) , the state advances with a 64 bits linear congruential step and the output is a permutation of it
+#define PCG_MULTIPLIER 6364136223846793005ULL
+
+// the state and the stream of the generator of each thread , they hold the default stream until the thread is seeded
+static Thread_Local unsigned long long pcg_state = 0x853c49e6748fea9bULL;
+static Thread_Local unsigned long long pcg_inc = 0xda3e39cb94b95bdbULL;
+
+// the source replacing the generator of each thread , it is null unless a path is replayed by it
+static Thread_Local RandomSource* rand_source = nullptr;
+
+// whether the rendering is deterministic , the streams are keyed by pixels and samples then
+static bool g_deterministic = false;
+static unsigned g_epoch = 0;
+// the seed of the streams of deterministic rendering
+static unsigned long long g_seed = 0;
+
+// the seed of the streams of keys in this run , the keyed streams differ in every run unless the rendering is deterministic
+static const unsigned long long g_runSeed = (unsigned long long)time(0);
+
+// the finalizer of SplitMix64 , it maps a key to a well distributed number
+static inline unsigned long long mix64( unsigned long long z )
+{
+	z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+	z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+	return z ^ ( z >> 31 );
+}
+
+// the output permutation of a state
+static inline unsigned pcg_output( unsigned long long state )
+{
+	const unsigned xorshifted = (unsigned)( ( ( state >> 18u ) ^ state ) >> 27u );
+	const unsigned rot = (unsigned)( state >> 59u );
+	return ( xorshifted >> rot ) | ( xorshifted << ( ( 0u - rot ) & 31 ) );
+}
+
+// start the generator of the current thread at a position of a stream
+static inline void pcg_seed( unsigned long long init_state , unsigned long long stream )
+{
+	pcg_inc = ( stream << 1u ) | 1u;
+	pcg_state = ( pcg_inc + init_state ) * PCG_MULTIPLIER + pcg_inc;
+}
 
 #include "utility/multithread/multithread.h"
 
 // set the seed
 void sort_seed()
 {
-	unsigned seed = ThreadId() * (unsigned)time(0);
-	mt[0]= seed & 0xffffffffUL;
-    for (mti=1; mti<N; mti++) {
-        mt[mti] =
-        (1812433253UL * (mt[mti-1] ^ (mt[mti-1] >> 30)) + mti);
-        /* See Knuth TAOCP Vol2. 3rd Ed. P.106 for multiplier. */
-        /* In the previous versions, MSBs of the seed affect   */
-        /* only MSBs of the array mt[].                        */
-        /* 2002/01/09 modified by Makoto Matsumoto             */
-        mt[mti] &= 0xffffffffUL;
-        /* for >32 bit machines */
-    }
+	// threads don't depend on the time of the rendering if it's deterministic , each thread takes its own stream
+	const unsigned long long seed = g_deterministic ? 0 : (unsigned long long)time(0);
+	pcg_seed( mix64( seed ) , (unsigned long long)ThreadId() );
+}
+
+// get the state of the generator
+void sort_get_state( unsigned* state )
+{
+	state[0] = (unsigned)pcg_state;
+	state[1] = (unsigned)( pcg_state >> 32 );
+	state[2] = (unsigned)pcg_inc;
+	state[3] = (unsigned)( pcg_inc >> 32 );
+}
 
-	seed_setup = true;
+// set the state of the generator
+void sort_set_state( const unsigned* state )
+{
+	pcg_state = (unsigned long long)state[0] | ( (unsigned long long)state[1] << 32 );
+	pcg_inc = (unsigned long long)state[2] | ( (unsigned long long)state[3] << 32 ) | 1u;
 }
 
 // generate a unsigned integer
 unsigned sort_rand()
 {
-	unsigned long y;
-	{
-		static Thread_Local unsigned long mag01[2]={0x0UL, MATRIX_A};
-		/* mag01[x] = x * MATRIX_A  for x=0,1 */
-
-		if( seed_setup == false )
-			sort_seed();
+	const unsigned long long state = pcg_state;
+	pcg_state = state * PCG_MULTIPLIER + pcg_inc;
+	return pcg_output( state );
+}
 
-		if (mti >= N) { /* generate N words at one time */
-			int kk;
+// generate a canonical random number
+float sort_canonical()
+{
+	if( rand_source )
+		return rand_source->Next();
+	return ( sort_rand() >> 8 ) * ( 1.0f / (float)( 1 << 24 ) );
+}
 
-			if (mti == N+1)   /* if Seed() has not been called, */
-				sort_seed(); /* default initial seed */
+// generate canonical random numbers
+void sort_canonical( float* data , unsigned num )
+{
+	if( rand_source ){
+		for( unsigned i = 0 ; i < num ; ++i )
+			data[i] = rand_source->Next();
+		return;
+	}
 
-			for (kk=0;kk<N-M;kk++) {
-				y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-				mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
-			}
-			for (;kk<N-1;kk++) {
-				y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-				mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
-			}
-			y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
-			mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
+	// the states of the lanes are the next SORT_RAND_LANES states of the sequence , every lane jumps ahead of
+	// all lanes after that , so the numbers are the same as the ones taken one by one
+	unsigned long long lanes[SORT_RAND_LANES];
+	unsigned long long mul = 1 , add = 0;
+	for( unsigned i = 0 ; i < SORT_RAND_LANES ; ++i ){
+		lanes[i] = pcg_state * mul + add;
+		add = add * PCG_MULTIPLIER + pcg_inc;
+		mul *= PCG_MULTIPLIER;
+	}
 
-			mti = 0;
+	unsigned i = 0;
+	for( ; i + SORT_RAND_LANES <= num ; i += SORT_RAND_LANES ){
+		for( unsigned k = 0 ; k < SORT_RAND_LANES ; ++k ){
+			data[i+k] = ( pcg_output( lanes[k] ) >> 8 ) * ( 1.0f / (float)( 1 << 24 ) );
+			lanes[k] = lanes[k] * mul + add;
 		}
+	}
 
-		y = mt[mti++];
+	// the rest continues from the first lane
+	pcg_state = lanes[0];
+	for( ; i < num ; ++i )
+		data[i] = sort_canonical();
+}
 
-		/* Tempering */
-		y ^= (y >> 11);
-		y ^= (y << 7) & 0x9d2c5680UL;
-		y ^= (y << 15) & 0xefc60000UL;
-		y ^= (y >> 18);
-	}
-    return y;
+// set the source of the canonical random numbers of the current thread
+void sort_set_source( RandomSource* source )
+{
+	rand_source = source;
 }
 
-// generate a canonical random number
-float sort_canonical()
+// enable deterministic rendering
+void sort_set_deterministic( bool deterministic )
+{
+	g_deterministic = deterministic;
+}
+
+// whether the rendering is deterministic
+bool sort_is_deterministic()
+{
+	return g_deterministic;
+}
+
+// set the seed of deterministic rendering
+void sort_set_seed( unsigned long long seed )
+{
+	g_seed = seed;
+}
+
+// set the epoch mixed into the keys of the streams
+void sort_set_epoch( unsigned epoch )
+{
+	g_epoch = epoch;
+}
+
+// restart the generator of the current thread at the stream of a key
+void sort_reseed( unsigned k0 , unsigned k1 , unsigned k2 )
+{
+	if( g_deterministic )
+		sort_set_stream( k0 , k1 , k2 );
+}
+
+// restart the generator of the current thread at the stream of a key
+void sort_set_stream( unsigned k0 , unsigned k1 , unsigned k2 )
 {
-	return (sort_rand() & 0xffffff) / float(1 << 24);
+	const unsigned long long seed = g_deterministic ? g_seed : g_runSeed;
+	unsigned long long key = mix64( g_epoch + seed + 0x9e3779b97f4a7c15ULL );
+	key = mix64( key ^ k0 );
+	key = mix64( key ^ ( (unsigned long long)k1 << 32 | k2 ) );
+	pcg_seed( key , mix64( key ) );
 }
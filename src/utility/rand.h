@@ -20,14 +20,77 @@
 /*
 description :
 	Random number generation method, the default 'rand' function provided by c++ standard library is not so good,
-	another random number generation method is adapted here.
+	PCG32 is adapted here. Its state is only two 64 bits words , each thread takes its own stream of it.
 */
 
-// set the seed
+// the number of words in the state of the generator
+static const unsigned SORT_RAND_STATE_SIZE = 4;
+
+// the number of states advanced together when canonical numbers are generated in batch
+static const unsigned SORT_RAND_LANES = 8;
+
+// set the seed , worker threads are seeded once they start
 void		sort_seed();
 
+// get the state of the generator of the current thread
+// para 'state' : the memory of SORT_RAND_STATE_SIZE words to save the state
+void		sort_get_state( unsigned* state );
+
+// set the state of the generator of the current thread
+// para 'state' : the state saved by 'sort_get_state'
+void		sort_set_state( const unsigned* state );
+
 // generate a unsigned integer
 unsigned	sort_rand();
 
 // generate a canonical random number
 float		sort_canonical();
+
+// generate canonical random numbers , they are the same as the ones generated one by one
+// para 'data' : the memory to save the numbers
+// para 'num'  : the number of random numbers to be generated
+void		sort_canonical( float* data , unsigned num );
+
+// enable deterministic rendering , the generator of a thread is restarted at the stream of a key by 'sort_reseed' ,
+// so that the random numbers of a pixel sample do not depend on the thread taking it
+// para 'deterministic' : whether the rendering is deterministic
+void		sort_set_deterministic( bool deterministic );
+
+// whether the rendering is deterministic
+bool		sort_is_deterministic();
+
+// set the seed mixed into the keys of the streams of deterministic rendering , renderings of different seeds take independent samples
+// para 'seed' : the seed , it is zero by default
+void		sort_set_seed( unsigned long long seed );
+
+// set the epoch mixed into the keys of the streams , such as the pass being rendered
+void		sort_set_epoch( unsigned epoch );
+
+// restart the generator of the current thread at the stream of a key , nothing is done unless the rendering is deterministic
+// para 'k0' , 'k1' , 'k2' : the key of the stream , such as the coordinate of a pixel and the index of its sample
+void		sort_reseed( unsigned k0 , unsigned k1 , unsigned k2 );
+
+// restart the generator of the current thread at the stream of a key , threads restarted with the same key take the same numbers
+// para 'k0' , 'k1' , 'k2' : the key of the stream
+void		sort_set_stream( unsigned k0 , unsigned k1 , unsigned k2 );
+
+// streams out of the pixels take the tags as the second key , they don't collide with the rows of an image
+static const unsigned SORT_RAND_SERIAL = 0xffffffff;	// the code on the main thread , such as pre-processing
+static const unsigned SORT_RAND_PARALLEL = 0xfffffffe;	// the items of parallel loops , such as the light paths of a pass
+static const unsigned SORT_RAND_DITHER = 0xfffffffd;	// the sample dimensions shared by all pixels with blue noise dithering
+
+// the source of the canonical random numbers of a thread , it replaces the generator of the thread once it is set
+// note : Metropolis light transport replays and mutates the numbers taken by a path through it , 'sort_rand' still
+//		  takes the numbers of the generator
+class RandomSource
+{
+public:
+	virtual ~RandomSource() {}
+
+	// the next canonical random number
+	virtual float Next() = 0;
+};
+
+// set the source of the canonical random numbers of the current thread
+// para 'source' : the source , the generator of the thread is used again if it is null
+void		sort_set_source( RandomSource* source );
@@ -0,0 +1,216 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "renderbench.h"
+#include "system.h"
+#include "utility/telemetry.h"
+#include "utility/cpuinfo.h"
+#include "utility/multithread/multithread.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include <chrono>
+#include <fstream>
+#include <map>
+
+#if defined(SORT_IN_WINDOWS)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+extern System g_System;
+
+// renderings slower than the baseline by more than the ratio are regressions , small scenes vary by a few percents
+static const double REGRESSION_RATIO = 1.2;
+
+// constructor
+RenderBenchmark::RenderBenchmark( const std::string& suite )
+{
+    std::ifstream file( suite.c_str() );
+    if( !file.is_open() ){
+        slog( WARNING , GENERAL , stringFormat( "Failed to read benchmark suite %s." , suite.c_str() ) );
+        return;
+    }
+
+    std::string line;
+    while( std::getline( file , line ) ){
+        const size_t begin = line.find_first_not_of( " \t\r" );
+        if( begin == std::string::npos || line[begin] == '#' )
+            continue;
+        m_files.push_back( line.substr( begin , line.find_last_not_of( " \t\r" ) + 1 - begin ) );
+    }
+}
+
+// render every scene of the suite
+int RenderBenchmark::Run( const std::string& report , const std::string& baseline )
+{
+    std::vector<Result> results;
+    bool failed = m_files.empty();
+    for( const std::string& file : m_files ){
+        Result result;
+        result.file = file;
+        const size_t slash = file.find_last_of( "/\\" );
+        const size_t begin = ( slash == std::string::npos ) ? 0 : slash + 1;
+        const size_t dot = file.find_last_of( '.' );
+        result.name = file.substr( begin , ( dot == std::string::npos || dot < begin ) ? std::string::npos : dot - begin );
+
+        slog( INFO , GENERAL , stringFormat( "Benchmark scene %s (%s)." , result.name.c_str() , file.c_str() ) );
+        resetPeakMemory();
+
+        const auto start = std::chrono::steady_clock::now();
+        if( g_System.Setup( file.c_str() ) ){
+            const std::chrono::duration<double,std::milli> load = std::chrono::steady_clock::now() - start;
+            result.loadMs = load.count();
+
+            g_System.Render();
+            result.done = !RenderControl::GetSingleton().IsCancelled();
+            result.preprocessMs = g_System.GetPreProcessingTime();
+            result.renderMs = g_System.GetRenderingTime();
+            const ThreadThroughput total = RenderTelemetry::GetTotal();
+            result.samples = total.samples;
+            result.rays = total.rays;
+        }
+        result.peakRssMb = peakMemory();
+
+        // the scene is released so that the next one is loaded from its files as well
+        g_System.Reset( false );
+
+        if( result.done )
+            slog( INFO , PERFORMANCE , stringFormat( "Benchmark %s : load %.1f ms , pre-processing %.1f ms , rendering %.1f ms , %.2f M rays/s , peak memory %.1f MB." ,
+                result.name.c_str() , result.loadMs , result.preprocessMs , result.renderMs ,
+                result.renderMs > 0.0 ? result.rays / result.renderMs / 1000.0 : 0.0 , result.peakRssMb ) );
+        else
+            slog( WARNING , GENERAL , stringFormat( "Benchmark scene %s is not rendered." , file.c_str() ) );
+        failed |= !result.done;
+        results.push_back( result );
+
+        if( RenderControl::GetSingleton().IsCancelled() )
+            break;
+    }
+
+    if( !report.empty() && writeReport( report , results ) )
+        slog( INFO , GENERAL , stringFormat( "Benchmark report is written to %s." , report.c_str() ) );
+    const unsigned regressions = baseline.empty() ? 0 : compareBaseline( baseline , results );
+
+    if( failed )
+        return 1;
+    return regressions > 0 ? 2 : 0;
+}
+
+// write the results as json
+bool RenderBenchmark::writeReport( const std::string& filename , const std::vector<Result>& results )
+{
+    std::ofstream file( filename.c_str() , std::ios::trunc );
+    if( !file.is_open() ){
+        slog( WARNING , GENERAL , stringFormat( "Failed to write benchmark report %s." , filename.c_str() ) );
+        return false;
+    }
+
+    // every scene is kept in one line , the baseline is read back line by line
+    file << "{\n";
+    file << "    \"threads\": " << RenderTelemetry::GetThreadCount() << ",\n";
+    file << "    \"isa\": \"" << GetCpuIsaName( GetCompiledIsa() ) << "\",\n";
+    file << "    \"scenes\": [\n";
+    for( size_t i = 0 ; i < results.size() ; ++i ){
+        const Result& r = results[i];
+        const double mrays = r.renderMs > 0.0 ? r.rays / r.renderMs / 1000.0 : 0.0;
+        file << stringFormat( "        { \"name\": \"%s\", \"file\": \"%s\", \"done\": %s, \"load_ms\": %.2f, \"preprocess_ms\": %.2f, \"render_ms\": %.2f, "
+                              "\"samples\": %llu, \"rays\": %llu, \"mrays_per_s\": %.3f, \"peak_rss_mb\": %.1f }%s\n" ,
+                              r.name.c_str() , r.file.c_str() , r.done ? "true" : "false" , r.loadMs , r.preprocessMs , r.renderMs ,
+                              r.samples , r.rays , mrays , r.peakRssMb , ( i + 1 < results.size() ) ? "," : "" );
+    }
+    file << "    ]\n";
+    file << "}\n";
+    return (bool)file;
+}
+
+// compare the rendering times with an earlier report
+unsigned RenderBenchmark::compareBaseline( const std::string& filename , const std::vector<Result>& results )
+{
+    std::ifstream file( filename.c_str() );
+    if( !file.is_open() ){
+        slog( WARNING , GENERAL , stringFormat( "Failed to read benchmark baseline %s." , filename.c_str() ) );
+        return 0;
+    }
+
+    // only the reports written by the benchmark are read , each scene is in one line
+    std::map<std::string,double> times;
+    std::string line;
+    while( std::getline( file , line ) ){
+        static const std::string name_key = "\"name\": \"";
+        static const std::string time_key = "\"render_ms\": ";
+        const size_t name_pos = line.find( name_key );
+        const size_t time_pos = line.find( time_key );
+        if( name_pos == std::string::npos || time_pos == std::string::npos )
+            continue;
+        const size_t name_end = line.find( '"' , name_pos + name_key.size() );
+        if( name_end != std::string::npos )
+            times[ line.substr( name_pos + name_key.size() , name_end - name_pos - name_key.size() ) ] = atof( line.c_str() + time_pos + time_key.size() );
+    }
+
+    unsigned regressions = 0;
+    for( const Result& r : results ){
+        const auto it = times.find( r.name );
+        if( !r.done || it == times.end() || it->second <= 0.0 )
+            continue;
+        const double ratio = r.renderMs / it->second;
+        if( ratio > REGRESSION_RATIO ){
+            slog( WARNING , PERFORMANCE , stringFormat( "Benchmark %s renders in %.1f ms , %.0f%% slower than %.1f ms of the baseline." ,
+                r.name.c_str() , r.renderMs , ( ratio - 1.0 ) * 100.0 , it->second ) );
+            ++regressions;
+        }else
+            slog( INFO , PERFORMANCE , stringFormat( "Benchmark %s renders in %.1f ms , %.1f ms in the baseline." , r.name.c_str() , r.renderMs , it->second ) );
+    }
+    return regressions;
+}
+
+// start measuring the peak resident memory again
+void RenderBenchmark::resetPeakMemory()
+{
+    // writing 5 to clear_refs resets the peak resident set size of the process since Linux 4.0
+#if defined(SORT_IN_LINUX)
+    std::ofstream file( "/proc/self/clear_refs" );
+    if( file.is_open() )
+        file << "5";
+#endif
+}
+
+// the peak resident memory of the process in megabytes
+double RenderBenchmark::peakMemory()
+{
+#if defined(SORT_IN_LINUX)
+    std::ifstream file( "/proc/self/status" );
+    std::string line;
+    while( std::getline( file , line ) )
+        if( line.compare( 0 , 6 , "VmHWM:" ) == 0 )
+            return atof( line.c_str() + 6 ) / 1024.0;
+    return 0.0;
+#elif defined(SORT_IN_WINDOWS)
+    // the peak of other platforms can't be reset , it is the peak of the process so far
+    PROCESS_MEMORY_COUNTERS counters;
+    if( GetProcessMemoryInfo( GetCurrentProcess() , &counters , sizeof( counters ) ) )
+        return counters.PeakWorkingSetSize / ( 1024.0 * 1024.0 );
+    return 0.0;
+#else
+    // the peak is in bytes on mac
+    struct rusage usage;
+    if( getrusage( RUSAGE_SELF , &usage ) == 0 )
+        return usage.ru_maxrss / ( 1024.0 * 1024.0 );
+    return 0.0;
+#endif
+}
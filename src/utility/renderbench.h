@@ -0,0 +1,83 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <string>
+#include <vector>
+
+//! @brief Benchmark rendering the reference scenes end to end.
+/**
+ * The sampler and accelerator benchmarks measure one part of the renderer alone, a change slowing down the
+ * loading, the shading or the integrators is only seen in full renders. The benchmark renders every settings
+ * file listed in a suite one after another in the same process. Each scene is loaded again from its files, it
+ * is not reused from the previous rendering. The loading, pre-processing and rendering are timed, and the
+ * rays traced and the peak resident memory are measured as well. The results are written as JSON. They could
+ * be compared with the report of an earlier build, renderings slower by more than a fifth are reported as
+ * regressions.
+ */
+class RenderBenchmark
+{
+public:
+    //! @brief Constructor reading the suite.
+    //! @param suite    A text file listing the settings files, one on each line. Empty lines and lines starting
+    //!                 with '#' are skipped. The files are relative to the working directory.
+    explicit RenderBenchmark( const std::string& suite );
+
+    //! @brief Render every scene of the suite.
+    //! @param report   The JSON file the results are written to, nothing is written if it is empty.
+    //! @param baseline The report of an earlier run to compare with, nothing is compared if it is empty.
+    //! @return         Zero if all scenes are rendered without any regression, one if any scene fails and two if
+    //!                 any scene renders slower than in the baseline.
+    int Run( const std::string& report , const std::string& baseline );
+
+private:
+    //! @brief Measurements of one scene.
+    struct Result
+    {
+        std::string         name;               /**< Name of the scene, the settings file without its extension. */
+        std::string         file;               /**< The settings file. */
+        bool                done = false;       /**< Whether the scene is rendered. */
+        double              loadMs = 0.0;       /**< Time of reading the settings and loading the scene. */
+        double              preprocessMs = 0.0; /**< Time of pre-processing the scene, the accelerator is built in it. */
+        double              renderMs = 0.0;     /**< Time of rendering the image. */
+        unsigned long long  samples = 0;        /**< Number of pixel samples taken. */
+        unsigned long long  rays = 0;           /**< Number of rays traced in the scene. */
+        double              peakRssMb = 0.0;    /**< Peak resident memory of the process while the scene is rendered. */
+    };
+
+    std::vector<std::string>    m_files;        /**< The settings files of the suite. */
+
+    //! @brief Write the results as JSON.
+    //! @param filename The name of the file.
+    //! @param results  The results of all scenes.
+    //! @return         False if the file can't be written.
+    static bool writeReport( const std::string& filename , const std::vector<Result>& results );
+
+    //! @brief Compare the rendering times with an earlier report.
+    //! @param filename The report of the earlier run.
+    //! @param results  The results of all scenes.
+    //! @return         The number of scenes rendering slower than before.
+    static unsigned compareBaseline( const std::string& filename , const std::vector<Result>& results );
+
+    //! @brief Start measuring the peak resident memory again, it is only possible on Linux.
+    static void resetPeakMemory();
+
+    //! @brief The peak resident memory of the process in megabytes, zero if it is unknown.
+    static double peakMemory();
+};
@@ -0,0 +1,515 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "renderfarm.h"
+#include "utility/multithread/multithread.h"
+#include "imagesensor/imagesensor.h"
+#include "integrator/integrator.h"
+#include "accel/accelcache.h"
+#include "log/log.h"
+#include "zlib.h"
+#include <half.h>
+#include <chrono>
+#include <deque>
+#include <condition_variable>
+
+// the version of the messages , workers of other versions are rejected
+static const unsigned FARM_VERSION = 2;
+// the number of tasks a worker thread holds at a time , the next task is fetched while the current one is rendered
+static const unsigned FARM_PIPELINE = 2;
+// the largest message accepted , a broken stream is detected before allocating memory for it
+static const unsigned FARM_MAX_MESSAGE = 1u << 28;
+
+// messages between the coordinator and the workers
+enum FARM_MESSAGE
+{
+	FARM_HELLO = 0 ,		// worker : the version and the key of its rendering
+	FARM_WELCOME ,			// coordinator : whether the worker is accepted and the format of the pixels
+	FARM_REQUEST ,			// worker : a request for the next task
+	FARM_TASK ,				// coordinator : the task to render
+	FARM_WAIT ,				// coordinator : no task is left for now , the worker asks again later
+	FARM_RESULT ,			// worker : the pixels of the oldest task it holds
+	FARM_DONE ,				// coordinator : the rendering is finished
+};
+
+// send a message , it is the type and the size of the payload followed by the payload
+static bool sendMessage( TcpSocket& socket , unsigned type , const std::vector<char>& payload )
+{
+	const unsigned header[2] = { type , (unsigned)payload.size() };
+	return socket.Send( header , sizeof( header ) ) && socket.Send( payload.data() , payload.size() );
+}
+
+// receive a message
+static bool receiveMessage( TcpSocket& socket , unsigned& type , std::vector<char>& payload )
+{
+	unsigned header[2];
+	if( !socket.Receive( header , sizeof( header ) ) || header[1] > FARM_MAX_MESSAGE )
+		return false;
+	type = header[0];
+	payload.resize( header[1] );
+	return socket.Receive( payload.data() , payload.size() );
+}
+
+// compress the pixels of a task , the bytes of the floats are shuffled into planes first as the high bytes of neighbor pixels are similar
+static void packPixels( const std::vector<float>& data , bool half_pixels , std::vector<char>& packed )
+{
+	const size_t cnt = data.size();
+	const unsigned char* bytes = (const unsigned char*)data.data();
+	size_t stride = sizeof( float );
+	std::vector<half> halfs;
+	if( half_pixels )
+	{
+		// values out of the range of half floats are clamped instead of becoming infinite
+		halfs.resize( cnt );
+		for( size_t i = 0 ; i < cnt ; ++i )
+			halfs[i] = half( std::min( std::max( data[i] , -(float)HALF_MAX ) , (float)HALF_MAX ) );
+		bytes = (const unsigned char*)halfs.data();
+		stride = sizeof( half );
+	}
+
+	std::vector<unsigned char> planes( cnt * stride );
+	for( size_t i = 0 ; i < cnt ; ++i )
+		for( size_t k = 0 ; k < stride ; ++k )
+			planes[ k * cnt + i ] = bytes[ i * stride + k ];
+
+	uLongf size = compressBound( (uLong)planes.size() );
+	packed.resize( size );
+	if( compress2( (Bytef*)packed.data() , &size , planes.data() , (uLong)planes.size() , Z_BEST_SPEED ) != Z_OK )
+		size = 0;
+	packed.resize( size );
+}
+
+// decompress the pixels of a task
+static bool unpackPixels( const char* packed , size_t size , bool half_pixels , std::vector<float>& data )
+{
+	const size_t cnt = data.size();
+	const size_t stride = half_pixels ? sizeof( half ) : sizeof( float );
+	std::vector<unsigned char> planes( cnt * stride );
+	uLongf planes_size = (uLongf)planes.size();
+	if( uncompress( planes.data() , &planes_size , (const Bytef*)packed , (uLong)size ) != Z_OK || planes_size != planes.size() )
+		return false;
+
+	std::vector<half> halfs( half_pixels ? cnt : 0 );
+	unsigned char* bytes = half_pixels ? (unsigned char*)halfs.data() : (unsigned char*)data.data();
+	for( size_t i = 0 ; i < cnt ; ++i )
+		for( size_t k = 0 ; k < stride ; ++k )
+			bytes[ i * stride + k ] = planes[ k * cnt + i ];
+	for( size_t i = 0 ; i < halfs.size() ; ++i )
+		data[i] = halfs[i];
+	return true;
+}
+
+// listen to workers
+bool FarmCoordinator::Start( unsigned short port , unsigned long long key , bool half )
+{
+	if( !m_listener.Listen( port ) )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Render farm coordinator can't listen to port %d." , (int)port ) );
+		return false;
+	}
+	m_key = key;
+	m_halfPixels = half;
+	m_stop = false;
+	m_remoteTasks = 0;
+	m_pixelBytes = 0;
+	m_resultBytes = 0;
+	m_acceptThread = std::thread( [this](){ _accept(); } );
+	slog( INFO , GENERAL , stringFormat( "Render farm coordinator listens to port %d." , (int)m_listener.GetPort() ) );
+	return true;
+}
+
+// finish all workers
+void FarmCoordinator::Stop()
+{
+	if( !m_acceptThread.joinable() )
+		return;
+
+	// workers asking for tasks are told to finish
+	m_stop = true;
+	m_acceptThread.join();
+	m_listener.Close();
+
+	std::lock_guard<std::mutex> lock( m_connectionMutex );
+	for( unsigned i = 0 ; i < 100 ; ++i )
+	{
+		bool finished = true;
+		for( auto& connection : m_connections )
+			finished &= connection->finished.load();
+		if( finished )
+			break;
+		std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+	}
+
+	// workers not responding in time are disconnected
+	for( auto& connection : m_connections )
+	{
+		connection->socket.Shutdown();
+		connection->thread.join();
+	}
+	m_connections.clear();
+
+	slog( INFO , GENERAL , stringFormat( "Render farm workers rendered %d tasks." , (int)m_remoteTasks.load() ) );
+	if( m_resultBytes > 0 )
+		slog( INFO , GENERAL , stringFormat( "Render farm workers sent %.2f MB of %s pixels in %.2f MB , %.1f : 1." , m_pixelBytes.load() / 1048576.0 ,
+			m_halfPixels ? "half float" : "float" , m_resultBytes.load() / 1048576.0 , (double)m_pixelBytes.load() / m_resultBytes.load() ) );
+}
+
+// serve the tasks of a pass
+void FarmCoordinator::BeginPass( const FarmTask& pass , unsigned slot , std::shared_ptr<Integrator> integrator , ImageSensor* imagesensor )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	const unsigned pass_id = m_pass.pass + 1;
+	m_pass = pass;
+	m_pass.pass = pass_id;
+	m_slot = slot;
+	m_integrator = integrator;
+	m_imagesensor = imagesensor;
+	m_outstanding = 0;
+	m_passActive = true;
+}
+
+// stop serving the tasks of the pass
+bool FarmCoordinator::EndPass()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	if( m_outstanding > 0 )
+		return false;
+	m_passActive = false;
+	m_integrator.reset();
+	m_imagesensor = nullptr;
+	return true;
+}
+
+// accept the workers
+void FarmCoordinator::_accept()
+{
+	while( !m_stop.load() )
+	{
+		std::unique_ptr<Connection> connection( new Connection() );
+		if( !m_listener.Accept( connection->socket , 100 ) )
+			continue;
+
+		std::lock_guard<std::mutex> lock( m_connectionMutex );
+		Connection* c = connection.get();
+		c->thread = std::thread( [this,c](){ _serve( c ); c->finished = true; } );
+		m_connections.push_back( std::move( connection ) );
+	}
+}
+
+// serve the tasks to a worker
+void FarmCoordinator::_serve( Connection* connection )
+{
+	TcpSocket& socket = connection->socket;
+	const string name = socket.GetPeerName();
+	RenderTaskScheduler& scheduler = RenderTaskScheduler::GetSingleton();
+
+	// the worker introduces itself with the key of its rendering
+	unsigned type = 0;
+	std::vector<char> payload;
+	if( !receiveMessage( socket , type , payload ) || type != FARM_HELLO )
+		return;
+	AccelReader hello( payload.data() , payload.size() );
+	unsigned version = 0;
+	unsigned long long key = 0;
+	const bool accepted = hello.Read( version ) && hello.Read( key ) && hello.IsComplete() && version == FARM_VERSION && key == m_key;
+	AccelWriter welcome;
+	welcome.Write( (unsigned)accepted );
+	welcome.Write( (unsigned)m_halfPixels );
+	if( !sendMessage( socket , FARM_WELCOME , welcome.GetData() ) )
+		return;
+	if( !accepted )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Render farm worker %s is rejected , it renders another scene or version." , name.c_str() ) );
+		return;
+	}
+	slog( INFO , GENERAL , stringFormat( "Render farm worker %s is connected." , name.c_str() ) );
+
+	// the worker asks for the next task while it renders the current one , the results come back in the order of the tasks
+	struct Pending
+	{
+		RenderTask*					task;
+		std::shared_ptr<Integrator>	integrator;
+		ImageSensor*				imagesensor;
+	};
+	std::deque<Pending> pending;
+	std::vector<float> pixels;
+	bool finished = false;
+	while( receiveMessage( socket , type , payload ) )
+	{
+		if( type == FARM_REQUEST && pending.size() < FARM_PIPELINE )
+		{
+			Pending next = { nullptr , nullptr , nullptr };
+			FarmTask desc;
+			{
+				std::lock_guard<std::mutex> lock( m_mutex );
+				if( m_stop.load() )
+				{
+					finished = true;
+					break;
+				}
+				if( m_passActive )
+				{
+					// tasks of a cancelled rendering are drained without rendering , like the local threads do
+					while( ( next.task = scheduler.TryPopTask( m_slot ) ) && RenderControl::GetSingleton().IsCancelled() )
+					{
+						scheduler.FinishTask( *next.task );
+						RenderTask::DestoryRenderTask( *next.task );
+					}
+					if( next.task )
+					{
+						++m_outstanding;
+						desc = m_pass;
+						next.integrator = m_integrator;
+						next.imagesensor = m_imagesensor;
+					}
+				}
+			}
+			if( !next.task )
+			{
+				if( !sendMessage( socket , FARM_WAIT , std::vector<char>() ) )
+					break;
+				continue;
+			}
+			pending.push_back( next );
+
+			desc.taskId = next.task->taskId;
+			desc.ori = next.task->ori;
+			desc.size = next.task->size;
+			AccelWriter message;
+			message.Write( desc.view );
+			message.Write( desc.pass );
+			message.Write( desc.spp );
+			message.Write( desc.sampleOffset );
+			message.Write( desc.adaptiveThreshold );
+			message.Write( desc.adaptiveBatch );
+			message.Write( desc.taskId );
+			message.Write( desc.ori.x );
+			message.Write( desc.ori.y );
+			message.Write( desc.size.x );
+			message.Write( desc.size.y );
+			if( !sendMessage( socket , FARM_TASK , message.GetData() ) )
+				break;
+			continue;
+		}
+		if( type != FARM_RESULT || pending.empty() )
+			break;
+
+		// the result is the id of the task and the number of samples followed by the compressed pixels
+		const Pending current = pending.front();
+		RenderTask* task = current.task;
+		unsigned task_id = 0;
+		unsigned long long samples = 0;
+		AccelReader result( payload.data() , payload.size() );
+		const size_t header = sizeof( task_id ) + sizeof( samples );
+		bool valid = result.Read( task_id ) && result.Read( samples ) && payload.size() > header && task_id == task->taskId;
+		pixels.resize( (size_t)task->size.x * task->size.y * current.imagesensor->GetRectChannels() );
+		valid = valid && unpackPixels( payload.data() + header , payload.size() - header , m_halfPixels , pixels );
+		if( !valid )
+			break;
+		pending.pop_front();
+
+		current.imagesensor->StoreRect( *task , pixels.data() );
+		scheduler.AddSamples( samples );
+		if( current.integrator->NeedRefreshTile() )
+			current.imagesensor->FinishTile( *task );
+		scheduler.FinishTask( *task );
+		RenderTask::DestoryRenderTask( *task );
+		++m_remoteTasks;
+		m_pixelBytes += pixels.size() * sizeof( float );
+		m_resultBytes += payload.size();
+
+		std::lock_guard<std::mutex> lock( m_mutex );
+		--m_outstanding;
+	}
+
+	// the tiles held by a lost worker are rendered by another worker or a local thread
+	if( !pending.empty() )
+	{
+		for( const Pending& lost : pending )
+			scheduler.ReturnTask( lost.task );
+		{
+			std::lock_guard<std::mutex> lock( m_mutex );
+			m_outstanding -= (unsigned)pending.size();
+		}
+		slog( WARNING , GENERAL , stringFormat( "Render farm worker %s is lost , its %d tasks are rendered again." , name.c_str() , (int)pending.size() ) );
+		return;
+	}
+
+	if( finished )
+		sendMessage( socket , FARM_DONE , std::vector<char>() );
+	slog( INFO , GENERAL , stringFormat( "Render farm worker %s is finished." , name.c_str() ) );
+}
+
+// render the tasks of the coordinator
+unsigned FarmWorker::Run( const string& host , unsigned short port , unsigned long long key , const RenderFunc& render )
+{
+	// the worker could be started before the coordinator , it keeps trying for a while
+	TcpSocket socket;
+	for( unsigned i = 0 ; i < 100 && !socket.Connect( host , port ) ; ++i )
+	{
+		if( RenderControl::GetSingleton().IsCancelled() )
+			return 0;
+		std::this_thread::sleep_for( std::chrono::milliseconds( 300 ) );
+	}
+	if( !socket.IsOpen() )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Render farm worker can't connect to %s:%d." , host.c_str() , (int)port ) );
+		return 0;
+	}
+
+	AccelWriter hello;
+	hello.Write( FARM_VERSION );
+	hello.Write( key );
+	unsigned type = 0;
+	std::vector<char> payload;
+	unsigned accepted = 0;
+	unsigned half_pixels = 0;
+	if( !sendMessage( socket , FARM_HELLO , hello.GetData() ) || !receiveMessage( socket , type , payload ) || type != FARM_WELCOME )
+		payload.clear();
+	AccelReader welcome( payload.data() , payload.size() );
+	if( !welcome.Read( accepted ) || !welcome.Read( half_pixels ) || !accepted )
+	{
+		slog( WARNING , GENERAL , stringFormat( "Render farm worker is rejected by %s:%d , it renders another scene or version." , host.c_str() , (int)port ) );
+		return 0;
+	}
+
+	// the tasks fetched by the io thread and the results of the render thread
+	struct Result
+	{
+		unsigned			taskId;
+		unsigned long long	samples;
+		std::vector<float>	pixels;
+	};
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<FarmTask> tasks;
+	std::deque<Result> results;
+	unsigned held = 0;			// the tasks fetched and not returned yet
+	bool finished = false;		// no task is served anymore or the connection is lost
+	bool stopped = false;		// the render thread doesn't take tasks anymore
+	unsigned task_cnt = 0;
+
+	// the io thread sends the results first , so the coordinator gets the tiles as soon as possible
+	std::thread io( [&](){
+		std::vector<char> packed;
+		std::vector<char> message;
+		std::chrono::steady_clock::time_point next_request = std::chrono::steady_clock::now();
+		std::unique_lock<std::mutex> lock( mutex );
+		while( true )
+		{
+			if( !results.empty() )
+			{
+				Result result = std::move( results.front() );
+				results.pop_front();
+				lock.unlock();
+
+				packPixels( result.pixels , half_pixels != 0 , packed );
+				AccelWriter writer;
+				writer.Write( result.taskId );
+				writer.Write( result.samples );
+				writer.Write( packed.data() , packed.size() );
+				const bool sent = !packed.empty() && sendMessage( socket , FARM_RESULT , writer.GetData() );
+
+				lock.lock();
+				if( !sent )
+					break;
+				--held;
+				++task_cnt;
+				continue;
+			}
+			if( stopped )
+				break;
+
+			// the next task is fetched while the render thread is busy , the coordinator is asked again later if it has none for now
+			const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if( held >= FARM_PIPELINE || now < next_request )
+			{
+				cv.wait_for( lock , std::chrono::milliseconds( 10 ) );
+				continue;
+			}
+			lock.unlock();
+
+			FarmTask task;
+			bool valid = sendMessage( socket , FARM_REQUEST , std::vector<char>() ) && receiveMessage( socket , type , message );
+			if( !valid )
+				slog( WARNING , GENERAL , stringFormat( "Render farm worker lost the connection to %s:%d." , host.c_str() , (int)port ) );
+			else if( type == FARM_WAIT )
+				next_request = now + std::chrono::milliseconds( 10 );
+			else
+			{
+				AccelReader reader( message.data() , message.size() );
+				reader.Read( task.view );
+				reader.Read( task.pass );
+				reader.Read( task.spp );
+				reader.Read( task.sampleOffset );
+				reader.Read( task.adaptiveThreshold );
+				reader.Read( task.adaptiveBatch );
+				reader.Read( task.taskId );
+				reader.Read( task.ori.x );
+				reader.Read( task.ori.y );
+				reader.Read( task.size.x );
+				reader.Read( task.size.y );
+				valid = ( type == FARM_TASK && reader.IsComplete() );
+			}
+
+			lock.lock();
+			if( !valid )
+				break;
+			if( type == FARM_TASK )
+			{
+				tasks.push_back( task );
+				++held;
+				cv.notify_all();
+			}
+		}
+		finished = true;
+		cv.notify_all();
+	} );
+
+	// the render thread only waits for the tasks , the results are compressed and sent by the io thread
+	std::vector<float> pixels;
+	while( true )
+	{
+		FarmTask task;
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			while( tasks.empty() && !finished && !RenderControl::GetSingleton().IsCancelled() )
+				cv.wait_for( lock , std::chrono::milliseconds( 10 ) );
+			if( tasks.empty() || RenderControl::GetSingleton().IsCancelled() )
+				break;
+			task = tasks.front();
+			tasks.pop_front();
+		}
+
+		unsigned long long samples = 0;
+		if( !render( task , pixels , samples ) )
+			break;
+
+		std::lock_guard<std::mutex> lock( mutex );
+		results.push_back( Result{ task.taskId , samples , std::move( pixels ) } );
+		cv.notify_all();
+	}
+
+	// the tasks left are given back by the coordinator once the connection is closed
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		stopped = true;
+		cv.notify_all();
+	}
+	io.join();
+	return task_cnt;
+}
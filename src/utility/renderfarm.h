@@ -0,0 +1,162 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "math/vector2.h"
+#include "platform/socket/tcpsocket.h"
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+class Integrator;
+class ImageSensor;
+
+// a range of samples of a tile rendered by a worker of the render farm
+struct FarmTask
+{
+	unsigned	view = 0;					// the index of the view
+	unsigned	pass = 0;					// the index of the pass , every pass of progressive rendering has its own
+	unsigned	spp = 0;					// the sample number per pixel of the pass
+	unsigned	sampleOffset = 0;			// the number of samples per pixel taken before the pass
+	float		adaptiveThreshold = 0.0f;	// the adaptive sampling of the rendering
+	unsigned	adaptiveBatch = 0;
+	unsigned	taskId = 0;					// the id of the tile
+	Vector2i	ori;						// the rectangle of the task
+	Vector2i	size;
+};
+
+//////////////////////////////////////////////////////////////////////
+//	definition of render farm coordinator
+//	desc :	The coordinator renders the image like a standalone process,
+//			workers on other nodes of the farm load the same scene and
+//			pull tasks from it over TCP. Remote tasks are taken from an
+//			extra deque of the render task scheduler , so the workers
+//			steal the tiles of the local threads and the other way
+//			around , and slow nodes simply take fewer tiles. The pixels
+//			of a task are sent back compressed and stored into the
+//			image sensor as if the task were rendered locally. Tasks of
+//			a lost worker are given back to the scheduler. Pixels are
+//			sent as floats , or as half floats to save bandwidth on
+//			slow networks if the coordinator asks for it.
+class	FarmCoordinator
+{
+// public method
+public:
+	// destructor
+	~FarmCoordinator(){ Stop(); }
+
+	// listen to workers
+	// para 'port' : the port to listen to
+	// para 'key'  : the key of the scene and the settings , workers of other renderings are rejected
+	// para 'half' : whether the workers send the pixels as half floats , they are clamped to the range of half floats
+	// result      : false if the port can't be bound
+	bool	Start( unsigned short port , unsigned long long key , bool half = false );
+
+	// finish all workers and close the connections
+	void	Stop();
+
+	// serve the tasks of a pass to the workers , the render task scheduler has to be started with an extra worker for them
+	// para 'pass'        : the pass , the tile of each task is filled in when it is served
+	// para 'slot'        : the id of the extra worker of the scheduler
+	// para 'integrator'  : the integrator of the pass
+	// para 'imagesensor' : the image sensor the pixels of the workers are stored to
+	void	BeginPass( const FarmTask& pass , unsigned slot , std::shared_ptr<Integrator> integrator , ImageSensor* imagesensor );
+
+	// stop serving the tasks of the pass
+	// result : false if some tasks are still rendered by the workers , it has to be called again later
+	// note   : tasks of lost workers are given back to the scheduler , they have to be rendered locally afterward
+	bool	EndPass();
+
+// private field
+private:
+	// a connection to a worker
+	struct Connection
+	{
+		TcpSocket			socket;
+		std::thread			thread;
+		std::atomic<bool>	finished{false};
+	};
+
+	// the listening socket
+	TcpSocket		m_listener;
+	// the thread accepting the workers
+	std::thread		m_acceptThread;
+	// the connections to the workers
+	std::vector<std::unique_ptr<Connection>>	m_connections;
+	std::mutex		m_connectionMutex;
+	// the key of the rendering
+	unsigned long long	m_key = 0;
+	// whether the pixels are sent as half floats
+	bool			m_halfPixels = false;
+	// whether the workers are asked to finish
+	std::atomic<bool>	m_stop{false};
+
+	// the pass being served , the extra worker of the scheduler is only used by one connection at a time under the mutex
+	std::mutex		m_mutex;
+	bool			m_passActive = false;
+	FarmTask		m_pass;
+	unsigned		m_slot = 0;
+	std::shared_ptr<Integrator>	m_integrator;
+	ImageSensor*	m_imagesensor = nullptr;
+	// the number of tasks rendered by the workers at the moment
+	unsigned		m_outstanding = 0;
+	// the number of tasks rendered by the workers
+	std::atomic<unsigned>	m_remoteTasks{0};
+	// the size of the pixels received from the workers as floats and the size of the messages carrying them
+	std::atomic<unsigned long long>	m_pixelBytes{0};
+	std::atomic<unsigned long long>	m_resultBytes{0};
+
+	// accept the workers until the coordinator stops
+	void	_accept();
+	// serve the tasks to a worker
+	// para 'connection' : the connection to the worker
+	void	_serve( Connection* connection );
+};
+
+//////////////////////////////////////////////////////////////////////
+//	definition of render farm worker
+//	desc :	Every render thread of a worker process keeps its own
+//			connection to the coordinator and renders the tasks it
+//			pulls one after another , until the coordinator finishes.
+//			The connection is served by an IO thread , it compresses
+//			and sends the result of a task and fetches the next task
+//			while the render thread is busy , so rendering never waits
+//			for the compression or the network.
+class	FarmWorker
+{
+// public method
+public:
+	// render a task
+	// para 'task'    : the task
+	// para 'data'    : the pixels of the task in the layout of 'ImageSensor::TakeRect'
+	// para 'samples' : the number of samples taken
+	// result         : false if the task can't be finished , the connection is closed then
+	typedef std::function<bool( const FarmTask& task , std::vector<float>& data , unsigned long long& samples )> RenderFunc;
+
+	// connect to the coordinator and render its tasks until it finishes
+	// para 'host'   : the host of the coordinator
+	// para 'port'   : the port of the coordinator
+	// para 'key'    : the key of the scene and the settings
+	// para 'render' : the function rendering a task
+	// result        : the number of rendered tasks
+	static unsigned Run( const string& host , unsigned short port , unsigned long long key , const RenderFunc& render );
+};
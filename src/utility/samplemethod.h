@@ -22,6 +22,7 @@
 #include "texture/texture.h"
 #include <vector>
 #include "sassert.h"
+#include "multithread/threadpool.h"
 
 /*
 description :
@@ -62,8 +63,10 @@ inline void UniformSampleDisk( float u , float v , float& x , float& y )
 
 	theta *= PI / 4.0f;
 
-	x = cos( theta ) * r;
-	y = sin( theta ) * r;
+	float sin_theta , cos_theta;
+	SinCos( theta , sin_theta , cos_theta );
+	x = cos_theta * r;
+	y = sin_theta * r;
 }
 
 // sampling a vector in a hemisphere using cosine pdf
@@ -93,8 +96,10 @@ inline Vector UniformSampleCone( float u , float v , float cos_max )
 	float cos_theta = ( 1.0f - u ) + u * cos_max;
 	float sin_theta = sqrt( 1.0f - cos_theta * cos_theta );
 	float phi = TWO_PI * v;
+	float sin_phi , cos_phi;
+	SinCos( phi , sin_phi , cos_phi );
 
-	return Vector( cosf(phi)*sin_theta , cos_theta , sinf(phi)*sin_theta );
+	return Vector( cos_phi*sin_theta , cos_theta , sin_phi*sin_theta );
 }
 
 // sampling a cone uniformly
@@ -108,7 +113,7 @@ inline float UniformConePdf( float cos_max )
 // para 'v' : a canonical random variable
 inline Vector UniformSampleHemisphere( float u , float v )
 {
-	float theta = acos( u );
+	float theta = Acos( u );
 	float phi = TWO_PI * v;
 
 	return SphericalVec( theta , phi );
@@ -125,7 +130,7 @@ inline float UniformHemispherePdf()
 // para 'v'	: a canonical random variable
 inline Vector UniformSampleSphere( float u , float v )
 {
-	float theta = acos( 1 - 2.0f * u );
+	float theta = Acos( 1 - 2.0f * u );
 	float phi = TWO_PI * v;
 	return SphericalVec( theta , phi );
 }
@@ -136,6 +141,93 @@ inline float UniformSpherePdf()
 	return INV_TWOPI * 0.5f;
 }
 
+// a rectangle seen from a point , the directions toward it are sampled uniformly in solid angle
+// note : it follows 'An Area-Preserving Parametrization for Spherical Rectangles' by Urena et al.
+class SphericalRectangle
+{
+// public method
+public:
+	// setup the rectangle
+	// para 'o'  : the point the rectangle is seen from
+	// para 's'  : a corner of the rectangle
+	// para 'ex' : the edge along the first side of the rectangle
+	// para 'ey' : the edge along the second side , it is perpendicular to 'ex'
+	SphericalRectangle( const Point& o , const Point& s , const Vector& ex , const Vector& ey )
+	{
+		m_o = o;
+		m_exl = ex.Length();
+		m_eyl = ey.Length();
+		m_x = ex / m_exl;
+		m_y = ey / m_eyl;
+		m_z = Cross( m_x , m_y );
+
+		// the local frame is placed so that the rectangle lies below the point
+		const Vector d = s - o;
+		m_x0 = Dot( d , m_x );
+		m_y0 = Dot( d , m_y );
+		m_z0 = Dot( d , m_z );
+		if( m_z0 > 0.0f )
+		{
+			m_z0 = -m_z0;
+			m_z = -m_z;
+		}
+		m_x1 = m_x0 + m_exl;
+		m_y1 = m_y0 + m_eyl;
+
+		// the normals of the planes through the point and the edges
+		const Vector v00( m_x0 , m_y0 , m_z0 ) , v01( m_x0 , m_y1 , m_z0 );
+		const Vector v10( m_x1 , m_y0 , m_z0 ) , v11( m_x1 , m_y1 , m_z0 );
+		const Vector n0 = Normalize( Cross( v00 , v10 ) );
+		const Vector n1 = Normalize( Cross( v10 , v11 ) );
+		const Vector n2 = Normalize( Cross( v11 , v01 ) );
+		const Vector n3 = Normalize( Cross( v01 , v00 ) );
+
+		// the solid angle is the excess of the internal angles , the precise arc cosine keeps it accurate for small rectangles
+		const float g0 = acos( clamp( -Dot( n0 , n1 ) , -1.0f , 1.0f ) );
+		const float g1 = acos( clamp( -Dot( n1 , n2 ) , -1.0f , 1.0f ) );
+		const float g2 = acos( clamp( -Dot( n2 , n3 ) , -1.0f , 1.0f ) );
+		const float g3 = acos( clamp( -Dot( n3 , n0 ) , -1.0f , 1.0f ) );
+		m_b0 = n0.z;
+		m_b1 = n2.z;
+		m_k = TWO_PI - g2 - g3;
+		m_solidAngle = g0 + g1 - m_k;
+	}
+
+	// the solid angle of the rectangle , the pdf of the sampled directions is its reciprocal
+	float SolidAngle() const { return m_solidAngle; }
+
+	// sample a point on the rectangle
+	// para 'u' : a canonical random variable
+	// para 'v' : a canonical random variable
+	Point Sample( float u , float v ) const
+	{
+		// the position along the first side
+		const float au = u * m_solidAngle + m_k;
+		const float fu = ( cos( au ) * m_b0 - m_b1 ) / sin( au );
+		const float cu = clamp( ( ( fu > 0.0f ) ? 1.0f : -1.0f ) / sqrt( fu * fu + m_b0 * m_b0 ) , -1.0f , 1.0f );
+		const float xu = clamp( -( cu * m_z0 ) / sqrt( max( 0.0f , 1.0f - cu * cu ) ) , m_x0 , m_x1 );
+
+		// the position along the second side
+		const float d = sqrt( xu * xu + m_z0 * m_z0 );
+		const float h0 = m_y0 / sqrt( d * d + m_y0 * m_y0 );
+		const float h1 = m_y1 / sqrt( d * d + m_y1 * m_y1 );
+		const float hv = h0 + v * ( h1 - h0 );
+		const float hv2 = hv * hv;
+		const float yv = ( hv2 < 1.0f - 1e-6f ) ? hv * d / sqrt( 1.0f - hv2 ) : m_y1;
+
+		return m_o + m_x * xu + m_y * yv + m_z * m_z0;
+	}
+
+// private field
+private:
+	Point	m_o;							// the point the rectangle is seen from
+	Vector	m_x , m_y , m_z;				// the local frame
+	float	m_exl , m_eyl;					// the lengths of the edges
+	float	m_x0 , m_y0 , m_z0 , m_x1 , m_y1;	// the extent of the rectangle in the local frame
+	float	m_b0 , m_b1 , m_k;				// the constants of the parametrization
+	float	m_solidAngle;					// the solid angle of the rectangle
+};
+
 // one dimensional distribution
 class Distribution1D
 {
@@ -242,6 +334,97 @@ private:
 	float	sum;
 };
 
+// discrete distribution sampled in constant time , every bucket is split between itself and one alias
+// note : it is built with the method of Vose , 'A Linear Algorithm For Generating Random Numbers With a Given Distribution'
+class AliasTable
+{
+// public method
+public:
+	// constructor
+	// para 'f' : the weights of the buckets , they don't need to be normalized
+	// para 'n' : the number of buckets
+	AliasTable( const float* f , unsigned n ):
+		m_bins( n ) , m_sum( 0.0f )
+	{
+		for( unsigned i = 0 ; i < n ; ++i )
+			m_sum += f[i];
+		if( n == 0 || m_sum <= 0.0f )
+			return;
+
+		// buckets are scaled so that the average one is full , the under-full ones take the rest from the over-full ones
+		std::vector<unsigned> small , large;
+		std::vector<float> scaled( n );
+		for( unsigned i = 0 ; i < n ; ++i )
+		{
+			m_bins[i].pdf = f[i] / m_sum;
+			scaled[i] = m_bins[i].pdf * n;
+			( scaled[i] < 1.0f ? small : large ).push_back( i );
+		}
+		while( !small.empty() && !large.empty() )
+		{
+			const unsigned s = small.back() , l = large.back();
+			small.pop_back();
+			m_bins[s].prob = scaled[s];
+			m_bins[s].alias = l;
+			scaled[l] -= 1.0f - scaled[s];
+			if( scaled[l] < 1.0f )
+			{
+				large.pop_back();
+				small.push_back( l );
+			}
+		}
+
+		// the ones left are full up to the precision of floats
+		for( unsigned i : small )
+			m_bins[i].prob = 1.0f;
+		for( unsigned i : large )
+			m_bins[i].prob = 1.0f;
+	}
+
+	// get a discrete sample
+	// para 'u'   : a canonical random variable
+	// para 'pdf' : the probability of the bucket
+	// result     : the bucket , -1 if there is no data in the distribution
+	int SampleDiscrete( float u , float* pdf ) const
+	{
+		if( m_sum <= 0.0f )
+		{
+			if( pdf ) *pdf = 0.0f;
+			return -1;
+		}
+
+		const unsigned n = (unsigned)m_bins.size();
+		const float x = u * n;
+		const unsigned i = min( (unsigned)x , n - 1 );
+		const unsigned k = ( x - i < m_bins[i].prob ) ? i : m_bins[i].alias;
+		if( pdf ) *pdf = m_bins[k].pdf;
+		return (int)k;
+	}
+
+	// get the probability of a bucket
+	float GetProperty( unsigned i ) const
+	{
+		sAssert( i < m_bins.size() , GENERAL );
+		return m_bins[i].pdf;
+	}
+
+	// get the sum of the original data
+	float GetSum() const
+	{ return m_sum; }
+
+// private field
+private:
+	// a bucket of the table
+	struct Alias_Bin
+	{
+		float		prob = 1.0f;	// the probability of keeping the bucket instead of taking its alias
+		float		pdf = 0.0f;		// the probability of the bucket
+		unsigned	alias = 0;		// the other bucket sharing the slot
+	};
+	std::vector<Alias_Bin>	m_bins;
+	float					m_sum;
+};
+
 // two dimensional distribution
 class Distribution2D
 {
@@ -256,12 +439,14 @@ public:
 		unsigned nv = tex->GetHeight();
 		sAssert( nu != 0 && nv != 0 , GENERAL );
 		float* data = new float[nu*nv];
-		for( unsigned i = 0 ; i < nv ; i++ )
-		{
-			unsigned offset = i * nu;
-			for( unsigned j = 0 ; j < nu ; j++ )
-				data[offset+j] = tex->GetColor( j , i ).GetIntensity();
-		}
+		ParallelFor( 0 , nv , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+			for( unsigned i = _start ; i < _end ; i++ )
+			{
+				unsigned offset = i * nu;
+				for( unsigned j = 0 ; j < nu ; j++ )
+					data[offset+j] = tex->GetColor( j , i ).GetIntensity();
+			}
+		});
 		_init( data , nu , nv );
 		SAFE_DELETE_ARRAY(data);
 	}
@@ -293,8 +478,8 @@ public:
 		u = clamp( u , 0.0f , 1.0f );
 		v = clamp( v , 0.0f , 1.0f );
 
-		int iu = (int)( u * m_nu );
-		int iv = (int)( v * m_nv );
+		int iu = min( (int)( u * m_nu ) , (int)m_nu - 1 );
+		int iv = min( (int)( v * m_nv ) , (int)m_nv - 1 );
 		if( pConditions[iv]->GetSum() * marginal->GetSum() == 0.0f )
 			return 0.0f;
 		return pConditions[iv]->GetProperty( iu ) * m_nu * marginal->GetProperty( iv ) * m_nv ;// ( pConditions[iv]->GetSum() * marginal->GetSum() );
@@ -312,8 +497,12 @@ private:
 	// initialize data
 	void _init( const float* data , unsigned nu , unsigned nv )
 	{
-		for( unsigned i = 0 ; i < nv ; i++ )
-			pConditions.push_back( new Distribution1D( &data[i*nu] , nu ) );
+		// the distributions of rows are independent
+		pConditions.resize( nv );
+		ParallelFor( 0 , nv , 16 , [&]( unsigned chunk , unsigned _start , unsigned _end ){
+			for( unsigned i = _start ; i < _end ; i++ )
+				pConditions[i] = new Distribution1D( &data[i*nu] , nu );
+		});
 		float* m = new float[nv];
 		for( unsigned i = 0 ; i < nv ; i++ )
 			m[i] = pConditions[i]->GetSum();
@@ -0,0 +1,108 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "spacefilling.h"
+#include <algorithm>
+
+// the point at a position along the hilbert curve
+Vector2i HilbertPoint( unsigned side , unsigned d )
+{
+    // the quadrant of each level is picked from two bits of the position , the lower levels are rotated into it
+    int x = 0 , y = 0;
+    for( unsigned s = 1 ; s < side ; s *= 2 , d /= 4 ){
+        const unsigned rx = 1 & ( d / 2 );
+        const unsigned ry = 1 & ( d ^ rx );
+        if( ry == 0 ){
+            if( rx == 1 ){
+                x = (int)s - 1 - x;
+                y = (int)s - 1 - y;
+            }
+            std::swap( x , y );
+        }
+        x += (int)( s * rx );
+        y += (int)( s * ry );
+    }
+    return Vector2i( x , y );
+}
+
+// the cells of a grid in a center-out spiral
+std::vector<Vector2i> SpiralOrder( const Vector2i& count )
+{
+    std::vector<Vector2i> order;
+    order.reserve( count.x * count.y );
+
+    // start from the center instead of the top-left corner , the legs of the spiral grow every two turns
+    Vector2i cur_pos( count / 2 );
+    int cur_dir = 0;
+    int cur_len = 0;
+    int cur_dir_len = 1;
+    const Vector2i dir[4] = { Vector2i( 0 , -1 ) , Vector2i( -1 , 0 ) , Vector2i( 0 , 1 ) , Vector2i( 1 , 0 ) };
+    while( true ){
+        // only the cells inside the grid are visited
+        if( cur_pos.x >= 0 && cur_pos.x < count.x && cur_pos.y >= 0 && cur_pos.y < count.y )
+            order.push_back( cur_pos );
+
+        // turn to the next direction
+        if( cur_len >= cur_dir_len ){
+            cur_dir = ( cur_dir + 1 ) % 4;
+            cur_len = 0;
+            cur_dir_len += 1 - cur_dir % 2;
+        }
+        cur_pos += dir[cur_dir];
+        ++cur_len;
+
+        if( ( cur_pos.x < 0 || cur_pos.x >= count.x ) && ( cur_pos.y < 0 || cur_pos.y >= count.y ) )
+            return order;
+    }
+}
+
+// the cells of a grid along a hilbert curve
+std::vector<Vector2i> HilbertOrder( const Vector2i& count )
+{
+    unsigned side = 1;
+    while( side < (unsigned)count.x || side < (unsigned)count.y )
+        side *= 2;
+
+    // the points of the square outside the grid are skipped
+    std::vector<Vector2i> order;
+    order.reserve( count.x * count.y );
+    for( unsigned d = 0 ; d < side * side ; ++d ){
+        const Vector2i p = HilbertPoint( side , d );
+        if( p.x < count.x && p.y < count.y )
+            order.push_back( p );
+    }
+    return order;
+}
+
+// the cells of a grid in blocks visited in a center-out spiral
+std::vector<Vector2i> HilbertSpiralOrder( const Vector2i& count , unsigned block )
+{
+    const int b = (int)block;
+    const Vector2i blocks( ( count.x + b - 1 ) / b , ( count.y + b - 1 ) / b );
+
+    std::vector<Vector2i> order;
+    order.reserve( count.x * count.y );
+    for( const Vector2i& corner : SpiralOrder( blocks ) ){
+        for( unsigned d = 0 ; d < block * block ; ++d ){
+            const Vector2i p = Vector2i( corner.x * b , corner.y * b ) + HilbertPoint( block , d );
+            if( p.x < count.x && p.y < count.y )
+                order.push_back( p );
+        }
+    }
+    return order;
+}
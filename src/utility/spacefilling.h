@@ -0,0 +1,71 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include "sort.h"
+#include "math/vector2.h"
+#include <vector>
+
+//! @brief Take every other bit of a 32-bit number and pack them into its lower half.
+//! @param v    The number, its even bits are taken.
+//! @return     The packed bits.
+inline unsigned MortonCompact( unsigned v )
+{
+    v &= 0x55555555u;
+    v = ( v ^ ( v >> 1 ) ) & 0x33333333u;
+    v = ( v ^ ( v >> 2 ) ) & 0x0f0f0f0fu;
+    v = ( v ^ ( v >> 4 ) ) & 0x00ff00ffu;
+    v = ( v ^ ( v >> 8 ) ) & 0x0000ffffu;
+    return v;
+}
+
+//! @brief The point of a square grid at a position along the Morton curve.
+//! @param code     The position along the curve, the even bits are the x coordinate and the odd ones the y coordinate.
+//! @return         The point in the grid.
+inline Vector2i MortonPoint( unsigned code )
+{
+    return Vector2i( (int)MortonCompact( code ) , (int)MortonCompact( code >> 1 ) );
+}
+
+//! @brief The point of a square grid at a position along the Hilbert curve.
+//!
+//! Unlike the Morton curve, consecutive points of the Hilbert curve are always neighbours in the grid.
+//! @param side     The size of the grid, it is a power of two.
+//! @param d        The position along the curve, it is smaller than the square of the size.
+//! @return         The point in the grid, the curve starts at the origin and ends at ( side - 1 , 0 ).
+Vector2i HilbertPoint( unsigned side , unsigned d );
+
+//! @brief The cells of a grid in a center-out spiral, the center of the image is previewed first.
+//! @param count    The number of cells along each axis.
+//! @return         All cells of the grid in the order they are visited.
+std::vector<Vector2i> SpiralOrder( const Vector2i& count );
+
+//! @brief The cells of a grid along a Hilbert curve over the smallest power-of-two square covering it.
+//! @param count    The number of cells along each axis.
+//! @return         All cells of the grid in the order they are visited.
+std::vector<Vector2i> HilbertOrder( const Vector2i& count );
+
+//! @brief The cells of a grid in square blocks visited in a center-out spiral, each block is walked along a Hilbert curve.
+//!
+//! Consecutive cells inside a block are neighbours like in HilbertOrder while the center of the image
+//! is still previewed first, only the moves between blocks jump.
+//! @param count    The number of cells along each axis.
+//! @param block    The size of the blocks, it is a power of two.
+//! @return         All cells of the grid in the order they are visited.
+std::vector<Vector2i> HilbertSpiralOrder( const Vector2i& count , unsigned block );
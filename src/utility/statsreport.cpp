@@ -0,0 +1,136 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "statsreport.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include <fstream>
+#include <cmath>
+
+// escape a string in JSON
+static std::string jsonString( const std::string& str )
+{
+    std::string ret = "\"";
+    for( const char c : str )
+    {
+        if( c == '"' || c == '\\' )
+        {
+            ret += '\\';
+            ret += c;
+        }
+        else if( c == '\n' )
+            ret += "\\n";
+        else if( c == '\t' )
+            ret += "\\t";
+        else if( (unsigned char)c < 0x20 )
+            ret += stringFormat( "\\u%04x" , (unsigned)c );
+        else
+            ret += c;
+    }
+    return ret + "\"";
+}
+
+// add a string value
+StatsGroup& StatsGroup::Add( const std::string& key , const std::string& value )
+{
+    return addLiteral( key , jsonString( value ) );
+}
+
+// add an encoded value
+StatsGroup& StatsGroup::addLiteral( const std::string& key , const std::string& literal )
+{
+    m_values.push_back( std::make_pair( key , literal ) );
+    return *this;
+}
+
+// add a real value , JSON has no infinity or nan
+StatsGroup& StatsGroup::addReal( const std::string& key , double value )
+{
+    return addLiteral( key , std::isfinite( value ) ? stringFormat( "%.6g" , value ) : "null" );
+}
+
+// the group as a JSON object
+std::string StatsGroup::ToJson( const std::string& indent ) const
+{
+    if( m_values.empty() )
+        return "{}";
+    std::string ret = "{\n";
+    for( size_t i = 0 ; i < m_values.size() ; ++i )
+        ret += indent + "    " + jsonString( m_values[i].first ) + ": " + m_values[i].second + ( i + 1 < m_values.size() ? ",\n" : "\n" );
+    return ret + indent + "}";
+}
+
+// find or create a section
+StatsReport::Section& StatsReport::section( const std::string& name , bool list )
+{
+    for( Section& section : m_sections )
+        if( section.name == name )
+            return section;
+    m_sections.push_back( Section{ name , list , std::vector<StatsGroup>() } );
+    return m_sections.back();
+}
+
+// the group of a section
+StatsGroup& StatsReport::Group( const std::string& name )
+{
+    Section& sec = section( name , false );
+    if( sec.groups.empty() )
+        sec.groups.push_back( StatsGroup() );
+    return sec.groups.front();
+}
+
+// append a group to a list section
+StatsGroup& StatsReport::Append( const std::string& name )
+{
+    Section& sec = section( name , true );
+    sec.groups.push_back( StatsGroup() );
+    return sec.groups.back();
+}
+
+// write the report
+bool StatsReport::Write( const std::string& filename ) const
+{
+    std::ofstream file( filename.c_str() , std::ios::trunc );
+    if( !file.is_open() )
+    {
+        slog( WARNING , GENERAL , stringFormat( "Failed to write statistics report %s." , filename.c_str() ) );
+        return false;
+    }
+
+    file << "{\n";
+    for( size_t i = 0 ; i < m_sections.size() ; ++i )
+    {
+        const Section& sec = m_sections[i];
+        file << "    " << jsonString( sec.name ) << ": ";
+        if( sec.list )
+        {
+            file << "[";
+            for( size_t j = 0 ; j < sec.groups.size() ; ++j )
+                file << ( j ? ",\n        " : "\n        " ) << sec.groups[j].ToJson( "        " );
+            file << ( sec.groups.empty() ? "]" : "\n    ]" );
+        }
+        else
+            file << sec.groups.front().ToJson( "    " );
+        file << ( i + 1 < m_sections.size() ? ",\n" : "\n" );
+    }
+    file << "}\n";
+    if( !file )
+        return false;
+
+    slog( INFO , GENERAL , stringFormat( "Statistics of the rendering are written to %s." , filename.c_str() ) );
+    return true;
+}
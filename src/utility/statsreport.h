@@ -0,0 +1,106 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+//! @brief Named values of one subsystem in the statistics report.
+class StatsGroup
+{
+public:
+    //! @brief Add an integer value.
+    //! @param key      The name of the value.
+    //! @param value    The value.
+    template< class T >
+    typename std::enable_if<std::is_integral<T>::value , StatsGroup&>::type Add( const std::string& key , T value ){
+        return addLiteral( key , std::to_string( value ) );
+    }
+
+    //! @brief Add a real value , it is written as null if it is not finite.
+    //! @param key      The name of the value.
+    //! @param value    The value.
+    template< class T >
+    typename std::enable_if<std::is_floating_point<T>::value , StatsGroup&>::type Add( const std::string& key , T value ){
+        return addReal( key , (double)value );
+    }
+
+    //! @brief Add a boolean value.
+    //! @param key      The name of the value.
+    //! @param value    The value.
+    StatsGroup& Add( const std::string& key , bool value ) { return addLiteral( key , value ? "true" : "false" ); }
+
+    //! @brief Add a string value.
+    //! @param key      The name of the value.
+    //! @param value    The value , it is escaped.
+    StatsGroup& Add( const std::string& key , const std::string& value );
+
+    //! @brief Add a string value.
+    //! @param key      The name of the value.
+    //! @param value    The value , it is escaped.
+    StatsGroup& Add( const std::string& key , const char* value ) { return Add( key , std::string( value ) ); }
+
+    //! @brief The group as a JSON object.
+    //! @param indent   The indentation of the values.
+    std::string ToJson( const std::string& indent ) const;
+
+private:
+    std::vector<std::pair<std::string,std::string>> m_values;   /**< The names and the JSON encoded values in the order they are added. */
+
+    StatsGroup& addLiteral( const std::string& key , const std::string& literal );
+    StatsGroup& addReal( const std::string& key , double value );
+};
+
+//! @brief Machine readable statistics of a rendering.
+/**
+ * Each subsystem fills its own group with the numbers it writes to the log , the report is written as one
+ * JSON document so that the statistics of renderings could be collected without parsing the log. A section
+ * is either one group or a list of groups , like the one of each render thread. Sections and values are
+ * written in the order they are added.
+ */
+class StatsReport
+{
+public:
+    //! @brief The group of a section , it is created by the first call.
+    //! @param section  The name of the section.
+    StatsGroup& Group( const std::string& section );
+
+    //! @brief Append a group to a list section.
+    //! @param section  The name of the section.
+    StatsGroup& Append( const std::string& section );
+
+    //! @brief Write the report in JSON.
+    //! @param filename The name of the file.
+    //! @return         False if the file can't be written.
+    bool Write( const std::string& filename ) const;
+
+private:
+    //! A section of the report.
+    struct Section
+    {
+        std::string             name;
+        bool                    list;
+        std::vector<StatsGroup> groups;
+    };
+    std::vector<Section>    m_sections; /**< The sections in the order they are added. */
+
+    Section& section( const std::string& name , bool list );
+};
@@ -92,6 +92,10 @@ TEX_TYPE	TexTypeFromStr( const string& str )
         return TT_PNG;
 	else if( strcmp( substr.c_str() , "hdr" ) == 0 )
 		return TT_HDR;
+	else if( strcmp( substr.c_str() , "dds" ) == 0 )
+		return TT_DDS;
+	else if( strcmp( substr.c_str() , "ktx" ) == 0 )
+		return TT_KTX;
 
 	// log a warning
     slog( WARNING , GENERAL , stringFormat( "Image type of \"%s\" is not supported" , substr.c_str() ) );
@@ -244,6 +248,26 @@ string NextToken( string& str , char t )
 	return res;
 }
 
+// get the name of a file of a frame
+string FrameName( const string& pattern , int frame )
+{
+	string name;
+	size_t i = 0;
+	while( i < pattern.size() )
+	{
+		if( pattern[i] != '#' )
+		{
+			name += pattern[i++];
+			continue;
+		}
+		const size_t end = pattern.find_first_not_of( '#' , i );
+		const size_t run = ( end == string::npos ? pattern.size() : end ) - i;
+		name += stringFormat( "%0*d" , (int)run , frame );
+		i += run;
+	}
+	return name;
+}
+
 // format the input string like sprintf
 string stringFormat( const char* fmt, ... ){
     std::vector<char> str(100,'\0');
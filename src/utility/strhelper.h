@@ -67,3 +67,8 @@ string NextToken( string& str , char t );
 
 // format the input string like sprintf
 string stringFormat( const char* format, ... );
+
+// get the name of a file of a frame in an animation
+// para 'pattern' : the name of the file , each run of '#' in it is replaced
+// para 'frame'   : the frame , it is padded with zeros to the length of the run
+string FrameName( const string& pattern , int frame );
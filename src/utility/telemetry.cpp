@@ -0,0 +1,299 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "telemetry.h"
+#include "log/log.h"
+#include "utility/define.h"
+#include "utility/strhelper.h"
+#include "utility/statsreport.h"
+#include <atomic>
+#include <memory>
+#include <fstream>
+#include <cstdio>
+#include <chrono>
+
+// the rays traced by each thread
+Thread_Local unsigned long long g_telemetryRays = 0;
+Thread_Local unsigned long long g_telemetryPathRays = 0;
+
+// the counters of a thread , they are padded to a cache line so that threads don't share lines
+struct ThreadCounters
+{
+    std::atomic<unsigned long long> samples{0};
+    std::atomic<unsigned long long> rays{0};
+    std::atomic<unsigned long long> pathRays{0};
+    std::atomic<unsigned long long> tasks{0};
+    std::atomic<unsigned long long> backgroundTasks{0};
+    // microseconds spent on the tasks , on scheduling , on storing tiles and idle
+    std::atomic<unsigned long long> busy{0};
+    std::atomic<unsigned long long> scheduling{0};
+    std::atomic<unsigned long long> image{0};
+    std::atomic<unsigned long long> idle{0};
+    // the time the thread found no task left in the current pass in microseconds , 0 if it is still busy
+    std::atomic<unsigned long long> drained{0};
+    char padding[48];
+};
+static std::unique_ptr<ThreadCounters[]> g_counters;
+static unsigned g_threadCnt = 0;
+
+// clear the counters
+void RenderTelemetry::Reset( unsigned thread_cnt )
+{
+    if( thread_cnt != g_threadCnt ){
+        g_counters.reset( new ThreadCounters[thread_cnt] );
+        g_threadCnt = thread_cnt;
+    }
+    for( unsigned i = 0 ; i < g_threadCnt ; ++i ){
+        g_counters[i].samples = 0;
+        g_counters[i].rays = 0;
+        g_counters[i].pathRays = 0;
+        g_counters[i].tasks = 0;
+        g_counters[i].backgroundTasks = 0;
+        g_counters[i].busy = 0;
+        g_counters[i].scheduling = 0;
+        g_counters[i].image = 0;
+        g_counters[i].idle = 0;
+        g_counters[i].drained = 0;
+    }
+}
+
+// the steady time in microseconds
+static unsigned long long nowMicroseconds()
+{
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// add time to a counter of a thread , only the thread itself writes its counters
+static void addTime( std::atomic<unsigned long long>& counter , double seconds )
+{
+    counter.store( counter.load( std::memory_order_relaxed ) + (unsigned long long)( seconds * 1e6 ) , std::memory_order_relaxed );
+}
+
+// add the time of scheduling
+void RenderTelemetry::AddSchedulingTime( unsigned tid , double seconds )
+{
+    if( tid < g_threadCnt )
+        addTime( g_counters[tid].scheduling , seconds );
+}
+
+// add the time of storing tiles
+void RenderTelemetry::AddImageTime( unsigned tid , double seconds )
+{
+    if( tid < g_threadCnt )
+        addTime( g_counters[tid].image , seconds );
+}
+
+// add the time waiting for split tasks
+void RenderTelemetry::AddIdleTime( unsigned tid , double seconds )
+{
+    if( tid < g_threadCnt )
+        addTime( g_counters[tid].idle , seconds );
+}
+
+// mark a thread without tasks
+void RenderTelemetry::ThreadDrained( unsigned tid )
+{
+    if( tid < g_threadCnt )
+        g_counters[tid].drained.store( nowMicroseconds() , std::memory_order_relaxed );
+}
+
+// finish a pass , the threads stopping early wait for the last one
+void RenderTelemetry::FinishPass()
+{
+    unsigned long long last = 0;
+    for( unsigned i = 0 ; i < g_threadCnt ; ++i )
+        last = max( last , g_counters[i].drained.load( std::memory_order_relaxed ) );
+    for( unsigned i = 0 ; i < g_threadCnt ; ++i ){
+        const unsigned long long drained = g_counters[i].drained.exchange( 0 , std::memory_order_relaxed );
+        if( drained > 0 )
+            g_counters[i].idle.fetch_add( last - drained , std::memory_order_relaxed );
+    }
+}
+
+// add a finished task to the counters of a thread
+void RenderTelemetry::FinishTask( unsigned tid , unsigned long long samples , unsigned long long rays , unsigned long long path_rays , double seconds )
+{
+    if( tid >= g_threadCnt )
+        return;
+    // only the thread itself writes its counters
+    ThreadCounters& counters = g_counters[tid];
+    counters.samples.store( counters.samples.load( std::memory_order_relaxed ) + samples , std::memory_order_relaxed );
+    counters.rays.store( counters.rays.load( std::memory_order_relaxed ) + rays , std::memory_order_relaxed );
+    counters.pathRays.store( counters.pathRays.load( std::memory_order_relaxed ) + path_rays , std::memory_order_relaxed );
+    counters.tasks.store( counters.tasks.load( std::memory_order_relaxed ) + 1 , std::memory_order_relaxed );
+    counters.busy.store( counters.busy.load( std::memory_order_relaxed ) + (unsigned long long)( seconds * 1e6 ) , std::memory_order_relaxed );
+}
+
+// count a task whose rays can't reach the scene
+void RenderTelemetry::CountBackgroundTask( unsigned tid )
+{
+    if( tid >= g_threadCnt )
+        return;
+    ThreadCounters& counters = g_counters[tid];
+    counters.backgroundTasks.store( counters.backgroundTasks.load( std::memory_order_relaxed ) + 1 , std::memory_order_relaxed );
+}
+
+// the counters of a thread
+ThreadThroughput RenderTelemetry::GetThread( unsigned tid )
+{
+    ThreadThroughput t;
+    if( tid >= g_threadCnt )
+        return t;
+    t.samples = g_counters[tid].samples.load( std::memory_order_relaxed );
+    t.rays = g_counters[tid].rays.load( std::memory_order_relaxed );
+    t.pathRays = g_counters[tid].pathRays.load( std::memory_order_relaxed );
+    t.tasks = g_counters[tid].tasks.load( std::memory_order_relaxed );
+    t.backgroundTasks = g_counters[tid].backgroundTasks.load( std::memory_order_relaxed );
+    t.busy = g_counters[tid].busy.load( std::memory_order_relaxed ) * 1e-6;
+    t.scheduling = g_counters[tid].scheduling.load( std::memory_order_relaxed ) * 1e-6;
+    t.image = g_counters[tid].image.load( std::memory_order_relaxed ) * 1e-6;
+    t.idle = g_counters[tid].idle.load( std::memory_order_relaxed ) * 1e-6;
+    return t;
+}
+
+// the counters of all threads
+ThreadThroughput RenderTelemetry::GetTotal()
+{
+    ThreadThroughput total;
+    for( unsigned i = 0 ; i < g_threadCnt ; ++i ){
+        const ThreadThroughput t = GetThread( i );
+        total.samples += t.samples;
+        total.rays += t.rays;
+        total.pathRays += t.pathRays;
+        total.tasks += t.tasks;
+        total.backgroundTasks += t.backgroundTasks;
+        total.busy += t.busy;
+        total.scheduling += t.scheduling;
+        total.image += t.image;
+        total.idle += t.idle;
+    }
+    return total;
+}
+
+// the number of render threads
+unsigned RenderTelemetry::GetThreadCount()
+{
+    return g_threadCnt;
+}
+
+// output the throughput of each thread
+void RenderTelemetry::OutputLog( double seconds )
+{
+    const double s = max( seconds , 1e-3 );
+    for( unsigned i = 0 ; i < g_threadCnt ; ++i ){
+        const ThreadThroughput t = GetThread( i );
+        slog( INFO , PERFORMANCE , stringFormat( "Thread %d : %.2f M samples/s , %.2f M rays/s , %.2f tiles/s , busy %.1f%% of the time." ,
+              i , t.samples / s * 1e-6 , t.rays / s * 1e-6 , t.tasks / s , 100.0 * min( 1.0 , t.busy / s ) ) );
+    }
+    const ThreadThroughput total = GetTotal();
+    slog( INFO , PERFORMANCE , stringFormat( "Throughput : %.2f M samples/s , %.2f M rays/s , %.2f tiles/s." , total.samples / s * 1e-6 , total.rays / s * 1e-6 , total.tasks / s ) );
+    if( total.backgroundTasks > 0 )
+        slog( INFO , PERFORMANCE , stringFormat( "Background tiles : %llu of %llu tiles can't reach the scene , they only see the environment." , total.backgroundTasks , total.tasks ) );
+}
+
+// output how each thread spends the time of the rendering , the rest of the time is spent outside of the passes
+void RenderTelemetry::OutputUtilization( double seconds )
+{
+    const double s = max( seconds , 1e-3 );
+    for( unsigned i = 0 ; i < g_threadCnt ; ++i ){
+        const ThreadThroughput t = GetThread( i );
+        slog( INFO , PERFORMANCE , stringFormat( "Thread %d : tasks %.1f%% , scheduling %.1f%% , storing tiles %.1f%% , idle %.1f%% of %.2f s." ,
+              i , 100.0 * t.busy / s , 100.0 * t.scheduling / s , 100.0 * t.image / s , 100.0 * t.idle / s , s ) );
+    }
+    const ThreadThroughput total = GetTotal();
+    const double all = s * max( g_threadCnt , 1u );
+    slog( INFO , PERFORMANCE , stringFormat( "Utilization : tasks %.1f%% , scheduling %.1f%% , storing tiles %.1f%% , idle %.1f%% of all threads." ,
+          100.0 * total.busy / all , 100.0 * total.scheduling / all , 100.0 * total.image / all , 100.0 * total.idle / all ) );
+}
+
+// add the throughput of each thread to the report
+void RenderTelemetry::CollectStats( StatsReport& report , double seconds )
+{
+    const double s = max( seconds , 1e-3 );
+    for( unsigned i = 0 ; i < g_threadCnt ; ++i ){
+        const ThreadThroughput t = GetThread( i );
+        report.Append( "threads" )
+            .Add( "id" , i )
+            .Add( "samples" , t.samples )
+            .Add( "rays" , t.rays )
+            .Add( "path_rays" , t.pathRays )
+            .Add( "tasks" , t.tasks )
+            .Add( "background_tasks" , t.backgroundTasks )
+            .Add( "busy_s" , t.busy )
+            .Add( "scheduling_s" , t.scheduling )
+            .Add( "image_s" , t.image )
+            .Add( "idle_s" , t.idle )
+            .Add( "utilization" , min( 1.0 , t.busy / s ) );
+    }
+}
+
+// write the progress and the throughput of all threads
+bool RenderTelemetry::WriteFile( const std::string& filename , float progress , double seconds , double eta )
+{
+    // the file is replaced at once so that readers never see a partial one
+    const std::string tmp = filename + ".tmp";
+    {
+        std::ofstream file( tmp.c_str() , std::ios::trunc );
+        if( !file.is_open() ){
+            slog( WARNING , GENERAL , stringFormat( "Failed to write telemetry %s." , filename.c_str() ) );
+            return false;
+        }
+
+        const double s = max( seconds , 1e-3 );
+        const ThreadThroughput total = GetTotal();
+        const bool prometheus = filename.size() >= 5 && filename.compare( filename.size() - 5 , 5 , ".prom" ) == 0;
+        if( prometheus ){
+            file << "# TYPE sort_progress gauge\nsort_progress " << progress << "\n";
+            file << "# TYPE sort_elapsed_seconds gauge\nsort_elapsed_seconds " << seconds << "\n";
+            file << "# TYPE sort_eta_seconds gauge\nsort_eta_seconds " << eta << "\n";
+            file << "# TYPE sort_samples_per_second gauge\nsort_samples_per_second " << total.samples / s << "\n";
+            file << "# TYPE sort_rays_per_second gauge\nsort_rays_per_second " << total.rays / s << "\n";
+            file << "# TYPE sort_tiles_per_second gauge\nsort_tiles_per_second " << total.tasks / s << "\n";
+            file << "# TYPE sort_thread_samples_total counter\n";
+            for( unsigned i = 0 ; i < g_threadCnt ; ++i )
+                file << "sort_thread_samples_total{thread=\"" << i << "\"} " << GetThread( i ).samples << "\n";
+            file << "# TYPE sort_thread_rays_total counter\n";
+            for( unsigned i = 0 ; i < g_threadCnt ; ++i )
+                file << "sort_thread_rays_total{thread=\"" << i << "\"} " << GetThread( i ).rays << "\n";
+            file << "# TYPE sort_thread_tiles_total counter\n";
+            for( unsigned i = 0 ; i < g_threadCnt ; ++i )
+                file << "sort_thread_tiles_total{thread=\"" << i << "\"} " << GetThread( i ).tasks << "\n";
+        }else{
+            file << "{\n";
+            file << "    \"progress\": " << progress << ",\n";
+            file << "    \"elapsed\": " << seconds << ",\n";
+            file << "    \"eta\": " << eta << ",\n";
+            file << "    \"samples_per_second\": " << total.samples / s << ",\n";
+            file << "    \"rays_per_second\": " << total.rays / s << ",\n";
+            file << "    \"tiles_per_second\": " << total.tasks / s << ",\n";
+            file << "    \"threads\": [\n";
+            for( unsigned i = 0 ; i < g_threadCnt ; ++i ){
+                const ThreadThroughput t = GetThread( i );
+                file << "        { \"samples\": " << t.samples << ", \"rays\": " << t.rays << ", \"tiles\": " << t.tasks << ", \"busy\": " << t.busy << " }" << ( i + 1 < g_threadCnt ? ",\n" : "\n" );
+            }
+            file << "    ]\n";
+            file << "}\n";
+        }
+        if( !file )
+            return false;
+    }
+#if defined(SORT_IN_WINDOWS)
+    // renaming doesn't replace an existing file on windows
+    remove( filename.c_str() );
+#endif
+    return rename( tmp.c_str() , filename.c_str() ) == 0;
+}
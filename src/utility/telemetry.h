@@ -0,0 +1,145 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include "utility/define.h"
+#include <string>
+
+class StatsReport;
+
+//! The rays traced by the current thread, it is only accessed through RenderTelemetry.
+extern Thread_Local unsigned long long g_telemetryRays;
+//! The closest hit rays traced by the current thread, they extend the paths unlike the shadow rays.
+extern Thread_Local unsigned long long g_telemetryPathRays;
+
+//! @brief Throughput of one render thread.
+struct ThreadThroughput
+{
+    unsigned long long  samples = 0;    /**< Number of pixel samples taken. */
+    unsigned long long  rays = 0;       /**< Number of rays traced in the scene. */
+    unsigned long long  pathRays = 0;   /**< Number of the rays extending paths , the rest are shadow rays. */
+    unsigned long long  tasks = 0;      /**< Number of render tasks finished. */
+    unsigned long long  backgroundTasks = 0;    /**< Number of the tasks whose rays can't reach the scene , they only see the environment. */
+    double              busy = 0.0;     /**< Seconds spent on the tasks. */
+    double              scheduling = 0.0;   /**< Seconds spent popping , stealing and finishing tasks. */
+    double              image = 0.0;    /**< Seconds spent storing finished tiles in the image sensor. */
+    double              idle = 0.0;     /**< Seconds waiting after all tasks are taken until the last thread of the pass finishes. */
+};
+
+//! @brief Live throughput of the rendering.
+/**
+ * Rays are counted by each thread in a thread local counter, it is cheap enough to be always on unlike the
+ * traversal statistics. Every finished task adds its samples, rays and time to the counters of its thread,
+ * they are read by any thread publishing the progress while the others keep rendering. The time a task
+ * takes tells the cost of the tasks left, the estimated time of the rendering left is based on it.
+ */
+class RenderTelemetry
+{
+public:
+    //! @brief Count rays traced by the current thread.
+    //! @param cnt  The number of rays.
+    //! It is inlined as every ray traced in the scene is counted.
+    static void CountRays( unsigned cnt ){
+        g_telemetryRays += cnt;
+    }
+
+    //! The number of rays traced by the current thread so far.
+    static unsigned long long LocalRays(){
+        return g_telemetryRays;
+    }
+
+    //! @brief Count closest hit rays traced by the current thread, they are counted by CountRays too.
+    //! @param cnt  The number of rays.
+    static void CountPathRays( unsigned cnt ){
+        g_telemetryPathRays += cnt;
+    }
+
+    //! The number of closest hit rays traced by the current thread so far.
+    static unsigned long long LocalPathRays(){
+        return g_telemetryPathRays;
+    }
+
+    //! @brief Clear the counters before rendering.
+    //! @param thread_cnt   The number of render threads.
+    static void Reset( unsigned thread_cnt );
+
+    //! @brief Add a finished task to the counters of a thread.
+    //! @param tid      The id of the thread.
+    //! @param samples  The number of pixel samples of the task.
+    //! @param rays     The number of rays traced by the task.
+    //! @param path_rays    The number of closest hit rays among them.
+    //! @param seconds  The time the task takes.
+    static void FinishTask( unsigned tid , unsigned long long samples , unsigned long long rays , unsigned long long path_rays , double seconds );
+
+    //! @brief Count a task of a thread whose rays can't reach the scene.
+    //! @param tid      The id of the thread.
+    static void CountBackgroundTask( unsigned tid );
+
+    //! @brief Add the time a thread spends popping , stealing and finishing tasks.
+    //! @param tid      The id of the thread.
+    //! @param seconds  The time.
+    static void AddSchedulingTime( unsigned tid , double seconds );
+
+    //! @brief Add the time a thread spends storing finished tiles in the image sensor.
+    //! @param tid      The id of the thread.
+    //! @param seconds  The time.
+    static void AddImageTime( unsigned tid , double seconds );
+
+    //! @brief Add the time a thread waits for the tasks of the others to be split , there is nothing else to do then.
+    //! @param tid      The id of the thread.
+    //! @param seconds  The time.
+    static void AddIdleTime( unsigned tid , double seconds );
+
+    //! @brief Mark that a thread finds no task left , it is idle until the pass is finished.
+    //! @param tid      The id of the thread.
+    static void ThreadDrained( unsigned tid );
+
+    //! @brief Finish a pass once all threads stopped , the time each thread stopped before the last one is idle.
+    static void FinishPass();
+
+    //! The counters of a thread.
+    static ThreadThroughput GetThread( unsigned tid );
+
+    //! The counters of all threads.
+    static ThreadThroughput GetTotal();
+
+    //! The number of render threads.
+    static unsigned GetThreadCount();
+
+    //! @brief Output the throughput of each thread to the performance log.
+    //! @param seconds  The time of the rendering.
+    static void OutputLog( double seconds );
+
+    //! @brief Output how each thread spends the time of the rendering to the performance log.
+    //! @param seconds  The time of the rendering.
+    static void OutputUtilization( double seconds );
+
+    //! @brief Add the throughput of each thread to the statistics report.
+    //! @param report   The statistics report.
+    //! @param seconds  The time of the rendering.
+    static void CollectStats( StatsReport& report , double seconds );
+
+    //! @brief Write the progress and the throughput of all threads.
+    //! @param filename The name of the file, it is written in the Prometheus text format if it ends with '.prom' or in JSON otherwise.
+    //! @param progress The finished part of the rendering from 0 to 1.
+    //! @param seconds  The time of the rendering so far.
+    //! @param eta      The estimated time of the rendering left in seconds, it is negative if it is unknown.
+    //! @return         False if the file can't be written.
+    static bool WriteFile( const std::string& filename , float progress , double seconds , double eta );
+};
@@ -28,21 +28,12 @@
 #endif
 
 #include <time.h>
+#include <chrono>
 
-// get tick count
+// get tick count , the steady clock never jumps with the wall clock
 unsigned long getTickCount()
 {
-	unsigned long currentTime;
-
-#if defined(SORT_IN_LINUX) || defined(SORT_IN_MAC)
-	struct timeval current;
-	gettimeofday( &current , 0 );
-	currentTime = current.tv_sec * 1000 + current.tv_usec/1000;
-#elif defined(SORT_IN_WINDOWS)
-	currentTime = GetTickCount();
-#endif
-
-	return currentTime;
+	return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
 }
 
 // start timer
@@ -93,6 +84,14 @@ unsigned long Timer::GetTotalElapsedTime() const
 	return m_totalElapsed;
 }
 
+// get the time since the timer is set
+unsigned long Timer::GetRunningTime() const
+{
+	if( m_bTimerSet == false )
+		return 0L;
+	return getTickCount() - m_elapsed;
+}
+
 // reset the timer
 void Timer::ResetTimer()
 {
@@ -34,6 +34,8 @@ public:
 	unsigned long GetElapsedTime() const;
 	// get total elapsed time
 	unsigned long GetTotalElapsedTime() const;
+	// get the time since the timer is set , it could be called while timing
+	unsigned long GetRunningTime() const;
 
 	// reset the timer
 	void ResetTimer();
@@ -0,0 +1,209 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "xmlbinary.h"
+#include "mappedfile.h"
+#include "memoryfile.h"
+#include "log/log.h"
+#include "utility/strhelper.h"
+#include "thirdparty/tinyxml/tinyxml.h"
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <algorithm>
+#include <string.h>
+
+static const char XML_BINARY_MAGIC[4] = { 'S' , 'B' , 'X' , 'M' };
+
+//! @brief Sequential reader over the mapped file, reads past the end fail.
+class XmlBinaryReader
+{
+public:
+    XmlBinaryReader( const char* data , size_t size ) : m_data(data) , m_size(size) {}
+
+    //! Read a 32-bit number.
+    bool Read( unsigned& value ){
+        if( m_size - m_offset < sizeof( value ) )
+            return false;
+        memcpy( &value , m_data + m_offset , sizeof( value ) );
+        m_offset += sizeof( value );
+        return true;
+    }
+
+    //! Read a string of a given length.
+    bool Read( std::string& str , unsigned len ){
+        if( m_size - m_offset < len )
+            return false;
+        str.assign( m_data + m_offset , len );
+        m_offset += len;
+        return true;
+    }
+
+    //! Whether the whole file is consumed.
+    bool IsComplete() const { return m_offset == m_size; }
+
+private:
+    const char* m_data;
+    size_t      m_size;
+    size_t      m_offset = 0;
+};
+
+// decode the element tree
+static bool decode( const char* data , size_t size , TiXmlDocument& doc )
+{
+    XmlBinaryReader reader( data + sizeof( XML_BINARY_MAGIC ) , size - sizeof( XML_BINARY_MAGIC ) );
+    unsigned version = 0 , count = 0;
+    if( !reader.Read( version ) || version != XML_BINARY_VERSION || !reader.Read( count ) )
+        return false;
+
+    // the strings take at least four bytes each, the count is checked before reserving memory for them
+    if( count > size / sizeof( unsigned ) )
+        return false;
+    std::vector<std::string> strings( count );
+    for( auto& str : strings ){
+        unsigned len = 0;
+        if( !reader.Read( len ) || !reader.Read( str , len ) )
+            return false;
+    }
+
+    // the elements are created with an explicit stack so that deep trees don't overflow the call stack
+    struct Open_Element{
+        TiXmlNode*  node;
+        unsigned    children;   // the number of children not decoded yet
+    };
+    std::vector<Open_Element> stack;
+    stack.push_back( { &doc , 1 } );
+    while( !stack.empty() ){
+        Open_Element& parent = stack.back();
+        if( parent.children == 0 ){
+            stack.pop_back();
+            continue;
+        }
+        --parent.children;
+
+        unsigned name = 0 , attr_count = 0 , child_count = 0;
+        if( !reader.Read( name ) || name >= count || !reader.Read( attr_count ) )
+            return false;
+        TiXmlElement* element = new TiXmlElement( strings[name].c_str() );
+        parent.node->LinkEndChild( element );
+        for( unsigned i = 0 ; i < attr_count ; ++i ){
+            unsigned attr = 0 , value = 0;
+            if( !reader.Read( attr ) || attr >= count || !reader.Read( value ) || value >= count )
+                return false;
+            element->SetAttribute( strings[attr].c_str() , strings[value].c_str() );
+        }
+        if( !reader.Read( child_count ) )
+            return false;
+        stack.push_back( { element , child_count } );
+    }
+    return reader.IsComplete();
+}
+
+// load a document
+bool XmlBinary::Load( TiXmlDocument& doc )
+{
+    const std::string filename = doc.Value();
+
+    // documents in memory are only text
+    std::string text;
+    if( MemoryFiles::GetText( filename , text ) ){
+        doc.Clear();
+        doc.ClearError();
+        doc.Parse( text.c_str() );
+        return !doc.Error();
+    }
+
+    MappedFile file;
+    if( !file.Open( filename ) || file.GetSize() < sizeof( XML_BINARY_MAGIC ) || memcmp( file.GetData() , XML_BINARY_MAGIC , sizeof( XML_BINARY_MAGIC ) ) != 0 ){
+        file.Close();
+        return doc.LoadFile();
+    }
+
+    doc.Clear();
+    doc.ClearError();
+    if( !decode( file.GetData() , file.GetSize() , doc ) ){
+        doc.Clear();
+        doc.SetError( TiXmlBase::TIXML_ERROR , 0 , 0 , TIXML_ENCODING_UNKNOWN );
+        slog( WARNING , GENERAL , stringFormat( "Binary file %s is corrupted or of another version." , filename.c_str() ) );
+        return false;
+    }
+    return true;
+}
+
+// store a document in the binary encoding
+bool XmlBinary::Save( const TiXmlDocument& doc , const std::string& filename )
+{
+    const TiXmlElement* root = doc.RootElement();
+    if( root == nullptr )
+        return false;
+
+    // the strings are numbered in the order they first appear
+    std::vector<const char*> strings;
+    std::unordered_map<std::string,unsigned> ids;
+    auto string_id = [&]( const char* str ){
+        auto it = ids.find( str );
+        if( it != ids.end() )
+            return it->second;
+        ids.emplace( str , (unsigned)strings.size() );
+        strings.push_back( str );
+        return (unsigned)strings.size() - 1;
+    };
+
+    std::vector<unsigned> elements;
+    std::vector<const TiXmlElement*> stack( 1 , root );
+    while( !stack.empty() ){
+        const TiXmlElement* element = stack.back();
+        stack.pop_back();
+
+        elements.push_back( string_id( element->Value() ) );
+        const size_t attr_count = elements.size();
+        elements.push_back( 0 );
+        for( const TiXmlAttribute* attr = element->FirstAttribute() ; attr ; attr = attr->Next() ){
+            elements.push_back( string_id( attr->Name() ) );
+            elements.push_back( string_id( attr->Value() ) );
+            ++elements[attr_count];
+        }
+
+        // children are pushed in reverse order so that they are written in document order
+        const size_t child_count = elements.size();
+        elements.push_back( 0 );
+        const size_t first = stack.size();
+        for( const TiXmlElement* child = element->FirstChildElement() ; child ; child = child->NextSiblingElement() ){
+            stack.push_back( child );
+            ++elements[child_count];
+        }
+        std::reverse( stack.begin() + first , stack.end() );
+    }
+
+    std::ofstream file( filename.c_str() , std::ios::binary | std::ios::trunc );
+    if( file.is_open() ){
+        const unsigned header[2] = { XML_BINARY_VERSION , (unsigned)strings.size() };
+        file.write( XML_BINARY_MAGIC , sizeof( XML_BINARY_MAGIC ) );
+        file.write( (const char*)header , sizeof( header ) );
+        for( auto str : strings ){
+            const unsigned len = (unsigned)strlen( str );
+            file.write( (const char*)&len , sizeof( len ) );
+            file.write( str , len );
+        }
+        file.write( (const char*)elements.data() , sizeof( unsigned ) * elements.size() );
+    }
+    if( !file.is_open() || !file ){
+        slog( WARNING , GENERAL , stringFormat( "Failed to write binary file %s." , filename.c_str() ) );
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+ 
+    Copyright (c) 2011-2018 by Cao Jiayin - All rights reserved.
+ 
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+ 
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "sort.h"
+#include <string>
+
+class TiXmlDocument;
+
+static const unsigned XML_BINARY_VERSION = 1;  /**< Version of the binary layout, files of other versions are rejected. */
+
+//! @brief Compact binary encoding of the XML files describing a render.
+/**
+ * Exported scenes with thousands of models, lights and materials spend a noticeable time tokenizing XML. The binary
+ * encoding stores the element tree in pre-order with all names and values in a string table, so it is decoded into
+ * the element tree without parsing any text. The encoding is detected by its magic number, so any file read with
+ * Load, including the render settings, scenes and material libraries, could be either human-editable XML or binary.
+ * Only elements and attributes are kept, text and comments are dropped. All numbers are little-endian 32-bit.
+ *
+ * The layout is the magic 'SBXM', the version, the number of strings, each string as its length and its bytes, then
+ * the root element. An element is the index of its name, the number of attributes, the indexes of the name and the
+ * value of each attribute, the number of children and the children.
+ */
+class XmlBinary
+{
+public:
+    //! @brief Load a document from the file named by the document.
+    //! @param doc      The document, it is in the error state if it can't be loaded just like TiXmlDocument::LoadFile.
+    //! @return         True if the document is loaded.
+    static bool Load( TiXmlDocument& doc );
+
+    //! @brief Store the element tree of a document in the binary encoding.
+    //! @param doc      The document.
+    //! @param filename The name of the output file.
+    //! @return         True if the file is written.
+    static bool Save( const TiXmlDocument& doc , const std::string& filename );
+};